@@ -0,0 +1,133 @@
+;; Blake2b hash function, computed by the hostAccel intrinsic module instead of WebAssembly code.
+;; This runs the same benchmark as blake2b.wast, and prints the same hash:
+;;   wavm-run --enable-host-accel --enable-thread-test blake2b_host.wast
+
+(module
+	(import "env" "_fwrite" (func $__fwrite (param i32 i32 i32 i32) (result i32)))
+	(import "env" "_stdout" (global $stdoutPtr i32))
+	(import "env" "memory" (memory 4096))
+	(import "env" "DYNAMICTOP_PTR" (global $DYNAMICTOP_PTR i32))
+	(import "threadTest" "createThread" (func $threadTest.createThread (param anyfunc i32) (result i64)))
+	(import "hostAccel" "blake2b" (func $hostAccel.blake2b (param i32 i32 i32 i32)))
+	(export "main" (func $main))
+
+	(global $numThreads i32 (i32.const 8))
+	(global $numIterationsPerThread i32 (i32.const 10))
+
+	;; lookup table for converting a nibble to a hexit
+	(global $hexitTable i32 (i32.const 128))
+	(data (i32.const 128) "0123456789abcdef")
+
+	(global $dataAddressAddress i32 (i32.const 144)) ;; 8 bytes
+	(global $dataNumBytes i32 (i32.const 134217728))
+
+	(global $numPendingThreadsAddress i32 (i32.const 152)) ;; 4 bytes
+	(global $outputStringAddress i32 (i32.const 156)) ;; 129 bytes
+
+	(global $digestsArrayAddressAddress i32 (i32.const 1024))	;; 4 bytes
+	(global $digestsArrayStride i32 (i32.const 64))
+
+	(func $sbrk (param $numBytes i32) (result i32)
+		(local $resultAddress i32)
+		(set_local $resultAddress (i32.load (get_global $DYNAMICTOP_PTR)))
+		(i32.store
+			(get_global $DYNAMICTOP_PTR)
+			(i32.add (get_local $resultAddress) (get_local $numBytes))
+			)
+		(get_local $resultAddress)
+		)
+
+	(func $threadEntry
+		(param $threadIndex i32)
+		(result i64)
+
+		(local $i i32)
+
+		;; Hash the test data enough times to dilute all the non-hash components of the timing.
+		(set_local $i (i32.const 0))
+		loop $iterLoop
+			(call $hostAccel.blake2b
+				(i32.load (get_global $dataAddressAddress))
+				(get_global $dataNumBytes)
+				(i32.add
+					(i32.atomic.load (get_global $digestsArrayAddressAddress))
+					(i32.mul (get_local $threadIndex) (get_global $digestsArrayStride)))
+				(i32.const 64))
+			(set_local $i (i32.add (get_local $i) (i32.const 1)))
+			(br_if $iterLoop (i32.lt_u (get_local $i) (get_global $numIterationsPerThread)))
+		end
+
+		(i32.eq (i32.const 1) (i32.atomic.rmw.sub (get_global $numPendingThreadsAddress) (i32.const 1)))
+		if
+			(drop (atomic.wake (get_global $numPendingThreadsAddress) (i32.const 1)))
+		end
+
+		i64.const 0
+	)
+
+	(func $main
+		(result i32)
+		(local $stdout i32)
+		(local $i i32)
+		(local $byte i32)
+
+		;; Allocate the digest array.
+		(i32.atomic.store
+			(get_global $digestsArrayAddressAddress)
+			(call $sbrk (i32.mul (get_global $numThreads) (get_global $digestsArrayStride))))
+
+		;; Initialize the test data.
+		(i32.store (get_global $dataAddressAddress) (call $sbrk (get_global $dataNumBytes)))
+		(set_local $i (i32.const 0))
+		loop $initDataLoop
+			(i32.store (i32.add (i32.load (get_global $dataAddressAddress)) (get_local $i)) (get_local $i))
+			(set_local $i (i32.add (get_local $i) (i32.const 4)))
+			(br_if $initDataLoop (i32.lt_u (get_local $i) (get_global $dataNumBytes)))
+		end
+
+		;; Launch the threads.
+		(i32.atomic.store (get_global $numPendingThreadsAddress) (get_global $numThreads))
+		(set_local $i (i32.const 0))
+		loop $threadLoop
+			(drop (call $threadTest.createThread (ref.func $threadEntry) (get_local $i)))
+			(set_local $i (i32.add (get_local $i) (i32.const 1)))
+			(br_if $threadLoop (i32.lt_u (get_local $i) (get_global $numThreads)))
+		end
+
+		;; Wait for the threads to finish.
+		block $waitLoopEnd
+			loop $waitLoop
+				(set_local $i (i32.atomic.load (get_global $numPendingThreadsAddress)))
+				(br_if $waitLoopEnd (i32.le_s (get_local $i) (i32.const 0)))
+				(drop (i32.atomic.wait (get_global $numPendingThreadsAddress) (get_local $i) (f64.const +inf)))
+				(br $waitLoop)
+			end
+		end
+
+		(i32.eq (i32.atomic.load (get_global $numPendingThreadsAddress)) (i32.const 0))
+		if
+			;; Create a hexadecimal string from the hash.
+			(set_local $i (i32.const 0))
+			loop $loop
+				(set_local $byte (i32.load8_u (i32.add (i32.atomic.load (get_global $digestsArrayAddressAddress)) (get_local $i))))
+				(i32.store8 offset=0
+					(i32.add (get_global $outputStringAddress) (i32.shl (get_local $i) (i32.const 1)))
+					(i32.load8_u (i32.add (get_global $hexitTable) (i32.and (get_local $byte) (i32.const 0x0f)))))
+				(i32.store8 offset=1
+					(i32.add (get_global $outputStringAddress) (i32.shl (get_local $i) (i32.const 1)))
+					(i32.load8_u (i32.add (get_global $hexitTable) (i32.shr_u (get_local $byte) (i32.const 4)))))
+				(set_local $i (i32.add (get_local $i) (i32.const 1)))
+				(br_if $loop (i32.lt_u (get_local $i) (i32.const 64)))
+			end
+			(i32.store8 offset=128 (get_global $outputStringAddress) (i32.const 10))
+
+			;; Print the string to the output.
+			(set_local $stdout (i32.load align=4 (get_global $stdoutPtr)))
+			(return (call $__fwrite (get_global $outputStringAddress) (i32.const 1) (i32.const 129) (get_local $stdout)))
+		end
+
+		(return (i32.const 1))
+	)
+
+	(func (export "establishStackSpace") (param i32 i32) (nop))
+)
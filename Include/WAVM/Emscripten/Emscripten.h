@@ -10,6 +10,8 @@ namespace WAVM { namespace IR {
 }}
 
 namespace WAVM { namespace Emscripten {
+	struct StdioStreams;
+
 	struct Instance
 	{
 		Runtime::GCPointer<Runtime::ModuleInstance> env;
@@ -17,6 +19,11 @@ namespace WAVM { namespace Emscripten {
 		Runtime::GCPointer<Runtime::ModuleInstance> global;
 
 		Runtime::GCPointer<Runtime::MemoryInstance> emscriptenMemory;
+
+		StdioStreams* stdioStreams = nullptr;
+
+		// Flushes the instance's buffered output.
+		EMSCRIPTEN_API ~Instance();
 	};
 
 	EMSCRIPTEN_API Instance* instantiate(Runtime::Compartment* compartment,
@@ -27,4 +34,15 @@ namespace WAVM { namespace Emscripten {
 	EMSCRIPTEN_API void injectCommandArgs(Emscripten::Instance* instance,
 										  const std::vector<const char*>& argStrings,
 										  std::vector<IR::Value>& outInvokeArgs);
+
+	// Sets the number of bytes buffered between the instance and each of the host's standard
+	// streams. The instance's output is written to the host when a buffer is full, when the
+	// program flushes the stream or calls exit, when flushStdio is called, and when the instance is
+	// destroyed. Its reads from stdin are served from a buffer that is refilled with as many bytes
+	// as are available, so the host shouldn't also read from stdin. The default of 0 forwards
+	// each access to the host's stream.
+	EMSCRIPTEN_API void setStdioBufferSize(Instance* instance, Uptr numBytes);
+
+	// Writes the instance's buffered output to the host's standard streams.
+	EMSCRIPTEN_API void flushStdio(Instance* instance);
 }}
@@ -0,0 +1,28 @@
+#pragma once
+
+namespace WAVM { namespace Runtime {
+	struct Compartment;
+	struct MemoryInstance;
+	struct ModuleInstance;
+}}
+
+namespace WAVM { namespace HostAccel {
+	// Instantiates the hostAccel intrinsic module in a compartment. Its functions hash, checksum,
+	// and compress ranges of guest memory with native code:
+	//   blake2b(i32 address, i32 numBytes, i32 digestAddress, i32 numDigestBytes) -> ()
+	//   sha256(i32 address, i32 numBytes, i32 digestAddress) -> ()
+	//   crc32c(i32 crc, i32 address, i32 numBytes) -> i32
+	//   lz4_compress(i32 address, i32 numBytes, i32 outAddress, i32 outNumBytes) -> i32
+	//   lz4_decompress(i32 address, i32 numBytes, i32 outAddress, i32 outNumBytes) -> i32
+	// The input ranges are read in place after validating that they are inside the memory. The
+	// LZ4 functions return the number of bytes written to the output range, or -1 if the output
+	// doesn't fit in it or the input isn't valid compressed data.
+	HOSTACCEL_API Runtime::ModuleInstance* instantiate(Runtime::Compartment* compartment);
+
+	// Sets the memory that the hostAccel functions called from a compartment access. This is
+	// usually the memory of the module instance that imports the functions, so it must be set
+	// after instantiating that module. The memory is kept alive until it is replaced, so set it to
+	// nullptr before collecting the compartment.
+	HOSTACCEL_API void setMemory(Runtime::Compartment* compartment,
+								 Runtime::MemoryInstance* memory);
+}}
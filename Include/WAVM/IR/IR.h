@@ -6,6 +6,7 @@ namespace WAVM { namespace IR {
 	enum : U64
 	{
 		maxMemoryPages = 65536,
+		maxMemory64Pages = U64(1) << 48,
 		maxTableElems = U64(UINT32_MAX) + 1
 	};
 	enum : Uptr
@@ -32,6 +33,8 @@ namespace WAVM { namespace IR {
 		bool multipleResultsAndBlockParams = true;
 		bool bulkMemoryOperations = true;
 		bool referenceTypes = true;
+		bool memory64 = true;
+		bool multipleMemories = true;
 
 		// WAVM-specific extensions
 		bool sharedTables = true;
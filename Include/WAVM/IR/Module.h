@@ -11,6 +11,7 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/SharedBytes.h"
 
 namespace WAVM { namespace IR {
 	enum class Opcode : U16;
@@ -82,12 +83,13 @@ namespace WAVM { namespace IR {
 		}
 	};
 
-	// A function definition
+	// A function definition. The code of the function definitions loaded from a binary module is
+	// stored in a single allocation that is shared by the module's function definitions.
 	struct FunctionDef
 	{
 		IndexedFunctionType type;
 		std::vector<ValueType> nonParameterLocalTypes;
-		std::vector<U8> code;
+		SharedBytes code;
 		std::vector<std::vector<Uptr>> branchTables;
 	};
 
@@ -145,7 +147,7 @@ namespace WAVM { namespace IR {
 		bool isActive;
 		Uptr memoryIndex;
 		InitializerExpression baseOffset;
-		std::vector<U8> data;
+		SharedBytes data;
 	};
 
 	// A table segment: a literal sequence of function indices that is copied into a Runtime::Table
@@ -158,11 +160,12 @@ namespace WAVM { namespace IR {
 		std::vector<Uptr> indices;
 	};
 
-	// A user-defined module section as an array of bytes
+	// A user-defined module section as an array of bytes. The bytes of user sections and data
+	// segments may be views of the binary the module was loaded from, which they keep alive.
 	struct UserSection
 	{
 		std::string name;
-		std::vector<U8> data;
+		SharedBytes data;
 	};
 
 	// An index-space for imports and definitions of a specific kind.
@@ -77,10 +77,15 @@ namespace WAVM { namespace IR {
 		template<Uptr naturalAlignmentLog2>
 		std::string describeImm(LoadOrStoreImm<naturalAlignmentLog2> imm)
 		{
-			return " offset=" + std::to_string(imm.offset)
+			return " " + std::to_string(imm.memoryIndex) + " offset=" + std::to_string(imm.offset)
 				   + " align=" + std::to_string(1 << imm.alignmentLog2);
 		}
 		std::string describeImm(MemoryImm imm) { return " " + std::to_string(imm.memoryIndex); }
+		std::string describeImm(MemoryCopyImm imm)
+		{
+			return " " + std::to_string(imm.destMemoryIndex) + " "
+				   + std::to_string(imm.sourceMemoryIndex);
+		}
 		std::string describeImm(TableImm imm) { return " " + std::to_string(imm.tableIndex); }
 
 		template<Uptr numLanes> std::string describeImm(LaneIndexImm<numLanes> imm)
@@ -107,7 +112,7 @@ namespace WAVM { namespace IR {
 		template<Uptr naturalAlignmentLog2>
 		std::string describeImm(AtomicLoadOrStoreImm<naturalAlignmentLog2> imm)
 		{
-			return " offset=" + std::to_string(imm.offset)
+			return " " + std::to_string(imm.memoryIndex) + " offset=" + std::to_string(imm.offset)
 				   + " align=" + std::to_string(1 << imm.alignmentLog2);
 		}
 		std::string describeImm(ExceptionTypeImm) { return ""; }
@@ -502,7 +502,7 @@
 	/* Bulk memory operators */ \
 	visitOp(0xfc08,memory_init,"memory.init",DataSegmentAndMemImm,BULKCOPY,bulkMemoryOperations) \
 	visitOp(0xfc09,memory_drop,"memory.drop",DataSegmentImm,NONE,bulkMemoryOperations) \
-	visitOp(0xfc0a,memory_copy,"memory.copy",MemoryImm,BULKCOPY,bulkMemoryOperations) \
+	visitOp(0xfc0a,memory_copy,"memory.copy",MemoryCopyImm,BULKCOPY,bulkMemoryOperations) \
 	visitOp(0xfc0b,memory_fill,"memory.fill",MemoryImm,BULKCOPY,bulkMemoryOperations) \
 	visitOp(0xfc0c,table_init,"table.init",ElemSegmentAndTableImm,BULKCOPY,bulkMemoryOperations) \
 	visitOp(0xfc0d,table_drop,"table.drop",ElemSegmentImm,NONE,bulkMemoryOperations) \
@@ -8,6 +8,7 @@
 #include "WAVM/IR/Types.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Serialization.h"
 #include "WAVM/Platform/Defines.h"
 
@@ -23,6 +24,11 @@ namespace WAVM { namespace IR {
 	{
 		Uptr memoryIndex;
 	};
+	struct MemoryCopyImm
+	{
+		Uptr destMemoryIndex;
+		Uptr sourceMemoryIndex;
+	};
 	struct TableImm
 	{
 		Uptr tableIndex;
@@ -70,7 +76,8 @@ namespace WAVM { namespace IR {
 	template<Uptr naturalAlignmentLog2> struct LoadOrStoreImm
 	{
 		U8 alignmentLog2;
-		U32 offset;
+		U64 offset;
+		Uptr memoryIndex;
 	};
 
 	template<Uptr numLanes> struct LaneIndexImm
@@ -86,7 +93,8 @@ namespace WAVM { namespace IR {
 	template<Uptr naturalAlignmentLog2> struct AtomicLoadOrStoreImm
 	{
 		U8 alignmentLog2;
-		U32 offset;
+		U64 offset;
+		Uptr memoryIndex;
 	};
 
 	struct ExceptionTypeImm
@@ -130,53 +138,447 @@ namespace WAVM { namespace IR {
 		= 0xdf,
 	};
 
-	PACKED_STRUCT(template<typename Imm> struct OpcodeAndImm {
-		Opcode opcode;
-		Imm imm;
-	});
+	// The code of a FunctionDef is a sequence of operators in a compact internal encoding: an
+	// opcode, encoded like the WebAssembly binary format as one byte or a prefix byte followed by
+	// one byte, followed by its immediates. Integer immediates are encoded as LEB128
+	// variable-length integers, with signed integers zigzag encoded, and the other immediates are
+	// encoded as their raw bytes. The code is only produced by OperatorEncoderStream, so it isn't
+	// validated when it is decoded.
+
+	inline void encodeOpcode(Serialization::OutputStream& stream, Opcode opcode)
+	{
+		if(opcode <= Opcode::maxSingleByteOpcode) { *stream.advance(1) = U8(opcode); }
+		else
+		{
+			U8* bytes = stream.advance(2);
+			bytes[0] = U8(U16(opcode) >> 8);
+			bytes[1] = U8(opcode);
+		}
+	}
+
+	inline Opcode decodeOpcode(const U8*& nextByte)
+	{
+		const U8 firstByte = *nextByte++;
+		if(firstByte <= U8(Opcode::maxSingleByteOpcode)) { return Opcode(firstByte); }
+		return Opcode(U16(firstByte) << 8 | *nextByte++);
+	}
+
+	inline void encodeVarUInt(Serialization::OutputStream& stream, U64 value)
+	{
+		if(value < 0x80) { *stream.advance(1) = U8(value); }
+		else
+		{
+			U8 bytes[10];
+			Uptr numBytes = 0;
+			while(value >= 0x80)
+			{
+				bytes[numBytes++] = U8(value) | 0x80;
+				value >>= 7;
+			};
+			bytes[numBytes++] = U8(value);
+			memcpy(stream.advance(numBytes), bytes, numBytes);
+		}
+	}
+
+	inline U64 decodeVarUInt(const U8*& nextByte)
+	{
+		// Most integer immediates are small enough to be encoded in a single byte.
+		U64 value = *nextByte++;
+		if(value >= 0x80)
+		{
+			value &= 0x7f;
+			U64 shift = 7;
+			while(true)
+			{
+				const U8 byte = *nextByte++;
+				value |= U64(byte & 0x7f) << shift;
+				if(!(byte & 0x80)) { break; }
+				shift += 7;
+			};
+		}
+		return value;
+	}
+
+	inline void encodeVarSInt(Serialization::OutputStream& stream, I64 value)
+	{
+		encodeVarUInt(stream, (U64(value) << 1) ^ U64(value >> 63));
+	}
+
+	inline I64 decodeVarSInt(const U8*& nextByte)
+	{
+		const U64 zigzag = decodeVarUInt(nextByte);
+		return I64(zigzag >> 1) ^ -I64(zigzag & 1);
+	}
+
+	template<typename Value>
+	void encodeRawImm(Serialization::OutputStream& stream, const Value& value)
+	{
+		memcpy(stream.advance(sizeof(Value)), &value, sizeof(Value));
+	}
+
+	template<typename Value> inline void decodeRawImm(const U8*& nextByte, Value& outValue)
+	{
+		memcpy(&outValue, nextByte, sizeof(Value));
+		nextByte += sizeof(Value);
+	}
+
+	// Encoding and decoding for each type of immediate.
+
+	inline void encodeImm(Serialization::OutputStream&, NoImm) {}
+	inline void decodeImm(const U8*&, NoImm&) {}
+
+	inline void encodeImm(Serialization::OutputStream& stream, MemoryImm imm)
+	{
+		encodeVarUInt(stream, imm.memoryIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, MemoryImm& imm)
+	{
+		imm.memoryIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, MemoryCopyImm imm)
+	{
+		encodeVarUInt(stream, imm.destMemoryIndex);
+		encodeVarUInt(stream, imm.sourceMemoryIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, MemoryCopyImm& imm)
+	{
+		imm.destMemoryIndex = Uptr(decodeVarUInt(nextByte));
+		imm.sourceMemoryIndex = Uptr(decodeVarUInt(nextByte));
+	}
 
-	// Specialize for the empty immediate struct so they don't take an extra byte of space.
-	template<> struct OpcodeAndImm<NoImm>
+	inline void encodeImm(Serialization::OutputStream& stream, TableImm imm)
+	{
+		encodeVarUInt(stream, imm.tableIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, TableImm& imm)
 	{
-		union
+		imm.tableIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	// Block types are encoded as a single integer, with the format in the low two bits.
+	inline void encodeImm(Serialization::OutputStream& stream, ControlStructureImm imm)
+	{
+		switch(imm.type.format)
 		{
-			Opcode opcode;
-			NoImm imm;
+		case IndexedBlockType::noParametersOrResult:
+			encodeVarUInt(stream, IndexedBlockType::noParametersOrResult);
+			break;
+		case IndexedBlockType::oneResult:
+			encodeVarUInt(stream, U64(imm.type.resultType) << 2 | IndexedBlockType::oneResult);
+			break;
+		case IndexedBlockType::functionType:
+			encodeVarUInt(stream, U64(imm.type.index) << 2 | IndexedBlockType::functionType);
+			break;
+		default: Errors::unreachable();
 		};
-	};
+	}
+	inline void decodeImm(const U8*& nextByte, ControlStructureImm& imm)
+	{
+		const U64 encodedType = decodeVarUInt(nextByte);
+		imm.type.format = IndexedBlockType::Format(encodedType & 3);
+		if(imm.type.format == IndexedBlockType::oneResult)
+		{ imm.type.resultType = ValueType(encodedType >> 2); }
+		else
+		{
+			imm.type.index = Uptr(encodedType >> 2);
+		}
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, BranchImm imm)
+	{
+		encodeVarUInt(stream, imm.targetDepth);
+	}
+	inline void decodeImm(const U8*& nextByte, BranchImm& imm)
+	{
+		imm.targetDepth = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, BranchTableImm imm)
+	{
+		encodeVarUInt(stream, imm.defaultTargetDepth);
+		encodeVarUInt(stream, imm.branchTableIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, BranchTableImm& imm)
+	{
+		imm.defaultTargetDepth = Uptr(decodeVarUInt(nextByte));
+		imm.branchTableIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, LiteralImm<I32> imm)
+	{
+		encodeVarSInt(stream, imm.value);
+	}
+	inline void decodeImm(const U8*& nextByte, LiteralImm<I32>& imm)
+	{
+		imm.value = I32(decodeVarSInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, LiteralImm<I64> imm)
+	{
+		encodeVarSInt(stream, imm.value);
+	}
+	inline void decodeImm(const U8*& nextByte, LiteralImm<I64>& imm)
+	{
+		imm.value = decodeVarSInt(nextByte);
+	}
+
+	// Float and V128 literals are encoded as their raw bytes.
+	template<typename Value>
+	void encodeImm(Serialization::OutputStream& stream, const LiteralImm<Value>& imm)
+	{
+		encodeRawImm(stream, imm.value);
+	}
+	template<typename Value> inline void decodeImm(const U8*& nextByte, LiteralImm<Value>& imm)
+	{
+		decodeRawImm(nextByte, imm.value);
+	}
+
+	template<bool isGlobal>
+	void encodeImm(Serialization::OutputStream& stream, GetOrSetVariableImm<isGlobal> imm)
+	{
+		encodeVarUInt(stream, imm.variableIndex);
+	}
+	template<bool isGlobal>
+	inline void decodeImm(const U8*& nextByte, GetOrSetVariableImm<isGlobal>& imm)
+	{
+		imm.variableIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, FunctionImm imm)
+	{
+		encodeVarUInt(stream, imm.functionIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, FunctionImm& imm)
+	{
+		imm.functionIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, CallIndirectImm imm)
+	{
+		encodeVarUInt(stream, imm.type.index);
+		encodeVarUInt(stream, imm.tableIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, CallIndirectImm& imm)
+	{
+		imm.type.index = Uptr(decodeVarUInt(nextByte));
+		imm.tableIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	template<Uptr naturalAlignmentLog2>
+	void encodeImm(Serialization::OutputStream& stream, LoadOrStoreImm<naturalAlignmentLog2> imm)
+	{
+		*stream.advance(1) = imm.alignmentLog2;
+		encodeVarUInt(stream, imm.offset);
+		encodeVarUInt(stream, imm.memoryIndex);
+	}
+	template<Uptr naturalAlignmentLog2>
+	inline void decodeImm(const U8*& nextByte, LoadOrStoreImm<naturalAlignmentLog2>& imm)
+	{
+		imm.alignmentLog2 = *nextByte++;
+		imm.offset = U64(decodeVarUInt(nextByte));
+		imm.memoryIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	template<Uptr numLanes>
+	void encodeImm(Serialization::OutputStream& stream, LaneIndexImm<numLanes> imm)
+	{
+		*stream.advance(1) = imm.laneIndex;
+	}
+	template<Uptr numLanes> inline void decodeImm(const U8*& nextByte, LaneIndexImm<numLanes>& imm)
+	{
+		imm.laneIndex = *nextByte++;
+	}
+
+	template<Uptr numLanes>
+	void encodeImm(Serialization::OutputStream& stream, const ShuffleImm<numLanes>& imm)
+	{
+		encodeRawImm(stream, imm.laneIndices);
+	}
+	template<Uptr numLanes> inline void decodeImm(const U8*& nextByte, ShuffleImm<numLanes>& imm)
+	{
+		decodeRawImm(nextByte, imm.laneIndices);
+	}
+
+	template<Uptr naturalAlignmentLog2>
+	void encodeImm(Serialization::OutputStream& stream,
+				   AtomicLoadOrStoreImm<naturalAlignmentLog2> imm)
+	{
+		*stream.advance(1) = imm.alignmentLog2;
+		encodeVarUInt(stream, imm.offset);
+		encodeVarUInt(stream, imm.memoryIndex);
+	}
+	template<Uptr naturalAlignmentLog2>
+	inline void decodeImm(const U8*& nextByte,
+							   AtomicLoadOrStoreImm<naturalAlignmentLog2>& imm)
+	{
+		imm.alignmentLog2 = *nextByte++;
+		imm.offset = U64(decodeVarUInt(nextByte));
+		imm.memoryIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, ExceptionTypeImm imm)
+	{
+		encodeVarUInt(stream, imm.exceptionTypeIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, ExceptionTypeImm& imm)
+	{
+		imm.exceptionTypeIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, RethrowImm imm)
+	{
+		encodeVarUInt(stream, imm.catchDepth);
+	}
+	inline void decodeImm(const U8*& nextByte, RethrowImm& imm)
+	{
+		imm.catchDepth = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, DataSegmentAndMemImm imm)
+	{
+		encodeVarUInt(stream, imm.dataSegmentIndex);
+		encodeVarUInt(stream, imm.memoryIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, DataSegmentAndMemImm& imm)
+	{
+		imm.dataSegmentIndex = Uptr(decodeVarUInt(nextByte));
+		imm.memoryIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, DataSegmentImm imm)
+	{
+		encodeVarUInt(stream, imm.dataSegmentIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, DataSegmentImm& imm)
+	{
+		imm.dataSegmentIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, ElemSegmentAndTableImm imm)
+	{
+		encodeVarUInt(stream, imm.elemSegmentIndex);
+		encodeVarUInt(stream, imm.tableIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, ElemSegmentAndTableImm& imm)
+	{
+		imm.elemSegmentIndex = Uptr(decodeVarUInt(nextByte));
+		imm.tableIndex = Uptr(decodeVarUInt(nextByte));
+	}
+
+	inline void encodeImm(Serialization::OutputStream& stream, ElemSegmentImm imm)
+	{
+		encodeVarUInt(stream, imm.elemSegmentIndex);
+	}
+	inline void decodeImm(const U8*& nextByte, ElemSegmentImm& imm)
+	{
+		imm.elemSegmentIndex = Uptr(decodeVarUInt(nextByte));
+	}
 
 	// Decodes an operator from an input stream and dispatches by opcode.
+	// Maps each byte that may start an encoded operator to one more than the index in
+	// ENUM_OPERATORS of the single-byte opcode it encodes, or to zero if it isn't a single-byte
+	// opcode: the prefix bytes of the multi-byte opcodes map to zero.
+	struct SingleByteOpcodeIndices
+	{
+		U16 indices[256];
+
+		SingleByteOpcodeIndices() : indices()
+		{
+			U16 operatorIndex = 0;
+#define VISIT_OPCODE(encoding, name, ...)                                                          \
+	++operatorIndex;                                                                               \
+	if(encoding <= Uptr(Opcode::maxSingleByteOpcode)) { indices[encoding] = operatorIndex; }
+			ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+		}
+	};
+
+	inline const SingleByteOpcodeIndices& getSingleByteOpcodeIndices()
+	{
+		static const SingleByteOpcodeIndices singleByteOpcodeIndices;
+		return singleByteOpcodeIndices;
+	}
+
 	struct OperatorDecoderStream
 	{
 		OperatorDecoderStream(const std::vector<U8>& codeBytes)
 		: nextByte(codeBytes.data()), end(codeBytes.data() + codeBytes.size())
 		{
 		}
+		OperatorDecoderStream(const SharedBytes& codeBytes)
+		: nextByte(codeBytes.data()), end(codeBytes.data() + codeBytes.size())
+		{
+		}
 
 		operator bool() const { return nextByte < end; }
 
 		template<typename Visitor> typename Visitor::Result decodeOp(Visitor& visitor)
 		{
-			wavmAssert(nextByte + sizeof(Opcode) <= end);
-			Opcode opcode;
-			memcpy(&opcode, nextByte, sizeof(Opcode));
+			wavmAssert(nextByte < end);
+			const Opcode opcode = decodeOpcode(nextByte);
 			switch(opcode)
 			{
 #define VISIT_OPCODE(opcode, name, nameString, Imm, ...)                                           \
 	case Opcode::name:                                                                             \
 	{                                                                                              \
-		wavmAssert(nextByte + sizeof(OpcodeAndImm<Imm>) <= end);                                   \
-		OpcodeAndImm<Imm> encodedOperator;                                                         \
-		memcpy(&encodedOperator, nextByte, sizeof(OpcodeAndImm<Imm>));                             \
-		nextByte += sizeof(OpcodeAndImm<Imm>);                                                     \
-		return visitor.name(encodedOperator.imm);                                                  \
+		Imm imm;                                                                                   \
+		decodeImm(nextByte, imm);                                                                  \
+		wavmAssert(nextByte <= end);                                                               \
+		return visitor.name(imm);                                                                  \
 	}
 				ENUM_OPERATORS(VISIT_OPCODE)
 #undef VISIT_OPCODE
-			default: nextByte += sizeof(Opcode); return visitor.unknown(opcode);
+			default: return visitor.unknown(opcode);
 			}
 		}
 
+		// Decodes all the remaining operators, passing each to the visitor. The visitor's results
+		// are discarded. Where the compiler supports it, each operator's visitor call is followed
+		// by an indirect branch straight to the code that decodes the next operator, so the
+		// branch predictor can use the previous operator to predict the next. The operators with
+		// multi-byte opcodes are decoded by decodeOp.
+		template<typename Visitor> void decodeAll(Visitor& visitor)
+		{
+#if HAS_COMPUTED_GOTO
+			static void* const labels[] = {
+				&&decodeMultiByteOp,
+#define VISIT_OPCODE(encoding, name, ...)                                                          \
+	encoding <= Uptr(Opcode::maxSingleByteOpcode) ? &&decode_##name : &&decodeMultiByteOp,
+				ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+			};
+			const U16* opcodeIndices = getSingleByteOpcodeIndices().indices;
+
+#define DISPATCH_NEXT_OP()                                                                         \
+	if(nextByte >= end) { return; }                                                                 \
+	goto* labels[opcodeIndices[*nextByte]];
+
+			DISPATCH_NEXT_OP();
+
+#define VISIT_OPCODE(encoding, name, nameString, Imm, ...)                                         \
+	decode_##name : if(encoding <= Uptr(Opcode::maxSingleByteOpcode))                              \
+	{                                                                                              \
+		++nextByte;                                                                                \
+		Imm imm;                                                                                   \
+		decodeImm(nextByte, imm);                                                                  \
+		wavmAssert(nextByte <= end);                                                               \
+		visitor.name(imm);                                                                         \
+		DISPATCH_NEXT_OP();                                                                        \
+	}
+			ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+
+		decodeMultiByteOp:
+			decodeOp(visitor);
+			DISPATCH_NEXT_OP();
+
+#undef DISPATCH_NEXT_OP
+#else
+			while(nextByte < end) { decodeOp(visitor); }
+#endif
+		}
+
 		template<typename Visitor> typename Visitor::Result decodeOpWithoutConsume(Visitor& visitor)
 		{
 			const U8* savedNextByte = nextByte;
@@ -200,12 +602,8 @@ namespace WAVM { namespace IR {
 #define VISIT_OPCODE(_, name, nameString, Imm, ...)                                                \
 	void name(Imm imm = {})                                                                        \
 	{                                                                                              \
-		OpcodeAndImm<Imm> encodedOperator;                                                         \
-		encodedOperator.opcode = Opcode::name;                                                     \
-		encodedOperator.imm = imm;                                                                 \
-		memcpy((OpcodeAndImm<Imm>*)byteStream.advance(sizeof(OpcodeAndImm<Imm>)),                  \
-			   &encodedOperator,                                                                   \
-			   sizeof(OpcodeAndImm<Imm>));                                                         \
+		encodeOpcode(byteStream, Opcode::name);                                                    \
+		encodeImm(byteStream, imm);                                                                \
 	}
 		ENUM_OPERATORS(VISIT_OPCODE)
 #undef VISIT_OPCODE
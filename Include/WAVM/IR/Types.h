@@ -417,35 +417,54 @@ namespace WAVM { namespace IR {
 		return asString(tableType.size) + (tableType.isShared ? " shared anyfunc" : " anyfunc");
 	}
 
+	// The type of the addresses that are used to access a memory.
+	enum class IndexType : U8
+	{
+		i32,
+		i64
+	};
+
+	inline ValueType asValueType(IndexType indexType)
+	{
+		return indexType == IndexType::i64 ? ValueType::i64 : ValueType::i32;
+	}
+
 	// The type of a memory
 	struct MemoryType
 	{
 		bool isShared;
+		IndexType indexType;
 		SizeConstraints size;
 
-		MemoryType() : isShared(false), size({0, UINT64_MAX}) {}
-		MemoryType(bool inIsShared, const SizeConstraints& inSize)
-		: isShared(inIsShared), size(inSize)
+		MemoryType() : isShared(false), indexType(IndexType::i32), size({0, UINT64_MAX}) {}
+		MemoryType(bool inIsShared,
+				   const SizeConstraints& inSize,
+				   IndexType inIndexType = IndexType::i32)
+		: isShared(inIsShared), indexType(inIndexType), size(inSize)
 		{
 		}
 
 		friend bool operator==(const MemoryType& left, const MemoryType& right)
 		{
-			return left.isShared == right.isShared && left.size == right.size;
+			return left.isShared == right.isShared && left.indexType == right.indexType
+				   && left.size == right.size;
 		}
 		friend bool operator!=(const MemoryType& left, const MemoryType& right)
 		{
-			return left.isShared != right.isShared || left.size != right.size;
+			return left.isShared != right.isShared || left.indexType != right.indexType
+				   || left.size != right.size;
 		}
 		friend bool isSubtype(const MemoryType& sub, const MemoryType& super)
 		{
-			return super.isShared == sub.isShared && isSubset(super.size, sub.size);
+			return super.isShared == sub.isShared && super.indexType == sub.indexType
+				   && isSubset(super.size, sub.size);
 		}
 	};
 
 	inline std::string asString(const MemoryType& memoryType)
 	{
-		return asString(memoryType.size) + (memoryType.isShared ? " shared" : "");
+		return (memoryType.indexType == IndexType::i64 ? "i64 " : "") + asString(memoryType.size)
+			   + (memoryType.isShared ? " shared" : "");
 	}
 
 	// The type of a global
@@ -69,6 +69,16 @@ namespace WAVM { namespace IR {
 	IR_API void validateElemSegments(const IR::Module& module);
 	IR_API void validateDataSegments(const IR::Module& module);
 
+	// Validates the code of a function definition.
+	IR_API void validateFunctionDef(const IR::Module& module, const IR::FunctionDef& functionDef);
+
+	// Validates the code of all a module's function definitions. If numThreads is greater than
+	// one, the function definitions are validated in parallel on that many threads; if it is zero,
+	// one thread is used for each hardware thread. If more than one function definition is
+	// invalid, the exception for the one with the lowest index is thrown regardless of the number
+	// of threads.
+	IR_API void validateFunctionDefs(const IR::Module& module, Uptr numThreads = 1);
+
 	inline void validateDefinitions(const IR::Module& module)
 	{
 		validateTypes(module);
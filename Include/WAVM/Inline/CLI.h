@@ -1,9 +1,11 @@
 #pragma once
 
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/SharedBytes.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/File.h"
 
+#include <memory>
 #include <vector>
 
 namespace WAVM {
@@ -37,6 +39,38 @@ namespace WAVM {
 		return true;
 	}
 
+	// Maps a file read-only into memory, falling back to reading it into memory if it can't be
+	// mapped. The mapping is kept alive by the resulting SharedBytes and any views of it, such as
+	// the data segments and user sections of a WASM module loaded from it.
+	inline bool loadMappedFile(const char* filename, SharedBytes& outFileContents)
+	{
+		Platform::File* file = Platform::openFile(
+			filename, Platform::FileAccessMode::readOnly, Platform::FileCreateMode::openExisting);
+		if(!file)
+		{
+			Log::printf(Log::error, "Couldn't read %s: couldn't open file.\n", filename);
+			return false;
+		}
+
+		Uptr numFileBytes = 0;
+		const U8* mappedBytes = Platform::mapFile(file, numFileBytes);
+		errorUnless(Platform::closeFile(file));
+
+		if(!mappedBytes)
+		{
+			std::vector<U8> fileContents;
+			if(!loadFile(filename, fileContents)) { return false; }
+			outFileContents = std::move(fileContents);
+			return true;
+		}
+
+		std::shared_ptr<const U8> mapping(mappedBytes, [numFileBytes](const U8* baseAddress) {
+			Platform::unmapFile(baseAddress, numFileBytes);
+		});
+		outFileContents = SharedBytes(mappedBytes, numFileBytes, std::move(mapping));
+		return true;
+	}
+
 	inline bool saveFile(const char* filename, const void* fileBytes, Uptr numFileBytes)
 	{
 		Platform::File* file = Platform::openFile(
@@ -1,95 +1,431 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Hash.h"
-#include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/Mutex.h"
 
 namespace WAVM {
+	// A hash map that may be used concurrently by multiple threads, split into stripes by the
+	// key's hash.
+	//
+	//   Reads don't lock: each stripe is an open-addressed table of pointers to immutable nodes,
+	// and a reader just follows the pointers. Writers lock the stripe's mutex, and publish a new
+	// node (or a new table when the stripe is resized) with an atomic store. Replaced nodes and
+	// tables are retired, and freed once the readers that might have seen them have finished.
+	//
+	//   Each stripe has a reader epoch, and counts its readers separately for odd and even epochs.
+	// A writer flips the epoch to move the objects retired so far to a draining list, which only
+	// waits for the readers that counted themselves under the previous epoch: new readers count
+	// themselves under the new epoch, so the draining objects are freed by the next write after
+	// the readers that were already running finish, even if the stripe always has a reader. If
+	// too many objects are retired while waiting for them, the writer waits for those readers.
+	//
+	//   Values are returned by copy, since a value in the map may be replaced and freed as soon as
+	// the read that found it ends.
 	template<typename Key,
 			 typename Value,
 			 typename KeyHashPolicy = DefaultHashPolicy<Key>,
 			 Uptr numStripes = 64>
 	struct ConcurrentHashMap
 	{
+		ConcurrentHashMap() = default;
+		~ConcurrentHashMap()
+		{
+			for(Stripe& stripe : stripes)
+			{
+				Table* table = stripe.table.load(std::memory_order_relaxed);
+				if(table)
+				{
+					for(Uptr bucketIndex = 0; bucketIndex <= table->hashToBucketIndexMask;
+						++bucketIndex)
+					{
+						Node* node = table->buckets[bucketIndex].load(std::memory_order_relaxed);
+						if(node && node != getTombstone()) { delete node; }
+					}
+					deleteTable(table);
+				}
+				freeRetired(stripe);
+				freeDraining(stripe);
+			}
+		}
+
+		// Don't allow copying or moving a ConcurrentHashMap.
+		ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+		ConcurrentHashMap(ConcurrentHashMap&&) = delete;
+		void operator=(const ConcurrentHashMap&) = delete;
+		void operator=(ConcurrentHashMap&&) = delete;
+
 		template<typename... ValueArgs> Value getOrAdd(const Key& key, ValueArgs&&... valueArgs)
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
+
+			// Try to find the key without locking the stripe first.
+			{
+				ReadGuard readGuard(stripe);
+				const Node* node = find(stripe, hash, key);
+				if(node) { return node->value; }
+			}
+
 			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			return stripe.map.getOrAdd(key, std::forward<ValueArgs>(valueArgs)...);
+			Uptr bucketIndex;
+			const Node* node = findForWrite(stripe, hash, key, bucketIndex);
+			if(node) { return node->value; }
+			return insert(stripe, bucketIndex, hash, key, std::forward<ValueArgs>(valueArgs)...)
+				->value;
 		}
 
 		template<typename... ValueArgs> bool add(const Key& key, ValueArgs&&... valueArgs)
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
 			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			return stripe.map.add(key, std::forward<ValueArgs>(valueArgs)...);
+			Uptr bucketIndex;
+			if(findForWrite(stripe, hash, key, bucketIndex)) { return false; }
+			insert(stripe, bucketIndex, hash, key, std::forward<ValueArgs>(valueArgs)...);
+			return true;
 		}
 
 		template<typename... ValueArgs> void addOrFail(const Key& key, ValueArgs&&... valueArgs)
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
-			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			stripe.map.addOrFail(key, std::forward<ValueArgs>(valueArgs)...);
+			const bool added = add(key, std::forward<ValueArgs>(valueArgs)...);
+			wavmAssert(added);
 		}
 
 		template<typename... ValueArgs> void set(const Key& key, ValueArgs&&... valueArgs)
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
 			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			stripe.map.set(key, std::forward<ValueArgs>(valueArgs)...);
+			Uptr bucketIndex;
+			Node* oldNode = findForWrite(stripe, hash, key, bucketIndex);
+			if(!oldNode)
+			{ insert(stripe, bucketIndex, hash, key, std::forward<ValueArgs>(valueArgs)...); }
+			else
+			{
+				Table* table = stripe.table.load(std::memory_order_relaxed);
+				table->buckets[bucketIndex].store(
+					new Node(hash, key, std::forward<ValueArgs>(valueArgs)...));
+				retireNode(stripe, oldNode);
+			}
 		}
 
 		bool remove(const Key& key)
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
 			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			return stripe.map.remove(key);
+			Uptr bucketIndex;
+			Node* node = findForWrite(stripe, hash, key, bucketIndex);
+			if(!node) { return false; }
+
+			// Leave a tombstone in the bucket, so readers probing past it don't stop there.
+			Table* table = stripe.table.load(std::memory_order_relaxed);
+			table->buckets[bucketIndex].store(getTombstone());
+			--stripe.numElements;
+			++stripe.numTombstones;
+			retireNode(stripe, node);
+			return true;
 		}
 
 		bool contains(const Key& key) const
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
-			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			return stripe.map.contains(key);
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
+			ReadGuard readGuard(stripe);
+			return find(stripe, hash, key) != nullptr;
 		}
 
 		const Value operator[](const Key& key) const
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
-			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			return stripe.map[key];
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
+			ReadGuard readGuard(stripe);
+			const Node* node = find(stripe, hash, key);
+			wavmAssert(node);
+			return node->value;
 		}
 
 		Value get(const Key& key, Value&& nullValue) const
 		{
-			Stripe& stripe = stripes[getStripeIndex(key)];
-			Lock<Platform::Mutex> stripeLock(stripe.mutex);
-			Value* value = stripe.map.get(key);
-			if(value) { return *value; }
+			const Uptr hash = KeyHashPolicy::getKeyHash(key);
+			Stripe& stripe = stripes[getStripeIndex(hash)];
+			ReadGuard readGuard(stripe);
+			const Node* node = find(stripe, hash, key);
+			if(node) { return node->value; }
 			else
 			{
 				return nullValue;
 			}
 		}
 
+		// The number of objects a stripe may retire while its draining objects wait for readers,
+		// before a writer waits for the readers to finish.
+		static constexpr Uptr maxRetiredObjects = 256;
+
+		// Returns the number of nodes and tables that have been retired, but not freed yet.
+		Uptr getNumRetiredObjects() const
+		{
+			Uptr numRetiredObjects = 0;
+			for(Stripe& stripe : stripes)
+			{
+				Lock<Platform::Mutex> stripeLock(stripe.mutex);
+				numRetiredObjects += stripe.retiredNodes.size() + stripe.retiredTables.size()
+									 + stripe.drainingNodes.size() + stripe.drainingTables.size();
+			}
+			return numRetiredObjects;
+		}
+
 	private:
+		struct Node
+		{
+			const Uptr hash;
+			const Key key;
+			const Value value;
+
+			template<typename... ValueArgs>
+			Node(Uptr inHash, const Key& inKey, ValueArgs&&... valueArgs)
+			: hash(inHash), key(inKey), value(std::forward<ValueArgs>(valueArgs)...)
+			{
+			}
+		};
+
+		struct Table
+		{
+			Uptr hashToBucketIndexMask;
+			std::atomic<Node*>* buckets;
+		};
+
 		struct alignas(WAVM::Platform::numCacheLineBytes) Stripe
 		{
+			std::atomic<Table*> table{nullptr};
+			std::atomic<Uptr> readerEpoch{0};
+			std::atomic<Uptr> numActiveReaders[2] = {{0}, {0}};
+
+			// The remaining members are only accessed by writers holding the mutex.
 			WAVM::Platform::Mutex mutex;
-			HashMap<Key, Value, KeyHashPolicy> map;
+			Uptr numElements = 0;
+			Uptr numTombstones = 0;
+
+			// The objects retired since the reader epoch was last flipped.
+			std::vector<Node*> retiredNodes;
+			std::vector<Table*> retiredTables;
+
+			// The objects retired before the reader epoch was last flipped, which may only be seen
+			// by the readers counted under the previous epoch.
+			std::vector<Node*> drainingNodes;
+			std::vector<Table*> drainingTables;
 		};
 
-		Stripe stripes[numStripes];
+		// Counts the reader in a stripe under the stripe's current reader epoch while it is in
+		// scope, which keeps writers from freeing anything the reader might see. The reader
+		// checks that the epoch didn't change while it counted itself, so a writer that flips the
+		// epoch after retiring an object either sees the reader under the previous epoch, or the
+		// reader doesn't see the retired object. The counters, the epoch and the pointers a reader
+		// loads are accessed with sequentially consistent ordering.
+		struct ReadGuard
+		{
+			ReadGuard(Stripe& inStripe) : stripe(inStripe)
+			{
+				while(true)
+				{
+					const Uptr epoch = stripe.readerEpoch.load();
+					parity = epoch & 1;
+					++stripe.numActiveReaders[parity];
+					if(stripe.readerEpoch.load() == epoch) { break; }
+					--stripe.numActiveReaders[parity];
+				}
+			}
+			~ReadGuard() { --stripe.numActiveReaders[parity]; }
+
+		private:
+			Stripe& stripe;
+			Uptr parity;
+		};
+
+		static constexpr Uptr minBuckets = 16;
+
+		mutable Stripe stripes[numStripes];
+
+		static Node* getTombstone() { return reinterpret_cast<Node*>(Uptr(1)); }
+
+		static const Node* find(const Stripe& stripe, Uptr hash, const Key& key)
+		{
+			const Table* table = stripe.table.load();
+			if(!table) { return nullptr; }
+
+			// Writers keep at least half the buckets null, so probing always reaches one.
+			for(Uptr bucketIndex = hash & table->hashToBucketIndexMask;;
+				bucketIndex = (bucketIndex + 1) & table->hashToBucketIndexMask)
+			{
+				const Node* node = table->buckets[bucketIndex].load();
+				if(!node) { return nullptr; }
+				if(node != getTombstone() && node->hash == hash
+				   && KeyHashPolicy::areKeysEqual(node->key, key))
+				{ return node; }
+			}
+		}
+
+		// Finds the node for a key in a stripe whose mutex is held by the caller. If the key is
+		// found, returns its node and sets outBucketIndex to its bucket. Otherwise, returns null
+		// and sets outBucketIndex to the bucket the key should be inserted in.
+		static Node* findForWrite(Stripe& stripe, Uptr hash, const Key& key, Uptr& outBucketIndex)
+		{
+			// Resize before searching if inserting another element would fill more than half the
+			// buckets, so the bucket index returned for an insert stays valid.
+			Table* table = stripe.table.load(std::memory_order_relaxed);
+			const Uptr numUsedBuckets = stripe.numElements + stripe.numTombstones + 1;
+			if(!table || numUsedBuckets * 2 > table->hashToBucketIndexMask + 1)
+			{ table = rehash(stripe); }
+
+			Uptr firstTombstoneIndex = UINTPTR_MAX;
+			for(Uptr bucketIndex = hash & table->hashToBucketIndexMask;;
+				bucketIndex = (bucketIndex + 1) & table->hashToBucketIndexMask)
+			{
+				Node* node = table->buckets[bucketIndex].load(std::memory_order_relaxed);
+				if(!node)
+				{
+					outBucketIndex
+						= firstTombstoneIndex != UINTPTR_MAX ? firstTombstoneIndex : bucketIndex;
+					return nullptr;
+				}
+				else if(node == getTombstone())
+				{
+					if(firstTombstoneIndex == UINTPTR_MAX) { firstTombstoneIndex = bucketIndex; }
+				}
+				else if(node->hash == hash && KeyHashPolicy::areKeysEqual(node->key, key))
+				{
+					outBucketIndex = bucketIndex;
+					return node;
+				}
+			}
+		}
+
+		template<typename... ValueArgs>
+		static Node* insert(Stripe& stripe,
+							Uptr bucketIndex,
+							Uptr hash,
+							const Key& key,
+							ValueArgs&&... valueArgs)
+		{
+			Table* table = stripe.table.load(std::memory_order_relaxed);
+			Node* node = new Node(hash, key, std::forward<ValueArgs>(valueArgs)...);
+			if(table->buckets[bucketIndex].load(std::memory_order_relaxed) == getTombstone())
+			{ --stripe.numTombstones; }
+			table->buckets[bucketIndex].store(node);
+			++stripe.numElements;
+			return node;
+		}
+
+		// Replaces a stripe's table with one that has room for twice its elements and no
+		// tombstones. The nodes are shared by both tables, so readers still using the old table
+		// see the same values.
+		static Table* rehash(Stripe& stripe)
+		{
+			Uptr newNumBuckets = minBuckets;
+			while(newNumBuckets < (stripe.numElements + 1) * 4) { newNumBuckets *= 2; }
+
+			Table* newTable = new Table;
+			newTable->hashToBucketIndexMask = newNumBuckets - 1;
+			newTable->buckets = new std::atomic<Node*>[newNumBuckets]();
+
+			Table* oldTable = stripe.table.load(std::memory_order_relaxed);
+			if(oldTable)
+			{
+				for(Uptr oldBucketIndex = 0; oldBucketIndex <= oldTable->hashToBucketIndexMask;
+					++oldBucketIndex)
+				{
+					Node* node = oldTable->buckets[oldBucketIndex].load(std::memory_order_relaxed);
+					if(!node || node == getTombstone()) { continue; }
+
+					Uptr newBucketIndex = node->hash & newTable->hashToBucketIndexMask;
+					while(newTable->buckets[newBucketIndex].load(std::memory_order_relaxed))
+					{ newBucketIndex = (newBucketIndex + 1) & newTable->hashToBucketIndexMask; }
+					newTable->buckets[newBucketIndex].store(node, std::memory_order_relaxed);
+				}
+			}
+
+			stripe.table.store(newTable);
+			stripe.numTombstones = 0;
+			if(oldTable)
+			{
+				stripe.retiredTables.push_back(oldTable);
+				tryFreeRetired(stripe);
+			}
+			return newTable;
+		}
+
+		static void retireNode(Stripe& stripe, Node* node)
+		{
+			stripe.retiredNodes.push_back(node);
+			tryFreeRetired(stripe);
+		}
+
+		// Frees the draining objects if the readers that might see them have finished, and then
+		// flips the reader epoch to start draining the retired objects. The stripe's mutex must be
+		// held by the caller.
+		static void tryFreeRetired(Stripe& stripe)
+		{
+			while(true)
+			{
+				const Uptr epoch = stripe.readerEpoch.load(std::memory_order_relaxed);
+				if(stripe.drainingNodes.size() || stripe.drainingTables.size())
+				{
+					std::atomic<Uptr>& numPreviousEpochReaders
+						= stripe.numActiveReaders[(epoch - 1) & 1];
+					if(numPreviousEpochReaders.load())
+					{
+						if(stripe.retiredNodes.size() + stripe.retiredTables.size()
+						   < maxRetiredObjects)
+						{ return; }
+
+						// Each reader only does one lookup, so this doesn't wait long.
+						while(numPreviousEpochReaders.load()) { std::this_thread::yield(); }
+					}
+					freeDraining(stripe);
+				}
+
+				if(!stripe.retiredNodes.size() && !stripe.retiredTables.size()) { return; }
+				stripe.retiredNodes.swap(stripe.drainingNodes);
+				stripe.retiredTables.swap(stripe.drainingTables);
+				stripe.readerEpoch.store(epoch + 1);
+			}
+		}
+
+		static void freeRetired(Stripe& stripe)
+		{
+			for(Node* node : stripe.retiredNodes) { delete node; }
+			for(Table* table : stripe.retiredTables) { deleteTable(table); }
+			stripe.retiredNodes.clear();
+			stripe.retiredTables.clear();
+		}
+
+		static void freeDraining(Stripe& stripe)
+		{
+			for(Node* node : stripe.drainingNodes) { delete node; }
+			for(Table* table : stripe.drainingTables) { deleteTable(table); }
+			stripe.drainingNodes.clear();
+			stripe.drainingTables.clear();
+		}
+
+		static void deleteTable(Table* table)
+		{
+			delete[] table->buckets;
+			delete table;
+		}
 
-		static Uptr getStripeIndex(const Key& key)
+		static Uptr getStripeIndex(Uptr hash)
 		{
 			// Instead of just using the key hash, apply some mixing function so keys end up in
 			// different buckets within the stripe for stripe hash tables with numBuckets <=
 			// numStripes.
-			Uptr hash = KeyHashPolicy::getKeyHash(key);
 			if(sizeof(Uptr) == 8)
 			{
 				// Thomas Wang's 64-bit hash mixing function
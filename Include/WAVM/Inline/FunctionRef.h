@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace WAVM {
+	// A non-owning reference to a callable object. Unlike std::function, constructing one never
+	// allocates, and calling it is a single indirect call. The referenced object must outlive the
+	// FunctionRef, so it should only be used for parameters that aren't retained after the callee
+	// returns.
+	template<typename Function> struct FunctionRef;
+
+	template<typename Result, typename... Args> struct FunctionRef<Result(Args...)>
+	{
+		template<typename Callable,
+				 typename = typename std::enable_if<
+					 !std::is_same<typename std::decay<Callable>::type, FunctionRef>::value>::type>
+		FunctionRef(Callable&& callable)
+		: callablePointer((void*)std::addressof(callable))
+		, thunk(&callThunk<typename std::remove_reference<Callable>::type>)
+		{
+		}
+
+		Result operator()(Args... args) const
+		{
+			return thunk(callablePointer, std::forward<Args>(args)...);
+		}
+
+	private:
+		void* callablePointer;
+		Result (*thunk)(void*, Args...);
+
+		template<typename Callable> static Result callThunk(void* callablePointer, Args... args)
+		{
+			return (*reinterpret_cast<Callable*>(callablePointer))(std::forward<Args>(args)...);
+		}
+	};
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string.h>
+#include "Assert.h"
+#include "BasicTypes.h"
+#include "HashTable.h"
+#include "OptionalStorage.h"
+#include "WAVM/Platform/Intrinsic.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WAVM_GROUPHASHTABLE_USE_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WAVM_GROUPHASHTABLE_USE_NEON 1
+#endif
+
+namespace WAVM {
+	// The control bytes of a GroupHashTable are probed 16 at a time.
+	struct HashTableGroup
+	{
+		enum : U8
+		{
+			emptyControl = 0x80,
+			deletedControl = 0xfe,
+		};
+
+		static constexpr Uptr numBuckets = 16;
+
+#if WAVM_GROUPHASHTABLE_USE_NEON
+		// NEON has no equivalent of SSE2's movemask, so the match masks have 4 bits per bucket.
+		typedef U64 Mask;
+		static constexpr Uptr maskBitsPerBucketLog2 = 2;
+#else
+		typedef U32 Mask;
+		static constexpr Uptr maskBitsPerBucketLog2 = 0;
+#endif
+
+		// Returns a mask with the bits for each bucket in the group whose control byte is value.
+		static Mask match(const U8* controls, U8 value)
+		{
+#if WAVM_GROUPHASHTABLE_USE_SSE2
+			const __m128i group = _mm_loadu_si128((const __m128i*)controls);
+			return U32(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(char(value)))));
+#elif WAVM_GROUPHASHTABLE_USE_NEON
+			const uint8x16_t equal = vceqq_u8(vld1q_u8(controls), vdupq_n_u8(value));
+			const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(equal), 4);
+			return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull;
+#else
+			Mask mask = 0;
+			for(Uptr index = 0; index < numBuckets; ++index)
+			{ mask |= Mask(controls[index] == value) << index; }
+			return mask;
+#endif
+		}
+
+		// Returns a mask with the bits for each bucket in the group that is empty or deleted. Both
+		// have the high bit of their control byte set, which full buckets never do.
+		static Mask matchEmptyOrDeleted(const U8* controls)
+		{
+#if WAVM_GROUPHASHTABLE_USE_SSE2
+			return U32(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)controls)));
+#elif WAVM_GROUPHASHTABLE_USE_NEON
+			const uint8x16_t highBits = vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(controls)));
+			const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(highBits), 4);
+			return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull;
+#else
+			Mask mask = 0;
+			for(Uptr index = 0; index < numBuckets; ++index)
+			{ mask |= Mask(controls[index] >> 7) << index; }
+			return mask;
+#endif
+		}
+
+		// Returns the index of the lowest bucket in a non-zero mask.
+		static Uptr getLowestBucket(Mask mask)
+		{
+			wavmAssert(mask);
+			return Uptr(Platform::countTrailingZeroes(mask)) >> maskBitsPerBucketLog2;
+		}
+	};
+
+	// An alternative to HashTable that keeps a byte of metadata for each bucket in an array
+	// separate from the buckets, and probes that metadata a group of 16 buckets at a time using
+	// SSE2 or NEON instructions.
+	//
+	//   Each bucket's control byte is either emptyControl, deletedControl, or the top 7 bits of
+	// the hash of the element occupying the bucket. A search loads a group of control bytes, and
+	// only compares keys for the buckets in the group whose control byte matches the searched
+	// hash, so it usually only touches the cache line holding the control bytes and the one
+	// holding the element it finds. Groups are probed in a triangular sequence starting from the
+	// group indexed by the lower bits of the hash, and a search stops at the first group that has
+	// an empty bucket.
+	//
+	//   Removing an element leaves a deleted control byte, unless the element's group has an
+	// empty bucket: no search can have continued past that group. Deleted buckets are reused by
+	// later adds, and are cleared when the table is resized.
+	//
+	//   The buckets are the same HashTableBucket used by HashTable, including the full hash of the
+	// occupying element, so HashMap and HashSet (and their iterators and debugger visualizers)
+	// work the same on both tables. This trades some space for not having to recompute hashes
+	// when resizing.
+	template<typename Key,
+			 typename Element,
+			 typename HashTablePolicy,
+			 typename AllocPolicy = DefaultHashTableAllocPolicy>
+	struct GroupHashTable
+	{
+		typedef HashTableBucket<Element> Bucket;
+
+		GroupHashTable(Uptr estimatedNumElements = 0);
+		GroupHashTable(const GroupHashTable& copy);
+		GroupHashTable(GroupHashTable&& movee);
+		~GroupHashTable();
+
+		GroupHashTable& operator=(const GroupHashTable& copyee);
+		GroupHashTable& operator=(GroupHashTable&& movee);
+
+		void resize(Uptr newNumBuckets);
+
+		bool remove(Uptr hash, const Key& key);
+
+		const Bucket* getBucketForRead(Uptr hash, const Key& key) const;
+		Bucket* getBucketForModify(Uptr hash, const Key& key);
+		Bucket& getBucketForAdd(Uptr hash, const Key& key);
+
+		Uptr size() const { return numElements; }
+		Uptr numBuckets() const { return hashToBucketIndexMask + 1; }
+
+		Bucket* getBuckets() const { return buckets; }
+
+		// Compute some statistics about the space usage of this hash table. The probe counts are
+		// the number of groups probed.
+		void analyzeSpaceUsage(Uptr& outTotalMemoryBytes,
+							   Uptr& outMaxProbeCount,
+							   F32& outOccupancy,
+							   F32& outAverageProbeCount) const;
+
+	private:
+		Bucket* buckets;
+		U8* controls;
+		Uptr numElements;
+		Uptr hashToBucketIndexMask;
+
+		// The number of empty buckets that may be filled before the table must be resized.
+		Uptr numAddsBeforeResize;
+
+		static Uptr getBucketHash(Uptr hash) { return hash & Bucket::hashMask; }
+		static U8 getHashControl(Uptr hash)
+		{
+			return U8(getBucketHash(hash) >> (sizeof(Uptr) * 8 - 8));
+		}
+		static Uptr clampNumBuckets(Uptr numBuckets);
+
+		Uptr findEmptyOrDeletedBucket(Uptr hash) const;
+
+		void allocate(Uptr newNumBuckets);
+		void destruct();
+		void copyFrom(const GroupHashTable& copy);
+		void moveFrom(GroupHashTable&& movee);
+	};
+
+	struct GroupProbing
+	{
+		template<typename Key, typename Element, typename HashTablePolicy>
+		using Table = GroupHashTable<Key, Element, HashTablePolicy>;
+	};
+
+// The implementation is defined in a separate file.
+#include "GroupHashTableImpl.h"
+}
@@ -0,0 +1,372 @@
+// IWYU pragma: private, include "Inline/GroupHashTable.h"
+// You should only include this file indirectly by including GroupHashTable.h.
+
+// Use these macros to compress the boilerplate template declarations in a non-inline member
+// function definition for GroupHashTable.
+#define GROUPHASHTABLE_PARAMETERS                                                                  \
+	typename Key, typename Element, typename HashTablePolicy, typename AllocPolicy
+#define GROUPHASHTABLE_ARGUMENTS Key, Element, HashTablePolicy, AllocPolicy
+
+template<GROUPHASHTABLE_PARAMETERS>
+Uptr GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::clampNumBuckets(Uptr numBuckets)
+{
+	// The table must have at least one whole group of buckets.
+	return numBuckets && numBuckets < HashTableGroup::numBuckets ? HashTableGroup::numBuckets
+																 : numBuckets;
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+void GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::allocate(Uptr newNumBuckets)
+{
+	wavmAssert(!(newNumBuckets & (newNumBuckets - 1)));
+	wavmAssert(!newNumBuckets || newNumBuckets >= HashTableGroup::numBuckets);
+
+	hashToBucketIndexMask = newNumBuckets - 1;
+	if(!newNumBuckets)
+	{
+		buckets = nullptr;
+		controls = nullptr;
+		numAddsBeforeResize = 0;
+	}
+	else
+	{
+		buckets = new Bucket[newNumBuckets]();
+		controls = new U8[newNumBuckets];
+		memset(controls, HashTableGroup::emptyControl, newNumBuckets);
+
+		// Keep at least 1/8 of the buckets empty, so searches don't have to probe too many groups
+		// to find an empty one.
+		numAddsBeforeResize = newNumBuckets - newNumBuckets / 8;
+	}
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+Uptr GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::findEmptyOrDeletedBucket(Uptr hash) const
+{
+	wavmAssert(buckets);
+
+	// Probe the groups in a triangular sequence, which visits every group in a power-of-two number
+	// of groups, starting from the group indexed by the lower bits of the hash.
+	const Uptr groupIndexMask = hashToBucketIndexMask / HashTableGroup::numBuckets;
+	Uptr groupIndex = getBucketHash(hash) & groupIndexMask;
+	for(Uptr probeCount = 1;; ++probeCount)
+	{
+		const Uptr groupBucketIndex = groupIndex * HashTableGroup::numBuckets;
+		const HashTableGroup::Mask mask
+			= HashTableGroup::matchEmptyOrDeleted(controls + groupBucketIndex);
+		if(mask) { return groupBucketIndex + HashTableGroup::getLowestBucket(mask); }
+
+		wavmAssert(probeCount <= groupIndexMask + 1);
+		groupIndex = (groupIndex + probeCount) & groupIndexMask;
+	};
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+void GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::resize(Uptr newNumBuckets)
+{
+	newNumBuckets = clampNumBuckets(newNumBuckets);
+	wavmAssert(newNumBuckets || !numElements);
+
+	const Uptr oldNumBuckets = numBuckets();
+	Bucket* oldBuckets = buckets;
+	U8* oldControls = controls;
+
+	allocate(newNumBuckets);
+
+	if(oldBuckets)
+	{
+		// Iterate over the old buckets, and reinsert their contents in the new buckets. Since the
+		// new table doesn't contain any of the elements yet, their keys don't need to be compared.
+		for(Uptr bucketIndex = 0; bucketIndex < oldNumBuckets; ++bucketIndex)
+		{
+			Bucket& oldBucket = oldBuckets[bucketIndex];
+			if(oldBucket.hashAndOccupancy)
+			{
+				const Uptr newBucketIndex = findEmptyOrDeletedBucket(oldBucket.hashAndOccupancy);
+				Bucket& newBucket = buckets[newBucketIndex];
+				controls[newBucketIndex] = getHashControl(oldBucket.hashAndOccupancy);
+				--numAddsBeforeResize;
+
+				// Move the element from the old bucket to the new.
+				newBucket.storage.construct(std::move(oldBucket.storage.contents));
+				newBucket.hashAndOccupancy = oldBucket.hashAndOccupancy;
+				oldBucket.storage.destruct();
+				oldBucket.hashAndOccupancy = 0;
+			}
+		}
+
+		// Free the old buckets.
+		delete[] oldBuckets;
+		delete[] oldControls;
+	}
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+bool GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::remove(Uptr hash, const Key& key)
+{
+	// Find the bucket (if any) holding the key.
+	const Bucket* bucket = getBucketForRead(hash, key);
+	if(!bucket) { return false; }
+	else
+	{
+		// Remove the element in the bucket.
+		const Uptr bucketIndex = bucket - buckets;
+		buckets[bucketIndex].hashAndOccupancy = 0;
+		buckets[bucketIndex].storage.destruct();
+
+		// If the bucket's group has an empty bucket, then no search will have continued past the
+		// group, and the bucket can be marked as empty. Otherwise, mark it as deleted so searches
+		// continue past it.
+		const Uptr groupBucketIndex = bucketIndex & ~(HashTableGroup::numBuckets - 1);
+		if(HashTableGroup::match(controls + groupBucketIndex, HashTableGroup::emptyControl))
+		{
+			controls[bucketIndex] = HashTableGroup::emptyControl;
+			++numAddsBeforeResize;
+		}
+		else
+		{
+			controls[bucketIndex] = HashTableGroup::deletedControl;
+		}
+
+		// Decrease the number of elements and resize the table if the occupancy is too low.
+		--numElements;
+		const Uptr maxDesiredBuckets
+			= clampNumBuckets(AllocPolicy::getMaxDesiredBuckets(numElements));
+		if(numBuckets() > maxDesiredBuckets) { resize(maxDesiredBuckets); }
+
+		return true;
+	}
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+const HashTableBucket<Element>* GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::getBucketForRead(
+	Uptr hash,
+	const Key& key) const
+{
+	if(!buckets) { return nullptr; }
+
+	const Uptr hashAndOccupancy = hash | Bucket::isOccupiedMask;
+	const U8 hashControl = getHashControl(hash);
+
+	// Probe the groups in the same sequence as findEmptyOrDeletedBucket.
+	const Uptr groupIndexMask = hashToBucketIndexMask / HashTableGroup::numBuckets;
+	Uptr groupIndex = getBucketHash(hash) & groupIndexMask;
+	for(Uptr probeCount = 1;; ++probeCount)
+	{
+		const Uptr groupBucketIndex = groupIndex * HashTableGroup::numBuckets;
+		const U8* groupControls = controls + groupBucketIndex;
+
+		// Compare the key against the elements in the group's buckets whose control byte matches
+		// the hash.
+		HashTableGroup::Mask mask = HashTableGroup::match(groupControls, hashControl);
+		while(mask)
+		{
+			const Bucket& bucket
+				= buckets[groupBucketIndex + HashTableGroup::getLowestBucket(mask)];
+			if(bucket.hashAndOccupancy == hashAndOccupancy
+			   && HashTablePolicy::areKeysEqual(HashTablePolicy::getKey(bucket.storage.contents),
+												key))
+			{ return &bucket; }
+			mask &= mask - 1;
+		};
+
+		// If the group has an empty bucket, an add of the key would have stopped here, so the
+		// table doesn't contain the key.
+		if(HashTableGroup::match(groupControls, HashTableGroup::emptyControl)) { return nullptr; }
+
+		if(probeCount > groupIndexMask) { return nullptr; }
+		groupIndex = (groupIndex + probeCount) & groupIndexMask;
+	};
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+HashTableBucket<Element>* GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::getBucketForModify(
+	Uptr hash,
+	const Key& key)
+{
+	return const_cast<Bucket*>(getBucketForRead(hash, key));
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+HashTableBucket<Element>& GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::getBucketForAdd(
+	Uptr hash,
+	const Key& key)
+{
+	// If the table already holds the key, return its bucket.
+	if(Bucket* existingBucket = getBucketForModify(hash, key))
+	{
+		wavmAssert(existingBucket->hashAndOccupancy == (hash | Bucket::isOccupiedMask));
+		return *existingBucket;
+	}
+
+	// Make sure there's enough space to add a new key to the table. If the table isn't too
+	// occupied, but has run out of empty buckets because of deleted buckets, resize it to the same
+	// number of buckets to clear the deleted buckets.
+	const Uptr minDesiredBuckets
+		= clampNumBuckets(AllocPolicy::getMinDesiredBuckets(numElements + 1));
+	if(numBuckets() < minDesiredBuckets) { resize(minDesiredBuckets); }
+	else if(!numAddsBeforeResize)
+	{
+		resize(numBuckets());
+	}
+
+	// Find the first empty or deleted bucket in the key's probe sequence.
+	const Uptr bucketIndex = findEmptyOrDeletedBucket(hash);
+	if(controls[bucketIndex] == HashTableGroup::emptyControl)
+	{
+		wavmAssert(numAddsBeforeResize);
+		--numAddsBeforeResize;
+	}
+	controls[bucketIndex] = getHashControl(hash);
+
+	// Increment the number of elements in the table. The caller is expected to fill the bucket
+	// once this function returns.
+	++numElements;
+	wavmAssert(!buckets[bucketIndex].hashAndOccupancy);
+	return buckets[bucketIndex];
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+void GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::analyzeSpaceUsage(Uptr& outTotalMemoryBytes,
+																 Uptr& outMaxProbeCount,
+																 F32& outOccupancy,
+																 F32& outAverageProbeCount) const
+{
+	outTotalMemoryBytes = (sizeof(Bucket) + sizeof(U8)) * numBuckets() + sizeof(*this);
+	outOccupancy = size() / F32(numBuckets());
+
+	// Count the number of groups probed to find each element.
+	outMaxProbeCount = 0;
+	outAverageProbeCount = 0.0f;
+	const Uptr groupIndexMask = hashToBucketIndexMask / HashTableGroup::numBuckets;
+	for(Uptr bucketIndex = 0; bucketIndex < numBuckets(); ++bucketIndex)
+	{
+		const Uptr hash = buckets[bucketIndex].hashAndOccupancy;
+		if(!hash) { continue; }
+
+		const Uptr elementGroupIndex = bucketIndex / HashTableGroup::numBuckets;
+		Uptr groupIndex = getBucketHash(hash) & groupIndexMask;
+		Uptr probeCount = 1;
+		while(groupIndex != elementGroupIndex)
+		{
+			groupIndex = (groupIndex + probeCount) & groupIndexMask;
+			++probeCount;
+		};
+
+		outMaxProbeCount = probeCount > outMaxProbeCount ? probeCount : outMaxProbeCount;
+		outAverageProbeCount += probeCount / F32(size());
+	}
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::GroupHashTable(Uptr estimatedNumElements)
+: numElements(0)
+{
+	allocate(clampNumBuckets(AllocPolicy::getMinDesiredBuckets(estimatedNumElements)));
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::GroupHashTable(const GroupHashTable& copy)
+{
+	copyFrom(copy);
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::GroupHashTable(GroupHashTable&& movee)
+{
+	moveFrom(std::move(movee));
+}
+
+template<GROUPHASHTABLE_PARAMETERS> GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::~GroupHashTable()
+{
+	destruct();
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+GroupHashTable<GROUPHASHTABLE_ARGUMENTS>& GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::operator=(
+	const GroupHashTable<GROUPHASHTABLE_ARGUMENTS>& copyee)
+{
+	// Do nothing if copying from this.
+	if(this != &copyee)
+	{
+		destruct();
+		copyFrom(copyee);
+	}
+	return *this;
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+GroupHashTable<GROUPHASHTABLE_ARGUMENTS>& GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::operator=(
+	GroupHashTable<GROUPHASHTABLE_ARGUMENTS>&& movee)
+{
+	// Do nothing if moving from this.
+	if(this != &movee)
+	{
+		destruct();
+		moveFrom(std::move(movee));
+	}
+	return *this;
+}
+
+template<GROUPHASHTABLE_PARAMETERS> void GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::destruct()
+{
+	if(buckets)
+	{
+		for(Uptr bucketIndex = 0; bucketIndex < numBuckets(); ++bucketIndex)
+		{
+			if(buckets[bucketIndex].hashAndOccupancy) { buckets[bucketIndex].storage.destruct(); }
+		}
+
+		delete[] buckets;
+		delete[] controls;
+		buckets = nullptr;
+		controls = nullptr;
+	}
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+void GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::copyFrom(const GroupHashTable& copy)
+{
+	numElements = copy.numElements;
+	hashToBucketIndexMask = copy.hashToBucketIndexMask;
+	numAddsBeforeResize = copy.numAddsBeforeResize;
+
+	if(!copy.buckets)
+	{
+		buckets = nullptr;
+		controls = nullptr;
+	}
+	else
+	{
+		buckets = new Bucket[copy.numBuckets()];
+		controls = new U8[copy.numBuckets()];
+		memcpy(controls, copy.controls, copy.numBuckets());
+		for(Uptr bucketIndex = 0; bucketIndex < numBuckets(); ++bucketIndex)
+		{
+			buckets[bucketIndex].hashAndOccupancy = copy.buckets[bucketIndex].hashAndOccupancy;
+			if(buckets[bucketIndex].hashAndOccupancy)
+			{
+				buckets[bucketIndex].storage.construct(copy.buckets[bucketIndex].storage.contents);
+			}
+		}
+	}
+}
+
+template<GROUPHASHTABLE_PARAMETERS>
+void GroupHashTable<GROUPHASHTABLE_ARGUMENTS>::moveFrom(GroupHashTable&& movee)
+{
+	numElements = movee.numElements;
+	hashToBucketIndexMask = movee.hashToBucketIndexMask;
+	numAddsBeforeResize = movee.numAddsBeforeResize;
+	buckets = movee.buckets;
+	controls = movee.controls;
+
+	movee.numElements = 0;
+	movee.hashToBucketIndexMask = UINTPTR_MAX;
+	movee.numAddsBeforeResize = 0;
+	movee.buckets = nullptr;
+	movee.controls = nullptr;
+}
+
+#undef GROUPHASHTABLE_PARAMETERS
+#undef GROUPHASHTABLE_ARGUMENTS
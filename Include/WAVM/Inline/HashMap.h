@@ -20,7 +20,7 @@ namespace WAVM {
 
 	template<typename Key, typename Value> struct HashMapIterator
 	{
-		template<typename, typename, typename> friend struct HashMap;
+		template<typename, typename, typename, typename> friend struct HashMap;
 
 		typedef HashMapPair<Key, Value> Pair;
 
@@ -40,7 +40,10 @@ namespace WAVM {
 						const HashTableBucket<Pair>* inEndBucket);
 	};
 
-	template<typename Key, typename Value, typename KeyHashPolicy = DefaultHashPolicy<Key>>
+	template<typename Key,
+			 typename Value,
+			 typename KeyHashPolicy = DefaultHashPolicy<Key>,
+			 typename Probing = RobinHoodProbing>
 	struct HashMap
 	{
 		typedef HashMapPair<Key, Value> Pair;
@@ -112,7 +115,7 @@ namespace WAVM {
 			}
 		};
 
-		HashTable<Key, Pair, HashTablePolicy> table;
+		typename Probing::template Table<Key, Pair, HashTablePolicy> table;
 	};
 
 // The implementation is defined in a separate file.
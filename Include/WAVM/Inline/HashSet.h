@@ -10,7 +10,7 @@
 namespace WAVM {
 	template<typename Element> struct HashSetIterator
 	{
-		template<typename, typename> friend struct HashSet;
+		template<typename, typename, typename> friend struct HashSet;
 
 		bool operator!=(const HashSetIterator& other);
 		bool operator==(const HashSetIterator& other);
@@ -29,7 +29,9 @@ namespace WAVM {
 						const HashTableBucket<Element>* inEndBucket);
 	};
 
-	template<typename Element, typename ElementHashPolicy = DefaultHashPolicy<Element>>
+	template<typename Element,
+			 typename ElementHashPolicy = DefaultHashPolicy<Element>,
+			 typename Probing = RobinHoodProbing>
 	struct HashSet
 	{
 		HashSet(Uptr reserveNumElements = 0);
@@ -85,7 +87,7 @@ namespace WAVM {
 			}
 		};
 
-		HashTable<Element, Element, HashTablePolicy> table;
+		typename Probing::template Table<Element, Element, HashTablePolicy> table;
 	};
 
 // The implementation is defined in a separate file.
@@ -151,6 +151,14 @@ namespace WAVM {
 		void moveFrom(HashTable&& movee);
 	};
 
+	// Selects the hash table implementation that a HashMap or HashSet uses. RobinHoodProbing
+	// selects HashTable, and GroupProbing selects GroupHashTable.
+	struct RobinHoodProbing
+	{
+		template<typename Key, typename Element, typename HashTablePolicy>
+		using Table = HashTable<Key, Element, HashTablePolicy>;
+	};
+
 // The implementation is defined in a separate file.
 #include "HashTableImpl.h"
 }
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+#include "WAVM/Inline/BasicTypes.h"
+
+namespace WAVM { namespace LZ4 {
+	namespace Impl {
+		// The LZ4 block format requires the last match to start at least 12 bytes before the end of
+		// the block, and the last 5 bytes to be literals.
+		static constexpr Uptr minMatchBytes = 4;
+		static constexpr Uptr matchStartLimitBytes = 12;
+		static constexpr Uptr lastLiteralBytes = 5;
+		static constexpr Uptr maxOffset = 65535;
+		static constexpr Uptr numHashBits = 14;
+
+		inline U32 load32(const U8* bytes)
+		{
+			U32 value;
+			memcpy(&value, bytes, sizeof(value));
+			return value;
+		}
+
+		inline Uptr hash32(U32 value) { return (value * 2654435761u) >> (32 - numHashBits); }
+
+		inline void writeLength(std::vector<U8>& outBytes, Uptr length)
+		{
+			while(length >= 255)
+			{
+				outBytes.push_back(255);
+				length -= 255;
+			}
+			outBytes.push_back(U8(length));
+		}
+
+		inline bool readLength(const U8*& in, const U8* inEnd, Uptr& inOutLength)
+		{
+			U8 byte;
+			do
+			{
+				if(in == inEnd || inOutLength > UINTPTR_MAX - 255) { return false; }
+				byte = *in++;
+				inOutLength += byte;
+			} while(byte == 255);
+			return true;
+		}
+
+		// Writes a sequence of literal bytes followed by a match, or by nothing if matchLength is
+		// zero.
+		inline void writeSequence(std::vector<U8>& outBytes,
+								  const U8* literals,
+								  Uptr numLiterals,
+								  Uptr offset,
+								  Uptr matchLength)
+		{
+			const Uptr extraMatchLength = matchLength ? matchLength - minMatchBytes : 0;
+			outBytes.push_back(U8(((numLiterals < 15 ? numLiterals : 15) << 4)
+								  | (extraMatchLength < 15 ? extraMatchLength : 15)));
+			if(numLiterals >= 15) { writeLength(outBytes, numLiterals - 15); }
+			outBytes.insert(outBytes.end(), literals, literals + numLiterals);
+
+			if(matchLength)
+			{
+				outBytes.push_back(U8(offset));
+				outBytes.push_back(U8(offset >> 8));
+				if(extraMatchLength >= 15) { writeLength(outBytes, extraMatchLength - 15); }
+			}
+		}
+	}
+
+	// Compresses bytes to an LZ4 block, preceded by the number of uncompressed bytes as a 64-bit
+	// little-endian integer. The compressor only checks one earlier position for each match, which
+	// trades compression ratio for speed.
+	inline void compress(const U8* bytes, Uptr numBytes, std::vector<U8>& outBytes)
+	{
+		outBytes.clear();
+		outBytes.reserve(8 + numBytes + numBytes / 255 + 16);
+		for(Uptr byteIndex = 0; byteIndex < 8; ++byteIndex)
+		{ outBytes.push_back(U8(U64(numBytes) >> (byteIndex * 8))); }
+
+		Uptr literalStart = 0;
+		if(numBytes > Impl::matchStartLimitBytes)
+		{
+			// The hash table maps the hash of 4 bytes to the last position they were seen at.
+			// Candidate matches are checked against the input, so collisions and stale positions
+			// only cost compression ratio.
+			std::vector<U32> hashTable(Uptr(1) << Impl::numHashBits, 0);
+			const Uptr matchStartLimit = numBytes - Impl::matchStartLimitBytes;
+			const Uptr matchEndLimit = numBytes - Impl::lastLiteralBytes;
+			Uptr index = 0;
+			while(index < matchStartLimit)
+			{
+				const U32 sequence = Impl::load32(bytes + index);
+				const Uptr hash = Impl::hash32(sequence);
+				const Uptr candidate = hashTable[hash];
+				hashTable[hash] = U32(index);
+
+				if(candidate >= index || index - candidate > Impl::maxOffset
+				   || Impl::load32(bytes + candidate) != sequence)
+				{
+					// Skip ahead faster the longer the input has been incompressible.
+					index += 1 + ((index - literalStart) >> 6);
+					continue;
+				}
+
+				Uptr matchEnd = index + Impl::minMatchBytes;
+				const Uptr offset = index - candidate;
+				while(matchEnd < matchEndLimit && bytes[matchEnd] == bytes[matchEnd - offset])
+				{ ++matchEnd; }
+
+				Impl::writeSequence(outBytes,
+									bytes + literalStart,
+									index - literalStart,
+									offset,
+									matchEnd - index);
+				index = literalStart = matchEnd;
+			}
+		}
+
+		Impl::writeSequence(outBytes, bytes + literalStart, numBytes - literalStart, 0, 0);
+	}
+
+	// Decompresses bytes produced by compress. Returns false if the bytes aren't a valid
+	// compressed sequence of bytes.
+	inline bool decompress(const U8* bytes, Uptr numBytes, std::vector<U8>& outBytes)
+	{
+		if(numBytes < 9) { return false; }
+		U64 numDecompressedBytes64 = 0;
+		for(Uptr byteIndex = 0; byteIndex < 8; ++byteIndex)
+		{ numDecompressedBytes64 |= U64(bytes[byteIndex]) << (byteIndex * 8); }
+
+		// Each compressed byte decompresses to at most 255 bytes, so reject sizes that couldn't be
+		// produced by the compressed bytes before allocating the output.
+		const U8* in = bytes + 8;
+		const U8* inEnd = bytes + numBytes;
+		if(numDecompressedBytes64 / 255 > U64(inEnd - in) || numDecompressedBytes64 > UINTPTR_MAX)
+		{ return false; }
+		const Uptr numDecompressedBytes = Uptr(numDecompressedBytes64);
+
+		outBytes.resize(numDecompressedBytes);
+		U8* out = outBytes.data();
+		Uptr outIndex = 0;
+		while(true)
+		{
+			if(in == inEnd) { return false; }
+			const U8 token = *in++;
+
+			Uptr numLiterals = token >> 4;
+			if(numLiterals == 15 && !Impl::readLength(in, inEnd, numLiterals)) { return false; }
+			if(numLiterals > Uptr(inEnd - in) || numLiterals > numDecompressedBytes - outIndex)
+			{ return false; }
+			if(numLiterals) { memcpy(out + outIndex, in, numLiterals); }
+			in += numLiterals;
+			outIndex += numLiterals;
+
+			// The last sequence has no match.
+			if(in == inEnd) { return outIndex == numDecompressedBytes; }
+
+			if(inEnd - in < 2) { return false; }
+			const Uptr offset = Uptr(in[0]) | (Uptr(in[1]) << 8);
+			in += 2;
+			if(!offset || offset > outIndex) { return false; }
+
+			Uptr matchLength = token & 15;
+			if(matchLength == 15 && !Impl::readLength(in, inEnd, matchLength)) { return false; }
+			matchLength += Impl::minMatchBytes;
+			if(matchLength > numDecompressedBytes - outIndex) { return false; }
+
+			// A match may overlap the bytes it produces, which repeats the last offset bytes.
+			const U8* match = out + outIndex - offset;
+			if(offset >= matchLength) { memcpy(out + outIndex, match, matchLength); }
+			else
+			{
+				for(Uptr byteIndex = 0; byteIndex < matchLength; ++byteIndex)
+				{ out[outIndex + byteIndex] = match[byteIndex]; }
+			}
+			outIndex += matchLength;
+		}
+	}
+}}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stdlib.h>
+#include <vector>
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+
+namespace WAVM {
+	// A per-thread bump allocator for transient allocations. Allocations are only freed when the
+	// ScratchScope that they were made in ends, which makes the memory available to later scopes
+	// on the same thread. The arena keeps its chunks until the thread exits, so code that
+	// repeatedly allocates the same amount of scratch memory doesn't use the heap once the arena
+	// has grown to fit it.
+	struct ScratchArena
+	{
+		static ScratchArena& get()
+		{
+			static thread_local ScratchArena arena;
+			return arena;
+		}
+
+		~ScratchArena()
+		{
+			Chunk* chunk = firstChunk;
+			while(chunk)
+			{
+				Chunk* nextChunk = chunk->next;
+				free(chunk);
+				chunk = nextChunk;
+			}
+		}
+
+		void* allocate(Uptr numBytes, Uptr alignment)
+		{
+			wavmAssert(alignment && !(alignment & (alignment - 1)));
+			wavmAssert(alignment <= alignof(Chunk));
+
+			if(currentChunk)
+			{
+				const Uptr alignedOffset = (currentOffset + alignment - 1) & ~(alignment - 1);
+				if(alignedOffset <= currentChunk->numBytes
+				   && numBytes <= currentChunk->numBytes - alignedOffset)
+				{
+					currentOffset = alignedOffset + numBytes;
+					return currentChunk->getData() + alignedOffset;
+				}
+			}
+
+			// Move to the next chunk if it is large enough, or insert a new chunk after the
+			// current chunk.
+			Chunk* nextChunk = currentChunk ? currentChunk->next : firstChunk;
+			if(!nextChunk || nextChunk->numBytes < numBytes)
+			{
+				Uptr numChunkBytes = defaultChunkBytes;
+				if(numBytes > numChunkBytes) { numChunkBytes = numBytes; }
+				if(numChunkBytes > UINTPTR_MAX - sizeof(Chunk))
+				{ Errors::fatal("Scratch allocation is too large"); }
+				Chunk* newChunk = (Chunk*)malloc(sizeof(Chunk) + numChunkBytes);
+				if(!newChunk) { Errors::fatal("Failed to allocate scratch memory"); }
+				newChunk->next = nextChunk;
+				newChunk->numBytes = numChunkBytes;
+				if(currentChunk) { currentChunk->next = newChunk; }
+				else
+				{
+					firstChunk = newChunk;
+				}
+				nextChunk = newChunk;
+			}
+
+			currentChunk = nextChunk;
+			currentOffset = numBytes;
+			return currentChunk->getData();
+		}
+
+	private:
+		friend struct ScratchScope;
+
+		static constexpr Uptr defaultChunkBytes = 64 * 1024;
+
+		struct alignas(16) Chunk
+		{
+			Chunk* next;
+			Uptr numBytes;
+
+			U8* getData() { return reinterpret_cast<U8*>(this + 1); }
+		};
+
+		// The chunks form a list, ordered by when scopes on the thread use them. currentChunk is
+		// null if no chunk is in use.
+		Chunk* firstChunk = nullptr;
+		Chunk* currentChunk = nullptr;
+		Uptr currentOffset = 0;
+
+		ScratchArena() {}
+	};
+
+	// Frees the scratch memory allocated on the calling thread during the scope's lifetime when it
+	// ends. Scopes on a thread must be nested, and scratch containers must be destroyed before the
+	// scope they allocate their memory in, so the scope should be declared before them. A scope
+	// may not be live while switching stacks, e.g. across calls into WebAssembly code that may be
+	// suspended by Runtime::suspendInvoke, since the scopes would no longer be nested.
+	struct ScratchScope
+	{
+		ScratchScope()
+		: arena(ScratchArena::get())
+		, savedChunk(arena.currentChunk)
+		, savedOffset(arena.currentOffset)
+		{
+		}
+
+		~ScratchScope()
+		{
+			arena.currentChunk = savedChunk;
+			arena.currentOffset = savedOffset;
+		}
+
+		ScratchScope(const ScratchScope&) = delete;
+		ScratchScope& operator=(const ScratchScope&) = delete;
+
+	private:
+		ScratchArena& arena;
+		ScratchArena::Chunk* savedChunk;
+		Uptr savedOffset;
+	};
+
+	// An allocator for standard containers that allocates from the calling thread's ScratchArena.
+	// Deallocating is a no-op: the memory is freed when the enclosing ScratchScope ends.
+	template<typename Element> struct ScratchAllocator
+	{
+		typedef Element value_type;
+
+		ScratchAllocator() {}
+		template<typename OtherElement> ScratchAllocator(const ScratchAllocator<OtherElement>&) {}
+
+		Element* allocate(std::size_t numElements)
+		{
+			if(numElements > UINTPTR_MAX / sizeof(Element))
+			{ Errors::fatal("Scratch allocation is too large"); }
+			return (Element*)ScratchArena::get().allocate(numElements * sizeof(Element),
+														  alignof(Element));
+		}
+		void deallocate(Element*, std::size_t) {}
+	};
+
+	template<typename A, typename B>
+	bool operator==(const ScratchAllocator<A>&, const ScratchAllocator<B>&)
+	{
+		return true;
+	}
+	template<typename A, typename B>
+	bool operator!=(const ScratchAllocator<A>&, const ScratchAllocator<B>&)
+	{
+		return false;
+	}
+
+	template<typename Element>
+	using ScratchVector = std::vector<Element, ScratchAllocator<Element>>;
+}
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/SharedBytes.h"
 
 #include <string.h>
 #include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -62,6 +64,22 @@ namespace WAVM { namespace Serialization {
 			return std::move(bytes);
 		}
 
+		// Returns the number of bytes that have been written to the stream.
+		Uptr getNumBytes() const { return bytes.size() ? Uptr(next - bytes.data()) : 0; }
+
+		// Returns a pointer to the bytes that have been written to the stream. The pointer is
+		// invalidated if a write extends the stream's buffer.
+		U8* getWrittenBytes() { return bytes.data(); }
+
+		// Moves the stream cursor back to an offset no greater than the number of bytes written,
+		// so the following writes overwrite the bytes after it. The bytes aren't discarded, so
+		// advancing the stream past them again leaves them unchanged.
+		void rewind(Uptr offset)
+		{
+			wavmAssert(offset <= getNumBytes());
+			next = bytes.data() + offset;
+		}
+
 	private:
 		std::vector<U8> bytes;
 
@@ -86,10 +104,19 @@ namespace WAVM { namespace Serialization {
 			isInput = true
 		};
 
-		InputStream(const U8* inNext, const U8* inEnd) : next(inNext), end(inEnd) {}
+		InputStream(const U8* inNext,
+					const U8* inEnd,
+					std::shared_ptr<const void> inBytesOwner = nullptr)
+		: next(inNext), end(inEnd), bytesOwner(std::move(inBytesOwner))
+		{
+		}
 
 		virtual Uptr capacity() const = 0;
 
+		// If the stream's bytes are kept alive by a shared owner, returns it. Byte sequences read
+		// from such a stream may be views of the stream's bytes instead of copies.
+		const std::shared_ptr<const void>& getBytesOwner() const { return bytesOwner; }
+
 		// Advances the stream cursor by numBytes, and returns a pointer to the previous stream
 		// cursor.
 		inline const U8* advance(Uptr numBytes)
@@ -108,9 +135,14 @@ namespace WAVM { namespace Serialization {
 			return next;
 		}
 
+		// Returns the number of bytes following the stream cursor that can be read without calling
+		// getMoreData.
+		Uptr getNumBufferedBytes() const { return Uptr(end - next); }
+
 	protected:
 		const U8* next;
 		const U8* end;
+		std::shared_ptr<const void> bytesOwner;
 
 		// Called when there isn't enough space in the buffer to satisfy a read from the stream.
 		// Should update next and end to point to a new buffer, and ensure that the new
@@ -121,7 +153,12 @@ namespace WAVM { namespace Serialization {
 	// An input stream that reads from a contiguous range of memory.
 	struct MemoryInputStream : InputStream
 	{
-		MemoryInputStream(const U8* begin, Uptr numBytes) : InputStream(begin, begin + numBytes) {}
+		MemoryInputStream(const U8* begin,
+						  Uptr numBytes,
+						  std::shared_ptr<const void> bytesOwner = nullptr)
+		: InputStream(begin, begin + numBytes, std::move(bytesOwner))
+		{
+		}
 		virtual Uptr capacity() const { return end - next; }
 
 	private:
@@ -211,11 +248,10 @@ namespace WAVM { namespace Serialization {
 		};
 	}
 
+	// Decodes a LEB128 integer that may be encoded in more than one byte, without checking that it
+	// is in the range of the serialized type.
 	template<typename Value, Uptr maxBits>
-	FORCEINLINE void serializeVarInt(InputStream& stream,
-									 Value& value,
-									 Value minValue,
-									 Value maxValue)
+	FORCEINLINE void decodeMultiByteVarInt(InputStream& stream, Value& value)
 	{
 		// First, read the variable number of input bytes into a fixed size buffer.
 		enum
@@ -225,14 +261,32 @@ namespace WAVM { namespace Serialization {
 		U8 bytes[maxBytes] = {0};
 		Uptr numBytes = 0;
 		I8 signExtendShift = (I8)sizeof(Value) * 8;
-		while(numBytes < maxBytes)
+		if(stream.getNumBufferedBytes() >= maxBytes)
 		{
-			U8 byte = *stream.advance(1);
-			bytes[numBytes] = byte;
-			++numBytes;
-			signExtendShift -= 7;
-			if(!(byte & 0x80)) { break; }
-		};
+			// If the longest possible encoding is buffered, read the bytes without checking for the
+			// end of the buffer before each byte, and advance the stream past them once.
+			const U8* nextByte = stream.peek(maxBytes);
+			while(numBytes < maxBytes)
+			{
+				const U8 byte = nextByte[numBytes];
+				bytes[numBytes] = byte;
+				++numBytes;
+				signExtendShift -= 7;
+				if(!(byte & 0x80)) { break; }
+			};
+			stream.advance(numBytes);
+		}
+		else
+		{
+			while(numBytes < maxBytes)
+			{
+				U8 byte = *stream.advance(1);
+				bytes[numBytes] = byte;
+				++numBytes;
+				signExtendShift -= 7;
+				if(!(byte & 0x80)) { break; }
+			};
+		}
 
 		// Ensure that the input does not encode more than maxBits of data.
 		enum
@@ -272,6 +326,26 @@ namespace WAVM { namespace Serialization {
 		// Sign extend the output integer to the full size of Value.
 		if(std::is_signed<Value>::value && signExtendShift > 0)
 		{ value = Value(value << signExtendShift) >> signExtendShift; }
+	}
+
+	template<typename Value, Uptr maxBits>
+	FORCEINLINE void serializeVarInt(InputStream& stream,
+									 Value& value,
+									 Value minValue,
+									 Value maxValue)
+	{
+		// Most LEB128 values are small enough to be encoded in a single byte, so decode that case
+		// without buffering the input. A single byte is always a valid encoding if maxBits >= 7.
+		const U8 firstByte = *stream.peek(1);
+		if(maxBits >= 7 && !(firstByte & 0x80))
+		{
+			stream.advance(1);
+			value = std::is_signed<Value>::value ? Value(I8(firstByte << 1) >> 1) : Value(firstByte);
+		}
+		else
+		{
+			decodeMultiByteVarInt<Value, maxBits>(stream, value);
+		}
 
 		// Check that the output integer is in the expected range.
 		if(value < minValue || value > maxValue)
@@ -357,6 +431,36 @@ namespace WAVM { namespace Serialization {
 		}
 	}
 
+	FORCEINLINE void serializeBytes(OutputStream& stream, const SharedBytes& bytes)
+	{
+		serializeBytes(stream, bytes.data(), bytes.size());
+	}
+	// Reads numBytes from the stream. If the stream's bytes have a shared owner, the result is a
+	// view of them; otherwise, the bytes are copied.
+	inline void serializeBytes(InputStream& stream, SharedBytes& outBytes, Uptr numBytes)
+	{
+		const U8* inputBytes = stream.advance(numBytes);
+		if(stream.getBytesOwner())
+		{ outBytes = SharedBytes(inputBytes, numBytes, stream.getBytesOwner()); }
+		else
+		{
+			outBytes = std::vector<U8>(inputBytes, inputBytes + numBytes);
+		}
+	}
+
+	inline void serialize(OutputStream& stream, SharedBytes& bytes)
+	{
+		Uptr size = bytes.size();
+		serializeVarUInt32(stream, size);
+		serializeBytes(stream, bytes);
+	}
+	inline void serialize(InputStream& stream, SharedBytes& bytes)
+	{
+		Uptr size = 0;
+		serializeVarUInt32(stream, size);
+		serializeBytes(stream, bytes, size);
+	}
+
 	template<typename Stream, typename Element, typename Allocator, typename SerializeElement>
 	void serializeArray(Stream& stream,
 						std::vector<Element, Allocator>& vector,
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <string.h>
+#include <vector>
+
+#include "WAVM/Inline/BasicTypes.h"
+
+namespace WAVM {
+	// An immutable sequence of bytes that is cheap to copy. The bytes are either owned by the
+	// SharedBytes (and shared by its copies), or are a view of bytes that are kept alive by some
+	// other shared owner, e.g. a memory-mapped file.
+	struct SharedBytes
+	{
+		SharedBytes() : bytes(nullptr), numBytes(0) {}
+
+		SharedBytes(std::vector<U8>&& vector)
+		{
+			std::shared_ptr<const std::vector<U8>> ownedVector
+				= std::make_shared<const std::vector<U8>>(std::move(vector));
+			bytes = ownedVector->data();
+			numBytes = ownedVector->size();
+			owner = std::move(ownedVector);
+		}
+
+		SharedBytes(const std::vector<U8>& vector) : SharedBytes(std::vector<U8>(vector)) {}
+
+		// Creates a view of numBytes bytes at inBytes, which must remain valid as long as inOwner
+		// is referenced.
+		SharedBytes(const U8* inBytes, Uptr inNumBytes, std::shared_ptr<const void> inOwner)
+		: bytes(inBytes), numBytes(inNumBytes), owner(std::move(inOwner))
+		{
+		}
+
+		const U8* data() const { return bytes; }
+		Uptr size() const { return numBytes; }
+		bool empty() const { return numBytes == 0; }
+
+		const U8* begin() const { return bytes; }
+		const U8* end() const { return bytes + numBytes; }
+
+		const U8& operator[](Uptr index) const { return bytes[index]; }
+
+		// Returns the shared owner that keeps the bytes alive.
+		const std::shared_ptr<const void>& getOwner() const { return owner; }
+
+		friend bool operator==(const SharedBytes& a, const SharedBytes& b)
+		{
+			return a.numBytes == b.numBytes
+				   && (a.bytes == b.bytes || !memcmp(a.bytes, b.bytes, a.numBytes));
+		}
+		friend bool operator!=(const SharedBytes& a, const SharedBytes& b) { return !(a == b); }
+
+	private:
+		const U8* bytes;
+		Uptr numBytes;
+		std::shared_ptr<const void> owner;
+	};
+}
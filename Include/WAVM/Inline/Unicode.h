@@ -1,7 +1,17 @@
 #pragma once
 
+#include <string.h>
 #include "BasicTypes.h"
 #include "WAVM/Inline/Assert.h"
+#include "WAVM/Platform/Intrinsic.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UNICODE_USE_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UNICODE_USE_NEON 1
+#endif
 
 namespace WAVM { namespace Unicode {
 	template<typename String> void encodeUTF8CodePoint(U32 codePoint, String& outString)
@@ -58,7 +68,7 @@ namespace WAVM { namespace Unicode {
 			}
 			else if(*nextChar == 0xed)
 			{
-				if(nextChar + 2 >= endChar || nextChar[1] < 0xa0 || nextChar[1] > 0x9f
+				if(nextChar + 2 >= endChar || nextChar[1] < 0x80 || nextChar[1] > 0x9f
 				   || nextChar[2] < 0x80 || nextChar[2] > 0xbf)
 				{ return false; }
 			}
@@ -139,11 +149,51 @@ namespace WAVM { namespace Unicode {
 		}
 	}
 
+	// Returns a pointer to the first byte in [nextChar, endChar) that isn't an ASCII character, or
+	// endChar if they are all ASCII.
+	inline const U8* skipASCIIChars(const U8* nextChar, const U8* endChar)
+	{
+#if UNICODE_USE_SSE2
+		while(endChar - nextChar >= 16)
+		{
+			const U32 nonASCIIMask
+				= U32(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)nextChar)));
+			if(nonASCIIMask) { return nextChar + Platform::countTrailingZeroes(nonASCIIMask); }
+			nextChar += 16;
+		}
+#elif UNICODE_USE_NEON
+		while(endChar - nextChar >= 16 && vmaxvq_u8(vld1q_u8(nextChar)) < 0x80) { nextChar += 16; }
+#else
+		while(endChar - nextChar >= 8)
+		{
+			U64 chars;
+			memcpy(&chars, nextChar, sizeof(chars));
+			if(chars & 0x8080808080808080ull) { break; }
+			nextChar += 8;
+		}
+#endif
+		while(nextChar != endChar && *nextChar < 0x80) { ++nextChar; }
+		return nextChar;
+	}
+
+	// Returns a pointer to the first byte in [nextChar, endChar) that doesn't start a valid UTF-8
+	// encoded code point, or endChar if the bytes are a valid UTF-8 string. Runs of ASCII
+	// characters, which make up most of the names in WebAssembly modules, are skipped a vector at
+	// a time; only the other characters are decoded.
 	inline const U8* validateUTF8String(const U8* nextChar, const U8* endChar)
 	{
 		U32 codePoint;
-		while(nextChar != endChar && decodeUTF8CodePoint(nextChar, endChar, codePoint)) {};
-		return nextChar;
+		while(true)
+		{
+			nextChar = skipASCIIChars(nextChar, endChar);
+			if(nextChar == endChar) { return nextChar; }
+
+			// Decode the non-ASCII characters up to the next ASCII character.
+			do
+			{
+				if(!decodeUTF8CodePoint(nextChar, endChar, codePoint)) { return nextChar; }
+			} while(nextChar != endChar && *nextChar >= 0x80);
+		}
 	}
 
 	template<typename String> void encodeUTF16CodePoint(U32 codePoint, String& outString)
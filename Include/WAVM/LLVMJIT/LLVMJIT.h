@@ -1,10 +1,12 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/HashMap.h"
 
@@ -23,41 +25,358 @@ namespace WAVM { namespace Runtime {
 }}
 
 namespace WAVM { namespace LLVMJIT {
+	// Which optimization passes the compiler runs on a module.
+	enum class OptimizationLevel
+	{
+		// Only promotes locals to SSA values, and generates code with the fastest code generator
+		// settings. Used for the baseline tier of tiered compilation.
+		none,
+
+		// Runs a short list of cheap optimization passes.
+		fast,
+
+		// Similar to LLVM's -O2: adds inlining of small functions, redundancy elimination, loop
+		// invariant code motion, loop unrolling, and straight-line code vectorization.
+		standard,
+
+		// Similar to LLVM's -O3: adds loop vectorization, more aggressive scalar optimizations,
+		// and inlining of larger functions.
+		aggressive,
+	};
+
+	// How much effort the code generator spends on optimizing the machine code for a module.
+	enum class CodeGenOptimizationLevel
+	{
+		// Chosen according to the OptimizationLevel.
+		automatic,
+
+		none,
+		less,
+		standard,
+		aggressive,
+	};
+
+	// A profile of the execution of a module's code, collected by code compiled with
+	// CompileOptions::profileInstrumentation. Operators are identified by the index of their
+	// function definition, and their index in the function definition's code.
+	struct ModuleProfile
+	{
+		// The number of times each function definition was called.
+		std::vector<U64> functionDefEntryCounts;
+
+		// The number of processor cycles spent in each function definition's calls, including the
+		// cycles spent in its callees. Only counted by code compiled with
+		// CompileOptions::profileCycles, and not counted for calls that are unwound by an
+		// exception.
+		std::vector<U64> functionDefCycleCounts;
+
+		// The number of times each branch of the if, br_if, and br_table operators that were
+		// executed was taken: for if and br_if, the number of times the condition was true,
+		// followed by the number of times it was false; for br_table, the number of times each
+		// target in the table was taken, followed by the number of times the default target was.
+		std::map<std::pair<Uptr, Uptr>, std::vector<U64>> branchCounts;
+
+		// The index of the function most frequently called by each call_indirect operator that
+		// called a function of the module instance the profile was collected from.
+		std::map<std::pair<Uptr, Uptr>, Uptr> indirectCallees;
+	};
+
+	// A CPU and features to compile a version of a module's code for (see
+	// CompileOptions::targetVersions).
+	struct TargetVersion
+	{
+		std::string targetCPU;
+		std::vector<std::string> targetFeatures;
+	};
+
+	// Observes the progress of compiling a module, and may cancel it. The methods may be called
+	// concurrently by the threads compiling the partitions of a module.
+	struct CompileMonitor
+	{
+		virtual ~CompileMonitor() {}
+
+		// Called before each partition of the module's function definitions is emitted. It may
+		// block, e.g. to yield the thread to a more urgent compile. If it returns false, the
+		// compile is cancelled: the remaining partitions are skipped, and the compile functions
+		// return empty object code.
+		virtual bool beginPartition() = 0;
+
+		// Called after numFunctionDefs function definitions were emitted to LLVM IR, and after
+		// they were compiled to object code.
+		virtual void onFunctionDefsEmitted(Uptr numFunctionDefs) = 0;
+		virtual void onFunctionDefsCompiled(Uptr numFunctionDefs) = 0;
+	};
+
+	// Options that control how a module is compiled.
+	struct CompileOptions
+	{
+		OptimizationLevel optimizationLevel = OptimizationLevel::fast;
+		CodeGenOptimizationLevel codeGenOptimizationLevel = CodeGenOptimizationLevel::automatic;
+
+		// The CPU to generate code for, using LLVM's CPU names (e.g. "skylake"). If empty, code is
+		// generated for the host CPU.
+		std::string targetCPU;
+
+		// LLVM target features to enable or disable (e.g. "+avx2" or "-avx512f"), in addition to
+		// those implied by the target CPU and the LLVM_TARGET_ATTRIBUTES build option.
+		std::vector<std::string> targetFeatures;
+
+		// Additional targets that compileModule compiles versions of the module's code for, in
+		// order of preference. loadModule loads the first version whose target the host CPU
+		// supports, or the version for targetCPU and targetFeatures if the host doesn't support
+		// any of them. This allows object code compiled ahead of time for a baseline CPU to use
+		// the features of more capable hosts.
+		std::vector<TargetVersion> targetVersions;
+
+		// If true, memory accesses are checked against the number of bytes of address space
+		// reserved for the memory, instead of relying on the memory having 8GiB of address space
+		// reserved, so the code may access memories with smaller reservations.
+		bool memoryBoundsChecks = false;
+
+		// If true, function entries and loop headers check whether the epoch counter bound by
+		// loadModule has reached the deadline in the ContextRuntimeData the code is running in,
+		// and call the epochDeadlineReached WAVM intrinsic if it has.
+		bool epochInterruption = false;
+
+		// If true, each straight-line run of operators subtracts its number of operators from the
+		// fuel in the ContextRuntimeData the code is running in when it is entered, and calls the
+		// fuelExhausted WAVM intrinsic if the fuel becomes negative.
+		bool fuelMetering = false;
+
+		// If true, function entries check whether the stack pointer is below the stack limit in the
+		// ContextRuntimeData the code is running in, and call the stackOverflowTrap WAVM intrinsic
+		// if it is.
+		bool stackLimitChecks = false;
+
+		// If true, floating-point operators that may produce a NaN replace it with the positive
+		// canonical NaN, so the code's results don't depend on the NaN propagation of the host CPU.
+		bool canonicalizeNaNs = false;
+
+		// If true, each load and store to a memory (including atomic operators) decrements the
+		// memory access sample countdown in the ContextRuntimeData the code is running in, and
+		// calls the memoryAccessSampled WAVM intrinsic with the accessed address when it reaches
+		// zero.
+		bool memoryAccessSampling = false;
+
+		// If true, the non-atomic loads and stores of memories that aren't shared aren't volatile,
+		// so the optimizer may remove, combine, reorder, and vectorize them. Out-of-bounds accesses
+		// still trap, but an out-of-bounds load whose result is unused may be removed, and a trap
+		// may leave the memory with more or fewer of the surrounding stores than WebAssembly
+		// specifies.
+		bool relaxedMemoryAccesses = false;
+
+		// If true, the module's function definitions keep a frame pointer, so their call stacks
+		// may be sampled by following the frame pointers instead of unwinding them.
+		bool framePointers = false;
+
+		// The functions that call_indirect operators are speculated to call, e.g. the callees
+		// observed by a profile of the module. Maps a function definition index, and the index of a
+		// call_indirect operator in the function definition's code, to the index of the function it
+		// is speculated to call. A speculated call_indirect compares the table element to the
+		// speculated callee, and if they match calls it directly, without checking its type.
+		std::map<std::pair<Uptr, Uptr>, Uptr> speculatedIndirectCallees;
+
+		// Maps the indices of immutable imported globals to the values that the code is
+		// specialized for: get_global of one of the globals is compiled to its value, instead of a
+		// load from the imported global, so the value may be constant folded into the code that
+		// uses it. The code may only be bound to imported globals with the same values.
+		std::map<Uptr, IR::Value> specializedGlobalImports;
+
+		// If true, the code counts the calls to each function definition, the branches taken by
+		// each if, br_if, and br_table operator, and the most frequent callee of each
+		// call_indirect operator in the profile counters bound by loadModule. The counters aren't
+		// updated atomically, so counts may be lost if the code runs on multiple threads.
+		bool profileInstrumentation = false;
+
+		// If true, code compiled with profileInstrumentation also reads the processor's cycle
+		// counter (e.g. rdtsc on x86-64) when each function definition is entered and when it
+		// returns, and adds the difference to the function definition's cycle count.
+		bool profileCycles = false;
+
+		// If non-null, a profile of the module used to optimize the code for the paths that were
+		// hot when it was collected: function definitions are annotated with their entry counts,
+		// branches with their profiled weights, and call_indirect operators that aren't in
+		// speculatedIndirectCallees are speculated to call their most frequent profiled callee.
+		std::shared_ptr<const ModuleProfile> profile;
+
+		// The number of threads to compile the module's function definitions on. If it is greater
+		// than one, the function definitions are split into partitions that are compiled in
+		// parallel into separate object files, which are linked together by loadModule. If it is
+		// zero, one thread is used for each hardware thread.
+		Uptr numThreads = 1;
+
+		// The minimum number of function definitions in a partition. Modules with too few function
+		// definitions to split into more than one partition are compiled on the calling thread.
+		Uptr minFunctionDefsPerPartition = 32;
+
+		// If non-null, observes the progress of compileModule and compileFunctionDefs, and may
+		// cancel them. It doesn't affect the generated object code.
+		CompileMonitor* monitor = nullptr;
+	};
+
+	// Returns a string that describes the compiler and the target machine compileModule generates
+	// code for with the given options. Object code compiled by a WAVM with a different target
+	// description is not compatible with this WAVM.
+	LLVMJIT_API std::string getTargetDescription(const CompileOptions& options = CompileOptions());
+
+	// Returns whether the host CPU supports all the instruction set features of a target CPU with
+	// additional target features. If targetCPU is empty, it's the host CPU.
+	LLVMJIT_API bool isTargetSupportedByHost(const std::string& targetCPU,
+											 const std::vector<std::string>& targetFeatures);
+
 	// Compiles a module to object code.
-	LLVMJIT_API std::vector<U8> compileModule(const IR::Module& irModule);
+	LLVMJIT_API std::vector<U8> compileModule(const IR::Module& irModule,
+											  const CompileOptions& options = CompileOptions());
+
+	// Compiles a subset of a module's function definitions to object code. The object code
+	// references the module's other function definitions as undefined symbols, which must be bound
+	// by the functionDefs passed to loadModule.
+	LLVMJIT_API std::vector<U8> compileFunctionDefs(
+		const IR::Module& irModule,
+		const std::vector<Uptr>& functionDefIndices,
+		const CompileOptions& options = CompileOptions());
+
+	// Compiles a module's function definitions in partitions of consecutive definitions, and
+	// returns the object code in the same form as compileModule. partitionBeginFunctionDefIndices
+	// holds the index of the first function definition in each partition, followed by the number
+	// of function definitions. A partition that has non-empty object code in partitionObjects is
+	// not recompiled: its object code is reused, so it must have been compiled by this function
+	// from the same function definitions and declarations, with the same options. Identical
+	// function definitions aren't folded, so the object code of a partition doesn't depend on the
+	// module's other function definitions. The options must not have target versions.
+	LLVMJIT_API std::vector<U8> compilePartitions(
+		const IR::Module& irModule,
+		const std::vector<Uptr>& partitionBeginFunctionDefIndices,
+		std::vector<std::vector<U8>>&& partitionObjects,
+		const CompileOptions& options = CompileOptions());
+
+	// Splits object code returned by compileModule or compilePartitions into the object files of
+	// its partitions. Returns false if the object code has more than one target version.
+	LLVMJIT_API bool getPartitionObjects(const std::vector<U8>& objectCode,
+										 std::vector<std::vector<U8>>& outPartitionObjects);
+
+	// Returns the number of U64 profile counters that must be passed to loadModule for object
+	// code compiled from a module with profileInstrumentation. The counters are zero-initialized
+	// by the caller, and may be shared by all instances of the module.
+	LLVMJIT_API Uptr getNumProfileCounters(const IR::Module& irModule);
+
+	// Reads a profile from the counters updated by object code compiled from a module with
+	// profileInstrumentation. anyFuncFunctionIndices maps the addresses of the AnyFuncs a module
+	// instance's code may call indirectly to their function index in the module; callees without
+	// an entry are omitted from the profile.
+	LLVMJIT_API ModuleProfile getModuleProfile(const IR::Module& irModule,
+											   const U64* profileCounters,
+											   const HashMap<Uptr, Uptr>& anyFuncFunctionIndices);
+
+	// Compiles a module's function definitions while the module is still being decoded (see
+	// WASM::createStreamingDecoder). beginStreamingCompile may be called once the module's
+	// declarations are decoded. After that, addDecodedFunctionDefs is called each time more function
+	// definition bodies have been decoded, and the decoded function definitions are compiled in
+	// partitions on background threads. The module must not be modified, except to decode the bodies
+	// of function definitions that haven't been added yet, until the compile is finished or
+	// cancelled.
+	struct StreamingCompile;
+	LLVMJIT_API StreamingCompile* beginStreamingCompile(
+		const IR::Module& irModule,
+		const CompileOptions& options = CompileOptions());
+
+	// Adds the function definitions up to numDecodedFunctionDefs, whose bodies must be decoded, to
+	// a streaming compile.
+	LLVMJIT_API void addDecodedFunctionDefs(StreamingCompile* compile, Uptr numDecodedFunctionDefs);
+
+	// Waits for all the module's function definitions, which must have been added, to be compiled,
+	// deletes the streaming compile, and returns the module's object code in the same form as
+	// compileModule.
+	LLVMJIT_API std::vector<U8> finishStreamingCompile(StreamingCompile* compile);
+
+	// Waits for the partitions that are being compiled to finish, and deletes the streaming compile
+	// without compiling the rest of the module.
+	LLVMJIT_API void cancelStreamingCompile(StreamingCompile* compile);
+
+	// Maps the offset of an instruction in a JIT function to the index of the operator it was
+	// compiled from.
+	struct JITFunctionOpIndex
+	{
+		U32 offset;
+		U32 opIndex;
+	};
 
 	// Information about a JIT function, used to map addresses to information about the function.
+	// The JITFunctions of a loaded module are stored contiguously, sorted by address.
 	struct JITFunction
 	{
-		enum class Type
+		enum class Type : U8
 		{
 			unknown,
 			wasmFunction,
 			invokeThunk,
-			intrinsicThunk
+			intrinsicThunk,
+			lazyCompileStub
 		};
 		Type type;
+		U32 numOpIndices;
+		Uptr baseAddress;
+		Uptr numBytes;
 		union
 		{
 			Runtime::FunctionInstance* functionInstance;
 			IR::FunctionType invokeThunkType;
 		};
-		Uptr baseAddress;
-		Uptr numBytes;
-		std::map<U32, U32> offsetToOpIndexMap;
 
-		JITFunction(Uptr inBaseAddress, Uptr inNumBytes, std::map<U32, U32>&& inOffsetToOpIndexMap)
+		// The function's operator indices, sorted by offset. They are owned by the loaded module.
+		const JITFunctionOpIndex* opIndices;
+
+		JITFunction(Uptr inBaseAddress, Uptr inNumBytes)
 		: type(Type::unknown)
+		, numOpIndices(0)
 		, baseAddress(inBaseAddress)
 		, numBytes(inNumBytes)
-		, offsetToOpIndexMap(inOffsetToOpIndexMap)
+		, functionInstance(nullptr)
+		, opIndices(nullptr)
+		{
+		}
+
+		// Returns the index of the operator that the instruction at the given offset was compiled
+		// from, or -1 if it isn't known.
+		Iptr getOpIndexByOffset(U32 offset) const
 		{
+			Uptr begin = 0;
+			Uptr end = numOpIndices;
+			while(begin < end)
+			{
+				const Uptr middle = begin + (end - begin) / 2;
+				if(opIndices[middle].offset <= offset) { begin = middle + 1; }
+				else
+				{
+					end = middle;
+				}
+			}
+			return begin ? Iptr(opIndices[begin - 1].opIndex) : -1;
 		}
 	};
 
 	// An opaque type that can be used to reference a loaded JIT module.
 	struct LoadedModule;
 
+	// An opaque type that allocates the code and data of the JIT modules loaded into it from a
+	// shared pool of virtual pages. Unloading a module decommits its pages, and the arena's virtual
+	// pages are freed in bulk once the arena has been released and all the modules loaded into it
+	// have been unloaded.
+	struct CodeArena;
+
+	// Creates a code arena. By default, each module's code is executable but not writable once the
+	// module is loaded, and its read-only data isn't writable. If packImages is true and the host
+	// supports dual-mapped pages, the modules are instead packed together into pages that are
+	// mapped both writable and executable at a fixed offset from each other, so loading a module
+	// doesn't change the access of any pages, and small modules don't use whole pages for each of
+	// their sections. The packed pages are freed once all the modules that shared them have been
+	// unloaded. Since any code that can write to the writable view can modify the code and
+	// read-only data, packImages should only be used by hosts that accept that risk.
+	LLVMJIT_API CodeArena* createCodeArena(bool packImages = false);
+
+	// Releases the reference to an arena returned by createCodeArena.
+	LLVMJIT_API void releaseCodeArena(CodeArena* codeArena);
+
 	//
 	// Structs that are passed to loadModule to bind undefined symbols in object code to values.
 	//
@@ -88,11 +407,21 @@ namespace WAVM { namespace LLVMJIT {
 	};
 
 	// Loads a module from object code, and binds its undefined symbols to the provided bindings.
+	// functionDefs may be empty if the object code defines all the module's function definitions;
+	// if it doesn't, functionDefs binds the function definitions the object code doesn't define,
+	// and the corresponding elements of outFunctionDefs are null.
+	// If codeArena is non-null, the module's code and data are allocated from it. epochAddress is
+	// the address of the U64 epoch counter checked by code compiled with epochInterruption, and
+	// profileCountersAddress is the address of the counters updated by code compiled with
+	// profileInstrumentation (see getNumProfileCounters). If the module's functions are described
+	// to profilers (see Platform::setJITProfilerOutput), the function definitions are named by
+	// functionDefNames, which may be empty otherwise.
 	LLVMJIT_API LoadedModule* loadModule(
 		const std::vector<U8>& objectFileBytes,
 		HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
 		std::vector<IR::FunctionType>&& types,
 		std::vector<FunctionBinding>&& functionImports,
+		std::vector<FunctionBinding>&& functionDefs,
 		std::vector<TableBinding>&& tables,
 		std::vector<MemoryBinding>&& memories,
 		std::vector<GlobalBinding>&& globals,
@@ -101,25 +430,90 @@ namespace WAVM { namespace LLVMJIT {
 		TableBinding defaultTable,
 		Runtime::ModuleInstance* moduleInstance,
 		Uptr tableReferenceBias,
+		Uptr epochAddress,
+		Uptr profileCountersAddress,
 		const std::vector<Runtime::FunctionInstance*>& functionDefInstances,
-		std::vector<JITFunction*>& outFunctionDefs);
+		const std::vector<std::string>& functionDefNames,
+		std::vector<JITFunction*>& outFunctionDefs,
+		CodeArena* codeArena = nullptr);
 
 	// Unloads a JIT module, freeings its memory.
 	LLVMJIT_API void unloadModule(LoadedModule* loadedModule);
 
+	// Returns the number of bytes of pages committed for a JIT module's code and data.
+	LLVMJIT_API Uptr getLoadedModuleNumBytes(LoadedModule* loadedModule);
+
+	// Sets whether the modules loaded after it is called register their object code with
+	// debuggers through the GDB JIT interface (__jit_debug_register_code), so GDB and LLDB can
+	// symbolize and step through their code. The line numbers in the object code's DWARF line
+	// tables are the indices of the operators each instruction was compiled from. A module is
+	// deregistered when it is unloaded. Registration is disabled by default, in which case loaded
+	// modules don't retain a copy of their object code.
+	LLVMJIT_API void setDebuggerRegistrationEnabled(bool enable);
+
 	// Finds the JIT function whose code contains the given address. If no JIT function contains the
 	// given address, returns null.
 	LLVMJIT_API JITFunction* getJITFunctionByAddress(Uptr address);
 
-	typedef Runtime::ContextRuntimeData* (*InvokeThunkPointer)(void*, Runtime::ContextRuntimeData*);
+	typedef Runtime::ContextRuntimeData* (
+		*InvokeThunkPointer)(void*, Runtime::ContextRuntimeData*, const U8*);
 
-	// Generates an invoke thunk for a specific function type.
+	// Generates an invoke thunk for a specific function type. The thunk reads the function's
+	// arguments from its third parameter, naturally aligning each, and writes the function's
+	// results to the thunkArgAndReturnData of the ContextRuntimeData it returns.
+	// The first call also generates the thunks for the most commonly invoked WebAssembly function
+	// types in the same module.
 	LLVMJIT_API InvokeThunkPointer getInvokeThunk(IR::FunctionType functionType,
 												  IR::CallingConvention callingConvention);
 
-	// Generates a thunk to call a native function from generated code.
+	// Generates a thunk to call a native function from generated code. If constantResult is
+	// non-null, the native function has no side effects, and the thunk returns *constantResult (or
+	// nothing if the function type has no results) without calling it. If isLeaf is true, the
+	// native function doesn't use its ContextRuntimeData and can't throw, so the thunk calls it
+	// as a tail call that can't unwind. If closure is non-null, the thunk passes it to the native
+	// function as an I64 argument before the function's parameters, and the thunk isn't shared
+	// with other calls to the same native function.
 	LLVMJIT_API void* getIntrinsicThunk(void* nativeFunction,
 										const Runtime::FunctionInstance* functionInstance,
 										IR::FunctionType functionType,
-										IR::CallingConvention callingConvention);
+										IR::CallingConvention callingConvention,
+										const IR::UntaggedValue* constantResult = nullptr,
+										bool isLeaf = false,
+										const void* closure = nullptr);
+
+	// The arguments to getIntrinsicThunk for one of the thunks generated by getIntrinsicThunks.
+	struct IntrinsicThunkRequest
+	{
+		void* nativeFunction;
+		const Runtime::FunctionInstance* functionInstance;
+		IR::FunctionType functionType;
+		IR::CallingConvention callingConvention;
+		const IR::UntaggedValue* constantResult;
+		bool isLeaf;
+		const void* closure;
+	};
+
+	// Generates the thunks for many native functions at once, compiling them all in a single
+	// module. Returns the thunk for each request, in the same order as the requests.
+	LLVMJIT_API std::vector<void*> getIntrinsicThunks(
+		const std::vector<IntrinsicThunkRequest>& requests);
+
+	// Called by a lazy compile stub to get the code it should forward the call to.
+	typedef void* (*LazyCompileFunction)(Runtime::FunctionInstance* functionInstance,
+										 Uptr functionDefIndex);
+
+	// Generates a lazy compile stub for each of a module instance's function definitions. A stub
+	// has the same signature as the function definition, and is prefixed by an AnyFunc for the
+	// function definition's FunctionInstance. When called, it calls lazyCompile with the
+	// FunctionInstance and the index of the function definition, and forwards the call to the code
+	// it returns. The stubs are returned as JITFunctions in outStubs. If codeArena is non-null, the
+	// stubs are allocated from it. Like loadModule, the stubs are named to profilers by
+	// functionDefNames.
+	LLVMJIT_API LoadedModule* loadLazyCompileStubs(
+		const std::vector<Runtime::FunctionInstance*>& functionDefInstances,
+		const std::vector<IR::FunctionType>& functionDefTypes,
+		const std::vector<std::string>& functionDefNames,
+		LazyCompileFunction lazyCompile,
+		std::vector<JITFunction*>& outStubs,
+		CodeArena* codeArena = nullptr);
 }}
@@ -21,4 +21,18 @@ namespace WAVM { namespace Log {
 	// Print some categorized, formatted string, and flush the output. Newline is not included.
 	LOGGING_API void printf(Category category, const char* format, ...) VALIDATE_AS_PRINTF(2, 3);
 	LOGGING_API void vprintf(Category category, const char* format, va_list argList);
+
+	// If enable is true, makes the output of the following calls to printf asynchronous: the
+	// messages are formatted on the calling thread, and added to a buffer owned by it, and a
+	// background thread writes the buffered messages to stdout. A thread's messages are written in
+	// the order it printed them, but the messages printed by different threads may be interleaved
+	// differently than they were printed. Messages in the error category are still written
+	// synchronously, after the buffered messages. If enable is false, waits for the background
+	// thread to write the buffered messages, and stops it. It must not be called concurrently with
+	// printf.
+	LOGGING_API void setAsyncOutput(bool enable);
+
+	// Writes the buffered asynchronous output to stdout, and flushes it. It is called on exit once
+	// the output has been made asynchronous.
+	LOGGING_API void flushOutput();
 }}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Intrinsic.h"
+
+// Machine-readable metrics, which monitoring can read from a running process with getMetrics.
+namespace WAVM { namespace Metrics {
+	enum class Type
+	{
+		counter,
+		gauge,
+		histogram
+	};
+
+	// A named metric. Metrics are registered when they are constructed, and are never
+	// unregistered, so they must have static storage duration.
+	struct Metric
+	{
+		const char* const name;
+		const char* const description;
+		const Type type;
+
+		// Don't allow copying or moving a Metric.
+		Metric(const Metric&) = delete;
+		Metric(Metric&&) = delete;
+		void operator=(const Metric&) = delete;
+		void operator=(Metric&&) = delete;
+
+	protected:
+		LOGGING_API Metric(const char* inName, const char* inDescription, Type inType);
+	};
+
+	// A value that only increases, e.g. the number of times something happened.
+	struct Counter : Metric
+	{
+		Counter(const char* inName, const char* inDescription)
+		: Metric(inName, inDescription, Type::counter)
+		{
+		}
+
+		void add(U64 delta = 1) { value.fetch_add(delta, std::memory_order_relaxed); }
+		U64 get() const { return value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<U64> value{0};
+	};
+
+	// A value that may increase or decrease, e.g. the number of objects that are alive.
+	struct Gauge : Metric
+	{
+		Gauge(const char* inName, const char* inDescription)
+		: Metric(inName, inDescription, Type::gauge)
+		{
+		}
+
+		void add(I64 delta) { value.fetch_add(delta, std::memory_order_relaxed); }
+		I64 get() const { return value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<I64> value{0};
+	};
+
+	// The distribution of a value that is recorded many times, e.g. the duration of an operation.
+	// The recorded values are counted in power-of-two buckets: bucket 0 counts the zeroes, and
+	// bucket i > 0 counts the values in [2^(i-1), 2^i).
+	struct Histogram : Metric
+	{
+		static constexpr Uptr numBuckets = 65;
+
+		Histogram(const char* inName, const char* inDescription)
+		: Metric(inName, inDescription, Type::histogram)
+		{
+		}
+
+		void record(U64 value)
+		{
+			count.fetch_add(1, std::memory_order_relaxed);
+			sum.fetch_add(value, std::memory_order_relaxed);
+			bucketCounts[64 - Platform::countLeadingZeroes(value)].fetch_add(
+				1, std::memory_order_relaxed);
+		}
+
+		U64 getCount() const { return count.load(std::memory_order_relaxed); }
+		U64 getSum() const { return sum.load(std::memory_order_relaxed); }
+		U64 getBucketCount(Uptr bucketIndex) const
+		{
+			return bucketCounts[bucketIndex].load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<U64> count{0};
+		std::atomic<U64> sum{0};
+		std::atomic<U64> bucketCounts[numBuckets] = {};
+	};
+
+	// A snapshot of a metric's value. The fields are read separately while other threads may be
+	// updating the metric, so a histogram's count, sum, and bucket counts may be inconsistent.
+	struct MetricValue
+	{
+		std::string name;
+		std::string description;
+		Type type;
+
+		// The value of a counter or gauge.
+		I64 value = 0;
+
+		// The number of values recorded by a histogram, their sum, and the number in each bucket.
+		U64 count = 0;
+		U64 sum = 0;
+		std::vector<U64> bucketCounts;
+	};
+
+	// Returns the current values of all the registered metrics, sorted by name.
+	LOGGING_API std::vector<MetricValue> getMetrics();
+}}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Platform/Defines.h"
+
+// A recorder of the spans of time that threads spend in the phases of loading a module, e.g.
+// compiling, linking, and instantiating it. Unlike the metrics, the spans show when each phase ran
+// on each thread, so they show how phases overlap on multiple threads. The spans can be written as
+// Chrome trace event JSON, which chrome://tracing and Perfetto can display.
+namespace WAVM { namespace Trace {
+	// Starts or stops recording spans. Starting discards the spans recorded by an earlier start.
+	LOGGING_API void setEnabled(bool enable);
+	LOGGING_API bool isEnabled();
+
+	// Returns the spans recorded since recording was started, as Chrome trace event JSON.
+	LOGGING_API std::string getChromeTraceJSON();
+
+	// Records a span that begins and ends at the given getMonotonicClock times on the current
+	// thread. The name must have static storage duration.
+	LOGGING_API void recordSpan(const char* name, U64 beginMicroseconds, U64 endMicroseconds);
+	LOGGING_API U64 getClockMicroseconds();
+
+	// Records a span from its construction to its destruction, if recording was enabled when it
+	// was constructed. The name must have static storage duration.
+	struct Span
+	{
+		Span(const char* inName)
+		: name(inName), beginMicroseconds(isEnabled() ? getClockMicroseconds() : UINT64_MAX)
+		{
+		}
+		~Span()
+		{
+			if(beginMicroseconds != UINT64_MAX)
+			{ recordSpan(name, beginMicroseconds, getClockMicroseconds()); }
+		}
+
+		// Don't allow copying or moving a Span.
+		Span(const Span&) = delete;
+		Span(Span&&) = delete;
+		void operator=(const Span&) = delete;
+		void operator=(Span&&) = delete;
+
+	private:
+		const char* name;
+		U64 beginMicroseconds;
+	};
+}}
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace WAVM { namespace Runtime {
+	struct Compartment;
+	struct ModuleInstance;
+}}
+
+namespace WAVM { namespace ParallelFor {
+	// Instantiates the parallelFor intrinsic module in a compartment. Its parallel_for function,
+	// with type (funcref, i32 begin, i32 end, i32 grain) -> (), calls a guest function with type
+	// (i32, i32) -> () for consecutive ranges of at most grain indices that cover [begin, end). The
+	// ranges are run by the calling thread and a pool of worker threads, one for each other
+	// hardware thread, which steal ranges from each other. Each worker calls the guest function in
+	// its own Context in the caller's compartment, so the guest's memory should be shared. If a
+	// call traps, no more ranges are started, and parallel_for throws the first exception once the
+	// ranges that were already started have finished.
+	PARALLELFOR_API Runtime::ModuleInstance* instantiate(Runtime::Compartment* compartment);
+}}
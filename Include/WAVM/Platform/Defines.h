@@ -27,11 +27,13 @@
 #define VALIDATE_AS_PRINTF(formatStringIndex, firstFormatArgIndex)                                 \
 	__attribute__((format(printf, formatStringIndex, firstFormatArgIndex)))
 #define UNLIKELY(condition) __builtin_expect(condition, 0)
+#define HAS_COMPUTED_GOTO 1
 #else
 #define NO_ASAN
 #define RETURNS_TWICE
 #define VALIDATE_AS_PRINTF(formatStringIndex, firstFormatArgIndex)
 #define UNLIKELY(condition) (condition)
+#define HAS_COMPUTED_GOTO 0
 #endif
 
 #if defined(__clang__) && WAVM_ENABLE_UBSAN
@@ -40,4 +40,54 @@ namespace WAVM { namespace Platform {
 
 	// Describes an instruction pointer.
 	PLATFORM_API bool describeInstructionPointer(Uptr ip, std::string& outDescription);
+
+	//
+	// Profiler integration
+	//
+
+	// Maps an offset in a JIT function's code to a line of the source it was compiled from.
+	struct JITFunctionLine
+	{
+		U32 offset;
+		U32 line;
+	};
+
+	// Enables describing JIT functions to sampling profilers. If perfMap is true,
+	// registerJITFunction appends a line for each function to /tmp/perf-<pid>.map, which Linux
+	// perf reads to symbolize addresses in anonymous memory. If jitDump is true, it appends the
+	// function's code and line info to /tmp/jit-<pid>.dump in the jitdump format, which
+	// "perf inject --jit" uses to annotate the functions in a profile recorded with
+	// "perf record -k 1". Should be called before any JIT functions are registered. Returns false
+	// if the outputs aren't supported by the platform or couldn't be created.
+	PLATFORM_API bool setJITProfilerOutput(bool perfMap, bool jitDump);
+
+	// Returns whether setJITProfilerOutput has enabled any profiler outputs.
+	PLATFORM_API bool isJITProfilerOutputEnabled();
+
+	// Describes a JIT function's code to the profiler outputs enabled by setJITProfilerOutput. The
+	// lines are sorted by offset, and are written to the jitdump with the function name as their
+	// source file name.
+	PLATFORM_API void registerJITFunction(const std::string& name,
+										  Uptr baseAddress,
+										  Uptr numBytes,
+										  const std::vector<JITFunctionLine>& lines);
+
+	// The maximum number of frames in a call stack sampled by startCallStackSampling.
+	static constexpr Uptr maxSampledCallStackFrames = 64;
+
+	// Called by startCallStackSampling from a signal handler on the interrupted thread. It is
+	// passed the address of the interrupted instruction, followed by the return addresses found by
+	// following the frame pointers from the interrupted frame, innermost first. It must be
+	// async-signal-safe.
+	typedef void (*CallStackSampleHandler)(const Uptr* frameAddresses, Uptr numFrames);
+
+	// Starts (or restarts with a new rate) interrupting the threads of the process about
+	// samplesPerSecond times per second of CPU time they use, and calling handler with the call
+	// stack of the interrupted thread. Only threads inside a catchSignals call are sampled, and the
+	// frame pointers are only followed while they point into the part of the stack used by the
+	// innermost catchSignals call, so frames without a frame pointer may truncate or corrupt the
+	// sampled call stack, but are always safe to follow. Returns false if sampling isn't supported
+	// by the platform.
+	PLATFORM_API bool startCallStackSampling(Uptr samplesPerSecond, CallStackSampleHandler handler);
+	PLATFORM_API void stopCallStackSampling();
 }}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Platform/Defines.h"
 
@@ -8,7 +9,35 @@ namespace WAVM { namespace Platform {
 	// The resolution is microseconds, and the origin is arbitrary.
 	PLATFORM_API U64 getMonotonicClock();
 
-	// Platform-independent events.
+	// The result of waitOnAddress.
+	enum class WaitOnAddressResult
+	{
+		woken,
+		notEqual,
+		timedOut,
+		unsupported
+	};
+
+	// If *address is expectedValue, blocks the calling thread until wakeAddress is called for the
+	// same address, or until the clock reaches untilClock. Returns WaitOnAddressResult::unsupported
+	// if the platform doesn't support waiting on an address natively (it is supported via futexes
+	// on Linux). The thread may rarely wake up spuriously.
+	//   If isProcessShared is false, only threads in the same process can wake the thread. If it is
+	// true, address must be in memory that is mapped shared, and threads in any process that maps
+	// the same memory can wake the thread by calling wakeAddress with isProcessShared=true.
+	PLATFORM_API WaitOnAddressResult waitOnAddress(const U32* address,
+												   U32 expectedValue,
+												   U64 untilClock,
+												   bool isProcessShared = false);
+
+	// Wakes up to numToWake threads waiting on an address in waitOnAddress with the same value of
+	// isProcessShared, and returns the number of threads that were woken. Returns 0 if
+	// waitOnAddress isn't supported.
+	PLATFORM_API Uptr wakeAddress(const U32* address, Uptr numToWake, bool isProcessShared = false);
+
+	// Platform-independent events. A signal wakes one waiting thread. On Windows and Linux, a signal
+	// while no thread is waiting is remembered until a thread waits; on other platforms, it is lost.
+	// On Linux, a wait spins for a short time before blocking the thread.
 	struct Event
 	{
 		PLATFORM_API Event();
@@ -27,14 +56,9 @@ namespace WAVM { namespace Platform {
 #ifdef WIN32
 		void* handle;
 #elif defined(__linux__)
-		struct PthreadMutex
-		{
-			Uptr data[5];
-		} pthreadMutex;
-		struct PthreadCond
-		{
-			Uptr data[6];
-		} pthreadCond;
+		// The futex that waiting threads block on: 1 if the event is signaled, or 0 if not.
+		std::atomic<U32> isSignaled;
+		std::atomic<U32> numWaiters;
 #elif defined(__APPLE__)
 		struct PthreadMutex
 		{
@@ -1,8 +1,7 @@
 #pragma once
 
-#include <functional>
-
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/FunctionRef.h"
 #include "WAVM/Platform/Defines.h"
 
 namespace WAVM { namespace Platform {
@@ -33,25 +32,57 @@ namespace WAVM { namespace Platform {
 		};
 	};
 
-	PLATFORM_API bool catchSignals(
-		const std::function<void()>& thunk,
-		const std::function<bool(Signal signal, const CallStack&)>& filter);
+	PLATFORM_API bool catchSignals(FunctionRef<void()> thunk,
+								   FunctionRef<bool(Signal signal, const CallStack&)> filter);
 
 	typedef bool (*SignalHandler)(Signal, const CallStack&);
 
 	PLATFORM_API void setSignalHandler(SignalHandler handler);
 
+	// Sets whether the call stack is captured when a signal or platform exception is raised.
+	// Capturing the call stack is most of the cost of handling a trap, so a program that traps
+	// frequently and doesn't need to describe where the traps occurred may disable it. While it is
+	// disabled, signal filters and platform exception handlers are passed an empty call stack.
+	// It is enabled by default.
+	PLATFORM_API void setExceptionCallStackCaptureEnabled(bool enabled);
+
 	PLATFORM_API void registerEHFrames(const U8* imageBase, const U8* ehFrames, Uptr numBytes);
 	PLATFORM_API void deregisterEHFrames(const U8* imageBase, const U8* ehFrames, Uptr numBytes);
 
+	// A table of Windows x64 function table entries for the code in a range of addresses, which
+	// entries can be added to without registering another table with the unwinder.
+	struct GrowableEHFrameTable;
+
+	// Creates a growable table of up to maxNumFunctions function table entries for the numBytes of
+	// code at imageBase. Returns nullptr if the platform doesn't support growable tables.
+	PLATFORM_API GrowableEHFrameTable* createGrowableEHFrameTable(const U8* imageBase,
+																  Uptr numBytes,
+																  Uptr maxNumFunctions);
+
+	// Adds the function table entries in ehFrames to a growable table. The entries' addresses are
+	// relative to the table's imageBase, and must be sorted. Returns false if the entries don't fit
+	// in the table, or don't follow the entries already in it, in which case the table is
+	// unmodified. Must not be called concurrently for the same table.
+	PLATFORM_API bool addGrowableEHFrames(GrowableEHFrameTable* table,
+										  const U8* ehFrames,
+										  Uptr numBytes);
+
+	// Deregisters a growable table and frees it.
+	PLATFORM_API void destroyGrowableEHFrameTable(GrowableEHFrameTable* table);
+
 	// Calls a thunk, catching any platform exceptions raised.
 	// If a platform exception is caught, the exception is passed to the handler function, and true
 	// is returned. If no exceptions are caught, false is returned.
-	PLATFORM_API bool catchPlatformExceptions(
-		const std::function<void()>& thunk,
-		const std::function<void(void*, const CallStack&)>& handler);
+	PLATFORM_API bool catchPlatformExceptions(FunctionRef<void()> thunk,
+											  FunctionRef<void(void*, const CallStack&)> handler);
+
+	// Raises a platform exception with a copy of numDataBytes of data, which is passed to the
+	// handler of the catchPlatformExceptions that catches it. If the data is no larger than
+	// maxInlinePlatformExceptionDataBytes, the copy is stored in the exception itself instead of
+	// in a separate heap allocation.
+	[[noreturn]] PLATFORM_API void raisePlatformException(const void* data, Uptr numDataBytes);
 
-	[[noreturn]] PLATFORM_API void raisePlatformException(void* data);
+	static constexpr Uptr maxInlinePlatformExceptionDataBytes = 128;
 
 	enum
 	{
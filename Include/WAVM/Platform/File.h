@@ -41,6 +41,14 @@ namespace WAVM { namespace Platform {
 								FileAccessMode accessMode,
 								FileCreateMode createMode);
 	PLATFORM_API bool closeFile(File* file);
+
+	// Opens a named shared memory object for reading and writing, which can be mapped by
+	// mapFileToVirtualPages in multiple processes to share memory between them. The name must
+	// start with a '/', and not contain any other '/'. A new shared memory object is empty, and
+	// persists until it is removed by removeSharedMemory. Returns nullptr if the shared memory
+	// object can't be opened, or shared memory objects aren't supported.
+	PLATFORM_API File* openSharedMemory(const std::string& name, FileCreateMode createMode);
+	PLATFORM_API bool removeSharedMemory(const std::string& name);
 	PLATFORM_API File* getStdFile(StdDevice device);
 	PLATFORM_API bool seekFile(File* file,
 							   I64 offset,
@@ -55,5 +63,34 @@ namespace WAVM { namespace Platform {
 								Uptr numBytes,
 								Uptr* outNumBytesWritten = nullptr);
 	PLATFORM_API bool flushFileWrites(File* file);
+
+	// Gets or sets the number of bytes in a file. Setting it truncates the file, or extends it with
+	// zeroes, without changing the file's current position.
+	PLATFORM_API bool getFileNumBytes(File* file, U64& outNumBytes);
+	PLATFORM_API bool setFileNumBytes(File* file, U64 numBytes);
+
+	// Maps the contents of a file read-only into memory, and writes the number of mapped bytes to
+	// outNumBytes. Returns nullptr if the file can't be mapped (e.g. if it is empty, or isn't a
+	// regular file). The mapping remains valid after the file is closed, until it is unmapped by
+	// unmapFile.
+	PLATFORM_API const U8* mapFile(File* file, Uptr& outNumBytes);
+	PLATFORM_API void unmapFile(const U8* baseAddress, Uptr numBytes);
+
+	// Maps a range of a regular file, starting at fileOffset, into the numPages virtual pages at
+	// baseVirtualAddress, which must already be allocated. fileOffset must be a multiple of the
+	// page size. If isShared is true, the pages share physical memory with the file's page cache:
+	// writes to them are written back to the file, and the file must have been opened for writing.
+	// Otherwise, the pages are mapped copy-on-write. The pages past the end of the file are zeroed
+	// pages that aren't mapped from it. The pages are left committed with read-write access, and
+	// remain mapped from the file after it is closed, until they are decommitted.
+	//   Returns false if the file can't be mapped, or mapping files into allocated virtual pages
+	// isn't supported. The pages are unmodified if the file isn't a regular file or wasn't opened
+	// for writing a shared mapping, but are decommitted if the mapping fails after that.
+	PLATFORM_API bool mapFileToVirtualPages(File* file,
+											U64 fileOffset,
+											U8* baseVirtualAddress,
+											Uptr numPages,
+											bool isShared);
+
 	PLATFORM_API std::string getCurrentWorkingDirectory();
 }}
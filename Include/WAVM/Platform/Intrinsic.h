@@ -121,22 +121,26 @@ namespace WAVM { namespace Platform {
 	}
 
 	// Byte-wise memmove: this uses the above byte-wise memcpy, but if the source and destination
-	// buffers overlap so the copy would overwrite the end of the source buffer before it is copied
-	// from, then split the copy into two: the overlapping end of the source buffer is copied first,
-	// so it can be overwritten by the second copy safely.
+	// buffers overlap so the copy would overwrite the source buffer before it is copied from, then
+	// split the copy into chunks no larger than the distance between the buffers, and copy them
+	// starting from the end: each chunk is copied before the chunks after it overwrite it.
 
 	inline void bytewiseMemMove(U8* dest, U8* source, Uptr numBytes)
 	{
-		const Uptr numNonOverlappingBytes
-			= source < dest && source + numBytes > dest ? dest - source : numBytes;
-
-		if(numNonOverlappingBytes != numBytes)
+		if(source < dest && source + numBytes > dest)
 		{
-			bytewiseMemCopy(dest + numNonOverlappingBytes,
-							source + numNonOverlappingBytes,
-							numBytes - numNonOverlappingBytes);
+			const Uptr numChunkBytes = dest - source;
+			Uptr chunkEnd = numBytes;
+			while(chunkEnd > numChunkBytes)
+			{
+				chunkEnd -= numChunkBytes;
+				bytewiseMemCopy(dest + chunkEnd, source + chunkEnd, numChunkBytes);
+			}
+			bytewiseMemCopy(dest, source, chunkEnd);
+		}
+		else
+		{
+			bytewiseMemCopy(dest, source, numBytes);
 		}
-
-		bytewiseMemCopy(dest, source, numNonOverlappingBytes);
 	}
 }}
@@ -14,6 +14,23 @@ namespace WAVM { namespace Platform {
 		readWriteExecute
 	};
 
+	// Flags that modify how physical memory is committed to virtual pages.
+	enum class CommitFlags : U32
+	{
+		none = 0,
+
+		// Back the pages with large pages (e.g. 2MiB transparent huge pages on Linux) where the
+		// OS allows it. This is only a hint: the pages are committed even if they can't be backed
+		// by large pages.
+		largePages = 1
+	};
+
+	inline CommitFlags operator|(CommitFlags a, CommitFlags b)
+	{
+		return CommitFlags(U32(a) | U32(b));
+	}
+	inline bool operator&(CommitFlags a, CommitFlags b) { return (U32(a) & U32(b)) != 0; }
+
 	// Returns the base 2 logarithm of the smallest virtual page size.
 	PLATFORM_API Uptr getPageSizeLog2();
 
@@ -29,12 +46,20 @@ namespace WAVM { namespace Platform {
 												 Uptr alignmentLog2,
 												 U8*& outUnalignedBaseAddress);
 
+	// Returns the number of NUMA nodes in the host: the nodes are numbered from zero, and hosts
+	// without NUMA have one node.
+	PLATFORM_API Uptr getNumNUMANodes();
+
 	// Commits physical memory to the specified virtual pages.
 	// baseVirtualAddress must be a multiple of the preferred page size.
+	// If numaNode isn't UINTPTR_MAX, the physical memory is allocated from that NUMA node where
+	// the OS allows it; like CommitFlags::largePages, this is only a hint.
 	// Return true if successful, or false if physical memory has been exhausted.
 	PLATFORM_API bool commitVirtualPages(U8* baseVirtualAddress,
 										 Uptr numPages,
-										 MemoryAccess access = MemoryAccess::readWrite);
+										 MemoryAccess access = MemoryAccess::readWrite,
+										 CommitFlags flags = CommitFlags::none,
+										 Uptr numaNode = UINTPTR_MAX);
 
 	// Changes the allowed access to the specified virtual pages.
 	// baseVirtualAddress must be a multiple of the preferred page size.
@@ -47,6 +72,95 @@ namespace WAVM { namespace Platform {
 	// baseVirtualAddress must be a multiple of the preferred page size.
 	PLATFORM_API void decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages);
 
+	// Frees the physical memory of the specified committed read-write pages, which stay committed
+	// and read as zero afterwards. The pages must not be mapped from a file or VirtualPageSnapshot,
+	// and must not be accessed by other threads while they are being reset.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	PLATFORM_API void resetVirtualPages(U8* baseVirtualAddress, Uptr numPages);
+
+	// A snapshot of the contents of a range of virtual pages, which is shared copy-on-write by the
+	// ranges of virtual pages that are mapped from it.
+	struct VirtualPageSnapshot;
+
+	// Maps the contents of numPages committed virtual pages at sourceBaseAddress copy-on-write into
+	// the virtual pages at destBaseAddress. sourceSnapshot is the snapshot the source pages are
+	// mapped from, or nullptr. If the source pages haven't been written since they were mapped from
+	// it, the destination pages are mapped from it without copying them; otherwise, the source
+	// pages are copied into a new snapshot that the destination pages are mapped from. The source
+	// pages are never remapped, so they may be written concurrently by other threads: the
+	// destination pages may or may not see such writes. outDestSnapshot receives a reference to
+	// the snapshot the destination pages are mapped from, and they are left committed with
+	// read-write access.
+	// Returns false if copy-on-write mapping isn't supported or fails, in which case the
+	// destination pages are unmodified.
+	PLATFORM_API bool cloneVirtualPagesCopyOnWrite(U8* sourceBaseAddress,
+												   U8* destBaseAddress,
+												   Uptr numPages,
+												   VirtualPageSnapshot* sourceSnapshot,
+												   VirtualPageSnapshot*& outDestSnapshot);
+
+	// Creates a snapshot of numPages zeroed virtual pages, which may then be written to by
+	// writeVirtualPageSnapshot. Returns nullptr if snapshots aren't supported or can't be created.
+	// The snapshot only uses physical memory for the pages that are written or accessed.
+	PLATFORM_API VirtualPageSnapshot* createVirtualPageSnapshot(Uptr numPages);
+
+	// Copies numBytes from data into a snapshot at the given byte offset. Virtual pages that are
+	// already mapped from the snapshot may or may not see the change. Returns false if the write
+	// fails.
+	PLATFORM_API bool writeVirtualPageSnapshot(VirtualPageSnapshot* snapshot,
+											   Uptr offset,
+											   const U8* data,
+											   Uptr numBytes);
+
+	// Maps a snapshot copy-on-write into the virtual pages at baseVirtualAddress, and adds a
+	// reference to the snapshot that must be released by releaseVirtualPageSnapshot. The pages
+	// are left committed with read-write access, and their contents are read from the snapshot
+	// when they are first accessed. Returns false if the pages can't be mapped, in which case they
+	// are unmodified.
+	PLATFORM_API bool mapVirtualPageSnapshot(VirtualPageSnapshot* snapshot,
+											 U8* baseVirtualAddress);
+
+	// Releases a reference to a snapshot returned by cloneVirtualPagesCopyOnWrite,
+	// createVirtualPageSnapshot, or mapVirtualPageSnapshot. Virtual pages that are mapped from the
+	// snapshot remain valid until they are decommitted or freed.
+	PLATFORM_API void releaseVirtualPageSnapshot(VirtualPageSnapshot* snapshot);
+
+	// Returns whether the platform can track which virtual pages are written: on Linux, this needs
+	// a kernel with soft-dirty page tracking.
+	PLATFORM_API bool isVirtualPageDirtyTrackingSupported();
+
+	// The dirty bits are process-wide state: clearing them clears the bits of every page in the
+	// process, so each tracker would lose the writes recorded for the others. Only one tracker may
+	// use them at a time, by acquiring them with acquireVirtualPageDirtyTracking, which returns
+	// false if the platform doesn't support tracking or another tracker has acquired them. Nothing
+	// else in the process may clear the bits (e.g. with /proc/self/clear_refs on Linux) while they
+	// are acquired.
+	PLATFORM_API bool acquireVirtualPageDirtyTracking();
+	PLATFORM_API void releaseVirtualPageDirtyTracking();
+
+	// Clears the dirty bits of all the process's virtual pages. A page's dirty bit is set when it is
+	// written, or when its mapping is replaced, e.g. by decommitVirtualPages. The bits must have
+	// been acquired by the caller with acquireVirtualPageDirtyTracking.
+	PLATFORM_API void clearVirtualPageDirtyBits();
+
+	// Reads the dirty bits of numPages virtual pages at baseVirtualAddress into outDirtyBits: the
+	// bit for page i is bit i % 64 of outDirtyBits[i / 64]. Returns false if they can't be read.
+	// The bits must have been acquired by the caller with acquireVirtualPageDirtyTracking.
+	PLATFORM_API bool readVirtualPageDirtyBits(const U8* baseVirtualAddress,
+											   Uptr numPages,
+											   U64* outDirtyBits);
+
+	// Allocates numPages of physical memory that is mapped at two adjacent ranges of virtual
+	// addresses: the pages at outWritableBaseAddress may be read and written, and the pages
+	// numPages later may be read and executed. Code may be written through the writable view and
+	// executed through the executable view without changing the access of any pages. Since the
+	// views are adjacent, code in the executable view may refer to data in the writable view with
+	// 32-bit relative offsets if numPages is small enough. Returns false if the platform doesn't
+	// support mapping the same memory twice, or the memory couldn't be allocated. The views are
+	// released by decommitVirtualPages and freeVirtualPages, like pages allocated by
+	// allocateVirtualPages: outWritableBaseAddress is the base address of numPages * 2 pages.
+	PLATFORM_API bool allocateDualMappedPages(Uptr numPages, U8*& outWritableBaseAddress);
+
 	// Frees virtual addresses. Any physical memory committed to the addresses must have already
 	// been decommitted. baseVirtualAddress must also be an address returned by
 	// allocateVirtualPages.
@@ -58,4 +172,8 @@ namespace WAVM { namespace Platform {
 	PLATFORM_API void freeAlignedVirtualPages(U8* unalignedBaseAddress,
 											  Uptr numPages,
 											  Uptr alignmentLog2);
+
+	// Returns the largest number of bytes of physical memory the process has used at once, or 0 if
+	// the platform doesn't report it.
+	PLATFORM_API Uptr getPeakResidentBytes();
 }}
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Platform/Defines.h"
 
 namespace WAVM { namespace Platform {
-	// Platform-independent mutexes.
+	// Platform-independent mutexes. Locking a mutex that another thread holds spins for a short
+	// time before blocking the thread, since most of the runtime's critical sections are short.
 	struct Mutex
 	{
 		PLATFORM_API Mutex();
@@ -31,10 +33,8 @@ namespace WAVM { namespace Platform {
 			Uptr spinCount;
 		} criticalSection;
 #elif defined(__linux__)
-		struct PthreadMutex
-		{
-			Uptr data[5];
-		} pthreadMutex;
+		// 0 if unlocked, 1 if locked, or 2 if locked and a thread may be waiting on the futex.
+		std::atomic<U32> state;
 #elif defined(__APPLE__)
 		struct PthreadMutex
 		{
@@ -5,12 +5,53 @@
 
 namespace WAVM { namespace Platform {
 	struct Thread;
+
+	// Creates a thread that calls threadEntry(argument). If numaNode isn't UINTPTR_MAX, the thread
+	// only runs on the processors of that NUMA node (see getNumNUMANodes).
 	PLATFORM_API Thread* createThread(Uptr numStackBytes,
 									  I64 (*threadEntry)(void*),
-									  void* argument);
+									  void* argument,
+									  Uptr numaNode = UINTPTR_MAX);
 	PLATFORM_API void detachThread(Thread* thread);
 	PLATFORM_API I64 joinThread(Thread* thread);
 	[[noreturn]] PLATFORM_API void exitThread(I64 code);
 
+	// Sets the maximum number of bytes of stacks that are kept mapped after the threads using them
+	// exit, to be reused by threads that are created later with the same stack size. Threads are
+	// cached when they exit if they have been detached, or when they are joined.
+	PLATFORM_API void setMaxCachedThreadStackBytes(Uptr numBytes);
+
+	// Sets the maximum number of idle threads that are kept in a pool after their entry function
+	// returns, to run threads that are created or forked later with the same stack size (and NUMA
+	// node) without creating a new host thread. The pool is empty by default. A pooled host thread
+	// keeps its thread-local variables between the threads it runs, and only destroys them when it
+	// exits, so it should only be enabled if the thread entry functions don't depend on them being
+	// initialized when the thread starts.
+	PLATFORM_API void setMaxPooledThreads(Uptr numThreads);
+
+	// Returns the number of threads the host can execute concurrently.
+	PLATFORM_API Uptr getNumberOfHardwareThreads();
+
 	RETURNS_TWICE PLATFORM_API Thread* forkCurrentThread();
+
+	// Fibers are execution contexts with their own stacks that a thread explicitly switches
+	// between. A fiber may only be switched to by the thread that created it.
+	struct Fiber;
+
+	// Creates a fiber that calls fiberEntry(argument) on a new stack of numStackBytes the first
+	// time it is switched to. fiberEntry must not return: when it is done, it must switch to
+	// another fiber, after which the fiber may be destroyed.
+	PLATFORM_API Fiber* createFiber(Uptr numStackBytes, void (*fiberEntry)(void*), void* argument);
+
+	// Returns the fiber the calling thread is executing in. If the thread hasn't switched to a
+	// fiber yet, a fiber is created for the thread's own stack.
+	PLATFORM_API Fiber* getCurrentFiber();
+
+	// Saves the calling fiber's execution state, and switches the thread to the given fiber.
+	// Returns when another fiber switches back to the calling fiber.
+	PLATFORM_API void switchToFiber(Fiber* fiber);
+
+	// Destroys a fiber created by createFiber. The fiber must not be executing. If it was
+	// suspended by switchToFiber, its stack is freed without being unwound.
+	PLATFORM_API void destroyFiber(Fiber* fiber);
 }}
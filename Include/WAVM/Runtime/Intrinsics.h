@@ -1,6 +1,10 @@
 #pragma once
 
+#include <string.h>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include "WAVM/IR/IR.h"
 #include "WAVM/IR/Types.h"
@@ -16,6 +20,14 @@ namespace WAVM { namespace Runtime {
 namespace WAVM { namespace Intrinsics {
 	struct ModuleImpl;
 
+	// A function that Runtime::invokeFunction calls a native function through. It's passed the
+	// native function, the ContextRuntimeData to call it with, and the function's arguments, each
+	// naturally aligned, and returns the ContextRuntimeData with the function's results written to
+	// the start of it. It has the same signature as the invoke thunks generated by the JIT.
+	typedef Runtime::ContextRuntimeData* (*InvokeThunk)(void* nativeFunction,
+														 Runtime::ContextRuntimeData*,
+														 const U8* argData);
+
 	struct Module
 	{
 		ModuleImpl* impl = nullptr;
@@ -32,18 +44,42 @@ namespace WAVM { namespace Intrinsics {
 	// An intrinsic function.
 	struct Function
 	{
+		// If isLeaf is true, the function doesn't use its ContextRuntimeData and can't throw, so
+		// WebAssembly code calls it through a thunk that calls it directly, without the
+		// bookkeeping needed for calls that may switch contexts or unwind.
+		// If invokeThunk isn't null, invokeFunction calls the function through it, instead of
+		// through an invoke thunk generated by the JIT.
+		RUNTIME_API Function(Intrinsics::Module& moduleRef,
+							 const char* inName,
+							 void* inNativeFunction,
+							 IR::FunctionType type,
+							 IR::CallingConvention inCallingConvention,
+							 bool inIsLeaf = false,
+							 InvokeThunk inInvokeThunk = nullptr);
+		// Creates an intrinsic function that has no side effects, and returns constantResult if
+		// its type has a result. WebAssembly code calls it through a thunk that returns
+		// constantResult without calling nativeFunction, which is only called by invokeFunction.
 		RUNTIME_API Function(Intrinsics::Module& moduleRef,
 							 const char* inName,
 							 void* inNativeFunction,
 							 IR::FunctionType type,
-							 IR::CallingConvention inCallingConvention);
-		RUNTIME_API Runtime::FunctionInstance* instantiate(Runtime::Compartment* compartment);
+							 IR::UntaggedValue inConstantResult,
+							 InvokeThunk inInvokeThunk = nullptr);
+
+		// Creates an instance of the function that isn't owned by any compartment, so it may be
+		// imported by modules in any compartment, and is never freed. instantiateModule creates one
+		// for each function of an intrinsic module, and reuses them for every instantiation.
+		RUNTIME_API Runtime::FunctionInstance* instantiate();
 
 	private:
 		const char* name;
 		IR::FunctionType type;
 		void* nativeFunction;
 		IR::CallingConvention callingConvention;
+		bool isConstant;
+		bool isLeaf;
+		IR::UntaggedValue constantResult;
+		InvokeThunk invokeThunk;
 	};
 
 	// The base class of Intrinsic globals.
@@ -121,6 +157,121 @@ namespace WAVM { namespace Intrinsics {
 		return reinterpret_cast<ResultInContextRuntimeData<Result>*>(contextRuntimeData);
 	}
 
+	// The offset of an intrinsic's argument in the argument data passed to its invoke thunk.
+	template<Uptr argIndex, typename... Args> struct InvokeArgOffset
+	{
+		typedef typename std::tuple_element<argIndex, std::tuple<Args...>>::type Arg;
+		typedef typename std::tuple_element<argIndex - 1, std::tuple<Args...>>::type PreviousArg;
+		static constexpr Uptr unalignedValue
+			= InvokeArgOffset<argIndex - 1, Args...>::value + sizeof(PreviousArg);
+		static constexpr Uptr value = (unalignedValue + sizeof(Arg) - 1) & ~(sizeof(Arg) - 1);
+	};
+	template<typename... Args> struct InvokeArgOffset<0, Args...>
+	{
+		static constexpr Uptr value = 0;
+	};
+
+	template<Uptr... argIndices> struct InvokeArgIndices
+	{
+	};
+	template<Uptr numArgs, Uptr... argIndices>
+	struct MakeInvokeArgIndices : MakeInvokeArgIndices<numArgs - 1, numArgs - 1, argIndices...>
+	{
+	};
+	template<Uptr... argIndices> struct MakeInvokeArgIndices<0, argIndices...>
+	{
+		typedef InvokeArgIndices<argIndices...> Type;
+	};
+
+	template<typename Arg> Arg loadInvokeArg(const U8* argData, Uptr offset)
+	{
+		Arg arg;
+		memcpy(&arg, argData + offset, sizeof(Arg));
+		return arg;
+	}
+
+	// Calls an intrinsic's native function pointer.
+	template<typename R, typename... Args> struct NativeFunctionCallee
+	{
+		static R call(void* nativeFunction,
+					  Runtime::ContextRuntimeData* contextRuntimeData,
+					  Args... args)
+		{
+			typedef R (*NativeFunction)(Runtime::ContextRuntimeData*, Args...);
+			return reinterpret_cast<NativeFunction>(nativeFunction)(contextRuntimeData, args...);
+		}
+	};
+
+	// Calls a function through a Callee with the arguments read from the argument data passed to
+	// its invoke thunk. The layout of the arguments is fixed at compile time by the function's C++
+	// signature.
+	template<typename Callee, typename R, typename... Args, Uptr... argIndices>
+	R callWithInvokeArgs(void* nativeFunction,
+						 Runtime::ContextRuntimeData* contextRuntimeData,
+						 const U8* argData,
+						 InvokeArgIndices<argIndices...>)
+	{
+		return Callee::call(
+			nativeFunction,
+			contextRuntimeData,
+			loadInvokeArg<Args>(argData, InvokeArgOffset<argIndices, Args...>::value)...);
+	}
+
+	// Implements InvokeThunk for functions with a given C++ signature.
+	template<typename Callee, typename R, typename... Args> struct IntrinsicInvokeThunk
+	{
+		static Runtime::ContextRuntimeData* invoke(void* nativeFunction,
+												   Runtime::ContextRuntimeData* contextRuntimeData,
+												   const U8* argData)
+		{
+			const R result = callWithInvokeArgs<Callee, R, Args...>(
+				nativeFunction,
+				contextRuntimeData,
+				argData,
+				typename MakeInvokeArgIndices<sizeof...(Args)>::Type());
+			memcpy(contextRuntimeData->thunkArgAndReturnData, &result, sizeof(R));
+			return contextRuntimeData;
+		}
+	};
+	template<typename Callee, typename... Args> struct IntrinsicInvokeThunk<Callee, void, Args...>
+	{
+		static Runtime::ContextRuntimeData* invoke(void* nativeFunction,
+												   Runtime::ContextRuntimeData* contextRuntimeData,
+												   const U8* argData)
+		{
+			callWithInvokeArgs<Callee, void, Args...>(
+				nativeFunction,
+				contextRuntimeData,
+				argData,
+				typename MakeInvokeArgIndices<sizeof...(Args)>::Type());
+			return contextRuntimeData;
+		}
+	};
+
+	// Intrinsics that may switch contexts return the context, with the result already written to
+	// it.
+	template<typename Callee, typename R, typename... Args>
+	struct IntrinsicInvokeThunk<Callee, ResultInContextRuntimeData<R>*, Args...>
+	{
+		static Runtime::ContextRuntimeData* invoke(void* nativeFunction,
+												   Runtime::ContextRuntimeData* contextRuntimeData,
+												   const U8* argData)
+		{
+			return reinterpret_cast<Runtime::ContextRuntimeData*>(
+				callWithInvokeArgs<Callee, ResultInContextRuntimeData<R>*, Args...>(
+					nativeFunction,
+					contextRuntimeData,
+					argData,
+					typename MakeInvokeArgIndices<sizeof...(Args)>::Type()));
+		}
+	};
+
+	template<typename R, typename... Args>
+	InvokeThunk getIntrinsicInvokeThunk(R (*)(Runtime::ContextRuntimeData*, Args...))
+	{
+		return &IntrinsicInvokeThunk<NativeFunctionCallee<R, Args...>, R, Args...>::invoke;
+	}
+
 	template<typename R, typename... Args>
 	IR::FunctionType inferIntrinsicFunctionType(R (*)(Runtime::ContextRuntimeData*, Args...))
 	{
@@ -134,6 +285,97 @@ namespace WAVM { namespace Intrinsics {
 		return IR::FunctionType(IR::inferResultType<R>(),
 								IR::TypeTuple({IR::inferValueType<Args>()...}));
 	}
+
+	// The state of a function created by createHostFunction. It is deleted when the function is
+	// freed by the garbage collector.
+	struct HostFunction
+	{
+		virtual ~HostFunction() {}
+	};
+
+	// Creates a function in a compartment that calls the host. The function takes ownership of
+	// hostFunction. WebAssembly code calls trampoline through a thunk that passes hostFunction as
+	// an I64 argument between the ContextRuntimeData and the function's parameters, and the host
+	// invokes the function through invokeThunk, which is passed hostFunction as its native function.
+	RUNTIME_API Runtime::FunctionInstance* createHostFunction(Runtime::Compartment* compartment,
+															  IR::FunctionType type,
+															  HostFunction* hostFunction,
+															  void* trampoline,
+															  InvokeThunk invokeThunk,
+															  std::string&& debugName);
+
+	// A host function that calls a C++ lambda.
+	template<typename Lambda, typename R, typename... Args>
+	struct LambdaHostFunction : HostFunction
+	{
+		template<typename InLambda>
+		LambdaHostFunction(InLambda&& inLambda) : lambda(std::forward<InLambda>(inLambda))
+		{
+		}
+
+		static R call(void* nativeFunction,
+					  Runtime::ContextRuntimeData* contextRuntimeData,
+					  Args... args)
+		{
+			auto hostFunction = static_cast<LambdaHostFunction*>(
+				reinterpret_cast<HostFunction*>(nativeFunction));
+			return hostFunction->lambda(contextRuntimeData, args...);
+		}
+
+		static R callFromWASM(Runtime::ContextRuntimeData* contextRuntimeData,
+							  I64 hostFunction,
+							  Args... args)
+		{
+			return call(reinterpret_cast<void*>(Uptr(hostFunction)), contextRuntimeData, args...);
+		}
+
+	private:
+		Lambda lambda;
+	};
+
+	template<typename Lambda, typename CallOperator> struct LambdaHostFunctionFactory;
+	template<typename Lambda, typename R, typename... Args>
+	struct LambdaHostFunctionFactory<Lambda,
+									 R (Lambda::*)(Runtime::ContextRuntimeData*, Args...) const>
+	{
+		template<typename InLambda>
+		static Runtime::FunctionInstance* create(Runtime::Compartment* compartment,
+												 std::string&& debugName,
+												 InLambda&& lambda)
+		{
+			typedef LambdaHostFunction<Lambda, R, Args...> HostFunctionType;
+			HostFunction* hostFunction = new HostFunctionType(std::forward<InLambda>(lambda));
+			return createHostFunction(
+				compartment,
+				IR::FunctionType(IR::inferResultType<R>(),
+								 IR::TypeTuple({IR::inferValueType<Args>()...})),
+				hostFunction,
+				(void*)&HostFunctionType::callFromWASM,
+				&IntrinsicInvokeThunk<HostFunctionType, R, Args...>::invoke,
+				std::move(debugName));
+		}
+	};
+	template<typename Lambda, typename R, typename... Args>
+	struct LambdaHostFunctionFactory<Lambda, R (Lambda::*)(Runtime::ContextRuntimeData*, Args...)>
+	: LambdaHostFunctionFactory<Lambda,
+								R (Lambda::*)(Runtime::ContextRuntimeData*, Args...) const>
+	{
+	};
+
+	// Creates a host function that calls a C++ lambda, which may capture state that is destroyed
+	// with the function. The lambda takes the ContextRuntimeData the function was called with,
+	// followed by the function's parameters, and the function's type is inferred from its
+	// signature: e.g. [&](Runtime::ContextRuntimeData*, I32 a, I64 b) -> F64 { ... }. Calls from
+	// WebAssembly code and invokes from the host both call the lambda without boxing the arguments.
+	template<typename Lambda>
+	Runtime::FunctionInstance* createHostFunction(Runtime::Compartment* compartment,
+												  std::string&& debugName,
+												  Lambda&& lambda)
+	{
+		typedef typename std::decay<Lambda>::type LambdaType;
+		return LambdaHostFunctionFactory<LambdaType, decltype(&LambdaType::operator())>::create(
+			compartment, std::move(debugName), std::forward<Lambda>(lambda));
+	}
 }}
 
 #define DEFINE_INTRINSIC_MODULE(name)                                                              \
@@ -153,7 +395,23 @@ namespace WAVM { namespace Intrinsics {
 												 nameString,                                       \
 												 (void*)&cName,                                    \
 												 Intrinsics::inferIntrinsicFunctionType(&cName),   \
-												 IR::CallingConvention::intrinsic);                \
+												 IR::CallingConvention::intrinsic,                 \
+												 false,                                            \
+												 Intrinsics::getIntrinsicInvokeThunk(&cName));     \
+	static Result cName(Runtime::ContextRuntimeData* contextRuntimeData, ##__VA_ARGS__)
+
+// Defines an intrinsic function that doesn't use contextRuntimeData and can't throw or trap. Calls
+// to it from WebAssembly code bypass the context switching and unwinding bookkeeping of other
+// intrinsic calls.
+#define DEFINE_LEAF_INTRINSIC_FUNCTION(module, nameString, Result, cName, ...)                     \
+	static Result cName(Runtime::ContextRuntimeData* contextRuntimeData, ##__VA_ARGS__);           \
+	static Intrinsics::Function cName##Intrinsic(getIntrinsicModule_##module(),                    \
+												 nameString,                                       \
+												 (void*)&cName,                                    \
+												 Intrinsics::inferIntrinsicFunctionType(&cName),   \
+												 IR::CallingConvention::intrinsic,                 \
+												 true,                                             \
+												 Intrinsics::getIntrinsicInvokeThunk(&cName));     \
 	static Result cName(Runtime::ContextRuntimeData* contextRuntimeData, ##__VA_ARGS__)
 
 #define DEFINE_INTRINSIC_FUNCTION_WITH_CONTEXT_SWITCH(module, nameString, Result, cName, ...)      \
@@ -164,10 +422,34 @@ namespace WAVM { namespace Intrinsics {
 		nameString,                                                                                \
 		(void*)&cName,                                                                             \
 		Intrinsics::inferIntrinsicWithContextSwitchFunctionType(&cName),                           \
-		IR::CallingConvention::intrinsicWithContextSwitch);                                        \
+		IR::CallingConvention::intrinsicWithContextSwitch,                                         \
+		false,                                                                                     \
+		Intrinsics::getIntrinsicInvokeThunk(&cName));                                              \
 	static Intrinsics::ResultInContextRuntimeData<Result>* cName(                                  \
 		Runtime::ContextRuntimeData* contextRuntimeData, ##__VA_ARGS__)
 
+// Defines an intrinsic function that does nothing, or that does nothing but return a constant
+// value. Calls to it from WebAssembly code don't call into the host: see Intrinsics::Function.
+#define DEFINE_NOOP_INTRINSIC_FUNCTION(module, nameString, cName, ...)                             \
+	static void cName(Runtime::ContextRuntimeData* contextRuntimeData, ##__VA_ARGS__) {}           \
+	static Intrinsics::Function cName##Intrinsic(getIntrinsicModule_##module(),                    \
+												 nameString,                                       \
+												 (void*)&cName,                                    \
+												 Intrinsics::inferIntrinsicFunctionType(&cName),   \
+												 IR::UntaggedValue(),                              \
+												 Intrinsics::getIntrinsicInvokeThunk(&cName));
+#define DEFINE_CONSTANT_INTRINSIC_FUNCTION(module, nameString, Result, cName, value, ...)          \
+	static Result cName(Runtime::ContextRuntimeData* contextRuntimeData, ##__VA_ARGS__)            \
+	{                                                                                              \
+		return Result(value);                                                                      \
+	}                                                                                              \
+	static Intrinsics::Function cName##Intrinsic(getIntrinsicModule_##module(),                    \
+												 nameString,                                       \
+												 (void*)&cName,                                    \
+												 Intrinsics::inferIntrinsicFunctionType(&cName),   \
+												 IR::UntaggedValue(Result(value)),                 \
+												 Intrinsics::getIntrinsicInvokeThunk(&cName));
+
 // Macros for defining intrinsic globals, memories, and tables.
 #define DEFINE_INTRINSIC_GLOBAL(module, name, Value, cName, initializer)                           \
 	static Intrinsics::GenericGlobal<Value> cName(getIntrinsicModule_##module(), name, initializer);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -91,4 +92,83 @@ namespace WAVM { namespace Runtime {
 	};
 
 	RUNTIME_API LinkResult linkModule(const IR::Module& module, Resolver& resolver);
+
+	// A module's imports resolved to exports of a list of provider ModuleInstances, by index
+	// instead of by name. A plan is created once by looking up the imports by name, and may then
+	// link any number of instantiations of the module without hashing any names: the providers
+	// passed to linkModule must be the same instances the plan was created with, or other
+	// instances of the same modules.
+	struct LinkPlan
+	{
+		struct ImportSource
+		{
+			Uptr providerIndex;
+			Uptr exportIndex;
+		};
+
+		// The export names of each provider the plan was created with.
+		std::vector<std::shared_ptr<const std::vector<std::string>>> providerExportNames;
+
+		// The source of each import, in the order of the module's function, table, memory,
+		// global, and exception type imports. Only valid if success is true.
+		std::vector<ImportSource> importSources;
+
+		std::vector<LinkResult::MissingImport> missingImports;
+		bool success;
+	};
+
+	// Creates a plan that resolves each import of a module to the export with the import's export
+	// name in the first provider whose name is the import's module name.
+	RUNTIME_API LinkPlan
+	createLinkPlan(const IR::Module& module,
+				   const std::vector<std::pair<std::string, ModuleInstance*>>& providers);
+
+	// Links a module using a plan, and providers that correspond to those the plan was created
+	// with. Imports from a provider whose exports differ from those the plan was created with are
+	// looked up by name, as createLinkPlan did.
+	RUNTIME_API LinkResult linkModule(const IR::Module& module,
+									  const LinkPlan& plan,
+									  const std::vector<ModuleInstance*>& providers);
+
+	// A module to instantiate with instantiateModuleBatch.
+	struct BatchModule
+	{
+		// The module name that other modules in the batch import the module's exports by.
+		std::string name;
+
+		// The module to instantiate: either a compiled module, or an IR module that is compiled by
+		// the batch if module is null.
+		Module* module = nullptr;
+		const IR::Module* irModule = nullptr;
+	};
+
+	// The result of instantiating a module in a batch.
+	struct BatchModuleResult
+	{
+		// The module's instance, or null if it wasn't instantiated.
+		ModuleInstance* moduleInstance = nullptr;
+
+		// The imports that couldn't be resolved, if linking the module failed.
+		std::vector<LinkResult::MissingImport> missingImports;
+
+		// Why the module wasn't instantiated, or empty if it was.
+		std::string error;
+	};
+
+	// Compiles, links, and instantiates a batch of modules in a compartment, and calls their start
+	// functions. An import whose module name is the name of a module in the batch is resolved to
+	// that module's export, so the importing module is instantiated after it; other imports are
+	// resolved by the resolver, which is only called by one thread at a time. Modules that don't
+	// import each other are compiled and instantiated in parallel on numThreads threads, or one
+	// thread for each hardware thread if numThreads is zero.
+	//   A module isn't instantiated if it can't be linked, if instantiating it or calling its start
+	// function throws a runtime exception, if a module it imports wasn't instantiated, or if it
+	// imports itself through a cycle of modules. Writes a result for each module to outResults,
+	// and returns whether all the modules were instantiated.
+	RUNTIME_API bool instantiateModuleBatch(Compartment* compartment,
+											const std::vector<BatchModule>& modules,
+											Resolver& resolver,
+											std::vector<BatchModuleResult>& outResults,
+											const CompileOptions& compileOptions = CompileOptions(),
+											Uptr numThreads = 0);
 }}
\ No newline at end of file
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -7,13 +12,20 @@
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/FunctionRef.h"
 #include "WAVM/Platform/Diagnostics.h"
+#include "WAVM/Runtime/RuntimeData.h"
 
 // Declare IR::Module to avoid including the definition.
 namespace WAVM { namespace IR {
 	struct Module;
 }}
 
+// Declare Platform::File to avoid including the definition.
+namespace WAVM { namespace Platform {
+	struct File;
+}}
+
 // Declare the different kinds of objects.
 // They are only declared as incomplete struct types here, and Runtime clients
 // will only handle opaque pointers to them.
@@ -117,12 +129,14 @@ namespace WAVM { namespace Runtime {
 		}
 		void operator=(const GCPointer<ObjectType>& inCopy)
 		{
+			if(value == inCopy.value) { return; }
 			if(value) { removeGCRoot(asObject(value)); }
 			value = inCopy.value;
 			if(value) { addGCRoot(asObject(value)); }
 		}
 		void operator=(GCPointer<ObjectType>&& inMove)
 		{
+			if(this == &inMove) { return; }
 			if(value) { removeGCRoot(asObject(value)); }
 			value = inMove.value;
 			inMove.value = nullptr;
@@ -136,7 +150,9 @@ namespace WAVM { namespace Runtime {
 		ObjectType* value;
 	};
 
-	// Increments the object's counter of root references.
+	// Increments the object's counter of root references. The changes a thread makes to root
+	// reference counts are buffered by the thread until the garbage collector needs them, so
+	// rooting and unrooting an object repeatedly doesn't write to memory shared with other threads.
 	RUNTIME_API void addGCRoot(Object* object);
 
 	// Decrements the object's counter of root referencers.
@@ -145,6 +161,54 @@ namespace WAVM { namespace Runtime {
 	// Frees objects that are unreachable from root object references.
 	RUNTIME_API void collectGarbage();
 
+	// Frees the objects in a compartment that are unreachable from root object references, without
+	// scanning the objects in other compartments. The compartment itself is freed if it is
+	// unreachable. Modules and exception types aren't owned by a compartment, so they are only
+	// freed by collectGarbage. If other compartments have been cloned from the compartment and
+	// haven't been freed, they may reference any of its objects, so this falls back to
+	// collectGarbage. Returns whether the compartment was freed.
+	RUNTIME_API bool collectCompartmentGarbage(Compartment* compartment);
+
+	// Releases a root reference to a compartment, and frees the compartment and all of its objects
+	// if none of them are rooted by other references. If the compartment doesn't have any clones,
+	// this doesn't scan any objects outside the compartment, and if it is freed, its objects are
+	// freed without being scanned. Returns whether the compartment was freed.
+	RUNTIME_API bool tryCollectCompartment(GCPointer<Compartment>&& compartmentRootRef);
+
+	// Starts a background thread that collects garbage from all objects when the objects created
+	// or the bytes committed to compartments since the last collection exceed heapGrowthPercent of
+	// the objects that survived it or the bytes that were committed after it. A background
+	// collection treats the objects created since the previous background collection started as
+	// roots. If the thread is already running, only changes heapGrowthPercent. The thread is
+	// stopped when the process exits.
+	//   WARNING: while the thread is running, a pointer the runtime returns to a new object that
+	// isn't referenced by a rooted object must be rooted (e.g. by a GCPointer) before the next
+	// object is created or memory is committed on any thread, since that may trigger a background
+	// collection that frees the object. Code that can't root the objects it uses must run inside a
+	// NoBackgroundCollectionScope.
+	RUNTIME_API void startBackgroundGarbageCollection(Uptr heapGrowthPercent = 100);
+
+	// Stops the thread started by startBackgroundGarbageCollection, waiting for any collection it
+	// is running to finish.
+	RUNTIME_API void stopBackgroundGarbageCollection();
+
+	// While any thread is between beginNoBackgroundCollection and endNoBackgroundCollection,
+	// background collections don't free any objects, so unrooted objects may be used until the
+	// last scope ends. Collections requested meanwhile run after it ends. Explicit collections
+	// aren't affected. Beginning a scope waits for a background collection that is freeing objects
+	// to finish.
+	RUNTIME_API void beginNoBackgroundCollection();
+	RUNTIME_API void endNoBackgroundCollection();
+
+	struct NoBackgroundCollectionScope
+	{
+		NoBackgroundCollectionScope() { beginNoBackgroundCollection(); }
+		~NoBackgroundCollectionScope() { endNoBackgroundCollection(); }
+
+		NoBackgroundCollectionScope(const NoBackgroundCollectionScope&) = delete;
+		void operator=(const NoBackgroundCollectionScope&) = delete;
+	};
+
 	// Returns the AnyReferee proxy of an Object.
 	RUNTIME_API const AnyReferee* asAnyRef(const Object* object);
 
@@ -170,6 +234,8 @@ namespace WAVM { namespace Runtime {
 		RUNTIME_API static const GCPointer<ExceptionTypeInstance> invalidSegmentOffsetType;
 		RUNTIME_API static const GCPointer<ExceptionTypeInstance> misalignedAtomicMemoryAccessType;
 		RUNTIME_API static const GCPointer<ExceptionTypeInstance> invalidArgumentType;
+		RUNTIME_API static const GCPointer<ExceptionTypeInstance> epochDeadlineReachedType;
+		RUNTIME_API static const GCPointer<ExceptionTypeInstance> fuelExhaustedType;
 
 		GCPointer<ExceptionTypeInstance> typeInstance;
 		std::vector<IR::UntaggedValue> arguments;
@@ -193,9 +259,10 @@ namespace WAVM { namespace Runtime {
 	[[noreturn]] RUNTIME_API void throwException(ExceptionTypeInstance* type,
 												 std::vector<IR::UntaggedValue>&& arguments = {});
 
-	// Calls a thunk and catches any runtime exceptions that occur within it.
-	RUNTIME_API void catchRuntimeExceptions(const std::function<void()>& thunk,
-											const std::function<void(Exception&&)>& catchThunk);
+	// Calls a thunk and catches any runtime exceptions that occur within it. The thunks are passed
+	// by reference without being copied, so this doesn't allocate unless an exception is caught.
+	RUNTIME_API void catchRuntimeExceptions(FunctionRef<void()> thunk,
+											FunctionRef<void(Exception&&)> catchThunk);
 
 	typedef void (*UnhandledExceptionHandler)(Exception&&);
 	RUNTIME_API void setUnhandledExceptionHandler(UnhandledExceptionHandler handler);
@@ -226,6 +293,150 @@ namespace WAVM { namespace Runtime {
 													 FunctionInstance* function,
 													 const std::vector<IR::Value>& arguments);
 
+	// A FunctionInstance bound to a Context for repeated invocation. The invoke thunk, the
+	// context's runtime data, and the layout of the arguments in the thunk argument buffer are
+	// resolved once by prepareInvoke, so each call only needs to copy the arguments and call the
+	// thunk. The function's code is read through nativeFunction on each call, so calls will use
+	// code produced by tiered or lazy compilation after the invoke was prepared, but prepared
+	// invokes don't count toward tiering up the function's module instance.
+	struct PreparedInvoke
+	{
+		typedef ContextRuntimeData* (*InvokeThunkPointer)(void*, ContextRuntimeData*, const U8*);
+
+		FunctionInstance* function = nullptr;
+		IR::FunctionType functionType;
+		InvokeThunkPointer invokeThunk = nullptr;
+		const std::atomic<void*>* nativeFunction = nullptr;
+		ContextRuntimeData* contextRuntimeData = nullptr;
+		std::vector<U32> argOffsets;
+		Uptr numArgBytes = 0;
+	};
+
+	// Prepares a FunctionInstance to be invoked in a Context. The PreparedInvoke is only valid as
+	// long as the function and context are.
+	RUNTIME_API PreparedInvoke prepareInvoke(Context* context, FunctionInstance* function);
+
+	// Like invokeFunctionUnchecked, but invokes a PreparedInvoke.
+	RUNTIME_API IR::UntaggedValue* invokePrepared(const PreparedInvoke& preparedInvoke,
+												  const IR::UntaggedValue* arguments);
+
+	// Invokes a FunctionInstance once for each of numInvokes argument tuples. The arguments are
+	// read from numInvokes consecutive tuples of the function's parameter count, and the results
+	// are written to numInvokes consecutive tuples of the function's result count. All the invokes
+	// share a single runtime exception handler scope: if an invoke traps, trapHandler is called with
+	// its index and the exception, its results are zeroed, and the batch continues with the next
+	// invoke. Returns the number of invokes that trapped.
+	RUNTIME_API Uptr invokeFunctionBatch(
+		Context* context,
+		FunctionInstance* function,
+		Uptr numInvokes,
+		const IR::UntaggedValue* arguments,
+		IR::UntaggedValue* results,
+		const std::function<void(Uptr invokeIndex, Exception&& exception)>& trapHandler);
+
+	// Invokes a FunctionInstance through a statically typed C++ signature: e.g.
+	// TypedInvoke<I32(I32, F64)>. The function's type is checked against the signature once when
+	// the TypedInvoke is constructed, and each call writes its arguments directly into the thunk
+	// argument buffer at offsets that are known at compile time.
+	template<typename Signature> struct TypedInvoke;
+
+	template<typename Result, typename... Args> struct TypedInvoke<Result(Args...)>
+	{
+		TypedInvoke(Context* context, FunctionInstance* function)
+		: preparedInvoke(prepareInvoke(context, function))
+		{
+			const std::initializer_list<IR::ValueType> paramTypes = {
+				IR::inferValueType<Args>()...};
+			const IR::FunctionType signatureType(IR::inferResultType<Result>(),
+												 IR::TypeTuple(paramTypes));
+			if(preparedInvoke.functionType != signatureType)
+			{ throwException(Exception::invokeSignatureMismatchType); }
+
+			// The arguments are always written to the thunk argument buffer in ContextRuntimeData,
+			// so throw an exception if they don't fit in it.
+			if(preparedInvoke.numArgBytes > maxThunkArgAndReturnBytes)
+			{ throwException(Exception::outOfMemoryType); }
+		}
+
+		Result operator()(Args... args) const
+		{
+			U8* argData = preparedInvoke.contextRuntimeData->thunkArgAndReturnData;
+			writeArgs(argData, 0, args...);
+			ContextRuntimeData* resultContextRuntimeData = (*preparedInvoke.invokeThunk)(
+				preparedInvoke.nativeFunction->load(std::memory_order_acquire),
+				preparedInvoke.contextRuntimeData,
+				argData);
+			return readResult((Result*)nullptr, resultContextRuntimeData->thunkArgAndReturnData);
+		}
+
+		const PreparedInvoke& getPreparedInvoke() const { return preparedInvoke; }
+
+	private:
+		PreparedInvoke preparedInvoke;
+
+		static void writeArgs(U8*, Uptr) {}
+		template<typename Arg, typename... RestArgs>
+		static void writeArgs(U8* argData, Uptr offset, Arg arg, RestArgs... restArgs)
+		{
+			// Naturally align each argument, matching the layout used by invokeFunctionUnchecked.
+			offset = (offset + sizeof(Arg) - 1) & -Uptr(sizeof(Arg));
+			memcpy(argData + offset, &arg, sizeof(Arg));
+			writeArgs(argData, offset + sizeof(Arg), restArgs...);
+		}
+
+		static void readResult(void*, const U8*) {}
+		template<typename ResultValue> static ResultValue readResult(ResultValue*, const U8* data)
+		{
+			ResultValue result;
+			memcpy(&result, data, sizeof(ResultValue));
+			return result;
+		}
+	};
+
+	// An invocation of a FunctionInstance on its own stack, which an intrinsic called by the
+	// function may suspend with suspendInvoke, returning control to the host until the host resumes
+	// it. This allows a single thread to multiplex many invokes that are waiting for the host to
+	// complete asynchronous operations. Invokes that run in the same context share its mutable
+	// globals, so interleaved invokes should usually each have their own context.
+	struct SuspendableInvoke;
+
+	enum class SuspendableInvokeState
+	{
+		suspended,
+		returned,
+		threwException
+	};
+
+	// Creates a suspendable invoke of a function with the given arguments, which doesn't start
+	// running until it is resumed. The invoke keeps the context and function alive.
+	RUNTIME_API SuspendableInvoke* createSuspendableInvoke(Context* context,
+														   FunctionInstance* function,
+														   std::vector<IR::Value>&& arguments,
+														   Uptr numStackBytes = 1024 * 1024);
+
+	// Runs a suspended invoke on the calling thread until it returns, throws a runtime exception,
+	// or is suspended again. An invoke must always be resumed by the thread that created it.
+	RUNTIME_API SuspendableInvokeState resumeSuspendableInvoke(SuspendableInvoke* invoke);
+
+	// Returns the results of an invoke that has returned, or the exception thrown by an invoke that
+	// threw a runtime exception.
+	RUNTIME_API const IR::ValueTuple& getSuspendableInvokeResults(SuspendableInvoke* invoke);
+	RUNTIME_API const Exception& getSuspendableInvokeException(SuspendableInvoke* invoke);
+
+	// Deletes a suspendable invoke. If the invoke is suspended after it started running, it is
+	// resumed to unwind its stack before the stack is freed: the suspendInvoke call it is suspended
+	// in throws a C++ exception that isn't a runtime exception, and must not be caught by the
+	// intrinsic that called suspendInvoke.
+	RUNTIME_API void deleteSuspendableInvoke(SuspendableInvoke* invoke);
+
+	// Returns the suspendable invoke that is running on the calling thread, or null.
+	RUNTIME_API SuspendableInvoke* getCurrentSuspendableInvoke();
+
+	// Suspends the suspendable invoke that is running on the calling thread: returns from the
+	// resumeSuspendableInvoke call that is running it, and returns when it is resumed. Must be
+	// called by an intrinsic while a suspendable invoke is running.
+	RUNTIME_API void suspendInvoke();
+
 	// Returns the type of a FunctionInstance.
 	RUNTIME_API IR::FunctionType getFunctionType(FunctionInstance* function);
 
@@ -260,8 +471,33 @@ namespace WAVM { namespace Runtime {
 	// Memories
 	//
 
-	// Creates a Memory. May return null if the memory allocation fails.
-	RUNTIME_API MemoryInstance* createMemory(Compartment* compartment, IR::MemoryType type);
+	// Creates a Memory. May return null if the memory allocation fails. By default, 8GiB of address
+	// space is reserved for the memory, so code can access it without bounds checks. If
+	// maxReservedBytes is less than UINTPTR_MAX, only enough address space for the memory's
+	// declared maximum size is reserved, but no more than maxReservedBytes: the memory can't grow
+	// beyond its reservation, and may only be accessed by code compiled with memory bounds checks.
+	RUNTIME_API MemoryInstance* createMemory(Compartment* compartment,
+											 IR::MemoryType type,
+											 Uptr maxReservedBytes = UINTPTR_MAX);
+
+	// Creates a Memory whose pages are mapped from a file, so its contents can persist across
+	// processes. The memory's initial size is the type's minimum size, or the file's size rounded up
+	// to a whole number of pages if that is larger. If isShared is true, writes to the memory are
+	// written to the file, which must be open for writing, and growing the memory extends the file.
+	// Otherwise, the memory's pages are mapped copy-on-write, so memories created from the same file
+	// share physical pages until they are written, and the file is never modified.
+	//   If the memory's type is shared and isShared is true, processes that map the same file (e.g.
+	// a shared memory object opened by Platform::openSharedMemory) into a memory share it like
+	// threads do: atomic.notify wakes atomic.wait calls on the same 32-bit address in any of the
+	// processes. 64-bit waits may still only be woken by atomic.notify in the same process.
+	//   The memory takes ownership of the file, and closes it when the memory is freed, or if
+	// creating the memory fails. May return null if the file is larger than the memory's maximum
+	// size, or can't be mapped.
+	RUNTIME_API MemoryInstance* createFileBackedMemory(Compartment* compartment,
+													   IR::MemoryType type,
+													   Platform::File* file,
+													   bool isShared,
+													   Uptr maxReservedBytes = UINTPTR_MAX);
 
 	// Gets the base address of the memory's data.
 	RUNTIME_API U8* getMemoryBaseAddress(MemoryInstance* memory);
@@ -277,6 +513,66 @@ namespace WAVM { namespace Runtime {
 	// Unmaps a range of memory pages within the memory's address-space.
 	RUNTIME_API void unmapMemoryPages(MemoryInstance* memory, Uptr pageIndex, Uptr numPages);
 
+	// Frees the physical memory of the memory's pages that contain only zeroes. The pages stay in
+	// the memory, and still read as zero. Returns the number of bytes of pages that were reset,
+	// which may include pages that were never touched. Memories with pages mapped from a file are
+	// skipped. No thread may access the memory while it is being reclaimed, so hosts should call
+	// this between the calls into an instance, e.g. when a long-lived instance is idle.
+	RUNTIME_API Uptr reclaimZeroMemoryPages(MemoryInstance* memory);
+
+	// Calls reclaimZeroMemoryPages for each memory in a compartment, and returns the total number
+	// of bytes reset.
+	RUNTIME_API Uptr reclaimCompartmentZeroMemoryPages(Compartment* compartment);
+
+	// Maps a range of a file, starting at fileOffset, into a range of the memory's pages, so the
+	// file's contents can be accessed by WebAssembly code without copying them. fileOffset must be
+	// a multiple of IR::numBytesPerPage, and the pages must be within the memory's current size.
+	// If isShared is true, writes to the pages are written to the file, which must be open for
+	// writing; otherwise the pages are mapped copy-on-write. Pages past the end of the file are
+	// zeroed. Returns false if the file can't be mapped into the memory; if that happens, the
+	// contents of the pages are undefined.
+	RUNTIME_API bool mapMemoryFile(MemoryInstance* memory,
+								   Uptr pageIndex,
+								   Uptr numPages,
+								   Platform::File* file,
+								   U64 fileOffset,
+								   bool isShared);
+
+	// Replaces a range of memory pages mapped by mapMemoryFile with zeroed pages.
+	RUNTIME_API void unmapMemoryFile(MemoryInstance* memory, Uptr pageIndex, Uptr numPages);
+
+	// Starts or stops tracking which of a memory's pages are written, so a host can checkpoint the
+	// memory by copying only the pages written since its last checkpoint. The first checkpoint
+	// should copy the whole memory when tracking starts. startMemoryDirtyPageTracking returns
+	// false if the platform can't track written pages: it is supported on Linux kernels with
+	// soft-dirty page tracking. The platform's record of written pages is process-wide, so while
+	// any memory is tracked, the runtime must be its only user in the process: it also returns
+	// false if other code acquired it with Platform::acquireVirtualPageDirtyTracking, and nothing
+	// else in the process may clear the soft-dirty bits, e.g. through /proc/self/clear_refs.
+	RUNTIME_API bool startMemoryDirtyPageTracking(MemoryInstance* memory);
+	RUNTIME_API void stopMemoryDirtyPageTracking(MemoryInstance* memory);
+
+	// A range of bytes in a memory.
+	struct MemoryRange
+	{
+		Uptr offset;
+		Uptr numBytes;
+	};
+
+	// Returns the ranges of a tracked memory's pages that may have been written since tracking
+	// started or this was last called for the memory, in order of their offsets, and starts
+	// tracking the writes for the next checkpoint. The ranges are aligned to the platform's page
+	// size, and only cover the memory's current size, so a checkpoint should also record the
+	// memory's size: pages past the previous checkpoint's size that aren't in a range are zero.
+	// The platform tracks writes for the whole process at once, so no thread may write to any
+	// tracked memory while this is called.
+	RUNTIME_API std::vector<MemoryRange> getDirtyMemoryRanges(MemoryInstance* memory);
+
+	// Sets the number of bytes that a memory.copy or memory.fill of a shared memory must write to be
+	// split between multiple threads. By default, it is 64MiB. Copies between overlapping ranges
+	// always run on the calling thread.
+	RUNTIME_API void setParallelBulkMemoryThreshold(Uptr numBytes);
+
 	// Validates that an offset range is wholly inside a Memory's virtual address range.
 	// Note that this returns an address range that may fault on access, though it's guaranteed not
 	// to be mapped by anything other than the given MemoryInstance.
@@ -304,11 +600,93 @@ namespace WAVM { namespace Runtime {
 		return (Value*)getValidatedMemoryOffsetRange(memory, offset, numElements * sizeof(Value));
 	}
 
+	// A range of a memory that is validated once when the view is created, so host code that reads
+	// or writes many values in the range (e.g. the fields of a struct, or an array of iovecs) only
+	// needs to compare each access against the view's bounds, without loading the memory's size.
+	// Addresses are offsets in the memory, not in the view. The view is only valid until the memory
+	// is shrunk or its pages are unmapped: growing the memory doesn't invalidate it.
+	struct MemoryView
+	{
+		// Creates a view of a range of the memory, throwing an out-of-bounds exception if it isn't
+		// wholly inside the memory's committed pages.
+		MemoryView(MemoryInstance* memory, Uptr inAddress, Uptr inNumBytes)
+		: base(getValidatedMemoryOffsetRange(memory, inAddress, inNumBytes))
+		, beginAddress(inAddress)
+		, endAddress(inAddress + inNumBytes)
+		{
+		}
+
+		// Creates a view of all the memory's committed pages.
+		RUNTIME_API MemoryView(MemoryInstance* memory);
+
+		bool contains(Uptr address, Uptr numBytes) const
+		{
+			return address >= beginAddress && address <= endAddress
+				   && numBytes <= endAddress - address;
+		}
+
+		// Validates that a range of elements is inside the view, and returns a pointer to it.
+		template<typename Value> Value* arrayPtr(Uptr address, Uptr numElements) const
+		{
+			if(numElements > UINTPTR_MAX / sizeof(Value)
+			   || !contains(address, numElements * sizeof(Value)))
+			{ throwException(Exception::memoryAddressOutOfBoundsType); }
+			return (Value*)(base + (address - beginAddress));
+		}
+
+		// Validates that an element is inside the view, and returns a reference to it.
+		template<typename Value> Value& ref(Uptr address) const
+		{
+			return *arrayPtr<Value>(address, 1);
+		}
+
+		// Reads or writes an element at an address that the caller knows is inside the view, e.g.
+		// a field of a struct the view was created for. The address isn't validated, except by an
+		// assertion, and needn't be aligned.
+		template<typename Value> Value load(Uptr address) const
+		{
+			wavmAssert(contains(address, sizeof(Value)));
+			Value value;
+			memcpy(&value, base + (address - beginAddress), sizeof(Value));
+			return value;
+		}
+		template<typename Value> void store(Uptr address, Value value) const
+		{
+			wavmAssert(contains(address, sizeof(Value)));
+			memcpy(base + (address - beginAddress), &value, sizeof(Value));
+		}
+
+		// Returns the number of bytes in the null-terminated string at address before its
+		// terminator, or maxNumBytes if it has no terminator in its first maxNumBytes bytes. Throws
+		// an out-of-bounds exception if the view ends before the terminator or maxNumBytes. The
+		// string is scanned with memchr, which the C library vectorizes.
+		Uptr getStringLength(Uptr address, Uptr maxNumBytes) const
+		{
+			if(address < beginAddress || address > endAddress)
+			{ throwException(Exception::memoryAddressOutOfBoundsType); }
+			const Uptr numScannedBytes
+				= maxNumBytes < endAddress - address ? maxNumBytes : endAddress - address;
+			const U8* string = base + (address - beginAddress);
+			const void* terminator = memchr(string, 0, numScannedBytes);
+			if(terminator) { return Uptr((const U8*)terminator - string); }
+			if(numScannedBytes < maxNumBytes)
+			{ throwException(Exception::memoryAddressOutOfBoundsType); }
+			return maxNumBytes;
+		}
+
+	private:
+		// The address of the first byte of the view.
+		U8* base;
+		Uptr beginAddress;
+		Uptr endAddress;
+	};
+
 	//
 	// Globals
 	//
 
-	// Creates a GlobalInstance with the specified type and initial value.
+	// Creates a GlobalInstance with the specified type and initial value. May return null if the
+	// global is mutable and the compartment's contexts have no space left for its value.
 	RUNTIME_API GlobalInstance* createGlobal(Compartment* compartment,
 											 IR::GlobalType type,
 											 IR::Value initialValue);
@@ -321,6 +699,37 @@ namespace WAVM { namespace Runtime {
 										 GlobalInstance* global,
 										 IR::Value newValue);
 
+	// Returns a pointer to a mutable global's value in a context, after checking that the global
+	// has the given value type. The pointer is valid for the context's lifetime, so host code that
+	// accesses a global often (e.g. a stack pointer) can resolve it once instead of calling
+	// getGlobalValue or setGlobalValue for each access.
+	RUNTIME_API IR::UntaggedValue* getMutableGlobalValuePointer(Context* context,
+																GlobalInstance* global,
+																IR::ValueType valueType);
+
+	// A typed handle to a mutable global's value in a context, which reads and writes the value
+	// directly, without boxing it or checking its type. It is valid for the context's lifetime. A
+	// reference written to the global must be in the context's compartment.
+	template<typename Value> struct GlobalHandle
+	{
+		GlobalHandle(Context* context, GlobalInstance* global)
+		: value(getMutableGlobalValuePointer(context, global, IR::inferValueType<Value>()))
+		{
+		}
+
+		Value get() const
+		{
+			Value result;
+			memcpy(&result, value, sizeof(Value));
+			return result;
+		}
+
+		void set(Value newValue) const { memcpy(value, &newValue, sizeof(Value)); }
+
+	private:
+		IR::UntaggedValue* value;
+	};
+
 	//
 	// Modules
 	//
@@ -334,18 +743,352 @@ namespace WAVM { namespace Runtime {
 		std::vector<ExceptionTypeInstance*> exceptionTypes;
 	};
 
+	// A cache of compiled object code provided by the host, e.g. one shared by many machines
+	// through a remote store. The object code for a compile is cached with a key derived from a
+	// hash of the module, the compile options, the WAVM version, and the target CPU and features.
+	// The values are opaque to the cache, and are validated by the runtime when they are loaded,
+	// so invalid or mismatched values are ignored. The cache may be called by multiple threads at
+	// once.
+	struct ObjectCache
+	{
+		virtual ~ObjectCache() {}
+
+		// Returns true and the value cached with a key, or false if there isn't one.
+		virtual bool load(const std::string& key, std::vector<U8>& outValue) = 0;
+
+		// Caches a value with a key. It may return before the value is stored, e.g. to upload it
+		// in the background, and may ignore failures.
+		virtual void save(const std::string& key, std::vector<U8>&& value) = 0;
+	};
+
+	// Which optimization passes compileModule runs on a module.
+	enum class OptimizationLevel
+	{
+		// Only promotes locals to SSA values: compiles quickly, but generates slow code.
+		none,
+
+		// Runs a short list of cheap optimization passes.
+		fast,
+
+		// Similar to LLVM's -O2.
+		standard,
+
+		// Similar to LLVM's -O3.
+		aggressive,
+	};
+
+	// How much effort the code generator spends on optimizing the machine code for a module.
+	enum class CodeGenOptimizationLevel
+	{
+		// Chosen according to the OptimizationLevel.
+		automatic,
+
+		none,
+		less,
+		standard,
+		aggressive,
+	};
+
+	// Options that control how compileModule compiles a module.
+	struct CompileOptions
+	{
+		OptimizationLevel optimizationLevel = OptimizationLevel::fast;
+		CodeGenOptimizationLevel codeGenOptimizationLevel = CodeGenOptimizationLevel::automatic;
+
+		// The CPU to generate code for, using LLVM's CPU names (e.g. "skylake"). If empty, code is
+		// generated for the host CPU. Code generated for a different CPU may only be executed on
+		// CPUs that support all its features.
+		std::string targetCPU;
+
+		// LLVM target features to enable or disable (e.g. "+avx2" or "-avx512f").
+		std::vector<std::string> targetFeatures;
+
+		// Additional CPUs and features to compile versions of the module's code for, in order of
+		// preference. When the module's object code is loaded, the first version that the host CPU
+		// supports is used, or the version for targetCPU and targetFeatures if the host doesn't
+		// support any of them. This allows a module to be compiled ahead of time for a baseline
+		// CPU, and still use the features of more capable hosts. Lazily compiled functions are
+		// only compiled for targetCPU and targetFeatures.
+		struct TargetVersion
+		{
+			std::string targetCPU;
+			std::vector<std::string> targetFeatures;
+		};
+		std::vector<TargetVersion> targetVersions;
+
+		// The maximum number of bytes of address space to reserve for each memory defined by an
+		// instance of the module (see createMemory). If it is UINTPTR_MAX, each memory has 8GiB of
+		// address space reserved, and memory accesses aren't bounds checked. Otherwise, memory
+		// accesses are bounds checked against the memory's reservation, which allows more
+		// instances to fit in the address space: e.g. 4GiB reserves just enough for any memory's
+		// declared maximum size, and less restricts how large memories can grow.
+		Uptr maxMemoryReservedBytes = UINTPTR_MAX;
+
+		// The number of threads to compile the module on. If greater than one, the module's
+		// function definitions are compiled in parallel partitions. If zero, one thread is used for
+		// each hardware thread.
+		Uptr numCompileThreads = 1;
+
+		// If not empty, a directory used to cache compiled object code. Compiling a module that was
+		// previously compiled with the same WAVM, feature spec, and host CPU loads the previously
+		// compiled object code from the cache instead of recompiling it.
+		std::string objectCacheDirectory;
+
+		// If not null, a host cache used to load and save compiled object code like
+		// objectCacheDirectory. If both are set, the directory is checked first, and object code
+		// loaded from the host's cache is saved to the directory.
+		std::shared_ptr<ObjectCache> objectCache;
+
+		// If non-zero, the module is compiled with tiered compilation: it is first compiled with
+		// minimal optimization, so it can start executing as soon as possible. When an instance of
+		// the module is invoked from the host tierUpCallCount times, the module is recompiled with
+		// optimizationLevel on a background thread, and the instance's functions are switched to
+		// the optimized code: host calls and calls through tables use the optimized code from then
+		// on, and the optimized code only calls other optimized code.
+		Uptr tierUpCallCount = 0;
+
+		// If true, the module isn't compiled by compileModule: instead, each function definition
+		// in an instance of the module initially points to a stub that compiles the function the
+		// first time it is called. This reduces the time and memory needed to instantiate modules
+		// that only call a few of their functions. If lazyCompileDirectCallees is also true, the
+		// functions a function directly calls or references are compiled along with it. Lazily
+		// compiled modules don't use the object cache or tiered compilation, and have no object
+		// code for getObjectCode to return.
+		bool lazyCompile = false;
+		bool lazyCompileDirectCallees = false;
+
+		// If true, the active data segments of each memory defined by the module are written once
+		// to a snapshot of the memory's initial contents, which is mapped copy-on-write into the
+		// memory of each instance of the module instead of copying the data segments into it. The
+		// pages of the memory are read from the snapshot when they are first accessed, so
+		// instantiating the module doesn't take time proportional to the size of its data
+		// segments. This is only supported on Linux, and only for memories with data segments
+		// that have constant offsets within the memory's minimum size; other memories are
+		// initialized by copying their data segments.
+		bool mapDataSegmentsOnDemand = false;
+
+		// If true, compiling a module that is identical to a module that was previously compiled
+		// with the same options returns the previously compiled module while it hasn't been freed,
+		// instead of compiling it again. This allows the hosts of many compartments that each load
+		// the same module to compile it once, and share the compiled module's object code and the
+		// state derived from it (e.g. the memory snapshots of mapDataSegmentsOnDemand and the
+		// optimized tier) between the compartments. Modules compiled with lazyCompile or
+		// profileInstrumentation aren't shared, since their instances aren't independent of the
+		// module: they add their lazily compiled code or profile counts to it.
+		bool shareIdenticalModules = false;
+
+		// If true, the module's code checks the epoch (see incrementEpoch) on entry to each
+		// function and on each iteration of each loop, and throws epochDeadlineReachedType if it
+		// has reached the deadline of the context the code is running in (or yields, see
+		// setContextEpochYieldSlice). This allows the host to bound the time spent in a call to a
+		// module's code without killing the thread running it.
+		bool epochInterruption = false;
+
+		// If true, the module's code consumes the fuel of the context it is running in: each
+		// straight-line run of operators consumes one unit of fuel per operator when it is entered.
+		// When the fuel runs out, the context's fuel exhausted handler is called, and if it doesn't
+		// refill the fuel, Exception::fuelExhaustedType is thrown. See setContextFuel.
+		bool fuelMetering = false;
+
+		// If true, the module's code checks the stack pointer on entry to each function against
+		// the stack budget of the context it is running in, and throws stackOverflowType if the
+		// budget is exhausted. See setContextStackBudget.
+		bool stackLimitChecks = false;
+
+		// If true, the module's floating-point operators produce the positive canonical NaN
+		// wherever WebAssembly allows them to produce a NaN with an arbitrary sign and payload.
+		// Along with a fixed targetCPU and targetFeatures, this makes the module's results
+		// bit-identical across hosts, e.g. for replaying or agreeing on the results of an
+		// execution, at the cost of a compare and select for each floating-point operator.
+		bool canonicalizeNaNs = false;
+
+		// If true, the module's loads and stores may be sampled by the memory access trace of the
+		// context they run in (see startContextMemoryAccessTrace). Each access decrements a
+		// countdown in the context, and only calls into the runtime when it reaches zero.
+		bool memoryAccessSampling = false;
+
+		// If true, the module's non-atomic loads and stores of unshared memories may be vectorized
+		// and otherwise optimized like ordinary memory accesses. Out-of-bounds accesses still
+		// trap, but the memory's contents after a trap may differ from what WebAssembly specifies,
+		// and an out-of-bounds load whose result is unused may not trap.
+		bool relaxedMemoryAccesses = false;
+
+		// Maps the indices of immutable imported globals with number or vector types to values that
+		// the module's code is specialized for: the code uses the values as constants instead of
+		// loading them from the imported globals, but the module may only be instantiated with
+		// imported globals that have the same values. See compileSpecializedModule.
+		std::map<Uptr, IR::Value> specializedGlobalImports;
+
+		// If true, the module's code collects a profile of its execution: how many times each
+		// function is called, which branches are taken, and which functions are called through
+		// tables. The profile is shared by all instances of the module, and can be read with
+		// getModuleProfile. Profiled modules aren't compiled while streaming.
+		bool profileInstrumentation = false;
+
+		// If true, the code of a module compiled with profileInstrumentation also counts the
+		// processor cycles spent in each function's calls (see getFunctionProfiles).
+		bool profileCycles = false;
+
+		// If true, the module's code keeps a frame pointer in each function, so its call stacks
+		// can be sampled by startGuestCallStackSampling.
+		bool framePointers = false;
+
+		// If not empty, a profile returned by getModuleProfile for a previous compilation of the
+		// module, which is used to optimize the code for the paths that were hot when the profile
+		// was collected. An invalid profile is logged and ignored.
+		std::vector<U8> profile;
+	};
+
+	// Parses the name of an optimization level, as used by the command-line tools: "none", "fast",
+	// "O2", or "O3" for OptimizationLevel, and "none", "less", "default", or "aggressive" for
+	// CodeGenOptimizationLevel. Returns false if the name isn't recognized.
+	RUNTIME_API bool parseOptimizationLevel(const char* name, OptimizationLevel& outLevel);
+	RUNTIME_API bool parseCodeGenOptimizationLevel(const char* name,
+												   CodeGenOptimizationLevel& outLevel);
+
+	// Splits a comma-separated list of target features, as used by the command-line tools, and
+	// appends them to outFeatures (e.g. to CompileOptions::targetFeatures). Empty features are
+	// skipped.
+	RUNTIME_API void appendTargetFeatures(const char* featureList,
+										  std::vector<std::string>& outFeatures);
+
 	// Compiles an IR module to object code.
-	RUNTIME_API Module* compileModule(const IR::Module& irModule);
+	RUNTIME_API Module* compileModule(const IR::Module& irModule,
+									  const CompileOptions& options = CompileOptions());
+
+	// Compiles a module like compileModule, specialized for the values of the immutable number and
+	// vector globals it imports from imports (see CompileOptions::specializedGlobalImports), so
+	// e.g. address computations using an imported memory or table base are constant folded. The
+	// module may only be instantiated with imported globals that have the same values. With
+	// shareIdenticalModules or an object cache directory, compiles with the same import values
+	// reuse the same module or object code.
+	RUNTIME_API Module* compileSpecializedModule(const IR::Module& irModule,
+												 const ImportBindings& imports,
+												 const CompileOptions& options = CompileOptions());
+
+	// Decodes and compiles a binary WebAssembly module from bytes that are fed to it incrementally,
+	// e.g. as they are received from the network: the bytes are decoded on a background thread as
+	// they arrive, and each function definition is compiled as soon as its body has been decoded
+	// and validated. Modules that are compiled lazily or with an object cache directory are
+	// decoded while streaming, but aren't compiled until the stream is finished.
+	struct StreamingCompile;
+	RUNTIME_API StreamingCompile* beginStreamingCompile(
+		const IR::FeatureSpec& featureSpec,
+		const CompileOptions& options = CompileOptions());
+
+	// Feeds the next numBytes of the module's binary to a streaming compile.
+	RUNTIME_API void feedStreamingCompile(StreamingCompile* compile,
+										  const U8* bytes,
+										  Uptr numBytes);
+
+	// Signals that all the module's bytes have been fed to a streaming compile, waits for the
+	// module to be decoded and compiled, and deletes the streaming compile. If the module was
+	// valid, writes it to outIRModule and returns the compiled module. Otherwise, logs the error
+	// and returns nullptr.
+	RUNTIME_API Module* finishStreamingCompile(StreamingCompile* compile, IR::Module& outIRModule);
+
+	// The priority of a compile on the background compile threads. The threads start the most
+	// urgent compile that is waiting, and a compile that is running yields its thread between
+	// partitions while a more urgent compile is waiting for a thread. The optimized tier of
+	// modules compiled with tiered compilation is compiled with warmUp priority.
+	enum class CompilePriority
+	{
+		warmUp,
+		normal,
+		interactive,
+	};
+
+	// The progress of a compile started by compileModuleAsync. The numbers of function
+	// definitions that were emitted and compiled increase as each partition of the module is
+	// compiled (see CompileOptions::numCompileThreads). If the module's object code was loaded
+	// from the object cache, they jump to numFunctionDefs when it was loaded.
+	struct AsyncCompileProgress
+	{
+		Uptr numFunctionDefs;
+		Uptr numFunctionDefsEmitted;
+		Uptr numFunctionDefsCompiled;
+		bool isFinished;
+	};
+
+	// Compiles a module on the background compile threads. The module is copied, so irModule
+	// doesn't need to outlive the compile. If onFinished is not null, it is called on the compile
+	// thread when the compile finishes, with the compiled module, or null if it was cancelled.
+	// Either way, the compile must be deleted by finishAsyncCompile, which must not be called by
+	// onFinished.
+	struct AsyncCompile;
+	RUNTIME_API AsyncCompile* compileModuleAsync(
+		const IR::Module& irModule,
+		const CompileOptions& options = CompileOptions(),
+		CompilePriority priority = CompilePriority::normal,
+		std::function<void(Module*)>&& onFinished = nullptr);
+
+	// Returns the progress of a compile started by compileModuleAsync.
+	RUNTIME_API AsyncCompileProgress getAsyncCompileProgress(AsyncCompile* compile);
+
+	// Cancels a compile started by compileModuleAsync. If it hasn't started yet, it never starts;
+	// otherwise, it stops before compiling its next partition.
+	RUNTIME_API void cancelAsyncCompile(AsyncCompile* compile);
+
+	// Waits for a compile started by compileModuleAsync to finish, deletes it, and returns the
+	// compiled module, or null if the compile was cancelled.
+	RUNTIME_API Module* finishAsyncCompile(AsyncCompile* compile);
+
+	// Sets the maximum number of compiles that run on the background compile threads at once. By
+	// default, it is the number of hardware threads.
+	RUNTIME_API void setMaxAsyncCompileThreads(Uptr maxThreads);
 
 	// Extracts the compiled object code for a module. This may be used as an input to
-	// loadPrecompiledModule to bypass redundant compilations of the module.
+	// loadPrecompiledModule to bypass redundant compilations of the module. The module must not be
+	// compiled lazily or with profileInstrumentation.
 	RUNTIME_API std::vector<U8> getObjectCode(Module* module);
 
+	// Compiles a module like compileModule, reusing the object code of the parts of the module
+	// that are unchanged since previousObjectCode was compiled by this function: previousManifest
+	// is the manifest it wrote to outManifest, which describes the function definitions its object
+	// code was compiled from. Object code is reused for partitions of consecutive function
+	// definitions that have the same code, when the module's declarations and the compile options
+	// are also unchanged. previousObjectCode and previousManifest may be empty, or invalid, in
+	// which case the whole module is compiled. Modules that are compiled lazily, with profile
+	// instrumentation, or with target versions are always compiled as a whole, and have an empty
+	// manifest.
+	RUNTIME_API Module* compileModuleIncrementally(const IR::Module& irModule,
+												   const std::vector<U8>& previousObjectCode,
+												   const std::vector<U8>& previousManifest,
+												   std::vector<U8>& outManifest,
+												   const CompileOptions& options = CompileOptions());
+
 	// Loads a previously compiled module from a combination of an IR module and the object code
-	// returned by getObjectCode for the previously compiled module.
+	// returned by getObjectCode for the previously compiled module. Only the IR module's
+	// declarations are used, so it may be loaded with WASM::loadBinaryModuleDeclarations to skip
+	// decoding and validating its function bodies, as long as the object code is trusted to have
+	// been compiled from the same module.
 	RUNTIME_API Module* loadPrecompiledModule(const IR::Module& irModule,
 											  const std::vector<U8>& objectCode);
 
+	// Returns the profile collected by the code of an instance of a module compiled with
+	// profileInstrumentation, which may be passed as CompileOptions::profile to recompile the
+	// module. The profile includes the execution of all the module's instances.
+	RUNTIME_API std::vector<U8> getModuleProfile(ModuleInstance* moduleInstance);
+
+	// The execution profile of a function definition.
+	struct FunctionProfile
+	{
+		// The function's name from the module's name section.
+		std::string name;
+
+		// The number of times the function was called.
+		U64 numCalls;
+
+		// The number of processor cycles spent in the function's calls, including the cycles
+		// spent in its callees, if the module was compiled with profileCycles. Calls that are
+		// unwound by an exception aren't counted.
+		U64 numCycles;
+	};
+
+	// Returns the profile of each function definition of a module compiled with
+	// profileInstrumentation, including the execution of all the module's instances.
+	RUNTIME_API std::vector<FunctionProfile> getFunctionProfiles(ModuleInstance* moduleInstance);
+
 	// Instantiates a compiled module, bindings its imports to the specified objects. May throw a
 	// runtime exception for bad segment offsets.
 	RUNTIME_API ModuleInstance* instantiateModule(Compartment* compartment,
@@ -363,14 +1106,75 @@ namespace WAVM { namespace Runtime {
 	// Gets an object exported by a ModuleInstance by name.
 	RUNTIME_API Object* getInstanceExport(ModuleInstance* moduleInstance, const std::string& name);
 
+	// Returns the index of a module's export with the given name, or UINTPTR_MAX if the module has
+	// no such export. The index may be passed to getInstanceExportByIndex for any instance of the
+	// module, which gets the export without looking up its name.
+	RUNTIME_API Uptr getModuleExportIndex(Module* module, const std::string& name);
+
+	// Gets the object exported by an instance of a module for an index returned by
+	// getModuleExportIndex for the module. The ModuleInstance must have been created by
+	// instantiateModule, not Intrinsics::instantiateModule.
+	RUNTIME_API Object* getInstanceExportByIndex(ModuleInstance* moduleInstance, Uptr exportIndex);
+
+	// Replaces the code of a ModuleInstance's function definitions with the code of a newer
+	// compiled module, without reinitializing the instance's memories, tables or globals. The
+	// instance's exports and the compartment's table elements that refer to its functions call the
+	// new code once this returns; calls that are already running finish in the old code, which
+	// stays loaded until the instance is destroyed. Returns false without changing the instance if
+	// the new module's layout isn't compatible with the instance: it must have the same function
+	// imports and the same number of each kind of object, with types that the instance's objects
+	// match, the same exports, and the same passive segments. Instances or modules that use tiered
+	// or lazy compilation or profile instrumentation can't be replaced. May throw an out of memory
+	// exception if the new code exceeds the compartment's memory budget.
+	RUNTIME_API bool replaceModuleInstanceCode(ModuleInstance* moduleInstance, Module* newModule);
+
 	//
 	// Compartments
 	//
 
-	RUNTIME_API Compartment* createCompartment();
-
+	// Creates a compartment. If useLargePages is true, the pages committed to the compartment's
+	// memories and tables are backed by large pages where the OS allows it, which reduces TLB misses
+	// for code that accesses large memories. If numaNode isn't UINTPTR_MAX, the compartment has an
+	// affinity for that NUMA node (see Platform::getNumNUMANodes): the pages committed to its
+	// memories and tables are allocated from the node where the OS allows it, and the threads that
+	// intrinsics create for it should only run on the node's processors. If packJITCode is true,
+	// the JIT code of the compartment's module instances is packed into pages that are mapped both
+	// writable and executable (see LLVMJIT::createCodeArena), which uses less memory for many
+	// small modules, but leaves the code writable through the writable mapping.
+	RUNTIME_API Compartment* createCompartment(bool useLargePages = false,
+											   Uptr numaNode = UINTPTR_MAX,
+											   bool packJITCode = false);
+
+	// Returns the NUMA node that a compartment was created with an affinity for, or UINTPTR_MAX if
+	// it has none. Hosts and intrinsics that create threads that execute a compartment's code pass
+	// it to Platform::createThread.
+	RUNTIME_API Uptr getCompartmentNUMANode(const Compartment* compartment);
+
+	// Limits the number of bytes that may be committed to a compartment's runtime data, contexts,
+	// memories, tables, and the JIT code of its module instances. Once the limit is reached, growing
+	// a memory or table fails as if the OS couldn't commit the pages, createContext returns null,
+	// and instantiating a module throws Exception::outOfMemoryType. Lowering the limit below the
+	// bytes already committed doesn't free them. Clones of the compartment inherit its limit. The
+	// limit is UINTPTR_MAX by default.
+	RUNTIME_API void setCompartmentMemoryLimit(Compartment* compartment, Uptr maxCommittedBytes);
+
+	// Returns the number of bytes committed to a compartment, as counted by the limit set by
+	// setCompartmentMemoryLimit. The "runtime.compartment_committed_bytes" metric is the sum of
+	// this for all compartments.
+	RUNTIME_API Uptr getCompartmentCommittedBytes(const Compartment* compartment);
+
+	// Creates a copy of a compartment and the objects in it. Where the platform supports it, each
+	// memory is cloned copy-on-write, but only a memory that is still mapped from an unmodified
+	// snapshot (e.g. an unmodified clone) shares physical pages with its clone: any other memory
+	// is copied into a new snapshot first. To create many clones of a compartment cheaply, clone
+	// it once, and create the other clones from that clone without writing its memories.
 	RUNTIME_API Compartment* cloneCompartment(Compartment* compartment);
 
+	// Returns whether an object may be referenced by the objects in a compartment: objects may
+	// only reference objects in the same compartment, in a compartment it was cloned from, or that
+	// aren't owned by any compartment (modules, exception types, and intrinsic functions).
+	RUNTIME_API bool isInCompartment(Object* object, const Compartment* compartment);
+
 	RUNTIME_API Uptr getCompartmentTableId(const TableInstance* table);
 	RUNTIME_API Uptr getCompartmentMemoryId(const MemoryInstance* memory);
 
@@ -391,4 +1195,221 @@ namespace WAVM { namespace Runtime {
 
 	// Creates a new context, initializing its mutable global state from the given context.
 	RUNTIME_API Context* cloneContext(Context* context, Compartment* newCompartment);
+
+	//
+	// Runtime shards
+	//
+
+	// A runtime shard holds its own copies of caches and pools that are otherwise shared by all
+	// threads: the invoke thunks that functions are called through, and the address ranges of
+	// destroyed memories. A thread that is bound to a shard looks up invoke thunks in the shard's
+	// cache, and reuses the address ranges that were pooled by other threads bound to the shard,
+	// without synchronizing with threads bound to other shards. For example, a server that
+	// handles each request on a single thread may bind each of its worker threads to its own
+	// shard. Objects are still owned by their compartment, and may be used from any thread.
+	struct RuntimeShard;
+
+	RUNTIME_API RuntimeShard* createRuntimeShard();
+
+	// Destroys a shard that isn't bound to any thread, and returns the address ranges pooled by
+	// it to the process-wide pool.
+	RUNTIME_API void destroyRuntimeShard(RuntimeShard* shard);
+
+	// Binds the calling thread to a shard, or unbinds it if shard is null. Threads aren't bound to
+	// a shard when they are created.
+	RUNTIME_API void setCurrentRuntimeShard(RuntimeShard* shard);
+	RUNTIME_API RuntimeShard* getCurrentRuntimeShard();
+
+	//
+	// Epoch interruption
+	//
+
+	// The epoch is a process-wide counter that code compiled with CompileOptions::epochInterruption
+	// compares to the deadline of the context it is running in. The host interrupts code by
+	// setting a context's deadline, and incrementing the epoch until it reaches it: either
+	// directly, or by starting the epoch timer to increment it periodically on a background thread.
+	RUNTIME_API U64 getEpoch();
+	RUNTIME_API void incrementEpoch();
+
+	// Sets the deadline of a context to numEpochs after the current epoch, after which code running
+	// in the context throws Exception::epochDeadlineReachedType. If numEpochs is UINT64_MAX, the
+	// context has no deadline, which is the initial state of a new context. Once the deadline is
+	// reached, code running in the context keeps throwing the exception until the deadline is set
+	// again.
+	RUNTIME_API void setContextEpochDeadline(Context* context, U64 numEpochs);
+
+	// Sets the time slice of a context for cooperative scheduling. If numEpochs is non-zero, code
+	// running in a suspendable invoke in the context suspends the invoke when it reaches the
+	// context's deadline, instead of throwing Exception::epochDeadlineReachedType, and sets the
+	// deadline to numEpochs after the current epoch when it is resumed. This allows a host to
+	// fairly multiplex many long-running invokes on one thread by resuming them in turn. Code that
+	// isn't running in a suspendable invoke still throws. A new context's slice is zero.
+	RUNTIME_API void setContextEpochYieldSlice(Context* context, U64 numEpochs);
+
+	// Starts (or restarts with a new period) a thread that increments the epoch every
+	// periodMicroseconds, or stops it.
+	RUNTIME_API void startEpochTimer(U64 periodMicroseconds);
+	RUNTIME_API void stopEpochTimer();
+
+	//
+	// Call stack sampling
+	//
+
+	// A call stack of WebAssembly functions sampled by startGuestCallStackSampling.
+	struct SampledCallStack
+	{
+		// The names of the functions in the call stack, outermost first. If the sampled thread
+		// was running host code called by WebAssembly code, the innermost name is "[host]".
+		std::vector<std::string> functionNames;
+
+		// The number of samples of the call stack.
+		U64 numSamples;
+	};
+
+	// Starts (or restarts with a new rate) sampling the call stacks of the threads running
+	// WebAssembly code about samplesPerSecond times per second of CPU time. Call stacks are found
+	// by following frame pointers, so only the code of modules compiled with
+	// CompileOptions::framePointers is sampled accurately. The samples are symbolized by a
+	// background thread shortly after they are taken, so the modules of sampled code must not be
+	// freed while sampling. Starting sampling discards the call stacks sampled by an earlier call.
+	// Returns false if sampling isn't supported by the platform.
+	RUNTIME_API bool startGuestCallStackSampling(Uptr samplesPerSecond);
+	RUNTIME_API void stopGuestCallStackSampling();
+
+	// Returns the call stacks sampled since startGuestCallStackSampling was called, and the number
+	// of samples that were dropped because they were taken faster than they could be symbolized.
+	RUNTIME_API std::vector<SampledCallStack> getSampledGuestCallStacks(U64& outNumDroppedSamples);
+
+	//
+	// Fuel metering
+	//
+
+	// Gets or sets the fuel that code compiled with CompileOptions::fuelMetering may consume in a
+	// context. New contexts have INT64_MAX fuel. The fuel is negative if it was exhausted by the
+	// last code that ran in the context.
+	RUNTIME_API I64 getContextFuel(Context* context);
+	RUNTIME_API void setContextFuel(Context* context, I64 fuel);
+
+	// Sets a function that is called when code running in a context exhausts its fuel. If the
+	// handler returns true after making the context's fuel non-negative (e.g. by adding to it with
+	// setContextFuel), the code resumes; otherwise, Exception::fuelExhaustedType is thrown.
+	RUNTIME_API void setContextFuelExhaustedHandler(Context* context,
+													std::function<bool(Context*)>&& handler);
+
+	//
+	// Stack limits
+	//
+
+	// Gets or sets the number of bytes of stack that each invoke of a function in a context may
+	// use before code compiled with CompileOptions::stackLimitChecks throws
+	// Exception::stackOverflowType. Unlike the stack overflows detected by the native stack's guard
+	// page, these are detected before the stack is exhausted, so threads that run with a budget
+	// smaller than their stack don't depend on handling the guard page fault. Invokes nested in
+	// host calls from the context's code get their own budget. New contexts have a budget of
+	// zero, which doesn't limit the stack.
+	RUNTIME_API Uptr getContextStackBudget(Context* context);
+	RUNTIME_API void setContextStackBudget(Context* context, Uptr numBytes);
+
+	//
+	// Memory access tracing
+	//
+
+	// A load or store to a memory that was sampled by a context's memory access trace. address is
+	// the first byte accessed, including the access's offset immediate. Atomic read-modify-write
+	// operators are recorded as stores.
+	struct MemoryAccessRecord
+	{
+		MemoryInstance* memory;
+		U64 address;
+		U32 numBytes;
+		bool isStore;
+	};
+
+	struct MemoryAccessTraceConfig
+	{
+		// Sample one of every sampleInterval loads and stores executed in the context.
+		U64 sampleInterval = 1;
+
+		// Only record the sampled accesses whose address is in [beginAddress, endAddress).
+		U64 beginAddress = 0;
+		U64 endAddress = UINT64_MAX;
+
+		// The number of records the trace's ring buffer holds. Once it is full, each new record
+		// overwrites the oldest one.
+		Uptr numRecords = 65536;
+	};
+
+	// Starts (or restarts with a new config) recording a sample of the loads and stores executed
+	// by code compiled with CompileOptions::memoryAccessSampling in a context. Starting or
+	// stopping a trace must not race with code running in the context, but the trace may be read
+	// by readContextMemoryAccessTrace on any thread while code runs. The records hold pointers to
+	// the accessed memories, which the caller must keep alive to use them.
+	RUNTIME_API void startContextMemoryAccessTrace(Context* context,
+												   const MemoryAccessTraceConfig& config);
+	RUNTIME_API void stopContextMemoryAccessTrace(Context* context);
+
+	// Removes the records in a context's memory access trace, oldest first, and appends them to
+	// outRecords. Returns the number of records that were overwritten before they were read.
+	RUNTIME_API U64 readContextMemoryAccessTrace(Context* context,
+												 std::vector<MemoryAccessRecord>& outRecords);
+
+	// Adds the accesses to a memory in a list of records to a heat map of the memory: the count at
+	// index i of inOutPageAccessCounts is the number of accesses to the bytes in
+	// [i << pageSizeLog2, (i + 1) << pageSizeLog2). inOutPageAccessCounts is extended as needed.
+	RUNTIME_API void addMemoryAccessesToHeatMap(const std::vector<MemoryAccessRecord>& records,
+												MemoryInstance* memory,
+												Uptr pageSizeLog2,
+												std::vector<U64>& inOutPageAccessCounts);
+
+	//
+	// Module instance snapshots
+	//
+
+	// A snapshot of an initialized ModuleInstance: the memories, tables, and globals of its
+	// compartment, and the values of the mutable globals in the context it was initialized in.
+	// New instances of the module can be created from the snapshot without running any of its
+	// initialization code again. The snapshot's memories are shared copy-on-write with the
+	// instances created from it, where supported.
+	struct ModuleInstanceSnapshot;
+
+	// Creates a snapshot of a ModuleInstance's state in a context. The snapshot and each instance
+	// created from it have their own copies of the ModuleInstance's functions, which run the same
+	// compiled code. If the ModuleInstance's compartment has other objects that the snapshot would
+	// reference, e.g. functions of other instances that it imports, the compartment will not be
+	// collected until the snapshot and all instances created from it have been.
+	RUNTIME_API ModuleInstanceSnapshot* createModuleInstanceSnapshot(ModuleInstance* moduleInstance,
+																	 Context* context);
+
+	RUNTIME_API void deleteModuleInstanceSnapshot(ModuleInstanceSnapshot* snapshot);
+
+	// Creates a new compartment and context with the state of a snapshot, and returns the instance
+	// of the snapshotted module in the new compartment.
+	RUNTIME_API ModuleInstance* instantiateModuleFromSnapshot(ModuleInstanceSnapshot* snapshot,
+															  Compartment*& outCompartment,
+															  Context*& outContext);
+
+	// Writes a snapshot of an initialized ModuleInstance's state in a context to a file, so that
+	// other processes can instantiate the module from it without running any of its initialization
+	// code. The snapshot contains module's object code (see getObjectCode), the contents of the
+	// memories and tables the module defines, the values of the mutable globals it defines, and
+	// which of its passive segments haven't been dropped; the module's imports aren't included.
+	// Returns false if the file can't be written, or if a table or mutable global the module
+	// defines refers to an object other than one of the ModuleInstance's functions.
+	RUNTIME_API bool saveModuleInstanceSnapshot(Module* module,
+												ModuleInstance* moduleInstance,
+												Context* context,
+												Platform::File* file);
+
+	// Instantiates a module from a snapshot written by saveModuleInstanceSnapshot, binding its
+	// imports to the specified objects. irModule must be the module that the snapshot was saved
+	// from, and the imports should be equivalent to those the original instance was bound to.
+	// The memories are mapped copy-on-write from the file where that's supported, so their pages
+	// are only read when they're first accessed. The instance is already initialized, so its start
+	// function shouldn't be called. Returns null if the file isn't a valid snapshot of irModule.
+	RUNTIME_API ModuleInstance* loadModuleInstanceSnapshot(Compartment* compartment,
+														   Context* context,
+														   const IR::Module& irModule,
+														   Platform::File* file,
+														   ImportBindings&& imports,
+														   std::string&& debugName);
 }}
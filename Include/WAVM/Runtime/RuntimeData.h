@@ -21,44 +21,112 @@ namespace WAVM { namespace Runtime {
 	enum
 	{
 		maxThunkArgAndReturnBytes = 256,
-		maxGlobalBytes = 4096 - maxThunkArgAndReturnBytes,
+		contextInterruptionBytes = 40,
+		minContextRuntimeDataBytes = 4096,
+		maxContextRuntimeDataBytes = 65536,
+		maxGlobalBytes
+		= maxContextRuntimeDataBytes - maxThunkArgAndReturnBytes - contextInterruptionBytes,
 		maxMutableGlobals = maxGlobalBytes / sizeof(IR::UntaggedValue),
 		maxMemories = 255,
 		maxTables = 256,
 		compartmentRuntimeDataAlignmentLog2 = 32,
-		contextRuntimeDataAlignment = 4096
+		contextRuntimeDataAlignment = minContextRuntimeDataBytes
 	};
 
 	static_assert(sizeof(IR::UntaggedValue) * IR::maxReturnValues <= maxThunkArgAndReturnBytes,
 				  "maxThunkArgAndReturnBytes must be large enough to hold IR::maxReturnValues * "
 				  "sizeof(UntaggedValue)");
 
+	// The runtime data for a context. Only the prefix of it that holds the mutable globals used by
+	// the context's compartment is allocated: see Compartment::numContextRuntimeDataBytes.
 	struct ContextRuntimeData
 	{
+		// Invoke thunks write their results here. Arguments are read from a separate buffer, which
+		// is usually this one, but may be larger for functions with many parameters.
 		U8 thunkArgAndReturnData[maxThunkArgAndReturnBytes];
+
+		// Code compiled with epoch interruption traps when the epoch reaches this value.
+		U64 epochDeadline;
+
+		// Code compiled with fuel metering subtracts the cost of each block it executes from this,
+		// and calls the fuelExhausted intrinsic if it becomes negative.
+		I64 fuel;
+
+		// Code compiled with stack limit checks traps with a stack overflow if a function is entered
+		// with the stack pointer below stackLimit. If stackBudgetBytes isn't zero, invoking a
+		// function in the context sets stackLimit to that many bytes below the invoke's stack
+		// pointer until the invoke returns.
+		Uptr stackLimit;
+		Uptr stackBudgetBytes;
+
+		// Code compiled with memory access sampling decrements this for each load and store, and
+		// calls the memoryAccessSampled intrinsic when it reaches zero.
+		I64 memoryAccessSampleCountdown;
+
 		IR::UntaggedValue mutableGlobals[maxMutableGlobals];
 	};
 
-	static_assert(sizeof(ContextRuntimeData) == 4096, "");
+	static_assert(sizeof(ContextRuntimeData) == maxContextRuntimeDataBytes, "");
+
+	enum
+	{
+		numMemoryWaiterCountsLog2 = 6,
+		numMemoryWaiterCounts = Uptr(1) << numMemoryWaiterCountsLog2
+	};
+
+	// Returns the index of the waiter count for an address in a memory, using its Fibonacci hash.
+	inline Uptr getMemoryWaiterCountIndex(U32 address)
+	{
+		return U32(address * 0x9e3779b9u) >> (32 - numMemoryWaiterCountsLog2);
+	}
+
+	// Every memory's reserved address space is followed by this many bytes of inaccessible guard
+	// pages. Code compiled with memory bounds checks only checks an access's address against the
+	// memory's reserved bytes, and relies on the guard pages to trap if the access's offset and
+	// size extend it past them, as long as they fit in the guard pages.
+	enum
+	{
+		memoryNumGuardBytes = 65536
+	};
 
 	struct CompartmentRuntimeData
 	{
 		Compartment* compartment;
 		void* memoryBases[maxMemories];
 		void* tableBases[maxTables];
-		ContextRuntimeData contexts[1]; // Actually [maxContexts], but at least MSVC doesn't allow
-										// declaring arrays that large.
+
+		// The number of bytes of address space reserved for each memory, used by code that is
+		// compiled with memory bounds checks.
+		Uptr memoryNumReservedBytes[maxMemories];
+
+		// For each memory, a pointer to the memory's counts of threads waiting on addresses in it,
+		// indexed by getMemoryWaiterCountIndex. atomic.notify only calls into the runtime if the
+		// count for the address it's notifying is non-zero.
+		Uptr* memoryWaiterCounts[maxMemories];
+
+		// The number of elements of address space reserved for each table. Tables with a maximum
+		// size below 2^32 elements only reserve enough address space for their maximum size, so
+		// call_indirect must check the element index against this for them.
+		Uptr tableNumReservedElements[maxTables];
+
+		// The ContextRuntimeData for each context, at a stride of the compartment's
+		// numContextRuntimeDataBytes. Takes up the rest of the compartment's reserved bytes, but at
+		// least MSVC doesn't allow declaring arrays that large.
+		alignas(contextRuntimeDataAlignment) U8 contexts[1];
 	};
 
 	enum
 	{
-		maxContexts
-		= 1024 * 1024 - offsetof(CompartmentRuntimeData, contexts) / sizeof(ContextRuntimeData)
+		// The maximum number of contexts in a compartment, if each context's runtime data takes
+		// up minContextRuntimeDataBytes.
+		maxContexts = 1024 * 1024
+					  - offsetof(CompartmentRuntimeData, contexts) / minContextRuntimeDataBytes
 	};
 
 	static_assert(offsetof(CompartmentRuntimeData, contexts) % 4096 == 0,
 				  "CompartmentRuntimeData::contexts isn't page-aligned");
-	static_assert(offsetof(CompartmentRuntimeData, contexts[maxContexts])
+	static_assert(offsetof(CompartmentRuntimeData, contexts)
+						  + U64(maxContexts) * minContextRuntimeDataBytes
 					  == compartmentReservedBytes,
 				  "CompartmentRuntimeData isn't the expected size");
 
@@ -86,6 +154,26 @@ namespace WAVM { namespace Runtime {
 		U8 code[1];
 	};
 
+	// The JIT emits the fields before code as the two pointer-sized words of prefix data before
+	// each function's code, so they must not be padded.
+	static_assert(offsetof(AnyFunc, code) == sizeof(Uptr) * 2, "AnyFunc prefix must be 2 words");
+
+	// Returns the AnyFunc that is emitted as a prefix to the given function code. The runtime finds
+	// a function's AnyFunc only through this, so that the AnyFuncs may be moved out of the code.
+	inline const AnyFunc* getAnyFuncFromCode(const void* code)
+	{
+		return reinterpret_cast<const AnyFunc*>(reinterpret_cast<const U8*>(code)
+												- offsetof(AnyFunc, code));
+	}
+
+	// The biased value of a table element that contains a null reference: table elements store the
+	// address of the referee minus the address of the out-of-bounds sentinel AnyFunc, and the
+	// sentinel for null references immediately follows the out-of-bounds sentinel in memory.
+	enum
+	{
+		uninitializedAnyFuncBiasedValue = sizeof(AnyFunc)
+	};
+
 	inline CompartmentRuntimeData* getCompartmentRuntimeData(ContextRuntimeData* contextRuntimeData)
 	{
 		return reinterpret_cast<CompartmentRuntimeData*>(reinterpret_cast<Uptr>(contextRuntimeData)
@@ -7,4 +7,9 @@ namespace WAVM { namespace Runtime {
 
 namespace WAVM { namespace ThreadTest {
 	THREADTEST_API Runtime::ModuleInstance* instantiate(Runtime::Compartment* compartment);
+
+	// If true, threads created by the createThread intrinsic are run by a pool of worker threads,
+	// one for each hardware thread, instead of each creating a platform thread. Threads run by the
+	// pool can't call the forkThread intrinsic.
+	THREADTEST_API void setUseWorkerPool(bool useWorkerPool);
 }}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Runtime/Runtime.h"
+
+namespace WAVM { namespace WASI {
+	struct Process;
+
+	// Thrown by the wasi_unstable.proc_exit function to unwind the process's calls into
+	// WebAssembly code.
+	struct ExitException
+	{
+		U32 exitCode;
+	};
+
+	// Creates a process that implements the wasi_unstable intrinsic module for the modules in a
+	// compartment, which may only have one process at a time. The process's file descriptors 0-2
+	// are the host's standard streams, and the preopened directories follow them: each is a pair
+	// of the name the process sees and the host directory it refers to. The process can only open
+	// paths relative to a preopened directory, and can't open paths outside of it. Returns nullptr
+	// if a preopened directory can't be opened.
+	WASI_API Process* createProcess(
+		Runtime::Compartment* compartment,
+		std::vector<std::string>&& args,
+		std::vector<std::string>&& env,
+		const std::vector<std::pair<std::string, std::string>>& preopenedDirectories);
+
+	// Closes the files the process opened, and frees the process.
+	WASI_API void destroyProcess(Process* process);
+
+	// Returns the process's instance of the wasi_unstable intrinsic module.
+	WASI_API Runtime::ModuleInstance* getProcessModuleInstance(Process* process);
+
+	// Sets the memory that the process's WASI functions read their arguments from and write their
+	// results to. This is usually the memory exported as "memory" by the module instance that
+	// imports the WASI functions, so it must be set after instantiating that module.
+	WASI_API void setProcessMemory(Process* process, Runtime::MemoryInstance* memory);
+}}
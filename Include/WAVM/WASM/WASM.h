@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "WAVM/IR/Validate.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Serialization.h"
@@ -13,23 +15,65 @@ namespace WAVM { namespace Serialization {
 	struct InputStream;
 	struct OutputStream;
 }}
+namespace WAVM { namespace Platform {
+	struct File;
+}}
 
 namespace WAVM { namespace WASM {
-	WASM_API void serialize(Serialization::InputStream& stream, IR::Module& module);
+	// Deserializes a module from a binary WebAssembly file. If numValidationThreads isn't one, the
+	// function bodies are validated after the code section is decoded, in parallel on that many
+	// threads (zero means one per hardware thread); see IR::validateFunctionDefs.
+	WASM_API void serialize(Serialization::InputStream& stream,
+							IR::Module& module,
+							Uptr numValidationThreads = 1);
 	WASM_API void serialize(Serialization::OutputStream& stream, const IR::Module& module);
 
-	inline bool loadBinaryModule(const void* wasmBytes,
-								 Uptr numBytes,
-								 IR::Module& outModule,
-								 Log::Category errorCategory = Log::error)
+	// Serializes a module to a binary WebAssembly file, writing the bytes to the file in chunks as
+	// they are serialized, so the whole binary is never held in memory. Returns false if writing
+	// the file failed. Like the stream overload, throws FatalSerializationException if the module
+	// can't be serialized.
+	WASM_API bool serialize(Platform::File* file, const IR::Module& module);
+
+	// Deserializes the declarations of a module from a binary WebAssembly file, skipping its
+	// function bodies without decoding or validating them. The function definitions' types are
+	// decoded, but their locals and code are left empty, so the module may be inspected (e.g. for
+	// its imports and exports), but not validated, compiled, or serialized. Like the user sections,
+	// the name section is not decoded until it is needed, e.g. by IR::getDisassemblyNames.
+	WASM_API void serializeDeclarations(Serialization::InputStream& stream, IR::Module& module);
+
+	// Decodes a binary WebAssembly module from bytes that are fed to it incrementally, e.g. as
+	// they are received from the network. The bytes are decoded on a background thread as they
+	// arrive. If onFunctionDefDecoded isn't null, it is called on the decoding thread with the
+	// index of each function definition as soon as its body is decoded and validated; at that
+	// point, the module's declarations and the preceding function definitions are also complete,
+	// and may be read (but not modified) by other threads until finishStreamingDecode returns.
+	struct StreamingDecoder;
+	WASM_API StreamingDecoder* createStreamingDecoder(
+		IR::Module& outModule,
+		std::function<void(Uptr functionDefIndex)>&& onFunctionDefDecoded = nullptr);
+
+	// Feeds the next numBytes of the module's binary to a StreamingDecoder. The bytes are copied,
+	// so the caller may reuse the buffer immediately.
+	WASM_API void feedStreamingDecoder(StreamingDecoder* decoder, const U8* bytes, Uptr numBytes);
+
+	// Signals that all the module's bytes have been fed to a StreamingDecoder, waits for it to
+	// finish decoding them, and deletes it. Returns true if the module was decoded and validated,
+	// or logs the error to errorCategory and returns false if it was malformed or invalid.
+	WASM_API bool finishStreamingDecode(StreamingDecoder* decoder,
+										Log::Category errorCategory = Log::error);
+
+	// Calls deserialize, and logs any error it throws while deserializing a binary WebAssembly
+	// file to errorCategory. Returns true if deserialize didn't throw an error.
+	template<typename Deserialize>
+	bool catchBinaryModuleErrors(Uptr numBytes,
+								 Log::Category errorCategory,
+								 Deserialize&& deserialize)
 	{
-		// Load the module from a binary WebAssembly file.
 		try
 		{
 			Timing::Timer loadTimer;
 
-			Serialization::MemoryInputStream stream((const U8*)wasmBytes, numBytes);
-			WASM::serialize(stream, outModule);
+			deserialize();
 
 			Timing::logRatePerSecond("Loaded WASM", loadTimer, numBytes / 1024.0 / 1024.0, "MB");
 			return true;
@@ -54,4 +98,61 @@ namespace WAVM { namespace WASM {
 			return false;
 		}
 	}
+
+	inline bool loadBinaryModule(Serialization::InputStream& stream,
+								 Uptr numBytes,
+								 IR::Module& outModule,
+								 Log::Category errorCategory = Log::error,
+								 Uptr numValidationThreads = 1)
+	{
+		// Load the module from a binary WebAssembly file.
+		return catchBinaryModuleErrors(numBytes, errorCategory, [&] {
+			WASM::serialize(stream, outModule, numValidationThreads);
+		});
+	}
+
+	inline bool loadBinaryModule(const void* wasmBytes,
+								 Uptr numBytes,
+								 IR::Module& outModule,
+								 Log::Category errorCategory = Log::error,
+								 Uptr numValidationThreads = 1)
+	{
+		Serialization::MemoryInputStream stream((const U8*)wasmBytes, numBytes);
+		return loadBinaryModule(stream, numBytes, outModule, errorCategory, numValidationThreads);
+	}
+
+	// Loads a module from a binary WebAssembly file without copying its data segments and user
+	// sections: they are views of wasmBytes, which they keep alive.
+	inline bool loadBinaryModule(const SharedBytes& wasmBytes,
+								 IR::Module& outModule,
+								 Log::Category errorCategory = Log::error,
+								 Uptr numValidationThreads = 1)
+	{
+		Serialization::MemoryInputStream stream(
+			wasmBytes.data(), wasmBytes.size(), wasmBytes.getOwner());
+		return loadBinaryModule(
+			stream, wasmBytes.size(), outModule, errorCategory, numValidationThreads);
+	}
+
+	// Loads the declarations of a module from a binary WebAssembly file, without decoding its
+	// function bodies; see serializeDeclarations.
+	inline bool loadBinaryModuleDeclarations(const void* wasmBytes,
+											 Uptr numBytes,
+											 IR::Module& outModule,
+											 Log::Category errorCategory = Log::error)
+	{
+		Serialization::MemoryInputStream stream((const U8*)wasmBytes, numBytes);
+		return catchBinaryModuleErrors(
+			numBytes, errorCategory, [&] { WASM::serializeDeclarations(stream, outModule); });
+	}
+	inline bool loadBinaryModuleDeclarations(const SharedBytes& wasmBytes,
+											 IR::Module& outModule,
+											 Log::Category errorCategory = Log::error)
+	{
+		Serialization::MemoryInputStream stream(
+			wasmBytes.data(), wasmBytes.size(), wasmBytes.getOwner());
+		return catchBinaryModuleErrors(wasmBytes.size(), errorCategory, [&] {
+			WASM::serializeDeclarations(stream, outModule);
+		});
+	}
 }}
@@ -38,11 +38,15 @@ namespace WAVM { namespace WAST {
 	};
 
 	// Parse a module from a string. Returns true if it succeeds, and writes the module to
-	// outModule. If it fails, returns false and appends a list of errors to outErrors.
+	// outModule. If it fails, returns false and appends a list of errors to outErrors. If
+	// numThreads is greater than one, the module's function bodies are parsed in parallel on that
+	// many threads; if it is zero, one thread is used for each hardware thread. The parsed module
+	// doesn't depend on the number of threads.
 	WASTPARSE_API bool parseModule(const char* string,
 								   Uptr stringLength,
 								   IR::Module& outModule,
-								   std::vector<Error>& outErrors);
+								   std::vector<Error>& outErrors,
+								   Uptr numThreads = 1);
 
 	inline void reportParseErrors(const char* filename, const std::vector<WAST::Error>& parseErrors)
 	{
@@ -7,7 +7,18 @@ namespace WAVM { namespace IR {
 	struct Module;
 }}
 
+namespace WAVM { namespace Platform {
+	struct File;
+}}
+
 namespace WAVM { namespace WAST {
-	// Prints a module in WAST format.
-	WASTPRINT_API std::string print(const IR::Module& module);
+	// Prints a module in WAST format. If numThreads is greater than one, the function definitions
+	// are printed in parallel on that many threads; if it is zero, one thread is used for each
+	// hardware thread. The text doesn't depend on the number of threads.
+	WASTPRINT_API std::string print(const IR::Module& module, Uptr numThreads = 1);
+
+	// Prints a module in WAST format to a file, like print, but writes the text to the file in
+	// chunks as it is printed, so the whole text is never held in memory. Returns false if writing
+	// the file failed.
+	WASTPRINT_API bool print(const IR::Module& module, Platform::File* file, Uptr numThreads = 1);
 }}
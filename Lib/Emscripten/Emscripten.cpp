@@ -4,13 +4,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <algorithm>
 #include <initializer_list>
 #include <memory>
 #include <new>
 #include <string>
 #include <utility>
-#ifndef _WIN32
-#include <sys/uio.h>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
 #endif
 
 #include "WAVM/Emscripten/Emscripten.h"
@@ -110,6 +114,187 @@ DEFINE_INTRINSIC_GLOBAL(env, "EMT_STACK_MAX", I32, EMT_STACK_MAX, 0)
 DEFINE_INTRINSIC_GLOBAL(env, "eb", I32, eb, 0)
 
 static thread_local MemoryInstance* emscriptenMemory = nullptr;
+static thread_local Emscripten::Instance* emscriptenInstance = nullptr;
+
+// A buffer between an instance and one of the host's standard streams. If buffer is empty,
+// accesses are forwarded to the host's FILE. Otherwise, writes are copied into the buffer and
+// written to the FILE when the buffer is full or flushed, and writes at least as large as the
+// buffer are written to the FILE directly from the instance's memory. Reads are served from the
+// buffer, which is refilled by reading as many bytes as are available from the FILE's descriptor.
+struct StdioStream
+{
+	FILE* file;
+	std::vector<U8> buffer;
+
+	// For an output stream, the number of bytes in the buffer waiting to be written. For an input
+	// stream, the number of bytes read into the buffer, of which the first readOffset have been
+	// consumed.
+	Uptr numBufferedBytes = 0;
+	Uptr readOffset = 0;
+
+	StdioStream(FILE* inFile) : file(inFile) {}
+};
+
+struct Emscripten::StdioStreams
+{
+	StdioStream stdErr{stderr};
+	StdioStream stdIn{stdin};
+	StdioStream stdOut{stdout};
+};
+
+// The streams used by intrinsics called on threads without an instance. They have no buffers, so
+// they never change.
+static Emscripten::StdioStreams unbufferedStdioStreams;
+
+static Emscripten::StdioStreams& getStdioStreams()
+{
+	return emscriptenInstance ? *emscriptenInstance->stdioStreams : unbufferedStdioStreams;
+}
+
+static bool flushStdioStream(StdioStream& stream)
+{
+	if(!stream.buffer.size() || stream.file == stdin) { return true; }
+
+	const Uptr numBytes = stream.numBufferedBytes;
+	stream.numBufferedBytes = 0;
+	const bool wroteAll = fwrite(stream.buffer.data(), 1, numBytes, stream.file) == numBytes;
+	return !fflush(stream.file) && wroteAll;
+}
+
+static void flushStdioStreams(Emscripten::StdioStreams& streams)
+{
+	flushStdioStream(streams.stdOut);
+	flushStdioStream(streams.stdErr);
+}
+
+static Uptr writeStdioStream(StdioStream& stream, const U8* data, Uptr numBytes)
+{
+	const Uptr numBufferBytes = stream.buffer.size();
+	if(!numBufferBytes) { return fwrite(data, 1, numBytes, stream.file); }
+
+	if(numBytes > numBufferBytes - stream.numBufferedBytes)
+	{
+		if(!flushStdioStream(stream)) { return 0; }
+		if(numBytes >= numBufferBytes)
+		{
+			const Uptr numWrittenBytes = fwrite(data, 1, numBytes, stream.file);
+			fflush(stream.file);
+			return numWrittenBytes;
+		}
+	}
+
+	memcpy(stream.buffer.data() + stream.numBufferedBytes, data, numBytes);
+	stream.numBufferedBytes += numBytes;
+	return numBytes;
+}
+
+// Reads as many bytes as are available from a stream's file descriptor, up to numBytes, blocking
+// until at least one byte is available. Returns 0 at the end of the stream or on an error.
+static Uptr readStdioStreamFile(StdioStream& stream, U8* data, Uptr numBytes)
+{
+	// Flush the output before waiting for input, so an interactive program's prompt is shown.
+	flushStdioStreams(getStdioStreams());
+
+#ifdef _WIN32
+	const int numReadBytes = _read(_fileno(stream.file), data, unsigned(numBytes));
+#else
+	const ssize_t numReadBytes = read(fileno(stream.file), data, numBytes);
+#endif
+	return numReadBytes > 0 ? Uptr(numReadBytes) : 0;
+}
+
+static bool fillStdioStream(StdioStream& stream)
+{
+	stream.readOffset = 0;
+	stream.numBufferedBytes
+		= readStdioStreamFile(stream, stream.buffer.data(), stream.buffer.size());
+	return stream.numBufferedBytes > 0;
+}
+
+static Uptr readStdioStream(StdioStream& stream, U8* data, Uptr numBytes)
+{
+	const Uptr numBufferBytes = stream.buffer.size();
+	if(!numBufferBytes) { return fread(data, 1, numBytes, stream.file); }
+
+	Uptr numReadBytes = 0;
+	while(numReadBytes < numBytes)
+	{
+		if(stream.readOffset < stream.numBufferedBytes)
+		{
+			const Uptr numCopiedBytes = std::min(numBytes - numReadBytes,
+												 stream.numBufferedBytes - stream.readOffset);
+			memcpy(data + numReadBytes, stream.buffer.data() + stream.readOffset, numCopiedBytes);
+			stream.readOffset += numCopiedBytes;
+			numReadBytes += numCopiedBytes;
+		}
+		else if(numBytes - numReadBytes >= numBufferBytes)
+		{
+			// Read data that doesn't fit in the buffer directly into the instance's memory.
+			const Uptr numFileBytes
+				= readStdioStreamFile(stream, data + numReadBytes, numBytes - numReadBytes);
+			if(!numFileBytes) { break; }
+			numReadBytes += numFileBytes;
+		}
+		else if(!fillStdioStream(stream))
+		{
+			break;
+		}
+	}
+	return numReadBytes;
+}
+
+static I32 getcStdioStream(StdioStream& stream)
+{
+	if(!stream.buffer.size()) { return getc(stream.file); }
+	if(stream.readOffset == stream.numBufferedBytes && !fillStdioStream(stream)) { return EOF; }
+	return stream.buffer[stream.readOffset++];
+}
+
+static I32 ungetcStdioStream(StdioStream& stream, I32 character)
+{
+	if(!stream.buffer.size()) { return ungetc(character, stream.file); }
+	if(character == EOF) { return EOF; }
+
+	// Put the character back in the buffer in front of the unconsumed bytes.
+	if(!stream.readOffset)
+	{
+		if(stream.numBufferedBytes == stream.buffer.size()) { return EOF; }
+		memmove(stream.buffer.data() + 1, stream.buffer.data(), stream.numBufferedBytes);
+		++stream.numBufferedBytes;
+		++stream.readOffset;
+	}
+	stream.buffer[--stream.readOffset] = U8(character);
+	return U8(character);
+}
+
+Emscripten::Instance::~Instance()
+{
+	if(stdioStreams)
+	{
+		flushStdioStreams(*stdioStreams);
+		delete stdioStreams;
+	}
+	if(emscriptenInstance == this) { emscriptenInstance = nullptr; }
+}
+
+void Emscripten::setStdioBufferSize(Instance* instance, Uptr numBytes)
+{
+	StdioStreams& streams = *instance->stdioStreams;
+	flushStdioStreams(streams);
+	for(StdioStream* stream : {&streams.stdErr, &streams.stdIn, &streams.stdOut})
+	{
+		// Keep any input that was buffered but not consumed yet.
+		std::vector<U8> unreadBytes(stream->buffer.begin() + stream->readOffset,
+									stream->buffer.begin() + stream->numBufferedBytes);
+		stream->buffer.resize(std::max(numBytes, unreadBytes.size()));
+		if(unreadBytes.size())
+		{ memcpy(stream->buffer.data(), unreadBytes.data(), unreadBytes.size()); }
+		stream->numBufferedBytes = unreadBytes.size();
+		stream->readOffset = 0;
+	}
+}
+
+void Emscripten::flushStdio(Instance* instance) { flushStdioStreams(*instance->stdioStreams); }
 
 static U32 dynamicAlloc(MemoryInstance* memory, U32 numBytes)
 {
@@ -150,7 +335,7 @@ DEFINE_INTRINSIC_FUNCTION(env, "_time", I32, _time, I32 address)
 	return (I32)t;
 }
 
-DEFINE_INTRINSIC_FUNCTION(env, "___errno_location", I32, ___errno_location) { return 0; }
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(env, "___errno_location", I32, ___errno_location, 0)
 
 DEFINE_INTRINSIC_FUNCTION(env, "_sysconf", I32, _sysconf, I32 a)
 {
@@ -193,11 +378,13 @@ DEFINE_INTRINSIC_FUNCTION(env,
 
 	return 0;
 }
-DEFINE_INTRINSIC_FUNCTION(env, "_pthread_mutex_lock", I32, _pthread_mutex_lock, I32 a) { return 0; }
-DEFINE_INTRINSIC_FUNCTION(env, "_pthread_mutex_unlock", I32, _pthread_mutex_unlock, I32 a)
-{
-	return 0;
-}
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(env, "_pthread_mutex_lock", I32, _pthread_mutex_lock, 0, I32 a)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(env,
+								   "_pthread_mutex_unlock",
+								   I32,
+								   _pthread_mutex_unlock,
+								   0,
+								   I32 a)
 DEFINE_INTRINSIC_FUNCTION(env,
 						  "_pthread_setspecific",
 						  I32,
@@ -221,8 +408,8 @@ DEFINE_INTRINSIC_FUNCTION(env, "_pthread_once", I32, _pthread_once, I32 a, I32 b
 DEFINE_INTRINSIC_FUNCTION(env, "_pthread_cleanup_push", void, _pthread_cleanup_push, I32 a, I32 b)
 {
 }
-DEFINE_INTRINSIC_FUNCTION(env, "_pthread_cleanup_pop", void, _pthread_cleanup_pop, I32 a) {}
-DEFINE_INTRINSIC_FUNCTION(env, "_pthread_self", I32, _pthread_self) { return 0; }
+DEFINE_NOOP_INTRINSIC_FUNCTION(env, "_pthread_cleanup_pop", _pthread_cleanup_pop, I32 a)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(env, "_pthread_self", I32, _pthread_self, 0)
 
 DEFINE_INTRINSIC_FUNCTION(env, "___ctype_b_loc", I32, ___ctype_b_loc)
 {
@@ -363,7 +550,7 @@ DEFINE_INTRINSIC_FUNCTION(env, "___cxa_guard_acquire", I32, ___cxa_guard_acquire
 		return 0;
 	}
 }
-DEFINE_INTRINSIC_FUNCTION(env, "___cxa_guard_release", void, ___cxa_guard_release, I32 a) {}
+DEFINE_NOOP_INTRINSIC_FUNCTION(env, "___cxa_guard_release", ___cxa_guard_release, I32 a)
 DEFINE_INTRINSIC_FUNCTION(env, "___cxa_throw", void, ___cxa_throw, I32 a, I32 b, I32 c)
 {
 	throwException(Runtime::Exception::calledUnimplementedIntrinsicType);
@@ -391,6 +578,7 @@ DEFINE_INTRINSIC_FUNCTION(env, "_abort", void, emscripten__abort)
 }
 DEFINE_INTRINSIC_FUNCTION(env, "_exit", void, emscripten__exit, I32 code)
 {
+	flushStdioStreams(getStdioStreams());
 	throwException(Runtime::Exception::calledAbortType);
 }
 DEFINE_INTRINSIC_FUNCTION(env, "abort", void, emscripten_abort, I32 code)
@@ -412,7 +600,7 @@ DEFINE_INTRINSIC_FUNCTION(env, "_newlocale", I32, _newlocale, I32 mask, I32 loca
 	if(!base) { base = coerce32bitAddress(dynamicAlloc(emscriptenMemory, 4)); }
 	return base;
 }
-DEFINE_INTRINSIC_FUNCTION(env, "_freelocale", void, emscripten__freelocale, I32 a) {}
+DEFINE_NOOP_INTRINSIC_FUNCTION(env, "_freelocale", emscripten__freelocale, I32 a)
 
 DEFINE_INTRINSIC_FUNCTION(env,
 						  "_strftime_l",
@@ -446,7 +634,7 @@ DEFINE_INTRINSIC_FUNCTION(env,
 {
 	return s;
 }
-DEFINE_INTRINSIC_FUNCTION(env, "_catclose", I32, emscripten__catclose, I32 a) { return 0; }
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(env, "_catclose", I32, emscripten__catclose, 0, I32 a)
 
 DEFINE_INTRINSIC_FUNCTION(env,
 						  "_emscripten_memcpy_big",
@@ -469,14 +657,28 @@ enum class ioStreamVMHandle
 	StdIn = 2,
 	StdOut = 3
 };
-FILE* vmFile(U32 vmHandle)
+static StdioStream& vmFile(U32 vmHandle)
 {
+	Emscripten::StdioStreams& streams = getStdioStreams();
 	switch((ioStreamVMHandle)vmHandle)
 	{
-	case ioStreamVMHandle::StdErr: return stderr;
-	case ioStreamVMHandle::StdIn: return stdin;
-	case ioStreamVMHandle::StdOut: return stdout;
-	default: return stdout; // std::cerr << "invalid file handle " << vmHandle << std::endl; throw;
+	case ioStreamVMHandle::StdErr: return streams.stdErr;
+	case ioStreamVMHandle::StdIn: return streams.stdIn;
+	case ioStreamVMHandle::StdOut: return streams.stdOut;
+	// Treat invalid handles as stdout.
+	default: return streams.stdOut;
+	}
+}
+
+// Maps a file descriptor passed to a syscall to a stream.
+static StdioStream& vmFileDescriptor(U32 fd)
+{
+	Emscripten::StdioStreams& streams = getStdioStreams();
+	switch(fd)
+	{
+	case 0: return streams.stdIn;
+	case 2: return streams.stdErr;
+	default: return streams.stdOut;
 	}
 }
 
@@ -490,37 +692,51 @@ DEFINE_INTRINSIC_FUNCTION(env,
 {
 	throwException(Runtime::Exception::calledUnimplementedIntrinsicType);
 }
-DEFINE_INTRINSIC_FUNCTION(env, "_getc", I32, _getc, I32 file) { return getc(vmFile(file)); }
+DEFINE_INTRINSIC_FUNCTION(env, "_getc", I32, _getc, I32 file)
+{
+	return getcStdioStream(vmFile(file));
+}
 DEFINE_INTRINSIC_FUNCTION(env, "_ungetc", I32, _ungetc, I32 character, I32 file)
 {
-	return ungetc(character, vmFile(file));
+	return ungetcStdioStream(vmFile(file), character);
 }
 DEFINE_INTRINSIC_FUNCTION(env, "_fread", I32, _fread, I32 pointer, I32 size, I32 count, I32 file)
 {
 	wavmAssert(emscriptenMemory);
-	return (I32)fread(memoryArrayPtr<U8>(emscriptenMemory, pointer, U64(size) * U64(count)),
-					  U64(size),
-					  U64(count),
-					  vmFile(file));
+	const U64 numBytes = U64(U32(size)) * U64(U32(count));
+	if(!numBytes) { return 0; }
+	const Uptr numReadBytes = readStdioStream(
+		vmFile(file), memoryArrayPtr<U8>(emscriptenMemory, pointer, numBytes), Uptr(numBytes));
+	return I32(numReadBytes / U32(size));
 }
 DEFINE_INTRINSIC_FUNCTION(env, "_fwrite", I32, _fwrite, I32 pointer, I32 size, I32 count, I32 file)
 {
 	wavmAssert(emscriptenMemory);
-	return (I32)fwrite(memoryArrayPtr<U8>(emscriptenMemory, pointer, U64(size) * U64(count)),
-					   U64(size),
-					   U64(count),
-					   vmFile(file));
+	const U64 numBytes = U64(U32(size)) * U64(U32(count));
+	if(!numBytes) { return 0; }
+	const Uptr numWrittenBytes = writeStdioStream(
+		vmFile(file), memoryArrayPtr<U8>(emscriptenMemory, pointer, numBytes), Uptr(numBytes));
+	return I32(numWrittenBytes / U32(size));
 }
 DEFINE_INTRINSIC_FUNCTION(env, "_fputc", I32, _fputc, I32 character, I32 file)
 {
-	return fputc(character, vmFile(file));
+	StdioStream& stream = vmFile(file);
+	if(!stream.buffer.size()) { return fputc(character, stream.file); }
+
+	const U8 byte = U8(character);
+	return writeStdioStream(stream, &byte, 1) ? byte : EOF;
+}
+DEFINE_INTRINSIC_FUNCTION(env, "_fflush", I32, _fflush, I32 file)
+{
+	StdioStream& stream = vmFile(file);
+	if(!stream.buffer.size()) { return fflush(stream.file); }
+	return flushStdioStream(stream) ? 0 : EOF;
 }
-DEFINE_INTRINSIC_FUNCTION(env, "_fflush", I32, _fflush, I32 file) { return fflush(vmFile(file)); }
 
-DEFINE_INTRINSIC_FUNCTION(env, "___lock", void, ___lock, I32 a) {}
-DEFINE_INTRINSIC_FUNCTION(env, "___unlock", void, ___unlock, I32 a) {}
-DEFINE_INTRINSIC_FUNCTION(env, "___lockfile", I32, ___lockfile, I32 a) { return 1; }
-DEFINE_INTRINSIC_FUNCTION(env, "___unlockfile", void, ___unlockfile, I32 a) {}
+DEFINE_NOOP_INTRINSIC_FUNCTION(env, "___lock", ___lock, I32 a)
+DEFINE_NOOP_INTRINSIC_FUNCTION(env, "___unlock", ___unlock, I32 a)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(env, "___lockfile", I32, ___lockfile, 1, I32 a)
+DEFINE_NOOP_INTRINSIC_FUNCTION(env, "___unlockfile", ___unlockfile, I32 a)
 
 DEFINE_INTRINSIC_FUNCTION(env, "___syscall6", I32, ___syscall6, I32 a, I32 b)
 {
@@ -552,35 +768,29 @@ DEFINE_INTRINSIC_FUNCTION(env, "___syscall146", I32, ___syscall146, I32 file, I3
 
 	// writev
 	U32* args = memoryArrayPtr<U32>(emscriptenMemory, argsPtr, 3);
+	StdioStream& stream = vmFileDescriptor(args[0]);
 	U32 iov = args[1];
 	U32 iovcnt = args[2];
-#ifdef _WIN32
+
+	// Write each buffer directly from the instance's memory, or copy it into the stream's buffer.
+	const MemoryView iovView(emscriptenMemory, iov, Uptr(iovcnt) * 8);
+	const MemoryView memoryView(emscriptenMemory);
 	U32 count = 0;
 	for(U32 i = 0; i < iovcnt; i++)
 	{
-		U32 base = memoryRef<U32>(emscriptenMemory, iov + i * 8);
-		U32 len = memoryRef<U32>(emscriptenMemory, iov + i * 8 + 4);
-		U32 size
-			= (U32)fwrite(memoryArrayPtr<U8>(emscriptenMemory, base, len), 1, len, vmFile(file));
+		U32 base = iovView.load<U32>(iov + i * 8);
+		U32 len = iovView.load<U32>(iov + i * 8 + 4);
+		U32 size = (U32)writeStdioStream(stream, memoryView.arrayPtr<U8>(base, len), len);
 		count += size;
 		if(size < len) break;
 	}
-#else
-	struct iovec* native_iovec = new(alloca(sizeof(iovec) * iovcnt)) struct iovec[iovcnt];
-	for(U32 i = 0; i < iovcnt; i++)
-	{
-		U32 base = memoryRef<U32>(emscriptenMemory, iov + i * 8);
-		U32 len = memoryRef<U32>(emscriptenMemory, iov + i * 8 + 4);
 
-		native_iovec[i].iov_base = memoryArrayPtr<U8>(emscriptenMemory, base, len);
-		native_iovec[i].iov_len = len;
-	}
-	Iptr count = writev(fileno(vmFile(file)), native_iovec, iovcnt);
-#endif
+	// Without a buffer, forward the writes to the host immediately, as writev would.
+	if(!stream.buffer.size()) { fflush(stream.file); }
 	return count;
 }
 
-DEFINE_INTRINSIC_FUNCTION(asm2wasm, "f64-to-int", I32, f64_to_int, F64 f) { return (I32)f; }
+DEFINE_LEAF_INTRINSIC_FUNCTION(asm2wasm, "f64-to-int", I32, f64_to_int, F64 f) { return (I32)f; }
 
 static F64 makeNaN()
 {
@@ -618,7 +828,7 @@ DEFINE_INTRINSIC_FUNCTION(asm2wasm, "i32s-div", I32, I32_divs, I32 left, I32 rig
 {
 	return left / right;
 }
-DEFINE_INTRINSIC_FUNCTION(asm2wasm, "f64-rem", F64, F64_rems, F64 left, F64 right)
+DEFINE_LEAF_INTRINSIC_FUNCTION(asm2wasm, "f64-rem", F64, F64_rems, F64 left, F64 right)
 {
 	return (F64)fmod(left, right);
 }
@@ -663,6 +873,7 @@ Emscripten::Instance* Emscripten::instantiate(Compartment* compartment, const IR
 	};
 
 	Instance* instance = new Instance;
+	instance->stdioStreams = new StdioStreams;
 	instance->env = Intrinsics::instantiateModule(
 		compartment, INTRINSIC_MODULE_REF(env), "env", extraEnvExports);
 	instance->asm2wasm
@@ -679,6 +890,7 @@ Emscripten::Instance* Emscripten::instantiate(Compartment* compartment, const IR
 
 	instance->emscriptenMemory = memory;
 	emscriptenMemory = instance->emscriptenMemory;
+	emscriptenInstance = instance;
 
 	return instance;
 }
@@ -0,0 +1,403 @@
+#include <string.h>
+
+#include "HostAccelPrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HOSTACCEL_USE_X86_EXTENSIONS 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define HOSTACCEL_USE_X86_EXTENSIONS 0
+#endif
+
+using namespace WAVM;
+using namespace WAVM::HostAccel;
+
+static U32 load32BE(const U8* bytes)
+{
+	return (U32(bytes[0]) << 24) | (U32(bytes[1]) << 16) | (U32(bytes[2]) << 8) | U32(bytes[3]);
+}
+
+static void store32BE(U8* bytes, U32 value)
+{
+	bytes[0] = U8(value >> 24);
+	bytes[1] = U8(value >> 16);
+	bytes[2] = U8(value >> 8);
+	bytes[3] = U8(value);
+}
+
+static U64 load64LE(const U8* bytes)
+{
+	U64 value = 0;
+	for(Uptr byteIndex = 0; byteIndex < 8; ++byteIndex)
+	{ value |= U64(bytes[byteIndex]) << (byteIndex * 8); }
+	return value;
+}
+
+static U32 rotr32(U32 value, U32 numBits) { return (value >> numBits) | (value << (32 - numBits)); }
+static U64 rotr64(U64 value, U64 numBits) { return (value >> numBits) | (value << (64 - numBits)); }
+
+#if HOSTACCEL_USE_X86_EXTENSIONS
+struct X86Features
+{
+	bool sse42 = false;
+	bool sha = false;
+
+	X86Features()
+	{
+		unsigned int eax, ebx, ecx, edx;
+		if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return; }
+		const bool ssse3 = ecx & (1 << 9);
+		const bool sse41 = ecx & (1 << 19);
+		sse42 = ecx & (1 << 20);
+		if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		{ sha = ssse3 && sse41 && (ebx & (1 << 29)); }
+	}
+};
+
+static const X86Features& getX86Features()
+{
+	static const X86Features features;
+	return features;
+}
+#endif
+
+//
+// BLAKE2b
+//
+
+static const U64 blake2bIV[8] = {0x6a09e667f3bcc908,
+								 0xbb67ae8584caa73b,
+								 0x3c6ef372fe94f82b,
+								 0xa54ff53a5f1d36f1,
+								 0x510e527fade682d1,
+								 0x9b05688c2b3e6c1f,
+								 0x1f83d9abfb41bd6b,
+								 0x5be0cd19137e2179};
+
+static const U8 blake2bSigma[12][16] = {{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+										{14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+										{11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+										{7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+										{9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+										{2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+										{12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+										{13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+										{6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+										{10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+										{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+										{14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+static inline void blake2bMix(U64* v, Uptr a, Uptr b, Uptr c, Uptr d, U64 x, U64 y)
+{
+	v[a] = v[a] + v[b] + x;
+	v[d] = rotr64(v[d] ^ v[a], 32);
+	v[c] = v[c] + v[d];
+	v[b] = rotr64(v[b] ^ v[c], 24);
+	v[a] = v[a] + v[b] + y;
+	v[d] = rotr64(v[d] ^ v[a], 16);
+	v[c] = v[c] + v[d];
+	v[b] = rotr64(v[b] ^ v[c], 63);
+}
+
+static void blake2bCompress(U64 h[8], const U8* block, U64 numHashedBytes, bool isLastBlock)
+{
+	U64 m[16];
+	for(Uptr wordIndex = 0; wordIndex < 16; ++wordIndex)
+	{ m[wordIndex] = load64LE(block + wordIndex * 8); }
+
+	U64 v[16];
+	for(Uptr wordIndex = 0; wordIndex < 8; ++wordIndex)
+	{
+		v[wordIndex] = h[wordIndex];
+		v[wordIndex + 8] = blake2bIV[wordIndex];
+	}
+	v[12] ^= numHashedBytes;
+	if(isLastBlock) { v[14] = ~v[14]; }
+
+	for(Uptr round = 0; round < 12; ++round)
+	{
+		const U8* s = blake2bSigma[round];
+		blake2bMix(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+		blake2bMix(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+		blake2bMix(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+		blake2bMix(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+		blake2bMix(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+		blake2bMix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+		blake2bMix(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+		blake2bMix(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+	}
+
+	for(Uptr wordIndex = 0; wordIndex < 8; ++wordIndex)
+	{ h[wordIndex] ^= v[wordIndex] ^ v[wordIndex + 8]; }
+}
+
+void HostAccel::blake2b(const U8* bytes, Uptr numBytes, U8* outDigest, Uptr numDigestBytes)
+{
+	wavmAssert(numDigestBytes >= 1 && numDigestBytes <= 64);
+
+	U64 h[8];
+	for(Uptr wordIndex = 0; wordIndex < 8; ++wordIndex) { h[wordIndex] = blake2bIV[wordIndex]; }
+	h[0] ^= 0x01010000 ^ U64(numDigestBytes);
+
+	// Compress every block but the last directly from the input, and the last block, which may
+	// be partial or empty, from a zero-padded copy.
+	U64 numHashedBytes = 0;
+	while(numBytes > 128)
+	{
+		numHashedBytes += 128;
+		blake2bCompress(h, bytes, numHashedBytes, false);
+		bytes += 128;
+		numBytes -= 128;
+	}
+
+	U8 lastBlock[128] = {0};
+	if(numBytes) { memcpy(lastBlock, bytes, numBytes); }
+	numHashedBytes += numBytes;
+	blake2bCompress(h, lastBlock, numHashedBytes, true);
+
+	for(Uptr byteIndex = 0; byteIndex < numDigestBytes; ++byteIndex)
+	{ outDigest[byteIndex] = U8(h[byteIndex / 8] >> ((byteIndex % 8) * 8)); }
+}
+
+//
+// SHA-256
+//
+
+alignas(16) static const U32 sha256K[64]
+	= {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+	   0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+	   0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+	   0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	   0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+	   0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	   0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+	   0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+	   0xc67178f2};
+
+static void sha256BlocksPortable(U32 state[8], const U8* blocks, Uptr numBlocks)
+{
+	for(Uptr blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		const U8* block = blocks + blockIndex * 64;
+
+		U32 w[64];
+		for(Uptr wordIndex = 0; wordIndex < 16; ++wordIndex)
+		{ w[wordIndex] = load32BE(block + wordIndex * 4); }
+		for(Uptr wordIndex = 16; wordIndex < 64; ++wordIndex)
+		{
+			const U32 s0 = rotr32(w[wordIndex - 15], 7) ^ rotr32(w[wordIndex - 15], 18)
+						   ^ (w[wordIndex - 15] >> 3);
+			const U32 s1 = rotr32(w[wordIndex - 2], 17) ^ rotr32(w[wordIndex - 2], 19)
+						   ^ (w[wordIndex - 2] >> 10);
+			w[wordIndex] = w[wordIndex - 16] + s0 + w[wordIndex - 7] + s1;
+		}
+
+		U32 a = state[0], b = state[1], c = state[2], d = state[3];
+		U32 e = state[4], f = state[5], g = state[6], h = state[7];
+		for(Uptr round = 0; round < 64; ++round)
+		{
+			const U32 s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+			const U32 choice = (e & f) ^ (~e & g);
+			const U32 temp1 = h + s1 + choice + sha256K[round] + w[round];
+			const U32 s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+			const U32 majority = (a & b) ^ (a & c) ^ (b & c);
+			const U32 temp2 = s0 + majority;
+			h = g;
+			g = f;
+			f = e;
+			e = d + temp1;
+			d = c;
+			c = b;
+			b = a;
+			a = temp1 + temp2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+#if HOSTACCEL_USE_X86_EXTENSIONS
+// Each SHA256RNDS2 instruction does two rounds, with the state split into ABEF and CDGH vectors,
+// and the message schedule is computed 4 words at a time with SHA256MSG1 and SHA256MSG2.
+__attribute__((target("sha,sse4.1,ssse3"))) static void sha256BlocksSHA(U32 state[8],
+																		 const U8* blocks,
+																		 Uptr numBlocks)
+{
+	const __m128i byteSwapMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	__m128i dcba = _mm_loadu_si128((const __m128i*)&state[0]);
+	__m128i hgfe = _mm_loadu_si128((const __m128i*)&state[4]);
+	const __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+	const __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+	__m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+	__m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+	for(Uptr blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+	{
+		const U8* block = blocks + blockIndex * 64;
+		const __m128i savedABEF = abef;
+		const __m128i savedCDGH = cdgh;
+
+		__m128i w[4];
+		for(Uptr groupIndex = 0; groupIndex < 16; ++groupIndex)
+		{
+			if(groupIndex < 4)
+			{
+				w[groupIndex] = _mm_shuffle_epi8(
+					_mm_loadu_si128((const __m128i*)(block + groupIndex * 16)), byteSwapMask);
+			}
+
+			__m128i message = _mm_add_epi32(
+				w[groupIndex % 4], _mm_load_si128((const __m128i*)&sha256K[groupIndex * 4]));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+
+			// Finish computing the message words for the next group of rounds.
+			if(groupIndex >= 3 && groupIndex < 15)
+			{
+				__m128i& next = w[(groupIndex + 1) % 4];
+				next = _mm_add_epi32(
+					next, _mm_alignr_epi8(w[groupIndex % 4], w[(groupIndex + 3) % 4], 4));
+				next = _mm_sha256msg2_epu32(next, w[groupIndex % 4]);
+			}
+
+			message = _mm_shuffle_epi32(message, 0x0e);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, message);
+
+			// Start computing the message words for the group of rounds after the next.
+			if(groupIndex >= 1 && groupIndex < 13)
+			{
+				__m128i& afterNext = w[(groupIndex + 3) % 4];
+				afterNext = _mm_sha256msg1_epu32(afterNext, w[groupIndex % 4]);
+			}
+		}
+
+		abef = _mm_add_epi32(abef, savedABEF);
+		cdgh = _mm_add_epi32(cdgh, savedCDGH);
+	}
+
+	const __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+	const __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+	dcba = _mm_blend_epi16(feba, dchg, 0xf0);
+	hgfe = _mm_alignr_epi8(dchg, feba, 8);
+	_mm_storeu_si128((__m128i*)&state[0], dcba);
+	_mm_storeu_si128((__m128i*)&state[4], hgfe);
+}
+#endif
+
+static void sha256Blocks(U32 state[8], const U8* blocks, Uptr numBlocks)
+{
+#if HOSTACCEL_USE_X86_EXTENSIONS
+	if(getX86Features().sha)
+	{
+		sha256BlocksSHA(state, blocks, numBlocks);
+		return;
+	}
+#endif
+	sha256BlocksPortable(state, blocks, numBlocks);
+}
+
+void HostAccel::sha256(const U8* bytes, Uptr numBytes, U8 outDigest[32])
+{
+	U32 state[8] = {0x6a09e667,
+					0xbb67ae85,
+					0x3c6ef372,
+					0xa54ff53a,
+					0x510e527f,
+					0x9b05688c,
+					0x1f83d9ab,
+					0x5be0cd19};
+
+	// Hash the whole blocks directly from the input, then the remaining bytes followed by the
+	// padding and the number of hashed bits, which take one or two more blocks.
+	const Uptr numWholeBlocks = numBytes / 64;
+	sha256Blocks(state, bytes, numWholeBlocks);
+
+	const Uptr numRemainingBytes = numBytes % 64;
+	U8 lastBlocks[128] = {0};
+	if(numRemainingBytes)
+	{ memcpy(lastBlocks, bytes + numWholeBlocks * 64, numRemainingBytes); }
+	lastBlocks[numRemainingBytes] = 0x80;
+	const Uptr numLastBlocks = numRemainingBytes < 56 ? 1 : 2;
+	const U64 numBits = U64(numBytes) * 8;
+	for(Uptr byteIndex = 0; byteIndex < 8; ++byteIndex)
+	{ lastBlocks[numLastBlocks * 64 - 1 - byteIndex] = U8(numBits >> (byteIndex * 8)); }
+	sha256Blocks(state, lastBlocks, numLastBlocks);
+
+	for(Uptr wordIndex = 0; wordIndex < 8; ++wordIndex)
+	{ store32BE(outDigest + wordIndex * 4, state[wordIndex]); }
+}
+
+//
+// CRC32C
+//
+
+struct CRC32CTable
+{
+	U32 entries[256];
+
+	CRC32CTable()
+	{
+		for(U32 byte = 0; byte < 256; ++byte)
+		{
+			U32 crc = byte;
+			for(Uptr bitIndex = 0; bitIndex < 8; ++bitIndex)
+			{ crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0); }
+			entries[byte] = crc;
+		}
+	}
+};
+
+static U32 crc32cPortable(U32 crc, const U8* bytes, Uptr numBytes)
+{
+	static const CRC32CTable table;
+	for(Uptr byteIndex = 0; byteIndex < numBytes; ++byteIndex)
+	{ crc = table.entries[(crc ^ bytes[byteIndex]) & 0xff] ^ (crc >> 8); }
+	return crc;
+}
+
+#if HOSTACCEL_USE_X86_EXTENSIONS
+__attribute__((target("sse4.2"))) static U32 crc32cSSE42(U32 crc, const U8* bytes, Uptr numBytes)
+{
+#if defined(__x86_64__)
+	U64 crc64 = crc;
+	while(numBytes >= 8)
+	{
+		U64 word;
+		memcpy(&word, bytes, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+		bytes += 8;
+		numBytes -= 8;
+	}
+	crc = U32(crc64);
+#endif
+	while(numBytes >= 4)
+	{
+		U32 word;
+		memcpy(&word, bytes, sizeof(word));
+		crc = _mm_crc32_u32(crc, word);
+		bytes += 4;
+		numBytes -= 4;
+	}
+	while(numBytes--) { crc = _mm_crc32_u8(crc, *bytes++); }
+	return crc;
+}
+#endif
+
+U32 HostAccel::crc32c(U32 crc, const U8* bytes, Uptr numBytes)
+{
+#if HOSTACCEL_USE_X86_EXTENSIONS
+	if(getX86Features().sse42) { return ~crc32cSSE42(~crc, bytes, numBytes); }
+#endif
+	return ~crc32cPortable(~crc, bytes, numBytes);
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+#include <vector>
+
+#include "HostAccelPrivate.h"
+#include "WAVM/HostAccel/HostAccel.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/LZ4.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Intrinsics.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/Runtime/RuntimeData.h"
+
+using namespace WAVM;
+using namespace WAVM::HostAccel;
+using namespace WAVM::Runtime;
+
+// The intrinsic functions are shared by all compartments, so they map their context's compartment
+// to the memory they access.
+static Platform::Mutex memoriesMutex;
+static HashMap<Compartment*, GCPointer<MemoryInstance>> compartmentMemories;
+
+static GCPointer<MemoryInstance> getMemory(ContextRuntimeData* contextRuntimeData)
+{
+	Compartment* compartment
+		= getCompartmentFromContext(getContextFromRuntimeData(contextRuntimeData));
+
+	GCPointer<MemoryInstance> memory;
+	{
+		Lock<Platform::Mutex> memoriesLock(memoriesMutex);
+		const GCPointer<MemoryInstance>* compartmentMemory = compartmentMemories.get(compartment);
+		if(compartmentMemory) { memory = *compartmentMemory; }
+	}
+
+	if(!memory)
+	{
+		Log::printf(Log::error,
+					"hostAccel function called before the compartment's memory was set\n");
+		throwException(Exception::calledAbortType);
+	}
+	return memory;
+}
+
+DEFINE_INTRINSIC_MODULE(hostAccel);
+
+DEFINE_INTRINSIC_FUNCTION(hostAccel,
+						  "blake2b",
+						  void,
+						  hostAccel_blake2b,
+						  U32 address,
+						  U32 numBytes,
+						  U32 digestAddress,
+						  U32 numDigestBytes)
+{
+	if(numDigestBytes < 1 || numDigestBytes > 64)
+	{ throwException(Exception::invalidArgumentType); }
+
+	GCPointer<MemoryInstance> memory = getMemory(contextRuntimeData);
+	const MemoryView inputView(memory, address, numBytes);
+	const MemoryView digestView(memory, digestAddress, numDigestBytes);
+
+	U8 digest[64];
+	blake2b(inputView.arrayPtr<U8>(address, numBytes), numBytes, digest, numDigestBytes);
+	memcpy(digestView.arrayPtr<U8>(digestAddress, numDigestBytes), digest, numDigestBytes);
+}
+
+DEFINE_INTRINSIC_FUNCTION(hostAccel,
+						  "sha256",
+						  void,
+						  hostAccel_sha256,
+						  U32 address,
+						  U32 numBytes,
+						  U32 digestAddress)
+{
+	GCPointer<MemoryInstance> memory = getMemory(contextRuntimeData);
+	const MemoryView inputView(memory, address, numBytes);
+	const MemoryView digestView(memory, digestAddress, 32);
+
+	U8 digest[32];
+	sha256(inputView.arrayPtr<U8>(address, numBytes), numBytes, digest);
+	memcpy(digestView.arrayPtr<U8>(digestAddress, 32), digest, 32);
+}
+
+DEFINE_INTRINSIC_FUNCTION(hostAccel,
+						  "crc32c",
+						  U32,
+						  hostAccel_crc32c,
+						  U32 crc,
+						  U32 address,
+						  U32 numBytes)
+{
+	GCPointer<MemoryInstance> memory = getMemory(contextRuntimeData);
+	const MemoryView inputView(memory, address, numBytes);
+	return crc32c(crc, inputView.arrayPtr<U8>(address, numBytes), numBytes);
+}
+
+// Copies the output of an LZ4 function to the guest's output range, if it fits.
+static I32 writeLZ4Output(MemoryInstance* memory,
+						  const std::vector<U8>& output,
+						  U32 outAddress,
+						  U32 outNumBytes)
+{
+	const MemoryView outputView(memory, outAddress, outNumBytes);
+	if(output.size() > outNumBytes || output.size() > INT32_MAX) { return -1; }
+	if(output.size())
+	{ memcpy(outputView.arrayPtr<U8>(outAddress, output.size()), output.data(), output.size()); }
+	return I32(output.size());
+}
+
+DEFINE_INTRINSIC_FUNCTION(hostAccel,
+						  "lz4_compress",
+						  I32,
+						  hostAccel_lz4_compress,
+						  U32 address,
+						  U32 numBytes,
+						  U32 outAddress,
+						  U32 outNumBytes)
+{
+	GCPointer<MemoryInstance> memory = getMemory(contextRuntimeData);
+	const MemoryView inputView(memory, address, numBytes);
+
+	std::vector<U8> output;
+	LZ4::compress(inputView.arrayPtr<U8>(address, numBytes), numBytes, output);
+	return writeLZ4Output(memory, output, outAddress, outNumBytes);
+}
+
+DEFINE_INTRINSIC_FUNCTION(hostAccel,
+						  "lz4_decompress",
+						  I32,
+						  hostAccel_lz4_decompress,
+						  U32 address,
+						  U32 numBytes,
+						  U32 outAddress,
+						  U32 outNumBytes)
+{
+	GCPointer<MemoryInstance> memory = getMemory(contextRuntimeData);
+	const MemoryView inputView(memory, address, numBytes);
+	const U8* input = inputView.arrayPtr<U8>(address, numBytes);
+
+	// Check the decompressed size in the header before allocating the output for it.
+	if(numBytes >= 8)
+	{
+		U64 numDecompressedBytes = 0;
+		for(Uptr byteIndex = 0; byteIndex < 8; ++byteIndex)
+		{ numDecompressedBytes |= U64(input[byteIndex]) << (byteIndex * 8); }
+		if(numDecompressedBytes > outNumBytes) { return -1; }
+	}
+
+	std::vector<U8> output;
+	if(!LZ4::decompress(input, numBytes, output)) { return -1; }
+	return writeLZ4Output(memory, output, outAddress, outNumBytes);
+}
+
+ModuleInstance* HostAccel::instantiate(Compartment* compartment)
+{
+	return Intrinsics::instantiateModule(
+		compartment, INTRINSIC_MODULE_REF(hostAccel), "hostAccel");
+}
+
+void HostAccel::setMemory(Compartment* compartment, MemoryInstance* memory)
+{
+	Lock<Platform::Mutex> memoriesLock(memoriesMutex);
+	if(memory) { compartmentMemories.set(compartment, memory); }
+	else
+	{
+		compartmentMemories.remove(compartment);
+	}
+}
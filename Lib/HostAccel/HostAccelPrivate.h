@@ -0,0 +1,15 @@
+#pragma once
+
+#include "WAVM/Inline/BasicTypes.h"
+
+namespace WAVM { namespace HostAccel {
+	// Computes the unkeyed BLAKE2b hash of some bytes, with a digest of 1-64 bytes.
+	void blake2b(const U8* bytes, Uptr numBytes, U8* outDigest, Uptr numDigestBytes);
+
+	// Computes the SHA-256 hash of some bytes. Uses the SHA extensions if the CPU supports them.
+	void sha256(const U8* bytes, Uptr numBytes, U8 outDigest[32]);
+
+	// Extends a CRC32C (Castagnoli) checksum with some bytes. The checksum of no bytes is 0. Uses
+	// the SSE4.2 CRC32 instruction if the CPU supports it.
+	U32 crc32c(U32 crc, const U8* bytes, Uptr numBytes);
+}}
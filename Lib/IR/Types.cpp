@@ -2,13 +2,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include <new>
 #include <utility>
 
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/ConcurrentHashMap.h"
 #include "WAVM/Inline/Hash.h"
-#include "WAVM/Inline/HashSet.h"
-#include "WAVM/Inline/Lock.h"
-#include "WAVM/Platform/Mutex.h"
 
 using namespace WAVM;
 using namespace WAVM::IR;
@@ -36,6 +36,28 @@ struct FunctionTypeHashPolicy
 	static Uptr getKeyHash(FunctionType functionType) { return functionType.getHash(); }
 };
 
+// Tuples of up to maxSmallTypeTupleElems elements are interned in a table indexed directly by
+// their elements, so interning them doesn't need to hash the elements or search a hash table.
+static constexpr Uptr maxSmallTypeTupleElems = 4;
+static constexpr Uptr numValueTypes = Uptr(ValueType::num);
+static constexpr Uptr numSmallTypeTuples
+	= numValueTypes * (1 + numValueTypes * (1 + numValueTypes * (1 + numValueTypes)));
+
+static Uptr getSmallTypeTupleIndex(Uptr numElems, const ValueType* elems)
+{
+	// Number the non-empty tuples by treating the elements as the digits 1..numValueTypes of a
+	// (bijective) base numValueTypes number.
+	wavmAssert(numElems > 0 && numElems <= maxSmallTypeTupleElems);
+	Uptr index = 0;
+	for(Uptr elemIndex = 0; elemIndex < numElems; ++elemIndex)
+	{
+		wavmAssert(Uptr(elems[elemIndex]) < numValueTypes);
+		index = index * numValueTypes + Uptr(elems[elemIndex]) + 1;
+	}
+	wavmAssert(index > 0 && index <= numSmallTypeTuples);
+	return index - 1;
+}
+
 IR::TypeTuple::Impl::Impl(Uptr inNumElems, const ValueType* inElems) : numElems(inNumElems)
 {
 	if(numElems) { memcpy(elems, inElems, sizeof(ValueType) * numElems); }
@@ -71,24 +93,42 @@ const TypeTuple::Impl* IR::TypeTuple::getUniqueImpl(Uptr numElems, const ValueTy
 		static Impl emptyImpl(0, nullptr);
 		return &emptyImpl;
 	}
+	else if(numElems <= maxSmallTypeTupleElems)
+	{
+		static std::atomic<const Impl*> smallImpls[numSmallTypeTuples];
+
+		std::atomic<const Impl*>& smallImpl
+			= smallImpls[getSmallTypeTupleIndex(numElems, inElems)];
+		const Impl* impl = smallImpl.load(std::memory_order_acquire);
+		if(!impl)
+		{
+			// If another thread interns the same tuple first, use its Impl instead.
+			Impl* newImpl = new(malloc(Impl::calcNumBytes(numElems))) Impl(numElems, inElems);
+			if(smallImpl.compare_exchange_strong(impl, newImpl, std::memory_order_acq_rel))
+			{ impl = newImpl; }
+			else
+			{
+				free(newImpl);
+			}
+		}
+		return impl;
+	}
 	else
 	{
 		const Uptr numImplBytes = Impl::calcNumBytes(numElems);
 		Impl* localImpl = new(alloca(numImplBytes)) Impl(numElems, inElems);
 
-		static Platform::Mutex uniqueTypeTupleSetMutex;
-		static HashSet<TypeTuple, TypeTupleHashPolicy> uniqueTypeTupleSet;
-
-		Lock<Platform::Mutex> uniqueTypeTupleSetLock(uniqueTypeTupleSetMutex);
-
-		const TypeTuple* typeTuple = uniqueTypeTupleSet.get(TypeTuple(localImpl));
-		if(typeTuple) { return typeTuple->impl; }
-		else
+		// Look for an existing Impl without locking or allocating, and only allocate a new Impl
+		// before adding it to the set.
+		static ConcurrentHashMap<TypeTuple, const Impl*, TypeTupleHashPolicy> uniqueTypeTupleMap;
+		const Impl* impl = uniqueTypeTupleMap.get(TypeTuple(localImpl), nullptr);
+		if(!impl)
 		{
 			Impl* globalImpl = new(malloc(numImplBytes)) Impl(*localImpl);
-			uniqueTypeTupleSet.addOrFail(TypeTuple(globalImpl));
-			return globalImpl;
+			impl = uniqueTypeTupleMap.getOrAdd(TypeTuple(globalImpl), globalImpl);
+			if(impl != globalImpl) { free(globalImpl); }
 		}
+		return impl;
 	}
 }
 
@@ -109,18 +149,15 @@ const FunctionType::Impl* IR::FunctionType::getUniqueImpl(TypeTuple results, Typ
 	{
 		Impl localImpl(results, params);
 
-		static Platform::Mutex uniqueFunctionTypeSetMutex;
-		static HashSet<FunctionType, FunctionTypeHashPolicy> uniqueFunctionTypeSet;
-
-		Lock<Platform::Mutex> uniqueFunctionTypeSetLock(uniqueFunctionTypeSetMutex);
-
-		const FunctionType* functionType = uniqueFunctionTypeSet.get(FunctionType(&localImpl));
-		if(functionType) { return functionType->impl; }
-		else
+		static ConcurrentHashMap<FunctionType, const Impl*, FunctionTypeHashPolicy>
+			uniqueFunctionTypeMap;
+		const Impl* impl = uniqueFunctionTypeMap.get(FunctionType(&localImpl), nullptr);
+		if(!impl)
 		{
 			Impl* globalImpl = new Impl(localImpl);
-			uniqueFunctionTypeSet.addOrFail(FunctionType(globalImpl));
-			return globalImpl;
+			impl = uniqueFunctionTypeMap.getOrAdd(FunctionType(globalImpl), globalImpl);
+			if(impl != globalImpl) { delete globalImpl; }
 		}
+		return impl;
 	}
 }
@@ -1,7 +1,9 @@
 #include "WAVM/IR/Validate.h"
 
 #include <stdint.h>
+#include <atomic>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -15,7 +17,10 @@
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashSet.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 
 #define ENABLE_LOGGING 0
 
@@ -90,7 +95,16 @@ static void validate(const Module& module, TableType type)
 
 static void validate(const Module& module, MemoryType type)
 {
-	validate(type.size, IR::maxMemoryPages);
+	if(type.indexType == IndexType::i64)
+	{
+		VALIDATE_FEATURE("64-bit memory", memory64);
+		validate(type.size, IR::maxMemory64Pages);
+	}
+	else
+	{
+		VALIDATE_UNLESS("invalid memory index type: ", type.indexType != IndexType::i32);
+		validate(type.size, IR::maxMemoryPages);
+	}
 	if(type.isShared)
 	{
 		VALIDATE_FEATURE("shared memory", atomics);
@@ -147,14 +161,22 @@ static FunctionType validateFunctionIndex(const Module& module, Uptr functionInd
 	return module.types[module.functions.getType(functionIndex).index];
 }
 
-static FunctionType validateBlockType(const Module& module, const IndexedBlockType& type)
+// The parameters and results of a control structure. Unlike a FunctionType, it doesn't need to be
+// interned, so validating a block with a single result doesn't need to look up a function type.
+struct BlockSignature
+{
+	TypeTuple params;
+	TypeTuple results;
+};
+
+static BlockSignature validateBlockType(const Module& module, const IndexedBlockType& type)
 {
 	switch(type.format)
 	{
-	case IndexedBlockType::noParametersOrResult: return FunctionType();
+	case IndexedBlockType::noParametersOrResult: return BlockSignature();
 	case IndexedBlockType::oneResult:
 		validate(module.featureSpec, type.resultType);
-		return FunctionType(TypeTuple(type.resultType));
+		return BlockSignature{TypeTuple(), TypeTuple(type.resultType)};
 	case IndexedBlockType::functionType:
 	{
 		VALIDATE_INDEX(type.index, module.types.size());
@@ -169,7 +191,7 @@ static FunctionType validateBlockType(const Module& module, const IndexedBlockTy
 			throw ValidationException(
 				"block has multiple results, but \"multivalue\" extension is disabled");
 		}
-		return functionType;
+		return BlockSignature{functionType.params(), functionType.results()};
 	}
 	default: Errors::unreachable();
 	}
@@ -225,24 +247,81 @@ static void validateInitializer(const Module& module,
 	};
 }
 
+struct ControlContext
+{
+	enum class Type : U8
+	{
+		function,
+		block,
+		ifThen,
+		ifElse,
+		loop,
+		try_,
+		catch_
+	};
+
+	Type type;
+	bool isReachable;
+	Uptr outerStackSize;
+
+	TypeTuple params;
+	TypeTuple results;
+
+	// A branch to a loop jumps to its start, and so takes the loop's parameters. A branch to any
+	// other control structure jumps to its end, and so takes its results.
+	TypeTuple getBranchParams() const { return type == Type::loop ? params : results; }
+};
+
+// The operand and control stacks used to validate a function definition. They are reused by later
+// validation on the same thread, so validating a function usually doesn't need to allocate them.
+struct ValidationStacks
+{
+	std::vector<ControlContext> controlStack;
+	std::vector<ValueType> stack;
+};
+
+static thread_local std::vector<std::unique_ptr<ValidationStacks>> freeValidationStacks;
+
+// Owns a ValidationStacks taken from the current thread's free list, and returns it to the free
+// list of the thread that destroys it.
+struct PooledValidationStacks
+{
+	ValidationStacks* stacks;
+
+	PooledValidationStacks()
+	{
+		if(!freeValidationStacks.size()) { stacks = new ValidationStacks; }
+		else
+		{
+			stacks = freeValidationStacks.back().release();
+			freeValidationStacks.pop_back();
+		}
+	}
+
+	~PooledValidationStacks()
+	{
+		stacks->controlStack.clear();
+		stacks->stack.clear();
+		freeValidationStacks.emplace_back(stacks);
+	}
+
+	PooledValidationStacks(const PooledValidationStacks&) = delete;
+	PooledValidationStacks& operator=(const PooledValidationStacks&) = delete;
+};
+
 struct FunctionValidationContext
 {
 	FunctionValidationContext(const Module& inModule, const FunctionDef& inFunctionDef)
 	: module(inModule)
 	, functionDef(inFunctionDef)
 	, functionType(inModule.types[inFunctionDef.type.index])
+	, controlStack(pooledStacks.stacks->controlStack)
+	, stack(pooledStacks.stacks->stack)
 	{
 		// Validate the function's local types.
 		for(auto localType : functionDef.nonParameterLocalTypes)
 		{ validate(module.featureSpec, localType); }
 
-		// Initialize the local types.
-		locals.reserve(functionType.params().size() + functionDef.nonParameterLocalTypes.size());
-		locals.insert(locals.end(), functionType.params().begin(), functionType.params().end());
-		locals.insert(locals.end(),
-					  functionDef.nonParameterLocalTypes.begin(),
-					  functionDef.nonParameterLocalTypes.end());
-
 		// Log the start of the function and its signature+locals.
 		if(ENABLE_LOGGING)
 		{
@@ -257,7 +336,7 @@ struct FunctionValidationContext
 
 		// Push the function context onto the control stack.
 		pushControlStack(
-			ControlContext::Type::function, functionType.results(), functionType.results());
+			ControlContext::Type::function, functionType.params(), functionType.results());
 	}
 
 	Uptr getControlStackSize() { return controlStack.size(); }
@@ -319,33 +398,32 @@ struct FunctionValidationContext
 	}
 	void block(ControlStructureImm imm)
 	{
-		const FunctionType type = validateBlockType(module, imm.type);
-		popAndValidateTypeTuple("block arguments", type.params());
-		pushControlStack(ControlContext::Type::block, type.results(), type.results());
+		const BlockSignature type = validateBlockType(module, imm.type);
+		popAndValidateTypeTuple("block arguments", type.params);
+		pushControlStack(ControlContext::Type::block, type.params, type.results);
 
-		pushOperandTuple(type.params());
+		pushOperandTuple(type.params);
 	}
 	void loop(ControlStructureImm imm)
 	{
-		const FunctionType type = validateBlockType(module, imm.type);
-		popAndValidateTypeTuple("loop arguments", type.params());
-		pushControlStack(ControlContext::Type::loop, type.params(), type.results());
-		pushOperandTuple(type.params());
+		const BlockSignature type = validateBlockType(module, imm.type);
+		popAndValidateTypeTuple("loop arguments", type.params);
+		pushControlStack(ControlContext::Type::loop, type.params, type.results);
+		pushOperandTuple(type.params);
 	}
 	void if_(ControlStructureImm imm)
 	{
-		const FunctionType type = validateBlockType(module, imm.type);
+		const BlockSignature type = validateBlockType(module, imm.type);
 		popAndValidateOperand("if condition", ValueType::i32);
-		popAndValidateTypeTuple("if arguments", type.params());
-		pushControlStack(
-			ControlContext::Type::ifThen, type.results(), type.results(), type.params());
-		pushOperandTuple(type.params());
+		popAndValidateTypeTuple("if arguments", type.params);
+		pushControlStack(ControlContext::Type::ifThen, type.params, type.results);
+		pushOperandTuple(type.params);
 	}
 	void else_(NoImm imm)
 	{
 		wavmAssert(controlStack.size());
 
-		TypeTuple params = controlStack.back().elseParams;
+		TypeTuple params = controlStack.back().params;
 		popAndValidateTypeTuple("if result", controlStack.back().results);
 		popControlStack(true);
 		pushOperandTuple(params);
@@ -359,11 +437,11 @@ struct FunctionValidationContext
 	}
 	void try_(ControlStructureImm imm)
 	{
-		const FunctionType type = validateBlockType(module, imm.type);
+		const BlockSignature type = validateBlockType(module, imm.type);
 		VALIDATE_FEATURE("try", exceptionHandling);
-		popAndValidateTypeTuple("try arguments", type.params());
-		pushControlStack(ControlContext::Type::try_, type.results(), type.results());
-		pushOperandTuple(type.params());
+		popAndValidateTypeTuple("try arguments", type.params);
+		pushControlStack(ControlContext::Type::try_, type.params, type.results);
+		pushOperandTuple(type.params);
 	}
 	void catch_(ExceptionTypeImm imm)
 	{
@@ -395,14 +473,16 @@ struct FunctionValidationContext
 
 	void br(BranchImm imm)
 	{
-		popAndValidateTypeTuple("br argument", getBranchTargetByDepth(imm.targetDepth).params);
+		popAndValidateTypeTuple("br argument",
+								getBranchTargetByDepth(imm.targetDepth).getBranchParams());
 		enterUnreachable();
 	}
 	void br_table(BranchTableImm imm)
 	{
 		popAndValidateOperand("br_table index", ValueType::i32);
 
-		const TypeTuple defaultTargetParams = getBranchTargetByDepth(imm.defaultTargetDepth).params;
+		const TypeTuple defaultTargetParams
+			= getBranchTargetByDepth(imm.defaultTargetDepth).getBranchParams();
 
 		// Meet (intersect) the parameters of all the branch targets to get the most general type
 		// that matches any of the targets.
@@ -416,7 +496,8 @@ struct FunctionValidationContext
 		const std::vector<Uptr>& targetDepths = functionDef.branchTables[imm.branchTableIndex];
 		for(Uptr targetIndex = 0; targetIndex < targetDepths.size(); ++targetIndex)
 		{
-			const TypeTuple targetParams = getBranchTargetByDepth(targetDepths[targetIndex]).params;
+			const TypeTuple targetParams
+				= getBranchTargetByDepth(targetDepths[targetIndex]).getBranchParams();
 			if(targetParams.size() != numTargetParams)
 			{
 				throw ValidationException(
@@ -449,7 +530,7 @@ struct FunctionValidationContext
 	}
 	void br_if(BranchImm imm)
 	{
-		const TypeTuple targetParams = getBranchTargetByDepth(imm.targetDepth).params;
+		const TypeTuple targetParams = getBranchTargetByDepth(imm.targetDepth).getBranchParams();
 		popAndValidateOperand("br_if condition", ValueType::i32);
 		popAndValidateTypeTuple("br_if argument", targetParams);
 		pushOperandTuple(targetParams);
@@ -564,10 +645,19 @@ struct FunctionValidationContext
 						imm.alignmentLog2 > naturalAlignmentLog2);
 		VALIDATE_UNLESS("load or store in module without default memory: ",
 						module.memories.size() == 0);
+		VALIDATE_INDEX(imm.memoryIndex, module.memories.size());
+		VALIDATE_UNLESS("load or store offset must be less than 2^32 for a 32-bit memory: ",
+						!isMemory64(imm.memoryIndex) && imm.offset > UINT32_MAX);
 	}
 
 	void validateImm(MemoryImm imm) { VALIDATE_INDEX(imm.memoryIndex, module.memories.size()); }
 
+	void validateImm(MemoryCopyImm imm)
+	{
+		VALIDATE_INDEX(imm.destMemoryIndex, module.memories.size());
+		VALIDATE_INDEX(imm.sourceMemoryIndex, module.memories.size());
+	}
+
 	void validateImm(TableImm imm) { VALIDATE_INDEX(imm.tableIndex, module.tables.size()); }
 
 	void validateImm(FunctionImm imm) { validateFunctionIndex(module, imm.functionIndex); }
@@ -591,13 +681,16 @@ struct FunctionValidationContext
 	{
 		VALIDATE_UNLESS("atomic memory operator in module without default memory: ",
 						module.memories.size() == 0);
+		VALIDATE_INDEX(imm.memoryIndex, module.memories.size());
 		if(module.featureSpec.requireSharedFlagForAtomicOperators)
 		{
 			VALIDATE_UNLESS("atomic memory operators require a memory with the shared flag: ",
-							!module.memories.getType(0).isShared);
+							!module.memories.getType(imm.memoryIndex).isShared);
 		}
 		VALIDATE_UNLESS("atomic memory operators must have natural alignment: ",
 						imm.alignmentLog2 != naturalAlignmentLog2);
+		VALIDATE_UNLESS("atomic memory operator offset must be less than 2^32 for a 32-bit memory: ",
+						!isMemory64(imm.memoryIndex) && imm.offset > UINT32_MAX);
 	}
 
 	void validateImm(DataSegmentAndMemImm imm)
@@ -630,6 +723,76 @@ struct FunctionValidationContext
 						module.tableSegments[imm.elemSegmentIndex].isActive)
 	}
 
+	bool isMemory64(Uptr memoryIndex)
+	{
+		return module.memories.getType(memoryIndex).indexType == IndexType::i64;
+	}
+
+	// Returns whether an operator accesses a 64-bit memory.
+	template<typename Imm> bool isMemory64Operator(Imm) { return false; }
+	template<Uptr naturalAlignmentLog2>
+	bool isMemory64Operator(LoadOrStoreImm<naturalAlignmentLog2> imm)
+	{
+		return isMemory64(imm.memoryIndex);
+	}
+	template<Uptr naturalAlignmentLog2>
+	bool isMemory64Operator(AtomicLoadOrStoreImm<naturalAlignmentLog2> imm)
+	{
+		return isMemory64(imm.memoryIndex);
+	}
+	bool isMemory64Operator(MemoryImm imm) { return isMemory64(imm.memoryIndex); }
+	bool isMemory64Operator(DataSegmentAndMemImm imm) { return isMemory64(imm.memoryIndex); }
+	bool isMemory64Operator(MemoryCopyImm imm)
+	{
+		return isMemory64(imm.destMemoryIndex) && isMemory64(imm.sourceMemoryIndex);
+	}
+
+	// A memory.copy between a 32-bit and a 64-bit memory takes an address in each memory, and a
+	// 32-bit number of bytes.
+	template<typename Imm> void adjustMixedMemoryCopySignature(Imm, FunctionType&) {}
+	void adjustMixedMemoryCopySignature(MemoryCopyImm imm, FunctionType& inOutSignature)
+	{
+		const bool isDestMemory64 = isMemory64(imm.destMemoryIndex);
+		if(isDestMemory64 != isMemory64(imm.sourceMemoryIndex))
+		{
+			inOutSignature = FunctionType(
+				TypeTuple(),
+				TypeTuple({isDestMemory64 ? ValueType::i64 : ValueType::i32,
+						   isDestMemory64 ? ValueType::i32 : ValueType::i64,
+						   ValueType::i32}));
+		}
+	}
+
+	// Translates the signature of an operator that accesses a 32-bit memory to the signature of
+	// the same operator accessing a 64-bit memory: the operands and results that are addresses or
+	// numbers of bytes in the memory become i64.
+	static FunctionType getMemory64Signature(Opcode opcode, FunctionType signature)
+	{
+		std::vector<ValueType> params(signature.params().begin(), signature.params().end());
+		std::vector<ValueType> results(signature.results().begin(), signature.results().end());
+		switch(opcode)
+		{
+		case Opcode::memory_size: results[0] = ValueType::i64; break;
+		case Opcode::memory_grow:
+			params[0] = ValueType::i64;
+			results[0] = ValueType::i64;
+			break;
+		case Opcode::memory_copy:
+			params[0] = params[1] = params[2] = ValueType::i64;
+			break;
+		case Opcode::memory_fill:
+			params[0] = params[2] = ValueType::i64;
+			break;
+		default:
+			// memory.init and the load, store, and atomic operators take an address as their first
+			// operand.
+			wavmAssert(params.size() && params[0] == ValueType::i32);
+			params[0] = ValueType::i64;
+			break;
+		};
+		return FunctionType(TypeTuple(results), TypeTuple(params));
+	}
+
 #define VALIDATE_OP(opcode, name, nameString, Imm, signatureInitializer, requiredFeature)          \
 	void name(Imm imm)                                                                             \
 	{                                                                                              \
@@ -638,50 +801,32 @@ struct FunctionValidationContext
 		SUPPRESS_UNUSED(operatorName);                                                             \
 		validateImm(imm);                                                                          \
 		static const FunctionType signature = signatureInitializer;                                \
-		popAndValidateTypeTuple("call arguments", signature.params());                             \
-		pushOperandTuple(signature.results());                                                     \
+		FunctionType operatorSignature = signature;                                                \
+		if(isMemory64Operator(imm))                                                                \
+		{                                                                                          \
+			static const FunctionType signature64                                                  \
+				= getMemory64Signature(Opcode::name, signature);                                   \
+			operatorSignature = signature64;                                                       \
+		}                                                                                          \
+		adjustMixedMemoryCopySignature(imm, operatorSignature);                                    \
+		popAndValidateTypeTuple("call arguments", operatorSignature.params());                     \
+		pushOperandTuple(operatorSignature.results());                                             \
 	}
 	ENUM_NONCONTROL_NONPARAMETRIC_OPERATORS(VALIDATE_OP)
 #undef VALIDATE_OP
 
 private:
-	struct ControlContext
-	{
-		enum class Type : U8
-		{
-			function,
-			block,
-			ifThen,
-			ifElse,
-			loop,
-			try_,
-			catch_
-		};
-
-		Type type;
-		Uptr outerStackSize;
-
-		TypeTuple params;
-		TypeTuple results;
-		bool isReachable;
-
-		TypeTuple elseParams;
-	};
-
 	const Module& module;
 	const FunctionDef& functionDef;
 	FunctionType functionType;
 
-	std::vector<ValueType> locals;
-	std::vector<ControlContext> controlStack;
-	std::vector<ValueType> stack;
+	PooledValidationStacks pooledStacks;
+	std::vector<ControlContext>& controlStack;
+	std::vector<ValueType>& stack;
 
-	void pushControlStack(ControlContext::Type type,
-						  TypeTuple params,
-						  TypeTuple results,
-						  TypeTuple elseParams = TypeTuple())
+	void pushControlStack(ControlContext::Type type, TypeTuple params, TypeTuple results)
 	{
-		controlStack.push_back({type, stack.size(), params, results, true, elseParams});
+		controlStack.push_back({type, true, stack.size(), params, results});
 	}
 
 	void popControlStack(bool isElse = false, bool isCatch = false)
@@ -722,7 +867,7 @@ private:
 			VALIDATE_UNLESS("catch only allowed in try context: ", isCatch);
 			TypeTuple results = controlStack.back().results;
 			if(controlStack.back().type == ControlContext::Type::ifThen
-			   && results != controlStack.back().elseParams)
+			   && results != controlStack.back().params)
 			{ throw ValidationException("else-less if must have identity signature"); }
 			controlStack.pop_back();
 			if(controlStack.size()) { pushOperandTuple(results); }
@@ -751,8 +896,11 @@ private:
 
 	ValueType validateLocalIndex(Uptr localIndex)
 	{
-		VALIDATE_INDEX(localIndex, locals.size());
-		return locals[localIndex];
+		const Uptr numParams = functionType.params().size();
+		const Uptr numLocals = numParams + functionDef.nonParameterLocalTypes.size();
+		VALIDATE_INDEX(localIndex, numLocals);
+		return localIndex < numParams ? functionType.params()[localIndex]
+									  : functionDef.nonParameterLocalTypes[localIndex - numParams];
 	}
 
 	void popAndValidateOperands(const char* context, const ValueType* expectedTypes, Uptr num)
@@ -863,7 +1011,8 @@ void IR::validateImports(const Module& module)
 
 	VALIDATE_UNLESS("too many tables: ",
 					!module.featureSpec.referenceTypes && module.tables.size() > 1);
-	VALIDATE_UNLESS("too many memories: ", module.memories.size() > 1);
+	VALIDATE_UNLESS("too many memories: ",
+					!module.featureSpec.multipleMemories && module.memories.size() > 1);
 }
 
 void IR::validateFunctionDeclarations(const Module& module)
@@ -904,7 +1053,8 @@ void IR::validateTableDefs(const Module& module)
 void IR::validateMemoryDefs(const Module& module)
 {
 	for(auto& memoryDef : module.memories.defs) { validate(module, memoryDef.type); }
-	VALIDATE_UNLESS("too many memories: ", module.memories.size() > 1);
+	VALIDATE_UNLESS("too many memories: ",
+					!module.featureSpec.multipleMemories && module.memories.size() > 1);
 }
 
 void IR::validateExports(const Module& module)
@@ -973,8 +1123,11 @@ void IR::validateDataSegments(const Module& module)
 		if(dataSegment.isActive)
 		{
 			VALIDATE_INDEX(dataSegment.memoryIndex, module.memories.size());
-			validateInitializer(
-				module, dataSegment.baseOffset, ValueType::i32, "data segment base initializer");
+			const MemoryType memoryType = module.memories.getType(dataSegment.memoryIndex);
+			validateInitializer(module,
+								dataSegment.baseOffset,
+								asValueType(memoryType.indexType),
+								"data segment base initializer");
 		}
 	}
 }
@@ -1018,3 +1171,108 @@ void IR::CodeValidationStream::finish()
 	}
 ENUM_OPERATORS(VISIT_OPCODE)
 #undef VISIT_OPCODE
+
+// Forwards the operators decoded from a function definition's code to a CodeValidationStream.
+struct CodeValidationVisitor
+{
+	typedef void Result;
+
+	CodeValidationStream& codeValidationStream;
+
+	CodeValidationVisitor(CodeValidationStream& inCodeValidationStream)
+	: codeValidationStream(inCodeValidationStream)
+	{
+	}
+
+#define VISIT_OPCODE(_, name, nameString, Imm, ...)                                                \
+	void name(Imm imm) { codeValidationStream.name(imm); }
+	ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+
+	void unknown(Opcode) { Errors::unreachable(); }
+};
+
+void IR::validateFunctionDef(const Module& module, const FunctionDef& functionDef)
+{
+	CodeValidationStream codeValidationStream(module, functionDef);
+	CodeValidationVisitor visitor(codeValidationStream);
+	OperatorDecoderStream decoderStream(functionDef.code);
+	decoderStream.decodeAll(visitor);
+	codeValidationStream.finish();
+}
+
+static constexpr Uptr validationThreadStackBytes = 1024 * 1024;
+
+// The state shared by the threads that validate a module's function definitions in parallel.
+struct ParallelValidationState
+{
+	const Module& module;
+	std::atomic<Uptr> nextFunctionDefIndex{0};
+
+	// The lowest index of a function definition that has been found to be invalid, or UINTPTR_MAX.
+	// It is only written while holding errorMutex, along with errorMessage.
+	std::atomic<Uptr> firstInvalidFunctionDefIndex{UINTPTR_MAX};
+	Platform::Mutex errorMutex;
+	std::string errorMessage;
+
+	ParallelValidationState(const Module& inModule) : module(inModule) {}
+};
+
+static I64 validationThreadEntry(void* stateVoid)
+{
+	ParallelValidationState& state = *(ParallelValidationState*)stateVoid;
+
+	// Function definitions are claimed in increasing index order, so once a function definition
+	// is found to be invalid, every function definition with a lower index has already been
+	// claimed, and the remaining function definitions don't need to be validated.
+	while(true)
+	{
+		const Uptr functionDefIndex = state.nextFunctionDefIndex++;
+		if(functionDefIndex >= state.module.functions.defs.size()
+		   || functionDefIndex > state.firstInvalidFunctionDefIndex.load(std::memory_order_relaxed))
+		{ break; }
+
+		try
+		{
+			validateFunctionDef(state.module, state.module.functions.defs[functionDefIndex]);
+		}
+		catch(ValidationException exception)
+		{
+			Lock<Platform::Mutex> errorLock(state.errorMutex);
+			if(functionDefIndex < state.firstInvalidFunctionDefIndex.load(std::memory_order_relaxed))
+			{
+				state.firstInvalidFunctionDefIndex.store(functionDefIndex,
+														 std::memory_order_relaxed);
+				state.errorMessage = std::move(exception.message);
+			}
+		}
+	}
+
+	return 0;
+}
+
+void IR::validateFunctionDefs(const Module& module, Uptr numThreads)
+{
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::min(numThreads, Uptr(module.functions.defs.size()));
+	if(numThreads <= 1)
+	{
+		for(const FunctionDef& functionDef : module.functions.defs)
+		{ validateFunctionDef(module, functionDef); }
+		return;
+	}
+
+	// Validate the function definitions on the worker threads and the calling thread.
+	ParallelValidationState state(module);
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{
+		threads.push_back(
+			Platform::createThread(validationThreadStackBytes, validationThreadEntry, &state));
+	}
+	validationThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	if(state.firstInvalidFunctionDefIndex.load(std::memory_order_relaxed) != UINTPTR_MAX)
+	{ throw ValidationException(std::move(state.errorMessage)); }
+}
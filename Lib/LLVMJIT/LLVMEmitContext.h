@@ -9,6 +9,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Value.h"
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
@@ -20,27 +21,45 @@ namespace WAVM { namespace LLVMJIT {
 		llvm::IRBuilder<> irBuilder;
 
 		llvm::Value* contextPointerVariable;
-		llvm::Value* memoryBasePointerVariable;
 
-		EmitContext(LLVMContext& inLLVMContext, llvm::Constant* inDefaultMemoryOffset)
+		// The offsets in the CompartmentRuntimeData of the base pointers of the memories that the
+		// code may access, indexed by memory index. Must be set before initContextVariables.
+		std::vector<llvm::Constant*> memoryOffsets;
+
+		// A variable for each memory that caches its base address. The variables are only reloaded
+		// at function entry and when a call switches contexts, so LLVM can keep the bases of all
+		// the memories the code uses in registers. The loads of the bases of memories that the code
+		// doesn't use are dead, and are removed by the optimizer.
+		std::vector<llvm::Value*> memoryBasePointerVariables;
+
+		// Only set if the code is emitted with memory bounds checks.
+		std::vector<llvm::Value*> memoryNumReservedBytesVariables;
+
+		EmitContext(LLVMContext& inLLVMContext, bool inEmitMemoryBoundsChecks = false)
 		: llvmContext(inLLVMContext)
 		, irBuilder(inLLVMContext)
 		, contextPointerVariable(nullptr)
-		, memoryBasePointerVariable(nullptr)
-		, defaultMemoryOffset(inDefaultMemoryOffset)
+		, emitMemoryBoundsChecks(inEmitMemoryBoundsChecks)
 		{
 		}
 
-		llvm::Value* loadFromUntypedPointer(llvm::Value* pointer, llvm::Type* valueType)
+		llvm::Value* loadFromUntypedPointer(llvm::Value* pointer,
+											llvm::Type* valueType,
+											llvm::MDNode* tbaaTag = nullptr)
 		{
-			return irBuilder.CreateLoad(
+			llvm::LoadInst* load = irBuilder.CreateLoad(
 				irBuilder.CreatePointerCast(pointer, valueType->getPointerTo()));
+			if(tbaaTag) { load->setMetadata(llvm::LLVMContext::MD_tbaa, tbaaTag); }
+			return load;
 		}
 
-		void storeToUntypedPointer(llvm::Value* value, llvm::Value* pointer)
+		void storeToUntypedPointer(llvm::Value* value,
+								   llvm::Value* pointer,
+								   llvm::MDNode* tbaaTag = nullptr)
 		{
-			irBuilder.CreateStore(
+			llvm::StoreInst* store = irBuilder.CreateStore(
 				value, irBuilder.CreatePointerCast(pointer, value->getType()->getPointerTo()));
+			if(tbaaTag) { store->setMetadata(llvm::LLVMContext::MD_tbaa, tbaaTag); }
 		}
 
 		llvm::Value* getCompartmentAddress()
@@ -59,25 +78,81 @@ namespace WAVM { namespace LLVMJIT {
 		{
 			llvm::Value* compartmentAddress = getCompartmentAddress();
 
-			// Load the defaultMemoryBase and defaultTableBase values from the runtime data for this
-			// module instance.
-
-			if(defaultMemoryOffset)
+			// Load the base and reserved size of each memory from the runtime data for this module
+			// instance.
+			for(Uptr memoryIndex = 0; memoryIndex < memoryOffsets.size(); ++memoryIndex)
 			{
+				llvm::Constant* memoryOffset = memoryOffsets[memoryIndex];
+
 				irBuilder.CreateStore(
 					loadFromUntypedPointer(
-						irBuilder.CreateInBoundsGEP(compartmentAddress, {defaultMemoryOffset}),
-						llvmContext.i8PtrType),
-					memoryBasePointerVariable);
+						irBuilder.CreateInBoundsGEP(compartmentAddress, {memoryOffset}),
+						llvmContext.i8PtrType,
+						llvmContext.runtimeDataTBAATag),
+					memoryBasePointerVariables[memoryIndex]);
+
+				if(memoryNumReservedBytesVariables[memoryIndex])
+				{
+					// The memory's reserved size is at a fixed offset from its base pointer in the
+					// CompartmentRuntimeData.
+					llvm::Constant* numReservedBytesOffset = llvm::ConstantExpr::getAdd(
+						memoryOffset,
+						emitLiteral(
+							llvmContext,
+							Uptr(offsetof(Runtime::CompartmentRuntimeData, memoryNumReservedBytes)
+								 - offsetof(Runtime::CompartmentRuntimeData, memoryBases))));
+					llvm::Value* numReservedBytesPointer
+						= irBuilder.CreateInBoundsGEP(compartmentAddress, {numReservedBytesOffset});
+					irBuilder.CreateStore(
+						loadFromUntypedPointer(numReservedBytesPointer,
+											   llvmContext.i64Type,
+											   llvmContext.runtimeDataTBAATag),
+						memoryNumReservedBytesVariables[memoryIndex]);
+				}
 			}
 		}
 
+		// A memory's base address and reserved size don't change over its lifetime, so they only
+		// need to be reloaded after a call if it returned a different context than was passed to
+		// it: a callee may switch to a context in another compartment (e.g. by forking the thread
+		// into a cloned compartment). Skipping the reload for the usual case lets LLVM keep the
+		// memory bases in registers across calls.
+		void reloadMemoryBaseIfContextChanged(llvm::Value* oldContextPointer,
+											  llvm::Value* newContextPointer)
+		{
+			if(!memoryOffsets.size()) { return; }
+
+			llvm::Function* function = irBuilder.GetInsertBlock()->getParent();
+			auto reloadBlock = llvm::BasicBlock::Create(llvmContext, "reloadMemoryBase", function);
+			auto endBlock = llvm::BasicBlock::Create(llvmContext, "reloadMemoryBaseEnd", function);
+			irBuilder.CreateCondBr(irBuilder.CreateICmpNE(oldContextPointer, newContextPointer),
+								   reloadBlock,
+								   endBlock,
+								   llvm::MDBuilder(llvmContext).createBranchWeights(1, 1000));
+
+			irBuilder.SetInsertPoint(reloadBlock);
+			reloadMemoryBase();
+			irBuilder.CreateBr(endBlock);
+
+			irBuilder.SetInsertPoint(endBlock);
+		}
+
 		void initContextVariables(llvm::Value* initialContextPointer)
 		{
-			memoryBasePointerVariable
-				= irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "memoryBase");
 			contextPointerVariable
 				= irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "context");
+			memoryBasePointerVariables.assign(memoryOffsets.size(), nullptr);
+			memoryNumReservedBytesVariables.assign(memoryOffsets.size(), nullptr);
+			for(Uptr memoryIndex = 0; memoryIndex < memoryOffsets.size(); ++memoryIndex)
+			{
+				memoryBasePointerVariables[memoryIndex]
+					= irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "memoryBase");
+				if(emitMemoryBoundsChecks)
+				{
+					memoryNumReservedBytesVariables[memoryIndex] = irBuilder.CreateAlloca(
+						llvmContext.i64Type, nullptr, "memoryNumReservedBytes");
+				}
+			}
 			irBuilder.CreateStore(initialContextPointer, contextPointerVariable);
 			reloadMemoryBase();
 		}
@@ -130,8 +205,8 @@ namespace WAVM { namespace LLVMJIT {
 				auto newContextPointer = irBuilder.CreateExtractValue(returnValue, {0});
 				irBuilder.CreateStore(newContextPointer, contextPointerVariable);
 
-				// Reload the memory/table base pointers.
-				reloadMemoryBase();
+				// Reload the memory base pointer if the callee switched contexts.
+				reloadMemoryBaseIfContextChanged(augmentedArgs[0], newContextPointer);
 
 				if(areResultsReturnedDirectly(calleeType.results()))
 				{
@@ -172,8 +247,8 @@ namespace WAVM { namespace LLVMJIT {
 				// Update the context variable.
 				irBuilder.CreateStore(newContextPointer, contextPointerVariable);
 
-				// Reload the memory/table base pointers.
-				reloadMemoryBase();
+				// Reload the memory base pointer if the callee switched contexts.
+				reloadMemoryBaseIfContextChanged(augmentedArgs[0], newContextPointer);
 
 				// Load the call result from the returned context.
 				wavmAssert(calleeType.results().size() <= 1);
@@ -242,6 +317,6 @@ namespace WAVM { namespace LLVMJIT {
 		}
 
 	private:
-		llvm::Constant* defaultMemoryOffset;
+		bool emitMemoryBoundsChecks;
 	};
 }}
@@ -58,8 +58,9 @@ EMIT_UNARY_OP(f64x2_convert_u_i64x2,
 			  irBuilder.CreateUIToFP(irBuilder.CreateBitCast(operand, llvmContext.i64x2Type),
 									 llvmContext.f64x2Type));
 
-EMIT_UNARY_OP(f32_demote_f64, irBuilder.CreateFPTrunc(operand, llvmContext.f32Type))
-EMIT_UNARY_OP(f64_promote_f32, emitF64Promote(operand))
+EMIT_UNARY_OP(f32_demote_f64,
+			  emitCanonicalizeNaNs(irBuilder.CreateFPTrunc(operand, llvmContext.f32Type)))
+EMIT_UNARY_OP(f64_promote_f32, emitCanonicalizeNaNs(emitF64Promote(operand)))
 EMIT_UNARY_OP(f32_reinterpret_i32, irBuilder.CreateBitCast(operand, llvmContext.f32Type))
 EMIT_UNARY_OP(f64_reinterpret_i64, irBuilder.CreateBitCast(operand, llvmContext.f64Type))
 EMIT_UNARY_OP(i32_reinterpret_f32, irBuilder.CreateBitCast(operand, llvmContext.i32Type))
@@ -249,14 +250,38 @@ llvm::Value* EmitFunctionContext::emitTruncVectorFloatToIntSat(llvm::Type* destT
 															   Int nanResult,
 															   llvm::Value* operand)
 {
-	auto result = isSigned ? irBuilder.CreateFPToSI(operand, destType)
-						   : irBuilder.CreateFPToUI(operand, destType);
-
 	auto minFloatBoundsVec
 		= irBuilder.CreateVectorSplat(numElements, emitLiteral(llvmContext, minFloatBounds));
 	auto maxFloatBoundsVec
 		= irBuilder.CreateVectorSplat(numElements, emitLiteral(llvmContext, maxFloatBounds));
 
+	if(moduleContext.simdISA == TargetSIMDISA::aarch64NEON && nanResult == 0)
+	{
+		// fcvtzs and fcvtzu saturate out-of-range lanes and convert NaN lanes to zero.
+		return callLLVMIntrinsic({destType, operand->getType()},
+								 isSigned ? llvm::Intrinsic::aarch64_neon_fcvtzs
+										  : llvm::Intrinsic::aarch64_neon_fcvtzu,
+								 {operand});
+	}
+	else if(moduleContext.simdISA >= TargetSIMDISA::x86SSE2 && isSigned && sizeof(Int) == 4
+			&& sizeof(Float) == 4 && nanResult == 0)
+	{
+		// cvttps2dq converts out-of-range and NaN lanes to INT32_MIN, which is already the correct
+		// result for negative overflow. Flip the positive overflow lanes to INT32_MAX, and clear
+		// the NaN lanes.
+		llvm::Value* result
+			= callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_cvttps2dq, {operand});
+		llvm::Value* isPositiveOverflow
+			= sext(irBuilder.CreateFCmpOGE(operand, maxFloatBoundsVec), destType);
+		llvm::Value* isNotNaN = sext(
+			createFCmpWithWorkaround(irBuilder, llvm::CmpInst::FCMP_ORD, operand, operand),
+			destType);
+		return irBuilder.CreateAnd(irBuilder.CreateXor(result, isPositiveOverflow), isNotNaN);
+	}
+
+	auto result = isSigned ? irBuilder.CreateFPToSI(operand, destType)
+						   : irBuilder.CreateFPToUI(operand, destType);
+
 	result = emitVectorSelect(
 		irBuilder.CreateFCmpOGE(operand, maxFloatBoundsVec),
 		irBuilder.CreateVectorSplat(numElements, emitLiteral(llvmContext, maxIntBounds)),
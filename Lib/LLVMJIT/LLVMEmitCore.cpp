@@ -67,14 +67,19 @@ void EmitFunctionContext::loop(ControlStructureImm imm)
 	auto parameterPHIs = createPHIs(loopBodyBlock, blockType.params());
 	auto endPHIs = createPHIs(endBlock, blockType.results());
 
-	// Branch to the loop body and switch the IR builder to emit there.
+	// Branch to the loop body and switch the IR builder to emit there. The loop body is unsealed
+	// until the end of the loop, since branches back to it may still be emitted.
 	irBuilder.CreateBr(loopBodyBlock);
 	irBuilder.SetInsertPoint(loopBodyBlock);
+	unsealedBlocks.addOrFail(loopBodyBlock);
 
 	// Pop the initial values of the loop's parameters from the stack.
 	for(Iptr elementIndex = Iptr(blockType.params().size()) - 1; elementIndex >= 0; --elementIndex)
 	{ parameterPHIs[elementIndex]->addIncoming(pop(), loopEntryBlock); }
 
+	// Check the epoch on each iteration of the loop, so an infinite loop can be interrupted.
+	emitEpochCheck();
+
 	// Push a control context that ends at the end block/phi.
 	pushControlStack(ControlContext::Type::loop, blockType.results(), endBlock, endPHIs);
 
@@ -95,8 +100,9 @@ void EmitFunctionContext::if_(ControlStructureImm imm)
 	auto endPHIs = createPHIs(endBlock, blockType.results());
 
 	// Pop the if condition from the operand stack.
-	auto condition = pop();
-	irBuilder.CreateCondBr(coerceI32ToBool(condition), thenBlock, elseBlock);
+	auto condition = coerceI32ToBool(pop());
+	emitBranchProfile(condition);
+	irBuilder.CreateCondBr(condition, thenBlock, elseBlock, getProfileBranchWeights(2));
 
 	// Pop the arguments from the operand stack.
 	ValueVector args;
@@ -168,6 +174,12 @@ void EmitFunctionContext::end(NoImm)
 	{
 		endCatch();
 	}
+	else if(currentContext.type == ControlContext::Type::loop)
+	{
+		// All the branches back to the loop body have been emitted, so seal it.
+		wavmAssert(currentContext.outerBranchTargetStackSize < branchTargetStack.size());
+		sealBlock(branchTargetStack[currentContext.outerBranchTargetStackSize].block);
+	}
 
 	// Switch the IR emitter to the end block.
 	currentContext.endBlock->moveAfter(irBuilder.GetInsertBlock());
@@ -221,7 +233,9 @@ void EmitFunctionContext::br_if(BranchImm imm)
 	auto falseBlock = llvm::BasicBlock::Create(llvmContext, "br_ifElse", function);
 
 	// Emit a conditional branch to either the falseBlock or the target block.
-	irBuilder.CreateCondBr(coerceI32ToBool(condition), target.block, falseBlock);
+	llvm::Value* booleanCondition = coerceI32ToBool(condition);
+	emitBranchProfile(booleanCondition);
+	irBuilder.CreateCondBr(booleanCondition, target.block, falseBlock, getProfileBranchWeights(2));
 
 	// Resume emitting instructions in the falseBlock.
 	irBuilder.SetInsertPoint(falseBlock);
@@ -270,8 +284,11 @@ void EmitFunctionContext::br_table(BranchTableImm imm)
 	// Create a LLVM switch instruction.
 	wavmAssert(imm.branchTableIndex < functionDef.branchTables.size());
 	const std::vector<Uptr>& targetDepths = functionDef.branchTables[imm.branchTableIndex];
-	auto llvmSwitch
-		= irBuilder.CreateSwitch(index, defaultTarget.block, (unsigned int)targetDepths.size());
+	emitBranchTableProfile(index, targetDepths.size());
+	auto llvmSwitch = irBuilder.CreateSwitch(index,
+											 defaultTarget.block,
+											 (unsigned int)targetDepths.size(),
+											 getProfileBranchWeights(targetDepths.size() + 1, true));
 
 	for(Uptr targetIndex = 0; targetIndex < targetDepths.size(); ++targetIndex)
 	{
@@ -327,7 +344,7 @@ void EmitFunctionContext::call(FunctionImm imm)
 	wavmAssert(imm.functionIndex < moduleContext.functions.size());
 	wavmAssert(imm.functionIndex < irModule.functions.size());
 
-	llvm::Value* callee = moduleContext.functions[imm.functionIndex];
+	llvm::Value* callee = moduleContext.getFunction(imm.functionIndex);
 	FunctionType calleeType = irModule.types[irModule.functions.getType(imm.functionIndex).index];
 
 	// Pop the call arguments from the operand stack.
@@ -367,22 +384,59 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 	for(Uptr argIndex = 0; argIndex < numArguments; ++argIndex)
 	{ llvmArgs[argIndex] = coerceToCanonicalType(llvmArgs[argIndex]); }
 
-	// Zero extend the function index to the pointer size.
-	auto functionIndexZExt = zext(tableElementIndex, llvmContext.iptrType);
-
-	auto tableBasePointer = loadFromUntypedPointer(
-		irBuilder.CreateInBoundsGEP(getCompartmentAddress(),
-									{moduleContext.tableOffsets[imm.tableIndex]}),
-		llvmContext.iptrType->getPointerTo());
-
 	// Load the anyfunc referenced by the table.
-	auto elementPointer = irBuilder.CreateInBoundsGEP(tableBasePointer, {functionIndexZExt});
+	auto elementPointer = emitTableElementPointer(imm.tableIndex, tableElementIndex);
 	llvm::LoadInst* biasedValueLoad = irBuilder.CreateLoad(elementPointer);
 	biasedValueLoad->setAtomic(llvm::AtomicOrdering::Acquire);
 	biasedValueLoad->setAlignment(sizeof(Uptr));
 	auto anyfuncPointer = irBuilder.CreateIntToPtr(
 		irBuilder.CreateAdd(biasedValueLoad, moduleContext.tableReferenceBias),
 		llvmContext.i8PtrType);
+	auto llvmArgArray = llvm::ArrayRef<llvm::Value*>(llvmArgs, numArguments);
+	emitIndirectCalleeProfile(irBuilder.CreatePtrToInt(anyfuncPointer, llvmContext.iptrType));
+
+	// If the call is speculated to call a function with the right type, check whether the table
+	// element is that function, and if so call it directly. The function's AnyFunc immediately
+	// precedes its code, so the comparison doesn't need to load anything from the AnyFunc, and
+	// the type check is implied by the comparison.
+	llvm::Function* speculatedCallee = nullptr;
+	auto speculatedCalleeIt
+		= moduleContext.speculatedIndirectCallees.find({functionDefIndex, opIndex});
+	if(speculatedCalleeIt != moduleContext.speculatedIndirectCallees.end())
+	{
+		const Uptr calleeIndex = speculatedCalleeIt->second;
+		if(calleeIndex < irModule.functions.size()
+		   && irModule.types[irModule.functions.getType(calleeIndex).index] == calleeType)
+		{ speculatedCallee = moduleContext.getFunction(calleeIndex); }
+	}
+
+	llvm::BasicBlock* speculatedCallEndBlock = nullptr;
+	ValueVector speculatedResults;
+	if(speculatedCallee)
+	{
+		auto speculatedCallBlock = llvm::BasicBlock::Create(llvmContext, "speculatedCall", function);
+		auto indirectCallBlock = llvm::BasicBlock::Create(llvmContext, "indirectCall", function);
+		llvm::Constant* speculatedAnyFunc = llvm::ConstantExpr::getSub(
+			llvm::ConstantExpr::getPtrToInt(speculatedCallee, llvmContext.iptrType),
+			emitLiteral(llvmContext, Uptr(offsetof(AnyFunc, code))));
+		irBuilder.CreateCondBr(
+			irBuilder.CreateICmpEQ(irBuilder.CreatePtrToInt(anyfuncPointer, llvmContext.iptrType),
+								   speculatedAnyFunc),
+			speculatedCallBlock,
+			indirectCallBlock,
+			moduleContext.likelyTrueBranchWeights);
+
+		irBuilder.SetInsertPoint(speculatedCallBlock);
+		speculatedResults = emitCallOrInvoke(speculatedCallee,
+											 llvmArgArray,
+											 calleeType,
+											 CallingConvention::wasm,
+											 getInnermostUnwindToBlock());
+		speculatedCallEndBlock = irBuilder.GetInsertBlock();
+
+		irBuilder.SetInsertPoint(indirectCallBlock);
+	}
+
 	auto elementTypeId = loadFromUntypedPointer(
 		irBuilder.CreateInBoundsGEP(
 			anyfuncPointer,
@@ -406,11 +460,31 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 									emitLiteral(llvmContext, Uptr(offsetof(AnyFunc, code)))),
 		asLLVMType(llvmContext, calleeType, CallingConvention::wasm)->getPointerTo());
 	ValueVector results = emitCallOrInvoke(functionPointer,
-										   llvm::ArrayRef<llvm::Value*>(llvmArgs, numArguments),
+										   llvmArgArray,
 										   calleeType,
 										   CallingConvention::wasm,
 										   getInnermostUnwindToBlock());
 
+	// If the call was speculated, merge the results of the direct and indirect calls.
+	if(speculatedCallee)
+	{
+		llvm::BasicBlock* indirectCallEndBlock = irBuilder.GetInsertBlock();
+		auto endBlock = llvm::BasicBlock::Create(llvmContext, "callIndirectEnd", function);
+		irBuilder.CreateBr(endBlock);
+		irBuilder.SetInsertPoint(speculatedCallEndBlock);
+		irBuilder.CreateBr(endBlock);
+
+		irBuilder.SetInsertPoint(endBlock);
+		wavmAssert(results.size() == speculatedResults.size());
+		for(Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+		{
+			llvm::PHINode* phi = irBuilder.CreatePHI(results[resultIndex]->getType(), 2);
+			phi->addIncoming(speculatedResults[resultIndex], speculatedCallEndBlock);
+			phi->addIncoming(results[resultIndex], indirectCallEndBlock);
+			results[resultIndex] = phi;
+		}
+	}
+
 	// Push the results on the operand stack.
 	for(llvm::Value* result : results) { push(result); }
 }
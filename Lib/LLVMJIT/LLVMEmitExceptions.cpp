@@ -39,6 +39,7 @@ void EmitFunctionContext::endTry()
 {
 	wavmAssert(tryStack.size());
 	tryStack.pop_back();
+	emitUncaughtLocalThrows(catchStack.back());
 	catchStack.pop_back();
 }
 
@@ -55,10 +56,10 @@ void EmitFunctionContext::endCatch()
 			"throwException",
 			FunctionType(TypeTuple{},
 						 TypeTuple{inferValueType<Iptr>(), inferValueType<Iptr>(), ValueType::i32}),
-			{loadFromUntypedPointer(catchContext.exceptionPointer, llvmContext.iptrType),
+			{loadFromUntypedPointer(catchContext.landingPadExceptionPointer, llvmContext.iptrType),
 			 irBuilder.CreatePtrToInt(
 				 irBuilder.CreateInBoundsGEP(
-					 catchContext.exceptionPointer,
+					 catchContext.landingPadExceptionPointer,
 					 {emitLiteral(llvmContext, I32(offsetof(ExceptionData, arguments)))}),
 				 llvmContext.iptrType),
 			 emitLiteral(llvmContext, I32(0))});
@@ -66,6 +67,7 @@ void EmitFunctionContext::endCatch()
 		irBuilder.CreateUnreachable();
 	}
 
+	emitUncaughtLocalThrows(catchStack.back());
 	catchStack.pop_back();
 }
 
@@ -90,8 +92,9 @@ void EmitFunctionContext::try_(ControlStructureImm imm)
 		auto catchSwitchInst
 			= irBuilder.CreateCatchSwitch(llvm::ConstantTokenNone::get(llvmContext), nullptr, 1);
 		irBuilder.SetInsertPoint(originalInsertBlock);
-		tryStack.push_back(TryContext{catchSwitchBlock});
-		catchStack.push_back(CatchContext{catchSwitchInst, nullptr, nullptr, nullptr, nullptr});
+		tryStack.push_back(TryContext{catchSwitchBlock, catchStack.size()});
+		catchStack.push_back(
+			CatchContext{catchSwitchInst, nullptr, nullptr, nullptr, nullptr, nullptr});
 
 		// Create an end try+phi for the try result.
 		auto endBlock = llvm::BasicBlock::Create(llvmContext, "tryEnd", function);
@@ -152,9 +155,13 @@ void EmitFunctionContext::try_(ControlStructureImm imm)
 			llvmContext.i8PtrType);
 
 		irBuilder.SetInsertPoint(originalInsertBlock);
-		tryStack.push_back(TryContext{landingPadBlock});
-		catchStack.push_back(CatchContext{
-			nullptr, landingPadInst, landingPadBlock, exceptionTypeInstance, exceptionPointer});
+		tryStack.push_back(TryContext{landingPadBlock, catchStack.size()});
+		catchStack.push_back(CatchContext{nullptr,
+										  landingPadInst,
+										  landingPadBlock,
+										  exceptionTypeInstance,
+										  exceptionPointer,
+										  nullptr});
 
 		// Add the platform exception type to the landing pad's type filter.
 		auto platformExceptionTypeInfo
@@ -328,19 +335,6 @@ void EmitFunctionContext::catch_(ExceptionTypeImm imm)
 		irBuilder.SetInsertPoint(catchBlock);
 
 		catchContext.exceptionPointer = irBuilder.CreateLoad(exceptionDataAlloca);
-		for(Uptr argumentIndex = 0; argumentIndex < catchType.params.size(); ++argumentIndex)
-		{
-			const ValueType parameters = catchType.params[argumentIndex];
-			auto argument = loadFromUntypedPointer(
-				irBuilder.CreateInBoundsGEP(
-					catchContext.exceptionPointer,
-					{emitLiteral(llvmContext,
-								 offsetof(ExceptionData, arguments)
-									 + (catchType.params.size() - argumentIndex - 1)
-										   * sizeof(ExceptionData::arguments[0]))}),
-				asLLVMType(llvmContext, parameters));
-			push(argument);
-		}
 	}
 	else
 	{
@@ -353,20 +347,25 @@ void EmitFunctionContext::catch_(ExceptionTypeImm imm)
 		irBuilder.CreateCondBr(isExceptionType, catchBlock, unhandledBlock);
 		catchContext.nextHandlerBlock = unhandledBlock;
 		irBuilder.SetInsertPoint(catchBlock);
+		catchContext.exceptionPointer = catchContext.landingPadExceptionPointer;
+	}
 
-		for(Iptr argumentIndex = catchType.params.size() - 1; argumentIndex >= 0; --argumentIndex)
-		{
-			const ValueType parameters = catchType.params[argumentIndex];
-			const Uptr argumentOffset = offsetof(ExceptionData, arguments)
-										+ sizeof(ExceptionData::arguments[0]) * argumentIndex;
-			auto argument = loadFromUntypedPointer(
-				irBuilder.CreateInBoundsGEP(catchContext.exceptionPointer,
-											{emitLiteral(llvmContext, argumentOffset)}),
-				asLLVMType(llvmContext, parameters));
-			push(argument);
-		}
+	// Load the exception's arguments from its ExceptionData.
+	std::vector<llvm::Value*> arguments;
+	for(Uptr argumentIndex = 0; argumentIndex < catchType.params.size(); ++argumentIndex)
+	{
+		const Uptr argumentOffset = offsetof(ExceptionData, arguments)
+									+ sizeof(ExceptionData::arguments[0]) * argumentIndex;
+		arguments.push_back(loadFromUntypedPointer(
+			irBuilder.CreateInBoundsGEP(catchContext.exceptionPointer,
+										{emitLiteral(llvmContext, argumentOffset)}),
+			asLLVMType(llvmContext, catchType.params[argumentIndex])));
 	}
 
+	// Merge the local throws caught by this clause into it, and push the arguments.
+	mergeLocalThrowsIntoCatch(catchContext, false, imm.exceptionTypeIndex, arguments);
+	for(llvm::Value* argument : arguments) { push(argument); }
+
 	// Change the top of the control stack to a catch clause.
 	controlContext.type = ControlContext::Type::catch_;
 	controlContext.isReachable = true;
@@ -416,7 +415,7 @@ void EmitFunctionContext::catch_all(NoImm)
 		auto isUserExceptionType = irBuilder.CreateICmpNE(
 			loadFromUntypedPointer(
 				irBuilder.CreateInBoundsGEP(
-					catchContext.exceptionPointer,
+					catchContext.landingPadExceptionPointer,
 					{emitLiteral(llvmContext, Uptr(offsetof(ExceptionData, isUserException)))}),
 				llvmContext.i8Type),
 			llvm::ConstantInt::get(llvmContext.i8Type, llvm::APInt(8, 0, false)));
@@ -426,45 +425,187 @@ void EmitFunctionContext::catch_all(NoImm)
 		irBuilder.CreateCondBr(isUserExceptionType, catchBlock, unhandledBlock);
 		catchContext.nextHandlerBlock = unhandledBlock;
 		irBuilder.SetInsertPoint(catchBlock);
+		catchContext.exceptionPointer = catchContext.landingPadExceptionPointer;
 	}
 
+	// Merge all the local throws that weren't caught by a previous clause into this clause.
+	std::vector<llvm::Value*> noArguments;
+	mergeLocalThrowsIntoCatch(catchContext, true, 0, noArguments);
+
 	// Change the top of the control stack to a catch clause.
 	controlContext.type = ControlContext::Type::catch_;
 	controlContext.isReachable = true;
 }
 
+void EmitFunctionContext::emitThrow(Uptr exceptionTypeIndex,
+									llvm::Value* exceptionPointer,
+									std::vector<llvm::Value*>&& arguments)
+{
+	if(tryStack.size())
+	{
+		// Branch to a new block that is routed to the catch clause that handles the exception once
+		// the try's catch clauses have been emitted.
+		auto localThrowBlock = llvm::BasicBlock::Create(llvmContext, "localThrow", function);
+		irBuilder.CreateBr(localThrowBlock);
+
+		CatchContext& catchContext = catchStack[tryStack.back().catchStackIndex];
+		catchContext.pendingLocalThrows.push_back(
+			LocalThrow{exceptionTypeIndex, localThrowBlock, exceptionPointer, std::move(arguments)});
+	}
+	else
+	{
+		llvm::Value* exceptionTypeInstance = irBuilder.CreatePtrToInt(
+			moduleContext.exceptionTypeInstances[exceptionTypeIndex], llvmContext.iptrType);
+		llvm::Value* argsPointerAsInt = irBuilder.CreatePtrToInt(
+			irBuilder.CreateInBoundsGEP(
+				exceptionPointer,
+				{emitLiteral(llvmContext, Uptr(offsetof(ExceptionData, arguments)))}),
+			llvmContext.iptrType);
+
+		emitRuntimeIntrinsic(
+			"throwException",
+			FunctionType(TypeTuple{},
+						 TypeTuple{inferValueType<Iptr>(), inferValueType<Iptr>(), ValueType::i32}),
+			{exceptionTypeInstance, argsPointerAsInt, emitLiteral(llvmContext, I32(1))});
+
+		irBuilder.CreateUnreachable();
+	}
+}
+
+void EmitFunctionContext::mergeLocalThrowsIntoCatch(CatchContext& catchContext,
+													 bool isCatchAll,
+													 Uptr catchExceptionTypeIndex,
+													 std::vector<llvm::Value*>& inOutArguments)
+{
+	if(!catchContext.pendingLocalThrows.size()) { return; }
+
+	// Create an entry block for the catch clause, with PHIs that merge the exception pointer and
+	// arguments of the platform exception with those of the local throws.
+	llvm::BasicBlock* platformCatchBlock = irBuilder.GetInsertBlock();
+	auto catchEntryBlock = llvm::BasicBlock::Create(llvmContext, "catchEntry", function);
+	irBuilder.CreateBr(catchEntryBlock);
+	irBuilder.SetInsertPoint(catchEntryBlock);
+
+	llvm::PHINode* exceptionPointerPHI = irBuilder.CreatePHI(llvmContext.i8PtrType, 2);
+	exceptionPointerPHI->addIncoming(catchContext.exceptionPointer, platformCatchBlock);
+	catchContext.exceptionPointer = exceptionPointerPHI;
+
+	std::vector<llvm::PHINode*> argumentPHIs;
+	for(llvm::Value*& argument : inOutArguments)
+	{
+		llvm::PHINode* argumentPHI = irBuilder.CreatePHI(argument->getType(), 2);
+		argumentPHI->addIncoming(argument, platformCatchBlock);
+		argumentPHIs.push_back(argumentPHI);
+		argument = argumentPHI;
+	}
+
+	const Uptr numImportedExceptionTypes = irModule.exceptionTypes.imports.size();
+	std::vector<LocalThrow> uncaughtLocalThrows;
+	for(LocalThrow& localThrow : catchContext.pendingLocalThrows)
+	{
+		// A catch clause for an exception type defined by the module only catches throws with the
+		// same exception type index. Imported exception types with the same parameters may be the
+		// same exception type instance, so they are compared when the exception is thrown.
+		llvm::Value* isCaught = nullptr;
+		if(!isCatchAll && localThrow.exceptionTypeIndex != catchExceptionTypeIndex)
+		{
+			if(localThrow.exceptionTypeIndex >= numImportedExceptionTypes
+			   || catchExceptionTypeIndex >= numImportedExceptionTypes
+			   || irModule.exceptionTypes.getType(localThrow.exceptionTypeIndex)
+					  != irModule.exceptionTypes.getType(catchExceptionTypeIndex))
+			{
+				uncaughtLocalThrows.push_back(std::move(localThrow));
+				continue;
+			}
+
+			irBuilder.SetInsertPoint(localThrow.block);
+			isCaught = irBuilder.CreateICmpEQ(
+				moduleContext.exceptionTypeInstances[localThrow.exceptionTypeIndex],
+				moduleContext.exceptionTypeInstances[catchExceptionTypeIndex]);
+		}
+
+		irBuilder.SetInsertPoint(localThrow.block);
+		exceptionPointerPHI->addIncoming(localThrow.exceptionPointer, localThrow.block);
+		for(Uptr argumentIndex = 0; argumentIndex < argumentPHIs.size(); ++argumentIndex)
+		{
+			argumentPHIs[argumentIndex]->addIncoming(
+				coerceToCanonicalType(localThrow.arguments[argumentIndex]), localThrow.block);
+		}
+
+		if(!isCaught) { irBuilder.CreateBr(catchEntryBlock); }
+		else
+		{
+			auto uncaughtBlock
+				= llvm::BasicBlock::Create(llvmContext, "localThrowUncaught", function);
+			irBuilder.CreateCondBr(isCaught, catchEntryBlock, uncaughtBlock);
+			uncaughtLocalThrows.push_back(LocalThrow{localThrow.exceptionTypeIndex,
+													 uncaughtBlock,
+													 localThrow.exceptionPointer,
+													 std::move(localThrow.arguments)});
+		}
+	}
+	catchContext.pendingLocalThrows = std::move(uncaughtLocalThrows);
+
+	irBuilder.SetInsertPoint(catchEntryBlock);
+}
+
+void EmitFunctionContext::emitUncaughtLocalThrows(CatchContext& catchContext)
+{
+	std::vector<LocalThrow> uncaughtLocalThrows = std::move(catchContext.pendingLocalThrows);
+	for(LocalThrow& localThrow : uncaughtLocalThrows)
+	{
+		irBuilder.SetInsertPoint(localThrow.block);
+		emitThrow(localThrow.exceptionTypeIndex,
+				  localThrow.exceptionPointer,
+				  std::move(localThrow.arguments));
+	}
+}
+
 void EmitFunctionContext::throw_(ExceptionTypeImm imm)
 {
 	const ExceptionType& exceptionType = irModule.exceptionTypes.getType(imm.exceptionTypeIndex);
-
 	const Uptr numArgs = exceptionType.params.size();
-	const Uptr numArgBytes = numArgs * sizeof(UntaggedValue);
-	auto argBaseAddress
-		= irBuilder.CreateAlloca(llvmContext.i8Type, emitLiteral(llvmContext, numArgBytes));
 
-	for(Uptr argIndex = 0; argIndex < exceptionType.params.size(); ++argIndex)
+	// Allocate the ExceptionData in the function's entry block, so a throw in a loop doesn't grow
+	// the stack.
+	llvm::IRBuilder<> entryIRBuilder(llvm::cast<llvm::Instruction>(contextPointerVariable));
+	llvm::AllocaInst* exceptionPointer = entryIRBuilder.CreateAlloca(
+		llvmContext.i8Type, emitLiteral(llvmContext, ExceptionData::calcNumBytes(numArgs)));
+	exceptionPointer->setAlignment(sizeof(UntaggedValue));
+
+	llvm::Constant* exceptionTypeInstance
+		= moduleContext.exceptionTypeInstances[imm.exceptionTypeIndex];
+	irBuilder.CreateStore(
+		exceptionTypeInstance,
+		irBuilder.CreatePointerCast(
+			irBuilder.CreateInBoundsGEP(
+				exceptionPointer,
+				{emitLiteral(llvmContext, Uptr(offsetof(ExceptionData, typeInstance)))}),
+			exceptionTypeInstance->getType()->getPointerTo()));
+	irBuilder.CreateStore(
+		llvm::ConstantInt::get(llvmContext.i8Type, llvm::APInt(8, 1, false)),
+		irBuilder.CreateInBoundsGEP(
+			exceptionPointer,
+			{emitLiteral(llvmContext, Uptr(offsetof(ExceptionData, isUserException)))}));
+
+	std::vector<llvm::Value*> arguments(numArgs);
+	for(Uptr argIndex = 0; argIndex < numArgs; ++argIndex)
 	{
-		auto elementValue = pop();
+		const Uptr paramIndex = numArgs - argIndex - 1;
+		llvm::Value* argument = pop();
+		arguments[paramIndex] = argument;
 		irBuilder.CreateStore(
-			elementValue,
+			argument,
 			irBuilder.CreatePointerCast(
 				irBuilder.CreateInBoundsGEP(
-					argBaseAddress,
-					{emitLiteral(llvmContext, (numArgs - argIndex - 1) * sizeof(UntaggedValue))}),
-				elementValue->getType()->getPointerTo()));
+					exceptionPointer,
+					{emitLiteral(llvmContext,
+								 offsetof(ExceptionData, arguments)
+									 + paramIndex * sizeof(ExceptionData::arguments[0]))}),
+				argument->getType()->getPointerTo()));
 	}
 
-	llvm::Value* exceptionTypeInstance = irBuilder.CreatePtrToInt(
-		moduleContext.exceptionTypeInstances[imm.exceptionTypeIndex], llvmContext.iptrType);
-	llvm::Value* argsPointerAsInt = irBuilder.CreatePtrToInt(argBaseAddress, llvmContext.iptrType);
-
-	emitRuntimeIntrinsic(
-		"throwException",
-		FunctionType(TypeTuple{},
-					 TypeTuple{inferValueType<Iptr>(), inferValueType<Iptr>(), ValueType::i32}),
-		{exceptionTypeInstance, argsPointerAsInt, emitLiteral(llvmContext, I32(1))});
-
-	irBuilder.CreateUnreachable();
+	emitThrow(imm.exceptionTypeIndex, exceptionPointer, std::move(arguments));
 	enterUnreachable();
 }
 void EmitFunctionContext::rethrow(RethrowImm imm)
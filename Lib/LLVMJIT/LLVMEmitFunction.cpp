@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <algorithm>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -31,6 +32,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
@@ -207,6 +209,194 @@ void EmitFunctionContext::emitConditionalTrapIntrinsic(
 	irBuilder.SetInsertPoint(endBlock);
 }
 
+void EmitFunctionContext::emitEpochCheck()
+{
+	if(!moduleContext.emitEpochChecks) { return; }
+
+	// Both loads are volatile, so they aren't hoisted out of loops: the epoch is incremented by
+	// other threads, and the deadline may be changed by the host while the code is running.
+	llvm::LoadInst* epoch = irBuilder.CreateLoad(irBuilder.CreatePointerCast(
+		moduleContext.epochAddress, llvmContext.i64Type->getPointerTo()));
+	epoch->setVolatile(true);
+	llvm::LoadInst* deadline = irBuilder.CreateLoad(irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(
+			irBuilder.CreateLoad(contextPointerVariable),
+			{emitLiteral(llvmContext, Uptr(offsetof(ContextRuntimeData, epochDeadline)))}),
+		llvmContext.i64Type->getPointerTo()));
+	deadline->setVolatile(true);
+	deadline->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.runtimeDataTBAATag);
+
+	// Unlike the trap intrinsics, the epochDeadlineReached intrinsic returns if the context yields
+	// the suspendable invoke running the code instead of throwing (see setContextEpochYieldSlice).
+	auto reachedBlock = llvm::BasicBlock::Create(llvmContext, "epochDeadlineReached", function);
+	auto continueBlock = llvm::BasicBlock::Create(llvmContext, "epochDeadlineNotReached", function);
+	irBuilder.CreateCondBr(irBuilder.CreateICmpUGE(epoch, deadline),
+						   reachedBlock,
+						   continueBlock,
+						   moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(reachedBlock);
+	emitRuntimeIntrinsic("epochDeadlineReached", FunctionType(), {});
+	irBuilder.CreateBr(continueBlock);
+
+	irBuilder.SetInsertPoint(continueBlock);
+}
+
+void EmitFunctionContext::emitStackLimitCheck()
+{
+	if(!moduleContext.emitStackLimitChecks) { return; }
+
+	// The limit is set by the runtime when the context is invoked (see setContextStackBudget), so
+	// it doesn't change while the function runs, and a context with no budget has a limit of zero.
+	llvm::Value* stackPointer = irBuilder.CreatePtrToInt(
+		callLLVMIntrinsic({}, llvm::Intrinsic::stacksave, {}), llvmContext.iptrType);
+	llvm::Value* stackLimit = loadFromUntypedPointer(
+		irBuilder.CreateInBoundsGEP(
+			irBuilder.CreateLoad(contextPointerVariable),
+			{emitLiteral(llvmContext, Uptr(offsetof(ContextRuntimeData, stackLimit)))}),
+		llvmContext.iptrType,
+		llvmContext.runtimeDataTBAATag);
+
+	emitConditionalTrapIntrinsic(irBuilder.CreateICmpULT(stackPointer, stackLimit),
+								 "stackOverflowTrap",
+								 FunctionType(),
+								 {});
+}
+
+llvm::Instruction* EmitFunctionContext::emitFuelCharge()
+{
+	llvm::Value* fuelPointer = irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(
+			irBuilder.CreateLoad(contextPointerVariable),
+			{emitLiteral(llvmContext, Uptr(offsetof(ContextRuntimeData, fuel)))}),
+		llvmContext.i64Type->getPointerTo());
+	llvm::LoadInst* oldFuel = irBuilder.CreateLoad(fuelPointer);
+	oldFuel->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.runtimeDataTBAATag);
+	llvm::Value* fuel = irBuilder.CreateSub(oldFuel, emitLiteral(llvmContext, U64(0)));
+	irBuilder.CreateStore(fuel, fuelPointer)
+		->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.runtimeDataTBAATag);
+
+	// Unlike the trap intrinsics, the fuelExhausted intrinsic returns if the host refills the fuel.
+	auto exhaustedBlock = llvm::BasicBlock::Create(llvmContext, "fuelExhausted", function);
+	auto continueBlock = llvm::BasicBlock::Create(llvmContext, "fuelRemaining", function);
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpSLT(fuel, llvmContext.typedZeroConstants[(Uptr)ValueType::i64]),
+		exhaustedBlock,
+		continueBlock,
+		moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(exhaustedBlock);
+	emitRuntimeIntrinsic("fuelExhausted", FunctionType(), {});
+	irBuilder.CreateBr(continueBlock);
+
+	irBuilder.SetInsertPoint(continueBlock);
+	return llvm::cast<llvm::Instruction>(fuel);
+}
+
+void EmitFunctionContext::setFuelCharge(llvm::Instruction* charge, Uptr cost)
+{
+	charge->setOperand(1, emitLiteral(llvmContext, U64(cost)));
+}
+
+void EmitFunctionContext::emitProfileCounterIncrement(Uptr counterIndex, llvm::Value* increment)
+{
+	llvm::Value* counterPointer = irBuilder.CreateInBoundsGEP(
+		irBuilder.CreatePointerCast(moduleContext.profileCounters,
+									llvmContext.i64Type->getPointerTo()),
+		{emitLiteral(llvmContext, counterIndex)});
+	irBuilder.CreateStore(irBuilder.CreateAdd(irBuilder.CreateLoad(counterPointer), increment),
+						  counterPointer);
+}
+
+void EmitFunctionContext::emitBranchProfile(llvm::Value* booleanCondition)
+{
+	if(!moduleContext.profileCounters) { return; }
+
+	// Count both outcomes without branching on the condition.
+	llvm::Value* isTrue = irBuilder.CreateZExt(booleanCondition, llvmContext.i64Type);
+	emitProfileCounterIncrement(profileCounterIndex, isTrue);
+	emitProfileCounterIncrement(profileCounterIndex + 1,
+								irBuilder.CreateXor(isTrue, emitLiteral(llvmContext, U64(1))));
+}
+
+void EmitFunctionContext::emitBranchTableProfile(llvm::Value* index, Uptr numTargets)
+{
+	if(!moduleContext.profileCounters) { return; }
+
+	// Indices past the end of the table take the default target, which is counted by the counter
+	// after the table's targets.
+	llvm::Value* targetIndex = irBuilder.CreateSelect(
+		irBuilder.CreateICmpULT(index, emitLiteral(llvmContext, U32(numTargets))),
+		irBuilder.CreateZExt(index, llvmContext.iptrType),
+		emitLiteral(llvmContext, numTargets));
+	llvm::Value* counterPointer = irBuilder.CreateInBoundsGEP(
+		irBuilder.CreatePointerCast(moduleContext.profileCounters,
+									llvmContext.i64Type->getPointerTo()),
+		{irBuilder.CreateAdd(targetIndex, emitLiteral(llvmContext, profileCounterIndex))});
+	irBuilder.CreateStore(irBuilder.CreateAdd(irBuilder.CreateLoad(counterPointer),
+											  emitLiteral(llvmContext, U64(1))),
+						  counterPointer);
+}
+
+void EmitFunctionContext::emitIndirectCalleeProfile(llvm::Value* anyFuncAddress)
+{
+	if(!moduleContext.profileCounters) { return; }
+
+	// Find the majority callee with the Boyer-Moore majority vote algorithm: the first counter is
+	// the candidate callee, and the second is incremented when the candidate is called, and
+	// decremented when another function is called. When the count is zero, the next callee
+	// replaces the candidate. If one function is called by a majority of the calls, it is the
+	// candidate at the end, and otherwise the candidate is likely to be a frequent callee.
+	llvm::Value* counters = irBuilder.CreatePointerCast(moduleContext.profileCounters,
+														llvmContext.i64Type->getPointerTo());
+	llvm::Value* candidatePointer = irBuilder.CreateInBoundsGEP(
+		counters, {emitLiteral(llvmContext, profileCounterIndex)});
+	llvm::Value* countPointer = irBuilder.CreateInBoundsGEP(
+		counters, {emitLiteral(llvmContext, profileCounterIndex + 1)});
+	llvm::Value* candidate = irBuilder.CreateLoad(candidatePointer);
+	llvm::Value* count = irBuilder.CreateLoad(countPointer);
+	llvm::Value* callee = irBuilder.CreateZExtOrTrunc(anyFuncAddress, llvmContext.i64Type);
+
+	llvm::Value* isCandidate = irBuilder.CreateICmpEQ(candidate, callee);
+	llvm::Value* isCountZero
+		= irBuilder.CreateICmpEQ(count, llvmContext.typedZeroConstants[(Uptr)ValueType::i64]);
+	irBuilder.CreateStore(irBuilder.CreateSelect(isCountZero, callee, candidate),
+						  candidatePointer);
+	irBuilder.CreateStore(
+		irBuilder.CreateSelect(
+			isCandidate,
+			irBuilder.CreateAdd(count, emitLiteral(llvmContext, U64(1))),
+			irBuilder.CreateSelect(isCountZero,
+								   emitLiteral(llvmContext, U64(1)),
+								   irBuilder.CreateSub(count, emitLiteral(llvmContext, U64(1))))),
+		countPointer);
+}
+
+llvm::MDNode* EmitFunctionContext::getProfileBranchWeights(Uptr numBranches, bool isBranchTable)
+{
+	if(!moduleContext.profile) { return nullptr; }
+
+	auto branchCountsIt = moduleContext.profile->branchCounts.find({functionDefIndex, opIndex});
+	if(branchCountsIt == moduleContext.profile->branchCounts.end()) { return nullptr; }
+	const std::vector<U64>& branchCounts = branchCountsIt->second;
+	if(branchCounts.size() != numBranches) { return nullptr; }
+
+	// Scale the counts down to fit in the 32-bit branch weights.
+	U64 maxBranchCount = 0;
+	for(U64 branchCount : branchCounts) { maxBranchCount = std::max(maxBranchCount, branchCount); }
+	if(!maxBranchCount) { return nullptr; }
+	const U64 scale = maxBranchCount / UINT32_MAX + 1;
+
+	// LLVM expects the weight of a switch's default destination before the weights of its cases,
+	// but the profile counts a br_table's default target after the table's targets.
+	llvm::SmallVector<uint32_t, 8> weights;
+	if(isBranchTable) { weights.push_back(uint32_t(branchCounts.back() / scale)); }
+	for(Uptr branchIndex = 0; branchIndex < branchCounts.size() - (isBranchTable ? 1 : 0);
+		++branchIndex)
+	{ weights.push_back(uint32_t(branchCounts[branchIndex] / scale)); }
+	return llvm::MDBuilder(llvmContext).createBranchWeights(weights);
+}
+
 //
 // Control structure operators
 //
@@ -272,6 +462,38 @@ void EmitFunctionContext::enterUnreachable()
 	controlStack.back().isReachable = false;
 }
 
+// A visitor that returns the opcode of the decoded operator.
+struct OpcodeVisitor
+{
+	typedef Opcode Result;
+
+#define VISIT_OP(opcode, name, nameString, Imm, ...)                                               \
+	Opcode name(Imm imm) { return Opcode::name; }
+	ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+	Opcode unknown(Opcode opcode) { return opcode; }
+};
+
+// Returns whether an operator may branch, or be branched to: fuel is charged for the operators
+// between them all at once.
+static bool endsFuelRegion(Opcode opcode)
+{
+	switch(opcode)
+	{
+#define VISIT_OP(opcode, name, ...) case Opcode::name:
+		ENUM_CONTROL_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+	case Opcode::unreachable:
+	case Opcode::br:
+	case Opcode::br_if:
+	case Opcode::br_table:
+	case Opcode::return_:
+	case Opcode::throw_:
+	case Opcode::rethrow: return true;
+	default: return false;
+	};
+}
+
 // A do-nothing visitor used to decode past unreachable operators (but supporting logging, and
 // passing the end operator through).
 struct UnreachableOpVisitor
@@ -324,6 +546,39 @@ private:
 	Uptr unreachableControlDepth;
 };
 
+// Forwards each decoded operator to another visitor, after recording its opcode and the number of
+// profile counters it uses. This lets the emitter get what it needs to know about an operator
+// without decoding it more than once.
+template<typename Visitor> struct OpInfoVisitor
+{
+	typedef void Result;
+
+	OpInfoVisitor(Visitor& inVisitor, ProfileCounterVisitor& inProfileCounterVisitor)
+	: visitor(inVisitor), profileCounterVisitor(inProfileCounterVisitor)
+	{
+	}
+
+#define VISIT_OP(opcode, name, nameString, Imm, ...)                                               \
+	void name(Imm imm)                                                                             \
+	{                                                                                              \
+		numProfileCounters = profileCounterVisitor.name(imm);                                      \
+		visitor.name(imm);                                                                         \
+	}
+	ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+	void unknown(Opcode opcode)
+	{
+		numProfileCounters = profileCounterVisitor.unknown(opcode);
+		visitor.unknown(opcode);
+	}
+
+	Uptr numProfileCounters = 0;
+
+private:
+	Visitor& visitor;
+	ProfileCounterVisitor& profileCounterVisitor;
+};
+
 void EmitFunctionContext::emit()
 {
 	// Create debug info for the function.
@@ -358,7 +613,7 @@ void EmitFunctionContext::emit()
 	auto llvmArgIt = function->arg_begin();
 	initContextVariables(&*llvmArgIt++);
 
-	// Create and initialize allocas for all the locals and parameters.
+	// Initialize the locals to the parameter values, and the non-parameter locals to zero.
 	for(Uptr localIndex = 0;
 		localIndex < functionType.params().size() + functionDef.nonParameterLocalTypes.size();
 		++localIndex)
@@ -367,19 +622,16 @@ void EmitFunctionContext::emit()
 			= localIndex < functionType.params().size()
 				  ? functionType.params()[localIndex]
 				  : functionDef.nonParameterLocalTypes[localIndex - functionType.params().size()];
-		auto localPointer = irBuilder.CreateAlloca(asLLVMType(llvmContext, localType), nullptr, "");
-		localPointers.push_back(localPointer);
+		localTypes.push_back(asLLVMType(llvmContext, localType));
 
 		if(localIndex < functionType.params().size())
 		{
-			// Copy the parameter value into the local that stores it.
-			irBuilder.CreateStore(&*llvmArgIt, localPointer);
+			setLocal(localIndex, &*llvmArgIt);
 			++llvmArgIt;
 		}
 		else
 		{
-			// Initialize non-parameter locals to zero.
-			irBuilder.CreateStore(llvmContext.typedZeroConstants[(Uptr)localType], localPointer);
+			setLocal(localIndex, llvmContext.typedZeroConstants[(Uptr)localType]);
 		}
 	}
 
@@ -392,25 +644,81 @@ void EmitFunctionContext::emit()
 								 emitLiteral(llvmContext, Uptr(offsetof(AnyFunc, code))))});
 	}
 
-	// Decode the WebAssembly opcodes and emit LLVM IR for them.
+	emitStackLimitCheck();
+	emitEpochCheck();
+
+	// Count the calls to the function, and start the operators' profile counters after the entry
+	// and cycle counters.
+	llvm::Value* entryCycleCount = nullptr;
+	if(moduleContext.profileCounters)
+	{
+		profileCounterIndex = moduleContext.profileCounterBaseIndices[functionDefIndex];
+		emitProfileCounterIncrement(profileCounterIndex, emitLiteral(llvmContext, U64(1)));
+		if(moduleContext.emitProfileCycles)
+		{ entryCycleCount = callLLVMIntrinsic({}, llvm::Intrinsic::readcyclecounter, {}); }
+		profileCounterIndex += 2;
+	}
+
+	// Decode the WebAssembly opcodes and emit LLVM IR for them. Each operator is decoded once: the
+	// fuel charged when entering a fuel region is patched with the number of operators in the region
+	// once its end is reached, instead of decoding ahead to count them.
 	OperatorDecoderStream decoder(functionDef.code);
+	ProfileCounterVisitor profileCounterVisitor(functionDef);
+	OpInfoVisitor<EmitFunctionContext> reachableOpVisitor(*this, profileCounterVisitor);
 	UnreachableOpVisitor unreachableOpVisitor(*this);
+	OpInfoVisitor<UnreachableOpVisitor> unreachableOpInfoVisitor(unreachableOpVisitor,
+																 profileCounterVisitor);
 	OperatorPrinter operatorPrinter(irModule, functionDef);
-	Uptr opIndex = 0;
-	while(decoder && controlStack.size())
+	llvm::Instruction* fuelRegionCharge = nullptr;
+	Uptr fuelRegionNumOps = 0;
+	for(opIndex = 0; decoder && controlStack.size(); ++opIndex)
 	{
 		irBuilder.SetCurrentDebugLocation(
-			llvm::DILocation::get(llvmContext, (unsigned int)opIndex++, 0, diFunction));
+			llvm::DILocation::get(llvmContext, (unsigned int)opIndex, 0, diFunction));
 		if(ENABLE_LOGGING) { logOperator(decoder.decodeOpWithoutConsume(operatorPrinter)); }
 
-		if(controlStack.back().isReachable) { decoder.decodeOp(*this); }
+		// Unreachable operators are also assigned profile counters, so each operator's counters
+		// don't depend on which operators are reachable.
+		if(controlStack.back().isReachable)
+		{
+			// Charge fuel for each fuel region when it is entered. Only the operators that end a
+			// fuel region can make the following code unreachable, so the fuel region's operators
+			// are all reachable.
+			if(moduleContext.emitFuelMetering && !fuelRegionCharge)
+			{
+				fuelRegionCharge = emitFuelCharge();
+				fuelRegionNumOps = 0;
+			}
+
+			decoder.decodeOp(reachableOpVisitor);
+			if(fuelRegionCharge)
+			{
+				++fuelRegionNumOps;
+				if(endsFuelRegion(profileCounterVisitor.opcode))
+				{
+					setFuelCharge(fuelRegionCharge, fuelRegionNumOps);
+					fuelRegionCharge = nullptr;
+				}
+			}
+			profileCounterIndex += reachableOpVisitor.numProfileCounters;
+		}
 		else
 		{
-			decoder.decodeOp(unreachableOpVisitor);
+			decoder.decodeOp(unreachableOpInfoVisitor);
+			profileCounterIndex += unreachableOpInfoVisitor.numProfileCounters;
 		}
-	};
+	}
+	if(fuelRegionCharge) { setFuelCharge(fuelRegionCharge, fuelRegionNumOps); }
 	wavmAssert(irBuilder.GetInsertBlock() == returnBlock);
 
+	// Add the cycles spent in this call of the function to its cycle count.
+	if(entryCycleCount)
+	{
+		llvm::Value* exitCycleCount = callLLVMIntrinsic({}, llvm::Intrinsic::readcyclecounter, {});
+		emitProfileCounterIncrement(moduleContext.profileCounterBaseIndices[functionDefIndex] + 1,
+									irBuilder.CreateSub(exitCycleCount, entryCycleCount));
+	}
+
 	if(EMIT_ENTER_EXIT_HOOKS)
 	{
 		emitRuntimeIntrinsic("debugExitFunction",
@@ -423,6 +731,10 @@ void EmitFunctionContext::emit()
 	// Emit the function return.
 	emitReturn(functionType.results(), stack);
 
+	// Erase the trivial PHIs for locals, which were already replaced by the value they joined.
+	wavmAssert(!unsealedBlocks.size());
+	for(const auto& pair : trivialLocalPHIs) { pair.key->eraseFromParent(); }
+
 	// If a local escape block was created, add a localescape intrinsic to it with the accumulated
 	// local escape allocas, and insert it before the function's entry block.
 	if(localEscapeBlock)
@@ -5,6 +5,8 @@
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/ScratchArena.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/Intrinsics.h"
@@ -17,14 +19,59 @@ namespace WAVM { namespace LLVMJIT {
 
 		struct EmitModuleContext& moduleContext;
 		const IR::Module& irModule;
+		const Uptr functionDefIndex;
 		const IR::FunctionDef& functionDef;
 		IR::FunctionType functionType;
 		llvm::Function* function;
 
-		std::vector<llvm::Value*> localPointers;
+		// The SSA values of the function's locals are built while emitting the function, rather
+		// than storing the locals to allocas for mem2reg to promote: each basic block maps the
+		// locals it assigns to their value at the end of the block, and reading a local that the
+		// insertion block doesn't assign looks it up in the block's predecessors, joining the
+		// values with a PHI if there are several. Loop bodies may still gain predecessors while
+		// they are emitted, so they remain unsealed until the end of the loop: reading a local that
+		// is not assigned in an unsealed block adds a PHI whose operands are filled in when the
+		// block is sealed.
+		struct LocalDefKey
+		{
+			llvm::BasicBlock* block;
+			Uptr localIndex;
+
+			struct HashPolicy
+			{
+				static bool areKeysEqual(const LocalDefKey& left, const LocalDefKey& right)
+				{
+					return left.block == right.block && left.localIndex == right.localIndex;
+				}
+				static Uptr getKeyHash(const LocalDefKey& key)
+				{
+					return Hash<Uptr>()(reinterpret_cast<Uptr>(key.block), key.localIndex);
+				}
+			};
+		};
+		struct IncompleteLocalPHI
+		{
+			llvm::PHINode* phi;
+			Uptr localIndex;
+		};
+		ScratchVector<llvm::Type*> localTypes;
+		HashMap<LocalDefKey, llvm::Value*, LocalDefKey::HashPolicy> localDefs;
+		HashMap<llvm::BasicBlock*, std::vector<IncompleteLocalPHI>> unsealedBlocks;
+
+		// PHIs for locals that turned out to only join a single value when they were created.
+		// They are replaced by that value, but aren't erased until the function has been emitted,
+		// so their addresses can't be reused by a PHI that would be mistaken for one of them.
+		HashMap<llvm::PHINode*, llvm::Value*> trivialLocalPHIs;
 
 		llvm::DISubprogram* diFunction;
 
+		// The index in the function definition's code of the operator being emitted.
+		Uptr opIndex;
+
+		// If the module is compiled with profile instrumentation, the index of the first profile
+		// counter of the operator being emitted.
+		Uptr profileCounterIndex;
+
 		llvm::BasicBlock* localEscapeBlock;
 		std::vector<llvm::Value*> pendingLocalEscapes;
 
@@ -60,23 +107,55 @@ namespace WAVM { namespace LLVMJIT {
 			PHIVector phis;
 		};
 
-		std::vector<ControlContext> controlStack;
-		std::vector<BranchTarget> branchTargetStack;
-		std::vector<llvm::Value*> stack;
+		// The emitter's stacks are allocated from the thread's scratch arena, so emitting many small
+		// functions reuses the same memory instead of allocating new stacks for each function.
+		ScratchVector<ControlContext> controlStack;
+		ScratchVector<BranchTarget> branchTargetStack;
+		ScratchVector<llvm::Value*> stack;
+
+		// The explicit memory bounds checks that are known to pass at the end of
+		// boundsCheckedBlock: maps a checked address to the memory and the largest end offset it
+		// was checked for. Constant addresses use a null key, and the absolute end address as the
+		// offset.
+		struct BoundsCheck
+		{
+			Uptr memoryIndex;
+			U64 endOffset;
+		};
+		llvm::BasicBlock* boundsCheckedBlock;
+		HashMap<llvm::Value*, BoundsCheck> boundsCheckedEndOffsets;
+
+		// The atomic access alignment checks that are known to pass at the end of
+		// alignmentCheckedBlock, keyed like boundsCheckedEndOffsets: maps a checked address to the
+		// offset and alignment it was checked for.
+		struct AlignmentCheck
+		{
+			U64 offset;
+			U32 alignmentLog2;
+		};
+		llvm::BasicBlock* alignmentCheckedBlock;
+		HashMap<llvm::Value*, AlignmentCheck> alignmentCheckedOffsets;
 
 		EmitFunctionContext(LLVMContext& inLLVMContext,
 							EmitModuleContext& inModuleContext,
 							const IR::Module& inIRModule,
+							Uptr inFunctionDefIndex,
 							const IR::FunctionDef& inFunctionDef,
 							llvm::Function* inLLVMFunction)
-		: EmitContext(inLLVMContext, inModuleContext.defaultMemoryOffset)
+		: EmitContext(inLLVMContext, inModuleContext.emitMemoryBoundsChecks)
 		, moduleContext(inModuleContext)
 		, irModule(inIRModule)
+		, functionDefIndex(inFunctionDefIndex)
 		, functionDef(inFunctionDef)
 		, functionType(inIRModule.types[inFunctionDef.type.index])
 		, function(inLLVMFunction)
+		, opIndex(0)
+		, profileCounterIndex(0)
 		, localEscapeBlock(nullptr)
+		, boundsCheckedBlock(nullptr)
+		, alignmentCheckedBlock(nullptr)
 		{
+			memoryOffsets = inModuleContext.memoryOffsets;
 		}
 
 		void emit();
@@ -115,6 +194,14 @@ namespace WAVM { namespace LLVMJIT {
 		// Creates a PHI node for the argument of branches to a basic block.
 		PHIVector createPHIs(llvm::BasicBlock* basicBlock, IR::TypeTuple type);
 
+		// Reads and assigns the SSA value of a local at the IR builder's insertion point.
+		llvm::Value* getLocal(Uptr localIndex);
+		void setLocal(Uptr localIndex, llvm::Value* value);
+
+		// Seals a loop body once all the branches back to it have been emitted, completing the
+		// PHIs that were added for the locals read in it.
+		void sealBlock(llvm::BasicBlock* block);
+
 		// Bitcasts a LLVM value to a canonical type for the corresponding WebAssembly type.
 		// This is currently just used to map all the various vector types to a canonical type for
 		// the vector width.
@@ -136,7 +223,13 @@ namespace WAVM { namespace LLVMJIT {
 		}
 
 		// Converts a bounded memory address to a LLVM pointer.
-		llvm::Value* coerceAddressToPointer(llvm::Value* boundedAddress, llvm::Type* memoryType);
+		llvm::Value* coerceAddressToPointer(llvm::Value* boundedAddress,
+											llvm::Type* memoryType,
+											Uptr memoryIndex);
+
+		// Returns whether the non-atomic loads and stores of a memory are volatile, which keeps
+		// the optimizer from removing or reordering accesses that may trap.
+		bool isMemoryAccessVolatile(Uptr memoryIndex);
 
 		// Traps a divide-by-zero
 		void trapDivideByZero(llvm::Value* divisor);
@@ -165,6 +258,40 @@ namespace WAVM { namespace LLVMJIT {
 										  IR::FunctionType intrinsicType,
 										  const std::initializer_list<llvm::Value*>& args);
 
+		// Emits a check that the index is within the table's reserved elements, and returns a
+		// pointer to the table element's biased value.
+		llvm::Value* emitTableElementPointer(Uptr tableIndex, llvm::Value* elementIndex);
+
+		// If the module is compiled with epoch checks, emits a check that traps if the epoch has
+		// reached the current context's deadline.
+		void emitEpochCheck();
+		void emitStackLimitCheck();
+
+		// Emits code that subtracts the cost of a straight-line run of operators from the
+		// context's fuel, and calls the fuelExhausted intrinsic if the fuel becomes negative. The
+		// cost isn't known until the end of the run, so it is initially zero, and is set by passing
+		// the returned instruction to setFuelCharge.
+		llvm::Instruction* emitFuelCharge();
+		void setFuelCharge(llvm::Instruction* charge, Uptr cost);
+
+		// Emits code that adds to a profile counter.
+		void emitProfileCounterIncrement(Uptr counterIndex, llvm::Value* increment);
+
+		// If the module is compiled with profile instrumentation, emits code that counts the
+		// branches taken by the current operator: a condition selects between two counters, and a
+		// br_table index selects between the table's counters.
+		void emitBranchProfile(llvm::Value* booleanCondition);
+		void emitBranchTableProfile(llvm::Value* index, Uptr numTargets);
+
+		// If the module is compiled with profile instrumentation, emits code that tracks the
+		// most frequent callee of the current call_indirect operator.
+		void emitIndirectCalleeProfile(llvm::Value* anyFuncAddress);
+
+		// Returns branch weights for the numBranches branches of the current if, br_if, or br_table
+		// operator from the module's profile, or null if the module isn't compiled with a profile,
+		// or the profile doesn't have counts for that many branches of the operator.
+		llvm::MDNode* getProfileBranchWeights(Uptr numBranches, bool isBranchTable = false);
+
 		void pushControlStack(ControlContext::Type type,
 							  IR::TypeTuple resultTypes,
 							  llvm::BasicBlock* endBlock,
@@ -207,6 +334,7 @@ namespace WAVM { namespace LLVMJIT {
 
 		llvm::Value* emitSRem(IR::ValueType type, llvm::Value* left, llvm::Value* right);
 		llvm::Value* emitF64Promote(llvm::Value* operand);
+		llvm::Value* emitCanonicalizeNaNs(llvm::Value* value);
 
 		template<typename Float>
 		llvm::Value* emitTruncFloatToInt(IR::ValueType destType,
@@ -234,6 +362,16 @@ namespace WAVM { namespace LLVMJIT {
 												  Int nanResult,
 												  llvm::Value* operand);
 
+		// Emits a call to the x86 or AArch64 intrinsic that implements a SIMD operator, depending on
+		// the target's SIMD instruction set.
+		llvm::Value* emitSIMDIntrinsic(llvm::Intrinsic::ID x86IntrinsicId,
+									   llvm::Intrinsic::ID aarch64IntrinsicId,
+									   llvm::Type* vectorType,
+									   llvm::ArrayRef<llvm::Value*> arguments);
+
+		llvm::Value* emitAnyTrue(llvm::Value* vector);
+		llvm::Value* emitAllTrue(llvm::Value* vector, llvm::Type* vectorType);
+
 		llvm::Value* emitBitSelect(llvm::Value* mask,
 								   llvm::Value* trueValue,
 								   llvm::Value* falseValue);
@@ -242,11 +380,28 @@ namespace WAVM { namespace LLVMJIT {
 									  llvm::Value* trueValue,
 									  llvm::Value* falseValue);
 
-		void trapIfMisalignedAtomic(llvm::Value* address, U32 naturalAlignmentLog2);
+		void trapIfMisalignedAtomic(llvm::Value* address,
+									U64 offset,
+									llvm::Value* boundedAddress,
+									U32 alignmentLog2);
 
 		struct TryContext
 		{
 			llvm::BasicBlock* unwindToBlock;
+
+			// The index of the try's CatchContext in catchStack.
+			Uptr catchStackIndex;
+		};
+
+		// A throw within a try in the same function. Instead of raising a platform exception, it
+		// branches directly to the try's catch clause that handles it. Its ExceptionData is stored
+		// on the stack, so it may be rethrown by the catch clause.
+		struct LocalThrow
+		{
+			Uptr exceptionTypeIndex;
+			llvm::BasicBlock* block;
+			llvm::Value* exceptionPointer;
+			std::vector<llvm::Value*> arguments;
 		};
 
 		struct CatchContext
@@ -258,17 +413,39 @@ namespace WAVM { namespace LLVMJIT {
 			llvm::LandingPadInst* landingPadInst;
 			llvm::BasicBlock* nextHandlerBlock;
 			llvm::Value* exceptionTypeInstance;
+			llvm::Value* landingPadExceptionPointer;
 
 			// Used for all platforms.
 			llvm::Value* exceptionPointer;
+
+			// The local throws within the try that haven't been matched to a catch clause yet.
+			std::vector<LocalThrow> pendingLocalThrows;
 		};
 
-		std::vector<TryContext> tryStack;
-		std::vector<CatchContext> catchStack;
+		ScratchVector<TryContext> tryStack;
+		ScratchVector<CatchContext> catchStack;
 
 		void endTry();
 		void endCatch();
 
+		// Emits a throw of a user exception with the ExceptionData at exceptionPointer. If the throw
+		// is within a try in this function, it becomes a pending local throw of the try; otherwise,
+		// it raises a platform exception.
+		void emitThrow(Uptr exceptionTypeIndex,
+					   llvm::Value* exceptionPointer,
+					   std::vector<llvm::Value*>&& arguments);
+
+		// Branches the pending local throws that are caught by a catch clause to a new entry block
+		// for the clause, and merges their exception pointer and arguments with the clause's.
+		void mergeLocalThrowsIntoCatch(CatchContext& catchContext,
+									   bool isCatchAll,
+									   Uptr catchExceptionTypeIndex,
+									   std::vector<llvm::Value*>& inOutArguments);
+
+		// Re-emits the pending local throws that none of a try's catch clauses caught, so they
+		// propagate to the enclosing try or out of the function.
+		void emitUncaughtLocalThrows(CatchContext& catchContext);
+
 		llvm::BasicBlock* getInnermostUnwindToBlock();
 
 #define VISIT_OPCODE(encoding, name, nameString, Imm, ...) void name(IR::Imm imm);
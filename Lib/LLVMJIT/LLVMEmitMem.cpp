@@ -9,86 +9,248 @@
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Support/AtomicOrdering.h"
+#include "llvm/Support/KnownBits.h"
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
+using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
 
+// Identifies an address for the purpose of finding redundant bounds and alignment checks: the
+// locals are SSA values, so accesses through separate get_locals of the same variable share their
+// checks as long as the variable isn't assigned in between. Constant addresses use a null key, and
+// add the address to inOutOffset.
+static llvm::Value* getAddressCheckKey(llvm::Value* address, U64& inOutOffset)
+{
+	if(auto constantAddress = llvm::dyn_cast<llvm::ConstantInt>(address))
+	{
+		inOutOffset += constantAddress->getZExtValue();
+		return nullptr;
+	}
+	return address;
+}
+
+// Zero-extends a 32-bit memory address or size operand to 64 bits. The operands of 64-bit
+// memories are already 64-bit.
+static llvm::Value* zextMemoryOperand(EmitFunctionContext& functionContext, llvm::Value* operand)
+{
+	if(operand->getType() == functionContext.llvmContext.i64Type) { return operand; }
+	return functionContext.irBuilder.CreateZExt(operand, functionContext.llvmContext.i64Type);
+}
+
+// Truncates a 64-bit value returned by a memory intrinsic to a 32-bit memory's index type.
+static llvm::Value* truncToMemoryIndexType(EmitFunctionContext& functionContext,
+										   Uptr memoryIndex,
+										   llvm::Value* value)
+{
+	const MemoryType memoryType = functionContext.irModule.memories.getType(memoryIndex);
+	if(memoryType.indexType == IndexType::i64) { return value; }
+	return functionContext.irBuilder.CreateTrunc(value, functionContext.llvmContext.i32Type);
+}
+
 // Bounds checks a sandboxed memory address + offset, and returns an offset relative to the memory
 // base address that is guaranteed to be within the virtual address space allocated for the linear
 // memory object.
-static llvm::Value* getOffsetAndBoundedAddress(EmitContext& emitContext,
+static llvm::Value* getOffsetAndBoundedAddress(EmitFunctionContext& functionContext,
+											   Uptr memoryIndex,
 											   llvm::Value* address,
-											   U32 offset)
+											   U64 offset,
+											   U32 numBytes)
 {
 	// zext the 32-bit address to 64-bits.
 	// This is crucial for security, as LLVM will otherwise implicitly sign extend it to 64-bits in
 	// the GEP below, interpreting it as a signed offset and allowing access to memory outside the
 	// sandboxed memory range. There are no 'far addresses' in a 32 bit runtime.
-	address = emitContext.irBuilder.CreateZExt(address, emitContext.llvmContext.i64Type);
+	llvm::Value* boundedAddress = zextMemoryOperand(functionContext, address);
+
+	// If HAS_64BIT_ADDRESS_SPACE, the memory has enough virtual address space allocated to ensure
+	// that any 32-bit byte index + 32-bit offset will fall within the virtual address sandbox, so
+	// no explicit bounds check is necessary. If the code is compiled with memory bounds checks, or
+	// the memory is a 64-bit memory, the memory may have less address space reserved, so check
+	// that the accessed bytes are within the reserved address space or the guard pages after it.
+	// Accesses to reserved pages that aren't committed and to the guard pages will still fault,
+	// and are reported as out-of-bounds accesses by the signal handler.
+	llvm::Value* numReservedBytesVariable
+		= functionContext.memoryNumReservedBytesVariables[memoryIndex];
+	if(numReservedBytesVariable)
+	{
+		// Check the address before adding the offset to it, so a 64-bit address + offset can't
+		// wrap around. An access of numBytes at address+offset is within the reserved bytes or
+		// guard pages if address <= numReservedBytes - max(0, offset + numBytes - numGuardBytes),
+		// so accesses with a small enough offset and size share the same address <=
+		// numReservedBytes check.
+		const U64 accessEndOffset
+			= offset > UINT64_MAX - numBytes ? UINT64_MAX : offset + U64(numBytes);
+		const U64 checkEndOffset = std::max(accessEndOffset, U64(Runtime::memoryNumGuardBytes));
+
+		// The memory's reserved size doesn't change, so a check that passed earlier in the same
+		// straight-line code also covers any access to the same address in the same memory that
+		// ends at or before the checked end offset. The checks only fall through to a new block,
+		// so a check is known to have passed if it was emitted since the last change of basic
+		// block.
+		U64 checkKeyEndOffset = checkEndOffset;
+		llvm::Value* checkKey = getAddressCheckKey(address, checkKeyEndOffset);
+		if(checkKeyEndOffset < checkEndOffset) { checkKeyEndOffset = UINT64_MAX; }
+
+		llvm::BasicBlock* insertBlock = functionContext.irBuilder.GetInsertBlock();
+		if(insertBlock != functionContext.boundsCheckedBlock)
+		{
+			functionContext.boundsCheckedBlock = insertBlock;
+			functionContext.boundsCheckedEndOffsets
+				= HashMap<llvm::Value*, EmitFunctionContext::BoundsCheck>();
+		}
+		const EmitFunctionContext::BoundsCheck* checked
+			= functionContext.boundsCheckedEndOffsets.get(checkKey);
+		if(!checked || checked->memoryIndex != memoryIndex
+		   || checked->endOffset < checkKeyEndOffset)
+		{
+			const U64 numExcessBytes = checkEndOffset - Runtime::memoryNumGuardBytes;
+			llvm::Value* numExcessBytesValue
+				= emitLiteral(functionContext.llvmContext, numExcessBytes);
+			llvm::Value* numReservedBytes
+				= functionContext.irBuilder.CreateLoad(numReservedBytesVariable);
+			llvm::Value* isOutOfBounds = functionContext.irBuilder.CreateICmpUGT(
+				boundedAddress,
+				functionContext.irBuilder.CreateSub(numReservedBytes, numExcessBytesValue));
+			if(numExcessBytes)
+			{
+				isOutOfBounds = functionContext.irBuilder.CreateOr(
+					isOutOfBounds,
+					functionContext.irBuilder.CreateICmpULT(numReservedBytes, numExcessBytesValue));
+			}
+			functionContext.emitConditionalTrapIntrinsic(
+				isOutOfBounds, "accessViolationTrap", FunctionType(), {});
+
+			if(functionContext.alignmentCheckedBlock == insertBlock)
+			{ functionContext.alignmentCheckedBlock = functionContext.irBuilder.GetInsertBlock(); }
+			functionContext.boundsCheckedBlock = functionContext.irBuilder.GetInsertBlock();
+			functionContext.boundsCheckedEndOffsets.set(
+				checkKey, EmitFunctionContext::BoundsCheck{memoryIndex, checkKeyEndOffset});
+		}
+	}
 
 	// Add the offset to the byte index.
 	if(offset)
 	{
-		address = emitContext.irBuilder.CreateAdd(
-			address,
-			emitContext.irBuilder.CreateZExt(emitLiteral(emitContext.llvmContext, offset),
-											 emitContext.llvmContext.i64Type));
+		boundedAddress = functionContext.irBuilder.CreateAdd(
+			boundedAddress, emitLiteral(functionContext.llvmContext, offset));
 	}
 
-	// If HAS_64BIT_ADDRESS_SPACE, the memory has enough virtual address space allocated to ensure
-	// that any 32-bit byte index + 32-bit offset will fall within the virtual address sandbox, so
-	// no explicit bounds check is necessary.
+	return boundedAddress;
+}
 
-	return address;
+// If the module is compiled with memory access sampling, emits code that decrements the context's
+// memory access sample countdown, and calls the memoryAccessSampled intrinsic with the bounded
+// address of the access if it reaches zero.
+static void emitMemoryAccessSample(EmitFunctionContext& functionContext,
+								   Uptr memoryIndex,
+								   llvm::Value* boundedAddress,
+								   U32 numBytes,
+								   bool isStore)
+{
+	if(!functionContext.moduleContext.emitMemoryAccessSampling) { return; }
+
+	llvm::IRBuilder<>& irBuilder = functionContext.irBuilder;
+	LLVMContext& llvmContext = functionContext.llvmContext;
+	llvm::Value* countdownPointer = irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(
+			irBuilder.CreateLoad(functionContext.contextPointerVariable),
+			{emitLiteral(llvmContext,
+						 Uptr(offsetof(Runtime::ContextRuntimeData, memoryAccessSampleCountdown)))}),
+		llvmContext.i64Type->getPointerTo());
+	llvm::LoadInst* oldCountdown = irBuilder.CreateLoad(countdownPointer);
+	oldCountdown->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.runtimeDataTBAATag);
+	llvm::Value* countdown = irBuilder.CreateSub(oldCountdown, emitLiteral(llvmContext, U64(1)));
+	irBuilder.CreateStore(countdown, countdownPointer)
+		->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.runtimeDataTBAATag);
+
+	llvm::BasicBlock* insertBlock = irBuilder.GetInsertBlock();
+	auto sampleBlock
+		= llvm::BasicBlock::Create(llvmContext, "memoryAccessSample", functionContext.function);
+	auto continueBlock
+		= llvm::BasicBlock::Create(llvmContext, "memoryAccessSampleEnd", functionContext.function);
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpSLE(countdown, llvmContext.typedZeroConstants[(Uptr)ValueType::i64]),
+		sampleBlock,
+		continueBlock,
+		functionContext.moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(sampleBlock);
+	functionContext.emitRuntimeIntrinsic(
+		"memoryAccessSampled",
+		FunctionType(
+			{},
+			TypeTuple({ValueType::i64, ValueType::i32, ValueType::i32, inferValueType<Iptr>()})),
+		{boundedAddress,
+		 emitLiteral(llvmContext, numBytes),
+		 emitLiteral(llvmContext, U32(isStore ? 1 : 0)),
+		 getMemoryIdFromOffset(llvmContext,
+							   functionContext.moduleContext.memoryOffsets[memoryIndex])});
+	irBuilder.CreateBr(continueBlock);
+	irBuilder.SetInsertPoint(continueBlock);
+
+	// The sample doesn't affect the bounds and alignment checks that had passed before it.
+	if(functionContext.boundsCheckedBlock == insertBlock)
+	{ functionContext.boundsCheckedBlock = continueBlock; }
+	if(functionContext.alignmentCheckedBlock == insertBlock)
+	{ functionContext.alignmentCheckedBlock = continueBlock; }
 }
 
 llvm::Value* EmitFunctionContext::coerceAddressToPointer(llvm::Value* boundedAddress,
-														 llvm::Type* memoryType)
+														 llvm::Type* memoryType,
+														 Uptr memoryIndex)
 {
-	llvm::Value* memoryBasePointer = irBuilder.CreateLoad(memoryBasePointerVariable);
+	llvm::Value* memoryBasePointer
+		= irBuilder.CreateLoad(memoryBasePointerVariables[memoryIndex]);
 	llvm::Value* bytePointer = irBuilder.CreateInBoundsGEP(memoryBasePointer, boundedAddress);
 
 	// Cast the pointer to the appropriate type.
 	return irBuilder.CreatePointerCast(bytePointer, memoryType->getPointerTo());
 }
 
+bool EmitFunctionContext::isMemoryAccessVolatile(Uptr memoryIndex)
+{
+	// Accesses of a shared memory are always volatile, since other threads may observe their
+	// order.
+	return !moduleContext.emitRelaxedMemoryAccesses
+		   || irModule.memories.getType(memoryIndex).isShared;
+}
+
 //
 // Memory size operators
-// These just call out to wavmIntrinsics.growMemory/currentMemory, passing a pointer to the default
-// memory for the module.
+// These just call out to wavmIntrinsics.growMemory/currentMemory, passing the id of the memory.
 //
 
 void EmitFunctionContext::memory_grow(MemoryImm imm)
 {
-	errorUnless(imm.memoryIndex == 0);
 	llvm::Value* deltaNumPages = pop();
 	ValueVector previousNumPages = emitRuntimeIntrinsic(
 		"memory.grow",
-		FunctionType(TypeTuple(ValueType::i32),
-					 TypeTuple({ValueType::i32, inferValueType<Iptr>()})),
-		{deltaNumPages,
+		FunctionType(TypeTuple(ValueType::i64),
+					 TypeTuple({ValueType::i64, inferValueType<Iptr>()})),
+		{zextMemoryOperand(*this, deltaNumPages),
 		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
 	wavmAssert(previousNumPages.size() == 1);
-	push(previousNumPages[0]);
+	push(truncToMemoryIndexType(*this, imm.memoryIndex, previousNumPages[0]));
 }
 void EmitFunctionContext::memory_size(MemoryImm imm)
 {
-	errorUnless(imm.memoryIndex == 0);
 	ValueVector currentNumPages = emitRuntimeIntrinsic(
 		"memory.size",
-		FunctionType(TypeTuple(ValueType::i32), TypeTuple(inferValueType<Iptr>())),
+		FunctionType(TypeTuple(ValueType::i64), TypeTuple(inferValueType<Iptr>())),
 		{getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
 	wavmAssert(currentNumPages.size() == 1);
-	push(currentNumPages[0]);
+	push(truncToMemoryIndexType(*this, imm.memoryIndex, currentNumPages[0]));
 }
 
 //
@@ -103,13 +265,13 @@ void EmitFunctionContext::memory_init(DataSegmentAndMemImm imm)
 	emitRuntimeIntrinsic(
 		"memory.init",
 		FunctionType({},
-					 TypeTuple({ValueType::i32,
+					 TypeTuple({ValueType::i64,
 								ValueType::i32,
 								ValueType::i32,
 								inferValueType<Uptr>(),
 								inferValueType<Uptr>(),
 								inferValueType<Uptr>()})),
-		{destAddress,
+		{zextMemoryOperand(*this, destAddress),
 		 sourceOffset,
 		 numBytes,
 		 irBuilder.CreatePointerCast(moduleContext.moduleInstancePointer, llvmContext.iptrType),
@@ -126,21 +288,118 @@ void EmitFunctionContext::memory_drop(DataSegmentImm imm)
 		 emitLiteral(llvmContext, imm.dataSegmentIndex)});
 }
 
-void EmitFunctionContext::memory_copy(MemoryImm imm)
+// memory.copy and memory.fill with a constant number of bytes up to this limit are emitted as
+// inline loads and stores instead of calls to the runtime intrinsics.
+static constexpr U64 maxInlineBulkMemoryBytes = 64;
+
+// If numBytes is a constant that is small enough to emit the bulk memory operation inline,
+// returns true and writes the constant to outNumBytes.
+static bool getInlineBulkMemoryNumBytes(llvm::Value* numBytes, U64& outNumBytes)
+{
+	auto numBytesConstant = llvm::dyn_cast<llvm::ConstantInt>(numBytes);
+	if(!numBytesConstant || numBytesConstant->getZExtValue() > maxInlineBulkMemoryBytes)
+	{ return false; }
+	outNumBytes = numBytesConstant->getZExtValue();
+	return true;
+}
+
+// Splits a range of bytes into chunks that are accessed with a single load or store: as many
+// 16-byte chunks as fit, followed by at most one each of 8, 4, 2, and 1-byte chunks.
+template<typename ChunkFunc>
+static void forEachBulkMemoryChunk(LLVMContext& llvmContext, U64 numBytes, ChunkFunc&& chunkFunc)
+{
+	U64 chunkOffset = 0;
+	while(chunkOffset < numBytes)
+	{
+		const U64 numRemainingBytes = numBytes - chunkOffset;
+		llvm::Type* chunkType;
+		U64 numChunkBytes;
+		if(numRemainingBytes >= 16)
+		{
+			chunkType = llvmContext.i64x2Type;
+			numChunkBytes = 16;
+		}
+		else if(numRemainingBytes >= 8)
+		{
+			chunkType = llvmContext.i64Type;
+			numChunkBytes = 8;
+		}
+		else if(numRemainingBytes >= 4)
+		{
+			chunkType = llvmContext.i32Type;
+			numChunkBytes = 4;
+		}
+		else if(numRemainingBytes >= 2)
+		{
+			chunkType = llvmContext.i16Type;
+			numChunkBytes = 2;
+		}
+		else
+		{
+			chunkType = llvmContext.i8Type;
+			numChunkBytes = 1;
+		}
+		chunkFunc(chunkOffset, chunkType);
+		chunkOffset += numChunkBytes;
+	}
+}
+
+void EmitFunctionContext::memory_copy(MemoryCopyImm imm)
 {
 	auto numBytes = pop();
 	auto sourceAddress = pop();
 	auto destAddress = pop();
 
+	U64 constantNumBytes;
+	if(getInlineBulkMemoryNumBytes(numBytes, constantNumBytes))
+	{
+		// Bounds check the source and destination ranges the same way as a load or store of
+		// constantNumBytes bytes would be.
+		llvm::Value* boundedSourceAddress = getOffsetAndBoundedAddress(
+			*this, imm.sourceMemoryIndex, sourceAddress, 0, U32(constantNumBytes));
+		llvm::Value* boundedDestAddress = getOffsetAndBoundedAddress(
+			*this, imm.destMemoryIndex, destAddress, 0, U32(constantNumBytes));
+
+		// Load all the source bytes before storing any of them, so overlapping source and
+		// destination ranges are copied as if through an intermediate buffer.
+		std::vector<std::pair<U64, llvm::Value*>> chunks;
+		forEachBulkMemoryChunk(llvmContext, constantNumBytes, [&](U64 offset, llvm::Type* type) {
+			llvm::Value* address = irBuilder.CreateAdd(boundedSourceAddress,
+													   emitLiteral(llvmContext, offset));
+			auto load = irBuilder.CreateLoad(
+				coerceAddressToPointer(address, type, imm.sourceMemoryIndex));
+			load->setAlignment(1);
+			load->setVolatile(isMemoryAccessVolatile(imm.sourceMemoryIndex));
+			load->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);
+			chunks.push_back({offset, load});
+		});
+		for(const auto& chunk : chunks)
+		{
+			llvm::Value* address = irBuilder.CreateAdd(boundedDestAddress,
+													   emitLiteral(llvmContext, chunk.first));
+			auto store = irBuilder.CreateStore(
+				chunk.second,
+				coerceAddressToPointer(address, chunk.second->getType(), imm.destMemoryIndex));
+			store->setAlignment(1);
+			store->setVolatile(isMemoryAccessVolatile(imm.destMemoryIndex));
+			store->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);
+		}
+		return;
+	}
+
 	emitRuntimeIntrinsic(
 		"memory.copy",
-		FunctionType(
-			{},
-			TypeTuple({ValueType::i32, ValueType::i32, ValueType::i32, inferValueType<Uptr>()})),
-		{destAddress,
-		 sourceAddress,
-		 numBytes,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
+		FunctionType({},
+					 TypeTuple({ValueType::i64,
+								ValueType::i64,
+								ValueType::i64,
+								inferValueType<Uptr>(),
+								inferValueType<Uptr>()})),
+		{zextMemoryOperand(*this, destAddress),
+		 zextMemoryOperand(*this, sourceAddress),
+		 zextMemoryOperand(*this, numBytes),
+		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.destMemoryIndex]),
+		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.sourceMemoryIndex])});
 }
 
 void EmitFunctionContext::memory_fill(MemoryImm imm)
@@ -149,14 +408,41 @@ void EmitFunctionContext::memory_fill(MemoryImm imm)
 	auto value = pop();
 	auto destAddress = pop();
 
+	U64 constantNumBytes;
+	if(getInlineBulkMemoryNumBytes(numBytes, constantNumBytes))
+	{
+		llvm::Value* boundedDestAddress = getOffsetAndBoundedAddress(
+			*this, imm.memoryIndex, destAddress, 0, U32(constantNumBytes));
+
+		// Replicate the low byte of the value to all 8 bytes of an i64, and truncate or splat that
+		// to the type of each chunk.
+		llvm::Value* valueI64 = irBuilder.CreateMul(
+			irBuilder.CreateZExt(irBuilder.CreateTrunc(value, llvmContext.i8Type),
+								 llvmContext.i64Type),
+			emitLiteral(llvmContext, U64(0x0101010101010101)));
+		forEachBulkMemoryChunk(llvmContext, constantNumBytes, [&](U64 offset, llvm::Type* type) {
+			llvm::Value* chunkValue = type == llvmContext.i64x2Type
+										  ? irBuilder.CreateVectorSplat(2, valueI64)
+										  : irBuilder.CreateTrunc(valueI64, type);
+			llvm::Value* address
+				= irBuilder.CreateAdd(boundedDestAddress, emitLiteral(llvmContext, offset));
+			auto store = irBuilder.CreateStore(
+				chunkValue, coerceAddressToPointer(address, type, imm.memoryIndex));
+			store->setAlignment(1);
+			store->setVolatile(isMemoryAccessVolatile(imm.memoryIndex));
+			store->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);
+		});
+		return;
+	}
+
 	emitRuntimeIntrinsic(
 		"memory.fill",
 		FunctionType(
 			{},
-			TypeTuple({ValueType::i32, ValueType::i32, ValueType::i32, inferValueType<Uptr>()})),
-		{destAddress,
+			TypeTuple({ValueType::i64, ValueType::i32, ValueType::i64, inferValueType<Uptr>()})),
+		{zextMemoryOperand(*this, destAddress),
 		 value,
-		 numBytes,
+		 zextMemoryOperand(*this, numBytes),
 		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
 }
 
@@ -168,11 +454,15 @@ void EmitFunctionContext::memory_fill(MemoryImm imm)
 	void EmitFunctionContext::valueTypeId##_##name(LoadOrStoreImm<naturalAlignmentLog2> imm)       \
 	{                                                                                              \
 		auto address = pop();                                                                      \
-		auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
-		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
+		auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+			*this, imm.memoryIndex, address, imm.offset, 1 << naturalAlignmentLog2);               \
+		emitMemoryAccessSample(                                                                    \
+			*this, imm.memoryIndex, boundedAddress, 1 << naturalAlignmentLog2, false);             \
+		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType, imm.memoryIndex);    \
 		auto load = irBuilder.CreateLoad(pointer);                                                 \
 		load->setAlignment(1 << imm.alignmentLog2);                                                \
-		load->setVolatile(true);                                                                   \
+		load->setVolatile(isMemoryAccessVolatile(imm.memoryIndex));                                \
+		load->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);            \
 		push(conversionOp(load, asLLVMType(llvmContext, ValueType::valueTypeId)));                 \
 	}
 #define EMIT_STORE_OP(valueTypeId, name, llvmMemoryType, naturalAlignmentLog2, conversionOp)       \
@@ -180,11 +470,15 @@ void EmitFunctionContext::memory_fill(MemoryImm imm)
 	{                                                                                              \
 		auto value = pop();                                                                        \
 		auto address = pop();                                                                      \
-		auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
-		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
+		auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+			*this, imm.memoryIndex, address, imm.offset, 1 << naturalAlignmentLog2);               \
+		emitMemoryAccessSample(                                                                    \
+			*this, imm.memoryIndex, boundedAddress, 1 << naturalAlignmentLog2, true);              \
+		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType, imm.memoryIndex);    \
 		auto memoryValue = conversionOp(value, llvmMemoryType);                                    \
 		auto store = irBuilder.CreateStore(memoryValue, pointer);                                  \
-		store->setVolatile(true);                                                                  \
+		store->setVolatile(isMemoryAccessVolatile(imm.memoryIndex));                               \
+		store->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);           \
 		store->setAlignment(1 << imm.alignmentLog2);                                               \
 	}
 
@@ -217,80 +511,158 @@ EMIT_STORE_OP(f64, store, llvmContext.f64Type, 3, identity)
 EMIT_STORE_OP(v128, store, value->getType(), 4, identity)
 EMIT_LOAD_OP(v128, load, llvmContext.i64x2Type, 4, identity)
 
-void EmitFunctionContext::trapIfMisalignedAtomic(llvm::Value* address, U32 alignmentLog2)
+void EmitFunctionContext::trapIfMisalignedAtomic(llvm::Value* address,
+												 U64 offset,
+												 llvm::Value* boundedAddress,
+												 U32 alignmentLog2)
 {
-	if(alignmentLog2 > 0)
+	if(alignmentLog2 == 0) { return; }
+
+	// Omit the check if the low bits of the address are known to be zero, e.g. because it is
+	// constant, or masked or shifted by the WebAssembly code.
+	const llvm::KnownBits knownBits
+		= llvm::computeKnownBits(boundedAddress, moduleContext.llvmModule->getDataLayout());
+	if(knownBits.countMinTrailingZeros() >= alignmentLog2) { return; }
+
+	// Omit the check if an alignment check of the same address that implies this one is known to
+	// have passed. A check that address+checkedOffset is a multiple of 2^checkedAlignmentLog2
+	// implies that address+offset is a multiple of 2^alignmentLog2 if alignmentLog2 is no greater
+	// and offset-checkedOffset is a multiple of 2^alignmentLog2. Like the bounds checks, the checks
+	// only fall through to a new block, so a check is known to have passed if it was emitted since
+	// the last change of basic block.
+	U64 checkOffset = offset;
+	llvm::Value* checkKey = getAddressCheckKey(address, checkOffset);
+	llvm::BasicBlock* insertBlock = irBuilder.GetInsertBlock();
+	if(insertBlock != alignmentCheckedBlock)
 	{
-		emitConditionalTrapIntrinsic(
-			irBuilder.CreateICmpNE(
-				llvmContext.typedZeroConstants[(Uptr)ValueType::i64],
-				irBuilder.CreateAnd(address,
-									emitLiteral(llvmContext, (U64(1) << alignmentLog2) - 1))),
-			"misalignedAtomicTrap",
-			FunctionType(TypeTuple{}, TypeTuple{ValueType::i64}),
-			{address});
+		alignmentCheckedBlock = insertBlock;
+		alignmentCheckedOffsets = HashMap<llvm::Value*, AlignmentCheck>();
 	}
+	const AlignmentCheck* checked = alignmentCheckedOffsets.get(checkKey);
+	if(checked && checked->alignmentLog2 >= alignmentLog2
+	   && !((checkOffset - checked->offset) & ((U64(1) << alignmentLog2) - 1)))
+	{ return; }
+
+	emitConditionalTrapIntrinsic(
+		irBuilder.CreateICmpNE(
+			llvmContext.typedZeroConstants[(Uptr)ValueType::i64],
+			irBuilder.CreateAnd(boundedAddress,
+								emitLiteral(llvmContext, (U64(1) << alignmentLog2) - 1))),
+		"misalignedAtomicTrap",
+		FunctionType(TypeTuple{}, TypeTuple{ValueType::i64}),
+		{boundedAddress});
+
+	// The bounds checks that had passed before this check still pass after it.
+	if(boundsCheckedBlock == insertBlock) { boundsCheckedBlock = irBuilder.GetInsertBlock(); }
+	alignmentCheckedBlock = irBuilder.GetInsertBlock();
+	alignmentCheckedOffsets.set(checkKey, AlignmentCheck{checkOffset, alignmentLog2});
 }
 
 void EmitFunctionContext::atomic_wake(AtomicLoadOrStoreImm<2> imm)
 {
 	llvm::Value* numWaiters = pop();
 	llvm::Value* address = pop();
-	llvm::Value* boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);
-	trapIfMisalignedAtomic(boundedAddress, imm.alignmentLog2);
-	push(emitRuntimeIntrinsic(
+	llvm::Value* boundedAddress
+		= getOffsetAndBoundedAddress(*this, imm.memoryIndex, address, imm.offset, 4);
+	trapIfMisalignedAtomic(address, imm.offset, boundedAddress, imm.alignmentLog2);
+
+	// Load the memory's waiter count for the address, and only call into the runtime to wake
+	// waiting threads if it is non-zero. This must match Runtime::getMemoryWaiterCountIndex.
+	llvm::Constant* waiterCountsOffset = llvm::ConstantExpr::getAdd(
+		moduleContext.memoryOffsets[imm.memoryIndex],
+		emitLiteral(llvmContext,
+					Uptr(offsetof(Runtime::CompartmentRuntimeData, memoryWaiterCounts)
+						 - offsetof(Runtime::CompartmentRuntimeData, memoryBases))));
+	llvm::Value* waiterCounts = loadFromUntypedPointer(
+		irBuilder.CreateInBoundsGEP(getCompartmentAddress(), {waiterCountsOffset}),
+		llvmContext.iptrType->getPointerTo(),
+		llvmContext.runtimeDataTBAATag);
+	llvm::Value* waiterCountIndex = irBuilder.CreateLShr(
+		irBuilder.CreateMul(irBuilder.CreateTrunc(address, llvmContext.i32Type),
+							emitLiteral(llvmContext, U32(0x9e3779b9u))),
+		emitLiteral(llvmContext, U32(32 - Runtime::numMemoryWaiterCountsLog2)));
+	llvm::LoadInst* waiterCount = irBuilder.CreateLoad(irBuilder.CreateInBoundsGEP(
+		waiterCounts, {zext(waiterCountIndex, llvmContext.iptrType)}));
+	waiterCount->setAtomic(llvm::AtomicOrdering::SequentiallyConsistent);
+	waiterCount->setAlignment(sizeof(Uptr));
+
+	llvm::BasicBlock* wakeBlock = llvm::BasicBlock::Create(llvmContext, "atomicWake", function);
+	llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(llvmContext, "atomicWakeEnd", function);
+	llvm::BasicBlock* noWaitersBlock = irBuilder.GetInsertBlock();
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpNE(waiterCount, emitLiteral(llvmContext, Uptr(0))),
+		wakeBlock,
+		endBlock,
+		moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(wakeBlock);
+	llvm::Value* numWoken = emitRuntimeIntrinsic(
 		"atomic_wake",
 		FunctionType(TypeTuple{ValueType::i32},
-					 TypeTuple{ValueType::i32, ValueType::i32, ValueType::i64}),
-		{address,
+					 TypeTuple{ValueType::i64, ValueType::i32, ValueType::i64}),
+		{zextMemoryOperand(*this, address),
 		 numWaiters,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
+		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])})[0];
+	wakeBlock = irBuilder.GetInsertBlock();
+	irBuilder.CreateBr(endBlock);
+
+	irBuilder.SetInsertPoint(endBlock);
+	llvm::PHINode* result = irBuilder.CreatePHI(llvmContext.i32Type, 2);
+	result->addIncoming(emitLiteral(llvmContext, U32(0)), noWaitersBlock);
+	result->addIncoming(numWoken, wakeBlock);
+	push(result);
 }
 void EmitFunctionContext::i32_atomic_wait(AtomicLoadOrStoreImm<2> imm)
 {
 	llvm::Value* timeout = pop();
 	llvm::Value* expectedValue = pop();
 	llvm::Value* address = pop();
-	llvm::Value* boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);
-	trapIfMisalignedAtomic(boundedAddress, imm.alignmentLog2);
+	llvm::Value* boundedAddress
+		= getOffsetAndBoundedAddress(*this, imm.memoryIndex, address, imm.offset, 4);
+	trapIfMisalignedAtomic(address, imm.offset, boundedAddress, imm.alignmentLog2);
 	push(emitRuntimeIntrinsic(
 		"atomic_wait_i32",
 		FunctionType(
 			TypeTuple{ValueType::i32},
-			TypeTuple{ValueType::i32, ValueType::i32, ValueType::f64, inferValueType<Iptr>()}),
-		{address,
+			TypeTuple{ValueType::i64, ValueType::i32, ValueType::f64, inferValueType<Iptr>()}),
+		{zextMemoryOperand(*this, address),
 		 expectedValue,
 		 timeout,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
+		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])})[0]);
 }
 void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm)
 {
 	llvm::Value* timeout = pop();
 	llvm::Value* expectedValue = pop();
 	llvm::Value* address = pop();
-	llvm::Value* boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);
-	trapIfMisalignedAtomic(boundedAddress, imm.alignmentLog2);
+	llvm::Value* boundedAddress
+		= getOffsetAndBoundedAddress(*this, imm.memoryIndex, address, imm.offset, 8);
+	trapIfMisalignedAtomic(address, imm.offset, boundedAddress, imm.alignmentLog2);
 	push(emitRuntimeIntrinsic(
 		"atomic_wait_i64",
 		FunctionType(
 			TypeTuple{ValueType::i32},
-			TypeTuple{ValueType::i32, ValueType::i64, ValueType::f64, inferValueType<Iptr>()}),
-		{address,
+			TypeTuple{ValueType::i64, ValueType::i64, ValueType::f64, inferValueType<Iptr>()}),
+		{zextMemoryOperand(*this, address),
 		 expectedValue,
 		 timeout,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
+		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])})[0]);
 }
 
 #define EMIT_ATOMIC_LOAD_OP(valueTypeId, name, llvmMemoryType, naturalAlignmentLog2, memToValue)   \
 	void EmitFunctionContext::valueTypeId##_##name(AtomicLoadOrStoreImm<naturalAlignmentLog2> imm) \
 	{                                                                                              \
 		auto address = pop();                                                                      \
-		auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
-		trapIfMisalignedAtomic(boundedAddress, naturalAlignmentLog2);                              \
-		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
+		auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+			*this, imm.memoryIndex, address, imm.offset, 1 << naturalAlignmentLog2);               \
+		trapIfMisalignedAtomic(address, imm.offset, boundedAddress, naturalAlignmentLog2);         \
+		emitMemoryAccessSample(                                                                    \
+			*this, imm.memoryIndex, boundedAddress, 1 << naturalAlignmentLog2, false);             \
+		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType, imm.memoryIndex);    \
 		auto load = irBuilder.CreateLoad(pointer);                                                 \
 		load->setAlignment(1 << imm.alignmentLog2);                                                \
 		load->setVolatile(true);                                                                   \
+		load->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);            \
 		load->setAtomic(llvm::AtomicOrdering::SequentiallyConsistent);                             \
 		push(memToValue(load, asLLVMType(llvmContext, ValueType::valueTypeId)));                   \
 	}
@@ -299,12 +671,16 @@ void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm)
 	{                                                                                              \
 		auto value = pop();                                                                        \
 		auto address = pop();                                                                      \
-		auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
-		trapIfMisalignedAtomic(boundedAddress, naturalAlignmentLog2);                              \
-		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
+		auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+			*this, imm.memoryIndex, address, imm.offset, 1 << naturalAlignmentLog2);               \
+		trapIfMisalignedAtomic(address, imm.offset, boundedAddress, naturalAlignmentLog2);         \
+		emitMemoryAccessSample(                                                                    \
+			*this, imm.memoryIndex, boundedAddress, 1 << naturalAlignmentLog2, true);              \
+		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType, imm.memoryIndex);    \
 		auto memoryValue = valueToMem(value, llvmMemoryType);                                      \
 		auto store = irBuilder.CreateStore(memoryValue, pointer);                                  \
 		store->setVolatile(true);                                                                  \
+		store->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);           \
 		store->setAlignment(1 << imm.alignmentLog2);                                               \
 		store->setAtomic(llvm::AtomicOrdering::SequentiallyConsistent);                            \
 	}
@@ -333,9 +709,11 @@ EMIT_ATOMIC_STORE_OP(i64, atomic_store32, llvmContext.i32Type, 2, trunc)
 		auto replacementValue = valueToMem(pop(), llvmMemoryType);                                 \
 		auto expectedValue = valueToMem(pop(), llvmMemoryType);                                    \
 		auto address = pop();                                                                      \
-		auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
-		trapIfMisalignedAtomic(boundedAddress, alignmentLog2);                                     \
-		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
+		auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+			*this, imm.memoryIndex, address, imm.offset, 1 << alignmentLog2);                      \
+		trapIfMisalignedAtomic(address, imm.offset, boundedAddress, alignmentLog2);                \
+		emitMemoryAccessSample(*this, imm.memoryIndex, boundedAddress, 1 << alignmentLog2, true);  \
+		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType, imm.memoryIndex);    \
 		auto atomicCmpXchg                                                                         \
 			= irBuilder.CreateAtomicCmpXchg(pointer,                                               \
 											expectedValue,                                         \
@@ -343,6 +721,7 @@ EMIT_ATOMIC_STORE_OP(i64, atomic_store32, llvmContext.i32Type, 2, trunc)
 											llvm::AtomicOrdering::SequentiallyConsistent,          \
 											llvm::AtomicOrdering::SequentiallyConsistent);         \
 		atomicCmpXchg->setVolatile(true);                                                          \
+		atomicCmpXchg->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);   \
 		auto previousValue = irBuilder.CreateExtractValue(atomicCmpXchg, {0});                     \
 		push(memToValue(previousValue, asLLVMType(llvmContext, ValueType::valueTypeId)));          \
 	}
@@ -362,14 +741,17 @@ EMIT_ATOMIC_CMPXCHG(i64, atomic_rmw_cmpxchg, llvmContext.i64Type, 3, identity, i
 	{                                                                                              \
 		auto value = valueToMem(pop(), llvmMemoryType);                                            \
 		auto address = pop();                                                                      \
-		auto boundedAddress = getOffsetAndBoundedAddress(*this, address, imm.offset);              \
-		trapIfMisalignedAtomic(boundedAddress, alignmentLog2);                                     \
-		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType);                     \
+		auto boundedAddress = getOffsetAndBoundedAddress(                                          \
+			*this, imm.memoryIndex, address, imm.offset, 1 << alignmentLog2);                      \
+		trapIfMisalignedAtomic(address, imm.offset, boundedAddress, alignmentLog2);                \
+		emitMemoryAccessSample(*this, imm.memoryIndex, boundedAddress, 1 << alignmentLog2, true);  \
+		auto pointer = coerceAddressToPointer(boundedAddress, llvmMemoryType, imm.memoryIndex);    \
 		auto atomicRMW = irBuilder.CreateAtomicRMW(llvm::AtomicRMWInst::BinOp::rmwOpId,            \
 												   pointer,                                        \
 												   value,                                          \
 												   llvm::AtomicOrdering::SequentiallyConsistent);  \
 		atomicRMW->setVolatile(true);                                                              \
+		atomicRMW->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.linearMemoryTBAATag);       \
 		push(memToValue(atomicRMW, asLLVMType(llvmContext, ValueType::valueTypeId)));              \
 	}
 
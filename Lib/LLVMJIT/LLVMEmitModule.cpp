@@ -6,10 +6,15 @@
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/ScratchArena.h"
 #include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Logging/Trace.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/BinaryFormat/Dwarf.h"
 #include "llvm/IR/Constants.h"
@@ -19,6 +24,8 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
@@ -33,14 +40,45 @@ using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
 using namespace WAVM::Runtime;
 
-EmitModuleContext::EmitModuleContext(const IR::Module& inIRModule,
-									 LLVMContext& inLLVMContext,
-									 llvm::Module* inLLVMModule)
+// Accesses to 64-bit memories are always bounds checked, since their reserved address space can't
+// cover every 64-bit address.
+static bool hasMemory64(const IR::Module& irModule)
+{
+	for(Uptr memoryIndex = 0; memoryIndex < irModule.memories.size(); ++memoryIndex)
+	{
+		if(irModule.memories.getType(memoryIndex).indexType == IndexType::i64) { return true; }
+	}
+	return false;
+}
+
+EmitModuleContext::EmitModuleContext(
+	const IR::Module& inIRModule,
+	LLVMContext& inLLVMContext,
+	llvm::Module* inLLVMModule,
+	bool inEmitMemoryBoundsChecks,
+	bool inEmitEpochChecks,
+	bool inEmitFuelMetering,
+	bool inEmitStackLimitChecks,
+	bool inCanonicalizeNaNs,
+	const std::map<std::pair<Uptr, Uptr>, Uptr>& inSpeculatedIndirectCallees)
 : irModule(inIRModule)
 , llvmContext(inLLVMContext)
 , llvmModule(inLLVMModule)
-, defaultMemoryOffset(nullptr)
+, emitMemoryBoundsChecks(inEmitMemoryBoundsChecks || hasMemory64(inIRModule))
+, emitEpochChecks(inEmitEpochChecks)
+, emitFuelMetering(inEmitFuelMetering)
+, emitStackLimitChecks(inEmitStackLimitChecks)
+, canonicalizeNaNs(inCanonicalizeNaNs)
+, speculatedIndirectCallees(inSpeculatedIndirectCallees)
 , defaultTableOffset(nullptr)
+, epochAddress(nullptr)
+, profileCounters(nullptr)
+, emitProfileCycles(false)
+, profile(nullptr)
+, emitMemoryAccessSampling(false)
+, emitRelaxedMemoryAccesses(false)
+, specializedGlobalImports(nullptr)
+, simdISA(TargetSIMDISA::generic)
 , diBuilder(*inLLVMModule)
 {
 	diModuleScope = diBuilder.createFile("unknown", "unknown");
@@ -90,6 +128,26 @@ EmitModuleContext::EmitModuleContext(const IR::Module& inIRModule,
 	}
 }
 
+llvm::Function* EmitModuleContext::getFunction(Uptr functionIndex)
+{
+	wavmAssert(functionIndex < functions.size());
+	if(!functions[functionIndex])
+	{
+		FunctionType functionType = irModule.types[irModule.functions.getType(functionIndex).index];
+
+		llvm::Function* function = llvm::Function::Create(
+			asLLVMType(llvmContext, functionType, CallingConvention::wasm),
+			llvm::Function::ExternalLinkage,
+			functionIndex >= irModule.functions.imports.size()
+				? getExternalName("functionDef", functionIndex - irModule.functions.imports.size())
+				: getExternalName("functionImport", functionIndex),
+			llvmModule);
+		function->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
+		functions[functionIndex] = function;
+	}
+	return functions[functionIndex];
+}
+
 static llvm::Constant* createImportedConstant(llvm::Module& llvmModule, llvm::Twine externalName)
 {
 	return new llvm::GlobalVariable(llvmModule,
@@ -100,12 +158,78 @@ static llvm::Constant* createImportedConstant(llvm::Module& llvmModule, llvm::Tw
 									externalName);
 }
 
+static void emitFoldedFunctionDef(EmitModuleContext& moduleContext,
+								  llvm::Function* function,
+								  llvm::Function* foldedFunction)
+{
+	llvm::IRBuilder<> irBuilder(
+		llvm::BasicBlock::Create(moduleContext.llvmContext, "entry", function));
+
+	llvm::SmallVector<llvm::Value*, 8> arguments;
+	for(llvm::Argument& argument : function->args()) { arguments.push_back(&argument); }
+
+	llvm::CallInst* call = irBuilder.CreateCall(foldedFunction, arguments);
+	call->setCallingConv(foldedFunction->getCallingConv());
+	call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+	if(function->getReturnType()->isVoidTy()) { irBuilder.CreateRetVoid(); }
+	else
+	{
+		irBuilder.CreateRet(call);
+	}
+}
+
+static Metrics::Histogram emitTimeHistogram(
+	"llvmjit.emit_us",
+	"Time to emit the LLVM IR for a module in microseconds");
+
 void LLVMJIT::emitModule(const IR::Module& irModule,
 						 LLVMContext& llvmContext,
-						 llvm::Module& outLLVMModule)
+						 llvm::Module& outLLVMModule,
+						 const std::vector<Uptr>& functionDefIndices,
+						 const std::vector<Uptr>& foldedFunctionDefIndices,
+						 bool emitMemoryBoundsChecks,
+						 bool emitEpochChecks,
+						 bool emitFuelMetering,
+						 bool emitStackLimitChecks,
+						 bool canonicalizeNaNs,
+						 bool emitMemoryAccessSampling,
+						 bool emitRelaxedMemoryAccesses,
+						 bool emitProfileInstrumentation,
+						 bool emitProfileCycles,
+						 const std::map<std::pair<Uptr, Uptr>, Uptr>& speculatedIndirectCallees,
+						 const std::map<Uptr, IR::Value>& specializedGlobalImports,
+						 const ModuleProfile* profile,
+						 TargetSIMDISA simdISA)
 {
+	Trace::Span traceSpan("emitModule");
+
+	// Speculate that each call_indirect in the profile calls its most frequent profiled callee,
+	// unless the caller speculated a different callee for it.
+	std::map<std::pair<Uptr, Uptr>, Uptr> profiledSpeculatedIndirectCallees;
+	if(profile && profile->indirectCallees.size())
+	{
+		profiledSpeculatedIndirectCallees = profile->indirectCallees;
+		for(const auto& speculatedCallee : speculatedIndirectCallees)
+		{ profiledSpeculatedIndirectCallees[speculatedCallee.first] = speculatedCallee.second; }
+	}
+
 	Timing::Timer emitTimer;
-	EmitModuleContext moduleContext(irModule, llvmContext, &outLLVMModule);
+	EmitModuleContext moduleContext(irModule,
+									llvmContext,
+									&outLLVMModule,
+									emitMemoryBoundsChecks,
+									emitEpochChecks,
+									emitFuelMetering,
+									emitStackLimitChecks,
+									canonicalizeNaNs,
+									profiledSpeculatedIndirectCallees.size()
+										? profiledSpeculatedIndirectCallees
+										: speculatedIndirectCallees);
+	moduleContext.profile = profile;
+	moduleContext.specializedGlobalImports = &specializedGlobalImports;
+	moduleContext.simdISA = simdISA;
+	moduleContext.emitMemoryAccessSampling = emitMemoryAccessSampling;
+	moduleContext.emitRelaxedMemoryAccesses = emitRelaxedMemoryAccesses;
 
 	// Create an external reference to the appropriate exception personality function.
 	auto personalityFunction
@@ -146,8 +270,6 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 			createImportedConstant(outLLVMModule, getExternalName("memoryOffset", memoryIndex)),
 			llvmContext.iptrType));
 	}
-	if(moduleContext.memoryOffsets.size())
-	{ moduleContext.defaultMemoryOffset = moduleContext.memoryOffsets[0]; }
 
 	// Create LLVM external globals for the module's globals.
 	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
@@ -172,30 +294,28 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 	moduleContext.tableReferenceBias = llvm::ConstantExpr::getPtrToInt(
 		createImportedConstant(outLLVMModule, "tableReferenceBias"), llvmContext.iptrType);
 
-	// Create the LLVM functions.
-	moduleContext.functions.resize(irModule.functions.size());
-	for(Uptr functionIndex = 0; functionIndex < irModule.functions.size(); ++functionIndex)
-	{
-		FunctionType functionType = irModule.types[irModule.functions.getType(functionIndex).index];
+	// Create a LLVM external global that will point to the epoch counter.
+	if(emitEpochChecks)
+	{ moduleContext.epochAddress = createImportedConstant(outLLVMModule, "epoch"); }
 
-		llvm::Function* function = llvm::Function::Create(
-			asLLVMType(llvmContext, functionType, CallingConvention::wasm),
-			llvm::Function::ExternalLinkage,
-			functionIndex >= irModule.functions.imports.size()
-				? getExternalName("functionDef", functionIndex - irModule.functions.imports.size())
-				: getExternalName("functionImport", functionIndex),
-			&outLLVMModule);
-		function->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
-		moduleContext.functions[functionIndex] = function;
+	// Create a LLVM external global that will point to the profile counters.
+	if(emitProfileInstrumentation)
+	{
+		moduleContext.profileCounters = createImportedConstant(outLLVMModule, "profileCounters");
+		moduleContext.profileCounterBaseIndices = getProfileCounterBaseIndices(irModule);
+		moduleContext.emitProfileCycles = emitProfileCycles;
 	}
 
-	// Compile each function in the module.
-	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
-		++functionDefIndex)
+	// The LLVM functions are declared when they are first used.
+	moduleContext.functions.resize(irModule.functions.size(), nullptr);
+
+	// Compile each of the function definitions that are emitted.
+	for(Uptr functionDefIndex : functionDefIndices)
 	{
+		wavmAssert(functionDefIndex < irModule.functions.defs.size());
 		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
 		llvm::Function* function
-			= moduleContext.functions[irModule.functions.imports.size() + functionDefIndex];
+			= moduleContext.getFunction(irModule.functions.imports.size() + functionDefIndex);
 
 		function->setPersonalityFn(personalityFunction);
 
@@ -208,11 +328,69 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 			llvm::ArrayType::get(llvmContext.iptrType, 2),
 			{functionInstance, moduleContext.typeIds[functionDef.type.index]}));
 
-		EmitFunctionContext(llvmContext, moduleContext, irModule, functionDef, function).emit();
+		// Annotate the function with its profiled entry count.
+		if(profile && functionDefIndex < profile->functionDefEntryCounts.size())
+		{ function->setEntryCount(profile->functionDefEntryCounts[functionDefIndex]); }
+
+		if(foldedFunctionDefIndices.size()
+		   && foldedFunctionDefIndices[functionDefIndex] != functionDefIndex)
+		{
+			// If the function definition is identical to an earlier function definition, emit it
+			// as a tail call to the earlier definition. The function keeps its own prefix data, so
+			// references to it still identify its own function instance.
+			wavmAssert(foldedFunctionDefIndices[functionDefIndex] < functionDefIndex);
+			emitFoldedFunctionDef(moduleContext,
+								  function,
+								  moduleContext.getFunction(
+									  irModule.functions.imports.size()
+									  + foldedFunctionDefIndices[functionDefIndex]));
+			continue;
+		}
+
+		// Free the function's scratch allocations once it has been emitted, so the next function
+		// reuses them.
+		ScratchScope scratchScope;
+		EmitFunctionContext(
+			llvmContext, moduleContext, irModule, functionDefIndex, functionDef, function)
+			.emit();
+	}
+
+	// If all the module's function definitions are emitted, give the ones that can only be called
+	// directly by the module's code internal linkage, so the optimizer may delete them once they
+	// have been inlined into all their callers. The exported functions, the functions in table
+	// segments, and the start function may be called through their function instances, so they
+	// stay external. ref.func takes the address of its function, which stops the optimizer from
+	// deleting it.
+	if(functionDefIndices.size() == irModule.functions.defs.size())
+	{
+		std::vector<bool> isFunctionReferenced(irModule.functions.size(), false);
+		for(const Export& exportIt : irModule.exports)
+		{
+			if(exportIt.kind == ObjectKind::function)
+			{ isFunctionReferenced[exportIt.index] = true; }
+		}
+		for(const TableSegment& tableSegment : irModule.tableSegments)
+		{
+			for(Uptr functionIndex : tableSegment.indices)
+			{ isFunctionReferenced[functionIndex] = true; }
+		}
+		if(irModule.startFunctionIndex != UINTPTR_MAX)
+		{ isFunctionReferenced[irModule.startFunctionIndex] = true; }
+
+		for(Uptr functionDefIndex : functionDefIndices)
+		{
+			const Uptr functionIndex = irModule.functions.imports.size() + functionDefIndex;
+			if(!isFunctionReferenced[functionIndex])
+			{
+				moduleContext.getFunction(functionIndex)
+					->setLinkage(llvm::Function::InternalLinkage);
+			}
+		}
 	}
 
 	// Finalize the debug info.
 	moduleContext.diBuilder.finalize();
 
 	Timing::logRatePerSecond("Emitted LLVM IR", emitTimer, (F64)outLLVMModule.size(), "functions");
+	emitTimeHistogram.record(emitTimer.getMicroseconds());
 }
@@ -14,20 +14,47 @@ namespace WAVM { namespace LLVMJIT {
 
 		LLVMContext& llvmContext;
 		llvm::Module* llvmModule;
+		const bool emitMemoryBoundsChecks;
+		const bool emitEpochChecks;
+		const bool emitFuelMetering;
+		const bool emitStackLimitChecks;
+		const bool canonicalizeNaNs;
+		const std::map<std::pair<Uptr, Uptr>, Uptr>& speculatedIndirectCallees;
 		std::vector<llvm::Constant*> typeIds;
 		std::vector<llvm::Constant*> functionDefInstances;
+		// The LLVM functions for the module's functions, declared on first use by getFunction:
+		// each partition of a module is emitted into its own LLVM module, and only needs to
+		// declare the functions that it defines or references.
 		std::vector<llvm::Function*> functions;
 		std::vector<llvm::Constant*> tableOffsets;
 		std::vector<llvm::Constant*> memoryOffsets;
 		std::vector<llvm::Constant*> globals;
 		std::vector<llvm::Constant*> exceptionTypeInstances;
 
-		llvm::Constant* defaultMemoryOffset;
 		llvm::Constant* defaultTableOffset;
 
 		llvm::Constant* moduleInstancePointer;
 		llvm::Constant* tableReferenceBias;
 
+		// Only set if the module is compiled with epoch checks.
+		llvm::Constant* epochAddress;
+
+		// Only set if the module is compiled with profile instrumentation.
+		llvm::Constant* profileCounters;
+		std::vector<Uptr> profileCounterBaseIndices;
+		bool emitProfileCycles;
+
+		// Only set if the module is compiled with a profile.
+		const ModuleProfile* profile;
+
+		bool emitMemoryAccessSampling;
+		bool emitRelaxedMemoryAccesses;
+
+		// The values of the immutable imported globals that the code is specialized for.
+		const std::map<Uptr, IR::Value>* specializedGlobalImports;
+
+		TargetSIMDISA simdISA;
+
 		llvm::DIBuilder diBuilder;
 		llvm::DICompileUnit* diCompileUnit;
 		llvm::DIFile* diModuleScope;
@@ -45,7 +72,15 @@ namespace WAVM { namespace LLVMJIT {
 
 		EmitModuleContext(const IR::Module& inModule,
 						  LLVMContext& inLLVMContext,
-						  llvm::Module* inLLVMModule);
+						  llvm::Module* inLLVMModule,
+						  bool inEmitMemoryBoundsChecks,
+						  bool inEmitEpochChecks,
+						  bool inEmitFuelMetering,
+						  bool inEmitStackLimitChecks,
+						  bool inCanonicalizeNaNs,
+						  const std::map<std::pair<Uptr, Uptr>, Uptr>& inSpeculatedIndirectCallees);
+
+		llvm::Function* getFunction(Uptr functionIndex);
 
 		inline llvm::Function* getLLVMIntrinsic(llvm::ArrayRef<llvm::Type*> typeArguments,
 												llvm::Intrinsic::ID id)
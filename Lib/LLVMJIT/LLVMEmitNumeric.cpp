@@ -233,45 +233,70 @@ EMIT_INT_UNARY_OP(
 // FP operators
 //
 
+llvm::Value* EmitFunctionContext::emitCanonicalizeNaNs(llvm::Value* value)
+{
+	if(!moduleContext.canonicalizeNaNs) { return value; }
+
+	// Select the canonical NaN for each NaN scalar or lane. This doesn't branch, and is lowered to
+	// a compare and blend for vectors.
+	llvm::Type* type = value->getType();
+	llvm::Type* scalarType = type->getScalarType();
+	llvm::Constant* canonicalNaN
+		= scalarType == llvmContext.f32Type
+			  ? llvm::ConstantExpr::getBitCast(emitLiteral(llvmContext, U32(0x7fc00000)),
+											   scalarType)
+			  : llvm::ConstantExpr::getBitCast(emitLiteral(llvmContext, U64(0x7ff8000000000000)),
+											   scalarType);
+	llvm::Value* canonicalNaNs = canonicalNaN;
+	if(type->isVectorTy())
+	{ canonicalNaNs = irBuilder.CreateVectorSplat(type->getVectorNumElements(), canonicalNaN); }
+	return irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(value, value), canonicalNaNs, value);
+}
+
 EMIT_FP_BINARY_OP(add,
-				  callLLVMIntrinsic({left->getType()},
-									llvm::Intrinsic::experimental_constrained_fadd,
-									{left,
-									 right,
-									 moduleContext.fpRoundingModeMetadata,
-									 moduleContext.fpExceptionMetadata}))
+				  emitCanonicalizeNaNs(
+					  callLLVMIntrinsic({left->getType()},
+										llvm::Intrinsic::experimental_constrained_fadd,
+										{left,
+										 right,
+										 moduleContext.fpRoundingModeMetadata,
+										 moduleContext.fpExceptionMetadata})))
 EMIT_FP_BINARY_OP(sub,
-				  callLLVMIntrinsic({left->getType()},
-									llvm::Intrinsic::experimental_constrained_fsub,
-									{left,
-									 right,
-									 moduleContext.fpRoundingModeMetadata,
-									 moduleContext.fpExceptionMetadata}))
+				  emitCanonicalizeNaNs(
+					  callLLVMIntrinsic({left->getType()},
+										llvm::Intrinsic::experimental_constrained_fsub,
+										{left,
+										 right,
+										 moduleContext.fpRoundingModeMetadata,
+										 moduleContext.fpExceptionMetadata})))
 EMIT_FP_BINARY_OP(mul,
-				  callLLVMIntrinsic({left->getType()},
-									llvm::Intrinsic::experimental_constrained_fmul,
-									{left,
-									 right,
-									 moduleContext.fpRoundingModeMetadata,
-									 moduleContext.fpExceptionMetadata}))
+				  emitCanonicalizeNaNs(
+					  callLLVMIntrinsic({left->getType()},
+										llvm::Intrinsic::experimental_constrained_fmul,
+										{left,
+										 right,
+										 moduleContext.fpRoundingModeMetadata,
+										 moduleContext.fpExceptionMetadata})))
 EMIT_FP_BINARY_OP(div,
-				  callLLVMIntrinsic({left->getType()},
-									llvm::Intrinsic::experimental_constrained_fdiv,
-									{left,
-									 right,
-									 moduleContext.fpRoundingModeMetadata,
-									 moduleContext.fpExceptionMetadata}))
+				  emitCanonicalizeNaNs(
+					  callLLVMIntrinsic({left->getType()},
+										llvm::Intrinsic::experimental_constrained_fdiv,
+										{left,
+										 right,
+										 moduleContext.fpRoundingModeMetadata,
+										 moduleContext.fpExceptionMetadata})))
 EMIT_FP_BINARY_OP(copysign,
 				  callLLVMIntrinsic({left->getType()}, llvm::Intrinsic::copysign, {left, right}))
 
 EMIT_FP_UNARY_OP(neg, irBuilder.CreateFNeg(operand))
 EMIT_FP_UNARY_OP(abs, callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::fabs, {operand}))
 EMIT_FP_UNARY_OP(sqrt,
-				 callLLVMIntrinsic({operand->getType()},
-								   llvm::Intrinsic::experimental_constrained_sqrt,
-								   {operand,
-									moduleContext.fpRoundingModeMetadata,
-									moduleContext.fpExceptionMetadata}))
+				 emitCanonicalizeNaNs(
+					 callLLVMIntrinsic({operand->getType()},
+									   llvm::Intrinsic::experimental_constrained_sqrt,
+									   {operand,
+										moduleContext.fpRoundingModeMetadata,
+										moduleContext.fpExceptionMetadata})))
 
 #define EMIT_FP_COMPARE_OP(name, predicate, llvmOperandType, llvmResultType)                       \
 	void EmitFunctionContext::name(NoImm)                                                          \
@@ -294,31 +319,86 @@ EMIT_FP_COMPARE(le, llvm::CmpInst::FCMP_OLE)
 EMIT_FP_COMPARE(gt, llvm::CmpInst::FCMP_OGT)
 EMIT_FP_COMPARE(ge, llvm::CmpInst::FCMP_OGE)
 
-// These operations don't match LLVM's semantics exactly, so just call out to C++ implementations.
-EMIT_FP_BINARY_OP(min,
-				  emitRuntimeIntrinsic(type == ValueType::f32 ? "f32.min" : "f64.min",
-									   FunctionType(TypeTuple(type), TypeTuple{type, type}),
-									   {left, right})[0])
-EMIT_FP_BINARY_OP(max,
-				  emitRuntimeIntrinsic(type == ValueType::f32 ? "f32.max" : "f64.max",
-									   FunctionType(TypeTuple(type), TypeTuple{type, type}),
-									   {left, right})[0])
-EMIT_FP_UNARY_OP(ceil,
-				 emitRuntimeIntrinsic(type == ValueType::f32 ? "f32.ceil" : "f64.ceil",
-									  FunctionType(TypeTuple(type), TypeTuple{type}),
-									  {operand})[0])
+// Sets the most significant bit of a NaN's significand to make it a quiet NaN.
+static llvm::Value* emitQuietNaN(EmitFunctionContext& functionContext, llvm::Value* nan)
+{
+	llvm::IRBuilder<>& irBuilder = functionContext.irBuilder;
+	llvm::Type* floatType = nan->getType();
+	if(floatType == functionContext.llvmContext.f32Type)
+	{
+		llvm::Value* bits = irBuilder.CreateBitCast(nan, functionContext.llvmContext.i32Type);
+		bits = irBuilder.CreateOr(bits, emitLiteral(functionContext.llvmContext, U32(1) << 22));
+		return irBuilder.CreateBitCast(bits, floatType);
+	}
+	else
+	{
+		llvm::Value* bits = irBuilder.CreateBitCast(nan, functionContext.llvmContext.i64Type);
+		bits = irBuilder.CreateOr(bits, emitLiteral(functionContext.llvmContext, U64(1) << 51));
+		return irBuilder.CreateBitCast(bits, floatType);
+	}
+}
+
+// LLVM's rounding intrinsics match WebAssembly's ceil/floor/trunc/nearest semantics except for not
+// guaranteeing a quiet NaN result, so select the quieted operand for NaN inputs. On X86 CPUs with
+// SSE4.1 the intrinsics are lowered to roundss/roundsd; otherwise they are lowered to calls to the
+// C library's ceil/floor/trunc/nearbyint.
+static llvm::Value* emitFloatRound(EmitFunctionContext& functionContext,
+								   llvm::Intrinsic::ID intrinsicId,
+								   llvm::Value* operand)
+{
+	llvm::IRBuilder<>& irBuilder = functionContext.irBuilder;
+	llvm::Value* rounded
+		= functionContext.callLLVMIntrinsic({operand->getType()}, intrinsicId, {operand});
+	return irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(operand, operand),
+								  emitQuietNaN(functionContext, operand),
+								  rounded);
+}
+
+// WebAssembly's min and max propagate NaN operands, and order -0 below +0, which doesn't match
+// LLVM's minnum/maxnum or X86's minss/maxss. Emit a compare and select with fixups for those cases:
+// if the operands compare equal, they are either identical or zeroes of different sign, so OR-ing
+// (for min) or AND-ing (for max) their bits yields the correctly signed zero.
+static llvm::Value* emitFloatMinOrMax(EmitFunctionContext& functionContext,
+									  bool isMin,
+									  llvm::Value* left,
+									  llvm::Value* right)
+{
+	llvm::IRBuilder<>& irBuilder = functionContext.irBuilder;
+	llvm::Type* floatType = left->getType();
+	llvm::Type* intType = floatType == functionContext.llvmContext.f32Type
+							  ? functionContext.llvmContext.i32Type
+							  : functionContext.llvmContext.i64Type;
+
+	llvm::Value* leftBits = irBuilder.CreateBitCast(left, intType);
+	llvm::Value* rightBits = irBuilder.CreateBitCast(right, intType);
+	llvm::Value* equalResult = irBuilder.CreateBitCast(
+		isMin ? irBuilder.CreateOr(leftBits, rightBits) : irBuilder.CreateAnd(leftBits, rightBits),
+		floatType);
+
+	llvm::Value* orderedResult
+		= irBuilder.CreateSelect(isMin ? irBuilder.CreateFCmpOLT(left, right)
+									   : irBuilder.CreateFCmpOGT(left, right),
+								 left,
+								 right);
+	orderedResult
+		= irBuilder.CreateSelect(irBuilder.CreateFCmpOEQ(left, right), equalResult, orderedResult);
+
+	// If either operand is a NaN, return the first NaN operand as a quiet NaN.
+	llvm::Value* firstNaN
+		= irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(left, left), left, right);
+	llvm::Value* nanResult = emitQuietNaN(functionContext, firstNaN);
+	return irBuilder.CreateSelect(irBuilder.CreateFCmpUNO(left, right), nanResult, orderedResult);
+}
+
+EMIT_FP_BINARY_OP(min, emitCanonicalizeNaNs(emitFloatMinOrMax(*this, true, left, right)))
+EMIT_FP_BINARY_OP(max, emitCanonicalizeNaNs(emitFloatMinOrMax(*this, false, left, right)))
+EMIT_FP_UNARY_OP(ceil, emitCanonicalizeNaNs(emitFloatRound(*this, llvm::Intrinsic::ceil, operand)))
 EMIT_FP_UNARY_OP(floor,
-				 emitRuntimeIntrinsic(type == ValueType::f32 ? "f32.floor" : "f64.floor",
-									  FunctionType(TypeTuple(type), TypeTuple{type}),
-									  {operand})[0])
+				 emitCanonicalizeNaNs(emitFloatRound(*this, llvm::Intrinsic::floor, operand)))
 EMIT_FP_UNARY_OP(trunc,
-				 emitRuntimeIntrinsic(type == ValueType::f32 ? "f32.trunc" : "f64.trunc",
-									  FunctionType(TypeTuple(type), TypeTuple{type}),
-									  {operand})[0])
+				 emitCanonicalizeNaNs(emitFloatRound(*this, llvm::Intrinsic::trunc, operand)))
 EMIT_FP_UNARY_OP(nearest,
-				 emitRuntimeIntrinsic(type == ValueType::f32 ? "f32.nearest" : "f64.nearest",
-									  FunctionType(TypeTuple(type), TypeTuple{type}),
-									  {operand})[0])
+				 emitCanonicalizeNaNs(emitFloatRound(*this, llvm::Intrinsic::nearbyint, operand)))
 
 EMIT_SIMD_INT_BINARY_OP(add, irBuilder.CreateAdd(left, right))
 EMIT_SIMD_INT_BINARY_OP(sub, irBuilder.CreateSub(left, right))
@@ -393,6 +473,17 @@ EMIT_INT_COMPARE(ge_u, llvm::CmpInst::ICMP_UGE)
 
 EMIT_SIMD_INT_UNARY_OP(neg, irBuilder.CreateNeg(operand))
 
+llvm::Value* EmitFunctionContext::emitSIMDIntrinsic(llvm::Intrinsic::ID x86IntrinsicId,
+													 llvm::Intrinsic::ID aarch64IntrinsicId,
+													 llvm::Type* vectorType,
+													 llvm::ArrayRef<llvm::Value*> arguments)
+{
+	// The AArch64 intrinsics are overloaded on the vector type, but the x86 intrinsics aren't.
+	return moduleContext.simdISA == TargetSIMDISA::aarch64NEON
+			   ? callLLVMIntrinsic({vectorType}, aarch64IntrinsicId, arguments)
+			   : callLLVMIntrinsic({}, x86IntrinsicId, arguments);
+}
+
 static llvm::Value* emitAddUnsignedSaturated(llvm::IRBuilder<>& irBuilder,
 											 llvm::Value* left,
 											 llvm::Value* right,
@@ -420,25 +511,37 @@ static llvm::Value* emitSubUnsignedSaturated(llvm::IRBuilder<>& irBuilder,
 
 EMIT_SIMD_BINARY_OP(i8x16_add_saturate_s,
 					llvmContext.i8x16Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_padds_b, {left, right}))
+					emitSIMDIntrinsic(llvm::Intrinsic::x86_sse2_padds_b,
+									  llvm::Intrinsic::aarch64_neon_sqadd,
+									  llvmContext.i8x16Type,
+									  {left, right}))
 EMIT_SIMD_BINARY_OP(i8x16_add_saturate_u,
 					llvmContext.i8x16Type,
 					emitAddUnsignedSaturated(irBuilder, left, right, llvmContext.i8x16Type))
 EMIT_SIMD_BINARY_OP(i8x16_sub_saturate_s,
 					llvmContext.i8x16Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_psubs_b, {left, right}))
+					emitSIMDIntrinsic(llvm::Intrinsic::x86_sse2_psubs_b,
+									  llvm::Intrinsic::aarch64_neon_sqsub,
+									  llvmContext.i8x16Type,
+									  {left, right}))
 EMIT_SIMD_BINARY_OP(i8x16_sub_saturate_u,
 					llvmContext.i8x16Type,
 					emitSubUnsignedSaturated(irBuilder, left, right, llvmContext.i8x16Type))
 EMIT_SIMD_BINARY_OP(i16x8_add_saturate_s,
 					llvmContext.i16x8Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_padds_w, {left, right}))
+					emitSIMDIntrinsic(llvm::Intrinsic::x86_sse2_padds_w,
+									  llvm::Intrinsic::aarch64_neon_sqadd,
+									  llvmContext.i16x8Type,
+									  {left, right}))
 EMIT_SIMD_BINARY_OP(i16x8_add_saturate_u,
 					llvmContext.i16x8Type,
 					emitAddUnsignedSaturated(irBuilder, left, right, llvmContext.i16x8Type))
 EMIT_SIMD_BINARY_OP(i16x8_sub_saturate_s,
 					llvmContext.i16x8Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_psubs_w, {left, right}))
+					emitSIMDIntrinsic(llvm::Intrinsic::x86_sse2_psubs_w,
+									  llvm::Intrinsic::aarch64_neon_sqsub,
+									  llvmContext.i16x8Type,
+									  {left, right}))
 EMIT_SIMD_BINARY_OP(i16x8_sub_saturate_u,
 					llvmContext.i16x8Type,
 					emitSubUnsignedSaturated(irBuilder, left, right, llvmContext.i16x8Type))
@@ -474,99 +577,131 @@ llvm::Value* EmitFunctionContext::emitVectorSelect(llvm::Value* condition,
 								   trueValue->getType());
 }
 
-EMIT_SIMD_FP_BINARY_OP(add, irBuilder.CreateFAdd(left, right))
-EMIT_SIMD_FP_BINARY_OP(sub, irBuilder.CreateFSub(left, right))
-EMIT_SIMD_FP_BINARY_OP(mul, irBuilder.CreateFMul(left, right))
-EMIT_SIMD_FP_BINARY_OP(div, irBuilder.CreateFDiv(left, right))
+EMIT_SIMD_FP_BINARY_OP(add, emitCanonicalizeNaNs(irBuilder.CreateFAdd(left, right)))
+EMIT_SIMD_FP_BINARY_OP(sub, emitCanonicalizeNaNs(irBuilder.CreateFSub(left, right)))
+EMIT_SIMD_FP_BINARY_OP(mul, emitCanonicalizeNaNs(irBuilder.CreateFMul(left, right)))
+EMIT_SIMD_FP_BINARY_OP(div, emitCanonicalizeNaNs(irBuilder.CreateFDiv(left, right)))
 
 EMIT_SIMD_BINARY_OP(f32x4_min,
 					llvmContext.f32x4Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse_min_ps, {left, right}))
+					emitCanonicalizeNaNs(
+						callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse_min_ps, {left, right})))
 EMIT_SIMD_BINARY_OP(f64x2_min,
 					llvmContext.f64x2Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_min_pd, {left, right}))
+					emitCanonicalizeNaNs(
+						callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_min_pd, {left, right})))
 EMIT_SIMD_BINARY_OP(f32x4_max,
 					llvmContext.f32x4Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse_max_ps, {left, right}))
+					emitCanonicalizeNaNs(
+						callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse_max_ps, {left, right})))
 EMIT_SIMD_BINARY_OP(f64x2_max,
 					llvmContext.f64x2Type,
-					callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_max_pd, {left, right}))
+					emitCanonicalizeNaNs(
+						callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_max_pd, {left, right})))
 
 EMIT_SIMD_FP_UNARY_OP(neg, irBuilder.CreateFNeg(operand))
 EMIT_SIMD_FP_UNARY_OP(abs,
 					  callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::fabs, {operand}))
 EMIT_SIMD_FP_UNARY_OP(sqrt,
-					  callLLVMIntrinsic({operand->getType()}, llvm::Intrinsic::sqrt, {operand}))
+					  emitCanonicalizeNaNs(callLLVMIntrinsic(
+						  {operand->getType()}, llvm::Intrinsic::sqrt, {operand})))
 
-static llvm::Value* emitAnyTrue(llvm::IRBuilder<>& irBuilder,
-								llvm::Value* vector,
-								llvm::Type* vectorType)
+llvm::Value* EmitFunctionContext::emitAnyTrue(llvm::Value* vector)
 {
-	vector = irBuilder.CreateBitCast(vector, vectorType);
-
-	const U32 numScalarBits = vectorType->getScalarSizeInBits();
-	const Uptr numLanes = vectorType->getVectorNumElements();
-	llvm::Constant* zero
-		= llvm::ConstantInt::get(vectorType->getScalarType(), llvm::APInt(numScalarBits, 0));
-
-	llvm::Value* result = nullptr;
-	for(Uptr laneIndex = 0; laneIndex < numLanes; ++laneIndex)
+	if(moduleContext.simdISA >= TargetSIMDISA::x86SSE41)
 	{
-		llvm::Value* scalar = irBuilder.CreateExtractElement(vector, laneIndex);
-		llvm::Value* scalarBool = irBuilder.CreateICmpNE(scalar, zero);
-
-		result = result ? irBuilder.CreateOr(result, scalarBool) : scalarBool;
+		// ptestz returns 1 if the vector is all zero bits.
+		vector = irBuilder.CreateBitCast(vector, llvmContext.i64x2Type);
+		llvm::Value* isZero
+			= callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse41_ptestz, {vector, vector});
+		return irBuilder.CreateXor(isZero, emitLiteral(llvmContext, U32(1)));
+	}
+	else if(moduleContext.simdISA == TargetSIMDISA::aarch64NEON)
+	{
+		// umaxv returns the greatest lane, which is non-zero if any bit is non-zero.
+		vector = irBuilder.CreateBitCast(vector, llvmContext.i32x4Type);
+		llvm::Value* maxLane = callLLVMIntrinsic({llvmContext.i32Type, llvmContext.i32x4Type},
+												 llvm::Intrinsic::aarch64_neon_umaxv,
+												 {vector});
+		return zext(irBuilder.CreateICmpNE(maxLane, emitLiteral(llvmContext, U32(0))),
+					llvmContext.i32Type);
+	}
+	else
+	{
+		// Whether any lane is non-zero doesn't depend on the lane width, so compare the whole
+		// vector to zero at once instead of extracting each lane.
+		llvm::Type* i128Type = llvm::Type::getIntNTy(llvmContext, 128);
+		vector = irBuilder.CreateBitCast(vector, i128Type);
+		return zext(irBuilder.CreateICmpNE(vector, llvm::Constant::getNullValue(i128Type)),
+					llvmContext.i32Type);
 	}
-	return irBuilder.CreateZExt(result, llvm::Type::getInt32Ty(irBuilder.getContext()));
 }
 
-static llvm::Value* emitAllTrue(llvm::IRBuilder<>& irBuilder,
-								llvm::Value* vector,
-								llvm::Type* vectorType)
+llvm::Value* EmitFunctionContext::emitAllTrue(llvm::Value* vector, llvm::Type* vectorType)
 {
 	vector = irBuilder.CreateBitCast(vector, vectorType);
 
-	const U32 numScalarBits = vectorType->getScalarSizeInBits();
 	const Uptr numLanes = vectorType->getVectorNumElements();
-	llvm::Constant* zero
-		= llvm::ConstantInt::get(vectorType->getScalarType(), llvm::APInt(numScalarBits, 0));
+	llvm::Value* isZeroMask
+		= irBuilder.CreateICmpEQ(vector, llvm::Constant::getNullValue(vectorType));
 
-	llvm::Value* result = nullptr;
-	for(Uptr laneIndex = 0; laneIndex < numLanes; ++laneIndex)
+	if(moduleContext.simdISA == TargetSIMDISA::x86SSE41)
 	{
-		llvm::Value* scalar = irBuilder.CreateExtractElement(vector, laneIndex);
-		llvm::Value* scalarBool = irBuilder.CreateICmpNE(scalar, zero);
-
-		result = result ? irBuilder.CreateAnd(result, scalarBool) : scalarBool;
+		// Compare each lane to zero, and use ptestz to check that the comparison was false for all
+		// of them.
+		llvm::Value* zeroLanes
+			= irBuilder.CreateBitCast(sext(isZeroMask, vectorType), llvmContext.i64x2Type);
+		return callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse41_ptestz, {zeroLanes, zeroLanes});
+	}
+	else if(moduleContext.simdISA == TargetSIMDISA::x86SSE2)
+	{
+		// Compare each lane to zero, and use pmovmskb to check that the comparison was false for
+		// all of them.
+		llvm::Value* zeroLanes
+			= irBuilder.CreateBitCast(sext(isZeroMask, vectorType), llvmContext.i8x16Type);
+		llvm::Value* zeroLaneBytes
+			= callLLVMIntrinsic({}, llvm::Intrinsic::x86_sse2_pmovmskb_128, {zeroLanes});
+		return zext(irBuilder.CreateICmpEQ(zeroLaneBytes, emitLiteral(llvmContext, U32(0))),
+					llvmContext.i32Type);
+	}
+	else if(moduleContext.simdISA == TargetSIMDISA::aarch64NEON && numLanes > 2)
+	{
+		// uminv returns the least lane, which is non-zero if all lanes are non-zero. It doesn't
+		// support 64-bit lanes, so those use the generic lowering.
+		llvm::Value* minLane = callLLVMIntrinsic(
+			{llvmContext.i32Type, vectorType}, llvm::Intrinsic::aarch64_neon_uminv, {vector});
+		return zext(irBuilder.CreateICmpNE(minLane, emitLiteral(llvmContext, U32(0))),
+					llvmContext.i32Type);
+	}
+	else
+	{
+		// Pack the per-lane comparisons into an integer with a bit per lane, and check that it's
+		// zero. On AVX-512, LLVM lowers this to a vptestnm and a kortest.
+		llvm::Type* maskIntType = llvm::Type::getIntNTy(llvmContext, U32(numLanes));
+		llvm::Value* zeroLaneBits = irBuilder.CreateBitCast(isZeroMask, maskIntType);
+		return zext(
+			irBuilder.CreateICmpEQ(zeroLaneBits, llvm::Constant::getNullValue(maskIntType)),
+			llvmContext.i32Type);
 	}
-	return irBuilder.CreateZExt(result, llvm::Type::getInt32Ty(irBuilder.getContext()));
 }
 
-EMIT_SIMD_UNARY_OP(i8x16_any_true,
-				   llvmContext.i8x16Type,
-				   emitAnyTrue(irBuilder, operand, llvmContext.i8x16Type))
-EMIT_SIMD_UNARY_OP(i16x8_any_true,
-				   llvmContext.i16x8Type,
-				   emitAnyTrue(irBuilder, operand, llvmContext.i16x8Type))
-EMIT_SIMD_UNARY_OP(i32x4_any_true,
-				   llvmContext.i32x4Type,
-				   emitAnyTrue(irBuilder, operand, llvmContext.i32x4Type))
-EMIT_SIMD_UNARY_OP(i64x2_any_true,
-				   llvmContext.i64x2Type,
-				   emitAnyTrue(irBuilder, operand, llvmContext.i64x2Type))
+EMIT_SIMD_UNARY_OP(i8x16_any_true, llvmContext.i8x16Type, emitAnyTrue(operand))
+EMIT_SIMD_UNARY_OP(i16x8_any_true, llvmContext.i16x8Type, emitAnyTrue(operand))
+EMIT_SIMD_UNARY_OP(i32x4_any_true, llvmContext.i32x4Type, emitAnyTrue(operand))
+EMIT_SIMD_UNARY_OP(i64x2_any_true, llvmContext.i64x2Type, emitAnyTrue(operand))
 
 EMIT_SIMD_UNARY_OP(i8x16_all_true,
 				   llvmContext.i8x16Type,
-				   emitAllTrue(irBuilder, operand, llvmContext.i8x16Type))
+				   emitAllTrue(operand, llvmContext.i8x16Type))
 EMIT_SIMD_UNARY_OP(i16x8_all_true,
 				   llvmContext.i16x8Type,
-				   emitAllTrue(irBuilder, operand, llvmContext.i16x8Type))
+				   emitAllTrue(operand, llvmContext.i16x8Type))
 EMIT_SIMD_UNARY_OP(i32x4_all_true,
 				   llvmContext.i32x4Type,
-				   emitAllTrue(irBuilder, operand, llvmContext.i32x4Type))
+				   emitAllTrue(operand, llvmContext.i32x4Type))
 EMIT_SIMD_UNARY_OP(i64x2_all_true,
 				   llvmContext.i64x2Type,
-				   emitAllTrue(irBuilder, operand, llvmContext.i64x2Type))
+				   emitAllTrue(operand, llvmContext.i64x2Type))
 
 void EmitFunctionContext::v128_and(IR::NoImm)
 {
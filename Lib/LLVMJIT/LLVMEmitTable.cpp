@@ -37,7 +37,7 @@ void EmitFunctionContext::ref_isnull(NoImm)
 
 void EmitFunctionContext::ref_func(FunctionImm imm)
 {
-	llvm::Value* referencedFunction = moduleContext.functions[imm.functionIndex];
+	llvm::Value* referencedFunction = moduleContext.getFunction(imm.functionIndex);
 	llvm::Value* codeAddress = irBuilder.CreatePtrToInt(referencedFunction, llvmContext.iptrType);
 	llvm::Value* anyFuncAddress = irBuilder.CreateSub(
 		codeAddress, emitLiteral(llvmContext, Uptr(offsetof(Runtime::AnyFunc, code))));
@@ -45,26 +45,116 @@ void EmitFunctionContext::ref_func(FunctionImm imm)
 	push(anyFunc);
 }
 
+llvm::Value* EmitFunctionContext::emitTableElementPointer(Uptr tableIndex,
+														 llvm::Value* elementIndex)
+{
+	// Zero extend the element index to the pointer size.
+	auto elementIndexZExt = zext(elementIndex, llvmContext.iptrType);
+
+	// Only a table defined by this module with no maximum size below 2^32 elements is known to
+	// have enough address-space reserved to index it without a bounds check. For any other table,
+	// check the index against the number of elements the table has reserved.
+	const TableType tableType = irModule.tables.getType(tableIndex);
+	if(tableIndex < irModule.tables.imports.size() || tableType.size.max < IR::maxTableElems)
+	{
+		llvm::Constant* numReservedElementsOffset = llvm::ConstantExpr::getAdd(
+			llvm::ConstantExpr::getMul(
+				getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[tableIndex]),
+				emitLiteral(llvmContext, Uptr(sizeof(Uptr)))),
+			emitLiteral(llvmContext,
+						Uptr(offsetof(Runtime::CompartmentRuntimeData, tableNumReservedElements))));
+		auto numReservedElements = loadFromUntypedPointer(
+			irBuilder.CreateInBoundsGEP(getCompartmentAddress(), {numReservedElementsOffset}),
+			llvmContext.iptrType,
+			llvmContext.runtimeDataTBAATag);
+		emitConditionalTrapIntrinsic(
+			irBuilder.CreateICmpUGE(elementIndexZExt, numReservedElements),
+			"tableIndexOutOfBoundsTrap",
+			FunctionType(),
+			{});
+	}
+
+	auto tableBasePointer = loadFromUntypedPointer(
+		irBuilder.CreateInBoundsGEP(getCompartmentAddress(),
+									{moduleContext.tableOffsets[tableIndex]}),
+		llvmContext.iptrType->getPointerTo(),
+		llvmContext.runtimeDataTBAATag);
+	return irBuilder.CreateInBoundsGEP(tableBasePointer, {elementIndexZExt});
+}
+
 void EmitFunctionContext::table_get(TableImm imm)
 {
 	llvm::Value* index = pop();
-	llvm::Value* result = emitRuntimeIntrinsic(
-		"table.get",
-		FunctionType({ValueType::anyref}, TypeTuple({ValueType::i32, inferValueType<Uptr>()})),
-		{index, getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])})[0];
-	push(result);
+	llvm::Value* elementPointer = emitTableElementPointer(imm.tableIndex, index);
+
+	llvm::LoadInst* biasedValue = irBuilder.CreateLoad(elementPointer);
+	biasedValue->setAtomic(llvm::AtomicOrdering::Acquire);
+	biasedValue->setAlignment(sizeof(Uptr));
+
+	// Elements past the end of the table contain the out-of-bounds sentinel, which has a biased
+	// value of zero.
+	emitConditionalTrapIntrinsic(
+		irBuilder.CreateICmpEQ(biasedValue, emitLiteral(llvmContext, Uptr(0))),
+		"tableIndexOutOfBoundsTrap",
+		FunctionType(),
+		{});
+
+	// Translate the uninitialized sentinel to a null reference.
+	llvm::Value* isNull = irBuilder.CreateICmpEQ(
+		biasedValue, emitLiteral(llvmContext, Uptr(Runtime::uninitializedAnyFuncBiasedValue)));
+	llvm::Value* anyRef = irBuilder.CreateIntToPtr(
+		irBuilder.CreateAdd(biasedValue, moduleContext.tableReferenceBias),
+		llvmContext.anyrefType);
+	push(irBuilder.CreateSelect(
+		isNull, llvm::Constant::getNullValue(llvmContext.anyrefType), anyRef));
 }
 
 void EmitFunctionContext::table_set(TableImm imm)
 {
 	llvm::Value* value = pop();
 	llvm::Value* index = pop();
-	emitRuntimeIntrinsic(
-		"table.set",
-		FunctionType({}, TypeTuple({ValueType::i32, ValueType::anyref, inferValueType<Uptr>()})),
-		{index,
-		 value,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])});
+	llvm::Value* elementPointer = emitTableElementPointer(imm.tableIndex, index);
+
+	// Compute the biased value to store in the table, translating a null reference to the
+	// uninitialized sentinel.
+	llvm::Value* isNull
+		= irBuilder.CreateICmpEQ(value, llvm::Constant::getNullValue(llvmContext.anyrefType));
+	llvm::Value* biasedValue = irBuilder.CreateSelect(
+		isNull,
+		emitLiteral(llvmContext, Uptr(Runtime::uninitializedAnyFuncBiasedValue)),
+		irBuilder.CreateSub(irBuilder.CreatePtrToInt(value, llvmContext.iptrType),
+							moduleContext.tableReferenceBias));
+
+	// Atomically replace the table element, trapping before the write if the element being
+	// replaced is the out-of-bounds sentinel.
+	llvm::LoadInst* initialOldBiasedValue = irBuilder.CreateLoad(elementPointer);
+	initialOldBiasedValue->setAtomic(llvm::AtomicOrdering::Acquire);
+	initialOldBiasedValue->setAlignment(sizeof(Uptr));
+
+	llvm::BasicBlock* entryBlock = irBuilder.GetInsertBlock();
+	llvm::BasicBlock* loopBlock = llvm::BasicBlock::Create(llvmContext, "tableSetLoop", function);
+	llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(llvmContext, "tableSetEnd", function);
+	irBuilder.CreateBr(loopBlock);
+
+	irBuilder.SetInsertPoint(loopBlock);
+	llvm::PHINode* oldBiasedValue = irBuilder.CreatePHI(llvmContext.iptrType, 2);
+	oldBiasedValue->addIncoming(initialOldBiasedValue, entryBlock);
+	emitConditionalTrapIntrinsic(
+		irBuilder.CreateICmpEQ(oldBiasedValue, emitLiteral(llvmContext, Uptr(0))),
+		"tableIndexOutOfBoundsTrap",
+		FunctionType(),
+		{});
+	llvm::Value* exchangeResult
+		= irBuilder.CreateAtomicCmpXchg(elementPointer,
+										oldBiasedValue,
+										biasedValue,
+										llvm::AtomicOrdering::AcquireRelease,
+										llvm::AtomicOrdering::Acquire);
+	oldBiasedValue->addIncoming(irBuilder.CreateExtractValue(exchangeResult, {0}),
+								irBuilder.GetInsertBlock());
+	irBuilder.CreateCondBr(irBuilder.CreateExtractValue(exchangeResult, {1}), endBlock, loopBlock);
+
+	irBuilder.SetInsertPoint(endBlock);
 }
 
 void EmitFunctionContext::table_init(ElemSegmentAndTableImm imm)
@@ -6,10 +6,13 @@
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Operators.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/Errors.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/Constant.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
@@ -24,24 +27,155 @@ using namespace WAVM::LLVMJIT;
 // Local variables
 //
 
+// Follows the chain of trivial PHIs that a local's value may have been replaced by.
+static llvm::Value* resolveLocalValue(EmitFunctionContext& functionContext, llvm::Value* value)
+{
+	while(llvm::PHINode* phi = llvm::dyn_cast<llvm::PHINode>(value))
+	{
+		const auto replacement = functionContext.trivialLocalPHIs.get(phi);
+		if(!replacement) { break; }
+		value = *replacement;
+	}
+	return value;
+}
+
+static llvm::PHINode* createLocalPHI(EmitFunctionContext& functionContext,
+									 llvm::BasicBlock* block,
+									 Uptr localIndex)
+{
+	llvm::Type* type = functionContext.localTypes[localIndex];
+	if(llvm::Instruction* firstNonPHI = block->getFirstNonPHI())
+	{ return llvm::PHINode::Create(type, 2, "", firstNonPHI); }
+	return llvm::PHINode::Create(type, 2, "", block);
+}
+
+static llvm::Value* readLocal(EmitFunctionContext& functionContext,
+							  llvm::BasicBlock* block,
+							  Uptr localIndex);
+
+static void addLocalPHIOperands(EmitFunctionContext& functionContext,
+								llvm::PHINode* phi,
+								Uptr localIndex)
+{
+	for(llvm::BasicBlock* predecessor : llvm::predecessors(phi->getParent()))
+	{ phi->addIncoming(readLocal(functionContext, predecessor, localIndex), predecessor); }
+}
+
+// If a PHI only joins a single value (besides itself), replaces it with that value.
+static llvm::Value* tryRemoveTrivialLocalPHI(EmitFunctionContext& functionContext,
+											 llvm::PHINode* phi)
+{
+	llvm::Value* joinedValue = nullptr;
+	for(unsigned int incomingIndex = 0; incomingIndex < phi->getNumIncomingValues();
+		++incomingIndex)
+	{
+		llvm::Value* incoming
+			= resolveLocalValue(functionContext, phi->getIncomingValue(incomingIndex));
+		if(incoming == phi || incoming == joinedValue) { continue; }
+		if(joinedValue) { return phi; }
+		joinedValue = incoming;
+	}
+	if(!joinedValue) { joinedValue = llvm::UndefValue::get(phi->getType()); }
+
+	phi->replaceAllUsesWith(joinedValue);
+	functionContext.trivialLocalPHIs.addOrFail(phi, joinedValue);
+	return joinedValue;
+}
+
+static llvm::Value* readLocal(EmitFunctionContext& functionContext,
+							  llvm::BasicBlock* block,
+							  Uptr localIndex)
+{
+	// Walk up the chain of single predecessors to the nearest block that either assigns the local
+	// or needs a PHI for it.
+	std::vector<llvm::BasicBlock*> chainBlocks;
+	llvm::Value* value;
+	while(true)
+	{
+		if(const auto def = functionContext.localDefs.get({block, localIndex}))
+		{
+			value = resolveLocalValue(functionContext, *def);
+			break;
+		}
+
+		if(functionContext.unsealedBlocks.contains(block))
+		{
+			// The block may still gain predecessors, so add a PHI whose operands are added when
+			// the block is sealed.
+			llvm::PHINode* phi = createLocalPHI(functionContext, block, localIndex);
+			functionContext.unsealedBlocks.getOrAdd(block).push_back({phi, localIndex});
+			value = phi;
+			functionContext.localDefs.set({block, localIndex}, value);
+			break;
+		}
+
+		if(llvm::BasicBlock* predecessor = block->getSinglePredecessor())
+		{
+			chainBlocks.push_back(block);
+			block = predecessor;
+			continue;
+		}
+
+		if(llvm::pred_begin(block) == llvm::pred_end(block))
+		{
+			// The block is unreachable, so the local's value doesn't matter.
+			value = llvm::UndefValue::get(functionContext.localTypes[localIndex]);
+		}
+		else
+		{
+			// Map the local to the PHI before reading its operands, so cycles in the control flow
+			// graph end at the PHI.
+			llvm::PHINode* phi = createLocalPHI(functionContext, block, localIndex);
+			functionContext.localDefs.set({block, localIndex}, phi);
+			addLocalPHIOperands(functionContext, phi, localIndex);
+			value = tryRemoveTrivialLocalPHI(functionContext, phi);
+		}
+		functionContext.localDefs.set({block, localIndex}, value);
+		break;
+	}
+
+	for(llvm::BasicBlock* chainBlock : chainBlocks)
+	{ functionContext.localDefs.set({chainBlock, localIndex}, value); }
+	return value;
+}
+
+llvm::Value* EmitFunctionContext::getLocal(Uptr localIndex)
+{
+	return readLocal(*this, irBuilder.GetInsertBlock(), localIndex);
+}
+
+void EmitFunctionContext::setLocal(Uptr localIndex, llvm::Value* value)
+{
+	localDefs.set({irBuilder.GetInsertBlock(), localIndex}, value);
+}
+
+void EmitFunctionContext::sealBlock(llvm::BasicBlock* block)
+{
+	std::vector<IncompleteLocalPHI> incompletePHIs = std::move(unsealedBlocks.getOrAdd(block));
+	unsealedBlocks.removeOrFail(block);
+
+	// The incomplete PHIs may already have been captured by state that outlives the loop (e.g. the
+	// arguments of a pending local throw), so they are left for the optimizer to remove even if
+	// they turn out to be trivial.
+	for(const IncompleteLocalPHI& incompletePHI : incompletePHIs)
+	{ addLocalPHIOperands(*this, incompletePHI.phi, incompletePHI.localIndex); }
+}
+
 void EmitFunctionContext::get_local(GetOrSetVariableImm<false> imm)
 {
-	wavmAssert(imm.variableIndex < localPointers.size());
-	push(irBuilder.CreateLoad(localPointers[imm.variableIndex]));
+	wavmAssert(imm.variableIndex < localTypes.size());
+	push(getLocal(imm.variableIndex));
 }
 void EmitFunctionContext::set_local(GetOrSetVariableImm<false> imm)
 {
-	wavmAssert(imm.variableIndex < localPointers.size());
-	auto value = irBuilder.CreateBitCast(
-		pop(), localPointers[imm.variableIndex]->getType()->getPointerElementType());
-	irBuilder.CreateStore(value, localPointers[imm.variableIndex]);
+	wavmAssert(imm.variableIndex < localTypes.size());
+	setLocal(imm.variableIndex, irBuilder.CreateBitCast(pop(), localTypes[imm.variableIndex]));
 }
 void EmitFunctionContext::tee_local(GetOrSetVariableImm<false> imm)
 {
-	wavmAssert(imm.variableIndex < localPointers.size());
-	auto value = irBuilder.CreateBitCast(
-		getValueFromTop(), localPointers[imm.variableIndex]->getType()->getPointerElementType());
-	irBuilder.CreateStore(value, localPointers[imm.variableIndex]);
+	wavmAssert(imm.variableIndex < localTypes.size());
+	setLocal(imm.variableIndex,
+			 irBuilder.CreateBitCast(getValueFromTop(), localTypes[imm.variableIndex]));
 }
 
 //
@@ -63,7 +197,7 @@ void EmitFunctionContext::get_global(GetOrSetVariableImm<true> imm)
 			moduleContext.globals[imm.variableIndex], llvmContext.iptrType);
 		llvm::Value* globalPointer = irBuilder.CreateInBoundsGEP(
 			irBuilder.CreateLoad(contextPointerVariable), {globalDataOffset});
-		value = loadFromUntypedPointer(globalPointer, llvmValueType);
+		value = loadFromUntypedPointer(globalPointer, llvmValueType, llvmContext.globalTBAATag);
 	}
 	else
 	{
@@ -95,11 +229,39 @@ void EmitFunctionContext::get_global(GetOrSetVariableImm<true> imm)
 			default: break;
 			};
 		}
+		else
+		{
+			// If the value is an immutable global import that the code is specialized for, emit
+			// the value it's specialized for.
+			auto specializedValueIt
+				= moduleContext.specializedGlobalImports->find(imm.variableIndex);
+			if(specializedValueIt != moduleContext.specializedGlobalImports->end())
+			{
+				const IR::Value& specializedValue = specializedValueIt->second;
+				switch(specializedValue.type)
+				{
+				case ValueType::i32: value = emitLiteral(llvmContext, specializedValue.i32); break;
+				case ValueType::i64: value = emitLiteral(llvmContext, specializedValue.i64); break;
+				case ValueType::f32: value = emitLiteral(llvmContext, specializedValue.f32); break;
+				case ValueType::f64: value = emitLiteral(llvmContext, specializedValue.f64); break;
+				case ValueType::v128:
+					value = emitLiteral(llvmContext, specializedValue.v128);
+					break;
+				default: Errors::unreachable();
+				};
+			}
+		}
 
 		if(!value)
 		{
-			// Otherwise, the symbol's value will point to the global's immutable value.
-			value = loadFromUntypedPointer(moduleContext.globals[imm.variableIndex], llvmValueType);
+			// Otherwise, the symbol's value will point to the global's immutable value, which is
+			// set before any code can run, so the load is invariant.
+			llvm::LoadInst* load = irBuilder.CreateLoad(irBuilder.CreatePointerCast(
+				moduleContext.globals[imm.variableIndex], llvmValueType->getPointerTo()));
+			load->setMetadata(llvm::LLVMContext::MD_tbaa, llvmContext.globalTBAATag);
+			load->setMetadata(llvm::LLVMContext::MD_invariant_load,
+							  llvm::MDNode::get(llvmContext, {}));
+			value = load;
 		}
 	}
 
@@ -120,5 +282,5 @@ void EmitFunctionContext::set_global(GetOrSetVariableImm<true> imm)
 		= irBuilder.CreatePtrToInt(moduleContext.globals[imm.variableIndex], llvmContext.iptrType);
 	llvm::Value* globalPointer = irBuilder.CreateInBoundsGEP(
 		irBuilder.CreateLoad(contextPointerVariable), {globalDataOffset});
-	storeToUntypedPointer(value, globalPointer);
+	storeToUntypedPointer(value, globalPointer, llvmContext.globalTBAATag);
 }
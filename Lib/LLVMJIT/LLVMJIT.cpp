@@ -1,4 +1,6 @@
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "LLVMJITPrivate.h"
 #include "WAVM/Inline/Assert.h"
@@ -13,6 +15,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/ExecutionEngine/JITSymbol.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/TargetSelect.h"
@@ -26,37 +29,54 @@ using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
 
-static HashMap<std::string, const char*> runtimeSymbolMap = {
+// Returns the map from the names of the runtime symbols that LLVM generated code may reference to
+// the names they are resolved to. It is built the first time it is needed, so tools that link
+// LLVMJIT but never compile anything don't build it during static initialization.
+static const HashMap<std::string, const char*>& getRuntimeSymbolMap()
+{
+	static const HashMap<std::string, const char*> runtimeSymbolMap = {
 #ifdef _WIN32
-	// the LLVM X86 code generator calls __chkstk when allocating more than 4KB of stack space
-	{"__chkstk", "__chkstk"},
-	{"__C_specific_handler", "__C_specific_handler"},
+		// the LLVM X86 code generator calls __chkstk when allocating more than 4KB of stack space
+		{"__chkstk", "__chkstk"},
+		{"__C_specific_handler", "__C_specific_handler"},
 #ifndef _WIN64
-	{"__aullrem", "_aullrem"},
-	{"__allrem", "_allrem"},
-	{"__aulldiv", "_aulldiv"},
-	{"__alldiv", "_alldiv"},
+		{"__aullrem", "_aullrem"},
+		{"__allrem", "_allrem"},
+		{"__aulldiv", "_aulldiv"},
+		{"__alldiv", "_alldiv"},
 #endif
 #else
-	{"__CxxFrameHandler3", "__CxxFrameHandler3"},
-	{"__cxa_begin_catch", "__cxa_begin_catch"},
-	{"__gxx_personality_v0", "__gxx_personality_v0"},
+		{"__CxxFrameHandler3", "__CxxFrameHandler3"},
+		{"__cxa_begin_catch", "__cxa_begin_catch"},
+		{"__gxx_personality_v0", "__gxx_personality_v0"},
 #endif
+		// The rounding intrinsics are lowered to C library calls on CPUs without native
+		// instructions for them, e.g. X86 CPUs without SSE4.1.
+		{"ceil", "ceil"},
+		{"ceilf", "ceilf"},
+		{"floor", "floor"},
+		{"floorf", "floorf"},
+		{"trunc", "trunc"},
+		{"truncf", "truncf"},
+		{"nearbyint", "nearbyint"},
+		{"nearbyintf", "nearbyintf"},
 #ifdef __arm__
-	{"__aeabi_uidiv", "__aeabi_uidiv"},
-	{"__aeabi_idiv", "__aeabi_idiv"},
-	{"__aeabi_idivmod", "__aeabi_idivmod"},
-	{"__aeabi_uldiv", "__aeabi_uldiv"},
-	{"__aeabi_uldivmod", "__aeabi_uldivmod"},
-	{"__aeabi_unwind_cpp_pr0", "__aeabi_unwind_cpp_pr0"},
-	{"__aeabi_unwind_cpp_pr1", "__aeabi_unwind_cpp_pr1"},
+		{"__aeabi_uidiv", "__aeabi_uidiv"},
+		{"__aeabi_idiv", "__aeabi_idiv"},
+		{"__aeabi_idivmod", "__aeabi_idivmod"},
+		{"__aeabi_uldiv", "__aeabi_uldiv"},
+		{"__aeabi_uldivmod", "__aeabi_uldivmod"},
+		{"__aeabi_unwind_cpp_pr0", "__aeabi_unwind_cpp_pr0"},
+		{"__aeabi_unwind_cpp_pr1", "__aeabi_unwind_cpp_pr1"},
 #endif
-};
+	};
+	return runtimeSymbolMap;
+}
 
 llvm::JITEvaluatedSymbol LLVMJIT::resolveJITImport(llvm::StringRef name)
 {
 	// Allow some intrinsics used by LLVM
-	const char* const* runtimeSymbolName = runtimeSymbolMap.get(name.str());
+	const char* const* runtimeSymbolName = getRuntimeSymbolMap().get(name.str());
 	if(!runtimeSymbolName) { return llvm::JITEvaluatedSymbol(nullptr); }
 
 	void* addr = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(*runtimeSymbolName);
@@ -138,4 +158,72 @@ LLVMContext::LLVMContext()
 	typedZeroConstants[(Uptr)ValueType::v128] = emitLiteral(*this, V128());
 	typedZeroConstants[(Uptr)ValueType::anyref] = typedZeroConstants[(Uptr)ValueType::anyfunc]
 		= typedZeroConstants[(Uptr)ValueType::nullref] = llvm::Constant::getNullValue(anyrefType);
+
+	// Create the TBAA access tags: each kind of memory has a scalar type node that is a direct
+	// child of the root, so accesses with different tags are known not to alias.
+	llvm::MDBuilder mdBuilder(*this);
+	llvm::MDNode* tbaaRoot = mdBuilder.createTBAARoot("WAVM");
+	auto createTBAATag = [&](const char* name) {
+		llvm::MDNode* tbaaType = mdBuilder.createTBAAScalarTypeNode(name, tbaaRoot);
+		return mdBuilder.createTBAAStructTagNode(tbaaType, tbaaType, 0);
+	};
+	linearMemoryTBAATag = createTBAATag("linear memory");
+	runtimeDataTBAATag = createTBAATag("runtime data");
+	globalTBAATag = createTBAATag("global");
+}
+
+// A context accumulates the types and constants that are created in it until it is destroyed, so
+// a pooled context is only reused for a limited number of compiles.
+static constexpr Uptr maxPooledLLVMContextUses = 64;
+
+struct LLVMContextPool
+{
+	struct Entry
+	{
+		std::unique_ptr<LLVMContext> context;
+		Uptr numUses;
+	};
+
+	// A thread may borrow more than one context at once, e.g. if it generates a thunk while
+	// compiling a module, so the borrowed contexts are tracked separately from the free ones.
+	std::vector<Entry> freeEntries;
+	std::vector<Entry> borrowedEntries;
+};
+
+static thread_local LLVMContextPool llvmContextPool;
+
+PooledLLVMContext::PooledLLVMContext()
+{
+	LLVMContextPool::Entry entry;
+	if(llvmContextPool.freeEntries.size())
+	{
+		entry = std::move(llvmContextPool.freeEntries.back());
+		llvmContextPool.freeEntries.pop_back();
+	}
+	else
+	{
+		entry.context.reset(new LLVMContext);
+		entry.numUses = 0;
+	}
+
+	context = entry.context.get();
+	llvmContextPool.borrowedEntries.push_back(std::move(entry));
+}
+
+PooledLLVMContext::~PooledLLVMContext()
+{
+	std::vector<LLVMContextPool::Entry>& borrowedEntries = llvmContextPool.borrowedEntries;
+	for(Uptr entryIndex = 0; entryIndex < borrowedEntries.size(); ++entryIndex)
+	{
+		if(borrowedEntries[entryIndex].context.get() == context)
+		{
+			LLVMContextPool::Entry entry = std::move(borrowedEntries[entryIndex]);
+			borrowedEntries.erase(borrowedEntries.begin() + entryIndex);
+
+			if(++entry.numUses < maxPooledLLVMContextUses)
+			{ llvmContextPool.freeEntries.push_back(std::move(entry)); }
+			return;
+		}
+	}
+	Errors::unreachable();
 }
@@ -1,4 +1,7 @@
+#include <inttypes.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <system_error>
@@ -10,26 +13,42 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Logging/Trace.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ADT/ilist_iterator.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Vectorize.h"
 #if LLVM_VERSION_MAJOR >= 7
 #include "llvm/Transforms/Utils.h"
 #endif
@@ -50,6 +69,9 @@ namespace llvm {
 #define DUMP_OPTIMIZED_MODULE 0
 #define DUMP_OBJECT 0
 
+// LLVM code generation can recurse deeply, so give the parallel compile threads generous stacks.
+static constexpr Uptr compileThreadStackBytes = 8 * 1024 * 1024;
+
 using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
@@ -96,21 +118,160 @@ private:
 	std::vector<U8> output;
 };
 
-static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
+static Metrics::Histogram optimizeTimeHistogram(
+	"llvmjit.optimize_us",
+	"Time to optimize the LLVM IR for a module in microseconds");
+static Metrics::Histogram codegenTimeHistogram(
+	"llvmjit.codegen_us",
+	"Time to generate machine code for a module in microseconds");
+
+// The inliner's cost threshold for each optimization level that inlines functions. The threshold
+// for standard optimization only inlines small functions, e.g. accessors and wrappers, so the
+// module's code doesn't grow much.
+static constexpr int standardInlineThreshold = 75;
+static constexpr int aggressiveInlineThreshold = 225;
+
+static void addFunctionPasses(llvm::legacy::PassManagerBase& passManager,
+							  OptimizationLevel optimizationLevel,
+							  bool memoryBoundsChecks)
+{
+	passManager.add(llvm::createPromoteMemoryToRegisterPass());
+	switch(optimizationLevel)
+	{
+	case OptimizationLevel::none: break;
+	case OptimizationLevel::fast:
+		passManager.add(llvm::createInstructionCombiningPass());
+		passManager.add(llvm::createCFGSimplificationPass());
+		passManager.add(llvm::createJumpThreadingPass());
+		passManager.add(llvm::createConstantPropagationPass());
+		break;
+	case OptimizationLevel::standard:
+	case OptimizationLevel::aggressive:
+	{
+		const bool isAggressive = optimizationLevel == OptimizationLevel::aggressive;
+		passManager.add(llvm::createSROAPass());
+		passManager.add(llvm::createEarlyCSEPass());
+		passManager.add(llvm::createInstructionCombiningPass());
+		passManager.add(llvm::createCFGSimplificationPass());
+		passManager.add(llvm::createJumpThreadingPass());
+		passManager.add(llvm::createReassociatePass());
+		passManager.add(llvm::createGVNPass());
+		// Rotate loops into do-while form, which LICM needs to hoist loads that aren't known to be
+		// safe to execute on every path, and the loop vectorizer needs to vectorize them.
+		passManager.add(llvm::createLoopRotatePass());
+		passManager.add(llvm::createLICMPass());
+		if(memoryBoundsChecks)
+		{
+			// Move explicit memory bounds checks out of loops: unswitching moves checks of
+			// loop-invariant addresses out of the loop, and IRCE splits off the iterations of a
+			// loop that need checks of addresses derived from the induction variable.
+			passManager.add(llvm::createLoopUnswitchPass());
+			passManager.add(llvm::createInductiveRangeCheckEliminationPass());
+		}
+		passManager.add(llvm::createIndVarSimplifyPass());
+		if(isAggressive) { passManager.add(llvm::createLoopVectorizePass()); }
+		passManager.add(llvm::createLoopUnrollPass(isAggressive ? 3 : 2));
+		passManager.add(llvm::createSLPVectorizerPass());
+		passManager.add(llvm::createInstructionCombiningPass());
+		if(isAggressive) { passManager.add(llvm::createGVNPass()); }
+		passManager.add(llvm::createDeadStoreEliminationPass());
+		passManager.add(llvm::createCFGSimplificationPass());
+		break;
+	}
+	default: Errors::unreachable();
+	};
+}
+
+// A function definition with internal linkage, which the inliner may delete once it has been
+// inlined into all its callers.
+struct InternalFunctionDef
+{
+	std::string name;
+	llvm::FunctionType* type;
+	llvm::CallingConv::ID callingConv;
+	llvm::Constant* prefixData;
+};
+
+// Replaces the internal function definitions that the inliner deleted with functions that trap if
+// they are called. The loader and runtime expect each function definition to have code preceded by
+// its prefix data, but nothing can call the replacements.
+
+static void restoreDeletedFunctionDefs(llvm::Module& llvmModule,
+									   const std::vector<InternalFunctionDef>& internalFunctionDefs)
+{
+	for(const InternalFunctionDef& functionDef : internalFunctionDefs)
+	{
+		if(llvmModule.getFunction(functionDef.name)) { continue; }
+
+		llvm::Function* function = llvm::Function::Create(
+			functionDef.type, llvm::Function::InternalLinkage, functionDef.name, &llvmModule);
+		function->setCallingConv(functionDef.callingConv);
+		function->setPrefixData(functionDef.prefixData);
+
+		llvm::IRBuilder<> irBuilder(
+			llvm::BasicBlock::Create(llvmModule.getContext(), "entry", function));
+		irBuilder.CreateCall(llvm::Intrinsic::getDeclaration(&llvmModule, llvm::Intrinsic::trap));
+		irBuilder.CreateUnreachable();
+	}
+}
+
+static void optimizeLLVMModule(llvm::Module& llvmModule,
+							   llvm::TargetMachine* targetMachine,
+							   bool shouldLogMetrics,
+							   OptimizationLevel optimizationLevel,
+							   bool memoryBoundsChecks)
 {
+	Trace::Span traceSpan("optimizeLLVMModule");
+
 	// Run some optimization on the module's functions.
 	Timing::Timer optimizationTimer;
 
-	llvm::legacy::FunctionPassManager fpm(&llvmModule);
-	fpm.add(llvm::createPromoteMemoryToRegisterPass());
-	fpm.add(llvm::createInstructionCombiningPass());
-	fpm.add(llvm::createCFGSimplificationPass());
-	fpm.add(llvm::createJumpThreadingPass());
-	fpm.add(llvm::createConstantPropagationPass());
-	fpm.doInitialization();
-	for(auto functionIt = llvmModule.begin(); functionIt != llvmModule.end(); ++functionIt)
-	{ fpm.run(*functionIt); }
+	if(optimizationLevel != OptimizationLevel::standard
+	   && optimizationLevel != OptimizationLevel::aggressive)
+	{
+		llvm::legacy::FunctionPassManager fpm(&llvmModule);
+
+		// Give the passes the target's cost model, so the vectorizers know which vector operations
+		// the target supports.
+		fpm.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+		addFunctionPasses(fpm, optimizationLevel, memoryBoundsChecks);
+
+		fpm.doInitialization();
+		for(auto functionIt = llvmModule.begin(); functionIt != llvmModule.end(); ++functionIt)
+		{ fpm.run(*functionIt); }
+	}
+	else
+	{
+		std::vector<InternalFunctionDef> internalFunctionDefs;
+		for(llvm::Function& function : llvmModule)
+		{
+			if(!function.isDeclaration() && function.hasLocalLinkage() && function.hasPrefixData())
+			{
+				internalFunctionDefs.push_back({function.getName().str(),
+												function.getFunctionType(),
+												function.getCallingConv(),
+												function.getPrefixData()});
+			}
+		}
 
+		// Promote the locals to SSA values before inlining, so the inliner's cost model sees the
+		// functions' real size. The function passes added after the inliner run on each function
+		// once the functions it calls have been inlined into it, in bottom-up call graph order.
+		llvm::legacy::PassManager passManager;
+		passManager.add(
+			llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+		passManager.add(llvm::createPromoteMemoryToRegisterPass());
+		const int inlineThreshold = optimizationLevel == OptimizationLevel::aggressive
+										? aggressiveInlineThreshold
+										: standardInlineThreshold;
+		passManager.add(llvm::createFunctionInliningPass(inlineThreshold));
+		addFunctionPasses(passManager, optimizationLevel, memoryBoundsChecks);
+		passManager.run(llvmModule);
+
+		restoreDeletedFunctionDefs(llvmModule, internalFunctionDefs);
+	}
+
+	optimizeTimeHistogram.record(optimizationTimer.getMicroseconds());
 	if(shouldLogMetrics)
 	{
 		Timing::logRatePerSecond(
@@ -121,9 +282,7 @@ static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
 	if(shouldLogMetrics && DUMP_OPTIMIZED_MODULE) { printModule(llvmModule, "llvmOptimizedDump"); }
 }
 
-std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
-										   llvm::Module&& llvmModule,
-										   bool shouldLogMetrics)
+static std::string getTargetTriple()
 {
 	auto targetTriple = llvm::sys::getProcessTriple();
 #ifdef __APPLE__
@@ -131,15 +290,153 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 	// Without it, our symbols can't be found in the JITed object file.
 	targetTriple += "-elf";
 #endif
-	std::unique_ptr<llvm::TargetMachine> targetMachine(llvm::EngineBuilder().selectTarget(
-		llvm::Triple(targetTriple),
-		"",
-		llvm::sys::getHostCPUName(),
-		llvm::SmallVector<std::string, 0>{LLVM_TARGET_ATTRIBUTES}));
+	return targetTriple;
+}
+
+static std::string getTargetCPU(const CompileOptions& options)
+{
+	return options.targetCPU.size() ? options.targetCPU : llvm::sys::getHostCPUName().str();
+}
+
+static llvm::SmallVector<std::string, 0> getTargetAttributes(const CompileOptions& options)
+{
+	llvm::SmallVector<std::string, 0> targetAttributes{LLVM_TARGET_ATTRIBUTES};
+	targetAttributes.append(options.targetFeatures.begin(), options.targetFeatures.end());
+	return targetAttributes;
+}
 
-	// Get a target machine object for this host, and set the module to use its data layout.
+static llvm::CodeGenOpt::Level getCodeGenOptLevel(const CompileOptions& options)
+{
+	switch(options.codeGenOptimizationLevel)
+	{
+	case CodeGenOptimizationLevel::automatic:
+		switch(options.optimizationLevel)
+		{
+		case OptimizationLevel::none: return llvm::CodeGenOpt::None;
+		case OptimizationLevel::fast: return llvm::CodeGenOpt::Default;
+		case OptimizationLevel::standard: return llvm::CodeGenOpt::Default;
+		case OptimizationLevel::aggressive: return llvm::CodeGenOpt::Aggressive;
+		default: Errors::unreachable();
+		};
+	case CodeGenOptimizationLevel::none: return llvm::CodeGenOpt::None;
+	case CodeGenOptimizationLevel::less: return llvm::CodeGenOpt::Less;
+	case CodeGenOptimizationLevel::standard: return llvm::CodeGenOpt::Default;
+	case CodeGenOptimizationLevel::aggressive: return llvm::CodeGenOpt::Aggressive;
+	default: Errors::unreachable();
+	};
+}
+
+static std::unique_ptr<llvm::TargetMachine> createTargetMachine(const CompileOptions& options)
+{
+	std::unique_ptr<llvm::TargetMachine> targetMachine(
+		llvm::EngineBuilder().selectTarget(llvm::Triple(getTargetTriple()),
+										   "",
+										   getTargetCPU(options),
+										   getTargetAttributes(options)));
+	if(!targetMachine)
+	{ Errors::fatalf("Couldn't create a target machine for CPU %s", getTargetCPU(options).c_str()); }
+	targetMachine->setOptLevel(getCodeGenOptLevel(options));
+	return targetMachine;
+}
+
+// Creating a target machine is relatively expensive, so each thread caches the target machines it
+// creates. A target machine may not be used by multiple threads at once, so the cache isn't shared
+// between threads.
+static constexpr Uptr maxCachedTargetMachines = 8;
+
+struct CachedTargetMachine
+{
+	std::string key;
+	std::unique_ptr<llvm::TargetMachine> targetMachine;
+};
+
+static thread_local std::vector<CachedTargetMachine> cachedTargetMachines;
+
+static llvm::TargetMachine* getTargetMachine(const CompileOptions& options)
+{
+	std::string key = getTargetCPU(options);
+	for(const std::string& targetAttribute : getTargetAttributes(options))
+	{ key += "," + targetAttribute; }
+	key += ";" + std::to_string(Uptr(getCodeGenOptLevel(options)));
+
+	for(const CachedTargetMachine& cachedTargetMachine : cachedTargetMachines)
+	{
+		if(cachedTargetMachine.key == key) { return cachedTargetMachine.targetMachine.get(); }
+	}
+
+	if(cachedTargetMachines.size() >= maxCachedTargetMachines) { cachedTargetMachines.clear(); }
+	cachedTargetMachines.push_back({std::move(key), createTargetMachine(options)});
+	return cachedTargetMachines.back().targetMachine.get();
+}
+
+TargetSIMDISA LLVMJIT::getTargetSIMDISA(const CompileOptions& options)
+{
+	llvm::TargetMachine* targetMachine = getTargetMachine(options);
+	const llvm::MCSubtargetInfo* subtargetInfo = targetMachine->getMCSubtargetInfo();
+	switch(targetMachine->getTargetTriple().getArch())
+	{
+	case llvm::Triple::x86_64:
+		if(subtargetInfo->checkFeatures("+avx512bw,+avx512vl"))
+		{ return TargetSIMDISA::x86AVX512; }
+		if(subtargetInfo->checkFeatures("+sse4.1")) { return TargetSIMDISA::x86SSE41; }
+		return TargetSIMDISA::x86SSE2;
+	case llvm::Triple::aarch64:
+		return subtargetInfo->checkFeatures("+neon") ? TargetSIMDISA::aarch64NEON
+													 : TargetSIMDISA::generic;
+	default: return TargetSIMDISA::generic;
+	};
+}
+
+bool LLVMJIT::isTargetSupportedByHost(const std::string& targetCPU,
+									   const std::vector<std::string>& targetFeatures)
+{
+	// If the host's features can't be determined, assume it only supports its own CPU.
+	llvm::StringMap<bool> hostFeatures;
+	if(!llvm::sys::getHostCPUFeatures(hostFeatures))
+	{ return targetCPU.empty() && targetFeatures.empty(); }
+
+	CompileOptions targetOptions;
+	targetOptions.targetCPU = targetCPU;
+	targetOptions.targetFeatures = targetFeatures;
+	llvm::TargetMachine* targetMachine = getTargetMachine(targetOptions);
+	const llvm::MCSubtargetInfo* subtargetInfo = targetMachine->getMCSubtargetInfo();
+
+	// The target is supported if it doesn't use any instruction set features the host lacks. Only
+	// the features that the host reports are checked: the target's other features only affect
+	// instruction selection and scheduling.
+	for(const auto& hostFeature : hostFeatures)
+	{
+		if(!hostFeature.second && subtargetInfo->checkFeatures("+" + hostFeature.first().str()))
+		{ return false; }
+	}
+	return true;
+}
+
+std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
+										   llvm::Module&& llvmModule,
+										   bool shouldLogMetrics,
+										   const CompileOptions& options)
+{
+	// Get the thread's target machine object for the target CPU, and set the module to use its data
+	// layout.
+	llvm::TargetMachine* targetMachine = getTargetMachine(options);
 	llvmModule.setDataLayout(targetMachine->createDataLayout());
 
+	// Keep frame pointers in the module's functions if requested. This is done before optimizing
+	// the module, so functions that are inlined keep the same attributes as their callers.
+	if(options.framePointers)
+	{
+		for(llvm::Function& function : llvmModule)
+		{
+			if(function.isDeclaration()) { continue; }
+#if LLVM_VERSION_MAJOR >= 10
+			function.addFnAttr("frame-pointer", "all");
+#else
+			function.addFnAttr("no-frame-pointer-elim", "true");
+#endif
+		}
+	}
+
 	// Dump the module if desired.
 	if(shouldLogMetrics && DUMP_UNOPTIMIZED_MODULE) { printModule(llvmModule, "llvmDump"); }
 
@@ -157,12 +454,17 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 	}
 
 	// Optimize the module;
-	optimizeLLVMModule(llvmModule, shouldLogMetrics);
+	optimizeLLVMModule(llvmModule,
+					   targetMachine,
+					   shouldLogMetrics,
+					   options.optimizationLevel,
+					   options.memoryBoundsChecks);
 
 	// Generate machine code for the module.
 	Timing::Timer machineCodeTimer;
 	std::vector<U8> objectBytes;
 	{
+		Trace::Span traceSpan("codegen");
 		llvm::legacy::PassManager passManager;
 		llvm::MCContext* mcContext;
 		LLVMArrayOutputStream objectStream;
@@ -170,6 +472,7 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 		passManager.run(llvmModule);
 		objectBytes = objectStream.getOutput();
 	}
+	codegenTimeHistogram.record(machineCodeTimer.getMicroseconds());
 	if(shouldLogMetrics)
 	{
 		Timing::logRatePerSecond(
@@ -192,14 +495,554 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 	return objectBytes;
 }
 
-std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule)
+std::string LLVMJIT::getTargetDescription(const CompileOptions& options)
+{
+	std::string targetDescription = "LLVM " LLVM_VERSION_STRING ";";
+	targetDescription += getTargetTriple();
+	targetDescription += ";";
+	targetDescription += getTargetCPU(options);
+	for(const std::string& targetAttribute : getTargetAttributes(options))
+	{ targetDescription += ";" + targetAttribute; }
+	for(const TargetVersion& targetVersion : options.targetVersions)
+	{
+		targetDescription += ";version:" + targetVersion.targetCPU;
+		for(const std::string& targetFeature : targetVersion.targetFeatures)
+		{ targetDescription += "," + targetFeature; }
+	}
+	return targetDescription;
+}
+
+static bool areFunctionDefsIdentical(const FunctionDef& a, const FunctionDef& b)
+{
+	return a.type.index == b.type.index && a.nonParameterLocalTypes == b.nonParameterLocalTypes
+		   && a.branchTables == b.branchTables && a.code.size() == b.code.size()
+		   && !memcmp(a.code.data(), b.code.data(), a.code.size());
+}
+
+// Maps each function definition to the first function definition with the same type, locals,
+// branch tables and code, or returns an empty vector if identical function definitions shouldn't
+// be folded. The profile counters and speculated indirect callees are specific to each function
+// definition, so functions compiled with them aren't folded.
+static std::vector<Uptr> getFoldedFunctionDefIndices(const IR::Module& irModule,
+													 const CompileOptions& options)
+{
+	if(options.profileInstrumentation || options.profile
+	   || options.speculatedIndirectCallees.size())
+	{ return {}; }
+
+	std::vector<Uptr> foldedFunctionDefIndices;
+	HashMap<Uptr, std::vector<Uptr>> hashToFunctionDefIndices;
+	Uptr numFoldedFunctionDefs = 0;
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
+	{
+		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
+		const Uptr hash = XXH<Uptr>(functionDef.code.data(),
+									functionDef.code.size(),
+									Hash<Uptr>()(functionDef.type.index));
+
+		std::vector<Uptr>& candidateIndices = hashToFunctionDefIndices.getOrAdd(hash);
+		Uptr foldedFunctionDefIndex = functionDefIndex;
+		for(Uptr candidateIndex : candidateIndices)
+		{
+			if(areFunctionDefsIdentical(functionDef, irModule.functions.defs[candidateIndex]))
+			{
+				foldedFunctionDefIndex = candidateIndex;
+				++numFoldedFunctionDefs;
+				break;
+			}
+		}
+		if(foldedFunctionDefIndex == functionDefIndex)
+		{ candidateIndices.push_back(functionDefIndex); }
+		foldedFunctionDefIndices.push_back(foldedFunctionDefIndex);
+	}
+
+	Log::printf(Log::metrics,
+				"Folded %" PRIuPTR " identical function definitions\n",
+				numFoldedFunctionDefs);
+	return foldedFunctionDefIndices;
+}
+
+static std::vector<U8> emitAndCompileFunctionDefs(const IR::Module& irModule,
+												  const CompileOptions& options,
+												  const std::vector<Uptr>& functionDefIndices,
+												  const std::vector<Uptr>& foldedFunctionDefIndices,
+												  bool shouldLogMetrics)
 {
-	LLVMContext llvmContext;
+	if(options.monitor && !options.monitor->beginPartition()) { return {}; }
+
+	PooledLLVMContext pooledLLVMContext;
+	LLVMContext& llvmContext = *pooledLLVMContext;
 
 	// Emit LLVM IR for the module.
 	llvm::Module llvmModule("", llvmContext);
-	emitModule(irModule, llvmContext, llvmModule);
+	emitModule(irModule,
+			   llvmContext,
+			   llvmModule,
+			   functionDefIndices,
+			   foldedFunctionDefIndices,
+			   options.memoryBoundsChecks,
+			   options.epochInterruption,
+			   options.fuelMetering,
+			   options.stackLimitChecks,
+			   options.canonicalizeNaNs,
+			   options.memoryAccessSampling,
+			   options.relaxedMemoryAccesses,
+			   options.profileInstrumentation,
+			   options.profileCycles,
+			   options.speculatedIndirectCallees,
+			   options.specializedGlobalImports,
+			   options.profile.get(),
+			   getTargetSIMDISA(options));
+	if(options.monitor) { options.monitor->onFunctionDefsEmitted(functionDefIndices.size()); }
 
 	// Compile the LLVM IR to object code.
-	return compileLLVMModule(llvmContext, std::move(llvmModule), true);
+	std::vector<U8> objectCode
+		= compileLLVMModule(llvmContext, std::move(llvmModule), shouldLogMetrics, options);
+	if(options.monitor) { options.monitor->onFunctionDefsCompiled(functionDefIndices.size()); }
+	return objectCode;
+}
+
+// The state shared by the threads that compile the partitions of a module.
+struct ParallelCompileState
+{
+	const IR::Module& irModule;
+	const CompileOptions& options;
+	std::vector<Uptr> foldedFunctionDefIndices;
+	std::vector<Uptr> partitionBeginFunctionDefIndices;
+	std::vector<std::vector<U8>> partitionObjects;
+	std::atomic<Uptr> nextPartitionIndex{0};
+
+	ParallelCompileState(const IR::Module& inIRModule, const CompileOptions& inOptions)
+	: irModule(inIRModule), options(inOptions)
+	{
+	}
+
+	Uptr getNumPartitions() const { return partitionBeginFunctionDefIndices.size() - 1; }
+};
+
+static I64 compileThreadEntry(void* stateVoid)
+{
+	ParallelCompileState& state = *(ParallelCompileState*)stateVoid;
+
+	// Compile partitions until there are none left.
+	while(true)
+	{
+		const Uptr partitionIndex = state.nextPartitionIndex++;
+		if(partitionIndex >= state.getNumPartitions()) { break; }
+
+		// Skip partitions whose object code is reused from a previous compile.
+		if(state.partitionObjects[partitionIndex].size()) { continue; }
+
+		std::vector<Uptr> functionDefIndices;
+		for(Uptr functionDefIndex = state.partitionBeginFunctionDefIndices[partitionIndex];
+			functionDefIndex < state.partitionBeginFunctionDefIndices[partitionIndex + 1];
+			++functionDefIndex)
+		{ functionDefIndices.push_back(functionDefIndex); }
+
+		state.partitionObjects[partitionIndex]
+			= emitAndCompileFunctionDefs(state.irModule,
+										 state.options,
+										 functionDefIndices,
+										 state.foldedFunctionDefIndices,
+										 false);
+	}
+
+	return 0;
+}
+
+static std::vector<U8> packObjectFiles(const std::vector<std::vector<U8>>& objectFiles)
+{
+	// See the definition of multiObjectMagic for the format of the packed object code.
+	std::vector<U8> objectCode(multiObjectMagic, multiObjectMagic + sizeof(multiObjectMagic));
+
+	const U64 numObjects = U64(objectFiles.size());
+	objectCode.insert(objectCode.end(), (const U8*)&numObjects, (const U8*)(&numObjects + 1));
+	for(const std::vector<U8>& objectFile : objectFiles)
+	{
+		const U64 numObjectBytes = U64(objectFile.size());
+		objectCode.insert(
+			objectCode.end(), (const U8*)&numObjectBytes, (const U8*)(&numObjectBytes + 1));
+	}
+
+	for(const std::vector<U8>& objectFile : objectFiles)
+	{
+		objectCode.resize((objectCode.size() + multiObjectAlignment - 1)
+						  & ~(multiObjectAlignment - 1));
+		objectCode.insert(objectCode.end(), objectFile.begin(), objectFile.end());
+	}
+
+	return objectCode;
+}
+
+static std::vector<U8> packTargetVersions(const std::vector<TargetVersion>& targetVersions,
+										  const std::vector<std::vector<U8>>& versionObjectCodes)
+{
+	// See the definition of multiVersionMagic for the format of the packed object code.
+	std::vector<U8> objectCode(multiVersionMagic, multiVersionMagic + sizeof(multiVersionMagic));
+	auto appendU64 = [&objectCode](U64 value) {
+		objectCode.insert(objectCode.end(), (const U8*)&value, (const U8*)(&value + 1));
+	};
+
+	appendU64(U64(targetVersions.size()));
+	for(Uptr versionIndex = 0; versionIndex < targetVersions.size(); ++versionIndex)
+	{
+		const TargetVersion& targetVersion = targetVersions[versionIndex];
+		std::string targetFeatures;
+		for(const std::string& targetFeature : targetVersion.targetFeatures)
+		{
+			if(targetFeatures.size()) { targetFeatures += ","; }
+			targetFeatures += targetFeature;
+		}
+
+		appendU64(U64(targetVersion.targetCPU.size()));
+		objectCode.insert(
+			objectCode.end(), targetVersion.targetCPU.begin(), targetVersion.targetCPU.end());
+		appendU64(U64(targetFeatures.size()));
+		objectCode.insert(objectCode.end(), targetFeatures.begin(), targetFeatures.end());
+		appendU64(U64(versionObjectCodes[versionIndex].size()));
+	}
+
+	for(const std::vector<U8>& versionObjectCode : versionObjectCodes)
+	{
+		objectCode.resize((objectCode.size() + multiObjectAlignment - 1)
+						  & ~(multiObjectAlignment - 1));
+		objectCode.insert(objectCode.end(), versionObjectCode.begin(), versionObjectCode.end());
+	}
+
+	return objectCode;
+}
+
+std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule, const CompileOptions& options)
+{
+	Trace::Span traceSpan("LLVMJIT::compileModule");
+	if(options.targetVersions.size())
+	{
+		// Compile a complete version of the module for each target version, followed by the
+		// baseline version for targetCPU and targetFeatures.
+		std::vector<TargetVersion> targetVersions = options.targetVersions;
+		targetVersions.push_back({options.targetCPU, options.targetFeatures});
+
+		std::vector<std::vector<U8>> versionObjectCodes;
+		for(const TargetVersion& targetVersion : targetVersions)
+		{
+			CompileOptions versionOptions = options;
+			versionOptions.targetCPU = targetVersion.targetCPU;
+			versionOptions.targetFeatures = targetVersion.targetFeatures;
+			versionOptions.targetVersions.clear();
+			versionObjectCodes.push_back(compileModule(irModule, versionOptions));
+			if(!versionObjectCodes.back().size()) { return {}; }
+		}
+		return packTargetVersions(targetVersions, versionObjectCodes);
+	}
+
+	const Uptr numFunctionDefs = irModule.functions.defs.size();
+
+	Uptr numThreads = options.numThreads;
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+
+	// Split the function definitions into enough partitions to keep all the threads busy even if
+	// the partitions take different amounts of time to compile.
+	Uptr numPartitions = numThreads > 1 ? numThreads * 2 : 1;
+	if(options.minFunctionDefsPerPartition)
+	{
+		numPartitions
+			= std::min(numPartitions, numFunctionDefs / options.minFunctionDefsPerPartition);
+	}
+
+	// Compile identical function definitions once, and emit the other copies as tail calls to it.
+	std::vector<Uptr> foldedFunctionDefIndices = getFoldedFunctionDefIndices(irModule, options);
+
+	if(numPartitions <= 1)
+	{
+		std::vector<Uptr> functionDefIndices;
+		for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionDefs; ++functionDefIndex)
+		{ functionDefIndices.push_back(functionDefIndex); }
+		return emitAndCompileFunctionDefs(
+			irModule, options, functionDefIndices, foldedFunctionDefIndices, true);
+	}
+	numThreads = std::min(numThreads, numPartitions);
+
+	Timing::Timer compileTimer;
+
+	// Partition the function definitions so that each partition has about the same number of
+	// bytes of code.
+	ParallelCompileState state(irModule, options);
+	state.foldedFunctionDefIndices = std::move(foldedFunctionDefIndices);
+	Uptr numCodeBytes = 0;
+	for(const FunctionDef& functionDef : irModule.functions.defs)
+	{ numCodeBytes += functionDef.code.size(); }
+
+	state.partitionBeginFunctionDefIndices.push_back(0);
+	Uptr numPartitionedCodeBytes = 0;
+	for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionDefs; ++functionDefIndex)
+	{
+		const Uptr partitionIndex = state.partitionBeginFunctionDefIndices.size();
+		if(partitionIndex < numPartitions
+		   && numPartitionedCodeBytes >= numCodeBytes * partitionIndex / numPartitions)
+		{ state.partitionBeginFunctionDefIndices.push_back(functionDefIndex); }
+		numPartitionedCodeBytes += irModule.functions.defs[functionDefIndex].code.size();
+	}
+	state.partitionBeginFunctionDefIndices.push_back(numFunctionDefs);
+	state.partitionObjects.resize(state.getNumPartitions());
+
+	// Compile the partitions on the worker threads and the calling thread.
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{
+		threads.push_back(
+			Platform::createThread(compileThreadStackBytes, compileThreadEntry, &state));
+	}
+	compileThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	// If the monitor cancelled the compile, some partitions weren't compiled.
+	for(const std::vector<U8>& partitionObject : state.partitionObjects)
+	{
+		if(!partitionObject.size()) { return {}; }
+	}
+
+	Timing::logRatePerSecond(
+		"Compiled module in parallel", compileTimer, (F64)numFunctionDefs, "functions");
+	Log::printf(Log::metrics,
+				"Compiled %" PRIuPTR " partitions on %" PRIuPTR " threads\n",
+				state.getNumPartitions(),
+				numThreads);
+
+	return packObjectFiles(state.partitionObjects);
+}
+
+std::vector<U8> LLVMJIT::compilePartitions(const IR::Module& irModule,
+										   const std::vector<Uptr>& partitionBeginFunctionDefIndices,
+										   std::vector<std::vector<U8>>&& partitionObjects,
+										   const CompileOptions& options)
+{
+	Trace::Span traceSpan("LLVMJIT::compilePartitions");
+	wavmAssert(!options.targetVersions.size());
+	wavmAssert(partitionBeginFunctionDefIndices.size() == partitionObjects.size() + 1);
+	wavmAssert(partitionBeginFunctionDefIndices.back() == irModule.functions.defs.size());
+
+	ParallelCompileState state(irModule, options);
+	state.partitionBeginFunctionDefIndices = partitionBeginFunctionDefIndices;
+	state.partitionObjects = std::move(partitionObjects);
+
+	Uptr numCompiledPartitions = 0;
+	for(const std::vector<U8>& partitionObject : state.partitionObjects)
+	{
+		if(!partitionObject.size()) { ++numCompiledPartitions; }
+	}
+
+	Uptr numThreads = options.numThreads;
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::max(Uptr(1), std::min(numThreads, numCompiledPartitions));
+
+	// Compile the partitions that aren't reused on the worker threads and the calling thread.
+	Timing::Timer compileTimer;
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{
+		threads.push_back(
+			Platform::createThread(compileThreadStackBytes, compileThreadEntry, &state));
+	}
+	compileThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	// If the monitor cancelled the compile, some partitions weren't compiled.
+	for(const std::vector<U8>& partitionObject : state.partitionObjects)
+	{
+		if(!partitionObject.size()) { return {}; }
+	}
+
+	Timing::logTimer("Compiled module partitions", compileTimer);
+	Log::printf(Log::metrics,
+				"Compiled %" PRIuPTR " and reused %" PRIuPTR " of %" PRIuPTR " partitions\n",
+				numCompiledPartitions,
+				state.getNumPartitions() - numCompiledPartitions,
+				state.getNumPartitions());
+
+	return packObjectFiles(state.partitionObjects);
+}
+
+std::vector<U8> LLVMJIT::compileFunctionDefs(const IR::Module& irModule,
+											 const std::vector<Uptr>& functionDefIndices,
+											 const CompileOptions& options)
+{
+	return emitAndCompileFunctionDefs(irModule, options, functionDefIndices, {}, false);
+}
+
+// A streaming compile doesn't know how much code the module has until it is finished, so it adds a
+// partition as soon as enough code has been decoded to be worth compiling separately.
+static constexpr Uptr minStreamingPartitionCodeBytes = 64 * 1024;
+
+// The compile threads wait for partitions on an event that may be signaled before they wait on it,
+// so they only wait for a short time before checking for partitions again.
+static constexpr U64 streamingCompileWaitMicroseconds = 1000;
+
+struct LLVMJIT::StreamingCompile
+{
+	const IR::Module& irModule;
+	const CompileOptions options;
+	std::vector<Platform::Thread*> threads;
+	Timing::Timer compileTimer;
+
+	// Only accessed by the thread that adds decoded function definitions.
+	Uptr numDecodedFunctionDefs = 0;
+	Uptr numUnpartitionedCodeBytes = 0;
+
+	// Protected by mutex.
+	Platform::Mutex mutex;
+	std::vector<Uptr> partitionBeginFunctionDefIndices{0};
+	std::vector<std::vector<U8>> partitionObjects;
+	Uptr nextPartitionIndex = 0;
+	bool isFinished = false;
+	bool isCancelled = false;
+
+	Platform::Event partitionAddedEvent;
+
+	StreamingCompile(const IR::Module& inIRModule, const CompileOptions& inOptions)
+	: irModule(inIRModule), options(inOptions)
+	{
+	}
+
+	Uptr getNumPartitions() const { return partitionBeginFunctionDefIndices.size() - 1; }
+};
+
+static I64 streamingCompileThreadEntry(void* compileVoid)
+{
+	StreamingCompile& compile = *(StreamingCompile*)compileVoid;
+
+	while(true)
+	{
+		// Take the next partition that hasn't been compiled, or wait for one to be added.
+		std::vector<Uptr> functionDefIndices;
+		Uptr partitionIndex;
+		{
+			Lock<Platform::Mutex> compileLock(compile.mutex);
+			if(compile.isCancelled) { return 0; }
+			else if(compile.nextPartitionIndex < compile.getNumPartitions())
+			{
+				partitionIndex = compile.nextPartitionIndex++;
+				for(Uptr functionDefIndex
+					= compile.partitionBeginFunctionDefIndices[partitionIndex];
+					functionDefIndex < compile.partitionBeginFunctionDefIndices[partitionIndex + 1];
+					++functionDefIndex)
+				{ functionDefIndices.push_back(functionDefIndex); }
+			}
+			else if(compile.isFinished)
+			{
+				return 0;
+			}
+			else
+			{
+				compileLock.unlock();
+				compile.partitionAddedEvent.wait(Platform::getMonotonicClock()
+												 + streamingCompileWaitMicroseconds);
+				continue;
+			}
+		}
+
+		std::vector<U8> partitionObject = emitAndCompileFunctionDefs(
+			compile.irModule, compile.options, functionDefIndices, {}, false);
+
+		Lock<Platform::Mutex> compileLock(compile.mutex);
+		compile.partitionObjects[partitionIndex] = std::move(partitionObject);
+	}
+}
+
+static void addStreamingPartition(StreamingCompile* compile)
+{
+	{
+		Lock<Platform::Mutex> compileLock(compile->mutex);
+		compile->partitionBeginFunctionDefIndices.push_back(compile->numDecodedFunctionDefs);
+		compile->partitionObjects.emplace_back();
+	}
+	compile->numUnpartitionedCodeBytes = 0;
+	compile->partitionAddedEvent.signal();
+}
+
+StreamingCompile* LLVMJIT::beginStreamingCompile(const IR::Module& irModule,
+												 const CompileOptions& options)
+{
+	StreamingCompile* compile = new StreamingCompile(irModule, options);
+
+	// The function definitions are decoded on the calling thread, so compile them on at least one
+	// other thread.
+	Uptr numThreads = options.numThreads;
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::max(numThreads, Uptr(1));
+	for(Uptr threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+	{
+		compile->threads.push_back(Platform::createThread(
+			compileThreadStackBytes, streamingCompileThreadEntry, compile));
+	}
+
+	return compile;
+}
+
+void LLVMJIT::addDecodedFunctionDefs(StreamingCompile* compile, Uptr numDecodedFunctionDefs)
+{
+	wavmAssert(numDecodedFunctionDefs >= compile->numDecodedFunctionDefs);
+	wavmAssert(numDecodedFunctionDefs <= compile->irModule.functions.defs.size());
+	for(Uptr functionDefIndex = compile->numDecodedFunctionDefs;
+		functionDefIndex < numDecodedFunctionDefs;
+		++functionDefIndex)
+	{
+		compile->numUnpartitionedCodeBytes
+			+= compile->irModule.functions.defs[functionDefIndex].code.size();
+	}
+	compile->numDecodedFunctionDefs = numDecodedFunctionDefs;
+
+	const Uptr numUnpartitionedFunctionDefs
+		= numDecodedFunctionDefs - compile->partitionBeginFunctionDefIndices.back();
+	const Uptr minFunctionDefsPerPartition
+		= std::max(compile->options.minFunctionDefsPerPartition, Uptr(1));
+	if(numUnpartitionedFunctionDefs >= minFunctionDefsPerPartition
+	   && compile->numUnpartitionedCodeBytes >= minStreamingPartitionCodeBytes)
+	{ addStreamingPartition(compile); }
+}
+
+std::vector<U8> LLVMJIT::finishStreamingCompile(StreamingCompile* compile)
+{
+	wavmAssert(compile->numDecodedFunctionDefs == compile->irModule.functions.defs.size());
+
+	// Add the remaining function definitions as the last partition, and wait for the compile
+	// threads to compile all the partitions.
+	if(!compile->getNumPartitions()
+	   || compile->numDecodedFunctionDefs > compile->partitionBeginFunctionDefIndices.back())
+	{ addStreamingPartition(compile); }
+	{
+		Lock<Platform::Mutex> compileLock(compile->mutex);
+		compile->isFinished = true;
+	}
+	for(Platform::Thread* thread : compile->threads)
+	{
+		compile->partitionAddedEvent.signal();
+		Platform::joinThread(thread);
+	}
+
+	Timing::logTimer("Finished streaming compile", compile->compileTimer);
+	Log::printf(Log::metrics,
+				"Compiled %" PRIuPTR " partitions on %" PRIuPTR " threads while streaming\n",
+				compile->getNumPartitions(),
+				compile->threads.size());
+
+	std::vector<std::vector<U8>> partitionObjects = std::move(compile->partitionObjects);
+	delete compile;
+
+	if(partitionObjects.size() == 1) { return std::move(partitionObjects[0]); }
+	return packObjectFiles(partitionObjects);
+}
+
+void LLVMJIT::cancelStreamingCompile(StreamingCompile* compile)
+{
+	{
+		Lock<Platform::Mutex> compileLock(compile->mutex);
+		compile->isCancelled = true;
+	}
+	for(Platform::Thread* thread : compile->threads)
+	{
+		compile->partitionAddedEvent.signal();
+		Platform::joinThread(thread);
+	}
+	delete compile;
 }
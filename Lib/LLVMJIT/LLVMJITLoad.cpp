@@ -1,10 +1,13 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -19,12 +22,16 @@
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Logging/Trace.h"
+#include "WAVM/Platform/Diagnostics.h"
 #include "WAVM/Platform/Exception.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/RuntimeData.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/DebugInfo/DIContext.h"
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
@@ -89,22 +96,364 @@ using namespace WAVM::LLVMJIT;
 using namespace WAVM::Runtime;
 
 static llvm::JITEventListener* gdbRegistrationListener = nullptr;
+static Platform::Mutex gdbRegistrationListenerMutex;
+static std::atomic<bool> isDebuggerRegistrationEnabled{false};
+
+// An immutable table of the address ranges of the loaded modules' images, sorted by address. It is
+// replaced by a new table whenever a module is loaded or unloaded, so getJITFunctionByAddress can
+// search it without taking a lock: it is called when handling signals and symbolizing call stacks,
+// which may happen frequently on many threads.
+struct ModuleAddressRange
+{
+	Uptr begin;
+	Uptr end;
+	LoadedModule* module;
+};
+typedef std::vector<ModuleAddressRange> ModuleAddressTable;
+static Platform::Mutex moduleAddressTableUpdateMutex;
+static std::atomic<const ModuleAddressTable*> moduleAddressTable{nullptr};
+
+// Readers of moduleAddressTable increment one of these counters while they use the table, so the
+// thread that replaces the table can tell when no readers are using the old table, and delete it.
+// The counters are spread over separate cache lines, and each thread is assigned a counter the
+// first time it reads the table, round-robin, so readers on different threads rarely contend for
+// the same cache line.
+struct alignas(64) ModuleAddressTableReaderCount
+{
+	std::atomic<Uptr> value{0};
+};
+static constexpr Uptr numModuleAddressTableReaderCounts = 16;
+static ModuleAddressTableReaderCount
+	moduleAddressTableReaderCounts[numModuleAddressTableReaderCounts];
+static std::atomic<Uptr> nextModuleAddressTableReaderCountIndex{0};
+
+// The index of the calling thread's reader count plus one, or zero if it hasn't been assigned one.
+// It is constant-initialized, and assigned with a lock-free atomic, so it may be used in signal
+// handlers.
+static thread_local Uptr threadModuleAddressTableReaderCountIndexPlusOne = 0;
+
+static std::atomic<Uptr>& getModuleAddressTableReaderCount()
+{
+	if(!threadModuleAddressTableReaderCountIndexPlusOne)
+	{
+		threadModuleAddressTableReaderCountIndexPlusOne
+			= 1
+			  + nextModuleAddressTableReaderCountIndex.fetch_add(1, std::memory_order_relaxed)
+					% numModuleAddressTableReaderCounts;
+	}
+	return moduleAddressTableReaderCounts[threadModuleAddressTableReaderCountIndexPlusOne - 1]
+		.value;
+}
+
+// Replaces the module address table with a copy that has the given ranges added and removed.
+static void updateModuleAddressTable(const std::vector<ModuleAddressRange>& addedRanges,
+									 const LoadedModule* removedModule)
+{
+	Lock<Platform::Mutex> updateLock(moduleAddressTableUpdateMutex);
+
+	const ModuleAddressTable* oldTable = moduleAddressTable.load(std::memory_order_acquire);
+	ModuleAddressTable* newTable = new ModuleAddressTable;
+	if(oldTable)
+	{
+		for(const ModuleAddressRange& range : *oldTable)
+		{
+			if(range.module != removedModule) { newTable->push_back(range); }
+		}
+	}
+	newTable->insert(newTable->end(), addedRanges.begin(), addedRanges.end());
+	std::sort(newTable->begin(),
+			  newTable->end(),
+			  [](const ModuleAddressRange& left, const ModuleAddressRange& right) {
+				  return left.begin < right.begin;
+			  });
+	moduleAddressTable.store(newTable, std::memory_order_seq_cst);
+
+	// Wait until every reader that might have loaded the old table has finished with it. Readers
+	// that start after this point will load the new table. Readers only use the table briefly, so
+	// spin for a while before yielding to them, in case they were preempted.
+	if(oldTable)
+	{
+		static constexpr Uptr numSpinsBeforeYield = 64;
+		for(ModuleAddressTableReaderCount& readerCount : moduleAddressTableReaderCounts)
+		{
+			for(Uptr numSpins = 0; readerCount.value.load(std::memory_order_seq_cst); ++numSpins)
+			{
+				if(numSpins >= numSpinsBeforeYield) { std::this_thread::yield(); }
+			}
+		}
+		delete oldTable;
+	}
+}
+
+// A pool of virtual pages that the images of JIT modules are allocated from. The pages are
+// reserved in large chunks, and an image's pages are never reused after it is unloaded, so that
+// references to them that might erroneously remain still fault. All the chunks are freed when the
+// last reference to the arena is released.
+//
+// If the arena was created with packImages, and the host supports dual-mapped pages, images are
+// instead packed into shared chunks of pages that are mapped twice: once writable, and once
+// executable. Loading code into the arena then doesn't change the access of any pages, and small
+// modules such as thunks don't use whole pages for each of their sections. The writable view stays
+// mapped while the chunk is used, so this gives up the separation of writable and executable pages,
+// and is only done if the host asks for it. A packed chunk is freed once images are no longer
+// allocated from it, and all the images allocated from it have been unloaded, so its addresses may
+// be reused.
+struct LLVMJIT::CodeArena
+{
+	CodeArena(bool inPackImages) : numReferences(1), isPackingDisabled(!inPackImages) {}
+	~CodeArena()
+	{
+		// The modules loaded into the arena have all been unloaded, and have decommitted their
+		// pages, so the chunks can just be freed.
+		for(const Chunk& chunk : chunks)
+		{
+			if(chunk.ehFrameTable) { Platform::destroyGrowableEHFrameTable(chunk.ehFrameTable); }
+			Platform::freeVirtualPages(chunk.baseAddress, chunk.numPages);
+		}
+		for(const PackedChunk& chunk : packedChunks)
+		{ Platform::freeVirtualPages(chunk.writableBaseAddress, chunk.numPages * 2); }
+	}
+
+	void addReference() { ++numReferences; }
+	void removeReference()
+	{
+		if(--numReferences == 0) { delete this; }
+	}
+
+	// Reserves numPages contiguous virtual pages. Returns nullptr if the virtual address space has
+	// been exhausted.
+	U8* allocatePages(Uptr numPages)
+	{
+		Lock<Platform::Mutex> chunksLock(chunksMutex);
+
+		if(!chunks.size() || chunks.back().numPages - chunks.back().numAllocatedPages < numPages)
+		{
+			const Uptr minChunkPages = minChunkBytes >> Platform::getPageSizeLog2();
+			Chunk chunk;
+			chunk.numPages = std::max(numPages + (USE_WINDOWS_SEH ? 1 : 0), minChunkPages);
+			chunk.numAllocatedPages = 0;
+			chunk.baseAddress = Platform::allocateVirtualPages(chunk.numPages);
+			if(!chunk.baseAddress) { return nullptr; }
+			if(USE_WINDOWS_SEH) { createSEHFunctionTable(chunk); }
+			chunks.push_back(chunk);
+		}
+
+		Chunk& chunk = chunks.back();
+		U8* result = chunk.baseAddress + (chunk.numAllocatedPages << Platform::getPageSizeLog2());
+		chunk.numAllocatedPages += numPages;
+		return result;
+	}
+
+	// Finds the growable SEH function table of the chunk containing an image allocated by
+	// allocatePages. The function table's entries and the image's unwind info must be relative to
+	// outTableBaseAddress, and refer to the chunk's __C_specific_handler trampoline at
+	// outSEHTrampolineAddress. Returns false if the chunk doesn't have a function table.
+	bool findSEHFunctionTable(const U8* imageBaseAddress,
+							  U8*& outTableBaseAddress,
+							  Uptr& outSEHTrampolineAddress)
+	{
+		Lock<Platform::Mutex> chunksLock(chunksMutex);
+		const Chunk* chunk = findChunk(imageBaseAddress);
+		if(!chunk || !chunk->ehFrameTable) { return false; }
+
+		outTableBaseAddress = chunk->baseAddress;
+		outSEHTrampolineAddress = reinterpret_cast<Uptr>(chunk->baseAddress);
+		return true;
+	}
+
+	// Adds the function table entries in pdata to the growable function table of the chunk at
+	// tableBaseAddress. Returns false if the entries couldn't be added, in which case they must be
+	// registered separately.
+	bool addSEHFunctions(const U8* tableBaseAddress, const U8* pdata, Uptr numPDataBytes)
+	{
+		Lock<Platform::Mutex> chunksLock(chunksMutex);
+		const Chunk* chunk = findChunk(tableBaseAddress);
+		wavmAssert(chunk && chunk->ehFrameTable);
+		return Platform::addGrowableEHFrames(chunk->ehFrameTable, pdata, numPDataBytes);
+	}
+
+	// Allocates numBytes of committed dual-mapped memory, which is written through
+	// outWritableAddress, and executed through outWritableAddress + outExecutableOffset. Returns
+	// false if the host doesn't support dual-mapped pages.
+	bool allocatePackedBytes(Uptr numBytes,
+							 Uptr alignment,
+							 U8*& outWritableAddress,
+							 Uptr& outExecutableOffset)
+	{
+		wavmAssert(alignment && !(alignment & (alignment - 1)));
+		Lock<Platform::Mutex> chunksLock(chunksMutex);
+		if(isPackingDisabled) { return false; }
+
+		Uptr offset = 0;
+		if(packedChunks.size())
+		{
+			const PackedChunk& chunk = packedChunks.back();
+			offset = (chunk.numAllocatedBytes + alignment - 1) & ~(alignment - 1);
+		}
+		if(!packedChunks.size()
+		   || offset + numBytes > (packedChunks.back().numPages << Platform::getPageSizeLog2()))
+		{
+			// Stop allocating from the current chunk.
+			if(packedChunks.size())
+			{
+				packedChunks.back().isRetired = true;
+				freeIfUnused(packedChunks.size() - 1);
+			}
+
+			const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
+			const Uptr numNeededPages = (numBytes + (Uptr(1) << pageSizeLog2) - 1) >> pageSizeLog2;
+			// Round the chunk up to a multiple of the minimum chunk size, which is a multiple of the
+			// granularity any platform maps views at.
+			const Uptr numMinChunkPages = minPackedChunkBytes >> pageSizeLog2;
+			PackedChunk chunk;
+			chunk.numPages
+				= (numNeededPages + numMinChunkPages - 1) / numMinChunkPages * numMinChunkPages;
+			chunk.numAllocatedBytes = 0;
+			chunk.numLiveBytes = 0;
+			chunk.isRetired = false;
+			if(!Platform::allocateDualMappedPages(chunk.numPages, chunk.writableBaseAddress))
+			{
+				isPackingDisabled = true;
+				return false;
+			}
+			packedChunks.push_back(chunk);
+			offset = 0;
+		}
+
+		PackedChunk& chunk = packedChunks.back();
+		chunk.numAllocatedBytes = offset + numBytes;
+		chunk.numLiveBytes += numBytes;
+		outWritableAddress = chunk.writableBaseAddress + offset;
+		outExecutableOffset = chunk.numPages << Platform::getPageSizeLog2();
+		return true;
+	}
+
+	// Frees bytes allocated by allocatePackedBytes.
+	void freePackedBytes(U8* writableAddress, Uptr numBytes)
+	{
+		Lock<Platform::Mutex> chunksLock(chunksMutex);
+		for(Uptr chunkIndex = 0; chunkIndex < packedChunks.size(); ++chunkIndex)
+		{
+			PackedChunk& chunk = packedChunks[chunkIndex];
+			if(writableAddress >= chunk.writableBaseAddress
+			   && writableAddress
+					  < chunk.writableBaseAddress + (chunk.numPages << Platform::getPageSizeLog2()))
+			{
+				wavmAssert(chunk.numLiveBytes >= numBytes);
+				chunk.numLiveBytes -= numBytes;
+				freeIfUnused(chunkIndex);
+				return;
+			}
+		}
+		Errors::unreachable();
+	}
+
+private:
+	static constexpr Uptr minChunkBytes = Uptr(16) * 1024 * 1024;
+	static constexpr Uptr minPackedChunkBytes = Uptr(2) * 1024 * 1024;
+
+	// A chunk of numPages pages that images are allocated from. On Windows, the chunk's first page
+	// contains a trampoline to __C_specific_handler, and the function table entries of the images
+	// in the chunk are added to a single growable function table. The entries of unloaded images
+	// stay in the table, but the addresses they describe aren't reused.
+	struct Chunk
+	{
+		U8* baseAddress;
+		Uptr numPages;
+		Uptr numAllocatedPages;
+		Platform::GrowableEHFrameTable* ehFrameTable = nullptr;
+	};
+
+	// Each function table entry describes at least one function of 16 bytes or more, but most
+	// functions are much larger.
+	static constexpr Uptr minAverageSEHFunctionBytes = 256;
+
+	// A chunk of numPages dual-mapped pages, whose writable view is followed by its executable
+	// view. A chunk is retired once images are no longer allocated from it.
+	struct PackedChunk
+	{
+		U8* writableBaseAddress;
+		Uptr numPages;
+		Uptr numAllocatedBytes;
+		Uptr numLiveBytes;
+		bool isRetired;
+	};
+
+	std::atomic<Uptr> numReferences;
+	Platform::Mutex chunksMutex;
+	std::vector<Chunk> chunks;
+	std::vector<PackedChunk> packedChunks;
+
+	// Set if the arena wasn't created with packImages, or the host doesn't support dual-mapped
+	// pages.
+	bool isPackingDisabled;
+
+	const Chunk* findChunk(const U8* address) const
+	{
+		for(const Chunk& chunk : chunks)
+		{
+			if(address >= chunk.baseAddress
+			   && address < chunk.baseAddress + (chunk.numPages << Platform::getPageSizeLog2()))
+			{ return &chunk; }
+		}
+		return nullptr;
+	}
+
+	// Creates a chunk's growable function table, and writes its __C_specific_handler trampoline to
+	// the chunk's first page, which must be within 2GB of the code that uses it. If the platform
+	// doesn't support growable function tables, each image registers its own function table.
+	static void createSEHFunctionTable(Chunk& chunk)
+	{
+		const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
+		chunk.ehFrameTable = Platform::createGrowableEHFrameTable(
+			chunk.baseAddress,
+			chunk.numPages << pageSizeLog2,
+			(chunk.numPages << pageSizeLog2) / minAverageSEHFunctionBytes);
+		if(!chunk.ehFrameTable) { return; }
+
+		// Lookup the real address of __C_specific_handler.
+		const llvm::JITEvaluatedSymbol sehHandlerSymbol = resolveJITImport("__C_specific_handler");
+		errorUnless(sehHandlerSymbol);
+		const U64 sehHandlerAddress = U64(sehHandlerSymbol.getAddress());
+
+		// jmp [rip+0] <64-bit address>
+		U8* trampolineBytes = chunk.baseAddress;
+		if(!Platform::commitVirtualPages(trampolineBytes, 1))
+		{ Errors::fatal("memory allocation for JIT code failed"); }
+		trampolineBytes[0] = 0xff;
+		trampolineBytes[1] = 0x25;
+		memset(trampolineBytes + 2, 0, 4);
+		memcpy(trampolineBytes + 6, &sehHandlerAddress, sizeof(U64));
+		errorUnless(
+			Platform::setVirtualPageAccess(trampolineBytes, 1, Platform::MemoryAccess::execute));
+		llvm::sys::Memory::InvalidateInstructionCache(trampolineBytes, 16);
+		chunk.numAllocatedPages = 1;
+	}
+
+	// Frees a retired chunk once none of the images allocated from it are loaded, so the address
+	// space doesn't grow without bound in a long-running host that keeps loading modules.
+	void freeIfUnused(Uptr chunkIndex)
+	{
+		const PackedChunk& chunk = packedChunks[chunkIndex];
+		if(chunk.isRetired && !chunk.numLiveBytes)
+		{
+			Platform::decommitVirtualPages(chunk.writableBaseAddress, chunk.numPages * 2);
+			Platform::freeVirtualPages(chunk.writableBaseAddress, chunk.numPages * 2);
+			packedChunks.erase(packedChunks.begin() + chunkIndex);
+		}
+	}
+};
 
-// A map from address to loaded JIT symbols.
-static Platform::Mutex addressToModuleMapMutex;
-static std::map<Uptr, LoadedModule*> addressToModuleMap;
+CodeArena* LLVMJIT::createCodeArena(bool packImages) { return new CodeArena(packImages); }
+
+void LLVMJIT::releaseCodeArena(CodeArena* codeArena) { codeArena->removeReference(); }
 
 // Allocates memory for the LLVM object loader.
 struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 {
-	ModuleMemoryManager()
-	: imageBaseAddress(nullptr)
-	, isFinalized(false)
-	, codeSection({0})
-	, readOnlySection({0})
-	, readWriteSection({0})
-	, hasRegisteredEHFrames(false)
+	ModuleMemoryManager(CodeArena* inCodeArena) : codeArena(inCodeArena), isFinalized(false)
 	{
+		if(codeArena) { codeArena->addReference(); }
 	}
 	virtual ~ModuleMemoryManager() override
 	{
@@ -112,27 +461,42 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 		deregisterEHFrames();
 
 		// Decommit the image pages, but leave them reserved to catch any references to them that
-		// might erroneously remain.
-		Platform::decommitVirtualPages(imageBaseAddress, numAllocatedImagePages);
+		// might erroneously remain. If the images were allocated from an arena, their pages are
+		// freed with the arena's other pages. Packed images share their pages with other images,
+		// so the arena decommits them once all the images that share them have been freed.
+		for(const Image& image : images)
+		{
+			if(image.isPacked)
+			{ codeArena->freePackedBytes(image.writableBaseAddress, image.numBytes); }
+			else if(image.numBytes)
+			{
+				Platform::decommitVirtualPages(image.baseAddress,
+											   image.numBytes >> Platform::getPageSizeLog2());
+			}
+		}
+		if(codeArena) { codeArena->removeReference(); }
 	}
 
 	void registerEHFrames(U8* addr, U64 loadAddr, uintptr_t numBytes) override
 	{
 		if(!USE_WINDOWS_SEH)
 		{
-			Platform::registerEHFrames(imageBaseAddress, addr, numBytes);
-			hasRegisteredEHFrames = true;
-			ehFramesAddr = addr;
-			ehFramesNumBytes = numBytes;
+			// The frames are registered at the address they are read from when unwinding, which
+			// is in the executable view of a packed image.
+			U8* loadedFrames = reinterpret_cast<U8*>(Uptr(loadAddr));
+			U8* imageBaseAddress = getImageContainingAddress(loadedFrames).baseAddress;
+			Platform::registerEHFrames(imageBaseAddress, loadedFrames, numBytes);
+			registeredEHFrames.push_back({imageBaseAddress, loadedFrames, Uptr(numBytes)});
 		}
 	}
 	void deregisterEHFrames() override
 	{
-		if(hasRegisteredEHFrames)
+		for(const EHFrames& ehFrames : registeredEHFrames)
 		{
-			hasRegisteredEHFrames = false;
-			Platform::deregisterEHFrames(imageBaseAddress, ehFramesAddr, ehFramesNumBytes);
+			Platform::deregisterEHFrames(
+				ehFrames.imageBaseAddress, ehFrames.address, ehFrames.numBytes);
 		}
+		registeredEHFrames.clear();
 	}
 
 	virtual bool needsToReserveAllocationSpace() override { return true; }
@@ -143,31 +507,51 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 										uintptr_t numReadWriteBytes,
 										U32 readWriteAlignment) override
 	{
+		// This is called once for each object file loaded into the module, and each object file is
+		// given its own image.
+		wavmAssert(!isFinalized);
+		images.emplace_back();
+		Image& image = images.back();
+
 		if(USE_WINDOWS_SEH)
 		{
 			// Pad the code section to allow for the SEH trampoline.
 			numCodeBytes += 32;
 		}
+		else if(codeArena
+				&& reservePackedImage(image,
+									  numCodeBytes,
+									  codeAlignment,
+									  numReadOnlyBytes,
+									  readOnlyAlignment,
+									  numReadWriteBytes,
+									  readWriteAlignment))
+		{
+			return;
+		}
 
 		// Calculate the number of pages to be used by each section.
-		codeSection.numPages = shrAndRoundUp(numCodeBytes, Platform::getPageSizeLog2());
-		readOnlySection.numPages = shrAndRoundUp(numReadOnlyBytes, Platform::getPageSizeLog2());
-		readWriteSection.numPages = shrAndRoundUp(numReadWriteBytes, Platform::getPageSizeLog2());
-		numAllocatedImagePages
-			= codeSection.numPages + readOnlySection.numPages + readWriteSection.numPages;
-		if(numAllocatedImagePages)
+		const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
+		const Uptr numCodePages = shrAndRoundUp(numCodeBytes, pageSizeLog2);
+		const Uptr numReadOnlyPages = shrAndRoundUp(numReadOnlyBytes, pageSizeLog2);
+		const Uptr numReadWritePages = shrAndRoundUp(numReadWriteBytes, pageSizeLog2);
+		const Uptr numPages = numCodePages + numReadOnlyPages + numReadWritePages;
+		image.numBytes = numPages << pageSizeLog2;
+		if(numPages)
 		{
 			// Reserve enough contiguous pages for all sections.
-			imageBaseAddress = Platform::allocateVirtualPages(numAllocatedImagePages);
-			if(!imageBaseAddress
-			   || !Platform::commitVirtualPages(imageBaseAddress, numAllocatedImagePages))
+			image.baseAddress = codeArena ? codeArena->allocatePages(numPages)
+										  : Platform::allocateVirtualPages(numPages);
+			if(!image.baseAddress || !Platform::commitVirtualPages(image.baseAddress, numPages))
 			{ Errors::fatal("memory allocation for JIT code failed"); }
-			codeSection.baseAddress = imageBaseAddress;
-			readOnlySection.baseAddress
-				= codeSection.baseAddress + (codeSection.numPages << Platform::getPageSizeLog2());
-			readWriteSection.baseAddress
-				= readOnlySection.baseAddress
-				  + (readOnlySection.numPages << Platform::getPageSizeLog2());
+			image.codeSection.baseAddress = image.baseAddress;
+			image.codeSection.numReservedBytes = numCodePages << pageSizeLog2;
+			image.readOnlySection.baseAddress
+				= image.codeSection.baseAddress + image.codeSection.numReservedBytes;
+			image.readOnlySection.numReservedBytes = numReadOnlyPages << pageSizeLog2;
+			image.readWriteSection.baseAddress
+				= image.readOnlySection.baseAddress + image.readOnlySection.numReservedBytes;
+			image.readWriteSection.numReservedBytes = numReadWritePages << pageSizeLog2;
 		}
 	}
 	virtual U8* allocateCodeSection(uintptr_t numBytes,
@@ -175,7 +559,8 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 									U32 sectionID,
 									llvm::StringRef sectionName) override
 	{
-		return allocateBytes((Uptr)numBytes, alignment, codeSection);
+		wavmAssert(images.size());
+		return allocateBytes((Uptr)numBytes, alignment, images.back().codeSection);
 	}
 	virtual U8* allocateDataSection(uintptr_t numBytes,
 									U32 alignment,
@@ -183,8 +568,11 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 									llvm::StringRef SectionName,
 									bool isReadOnly) override
 	{
-		return allocateBytes(
-			(Uptr)numBytes, alignment, isReadOnly ? readOnlySection : readWriteSection);
+		wavmAssert(images.size());
+		return allocateBytes((Uptr)numBytes,
+							 alignment,
+							 isReadOnly ? images.back().readOnlySection
+										: images.back().readWriteSection);
 	}
 	virtual bool finalizeMemory(std::string* ErrMsg = nullptr) override
 	{
@@ -197,54 +585,185 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 	{
 		wavmAssert(!isFinalized);
 		isFinalized = true;
+		const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
 		const Platform::MemoryAccess codeAccess = Platform::MemoryAccess::execute;
-		if(codeSection.numPages)
-		{
-			errorUnless(Platform::setVirtualPageAccess(
-				codeSection.baseAddress, codeSection.numPages, codeAccess));
-		}
-		if(readOnlySection.numPages)
+		for(const Image& image : images)
 		{
-			errorUnless(Platform::setVirtualPageAccess(readOnlySection.baseAddress,
-													   readOnlySection.numPages,
-													   Platform::MemoryAccess::readOnly));
-		}
-		if(readWriteSection.numPages)
-		{
-			errorUnless(Platform::setVirtualPageAccess(readWriteSection.baseAddress,
-													   readWriteSection.numPages,
-													   Platform::MemoryAccess::readWrite));
+			// Packed images are already executable through their executable view.
+			if(image.isPacked) { continue; }
+
+			if(image.codeSection.numReservedBytes)
+			{
+				errorUnless(Platform::setVirtualPageAccess(
+					image.codeSection.baseAddress,
+					image.codeSection.numReservedBytes >> pageSizeLog2,
+					codeAccess));
+			}
+			if(image.readOnlySection.numReservedBytes)
+			{
+				errorUnless(Platform::setVirtualPageAccess(
+					image.readOnlySection.baseAddress,
+					image.readOnlySection.numReservedBytes >> pageSizeLog2,
+					Platform::MemoryAccess::readOnly));
+			}
+			if(image.readWriteSection.numReservedBytes)
+			{
+				errorUnless(Platform::setVirtualPageAccess(
+					image.readWriteSection.baseAddress,
+					image.readWriteSection.numReservedBytes >> pageSizeLog2,
+					Platform::MemoryAccess::readWrite));
+			}
 		}
 	}
 	virtual void invalidateInstructionCache()
 	{
-		// Invalidate the instruction cache for the whole image.
-		llvm::sys::Memory::InvalidateInstructionCache(
-			imageBaseAddress, numAllocatedImagePages << Platform::getPageSizeLog2());
+		// Invalidate the instruction cache for all the module's images.
+		for(const Image& image : images)
+		{ llvm::sys::Memory::InvalidateInstructionCache(image.baseAddress, image.numBytes); }
 	}
 
-	U8* getImageBaseAddress() const { return imageBaseAddress; }
-	Uptr getNumImageBytes() const { return numAllocatedImagePages << Platform::getPageSizeLog2(); }
+	// Allocates code bytes in a specific image after its object has been loaded (e.g. for the SEH
+	// trampoline, which must be within 2GB of the code that uses it).
+	U8* allocateImageCodeBytes(Uptr imageIndex, Uptr numBytes, Uptr alignment)
+	{
+		wavmAssert(imageIndex < images.size());
+		wavmAssert(!images[imageIndex].isPacked);
+		return allocateBytes(numBytes, alignment, images[imageIndex].codeSection);
+	}
+
+	// Finds the growable SEH function table of the arena chunk that an image was allocated from.
+	// Returns false if the image wasn't allocated from an arena chunk with a function table.
+	bool findArenaSEHFunctionTable(Uptr imageIndex,
+								   U8*& outTableBaseAddress,
+								   Uptr& outSEHTrampolineAddress)
+	{
+		wavmAssert(imageIndex < images.size());
+		const Image& image = images[imageIndex];
+		return codeArena && !image.isPacked && image.baseAddress
+			   && codeArena->findSEHFunctionTable(
+				   image.baseAddress, outTableBaseAddress, outSEHTrampolineAddress);
+	}
+	bool addArenaSEHFunctions(const U8* tableBaseAddress, const U8* pdata, Uptr numPDataBytes)
+	{
+		return codeArena->addSEHFunctions(tableBaseAddress, pdata, numPDataBytes);
+	}
+
+	// Registers an image's SEH function table, and deregisters it when the module is unloaded.
+	void registerSEHFunctionTable(U8* tableBaseAddress, U8* pdata, Uptr numPDataBytes)
+	{
+		Platform::registerEHFrames(tableBaseAddress, pdata, numPDataBytes);
+		registeredEHFrames.push_back({tableBaseAddress, pdata, numPDataBytes});
+	}
+
+	Uptr getNumImages() const { return images.size(); }
+	U8* getImageBaseAddress(Uptr imageIndex) const { return images[imageIndex].baseAddress; }
+	Uptr getNumImageBytes(Uptr imageIndex) const { return images[imageIndex].numBytes; }
+
+	// Returns the sections that were allocated in the writable view of packed images, and the
+	// addresses in the executable view that the object loader must relocate them for.
+	const std::vector<std::pair<const U8*, U8*>>& getRemappedSections() const
+	{
+		return remappedSections;
+	}
 
 private:
 	struct Section
 	{
-		U8* baseAddress;
-		Uptr numPages;
-		Uptr numCommittedBytes;
+		U8* baseAddress = nullptr;
+		Uptr numReservedBytes = 0;
+		Uptr numCommittedBytes = 0;
+
+		// The offset from the address that the section is written at to the address that it is
+		// executed or read from, if the section is in the executable view of a packed image.
+		Uptr loadAddressOffset = 0;
+	};
+
+	// An image is either a range of pages that is only used by the image, or part of a packed chunk
+	// of dual-mapped pages that is shared with other images. baseAddress and numBytes are the
+	// address range that the image's code is executed from: for a packed image, the range contains
+	// the executable view of the image's code and read-only data, and the image's read-write data
+	// is at the same offsets in the writable view, starting at writableBaseAddress.
+	struct Image
+	{
+		U8* baseAddress = nullptr;
+		Uptr numBytes = 0;
+		bool isPacked = false;
+		U8* writableBaseAddress = nullptr;
+
+		Section codeSection;
+		Section readOnlySection;
+		Section readWriteSection;
+	};
+
+	struct EHFrames
+	{
+		U8* imageBaseAddress;
+		U8* address;
+		Uptr numBytes;
 	};
 
-	U8* imageBaseAddress;
-	Uptr numAllocatedImagePages;
+	CodeArena* codeArena;
+	std::vector<Image> images;
 	bool isFinalized;
 
-	Section codeSection;
-	Section readOnlySection;
-	Section readWriteSection;
+	std::vector<EHFrames> registeredEHFrames;
+	std::vector<std::pair<const U8*, U8*>> remappedSections;
+
+	// Reserves an image's sections in the arena's dual-mapped pages: the code and read-only data
+	// are loaded for the executable view, and the read-write data for the writable view. Returns
+	// false if the arena doesn't support dual-mapped pages.
+	bool reservePackedImage(Image& image,
+							Uptr numCodeBytes,
+							Uptr codeAlignment,
+							Uptr numReadOnlyBytes,
+							Uptr readOnlyAlignment,
+							Uptr numReadWriteBytes,
+							Uptr readWriteAlignment)
+	{
+		// The object loader reserves a multiple of each kind of section's largest alignment, so
+		// aligning each kind of section to it leaves enough space for the individual sections.
+		codeAlignment = std::max(codeAlignment, Uptr(16));
+		readOnlyAlignment = std::max(readOnlyAlignment, Uptr(1));
+		readWriteAlignment = std::max(readWriteAlignment, Uptr(1));
+		const Uptr readOnlyOffset = align(numCodeBytes, readOnlyAlignment);
+		const Uptr readWriteOffset = align(readOnlyOffset + numReadOnlyBytes, readWriteAlignment);
+		const Uptr numBytes = readWriteOffset + numReadWriteBytes;
+		const Uptr alignment
+			= std::max(codeAlignment, std::max(readOnlyAlignment, readWriteAlignment));
+
+		U8* writableBaseAddress;
+		Uptr executableOffset;
+		if(!codeArena->allocatePackedBytes(
+			   numBytes, alignment, writableBaseAddress, executableOffset))
+		{ return false; }
+
+		image.isPacked = true;
+		image.writableBaseAddress = writableBaseAddress;
+		image.baseAddress = writableBaseAddress + executableOffset;
+		image.numBytes = numBytes;
+		image.codeSection.baseAddress = writableBaseAddress;
+		image.codeSection.numReservedBytes = numCodeBytes;
+		image.codeSection.loadAddressOffset = executableOffset;
+		image.readOnlySection.baseAddress = writableBaseAddress + readOnlyOffset;
+		image.readOnlySection.numReservedBytes = numReadOnlyBytes;
+		image.readOnlySection.loadAddressOffset = executableOffset;
+		image.readWriteSection.baseAddress = writableBaseAddress + readWriteOffset;
+		image.readWriteSection.numReservedBytes = numReadWriteBytes;
+		return true;
+	}
 
-	bool hasRegisteredEHFrames;
-	U8* ehFramesAddr;
-	Uptr ehFramesNumBytes;
+	const Image& getImageContainingAddress(const U8* address) const
+	{
+		for(const Image& image : images)
+		{
+			if(address >= image.baseAddress && address < image.baseAddress + image.numBytes)
+			{ return image; }
+			if(image.isPacked && address >= image.writableBaseAddress
+			   && address < image.writableBaseAddress + image.numBytes)
+			{ return image; }
+		}
+		Errors::unreachable();
+	}
 
 	U8* allocateBytes(Uptr numBytes, Uptr alignment, Section& section)
 	{
@@ -260,9 +779,15 @@ private:
 			= align(section.numCommittedBytes, alignment) + align(numBytes, alignment);
 
 		// Check that enough space was reserved in the section.
-		if(section.numCommittedBytes > (section.numPages << Platform::getPageSizeLog2()))
+		if(section.numCommittedBytes > section.numReservedBytes)
 		{ Errors::fatal("didn't reserve enough space in section"); }
 
+		if(section.loadAddressOffset)
+		{
+			remappedSections.push_back(
+				{allocationBaseAddress, allocationBaseAddress + section.loadAddressOffset});
+		}
+
 		return allocationBaseAddress;
 	}
 
@@ -279,23 +804,182 @@ private:
 	void operator=(const ModuleMemoryManager&) = delete;
 };
 
+// If the object code was compiled for several target versions, returns the object code of the
+// most preferred version that the host supports. Otherwise, returns the object code unmodified.
+static std::vector<U8> selectTargetVersion(const std::vector<U8>& objectCode)
+{
+	if(objectCode.size() < sizeof(multiVersionMagic)
+	   || memcmp(objectCode.data(), multiVersionMagic, sizeof(multiVersionMagic)))
+	{ return objectCode; }
+
+	Uptr offset = sizeof(multiVersionMagic);
+	auto readU64 = [&objectCode, &offset]() {
+		errorUnless(offset + sizeof(U64) <= objectCode.size());
+		U64 value;
+		memcpy(&value, objectCode.data() + offset, sizeof(U64));
+		offset += sizeof(U64);
+		return value;
+	};
+	auto readString = [&objectCode, &offset, &readU64]() {
+		const U64 numChars = readU64();
+		errorUnless(numChars <= objectCode.size() - offset);
+		std::string string((const char*)objectCode.data() + offset, Uptr(numChars));
+		offset += Uptr(numChars);
+		return string;
+	};
+
+	// Read the header, and find the first version that the host supports. The last version is
+	// the baseline, which is used if the host doesn't support any of the others.
+	const U64 numVersions = readU64();
+	errorUnless(numVersions > 0);
+	Uptr selectedVersionIndex = UINTPTR_MAX;
+	std::vector<U64> versionNumObjectBytes;
+	std::string selectedTargetCPU;
+	for(U64 versionIndex = 0; versionIndex < numVersions; ++versionIndex)
+	{
+		std::string targetCPU = readString();
+		std::string targetFeatureList = readString();
+		versionNumObjectBytes.push_back(readU64());
+
+		if(selectedVersionIndex == UINTPTR_MAX)
+		{
+			llvm::SmallVector<llvm::StringRef, 8> targetFeatureRefs;
+			llvm::StringRef(targetFeatureList).split(targetFeatureRefs, ',', -1, false);
+			std::vector<std::string> targetFeatures;
+			for(llvm::StringRef targetFeature : targetFeatureRefs)
+			{ targetFeatures.push_back(targetFeature.str()); }
+
+			if(versionIndex + 1 == numVersions
+			   || isTargetSupportedByHost(targetCPU, targetFeatures))
+			{
+				selectedVersionIndex = Uptr(versionIndex);
+				selectedTargetCPU = std::move(targetCPU);
+			}
+		}
+	}
+
+	// Skip the object code of the versions preceding the selected version.
+	Uptr objectOffset = offset;
+	for(Uptr versionIndex = 0; versionIndex <= selectedVersionIndex; ++versionIndex)
+	{
+		objectOffset = (objectOffset + multiObjectAlignment - 1) & ~(multiObjectAlignment - 1);
+		errorUnless(objectOffset <= objectCode.size()
+					&& versionNumObjectBytes[versionIndex] <= objectCode.size() - objectOffset);
+		if(versionIndex < selectedVersionIndex)
+		{ objectOffset += Uptr(versionNumObjectBytes[versionIndex]); }
+	}
+
+	Log::printf(Log::debug,
+				"Loading object code compiled for target CPU '%s'\n",
+				selectedTargetCPU.c_str());
+
+	const U8* selectedObjectCode = objectCode.data() + objectOffset;
+	return std::vector<U8>(selectedObjectCode,
+						   selectedObjectCode + versionNumObjectBytes[selectedVersionIndex]);
+}
+
+static void unpackObjectFiles(const std::vector<U8>& objectCode,
+							  std::vector<llvm::StringRef>& outObjectFiles)
+{
+	if(objectCode.size() < sizeof(multiObjectMagic)
+	   || memcmp(objectCode.data(), multiObjectMagic, sizeof(multiObjectMagic)))
+	{
+		// If the object code doesn't start with the multi-object magic number, it's a single
+		// object file.
+		outObjectFiles.push_back(
+			llvm::StringRef((const char*)objectCode.data(), objectCode.size()));
+		return;
+	}
+
+	// Read the number of object files and their sizes from the header.
+	Uptr offset = sizeof(multiObjectMagic);
+	errorUnless(offset + sizeof(U64) <= objectCode.size());
+	U64 numObjects;
+	memcpy(&numObjects, objectCode.data() + offset, sizeof(U64));
+	offset += sizeof(U64);
+	errorUnless(numObjects <= (objectCode.size() - offset) / sizeof(U64));
+
+	Uptr objectOffset = offset + Uptr(numObjects) * sizeof(U64);
+	for(U64 objectIndex = 0; objectIndex < numObjects; ++objectIndex)
+	{
+		U64 numObjectBytes;
+		memcpy(&numObjectBytes, objectCode.data() + offset, sizeof(U64));
+		offset += sizeof(U64);
+
+		objectOffset = (objectOffset + multiObjectAlignment - 1) & ~(multiObjectAlignment - 1);
+		errorUnless(objectOffset <= objectCode.size()
+					&& numObjectBytes <= objectCode.size() - objectOffset);
+		outObjectFiles.push_back(
+			llvm::StringRef((const char*)objectCode.data() + objectOffset, Uptr(numObjectBytes)));
+		objectOffset += Uptr(numObjectBytes);
+	}
+}
+
+bool LLVMJIT::getPartitionObjects(const std::vector<U8>& objectCode,
+								  std::vector<std::vector<U8>>& outPartitionObjects)
+{
+	if(objectCode.size() >= sizeof(multiVersionMagic)
+	   && !memcmp(objectCode.data(), multiVersionMagic, sizeof(multiVersionMagic)))
+	{ return false; }
+
+	std::vector<llvm::StringRef> objectFiles;
+	unpackObjectFiles(objectCode, objectFiles);
+	outPartitionObjects.clear();
+	for(llvm::StringRef objectFile : objectFiles)
+	{ outPartitionObjects.emplace_back(objectFile.bytes_begin(), objectFile.bytes_end()); }
+	return true;
+}
+
+static Metrics::Histogram loadTimeHistogram("llvmjit.load_us",
+											 "Time to load a module's object code in microseconds");
+static Metrics::Gauge codeBytesGauge("llvmjit.code_bytes",
+									 "Number of bytes of code and data in loaded modules");
+
 LoadedModule::LoadedModule(const std::vector<U8>& inObjectBytes,
 						   const HashMap<std::string, Uptr>& importedSymbolMap,
-						   bool shouldLogMetrics)
-: memoryManager(new ModuleMemoryManager()), objectBytes(inObjectBytes)
+						   bool shouldLogMetrics,
+						   CodeArena* codeArena)
+: LoadedModule(
+	inObjectBytes,
+	[&importedSymbolMap](llvm::StringRef name, Uptr& outValue) {
+		const Uptr* symbolValue = importedSymbolMap.get(name.str());
+		if(!symbolValue) { return false; }
+		outValue = *symbolValue;
+		return true;
+	},
+	shouldLogMetrics,
+	codeArena)
+{
+}
+
+LoadedModule::LoadedModule(const std::vector<U8>& inObjectBytes,
+						   ImportedSymbolResolver resolveImportedSymbol,
+						   bool shouldLogMetrics,
+						   CodeArena* codeArena)
+: memoryManager(new ModuleMemoryManager(codeArena))
+, isRegisteredWithDebugger(isDebuggerRegistrationEnabled.load(std::memory_order_relaxed))
+, objectBytes(selectTargetVersion(inObjectBytes))
 {
 	Timing::Timer loadObjectTimer;
 
-	object = cantFail(llvm::object::ObjectFile::createObjectFile(llvm::MemoryBufferRef(
-		llvm::StringRef((const char*)objectBytes.data(), objectBytes.size()), "memory")));
+	// The object code may contain several object files if the module was compiled in parallel
+	// partitions. They are all loaded by a single RuntimeDyld, which resolves the references
+	// between them.
+	std::vector<llvm::StringRef> objectFiles;
+	unpackObjectFiles(objectBytes, objectFiles);
+	for(llvm::StringRef objectFile : objectFiles)
+	{
+		objects.push_back(cantFail(llvm::object::ObjectFile::createObjectFile(
+			llvm::MemoryBufferRef(objectFile, "memory"))));
+	}
 
 	// Create the LLVM object loader.
 	struct SymbolResolver : llvm::JITSymbolResolver
 	{
-		const HashMap<std::string, Uptr>& importedSymbolMap;
+		ImportedSymbolResolver resolveImportedSymbol;
 
-		SymbolResolver(const HashMap<std::string, Uptr>& inImportedSymbolMap)
-		: importedSymbolMap(inImportedSymbolMap)
+		SymbolResolver(ImportedSymbolResolver inResolveImportedSymbol)
+		: resolveImportedSymbol(inResolveImportedSymbol)
 		{
 		}
 
@@ -324,17 +1008,17 @@ LoadedModule::LoadedModule(const std::vector<U8>& inObjectBytes,
 	private:
 		llvm::JITEvaluatedSymbol findSymbolImpl(llvm::StringRef name)
 		{
-			const Uptr* symbolValue = importedSymbolMap.get(name.str());
-			if(!symbolValue) { return resolveJITImport(name); }
+			Uptr symbolValue = 0;
+			if(!resolveImportedSymbol(name, symbolValue)) { return resolveJITImport(name); }
 			else
 			{
 				// LLVM assumes that a symbol value of zero is a symbol that wasn't resolved.
-				wavmAssert(*symbolValue);
-				return llvm::JITEvaluatedSymbol(U64(*symbolValue), llvm::JITSymbolFlags::None);
+				wavmAssert(symbolValue);
+				return llvm::JITEvaluatedSymbol(U64(symbolValue), llvm::JITSymbolFlags::None);
 			}
 		}
 	};
-	SymbolResolver symbolResolver(importedSymbolMap);
+	SymbolResolver symbolResolver(resolveImportedSymbol);
 	llvm::RuntimeDyld loader(*memoryManager, symbolResolver);
 
 	// Process all sections on non-Windows platforms. On Windows, this triggers errors due to
@@ -348,175 +1032,344 @@ LoadedModule::LoadedModule(const std::vector<U8>& inObjectBytes,
 	// (https://github.com/llvm-mirror/llvm/blob/e84d8c12d5157a926db15976389f703809c49aa5/lib/ExecutionEngine/RuntimeDyld/Targets/RuntimeDyldCOFFX86_64.h#L96)
 	// Make a copy of those sections before they are clobbered, so we can do the fixup ourselves
 	// later.
-	llvm::object::SectionRef pdataSection;
-	U8* pdataCopy = nullptr;
-	Uptr pdataNumBytes = 0;
-	llvm::object::SectionRef xdataSection;
-	U8* xdataCopy = nullptr;
+	struct SEHSections
+	{
+		llvm::object::SectionRef pdataSection;
+		U8* pdataCopy = nullptr;
+		Uptr pdataNumBytes = 0;
+		llvm::object::SectionRef xdataSection;
+		U8* xdataCopy = nullptr;
+	};
+	std::vector<SEHSections> sehSections(objects.size());
 	if(USE_WINDOWS_SEH)
 	{
-		for(auto section : object->sections())
+		for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
 		{
-			llvm::StringRef sectionName;
-			if(!section.getName(sectionName))
+			SEHSections& objectSEHSections = sehSections[objectIndex];
+			for(auto section : objects[objectIndex]->sections())
 			{
-				llvm::StringRef sectionContents;
-				if(!section.getContents(sectionContents))
+				llvm::StringRef sectionName;
+				if(!section.getName(sectionName))
 				{
-					const U8* loadedSection = (const U8*)sectionContents.data();
-					if(sectionName == ".pdata")
+					llvm::StringRef sectionContents;
+					if(!section.getContents(sectionContents))
 					{
-						pdataCopy = new U8[section.getSize()];
-						pdataNumBytes = section.getSize();
-						pdataSection = section;
-						memcpy(pdataCopy, loadedSection, section.getSize());
-					}
-					else if(sectionName == ".xdata")
-					{
-						xdataCopy = new U8[section.getSize()];
-						xdataSection = section;
-						memcpy(xdataCopy, loadedSection, section.getSize());
+						const U8* loadedSection = (const U8*)sectionContents.data();
+						if(sectionName == ".pdata")
+						{
+							objectSEHSections.pdataCopy = new U8[section.getSize()];
+							objectSEHSections.pdataNumBytes = section.getSize();
+							objectSEHSections.pdataSection = section;
+							memcpy(objectSEHSections.pdataCopy, loadedSection, section.getSize());
+						}
+						else if(sectionName == ".xdata")
+						{
+							objectSEHSections.xdataCopy = new U8[section.getSize()];
+							objectSEHSections.xdataSection = section;
+							memcpy(objectSEHSections.xdataCopy, loadedSection, section.getSize());
+						}
 					}
 				}
 			}
 		}
 	}
 
-	// Use the LLVM object loader to load the object.
-	std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo> loadedObject = loader.loadObject(*object);
+	// Use the LLVM object loader to load the objects. Each object is given its own image by the
+	// memory manager, so the image index is the same as the object index.
+	for(auto& object : objects) { loadedObjects.push_back(loader.loadObject(*object)); }
+	wavmAssert(memoryManager->getNumImages() == objects.size());
+
+	// Relocate the sections that were written to the writable view of packed images for the
+	// addresses they are executed from.
+	for(const auto& remappedSection : memoryManager->getRemappedSections())
+	{
+		loader.mapSectionAddress(remappedSection.first,
+								 U64(reinterpret_cast<Uptr>(remappedSection.second)));
+	}
 	loader.finalizeWithMemoryManagerLocking();
 	if(loader.hasError())
 	{ Errors::fatalf("RuntimeDyld failed: %s", loader.getErrorString().data()); }
 
-	if(USE_WINDOWS_SEH && pdataCopy)
+	for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
 	{
-		// Lookup the real address of __C_specific_handler.
-		const llvm::JITEvaluatedSymbol sehHandlerSymbol = resolveJITImport("__C_specific_handler");
-		errorUnless(sehHandlerSymbol);
-		const U64 sehHandlerAddress = U64(sehHandlerSymbol.getAddress());
-
-		// Create a trampoline within the image's 2GB address space that jumps to
-		// __C_specific_handler. jmp [rip+0] <64-bit address>
-		U8* trampolineBytes = memoryManager->allocateCodeSection(16, 16, 0, "seh_trampoline");
-		trampolineBytes[0] = 0xff;
-		trampolineBytes[1] = 0x25;
-		memset(trampolineBytes + 2, 0, 4);
-		memcpy(trampolineBytes + 6, &sehHandlerAddress, sizeof(U64));
-
-		processSEHTables(memoryManager->getImageBaseAddress(),
-						 *loadedObject,
-						 pdataSection,
-						 pdataCopy,
-						 pdataNumBytes,
-						 xdataSection,
-						 xdataCopy,
-						 reinterpret_cast<Uptr>(trampolineBytes));
-
-		Platform::registerEHFrames(
-			memoryManager->getImageBaseAddress(),
-			reinterpret_cast<const U8*>(Uptr(loadedObject->getSectionLoadAddress(pdataSection))),
-			pdataNumBytes);
-	}
+		SEHSections& objectSEHSections = sehSections[objectIndex];
+		if(USE_WINDOWS_SEH && objectSEHSections.pdataCopy)
+		{
+			U8* pdata = reinterpret_cast<U8*>(Uptr(
+				loadedObjects[objectIndex]->getSectionLoadAddress(objectSEHSections.pdataSection)));
+
+			// If the image was allocated from an arena chunk with a growable function table, make
+			// the image's function table relative to the chunk, and add it to the chunk's table.
+			U8* tableBaseAddress = nullptr;
+			Uptr sehTrampolineAddress = 0;
+			if(memoryManager->findArenaSEHFunctionTable(
+				   objectIndex, tableBaseAddress, sehTrampolineAddress))
+			{
+				processSEHTables(tableBaseAddress,
+								 *loadedObjects[objectIndex],
+								 objectSEHSections.pdataSection,
+								 objectSEHSections.pdataCopy,
+								 objectSEHSections.pdataNumBytes,
+								 objectSEHSections.xdataSection,
+								 objectSEHSections.xdataCopy,
+								 sehTrampolineAddress);
+				if(!memoryManager->addArenaSEHFunctions(
+					   tableBaseAddress, pdata, objectSEHSections.pdataNumBytes))
+				{
+					memoryManager->registerSEHFunctionTable(
+						tableBaseAddress, pdata, objectSEHSections.pdataNumBytes);
+				}
+			}
+			else
+			{
+				// Lookup the real address of __C_specific_handler.
+				const llvm::JITEvaluatedSymbol sehHandlerSymbol
+					= resolveJITImport("__C_specific_handler");
+				errorUnless(sehHandlerSymbol);
+				const U64 sehHandlerAddress = U64(sehHandlerSymbol.getAddress());
+
+				// Create a trampoline within the image's 2GB address space that jumps to
+				// __C_specific_handler. jmp [rip+0] <64-bit address>
+				U8* trampolineBytes = memoryManager->allocateImageCodeBytes(objectIndex, 16, 16);
+				trampolineBytes[0] = 0xff;
+				trampolineBytes[1] = 0x25;
+				memset(trampolineBytes + 2, 0, 4);
+				memcpy(trampolineBytes + 6, &sehHandlerAddress, sizeof(U64));
+
+				U8* imageBaseAddress = memoryManager->getImageBaseAddress(objectIndex);
+				processSEHTables(imageBaseAddress,
+								 *loadedObjects[objectIndex],
+								 objectSEHSections.pdataSection,
+								 objectSEHSections.pdataCopy,
+								 objectSEHSections.pdataNumBytes,
+								 objectSEHSections.xdataSection,
+								 objectSEHSections.xdataCopy,
+								 reinterpret_cast<Uptr>(trampolineBytes));
+				memoryManager->registerSEHFunctionTable(
+					imageBaseAddress, pdata, objectSEHSections.pdataNumBytes);
+			}
+		}
 
-	// Free the copies of the Windows SEH sections created above.
-	if(pdataCopy)
-	{
-		delete[] pdataCopy;
-		pdataCopy = nullptr;
-	}
-	if(xdataCopy)
-	{
-		delete[] xdataCopy;
-		xdataCopy = nullptr;
+		// Free the copies of the Windows SEH sections created above.
+		if(objectSEHSections.pdataCopy)
+		{
+			delete[] objectSEHSections.pdataCopy;
+			objectSEHSections.pdataCopy = nullptr;
+		}
+		if(objectSEHSections.xdataCopy)
+		{
+			delete[] objectSEHSections.xdataCopy;
+			objectSEHSections.xdataCopy = nullptr;
+		}
 	}
 
 	// After having a chance to manually apply relocations for the pdata/xdata sections, apply the
 	// final non-writable memory permissions.
 	memoryManager->reallyFinalizeMemory();
 
-	// Notify GDB of the new object.
-	if(!gdbRegistrationListener)
-	{ gdbRegistrationListener = llvm::JITEventListener::createGDBRegistrationListener(); }
-	gdbRegistrationListener->NotifyObjectEmitted(*object, *loadedObject);
-
-	// Create a DWARF context to interpret the debug information in this compilation unit.
-	auto dwarfContext = llvm::DWARFContext::create(*object, &*loadedObject);
-
-	// Iterate over the functions in the loaded object.
-	for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
-		llvm::object::computeSymbolSizes(*object))
-	{
-		llvm::object::SymbolRef symbol = symbolSizePair.first;
-
-		// Get the type, name, and address of the symbol. Need to be careful not to get the
-		// Expected<T> for each value unless it will be checked for success before continuing.
-		llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
-		if(!type || *type != llvm::object::SymbolRef::ST_Function) { continue; }
-		llvm::Expected<llvm::StringRef> name = symbol.getName();
-		if(!name) { continue; }
-		llvm::Expected<U64> address = symbol.getAddress();
-		if(!address) { continue; }
-
-		// Compute the address the function was loaded at.
-		wavmAssert(*address <= UINTPTR_MAX);
-		Uptr loadedAddress = Uptr(*address);
-		if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
-		{ loadedAddress += (Uptr)loadedObject->getSectionLoadAddress(*symbolSection.get()); }
-
-		// Get the DWARF line info for this symbol, which maps machine code addresses to
-		// WebAssembly op indices.
-		llvm::DILineInfoTable lineInfoTable
-			= dwarfContext->getLineInfoForAddressRange(loadedAddress, symbolSizePair.second);
-		std::map<U32, U32> offsetToOpIndexMap;
-		for(auto lineInfo : lineInfoTable)
-		{ offsetToOpIndexMap.emplace(U32(lineInfo.first - loadedAddress), lineInfo.second.Line); }
+	// The functions loaded from the objects, along with the index of their first operator index in
+	// opIndices, which may be reallocated until all the objects are loaded.
+	struct LoadedFunction
+	{
+		JITFunction function;
+		Uptr firstOpIndex;
+		std::string name;
+	};
+	std::vector<LoadedFunction> loadedFunctions;
+
+	for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+	{
+		const llvm::object::ObjectFile& object = *objects[objectIndex];
+		const llvm::RuntimeDyld::LoadedObjectInfo& loadedObject
+			= static_cast<const llvm::RuntimeDyld::LoadedObjectInfo&>(*loadedObjects[objectIndex]);
 
-#if PRINT_DISASSEMBLY
-		if(shouldLogMetrics)
+		// Notify GDB of the new object.
+		if(isRegisteredWithDebugger)
 		{
-			Log::printf(Log::error, "Disassembly for function %s\n", name.get().data());
-			disassembleFunction(reinterpret_cast<U8*>(loadedAddress), Uptr(symbolSizePair.second));
+			Lock<Platform::Mutex> gdbRegistrationListenerLock(gdbRegistrationListenerMutex);
+			if(!gdbRegistrationListener)
+			{ gdbRegistrationListener = llvm::JITEventListener::createGDBRegistrationListener(); }
+			gdbRegistrationListener->NotifyObjectEmitted(object, loadedObject);
 		}
+
+		// Create a DWARF context to interpret the debug information in this compilation unit.
+		auto dwarfContext = llvm::DWARFContext::create(object, &loadedObject);
+
+		// Iterate over the functions in the loaded object.
+		for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
+			llvm::object::computeSymbolSizes(object))
+		{
+			llvm::object::SymbolRef symbol = symbolSizePair.first;
+
+			// Get the type, name, and address of the symbol. Need to be careful not to get the
+			// Expected<T> for each value unless it will be checked for success before continuing.
+			llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+			if(!type || *type != llvm::object::SymbolRef::ST_Function) { continue; }
+			llvm::Expected<llvm::StringRef> name = symbol.getName();
+			if(!name) { continue; }
+			llvm::Expected<U64> address = symbol.getAddress();
+			if(!address) { continue; }
+
+			// Compute the address the function was loaded at.
+			wavmAssert(*address <= UINTPTR_MAX);
+			Uptr loadedAddress = Uptr(*address);
+			if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
+			{ loadedAddress += (Uptr)loadedObject.getSectionLoadAddress(*symbolSection.get()); }
+
+			// Get the DWARF line info for this symbol, which maps machine code addresses to
+			// WebAssembly op indices.
+			// The operator indices are sorted by offset, and only the first operator index at each
+			// offset is kept.
+			llvm::DILineInfoTable lineInfoTable
+				= dwarfContext->getLineInfoForAddressRange(loadedAddress, symbolSizePair.second);
+			const Uptr firstOpIndex = opIndices.size();
+			for(auto lineInfo : lineInfoTable)
+			{ opIndices.push_back({U32(lineInfo.first - loadedAddress), lineInfo.second.Line}); }
+			std::stable_sort(opIndices.begin() + firstOpIndex,
+							 opIndices.end(),
+							 [](const JITFunctionOpIndex& left, const JITFunctionOpIndex& right) {
+								 return left.offset < right.offset;
+							 });
+			opIndices.erase(std::unique(opIndices.begin() + firstOpIndex,
+										opIndices.end(),
+										[](const JITFunctionOpIndex& left,
+										   const JITFunctionOpIndex& right) {
+											return left.offset == right.offset;
+										}),
+							opIndices.end());
+
+#if PRINT_DISASSEMBLY
+			if(shouldLogMetrics)
+			{
+				Log::printf(Log::error, "Disassembly for function %s\n", name.get().data());
+				disassembleFunction(reinterpret_cast<U8*>(loadedAddress),
+									Uptr(symbolSizePair.second));
+			}
 #endif
 
-		// Notify the JIT unit that the symbol was loaded.
-		wavmAssert(symbolSizePair.second <= UINTPTR_MAX);
-		JITFunction* jitFunction = new JITFunction(
-			loadedAddress, Uptr(symbolSizePair.second), std::move(offsetToOpIndexMap));
-		functions.push_back(std::unique_ptr<JITFunction>(jitFunction));
-		nameToFunctionMap.addOrFail(*name, jitFunction);
-		addressToFunctionMap.emplace(jitFunction->baseAddress + jitFunction->numBytes, jitFunction);
+			// Record the function until all the objects are loaded.
+			wavmAssert(symbolSizePair.second <= UINTPTR_MAX);
+			wavmAssert(opIndices.size() - firstOpIndex <= UINT32_MAX);
+			JITFunction jitFunction(loadedAddress, Uptr(symbolSizePair.second));
+			jitFunction.numOpIndices = U32(opIndices.size() - firstOpIndex);
+			loadedFunctions.push_back({jitFunction, firstOpIndex, name->str()});
+		}
 	}
 
-	addressToModuleMap.emplace(reinterpret_cast<Uptr>(memoryManager->getImageBaseAddress()
-													  + memoryManager->getNumImageBytes()),
-							   this);
+	// Sort the functions by address, so getJITFunctionByAddress can binary search them, and store
+	// them contiguously in the module.
+	std::sort(loadedFunctions.begin(),
+			  loadedFunctions.end(),
+			  [](const LoadedFunction& left, const LoadedFunction& right) {
+				  return left.function.baseAddress < right.function.baseAddress;
+			  });
+	opIndices.shrink_to_fit();
+	functions.reserve(loadedFunctions.size());
+	for(LoadedFunction& loadedFunction : loadedFunctions)
+	{
+		JITFunction& jitFunction = loadedFunction.function;
+		jitFunction.opIndices = opIndices.data() + loadedFunction.firstOpIndex;
+		functions.push_back(jitFunction);
+
+		// Internal symbols (e.g. __try_prologue) may be defined by more than one of the module's
+		// objects, so only add the first definition of a name to the name map. The name map is
+		// only used to look up the external symbols, which are defined once.
+		nameToFunctionMap.add(std::move(loadedFunction.name), &functions.back());
+	}
+
+	// Add the module's images to the global module address table.
+	std::vector<ModuleAddressRange> imageRanges;
+	for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+	{
+		if(!memoryManager->getNumImageBytes(imageIndex)) { continue; }
+		const Uptr imageBaseAddress
+			= reinterpret_cast<Uptr>(memoryManager->getImageBaseAddress(imageIndex));
+		const Uptr imageEndAddress
+			= imageBaseAddress + memoryManager->getNumImageBytes(imageIndex);
+		imageRanges.push_back({imageBaseAddress, imageEndAddress, this});
+		codeBytesGauge.add(I64(imageEndAddress - imageBaseAddress));
+	}
+	updateModuleAddressTable(imageRanges, nullptr);
 
+	loadTimeHistogram.record(loadObjectTimer.getMicroseconds());
 	if(shouldLogMetrics)
 	{
 		Timing::logRatePerSecond(
 			"Loaded object", loadObjectTimer, (F64)objectBytes.size() / 1024.0 / 1024.0, "MB");
 	}
+
+	// The object code is only needed after loading to deregister it from GDB.
+	if(!isRegisteredWithDebugger)
+	{
+		loadedObjects.clear();
+		objects.clear();
+		objectBytes = std::vector<U8>();
+	}
 }
 
 LLVMJIT::LoadedModule::~LoadedModule()
 {
-	// Notify GDB that the object is being unloaded.
-	gdbRegistrationListener->NotifyFreeingObject(*object);
+	// Notify GDB that the objects are being unloaded.
+	if(isRegisteredWithDebugger)
+	{
+		Lock<Platform::Mutex> gdbRegistrationListenerLock(gdbRegistrationListenerMutex);
+		for(auto& object : objects) { gdbRegistrationListener->NotifyFreeingObject(*object); }
+	}
 
-	// Remove the module from the global address to module map.
-	Lock<Platform::Mutex> addressToModuleMapLock(addressToModuleMapMutex);
-	addressToModuleMap.erase(addressToModuleMap.find(reinterpret_cast<Uptr>(
-		memoryManager->getImageBaseAddress() + memoryManager->getNumImageBytes())));
+	// Remove the module's images from the global module address table.
+	updateModuleAddressTable({}, this);
+	for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+	{ codeBytesGauge.add(-I64(memoryManager->getNumImageBytes(imageIndex))); }
 
 	// Delete the memory manager.
 	delete memoryManager;
 }
 
+void LLVMJIT::registerJITFunctionsWithProfilers(
+	const LoadedModule* jitModule,
+	const HashMap<std::string, std::string>& symbolDisplayNames)
+{
+	if(!Platform::isJITProfilerOutputEnabled()) { return; }
+
+	for(const auto& nameFunctionPair : jitModule->nameToFunctionMap)
+	{
+		const JITFunction* function = nameFunctionPair.value;
+
+		// The DWARF line numbers of a function's code are the indices of the operators it was
+		// compiled from.
+		std::vector<Platform::JITFunctionLine> lines;
+		for(U32 index = 0; index < function->numOpIndices; ++index)
+		{ lines.push_back({function->opIndices[index].offset, function->opIndices[index].opIndex}); }
+
+		const std::string* displayName = symbolDisplayNames.get(nameFunctionPair.key);
+		Platform::registerJITFunction(displayName ? *displayName : nameFunctionPair.key,
+									  function->baseAddress,
+									  function->numBytes,
+									  lines);
+	}
+}
+
+// Parses a symbol name created by getExternalName into its base name and index.
+static bool parseExternalName(llvm::StringRef name, llvm::StringRef& outBaseName, Uptr& outIndex)
+{
+	Uptr numDigits = 0;
+	while(numDigits < name.size() && name[name.size() - numDigits - 1] >= '0'
+		  && name[name.size() - numDigits - 1] <= '9')
+	{ ++numDigits; }
+	if(!numDigits || numDigits == name.size()) { return false; }
+
+	outBaseName = name.drop_back(numDigits);
+	U64 index = 0;
+	if(name.take_back(numDigits).getAsInteger(10, index) || index > UINTPTR_MAX) { return false; }
+	outIndex = Uptr(index);
+	return true;
+}
+
 LoadedModule* LLVMJIT::loadModule(const std::vector<U8>& objectFileBytes,
 								  HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
 								  std::vector<FunctionType>&& types,
 								  std::vector<FunctionBinding>&& functionImports,
+								  std::vector<FunctionBinding>&& functionDefs,
 								  std::vector<TableBinding>&& tables,
 								  std::vector<MemoryBinding>&& memories,
 								  std::vector<GlobalBinding>&& globals,
@@ -525,104 +1378,148 @@ LoadedModule* LLVMJIT::loadModule(const std::vector<U8>& objectFileBytes,
 								  TableBinding defaultTable,
 								  ModuleInstance* moduleInstance,
 								  Uptr tableReferenceBias,
+								  Uptr epochAddress,
+								  Uptr profileCountersAddress,
 								  const std::vector<FunctionInstance*>& functionDefInstances,
-								  std::vector<JITFunction*>& outFunctionDefs)
+								  const std::vector<std::string>& functionDefNames,
+								  std::vector<JITFunction*>& outFunctionDefs,
+								  CodeArena* codeArena)
 {
-	// Bind undefined symbols in the compiled object to values.
-	HashMap<std::string, Uptr> importedSymbolMap;
-
-	// Bind the wavmIntrinsic function symbols; the compiled module assumes they have the intrinsic
-	// calling convention, so no thunking is necessary.
-	for(auto exportMapPair : wavmIntrinsicsExportMap)
-	{
-		importedSymbolMap.addOrFail(exportMapPair.key,
-									reinterpret_cast<Uptr>(exportMapPair.value.nativeFunction));
-	}
-
-	// Bind the type ID symbols.
-	for(Uptr typeIndex = 0; typeIndex < types.size(); ++typeIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("typeId", typeIndex),
-									types[typeIndex].getEncoding().impl);
-	}
-
-	// Bind imported function symbols.
-	for(Uptr importIndex = 0; importIndex < functionImports.size(); ++importIndex)
-	{
-		void* nativeFunction = functionImports[importIndex].nativeFunction;
-		importedSymbolMap.addOrFail(getExternalName("functionImport", importIndex),
-									reinterpret_cast<Uptr>(nativeFunction));
-	}
-
-	// Bind the defined function instances.
-	for(Uptr functionDefIndex = 0; functionDefIndex < functionDefInstances.size();
-		++functionDefIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("functionDefInstance", functionDefIndex),
-									reinterpret_cast<Uptr>(functionDefInstances[functionDefIndex]));
-	}
-
-	// Bind the table symbols. The compiled module uses the symbol's value as an offset into
-	// CompartmentRuntimeData to the table's entry in CompartmentRuntimeData::tableBases.
-	for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
-	{
-		importedSymbolMap.addOrFail(
-			getExternalName("tableOffset", tableIndex),
-			offsetof(CompartmentRuntimeData, tableBases) + sizeof(void*) * tables[tableIndex].id);
-	}
-
-	// Bind the memory symbols. The compiled module uses the symbol's value as an offset into
-	// CompartmentRuntimeData to the memory's entry in CompartmentRuntimeData::memoryBases.
-	for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("memoryOffset", memoryIndex),
-									offsetof(CompartmentRuntimeData, memoryBases)
-										+ sizeof(void*) * memories[memoryIndex].id);
-	}
+	Trace::Span traceSpan("loadModule");
+
+	// Bind undefined symbols in the compiled object to values. The symbols for the module's
+	// indexed definitions are named by getExternalName, so they are bound by parsing the index from
+	// the symbol name, instead of building a map from symbol names to values for every load.
+	auto resolveImportedSymbol = [&](llvm::StringRef name, Uptr& outValue) -> bool {
+		llvm::StringRef baseName;
+		Uptr index;
+		if(parseExternalName(name, baseName, index))
+		{
+			if(baseName == "typeId")
+			{
+				if(index >= types.size()) { return false; }
+				outValue = types[index].getEncoding().impl;
+				return true;
+			}
+			else if(baseName == "functionImport")
+			{
+				// An import of a WebAssembly function is bound to the function's code, rather than
+				// to a thunk, so a call to it is the same absolute call as a call to a function
+				// defined by the module. The JIT uses the large code model, so the code doesn't
+				// contain relative calls that could be bound directly to a nearby function.
+				if(index >= functionImports.size()) { return false; }
+				outValue = reinterpret_cast<Uptr>(functionImports[index].nativeFunction);
+				return true;
+			}
+			else if(baseName == "functionDef")
+			{
+				// Only the function definitions that aren't defined by the object code are bound.
+				if(index >= functionDefs.size() || !functionDefs[index].nativeFunction)
+				{ return false; }
+				outValue = reinterpret_cast<Uptr>(functionDefs[index].nativeFunction);
+				return true;
+			}
+			else if(baseName == "functionDefInstance")
+			{
+				if(index >= functionDefInstances.size()) { return false; }
+				outValue = reinterpret_cast<Uptr>(functionDefInstances[index]);
+				return true;
+			}
+			else if(baseName == "tableOffset")
+			{
+				// The compiled module uses the symbol's value as an offset into
+				// CompartmentRuntimeData to the table's entry in CompartmentRuntimeData::tableBases.
+				if(index >= tables.size()) { return false; }
+				outValue = offsetof(CompartmentRuntimeData, tableBases)
+						   + sizeof(void*) * tables[index].id;
+				return true;
+			}
+			else if(baseName == "memoryOffset")
+			{
+				// The compiled module uses the symbol's value as an offset into
+				// CompartmentRuntimeData to the memory's entry in
+				// CompartmentRuntimeData::memoryBases.
+				if(index >= memories.size()) { return false; }
+				outValue = offsetof(CompartmentRuntimeData, memoryBases)
+						   + sizeof(void*) * memories[index].id;
+				return true;
+			}
+			else if(baseName == "global")
+			{
+				if(index >= globals.size()) { return false; }
+				const GlobalBinding& globalSpec = globals[index];
+				if(globalSpec.type.isMutable)
+				{
+					// If the global is mutable, bind the symbol to the offset into
+					// ContextRuntimeData::globalData where it is stored.
+					outValue = offsetof(ContextRuntimeData, mutableGlobals)
+							   + globalSpec.mutableGlobalId * sizeof(IR::UntaggedValue);
+				}
+				else
+				{
+					// Otherwise, bind the symbol to a pointer to the global's immutable value.
+					outValue = reinterpret_cast<Uptr>(globalSpec.immutableValuePointer);
+				}
+				return true;
+			}
+			else if(baseName == "exceptionType")
+			{
+				// Bind exception type symbols to point to the exception type instance.
+				if(index >= exceptionTypes.size()) { return false; }
+				outValue = reinterpret_cast<Uptr>(exceptionTypes[index]);
+				return true;
+			}
+		}
 
-	// Bind the globals symbols.
-	for(Uptr globalIndex = 0; globalIndex < globals.size(); ++globalIndex)
-	{
-		const GlobalBinding& globalSpec = globals[globalIndex];
-		Uptr value;
-		if(globalSpec.type.isMutable)
+		if(name == "moduleInstance") { outValue = reinterpret_cast<Uptr>(moduleInstance); }
+		else if(name == "tableReferenceBias")
 		{
-			// If the global is mutable, bind the symbol to the offset into
-			// ContextRuntimeData::globalData where it is stored.
-			value = offsetof(ContextRuntimeData, mutableGlobals)
-					+ globalSpec.mutableGlobalId * sizeof(IR::UntaggedValue);
+			outValue = tableReferenceBias;
+		}
+		else if(name == "epoch")
+		{
+			outValue = epochAddress;
+		}
+		else if(name == "profileCounters")
+		{
+			outValue = profileCountersAddress;
 		}
 		else
 		{
-			// Otherwise, bind the symbol to a pointer to the global's immutable value.
-			value = reinterpret_cast<Uptr>(globalSpec.immutableValuePointer);
+			// Bind the wavmIntrinsic function symbols; the compiled module assumes they have the
+			// intrinsic calling convention, so no thunking is necessary.
+			const FunctionBinding* intrinsicBinding = wavmIntrinsicsExportMap.get(name.str());
+			if(!intrinsicBinding) { return false; }
+			outValue = reinterpret_cast<Uptr>(intrinsicBinding->nativeFunction);
 		}
-		importedSymbolMap.addOrFail(getExternalName("global", globalIndex), value);
-	}
-
-	// Bind exception type symbols to point to the exception type instance.
-	for(Uptr exceptionTypeIndex = 0; exceptionTypeIndex < exceptionTypes.size();
-		++exceptionTypeIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("exceptionType", exceptionTypeIndex),
-									reinterpret_cast<Uptr>(exceptionTypes[exceptionTypeIndex]));
-	}
-
-	// Bind the moduleInstance symbol to point to the ModuleInstance.
-	importedSymbolMap.addOrFail("moduleInstance", reinterpret_cast<Uptr>(moduleInstance));
-
-	// Bind the tableReferenceBias symbol to the tableReferenceBias.
-	importedSymbolMap.addOrFail("tableReferenceBias", tableReferenceBias);
+		return true;
+	};
 
 	// Load the module.
-	LoadedModule* jitModule = new LoadedModule(objectFileBytes, importedSymbolMap, true);
+	LoadedModule* jitModule
+		= new LoadedModule(objectFileBytes, resolveImportedSymbol, true, codeArena);
 
 	// Look up the function definitions by name from the loaded module's functions.
 	for(Uptr functionDefIndex = 0; functionDefIndex < functionDefInstances.size();
 		++functionDefIndex)
 	{
-		outFunctionDefs.push_back(
-			jitModule->nameToFunctionMap[getExternalName("functionDef", functionDefIndex)]);
+		JITFunction* const* jitFunction
+			= jitModule->nameToFunctionMap.get(getExternalName("functionDef", functionDefIndex));
+		errorUnless(jitFunction || functionDefs.size());
+		outFunctionDefs.push_back(jitFunction ? *jitFunction : nullptr);
+	}
+
+	// Describe the module's functions to profilers, using the names of the function definitions.
+	if(Platform::isJITProfilerOutputEnabled())
+	{
+		HashMap<std::string, std::string> symbolDisplayNames;
+		for(Uptr functionDefIndex = 0; functionDefIndex < functionDefNames.size();
+			++functionDefIndex)
+		{
+			symbolDisplayNames.add(getExternalName("functionDef", functionDefIndex),
+								   functionDefNames[functionDefIndex]);
+		}
+		registerJITFunctionsWithProfilers(jitModule, symbolDisplayNames);
 	}
 
 	return jitModule;
@@ -630,20 +1527,55 @@ LoadedModule* LLVMJIT::loadModule(const std::vector<U8>& objectFileBytes,
 
 void LLVMJIT::unloadModule(LoadedModule* loadedModule) { delete loadedModule; }
 
+Uptr LoadedModule::getNumBytes() const
+{
+	Uptr numBytes = 0;
+	for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+	{ numBytes += memoryManager->getNumImageBytes(imageIndex); }
+	return numBytes;
+}
+
+Uptr LLVMJIT::getLoadedModuleNumBytes(LoadedModule* loadedModule)
+{
+	return loadedModule->getNumBytes();
+}
+
+void LLVMJIT::setDebuggerRegistrationEnabled(bool enable)
+{
+	isDebuggerRegistrationEnabled.store(enable, std::memory_order_relaxed);
+}
+
 JITFunction* LLVMJIT::getJITFunctionByAddress(Uptr address)
 {
-	LoadedModule* jitModule;
+	// Find the module image containing the address.
+	LoadedModule* jitModule = nullptr;
 	{
-		Lock<Platform::Mutex> addressToModuleMapLock(addressToModuleMapMutex);
-		auto moduleIt = addressToModuleMap.upper_bound(address);
-		if(moduleIt == addressToModuleMap.end()) { return nullptr; }
-		jitModule = moduleIt->second;
-	}
+		std::atomic<Uptr>& readerCount = getModuleAddressTableReaderCount();
+		readerCount.fetch_add(1, std::memory_order_seq_cst);
 
-	auto functionIt = jitModule->addressToFunctionMap.upper_bound(address);
-	if(functionIt == jitModule->addressToFunctionMap.end()) { return nullptr; }
-	JITFunction* function = functionIt->second;
-	return address >= function->baseAddress && address < function->baseAddress + function->numBytes
-			   ? function
-			   : nullptr;
+		const ModuleAddressTable* table = moduleAddressTable.load(std::memory_order_seq_cst);
+		if(table)
+		{
+			auto rangeIt = std::upper_bound(
+				table->begin(),
+				table->end(),
+				address,
+				[](Uptr address, const ModuleAddressRange& range) { return address < range.begin; });
+			if(rangeIt != table->begin() && address < (rangeIt - 1)->end)
+			{ jitModule = (rangeIt - 1)->module; }
+		}
+
+		readerCount.fetch_sub(1, std::memory_order_release);
+	}
+	if(!jitModule) { return nullptr; }
+
+	// Find the function in the module containing the address.
+	auto functionIt = std::upper_bound(
+		jitModule->functions.begin(),
+		jitModule->functions.end(),
+		address,
+		[](Uptr address, const JITFunction& function) { return address < function.baseAddress; });
+	if(functionIt == jitModule->functions.begin()) { return nullptr; }
+	JITFunction* function = &*(functionIt - 1);
+	return address < function->baseAddress + function->numBytes ? function : nullptr;
 }
@@ -2,7 +2,9 @@
 
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Operators.h"
+#include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/FunctionRef.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Runtime/RuntimeData.h"
 
@@ -101,9 +103,33 @@ namespace WAVM { namespace LLVMJIT {
 		// Maps a type ID to the corresponding LLVM type.
 		llvm::Type* valueTypes[Uptr(IR::ValueType::num)];
 
+		// TBAA access tags for the disjoint kinds of memory that compiled code accesses: linear
+		// memory, the runtime data of the compartment and context (memory and table bases, fuel,
+		// etc), and the values of globals. Tagging the accesses lets LLVM assume that a store to
+		// linear memory doesn't clobber a mutable global or a table base, so loads of them can be
+		// hoisted out of loops.
+		llvm::MDNode* linearMemoryTBAATag;
+		llvm::MDNode* runtimeDataTBAATag;
+		llvm::MDNode* globalTBAATag;
+
 		LLVMContext();
 	};
 
+	// An LLVMContext borrowed from the calling thread's pool of contexts. Creating a context and
+	// its cached types is relatively expensive, so the contexts are reused by later compiles on
+	// the same thread. Any llvm::Module created in the context must be destroyed before the
+	// PooledLLVMContext is.
+	struct PooledLLVMContext
+	{
+		PooledLLVMContext();
+		~PooledLLVMContext();
+
+		LLVMContext& operator*() const { return *context; }
+
+	private:
+		LLVMContext* context;
+	};
+
 	// Overloaded functions that compile a literal value to a LLVM constant of the right type.
 	inline llvm::ConstantInt* emitLiteral(llvm::LLVMContext& llvmContext, U32 value)
 	{
@@ -163,14 +189,30 @@ namespace WAVM { namespace LLVMJIT {
 
 	inline bool areResultsReturnedDirectly(IR::TypeTuple results)
 	{
-		// On X64, the calling conventions can return up to 3 i64s and 4 float/vectors.
-		// For simplicity, just allow up to 3 values to be returned, including the implicitly
-		// returned context pointer.
+		// On X64, the calling conventions can return up to 4 integers in RAX, RDX, RCX, and R8,
+		// and up to 2 floats or vectors in XMM0 and XMM1; AArch64 can return more of each. Count
+		// the integer and floating-point/vector results separately, so a small number of each
+		// may be returned in registers instead of spilled to the context's arg/return memory.
+		// The integer count includes the implicitly returned context pointer.
 		enum
 		{
-			maxDirectlyReturnedValues = 3
+			maxDirectlyReturnedIntegers = 4,
+			maxDirectlyReturnedFloatsOrVectors = 2
 		};
-		return results.size() + 1 <= maxDirectlyReturnedValues;
+		Uptr numIntegers = 1;
+		Uptr numFloatsOrVectors = 0;
+		for(IR::ValueType result : results)
+		{
+			if(result == IR::ValueType::f32 || result == IR::ValueType::f64
+			   || result == IR::ValueType::v128)
+			{ ++numFloatsOrVectors; }
+			else
+			{
+				++numIntegers;
+			}
+		}
+		return numIntegers <= maxDirectlyReturnedIntegers
+			   && numFloatsOrVectors <= maxDirectlyReturnedFloatsOrVectors;
 	}
 
 	inline llvm::StructType* getLLVMReturnStructType(LLVMContext& llvmContext,
@@ -280,10 +322,102 @@ namespace WAVM { namespace LLVMJIT {
 		return std::string(baseName) + std::to_string(index);
 	}
 
-	// Emits LLVM IR for a module.
+	// The SIMD instruction sets that some SIMD operators have hand-picked lowerings for, where
+	// LLVM's generic vector lowering would emit a long scalarized sequence. The x86 instruction sets
+	// are ordered so that each implies the instruction sets before it.
+	enum class TargetSIMDISA
+	{
+		generic,
+		aarch64NEON,
+		x86SSE2,
+		x86SSE41,
+		x86AVX512,
+	};
+
+	// Returns the best SIMD instruction set supported by the target CPU and features of the
+	// compile options.
+	TargetSIMDISA getTargetSIMDISA(const CompileOptions& options);
+
+	// Emits LLVM IR for a module. Only the function definitions in functionDefIndices are
+	// emitted; the module's other functions are declared as external symbols. If
+	// foldedFunctionDefIndices isn't empty, it maps each function definition to an identical
+	// function definition, and the function definitions that map to an earlier definition are
+	// emitted as a tail call to it.
 	void emitModule(const IR::Module& irModule,
 					LLVMContext& llvmContext,
-					llvm::Module& outLLVMModule);
+					llvm::Module& outLLVMModule,
+					const std::vector<Uptr>& functionDefIndices,
+					const std::vector<Uptr>& foldedFunctionDefIndices,
+					bool emitMemoryBoundsChecks,
+					bool emitEpochChecks,
+					bool emitFuelMetering,
+					bool emitStackLimitChecks,
+					bool canonicalizeNaNs,
+					bool emitMemoryAccessSampling,
+					bool emitRelaxedMemoryAccesses,
+					bool emitProfileInstrumentation,
+					bool emitProfileCycles,
+					const std::map<std::pair<Uptr, Uptr>, Uptr>& speculatedIndirectCallees,
+					const std::map<Uptr, IR::Value>& specializedGlobalImports,
+					const ModuleProfile* profile,
+					TargetSIMDISA simdISA);
+
+	// A visitor that returns the number of profile counters used by the decoded operator in a
+	// function definition compiled with profile instrumentation, and records its opcode.
+	struct ProfileCounterVisitor
+	{
+		typedef Uptr Result;
+
+		const IR::FunctionDef& functionDef;
+		IR::Opcode opcode;
+
+		ProfileCounterVisitor(const IR::FunctionDef& inFunctionDef)
+		: functionDef(inFunctionDef), opcode(IR::Opcode::nop)
+		{
+		}
+
+#define VISIT_OP(encoding, name, nameString, Imm, ...)                                             \
+	Uptr name(IR::Imm imm)                                                                         \
+	{                                                                                              \
+		opcode = IR::Opcode::name;                                                                 \
+		return getNumCounters(imm);                                                                \
+	}
+		ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+		Uptr unknown(IR::Opcode unknownOpcode)
+		{
+			opcode = unknownOpcode;
+			return 0;
+		}
+
+	private:
+		// A br_table has a counter for each target in the table, followed by one for its default
+		// target.
+		Uptr getNumCounters(IR::BranchTableImm imm)
+		{
+			wavmAssert(imm.branchTableIndex < functionDef.branchTables.size());
+			return functionDef.branchTables[imm.branchTableIndex].size() + 1;
+		}
+
+		// An if or br_if has counters for the number of times its condition was true and false,
+		// and a call_indirect has a counter for its candidate most frequent callee, and the count
+		// used to find the majority callee (see EmitFunctionContext::emitIndirectCalleeProfile).
+		template<typename Imm> Uptr getNumCounters(Imm)
+		{
+			switch(opcode)
+			{
+			case IR::Opcode::if_:
+			case IR::Opcode::br_if:
+			case IR::Opcode::call_indirect: return 2;
+			default: return 0;
+			};
+		}
+	};
+
+	// Returns the index of the first profile counter of each of a module's function definitions,
+	// followed by the total number of profile counters. A function definition's counters start with
+	// its entry count and cycle count, followed by the counters of each of its operators in order.
+	std::vector<Uptr> getProfileCounterBaseIndices(const IR::Module& irModule);
 
 	// Used to override LLVM's default behavior of looking up unresolved symbols in DLL exports.
 	llvm::JITEvaluatedSymbol resolveJITImport(llvm::StringRef name);
@@ -293,27 +427,72 @@ namespace WAVM { namespace LLVMJIT {
 	// Encapsulates a loaded module.
 	struct LoadedModule
 	{
-		std::vector<std::unique_ptr<JITFunction>> functions;
-		std::map<Uptr, JITFunction*> addressToFunctionMap;
+		// The module's functions, sorted by address. This is immutable once the module is loaded,
+		// so it may be searched without a lock, and the functions are never moved.
+		std::vector<JITFunction> functions;
 		HashMap<std::string, JITFunction*> nameToFunctionMap;
 
+		// The operator indices of all the module's functions, referenced by JITFunction::opIndices.
+		std::vector<JITFunctionOpIndex> opIndices;
+
 		LoadedModule(const std::vector<U8>& inObjectBytes,
 					 const HashMap<std::string, Uptr>& importedSymbolMap,
-					 bool shouldLogMetrics);
+					 bool shouldLogMetrics,
+					 CodeArena* codeArena = nullptr);
+
+		// Binds the object code's imported symbols by calling resolveImportedSymbol, which returns
+		// false if it doesn't bind the symbol.
+		typedef FunctionRef<bool(llvm::StringRef name, Uptr& outValue)> ImportedSymbolResolver;
+		LoadedModule(const std::vector<U8>& inObjectBytes,
+					 ImportedSymbolResolver resolveImportedSymbol,
+					 bool shouldLogMetrics,
+					 CodeArena* codeArena = nullptr);
 		~LoadedModule();
 
+		// The number of bytes of the module's loaded images.
+		Uptr getNumBytes() const;
+
 	private:
 		ModuleMemoryManager* memoryManager;
 
+		// Whether the module's objects were registered with GDB (see
+		// setDebuggerRegistrationEnabled).
+		bool isRegisteredWithDebugger;
+
 		// Have to keep copies of these around because GDB registration listener uses their pointers
-		// as keys for deregistration.
+		// as keys for deregistration. They are freed after loading if the module isn't registered
+		// with GDB.
 		std::vector<U8> objectBytes;
-		std::unique_ptr<llvm::object::ObjectFile> object;
+		std::vector<std::unique_ptr<llvm::object::ObjectFile>> objects;
+		std::vector<std::unique_ptr<llvm::LoadedObjectInfo>> loadedObjects;
 	};
 
+	// Describes a loaded module's functions to the profiler outputs enabled by
+	// Platform::setJITProfilerOutput. A function is named by the entry for its symbol name in
+	// symbolDisplayNames, or by its symbol name if there isn't one.
+	void registerJITFunctionsWithProfilers(
+		const LoadedModule* jitModule,
+		const HashMap<std::string, std::string>& symbolDisplayNames = {});
+
+	// Object code that contains more than one object file (e.g. from compiling a module in
+	// parallel partitions) starts with this magic number, followed by a U64 count of the object
+	// files, a U64 size for each object file, and then the object files themselves, each aligned
+	// to multiObjectAlignment bytes. Object code with a single object file is just the object file.
+	static constexpr U8 multiObjectMagic[8] = {'\0', 'w', 'a', 'v', 'm', 'o', 'b', 'j'};
+	static constexpr Uptr multiObjectAlignment = 16;
+
+	// Object code compiled for more than one target version starts with this magic number,
+	// followed by a U64 count of the versions. Each version then has a U64 size and the bytes of
+	// its target CPU name, a U64 size and the bytes of its comma-separated target features, and a
+	// U64 size of its object code. The object code of each version follows, each aligned to
+	// multiObjectAlignment bytes. The versions are in order of preference, and the last is the
+	// baseline version, which is loaded if the host doesn't support any of the others.
+	static constexpr U8 multiVersionMagic[8] = {'\0', 'w', 'a', 'v', 'm', 'v', 'e', 'r'};
+
 	extern std::vector<U8> compileLLVMModule(LLVMContext& llvmContext,
 											 llvm::Module&& llvmModule,
-											 bool shouldLogMetrics);
+											 bool shouldLogMetrics,
+											 const CompileOptions& options = CompileOptions());
 
 	extern void processSEHTables(U8* imageBase,
 								 const llvm::LoadedObjectInfo& loadedObject,
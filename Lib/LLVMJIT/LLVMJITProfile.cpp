@@ -0,0 +1,85 @@
+#include <vector>
+
+#include "LLVMJITPrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::LLVMJIT;
+
+std::vector<Uptr> LLVMJIT::getProfileCounterBaseIndices(const IR::Module& irModule)
+{
+	std::vector<Uptr> baseIndices;
+	Uptr numCounters = 0;
+	for(const FunctionDef& functionDef : irModule.functions.defs)
+	{
+		baseIndices.push_back(numCounters);
+
+		// Each function definition's counters start with its entry count and cycle count.
+		numCounters += 2;
+
+		ProfileCounterVisitor visitor(functionDef);
+		OperatorDecoderStream decoder(functionDef.code);
+		while(decoder) { numCounters += decoder.decodeOp(visitor); };
+	}
+	baseIndices.push_back(numCounters);
+	return baseIndices;
+}
+
+Uptr LLVMJIT::getNumProfileCounters(const IR::Module& irModule)
+{
+	return getProfileCounterBaseIndices(irModule).back();
+}
+
+ModuleProfile LLVMJIT::getModuleProfile(const IR::Module& irModule,
+										const U64* profileCounters,
+										const HashMap<Uptr, Uptr>& anyFuncFunctionIndices)
+{
+	ModuleProfile profile;
+	Uptr counterIndex = 0;
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
+	{
+		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
+		profile.functionDefEntryCounts.push_back(profileCounters[counterIndex++]);
+		profile.functionDefCycleCounts.push_back(profileCounters[counterIndex++]);
+
+		ProfileCounterVisitor visitor(functionDef);
+		OperatorDecoderStream decoder(functionDef.code);
+		for(Uptr opIndex = 0; decoder; ++opIndex)
+		{
+			const Uptr numOpCounters = decoder.decodeOp(visitor);
+			const U64* opCounters = profileCounters + counterIndex;
+			counterIndex += numOpCounters;
+			if(!numOpCounters) { continue; }
+
+			if(visitor.opcode == Opcode::call_indirect)
+			{
+				// The first counter is the address of the candidate majority callee, and the second
+				// is non-zero if there was a candidate when the profile was collected.
+				const Uptr* calleeFunctionIndex = anyFuncFunctionIndices.get(Uptr(opCounters[0]));
+				if(opCounters[1] && calleeFunctionIndex)
+				{ profile.indirectCallees[{functionDefIndex, opIndex}] = *calleeFunctionIndex; }
+			}
+			else
+			{
+				// Only include the branches that were executed.
+				bool wasExecuted = false;
+				for(Uptr branchIndex = 0; branchIndex < numOpCounters; ++branchIndex)
+				{ wasExecuted |= opCounters[branchIndex] != 0; }
+				if(wasExecuted)
+				{
+					profile.branchCounts[{functionDefIndex, opIndex}]
+						= std::vector<U64>(opCounters, opCounters + numOpCounters);
+				}
+			}
+		}
+	}
+	wavmAssert(counterIndex == getNumProfileCounters(irModule));
+	return profile;
+}
@@ -0,0 +1,163 @@
+// The LLVMJIT library that is built when WAVM_ENABLE_LLVMJIT is off: WAVM can't compile or load
+// the code of WebAssembly modules without LLVM, so the functions that would need it fail with a
+// fatal error that says why, and the functions that only query the loaded code report that there
+// isn't any.
+
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::LLVMJIT;
+
+struct LLVMJIT::CodeArena
+{
+};
+
+[[noreturn]] static void fatalWithoutLLVM(const char* operation)
+{
+	Errors::fatalf("Can't %s: WAVM was built with WAVM_ENABLE_LLVMJIT=OFF.\n", operation);
+}
+
+std::string LLVMJIT::getTargetDescription(const CompileOptions& options)
+{
+	return "no LLVMJIT";
+}
+
+bool LLVMJIT::isTargetSupportedByHost(const std::string& targetCPU,
+									  const std::vector<std::string>& targetFeatures)
+{
+	return false;
+}
+
+std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule, const CompileOptions& options)
+{
+	fatalWithoutLLVM("compile a module");
+}
+
+std::vector<U8> LLVMJIT::compileFunctionDefs(const IR::Module& irModule,
+											 const std::vector<Uptr>& functionDefIndices,
+											 const CompileOptions& options)
+{
+	fatalWithoutLLVM("compile a module");
+}
+
+std::vector<U8> LLVMJIT::compilePartitions(
+	const IR::Module& irModule,
+	const std::vector<Uptr>& partitionBeginFunctionDefIndices,
+	std::vector<std::vector<U8>>&& partitionObjects,
+	const CompileOptions& options)
+{
+	fatalWithoutLLVM("compile a module");
+}
+
+bool LLVMJIT::getPartitionObjects(const std::vector<U8>& objectCode,
+								  std::vector<std::vector<U8>>& outPartitionObjects)
+{
+	return false;
+}
+
+Uptr LLVMJIT::getNumProfileCounters(const IR::Module& irModule)
+{
+	fatalWithoutLLVM("compile a module with profile instrumentation");
+}
+
+ModuleProfile LLVMJIT::getModuleProfile(const IR::Module& irModule,
+										const U64* profileCounters,
+										const HashMap<Uptr, Uptr>& anyFuncFunctionIndices)
+{
+	fatalWithoutLLVM("read a module profile");
+}
+
+StreamingCompile* LLVMJIT::beginStreamingCompile(const IR::Module& irModule,
+												 const CompileOptions& options)
+{
+	fatalWithoutLLVM("compile a module");
+}
+
+void LLVMJIT::addDecodedFunctionDefs(StreamingCompile* compile, Uptr numDecodedFunctionDefs)
+{
+	Errors::unreachable();
+}
+
+std::vector<U8> LLVMJIT::finishStreamingCompile(StreamingCompile* compile)
+{
+	Errors::unreachable();
+}
+
+void LLVMJIT::cancelStreamingCompile(StreamingCompile* compile) { Errors::unreachable(); }
+
+CodeArena* LLVMJIT::createCodeArena(bool packImages) { return new CodeArena; }
+
+void LLVMJIT::releaseCodeArena(CodeArena* codeArena) { delete codeArena; }
+
+LoadedModule* LLVMJIT::loadModule(
+	const std::vector<U8>& objectFileBytes,
+	HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
+	std::vector<IR::FunctionType>&& types,
+	std::vector<FunctionBinding>&& functionImports,
+	std::vector<FunctionBinding>&& functionDefs,
+	std::vector<TableBinding>&& tables,
+	std::vector<MemoryBinding>&& memories,
+	std::vector<GlobalBinding>&& globals,
+	std::vector<Runtime::ExceptionTypeInstance*>&& exceptionTypes,
+	MemoryBinding defaultMemory,
+	TableBinding defaultTable,
+	Runtime::ModuleInstance* moduleInstance,
+	Uptr tableReferenceBias,
+	Uptr epochAddress,
+	Uptr profileCountersAddress,
+	const std::vector<Runtime::FunctionInstance*>& functionDefInstances,
+	const std::vector<std::string>& functionDefNames,
+	std::vector<JITFunction*>& outFunctionDefs,
+	CodeArena* codeArena)
+{
+	fatalWithoutLLVM("load a module's object code");
+}
+
+void LLVMJIT::unloadModule(LoadedModule* loadedModule) { Errors::unreachable(); }
+
+Uptr LLVMJIT::getLoadedModuleNumBytes(LoadedModule* loadedModule) { Errors::unreachable(); }
+
+void LLVMJIT::setDebuggerRegistrationEnabled(bool enable) {}
+
+JITFunction* LLVMJIT::getJITFunctionByAddress(Uptr address) { return nullptr; }
+
+InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType,
+										   CallingConvention callingConvention)
+{
+	fatalWithoutLLVM("generate an invoke thunk");
+}
+
+void* LLVMJIT::getIntrinsicThunk(void* nativeFunction,
+								 const Runtime::FunctionInstance* functionInstance,
+								 FunctionType functionType,
+								 CallingConvention callingConvention,
+								 const UntaggedValue* constantResult,
+								 bool isLeaf,
+								 const void* closure)
+{
+	fatalWithoutLLVM("generate an intrinsic thunk");
+}
+
+std::vector<void*> LLVMJIT::getIntrinsicThunks(const std::vector<IntrinsicThunkRequest>& requests)
+{
+	fatalWithoutLLVM("generate an intrinsic thunk");
+}
+
+LoadedModule* LLVMJIT::loadLazyCompileStubs(
+	const std::vector<Runtime::FunctionInstance*>& functionDefInstances,
+	const std::vector<FunctionType>& functionDefTypes,
+	const std::vector<std::string>& functionDefNames,
+	LazyCompileFunction lazyCompile,
+	std::vector<JITFunction*>& outStubs,
+	CodeArena* codeArena)
+{
+	fatalWithoutLLVM("compile a module");
+}
@@ -11,6 +11,7 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Platform/Mutex.h"
@@ -42,45 +43,74 @@ using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
 using namespace WAVM::Runtime;
 
+// The key for a cached invoke thunk: thunks for the same function type with different calling
+// conventions call the function differently, so they can't be shared.
+struct InvokeThunkKey
+{
+	FunctionType functionType;
+	CallingConvention callingConvention;
+
+	friend bool operator==(const InvokeThunkKey& left, const InvokeThunkKey& right)
+	{
+		return left.functionType == right.functionType
+			   && left.callingConvention == right.callingConvention;
+	}
+};
+
+template<> struct WAVM::Hash<InvokeThunkKey>
+{
+	Uptr operator()(const InvokeThunkKey& key, Uptr seed = 0) const
+	{
+		const Uptr functionTypeHash = WAVM::Hash<FunctionType>()(key.functionType, seed);
+		return WAVM::Hash<Uptr>()(Uptr(key.callingConvention), functionTypeHash);
+	}
+};
+
 // A map from function types to JIT symbols for cached invoke thunks (C++ -> WASM)
 static Platform::Mutex invokeThunkMutex;
-static HashMap<FunctionType, struct JITFunction*> invokeThunkTypeToFunctionMap;
+static HashMap<InvokeThunkKey, struct JITFunction*> invokeThunkTypeToFunctionMap;
+static bool hasGeneratedCommonInvokeThunks = false;
 
 // A map from function types to JIT symbols for cached native thunks (WASM -> C++)
 static Platform::Mutex intrinsicThunkMutex;
 static HashMap<void*, struct JITFunction*> intrinsicFunctionToThunkFunctionMap;
 
-InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType,
-										   CallingConvention callingConvention)
+static std::string getThunkSymbolName(Uptr thunkIndex)
 {
-	Lock<Platform::Mutex> invokeThunkLock(invokeThunkMutex);
-
-	LLVMContext llvmContext;
-
-	// Reuse cached invoke thunks for the same function type.
-	JITFunction*& invokeThunkFunction
-		= invokeThunkTypeToFunctionMap.getOrAdd(functionType, nullptr);
-	if(invokeThunkFunction)
-	{ return reinterpret_cast<InvokeThunkPointer>(invokeThunkFunction->baseAddress); }
+#if(defined(_WIN32) && !defined(_WIN64))
+	return "_" + getExternalName("thunk", thunkIndex);
+#else
+	return getExternalName("thunk", thunkIndex);
+#endif
+}
 
-	llvm::Module llvmModule("", llvmContext);
+static void emitInvokeThunk(LLVMContext& llvmContext,
+							llvm::Module& llvmModule,
+							Uptr thunkIndex,
+							FunctionType functionType,
+							CallingConvention callingConvention)
+{
 	auto llvmFunctionType = llvm::FunctionType::get(
 		llvmContext.i8PtrType,
 		{asLLVMType(llvmContext, functionType, callingConvention)->getPointerTo(),
+		 llvmContext.i8PtrType,
 		 llvmContext.i8PtrType},
 		false);
-	auto function = llvm::Function::Create(
-		llvmFunctionType, llvm::Function::ExternalLinkage, "thunk", &llvmModule);
+	auto function = llvm::Function::Create(llvmFunctionType,
+										   llvm::Function::ExternalLinkage,
+										   getExternalName("thunk", thunkIndex),
+										   &llvmModule);
 	llvm::Value* functionPointer = &*(function->args().begin() + 0);
 	llvm::Value* contextPointer = &*(function->args().begin() + 1);
+	llvm::Value* argDataPointer = &*(function->args().begin() + 2);
 
-	EmitContext emitContext(llvmContext, nullptr);
+	EmitContext emitContext(llvmContext);
 	emitContext.irBuilder.SetInsertPoint(llvm::BasicBlock::Create(llvmContext, "entry", function));
 
 	emitContext.initContextVariables(contextPointer);
 
-	// Load the function's arguments from an array of 64-bit values at an address provided by the
-	// caller.
+	// Load the function's arguments from the naturally aligned argument data at an address provided
+	// by the caller.
 	std::vector<llvm::Value*> arguments;
 	Uptr argDataOffset = 0;
 	for(ValueType parameterType : functionType.params())
@@ -90,10 +120,8 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType,
 		argDataOffset = (argDataOffset + numArgBytes - 1) & -numArgBytes;
 
 		arguments.push_back(emitContext.loadFromUntypedPointer(
-			emitContext.irBuilder.CreateInBoundsGEP(
-				contextPointer,
-				{emitLiteral(llvmContext,
-							 argDataOffset + offsetof(ContextRuntimeData, thunkArgAndReturnData))}),
+			emitContext.irBuilder.CreateInBoundsGEP(argDataPointer,
+													{emitLiteral(llvmContext, argDataOffset)}),
 			asLLVMType(llvmContext, parameterType)));
 
 		argDataOffset += numArgBytes;
@@ -127,6 +155,55 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType,
 
 	emitContext.irBuilder.CreateRet(
 		emitContext.irBuilder.CreateLoad(emitContext.contextPointerVariable));
+}
+
+InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType,
+										   CallingConvention callingConvention)
+{
+	Lock<Platform::Mutex> invokeThunkLock(invokeThunkMutex);
+
+	// Reuse cached invoke thunks for the same function type.
+	const InvokeThunkKey key{functionType, callingConvention};
+	if(JITFunction* const* cachedThunkFunction = invokeThunkTypeToFunctionMap.get(key))
+	{ return reinterpret_cast<InvokeThunkPointer>((*cachedThunkFunction)->baseAddress); }
+
+	// The first time an invoke thunk is needed, also generate the thunks for the signatures that
+	// are most commonly invoked, so they share the cost of compiling and loading a module.
+	std::vector<InvokeThunkKey> keys = {key};
+	if(!hasGeneratedCommonInvokeThunks)
+	{
+		hasGeneratedCommonInvokeThunks = true;
+
+		const ValueType i32 = ValueType::i32;
+		const FunctionType commonFunctionTypes[] = {
+			FunctionType({}, {}),
+			FunctionType({i32}, {}),
+			FunctionType({}, {i32}),
+			FunctionType({i32}, {i32}),
+			FunctionType({i32}, {i32, i32}),
+			FunctionType({}, {i32, i32}),
+			FunctionType({i32}, {i32, i32, i32}),
+			FunctionType({ValueType::i64}, {}),
+		};
+		for(FunctionType commonFunctionType : commonFunctionTypes)
+		{
+			const InvokeThunkKey commonKey{commonFunctionType, CallingConvention::wasm};
+			if(!(commonKey == key)) { keys.push_back(commonKey); }
+		}
+	}
+
+	// Emit all the thunks into a single LLVM module.
+	PooledLLVMContext pooledLLVMContext;
+	LLVMContext& llvmContext = *pooledLLVMContext;
+	llvm::Module llvmModule("", llvmContext);
+	for(Uptr thunkIndex = 0; thunkIndex < keys.size(); ++thunkIndex)
+	{
+		emitInvokeThunk(llvmContext,
+						llvmModule,
+						thunkIndex,
+						keys[thunkIndex].functionType,
+						keys[thunkIndex].callingConvention);
+	}
 
 	// Compile the LLVM IR to object code.
 	std::vector<U8> objectBytes = compileLLVMModule(llvmContext, std::move(llvmModule), false);
@@ -134,79 +211,303 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType,
 	// Load the object code.
 	auto jitModule = new LoadedModule(objectBytes, {}, false);
 
-#if(defined(_WIN32) && !defined(_WIN64))
-	const char* thunkFunctionName = "_thunk";
-#else
-	const char* thunkFunctionName = "thunk";
-#endif
-	invokeThunkFunction = jitModule->nameToFunctionMap[thunkFunctionName];
-	invokeThunkFunction->type = JITFunction::Type::invokeThunk;
-	invokeThunkFunction->invokeThunkType = functionType;
+	HashMap<std::string, std::string> thunkDisplayNames;
+	for(Uptr thunkIndex = 0; thunkIndex < keys.size(); ++thunkIndex)
+	{
+		const std::string thunkSymbolName = getThunkSymbolName(thunkIndex);
+		JITFunction* invokeThunkFunction = jitModule->nameToFunctionMap[thunkSymbolName];
+		invokeThunkFunction->type = JITFunction::Type::invokeThunk;
+		invokeThunkFunction->invokeThunkType = keys[thunkIndex].functionType;
+		invokeThunkTypeToFunctionMap.addOrFail(keys[thunkIndex], invokeThunkFunction);
+		thunkDisplayNames.add(thunkSymbolName, "thnk!" + asString(keys[thunkIndex].functionType));
+	}
+	registerJITFunctionsWithProfilers(jitModule, thunkDisplayNames);
 
-	return reinterpret_cast<InvokeThunkPointer>(invokeThunkFunction->baseAddress);
+	return reinterpret_cast<InvokeThunkPointer>(invokeThunkTypeToFunctionMap[key]->baseAddress);
 }
 
-void* LLVMJIT::getIntrinsicThunk(void* nativeFunction,
-								 const FunctionInstance* functionInstance,
-								 FunctionType functionType,
-								 CallingConvention callingConvention)
+static void emitIntrinsicThunk(LLVMContext& llvmContext,
+							   llvm::Module& llvmModule,
+							   Uptr thunkIndex,
+							   const IntrinsicThunkRequest& request)
 {
-	Lock<Platform::Mutex> intrinsicThunkLock(intrinsicThunkMutex);
-
+	const FunctionType functionType = request.functionType;
+	const CallingConvention callingConvention = request.callingConvention;
 	wavmAssert(callingConvention == CallingConvention::intrinsic
 			   || callingConvention == CallingConvention::intrinsicWithContextSwitch);
 
-	LLVMContext llvmContext;
-
-	// Reuse cached intrinsic thunks for the same function type.
-	JITFunction*& intrinsicThunkFunction
-		= intrinsicFunctionToThunkFunctionMap.getOrAdd(nativeFunction, nullptr);
-	if(intrinsicThunkFunction)
-	{ return reinterpret_cast<void*>(intrinsicThunkFunction->baseAddress); }
-
-	// Create a LLVM module containing a single function with the same signature as the native
-	// function, but with the WASM calling convention.
-	llvm::Module llvmModule("", llvmContext);
+	// Create a function with the same signature as the native function, but with the WASM calling
+	// convention.
 	auto llvmFunctionType = asLLVMType(llvmContext, functionType, CallingConvention::wasm);
-	auto function = llvm::Function::Create(
-		llvmFunctionType, llvm::Function::ExternalLinkage, "thunk", &llvmModule);
+	auto function = llvm::Function::Create(llvmFunctionType,
+										   llvm::Function::ExternalLinkage,
+										   getExternalName("thunk", thunkIndex),
+										   &llvmModule);
 	function->setCallingConv(asLLVMCallingConv(callingConvention));
 	function->setPrefixData(llvm::ConstantArray::get(
 		llvm::ArrayType::get(llvmContext.iptrType, 2),
-		{emitLiteral(llvmContext, reinterpret_cast<Uptr>(functionInstance)),
+		{emitLiteral(llvmContext, reinterpret_cast<Uptr>(request.functionInstance)),
 		 emitLiteral(llvmContext, functionType.getEncoding().impl)}));
 
-	EmitContext emitContext(llvmContext, nullptr);
+	EmitContext emitContext(llvmContext);
 	emitContext.irBuilder.SetInsertPoint(llvm::BasicBlock::Create(llvmContext, "entry", function));
 
 	emitContext.initContextVariables(&*function->args().begin());
 
+	// If the native function is a closure's trampoline, pass it the closure before the arguments.
+	FunctionType nativeFunctionType = functionType;
 	llvm::SmallVector<llvm::Value*, 8> args;
+	if(request.closure)
+	{
+		std::vector<ValueType> nativeParams{ValueType::i64};
+		for(ValueType param : functionType.params()) { nativeParams.push_back(param); }
+		nativeFunctionType = FunctionType(functionType.results(), TypeTuple(nativeParams));
+		args.push_back(emitLiteral(llvmContext, U64(reinterpret_cast<Uptr>(request.closure))));
+	}
 	for(auto argIt = function->args().begin() + 1; argIt != function->args().end(); ++argIt)
 	{ args.push_back(&*argIt); }
 
-	llvm::Type* llvmNativeFunctionType
-		= asLLVMType(llvmContext, functionType, callingConvention)->getPointerTo();
-	llvm::Value* llvmNativeFunction = emitLiteralPointer(nativeFunction, llvmNativeFunctionType);
-	ValueVector results
-		= emitContext.emitCallOrInvoke(llvmNativeFunction, args, functionType, callingConvention);
+	ValueVector results;
+	if(request.constantResult)
+	{
+		// The native function has no side effects, so just return its constant result.
+		wavmAssert(callingConvention == CallingConvention::intrinsic);
+		const UntaggedValue* constantResult = request.constantResult;
+		for(ValueType resultType : functionType.results())
+		{
+			switch(resultType)
+			{
+			case ValueType::i32:
+				results.push_back(emitLiteral(llvmContext, constantResult->i32));
+				break;
+			case ValueType::i64:
+				results.push_back(emitLiteral(llvmContext, constantResult->i64));
+				break;
+			case ValueType::f32:
+				results.push_back(emitLiteral(llvmContext, constantResult->f32));
+				break;
+			case ValueType::f64:
+				results.push_back(emitLiteral(llvmContext, constantResult->f64));
+				break;
+			case ValueType::v128:
+				results.push_back(emitLiteral(llvmContext, constantResult->v128));
+				break;
+			default: Errors::unreachable();
+			};
+		}
+	}
+	else
+	{
+		llvm::Type* llvmNativeFunctionType
+			= asLLVMType(llvmContext, nativeFunctionType, callingConvention)->getPointerTo();
+		llvm::Value* llvmNativeFunction
+			= emitLiteralPointer(request.nativeFunction, llvmNativeFunctionType);
+		if(!request.isLeaf)
+		{
+			results = emitContext.emitCallOrInvoke(
+				llvmNativeFunction, args, nativeFunctionType, callingConvention);
+		}
+		else
+		{
+			// The native function can't switch contexts or throw, so call it as a tail call that
+			// can't unwind, and return the context the thunk was called with.
+			wavmAssert(callingConvention == CallingConvention::intrinsic);
+			llvm::SmallVector<llvm::Value*, 8> nativeArgs;
+			nativeArgs.push_back(&*function->args().begin());
+			nativeArgs.append(args.begin(), args.end());
+
+			auto call = emitContext.irBuilder.CreateCall(llvmNativeFunction, nativeArgs);
+			call->setCallingConv(asLLVMCallingConv(callingConvention));
+			call->setTailCall();
+			call->setDoesNotThrow();
+			function->setDoesNotThrow();
+
+			wavmAssert(functionType.results().size() <= 1);
+			if(functionType.results().size() == 1) { results.push_back(call); }
+		}
+	}
 
 	// Emit the function return.
 	emitContext.emitReturn(functionType.results(), results);
+}
+
+std::vector<void*> LLVMJIT::getIntrinsicThunks(const std::vector<IntrinsicThunkRequest>& requests)
+{
+	Lock<Platform::Mutex> intrinsicThunkLock(intrinsicThunkMutex);
+
+	// Find the native functions that don't have a cached thunk. Thunks that pass a closure to the
+	// native function are specific to the closure, so they aren't cached.
+	std::vector<Uptr> thunkRequestIndices;
+	HashSet<void*> thunkNativeFunctions;
+	std::vector<void*> thunks(requests.size(), nullptr);
+	for(Uptr requestIndex = 0; requestIndex < requests.size(); ++requestIndex)
+	{
+		void* nativeFunction = requests[requestIndex].nativeFunction;
+		if(requests[requestIndex].closure
+		   || (!intrinsicFunctionToThunkFunctionMap.contains(nativeFunction)
+			   && thunkNativeFunctions.add(nativeFunction)))
+		{ thunkRequestIndices.push_back(requestIndex); }
+	}
+
+	if(thunkRequestIndices.size())
+	{
+		// Emit all the thunks into a single LLVM module.
+		PooledLLVMContext pooledLLVMContext;
+		LLVMContext& llvmContext = *pooledLLVMContext;
+		llvm::Module llvmModule("", llvmContext);
+		for(Uptr thunkIndex = 0; thunkIndex < thunkRequestIndices.size(); ++thunkIndex)
+		{
+			emitIntrinsicThunk(
+				llvmContext, llvmModule, thunkIndex, requests[thunkRequestIndices[thunkIndex]]);
+		}
+
+		// Compile the LLVM IR to object code.
+		std::vector<U8> objectBytes = compileLLVMModule(llvmContext, std::move(llvmModule), false);
+
+		// Load the object code.
+		auto jitModule = new LoadedModule(objectBytes, {}, false);
+
+		HashMap<std::string, std::string> thunkDisplayNames;
+		for(Uptr thunkIndex = 0; thunkIndex < thunkRequestIndices.size(); ++thunkIndex)
+		{
+			const Uptr requestIndex = thunkRequestIndices[thunkIndex];
+			const IntrinsicThunkRequest& request = requests[requestIndex];
+			const std::string thunkSymbolName = getThunkSymbolName(thunkIndex);
+			JITFunction* intrinsicThunkFunction = jitModule->nameToFunctionMap[thunkSymbolName];
+			intrinsicThunkFunction->type = JITFunction::Type::intrinsicThunk;
+			if(request.closure)
+			{ thunks[requestIndex] = reinterpret_cast<void*>(intrinsicThunkFunction->baseAddress); }
+			else
+			{
+				intrinsicFunctionToThunkFunctionMap.addOrFail(request.nativeFunction,
+															  intrinsicThunkFunction);
+			}
+			thunkDisplayNames.add(thunkSymbolName,
+								  "thnk!intrinsic!" + asString(request.functionType));
+		}
+		registerJITFunctionsWithProfilers(jitModule, thunkDisplayNames);
+	}
+
+	for(Uptr requestIndex = 0; requestIndex < requests.size(); ++requestIndex)
+	{
+		if(!thunks[requestIndex])
+		{
+			thunks[requestIndex] = reinterpret_cast<void*>(
+				intrinsicFunctionToThunkFunctionMap[requests[requestIndex].nativeFunction]
+					->baseAddress);
+		}
+	}
+	return thunks;
+}
+
+void* LLVMJIT::getIntrinsicThunk(void* nativeFunction,
+								 const FunctionInstance* functionInstance,
+								 FunctionType functionType,
+								 CallingConvention callingConvention,
+								 const UntaggedValue* constantResult,
+								 bool isLeaf,
+								 const void* closure)
+{
+	const IntrinsicThunkRequest request{nativeFunction,
+										functionInstance,
+										functionType,
+										callingConvention,
+										constantResult,
+										isLeaf,
+										closure};
+	return getIntrinsicThunks({request})[0];
+}
+
+LoadedModule* LLVMJIT::loadLazyCompileStubs(
+	const std::vector<FunctionInstance*>& functionDefInstances,
+	const std::vector<FunctionType>& functionDefTypes,
+	const std::vector<std::string>& functionDefNames,
+	LazyCompileFunction lazyCompile,
+	std::vector<JITFunction*>& outStubs,
+	CodeArena* codeArena)
+{
+	wavmAssert(functionDefInstances.size() == functionDefTypes.size());
+
+	PooledLLVMContext pooledLLVMContext;
+	LLVMContext& llvmContext = *pooledLLVMContext;
+	llvm::Module llvmModule("", llvmContext);
+
+	// The type of the lazyCompile function: void* (FunctionInstance*, Uptr).
+	auto llvmLazyCompileType = llvm::FunctionType::get(
+		llvmContext.i8PtrType, {llvmContext.iptrType, llvmContext.iptrType}, false);
+	llvm::Value* llvmLazyCompile
+		= emitLiteralPointer((void*)lazyCompile, llvmLazyCompileType->getPointerTo());
+
+	for(Uptr functionDefIndex = 0; functionDefIndex < functionDefInstances.size();
+		++functionDefIndex)
+	{
+		const FunctionType functionType = functionDefTypes[functionDefIndex];
+		const Uptr functionInstanceBits
+			= reinterpret_cast<Uptr>(functionDefInstances[functionDefIndex]);
+
+		// Create a function with the same signature as the function definition, prefixed by an
+		// AnyFunc for the function definition's FunctionInstance.
+		auto function = llvm::Function::Create(
+			asLLVMType(llvmContext, functionType, CallingConvention::wasm),
+			llvm::Function::ExternalLinkage,
+			getExternalName("lazyCompileStub", functionDefIndex),
+			&llvmModule);
+		function->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
+		function->setPrefixData(llvm::ConstantArray::get(
+			llvm::ArrayType::get(llvmContext.iptrType, 2),
+			{emitLiteral(llvmContext, functionInstanceBits),
+			 emitLiteral(llvmContext, functionType.getEncoding().impl)}));
+
+		EmitContext emitContext(llvmContext);
+		emitContext.irBuilder.SetInsertPoint(
+			llvm::BasicBlock::Create(llvmContext, "entry", function));
+
+		emitContext.initContextVariables(&*function->args().begin());
+
+		// Call lazyCompile to get the function definition's code.
+		llvm::Value* code = emitContext.irBuilder.CreateCall(
+			llvmLazyCompile,
+			{emitLiteral(llvmContext, functionInstanceBits),
+			 emitLiteral(llvmContext, functionDefIndex)});
+
+		// Forward the call to the function definition's code.
+		llvm::SmallVector<llvm::Value*, 8> args;
+		for(auto argIt = function->args().begin() + 1; argIt != function->args().end(); ++argIt)
+		{ args.push_back(&*argIt); }
+
+		llvm::Value* llvmCode = emitContext.irBuilder.CreatePointerCast(
+			code, asLLVMType(llvmContext, functionType, CallingConvention::wasm)->getPointerTo());
+		ValueVector results
+			= emitContext.emitCallOrInvoke(llvmCode, args, functionType, CallingConvention::wasm);
+
+		// Emit the function return.
+		emitContext.emitReturn(functionType.results(), results);
+	}
 
 	// Compile the LLVM IR to object code.
 	std::vector<U8> objectBytes = compileLLVMModule(llvmContext, std::move(llvmModule), false);
 
 	// Load the object code.
-	auto jitModule = new LoadedModule(objectBytes, {}, false);
+	auto jitModule = new LoadedModule(objectBytes, {}, false, codeArena);
 
+	HashMap<std::string, std::string> stubDisplayNames;
+	for(Uptr functionDefIndex = 0; functionDefIndex < functionDefInstances.size();
+		++functionDefIndex)
+	{
 #if(defined(_WIN32) && !defined(_WIN64))
-	const char* thunkFunctionName = "_thunk";
+		const std::string stubName = "_" + getExternalName("lazyCompileStub", functionDefIndex);
 #else
-	const char* thunkFunctionName = "thunk";
+		const std::string stubName = getExternalName("lazyCompileStub", functionDefIndex);
 #endif
-	intrinsicThunkFunction = jitModule->nameToFunctionMap[thunkFunctionName];
-	intrinsicThunkFunction->type = JITFunction::Type::intrinsicThunk;
+		JITFunction* stub = jitModule->nameToFunctionMap[stubName];
+		stub->type = JITFunction::Type::lazyCompileStub;
+		stub->functionInstance = functionDefInstances[functionDefIndex];
+		outStubs.push_back(stub);
+
+		if(functionDefIndex < functionDefNames.size())
+		{ stubDisplayNames.add(stubName, "thnk!lazy!" + functionDefNames[functionDefIndex]); }
+	}
+	registerJITFunctionsWithProfilers(jitModule, stubDisplayNames);
 
-	return reinterpret_cast<void*>(intrinsicThunkFunction->baseAddress);
+	return jitModule;
 }
@@ -1,5 +1,6 @@
 #include <inttypes.h>
 #include <stdint.h>
+#include <algorithm>
 #include <string>
 
 #include "LLVMJITPrivate.h"
@@ -302,13 +303,21 @@ void LLVMJIT::processSEHTables(U8* imageBase,
 								  reinterpret_cast<Uptr>(imageBase),
 								  sehTrampolineAddress);
 
+	// The unwinder binary searches function tables, and entries may only be added to a growable
+	// function table in order, so sort the function table by address.
+	RuntimeFunction* functionTable
+		= reinterpret_cast<RuntimeFunction*>(Uptr(loadedObject.getSectionLoadAddress(pdataSection)));
+	const Uptr numFunctions = pdataNumBytes / sizeof(RuntimeFunction);
+	std::sort(functionTable,
+			  functionTable + numFunctions,
+			  [](const RuntimeFunction& left, const RuntimeFunction& right) {
+				  return left.beginAddress < right.beginAddress;
+			  });
+
 	if(PRINT_SEH_TABLES)
 	{
 		Log::printf(Log::debug, "Win64 SEH function table:\n");
 
-		const RuntimeFunction* functionTable = reinterpret_cast<const RuntimeFunction*>(
-			Uptr(loadedObject.getSectionLoadAddress(pdataSection)));
-		const Uptr numFunctions = pdataNumBytes / sizeof(RuntimeFunction);
 		for(Uptr functionIndex = 0; functionIndex < numFunctions; ++functionIndex)
 		{
 			Log::printf(Log::debug, " Function %" PRIuPTR "\n", functionIndex);
@@ -1,11 +1,20 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
+#include <vector>
 
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Config.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 
 using namespace WAVM;
 using namespace WAVM::Log;
@@ -16,6 +25,190 @@ static std::atomic<bool> categoryEnabled[(Uptr)Category::num] = {
 	{WAVM_METRICS_OUTPUT != 0} // metrics
 };
 
+static std::atomic<bool> isAsyncOutputEnabled{false};
+
+// A ring buffer that holds the messages a thread has printed while the output is asynchronous,
+// until the writer thread writes them to stdout. Only the thread that owns the buffer adds bytes
+// to it, and only a thread that holds the AsyncOutput mutex removes bytes from it, so it needs no
+// lock.
+struct ThreadLogBuffer
+{
+	static constexpr Uptr numBytes = 64 * 1024;
+
+	U8 bytes[numBytes];
+
+	// The total number of bytes that have been added to and removed from the buffer.
+	std::atomic<Uptr> numAddedBytes{0};
+	std::atomic<Uptr> numRemovedBytes{0};
+
+	// Set when the owning thread exits, so the buffer is freed once it is drained.
+	std::atomic<bool> isOrphaned{false};
+};
+
+// The state of the asynchronous output. It is created the first time the output is made
+// asynchronous, and never destroyed, so the writer thread and the atexit handler may use it during
+// static destruction.
+struct AsyncOutput
+{
+	Platform::Mutex mutex;
+	std::vector<ThreadLogBuffer*> threadBuffers;
+
+	Platform::Event wakeWriterEvent;
+	Platform::Thread* writerThread = nullptr;
+	std::atomic<bool> isWriterStopping{false};
+
+	static AsyncOutput& get()
+	{
+		static AsyncOutput* asyncOutput = new AsyncOutput;
+		return *asyncOutput;
+	}
+
+	// Writes all the buffered messages to stdout. The caller must hold the mutex.
+	void drain()
+	{
+		bool wroteBytes = false;
+		for(Uptr bufferIndex = 0; bufferIndex < threadBuffers.size();)
+		{
+			ThreadLogBuffer* buffer = threadBuffers[bufferIndex];
+			const bool isOrphaned = buffer->isOrphaned.load(std::memory_order_acquire);
+
+			const Uptr numRemovedBytes = buffer->numRemovedBytes.load(std::memory_order_relaxed);
+			const Uptr numAddedBytes = buffer->numAddedBytes.load(std::memory_order_acquire);
+			if(numAddedBytes != numRemovedBytes)
+			{
+				// Write the buffered bytes, which may wrap around the end of the ring buffer.
+				const Uptr beginIndex = numRemovedBytes % ThreadLogBuffer::numBytes;
+				const Uptr numBufferedBytes = numAddedBytes - numRemovedBytes;
+				const Uptr numBytesBeforeWrap
+					= std::min(numBufferedBytes, ThreadLogBuffer::numBytes - beginIndex);
+				fwrite(buffer->bytes + beginIndex, 1, numBytesBeforeWrap, stdout);
+				fwrite(buffer->bytes, 1, numBufferedBytes - numBytesBeforeWrap, stdout);
+				buffer->numRemovedBytes.store(numAddedBytes, std::memory_order_release);
+				wroteBytes = true;
+			}
+
+			// An orphaned buffer won't have any more bytes added to it, so free it once the bytes
+			// that were added before it was orphaned are written.
+			if(isOrphaned)
+			{
+				delete buffer;
+				threadBuffers[bufferIndex] = threadBuffers.back();
+				threadBuffers.pop_back();
+			}
+			else
+			{
+				++bufferIndex;
+			}
+		}
+		if(wroteBytes) { fflush(stdout); }
+	}
+
+	// Writes bytes to stdout synchronously, after the buffered messages.
+	void writeSynchronously(const char* string, Uptr numChars)
+	{
+		Lock<Platform::Mutex> lock(mutex);
+		drain();
+		fwrite(string, 1, numChars, stdout);
+		fflush(stdout);
+	}
+};
+
+// Owns the calling thread's ThreadLogBuffer, and orphans it when the thread exits.
+struct ThreadLogBufferOwner
+{
+	ThreadLogBuffer* buffer = nullptr;
+
+	~ThreadLogBufferOwner()
+	{
+		if(buffer) { buffer->isOrphaned.store(true, std::memory_order_release); }
+	}
+};
+
+static thread_local ThreadLogBufferOwner threadLogBufferOwner;
+
+static I64 writerThreadEntry(void*)
+{
+	AsyncOutput& asyncOutput = AsyncOutput::get();
+	while(!asyncOutput.isWriterStopping.load())
+	{
+		// Wake up periodically, or when a thread's buffer is more than half full.
+		asyncOutput.wakeWriterEvent.wait(Platform::getMonotonicClock() + 10 * 1000);
+
+		Lock<Platform::Mutex> lock(asyncOutput.mutex);
+		asyncOutput.drain();
+	};
+	return 0;
+}
+
+static void flushAtExit() { flushOutput(); }
+
+// Adds a message to the calling thread's buffer, waiting for the buffer to be drained if it is
+// full. Messages too large for the buffer are written synchronously.
+static void addToThreadBuffer(const char* string, Uptr numChars)
+{
+	AsyncOutput& asyncOutput = AsyncOutput::get();
+	if(numChars > ThreadLogBuffer::numBytes)
+	{
+		asyncOutput.writeSynchronously(string, numChars);
+		return;
+	}
+
+	ThreadLogBuffer* buffer = threadLogBufferOwner.buffer;
+	if(!buffer)
+	{
+		buffer = threadLogBufferOwner.buffer = new ThreadLogBuffer;
+		Lock<Platform::Mutex> lock(asyncOutput.mutex);
+		asyncOutput.threadBuffers.push_back(buffer);
+	}
+
+	const Uptr numAddedBytes = buffer->numAddedBytes.load(std::memory_order_relaxed);
+	Uptr numRemovedBytes = buffer->numRemovedBytes.load(std::memory_order_acquire);
+	if(ThreadLogBuffer::numBytes - (numAddedBytes - numRemovedBytes) < numChars)
+	{
+		// If there isn't room for the message, drain the buffers on this thread.
+		Lock<Platform::Mutex> lock(asyncOutput.mutex);
+		asyncOutput.drain();
+		numRemovedBytes = numAddedBytes;
+	}
+
+	const Uptr beginIndex = numAddedBytes % ThreadLogBuffer::numBytes;
+	const Uptr numBytesBeforeWrap = std::min(numChars, ThreadLogBuffer::numBytes - beginIndex);
+	memcpy(buffer->bytes + beginIndex, string, numBytesBeforeWrap);
+	memcpy(buffer->bytes, string + numBytesBeforeWrap, numChars - numBytesBeforeWrap);
+	buffer->numAddedBytes.store(numAddedBytes + numChars, std::memory_order_release);
+
+	if(numAddedBytes + numChars - numRemovedBytes > ThreadLogBuffer::numBytes / 2)
+	{ asyncOutput.wakeWriterEvent.signal(); }
+}
+
+static void printAsync(Category category, const char* format, va_list argList)
+{
+	// Format the message into a buffer on the stack, or on the heap if it doesn't fit.
+	char stackChars[1024];
+	std::vector<char> heapChars;
+	const char* string = stackChars;
+
+	va_list argListCopy;
+	va_copy(argListCopy, argList);
+	const int numChars = vsnprintf(stackChars, sizeof(stackChars), format, argListCopy);
+	va_end(argListCopy);
+	if(numChars < 0) { return; }
+	if(Uptr(numChars) >= sizeof(stackChars))
+	{
+		heapChars.resize(Uptr(numChars) + 1);
+		vsnprintf(heapChars.data(), heapChars.size(), format, argList);
+		string = heapChars.data();
+	}
+
+	// Errors are written synchronously, so they aren't lost if the process exits abnormally.
+	if(category == Category::error)
+	{ AsyncOutput::get().writeSynchronously(string, Uptr(numChars)); }
+	else
+	{
+		addToThreadBuffer(string, Uptr(numChars));
+	}
+}
+
 void Log::setCategoryEnabled(Category category, bool enable)
 {
 	wavmAssert(category < Category::num);
@@ -25,26 +218,71 @@ void Log::setCategoryEnabled(Category category, bool enable)
 bool Log::isCategoryEnabled(Category category)
 {
 	wavmAssert(category < Category::num);
-	return categoryEnabled[(Uptr)category].load();
+	return categoryEnabled[(Uptr)category].load(std::memory_order_relaxed);
+}
+
+void Log::setAsyncOutput(bool enable)
+{
+	AsyncOutput& asyncOutput = AsyncOutput::get();
+	if(enable && !asyncOutput.writerThread)
+	{
+		static bool registeredAtExit = false;
+		if(!registeredAtExit)
+		{
+			errorUnless(!atexit(flushAtExit));
+			registeredAtExit = true;
+		}
+
+		asyncOutput.isWriterStopping.store(false);
+		asyncOutput.writerThread = Platform::createThread(64 * 1024, writerThreadEntry, nullptr);
+		isAsyncOutputEnabled.store(true);
+	}
+	else if(!enable && asyncOutput.writerThread)
+	{
+		isAsyncOutputEnabled.store(false);
+		asyncOutput.isWriterStopping.store(true);
+		asyncOutput.wakeWriterEvent.signal();
+		Platform::joinThread(asyncOutput.writerThread);
+		asyncOutput.writerThread = nullptr;
+		flushOutput();
+	}
+}
+
+void Log::flushOutput()
+{
+	AsyncOutput& asyncOutput = AsyncOutput::get();
+	Lock<Platform::Mutex> lock(asyncOutput.mutex);
+	asyncOutput.drain();
+	fflush(stdout);
 }
 
 void Log::printf(Category category, const char* format, ...)
 {
-	if(categoryEnabled[(Uptr)category].load())
+	if(categoryEnabled[(Uptr)category].load(std::memory_order_relaxed))
 	{
 		va_list argList;
 		va_start(argList, format);
-		vfprintf(stdout, format, argList);
-		fflush(stdout);
+		if(isAsyncOutputEnabled.load(std::memory_order_relaxed))
+		{ printAsync(category, format, argList); }
+		else
+		{
+			vfprintf(stdout, format, argList);
+			fflush(stdout);
+		}
 		va_end(argList);
 	}
 }
 
 void Log::vprintf(Category category, const char* format, va_list argList)
 {
-	if(categoryEnabled[(Uptr)category].load())
+	if(categoryEnabled[(Uptr)category].load(std::memory_order_relaxed))
 	{
-		vfprintf(stdout, format, argList);
-		fflush(stdout);
+		if(isAsyncOutputEnabled.load(std::memory_order_relaxed))
+		{ printAsync(category, format, argList); }
+		else
+		{
+			vfprintf(stdout, format, argList);
+			fflush(stdout);
+		}
 	}
 }
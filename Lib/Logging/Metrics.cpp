@@ -0,0 +1,70 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Platform/Mutex.h"
+
+using namespace WAVM;
+using namespace WAVM::Metrics;
+
+// The registered metrics. Metrics may be constructed during static initialization, so the registry
+// is created by the first metric that is registered.
+struct MetricRegistry
+{
+	Platform::Mutex mutex;
+	std::vector<const Metric*> metrics;
+
+	static MetricRegistry& get()
+	{
+		static MetricRegistry registry;
+		return registry;
+	}
+};
+
+Metric::Metric(const char* inName, const char* inDescription, Type inType)
+: name(inName), description(inDescription), type(inType)
+{
+	MetricRegistry& registry = MetricRegistry::get();
+	Lock<Platform::Mutex> registryLock(registry.mutex);
+	registry.metrics.push_back(this);
+}
+
+std::vector<MetricValue> Metrics::getMetrics()
+{
+	MetricRegistry& registry = MetricRegistry::get();
+	Lock<Platform::Mutex> registryLock(registry.mutex);
+
+	std::vector<MetricValue> values;
+	for(const Metric* metric : registry.metrics)
+	{
+		MetricValue value;
+		value.name = metric->name;
+		value.description = metric->description;
+		value.type = metric->type;
+		switch(metric->type)
+		{
+		case Type::counter: value.value = I64(static_cast<const Counter*>(metric)->get()); break;
+		case Type::gauge: value.value = static_cast<const Gauge*>(metric)->get(); break;
+		case Type::histogram:
+		{
+			const Histogram* histogram = static_cast<const Histogram*>(metric);
+			value.count = histogram->getCount();
+			value.sum = histogram->getSum();
+			for(Uptr bucketIndex = 0; bucketIndex < Histogram::numBuckets; ++bucketIndex)
+			{ value.bucketCounts.push_back(histogram->getBucketCount(bucketIndex)); }
+			break;
+		}
+		default: Errors::unreachable();
+		};
+		values.push_back(std::move(value));
+	}
+
+	std::sort(values.begin(), values.end(), [](const MetricValue& left, const MetricValue& right) {
+		return strcmp(left.name.c_str(), right.name.c_str()) < 0;
+	});
+	return values;
+}
@@ -0,0 +1,136 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Logging/Trace.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+
+using namespace WAVM;
+using namespace WAVM::Trace;
+
+struct TraceSpan
+{
+	const char* name;
+	U64 beginMicroseconds;
+	U64 endMicroseconds;
+	Uptr threadId;
+};
+
+// The recorded spans. Spans may be recorded during static initialization, so the recorder is
+// created by the first use.
+struct TraceRecorder
+{
+	std::atomic<bool> isEnabled{false};
+	U64 startMicroseconds = 0;
+
+	Platform::Mutex mutex;
+	std::vector<TraceSpan> spans;
+	std::atomic<Uptr> nextThreadId{1};
+
+	static TraceRecorder& get()
+	{
+		static TraceRecorder recorder;
+		return recorder;
+	}
+};
+
+// Chrome traces identify threads by a number, so number the threads in the order they record
+// their first span.
+static Uptr getCurrentThreadId()
+{
+	static thread_local Uptr threadId = 0;
+	if(!threadId)
+	{ threadId = TraceRecorder::get().nextThreadId.fetch_add(1, std::memory_order_relaxed); }
+	return threadId;
+}
+
+void Trace::setEnabled(bool enable)
+{
+	TraceRecorder& recorder = TraceRecorder::get();
+	Lock<Platform::Mutex> recorderLock(recorder.mutex);
+	if(enable && !recorder.isEnabled.load(std::memory_order_relaxed))
+	{
+		recorder.spans.clear();
+		recorder.startMicroseconds = Platform::getMonotonicClock();
+	}
+	recorder.isEnabled.store(enable, std::memory_order_relaxed);
+}
+
+bool Trace::isEnabled()
+{
+	return TraceRecorder::get().isEnabled.load(std::memory_order_relaxed);
+}
+
+U64 Trace::getClockMicroseconds() { return Platform::getMonotonicClock(); }
+
+void Trace::recordSpan(const char* name, U64 beginMicroseconds, U64 endMicroseconds)
+{
+	const Uptr threadId = getCurrentThreadId();
+
+	TraceRecorder& recorder = TraceRecorder::get();
+	Lock<Platform::Mutex> recorderLock(recorder.mutex);
+
+	// Ignore spans that began before recording was last started.
+	if(!recorder.isEnabled.load(std::memory_order_relaxed)
+	   || beginMicroseconds < recorder.startMicroseconds)
+	{ return; }
+	recorder.spans.push_back({name, beginMicroseconds, endMicroseconds, threadId});
+}
+
+static void appendJSONString(std::string& outJSON, const char* string)
+{
+	outJSON += '"';
+	for(; *string; ++string)
+	{
+		const char c = *string;
+		if(c == '"' || c == '\\')
+		{
+			outJSON += '\\';
+			outJSON += c;
+		}
+		else if(U8(c) < 0x20)
+		{
+			char escapedChar[8];
+			snprintf(escapedChar, sizeof(escapedChar), "\\u%04x", unsigned(U8(c)));
+			outJSON += escapedChar;
+		}
+		else
+		{
+			outJSON += c;
+		}
+	}
+	outJSON += '"';
+}
+
+std::string Trace::getChromeTraceJSON()
+{
+	TraceRecorder& recorder = TraceRecorder::get();
+	Lock<Platform::Mutex> recorderLock(recorder.mutex);
+
+	// Each span is written as a complete event, with its time relative to the start of recording.
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for(Uptr spanIndex = 0; spanIndex < recorder.spans.size(); ++spanIndex)
+	{
+		const TraceSpan& span = recorder.spans[spanIndex];
+		char eventFields[128];
+		snprintf(eventFields,
+				 sizeof(eventFields),
+				 ",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIuPTR ",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64
+				 "}",
+				 span.threadId,
+				 span.beginMicroseconds - recorder.startMicroseconds,
+				 span.endMicroseconds - span.beginMicroseconds);
+
+		if(spanIndex) { json += ','; }
+		json += "{\"name\":";
+		appendJSONString(json, span.name);
+		json += eventFields;
+	}
+	json += "]}\n";
+	return json;
+}
@@ -83,28 +83,87 @@ StateIndex NFA::getNonTerminalEdge(Builder* builder, StateIndex initialState, ch
 	return unmatchedCharacterTerminal;
 }
 
-struct DFAState
+// The DFA's transitions, indexed by [state][charClass]. The character classes partition the
+// characters so that every NFA edge predicate either contains all the characters in a class, or
+// none of them, so the DFA's transitions for all the characters in a class are the same.
+struct DFA
 {
-	StateIndex nextStateByChar[256];
-	DFAState()
+	U8 charToClassMap[256];
+	Uptr numClasses;
+	std::vector<StateIndex> nextStateByStateAndClass;
+
+	Uptr getNumStates() const { return nextStateByStateAndClass.size() / numClasses; }
+};
+
+// Partitions the characters into the coarsest set of classes that every NFA edge predicate either
+// contains or excludes, so the DFA construction only needs to consider a representative character
+// from each class.
+static Uptr partitionCharsByPredicates(const Builder* builder,
+									   U8 outCharToClassMap[256],
+									   U8 outRepresentativeCharsByClass[256])
+{
+	HashSet<CharSet> predicates;
+	for(const NFAState& nfaState : builder->nfaStates)
+	{
+		for(const auto& transition : nfaState.nextStateToPredicateMap)
+		{ predicates.add(transition.value); }
+	}
+
+	std::vector<CharSet> classCharSets;
+	classCharSets.push_back(~CharSet{});
+	for(const CharSet& predicate : predicates)
 	{
+		const Uptr numClassesBeforeSplit = classCharSets.size();
+		for(Uptr classIndex = 0; classIndex < numClassesBeforeSplit; ++classIndex)
+		{
+			const CharSet includedChars = classCharSets[classIndex] & predicate;
+			const CharSet excludedChars = classCharSets[classIndex] & ~predicate;
+			if(!includedChars.isEmpty() && !excludedChars.isEmpty())
+			{
+				classCharSets[classIndex] = includedChars;
+				classCharSets.push_back(excludedChars);
+			}
+		}
+	}
+	wavmAssert(classCharSets.size() <= 256);
+
+	for(Uptr classIndex = 0; classIndex < classCharSets.size(); ++classIndex)
+	{
+		bool hasRepresentativeChar = false;
 		for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
-		{ nextStateByChar[charIndex] = unmatchedCharacterTerminal | edgeDoesntConsumeInputFlag; }
+		{
+			if(classCharSets[classIndex].contains(U8(charIndex)))
+			{
+				outCharToClassMap[charIndex] = U8(classIndex);
+				if(!hasRepresentativeChar)
+				{
+					outRepresentativeCharsByClass[classIndex] = U8(charIndex);
+					hasRepresentativeChar = true;
+				}
+			}
+		}
 	}
-};
 
-static std::vector<DFAState> convertToDFA(Builder* builder)
+	return classCharSets.size();
+}
+
+static DFA convertToDFA(Builder* builder)
 {
 	Timing::Timer timer;
 
-	std::vector<DFAState> dfaStates;
+	DFA dfa;
+	U8 representativeCharsByClass[256];
+	dfa.numClasses
+		= partitionCharsByPredicates(builder, dfa.charToClassMap, representativeCharsByClass);
+	const Uptr numClasses = dfa.numClasses;
+
 	HashMap<StateSet, StateIndex> nfaStateSetToDFAStateMap;
 	std::vector<StateSet> dfaStateToNFAStateSetMap;
 	std::vector<StateIndex> pendingDFAStates;
 
 	nfaStateSetToDFAStateMap.set(StateSet{0}, (StateIndex)0);
 	dfaStateToNFAStateSetMap.emplace_back(StateSet{0});
-	dfaStates.emplace_back();
+	dfa.nextStateByStateAndClass.resize(numClasses);
 	pendingDFAStates.push_back((StateIndex)0);
 
 	Uptr maxLocalStates = 0;
@@ -115,11 +174,9 @@ static std::vector<DFAState> convertToDFA(Builder* builder)
 		const StateIndex currentDFAStateIndex = pendingDFAStates.back();
 		pendingDFAStates.pop_back();
 
-		const StateSet currentStateSet = dfaStateToNFAStateSetMap[currentDFAStateIndex];
-
 		// Expand the set of current states to include all states reachable by epsilon transitions
 		// from the current states.
-		StateSet epsilonClosureCurrentStateSet = currentStateSet;
+		StateSet epsilonClosureCurrentStateSet = dfaStateToNFAStateSetMap[currentDFAStateIndex];
 		for(Uptr scanIndex = 0; scanIndex < epsilonClosureCurrentStateSet.size(); ++scanIndex)
 		{
 			StateIndex scanState = epsilonClosureCurrentStateSet[scanIndex];
@@ -183,44 +240,49 @@ static std::vector<DFAState> convertToDFA(Builder* builder)
 		maxLocalStates = std::max<Uptr>(maxLocalStates, numLocalStates);
 
 		// Combine the [nextState][char] transition maps for current states and transpose to
-		// [char][nextState] After building the compact index of referenced states, the nextState
-		// set can be represented as a 64-bit mask.
-		LocalStateSet charToLocalStateSet[256];
+		// [charClass][nextState] After building the compact index of referenced states, the
+		// nextState set can be represented as a 64-bit mask.
+		LocalStateSet classToLocalStateSet[256];
 		for(auto stateIndex : nonTerminalCurrentStateSet)
 		{
 			const NFAState& nfaState = builder->nfaStates[stateIndex];
 			for(auto transition : nfaState.nextStateToPredicateMap)
 			{
-				for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
+				const StateIndex localStateIndex = stateIndexToLocalStateIndexMap[transition.key];
+				for(Uptr classIndex = 0; classIndex < numClasses; ++classIndex)
 				{
-					if(transition.value.contains((char)charIndex))
-					{
-						charToLocalStateSet[charIndex].add(
-							stateIndexToLocalStateIndexMap[transition.key]);
-					}
+					if(transition.value.contains(representativeCharsByClass[classIndex]))
+					{ classToLocalStateSet[classIndex].add(localStateIndex); }
 				}
 			}
 		}
 
 		const LocalStateSet currentTerminalStateLocalSet(
 			stateIndexToLocalStateIndexMap[currentTerminalState]);
-		for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
+		for(Uptr classIndex = 0; classIndex < numClasses; ++classIndex)
 		{
-			if(charToLocalStateSet[charIndex].isEmpty())
-			{ charToLocalStateSet[charIndex] = currentTerminalStateLocalSet; }
+			if(classToLocalStateSet[classIndex].isEmpty())
+			{ classToLocalStateSet[classIndex] = currentTerminalStateLocalSet; }
 		}
 
 		// Find the set of unique local state sets that follow this state set.
 		std::vector<LocalStateSet> uniqueLocalNextStateSets;
-		for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
+		U8 classToUniqueLocalNextStateSetMap[256];
+		for(Uptr classIndex = 0; classIndex < numClasses; ++classIndex)
 		{
-			const LocalStateSet localStateSet = charToLocalStateSet[charIndex];
-			if(!localStateSet.isEmpty()) { addUnique(uniqueLocalNextStateSets, localStateSet); }
+			const LocalStateSet localStateSet = classToLocalStateSet[classIndex];
+			Uptr uniqueIndex = 0;
+			while(uniqueIndex < uniqueLocalNextStateSets.size()
+				  && uniqueLocalNextStateSets[uniqueIndex] != localStateSet)
+			{ ++uniqueIndex; }
+			if(uniqueIndex == uniqueLocalNextStateSets.size())
+			{ uniqueLocalNextStateSets.push_back(localStateSet); }
+			classToUniqueLocalNextStateSetMap[classIndex] = U8(uniqueIndex);
 		}
 
 		// For each unique local state set that follows this state set, find or create a
 		// corresponding DFA state.
-		HashMap<LocalStateSet, StateIndex> localStateSetToDFAStateIndexMap;
+		std::vector<StateIndex> uniqueLocalNextStateSetDFAStates;
 		for(auto localNextStateSet : uniqueLocalNextStateSets)
 		{
 			// Convert the local state set bit mask to a global NFA state set.
@@ -238,38 +300,35 @@ static std::vector<DFAState> convertToDFA(Builder* builder)
 			}
 
 			if(nextStateSet.size() == 1 && *nextStateSet.begin() < 0)
-			{ localStateSetToDFAStateIndexMap.set(localNextStateSet, *nextStateSet.begin()); }
+			{ uniqueLocalNextStateSetDFAStates.push_back(*nextStateSet.begin()); }
 			else
 			{
 				// Find an existing DFA state corresponding to this NFA state set.
 				const StateIndex* nextDFAState = nfaStateSetToDFAStateMap.get(nextStateSet);
-				if(nextDFAState)
-				{ localStateSetToDFAStateIndexMap.set(localNextStateSet, *nextDFAState); }
+				if(nextDFAState) { uniqueLocalNextStateSetDFAStates.push_back(*nextDFAState); }
 				else
 				{
 					// If no corresponding DFA state existing yet, create a new one and add it to
 					// the queue of pending states to process.
-					const StateIndex nextDFAStateIndex = (StateIndex)dfaStates.size();
-					localStateSetToDFAStateIndexMap.set(localNextStateSet, nextDFAStateIndex);
+					const StateIndex nextDFAStateIndex
+						= (StateIndex)dfaStateToNFAStateSetMap.size();
+					uniqueLocalNextStateSetDFAStates.push_back(nextDFAStateIndex);
 					nfaStateSetToDFAStateMap.set(nextStateSet, nextDFAStateIndex);
-					dfaStateToNFAStateSetMap.emplace_back(nextStateSet);
-					dfaStates.emplace_back();
+					dfaStateToNFAStateSetMap.emplace_back(std::move(nextStateSet));
+					dfa.nextStateByStateAndClass.resize(dfa.nextStateByStateAndClass.size()
+														+ numClasses);
 					pendingDFAStates.push_back(nextDFAStateIndex);
 				}
 			}
 		}
 
 		// Set up the DFA transition map.
-		DFAState& dfaState = dfaStates[nfaStateSetToDFAStateMap[currentStateSet]];
-		for(auto localStateSetToDFAStateIndex : localStateSetToDFAStateIndexMap)
+		StateIndex* nextStateByClass
+			= dfa.nextStateByStateAndClass.data() + currentDFAStateIndex * numClasses;
+		for(Uptr classIndex = 0; classIndex < numClasses; ++classIndex)
 		{
-			const LocalStateSet& localStateSet = localStateSetToDFAStateIndex.key;
-			const StateIndex nextDFAStateIndex = localStateSetToDFAStateIndex.value;
-			for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
-			{
-				if(charToLocalStateSet[charIndex] == localStateSet)
-				{ dfaState.nextStateByChar[charIndex] = nextDFAStateIndex; }
-			}
+			nextStateByClass[classIndex]
+				= uniqueLocalNextStateSetDFAStates[classToUniqueLocalNextStateSetMap[classIndex]];
 		}
 		maxDFANextStates = std::max(maxDFANextStates, (Uptr)uniqueLocalNextStateSets.size());
 	};
@@ -278,7 +337,7 @@ static std::vector<DFAState> convertToDFA(Builder* builder)
 	Log::printf(Log::metrics,
 				"  translated NFA with %" PRIuPTR " states to DFA with %" PRIuPTR " states\n",
 				Uptr(builder->nfaStates.size()),
-				Uptr(dfaStates.size()));
+				dfa.getNumStates());
 	Log::printf(Log::metrics,
 				"  maximum number of states following a NFA state set: %" PRIuPTR "\n",
 				maxLocalStates);
@@ -286,123 +345,102 @@ static std::vector<DFAState> convertToDFA(Builder* builder)
 				"  maximum number of states following a DFA state: %" PRIuPTR "\n",
 				maxDFANextStates);
 
-	return dfaStates;
+	return dfa;
 }
 
-struct StateTransitionsByChar
-{
-	U8 c;
-	StateIndex* nextStateByInitialState;
-	Uptr numStates;
-	StateTransitionsByChar(U8 inC, Uptr inNumStates)
-	: c(inC), nextStateByInitialState(nullptr), numStates(inNumStates)
-	{
-	}
-	StateTransitionsByChar(StateTransitionsByChar&& inMove)
-	: c(inMove.c)
-	, nextStateByInitialState(inMove.nextStateByInitialState)
-	, numStates(inMove.numStates)
-	{
-		inMove.nextStateByInitialState = nullptr;
-	}
-	~StateTransitionsByChar()
-	{
-		if(nextStateByInitialState) { delete[] nextStateByInitialState; }
-	}
-
-	void operator=(StateTransitionsByChar&& inMove)
-	{
-		c = inMove.c;
-		nextStateByInitialState = inMove.nextStateByInitialState;
-		numStates = inMove.numStates;
-		inMove.nextStateByInitialState = nullptr;
-	}
-
-	bool operator<(const StateTransitionsByChar& right) const
-	{
-		wavmAssert(numStates == right.numStates);
-		return memcmp(nextStateByInitialState,
-					  right.nextStateByInitialState,
-					  sizeof(StateIndex) * numStates)
-			   < 0;
-	}
-	bool operator!=(const StateTransitionsByChar& right) const
-	{
-		wavmAssert(numStates == right.numStates);
-		return memcmp(nextStateByInitialState,
-					  right.nextStateByInitialState,
-					  sizeof(StateIndex) * numStates)
-			   != 0;
-	}
-};
-
 NFA::Machine::Machine(Builder* builder)
 {
 	// Convert the NFA constructed by the builder to a DFA.
-	std::vector<DFAState> dfaStates = convertToDFA(builder);
-	wavmAssert(dfaStates.size() <= internalMaxStates);
+	const DFA dfa = convertToDFA(builder);
+	numStates = dfa.getNumStates();
+	wavmAssert(numStates <= internalMaxStates);
 	delete builder;
 
 	Timing::Timer timer;
 
-	// Transpose the [state][character] transition map to [character][state].
-	std::vector<StateTransitionsByChar> stateTransitionsByChar;
-	for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
+	// The NFA's character classes may distinguish characters that the DFA doesn't, so merge the
+	// classes that have the same transition in every DFA state. Hash each class's column of the
+	// transition table to avoid comparing all pairs of columns.
+	std::vector<Uptr> columnHashes(dfa.numClasses, 0);
+	for(Uptr stateIndex = 0; stateIndex < numStates; ++stateIndex)
 	{
-		stateTransitionsByChar.push_back(StateTransitionsByChar((U8)charIndex, dfaStates.size()));
-		stateTransitionsByChar[charIndex].nextStateByInitialState
-			= new StateIndex[dfaStates.size()];
-		for(Uptr stateIndex = 0; stateIndex < dfaStates.size(); ++stateIndex)
+		for(Uptr dfaClassIndex = 0; dfaClassIndex < dfa.numClasses; ++dfaClassIndex)
 		{
-			stateTransitionsByChar[charIndex].nextStateByInitialState[stateIndex]
-				= dfaStates[stateIndex].nextStateByChar[charIndex];
+			columnHashes[dfaClassIndex] = Hash<StateIndex>()(
+				dfa.nextStateByStateAndClass[stateIndex * dfa.numClasses + dfaClassIndex],
+				columnHashes[dfaClassIndex]);
 		}
 	}
 
-	// Sort the [character][state] transition map by the [state] column.
-	numStates = dfaStates.size();
-	std::sort(stateTransitionsByChar.begin(), stateTransitionsByChar.end());
-
-	// Build a minimal set of character equivalence classes that have the same transition across all
-	// states.
-	U8 characterToClassMap[256];
-	U8 representativeCharsByClass[256];
-	numClasses = 1;
-	characterToClassMap[stateTransitionsByChar[0].c] = 0;
-	representativeCharsByClass[0] = stateTransitionsByChar[0].c;
-	for(Uptr charIndex = 1; charIndex < stateTransitionsByChar.size(); ++charIndex)
-	{
-		if(stateTransitionsByChar[charIndex] != stateTransitionsByChar[charIndex - 1])
+	auto haveSameTransitions = [&](Uptr dfaClassA, Uptr dfaClassB) {
+		if(columnHashes[dfaClassA] != columnHashes[dfaClassB]) { return false; }
+		for(Uptr stateIndex = 0; stateIndex < numStates; ++stateIndex)
 		{
-			representativeCharsByClass[numClasses] = stateTransitionsByChar[charIndex].c;
-			++numClasses;
+			const StateIndex* nextStateByClass
+				= dfa.nextStateByStateAndClass.data() + stateIndex * dfa.numClasses;
+			if(nextStateByClass[dfaClassA] != nextStateByClass[dfaClassB]) { return false; }
 		}
-		characterToClassMap[stateTransitionsByChar[charIndex].c] = U8(numClasses - 1);
+		return true;
+	};
+
+	U8 dfaClassToClassMap[256];
+	U8 representativeDFAClassesByClass[256];
+	numClasses = 0;
+	for(Uptr dfaClassIndex = 0; dfaClassIndex < dfa.numClasses; ++dfaClassIndex)
+	{
+		Uptr classIndex = 0;
+		while(classIndex < numClasses
+			  && !haveSameTransitions(dfaClassIndex, representativeDFAClassesByClass[classIndex]))
+		{ ++classIndex; }
+		if(classIndex == numClasses)
+		{ representativeDFAClassesByClass[numClasses++] = U8(dfaClassIndex); }
+		dfaClassToClassMap[dfaClassIndex] = U8(classIndex);
 	}
 
 	// Build a [charClass][state] transition map.
-	stateAndOffsetToNextStateMap = new InternalStateIndex[numClasses * numStates];
+	InternalStateIndex* newStateAndOffsetToNextStateMap
+		= new InternalStateIndex[numClasses * numStates];
 	for(Uptr classIndex = 0; classIndex < numClasses; ++classIndex)
 	{
+		const Uptr dfaClassIndex = representativeDFAClassesByClass[classIndex];
 		for(Uptr stateIndex = 0; stateIndex < numStates; ++stateIndex)
 		{
-			stateAndOffsetToNextStateMap[stateIndex + classIndex * numStates] = InternalStateIndex(
-				dfaStates[stateIndex].nextStateByChar[representativeCharsByClass[classIndex]]);
+			newStateAndOffsetToNextStateMap[stateIndex + classIndex * numStates]
+				= InternalStateIndex(
+					dfa.nextStateByStateAndClass[stateIndex * dfa.numClasses + dfaClassIndex]);
 		}
 	}
+	stateAndOffsetToNextStateMap = newStateAndOffsetToNextStateMap;
+	ownsStateAndOffsetToNextStateMap = true;
 
 	// Build a map from character index to offset into [charClass][initialState] transition map.
 	wavmAssert((numClasses - 1) * (numStates - 1) <= UINT32_MAX);
 	for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
-	{ charToOffsetMap[charIndex] = U32(numStates * characterToClassMap[charIndex]); }
+	{
+		const Uptr classIndex = dfaClassToClassMap[dfa.charToClassMap[charIndex]];
+		charToOffsetMap[charIndex] = U32(numStates * classIndex);
+	}
 
 	Timing::logTimer("reduced DFA character classes", timer);
 	Log::printf(Log::metrics, "  reduced DFA character classes to %" PRIuPTR "\n", numClasses);
 }
 
+NFA::Machine::Machine(const U32 inCharToOffsetMap[256],
+					  const I16* inStateAndOffsetToNextStateMap,
+					  Uptr inNumClasses,
+					  Uptr inNumStates)
+: stateAndOffsetToNextStateMap(inStateAndOffsetToNextStateMap)
+, numClasses(inNumClasses)
+, numStates(inNumStates)
+, ownsStateAndOffsetToNextStateMap(false)
+{
+	wavmAssert(numStates <= internalMaxStates);
+	memcpy(charToOffsetMap, inCharToOffsetMap, sizeof(charToOffsetMap));
+}
+
 NFA::Machine::~Machine()
 {
-	if(stateAndOffsetToNextStateMap)
+	if(stateAndOffsetToNextStateMap && ownsStateAndOffsetToNextStateMap)
 	{
 		delete[] stateAndOffsetToNextStateMap;
 		stateAndOffsetToNextStateMap = nullptr;
@@ -416,6 +454,45 @@ void NFA::Machine::moveFrom(Machine&& inMachine)
 	inMachine.stateAndOffsetToNextStateMap = nullptr;
 	numClasses = inMachine.numClasses;
 	numStates = inMachine.numStates;
+	ownsStateAndOffsetToNextStateMap = inMachine.ownsStateAndOffsetToNextStateMap;
+}
+
+std::string NFA::Machine::dumpCPPTables(const char* namePrefix) const
+{
+	// Write each table value to a line of at most 100 characters.
+	Uptr lineLength = 0;
+	auto appendTableValue = [&lineLength](std::string& result, Iptr value) {
+		const std::string valueString = std::to_string(value) + ",";
+		if(lineLength + valueString.size() > 100)
+		{
+			result += "\n";
+			lineLength = 0;
+		}
+		result += valueString;
+		lineLength += valueString.size();
+	};
+
+	std::string result;
+	result += "static constexpr Uptr " + std::string(namePrefix)
+			  + "NumClasses = " + std::to_string(numClasses) + ";\n";
+	result += "static constexpr Uptr " + std::string(namePrefix)
+			  + "NumStates = " + std::to_string(numStates) + ";\n";
+
+	result += "static constexpr U32 " + std::string(namePrefix) + "CharToOffsetMap[256] = {\n";
+	lineLength = 0;
+	for(Uptr charIndex = 0; charIndex < 256; ++charIndex)
+	{ appendTableValue(result, Iptr(charToOffsetMap[charIndex])); }
+	result += "\n};\n";
+
+	result += "static constexpr I16 " + std::string(namePrefix)
+			  + "StateAndOffsetToNextStateMap[" + std::to_string(numClasses * numStates)
+			  + "] = {\n";
+	lineLength = 0;
+	for(Uptr index = 0; index < numClasses * numStates; ++index)
+	{ appendTableValue(result, Iptr(stateAndOffsetToNextStateMap[index])); }
+	result += "\n};\n";
+
+	return result;
 }
 
 static char nibbleToHexChar(U8 value) { return value < 10 ? ('0' + value) : 'a' + value - 10; }
@@ -557,7 +634,7 @@ std::string NFA::Machine::dumpDFAGraphViz() const
 		for(Uptr classIndex = 0; classIndex < numClasses; ++classIndex)
 		{
 			const InternalStateIndex nextState
-				= stateAndOffsetToNextStateMap[0 + classIndex * numStates];
+				= stateAndOffsetToNextStateMap[classIndex * numStates];
 			CharSet& transitionPredicate = transitions.getOrAdd(nextState, CharSet{});
 			transitionPredicate = classCharSets[classIndex] | transitionPredicate;
 		}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/ParallelFor/ParallelFor.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Intrinsic.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Intrinsics.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/Runtime/RuntimeData.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+enum
+{
+	numStackBytes = 1 * 1024 * 1024,
+
+	// Platform::Event::signal doesn't wake threads that aren't waiting yet, so waits for a job to
+	// be queued or for a job's helpers to finish use this timeout to recheck the condition they are
+	// waiting for.
+	maxPoolWaitMicroseconds = 1000
+};
+
+// The indices that remain to be run by one of a job's participants. The participant takes ranges
+// of indices from the beginning, and other participants that run out of indices steal them from
+// the end. The slots are allocated dynamically, so they are padded rather than aligned to keep
+// different participants' slots out of the same cache line.
+struct JobSlot
+{
+	Platform::Mutex mutex;
+	I64 begin = 0;
+	I64 end = 0;
+	U8 padding[Platform::numCacheLineBytes];
+};
+
+// A call to parallel_for. The calling thread participates using the first slot, and each worker
+// that helps with the job claims one of the other slots.
+struct Job
+{
+	Compartment* compartment;
+	GCPointer<FunctionInstance> function;
+	I64 grain;
+
+	std::unique_ptr<JobSlot[]> slots;
+	Uptr numSlots;
+	std::atomic<Uptr> nextHelperSlotIndex{1};
+	std::atomic<Uptr> numActiveHelpers{0};
+	Platform::Event helperDoneEvent;
+
+	// The first exception thrown by a call to the function, which stops the participants from
+	// starting more calls.
+	std::atomic<bool> failed{false};
+	Platform::Mutex exceptionMutex;
+	std::unique_ptr<Exception> exception;
+};
+
+// The jobs that may still have a slot for a worker to claim.
+static Platform::Mutex jobsMutex;
+static std::vector<Job*> jobs;
+static Platform::Event jobQueuedEvent;
+
+static Platform::Mutex workersMutex;
+static std::atomic<Uptr> numWorkers{0};
+
+DEFINE_INTRINSIC_MODULE(parallelFor);
+
+// Takes the next range of at most grain indices from a slot. Returns false if the slot is empty.
+static bool takeRange(JobSlot& slot, I64 grain, I64& outBegin, I64& outEnd)
+{
+	Lock<Platform::Mutex> slotLock(slot.mutex);
+	if(slot.begin >= slot.end) { return false; }
+	outBegin = slot.begin;
+	outEnd = slot.end - slot.begin > grain ? slot.begin + grain : slot.end;
+	slot.begin = outEnd;
+	return true;
+}
+
+// Moves the second half of another slot's remaining indices into an empty slot. Returns false if
+// all the other slots are empty.
+static bool stealRange(Job& job, Uptr thiefSlotIndex)
+{
+	for(Uptr victimOffset = 1; victimOffset < job.numSlots; ++victimOffset)
+	{
+		JobSlot& victim = job.slots[(thiefSlotIndex + victimOffset) % job.numSlots];
+		I64 stolenBegin;
+		I64 stolenEnd;
+		{
+			Lock<Platform::Mutex> victimLock(victim.mutex);
+			const I64 numRemaining = victim.end - victim.begin;
+			if(numRemaining <= 0) { continue; }
+
+			// Steal half of the victim's remaining ranges, or its last range.
+			const I64 numRemainingRanges = (numRemaining + job.grain - 1) / job.grain;
+			const I64 numStolen
+				= numRemainingRanges > 1 ? numRemainingRanges / 2 * job.grain : numRemaining;
+			stolenEnd = victim.end;
+			stolenBegin = victim.end - numStolen;
+			victim.end = stolenBegin;
+		}
+
+		JobSlot& thief = job.slots[thiefSlotIndex];
+		Lock<Platform::Mutex> thiefLock(thief.mutex);
+		thief.begin = stolenBegin;
+		thief.end = stolenEnd;
+		return true;
+	}
+	return false;
+}
+
+// Calls the job's function for ranges from a slot, and ranges stolen from other slots, until all
+// the job's indices have been taken or a call throws an exception. If context is null, a new
+// context is created in the job's compartment.
+static void runParticipant(Job& job, Uptr slotIndex, Context* context)
+{
+	catchRuntimeExceptions(
+		[&] {
+			GCPointer<Context> helperContext;
+			if(!context)
+			{
+				helperContext = createContext(job.compartment);
+				context = helperContext;
+			}
+
+			I64 rangeBegin;
+			I64 rangeEnd;
+			while(!job.failed.load(std::memory_order_acquire))
+			{
+				if(!takeRange(job.slots[slotIndex], job.grain, rangeBegin, rangeEnd))
+				{
+					if(!stealRange(job, slotIndex)) { break; }
+					continue;
+				}
+
+				UntaggedValue arguments[2] = {I32(rangeBegin), I32(rangeEnd)};
+				invokeFunctionUnchecked(context, job.function, arguments);
+			}
+		},
+		[&](Exception&& exception) {
+			Lock<Platform::Mutex> exceptionLock(job.exceptionMutex);
+			if(!job.exception) { job.exception.reset(new Exception(std::move(exception))); }
+			job.failed.store(true, std::memory_order_release);
+		});
+}
+
+static I64 workerEntry(void*)
+{
+	while(true)
+	{
+		// Claim a slot in a queued job.
+		Job* job = nullptr;
+		Uptr slotIndex = 0;
+		{
+			Lock<Platform::Mutex> jobsLock(jobsMutex);
+			for(Job* queuedJob : jobs)
+			{
+				slotIndex = queuedJob->nextHelperSlotIndex.fetch_add(1, std::memory_order_relaxed);
+				if(slotIndex < queuedJob->numSlots)
+				{
+					// Count the helper before unlocking jobsMutex, so the calling thread can't
+					// dequeue the job and stop waiting for its helpers before counting this one.
+					job = queuedJob;
+					job->numActiveHelpers.fetch_add(1, std::memory_order_acq_rel);
+					break;
+				}
+			}
+		}
+
+		if(!job)
+		{
+			jobQueuedEvent.wait(Platform::getMonotonicClock() + maxPoolWaitMicroseconds);
+			continue;
+		}
+
+		runParticipant(*job, slotIndex, nullptr);
+
+		// Signal the calling thread before decrementing the number of active helpers, since the job
+		// may be freed as soon as it is decremented.
+		job->helperDoneEvent.signal();
+		job->numActiveHelpers.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+// Starts the workers the first time a job is queued, and returns the number of workers.
+static Uptr startWorkers()
+{
+	const Uptr currentNumWorkers = numWorkers.load(std::memory_order_acquire);
+	if(currentNumWorkers) { return currentNumWorkers; }
+
+	Lock<Platform::Mutex> workersLock(workersMutex);
+	if(!numWorkers.load(std::memory_order_relaxed))
+	{
+		const Uptr numHardwareThreads = Platform::getNumberOfHardwareThreads();
+		const Uptr newNumWorkers = numHardwareThreads > 1 ? numHardwareThreads - 1 : 1;
+		for(Uptr workerIndex = 0; workerIndex < newNumWorkers; ++workerIndex)
+		{ Platform::detachThread(Platform::createThread(numStackBytes, workerEntry, nullptr)); }
+		numWorkers.store(newNumWorkers, std::memory_order_release);
+	}
+	return numWorkers.load(std::memory_order_relaxed);
+}
+
+DEFINE_INTRINSIC_FUNCTION(parallelFor,
+						  "parallel_for",
+						  void,
+						  parallel_for,
+						  const AnyFunc* bodyAnyFunc,
+						  I32 begin,
+						  I32 end,
+						  I32 grain)
+{
+	// Validate that the body function is non-null and has the correct type (i32, i32)->()
+	if(!bodyAnyFunc
+	   || IR::FunctionType{bodyAnyFunc->functionTypeEncoding}
+			  != FunctionType(TypeTuple{}, TypeTuple{ValueType::i32, ValueType::i32}))
+	{ throwException(Runtime::Exception::indirectCallSignatureMismatchType); }
+	if(grain <= 0) { throwException(Runtime::Exception::invalidArgumentType); }
+	if(begin >= end) { return; }
+
+	Context* context = getContextFromRuntimeData(contextRuntimeData);
+
+	Job job;
+	job.compartment = getCompartmentFromContext(context);
+	job.function = asFunction(bodyAnyFunc->anyRef.object);
+	job.grain = grain;
+
+	// Divide the ranges evenly between a slot for the calling thread and a slot for each worker.
+	const I64 numRanges = (I64(end) - I64(begin) + grain - 1) / grain;
+	const Uptr maxNumSlots = startWorkers() + 1;
+	job.numSlots = U64(numRanges) < maxNumSlots ? Uptr(numRanges) : maxNumSlots;
+	job.slots.reset(new JobSlot[job.numSlots]);
+	for(Uptr slotIndex = 0; slotIndex < job.numSlots; ++slotIndex)
+	{
+		const I64 firstRange = I64(slotIndex) * numRanges / I64(job.numSlots);
+		const I64 endRange = I64(slotIndex + 1) * numRanges / I64(job.numSlots);
+		job.slots[slotIndex].begin = I64(begin) + firstRange * grain;
+		job.slots[slotIndex].end = std::min(I64(end), I64(begin) + endRange * grain);
+	}
+
+	if(job.numSlots > 1)
+	{
+		{
+			Lock<Platform::Mutex> jobsLock(jobsMutex);
+			jobs.push_back(&job);
+		}
+		for(Uptr slotIndex = 1; slotIndex < job.numSlots; ++slotIndex) { jobQueuedEvent.signal(); }
+	}
+
+	runParticipant(job, 0, context);
+
+	if(job.numSlots > 1)
+	{
+		// Dequeue the job, so no more workers claim its slots, and wait for the workers that
+		// already claimed a slot to finish.
+		{
+			Lock<Platform::Mutex> jobsLock(jobsMutex);
+			jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+		}
+		while(job.numActiveHelpers.load(std::memory_order_acquire))
+		{ job.helperDoneEvent.wait(Platform::getMonotonicClock() + maxPoolWaitMicroseconds); }
+	}
+
+	if(job.exception)
+	{
+		ExceptionTypeInstance* exceptionType = job.exception->typeInstance;
+		std::vector<UntaggedValue> exceptionArguments = std::move(job.exception->arguments);
+		throwException(exceptionType, std::move(exceptionArguments));
+	}
+}
+
+ModuleInstance* ParallelFor::instantiate(Compartment* compartment)
+{
+	return Intrinsics::instantiateModule(
+		compartment, INTRINSIC_MODULE_REF(parallelFor), "parallelFor");
+}
@@ -1,5 +1,12 @@
 #ifndef _WIN32
 
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+// MacOS only declares the ucontext functions if _XOPEN_SOURCE is defined, and only declares its
+// own extensions to the POSIX headers if _DARWIN_C_SOURCE is also defined.
+#define _XOPEN_SOURCE 700
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Config.h"
@@ -34,6 +41,10 @@
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
+#ifndef __WAVIX__
+#include <ucontext.h>
+#endif
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
@@ -55,7 +66,14 @@
 #endif
 
 #ifdef __linux__
+#include <elf.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
 #define MAP_STACK_FLAGS (MAP_STACK)
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
 #else
 #define MAP_STACK_FLAGS 0
 #endif
@@ -263,7 +281,53 @@ U8* Platform::allocateAlignedVirtualPages(Uptr numPages,
 	}
 }
 
-bool Platform::commitVirtualPages(U8* baseVirtualAddress, Uptr numPages, MemoryAccess access)
+#ifdef __linux__
+// The number of NUMA nodes that commitVirtualPages can allocate memory from.
+static constexpr Uptr maxNUMANodes = 1024;
+
+// Reads a list of CPU or NUMA node indices from a sysfs file, in the kernel's list format (e.g.
+// "0-3,8,10-11"). Returns false if the file can't be read.
+static bool readSysfsIndexList(const char* path, std::vector<Uptr>& outIndices)
+{
+	FILE* file = fopen(path, "r");
+	if(!file) { return false; }
+	char buffer[4096];
+	const bool readLine = fgets(buffer, sizeof(buffer), file) != nullptr;
+	fclose(file);
+	if(!readLine) { return false; }
+
+	const char* next = buffer;
+	while(*next >= '0' && *next <= '9')
+	{
+		char* end;
+		const Uptr firstIndex = Uptr(strtoull(next, &end, 10));
+		Uptr lastIndex = firstIndex;
+		if(*end == '-') { lastIndex = Uptr(strtoull(end + 1, &end, 10)); }
+		for(Uptr index = firstIndex; index <= lastIndex; ++index) { outIndices.push_back(index); }
+		next = *end == ',' ? end + 1 : end;
+	}
+	return true;
+}
+
+Uptr Platform::getNumNUMANodes()
+{
+	static const Uptr numNUMANodes = [] {
+		std::vector<Uptr> nodes;
+		if(!readSysfsIndexList("/sys/devices/system/node/online", nodes) || nodes.empty())
+		{ return Uptr(1); }
+		return nodes.back() + 1;
+	}();
+	return numNUMANodes;
+}
+#else
+Uptr Platform::getNumNUMANodes() { return 1; }
+#endif
+
+bool Platform::commitVirtualPages(U8* baseVirtualAddress,
+								  Uptr numPages,
+								  MemoryAccess access,
+								  CommitFlags flags,
+								  Uptr numaNode)
 {
 	errorUnless(isPageAligned(baseVirtualAddress));
 	int result = mprotect(
@@ -278,6 +342,32 @@ bool Platform::commitVirtualPages(U8* baseVirtualAddress, Uptr numPages, MemoryA
 				strerror(errno));
 		dumpErrorCallStack(0);
 	}
+#ifdef MADV_HUGEPAGE
+	else if(flags & CommitFlags::largePages)
+	{
+		// Ask the kernel to back the pages with transparent huge pages. This only affects the
+		// 2MiB-aligned huge pages that are entirely within the committed pages, and is ignored if
+		// transparent huge pages are disabled, so don't treat failure as an error.
+		madvise(baseVirtualAddress, numPages << getPageSizeLog2(), MADV_HUGEPAGE);
+	}
+#endif
+#ifdef __linux__
+	if(result == 0 && numaNode < maxNUMANodes)
+	{
+		// Set the pages' memory policy to prefer the NUMA node, so they are allocated from it when
+		// they are first touched. Like the large page hint, failure isn't treated as an error.
+		constexpr Uptr numBitsPerMaskWord = sizeof(unsigned long) * 8;
+		unsigned long nodeMask[maxNUMANodes / numBitsPerMaskWord] = {};
+		nodeMask[numaNode / numBitsPerMaskWord] |= 1ul << (numaNode % numBitsPerMaskWord);
+		syscall(SYS_mbind,
+				baseVirtualAddress,
+				numPages << getPageSizeLog2(),
+				MPOL_PREFERRED,
+				nodeMask,
+				maxNUMANodes,
+				0);
+	}
+#endif
 	return result == 0;
 }
 
@@ -303,20 +393,62 @@ void Platform::decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	errorUnless(isPageAligned(baseVirtualAddress));
 	auto numBytes = numPages << getPageSizeLog2();
-	if(mprotect(baseVirtualAddress, numBytes, PROT_NONE))
+
+	// Replace the pages with a new anonymous mapping instead of using madvise(MADV_DONTNEED): the
+	// pages may have been mapped copy-on-write from a VirtualPageSnapshot, and MADV_DONTNEED would
+	// revert them to the snapshot's contents instead of zeroing them.
+	if(mmap(baseVirtualAddress,
+			numBytes,
+			PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+			-1,
+			0)
+	   == MAP_FAILED)
 	{
-		Errors::fatalf("mprotect(0x%" PRIxPTR ", %u, PROT_NONE) failed! errno=%s",
+		Errors::fatalf("mmap(0x%" PRIxPTR ", %" PRIuPTR
+					   ", PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) failed! "
+					   "errno=%s",
 					   reinterpret_cast<Uptr>(baseVirtualAddress),
 					   numBytes,
 					   strerror(errno));
 	}
+}
+
+void Platform::resetVirtualPages(U8* baseVirtualAddress, Uptr numPages)
+{
+	errorUnless(isPageAligned(baseVirtualAddress));
+	auto numBytes = numPages << getPageSizeLog2();
+
+#ifdef __linux__
+	// On Linux, MADV_DONTNEED frees the pages of a private anonymous mapping, which are zeroed when
+	// they are next touched. Unlike replacing the mapping, this keeps the pages' memory policy and
+	// huge page hint.
 	if(madvise(baseVirtualAddress, numBytes, MADV_DONTNEED))
 	{
-		Errors::fatalf("madvise(0x%" PRIxPTR ", %u, MADV_DONTNEED) failed! errno=%s",
+		Errors::fatalf("madvise(0x%" PRIxPTR ", %" PRIuPTR ", MADV_DONTNEED) failed! errno=%s",
 					   reinterpret_cast<Uptr>(baseVirtualAddress),
 					   numBytes,
 					   strerror(errno));
 	}
+#else
+	// Other POSIX systems don't guarantee that MADV_DONTNEED zeroes the pages, so replace them with
+	// a new anonymous mapping.
+	if(mmap(baseVirtualAddress,
+			numBytes,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+			-1,
+			0)
+	   == MAP_FAILED)
+	{
+		Errors::fatalf("mmap(0x%" PRIxPTR ", %" PRIuPTR
+					   ", PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) "
+					   "failed! errno=%s",
+					   reinterpret_cast<Uptr>(baseVirtualAddress),
+					   numBytes,
+					   strerror(errno));
+	}
+#endif
 }
 
 void Platform::freeVirtualPages(U8* baseVirtualAddress, Uptr numPages)
@@ -343,241 +475,997 @@ void Platform::freeAlignedVirtualPages(U8* unalignedBaseAddress, Uptr numPages,
 	}
 }
 
-bool Platform::describeInstructionPointer(Uptr ip, std::string& outDescription)
-{
-#if WAVM_ENABLE_RUNTIME
-	// Look up static symbol information for the address.
-	Dl_info symbolInfo;
-	if(dladdr((void*)(ip - 1), &symbolInfo))
-	{
-		wavmAssert(symbolInfo.dli_fname);
-		outDescription = "host!";
-		outDescription += symbolInfo.dli_fname;
-		outDescription += '!';
-		if(!symbolInfo.dli_sname) { outDescription += "<unknown>"; }
-		else
-		{
-			char demangledBuffer[1024];
-			const char* demangledSymbolName = symbolInfo.dli_sname;
-			if(symbolInfo.dli_sname[0] == '_')
-			{
-				Uptr numDemangledChars = sizeof(demangledBuffer);
-				I32 demangleStatus = 0;
-				if(abi::__cxa_demangle(symbolInfo.dli_sname,
-									   demangledBuffer,
-									   (size_t*)&numDemangledChars,
-									   &demangleStatus))
-				{ demangledSymbolName = demangledBuffer; }
-			}
-			outDescription += demangledSymbolName;
-			outDescription += '+';
-			outDescription += std::to_string(ip - reinterpret_cast<Uptr>(symbolInfo.dli_saddr));
-		}
-		return true;
-	}
-#endif
-	return false;
-}
-
-static void getCurrentThreadStack(U8*& outMinAddr, U8*& outMaxAddr)
+Uptr Platform::getPeakResidentBytes()
 {
-	// Get the stack address from pthreads, but use getrlimit to find the maximum size of the stack
-	// instead of the current.
-	struct rlimit stackLimit;
-	getrlimit(RLIMIT_STACK, &stackLimit);
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage)) { return 0; }
 
-#ifdef __linux__
-	// Linux uses pthread_getattr_np/pthread_attr_getstack, and returns a pointer to the minimum
-	// address of the stack.
-	pthread_attr_t threadAttributes;
-	memset(&threadAttributes, 0, sizeof(threadAttributes));
-	pthread_getattr_np(pthread_self(), &threadAttributes);
-	Uptr numStackBytes;
-	pthread_attr_getstack(&threadAttributes, (void**)&outMinAddr, &numStackBytes);
-	pthread_attr_destroy(&threadAttributes);
-	outMaxAddr = outMinAddr + numStackBytes;
-#elif defined(__APPLE__)
-	// MacOS uses pthread_get_stackaddr_np, and returns a pointer to the maximum address of the
-	// stack.
-	outMaxAddr = (U8*)pthread_get_stackaddr_np(pthread_self());
-#elif defined(__WAVIX__)
-	Errors::fatal("getCurrentThreadStack is unimplemented on Wavix.");
+	// Linux reports the maximum resident set size in kilobytes, and MacOS in bytes.
+#ifdef __APPLE__
+	return Uptr(usage.ru_maxrss);
 #else
-#error unsupported platform
+	return Uptr(usage.ru_maxrss) * 1024;
 #endif
-
-	outMinAddr = outMaxAddr - stackLimit.rlim_cur;
 }
 
-struct SignalContext
+#ifdef __linux__
+struct Platform::VirtualPageSnapshot
 {
-	SignalContext* outerContext;
-	jmp_buf catchJump;
-	std::function<bool(Platform::Signal, const Platform::CallStack&)> filter;
+	int fd;
+	Uptr numPages;
+	std::atomic<Uptr> numRefs;
+
+	VirtualPageSnapshot(int inFD, Uptr inNumPages) : fd(inFD), numPages(inNumPages), numRefs(1) {}
 };
 
-// Define a unique_ptr to a Platform::Event.
-struct SigAltStack
+static bool writeSnapshotFile(int fd, Uptr offset, const U8* data, Uptr numBytes)
 {
-	enum
+	Uptr numBytesWritten = 0;
+	while(numBytesWritten < numBytes)
 	{
-		numBytes = 65536
-	};
+		const ssize_t result = pwrite(
+			fd, data + numBytesWritten, numBytes - numBytesWritten, off_t(offset + numBytesWritten));
+		if(result > 0) { numBytesWritten += Uptr(result); }
+		else if(result == 0 || errno != EINTR)
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-	U8* base = nullptr;
+VirtualPageSnapshot* Platform::createVirtualPageSnapshot(Uptr numPages)
+{
+	// Create an anonymous in-memory file that is large enough to hold the pages. The file is
+	// sparse, so it only uses physical memory for the parts of it that are written or accessed.
+	const int fd = int(syscall(SYS_memfd_create, "wavm-page-snapshot", MFD_CLOEXEC));
+	if(fd < 0) { return nullptr; }
 
-	~SigAltStack()
+	if(ftruncate(fd, off_t(numPages << getPageSizeLog2())))
 	{
-		if(base)
-		{
-			// Disable the sig alt stack.
-			// According to the docs, ss_size is ignored if SS_DISABLE is set, but MacOS returns an
-			// ENOMEM error if ss_size is too small regardless of whether SS_DISABLE is set.
-			stack_t disableAltStack;
-			memset(&disableAltStack, 0, sizeof(stack_t));
-			disableAltStack.ss_flags = SS_DISABLE;
-			disableAltStack.ss_size = SigAltStack::numBytes;
-			errorUnless(!sigaltstack(&disableAltStack, nullptr));
-
-			// Free the alt stack's memory.
-			errorUnless(!munmap(base, SigAltStack::numBytes));
-			base = nullptr;
-		}
+		close(fd);
+		return nullptr;
 	}
+	return new VirtualPageSnapshot(fd, numPages);
+}
 
-	void init()
+bool Platform::writeVirtualPageSnapshot(VirtualPageSnapshot* snapshot,
+										Uptr offset,
+										const U8* data,
+										Uptr numBytes)
+{
+	wavmAssert(offset <= (snapshot->numPages << getPageSizeLog2()));
+	wavmAssert(numBytes <= (snapshot->numPages << getPageSizeLog2()) - offset);
+	return writeSnapshotFile(snapshot->fd, offset, data, numBytes);
+}
+
+static VirtualPageSnapshot* createSnapshotOfPages(U8* baseVirtualAddress, Uptr numPages)
+{
+	// Create a snapshot, and copy the contents of the pages into it.
+	VirtualPageSnapshot* snapshot = createVirtualPageSnapshot(numPages);
+	if(snapshot
+	   && !writeSnapshotFile(snapshot->fd, 0, baseVirtualAddress, numPages << getPageSizeLog2()))
 	{
-		if(!base)
-		{
-			// Allocate a stack to use when handling signals, so stack overflow can be handled
-			// safely.
-			base = (U8*)mmap(nullptr,
-							 SigAltStack::numBytes,
-							 PROT_READ | PROT_WRITE,
-							 MAP_PRIVATE | MAP_ANONYMOUS,
-							 -1,
-							 0);
-			errorUnless(base != MAP_FAILED);
-			stack_t sigAltStackInfo;
-			sigAltStackInfo.ss_size = SigAltStack::numBytes;
-			sigAltStackInfo.ss_sp = base;
-			sigAltStackInfo.ss_flags = 0;
-			errorUnless(!sigaltstack(&sigAltStackInfo, nullptr));
-		}
+		releaseVirtualPageSnapshot(snapshot);
+		return nullptr;
 	}
-};
+	return snapshot;
+}
 
-struct PlatformException
+static bool mapSnapshotPages(VirtualPageSnapshot* snapshot, U8* baseVirtualAddress)
 {
-	void* data;
-	CallStack callStack;
-};
+	// Map the snapshot MAP_PRIVATE, so writes to the pages copy them instead of modifying the
+	// snapshot.
+	return mmap(baseVirtualAddress,
+				snapshot->numPages << getPageSizeLog2(),
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED,
+				snapshot->fd,
+				0)
+		   != MAP_FAILED;
+}
 
-static thread_local SigAltStack sigAltStack;
-static thread_local SignalContext* innermostSignalContext = nullptr;
-static std::atomic<SignalHandler> portableSignalHandler;
+bool Platform::mapVirtualPageSnapshot(VirtualPageSnapshot* snapshot, U8* baseVirtualAddress)
+{
+	errorUnless(isPageAligned(baseVirtualAddress));
+	if(!mapSnapshotPages(snapshot, baseVirtualAddress)) { return false; }
 
-static void deliverSignal(Signal signal, const CallStack& callStack)
+	++snapshot->numRefs;
+	return true;
+}
+
+static bool arePagesUnmodifiedSnapshotPages(U8* baseVirtualAddress, Uptr numPages)
 {
-	// Call the signal handlers, from innermost to outermost, until one returns true.
-	for(SignalContext* signalContext = innermostSignalContext; signalContext;
-		signalContext = signalContext->outerContext)
+	// When a page that is mapped MAP_PRIVATE from a snapshot is written, it is replaced by an
+	// anonymous copy of the page. /proc/self/pagemap reports such pages as present or swapped,
+	// but not file-backed.
+	const int pagemapFD = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if(pagemapFD < 0) { return false; }
+
+	static constexpr Uptr numEntriesPerRead = 512;
+	static constexpr U64 presentOrSwappedMask = 3ull << 62;
+	static constexpr U64 fileOrSharedMask = 1ull << 61;
+
+	U64 entries[numEntriesPerRead];
+	const Uptr basePageIndex = reinterpret_cast<Uptr>(baseVirtualAddress) >> getPageSizeLog2();
+	bool isUnmodified = true;
+	for(Uptr pageIndex = 0; isUnmodified && pageIndex < numPages; pageIndex += numEntriesPerRead)
 	{
-		if(signalContext->filter(signal, callStack))
+		const Uptr numEntries = std::min(numEntriesPerRead, numPages - pageIndex);
+		const ssize_t numBytes = ssize_t(numEntries * sizeof(U64));
+		if(pread(pagemapFD, entries, numBytes, off_t((basePageIndex + pageIndex) * sizeof(U64)))
+		   != numBytes)
 		{
-			// Jump back to the execution context that was saved in catchSignals.
-			siglongjmp(signalContext->catchJump, 1);
+			isUnmodified = false;
+			break;
+		}
+
+		for(Uptr entryIndex = 0; entryIndex < numEntries; ++entryIndex)
+		{
+			if((entries[entryIndex] & presentOrSwappedMask)
+			   && !(entries[entryIndex] & fileOrSharedMask))
+			{
+				isUnmodified = false;
+				break;
+			}
 		}
 	}
 
-	// If the signal wasn't handled by a catchSignals call, call the portable signal handler.
-	SignalHandler portableSignalHandlerSnapshot = portableSignalHandler.load();
-	if(portableSignalHandlerSnapshot) { portableSignalHandlerSnapshot(signal, callStack); }
+	close(pagemapFD);
+	return isUnmodified;
 }
 
-[[noreturn]] static void signalHandler(int signalNumber, siginfo_t* signalInfo, void*)
+bool Platform::cloneVirtualPagesCopyOnWrite(U8* sourceBaseAddress,
+											U8* destBaseAddress,
+											Uptr numPages,
+											VirtualPageSnapshot* sourceSnapshot,
+											VirtualPageSnapshot*& outDestSnapshot)
 {
-	Signal signal;
-
-	// Derive the exception cause the from signal that was received.
-	switch(signalNumber)
-	{
-	case SIGFPE:
-		if(signalInfo->si_code != FPE_INTDIV && signalInfo->si_code != FPE_INTOVF)
-		{ Errors::fatal("unknown SIGFPE code"); }
-		signal.type = Signal::Type::intDivideByZeroOrOverflow;
-		break;
-	case SIGSEGV:
-	case SIGBUS:
+	errorUnless(isPageAligned(sourceBaseAddress));
+	errorUnless(isPageAligned(destBaseAddress));
+
+	// If the source pages are mapped from a snapshot and haven't been written since, the snapshot
+	// can be shared with the destination pages without copying them. Otherwise, copy the source
+	// pages into a new snapshot that only the destination pages are mapped from. The source pages
+	// are never remapped, so writes to them by other threads while they are cloned aren't lost.
+	VirtualPageSnapshot* snapshot = sourceSnapshot;
+	if(snapshot && snapshot->numPages == numPages
+	   && arePagesUnmodifiedSnapshotPages(sourceBaseAddress, numPages))
+	{ ++snapshot->numRefs; }
+	else
 	{
-		// Determine whether the faulting address was an address reserved by the stack.
-		U8* stackMinAddr;
-		U8* stackMaxAddr;
-		getCurrentThreadStack(stackMinAddr, stackMaxAddr);
-		stackMinAddr -= sysconf(_SC_PAGESIZE);
-		signal.type = signalInfo->si_addr >= stackMinAddr && signalInfo->si_addr < stackMaxAddr
-						  ? Signal::Type::stackOverflow
-						  : Signal::Type::accessViolation;
-		signal.accessViolation.address = reinterpret_cast<Uptr>(signalInfo->si_addr);
-		break;
+		snapshot = createSnapshotOfPages(sourceBaseAddress, numPages);
+		if(!snapshot) { return false; }
 	}
-	default: Errors::fatalf("unknown signal number: %i", signalNumber); break;
-	};
 
-	// Capture the execution context, omitting this function and the function that called it, so the
-	// top of the callstack is the function that triggered the signal.
-	CallStack callStack = captureCallStack(2);
+	if(!mapSnapshotPages(snapshot, destBaseAddress))
+	{
+		releaseVirtualPageSnapshot(snapshot);
+		return false;
+	}
 
-	deliverSignal(signal, callStack);
+	outDestSnapshot = snapshot;
+	return true;
+}
 
-	switch(signalNumber)
+void Platform::releaseVirtualPageSnapshot(VirtualPageSnapshot* snapshot)
+{
+	if(--snapshot->numRefs == 0)
 	{
-	case SIGFPE: Errors::fatalf("unhandled SIGFPE\n");
-	case SIGSEGV: Errors::fatalf("unhandled SIGSEGV\n");
-	case SIGBUS: Errors::fatalf("unhandled SIGBUS\n");
-	default: Errors::unreachable();
-	};
+		close(snapshot->fd);
+		delete snapshot;
+	}
 }
+#else
+struct Platform::VirtualPageSnapshot
+{
+};
 
-static void initSignals()
+bool Platform::cloneVirtualPagesCopyOnWrite(U8* sourceBaseAddress,
+											U8* destBaseAddress,
+											Uptr numPages,
+											VirtualPageSnapshot* sourceSnapshot,
+											VirtualPageSnapshot*& outDestSnapshot)
 {
-	static bool hasInitializedSignalHandlers = false;
-	if(!hasInitializedSignalHandlers)
-	{
-		hasInitializedSignalHandlers = true;
+	return false;
+}
 
-		// Set up a signal mask for the signals we handle that will disable them inside the handler.
-		struct sigaction signalAction;
-		sigemptyset(&signalAction.sa_mask);
-		sigaddset(&signalAction.sa_mask, SIGFPE);
-		sigaddset(&signalAction.sa_mask, SIGSEGV);
-		sigaddset(&signalAction.sa_mask, SIGBUS);
+VirtualPageSnapshot* Platform::createVirtualPageSnapshot(Uptr numPages) { return nullptr; }
 
-		// Set the signal handler for the signals we want to intercept.
-		signalAction.sa_sigaction = signalHandler;
-		signalAction.sa_flags = SA_SIGINFO | SA_ONSTACK;
-		sigaction(SIGSEGV, &signalAction, nullptr);
-		sigaction(SIGBUS, &signalAction, nullptr);
-		sigaction(SIGFPE, &signalAction, nullptr);
-	}
+bool Platform::writeVirtualPageSnapshot(VirtualPageSnapshot* snapshot,
+										Uptr offset,
+										const U8* data,
+										Uptr numBytes)
+{
+	Errors::unreachable();
 }
 
-bool Platform::catchSignals(const std::function<void()>& thunk,
-							const std::function<bool(Signal, const CallStack&)>& filter)
+bool Platform::mapVirtualPageSnapshot(VirtualPageSnapshot* snapshot, U8* baseVirtualAddress)
 {
-	initSignals();
-	sigAltStack.init();
+	Errors::unreachable();
+}
 
-	SignalContext signalContext;
-	signalContext.outerContext = innermostSignalContext;
-	signalContext.filter = filter;
+void Platform::releaseVirtualPageSnapshot(VirtualPageSnapshot* snapshot)
+{
+	Errors::unreachable();
+}
+#endif
 
-#ifdef __WAVIX__
-	Errors::fatal("catchSignals is unimplemented on Wavix");
-#else
-	// Use sigsetjmp to capture the execution state into the signal context. If a signal is raised,
-	// the signal handler will jump back to here.
-	bool isReturningFromSignalHandler = sigsetjmp(signalContext.catchJump, 1) != 0;
+#ifdef __linux__
+// The dirty bits are the soft-dirty bits of the process's pagemap entries, which are cleared for
+// all of the process's pages by writing 4 to /proc/self/clear_refs.
+static constexpr U64 pagemapSoftDirtyBit = U64(1) << 55;
+
+static bool clearSoftDirtyBits()
+{
+	const int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+	if(fd < 0) { return false; }
+	const bool succeeded = write(fd, "4", 1) == 1;
+	close(fd);
+	return succeeded;
+}
+
+static bool readSoftDirtyBits(const U8* baseVirtualAddress, Uptr numPages, U64* outDirtyBits)
+{
+	errorUnless(isPageAligned(const_cast<U8*>(baseVirtualAddress)));
+	memset(outDirtyBits, 0, ((numPages + 63) / 64) * sizeof(U64));
+
+	const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if(fd < 0) { return false; }
+
+	// Read the pagemap entries for the pages in chunks, so the entries for a large range of pages
+	// don't need to be buffered at once.
+	static constexpr Uptr numChunkEntries = 512;
+	U64 entries[numChunkEntries];
+	const Uptr basePageIndex = reinterpret_cast<Uptr>(baseVirtualAddress) >> getPageSizeLog2();
+	bool succeeded = true;
+	for(Uptr pageIndex = 0; pageIndex < numPages; pageIndex += numChunkEntries)
+	{
+		const Uptr numEntries = std::min(numChunkEntries, numPages - pageIndex);
+		const Uptr numEntryBytes = numEntries * sizeof(U64);
+		if(pread(fd, entries, numEntryBytes, off_t((basePageIndex + pageIndex) * sizeof(U64)))
+		   != ssize_t(numEntryBytes))
+		{
+			succeeded = false;
+			break;
+		}
+
+		for(Uptr entryIndex = 0; entryIndex < numEntries; ++entryIndex)
+		{
+			if(entries[entryIndex] & pagemapSoftDirtyBit)
+			{
+				const Uptr dirtyPageIndex = pageIndex + entryIndex;
+				outDirtyBits[dirtyPageIndex / 64] |= U64(1) << (dirtyPageIndex % 64);
+			}
+		}
+	}
+	close(fd);
+	return succeeded;
+}
+
+// A kernel without soft-dirty page tracking accepts the request to clear the bits, but never sets
+// them, so test whether a page's bit is set when it is written after clearing it.
+static bool testSoftDirtyBits()
+{
+	U8* page = allocateVirtualPages(1);
+	if(!page) { return false; }
+
+	bool isSupported = false;
+	if(commitVirtualPages(page, 1))
+	{
+		U64 dirtyBits = 0;
+		*(volatile U8*)page = 1;
+		if(clearSoftDirtyBits() && readSoftDirtyBits(page, 1, &dirtyBits) && !dirtyBits)
+		{
+			*(volatile U8*)page = 2;
+			isSupported = readSoftDirtyBits(page, 1, &dirtyBits) && dirtyBits;
+		}
+		decommitVirtualPages(page, 1);
+	}
+	freeVirtualPages(page, 1);
+	return isSupported;
+}
+
+// Whether the soft-dirty bits are acquired by a tracker.
+static std::atomic<bool> isSoftDirtyTrackingAcquired{false};
+
+bool Platform::isVirtualPageDirtyTrackingSupported()
+{
+	static const bool isSupported = testSoftDirtyBits();
+	return isSupported;
+}
+
+bool Platform::acquireVirtualPageDirtyTracking()
+{
+	if(!isVirtualPageDirtyTrackingSupported()) { return false; }
+	return !isSoftDirtyTrackingAcquired.exchange(true, std::memory_order_acquire);
+}
+
+void Platform::releaseVirtualPageDirtyTracking()
+{
+	wavmAssert(isSoftDirtyTrackingAcquired.load(std::memory_order_relaxed));
+	isSoftDirtyTrackingAcquired.store(false, std::memory_order_release);
+}
+
+void Platform::clearVirtualPageDirtyBits()
+{
+	wavmAssert(isSoftDirtyTrackingAcquired.load(std::memory_order_relaxed));
+	if(!clearSoftDirtyBits())
+	{ Errors::fatalf("Failed to clear the soft-dirty bits: errno=%s", strerror(errno)); }
+}
+
+bool Platform::readVirtualPageDirtyBits(const U8* baseVirtualAddress,
+										Uptr numPages,
+										U64* outDirtyBits)
+{
+	wavmAssert(isSoftDirtyTrackingAcquired.load(std::memory_order_relaxed));
+	return readSoftDirtyBits(baseVirtualAddress, numPages, outDirtyBits);
+}
+#else
+bool Platform::isVirtualPageDirtyTrackingSupported() { return false; }
+
+bool Platform::acquireVirtualPageDirtyTracking() { return false; }
+
+void Platform::releaseVirtualPageDirtyTracking() { Errors::unreachable(); }
+
+void Platform::clearVirtualPageDirtyBits() { Errors::unreachable(); }
+
+bool Platform::readVirtualPageDirtyBits(const U8* baseVirtualAddress,
+										Uptr numPages,
+										U64* outDirtyBits)
+{
+	Errors::unreachable();
+}
+#endif
+
+#ifdef __linux__
+bool Platform::allocateDualMappedPages(Uptr numPages, U8*& outWritableBaseAddress)
+{
+	const Uptr numBytes = numPages << getPageSizeLog2();
+
+	// Reserve the addresses for both views, so they are adjacent.
+	U8* baseAddress = allocateVirtualPages(numPages * 2);
+	if(!baseAddress) { return false; }
+
+	// Map both views from an anonymous in-memory file. The mappings keep the file alive after it
+	// is closed, and the file's memory is freed when both views are decommitted or freed. The
+	// executable mapping fails if the OS doesn't allow executing memory-backed files.
+	bool mapped = false;
+	const int fd = int(syscall(SYS_memfd_create, "wavm-code", MFD_CLOEXEC));
+	if(fd >= 0)
+	{
+		mapped = !ftruncate(fd, off_t(numBytes))
+				 && mmap(baseAddress,
+						 numBytes,
+						 PROT_READ | PROT_WRITE,
+						 MAP_SHARED | MAP_FIXED,
+						 fd,
+						 0)
+						!= MAP_FAILED
+				 && mmap(baseAddress + numBytes,
+						 numBytes,
+						 PROT_READ | PROT_EXEC,
+						 MAP_SHARED | MAP_FIXED,
+						 fd,
+						 0)
+						!= MAP_FAILED;
+		close(fd);
+	}
+	if(!mapped)
+	{
+		freeVirtualPages(baseAddress, numPages * 2);
+		return false;
+	}
+
+	outWritableBaseAddress = baseAddress;
+	return true;
+}
+#else
+bool Platform::allocateDualMappedPages(Uptr numPages, U8*& outWritableBaseAddress)
+{
+	return false;
+}
+#endif
+
+bool Platform::describeInstructionPointer(Uptr ip, std::string& outDescription)
+{
+#if WAVM_ENABLE_RUNTIME
+	// Look up static symbol information for the address.
+	Dl_info symbolInfo;
+	if(dladdr((void*)(ip - 1), &symbolInfo))
+	{
+		wavmAssert(symbolInfo.dli_fname);
+		outDescription = "host!";
+		outDescription += symbolInfo.dli_fname;
+		outDescription += '!';
+		if(!symbolInfo.dli_sname) { outDescription += "<unknown>"; }
+		else
+		{
+			char demangledBuffer[1024];
+			const char* demangledSymbolName = symbolInfo.dli_sname;
+			if(symbolInfo.dli_sname[0] == '_')
+			{
+				Uptr numDemangledChars = sizeof(demangledBuffer);
+				I32 demangleStatus = 0;
+				if(abi::__cxa_demangle(symbolInfo.dli_sname,
+									   demangledBuffer,
+									   (size_t*)&numDemangledChars,
+									   &demangleStatus))
+				{ demangledSymbolName = demangledBuffer; }
+			}
+			outDescription += demangledSymbolName;
+			outDescription += '+';
+			outDescription += std::to_string(ip - reinterpret_cast<Uptr>(symbolInfo.dli_saddr));
+		}
+		return true;
+	}
+#endif
+	return false;
+}
+
+// The profiler outputs opened by setJITProfilerOutput. The mutex serializes writes to them by
+// threads that register JIT functions concurrently.
+static Platform::Mutex jitProfilerOutputMutex;
+static std::atomic<bool> isJITProfilerOutputEnabledFlag{false};
+static FILE* perfMapFile = nullptr;
+
+#ifdef __linux__
+// The jitdump format is specified by tools/perf/Documentation/jitdump-specification.txt in the
+// Linux source tree.
+struct JITDumpHeader
+{
+	U32 magic;
+	U32 version;
+	U32 numBytes;
+	U32 elfMachine;
+	U32 padding;
+	U32 pid;
+	U64 timestamp;
+	U64 flags;
+};
+
+struct JITDumpRecordHeader
+{
+	U32 id;
+	U32 numBytes;
+	U64 timestamp;
+};
+
+// A JIT_CODE_LOAD record is followed by the function's null-terminated name and its code.
+struct JITDumpCodeLoadRecord
+{
+	JITDumpRecordHeader header;
+	U32 pid;
+	U32 tid;
+	U64 virtualAddress;
+	U64 codeAddress;
+	U64 numCodeBytes;
+	U64 codeIndex;
+};
+
+// A JIT_CODE_DEBUG_INFO record is followed by numEntries entries, each of which is followed by its
+// null-terminated source file name.
+struct JITDumpDebugInfoRecord
+{
+	JITDumpRecordHeader header;
+	U64 codeAddress;
+	U64 numEntries;
+};
+
+struct JITDumpDebugEntry
+{
+	U64 codeAddress;
+	U32 line;
+	U32 discriminator;
+};
+
+enum : U32
+{
+	jitDumpCodeLoadRecordId = 0,
+	jitDumpDebugInfoRecordId = 2,
+};
+
+static FILE* jitDumpFile = nullptr;
+static U64 nextJITDumpCodeIndex = 0;
+
+// jitdump timestamps must use the clock that "perf record -k 1" uses for its samples.
+static U64 getJITDumpTimestamp()
+{
+	timespec monotonicClock;
+	clock_gettime(CLOCK_MONOTONIC, &monotonicClock);
+	return U64(monotonicClock.tv_sec) * 1000000000 + U64(monotonicClock.tv_nsec);
+}
+
+static FILE* openJITDumpFile()
+{
+	const std::string filename = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+	const int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0666);
+	if(fd == -1) { return nullptr; }
+
+	// perf finds the jitdump file by recording an executable mapping of it. The mapping is never
+	// unmapped, so it's in the profile no matter when perf starts recording.
+	if(mmap(nullptr, Uptr(1) << getPageSizeLog2(), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0)
+	   == MAP_FAILED)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	FILE* file = fdopen(fd, "wb");
+	if(!file)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	JITDumpHeader header;
+	header.magic = 0x4A695444;
+	header.version = 1;
+	header.numBytes = sizeof(JITDumpHeader);
+#if defined(__x86_64__)
+	header.elfMachine = EM_X86_64;
+#elif defined(__aarch64__)
+	header.elfMachine = EM_AARCH64;
+#elif defined(__i386__)
+	header.elfMachine = EM_386;
+#elif defined(__arm__)
+	header.elfMachine = EM_ARM;
+#else
+	header.elfMachine = EM_NONE;
+#endif
+	header.padding = 0;
+	header.pid = U32(getpid());
+	header.timestamp = getJITDumpTimestamp();
+	header.flags = 0;
+	fwrite(&header, sizeof(header), 1, file);
+	fflush(file);
+	return file;
+}
+
+static void writeJITDumpRecords(const std::string& name,
+								Uptr baseAddress,
+								Uptr numBytes,
+								const std::vector<JITFunctionLine>& lines)
+{
+	const U64 timestamp = getJITDumpTimestamp();
+
+	// The debug info for a function must precede its code load record.
+	if(lines.size())
+	{
+		JITDumpDebugInfoRecord debugInfo;
+		debugInfo.header.id = jitDumpDebugInfoRecordId;
+		debugInfo.header.numBytes
+			= U32(sizeof(debugInfo)
+				  + lines.size() * (sizeof(JITDumpDebugEntry) + name.size() + 1));
+		debugInfo.header.timestamp = timestamp;
+		debugInfo.codeAddress = baseAddress;
+		debugInfo.numEntries = lines.size();
+		fwrite(&debugInfo, sizeof(debugInfo), 1, jitDumpFile);
+		for(const JITFunctionLine& line : lines)
+		{
+			JITDumpDebugEntry entry;
+			entry.codeAddress = baseAddress + line.offset;
+			entry.line = line.line;
+			entry.discriminator = 0;
+			fwrite(&entry, sizeof(entry), 1, jitDumpFile);
+			fwrite(name.c_str(), name.size() + 1, 1, jitDumpFile);
+		}
+	}
+
+	JITDumpCodeLoadRecord codeLoad;
+	codeLoad.header.id = jitDumpCodeLoadRecordId;
+	codeLoad.header.numBytes = U32(sizeof(codeLoad) + name.size() + 1 + numBytes);
+	codeLoad.header.timestamp = timestamp;
+	codeLoad.pid = U32(getpid());
+	codeLoad.tid = U32(syscall(SYS_gettid));
+	codeLoad.virtualAddress = baseAddress;
+	codeLoad.codeAddress = baseAddress;
+	codeLoad.numCodeBytes = numBytes;
+	codeLoad.codeIndex = nextJITDumpCodeIndex++;
+	fwrite(&codeLoad, sizeof(codeLoad), 1, jitDumpFile);
+	fwrite(name.c_str(), name.size() + 1, 1, jitDumpFile);
+	fwrite(reinterpret_cast<const void*>(baseAddress), numBytes, 1, jitDumpFile);
+	fflush(jitDumpFile);
+}
+#endif
+
+bool Platform::setJITProfilerOutput(bool perfMap, bool jitDump)
+{
+	Lock<Platform::Mutex> outputLock(jitProfilerOutputMutex);
+
+	if(perfMap && !perfMapFile)
+	{
+		const std::string filename = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+		perfMapFile = fopen(filename.c_str(), "we");
+		if(!perfMapFile) { return false; }
+	}
+
+	if(jitDump)
+	{
+#ifdef __linux__
+		if(!jitDumpFile)
+		{
+			jitDumpFile = openJITDumpFile();
+			if(!jitDumpFile) { return false; }
+		}
+#else
+		return false;
+#endif
+	}
+
+	if(perfMap || jitDump) { isJITProfilerOutputEnabledFlag.store(true); }
+	return true;
+}
+
+bool Platform::isJITProfilerOutputEnabled() { return isJITProfilerOutputEnabledFlag.load(); }
+
+void Platform::registerJITFunction(const std::string& name,
+								   Uptr baseAddress,
+								   Uptr numBytes,
+								   const std::vector<JITFunctionLine>& lines)
+{
+	if(!isJITProfilerOutputEnabledFlag.load()) { return; }
+
+	Lock<Platform::Mutex> outputLock(jitProfilerOutputMutex);
+	if(perfMapFile)
+	{
+		fprintf(perfMapFile, "%" PRIxPTR " %" PRIxPTR " %s\n", baseAddress, numBytes, name.c_str());
+		fflush(perfMapFile);
+	}
+#ifdef __linux__
+	if(jitDumpFile) { writeJITDumpRecords(name, baseAddress, numBytes, lines); }
+#endif
+}
+
+static void getCurrentThreadStack(U8*& outMinAddr, U8*& outMaxAddr)
+{
+	// Get the stack address from pthreads, but use getrlimit to find the maximum size of the stack
+	// instead of the current.
+	struct rlimit stackLimit;
+	getrlimit(RLIMIT_STACK, &stackLimit);
+
+#ifdef __linux__
+	// Linux uses pthread_getattr_np/pthread_attr_getstack, and returns a pointer to the minimum
+	// address of the stack.
+	pthread_attr_t threadAttributes;
+	memset(&threadAttributes, 0, sizeof(threadAttributes));
+	pthread_getattr_np(pthread_self(), &threadAttributes);
+	Uptr numStackBytes;
+	pthread_attr_getstack(&threadAttributes, (void**)&outMinAddr, &numStackBytes);
+	pthread_attr_destroy(&threadAttributes);
+	outMaxAddr = outMinAddr + numStackBytes;
+#elif defined(__APPLE__)
+	// MacOS uses pthread_get_stackaddr_np, and returns a pointer to the maximum address of the
+	// stack.
+	outMaxAddr = (U8*)pthread_get_stackaddr_np(pthread_self());
+#elif defined(__WAVIX__)
+	Errors::fatal("getCurrentThreadStack is unimplemented on Wavix.");
+#else
+#error unsupported platform
+#endif
+
+	outMinAddr = outMaxAddr - stackLimit.rlim_cur;
+}
+
+struct SignalContext
+{
+	SignalContext* outerContext;
+	jmp_buf catchJump;
+	FunctionRef<bool(Platform::Signal, const Platform::CallStack&)> filter;
+
+	// An address in the frame of the catchSignals call: the frames of the functions it calls are
+	// all below it on the stack.
+	U8* stackMaxAddr;
+};
+
+// Thread stacks and signal stacks are cached when their thread exits, and reused by threads that
+// are created later with the same stack size, so creating a thread doesn't need to map a stack.
+struct CachedStack
+{
+	U8* base;
+	Uptr numBytes;
+};
+
+static Platform::Mutex stackCacheMutex;
+static std::vector<CachedStack> cachedStacks;
+static Uptr numCachedStackBytes = 0;
+static Uptr maxCachedStackBytes = 64 * 1024 * 1024;
+
+// Maps numBytes of stack, or reuses a cached stack of the same size. If hasGuardPage is true, the
+// lowest page of the stack is a guard page, which is included in numBytes.
+static U8* allocateStack(Uptr numBytes, bool hasGuardPage)
+{
+	{
+		Lock<Platform::Mutex> stackCacheLock(stackCacheMutex);
+		for(Uptr stackIndex = 0; stackIndex < cachedStacks.size(); ++stackIndex)
+		{
+			if(cachedStacks[stackIndex].numBytes == numBytes)
+			{
+				U8* base = cachedStacks[stackIndex].base;
+				cachedStacks[stackIndex] = cachedStacks.back();
+				cachedStacks.pop_back();
+				numCachedStackBytes -= numBytes;
+				return base;
+			}
+		}
+	}
+
+	U8* base = (U8*)mmap(nullptr,
+						 numBytes,
+						 PROT_READ | PROT_WRITE,
+						 MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK_FLAGS,
+						 -1,
+						 0);
+	errorUnless(base != MAP_FAILED);
+	if(hasGuardPage) { errorUnless(!mprotect(base, sysconf(_SC_PAGESIZE), PROT_NONE)); }
+	return base;
+}
+
+// Caches a stack allocated by allocateStack if there is room in the cache, or unmaps it. The stack
+// must no longer be used by any thread.
+static void freeStack(U8* base, Uptr numBytes)
+{
+	{
+		Lock<Platform::Mutex> stackCacheLock(stackCacheMutex);
+		if(numCachedStackBytes + numBytes <= maxCachedStackBytes)
+		{
+			cachedStacks.push_back({base, numBytes});
+			numCachedStackBytes += numBytes;
+			return;
+		}
+	}
+
+	errorUnless(!munmap(base, numBytes));
+}
+
+void Platform::setMaxCachedThreadStackBytes(Uptr numBytes)
+{
+	std::vector<CachedStack> evictedStacks;
+	{
+		Lock<Platform::Mutex> stackCacheLock(stackCacheMutex);
+		maxCachedStackBytes = numBytes;
+		while(numCachedStackBytes > maxCachedStackBytes)
+		{
+			evictedStacks.push_back(cachedStacks.back());
+			cachedStacks.pop_back();
+			numCachedStackBytes -= evictedStacks.back().numBytes;
+		}
+	}
+
+	for(const CachedStack& stack : evictedStacks)
+	{ errorUnless(!munmap(stack.base, stack.numBytes)); }
+}
+
+// Define a unique_ptr to a Platform::Event.
+struct SigAltStack
+{
+	enum
+	{
+		numBytes = 65536
+	};
+
+	U8* base = nullptr;
+
+	~SigAltStack()
+	{
+		if(base)
+		{
+			// Disable the sig alt stack.
+			// According to the docs, ss_size is ignored if SS_DISABLE is set, but MacOS returns an
+			// ENOMEM error if ss_size is too small regardless of whether SS_DISABLE is set.
+			stack_t disableAltStack;
+			memset(&disableAltStack, 0, sizeof(stack_t));
+			disableAltStack.ss_flags = SS_DISABLE;
+			disableAltStack.ss_size = SigAltStack::numBytes;
+			errorUnless(!sigaltstack(&disableAltStack, nullptr));
+
+			// Free the alt stack's memory.
+			freeStack(base, SigAltStack::numBytes);
+			base = nullptr;
+		}
+	}
+
+	void init()
+	{
+		if(!base)
+		{
+			// Allocate a stack to use when handling signals, so stack overflow can be handled
+			// safely.
+			base = allocateStack(SigAltStack::numBytes, false);
+			stack_t sigAltStackInfo;
+			sigAltStackInfo.ss_size = SigAltStack::numBytes;
+			sigAltStackInfo.ss_sp = base;
+			sigAltStackInfo.ss_flags = 0;
+			errorUnless(!sigaltstack(&sigAltStackInfo, nullptr));
+		}
+	}
+};
+
+// The C++ exception thrown by raisePlatformException. Data that fits in inlineData is stored there,
+// so throwing a typical WebAssembly exception doesn't need a separate allocation for its payload.
+// The JITed code that catches these exceptions reads the data pointer from the start of the
+// exception object, so it must remain the first member.
+struct PlatformException
+{
+	void* data;
+	CallStack callStack;
+	Uptr numDataBytes;
+	U8 inlineData[maxInlinePlatformExceptionDataBytes];
+
+	PlatformException(const void* inData, Uptr inNumDataBytes, CallStack&& inCallStack)
+	: callStack(std::move(inCallStack))
+	{
+		initData(inData, inNumDataBytes);
+	}
+
+	PlatformException(const PlatformException& copyee) : callStack(copyee.callStack)
+	{
+		initData(copyee.data, copyee.numDataBytes);
+	}
+
+	~PlatformException()
+	{
+		if(data != inlineData) { free(data); }
+	}
+
+	PlatformException& operator=(const PlatformException&) = delete;
+
+private:
+	void initData(const void* inData, Uptr inNumDataBytes)
+	{
+		numDataBytes = inNumDataBytes;
+		if(!inData) { data = nullptr; }
+		else
+		{
+			data = numDataBytes <= maxInlinePlatformExceptionDataBytes ? inlineData
+																	   : malloc(numDataBytes);
+			memcpy(data, inData, numDataBytes);
+		}
+	}
+};
+
+static thread_local SigAltStack sigAltStack;
+static thread_local SignalContext* innermostSignalContext = nullptr;
+static std::atomic<SignalHandler> portableSignalHandler;
+static std::atomic<bool> isExceptionCallStackCaptureEnabled{true};
+
+struct Platform::Fiber
+{
+#ifndef __WAVIX__
+	ucontext_t context;
+#endif
+
+	// The stack allocated by createFiber, or null for the fiber of a thread's own stack. The lowest
+	// page of the stack is a guard page.
+	U8* stackBase = nullptr;
+	Uptr numStackBytes = 0;
+
+	void (*entry)(void*) = nullptr;
+	void* argument = nullptr;
+
+	// The innermost catchSignals call on the fiber's stack, saved while the fiber isn't executing.
+	SignalContext* innermostSignalContext = nullptr;
+};
+
+static thread_local Fiber* currentFiber = nullptr;
+static thread_local std::unique_ptr<Fiber> threadFiber;
+
+// Gets the address range of the stack that is executing, and the guard page beneath it.
+static void getCurrentStackWithGuardPage(U8*& outMinAddr, U8*& outMaxAddr)
+{
+	if(currentFiber && currentFiber->stackBase)
+	{
+		outMinAddr = currentFiber->stackBase;
+		outMaxAddr = currentFiber->stackBase + currentFiber->numStackBytes;
+	}
+	else
+	{
+		getCurrentThreadStack(outMinAddr, outMaxAddr);
+		outMinAddr -= sysconf(_SC_PAGESIZE);
+	}
+}
+
+static void deliverSignal(Signal signal, const CallStack& callStack)
+{
+	// Call the signal handlers, from innermost to outermost, until one returns true.
+	for(SignalContext* signalContext = innermostSignalContext; signalContext;
+		signalContext = signalContext->outerContext)
+	{
+		if(signalContext->filter(signal, callStack))
+		{
+			// Jump back to the execution context that was saved in catchSignals.
+			siglongjmp(signalContext->catchJump, 1);
+		}
+	}
+
+	// If the signal wasn't handled by a catchSignals call, call the portable signal handler.
+	SignalHandler portableSignalHandlerSnapshot = portableSignalHandler.load();
+	if(portableSignalHandlerSnapshot) { portableSignalHandlerSnapshot(signal, callStack); }
+}
+
+[[noreturn]] static void signalHandler(int signalNumber, siginfo_t* signalInfo, void*)
+{
+	Signal signal;
+
+	// Derive the exception cause the from signal that was received.
+	switch(signalNumber)
+	{
+	case SIGFPE:
+		if(signalInfo->si_code != FPE_INTDIV && signalInfo->si_code != FPE_INTOVF)
+		{ Errors::fatal("unknown SIGFPE code"); }
+		signal.type = Signal::Type::intDivideByZeroOrOverflow;
+		break;
+	case SIGSEGV:
+	case SIGBUS:
+	{
+		// Determine whether the faulting address was an address reserved by the stack.
+		U8* stackMinAddr;
+		U8* stackMaxAddr;
+		getCurrentStackWithGuardPage(stackMinAddr, stackMaxAddr);
+		signal.type = signalInfo->si_addr >= stackMinAddr && signalInfo->si_addr < stackMaxAddr
+						  ? Signal::Type::stackOverflow
+						  : Signal::Type::accessViolation;
+		signal.accessViolation.address = reinterpret_cast<Uptr>(signalInfo->si_addr);
+		break;
+	}
+	default: Errors::fatalf("unknown signal number: %i", signalNumber); break;
+	};
+
+	// Capture the execution context, omitting this function and the function that called it, so the
+	// top of the callstack is the function that triggered the signal.
+	CallStack callStack;
+	if(isExceptionCallStackCaptureEnabled.load(std::memory_order_relaxed))
+	{ callStack = captureCallStack(2); }
+
+	deliverSignal(signal, callStack);
+
+	switch(signalNumber)
+	{
+	case SIGFPE: Errors::fatalf("unhandled SIGFPE\n");
+	case SIGSEGV: Errors::fatalf("unhandled SIGSEGV\n");
+	case SIGBUS: Errors::fatalf("unhandled SIGBUS\n");
+	default: Errors::unreachable();
+	};
+}
+
+static void initSignals()
+{
+	static bool hasInitializedSignalHandlers = false;
+	if(!hasInitializedSignalHandlers)
+	{
+		hasInitializedSignalHandlers = true;
+
+		// Set up a signal mask for the signals we handle that will disable them inside the handler.
+		struct sigaction signalAction;
+		sigemptyset(&signalAction.sa_mask);
+		sigaddset(&signalAction.sa_mask, SIGFPE);
+		sigaddset(&signalAction.sa_mask, SIGSEGV);
+		sigaddset(&signalAction.sa_mask, SIGBUS);
+
+		// Set the signal handler for the signals we want to intercept.
+		signalAction.sa_sigaction = signalHandler;
+		signalAction.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigaction(SIGSEGV, &signalAction, nullptr);
+		sigaction(SIGBUS, &signalAction, nullptr);
+		sigaction(SIGFPE, &signalAction, nullptr);
+	}
+}
+
+bool Platform::catchSignals(FunctionRef<void()> thunk,
+							FunctionRef<bool(Signal, const CallStack&)> filter)
+{
+	initSignals();
+	sigAltStack.init();
+
+	SignalContext signalContext{innermostSignalContext, {}, filter, nullptr};
+	signalContext.stackMaxAddr = reinterpret_cast<U8*>(&signalContext);
+
+#ifdef __WAVIX__
+	Errors::fatal("catchSignals is unimplemented on Wavix");
+#else
+	// Use sigsetjmp to capture the execution state into the signal context. If a signal is raised,
+	// the signal handler will jump back to here.
+	bool isReturningFromSignalHandler = sigsetjmp(signalContext.catchJump, 1) != 0;
 	if(!isReturningFromSignalHandler)
 	{
 		innermostSignalContext = &signalContext;
@@ -591,13 +1479,125 @@ bool Platform::catchSignals(const std::function<void()>& thunk,
 #endif
 }
 
+#if !defined(__WAVIX__) && (defined(__linux__) || defined(__APPLE__))                             \
+	&& (defined(__x86_64__) || defined(__aarch64__))
+static std::atomic<CallStackSampleHandler> callStackSampleHandler{nullptr};
+
+// Gets the instruction pointer, frame pointer, and stack pointer of the context interrupted by a
+// signal.
+static void getInterruptedRegisters(void* contextVoid, Uptr& outIP, Uptr& outFP, Uptr& outSP)
+{
+	const ucontext_t* context = (const ucontext_t*)contextVoid;
+#if defined(__linux__) && defined(__x86_64__)
+	outIP = Uptr(context->uc_mcontext.gregs[REG_RIP]);
+	outFP = Uptr(context->uc_mcontext.gregs[REG_RBP]);
+	outSP = Uptr(context->uc_mcontext.gregs[REG_RSP]);
+#elif defined(__linux__)
+	outIP = Uptr(context->uc_mcontext.pc);
+	outFP = Uptr(context->uc_mcontext.regs[29]);
+	outSP = Uptr(context->uc_mcontext.sp);
+#elif defined(__x86_64__)
+	outIP = Uptr(context->uc_mcontext->__ss.__rip);
+	outFP = Uptr(context->uc_mcontext->__ss.__rbp);
+	outSP = Uptr(context->uc_mcontext->__ss.__rsp);
+#else
+	outIP = Uptr(context->uc_mcontext->__ss.__pc);
+	outFP = Uptr(context->uc_mcontext->__ss.__fp);
+	outSP = Uptr(context->uc_mcontext->__ss.__sp);
+#endif
+}
+
+static void callStackSampleSignalHandler(int, siginfo_t*, void* contextVoid)
+{
+	const int savedErrno = errno;
+
+	// Only sample threads that are inside a catchSignals call, and so have a known range of stack
+	// addresses that frame pointers may be followed into. A thread that is handling a signal on
+	// its signal stack isn't sampled, since the range doesn't include the signal stack.
+	CallStackSampleHandler handler = callStackSampleHandler.load(std::memory_order_acquire);
+	const SignalContext* signalContext = innermostSignalContext;
+	Uptr ip, fp, sp;
+	getInterruptedRegisters(contextVoid, ip, fp, sp);
+	const Uptr sigAltStackBase = reinterpret_cast<Uptr>(sigAltStack.base);
+	if(handler && signalContext
+	   && (sp < sigAltStackBase || sp - sigAltStackBase >= SigAltStack::numBytes))
+	{
+		const Uptr stackMaxAddr = reinterpret_cast<Uptr>(signalContext->stackMaxAddr);
+
+		// Each frame pointer points to the saved frame pointer of the caller's frame, followed by
+		// the return address into the caller. Frame pointers must increase toward the base of the
+		// stack, so following them always terminates.
+		Uptr frameAddresses[maxSampledCallStackFrames];
+		Uptr numFrames = 0;
+		frameAddresses[numFrames++] = ip;
+		while(numFrames < maxSampledCallStackFrames && fp >= sp && fp % sizeof(Uptr) == 0
+			  && fp < stackMaxAddr && stackMaxAddr - fp >= sizeof(Uptr) * 2)
+		{
+			const Uptr callerFP = reinterpret_cast<const Uptr*>(fp)[0];
+			const Uptr returnAddress = reinterpret_cast<const Uptr*>(fp)[1];
+			if(!returnAddress) { break; }
+			frameAddresses[numFrames++] = returnAddress;
+			if(callerFP <= fp) { break; }
+			fp = callerFP;
+		}
+
+		handler(frameAddresses, numFrames);
+	}
+
+	errno = savedErrno;
+}
+
+bool Platform::startCallStackSampling(Uptr samplesPerSecond, CallStackSampleHandler handler)
+{
+	wavmAssert(samplesPerSecond > 0 && handler);
+
+	static bool hasInitializedSampleSignalHandler = false;
+	if(!hasInitializedSampleSignalHandler)
+	{
+		hasInitializedSampleSignalHandler = true;
+
+		struct sigaction signalAction;
+		sigemptyset(&signalAction.sa_mask);
+		signalAction.sa_sigaction = callStackSampleSignalHandler;
+		signalAction.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+		sigaction(SIGPROF, &signalAction, nullptr);
+	}
+
+	callStackSampleHandler.store(handler, std::memory_order_release);
+
+	// The profiling timer counts the CPU time used by all the process's threads, and signals a
+	// thread that is using the CPU.
+	const Uptr intervalMicroseconds = samplesPerSecond > 1000000 ? 1 : 1000000 / samplesPerSecond;
+	struct itimerval timer;
+	timer.it_interval.tv_sec = time_t(intervalMicroseconds / 1000000);
+	timer.it_interval.tv_usec = suseconds_t(intervalMicroseconds % 1000000);
+	timer.it_value = timer.it_interval;
+	return !setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void Platform::stopCallStackSampling()
+{
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, nullptr);
+	callStackSampleHandler.store(nullptr, std::memory_order_release);
+}
+#else
+bool Platform::startCallStackSampling(Uptr samplesPerSecond, CallStackSampleHandler handler)
+{
+	return false;
+}
+
+void Platform::stopCallStackSampling() {}
+#endif
+
 static void terminateHandler()
 {
 	try
 	{
 		std::rethrow_exception(std::current_exception());
 	}
-	catch(PlatformException exception)
+	catch(const PlatformException& exception)
 	{
 		Signal signal;
 		signal.type = Signal::Type::unhandledException;
@@ -683,18 +1683,36 @@ void Platform::deregisterEHFrames(const U8* imageBase, const U8* ehFrames, Uptr
 	visitFDEs(ehFrames, numBytes, __deregister_frame);
 }
 
-bool Platform::catchPlatformExceptions(const std::function<void()>& thunk,
-									   const std::function<void(void*, const CallStack&)>& handler)
+GrowableEHFrameTable* Platform::createGrowableEHFrameTable(const U8* imageBase,
+														   Uptr numBytes,
+														   Uptr maxNumFunctions)
+{
+	return nullptr;
+}
+
+bool Platform::addGrowableEHFrames(GrowableEHFrameTable* table, const U8* ehFrames, Uptr numBytes)
+{
+	Errors::unreachable();
+}
+
+void Platform::destroyGrowableEHFrameTable(GrowableEHFrameTable* table) { Errors::unreachable(); }
+
+void Platform::setExceptionCallStackCaptureEnabled(bool enabled)
+{
+	isExceptionCallStackCaptureEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Platform::catchPlatformExceptions(FunctionRef<void()> thunk,
+									   FunctionRef<void(void*, const CallStack&)> handler)
 {
 	try
 	{
 		thunk();
 		return false;
 	}
-	catch(PlatformException exception)
+	catch(const PlatformException& exception)
 	{
 		handler(exception.data, exception.callStack);
-		if(exception.data) { free(exception.data); }
 		return true;
 	}
 }
@@ -706,9 +1724,9 @@ std::type_info* Platform::getUserExceptionTypeInfo()
 	{
 		try
 		{
-			throw PlatformException{nullptr};
+			throw PlatformException(nullptr, 0, CallStack());
 		}
-		catch(PlatformException)
+		catch(const PlatformException&)
 		{
 			typeInfo = __cxxabiv1::__cxa_current_exception_type();
 		}
@@ -717,32 +1735,141 @@ std::type_info* Platform::getUserExceptionTypeInfo()
 	return typeInfo;
 }
 
-[[noreturn]] void Platform::raisePlatformException(void* data)
+[[noreturn]] void Platform::raisePlatformException(const void* data, Uptr numDataBytes)
 {
-	throw PlatformException{data, captureCallStack(1)};
+	throw PlatformException(data,
+							numDataBytes,
+							isExceptionCallStackCaptureEnabled.load(std::memory_order_relaxed)
+								? captureCallStack(1)
+								: CallStack());
 	printf("unhandled PlatformException\n");
 	Errors::unreachable();
 }
 
+struct ForkThreadArgs;
+
 namespace WAVM { namespace Platform {
+	enum class ThreadState : U32
+	{
+		running,
+		exited,
+		detached
+	};
+
 	struct Thread
 	{
-		pthread_t id;
+		// The entry function of a thread created by createThread, or the execution context a
+		// thread created by forkCurrentThread starts in.
+		I64 (*entry)(void*) = nullptr;
+		void* entryArgument = nullptr;
+		ForkThreadArgs* forkArgs = nullptr;
+
+		// These are accessed with threadsMutex locked.
+		ThreadState state = ThreadState::running;
+		I64 result = 0;
 	};
 }}
 
-struct CreateThreadArgs
-{
-	I64 (*entry)(void*);
-	void* entryArgument;
-};
-
 struct ForkThreadArgs
 {
 	ExecutionContext forkContext;
 	U8* threadEntryFramePointer;
 };
 
+// A pthread and the stack allocated for it, which runs the entry function of a Thread. If the
+// thread pool has room (see setMaxPooledThreads), the pthread waits for another Thread to run when
+// its Thread exits, instead of exiting itself.
+struct PThread
+{
+	pthread_t id;
+
+	// The stack allocated for the pthread, including its guard page.
+	U8* stackBase = nullptr;
+	Uptr numStackBytes = 0;
+
+	// The NUMA node the pthread is restricted to, or UINTPTR_MAX if it isn't restricted.
+	Uptr numaNode = UINTPTR_MAX;
+
+	bool isStarted = false;
+
+	// The remaining members are accessed with threadsMutex locked. nextThread is the Thread the
+	// pthread runs next, and shouldExit is set to make an idle pthread exit.
+	Thread* nextThread = nullptr;
+	bool shouldExit = false;
+	pthread_cond_t startCondition = PTHREAD_COND_INITIALIZER;
+};
+
+// Guards the state of Threads, and the lists of pthreads. threadExitCondition is signaled when any
+// Thread exits. Idle pthreads wait for a Thread to run in idlePThreads. Pthreads that exited are
+// added to exitedPThreads, and are joined and freed by the next call to createThread or
+// forkCurrentThread, so their stacks can be reused.
+static pthread_mutex_t threadsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t threadExitCondition = PTHREAD_COND_INITIALIZER;
+static std::vector<PThread*> idlePThreads;
+static std::vector<PThread*> exitedPThreads;
+static Uptr maxIdlePThreads = 0;
+
+struct ThreadsLock
+{
+	ThreadsLock() { errorUnless(!pthread_mutex_lock(&threadsMutex)); }
+	~ThreadsLock() { errorUnless(!pthread_mutex_unlock(&threadsMutex)); }
+};
+
+static void freeExitedPThreads()
+{
+	std::vector<PThread*> pthreadsToFree;
+	{
+		ThreadsLock threadsLock;
+		pthreadsToFree.swap(exitedPThreads);
+	}
+	for(PThread* pthread : pthreadsToFree)
+	{
+		errorUnless(!pthread_join(pthread->id, nullptr));
+		freeStack(pthread->stackBase, pthread->numStackBytes);
+		errorUnless(!pthread_cond_destroy(&pthread->startCondition));
+		delete pthread;
+	}
+}
+
+// Returns the number of bytes of a thread stack with at least numUsableBytes above its guard page.
+static Uptr getThreadStackNumBytes(Uptr numUsableBytes)
+{
+	const Uptr pageSize = Uptr(sysconf(_SC_PAGESIZE));
+	numUsableBytes = std::max(numUsableBytes, Uptr(PTHREAD_STACK_MIN));
+	numUsableBytes = (numUsableBytes + pageSize - 1) & ~(pageSize - 1);
+	return numUsableBytes + pageSize;
+}
+
+// Returns an idle pthread restricted to numaNode, with the stack that getThreadStackNumBytes gives
+// for numUsableBytes, or allocates a new pthread that isn't started yet. The caller starts a Thread
+// on it with startThread.
+static PThread* getPThread(Uptr numUsableBytes, Uptr numaNode)
+{
+	freeExitedPThreads();
+
+	const Uptr numStackBytes = getThreadStackNumBytes(numUsableBytes);
+	{
+		ThreadsLock threadsLock;
+		for(Uptr pthreadIndex = 0; pthreadIndex < idlePThreads.size(); ++pthreadIndex)
+		{
+			PThread* pthread = idlePThreads[pthreadIndex];
+			if(pthread->numStackBytes == numStackBytes && pthread->numaNode == numaNode)
+			{
+				idlePThreads[pthreadIndex] = idlePThreads.back();
+				idlePThreads.pop_back();
+				return pthread;
+			}
+		}
+	}
+
+	// Allocate the pthread's stack, or reuse the stack of a pthread that exited.
+	PThread* pthread = new PThread;
+	pthread->numStackBytes = numStackBytes;
+	pthread->stackBase = allocateStack(numStackBytes, true);
+	pthread->numaNode = numaNode;
+	return pthread;
+}
+
 struct ExitThreadException
 {
 	I64 exitCode;
@@ -750,82 +1877,200 @@ struct ExitThreadException
 
 static thread_local U8* threadEntryFramePointer = nullptr;
 
-NO_ASAN static void* createThreadEntry(void* argsVoid)
+NO_ASAN static I64 runCreatedThread(Thread* thread)
 {
-	std::unique_ptr<CreateThreadArgs> args((CreateThreadArgs*)argsVoid);
 	I64 result = 0;
 	try
 	{
-		sigAltStack.init();
-
 		threadEntryFramePointer = getStackPointer();
 
-		result = (*args->entry)(args->entryArgument);
+		result = (*thread->entry)(thread->entryArgument);
+	}
+	catch(ExitThreadException exception)
+	{
+		result = exception.exitCode;
+	}
+	return result;
+}
+
+NO_ASAN static I64 runForkedThread(Thread* thread)
+{
+	std::unique_ptr<ForkThreadArgs> args(thread->forkArgs);
+	I64 result = 0;
+	try
+	{
+		threadEntryFramePointer = args->threadEntryFramePointer;
+
+		result = switchToForkedStackContext(&args->forkContext, args->threadEntryFramePointer);
 	}
 	catch(ExitThreadException exception)
 	{
 		result = exception.exitCode;
 	}
+	return result;
+}
+
+// Records that a Thread exited, and returns the next Thread to run on its pthread, or null if the
+// pthread should exit.
+static Thread* finishThread(PThread* pthread, Thread* thread, I64 result)
+{
+	ThreadsLock threadsLock;
+	if(thread->state == ThreadState::detached) { delete thread; }
+	else
+	{
+		thread->state = ThreadState::exited;
+		thread->result = result;
+		errorUnless(!pthread_cond_broadcast(&threadExitCondition));
+	}
+
+	// If the pool has room for the pthread, wait for another Thread to run on it. The pthread's
+	// frames while it waits must fit in the top PTHREAD_STACK_MIN bytes of its stack, which
+	// forkCurrentThread doesn't copy the forked stack to.
+	pthread->nextThread = nullptr;
+	if(idlePThreads.size() < maxIdlePThreads)
+	{
+		idlePThreads.push_back(pthread);
+		while(!pthread->nextThread && !pthread->shouldExit)
+		{ errorUnless(!pthread_cond_wait(&pthread->startCondition, &threadsMutex)); }
+	}
 
-	return reinterpret_cast<void*>(result);
+	if(!pthread->nextThread) { exitedPThreads.push_back(pthread); }
+	return pthread->nextThread;
 }
 
-Platform::Thread* Platform::createThread(Uptr numStackBytes,
-										 I64 (*threadEntry)(void*),
-										 void* argument)
+static void* pthreadEntry(void* pthreadVoid)
 {
-	auto thread = new Thread;
-	auto createArgs = new CreateThreadArgs;
-	createArgs->entry = threadEntry;
-	createArgs->entryArgument = argument;
+	PThread* pthread = (PThread*)pthreadVoid;
+	sigAltStack.init();
 
+	Thread* thread = pthread->nextThread;
+	while(thread)
+	{
+		const I64 result = thread->forkArgs ? runForkedThread(thread) : runCreatedThread(thread);
+		threadEntryFramePointer = nullptr;
+		thread = finishThread(pthread, thread, result);
+	}
+	return nullptr;
+}
+
+#ifdef __linux__
+// Gets the set of CPUs in a NUMA node. Returns false if the node has no CPUs, or if they can't be
+// determined.
+static bool getNUMANodeCPUSet(Uptr numaNode, cpu_set_t& outCPUSet)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%" PRIuPTR "/cpulist", numaNode);
+	std::vector<Uptr> cpus;
+	if(!readSysfsIndexList(path, cpus)) { return false; }
+
+	CPU_ZERO(&outCPUSet);
+	bool hasCPUs = false;
+	for(Uptr cpu : cpus)
+	{
+		if(cpu < CPU_SETSIZE)
+		{
+			CPU_SET(cpu, &outCPUSet);
+			hasCPUs = true;
+		}
+	}
+	return hasCPUs;
+}
+#endif
+
+// Runs a Thread on a pthread returned by getPThread.
+static void startThread(PThread* pthread, Thread* thread)
+{
+	if(pthread->isStarted)
+	{
+		ThreadsLock threadsLock;
+		pthread->nextThread = thread;
+		errorUnless(!pthread_cond_signal(&pthread->startCondition));
+		return;
+	}
+
+	pthread->isStarted = true;
+	pthread->nextThread = thread;
+
+	const Uptr pageSize = Uptr(sysconf(_SC_PAGESIZE));
 	pthread_attr_t threadAttr;
 	errorUnless(!pthread_attr_init(&threadAttr));
-	errorUnless(!pthread_attr_setstacksize(&threadAttr, numStackBytes));
+	errorUnless(!pthread_attr_setstack(
+		&threadAttr, pthread->stackBase + pageSize, pthread->numStackBytes - pageSize));
+
+#ifdef __linux__
+	// Restrict the thread to the CPUs of its NUMA node. If the node's CPUs can't be determined,
+	// the thread may run on any CPU.
+	cpu_set_t cpuSet;
+	if(pthread->numaNode != UINTPTR_MAX && getNUMANodeCPUSet(pthread->numaNode, cpuSet))
+	{ errorUnless(!pthread_attr_setaffinity_np(&threadAttr, sizeof(cpuSet), &cpuSet)); }
+#endif
 
 	// Create a new pthread.
-	errorUnless(!pthread_create(&thread->id, &threadAttr, createThreadEntry, createArgs));
+	errorUnless(!pthread_create(&pthread->id, &threadAttr, pthreadEntry, pthread));
 	errorUnless(!pthread_attr_destroy(&threadAttr));
+}
+
+Platform::Thread* Platform::createThread(Uptr numStackBytes,
+										 I64 (*threadEntry)(void*),
+										 void* argument,
+										 Uptr numaNode)
+{
+	auto thread = new Thread;
+	thread->entry = threadEntry;
+	thread->entryArgument = argument;
 
+	startThread(getPThread(numStackBytes, numaNode), thread);
 	return thread;
 }
 
 void Platform::detachThread(Thread* thread)
 {
-	errorUnless(!pthread_detach(thread->id));
-	delete thread;
+	// If the thread has already exited, free it now. Otherwise, it will be freed after it exits.
+	ThreadsLock threadsLock;
+	if(thread->state == ThreadState::exited) { delete thread; }
+	else
+	{
+		wavmAssert(thread->state == ThreadState::running);
+		thread->state = ThreadState::detached;
+	}
 }
 
 I64 Platform::joinThread(Thread* thread)
 {
-	void* returnValue = nullptr;
-	errorUnless(!pthread_join(thread->id, &returnValue));
+	I64 result;
+	{
+		ThreadsLock threadsLock;
+		while(thread->state != ThreadState::exited)
+		{ errorUnless(!pthread_cond_wait(&threadExitCondition, &threadsMutex)); }
+		result = thread->result;
+	}
 	delete thread;
-	return reinterpret_cast<I64>(returnValue);
+	return result;
 }
 
-void Platform::exitThread(I64 argument)
+void Platform::setMaxPooledThreads(Uptr numThreads)
 {
-	throw ExitThreadException{argument};
-	Errors::unreachable();
+	ThreadsLock threadsLock;
+	maxIdlePThreads = numThreads;
+	while(idlePThreads.size() > maxIdlePThreads)
+	{
+		PThread* pthread = idlePThreads.back();
+		idlePThreads.pop_back();
+		pthread->shouldExit = true;
+		errorUnless(!pthread_cond_signal(&pthread->startCondition));
+	}
 }
 
-NO_ASAN static void* forkThreadEntry(void* argsVoid)
+Uptr Platform::getNumberOfHardwareThreads()
 {
-	std::unique_ptr<ForkThreadArgs> args((ForkThreadArgs*)argsVoid);
-	I64 result = 0;
-	try
-	{
-		threadEntryFramePointer = args->threadEntryFramePointer;
-
-		result = switchToForkedStackContext(&args->forkContext, args->threadEntryFramePointer);
-	}
-	catch(ExitThreadException exception)
-	{
-		result = exception.exitCode;
-	}
+	const long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+	return numProcessors > 0 ? Uptr(numProcessors) : 1;
+}
 
-	return reinterpret_cast<void*>(result);
+void Platform::exitThread(I64 argument)
+{
+	throw ExitThreadException{argument};
+	Errors::unreachable();
 }
 
 // This provides a non-always_inline version of memcpy to call from NO_ASAN functions. It's needed
@@ -845,18 +2090,14 @@ NO_ASAN Thread* Platform::forkCurrentThread()
 	{ Errors::fatal("Cannot fork a thread that wasn't created by Platform::createThread"); }
 	if(innermostSignalContext)
 	{ Errors::fatal("Cannot fork a thread with catchSignals on the stack"); }
+	if(currentFiber && currentFiber->stackBase)
+	{ Errors::fatal("Cannot fork a thread that is executing in a fiber"); }
 
 	// Capture the current execution state in forkThreadArgs->forkContext.
 	// The forked thread will load this execution context, and "return" from this function on the
 	// forked stack.
 	const I64 isExecutingInFork = saveExecutionState(&forkThreadArgs->forkContext, 0);
-	if(isExecutingInFork)
-	{
-		// Allocate a sigaltstack for the new thread.
-		sigAltStack.init();
-
-		return nullptr;
-	}
+	if(isExecutingInFork) { return nullptr; }
 	else
 	{
 		// Compute the address extent of this thread's stack.
@@ -874,15 +2115,15 @@ NO_ASAN Thread* Platform::forkCurrentThread()
 		if(numActiveStackBytes + PTHREAD_STACK_MIN > numStackBytes)
 		{ Errors::fatal("not enough stack space to fork thread"); }
 
-		// Allocate a stack for the forked thread, and copy this thread's stack to it.
-		U8* forkedMinStackAddr = (U8*)mmap(nullptr,
-										   numStackBytes,
-										   PROT_READ | PROT_WRITE,
-										   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK_FLAGS,
-										   -1,
-										   0);
-		errorUnless(forkedMinStackAddr != MAP_FAILED);
-		U8* forkedMaxStackAddr = forkedMinStackAddr + numStackBytes - PTHREAD_STACK_MIN;
+		// Take an idle pthread from the pool, or allocate a new pthread with a stack (which may
+		// reuse the stack of a thread that exited), and copy this thread's stack below the top
+		// PTHREAD_STACK_MIN bytes of its stack. Only the active part of the stack is copied, but it
+		// must be copied eagerly: this thread keeps writing to its stack as soon as it returns,
+		// and the stack is private anonymous memory. Sharing its pages copy-on-write, as
+		// cloneVirtualPagesCopyOnWrite does, would first copy them into a snapshot file, which
+		// costs as much as copying them to the forked stack directly.
+		PThread* pthread = getPThread(numStackBytes, UINTPTR_MAX);
+		U8* forkedMaxStackAddr = pthread->stackBase + pthread->numStackBytes - PTHREAD_STACK_MIN;
 		memcpyToCallFromNoASAN(
 			forkedMaxStackAddr - numActiveStackBytes, minActiveStackAddr, numActiveStackBytes);
 
@@ -896,24 +2137,86 @@ NO_ASAN Thread* Platform::forkCurrentThread()
 		// Translate this thread's entry stack pointer to the forked stack.
 		forkThreadArgs->threadEntryFramePointer = threadEntryFramePointer + forkedStackOffset;
 
-		// Create a pthread with a small temp stack that will just load
-		// forkThreadArgs->forkContext.rsp. Allocate the pthread_attr_t on the heap try to avoid the
-		// stack cookie check.
-		pthread_attr_t* threadAttr = new pthread_attr_t;
-		errorUnless(!pthread_attr_init(threadAttr));
-		errorUnless(!pthread_attr_setstack(threadAttr, forkedMinStackAddr, numStackBytes));
-
+		// Start the forked thread on the pthread. It calls switchToForkedStackContext from the
+		// top of the pthread's stack, which loads forkThreadArgs->forkContext.
 		auto thread = new Thread;
-		errorUnless(!pthread_create(
-			&thread->id, threadAttr, (void* (*)(void*))forkThreadEntry, forkThreadArgs));
-
-		errorUnless(!pthread_attr_destroy(threadAttr));
-		delete threadAttr;
+		thread->forkArgs = forkThreadArgs;
+		startThread(pthread, thread);
 
 		return thread;
 	}
 }
 
+#ifndef __WAVIX__
+static void fiberTrampoline()
+{
+	(*currentFiber->entry)(currentFiber->argument);
+	Errors::fatal("Fiber entry function returned");
+}
+#endif
+
+Fiber* Platform::createFiber(Uptr numStackBytes, void (*fiberEntry)(void*), void* argument)
+{
+#ifdef __WAVIX__
+	Errors::fatal("createFiber is unimplemented on Wavix");
+#else
+	const Uptr pageSize = Uptr(sysconf(_SC_PAGESIZE));
+	numStackBytes = std::max(numStackBytes, Uptr(PTHREAD_STACK_MIN));
+	numStackBytes = (numStackBytes + pageSize - 1) & ~(pageSize - 1);
+
+	Fiber* fiber = new Fiber;
+	fiber->numStackBytes = numStackBytes + pageSize;
+	fiber->entry = fiberEntry;
+	fiber->argument = argument;
+
+	// Allocate the fiber's stack, with a guard page beneath it so stack overflows fault.
+	fiber->stackBase = allocateStack(fiber->numStackBytes, true);
+
+	errorUnless(!getcontext(&fiber->context));
+	fiber->context.uc_stack.ss_sp = fiber->stackBase + pageSize;
+	fiber->context.uc_stack.ss_size = numStackBytes;
+	fiber->context.uc_link = nullptr;
+	makecontext(&fiber->context, fiberTrampoline, 0);
+
+	return fiber;
+#endif
+}
+
+Fiber* Platform::getCurrentFiber()
+{
+	if(!currentFiber)
+	{
+		threadFiber.reset(new Fiber);
+		currentFiber = threadFiber.get();
+	}
+	return currentFiber;
+}
+
+void Platform::switchToFiber(Fiber* fiber)
+{
+#ifdef __WAVIX__
+	Errors::fatal("switchToFiber is unimplemented on Wavix");
+#else
+	Fiber* fromFiber = getCurrentFiber();
+	wavmAssert(fiber != fromFiber);
+
+	// Each fiber has its own chain of catchSignals calls on its stack.
+	fromFiber->innermostSignalContext = innermostSignalContext;
+	innermostSignalContext = fiber->innermostSignalContext;
+
+	currentFiber = fiber;
+	errorUnless(!swapcontext(&fromFiber->context, &fiber->context));
+#endif
+}
+
+void Platform::destroyFiber(Fiber* fiber)
+{
+	wavmAssert(fiber != currentFiber);
+	wavmAssert(fiber->stackBase);
+	freeStack(fiber->stackBase, fiber->numStackBytes);
+	delete fiber;
+}
+
 U64 Platform::getMonotonicClock()
 {
 #ifdef __APPLE__
@@ -927,6 +2230,110 @@ U64 Platform::getMonotonicClock()
 #endif
 }
 
+#ifdef __linux__
+// The number of times to check whether a contended mutex was unlocked or an event was signaled
+// before blocking the thread: long enough to cover a short critical section, and short enough to
+// waste little time when the wait is long.
+static constexpr Uptr maxMutexSpins = 256;
+static constexpr Uptr maxEventSpins = 128;
+
+// Tells the CPU that the thread is spinning, so it can yield resources to the other logical
+// processors on the same core.
+static void spinWaitHint()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+static const U32* getFutexAddress(const std::atomic<U32>& futex)
+{
+	static_assert(sizeof(std::atomic<U32>) == sizeof(U32), "");
+	return reinterpret_cast<const U32*>(&futex);
+}
+
+static void waitOnFutex(const std::atomic<U32>& futex, U32 expectedValue, U64 untilClock)
+{
+	if(waitOnAddress(getFutexAddress(futex), expectedValue, untilClock)
+	   == WaitOnAddressResult::unsupported)
+	{ Errors::fatal("futex isn't supported"); }
+}
+
+Platform::Mutex::Mutex() : state(0) {}
+
+Platform::Mutex::~Mutex() { errorUnless(!state.load(std::memory_order_relaxed)); }
+
+void Platform::Mutex::lock()
+{
+	U32 expectedState = 0;
+	if(state.compare_exchange_strong(expectedState, 1, std::memory_order_acquire)) { return; }
+
+	// Spin while the mutex is locked, in case it's about to be unlocked.
+	for(Uptr spinIndex = 0; spinIndex < maxMutexSpins; ++spinIndex)
+	{
+		spinWaitHint();
+		expectedState = 0;
+		if(state.load(std::memory_order_relaxed) == 0
+		   && state.compare_exchange_weak(expectedState, 1, std::memory_order_acquire))
+		{ return; }
+	}
+
+	// Mark the mutex as contended, and block on the futex until it's unlocked. The mutex stays
+	// marked as contended once this thread acquires it, since other threads may still be waiting.
+	while(state.exchange(2, std::memory_order_acquire) != 0) { waitOnFutex(state, 2, UINT64_MAX); }
+}
+
+void Platform::Mutex::unlock()
+{
+	if(state.exchange(0, std::memory_order_release) == 2)
+	{ wakeAddress(getFutexAddress(state), 1); }
+}
+
+Platform::Event::Event() : isSignaled(0), numWaiters(0) {}
+
+Platform::Event::~Event() {}
+
+bool Platform::Event::wait(U64 untilTime)
+{
+	// Spin for a short time in case the event is about to be signaled.
+	for(Uptr spinIndex = 0; spinIndex < maxEventSpins; ++spinIndex)
+	{
+		if(isSignaled.load(std::memory_order_relaxed)
+		   && isSignaled.exchange(0, std::memory_order_acquire))
+		{ return true; }
+		spinWaitHint();
+	}
+
+	// Count this thread as waiting before checking whether the event is signaled, so a signal
+	// after the check sees the waiter and wakes it.
+	numWaiters.fetch_add(1, std::memory_order_seq_cst);
+	bool result;
+	while(true)
+	{
+		if(isSignaled.exchange(0, std::memory_order_seq_cst))
+		{
+			result = true;
+			break;
+		}
+		if(untilTime != UINT64_MAX && getMonotonicClock() >= untilTime)
+		{
+			result = false;
+			break;
+		}
+		waitOnFutex(isSignaled, 0, untilTime);
+	}
+	numWaiters.fetch_sub(1, std::memory_order_relaxed);
+	return result;
+}
+
+void Platform::Event::signal()
+{
+	isSignaled.store(1, std::memory_order_seq_cst);
+	if(numWaiters.load(std::memory_order_seq_cst)) { wakeAddress(getFutexAddress(isSignaled), 1); }
+}
+#else
 Platform::Mutex::Mutex()
 {
 	static_assert(sizeof(pthreadMutex) == sizeof(pthread_mutex_t), "");
@@ -1001,6 +2408,61 @@ bool Platform::Event::wait(U64 untilTime)
 }
 
 void Platform::Event::signal() { errorUnless(!pthread_cond_signal((pthread_cond_t*)&pthreadCond)); }
+#endif
+
+#ifdef __linux__
+WaitOnAddressResult Platform::waitOnAddress(const U32* address,
+											U32 expectedValue,
+											U64 untilClock,
+											bool isProcessShared)
+{
+	// Use FUTEX_WAIT_BITSET, which takes an absolute CLOCK_MONOTONIC timeout, so the timeout
+	// doesn't need to be recomputed if the wait is interrupted by a signal.
+	timespec untilTimeSpec;
+	untilTimeSpec.tv_sec = untilClock / 1000000;
+	untilTimeSpec.tv_nsec = (untilClock % 1000000) * 1000;
+	while(true)
+	{
+		const long result = syscall(SYS_futex,
+									address,
+									FUTEX_WAIT_BITSET | (isProcessShared ? 0 : FUTEX_PRIVATE_FLAG),
+									expectedValue,
+									untilClock == UINT64_MAX ? nullptr : &untilTimeSpec,
+									nullptr,
+									FUTEX_BITSET_MATCH_ANY);
+		if(result == 0) { return WaitOnAddressResult::woken; }
+		switch(errno)
+		{
+		case EINTR: break;
+		case EAGAIN: return WaitOnAddressResult::notEqual;
+		case ETIMEDOUT: return WaitOnAddressResult::timedOut;
+		case ENOSYS: return WaitOnAddressResult::unsupported;
+		default: Errors::fatalf("futex(FUTEX_WAIT_BITSET) failed: %s", strerror(errno));
+		};
+	}
+}
+
+Uptr Platform::wakeAddress(const U32* address, Uptr numToWake, bool isProcessShared)
+{
+	const int clampedNumToWake = int(std::min(numToWake, Uptr(INT_MAX)));
+	const long result = syscall(SYS_futex,
+								address,
+								FUTEX_WAKE | (isProcessShared ? 0 : FUTEX_PRIVATE_FLAG),
+								clampedNumToWake);
+	if(result < 0) { Errors::fatalf("futex(FUTEX_WAKE) failed: %s", strerror(errno)); }
+	return Uptr(result);
+}
+#else
+WaitOnAddressResult Platform::waitOnAddress(const U32* address,
+											U32 expectedValue,
+											U64 untilClock,
+											bool isProcessShared)
+{
+	return WaitOnAddressResult::unsupported;
+}
+
+Uptr Platform::wakeAddress(const U32* address, Uptr numToWake, bool isProcessShared) { return 0; }
+#endif
 
 // Instead of just reinterpreting the file descriptor as a pointer, use -fd - 1, which maps fd=0 to
 // a non-null value, and fd=-1 to null.
@@ -1008,6 +2470,19 @@ static I32 filePtrToIndex(File* ptr) { return I32(-reinterpret_cast<Iptr>(ptr) -
 
 static File* fileIndexToPtr(int index) { return reinterpret_cast<File*>(-Iptr(index) - 1); }
 
+static U32 getCreateModeOpenFlags(FileCreateMode createMode)
+{
+	switch(createMode)
+	{
+	case FileCreateMode::createAlways: return O_CREAT | O_TRUNC;
+	case FileCreateMode::createNew: return O_CREAT | O_EXCL;
+	case FileCreateMode::openAlways: return O_CREAT;
+	case FileCreateMode::openExisting: return 0;
+	case FileCreateMode::truncateExisting: return O_TRUNC;
+	default: Errors::unreachable();
+	}
+}
+
 File* Platform::openFile(const std::string& pathName,
 						 FileAccessMode accessMode,
 						 FileCreateMode createMode)
@@ -1022,15 +2497,7 @@ File* Platform::openFile(const std::string& pathName,
 	default: Errors::unreachable();
 	};
 
-	switch(createMode)
-	{
-	case FileCreateMode::createAlways: flags |= O_CREAT | O_TRUNC; break;
-	case FileCreateMode::createNew: flags |= O_CREAT | O_EXCL; break;
-	case FileCreateMode::openAlways: flags |= O_CREAT; break;
-	case FileCreateMode::openExisting: break;
-	case FileCreateMode::truncateExisting: flags |= O_TRUNC; break;
-	default: Errors::unreachable();
-	};
+	flags |= getCreateModeOpenFlags(createMode);
 
 	switch(createMode)
 	{
@@ -1044,6 +2511,15 @@ File* Platform::openFile(const std::string& pathName,
 	return fileIndexToPtr(result);
 }
 
+File* Platform::openSharedMemory(const std::string& name, FileCreateMode createMode)
+{
+	const I32 result
+		= shm_open(name.c_str(), O_RDWR | getCreateModeOpenFlags(createMode), S_IRUSR | S_IWUSR);
+	return fileIndexToPtr(result);
+}
+
+bool Platform::removeSharedMemory(const std::string& name) { return shm_unlink(name.c_str()) == 0; }
+
 bool Platform::closeFile(File* file) { return close(filePtrToIndex(file)) == 0; }
 
 File* Platform::getStdFile(StdDevice device)
@@ -1093,6 +2569,93 @@ bool Platform::writeFile(File* file, const void* data, Uptr numBytes, Uptr* outN
 
 bool Platform::flushFileWrites(File* file) { return fsync(filePtrToIndex(file)) == 0; }
 
+bool Platform::getFileNumBytes(File* file, U64& outNumBytes)
+{
+	struct stat fileStatus;
+	if(fstat(filePtrToIndex(file), &fileStatus)) { return false; }
+	outNumBytes = U64(fileStatus.st_size);
+	return true;
+}
+
+bool Platform::setFileNumBytes(File* file, U64 numBytes)
+{
+	if(numBytes > U64(INT64_MAX)) { return false; }
+	return ftruncate(filePtrToIndex(file), off_t(numBytes)) == 0;
+}
+
+const U8* Platform::mapFile(File* file, Uptr& outNumBytes)
+{
+	struct stat fileStatus;
+	if(fstat(filePtrToIndex(file), &fileStatus) || !S_ISREG(fileStatus.st_mode)
+	   || fileStatus.st_size <= 0 || U64(fileStatus.st_size) > UINTPTR_MAX)
+	{ return nullptr; }
+
+	const Uptr numBytes = Uptr(fileStatus.st_size);
+	void* result = mmap(nullptr, numBytes, PROT_READ, MAP_PRIVATE, filePtrToIndex(file), 0);
+	if(result == MAP_FAILED) { return nullptr; }
+
+	outNumBytes = numBytes;
+	return (const U8*)result;
+}
+
+void Platform::unmapFile(const U8* baseAddress, Uptr numBytes)
+{
+	errorUnless(!munmap(const_cast<U8*>(baseAddress), numBytes));
+}
+
+bool Platform::mapFileToVirtualPages(File* file,
+									 U64 fileOffset,
+									 U8* baseVirtualAddress,
+									 Uptr numPages,
+									 bool isShared)
+{
+	errorUnless(isPageAligned(baseVirtualAddress));
+	errorUnless(!(fileOffset & ((U64(1) << getPageSizeLog2()) - 1)));
+	const int fd = filePtrToIndex(file);
+
+	struct stat fileStatus;
+	if(fstat(fd, &fileStatus) || !S_ISREG(fileStatus.st_mode)) { return false; }
+	if(isShared && (fcntl(fd, F_GETFL) & O_ACCMODE) != O_RDWR) { return false; }
+
+	// Accessing a page of the mapping that is past the end of the file raises SIGBUS, so only map
+	// the pages that contain some of the file, and map zeroed pages over the rest.
+	const U64 fileNumBytes = U64(fileStatus.st_size);
+	const U64 numFileBytesInRange = fileOffset < fileNumBytes ? fileNumBytes - fileOffset : 0;
+	const U64 numFilePagesInRange
+		= (numFileBytesInRange + (U64(1) << getPageSizeLog2()) - 1) >> getPageSizeLog2();
+	const Uptr numFilePages = Uptr(std::min(numFilePagesInRange, U64(numPages)));
+	const Uptr numFileBytes = numFilePages << getPageSizeLog2();
+	const Uptr numZeroBytes = (numPages - numFilePages) << getPageSizeLog2();
+
+	if(numFilePages
+	   && mmap(baseVirtualAddress,
+			   numFileBytes,
+			   PROT_READ | PROT_WRITE,
+			   (isShared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED,
+			   fd,
+			   off_t(fileOffset))
+			  == MAP_FAILED)
+	{
+		decommitVirtualPages(baseVirtualAddress, numPages);
+		return false;
+	}
+
+	if(numZeroBytes
+	   && mmap(baseVirtualAddress + numFileBytes,
+			   numZeroBytes,
+			   PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+			   -1,
+			   0)
+			  == MAP_FAILED)
+	{
+		decommitVirtualPages(baseVirtualAddress, numPages);
+		return false;
+	}
+
+	return true;
+}
+
 std::string Platform::getCurrentWorkingDirectory()
 {
 	const Uptr maxPathBytes = pathconf(".", _PC_PATH_MAX);
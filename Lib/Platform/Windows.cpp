@@ -3,6 +3,7 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Unicode.h"
 #include "WAVM/Platform/Defines.h"
@@ -23,6 +24,7 @@
 #include <Windows.h>
 
 #include <DbgHelp.h>
+#include <Psapi.h>
 #include <string>
 
 #define POISON_FORKED_STACK_SELF_POINTERS 0
@@ -188,9 +190,33 @@ U8* Platform::allocateAlignedVirtualPages(Uptr numPages,
 	}
 }
 
-bool Platform::commitVirtualPages(U8* baseVirtualAddress, Uptr numPages, MemoryAccess access)
+Uptr Platform::getNumNUMANodes()
 {
+	ULONG highestNodeNumber = 0;
+	if(!GetNumaHighestNodeNumber(&highestNodeNumber)) { return 1; }
+	return Uptr(highestNodeNumber) + 1;
+}
+
+bool Platform::commitVirtualPages(U8* baseVirtualAddress,
+								  Uptr numPages,
+								  MemoryAccess access,
+								  CommitFlags flags,
+								  Uptr numaNode)
+{
+	// Windows large pages must be allocated with MEM_LARGE_PAGES when the address space is
+	// reserved, rather than committed into an existing reservation, so CommitFlags::largePages is
+	// ignored.
 	errorUnless(isPageAligned(baseVirtualAddress));
+	if(numaNode != UINTPTR_MAX && numaNode <= UINT32_MAX)
+	{
+		return baseVirtualAddress
+			   == VirtualAllocExNuma(GetCurrentProcess(),
+									 baseVirtualAddress,
+									 numPages << getPageSizeLog2(),
+									 MEM_COMMIT,
+									 memoryAccessAsWin32Flag(access),
+									 DWORD(numaNode));
+	}
 	return baseVirtualAddress
 		   == VirtualAlloc(baseVirtualAddress,
 						   numPages << getPageSizeLog2(),
@@ -209,16 +235,150 @@ bool Platform::setVirtualPageAccess(U8* baseVirtualAddress, Uptr numPages, Memor
 		   != 0;
 }
 
+// The placeholder functions were added in Windows 10 version 1803, so they are looked up at
+// runtime, and the flags are defined here for older SDKs.
+#ifndef MEM_RESERVE_PLACEHOLDER
+#define MEM_RESERVE_PLACEHOLDER 0x00040000
+#endif
+#ifndef MEM_REPLACE_PLACEHOLDER
+#define MEM_REPLACE_PLACEHOLDER 0x00004000
+#endif
+#ifndef MEM_PRESERVE_PLACEHOLDER
+#define MEM_PRESERVE_PLACEHOLDER 0x00000002
+#endif
+
+struct Placeholders
+{
+	typedef PVOID(WINAPI* VirtualAlloc2)(HANDLE, PVOID, SIZE_T, ULONG, ULONG, void*, ULONG);
+	typedef PVOID(WINAPI* MapViewOfFile3)(HANDLE,
+										  HANDLE,
+										  PVOID,
+										  ULONG64,
+										  SIZE_T,
+										  ULONG,
+										  ULONG,
+										  void*,
+										  ULONG);
+	typedef BOOL(WINAPI* UnmapViewOfFile2)(HANDLE, PVOID, ULONG);
+	VirtualAlloc2 virtualAlloc2;
+	MapViewOfFile3 mapViewOfFile3;
+	UnmapViewOfFile2 unmapViewOfFile2;
+
+	static const Placeholders& get()
+	{
+		static Placeholders placeholders;
+		return placeholders;
+	}
+
+	bool isSupported() const { return virtualAlloc2 && mapViewOfFile3 && unmapViewOfFile2; }
+
+private:
+	Placeholders() : virtualAlloc2(nullptr), mapViewOfFile3(nullptr), unmapViewOfFile2(nullptr)
+	{
+		HMODULE kernelBaseModule = ::GetModuleHandleA("kernelbase.dll");
+		if(kernelBaseModule)
+		{
+			virtualAlloc2 = (VirtualAlloc2)::GetProcAddress(kernelBaseModule, "VirtualAlloc2");
+			mapViewOfFile3 = (MapViewOfFile3)::GetProcAddress(kernelBaseModule, "MapViewOfFile3");
+			unmapViewOfFile2
+				= (UnmapViewOfFile2)::GetProcAddress(kernelBaseModule, "UnmapViewOfFile2");
+		}
+	}
+};
+
+// The dual-mapped page ranges allocated by allocateDualMappedPages, which map two views of a
+// section into adjacent placeholders instead of reserving a single range of virtual addresses, so
+// they are decommitted and freed differently. The map goes from the base address of the writable
+// view to the number of bytes in each view.
+struct DualMappedRanges
+{
+	Platform::Mutex mutex;
+	HashMap<Uptr, Uptr> baseAddressToNumViewBytes;
+
+	static DualMappedRanges& get()
+	{
+		static DualMappedRanges dualMappedRanges;
+		return dualMappedRanges;
+	}
+};
+
+static bool findDualMappedRange(U8* baseAddress, bool remove, Uptr& outNumViewBytes)
+{
+	DualMappedRanges& dualMappedRanges = DualMappedRanges::get();
+	Lock<Platform::Mutex> dualMappedRangesLock(dualMappedRanges.mutex);
+	const Uptr baseAddressBits = reinterpret_cast<Uptr>(baseAddress);
+	const Uptr* numViewBytes = dualMappedRanges.baseAddressToNumViewBytes.get(baseAddressBits);
+	if(!numViewBytes) { return false; }
+
+	outNumViewBytes = *numViewBytes;
+	if(remove) { dualMappedRanges.baseAddressToNumViewBytes.remove(baseAddressBits); }
+	return true;
+}
+
+// Unmaps a view allocated by allocateDualMappedPages if it is still mapped. If preservePlaceholder
+// is true, the view's addresses are left reserved by a placeholder. Otherwise, they are freed.
+static void releaseDualMappedView(U8* viewBaseAddress, bool preservePlaceholder)
+{
+	MEMORY_BASIC_INFORMATION memoryInfo;
+	errorUnless(VirtualQuery(viewBaseAddress, &memoryInfo, sizeof(memoryInfo))
+				== sizeof(memoryInfo));
+	if(memoryInfo.Type == MEM_MAPPED)
+	{
+		const Placeholders& placeholders = Placeholders::get();
+		if(!placeholders.unmapViewOfFile2(GetCurrentProcess(),
+										  viewBaseAddress,
+										  preservePlaceholder ? MEM_PRESERVE_PLACEHOLDER : 0))
+		{ Errors::fatal("UnmapViewOfFile2 failed"); }
+	}
+	else if(!preservePlaceholder)
+	{
+		if(!VirtualFree(viewBaseAddress, 0, MEM_RELEASE))
+		{ Errors::fatal("VirtualFree(MEM_RELEASE) failed"); }
+	}
+}
+
 void Platform::decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	errorUnless(isPageAligned(baseVirtualAddress));
+
+	// Decommitting dual-mapped pages unmaps their views, leaving placeholders that are freed by
+	// freeVirtualPages.
+	Uptr numViewBytes = 0;
+	if(findDualMappedRange(baseVirtualAddress, false, numViewBytes))
+	{
+		wavmAssert((numPages << getPageSizeLog2()) == numViewBytes * 2);
+		releaseDualMappedView(baseVirtualAddress, true);
+		releaseDualMappedView(baseVirtualAddress + numViewBytes, true);
+		return;
+	}
+
 	auto result = VirtualFree(baseVirtualAddress, numPages << getPageSizeLog2(), MEM_DECOMMIT);
 	if(baseVirtualAddress && !result) { Errors::fatal("VirtualFree(MEM_DECOMMIT) failed"); }
 }
 
+void Platform::resetVirtualPages(U8* baseVirtualAddress, Uptr numPages)
+{
+	// MEM_RESET frees the pages' physical memory, but leaves their contents undefined, so decommit
+	// the pages and commit them again instead: newly committed pages are zeroed.
+	errorUnless(isPageAligned(baseVirtualAddress));
+	decommitVirtualPages(baseVirtualAddress, numPages);
+	if(!commitVirtualPages(baseVirtualAddress, numPages))
+	{ Errors::fatal("VirtualAlloc(MEM_COMMIT) failed while resetting pages"); }
+}
+
 void Platform::freeVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	errorUnless(isPageAligned(baseVirtualAddress));
+
+	Uptr numViewBytes = 0;
+	if(findDualMappedRange(baseVirtualAddress, true, numViewBytes))
+	{
+		wavmAssert((numPages << getPageSizeLog2()) == numViewBytes * 2);
+		releaseDualMappedView(baseVirtualAddress, false);
+		releaseDualMappedView(baseVirtualAddress + numViewBytes, false);
+		return;
+	}
+
 	auto result = VirtualFree(baseVirtualAddress, 0, MEM_RELEASE);
 	if(baseVirtualAddress && !result) { Errors::fatal("VirtualFree(MEM_RELEASE) failed"); }
 }
@@ -230,6 +390,146 @@ void Platform::freeAlignedVirtualPages(U8* unalignedBaseAddress, Uptr numPages,
 	if(unalignedBaseAddress && !result) { Errors::fatal("VirtualFree(MEM_RELEASE) failed"); }
 }
 
+Uptr Platform::getPeakResidentBytes()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+	return Uptr(counters.PeakWorkingSetSize);
+}
+
+struct Platform::VirtualPageSnapshot
+{
+};
+
+bool Platform::cloneVirtualPagesCopyOnWrite(U8* sourceBaseAddress,
+											U8* destBaseAddress,
+											Uptr numPages,
+											VirtualPageSnapshot* sourceSnapshot,
+											VirtualPageSnapshot*& outDestSnapshot)
+{
+	// A section view can be mapped copy-on-write into a placeholder, but it can only be unmapped
+	// as a whole, and physical memory can't be committed to placeholders. The runtime decommits and
+	// recommits arbitrary runs of a memory's pages to shrink or reset it, which would discard the
+	// private copies of the other pages in the view, so copy-on-write cloning isn't supported on
+	// Windows.
+	return false;
+}
+
+VirtualPageSnapshot* Platform::createVirtualPageSnapshot(Uptr numPages) { return nullptr; }
+
+bool Platform::writeVirtualPageSnapshot(VirtualPageSnapshot* snapshot,
+										Uptr offset,
+										const U8* data,
+										Uptr numBytes)
+{
+	Errors::unreachable();
+}
+
+bool Platform::mapVirtualPageSnapshot(VirtualPageSnapshot* snapshot, U8* baseVirtualAddress)
+{
+	Errors::unreachable();
+}
+
+void Platform::releaseVirtualPageSnapshot(VirtualPageSnapshot* snapshot) { Errors::unreachable(); }
+
+// GetWriteWatch can only track the writes to pages that were allocated with MEM_WRITE_WATCH, which
+// can't be added to the address ranges that are already reserved for memories, so dirty page
+// tracking isn't supported on Windows.
+bool Platform::isVirtualPageDirtyTrackingSupported() { return false; }
+
+bool Platform::acquireVirtualPageDirtyTracking() { return false; }
+
+void Platform::releaseVirtualPageDirtyTracking() { Errors::unreachable(); }
+
+void Platform::clearVirtualPageDirtyBits() { Errors::unreachable(); }
+
+bool Platform::readVirtualPageDirtyBits(const U8* baseVirtualAddress,
+										Uptr numPages,
+										U64* outDirtyBits)
+{
+	Errors::unreachable();
+}
+
+bool Platform::allocateDualMappedPages(Uptr numPages, U8*& outWritableBaseAddress)
+{
+	const Placeholders& placeholders = Placeholders::get();
+	if(!placeholders.isSupported()) { return false; }
+
+	// Views must be aligned to the allocation granularity, so the executable view can only follow
+	// the writable view if the number of bytes in each view is a multiple of it.
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	const Uptr numBytes = numPages << getPageSizeLog2();
+	if(!numBytes || (numBytes & (Uptr(systemInfo.dwAllocationGranularity) - 1))) { return false; }
+
+	// Create a pagefile-backed section that can be mapped both writable and executable.
+	HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE,
+										nullptr,
+										PAGE_EXECUTE_READWRITE,
+										DWORD(U64(numBytes) >> 32),
+										DWORD(numBytes),
+										nullptr);
+	if(!section) { return false; }
+
+	// Reserve a placeholder for both views, and split it into a placeholder for each view.
+	U8* baseAddress = (U8*)placeholders.virtualAlloc2(GetCurrentProcess(),
+													  nullptr,
+													  numBytes * 2,
+													  MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+													  PAGE_NOACCESS,
+													  nullptr,
+													  0);
+	if(!baseAddress)
+	{
+		errorUnless(CloseHandle(section));
+		return false;
+	}
+	if(!VirtualFree(baseAddress, numBytes, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER))
+	{ Errors::fatal("VirtualFree(MEM_PRESERVE_PLACEHOLDER) failed"); }
+
+	// Replace the placeholders with the views. The views keep the section alive after its handle is
+	// closed.
+	void* writableView = placeholders.mapViewOfFile3(section,
+													 GetCurrentProcess(),
+													 baseAddress,
+													 0,
+													 numBytes,
+													 MEM_REPLACE_PLACEHOLDER,
+													 PAGE_READWRITE,
+													 nullptr,
+													 0);
+	void* executableView = nullptr;
+	if(writableView)
+	{
+		executableView = placeholders.mapViewOfFile3(section,
+													 GetCurrentProcess(),
+													 baseAddress + numBytes,
+													 0,
+													 numBytes,
+													 MEM_REPLACE_PLACEHOLDER,
+													 PAGE_EXECUTE_READ,
+													 nullptr,
+													 0);
+	}
+	errorUnless(CloseHandle(section));
+	if(!executableView)
+	{
+		releaseDualMappedView(baseAddress, false);
+		releaseDualMappedView(baseAddress + numBytes, false);
+		return false;
+	}
+
+	{
+		DualMappedRanges& dualMappedRanges = DualMappedRanges::get();
+		Lock<Platform::Mutex> dualMappedRangesLock(dualMappedRanges.mutex);
+		dualMappedRanges.baseAddressToNumViewBytes.addOrFail(
+			reinterpret_cast<Uptr>(baseAddress), numBytes);
+	}
+
+	outWritableBaseAddress = baseAddress;
+	return true;
+}
+
 static Mutex& getErrorReportingMutex()
 {
 	static Platform::Mutex mutex;
@@ -368,6 +668,25 @@ bool Platform::describeInstructionPointer(Uptr ip, std::string& outDescription)
 	}
 }
 
+// The perf map and jitdump profiler outputs are only used by Linux perf.
+bool Platform::setJITProfilerOutput(bool perfMap, bool jitDump) { return !perfMap && !jitDump; }
+
+bool Platform::isJITProfilerOutputEnabled() { return false; }
+
+void Platform::registerJITFunction(const std::string& name,
+								   Uptr baseAddress,
+								   Uptr numBytes,
+								   const std::vector<JITFunctionLine>& lines)
+{
+}
+
+bool Platform::startCallStackSampling(Uptr samplesPerSecond, CallStackSampleHandler handler)
+{
+	return false;
+}
+
+void Platform::stopCallStackSampling() {}
+
 static CallStack unwindStack(const CONTEXT& immutableContext, Uptr numOmittedFramesFromTop)
 {
 	// Make a mutable copy of the context.
@@ -447,6 +766,154 @@ void Platform::deregisterEHFrames(const U8* imageBase, const U8* ehFrames, Uptr
 #endif
 }
 
+#ifdef _WIN64
+// The interface to the growable function table functions in ntdll, which are looked up at runtime
+// since they were added in Windows 8.
+struct GrowableFunctionTables
+{
+	typedef DWORD(NTAPI* RtlAddGrowableFunctionTable)(PVOID*,
+													  PRUNTIME_FUNCTION,
+													  DWORD,
+													  DWORD,
+													  ULONG_PTR,
+													  ULONG_PTR);
+	typedef void(NTAPI* RtlGrowFunctionTable)(PVOID, DWORD);
+	typedef void(NTAPI* RtlDeleteGrowableFunctionTable)(PVOID);
+	RtlAddGrowableFunctionTable addTable;
+	RtlGrowFunctionTable growTable;
+	RtlDeleteGrowableFunctionTable deleteTable;
+
+	static const GrowableFunctionTables& get()
+	{
+		static GrowableFunctionTables growableFunctionTables;
+		return growableFunctionTables;
+	}
+
+	bool isSupported() const { return addTable && growTable && deleteTable; }
+
+private:
+	GrowableFunctionTables() : addTable(nullptr), growTable(nullptr), deleteTable(nullptr)
+	{
+		HMODULE ntdllModule = ::GetModuleHandleA("ntdll.dll");
+		if(ntdllModule)
+		{
+			addTable = (RtlAddGrowableFunctionTable)::GetProcAddress(
+				ntdllModule, "RtlAddGrowableFunctionTable");
+			growTable
+				= (RtlGrowFunctionTable)::GetProcAddress(ntdllModule, "RtlGrowFunctionTable");
+			deleteTable = (RtlDeleteGrowableFunctionTable)::GetProcAddress(
+				ntdllModule, "RtlDeleteGrowableFunctionTable");
+		}
+	}
+};
+#endif
+
+// The unwinder reads a growable table's entries from the array it was registered with, so the
+// array is reserved for the maximum number of entries, and committed as entries are added.
+struct Platform::GrowableEHFrameTable
+{
+	void* dynamicTable = nullptr;
+	Uptr imageBase;
+	Uptr numImageBytes;
+	U8* entries;
+	Uptr numEntries = 0;
+	Uptr maxNumEntries;
+	Uptr numCommittedBytes = 0;
+};
+
+GrowableEHFrameTable* Platform::createGrowableEHFrameTable(const U8* imageBase,
+														   Uptr numBytes,
+														   Uptr maxNumFunctions)
+{
+#ifdef _WIN64
+	if(!GrowableFunctionTables::get().isSupported() || numBytes > UINT32_MAX
+	   || maxNumFunctions > UINT32_MAX)
+	{ return nullptr; }
+
+	U8* entries = (U8*)VirtualAlloc(
+		nullptr, maxNumFunctions * sizeof(RUNTIME_FUNCTION), MEM_RESERVE, PAGE_NOACCESS);
+	if(!entries) { return nullptr; }
+
+	GrowableEHFrameTable* table = new GrowableEHFrameTable;
+	table->imageBase = reinterpret_cast<Uptr>(imageBase);
+	table->numImageBytes = numBytes;
+	table->entries = entries;
+	table->maxNumEntries = maxNumFunctions;
+	return table;
+#else
+	return nullptr;
+#endif
+}
+
+bool Platform::addGrowableEHFrames(GrowableEHFrameTable* table, const U8* ehFrames, Uptr numBytes)
+{
+#ifdef _WIN64
+	const RUNTIME_FUNCTION* newEntries = (const RUNTIME_FUNCTION*)ehFrames;
+	const Uptr numNewEntries = numBytes / sizeof(RUNTIME_FUNCTION);
+	if(!numNewEntries) { return true; }
+	if(numNewEntries > table->maxNumEntries - table->numEntries) { return false; }
+
+	// The unwinder binary searches the table, so the new entries must follow the existing entries.
+	RUNTIME_FUNCTION* entries = (RUNTIME_FUNCTION*)table->entries;
+	DWORD previousEndAddress = table->numEntries ? entries[table->numEntries - 1].EndAddress : 0;
+	for(Uptr entryIndex = 0; entryIndex < numNewEntries; ++entryIndex)
+	{
+		if(newEntries[entryIndex].BeginAddress < previousEndAddress) { return false; }
+		previousEndAddress = newEntries[entryIndex].EndAddress;
+	}
+	wavmAssert(previousEndAddress <= table->numImageBytes);
+
+	// Commit the pages of the array that the new entries are written to.
+	const Uptr numEntries = table->numEntries + numNewEntries;
+	const Uptr numEntryBytes = numEntries * sizeof(RUNTIME_FUNCTION);
+	if(numEntryBytes > table->numCommittedBytes)
+	{
+		const Uptr pageSize = Uptr(1) << getPageSizeLog2();
+		const Uptr numCommittedBytes = (numEntryBytes + pageSize - 1) & ~(pageSize - 1);
+		if(!VirtualAlloc(table->entries, numCommittedBytes, MEM_COMMIT, PAGE_READWRITE))
+		{ return false; }
+		table->numCommittedBytes = numCommittedBytes;
+	}
+
+	// Write the new entries, then tell the unwinder about them.
+	memcpy(entries + table->numEntries, newEntries, numNewEntries * sizeof(RUNTIME_FUNCTION));
+	const GrowableFunctionTables& growableFunctionTables = GrowableFunctionTables::get();
+	if(!table->dynamicTable)
+	{
+		if(growableFunctionTables.addTable(&table->dynamicTable,
+										   entries,
+										   DWORD(numEntries),
+										   DWORD(table->maxNumEntries),
+										   table->imageBase,
+										   table->imageBase + table->numImageBytes))
+		{
+			table->dynamicTable = nullptr;
+			return false;
+		}
+	}
+	else
+	{
+		growableFunctionTables.growTable(table->dynamicTable, DWORD(numEntries));
+	}
+
+	table->numEntries = numEntries;
+	return true;
+#else
+	Errors::unreachable();
+#endif
+}
+
+void Platform::destroyGrowableEHFrameTable(GrowableEHFrameTable* table)
+{
+#ifdef _WIN64
+	if(table->dynamicTable) { GrowableFunctionTables::get().deleteTable(table->dynamicTable); }
+	errorUnless(VirtualFree(table->entries, 0, MEM_RELEASE));
+	delete table;
+#else
+	Errors::unreachable();
+#endif
+}
+
 static bool translateSEHToSignal(EXCEPTION_POINTERS* exceptionPointers, Signal& outSignal)
 {
 	// Decide how to handle this exception code.
@@ -470,18 +937,32 @@ static bool translateSEHToSignal(EXCEPTION_POINTERS* exceptionPointers, Signal&
 	}
 }
 
+static std::atomic<bool> isExceptionCallStackCaptureEnabled{true};
+
+void Platform::setExceptionCallStackCaptureEnabled(bool enabled)
+{
+	isExceptionCallStackCaptureEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+static CallStack unwindExceptionStack(const CONTEXT& context)
+{
+	return isExceptionCallStackCaptureEnabled.load(std::memory_order_relaxed)
+			   ? unwindStack(context, 0)
+			   : CallStack();
+}
+
 // __try/__except doesn't support locals with destructors in the same function, so this is just
 // the body of the sehSignalFilterFunction __try pulled out into a function.
 static LONG CALLBACK
 sehSignalFilterFunctionNonReentrant(EXCEPTION_POINTERS* exceptionPointers,
-									const std::function<bool(Signal, const CallStack&)>& filter)
+									FunctionRef<bool(Signal, const CallStack&)> filter)
 {
 	Signal signal;
 	if(!translateSEHToSignal(exceptionPointers, signal)) { return EXCEPTION_CONTINUE_SEARCH; }
 	else
 	{
 		// Unwind the stack frames from the context of the exception.
-		CallStack callStack = unwindStack(*exceptionPointers->ContextRecord, 0);
+		CallStack callStack = unwindExceptionStack(*exceptionPointers->ContextRecord);
 
 		if(filter(signal, callStack)) { return EXCEPTION_EXECUTE_HANDLER; }
 		else
@@ -493,7 +974,7 @@ sehSignalFilterFunctionNonReentrant(EXCEPTION_POINTERS* exceptionPointers,
 
 static LONG CALLBACK
 sehSignalFilterFunction(EXCEPTION_POINTERS* exceptionPointers,
-						const std::function<bool(Signal, const CallStack&)>& filter)
+						FunctionRef<bool(Signal, const CallStack&)> filter)
 {
 	__try
 	{
@@ -505,8 +986,8 @@ sehSignalFilterFunction(EXCEPTION_POINTERS* exceptionPointers,
 	}
 }
 
-bool Platform::catchSignals(const std::function<void()>& thunk,
-							const std::function<bool(Signal, const CallStack&)>& filter)
+bool Platform::catchSignals(FunctionRef<void()> thunk,
+							FunctionRef<bool(Signal, const CallStack&)> filter)
 {
 	initThread();
 
@@ -548,7 +1029,7 @@ static LONG NTAPI unhandledExceptionFilterNonRentrant(struct _EXCEPTION_POINTERS
 	}
 
 	// Unwind the stack frames from the context of the exception.
-	CallStack callStack = unwindStack(*exceptionPointers->ContextRecord, 0);
+	CallStack callStack = unwindExceptionStack(*exceptionPointers->ContextRecord);
 
 	(signalHandler.load())(signal, callStack);
 
@@ -592,13 +1073,13 @@ static LONG CALLBACK sehPlatformExceptionFilterFunction(EXCEPTION_POINTERS* exce
 			= reinterpret_cast<void*>(exceptionPointers->ExceptionRecord->ExceptionInformation[0]);
 
 		// Unwind the stack frames from the context of the exception.
-		outCallStack = new CallStack(unwindStack(*exceptionPointers->ContextRecord, 0));
+		outCallStack = new CallStack(unwindExceptionStack(*exceptionPointers->ContextRecord));
 		return EXCEPTION_EXECUTE_HANDLER;
 	}
 }
 
-bool Platform::catchPlatformExceptions(const std::function<void()>& thunk,
-									   const std::function<void(void*, const CallStack&)>& handler)
+bool Platform::catchPlatformExceptions(FunctionRef<void()> thunk,
+									   FunctionRef<void(void*, const CallStack&)> handler)
 {
 	CallStack* callStack = nullptr;
 	void* exceptionData = nullptr;
@@ -619,9 +1100,19 @@ bool Platform::catchPlatformExceptions(const std::function<void()>& thunk,
 	}
 }
 
-[[noreturn]] void Platform::raisePlatformException(void* data)
+[[noreturn]] void Platform::raisePlatformException(const void* data, Uptr numDataBytes)
 {
-	ULONG_PTR arguments[1] = {reinterpret_cast<ULONG_PTR>(data)};
+	// The exception record doesn't outlive the filter, but the JITed catch code reads the data
+	// after the stack is unwound, so the data is always copied into a heap allocation that is freed
+	// by catchPlatformExceptions.
+	void* dataCopy = nullptr;
+	if(data)
+	{
+		dataCopy = malloc(numDataBytes);
+		memcpy(dataCopy, data, numDataBytes);
+	}
+
+	ULONG_PTR arguments[1] = {reinterpret_cast<ULONG_PTR>(dataCopy)};
 	RaiseException(U32(SEH_WAVM_EXCEPTION), 0, 1, arguments);
 	Errors::unreachable();
 }
@@ -748,7 +1239,8 @@ static std::vector<ProcessorGroupInfo> getProcessorGroupInfos()
 
 Platform::Thread* Platform::createThread(Uptr numStackBytes,
 										 I64 (*entry)(void*),
-										 void* entryArgument)
+										 void* entryArgument,
+										 Uptr numaNode)
 {
 	CreateThreadArgs* args = new CreateThreadArgs;
 	auto thread = new Thread;
@@ -768,10 +1260,17 @@ Platform::Thread* Platform::createThread(Uptr numStackBytes,
 	static std::vector<ProcessorGroupInfo> processorGroupInfos = getProcessorGroupInfos();
 	static std::atomic<U16> nextProcessorGroup{0};
 
+	// If the thread is assigned to a NUMA node, restrict it to the node's processors instead.
 	GROUP_AFFINITY groupAffinity;
 	memset(&groupAffinity, 0, sizeof(groupAffinity));
-	groupAffinity.Group = nextProcessorGroup++ % processorGroupInfos.size();
-	groupAffinity.Mask = (1ull << U64(processorGroupInfos[groupAffinity.Group].numProcessors)) - 1;
+	if(numaNode == UINTPTR_MAX || numaNode > UINT16_MAX
+	   || !GetNumaNodeProcessorMaskEx(USHORT(numaNode), &groupAffinity))
+	{
+		memset(&groupAffinity, 0, sizeof(groupAffinity));
+		groupAffinity.Group = nextProcessorGroup++ % processorGroupInfos.size();
+		groupAffinity.Mask
+			= (1ull << U64(processorGroupInfos[groupAffinity.Group].numProcessors)) - 1;
+	}
 	if(!SetThreadGroupAffinity(thread->handle, &groupAffinity, nullptr))
 	{ Errors::fatalf("SetThreadGroupAffinity failed: GetLastError=%x", GetLastError()); }
 
@@ -808,6 +1307,24 @@ I64 Platform::joinThread(Thread* thread)
 	return result;
 }
 
+void Platform::setMaxCachedThreadStackBytes(Uptr numBytes)
+{
+	// CreateThread doesn't allow the caller to provide the thread's stack, so there's nothing to
+	// cache: Windows reuses thread stacks itself.
+}
+
+void Platform::setMaxPooledThreads(Uptr numThreads)
+{
+	// Threads aren't pooled on Windows: a thread exits when its entry function returns.
+}
+
+Uptr Platform::getNumberOfHardwareThreads()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return Uptr(systemInfo.dwNumberOfProcessors);
+}
+
 void Platform::exitThread(I64 code) { throw ExitThreadException{code}; }
 
 #ifdef _WIN64
@@ -957,6 +1474,66 @@ Thread* Platform::forkCurrentThread()
 }
 #endif
 
+namespace WAVM { namespace Platform {
+	struct Fiber
+	{
+		void* handle = nullptr;
+		void (*entry)(void*) = nullptr;
+		void* argument = nullptr;
+	};
+}}
+
+static thread_local Fiber* currentFiber = nullptr;
+static thread_local std::unique_ptr<Fiber> threadFiber;
+
+static void CALLBACK fiberProc(void* fiberVoid)
+{
+	// The stack guarantee set by initThread only applies to the thread's own stack, so set it again
+	// for the fiber's stack.
+	ULONG stackOverflowReserveBytes = 32768;
+	SetThreadStackGuarantee(&stackOverflowReserveBytes);
+
+	Fiber* fiber = (Fiber*)fiberVoid;
+	(*fiber->entry)(fiber->argument);
+	Errors::fatal("Fiber entry function returned");
+}
+
+Fiber* Platform::createFiber(Uptr numStackBytes, void (*fiberEntry)(void*), void* argument)
+{
+	Fiber* fiber = new Fiber;
+	fiber->entry = fiberEntry;
+	fiber->argument = argument;
+	fiber->handle = CreateFiber(numStackBytes, fiberProc, fiber);
+	errorUnless(fiber->handle);
+	return fiber;
+}
+
+Fiber* Platform::getCurrentFiber()
+{
+	if(!currentFiber)
+	{
+		threadFiber.reset(new Fiber);
+		threadFiber->handle = IsThreadAFiber() ? GetCurrentFiber() : ConvertThreadToFiber(nullptr);
+		errorUnless(threadFiber->handle);
+		currentFiber = threadFiber.get();
+	}
+	return currentFiber;
+}
+
+void Platform::switchToFiber(Fiber* fiber)
+{
+	wavmAssert(fiber != getCurrentFiber());
+	currentFiber = fiber;
+	SwitchToFiber(fiber->handle);
+}
+
+void Platform::destroyFiber(Fiber* fiber)
+{
+	wavmAssert(fiber != currentFiber);
+	DeleteFiber(fiber->handle);
+	delete fiber;
+}
+
 U64 Platform::getMonotonicClock()
 {
 	LARGE_INTEGER performanceCounter;
@@ -1021,6 +1598,18 @@ bool Platform::Event::wait(U64 untilTime)
 
 void Platform::Event::signal() { errorUnless(SetEvent(handle)); }
 
+WaitOnAddressResult Platform::waitOnAddress(const U32* address,
+											U32 expectedValue,
+											U64 untilClock,
+											bool isProcessShared)
+{
+	// WakeByAddressSingle/WakeByAddressAll don't return the number of threads that were woken, so
+	// WaitOnAddress can't be used to implement wakeAddress.
+	return WaitOnAddressResult::unsupported;
+}
+
+Uptr Platform::wakeAddress(const U32* address, Uptr numToWake, bool isProcessShared) { return 0; }
+
 static File* fileHandleToPointer(HANDLE handle)
 {
 	return reinterpret_cast<File*>(reinterpret_cast<Uptr>(handle) + 1);
@@ -1129,11 +1718,73 @@ bool Platform::writeFile(File* file, const void* data, Uptr numBytes, Uptr* outN
 	return result != 0;
 }
 
+File* Platform::openSharedMemory(const std::string& name, FileCreateMode createMode)
+{
+	// Named file mapping objects can't be used as files, so this isn't supported on Windows.
+	return nullptr;
+}
+
+bool Platform::removeSharedMemory(const std::string& name) { return false; }
+
 bool Platform::flushFileWrites(File* file)
 {
 	return FlushFileBuffers(filePointerToHandle(file)) != 0;
 }
 
+bool Platform::getFileNumBytes(File* file, U64& outNumBytes)
+{
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(filePointerToHandle(file), &fileSize)) { return false; }
+	outNumBytes = U64(fileSize.QuadPart);
+	return true;
+}
+
+bool Platform::setFileNumBytes(File* file, U64 numBytes)
+{
+	if(numBytes > U64(INT64_MAX)) { return false; }
+	FILE_END_OF_FILE_INFO endOfFileInfo;
+	endOfFileInfo.EndOfFile.QuadPart = LONGLONG(numBytes);
+	return SetFileInformationByHandle(
+			   filePointerToHandle(file), FileEndOfFileInfo, &endOfFileInfo, sizeof(endOfFileInfo))
+		   != 0;
+}
+
+const U8* Platform::mapFile(File* file, Uptr& outNumBytes)
+{
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(filePointerToHandle(file), &fileSize) || fileSize.QuadPart <= 0
+	   || U64(fileSize.QuadPart) > UINTPTR_MAX)
+	{ return nullptr; }
+
+	HANDLE mappingHandle = CreateFileMappingW(
+		filePointerToHandle(file), nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(!mappingHandle) { return nullptr; }
+
+	// The view keeps the file mapping object alive, so the handle can be closed immediately.
+	void* result = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	errorUnless(CloseHandle(mappingHandle));
+	if(!result) { return nullptr; }
+
+	outNumBytes = Uptr(fileSize.QuadPart);
+	return (const U8*)result;
+}
+
+void Platform::unmapFile(const U8* baseAddress, Uptr numBytes)
+{
+	errorUnless(UnmapViewOfFile(baseAddress));
+}
+
+bool Platform::mapFileToVirtualPages(File* file,
+									 U64 fileOffset,
+									 U8* baseVirtualAddress,
+									 Uptr numPages,
+									 bool isShared)
+{
+	// Like cloneVirtualPagesCopyOnWrite, a file view mapped into a placeholder couldn't be partly
+	// decommitted, so mapping files into memories isn't supported on Windows.
+	return false;
+}
+
 std::string Platform::getCurrentWorkingDirectory()
 {
 	U16 buffer[MAX_PATH];
@@ -0,0 +1,117 @@
+#include <atomic>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Mutex.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// The address ranges owned by memories and tables are stored in an array of fixed-size segments.
+// Segments are allocated as needed and never freed, so getAddressOwnerKind, which is called when
+// translating access violation signals, can read the array without locking anything.
+struct OwnedAddressRange
+{
+	std::atomic<AddressOwnerKind> ownerKind{AddressOwnerKind::none};
+	std::atomic<U8*> baseAddress{nullptr};
+	std::atomic<Uptr> numBytes{0};
+};
+
+enum
+{
+	numRangesPerSegmentLog2 = 12,
+	numRangesPerSegment = Uptr(1) << numRangesPerSegmentLog2,
+	maxSegments = 1024
+};
+
+struct OwnedAddressRangeSegment
+{
+	OwnedAddressRange ranges[numRangesPerSegment];
+};
+
+static std::atomic<OwnedAddressRangeSegment*> segments[maxSegments];
+static std::atomic<Uptr> numRanges{0};
+
+// Protects adding and removing ranges. Taken only by the threads that create or destroy memories
+// and tables.
+static Platform::Mutex rangesMutex;
+static std::vector<Uptr> freeRangeIds;
+
+static OwnedAddressRange& getRange(Uptr rangeId)
+{
+	OwnedAddressRangeSegment* segment
+		= segments[rangeId >> numRangesPerSegmentLog2].load(std::memory_order_acquire);
+	wavmAssert(segment);
+	return segment->ranges[rangeId & (numRangesPerSegment - 1)];
+}
+
+Uptr Runtime::addOwnedAddressRange(U8* baseAddress, Uptr numBytes, AddressOwnerKind ownerKind)
+{
+	wavmAssert(ownerKind != AddressOwnerKind::none);
+
+	Lock<Platform::Mutex> rangesLock(rangesMutex);
+
+	// Reuse a removed range's slot if there is one, or allocate a new slot at the end of the array.
+	Uptr rangeId;
+	if(freeRangeIds.size())
+	{
+		rangeId = freeRangeIds.back();
+		freeRangeIds.pop_back();
+	}
+	else
+	{
+		rangeId = numRanges.load(std::memory_order_relaxed);
+		const Uptr segmentIndex = rangeId >> numRangesPerSegmentLog2;
+		if(segmentIndex >= maxSegments)
+		{ Errors::fatalf("Exceeded the maximum of %u owned address ranges\n", U32(rangeId)); }
+		if(!segments[segmentIndex].load(std::memory_order_relaxed))
+		{ segments[segmentIndex].store(new OwnedAddressRangeSegment, std::memory_order_release); }
+	}
+
+	// Write the range's bounds before publishing its owner kind, so a thread that sees the owner
+	// kind also sees the bounds.
+	OwnedAddressRange& range = getRange(rangeId);
+	wavmAssert(range.ownerKind.load(std::memory_order_relaxed) == AddressOwnerKind::none);
+	range.baseAddress.store(baseAddress, std::memory_order_relaxed);
+	range.numBytes.store(numBytes, std::memory_order_relaxed);
+	range.ownerKind.store(ownerKind, std::memory_order_release);
+
+	if(rangeId == numRanges.load(std::memory_order_relaxed))
+	{ numRanges.store(rangeId + 1, std::memory_order_release); }
+
+	return rangeId;
+}
+
+void Runtime::removeOwnedAddressRange(Uptr rangeId)
+{
+	Lock<Platform::Mutex> rangesLock(rangesMutex);
+
+	OwnedAddressRange& range = getRange(rangeId);
+	wavmAssert(range.ownerKind.load(std::memory_order_relaxed) != AddressOwnerKind::none);
+	range.ownerKind.store(AddressOwnerKind::none, std::memory_order_release);
+	freeRangeIds.push_back(rangeId);
+}
+
+AddressOwnerKind Runtime::getAddressOwnerKind(U8* address)
+{
+	// Iterate over all ranges and check if the address is within each. A range that is added or
+	// removed concurrently may or may not be seen, but the range containing an address that is
+	// being accessed by running code can't be removed until the object that owns it is destroyed.
+	const Uptr currentNumRanges = numRanges.load(std::memory_order_acquire);
+	for(Uptr rangeId = 0; rangeId < currentNumRanges; ++rangeId)
+	{
+		const OwnedAddressRange& range = getRange(rangeId);
+		const AddressOwnerKind ownerKind = range.ownerKind.load(std::memory_order_acquire);
+		if(ownerKind != AddressOwnerKind::none)
+		{
+			U8* startAddress = range.baseAddress.load(std::memory_order_relaxed);
+			U8* endAddress = startAddress + range.numBytes.load(std::memory_order_relaxed);
+			if(address >= startAddress && address < endAddress) { return ownerKind; }
+		}
+	}
+	return AddressOwnerKind::none;
+}
@@ -0,0 +1,270 @@
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// The number of bytes to reserve for the stack of the background compile threads: LLVM's
+// optimization passes are deeply recursive for some code.
+static constexpr Uptr compileThreadStackBytes = 8 * 1024 * 1024;
+
+// How long a thread waits for an event before checking its condition again. Platform::Event
+// doesn't remember signals that happen while no thread is waiting, so the threads can't wait
+// indefinitely.
+static constexpr U64 maxCompileWaitMicroseconds = 1000;
+
+enum
+{
+	numCompilePriorities = Uptr(CompilePriority::interactive) + 1
+};
+
+// The background compile threads are created on demand, and never exit. A thread is running a task
+// unless it is idle, or it yielded to a more urgent task; no more than maxRunningTasks tasks run at
+// once. Protected by compileThreadsMutex.
+static Platform::Mutex compileThreadsMutex;
+static std::deque<std::function<void()>> queuedTasks[numCompilePriorities];
+static Uptr numRunningTasks = 0;
+static Uptr numIdleThreads = 0;
+static Uptr maxRunningTasks = 0;
+static Platform::Event compileThreadsEvent;
+
+// The priority of the task that the calling thread is running, if it is a background compile
+// thread.
+static thread_local const CompilePriority* currentTaskPriority = nullptr;
+
+// Returns whether a task more urgent than priority is queued. Assumes compileThreadsMutex is
+// locked.
+static bool isMoreUrgentTaskQueued(CompilePriority priority)
+{
+	for(Uptr queuedPriority = Uptr(priority) + 1; queuedPriority < numCompilePriorities;
+		++queuedPriority)
+	{
+		if(queuedTasks[queuedPriority].size()) { return true; }
+	}
+	return false;
+}
+
+static Uptr getMaxRunningTasks()
+{
+	if(!maxRunningTasks) { maxRunningTasks = Platform::getNumberOfHardwareThreads(); }
+	return maxRunningTasks;
+}
+
+static I64 compileThreadEntry(void*);
+
+// Creates a background compile thread if there aren't any idle threads to run another task.
+// Assumes compileThreadsMutex is locked.
+static void ensureIdleCompileThread()
+{
+	if(numIdleThreads) { compileThreadsEvent.signal(); }
+	else
+	{
+		// The thread is counted as idle while it starts.
+		++numIdleThreads;
+		Platform::detachThread(
+			Platform::createThread(compileThreadStackBytes, compileThreadEntry, nullptr));
+	}
+}
+
+static I64 compileThreadEntry(void*)
+{
+	compileThreadsMutex.lock();
+	while(true)
+	{
+		// Find the most urgent queued task, unless the maximum number of tasks are running.
+		Uptr priorityIndex = numCompilePriorities;
+		if(numRunningTasks < getMaxRunningTasks())
+		{
+			for(Uptr index = numCompilePriorities; index > 0; --index)
+			{
+				if(queuedTasks[index - 1].size())
+				{
+					priorityIndex = index - 1;
+					break;
+				}
+			}
+		}
+		if(priorityIndex == numCompilePriorities)
+		{
+			compileThreadsMutex.unlock();
+			compileThreadsEvent.wait(Platform::getMonotonicClock() + maxCompileWaitMicroseconds);
+			compileThreadsMutex.lock();
+			continue;
+		}
+
+		const CompilePriority taskPriority = CompilePriority(priorityIndex);
+		std::function<void()> task = std::move(queuedTasks[priorityIndex].front());
+		queuedTasks[priorityIndex].pop_front();
+		--numIdleThreads;
+		++numRunningTasks;
+		compileThreadsMutex.unlock();
+
+		currentTaskPriority = &taskPriority;
+		task();
+		currentTaskPriority = nullptr;
+
+		compileThreadsMutex.lock();
+		--numRunningTasks;
+		++numIdleThreads;
+	}
+}
+
+void Runtime::queueCompileTask(CompilePriority priority, std::function<void()>&& task)
+{
+	Lock<Platform::Mutex> compileThreadsLock(compileThreadsMutex);
+	queuedTasks[Uptr(priority)].push_back(std::move(task));
+	ensureIdleCompileThread();
+}
+
+void Runtime::yieldCompileThread(CompilePriority priority)
+{
+	// Only the thread that is running a task gives up its place: the threads that LLVMJIT creates
+	// to compile the task's partitions in parallel aren't counted as running tasks.
+	if(!currentTaskPriority) { return; }
+	wavmAssert(*currentTaskPriority == priority);
+
+	compileThreadsMutex.lock();
+	if(isMoreUrgentTaskQueued(priority))
+	{
+		// Let another thread run the more urgent tasks, and wait until they have all started and
+		// there is room for this task to run again.
+		--numRunningTasks;
+		ensureIdleCompileThread();
+		while(isMoreUrgentTaskQueued(priority) || numRunningTasks >= getMaxRunningTasks())
+		{
+			compileThreadsMutex.unlock();
+			compileThreadsEvent.wait(Platform::getMonotonicClock() + maxCompileWaitMicroseconds);
+			compileThreadsMutex.lock();
+		}
+		++numRunningTasks;
+	}
+	compileThreadsMutex.unlock();
+}
+
+void Runtime::setMaxAsyncCompileThreads(Uptr maxThreads)
+{
+	wavmAssert(maxThreads > 0);
+	Lock<Platform::Mutex> compileThreadsLock(compileThreadsMutex);
+	maxRunningTasks = maxThreads;
+}
+
+struct Runtime::AsyncCompile : LLVMJIT::CompileMonitor
+{
+	const IR::Module irModule;
+	const CompileOptions options;
+	const CompilePriority priority;
+	std::function<void(Module*)> onFinished;
+
+	std::atomic<Uptr> numFunctionDefsEmitted{0};
+	std::atomic<Uptr> numFunctionDefsCompiled{0};
+	std::atomic<bool> isCancelled{false};
+
+	// Protected by finishedMutex.
+	Platform::Mutex finishedMutex;
+	Platform::Event finishedEvent;
+	bool isFinished = false;
+	Module* module = nullptr;
+
+	AsyncCompile(const IR::Module& inIRModule,
+				 const CompileOptions& inOptions,
+				 CompilePriority inPriority,
+				 std::function<void(Module*)>&& inOnFinished)
+	: irModule(inIRModule)
+	, options(inOptions)
+	, priority(inPriority)
+	, onFinished(std::move(inOnFinished))
+	{
+	}
+
+	bool beginPartition() override
+	{
+		yieldCompileThread(priority);
+		return !isCancelled.load(std::memory_order_relaxed);
+	}
+	void onFunctionDefsEmitted(Uptr numFunctionDefs) override
+	{
+		numFunctionDefsEmitted += numFunctionDefs;
+	}
+	void onFunctionDefsCompiled(Uptr numFunctionDefs) override
+	{
+		numFunctionDefsCompiled += numFunctionDefs;
+	}
+
+	void run()
+	{
+		Module* compiledModule = nullptr;
+		if(!isCancelled.load(std::memory_order_relaxed))
+		{
+			compiledModule = compileModuleWithMonitor(irModule, options, this);
+			if(compiledModule)
+			{
+				numFunctionDefsEmitted.store(irModule.functions.defs.size());
+				numFunctionDefsCompiled.store(irModule.functions.defs.size());
+			}
+		}
+		if(onFinished) { onFinished(compiledModule); }
+
+		// Once isFinished is set, finishAsyncCompile may delete the compile, but it must lock
+		// finishedMutex first.
+		Lock<Platform::Mutex> finishedLock(finishedMutex);
+		module = compiledModule;
+		isFinished = true;
+		finishedEvent.signal();
+	}
+};
+
+AsyncCompile* Runtime::compileModuleAsync(const IR::Module& irModule,
+										  const CompileOptions& options,
+										  CompilePriority priority,
+										  std::function<void(Module*)>&& onFinished)
+{
+	AsyncCompile* compile = new AsyncCompile(irModule, options, priority, std::move(onFinished));
+	queueCompileTask(priority, [compile] { compile->run(); });
+	return compile;
+}
+
+AsyncCompileProgress Runtime::getAsyncCompileProgress(AsyncCompile* compile)
+{
+	AsyncCompileProgress progress;
+	progress.numFunctionDefs = compile->irModule.functions.defs.size();
+	progress.numFunctionDefsEmitted = compile->numFunctionDefsEmitted.load();
+	progress.numFunctionDefsCompiled = compile->numFunctionDefsCompiled.load();
+
+	Lock<Platform::Mutex> finishedLock(compile->finishedMutex);
+	progress.isFinished = compile->isFinished;
+	return progress;
+}
+
+void Runtime::cancelAsyncCompile(AsyncCompile* compile)
+{
+	compile->isCancelled.store(true, std::memory_order_relaxed);
+}
+
+Module* Runtime::finishAsyncCompile(AsyncCompile* compile)
+{
+	compile->finishedMutex.lock();
+	while(!compile->isFinished)
+	{
+		compile->finishedMutex.unlock();
+		compile->finishedEvent.wait(Platform::getMonotonicClock() + maxCompileWaitMicroseconds);
+		compile->finishedMutex.lock();
+	}
+	Module* module = compile->module;
+	compile->finishedMutex.unlock();
+
+	delete compile;
+	return module;
+}
@@ -1,18 +1,15 @@
 #include <stdint.h>
-#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <memory>
 #include <utility>
-#include <vector>
 
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
-#include "WAVM/Inline/Hash.h"
-#include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -21,58 +18,85 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
-// Holds a list of threads (in the form of events that will wake them) that
-// are waiting on a specific address.
-struct WaitList
+// A thread that is waiting on an address. Waiters are allocated on the waiting thread's stack, and
+// linked into the wait list shard for the address while the thread is waiting.
+struct Waiter
 {
-	Platform::Mutex mutex;
-	std::vector<Platform::Event*> wakeEvents;
-	std::atomic<Uptr> numReferences;
-
-	WaitList() : numReferences(1) {}
+	Uptr address;
+	Platform::Event* wakeEvent;
+	Waiter* previous;
+	Waiter* next;
+	bool isWaiting;
 };
 
-// An event that is reused within a thread when it waits on a WaitList.
-thread_local std::unique_ptr<Platform::Event> threadWakeEvent = nullptr;
+// A list of the threads waiting on any address that hashes to the shard, in the order they started
+// waiting. The shards are aligned to cache lines so threads waiting on addresses in different
+// shards don't contend on the same cache line.
+struct alignas(Platform::numCacheLineBytes) WaitListShard
+{
+	Platform::Mutex mutex;
+	Waiter* first = nullptr;
+	Waiter* last = nullptr;
 
-// A map from address to a list of threads waiting on that address.
-static Platform::Mutex addressToWaitListMapMutex;
-static HashMap<Uptr, WaitList*> addressToWaitListMap;
+	// The number of threads waiting on addresses in the shard, either in the list of waiters or
+	// in Platform::waitOnAddress. wakeAddress doesn't lock the shard or make any system calls if
+	// these are zero.
+	std::atomic<Uptr> numListWaiters{0};
+	std::atomic<Uptr> numNativeWaiters{0};
 
-// Opens the wait list for a given address.
-// Increases the wait list's reference count, and returns a pointer to it.
-// Note that it does not lock the wait list mutex.
-// A call to openWaitList should be followed by a call to closeWaitList to avoid leaks.
-static WaitList* openWaitList(Uptr address)
-{
-	Lock<Platform::Mutex> mapLock(addressToWaitListMapMutex);
-	auto waitListPtr = addressToWaitListMap.get(address);
-	if(waitListPtr)
+	// Adds a waiter to the list. The caller must have already incremented numListWaiters.
+	void add(Waiter* waiter)
 	{
-		++(*waitListPtr)->numReferences;
-		return *waitListPtr;
-	}
-	else
-	{
-		WaitList* waitList = new WaitList();
-		addressToWaitListMap.set(address, waitList);
-		return waitList;
+		wavmAssert(!waiter->isWaiting);
+		waiter->previous = last;
+		waiter->next = nullptr;
+		if(last) { last->next = waiter; }
+		else
+		{
+			first = waiter;
+		}
+		last = waiter;
+		waiter->isWaiting = true;
 	}
-}
 
-// Closes a wait list, deleting it and removing it from the global map if it was the last reference.
-static void closeWaitList(Uptr address, WaitList* waitList)
-{
-	if(--waitList->numReferences == 0)
+	void remove(Waiter* waiter)
 	{
-		Lock<Platform::Mutex> mapLock(addressToWaitListMapMutex);
-		if(!waitList->numReferences)
+		wavmAssert(waiter->isWaiting);
+		if(waiter->previous) { waiter->previous->next = waiter->next; }
+		else
+		{
+			first = waiter->next;
+		}
+		if(waiter->next) { waiter->next->previous = waiter->previous; }
+		else
 		{
-			wavmAssert(!waitList->wakeEvents.size());
-			delete waitList;
-			addressToWaitListMap.remove(address);
+			last = waiter->previous;
 		}
+		waiter->isWaiting = false;
+		--numListWaiters;
 	}
+};
+
+enum
+{
+	numWaitListShardsLog2 = 8,
+	numWaitListShards = Uptr(1) << numWaitListShardsLog2
+};
+
+static WaitListShard waitListShards[numWaitListShards];
+
+// Whether Platform::waitOnAddress is supported. 32-bit waits use it if it is supported, and only
+// 64-bit waits use the wait list shards' lists of waiters.
+static std::atomic<bool> isNativeWaitOnAddressSupported{true};
+
+// An event that is reused within a thread when it waits on an address.
+thread_local std::unique_ptr<Platform::Event> threadWakeEvent = nullptr;
+
+static WaitListShard& getWaitListShard(Uptr address)
+{
+	// Use the Fibonacci hash of the address to pick a shard.
+	const U64 hash = U64(address) * 0x9e3779b97f4a7c15ull;
+	return waitListShards[hash >> (64 - numWaitListShardsLog2)];
 }
 
 // Loads a value from memory with seq_cst memory order.
@@ -115,18 +139,22 @@ static U32 waitOnAddress(Value* valuePointer, Value expectedValue, F64 timeout)
 {
 	const U64 endTime = getEndTimeFromTimeout(Platform::getMonotonicClock(), timeout);
 
-	// Open the wait list for this address.
+	// Lock the wait list shard for this address, and check that *valuePointer is still what the
+	// caller expected it to be.
 	const Uptr address = reinterpret_cast<Uptr>(valuePointer);
-	WaitList* waitList = openWaitList(address);
-
-	// Lock the wait list, and check that *valuePointer is still what the caller expected it to be.
+	WaitListShard& shard = getWaitListShard(address);
+	Waiter waiter;
+	waiter.isWaiting = false;
 	{
-		Lock<Platform::Mutex> waitListLock(waitList->mutex);
+		Lock<Platform::Mutex> shardLock(shard.mutex);
+
+		// Count the thread as waiting before checking *valuePointer, so a wakeAddress that runs
+		// after *valuePointer is changed sees the waiter.
+		++shard.numListWaiters;
 		if(atomicLoad(valuePointer) != expectedValue)
 		{
-			// If *valuePointer wasn't the expected value, unlock the wait list and return.
-			waitListLock.unlock();
-			closeWaitList(address, waitList);
+			// If *valuePointer wasn't the expected value, unlock the shard and return.
+			--shard.numListWaiters;
 			return 1;
 		}
 		else
@@ -135,9 +163,10 @@ static U32 waitOnAddress(Value* valuePointer, Value expectedValue, F64 timeout)
 			if(!threadWakeEvent)
 			{ threadWakeEvent = std::unique_ptr<Platform::Event>(new Platform::Event()); }
 
-			// Add the wake event to the wait list, and unlock the wait list.
-			waitList->wakeEvents.push_back(threadWakeEvent.get());
-			waitListLock.unlock();
+			// Add the thread to the shard's waiters, and unlock the shard.
+			waiter.address = address;
+			waiter.wakeEvent = threadWakeEvent.get();
+			shard.add(&waiter);
 		}
 	}
 
@@ -145,55 +174,95 @@ static U32 waitOnAddress(Value* valuePointer, Value expectedValue, F64 timeout)
 	bool timedOut = false;
 	if(!threadWakeEvent->wait(endTime))
 	{
-		// If the wait timed out, lock the wait list and check if the thread's wake event is still
-		// in the wait list.
-		Lock<Platform::Mutex> waitListLock(waitList->mutex);
-		auto wakeEventIt = std::find(
-			waitList->wakeEvents.begin(), waitList->wakeEvents.end(), threadWakeEvent.get());
-		if(wakeEventIt != waitList->wakeEvents.end())
+		// If the wait timed out, lock the shard and check if the thread is still waiting.
+		Lock<Platform::Mutex> shardLock(shard.mutex);
+		if(waiter.isWaiting)
 		{
-			// If the event was still on the wait list, remove it, and return the "timed out"
-			// result.
-			waitList->wakeEvents.erase(wakeEventIt);
+			// If the thread was still waiting, remove it from the shard's waiters, and return the
+			// "timed out" result.
+			shard.remove(&waiter);
 			timedOut = true;
 		}
 		else
 		{
-			// In between the wait timing out and locking the wait list, some other thread tried to
+			// In between the wait timing out and locking the shard, some other thread tried to
 			// wake this thread. The event will now be signaled, so use an immediately expiring wait
 			// on it to reset it.
 			errorUnless(threadWakeEvent->wait(Platform::getMonotonicClock()));
 		}
 	}
 
-	closeWaitList(address, waitList);
 	return timedOut ? 2 : 0;
 }
 
-static U32 wakeAddress(Uptr address, U32 numToWake)
+// Waits on a 32-bit value, using Platform::waitOnAddress if it is supported. If isProcessShared is
+// true, the wait may be woken by threads in other processes that map the same memory.
+static U32 waitOnAddress32(I32* valuePointer, I32 expectedValue, F64 timeout, bool isProcessShared)
+{
+	if(isNativeWaitOnAddressSupported.load(std::memory_order_relaxed))
+	{
+		const U64 endTime = getEndTimeFromTimeout(Platform::getMonotonicClock(), timeout);
+
+		// Count the thread as waiting before Platform::waitOnAddress checks *valuePointer.
+		WaitListShard& shard = getWaitListShard(reinterpret_cast<Uptr>(valuePointer));
+		++shard.numNativeWaiters;
+		const Platform::WaitOnAddressResult result = Platform::waitOnAddress(
+			(const U32*)valuePointer, U32(expectedValue), endTime, isProcessShared);
+		--shard.numNativeWaiters;
+
+		switch(result)
+		{
+		case Platform::WaitOnAddressResult::woken: return 0;
+		case Platform::WaitOnAddressResult::notEqual: return 1;
+		case Platform::WaitOnAddressResult::timedOut: return 2;
+		case Platform::WaitOnAddressResult::unsupported:
+			isNativeWaitOnAddressSupported.store(false, std::memory_order_relaxed);
+			break;
+		default: Errors::unreachable();
+		};
+	}
+
+	return waitOnAddress(valuePointer, expectedValue, timeout);
+}
+
+static U32 wakeAddress(Uptr address, U32 numToWake, bool isProcessShared)
 {
 	if(numToWake == 0) { return 0; }
 
-	// Open the wait list for this address.
-	WaitList* waitList = openWaitList(address);
-	Uptr actualNumToWake = numToWake;
-	{
-		Lock<Platform::Mutex> waitListLock(waitList->mutex);
+	WaitListShard& shard = getWaitListShard(address);
+	Uptr actualNumToWake = 0;
 
-		// Determine how many threads to wake.
-		// numToWake==UINT32_MAX means wake all waiting threads.
-		if(actualNumToWake == UINT32_MAX || actualNumToWake > waitList->wakeEvents.size())
-		{ actualNumToWake = waitList->wakeEvents.size(); }
+	// Wake the threads waiting on the address in Platform::waitOnAddress. Threads in other
+	// processes aren't counted in numNativeWaiters, so always wake a process-shared address.
+	if(shard.numNativeWaiters.load() || isProcessShared)
+	{
+		actualNumToWake = Platform::wakeAddress(reinterpret_cast<const U32*>(address),
+												numToWake == UINT32_MAX ? UINTPTR_MAX : numToWake,
+												isProcessShared);
+	}
 
-		// Signal the events corresponding to the oldest waiting threads.
-		for(Uptr wakeIndex = 0; wakeIndex < actualNumToWake; ++wakeIndex)
-		{ waitList->wakeEvents[wakeIndex]->signal(); }
+	// Wake the threads waiting on the address in the shard's list of waiters.
+	if((numToWake == UINT32_MAX || actualNumToWake < numToWake) && shard.numListWaiters.load())
+	{
+		Lock<Platform::Mutex> shardLock(shard.mutex);
 
-		// Remove the events from the wait list.
-		waitList->wakeEvents.erase(waitList->wakeEvents.begin(),
-								   waitList->wakeEvents.begin() + actualNumToWake);
+		// Wake the oldest threads waiting on the address, up to numToWake of them.
+		// numToWake==UINT32_MAX means wake all waiting threads.
+		Waiter* nextWaiter = shard.first;
+		while(nextWaiter && (numToWake == UINT32_MAX || actualNumToWake < numToWake))
+		{
+			Waiter* waiter = nextWaiter;
+			nextWaiter = waiter->next;
+			if(waiter->address == address)
+			{
+				// Remove the waiter from the shard before signaling its event: once the event is
+				// signaled, the waiting thread may return and free the Waiter.
+				shard.remove(waiter);
+				waiter->wakeEvent->signal();
+				++actualNumToWake;
+			}
+		}
 	}
-	closeWaitList(address, waitList);
 
 	if(actualNumToWake > UINT32_MAX)
 	{ Runtime::throwException(Runtime::Exception::integerDivideByZeroOrOverflowType); }
@@ -213,28 +282,34 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "atomic_wake",
 						  I32,
 						  atomic_wake,
-						  U32 addressOffset,
+						  U64 addressOffset,
 						  I32 numToWake,
 						  Iptr memoryId)
 {
 	MemoryInstance* memoryInstance = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
 
 	// Validate that the address is within the memory's bounds.
-	if(U64(addressOffset) + 4 > U64(memoryInstance->numPages) * IR::numBytesPerPage)
+	const U64 memoryNumBytes = U64(memoryInstance->numPages) * IR::numBytesPerPage;
+	if(memoryNumBytes < 4 || addressOffset > memoryNumBytes - 4)
 	{ throwException(Exception::memoryAddressOutOfBoundsType); }
 
 	// The alignment check is done by the caller.
 	wavmAssert(!(addressOffset & 3));
 
+	// Generated code only calls this if the address's waiter count is non-zero, but other callers
+	// may not check it.
+	if(!memoryInstance->waiterCounts[getMemoryWaiterCountIndex(U32(addressOffset))].load())
+	{ return 0; }
+
 	const Uptr address = reinterpret_cast<Uptr>(memoryInstance->baseAddress) + addressOffset;
-	return wakeAddress(address, numToWake);
+	return wakeAddress(address, numToWake, memoryInstance->isProcessShared);
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "atomic_wait_i32",
 						  I32,
 						  atomic_wait_I32,
-						  U32 addressOffset,
+						  U64 addressOffset,
 						  I32 expectedValue,
 						  F64 timeout,
 						  Iptr memoryId)
@@ -247,13 +322,21 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 	// Validate that the address is within the memory's bounds, and convert it to a pointer.
 	I32* valuePointer = &memoryRef<I32>(memoryInstance, addressOffset);
 
-	return waitOnAddress(valuePointer, expectedValue, timeout);
+	// Count the thread as waiting before checking *valuePointer, so an atomic.notify that runs
+	// after *valuePointer is changed calls into the runtime to wake it.
+	std::atomic<Uptr>& waiterCount
+		= memoryInstance->waiterCounts[getMemoryWaiterCountIndex(U32(addressOffset))];
+	++waiterCount;
+	const U32 result
+		= waitOnAddress32(valuePointer, expectedValue, timeout, memoryInstance->isProcessShared);
+	--waiterCount;
+	return result;
 }
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "atomic_wait_i64",
 						  I32,
 						  atomic_wait_i64,
-						  I32 addressOffset,
+						  U64 addressOffset,
 						  I64 expectedValue,
 						  F64 timeout,
 						  Iptr memoryId)
@@ -266,7 +349,12 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 	// Validate that the address is within the memory's bounds, and convert it to a pointer.
 	I64* valuePointer = &memoryRef<I64>(memoryInstance, addressOffset);
 
-	return waitOnAddress(valuePointer, expectedValue, timeout);
+	std::atomic<Uptr>& waiterCount
+		= memoryInstance->waiterCounts[getMemoryWaiterCountIndex(U32(addressOffset))];
+	++waiterCount;
+	const U32 result = waitOnAddress(valuePointer, expectedValue, timeout);
+	--waiterCount;
+	return result;
 }
 
 void Runtime::dummyReferenceAtomics()
@@ -1,11 +1,14 @@
 #include <stddef.h>
 #include <atomic>
+#include <memory>
 #include <vector>
 
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Logging/Metrics.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -14,13 +17,68 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
-Runtime::Compartment::Compartment()
+static Metrics::Gauge committedBytesGauge(
+	"runtime.compartment_committed_bytes",
+	"Number of bytes committed to all compartments' memories, tables, contexts, and JIT code");
+static Metrics::Counter memoryLimitFailureCounter(
+	"runtime.compartment_memory_limit_failures",
+	"Number of commits that failed because they would exceed a compartment's memory limit");
+
+bool CompartmentMemoryBudget::charge(Uptr numBytes)
+{
+	Uptr previousNumBytes = numCommittedBytes.load(std::memory_order_acquire);
+	do
+	{
+		const Uptr maxNumBytes = maxCommittedBytes.load(std::memory_order_acquire);
+		if(previousNumBytes > maxNumBytes || numBytes > maxNumBytes - previousNumBytes)
+		{
+			memoryLimitFailureCounter.add(1);
+			return false;
+		}
+	} while(!numCommittedBytes.compare_exchange_weak(previousNumBytes,
+													 previousNumBytes + numBytes,
+													 std::memory_order_acq_rel,
+													 std::memory_order_acquire));
+
+	committedBytesGauge.add(I64(numBytes));
+	addGCAllocatedBytes(numBytes);
+	return true;
+}
+
+void CompartmentMemoryBudget::release(Uptr numBytes)
+{
+	wavmAssert(numCommittedBytes.load(std::memory_order_acquire) >= numBytes);
+	numCommittedBytes.fetch_sub(numBytes, std::memory_order_acq_rel);
+	committedBytesGauge.add(-I64(numBytes));
+}
+
+Uptr Runtime::getTotalCommittedCompartmentBytes()
+{
+	const I64 numBytes = committedBytesGauge.get();
+	return numBytes > 0 ? Uptr(numBytes) : 0;
+}
+
+Runtime::Compartment::Compartment(bool inUseLargePages,
+									Uptr inNUMANode,
+									bool inPackJITCode,
+									Compartment* inSourceCompartment)
 : ObjectImplWithAnyRef(ObjectKind::compartment)
 , unalignedRuntimeData(nullptr)
 , memories(0, maxMemories)
 , tables(0, maxTables)
 , contexts(0, maxContexts)
+, numUsedMutableGlobalIds(0)
+, numContextRuntimeDataBytes(inSourceCompartment ? inSourceCompartment->numContextRuntimeDataBytes
+												 : 0)
+, memoryBudget(std::make_shared<CompartmentMemoryBudget>())
+, useLargePages(inUseLargePages)
+, numaNode(inNUMANode)
+, packJITCode(inPackJITCode)
+, sourceCompartment(inSourceCompartment)
+, numClonedCompartments(0)
 {
+	if(sourceCompartment) { ++sourceCompartment->numClonedCompartments; }
+
 	runtimeData = (CompartmentRuntimeData*)Platform::allocateAlignedVirtualPages(
 		compartmentReservedBytes >> Platform::getPageSizeLog2(),
 		compartmentRuntimeDataAlignmentLog2,
@@ -29,9 +87,12 @@ Runtime::Compartment::Compartment()
 	errorUnless(Platform::commitVirtualPages(
 		(U8*)runtimeData,
 		offsetof(CompartmentRuntimeData, contexts) >> Platform::getPageSizeLog2()));
+	errorUnless(memoryBudget->charge(offsetof(CompartmentRuntimeData, contexts)));
 
 	runtimeData->compartment = this;
 
+	codeArena = LLVMJIT::createCodeArena(packJITCode);
+
 	wavmIntrinsics = instantiateWAVMIntrinsics(this);
 }
 
@@ -42,24 +103,84 @@ Runtime::Compartment::~Compartment()
 	Platform::freeAlignedVirtualPages(unalignedRuntimeData,
 									  compartmentReservedBytes >> Platform::getPageSizeLog2(),
 									  compartmentRuntimeDataAlignmentLog2);
+	// Release the runtime data and the pages of every context that was created in the compartment:
+	// the pages of finalized contexts are left committed until now.
+	memoryBudget->release(offsetof(CompartmentRuntimeData, contexts)
+						  + (contexts.size() + freeContextIds.size()) * numContextRuntimeDataBytes);
 	runtimeData = nullptr;
 	unalignedRuntimeData = nullptr;
+
+	// The arena is freed once the JIT modules of the compartment's module instances are unloaded,
+	// which may happen after the compartment is deleted.
+	LLVMJIT::releaseCodeArena(codeArena);
+	codeArena = nullptr;
 }
 
-Compartment* Runtime::createCompartment() { return new Compartment(); }
+void Runtime::Compartment::finalize()
+{
+	// The source compartment is deleted after this compartment is finalized if it is garbage too,
+	// so it is still valid here.
+	if(sourceCompartment)
+	{
+		wavmAssert(sourceCompartment->numClonedCompartments > 0);
+		--sourceCompartment->numClonedCompartments;
+	}
+}
+
+Compartment* Runtime::createCompartment(bool useLargePages, Uptr numaNode, bool packJITCode)
+{
+	return new Compartment(useLargePages, numaNode, packJITCode);
+}
+
+Uptr Runtime::getCompartmentNUMANode(const Compartment* compartment)
+{
+	return compartment->numaNode;
+}
+
+void Runtime::setCompartmentMemoryLimit(Compartment* compartment, Uptr maxCommittedBytes)
+{
+	compartment->memoryBudget->maxCommittedBytes.store(maxCommittedBytes,
+													   std::memory_order_release);
+}
+
+Uptr Runtime::getCompartmentCommittedBytes(const Compartment* compartment)
+{
+	return compartment->memoryBudget->numCommittedBytes.load(std::memory_order_acquire);
+}
 
 Compartment* Runtime::cloneCompartment(Compartment* compartment)
 {
-	Compartment* newCompartment = new Compartment;
+	HashMap<Object*, Object*> clonedObjects;
+	return cloneCompartment(compartment, clonedObjects);
+}
+
+Compartment* Runtime::cloneCompartment(Compartment* compartment,
+									   HashMap<Object*, Object*>& outClonedObjects,
+									   bool isLinkedToSource)
+{
+	Compartment* newCompartment
+		= new Compartment(compartment->useLargePages,
+						  compartment->numaNode,
+						  compartment->packJITCode,
+						  isLinkedToSource ? compartment : nullptr);
+	newCompartment->numContextRuntimeDataBytes = compartment->numContextRuntimeDataBytes;
+	setCompartmentMemoryLimit(
+		newCompartment,
+		compartment->memoryBudget->maxCommittedBytes.load(std::memory_order_acquire));
 
 	Lock<Platform::Mutex> lock(compartment->mutex);
 
 	// Clone globals.
 	newCompartment->globalDataAllocationMask = compartment->globalDataAllocationMask;
+	newCompartment->numUsedMutableGlobalIds = compartment->numUsedMutableGlobalIds;
+	memcpy(newCompartment->initialContextMutableGlobals,
+		   compartment->initialContextMutableGlobals,
+		   sizeof(IR::UntaggedValue) * compartment->numUsedMutableGlobalIds);
 	for(GlobalInstance* global : compartment->globals)
 	{
 		GlobalInstance* newGlobal = cloneGlobal(global, newCompartment);
 		wavmAssert(newGlobal->mutableGlobalId == global->mutableGlobalId);
+		outClonedObjects.addOrFail(global, newGlobal);
 	}
 
 	// Clone memories.
@@ -67,6 +188,7 @@ Compartment* Runtime::cloneCompartment(Compartment* compartment)
 	{
 		MemoryInstance* newMemory = cloneMemory(memory, newCompartment);
 		wavmAssert(newMemory->id == memory->id);
+		outClonedObjects.addOrFail(memory, newMemory);
 	}
 
 	// Clone tables.
@@ -74,11 +196,45 @@ Compartment* Runtime::cloneCompartment(Compartment* compartment)
 	{
 		TableInstance* newTable = cloneTable(table, newCompartment);
 		wavmAssert(newTable->id == table->id);
+		outClonedObjects.addOrFail(table, newTable);
 	}
 
 	return newCompartment;
 }
 
+Compartment* Runtime::getOwnerCompartment(Object* object)
+{
+	switch(object->kind)
+	{
+	case ObjectKind::function: return asFunction(object)->compartment;
+	case ObjectKind::table: return asTable(object)->compartment;
+	case ObjectKind::memory: return asMemory(object)->compartment;
+	case ObjectKind::global: return asGlobal(object)->compartment;
+	case ObjectKind::moduleInstance: return asModuleInstance(object)->compartment;
+	case ObjectKind::context: return asContext(object)->compartment;
+	case ObjectKind::compartment: return asCompartment(object);
+
+	// Modules and exception types may be shared by all compartments.
+	case ObjectKind::module:
+	case ObjectKind::exceptionTypeInstance: return nullptr;
+
+	default: Errors::unreachable();
+	};
+}
+
+bool Runtime::isInCompartment(Object* object, const Compartment* compartment)
+{
+	const Compartment* ownerCompartment = getOwnerCompartment(object);
+	if(!ownerCompartment) { return true; }
+
+	// A compartment may also reference the objects in the compartments it was cloned from.
+	for(; compartment; compartment = compartment->sourceCompartment)
+	{
+		if(compartment == ownerCompartment) { return true; }
+	}
+	return false;
+}
+
 Uptr Runtime::getCompartmentTableId(const TableInstance* table) { return table->id; }
 
 Uptr Runtime::getCompartmentMemoryId(const MemoryInstance* memory) { return memory->id; }
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <algorithm>
 #include <atomic>
 #include <vector>
 
@@ -21,23 +22,76 @@ Context* Runtime::createContext(Compartment* compartment)
 	{
 		Lock<Platform::Mutex> lock(compartment->mutex);
 
-		// Allocate an ID for the context in the compartment.
-		context->id = compartment->contexts.add(UINTPTR_MAX, context);
-		if(context->id == UINTPTR_MAX)
+		if(compartment->freeContextIds.size())
 		{
-			delete context;
-			return nullptr;
+			// Reuse the ID of a finalized context, whose runtime data pages are still committed.
+			context->id = compartment->freeContextIds.back();
+			compartment->freeContextIds.pop_back();
+			compartment->contexts.insertOrFail(context->id, context);
+			context->runtimeData = compartment->getContextRuntimeData(context->id);
 		}
-		context->runtimeData = &compartment->runtimeData->contexts[context->id];
+		else
+		{
+			// If this is the compartment's first context, choose the size of its contexts' runtime
+			// data: enough pages to hold the mutable globals that have been allocated so far.
+			if(!compartment->numContextRuntimeDataBytes)
+			{
+				const Uptr numUsedBytes
+					= offsetof(ContextRuntimeData, mutableGlobals)
+					  + sizeof(IR::UntaggedValue) * compartment->numUsedMutableGlobalIds;
+				compartment->numContextRuntimeDataBytes
+					= std::max(Uptr(minContextRuntimeDataBytes),
+							   (numUsedBytes + minContextRuntimeDataBytes - 1)
+								   & ~Uptr(minContextRuntimeDataBytes - 1));
+			}
+
+			// Allocate an ID for the context in the compartment. Since the IDs of all finalized
+			// contexts are reused first, this is an ID that hasn't been used before. The IDs are
+			// limited by how many contexts of the compartment's size fit in its reserved bytes.
+			context->id = compartment->contexts.add(UINTPTR_MAX, context);
+			const Uptr numContextBytes = compartmentReservedBytes
+										 - offsetof(CompartmentRuntimeData, contexts);
+			if(context->id != UINTPTR_MAX
+			   && context->id >= numContextBytes / compartment->numContextRuntimeDataBytes)
+			{
+				compartment->contexts.removeOrFail(context->id);
+				context->id = UINTPTR_MAX;
+			}
 
-		// Commit the page(s) for the context's runtime data.
-		errorUnless(Platform::commitVirtualPages(
-			(U8*)context->runtimeData, sizeof(ContextRuntimeData) >> Platform::getPageSizeLog2()));
+			// Charge the context's runtime data to the compartment's memory budget. The pages stay
+			// committed until the compartment is deleted, which releases them from the budget.
+			if(context->id != UINTPTR_MAX
+			   && !compartment->memoryBudget->charge(compartment->numContextRuntimeDataBytes))
+			{
+				compartment->contexts.removeOrFail(context->id);
+				context->id = UINTPTR_MAX;
+			}
+			if(context->id == UINTPTR_MAX)
+			{
+				delete context;
+				return nullptr;
+			}
+			context->runtimeData = compartment->getContextRuntimeData(context->id);
+
+			// Commit the page(s) for the context's runtime data.
+			errorUnless(Platform::commitVirtualPages(
+				(U8*)context->runtimeData,
+				compartment->numContextRuntimeDataBytes >> Platform::getPageSizeLog2()));
+		}
 
-		// Initialize the context's global data.
+		// Initialize the context's global data. Only the mutable global IDs that have been
+		// allocated need to be copied: createGlobal initializes the value of a newly allocated
+		// global in every context.
 		memcpy(context->runtimeData->mutableGlobals,
 			   compartment->initialContextMutableGlobals,
-			   maxGlobalBytes);
+			   sizeof(IR::UntaggedValue) * compartment->numUsedMutableGlobalIds);
+
+		// New contexts have no epoch deadline, unlimited fuel, and no stack budget.
+		context->runtimeData->epochDeadline = UINT64_MAX;
+		context->runtimeData->fuel = INT64_MAX;
+		context->runtimeData->stackLimit = 0;
+		context->runtimeData->stackBudgetBytes = 0;
+		context->runtimeData->memoryAccessSampleCountdown = INT64_MAX;
 	}
 
 	return context;
@@ -47,6 +101,7 @@ void Runtime::Context::finalize()
 {
 	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
 	compartment->contexts.removeOrFail(id);
+	compartment->freeContextIds.push_back(id);
 }
 
 Compartment* Runtime::getCompartmentFromContext(Context* context) { return context->compartment; }
@@ -57,6 +112,26 @@ Context* Runtime::cloneContext(Context* context, Compartment* newCompartment)
 	Context* clonedContext = createContext(newCompartment);
 	memcpy(clonedContext->runtimeData->mutableGlobals,
 		   context->runtimeData->mutableGlobals,
-		   maxGlobalBytes);
+		   sizeof(IR::UntaggedValue) * context->compartment->numUsedMutableGlobalIds);
 	return clonedContext;
 }
+
+I64 Runtime::getContextFuel(Context* context) { return context->runtimeData->fuel; }
+
+void Runtime::setContextFuel(Context* context, I64 fuel) { context->runtimeData->fuel = fuel; }
+
+void Runtime::setContextFuelExhaustedHandler(Context* context,
+											 std::function<bool(Context*)>&& handler)
+{
+	context->fuelExhaustedHandler = std::move(handler);
+}
+
+Uptr Runtime::getContextStackBudget(Context* context)
+{
+	return context->runtimeData->stackBudgetBytes;
+}
+
+void Runtime::setContextStackBudget(Context* context, Uptr numBytes)
+{
+	context->runtimeData->stackBudgetBytes = numBytes;
+}
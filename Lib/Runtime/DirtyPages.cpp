@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// The platform's dirty bits are cleared for the whole process at once, so before they are cleared
+// for a checkpoint of one memory, the bits of all the tracked memories are accumulated into their
+// MemoryInstance::dirtyPageBits. The runtime is the process's single tracker of the bits: it
+// acquires them while any memory is tracked.
+static Platform::Mutex dirtyPageTrackingMutex;
+static std::vector<MemoryInstance*> dirtyPageTrackedMemories;
+
+static Uptr getNumPlatformPages(MemoryInstance* memory)
+{
+	return (memory->numPages.load(std::memory_order_acquire) * IR::numBytesPerPage)
+		   >> Platform::getPageSizeLog2();
+}
+
+static void accumulateDirtyPageBits(MemoryInstance* memory, std::vector<U64>& scratchBits)
+{
+	const Uptr numPlatformPages = getNumPlatformPages(memory);
+	const Uptr numWords = (numPlatformPages + 63) / 64;
+	if(memory->dirtyPageBits.size() < numWords) { memory->dirtyPageBits.resize(numWords, 0); }
+
+	// If the bits can't be read, conservatively treat all the memory's pages as dirty.
+	scratchBits.resize(numWords);
+	if(!Platform::readVirtualPageDirtyBits(
+		   memory->baseAddress, numPlatformPages, scratchBits.data()))
+	{ std::fill(scratchBits.begin(), scratchBits.end(), ~U64(0)); }
+
+	for(Uptr wordIndex = 0; wordIndex < numWords; ++wordIndex)
+	{ memory->dirtyPageBits[wordIndex] |= scratchBits[wordIndex]; }
+}
+
+// Accumulates the dirty bits of all the tracked memories, and then clears the platform's bits.
+static void accumulateAndClearDirtyPageBits()
+{
+	std::vector<U64> scratchBits;
+	for(MemoryInstance* memory : dirtyPageTrackedMemories)
+	{ accumulateDirtyPageBits(memory, scratchBits); }
+	Platform::clearVirtualPageDirtyBits();
+}
+
+bool Runtime::startMemoryDirtyPageTracking(MemoryInstance* memory)
+{
+	Lock<Platform::Mutex> dirtyPageTrackingLock(dirtyPageTrackingMutex);
+	if(memory->isDirtyPageTracked) { return true; }
+	if(dirtyPageTrackedMemories.empty())
+	{
+		if(!Platform::acquireVirtualPageDirtyTracking()) { return false; }
+	}
+
+	accumulateAndClearDirtyPageBits();
+	memory->isDirtyPageTracked = true;
+	memory->dirtyPageBits.clear();
+	dirtyPageTrackedMemories.push_back(memory);
+	return true;
+}
+
+void Runtime::stopMemoryDirtyPageTracking(MemoryInstance* memory)
+{
+	Lock<Platform::Mutex> dirtyPageTrackingLock(dirtyPageTrackingMutex);
+	if(!memory->isDirtyPageTracked) { return; }
+
+	auto memoryIt
+		= std::find(dirtyPageTrackedMemories.begin(), dirtyPageTrackedMemories.end(), memory);
+	wavmAssert(memoryIt != dirtyPageTrackedMemories.end());
+	dirtyPageTrackedMemories.erase(memoryIt);
+	memory->isDirtyPageTracked = false;
+	memory->dirtyPageBits.clear();
+	memory->dirtyPageBits.shrink_to_fit();
+
+	if(dirtyPageTrackedMemories.empty()) { Platform::releaseVirtualPageDirtyTracking(); }
+}
+
+std::vector<MemoryRange> Runtime::getDirtyMemoryRanges(MemoryInstance* memory)
+{
+	Lock<Platform::Mutex> dirtyPageTrackingLock(dirtyPageTrackingMutex);
+	errorUnless(memory->isDirtyPageTracked);
+
+	accumulateAndClearDirtyPageBits();
+
+	// Coalesce the runs of dirty pages within the memory's current size into ranges.
+	const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
+	const Uptr numPlatformPages
+		= std::min(getNumPlatformPages(memory), memory->dirtyPageBits.size() * 64);
+	std::vector<MemoryRange> ranges;
+	for(Uptr pageIndex = 0; pageIndex < numPlatformPages; ++pageIndex)
+	{
+		if(!(memory->dirtyPageBits[pageIndex / 64] & (U64(1) << (pageIndex % 64)))) { continue; }
+
+		const Uptr offset = pageIndex << pageSizeLog2;
+		if(ranges.size() && ranges.back().offset + ranges.back().numBytes == offset)
+		{ ranges.back().numBytes += Uptr(1) << pageSizeLog2; }
+		else
+		{
+			ranges.push_back({offset, Uptr(1) << pageSizeLog2});
+		}
+	}
+
+	std::fill(memory->dirtyPageBits.begin(), memory->dirtyPageBits.end(), 0);
+	return ranges;
+}
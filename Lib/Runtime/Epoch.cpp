@@ -0,0 +1,97 @@
+#include <atomic>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/Runtime/RuntimeData.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// There is a single epoch for the whole process, so one timer can bound the execution time of
+// code running in any number of contexts: each context's deadline is relative to it.
+static std::atomic<U64> epoch{0};
+
+static_assert(sizeof(std::atomic<U64>) == sizeof(U64) && alignof(std::atomic<U64>) == 8,
+			  "Compiled code loads the epoch as a plain aligned U64");
+
+// The state of the epoch timer thread, protected by timerMutex.
+static Platform::Mutex timerMutex;
+static Platform::Thread* timerThread = nullptr;
+
+// The timer thread's period and stop flag, which are read by the timer thread without locking.
+static std::atomic<U64> timerPeriodMicroseconds{0};
+static std::atomic<bool> stopTimer{false};
+static Platform::Event timerStopEvent;
+
+enum
+{
+	epochTimerThreadStackBytes = 64 * 1024
+};
+
+Uptr Runtime::getEpochAddress() { return reinterpret_cast<Uptr>(&epoch); }
+
+U64 Runtime::getEpoch() { return epoch.load(std::memory_order_relaxed); }
+
+void Runtime::incrementEpoch() { epoch.fetch_add(1, std::memory_order_relaxed); }
+
+void Runtime::setContextEpochDeadline(Context* context, U64 numEpochs)
+{
+	const U64 currentEpoch = getEpoch();
+	context->runtimeData->epochDeadline
+		= numEpochs >= UINT64_MAX - currentEpoch ? UINT64_MAX : currentEpoch + numEpochs;
+}
+
+void Runtime::setContextEpochYieldSlice(Context* context, U64 numEpochs)
+{
+	context->epochYieldSlice = numEpochs;
+}
+
+static I64 epochTimerThreadEntry(void*)
+{
+	U64 nextTickClock = Platform::getMonotonicClock();
+	while(true)
+	{
+		nextTickClock += timerPeriodMicroseconds.load(std::memory_order_relaxed);
+
+		// Wait until the next tick, or until stopEpochTimer signals the event. The event may be
+		// signaled spuriously, or before this thread waits on it, so recheck both conditions.
+		while(!stopTimer.load(std::memory_order_acquire)
+			  && Platform::getMonotonicClock() < nextTickClock)
+		{ timerStopEvent.wait(nextTickClock); }
+		if(stopTimer.load(std::memory_order_acquire)) { return 0; }
+
+		incrementEpoch();
+	}
+}
+
+void Runtime::startEpochTimer(U64 periodMicroseconds)
+{
+	wavmAssert(periodMicroseconds > 0);
+
+	Lock<Platform::Mutex> timerLock(timerMutex);
+	timerPeriodMicroseconds.store(periodMicroseconds, std::memory_order_relaxed);
+	if(!timerThread)
+	{
+		stopTimer.store(false, std::memory_order_release);
+		timerThread
+			= Platform::createThread(epochTimerThreadStackBytes, epochTimerThreadEntry, nullptr);
+	}
+}
+
+void Runtime::stopEpochTimer()
+{
+	Lock<Platform::Mutex> timerLock(timerMutex);
+	if(timerThread)
+	{
+		stopTimer.store(true, std::memory_order_release);
+		timerStopEvent.signal();
+		Platform::joinThread(timerThread);
+		timerThread = nullptr;
+	}
+}
@@ -13,6 +13,7 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Metrics.h"
 #include "WAVM/Platform/Diagnostics.h"
 #include "WAVM/Platform/Exception.h"
 #include "WAVM/Runtime/Intrinsics.h"
@@ -22,28 +23,45 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
+#define ENUM_STATIC_EXCEPTION_TYPES(visit)                                                         \
+	visit(memoryAddressOutOfBounds)                                                                \
+	visit(tableIndexOutOfBounds)                                                                   \
+	visit(stackOverflow)                                                                           \
+	visit(integerDivideByZeroOrOverflow)                                                           \
+	visit(invalidFloatOperation)                                                                   \
+	visit(invokeSignatureMismatch)                                                                 \
+	visit(reachedUnreachable)                                                                      \
+	visit(indirectCallSignatureMismatch)                                                           \
+	visit(uninitializedTableElement)                                                               \
+	visit(calledAbort)                                                                             \
+	visit(calledUnimplementedIntrinsic)                                                            \
+	visit(outOfMemory)                                                                             \
+	visit(invalidSegmentOffset)                                                                    \
+	visit(misalignedAtomicMemoryAccess)                                                            \
+	visit(invalidArgument)                                                                         \
+	visit(epochDeadlineReached)                                                                    \
+	visit(fuelExhausted)
+
+// Define each static exception type, and a counter of the traps raised with it.
 #define DEFINE_STATIC_EXCEPTION_TYPE(name)                                                         \
 	const GCPointer<ExceptionTypeInstance> Runtime::Exception::name##Type                          \
-		= createExceptionTypeInstance(IR::ExceptionType{IR::TypeTuple()}, "wavm." #name);
-
-DEFINE_STATIC_EXCEPTION_TYPE(memoryAddressOutOfBounds)
-DEFINE_STATIC_EXCEPTION_TYPE(tableIndexOutOfBounds)
-DEFINE_STATIC_EXCEPTION_TYPE(stackOverflow)
-DEFINE_STATIC_EXCEPTION_TYPE(integerDivideByZeroOrOverflow)
-DEFINE_STATIC_EXCEPTION_TYPE(invalidFloatOperation)
-DEFINE_STATIC_EXCEPTION_TYPE(invokeSignatureMismatch)
-DEFINE_STATIC_EXCEPTION_TYPE(reachedUnreachable)
-DEFINE_STATIC_EXCEPTION_TYPE(indirectCallSignatureMismatch)
-DEFINE_STATIC_EXCEPTION_TYPE(uninitializedTableElement)
-DEFINE_STATIC_EXCEPTION_TYPE(calledAbort)
-DEFINE_STATIC_EXCEPTION_TYPE(calledUnimplementedIntrinsic)
-DEFINE_STATIC_EXCEPTION_TYPE(outOfMemory)
-DEFINE_STATIC_EXCEPTION_TYPE(invalidSegmentOffset)
-DEFINE_STATIC_EXCEPTION_TYPE(misalignedAtomicMemoryAccess)
-DEFINE_STATIC_EXCEPTION_TYPE(invalidArgument)
-
+		= createExceptionTypeInstance(IR::ExceptionType{IR::TypeTuple()}, "wavm." #name);          \
+	static Metrics::Counter name##TrapCounter("runtime.traps." #name, "Number of " #name " traps");
+ENUM_STATIC_EXCEPTION_TYPES(DEFINE_STATIC_EXCEPTION_TYPE)
 #undef DEFINE_STATIC_EXCEPTION_TYPE
 
+static void countTrap(ExceptionTypeInstance* typeInstance)
+{
+#define COUNT_TRAP(name)                                                                           \
+	if(typeInstance == Exception::name##Type)                                                      \
+	{                                                                                              \
+		name##TrapCounter.add();                                                                   \
+		return;                                                                                    \
+	}
+	ENUM_STATIC_EXCEPTION_TYPES(COUNT_TRAP)
+#undef COUNT_TRAP
+}
+
 bool Runtime::describeInstructionPointer(Uptr ip, std::string& outDescription)
 {
 	LLVMJIT::JITFunction* jitFunction = LLVMJIT::getJITFunctionByAddress(ip);
@@ -60,18 +78,8 @@ bool Runtime::describeInstructionPointer(Uptr ip, std::string& outDescription)
 			outDescription += jitFunction->functionInstance->debugName;
 			outDescription += '+';
 
-			// Find the highest entry in the offsetToOpIndexMap whose offset is <= the
-			// symbol-relative IP.
-			U32 ipOffset = (U32)(ip - jitFunction->baseAddress);
-			Iptr opIndex = -1;
-			for(auto offsetMapIt : jitFunction->offsetToOpIndexMap)
-			{
-				if(offsetMapIt.first <= ipOffset) { opIndex = offsetMapIt.second; }
-				else
-				{
-					break;
-				}
-			}
+			const Iptr opIndex
+				= jitFunction->getOpIndexByOffset((U32)(ip - jitFunction->baseAddress));
 			outDescription += std::to_string(opIndex >= 0 ? opIndex : 0);
 
 			return true;
@@ -85,6 +93,14 @@ bool Runtime::describeInstructionPointer(Uptr ip, std::string& outDescription)
 		case LLVMJIT::JITFunction::Type::intrinsicThunk:
 			outDescription = "thnk!intrinsic+" + std::to_string(ip - jitFunction->baseAddress);
 			return true;
+		case LLVMJIT::JITFunction::Type::lazyCompileStub:
+			outDescription = "thnk!lazy!";
+			outDescription += jitFunction->functionInstance->moduleInstance->debugName;
+			outDescription += '!';
+			outDescription += jitFunction->functionInstance->debugName;
+			outDescription += '+';
+			outDescription += std::to_string(ip - jitFunction->baseAddress);
+			return true;
 		default: Errors::unreachable();
 		};
 	}
@@ -151,21 +167,28 @@ std::string Runtime::describeException(const Exception& exception)
 	return result;
 }
 
+// Raises a platform exception for a WebAssembly exception. The ExceptionData is built on the
+// stack, since raisePlatformException copies it into the thrown exception.
+[[noreturn]] static void raiseException(ExceptionTypeInstance* typeInstance,
+										const IR::UntaggedValue* arguments,
+										bool isUserException)
+{
+	const Uptr numArguments = typeInstance->type.params.size();
+	const Uptr numDataBytes = ExceptionData::calcNumBytes(numArguments);
+	ExceptionData* exceptionData = (ExceptionData*)alloca(numDataBytes);
+	exceptionData->typeInstance = typeInstance;
+	exceptionData->isUserException = isUserException ? 1 : 0;
+	if(!isUserException) { countTrap(typeInstance); }
+	if(numArguments)
+	{ memcpy(exceptionData->arguments, arguments, sizeof(IR::UntaggedValue) * numArguments); }
+	Platform::raisePlatformException(exceptionData, numDataBytes);
+}
+
 [[noreturn]] void Runtime::throwException(ExceptionTypeInstance* typeInstance,
 										  std::vector<IR::UntaggedValue>&& arguments)
 {
 	wavmAssert(arguments.size() == typeInstance->type.params.size());
-	ExceptionData* exceptionData
-		= (ExceptionData*)malloc(ExceptionData::calcNumBytes(typeInstance->type.params.size()));
-	exceptionData->typeInstance = typeInstance;
-	exceptionData->isUserException = 0;
-	if(arguments.size())
-	{
-		memcpy(exceptionData->arguments,
-			   arguments.data(),
-			   sizeof(IR::UntaggedValue) * arguments.size());
-	}
-	Platform::raisePlatformException(exceptionData);
+	raiseException(typeInstance, arguments.data(), false);
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
@@ -178,15 +201,7 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 {
 	auto typeInstance = reinterpret_cast<ExceptionTypeInstance*>(Uptr(exceptionTypeInstanceBits));
 	auto args = reinterpret_cast<const IR::UntaggedValue*>(Uptr(argsBits));
-
-	ExceptionData* exceptionData
-		= (ExceptionData*)malloc(ExceptionData::calcNumBytes(typeInstance->type.params.size()));
-	exceptionData->typeInstance = typeInstance;
-	exceptionData->isUserException = isUserException ? 1 : 0;
-	memcpy(exceptionData->arguments,
-		   args,
-		   sizeof(IR::UntaggedValue) * typeInstance->type.params.size());
-	Platform::raisePlatformException(exceptionData);
+	raiseException(typeInstance, args, isUserException != 0);
 }
 
 static Exception translateExceptionDataToException(const ExceptionData* exceptionData,
@@ -207,21 +222,23 @@ static bool translateSignalToRuntimeException(const Platform::Signal& signal,
 	{
 	case Platform::Signal::Type::accessViolation:
 	{
+		switch(getAddressOwnerKind(reinterpret_cast<U8*>(signal.accessViolation.address)))
+		{
 		// If the access violation occured in a Table's reserved pages, treat it as an undefined
 		// table element runtime error.
-		if(isAddressOwnedByTable(reinterpret_cast<U8*>(signal.accessViolation.address)))
-		{
+		case AddressOwnerKind::table:
 			outException = Exception{Exception::tableIndexOutOfBoundsType, {}, callStack};
 			return true;
-		}
+
 		// If the access violation occured in a Memory's reserved pages, treat it as an access
 		// violation runtime error.
-		else if(isAddressOwnedByMemory(reinterpret_cast<U8*>(signal.accessViolation.address)))
-		{
+		case AddressOwnerKind::memory:
 			outException = Exception{Exception::memoryAddressOutOfBoundsType, {}, callStack};
 			return true;
-		}
-		return false;
+
+		case AddressOwnerKind::none: return false;
+		default: Errors::unreachable();
+		};
 	}
 	case Platform::Signal::Type::stackOverflow:
 		outException = Exception{Exception::stackOverflowType, {}, callStack};
@@ -237,18 +254,29 @@ static bool translateSignalToRuntimeException(const Platform::Signal& signal,
 	}
 }
 
-void Runtime::catchRuntimeExceptions(const std::function<void()>& thunk,
-									 const std::function<void(Exception&&)>& catchThunk)
+// Translates a signal to a runtime exception, and counts the trap if the signal was a hardware
+// trap. Unhandled platform exceptions were already counted when they were raised.
+static bool translateAndCountSignal(const Platform::Signal& signal,
+									const Platform::CallStack& callStack,
+									Runtime::Exception& outException)
+{
+	if(!translateSignalToRuntimeException(signal, callStack, outException)) { return false; }
+	if(signal.type != Platform::Signal::Type::unhandledException)
+	{ countTrap(outException.typeInstance); }
+	return true;
+}
+
+void Runtime::catchRuntimeExceptions(FunctionRef<void()> thunk,
+									 FunctionRef<void(Exception&&)> catchThunk)
 {
 	// Catch platform exceptions and translate them into C++ exceptions.
 	Platform::catchPlatformExceptions(
-		[thunk, catchThunk] {
+		[&] {
 			Platform::catchSignals(
 				thunk,
-				[catchThunk](Platform::Signal signal,
-							 const Platform::CallStack& callStack) -> bool {
+				[&](Platform::Signal signal, const Platform::CallStack& callStack) -> bool {
 					Exception exception;
-					if(translateSignalToRuntimeException(signal, callStack, exception))
+					if(translateAndCountSignal(signal, callStack, exception))
 					{
 						catchThunk(std::move(exception));
 						return true;
@@ -259,7 +287,7 @@ void Runtime::catchRuntimeExceptions(const std::function<void()>& thunk,
 					}
 				});
 		},
-		[catchThunk](void* exceptionData, const Platform::CallStack& callStack) {
+		[&](void* exceptionData, const Platform::CallStack& callStack) {
 			catchThunk(translateExceptionDataToException(
 				reinterpret_cast<ExceptionData*>(exceptionData), callStack));
 		});
@@ -270,7 +298,7 @@ static std::atomic<UnhandledExceptionHandler> unhandledExceptionHandler;
 static bool globalSignalHandler(Platform::Signal signal, const Platform::CallStack& callStack)
 {
 	Exception exception;
-	if(translateSignalToRuntimeException(signal, callStack, exception))
+	if(translateAndCountSignal(signal, callStack, exception))
 	{
 		(unhandledExceptionHandler.load())(std::move(exception));
 		return true;
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// The table is built with the hash-and-displace algorithm: each name is hashed into one of a number
+// of buckets, and each bucket is assigned a seed that hashes all the names in it to distinct slots
+// that aren't used by any other bucket. There is one slot for each name, so a lookup only needs to
+// hash the name twice and compare it with a single candidate.
+enum
+{
+	averageNamesPerBucket = 4
+};
+
+ExportIndexTable::ExportIndexTable(std::vector<std::string>&& inNames)
+{
+	names = std::make_shared<const std::vector<std::string>>(std::move(inNames));
+	const std::vector<std::string>& nameVector = *names;
+	const Uptr numNames = nameVector.size();
+	if(!numNames) { return; }
+
+	const Uptr numBuckets = (numNames + averageNamesPerBucket - 1) / averageNamesPerBucket;
+	bucketSeeds.resize(numBuckets, 0);
+	slotExportIndices.resize(numNames, UINTPTR_MAX);
+
+	// Group the names by bucket. Equal names are always in the same bucket, so only keep the last
+	// export with each name.
+	std::vector<std::vector<Uptr>> buckets(numBuckets);
+	for(Uptr exportIndex = 0; exportIndex < numNames; ++exportIndex)
+	{
+		const std::string& name = nameVector[exportIndex];
+		std::vector<Uptr>& bucket = buckets[Hash<std::string>()(name) % numBuckets];
+		auto equalNameIt = std::find_if(bucket.begin(), bucket.end(), [&](Uptr otherExportIndex) {
+			return nameVector[otherExportIndex] == name;
+		});
+		if(equalNameIt != bucket.end()) { *equalNameIt = exportIndex; }
+		else
+		{
+			bucket.push_back(exportIndex);
+		}
+	}
+
+	// Place the largest buckets first, while most slots are still free.
+	std::vector<Uptr> bucketOrder;
+	for(Uptr bucketIndex = 0; bucketIndex < numBuckets; ++bucketIndex)
+	{
+		if(buckets[bucketIndex].size()) { bucketOrder.push_back(bucketIndex); }
+	}
+	std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&](Uptr left, Uptr right) {
+		return buckets[left].size() > buckets[right].size();
+	});
+
+	std::vector<Uptr> bucketSlots;
+	for(Uptr bucketIndex : bucketOrder)
+	{
+		const std::vector<Uptr>& bucket = buckets[bucketIndex];
+		for(U32 seed = 1;; ++seed)
+		{
+			wavmAssert(seed != 0);
+
+			bucketSlots.clear();
+			bool placedBucket = true;
+			for(Uptr exportIndex : bucket)
+			{
+				const Uptr slot = Hash<std::string>()(nameVector[exportIndex], seed) % numNames;
+				if(slotExportIndices[slot] != UINTPTR_MAX
+				   || std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+				{
+					placedBucket = false;
+					break;
+				}
+				bucketSlots.push_back(slot);
+			}
+
+			if(placedBucket)
+			{
+				for(Uptr bucketElementIndex = 0; bucketElementIndex < bucket.size();
+					++bucketElementIndex)
+				{ slotExportIndices[bucketSlots[bucketElementIndex]] = bucket[bucketElementIndex]; }
+				bucketSeeds[bucketIndex] = seed;
+				break;
+			}
+		}
+	}
+}
+
+Uptr ExportIndexTable::get(const std::string& name) const
+{
+	if(!bucketSeeds.size()) { return UINTPTR_MAX; }
+
+	const Uptr bucketIndex = Hash<std::string>()(name) % bucketSeeds.size();
+	const Uptr slot
+		= Hash<std::string>()(name, bucketSeeds[bucketIndex]) % slotExportIndices.size();
+	const Uptr exportIndex = slotExportIndices[slot];
+	if(exportIndex == UINTPTR_MAX || (*names)[exportIndex] != name) { return UINTPTR_MAX; }
+	return exportIndex;
+}
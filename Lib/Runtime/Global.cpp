@@ -20,12 +20,27 @@ using namespace WAVM::Runtime;
 GlobalInstance* Runtime::createGlobal(Compartment* compartment, GlobalType type, Value initialValue)
 {
 	wavmAssert(isSubtype(initialValue.type, type.valueType));
+	wavmAssert(!isReferenceType(type.valueType) || !initialValue.anyRef
+			   || isInCompartment(initialValue.anyRef->object, compartment));
 
 	U32 mutableGlobalId = UINT32_MAX;
 	if(type.isMutable)
 	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+
+		// Allocate an ID for the global's value in the runtime data of each context. Once the
+		// compartment has any contexts, the ID must fit in their runtime data.
 		mutableGlobalId = compartment->globalDataAllocationMask.getSmallestNonMember();
+		const Uptr maxCompartmentMutableGlobals
+			= compartment->numContextRuntimeDataBytes
+				  ? (compartment->numContextRuntimeDataBytes
+					 - offsetof(ContextRuntimeData, mutableGlobals))
+						/ sizeof(IR::UntaggedValue)
+				  : Uptr(maxMutableGlobals);
+		if(mutableGlobalId >= maxCompartmentMutableGlobals) { return nullptr; }
 		compartment->globalDataAllocationMask.add(mutableGlobalId);
+		if(mutableGlobalId >= compartment->numUsedMutableGlobalIds)
+		{ compartment->numUsedMutableGlobalIds = mutableGlobalId + 1; }
 
 		// Initialize the global value for each context, and the data used to initialize new
 		// contexts.
@@ -79,8 +94,21 @@ Value Runtime::setGlobalValue(Context* context, GlobalInstance* global, Value ne
 	wavmAssert(context);
 	wavmAssert(newValue.type == global->type.valueType);
 	wavmAssert(global->type.isMutable);
+	wavmAssert(!isReferenceType(newValue.type) || !newValue.anyRef
+			   || isInCompartment(newValue.anyRef->object, context->compartment));
 	UntaggedValue& value = context->runtimeData->mutableGlobals[global->mutableGlobalId];
 	const Value previousValue = Value(global->type.valueType, value);
 	value = newValue;
 	return previousValue;
 }
+
+UntaggedValue* Runtime::getMutableGlobalValuePointer(Context* context,
+													 GlobalInstance* global,
+													 ValueType valueType)
+{
+	wavmAssert(context);
+	errorUnless(global->type.isMutable);
+	errorUnless(global->type.valueType == valueType);
+	wavmAssert(global->compartment == context->compartment);
+	return &context->runtimeData->mutableGlobals[global->mutableGlobalId];
+}
@@ -0,0 +1,224 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/WASM/WASM.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// The manifest of incrementally compiled object code starts with a magic number and the number of
+// partitions, followed by a ManifestPartition for each partition.
+static constexpr U8 manifestMagic[8] = {'W', 'A', 'V', 'M', 'I', 'N', 'C', '1'};
+
+struct ManifestPartition
+{
+	U64 beginFunctionDefIndex;
+	U64 numFunctionDefs;
+	ObjectCacheKey key;
+};
+
+// The object code of a function definition refers to the other function definitions by their
+// index, so a partition's object code can only be reused at the same index: the partitions have a
+// fixed number of function definitions, so an edit to a function definition that doesn't add or
+// remove any only changes the key of its own partition. The number is a power of two, so it only
+// changes when the number of function definitions crosses a power of two.
+static Uptr getNumFunctionDefsPerPartition(Uptr numFunctionDefs)
+{
+	Uptr numFunctionDefsPerPartition = 16;
+	while(numFunctionDefsPerPartition * 256 < numFunctionDefs) { numFunctionDefsPerPartition *= 2; }
+	return numFunctionDefsPerPartition;
+}
+
+static void appendU64(std::vector<U8>& bytes, U64 value)
+{
+	bytes.insert(bytes.end(), (const U8*)&value, (const U8*)(&value + 1));
+}
+
+// Returns the key material for a module's declarations, and the options it is compiled with. The
+// module is encoded with empty function bodies, so the key material includes everything in the
+// module other than the function bodies, which is more than the object code of a function depends
+// on, but is simple to get right.
+static std::vector<U8> getDeclarationKeyBytes(const IR::Module& irModule,
+											  const LLVMJIT::CompileOptions& compileOptions)
+{
+	std::vector<U8> keyBytes;
+	appendCompileOptionsKeyBytes(keyBytes, irModule.featureSpec, compileOptions);
+
+	Serialization::ArrayOutputStream emptyCodeStream;
+	OperatorEncoderStream emptyCodeEncoder(emptyCodeStream);
+	emptyCodeEncoder.end();
+	const SharedBytes emptyCode(emptyCodeStream.getBytes());
+
+	IR::Module declarationModule(irModule);
+	for(FunctionDef& functionDef : declarationModule.functions.defs)
+	{
+		functionDef.nonParameterLocalTypes.clear();
+		functionDef.code = emptyCode;
+		functionDef.branchTables.clear();
+	}
+
+	Serialization::ArrayOutputStream moduleStream;
+	WASM::serialize(moduleStream, declarationModule);
+	const std::vector<U8> moduleBytes = moduleStream.getBytes();
+	keyBytes.insert(keyBytes.end(), moduleBytes.begin(), moduleBytes.end());
+	return keyBytes;
+}
+
+static void appendFunctionDefKeyBytes(std::vector<U8>& keyBytes, const FunctionDef& functionDef)
+{
+	appendU64(keyBytes, functionDef.type.index);
+
+	appendU64(keyBytes, functionDef.nonParameterLocalTypes.size());
+	for(ValueType localType : functionDef.nonParameterLocalTypes)
+	{ keyBytes.push_back(U8(localType)); }
+
+	appendU64(keyBytes, functionDef.branchTables.size());
+	for(const std::vector<Uptr>& branchTable : functionDef.branchTables)
+	{
+		appendU64(keyBytes, branchTable.size());
+		for(Uptr targetDepth : branchTable) { appendU64(keyBytes, targetDepth); }
+	}
+
+	appendU64(keyBytes, functionDef.code.size());
+	keyBytes.insert(keyBytes.end(), functionDef.code.begin(), functionDef.code.end());
+}
+
+static std::vector<U8> serializeManifest(const std::vector<ManifestPartition>& partitions)
+{
+	std::vector<U8> manifest(manifestMagic, manifestMagic + sizeof(manifestMagic));
+	appendU64(manifest, partitions.size());
+	for(const ManifestPartition& partition : partitions)
+	{
+		appendU64(manifest, partition.beginFunctionDefIndex);
+		appendU64(manifest, partition.numFunctionDefs);
+		appendU64(manifest, partition.key.hash);
+		appendU64(manifest, partition.key.checkHash);
+		appendU64(manifest, partition.key.numBytes);
+	}
+	return manifest;
+}
+
+static bool deserializeManifest(const std::vector<U8>& manifest,
+								std::vector<ManifestPartition>& outPartitions)
+{
+	if(manifest.size() < sizeof(manifestMagic) + sizeof(U64)
+	   || memcmp(manifest.data(), manifestMagic, sizeof(manifestMagic)))
+	{ return false; }
+
+	U64 numPartitions;
+	memcpy(&numPartitions, manifest.data() + sizeof(manifestMagic), sizeof(U64));
+	const Uptr numPartitionBytes = 5 * sizeof(U64);
+	const Uptr numManifestPartitionBytes = manifest.size() - sizeof(manifestMagic) - sizeof(U64);
+	if(numManifestPartitionBytes % numPartitionBytes
+	   || numPartitions != numManifestPartitionBytes / numPartitionBytes)
+	{ return false; }
+
+	U64 fields[5];
+	outPartitions.clear();
+	for(Uptr partitionIndex = 0; partitionIndex < numPartitions; ++partitionIndex)
+	{
+		memcpy(fields,
+			   manifest.data() + sizeof(manifestMagic) + sizeof(U64)
+				   + partitionIndex * numPartitionBytes,
+			   sizeof(fields));
+		outPartitions.push_back({fields[0], fields[1], {fields[2], fields[3], fields[4]}});
+	}
+	return true;
+}
+
+std::vector<U8> Runtime::compileObjectCodeIncrementally(
+	const IR::Module& irModule,
+	const LLVMJIT::CompileOptions& compileOptions,
+	const std::vector<U8>& previousObjectCode,
+	const std::vector<U8>& previousManifest,
+	std::vector<U8>& outManifest)
+{
+	wavmAssert(!compileOptions.targetVersions.size());
+	wavmAssert(!compileOptions.profileInstrumentation);
+
+	outManifest.clear();
+	const Uptr numFunctionDefs = irModule.functions.defs.size();
+	if(!numFunctionDefs) { return LLVMJIT::compileModule(irModule, compileOptions); }
+
+	// Compute the key of each partition from the key of the declarations, the index of the
+	// partition's first function definition, and the key material for its function definitions.
+	const ObjectCacheKey declarationKey
+		= getObjectCacheKey(getDeclarationKeyBytes(irModule, compileOptions));
+	const Uptr numFunctionDefsPerPartition = getNumFunctionDefsPerPartition(numFunctionDefs);
+	std::vector<ManifestPartition> partitions;
+	std::vector<Uptr> partitionBeginFunctionDefIndices;
+	std::vector<U8> partitionKeyBytes;
+	for(Uptr beginFunctionDefIndex = 0; beginFunctionDefIndex < numFunctionDefs;
+		beginFunctionDefIndex += numFunctionDefsPerPartition)
+	{
+		const Uptr endFunctionDefIndex
+			= std::min(numFunctionDefs, beginFunctionDefIndex + numFunctionDefsPerPartition);
+
+		partitionKeyBytes.clear();
+		appendU64(partitionKeyBytes, declarationKey.hash);
+		appendU64(partitionKeyBytes, declarationKey.checkHash);
+		appendU64(partitionKeyBytes, declarationKey.numBytes);
+		appendU64(partitionKeyBytes, beginFunctionDefIndex);
+		for(Uptr functionDefIndex = beginFunctionDefIndex; functionDefIndex < endFunctionDefIndex;
+			++functionDefIndex)
+		{
+			appendFunctionDefKeyBytes(partitionKeyBytes,
+									  irModule.functions.defs[functionDefIndex]);
+		}
+
+		partitions.push_back({beginFunctionDefIndex,
+							  endFunctionDefIndex - beginFunctionDefIndex,
+							  getObjectCacheKey(partitionKeyBytes)});
+		partitionBeginFunctionDefIndices.push_back(beginFunctionDefIndex);
+	}
+	partitionBeginFunctionDefIndices.push_back(numFunctionDefs);
+
+	// Reuse the object code of the previous partitions with the same keys. If the previous
+	// manifest or object code are invalid, or don't match, compile the whole module.
+	std::vector<std::vector<U8>> partitionObjects(partitions.size());
+	std::vector<ManifestPartition> previousPartitions;
+	std::vector<std::vector<U8>> previousPartitionObjects;
+	if(previousManifest.size())
+	{
+		if(!deserializeManifest(previousManifest, previousPartitions)
+		   || !LLVMJIT::getPartitionObjects(previousObjectCode, previousPartitionObjects)
+		   || previousPartitions.size() != previousPartitionObjects.size())
+		{ Log::printf(Log::debug, "Ignoring invalid incremental compile manifest.\n"); }
+		else
+		{
+			for(Uptr partitionIndex = 0; partitionIndex < partitions.size()
+										 && partitionIndex < previousPartitions.size();
+				++partitionIndex)
+			{
+				const ManifestPartition& partition = partitions[partitionIndex];
+				const ManifestPartition& previousPartition = previousPartitions[partitionIndex];
+				if(partition.beginFunctionDefIndex == previousPartition.beginFunctionDefIndex
+				   && partition.numFunctionDefs == previousPartition.numFunctionDefs
+				   && partition.key.hash == previousPartition.key.hash
+				   && partition.key.checkHash == previousPartition.key.checkHash
+				   && partition.key.numBytes == previousPartition.key.numBytes)
+				{
+					partitionObjects[partitionIndex]
+						= std::move(previousPartitionObjects[partitionIndex]);
+				}
+			}
+		}
+	}
+
+	std::vector<U8> objectCode = LLVMJIT::compilePartitions(
+		irModule, partitionBeginFunctionDefIndices, std::move(partitionObjects), compileOptions);
+	if(objectCode.size()) { outManifest = serializeManifest(partitions); }
+	return objectCode;
+}
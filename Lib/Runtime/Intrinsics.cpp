@@ -1,4 +1,6 @@
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -7,6 +9,7 @@
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -18,6 +21,13 @@ namespace WAVM { namespace Intrinsics {
 		HashMap<std::string, Intrinsics::Global*> globalMap;
 		HashMap<std::string, Intrinsics::Memory*> memoryMap;
 		HashMap<std::string, Intrinsics::Table*> tableMap;
+
+		// The instances of the module's functions don't belong to any compartment, so they are
+		// created by the first instantiation of the module, and shared by all its instantiations.
+		Platform::Mutex functionInstancesMutex;
+		bool createdFunctionInstances = false;
+		std::vector<Runtime::FunctionInstance*> functionInstances;
+		HashMap<std::string, Runtime::Object*> functionExportMap;
 	};
 }}
 
@@ -37,12 +47,19 @@ Intrinsics::Function::Function(Intrinsics::Module& moduleRef,
 							   const char* inName,
 							   void* inNativeFunction,
 							   IR::FunctionType inType,
-							   IR::CallingConvention inCallingConvention)
+							   IR::CallingConvention inCallingConvention,
+							   bool inIsLeaf,
+							   InvokeThunk inInvokeThunk)
 : name(inName)
 , type(inType)
 , nativeFunction(inNativeFunction)
 , callingConvention(inCallingConvention)
+, isConstant(false)
+, isLeaf(inIsLeaf)
+, invokeThunk(inInvokeThunk)
 {
+	errorUnless(!isLeaf || callingConvention == IR::CallingConvention::intrinsic);
+
 	initializeModule(moduleRef);
 
 	if(moduleRef.impl->functionMap.contains(name))
@@ -50,9 +67,68 @@ Intrinsics::Function::Function(Intrinsics::Module& moduleRef,
 	moduleRef.impl->functionMap.set(name, this);
 }
 
-Runtime::FunctionInstance* Intrinsics::Function::instantiate(Runtime::Compartment* compartment)
+Intrinsics::Function::Function(Intrinsics::Module& moduleRef,
+							   const char* inName,
+							   void* inNativeFunction,
+							   IR::FunctionType inType,
+							   IR::UntaggedValue inConstantResult,
+							   InvokeThunk inInvokeThunk)
+: Function(moduleRef,
+		   inName,
+		   inNativeFunction,
+		   inType,
+		   IR::CallingConvention::intrinsic,
+		   false,
+		   inInvokeThunk)
 {
-	return new Runtime::FunctionInstance(nullptr, type, nativeFunction, callingConvention, name);
+	errorUnless(type.results().size() <= 1);
+	for(IR::ValueType resultType : type.results()) { errorUnless(!isReferenceType(resultType)); }
+
+	isConstant = true;
+	constantResult = inConstantResult;
+}
+
+Runtime::FunctionInstance* Intrinsics::Function::instantiate()
+{
+	auto functionInstance = new Runtime::FunctionInstance(
+		nullptr, nullptr, type, nativeFunction, callingConvention, name);
+	if(isConstant) { functionInstance->constantResult = &constantResult; }
+	functionInstance->isLeafIntrinsic = isLeaf;
+
+	// Use the invoke thunk specialized for the function's C++ signature, so invoking it doesn't
+	// need to generate one with the JIT.
+	static_assert(std::is_same<InvokeThunk, LLVMJIT::InvokeThunkPointer>::value,
+				  "Intrinsics::InvokeThunk must match LLVMJIT::InvokeThunkPointer");
+	if(invokeThunk) { functionInstance->invokeThunk.store(invokeThunk); }
+
+	// Keep the instance alive for the rest of the process.
+	Runtime::addGCRoot(functionInstance);
+	return functionInstance;
+}
+
+Runtime::FunctionInstance* Intrinsics::createHostFunction(Runtime::Compartment* compartment,
+														 IR::FunctionType type,
+														 HostFunction* hostFunction,
+														 void* trampoline,
+														 InvokeThunk invokeThunk,
+														 std::string&& debugName)
+{
+	errorUnless(type.results().size() <= 1);
+
+	auto functionInstance = new Runtime::FunctionInstance(compartment,
+														  nullptr,
+														  type,
+														  reinterpret_cast<void*>(hostFunction),
+														  IR::CallingConvention::intrinsic,
+														  std::move(debugName));
+	functionInstance->hostFunction = hostFunction;
+	functionInstance->hostTrampoline = trampoline;
+	functionInstance->invokeThunk.store(invokeThunk);
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		compartment->functions.addOrFail(functionInstance);
+	}
+	return functionInstance;
 }
 
 Intrinsics::Global::Global(Intrinsics::Module& moduleRef,
@@ -120,40 +196,74 @@ Runtime::ModuleInstance* Intrinsics::instantiateModule(
 		compartment->modules.addOrFail(moduleInstance);
 	}
 
+	HashMap<std::string, Runtime::Object*> exportMap;
 	if(moduleRef.impl)
 	{
-		for(const auto& pair : moduleRef.impl->functionMap)
+		Intrinsics::ModuleImpl* impl = moduleRef.impl;
 		{
-			auto functionInstance = pair.value->instantiate(compartment);
-			moduleInstance->functions.push_back(functionInstance);
-			moduleInstance->exportMap.addOrFail(pair.key, functionInstance);
+			Lock<Platform::Mutex> functionInstancesLock(impl->functionInstancesMutex);
+			if(!impl->createdFunctionInstances)
+			{
+				for(const auto& pair : impl->functionMap)
+				{
+					Runtime::FunctionInstance* functionInstance = pair.value->instantiate();
+					impl->functionInstances.push_back(functionInstance);
+					impl->functionExportMap.addOrFail(pair.key, functionInstance);
+				}
+
+				// Generate the thunks that WebAssembly code calls the functions through in a single
+				// module, instead of generating each thunk in its own module when it's first used.
+				std::vector<LLVMJIT::IntrinsicThunkRequest> thunkRequests;
+				for(Runtime::FunctionInstance* functionInstance : impl->functionInstances)
+				{
+					thunkRequests.push_back({functionInstance->nativeFunction.load(
+												 std::memory_order_acquire),
+											 functionInstance,
+											 functionInstance->type,
+											 functionInstance->callingConvention,
+											 functionInstance->constantResult,
+											 functionInstance->isLeafIntrinsic,
+											 nullptr});
+				}
+				std::vector<void*> thunks = LLVMJIT::getIntrinsicThunks(thunkRequests);
+				for(Uptr functionIndex = 0; functionIndex < thunks.size(); ++functionIndex)
+				{
+					impl->functionInstances[functionIndex]->intrinsicThunk.store(
+						thunks[functionIndex], std::memory_order_release);
+				}
+
+				impl->createdFunctionInstances = true;
+			}
 		}
+		moduleInstance->functions = impl->functionInstances;
+		exportMap = impl->functionExportMap;
 
 		for(const auto& pair : moduleRef.impl->tableMap)
 		{
 			auto tableInstance = pair.value->instantiate(compartment);
 			moduleInstance->tables.push_back(tableInstance);
-			moduleInstance->exportMap.addOrFail(pair.key, tableInstance);
+			exportMap.addOrFail(pair.key, tableInstance);
 		}
 
 		for(const auto& pair : moduleRef.impl->memoryMap)
 		{
 			auto memoryInstance = pair.value->instantiate(compartment);
 			moduleInstance->memories.push_back(memoryInstance);
-			moduleInstance->exportMap.addOrFail(pair.key, memoryInstance);
+			exportMap.addOrFail(pair.key, memoryInstance);
 		}
 
 		for(const auto& pair : moduleRef.impl->globalMap)
 		{
 			auto globalInstance = pair.value->instantiate(compartment);
 			moduleInstance->globals.push_back(globalInstance);
-			moduleInstance->exportMap.addOrFail(pair.key, globalInstance);
+			exportMap.addOrFail(pair.key, globalInstance);
 		}
 
 		for(const auto& pair : extraExports)
 		{
 			Runtime::Object* object = pair.value;
-			moduleInstance->exportMap.set(pair.key, object);
+			errorUnless(isInCompartment(object, compartment));
+			exportMap.set(pair.key, object);
 
 			switch(object->kind)
 			{
@@ -177,5 +287,15 @@ Runtime::ModuleInstance* Intrinsics::instantiateModule(
 		}
 	}
 
+	std::vector<std::string> exportNames;
+	for(const auto& pair : exportMap)
+	{
+		exportNames.push_back(pair.key);
+		moduleInstance->exports.push_back(pair.value);
+	}
+	moduleInstance->exportIndexTable
+		= std::make_shared<Runtime::ExportIndexTable>(std::move(exportNames));
+	moduleInstance->exportNames = moduleInstance->exportIndexTable->names;
+
 	return moduleInstance;
 }
@@ -7,6 +7,7 @@
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/Runtime/RuntimeData.h"
@@ -15,36 +16,107 @@ using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::Runtime;
 
+void* Runtime::getWASMCallableCode(const FunctionInstance* function)
+{
+	if(function->callingConvention == IR::CallingConvention::wasm)
+	{ return function->nativeFunction.load(std::memory_order_acquire); }
+
+	// If the function isn't a WASM function, use a thunk for it, generating the thunk the first
+	// time it is needed. The thunk for a host function calls its trampoline, passing it the
+	// HostFunction.
+	void* intrinsicThunk = function->intrinsicThunk.load(std::memory_order_acquire);
+	if(!intrinsicThunk)
+	{
+		intrinsicThunk = LLVMJIT::getIntrinsicThunk(
+			function->hostFunction ? function->hostTrampoline
+								   : function->nativeFunction.load(std::memory_order_acquire),
+			function,
+			function->type,
+			function->callingConvention,
+			function->constantResult,
+			function->isLeafIntrinsic,
+			function->hostFunction);
+		function->intrinsicThunk.store(intrinsicThunk, std::memory_order_release);
+	}
+	return intrinsicThunk;
+}
+
 const AnyFunc* Runtime::asAnyFunc(const FunctionInstance* functionInstance)
 {
-	void* wasmFunction = functionInstance->nativeFunction;
+	return getAnyFuncFromCode(getWASMCallableCode(functionInstance));
+}
 
-	// If the function isn't a WASM function, generate a thunk for it.
-	if(functionInstance->callingConvention != IR::CallingConvention::wasm)
+static LLVMJIT::InvokeThunkPointer getInvokeThunk(FunctionInstance* function)
+{
+	// Get the invoke thunk for this function type, generating it the first time the function is
+	// invoked.
+	LLVMJIT::InvokeThunkPointer invokeThunk = function->invokeThunk.load(std::memory_order_acquire);
+	if(!invokeThunk)
 	{
-		wasmFunction = LLVMJIT::getIntrinsicThunk(wasmFunction,
-												  functionInstance,
-												  functionInstance->type,
-												  functionInstance->callingConvention);
+		invokeThunk = getShardedInvokeThunk(function->type, function->callingConvention);
+		function->invokeThunk.store(invokeThunk, std::memory_order_release);
 	}
+	return invokeThunk;
+}
 
-	// Get the pointer to the AnyFunc struct that is emitted as a prefix to the function's code.
-	return (AnyFunc*)((U8*)wasmFunction - offsetof(AnyFunc, code));
+// Returns the number of bytes needed to hold a function's arguments, naturally aligning each.
+static Uptr getNumInvokeArgBytes(FunctionType functionType)
+{
+	Uptr numArgBytes = 0;
+	for(ValueType type : functionType.params())
+	{
+		const Uptr numTypeBytes = getTypeByteWidth(type);
+		numArgBytes = ((numArgBytes + numTypeBytes - 1) & -numTypeBytes) + numTypeBytes;
+	}
+	return numArgBytes;
 }
 
+// Sets the stack limit of a context for the duration of an invoke, if the context has a stack
+// budget, and restores the limit of any outer invoke in the context when the invoke returns or is
+// unwound by an exception.
+struct StackLimitScope
+{
+	StackLimitScope(ContextRuntimeData* inContextRuntimeData)
+	: contextRuntimeData(inContextRuntimeData), savedStackLimit(inContextRuntimeData->stackLimit)
+	{
+		const Uptr stackBudgetBytes = contextRuntimeData->stackBudgetBytes;
+		if(stackBudgetBytes)
+		{
+			U8 stackMarker;
+			const Uptr stackPointer = reinterpret_cast<Uptr>(&stackMarker);
+			contextRuntimeData->stackLimit
+				= stackPointer > stackBudgetBytes ? stackPointer - stackBudgetBytes : 0;
+		}
+	}
+
+	~StackLimitScope() { contextRuntimeData->stackLimit = savedStackLimit; }
+
+private:
+	ContextRuntimeData* contextRuntimeData;
+	Uptr savedStackLimit;
+};
+
 UntaggedValue* Runtime::invokeFunctionUnchecked(Context* context,
 												FunctionInstance* function,
 												const UntaggedValue* arguments)
 {
 	FunctionType functionType = function->type;
 
-	// Get the invoke thunk for this function type.
-	auto invokeFunctionPointer = LLVMJIT::getInvokeThunk(functionType, function->callingConvention);
+	// If the function is in a module instance compiled with tiered compilation, count the call
+	// toward tiering up the module instance.
+	if(function->moduleInstance && function->moduleInstance->module
+	   && function->moduleInstance->module->tierUpCallCount)
+	{ sampleTierUpCall(function->moduleInstance); }
+
+	LLVMJIT::InvokeThunkPointer invokeFunctionPointer = getInvokeThunk(function);
 
-	// Copy the arguments into the thunk arguments buffer in ContextRuntimeData.
-	ContextRuntimeData* contextRuntimeData
-		= &context->compartment->runtimeData->contexts[context->id];
-	U8* argData = contextRuntimeData->thunkArgAndReturnData;
+	// Copy the arguments into the thunk arguments buffer in ContextRuntimeData, or if they don't
+	// fit, into a buffer on the stack.
+	ContextRuntimeData* contextRuntimeData = context->runtimeData;
+	const Uptr numArgBytes = getNumInvokeArgBytes(functionType);
+	U8* argData = numArgBytes <= maxThunkArgAndReturnBytes
+					  ? contextRuntimeData->thunkArgAndReturnData
+					  : (U8*)alloca(numArgBytes);
 	Uptr argDataOffset = 0;
 	for(Uptr argumentIndex = 0; argumentIndex < functionType.params().size(); ++argumentIndex)
 	{
@@ -52,26 +124,137 @@ UntaggedValue* Runtime::invokeFunctionUnchecked(Context* context,
 		const UntaggedValue& argument = arguments[argumentIndex];
 
 		// Naturally align each argument.
+		const Uptr numTypeBytes = getTypeByteWidth(type);
+		argDataOffset = (argDataOffset + numTypeBytes - 1) & -numTypeBytes;
+		memcpy(argData + argDataOffset, argument.bytes, numTypeBytes);
+		argDataOffset += numTypeBytes;
+	}
+
+	// Call the invoke thunk.
+	StackLimitScope stackLimitScope(contextRuntimeData);
+	contextRuntimeData = (ContextRuntimeData*)(*invokeFunctionPointer)(
+		function->nativeFunction.load(std::memory_order_acquire), contextRuntimeData, argData);
+
+	// Return a pointer to the return value that was written to the ContextRuntimeData.
+	return (UntaggedValue*)contextRuntimeData->thunkArgAndReturnData;
+}
+
+PreparedInvoke Runtime::prepareInvoke(Context* context, FunctionInstance* function)
+{
+	PreparedInvoke preparedInvoke;
+	preparedInvoke.function = function;
+	preparedInvoke.functionType = function->type;
+	preparedInvoke.invokeThunk = getInvokeThunk(function);
+	preparedInvoke.nativeFunction = &function->nativeFunction;
+	preparedInvoke.contextRuntimeData = context->runtimeData;
+
+	// Lay out the arguments the same way invokeFunctionUnchecked does, naturally aligning each
+	// argument.
+	Uptr argDataOffset = 0;
+	for(ValueType type : preparedInvoke.functionType.params())
+	{
 		const Uptr numArgBytes = getTypeByteWidth(type);
 		argDataOffset = (argDataOffset + numArgBytes - 1) & -numArgBytes;
-
-		if(argDataOffset >= maxThunkArgAndReturnBytes)
-		{
-			// Throw an exception if the invoke uses too much memory for arguments.
-			throwException(Exception::outOfMemoryType);
-		}
-		memcpy(argData + argDataOffset, argument.bytes, getTypeByteWidth(type));
+		preparedInvoke.argOffsets.push_back(U32(argDataOffset));
 		argDataOffset += numArgBytes;
 	}
+	preparedInvoke.numArgBytes = argDataOffset;
+
+	return preparedInvoke;
+}
+
+UntaggedValue* Runtime::invokePrepared(const PreparedInvoke& preparedInvoke,
+									   const UntaggedValue* arguments)
+{
+	// Copy the arguments into the thunk arguments buffer at the offsets computed by prepareInvoke,
+	// or if they don't fit, into a buffer on the stack.
+	U8* argData = preparedInvoke.numArgBytes <= maxThunkArgAndReturnBytes
+					  ? preparedInvoke.contextRuntimeData->thunkArgAndReturnData
+					  : (U8*)alloca(preparedInvoke.numArgBytes);
+	const TypeTuple params = preparedInvoke.functionType.params();
+	for(Uptr argumentIndex = 0; argumentIndex < params.size(); ++argumentIndex)
+	{
+		memcpy(argData + preparedInvoke.argOffsets[argumentIndex],
+			   arguments[argumentIndex].bytes,
+			   getTypeByteWidth(params[argumentIndex]));
+	}
 
 	// Call the invoke thunk.
-	contextRuntimeData = (ContextRuntimeData*)(*invokeFunctionPointer)(function->nativeFunction,
-																	   contextRuntimeData);
+	StackLimitScope stackLimitScope(preparedInvoke.contextRuntimeData);
+	ContextRuntimeData* contextRuntimeData = (*preparedInvoke.invokeThunk)(
+		preparedInvoke.nativeFunction->load(std::memory_order_acquire),
+		preparedInvoke.contextRuntimeData,
+		argData);
 
 	// Return a pointer to the return value that was written to the ContextRuntimeData.
 	return (UntaggedValue*)contextRuntimeData->thunkArgAndReturnData;
 }
 
+Uptr Runtime::invokeFunctionBatch(
+	Context* context,
+	FunctionInstance* function,
+	Uptr numInvokes,
+	const UntaggedValue* arguments,
+	UntaggedValue* results,
+	const std::function<void(Uptr invokeIndex, Exception&& exception)>& trapHandler)
+{
+	const PreparedInvoke preparedInvoke = prepareInvoke(context, function);
+	const Uptr numParams = preparedInvoke.functionType.params().size();
+	const TypeTuple resultTypes = preparedInvoke.functionType.results();
+	const bool sampleTierUp = function->moduleInstance && function->moduleInstance->module
+							  && function->moduleInstance->module->tierUpCallCount;
+
+	// Compute the offsets that the results are written to in the ContextRuntimeData.
+	std::vector<U32> resultOffsets;
+	Uptr resultOffset = 0;
+	for(ValueType resultType : resultTypes)
+	{
+		const Uptr resultNumBytes = getTypeByteWidth(resultType);
+		resultOffset = (resultOffset + resultNumBytes - 1) & -resultNumBytes;
+		wavmAssert(resultOffset < maxThunkArgAndReturnBytes);
+		resultOffsets.push_back(U32(resultOffset));
+		resultOffset += resultNumBytes;
+	}
+
+	// Run the invokes inside a single exception handler scope. If an invoke traps, the scope is
+	// unwound, so report the trap and enter a new scope to continue with the next invoke.
+	Uptr numTraps = 0;
+	Uptr invokeIndex = 0;
+	while(invokeIndex < numInvokes)
+	{
+		catchRuntimeExceptions(
+			[&] {
+				for(; invokeIndex < numInvokes; ++invokeIndex)
+				{
+					if(sampleTierUp) { sampleTierUpCall(function->moduleInstance); }
+
+					const U8* resultData = (const U8*)invokePrepared(
+						preparedInvoke, arguments + invokeIndex * numParams);
+
+					UntaggedValue* invokeResults = results + invokeIndex * resultTypes.size();
+					for(Uptr resultIndex = 0; resultIndex < resultTypes.size(); ++resultIndex)
+					{
+						invokeResults[resultIndex] = UntaggedValue();
+						memcpy(invokeResults[resultIndex].bytes,
+							   resultData + resultOffsets[resultIndex],
+							   getTypeByteWidth(resultTypes[resultIndex]));
+					}
+				}
+			},
+			[&](Exception&& exception) {
+				UntaggedValue* invokeResults = results + invokeIndex * resultTypes.size();
+				for(Uptr resultIndex = 0; resultIndex < resultTypes.size(); ++resultIndex)
+				{ invokeResults[resultIndex] = UntaggedValue(); }
+
+				++numTraps;
+				trapHandler(invokeIndex, std::move(exception));
+				++invokeIndex;
+			});
+	}
+
+	return numTraps;
+}
+
 ValueTuple Runtime::invokeFunctionChecked(Context* context,
 										  FunctionInstance* function,
 										  const std::vector<Value>& arguments)
@@ -92,6 +275,12 @@ ValueTuple Runtime::invokeFunctionChecked(Context* context,
 		if(!isSubtype(arguments[argumentIndex].type, functionType.params()[argumentIndex]))
 		{ throwException(Exception::invokeSignatureMismatchType); }
 
+		// Reference arguments may be stored by the function, so they must be in the context's
+		// compartment.
+		const Value& argument = arguments[argumentIndex];
+		errorUnless(!isReferenceType(argument.type) || !argument.anyRef
+					|| isInCompartment(argument.anyRef->object, context->compartment));
+
 		untaggedArguments[argumentIndex] = arguments[argumentIndex];
 	}
 
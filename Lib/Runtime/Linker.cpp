@@ -1,6 +1,10 @@
 #include "WAVM/Runtime/Linker.h"
+#include "RuntimePrivate.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/ScratchArena.h"
+#include "WAVM/Logging/Trace.h"
 #include "WAVM/Runtime/Runtime.h"
 
 using namespace WAVM;
@@ -46,6 +50,7 @@ void linkImport(const IR::Module& module,
 
 LinkResult Runtime::linkModule(const IR::Module& module, Resolver& resolver)
 {
+	Trace::Span traceSpan("linkModule");
 	LinkResult linkResult;
 	for(const auto& import : module.functions.imports)
 	{ linkImport(module, import, resolver, linkResult, linkResult.resolvedImports.functions); }
@@ -63,3 +68,109 @@ LinkResult Runtime::linkModule(const IR::Module& module, Resolver& resolver)
 	linkResult.success = linkResult.missingImports.size() == 0;
 	return linkResult;
 }
+
+// Calls visitImport(import, importType) for each import of a module, in the order of
+// LinkPlan::importSources.
+template<typename VisitImport>
+static void forEachImport(const IR::Module& module, VisitImport&& visitImport)
+{
+	for(const auto& import : module.functions.imports)
+	{ visitImport(import, ObjectType(resolveImportType(module, import.type))); }
+	for(const auto& import : module.tables.imports) { visitImport(import, ObjectType(import.type)); }
+	for(const auto& import : module.memories.imports)
+	{ visitImport(import, ObjectType(import.type)); }
+	for(const auto& import : module.globals.imports)
+	{ visitImport(import, ObjectType(import.type)); }
+	for(const auto& import : module.exceptionTypes.imports)
+	{ visitImport(import, ObjectType(import.type)); }
+}
+
+static void addResolvedImport(ImportBindings& resolvedImports, Object* object)
+{
+	switch(object->kind)
+	{
+	case Runtime::ObjectKind::function:
+		resolvedImports.functions.push_back(asFunction(object));
+		break;
+	case Runtime::ObjectKind::table: resolvedImports.tables.push_back(asTable(object)); break;
+	case Runtime::ObjectKind::memory: resolvedImports.memories.push_back(asMemory(object)); break;
+	case Runtime::ObjectKind::global: resolvedImports.globals.push_back(asGlobal(object)); break;
+	case Runtime::ObjectKind::exceptionTypeInstance:
+		resolvedImports.exceptionTypes.push_back(asExceptionTypeInstance(object));
+		break;
+	default: Errors::unreachable();
+	}
+}
+
+LinkPlan Runtime::createLinkPlan(
+	const IR::Module& module,
+	const std::vector<std::pair<std::string, ModuleInstance*>>& providers)
+{
+	LinkPlan plan;
+
+	for(const auto& provider : providers)
+	{ plan.providerExportNames.push_back(provider.second->exportNames); }
+
+	forEachImport(module, [&](const auto& import, ObjectType type) {
+		for(Uptr providerIndex = 0; providerIndex < providers.size(); ++providerIndex)
+		{
+			if(providers[providerIndex].first != import.moduleName) { continue; }
+
+			ModuleInstance* provider = providers[providerIndex].second;
+			const Uptr exportIndex = provider->exportIndexTable->get(import.exportName);
+			if(exportIndex != UINTPTR_MAX && isA(provider->exports[exportIndex], type))
+			{
+				plan.importSources.push_back({providerIndex, exportIndex});
+				return;
+			}
+			break;
+		}
+
+		plan.missingImports.push_back({import.moduleName, import.exportName, type});
+	});
+
+	plan.success = plan.missingImports.size() == 0;
+	return plan;
+}
+
+LinkResult Runtime::linkModule(const IR::Module& module,
+							   const LinkPlan& plan,
+							   const std::vector<ModuleInstance*>& providers)
+{
+	Trace::Span traceSpan("linkModule");
+	wavmAssert(plan.success);
+	errorUnless(providers.size() == plan.providerExportNames.size());
+
+	// Only use the plan's export indices for providers with the same exports as the providers the
+	// plan was created with. Instances of the same module share their export names, so this is
+	// usually just a pointer comparison.
+	ScratchScope scratchScope;
+	ScratchVector<bool> providerMatchesPlan(providers.size());
+	for(Uptr providerIndex = 0; providerIndex < providers.size(); ++providerIndex)
+	{
+		const auto& exportNames = providers[providerIndex]->exportNames;
+		const auto& planExportNames = plan.providerExportNames[providerIndex];
+		providerMatchesPlan[providerIndex]
+			= exportNames == planExportNames || *exportNames == *planExportNames;
+	}
+
+	LinkResult linkResult;
+	Uptr importIndex = 0;
+	forEachImport(module, [&](const auto& import, ObjectType type) {
+		const LinkPlan::ImportSource& source = plan.importSources[importIndex++];
+		ModuleInstance* provider = providers[source.providerIndex];
+
+		Object* object = providerMatchesPlan[source.providerIndex]
+							 ? provider->exports[source.exportIndex]
+							 : getInstanceExport(provider, import.exportName);
+		if(object && isA(object, type)) { addResolvedImport(linkResult.resolvedImports, object); }
+		else
+		{
+			linkResult.missingImports.push_back({import.moduleName, import.exportName, type});
+		}
+	});
+	wavmAssert(importIndex == plan.importSources.size());
+
+	linkResult.success = linkResult.missingImports.size() == 0;
+	return linkResult;
+}
@@ -1,7 +1,9 @@
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
 #include <atomic>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include "RuntimePrivate.h"
@@ -11,46 +13,301 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/Runtime/RuntimeData.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MEMORY_USE_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MEMORY_USE_NEON 1
+#endif
+
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
-// Global lists of memories; used to query whether an address is reserved by one of them.
-static Platform::Mutex memoriesMutex;
-static std::vector<MemoryInstance*> memories;
+// The address ranges reserved for memories are pooled: when a memory is destroyed, its pages are
+// decommitted, but its address range stays reserved so that it can be reused by the next memory
+// with the same number of reserved bytes. This avoids reserving and freeing address space (and the
+// TLB shootdowns that come with freeing it) every time a memory is created and destroyed.
+struct FreeReservation
+{
+	U8* baseAddress;
+	Uptr numReservedBytes;
+};
 
-enum
+// Decommitting a large memory's pages can take milliseconds, so unless the thread freeing a memory
+// is bound to a runtime shard, the pages are decommitted by a background thread, and the address
+// range is added to the pool once they are. The thread is created when there are pages to
+// decommit, and exits when there are none left.
+struct PendingDecommit
+{
+	FreeReservation reservation;
+	Uptr numPlatformPages;
+};
+
+// The pool of free address ranges, and the pending decommits, protected by the mutex. It is
+// created the first time it is used, and never destroyed, so the detached decommit thread may use
+// it during static destruction.
+struct MemoryReservationPool
 {
-	numGuardPages = 1
+	Platform::Mutex mutex;
+	std::vector<FreeReservation> freeReservations;
+	std::vector<PendingDecommit> pendingDecommits;
+	bool isDecommitThreadRunning = false;
+
+	static MemoryReservationPool& get()
+	{
+		static MemoryReservationPool* pool = new MemoryReservationPool;
+		return *pool;
+	}
 };
 
+static constexpr Uptr decommitThreadStackBytes = 1024 * 1024;
+
 static Uptr getPlatformPagesPerWebAssemblyPageLog2()
 {
 	errorUnless(Platform::getPageSizeLog2() <= IR::numBytesPerPageLog2);
 	return IR::numBytesPerPageLog2 - Platform::getPageSizeLog2();
 }
 
-static MemoryInstance* createMemoryImpl(Compartment* compartment,
-										IR::MemoryType type,
-										Uptr numPages)
+// The value of MemoryInstance::numClaimedPages while a MemoryResizingLock is held.
+static constexpr Uptr lockedNumClaimedPages = UINTPTR_MAX;
+
+// Locks a memory's resizingMutex, and prevents growMemory from claiming pages until it is
+// unlocked. Waits for the calls to growMemory that have already claimed pages to finish.
+struct MemoryResizingLock
+{
+	MemoryResizingLock(MemoryInstance* inMemory) : memory(inMemory), lock(inMemory->resizingMutex)
+	{
+		Uptr numClaimedPages = memory->numClaimedPages.load(std::memory_order_acquire);
+		while(numClaimedPages != memory->numPages.load(std::memory_order_acquire)
+			  || !memory->numClaimedPages.compare_exchange_weak(numClaimedPages,
+																lockedNumClaimedPages,
+																std::memory_order_acq_rel,
+																std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+			numClaimedPages = memory->numClaimedPages.load(std::memory_order_acquire);
+		}
+	}
+	~MemoryResizingLock() { unlock(); }
+
+	void unlock()
+	{
+		if(memory)
+		{
+			memory->numClaimedPages.store(memory->numPages.load(std::memory_order_acquire),
+										  std::memory_order_release);
+			lock.unlock();
+			memory = nullptr;
+		}
+	}
+
+private:
+	MemoryInstance* memory;
+	Lock<Platform::Mutex> lock;
+};
+
+static void releasePageSnapshot(MemoryInstance* memory)
+{
+	if(memory->pageSnapshot)
+	{
+		Platform::releaseVirtualPageSnapshot(memory->pageSnapshot);
+		memory->pageSnapshot = nullptr;
+	}
+}
+
+static Uptr getMemoryNumReservedBytes(IR::MemoryType type, Uptr maxReservedBytes)
+{
+	if(type.indexType == IR::IndexType::i64)
+	{
+		// 64-bit memories can't reserve enough address space to elide bounds checks, so reserve
+		// enough address space for the memory's declared maximum size, but no more than
+		// maxReservedBytes, or fullMemory64NumReservedBytes by default.
+		if(maxReservedBytes == UINTPTR_MAX) { maxReservedBytes = fullMemory64NumReservedBytes; }
+		const U64 maxPages
+			= std::min(type.size.max, U64(maxReservedBytes >> IR::numBytesPerPageLog2));
+		return std::max(Uptr(IR::numBytesPerPage), Uptr(maxPages) * IR::numBytesPerPage);
+	}
+
+	// By default, allocate 8GB of address space for the memory on a 64-bit runtime. This allows
+	// eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset will always be
+	// within the reserved address-space.
+	if(maxReservedBytes == UINTPTR_MAX) { return fullMemoryNumReservedBytes; }
+
+	// Otherwise, reserve enough address space for the memory's declared maximum size, but no more
+	// than maxReservedBytes.
+	const U64 maxPages = std::min(type.size.max, U64(IR::maxMemoryPages));
+	const Uptr maxPagesBytes = Uptr(maxPages) * IR::numBytesPerPage;
+	return std::max(Uptr(IR::numBytesPerPage),
+					std::min(maxPagesBytes, maxReservedBytes & ~Uptr(IR::numBytesPerPage - 1)));
+}
+
+static Uptr getNumReservedPlatformPages(Uptr numReservedBytes)
+{
+	return (numReservedBytes + memoryNumGuardBytes) >> Platform::getPageSizeLog2();
+}
+
+// Decommits the pages of the pending decommits on the calling thread, and adds their address
+// ranges to the pool. Assumes the pool's mutex is locked.
+static void decommitPendingDecommits()
+{
+	MemoryReservationPool& pool = MemoryReservationPool::get();
+	for(const PendingDecommit& pendingDecommit : pool.pendingDecommits)
+	{
+		Platform::decommitVirtualPages(pendingDecommit.reservation.baseAddress,
+									   pendingDecommit.numPlatformPages);
+		pool.freeReservations.push_back(pendingDecommit.reservation);
+	}
+	pool.pendingDecommits.clear();
+}
+
+static I64 decommitThreadEntry(void*)
+{
+	MemoryReservationPool& pool = MemoryReservationPool::get();
+	pool.mutex.lock();
+	while(pool.pendingDecommits.size())
+	{
+		const PendingDecommit pendingDecommit = pool.pendingDecommits.back();
+		pool.pendingDecommits.pop_back();
+
+		pool.mutex.unlock();
+		Platform::decommitVirtualPages(pendingDecommit.reservation.baseAddress,
+									   pendingDecommit.numPlatformPages);
+		pool.mutex.lock();
+
+		pool.freeReservations.push_back(pendingDecommit.reservation);
+	}
+	pool.isDecommitThreadRunning = false;
+	pool.mutex.unlock();
+	return 0;
+}
+
+// Frees the address ranges in the pool. Assumes the pool's mutex is locked.
+static void freeFreeReservations()
+{
+	MemoryReservationPool& pool = MemoryReservationPool::get();
+	for(const FreeReservation& reservation : pool.freeReservations)
+	{
+		Platform::freeVirtualPages(reservation.baseAddress,
+								   getNumReservedPlatformPages(reservation.numReservedBytes));
+	}
+	pool.freeReservations.clear();
+}
+
+// Reserves an address range for a memory, reusing a free address range from the current runtime
+// shard's pool or the process-wide pool if possible.
+static bool reserveMemoryAddressRange(MemoryInstance* memory, Uptr numReservedBytes)
+{
+	MemoryReservationPool& pool = MemoryReservationPool::get();
+	U8* baseAddress = nullptr;
+	if(!takeShardMemoryReservation(numReservedBytes, baseAddress))
+	{
+		const Uptr numReservedPlatformPages = getNumReservedPlatformPages(numReservedBytes);
+		{
+			Lock<Platform::Mutex> poolLock(pool.mutex);
+
+			// Look for a free address range with the same number of reserved bytes.
+			for(Uptr freeIndex = 0; freeIndex < pool.freeReservations.size(); ++freeIndex)
+			{
+				if(pool.freeReservations[freeIndex].numReservedBytes == numReservedBytes)
+				{
+					baseAddress = pool.freeReservations[freeIndex].baseAddress;
+					pool.freeReservations.erase(pool.freeReservations.begin() + freeIndex);
+					break;
+				}
+			}
+
+			// Otherwise, reserve a new address range.
+			if(!baseAddress)
+			{ baseAddress = Platform::allocateVirtualPages(numReservedPlatformPages); }
+		}
+
+		// If that fails, free the address ranges in the pools and try again.
+		if(!baseAddress)
+		{
+			releaseShardMemoryReservations();
+
+			Lock<Platform::Mutex> poolLock(pool.mutex);
+			decommitPendingDecommits();
+			if(pool.freeReservations.size())
+			{
+				freeFreeReservations();
+				baseAddress = Platform::allocateVirtualPages(numReservedPlatformPages);
+			}
+		}
+		if(!baseAddress) { return false; }
+	}
+
+	memory->baseAddress = baseAddress;
+	memory->numReservedBytes = numReservedBytes;
+
+	// Add the memory's reserved address range and guard pages to the owned address ranges, so
+	// accesses that fault in either are reported as out-of-bounds memory accesses.
+	memory->ownedAddressRangeId = addOwnedAddressRange(
+		baseAddress, numReservedBytes + memoryNumGuardBytes, AddressOwnerKind::memory);
+
+	return true;
+}
+
+// Decommits the first numPlatformPages pages of a memory's address range, and returns the address
+// range to the current runtime shard's pool, or the process-wide pool. If the thread isn't bound
+// to a shard, and the memory's pages aren't mapped from a file, the pages are decommitted by the
+// background decommit thread.
+static void releaseMemoryAddressRange(MemoryInstance* memory, Uptr numPlatformPages)
 {
-	MemoryInstance* memory = new MemoryInstance(compartment, type);
+	MemoryReservationPool& pool = MemoryReservationPool::get();
+	removeOwnedAddressRange(memory->ownedAddressRangeId);
+	memory->ownedAddressRangeId = UINTPTR_MAX;
 
-	// On a 64-bit runtime, allocate 8GB of address space for the memory.
-	// This allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset
-	// will always be within the reserved address-space.
-	const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
-	const Uptr memoryMaxBytes = Uptr(8ull * 1024 * 1024 * 1024);
-	const Uptr memoryMaxPages = memoryMaxBytes >> pageBytesLog2;
+	if(!getCurrentRuntimeShard() && !memory->hasMappedFiles && numPlatformPages)
+	{
+		Lock<Platform::Mutex> poolLock(pool.mutex);
+		pool.pendingDecommits.push_back(
+			{{memory->baseAddress, memory->numReservedBytes}, numPlatformPages});
+		if(!pool.isDecommitThreadRunning)
+		{
+			pool.isDecommitThreadRunning = true;
+			Platform::detachThread(
+				Platform::createThread(decommitThreadStackBytes, decommitThreadEntry, nullptr));
+		}
+		return;
+	}
 
-	memory->baseAddress = Platform::allocateVirtualPages(memoryMaxPages + numGuardPages);
-	memory->numReservedBytes = memoryMaxBytes;
-	if(!memory->baseAddress)
+	if(numPlatformPages) { Platform::decommitVirtualPages(memory->baseAddress, numPlatformPages); }
+	if(!addShardMemoryReservation(memory->baseAddress, memory->numReservedBytes))
+	{ addFreeMemoryReservation(memory->baseAddress, memory->numReservedBytes); }
+}
+
+void Runtime::addFreeMemoryReservation(U8* baseAddress, Uptr numReservedBytes)
+{
+	MemoryReservationPool& pool = MemoryReservationPool::get();
+	Lock<Platform::Mutex> poolLock(pool.mutex);
+	pool.freeReservations.push_back({baseAddress, numReservedBytes});
+}
+
+static Metrics::Gauge memoryPagesGauge("runtime.memory_pages",
+										"Number of WebAssembly pages in all memories");
+
+static MemoryInstance* createMemoryImpl(Compartment* compartment,
+										IR::MemoryType type,
+										Uptr numPages,
+										Uptr numReservedBytes,
+										Platform::File* backingFile = nullptr,
+										bool isBackingFileShared = false)
+{
+	MemoryInstance* memory
+		= new MemoryInstance(compartment, type, backingFile, isBackingFileShared);
+	memory->memoryBudget = compartment->memoryBudget;
+	if(!reserveMemoryAddressRange(memory, numReservedBytes))
 	{
 		delete memory;
 		return nullptr;
@@ -63,46 +320,105 @@ static MemoryInstance* createMemoryImpl(Compartment* compartment,
 		return nullptr;
 	}
 
-	// Add the memory to the global array.
+	return memory;
+}
+
+// Adds a new memory to the compartment's memories IndexMap. If that fails, deletes the memory and
+// returns null.
+static Uptr* getWaiterCountsPointer(MemoryInstance* memory)
+{
+	static_assert(sizeof(std::atomic<Uptr>) == sizeof(Uptr), "relying on non-standard behavior");
+	return reinterpret_cast<Uptr*>(memory->waiterCounts);
+}
+
+static MemoryInstance* addMemoryToCompartment(Compartment* compartment, MemoryInstance* memory)
+{
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+
+	memory->id = compartment->memories.add(UINTPTR_MAX, memory);
+	if(memory->id == UINTPTR_MAX)
 	{
-		Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-		memories.push_back(memory);
+		delete memory;
+		return nullptr;
 	}
+	compartment->runtimeData->memoryBases[memory->id] = memory->baseAddress;
+	compartment->runtimeData->memoryNumReservedBytes[memory->id] = memory->numReservedBytes;
+	compartment->runtimeData->memoryWaiterCounts[memory->id] = getWaiterCountsPointer(memory);
 
 	return memory;
 }
 
-MemoryInstance* Runtime::createMemory(Compartment* compartment, IR::MemoryType type)
+MemoryInstance* Runtime::createMemory(Compartment* compartment,
+									  IR::MemoryType type,
+									  Uptr maxReservedBytes)
 {
 	wavmAssert(type.size.min <= UINTPTR_MAX);
-	MemoryInstance* memory = createMemoryImpl(compartment, type, Uptr(type.size.min));
+	MemoryInstance* memory = createMemoryImpl(compartment,
+											  type,
+											  Uptr(type.size.min),
+											  getMemoryNumReservedBytes(type, maxReservedBytes));
 	if(!memory) { return nullptr; }
 
-	// Add the memory to the compartment's memories IndexMap.
-	{
-		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	return addMemoryToCompartment(compartment, memory);
+}
 
-		memory->id = compartment->memories.add(UINTPTR_MAX, memory);
-		if(memory->id == UINTPTR_MAX)
-		{
-			delete memory;
-			return nullptr;
-		}
-		compartment->runtimeData->memoryBases[memory->id] = memory->baseAddress;
+MemoryInstance* Runtime::createFileBackedMemory(Compartment* compartment,
+												IR::MemoryType type,
+												Platform::File* file,
+												bool isShared,
+												Uptr maxReservedBytes)
+{
+	wavmAssert(type.size.min <= UINTPTR_MAX);
+
+	// Start the memory with enough pages to hold the file's contents.
+	U64 fileNumBytes = 0;
+	if(!Platform::getFileNumBytes(file, fileNumBytes))
+	{
+		errorUnless(Platform::closeFile(file));
+		return nullptr;
+	}
+	const U64 fileNumPages = (fileNumBytes + IR::numBytesPerPage - 1) / IR::numBytesPerPage;
+	const Uptr numReservedBytes = getMemoryNumReservedBytes(type, maxReservedBytes);
+	if(fileNumPages > type.size.max || fileNumPages > numReservedBytes / IR::numBytesPerPage)
+	{
+		errorUnless(Platform::closeFile(file));
+		return nullptr;
 	}
+	const Uptr numPages = std::max(Uptr(type.size.min), Uptr(fileNumPages));
 
-	return memory;
+	// If creating the memory fails, the MemoryInstance destructor closes the file.
+	MemoryInstance* memory
+		= createMemoryImpl(compartment, type, numPages, numReservedBytes, file, isShared);
+	if(!memory) { return nullptr; }
+
+	return addMemoryToCompartment(compartment, memory);
 }
 
 MemoryInstance* Runtime::cloneMemory(MemoryInstance* memory, Compartment* newCompartment)
 {
-	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+	MemoryResizingLock resizingLock(memory);
 	const Uptr numPages = memory->numPages.load(std::memory_order_acquire);
-	MemoryInstance* newMemory = createMemoryImpl(newCompartment, memory->type, numPages);
+	MemoryInstance* newMemory
+		= createMemoryImpl(newCompartment, memory->type, numPages, memory->numReservedBytes);
 	if(!newMemory) { return nullptr; }
 
-	// Copy the memory contents to the new memory.
-	memcpy(newMemory->baseAddress, memory->baseAddress, numPages * IR::numBytesPerPage);
+	// Map the memory's pages copy-on-write into the new memory. Only a memory that is mapped from a
+	// snapshot, and hasn't been written since, shares the snapshot's physical pages with the new
+	// memory. Any other memory is copied into a new snapshot that only the new memory is mapped
+	// from, which copies every committed page while the resizing lock is held: the memory's own
+	// pages aren't remapped from the snapshot, since that would lose concurrent writes to them. So
+	// later clones of this memory copy it again, but clones of the new memory share its snapshot
+	// until it is written. If copy-on-write mapping isn't supported, copy the memory contents.
+	// Pages mapped from a file look like unmodified snapshot pages, so don't let a memory with
+	// mapped files share its snapshot with the new memory.
+	if(numPages > 0
+	   && !Platform::cloneVirtualPagesCopyOnWrite(
+		   memory->baseAddress,
+		   newMemory->baseAddress,
+		   numPages << getPlatformPagesPerWebAssemblyPageLog2(),
+		   memory->hasMappedFiles ? nullptr : memory->pageSnapshot,
+		   newMemory->pageSnapshot))
+	{ memcpy(newMemory->baseAddress, memory->baseAddress, numPages * IR::numBytesPerPage); }
 
 	resizingLock.unlock();
 
@@ -114,6 +430,10 @@ MemoryInstance* Runtime::cloneMemory(MemoryInstance* memory, Compartment* newCom
 		newMemory->id = memory->id;
 		newCompartment->memories.insertOrFail(newMemory->id, newMemory);
 		newCompartment->runtimeData->memoryBases[newMemory->id] = newMemory->baseAddress;
+		newCompartment->runtimeData->memoryNumReservedBytes[newMemory->id]
+			= newMemory->numReservedBytes;
+		newCompartment->runtimeData->memoryWaiterCounts[newMemory->id]
+			= getWaiterCountsPointer(newMemory);
 	}
 
 	return newMemory;
@@ -128,53 +448,33 @@ void Runtime::MemoryInstance::finalize()
 
 	wavmAssert(compartment->runtimeData->memoryBases[id] == baseAddress);
 	compartment->runtimeData->memoryBases[id] = nullptr;
+	compartment->runtimeData->memoryNumReservedBytes[id] = 0;
+	compartment->runtimeData->memoryWaiterCounts[id] = nullptr;
 }
 
 Runtime::MemoryInstance::~MemoryInstance()
 {
-	// Remove the memory from the global array.
+	if(isDirtyPageTracked) { stopMemoryDirtyPageTracking(this); }
+
+	if(baseAddress)
 	{
-		Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-		for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
+		if(numPages > 0)
 		{
-			if(memories[memoryIndex] == this)
-			{
-				memories.erase(memories.begin() + memoryIndex);
-				break;
-			}
+			memoryPagesGauge.add(-I64(numPages.load(std::memory_order_acquire)));
+			memoryBudget->release(numPages * IR::numBytesPerPage);
 		}
-	}
 
-	// Decommit all default memory pages.
-	if(numPages > 0)
-	{
-		Platform::decommitVirtualPages(baseAddress,
-									   numPages << getPlatformPagesPerWebAssemblyPageLog2());
-	}
-
-	// Free the virtual address space.
-	const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
-	if(numReservedBytes > 0)
-	{
-		Platform::freeVirtualPages(baseAddress,
-								   (numReservedBytes >> pageBytesLog2) + numGuardPages);
+		// Decommit all the memory's pages, so the address range can be reused by another memory,
+		// and return it to the pool.
+		releaseMemoryAddressRange(this, numPages << getPlatformPagesPerWebAssemblyPageLog2());
 	}
+	releasePageSnapshot(this);
 	baseAddress = nullptr;
 	numPages = numReservedBytes = 0;
-}
 
-bool Runtime::isAddressOwnedByMemory(U8* address)
-{
-	// Iterate over all memories and check if the address is within the reserved address space for
-	// each.
-	Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-	for(auto memory : memories)
-	{
-		U8* startAddress = memory->baseAddress;
-		U8* endAddress = memory->baseAddress + memory->numReservedBytes;
-		if(address >= startAddress && address < endAddress) { return true; }
-	}
-	return false;
+	// The file's pages were unmapped when the memory's pages were decommitted, so the file can be
+	// closed.
+	if(backingFile) { errorUnless(Platform::closeFile(backingFile)); }
 }
 
 Uptr Runtime::getMemoryNumPages(MemoryInstance* memory)
@@ -187,27 +487,112 @@ Uptr Runtime::getMemoryMaxPages(MemoryInstance* memory)
 	return Uptr(memory->type.size.max);
 }
 
+// Commits the pages that a memory is being grown by. If the memory is backed by a file, maps the
+// pages from the file, and extends a shared file to include them.
+static bool commitGrownPages(MemoryInstance* memory, Uptr pageIndex, Uptr numPages)
+{
+	U8* pagesBaseAddress = memory->baseAddress + pageIndex * IR::numBytesPerPage;
+	const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+	if(!memory->backingFile)
+	{
+		return Platform::commitVirtualPages(pagesBaseAddress,
+											numPlatformPages,
+											Platform::MemoryAccess::readWrite,
+											getCommitFlags(memory->compartment),
+											memory->compartment->numaNode);
+	}
+
+	if(memory->isBackingFileShared)
+	{
+		// Concurrent calls to growMemory may extend the file in any order, so never shrink it.
+		Lock<Platform::Mutex> backingFileLock(memory->backingFileMutex);
+		const U64 endNumBytes = U64(pageIndex + numPages) * IR::numBytesPerPage;
+		U64 fileNumBytes = 0;
+		if(!Platform::getFileNumBytes(memory->backingFile, fileNumBytes)) { return false; }
+		if(fileNumBytes < endNumBytes
+		   && !Platform::setFileNumBytes(memory->backingFile, endNumBytes))
+		{ return false; }
+	}
+
+	return Platform::mapFileToVirtualPages(memory->backingFile,
+										   U64(pageIndex) * IR::numBytesPerPage,
+										   pagesBaseAddress,
+										   numPlatformPages,
+										   memory->isBackingFileShared);
+}
+
 Iptr Runtime::growMemory(MemoryInstance* memory, Uptr numPagesToGrow)
 {
 	if(numPagesToGrow == 0) { return memory->numPages.load(std::memory_order_seq_cst); }
 
-	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
-	const Uptr previousNumPages = memory->numPages.load(std::memory_order_acquire);
+	wavmAssert(memory->type.size.max <= UINTPTR_MAX);
+	const Uptr maxIndexTypePages = memory->type.indexType == IR::IndexType::i64
+									   ? Uptr(IR::maxMemory64Pages)
+									   : Uptr(IR::maxMemoryPages);
+	const Uptr maxPages = std::min(std::min(Uptr(memory->type.size.max), maxIndexTypePages),
+								   memory->numReservedBytes / IR::numBytesPerPage);
+	if(numPagesToGrow > maxPages) { return -1; }
 
-	// If the number of pages to grow would cause the memory's size to exceed its maximum,
-	// return -1.
-	if(numPagesToGrow > memory->type.size.max
-	   || previousNumPages > memory->type.size.max - numPagesToGrow
-	   || numPagesToGrow > IR::maxMemoryPages
-	   || previousNumPages > IR::maxMemoryPages - numPagesToGrow)
-	{ return -1; }
+	// Charge the pages to the compartment's memory budget before claiming them, so the memory never
+	// has pages that weren't charged. If that would exceed the budget, return -1.
+	const Uptr numBytesToGrow = numPagesToGrow * IR::numBytesPerPage;
+	if(!memory->memoryBudget->charge(numBytesToGrow)) { return -1; }
 
-	// Try to commit the new pages, and return -1 if the commit fails.
-	if(!Platform::commitVirtualPages(memory->baseAddress + previousNumPages * IR::numBytesPerPage,
-									 numPagesToGrow << getPlatformPagesPerWebAssemblyPageLog2()))
-	{ return -1; }
+	// Claim the pages to grow the memory by adding them to numClaimedPages. If the number of pages
+	// to grow would cause the memory's size to exceed its maximum, return -1.
+	Uptr previousNumPages = memory->numClaimedPages.load(std::memory_order_acquire);
+	while(true)
+	{
+		if(previousNumPages == lockedNumClaimedPages)
+		{
+			// Wait for the MemoryResizingLock to be unlocked.
+			std::this_thread::yield();
+			previousNumPages = memory->numClaimedPages.load(std::memory_order_acquire);
+		}
+		else if(previousNumPages > maxPages - numPagesToGrow)
+		{
+			memory->memoryBudget->release(numBytesToGrow);
+			return -1;
+		}
+		else if(memory->numClaimedPages.compare_exchange_weak(previousNumPages,
+															  previousNumPages + numPagesToGrow,
+															  std::memory_order_acq_rel,
+															  std::memory_order_acquire))
+		{
+			break;
+		}
+	}
+	const Uptr newNumPages = previousNumPages + numPagesToGrow;
+
+	// Try to commit the claimed pages. This isn't done with any mutex locked, so concurrent calls
+	// to growMemory on the same memory may commit their pages in parallel.
+	bool committed = commitGrownPages(memory, previousNumPages, numPagesToGrow);
+
+	// Wait for the calls to growMemory that claimed the preceding pages to finish, so numPages
+	// never includes pages that aren't committed.
+	while(memory->numPages.load(std::memory_order_acquire) != previousNumPages)
+	{ std::this_thread::yield(); }
 
-	memory->numPages.store(previousNumPages + numPagesToGrow, std::memory_order_release);
+	if(!committed)
+	{
+		// If the commit failed, and no pages were claimed after this call's pages, unclaim them
+		// and return -1.
+		Uptr expectedNumClaimedPages = newNumPages;
+		if(memory->numClaimedPages.compare_exchange_strong(
+			   expectedNumClaimedPages, previousNumPages, std::memory_order_acq_rel))
+		{
+			memory->memoryBudget->release(numBytesToGrow);
+			return -1;
+		}
+
+		// Otherwise, the pages claimed after this call's pages can't be moved to fill the gap,
+		// so retry committing the pages before giving up.
+		if(!commitGrownPages(memory, previousNumPages, numPagesToGrow))
+		{ Errors::fatal("Failed to commit pages to a memory that is being grown concurrently"); }
+	}
+
+	memory->numPages.store(newNumPages, std::memory_order_release);
+	memoryPagesGauge.add(I64(numPagesToGrow));
 	return previousNumPages;
 }
 
@@ -215,7 +600,7 @@ Iptr Runtime::shrinkMemory(MemoryInstance* memory, Uptr numPagesToShrink)
 {
 	if(numPagesToShrink == 0) { return memory->numPages.load(std::memory_order_acquire); }
 
-	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+	MemoryResizingLock resizingLock(memory);
 
 	const Uptr previousNumPages = memory->numPages.load(std::memory_order_acquire);
 
@@ -225,11 +610,28 @@ Iptr Runtime::shrinkMemory(MemoryInstance* memory, Uptr numPagesToShrink)
 	   || previousNumPages - numPagesToShrink < memory->type.size.min)
 	{ return -1; }
 
-	// Decommit the pages that were shrunk off the end of the memory.
+	// Decommit the pages that were shrunk off the end of the memory. The memory's pages no longer
+	// match its page snapshot, so release it.
+	releasePageSnapshot(memory);
 	Platform::decommitVirtualPages(memory->baseAddress + previousNumPages * IR::numBytesPerPage,
 								   numPagesToShrink << getPlatformPagesPerWebAssemblyPageLog2());
 
-	memory->numPages.store(previousNumPages - numPagesToShrink, std::memory_order_release);
+	// Truncate a shared backing file to the memory's new size, so the pages that were shrunk off
+	// aren't restored if the file is used to create another memory.
+	const Uptr newNumPages = previousNumPages - numPagesToShrink;
+	if(memory->backingFile && memory->isBackingFileShared)
+	{
+		Lock<Platform::Mutex> backingFileLock(memory->backingFileMutex);
+		U64 fileNumBytes = 0;
+		const U64 newNumBytes = U64(newNumPages) * IR::numBytesPerPage;
+		if(Platform::getFileNumBytes(memory->backingFile, fileNumBytes)
+		   && fileNumBytes > newNumBytes)
+		{ Platform::setFileNumBytes(memory->backingFile, newNumBytes); }
+	}
+
+	memory->numPages.store(newNumPages, std::memory_order_release);
+	memoryPagesGauge.add(-I64(numPagesToShrink));
+	memory->memoryBudget->release(numPagesToShrink * IR::numBytesPerPage);
 	return previousNumPages;
 }
 
@@ -238,11 +640,174 @@ void Runtime::unmapMemoryPages(MemoryInstance* memory, Uptr pageIndex, Uptr numP
 	wavmAssert(pageIndex + numPages > pageIndex);
 	wavmAssert((pageIndex + numPages) * IR::numBytesPerPage <= memory->numReservedBytes);
 
-	// Decommit the pages.
+	// Decommit the pages. The memory's pages no longer match its page snapshot, so release it.
+	MemoryResizingLock resizingLock(memory);
+	releasePageSnapshot(memory);
 	Platform::decommitVirtualPages(memory->baseAddress + pageIndex * IR::numBytesPerPage,
 								   numPages << getPlatformPagesPerWebAssemblyPageLog2());
 }
 
+// Returns whether a page contains only zeroes. Where SSE2 or NEON are available, 64 bytes are
+// tested at a time.
+static bool isZeroPage(const U8* page, Uptr numBytes)
+{
+	wavmAssert(!(numBytes & 63));
+	for(const U8* chunk = page; chunk < page + numBytes; chunk += 64)
+	{
+#if MEMORY_USE_SSE2
+		const __m128i* vectors = (const __m128i*)chunk;
+		const __m128i orVector
+			= _mm_or_si128(_mm_or_si128(_mm_load_si128(vectors + 0), _mm_load_si128(vectors + 1)),
+						   _mm_or_si128(_mm_load_si128(vectors + 2), _mm_load_si128(vectors + 3)));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(orVector, _mm_setzero_si128())) != 0xffff)
+		{ return false; }
+#elif MEMORY_USE_NEON
+		const uint8x16_t orVector = vorrq_u8(vorrq_u8(vld1q_u8(chunk), vld1q_u8(chunk + 16)),
+											 vorrq_u8(vld1q_u8(chunk + 32), vld1q_u8(chunk + 48)));
+		if(vmaxvq_u8(orVector)) { return false; }
+#else
+		U64 orWord = 0;
+		for(Uptr wordIndex = 0; wordIndex < 8; ++wordIndex)
+		{
+			U64 word;
+			memcpy(&word, chunk + wordIndex * sizeof(U64), sizeof(U64));
+			orWord |= word;
+		}
+		if(orWord) { return false; }
+#endif
+	}
+	return true;
+}
+
+static Metrics::Counter reclaimedMemoryBytesCounter(
+	"runtime.reclaimed_memory_bytes",
+	"Number of bytes of zeroed memory pages reset by reclaimZeroMemoryPages");
+
+Uptr Runtime::reclaimZeroMemoryPages(MemoryInstance* memory)
+{
+	MemoryResizingLock resizingLock(memory);
+
+	// Pages that are mapped from a file must keep sharing the file's contents, even if they're
+	// zero, so skip memories with mapped files.
+	if(memory->hasMappedFiles) { return 0; }
+
+	// Pages that are mapped copy-on-write from a page snapshot would revert to the snapshot's
+	// contents if they were reset, so they are replaced with newly committed pages instead.
+	const bool isMappedFromSnapshot = memory->pageSnapshot != nullptr;
+
+	const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
+	const Uptr numPlatformPages = memory->numPages.load(std::memory_order_acquire)
+								  << getPlatformPagesPerWebAssemblyPageLog2();
+	auto isZeroPlatformPage = [memory, pageSizeLog2](Uptr pageIndex) {
+		return isZeroPage(memory->baseAddress + (pageIndex << pageSizeLog2),
+						  Uptr(1) << pageSizeLog2);
+	};
+
+	// Find each run of zero pages, and reset them.
+	Uptr numReclaimedPages = 0;
+	Uptr pageIndex = 0;
+	while(pageIndex < numPlatformPages)
+	{
+		if(!isZeroPlatformPage(pageIndex))
+		{
+			++pageIndex;
+			continue;
+		}
+
+		Uptr endPageIndex = pageIndex + 1;
+		while(endPageIndex < numPlatformPages && isZeroPlatformPage(endPageIndex))
+		{ ++endPageIndex; }
+
+		U8* runBaseAddress = memory->baseAddress + (pageIndex << pageSizeLog2);
+		const Uptr numRunPages = endPageIndex - pageIndex;
+		if(!isMappedFromSnapshot) { Platform::resetVirtualPages(runBaseAddress, numRunPages); }
+		else
+		{
+			Platform::decommitVirtualPages(runBaseAddress, numRunPages);
+			errorUnless(Platform::commitVirtualPages(runBaseAddress,
+													 numRunPages,
+													 Platform::MemoryAccess::readWrite,
+													 getCommitFlags(memory->compartment),
+													 memory->compartment->numaNode));
+		}
+
+		numReclaimedPages += numRunPages;
+		pageIndex = endPageIndex;
+	}
+
+	// The replaced pages no longer match the memory's page snapshot, so release it.
+	if(isMappedFromSnapshot && numReclaimedPages) { releasePageSnapshot(memory); }
+
+	const Uptr numReclaimedBytes = numReclaimedPages << pageSizeLog2;
+	reclaimedMemoryBytesCounter.add(numReclaimedBytes);
+	return numReclaimedBytes;
+}
+
+Uptr Runtime::reclaimCompartmentZeroMemoryPages(Compartment* compartment)
+{
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+
+	Uptr numReclaimedBytes = 0;
+	for(MemoryInstance* memory : compartment->memories)
+	{ numReclaimedBytes += reclaimZeroMemoryPages(memory); }
+	return numReclaimedBytes;
+}
+
+bool Runtime::mapMemoryFile(MemoryInstance* memory,
+							Uptr pageIndex,
+							Uptr numPages,
+							Platform::File* file,
+							U64 fileOffset,
+							bool isShared)
+{
+	if(fileOffset & (IR::numBytesPerPage - 1)) { return false; }
+
+	MemoryResizingLock resizingLock(memory);
+	const Uptr memoryNumPages = memory->numPages.load(std::memory_order_acquire);
+	if(pageIndex > memoryNumPages || numPages > memoryNumPages - pageIndex) { return false; }
+	if(!numPages) { return true; }
+
+	// The pages will no longer match the memory's page snapshot, so release it.
+	releasePageSnapshot(memory);
+	memory->hasMappedFiles = true;
+
+	U8* pagesBaseAddress = memory->baseAddress + pageIndex * IR::numBytesPerPage;
+	const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+	if(!Platform::mapFileToVirtualPages(
+		   file, fileOffset, pagesBaseAddress, numPlatformPages, isShared))
+	{
+		// Keep the pages accessible, since they are within the memory's size.
+		errorUnless(Platform::commitVirtualPages(pagesBaseAddress, numPlatformPages));
+		return false;
+	}
+
+	return true;
+}
+
+void Runtime::unmapMemoryFile(MemoryInstance* memory, Uptr pageIndex, Uptr numPages)
+{
+	wavmAssert(pageIndex + numPages >= pageIndex);
+	wavmAssert((pageIndex + numPages) * IR::numBytesPerPage <= memory->numReservedBytes);
+
+	// Decommitting the pages unmaps the file, and committing them again replaces them with zeroed
+	// pages.
+	MemoryResizingLock resizingLock(memory);
+	U8* pagesBaseAddress = memory->baseAddress + pageIndex * IR::numBytesPerPage;
+	const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+	Platform::decommitVirtualPages(pagesBaseAddress, numPlatformPages);
+	errorUnless(Platform::commitVirtualPages(pagesBaseAddress, numPlatformPages));
+}
+
+bool Runtime::mapMemoryPageSnapshot(MemoryInstance* memory, Platform::VirtualPageSnapshot* snapshot)
+{
+	MemoryResizingLock resizingLock(memory);
+	if(!Platform::mapVirtualPageSnapshot(snapshot, memory->baseAddress)) { return false; }
+
+	releasePageSnapshot(memory);
+	memory->pageSnapshot = snapshot;
+	return true;
+}
+
 U8* Runtime::getMemoryBaseAddress(MemoryInstance* memory) { return memory->baseAddress; }
 
 static U8* getValidatedMemoryOffsetRangeImpl(U8* memoryBase,
@@ -283,32 +848,38 @@ U8* Runtime::getValidatedMemoryOffsetRange(MemoryInstance* memory, Uptr address,
 		numBytes);
 }
 
+MemoryView::MemoryView(MemoryInstance* memory)
+: base(memory->baseAddress)
+, beginAddress(0)
+, endAddress(memory->numPages.load(std::memory_order_acquire) * IR::numBytesPerPage)
+{
+}
+
+// The memory intrinsics take 64-bit addresses, sizes, and page counts, so they can be used with
+// both 32-bit and 64-bit memories: generated code zero-extends the operands of 32-bit memories.
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "memory.grow",
-						  I32,
+						  I64,
 						  memory_grow,
-						  I32 deltaPages,
+						  U64 deltaPages,
 						  I64 memoryId)
 {
 	MemoryInstance* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
-	const Iptr numPreviousMemoryPages = growMemory(memory, (Uptr)deltaPages);
-	wavmAssert(numPreviousMemoryPages <= INT32_MAX);
-	return I32(numPreviousMemoryPages);
+	if(deltaPages > UINTPTR_MAX) { return -1; }
+	return I64(growMemory(memory, Uptr(deltaPages)));
 }
 
-DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "memory.size", I32, memory_size, I64 memoryId)
+DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "memory.size", I64, memory_size, I64 memoryId)
 {
 	MemoryInstance* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
-	Uptr numMemoryPages = getMemoryNumPages(memory);
-	wavmAssert(numMemoryPages <= UINT32_MAX);
-	return U32(numMemoryPages);
+	return I64(getMemoryNumPages(memory));
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "memory.init",
 						  void,
 						  memory_init,
-						  U32 destAddress,
+						  U64 destAddress,
 						  U32 sourceOffset,
 						  U32 numBytes,
 						  Uptr moduleInstanceBits,
@@ -316,38 +887,37 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  Uptr dataSegmentIndex)
 {
 	ModuleInstance* moduleInstance = reinterpret_cast<ModuleInstance*>(moduleInstanceBits);
-	Lock<Platform::Mutex> passiveDataSegmentsLock(moduleInstance->passiveDataSegmentsMutex);
+	wavmAssert(dataSegmentIndex < moduleInstance->passiveDataSegments->size());
 
-	if(!moduleInstance->passiveDataSegments.contains(dataSegmentIndex))
+	if(moduleInstance->isDataSegmentDropped(dataSegmentIndex))
 	{ throwException(Exception::invalidArgumentType); }
 	else
 	{
-		// Copy the passive data segment shared_ptr, and unlock the mutex. It's important to
-		// explicitly unlock the mutex before calling memcpy, as memcpy might trigger a signal that
-		// will unwind the stack without calling the Lock destructor.
-		std::shared_ptr<const std::vector<U8>> passiveDataSegmentBytes
-			= moduleInstance->passiveDataSegments[dataSegmentIndex];
-		passiveDataSegmentsLock.unlock();
+		// The segment's bytes are owned by the Module, and aren't freed while the instance refers
+		// to them, so they may be read without holding a lock even if another thread drops the
+		// segment.
+		const SharedBytes& passiveDataSegmentBytes
+			= (*moduleInstance->passiveDataSegments)[dataSegmentIndex];
 
 		MemoryInstance* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
 		U8* destPointer = getReservedMemoryOffsetRange(memory, destAddress, numBytes);
 
-		if(U64(sourceOffset) + U64(numBytes) > passiveDataSegmentBytes->size())
+		if(U64(sourceOffset) + U64(numBytes) > passiveDataSegmentBytes.size())
 		{
 			// If the source range is outside the bounds of the data segment, copy the part that is
 			// in range, then trap.
-			if(sourceOffset < passiveDataSegmentBytes->size())
+			if(sourceOffset < passiveDataSegmentBytes.size())
 			{
 				Platform::bytewiseMemCopy(destPointer,
-										  passiveDataSegmentBytes->data() + sourceOffset,
-										  passiveDataSegmentBytes->size() - sourceOffset);
+										  passiveDataSegmentBytes.data() + sourceOffset,
+										  passiveDataSegmentBytes.size() - sourceOffset);
 			}
 			throwException(Exception::memoryAddressOutOfBoundsType);
 		}
 		else if(numBytes)
 		{
 			Platform::bytewiseMemCopy(
-				destPointer, passiveDataSegmentBytes->data() + sourceOffset, numBytes);
+				destPointer, passiveDataSegmentBytes.data() + sourceOffset, numBytes);
 		}
 	}
 }
@@ -360,43 +930,275 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  Uptr dataSegmentIndex)
 {
 	ModuleInstance* moduleInstance = reinterpret_cast<ModuleInstance*>(moduleInstanceBits);
-	Lock<Platform::Mutex> passiveDataSegmentsLock(moduleInstance->passiveDataSegmentsMutex);
+	wavmAssert(dataSegmentIndex < moduleInstance->passiveDataSegments->size());
 
-	if(!moduleInstance->passiveDataSegments.contains(dataSegmentIndex))
+	if(moduleInstance->dropDataSegment(dataSegmentIndex))
 	{ throwException(Exception::invalidArgumentType); }
+}
+
+// memory.copy and memory.fill of shared memories that write at least this many bytes are split
+// between multiple threads.
+static std::atomic<Uptr> parallelBulkMemoryThreshold{Uptr(64) * 1024 * 1024};
+
+enum
+{
+	maxParallelBulkMemoryThreads = 8,
+	bulkMemoryThreadStackBytes = 64 * 1024
+};
+
+void Runtime::setParallelBulkMemoryThreshold(Uptr numBytes)
+{
+	parallelBulkMemoryThreshold.store(numBytes, std::memory_order_relaxed);
+}
+
+// A part of a memory.copy or memory.fill: copies numBytes from source to dest, or fills them with
+// value if source is null.
+struct BulkMemoryTask
+{
+	U8* dest;
+	const U8* source;
+	Uptr numBytes;
+	U8 value;
+};
+
+static I64 bulkMemoryThreadEntry(void* argument)
+{
+	const BulkMemoryTask& task = *(const BulkMemoryTask*)argument;
+	if(task.source) { memmove(task.dest, task.source, task.numBytes); }
 	else
 	{
-		moduleInstance->passiveDataSegments.removeOrFail(dataSegmentIndex);
+		memset(task.dest, task.value, task.numBytes);
 	}
+	return 0;
 }
 
+// Copies or fills a range of bytes that has been bounds checked against the memory's size, so it
+// can't trap partway. That allows using the C library's memmove and memset, which select a kernel
+// for the CPU when the program is loaded (e.g. AVX2, AVX-512, or ERMS "rep movsb"), and use
+// non-temporal stores for operations that are too large to fit in the cache. Large copies and
+// fills of shared memories are split between multiple threads, since a single core can't use all
+// the memory bandwidth.
+static void bulkMemoryOp(MemoryInstance* memory,
+						 U8* dest,
+						 const U8* source,
+						 U8 value,
+						 Uptr numBytes)
+{
+	const bool isOverlappingCopy = source && dest < source + numBytes && source < dest + numBytes;
+	Uptr numThreads = 1;
+	if(memory->type.isShared && !isOverlappingCopy
+	   && numBytes >= parallelBulkMemoryThreshold.load(std::memory_order_relaxed))
+	{
+		numThreads = std::min(Uptr(maxParallelBulkMemoryThreads),
+							  Platform::getNumberOfHardwareThreads());
+	}
+
+	if(numThreads <= 1)
+	{
+		if(source) { memmove(dest, source, numBytes); }
+		else
+		{
+			memset(dest, value, numBytes);
+		}
+		return;
+	}
+
+	// Split the range into tasks that are a whole number of pages, so the threads don't write to
+	// the same pages. The calling thread only waits for the tasks: if it ran one of them and
+	// trapped (e.g. because the host unmapped some of the memory's pages concurrently), it would
+	// unwind the tasks while the other threads are still using them.
+	const Uptr numPageBytes = Uptr(1) << Platform::getPageSizeLog2();
+	const Uptr numTaskBytes
+		= ((numBytes + numThreads - 1) / numThreads + numPageBytes - 1) & ~(numPageBytes - 1);
+	BulkMemoryTask tasks[maxParallelBulkMemoryThreads];
+	Platform::Thread* threads[maxParallelBulkMemoryThreads];
+	Uptr numTasks = 0;
+	for(Uptr offset = 0; offset < numBytes; offset += numTaskBytes)
+	{
+		wavmAssert(numTasks < numThreads);
+		tasks[numTasks] = BulkMemoryTask{dest + offset,
+										 source ? source + offset : nullptr,
+										 std::min(numTaskBytes, numBytes - offset),
+										 value};
+		threads[numTasks] = Platform::createThread(
+			bulkMemoryThreadStackBytes, bulkMemoryThreadEntry, &tasks[numTasks]);
+		++numTasks;
+	}
+	for(Uptr taskIndex = 0; taskIndex < numTasks; ++taskIndex)
+	{ Platform::joinThread(threads[taskIndex]); }
+}
+
+// Checks the range [address..address+numBytes) against the memory's current size, and returns
+// whether it is entirely in bounds. outNumInBoundsBytes receives the number of bytes at the start
+// of the range that are in bounds.
+static bool checkBulkMemoryRange(MemoryInstance* memory,
+								 U64 address,
+								 U64 numBytes,
+								 Uptr& outNumInBoundsBytes)
+{
+	const U64 numMemoryBytes
+		= U64(memory->numPages.load(std::memory_order_acquire)) * IR::numBytesPerPage;
+	outNumInBoundsBytes
+		= address >= numMemoryBytes ? 0 : Uptr(std::min(numBytes, numMemoryBytes - address));
+	return address <= numMemoryBytes && numBytes <= numMemoryBytes - address;
+}
+
+// memory.copy and memory.fill check their ranges against the memories' sizes up front. If a range
+// is out of bounds, they write the bytes before the first out-of-bounds byte before trapping, the
+// same as if they had accessed the bytes one at a time.
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "memory.copy",
 						  void,
 						  memory_copy,
-						  U32 destAddress,
-						  U32 sourceAddress,
-						  U32 numBytes,
-						  Uptr memoryId)
+						  U64 destAddress,
+						  U64 sourceAddress,
+						  U64 numBytes,
+						  Uptr destMemoryId,
+						  Uptr sourceMemoryId)
 {
-	MemoryInstance* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
+	MemoryInstance* destMemory = getMemoryFromRuntimeData(contextRuntimeData, destMemoryId);
+	MemoryInstance* sourceMemory = getMemoryFromRuntimeData(contextRuntimeData, sourceMemoryId);
+
+	Uptr numInBoundsDestBytes;
+	Uptr numInBoundsSourceBytes;
+	const bool isDestInBounds
+		= checkBulkMemoryRange(destMemory, destAddress, numBytes, numInBoundsDestBytes);
+	const bool isSourceInBounds
+		= checkBulkMemoryRange(sourceMemory, sourceAddress, numBytes, numInBoundsSourceBytes);
 
-	U8* destPointer = getReservedMemoryOffsetRange(memory, destAddress, numBytes);
-	U8* sourcePointer = getReservedMemoryOffsetRange(memory, sourceAddress, numBytes);
-	if(numBytes) { Platform::bytewiseMemMove(destPointer, sourcePointer, numBytes); }
+	const Uptr numCopyBytes = std::min(numInBoundsDestBytes, numInBoundsSourceBytes);
+	if(numCopyBytes)
+	{
+		U8* destPointer = getValidatedMemoryOffsetRange(destMemory, destAddress, numCopyBytes);
+		U8* sourcePointer
+			= getValidatedMemoryOffsetRange(sourceMemory, sourceAddress, numCopyBytes);
+		bulkMemoryOp(destMemory, destPointer, sourcePointer, 0, numCopyBytes);
+	}
+
+	if(!isDestInBounds || !isSourceInBounds)
+	{ throwException(Exception::memoryAddressOutOfBoundsType); }
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "memory.fill",
 						  void,
 						  memory_fill,
-						  U32 destAddress,
+						  U64 destAddress,
 						  U32 value,
-						  U32 numBytes,
+						  U64 numBytes,
 						  Uptr memoryId)
 {
 	MemoryInstance* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
 
-	U8* destPointer = getReservedMemoryOffsetRange(memory, destAddress, numBytes);
-	if(numBytes) { Platform::bytewiseMemSet(destPointer, U8(value), numBytes); }
+	Uptr numFillBytes;
+	const bool isInBounds = checkBulkMemoryRange(memory, destAddress, numBytes, numFillBytes);
+	if(numFillBytes)
+	{
+		U8* destPointer = getValidatedMemoryOffsetRange(memory, destAddress, numFillBytes);
+		bulkMemoryOp(memory, destPointer, nullptr, U8(value), numFillBytes);
+	}
+
+	if(!isInBounds) { throwException(Exception::memoryAddressOutOfBoundsType); }
+}
+
+void Runtime::startContextMemoryAccessTrace(Context* context, const MemoryAccessTraceConfig& config)
+{
+	wavmAssert(config.sampleInterval > 0);
+	wavmAssert(config.numRecords > 0);
+
+	std::unique_ptr<MemoryAccessTrace> trace(new MemoryAccessTrace);
+	trace->config = config;
+	trace->records.resize(config.numRecords);
+
+	Lock<Platform::Mutex> traceLock(context->memoryAccessTraceMutex);
+	context->memoryAccessTrace = std::move(trace);
+	context->runtimeData->memoryAccessSampleCountdown
+		= I64(std::min(config.sampleInterval, U64(INT64_MAX)));
+}
+
+void Runtime::stopContextMemoryAccessTrace(Context* context)
+{
+	Lock<Platform::Mutex> traceLock(context->memoryAccessTraceMutex);
+	context->memoryAccessTrace.reset();
+	context->runtimeData->memoryAccessSampleCountdown = INT64_MAX;
+}
+
+U64 Runtime::readContextMemoryAccessTrace(Context* context,
+										  std::vector<MemoryAccessRecord>& outRecords)
+{
+	Lock<Platform::Mutex> traceLock(context->memoryAccessTraceMutex);
+	MemoryAccessTrace* trace = context->memoryAccessTrace.get();
+	if(!trace) { return 0; }
+
+	const Uptr numBufferRecords = trace->records.size();
+	Uptr recordIndex
+		= (trace->nextRecordIndex + numBufferRecords - trace->numRecords) % numBufferRecords;
+	for(Uptr index = 0; index < trace->numRecords; ++index)
+	{
+		outRecords.push_back(trace->records[recordIndex]);
+		recordIndex = (recordIndex + 1) % numBufferRecords;
+	}
+	trace->numRecords = 0;
+
+	const U64 numOverwrittenRecords = trace->numOverwrittenRecords;
+	trace->numOverwrittenRecords = 0;
+	return numOverwrittenRecords;
+}
+
+void Runtime::addMemoryAccessesToHeatMap(const std::vector<MemoryAccessRecord>& records,
+										 MemoryInstance* memory,
+										 Uptr pageSizeLog2,
+										 std::vector<U64>& inOutPageAccessCounts)
+{
+	wavmAssert(pageSizeLog2 < 64);
+
+	// Accesses past the end of the memory trapped after they were sampled, so ignore them.
+	const U64 numMemoryBytes = U64(getMemoryNumPages(memory)) * IR::numBytesPerPage;
+	for(const MemoryAccessRecord& record : records)
+	{
+		if(record.memory != memory || !record.numBytes || record.address >= numMemoryBytes
+		   || record.numBytes > numMemoryBytes - record.address)
+		{ continue; }
+
+		const U64 firstPageIndex = record.address >> pageSizeLog2;
+		const U64 lastPageIndex = (record.address + record.numBytes - 1) >> pageSizeLog2;
+		if(lastPageIndex >= inOutPageAccessCounts.size())
+		{ inOutPageAccessCounts.resize(Uptr(lastPageIndex + 1), 0); }
+		for(U64 pageIndex = firstPageIndex; pageIndex <= lastPageIndex; ++pageIndex)
+		{ ++inOutPageAccessCounts[Uptr(pageIndex)]; }
+	}
+}
+
+DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
+						  "memoryAccessSampled",
+						  void,
+						  memoryAccessSampled,
+						  U64 address,
+						  U32 numBytes,
+						  U32 isStore,
+						  Iptr memoryId)
+{
+	Context* context = getContextFromRuntimeData(contextRuntimeData);
+	Lock<Platform::Mutex> traceLock(context->memoryAccessTraceMutex);
+	MemoryAccessTrace* trace = context->memoryAccessTrace.get();
+	if(!trace)
+	{
+		contextRuntimeData->memoryAccessSampleCountdown = INT64_MAX;
+		return;
+	}
+
+	contextRuntimeData->memoryAccessSampleCountdown
+		= I64(std::min(trace->config.sampleInterval, U64(INT64_MAX)));
+	if(address < trace->config.beginAddress || address >= trace->config.endAddress) { return; }
+
+	// Append the record to the ring buffer, overwriting the oldest record if it is full.
+	MemoryInstance* memory = getMemoryFromRuntimeData(contextRuntimeData, Uptr(memoryId));
+	trace->records[trace->nextRecordIndex]
+		= MemoryAccessRecord{memory, address, numBytes, isStore != 0};
+	trace->nextRecordIndex = (trace->nextRecordIndex + 1) % trace->records.size();
+	if(trace->numRecords < trace->records.size()) { ++trace->numRecords; }
+	else
+	{
+		++trace->numOverwrittenRecords;
+	}
 }
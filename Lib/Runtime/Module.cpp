@@ -1,23 +1,34 @@
 #include <string.h>
+#include <algorithm>
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <utility>
 
 #include "RuntimePrivate.h"
 #include "WAVM/IR/IR.h"
 #include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
 #include "WAVM/IR/Types.h"
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/ScratchArena.h"
 #include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/SharedBytes.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Logging/Trace.h"
+#include "WAVM/Platform/Diagnostics.h"
 #include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASM/WASM.h"
 
 using namespace WAVM;
 using namespace WAVM::IR;
@@ -47,27 +58,1084 @@ static Value evaluateInitializer(const std::vector<GlobalInstance*>& moduleGloba
 	};
 }
 
-Runtime::Module* Runtime::compileModule(const IR::Module& irModule)
+static std::vector<U8> compileObjectCode(const IR::Module& irModule,
+										 const LLVMJIT::CompileOptions& llvmJITOptions,
+										 const std::string& objectCacheDirectory,
+										 ObjectCache* objectCache)
 {
-	std::vector<U8> objectCode = LLVMJIT::compileModule(irModule);
-	return new Module(IR::Module(irModule), std::move(objectCode));
+	if(objectCacheDirectory.empty() && !objectCache)
+	{ return LLVMJIT::compileModule(irModule, llvmJITOptions); }
+
+	// Try to load the object code from the object cache before compiling the module.
+	const ObjectCacheKey objectCacheKey = getObjectCacheKey(irModule, llvmJITOptions);
+	std::vector<U8> objectCode;
+	if(!loadCachedObjectCode(objectCacheDirectory, objectCache, objectCacheKey, objectCode))
+	{
+		// Don't cache the empty object code of a cancelled compile.
+		objectCode = LLVMJIT::compileModule(irModule, llvmJITOptions);
+		if(objectCode.size())
+		{ saveCachedObjectCode(objectCacheDirectory, objectCache, objectCacheKey, objectCode); }
+	}
+	return objectCode;
+}
+
+static LLVMJIT::OptimizationLevel getLLVMJITOptimizationLevel(OptimizationLevel level)
+{
+	switch(level)
+	{
+	case OptimizationLevel::none: return LLVMJIT::OptimizationLevel::none;
+	case OptimizationLevel::fast: return LLVMJIT::OptimizationLevel::fast;
+	case OptimizationLevel::standard: return LLVMJIT::OptimizationLevel::standard;
+	case OptimizationLevel::aggressive: return LLVMJIT::OptimizationLevel::aggressive;
+	default: Errors::unreachable();
+	};
+}
+
+static LLVMJIT::CodeGenOptimizationLevel getLLVMJITCodeGenOptimizationLevel(
+	CodeGenOptimizationLevel level)
+{
+	switch(level)
+	{
+	case CodeGenOptimizationLevel::automatic: return LLVMJIT::CodeGenOptimizationLevel::automatic;
+	case CodeGenOptimizationLevel::none: return LLVMJIT::CodeGenOptimizationLevel::none;
+	case CodeGenOptimizationLevel::less: return LLVMJIT::CodeGenOptimizationLevel::less;
+	case CodeGenOptimizationLevel::standard: return LLVMJIT::CodeGenOptimizationLevel::standard;
+	case CodeGenOptimizationLevel::aggressive:
+		return LLVMJIT::CodeGenOptimizationLevel::aggressive;
+	default: Errors::unreachable();
+	};
+}
+
+bool Runtime::parseOptimizationLevel(const char* name, OptimizationLevel& outLevel)
+{
+	if(!strcmp(name, "none")) { outLevel = OptimizationLevel::none; }
+	else if(!strcmp(name, "fast"))
+	{
+		outLevel = OptimizationLevel::fast;
+	}
+	else if(!strcmp(name, "O2"))
+	{
+		outLevel = OptimizationLevel::standard;
+	}
+	else if(!strcmp(name, "O3"))
+	{
+		outLevel = OptimizationLevel::aggressive;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool Runtime::parseCodeGenOptimizationLevel(const char* name, CodeGenOptimizationLevel& outLevel)
+{
+	if(!strcmp(name, "none")) { outLevel = CodeGenOptimizationLevel::none; }
+	else if(!strcmp(name, "less"))
+	{
+		outLevel = CodeGenOptimizationLevel::less;
+	}
+	else if(!strcmp(name, "default"))
+	{
+		outLevel = CodeGenOptimizationLevel::standard;
+	}
+	else if(!strcmp(name, "aggressive"))
+	{
+		outLevel = CodeGenOptimizationLevel::aggressive;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+void Runtime::appendTargetFeatures(const char* featureList, std::vector<std::string>& outFeatures)
+{
+	while(*featureList)
+	{
+		const char* featureEnd = strchr(featureList, ',');
+		if(!featureEnd) { featureEnd = featureList + strlen(featureList); }
+		if(featureEnd != featureList) { outFeatures.emplace_back(featureList, featureEnd); }
+		featureList = *featureEnd ? featureEnd + 1 : featureEnd;
+	}
+}
+
+// The version of the serialized module profile format.
+static constexpr U32 moduleProfileVersion = 1;
+
+std::vector<U8> Runtime::serializeModuleProfile(const LLVMJIT::ModuleProfile& profile)
+{
+	Serialization::ArrayOutputStream stream;
+	U32 version = moduleProfileVersion;
+	Serialization::serialize(stream, version);
+
+	U64 numFunctionDefEntryCounts = profile.functionDefEntryCounts.size();
+	Serialization::serializeVarUInt64(stream, numFunctionDefEntryCounts);
+	for(U64 entryCount : profile.functionDefEntryCounts)
+	{ Serialization::serializeVarUInt64(stream, entryCount); }
+
+	U64 numBranchOps = profile.branchCounts.size();
+	Serialization::serializeVarUInt64(stream, numBranchOps);
+	for(const auto& branchCountsPair : profile.branchCounts)
+	{
+		U64 functionDefIndex = branchCountsPair.first.first;
+		U64 opIndex = branchCountsPair.first.second;
+		U64 numBranches = branchCountsPair.second.size();
+		Serialization::serializeVarUInt64(stream, functionDefIndex);
+		Serialization::serializeVarUInt64(stream, opIndex);
+		Serialization::serializeVarUInt64(stream, numBranches);
+		for(U64 branchCount : branchCountsPair.second)
+		{ Serialization::serializeVarUInt64(stream, branchCount); }
+	}
+
+	U64 numIndirectCallees = profile.indirectCallees.size();
+	Serialization::serializeVarUInt64(stream, numIndirectCallees);
+	for(const auto& indirectCalleePair : profile.indirectCallees)
+	{
+		U64 functionDefIndex = indirectCalleePair.first.first;
+		U64 opIndex = indirectCalleePair.first.second;
+		U64 calleeFunctionIndex = indirectCalleePair.second;
+		Serialization::serializeVarUInt64(stream, functionDefIndex);
+		Serialization::serializeVarUInt64(stream, opIndex);
+		Serialization::serializeVarUInt64(stream, calleeFunctionIndex);
+	}
+
+	return stream.getBytes();
+}
+
+// Deserializes a module profile serialized by serializeModuleProfile. Returns false if the bytes
+// aren't a valid serialized profile.
+static bool deserializeModuleProfile(const std::vector<U8>& bytes,
+									 LLVMJIT::ModuleProfile& outProfile)
+{
+	try
+	{
+		Serialization::MemoryInputStream stream(bytes.data(), bytes.size());
+		U32 version = 0;
+		Serialization::serialize(stream, version);
+		if(version != moduleProfileVersion) { return false; }
+
+		U64 numFunctionDefEntryCounts = 0;
+		Serialization::serializeVarUInt64(stream, numFunctionDefEntryCounts);
+		for(U64 index = 0; index < numFunctionDefEntryCounts; ++index)
+		{
+			U64 entryCount = 0;
+			Serialization::serializeVarUInt64(stream, entryCount);
+			outProfile.functionDefEntryCounts.push_back(entryCount);
+		}
+
+		U64 numBranchOps = 0;
+		Serialization::serializeVarUInt64(stream, numBranchOps);
+		for(U64 index = 0; index < numBranchOps; ++index)
+		{
+			U64 functionDefIndex = 0;
+			U64 opIndex = 0;
+			U64 numBranches = 0;
+			Serialization::serializeVarUInt64(stream, functionDefIndex);
+			Serialization::serializeVarUInt64(stream, opIndex);
+			Serialization::serializeVarUInt64(stream, numBranches);
+
+			std::vector<U64>& branchCounts
+				= outProfile.branchCounts[{Uptr(functionDefIndex), Uptr(opIndex)}];
+			for(U64 branchIndex = 0; branchIndex < numBranches; ++branchIndex)
+			{
+				U64 branchCount = 0;
+				Serialization::serializeVarUInt64(stream, branchCount);
+				branchCounts.push_back(branchCount);
+			}
+		}
+
+		U64 numIndirectCallees = 0;
+		Serialization::serializeVarUInt64(stream, numIndirectCallees);
+		for(U64 index = 0; index < numIndirectCallees; ++index)
+		{
+			U64 functionDefIndex = 0;
+			U64 opIndex = 0;
+			U64 calleeFunctionIndex = 0;
+			Serialization::serializeVarUInt64(stream, functionDefIndex);
+			Serialization::serializeVarUInt64(stream, opIndex);
+			Serialization::serializeVarUInt64(stream, calleeFunctionIndex);
+			outProfile.indirectCallees[{Uptr(functionDefIndex), Uptr(opIndex)}]
+				= Uptr(calleeFunctionIndex);
+		}
+
+		return stream.capacity() == 0;
+	}
+	catch(Serialization::FatalSerializationException const&)
+	{
+		return false;
+	}
+}
+
+static LLVMJIT::CompileOptions getLLVMJITCompileOptions(const CompileOptions& options)
+{
+	LLVMJIT::CompileOptions llvmJITOptions;
+	llvmJITOptions.optimizationLevel = getLLVMJITOptimizationLevel(options.optimizationLevel);
+	llvmJITOptions.codeGenOptimizationLevel
+		= getLLVMJITCodeGenOptimizationLevel(options.codeGenOptimizationLevel);
+	llvmJITOptions.targetCPU = options.targetCPU;
+	llvmJITOptions.targetFeatures = options.targetFeatures;
+	for(const CompileOptions::TargetVersion& targetVersion : options.targetVersions)
+	{
+		llvmJITOptions.targetVersions.push_back(
+			{targetVersion.targetCPU, targetVersion.targetFeatures});
+	}
+	llvmJITOptions.memoryBoundsChecks = options.maxMemoryReservedBytes != UINTPTR_MAX;
+	llvmJITOptions.numThreads = options.numCompileThreads;
+	llvmJITOptions.epochInterruption = options.epochInterruption;
+	llvmJITOptions.fuelMetering = options.fuelMetering;
+	llvmJITOptions.stackLimitChecks = options.stackLimitChecks;
+	llvmJITOptions.canonicalizeNaNs = options.canonicalizeNaNs;
+	llvmJITOptions.memoryAccessSampling = options.memoryAccessSampling;
+	llvmJITOptions.relaxedMemoryAccesses = options.relaxedMemoryAccesses;
+	llvmJITOptions.profileInstrumentation = options.profileInstrumentation;
+	llvmJITOptions.profileCycles = options.profileCycles;
+	llvmJITOptions.framePointers = options.framePointers;
+	llvmJITOptions.specializedGlobalImports = options.specializedGlobalImports;
+	if(options.profile.size())
+	{
+		// The profile only guides optimization, so the module is compiled without it if it's
+		// invalid.
+		auto profile = std::make_shared<LLVMJIT::ModuleProfile>();
+		if(deserializeModuleProfile(options.profile, *profile)) { llvmJITOptions.profile = profile; }
+		else
+		{
+			Log::printf(Log::error, "Ignoring invalid module profile.\n");
+		}
+	}
+	return llvmJITOptions;
+}
+
+// Returns the options to compile a module's initial object code with: with tiered compilation,
+// the baseline tier is compiled with minimal optimization.
+static LLVMJIT::CompileOptions getInitialTierCompileOptions(const CompileOptions& options)
+{
+	LLVMJIT::CompileOptions llvmJITOptions = getLLVMJITCompileOptions(options);
+	if(options.tierUpCallCount)
+	{
+		llvmJITOptions.optimizationLevel = LLVMJIT::OptimizationLevel::none;
+		llvmJITOptions.codeGenOptimizationLevel = LLVMJIT::CodeGenOptimizationLevel::automatic;
+	}
+	return llvmJITOptions;
+}
+
+// Checks that the globals a module is specialized for are immutable imported globals with the
+// types of the values they are specialized for.
+static void validateSpecializedGlobalImports(const IR::Module& irModule,
+											 const CompileOptions& options)
+{
+	for(const auto& specializedGlobalImport : options.specializedGlobalImports)
+	{
+		const Uptr globalIndex = specializedGlobalImport.first;
+		const ValueType valueType = specializedGlobalImport.second.type;
+		errorUnless(globalIndex < irModule.globals.imports.size());
+		const GlobalType globalType = irModule.globals.imports[globalIndex].type;
+		errorUnless(!globalType.isMutable && globalType.valueType == valueType);
+		errorUnless(valueType == ValueType::i32 || valueType == ValueType::i64
+					|| valueType == ValueType::f32 || valueType == ValueType::f64
+					|| valueType == ValueType::v128);
+	}
+}
+
+// If the module is compiled with profile instrumentation, allocates the profile counters that its
+// instances' code updates.
+static void createProfileCounters(Runtime::Module* module, const CompileOptions& options)
+{
+	if(options.profileInstrumentation)
+	{
+		module->profileInstrumentation = true;
+		module->profileCounters.resize(LLVMJIT::getNumProfileCounters(module->ir), 0);
+	}
+}
+
+// Releases the code of a compiled module's function definitions, which are only needed to compile
+// the module's optimized tier, or to decode its profile counters.
+static void releaseFunctionDefCode(Runtime::Module* module)
+{
+	for(FunctionDef& functionDef : module->ir.functions.defs)
+	{
+		functionDef.code = SharedBytes();
+		functionDef.branchTables.clear();
+		functionDef.branchTables.shrink_to_fit();
+	}
+}
+
+// Creates a module from its initial object code, and with tiered compilation, saves the options
+// needed to compile the optimized tier later.
+static Runtime::Module* createCompiledModule(IR::Module&& irModule,
+											 std::vector<U8>&& objectCode,
+											 const CompileOptions& options)
+{
+	Runtime::Module* module = new Runtime::Module(std::move(irModule), std::move(objectCode));
+	module->maxMemoryReservedBytes = options.maxMemoryReservedBytes;
+	module->mapDataSegmentsOnDemand = options.mapDataSegmentsOnDemand;
+	module->specializedGlobalImports = options.specializedGlobalImports;
+	createProfileCounters(module, options);
+	if(options.tierUpCallCount)
+	{
+		module->tierUpCallCount = options.tierUpCallCount;
+		module->deferredCompileOptions = getLLVMJITCompileOptions(options);
+		module->objectCacheDirectory = options.objectCacheDirectory;
+		module->objectCache = options.objectCache;
+	}
+	else if(!options.profileInstrumentation)
+	{ releaseFunctionDefCode(module); }
+	return module;
+}
+
+template<> struct WAVM::Hash<SharedModuleKey>
+{
+	Uptr operator()(const SharedModuleKey& key, Uptr seed = 0) const
+	{
+		Uptr hash = WAVM::Hash<U64>()(key.objectCacheKey.hash, seed);
+		hash = WAVM::Hash<Uptr>()(key.maxMemoryReservedBytes, hash);
+		hash = WAVM::Hash<Uptr>()(key.tierUpCallCount, hash);
+		return WAVM::Hash<Uptr>()(Uptr(key.mapDataSegmentsOnDemand), hash);
+	}
+};
+
+// The modules compiled with shareIdenticalModules that haven't been freed. The table doesn't root
+// the modules: they remove themselves from it when they are freed.
+static Platform::Mutex sharedModulesMutex;
+static HashMap<SharedModuleKey, Runtime::Module*> sharedModules;
+
+static Metrics::Counter sharedModuleHitCounter(
+	"runtime.shared_module_hits",
+	"Number of compiles that returned a previously compiled identical module");
+
+static SharedModuleKey getSharedModuleKey(const IR::Module& irModule,
+										  const LLVMJIT::CompileOptions& llvmJITOptions,
+										  const CompileOptions& options)
+{
+	SharedModuleKey key;
+	key.objectCacheKey = getObjectCacheKey(irModule, llvmJITOptions);
+	key.maxMemoryReservedBytes = options.maxMemoryReservedBytes;
+	key.tierUpCallCount = options.tierUpCallCount;
+	key.mapDataSegmentsOnDemand = options.mapDataSegmentsOnDemand;
+	return key;
+}
+
+// Returns the shared module with a key, or null if there isn't one.
+static Runtime::Module* findSharedModule(const SharedModuleKey& key)
+{
+	Lock<Platform::Mutex> gcLock(getGarbageCollectionMutex());
+	Lock<Platform::Mutex> sharedModulesLock(sharedModulesMutex);
+	Runtime::Module* const* sharedModule = sharedModules.get(key);
+	if(!sharedModule) { return nullptr; }
+	sharedModuleHitCounter.add();
+	return *sharedModule;
+}
+
+// Adds a module to the shared modules, and returns it. If another thread added an identical module
+// while this one was being compiled, returns that module instead.
+static Runtime::Module* addSharedModule(const SharedModuleKey& key, Runtime::Module* module)
+{
+	Lock<Platform::Mutex> gcLock(getGarbageCollectionMutex());
+	Lock<Platform::Mutex> sharedModulesLock(sharedModulesMutex);
+	Runtime::Module* const* sharedModule = sharedModules.get(key);
+	if(sharedModule) { return *sharedModule; }
+
+	sharedModules.addOrFail(key, module);
+	module->isShared = true;
+	module->sharedModuleKey = key;
+	return module;
+}
+
+Runtime::Module* Runtime::compileModule(const IR::Module& irModule, const CompileOptions& options)
+{
+	return compileModuleWithMonitor(irModule, options, nullptr);
+}
+
+Runtime::Module* Runtime::compileModuleWithMonitor(const IR::Module& irModule,
+												   const CompileOptions& options,
+												   LLVMJIT::CompileMonitor* monitor)
+{
+	Trace::Span traceSpan("compileModule");
+	validateSpecializedGlobalImports(irModule, options);
+
+	if(options.lazyCompile)
+	{
+		// With lazy compilation, the module's function definitions are compiled when they are
+		// first called, so there's nothing to compile yet.
+		Module* module = new Module(IR::Module(irModule), {});
+		module->lazyCompile = true;
+		module->lazyCompileDirectCallees = options.lazyCompileDirectCallees;
+		module->deferredCompileOptions = getLLVMJITCompileOptions(options);
+		module->maxMemoryReservedBytes = options.maxMemoryReservedBytes;
+		module->mapDataSegmentsOnDemand = options.mapDataSegmentsOnDemand;
+		module->specializedGlobalImports = options.specializedGlobalImports;
+		createProfileCounters(module, options);
+		return module;
+	}
+
+	LLVMJIT::CompileOptions llvmJITOptions = getInitialTierCompileOptions(options);
+	llvmJITOptions.monitor = monitor;
+
+	const bool shareModule = options.shareIdenticalModules && !options.profileInstrumentation;
+	SharedModuleKey sharedModuleKey;
+	if(shareModule)
+	{
+		sharedModuleKey = getSharedModuleKey(irModule, llvmJITOptions, options);
+		if(Module* sharedModule = findSharedModule(sharedModuleKey)) { return sharedModule; }
+	}
+
+	std::vector<U8> objectCode = compileObjectCode(
+		irModule, llvmJITOptions, options.objectCacheDirectory, options.objectCache.get());
+	if(!objectCode.size()) { return nullptr; }
+	Module* module = createCompiledModule(IR::Module(irModule), std::move(objectCode), options);
+	if(shareModule) { module = addSharedModule(sharedModuleKey, module); }
+	return module;
+}
+
+Runtime::Module* Runtime::compileModuleIncrementally(const IR::Module& irModule,
+													 const std::vector<U8>& previousObjectCode,
+													 const std::vector<U8>& previousManifest,
+													 std::vector<U8>& outManifest,
+													 const CompileOptions& options)
+{
+	Trace::Span traceSpan("compileModuleIncrementally");
+	validateSpecializedGlobalImports(irModule, options);
+
+	// Lazily compiled modules have no object code, and the layout of the profile counters and the
+	// packing of target versions depend on the whole module, so those modules are compiled as a
+	// whole, without a manifest.
+	if(options.lazyCompile || options.profileInstrumentation || options.targetVersions.size())
+	{
+		outManifest.clear();
+		return compileModule(irModule, options);
+	}
+
+	std::vector<U8> objectCode
+		= compileObjectCodeIncrementally(irModule,
+										 getInitialTierCompileOptions(options),
+										 previousObjectCode,
+										 previousManifest,
+										 outManifest);
+	if(!objectCode.size()) { return nullptr; }
+	return createCompiledModule(IR::Module(irModule), std::move(objectCode), options);
+}
+
+Runtime::Module* Runtime::compileSpecializedModule(const IR::Module& irModule,
+												   const ImportBindings& imports,
+												   const CompileOptions& options)
+{
+	errorUnless(imports.globals.size() == irModule.globals.imports.size());
+
+	CompileOptions specializedOptions = options;
+	for(Uptr importIndex = 0; importIndex < irModule.globals.imports.size(); ++importIndex)
+	{
+		const GlobalType globalType = irModule.globals.imports[importIndex].type;
+		if(globalType.isMutable) { continue; }
+		switch(globalType.valueType)
+		{
+		case ValueType::i32:
+		case ValueType::i64:
+		case ValueType::f32:
+		case ValueType::f64:
+		case ValueType::v128:
+		{
+			GlobalInstance* global = imports.globals[importIndex];
+			errorUnless(isA(global, globalType));
+			specializedOptions.specializedGlobalImports[importIndex]
+				= Value(globalType.valueType, global->initialValue);
+			break;
+		}
+		default: break;
+		};
+	}
+
+	return compileModule(irModule, specializedOptions);
+}
+
+struct Runtime::StreamingCompile
+{
+	IR::Module irModule;
+	const CompileOptions options;
+	const LLVMJIT::CompileOptions llvmJITOptions;
+	WASM::StreamingDecoder* decoder = nullptr;
+
+	// Created by the decoding thread when the first function definition is decoded, and only
+	// accessed by it until the decoder is finished.
+	LLVMJIT::StreamingCompile* llvmJITCompile = nullptr;
+
+	StreamingCompile(const IR::FeatureSpec& featureSpec, const CompileOptions& inOptions)
+	: irModule(featureSpec)
+	, options(inOptions)
+	, llvmJITOptions(getInitialTierCompileOptions(inOptions))
+	{
+	}
+
+	void onFunctionDefDecoded(Uptr functionDefIndex)
+	{
+		// The module's declarations precede its function definitions, so they are complete once
+		// the first function definition is decoded.
+		if(!llvmJITCompile)
+		{
+			validateSpecializedGlobalImports(irModule, options);
+			llvmJITCompile = LLVMJIT::beginStreamingCompile(irModule, llvmJITOptions);
+		}
+		LLVMJIT::addDecodedFunctionDefs(llvmJITCompile, functionDefIndex + 1);
+	}
+};
+
+Runtime::StreamingCompile* Runtime::beginStreamingCompile(const IR::FeatureSpec& featureSpec,
+														  const CompileOptions& options)
+{
+	StreamingCompile* compile = new StreamingCompile(featureSpec, options);
+
+	// Lazily compiled modules aren't compiled until they are called, and the object cache, the
+	// layout of the profile counters, and the packing of target versions depend on the whole
+	// module, so those modules are only decoded while streaming.
+	std::function<void(Uptr)> onFunctionDefDecoded;
+	if(!options.lazyCompile && options.objectCacheDirectory.empty() && !options.objectCache
+	   && !options.profileInstrumentation && options.targetVersions.empty())
+	{
+		onFunctionDefDecoded
+			= [compile](Uptr functionDefIndex) { compile->onFunctionDefDecoded(functionDefIndex); };
+	}
+	compile->decoder
+		= WASM::createStreamingDecoder(compile->irModule, std::move(onFunctionDefDecoded));
+	return compile;
+}
+
+void Runtime::feedStreamingCompile(StreamingCompile* compile, const U8* bytes, Uptr numBytes)
+{
+	WASM::feedStreamingDecoder(compile->decoder, bytes, numBytes);
+}
+
+Runtime::Module* Runtime::finishStreamingCompile(StreamingCompile* compile,
+												 IR::Module& outIRModule)
+{
+	Module* module = nullptr;
+	if(!WASM::finishStreamingDecode(compile->decoder))
+	{
+		if(compile->llvmJITCompile) { LLVMJIT::cancelStreamingCompile(compile->llvmJITCompile); }
+	}
+	else
+	{
+		if(compile->llvmJITCompile)
+		{
+			std::vector<U8> objectCode = LLVMJIT::finishStreamingCompile(compile->llvmJITCompile);
+			module = createCompiledModule(
+				IR::Module(compile->irModule), std::move(objectCode), compile->options);
+		}
+		else
+		{
+			// The module wasn't compiled while streaming, either because of the compile options,
+			// or because it has no function definitions.
+			module = compileModule(compile->irModule, compile->options);
+		}
+		outIRModule = std::move(compile->irModule);
+	}
+
+	delete compile;
+	return module;
+}
+
+std::vector<U8> Runtime::getObjectCode(Runtime::Module* module)
+{
+	errorUnless(!module->lazyCompile && !module->profileInstrumentation);
+	return module->objectCode;
+}
+
+std::vector<U8> Runtime::getModuleProfile(ModuleInstance* moduleInstance)
+{
+	Runtime::Module* module = moduleInstance->module;
+	errorUnless(module && module->profileInstrumentation);
+
+	// Map the AnyFuncs that the instance's code may call indirectly to the indices of their
+	// functions: the current code of each of the instance's functions, and the function
+	// definitions' lazy compile stubs.
+	HashMap<Uptr, Uptr> anyFuncFunctionIndices;
+	for(Uptr functionIndex = 0; functionIndex < moduleInstance->functions.size(); ++functionIndex)
+	{
+		anyFuncFunctionIndices.set(
+			reinterpret_cast<Uptr>(asAnyFunc(moduleInstance->functions[functionIndex])),
+			functionIndex);
+	}
+	for(Uptr functionDefIndex = 0; functionDefIndex < moduleInstance->lazyCompileStubs.size();
+		++functionDefIndex)
+	{
+		anyFuncFunctionIndices.set(
+			reinterpret_cast<Uptr>(
+				getAnyFuncFromCode(moduleInstance->lazyCompileStubs[functionDefIndex])),
+			module->ir.functions.imports.size() + functionDefIndex);
+	}
+
+	return serializeModuleProfile(LLVMJIT::getModuleProfile(
+		module->ir, module->profileCounters.data(), anyFuncFunctionIndices));
+}
+
+Runtime::Module* Runtime::loadPrecompiledModule(const IR::Module& irModule,
+												const std::vector<U8>& objectCode)
+{
+	Module* module = new Module(IR::Module(irModule), std::vector<U8>(objectCode));
+	releaseFunctionDefCode(module);
+	return module;
+}
+
+Runtime::Module::~Module()
+{
+	// Modules are only freed by the garbage collector, which holds the garbage collection mutex.
+	if(isShared)
+	{
+		Lock<Platform::Mutex> sharedModulesLock(sharedModulesMutex);
+		sharedModules.removeOrFail(sharedModuleKey);
+	}
+
+	for(Platform::VirtualPageSnapshot* memoryDefImage : memoryDefImages)
+	{
+		if(memoryDefImage) { Platform::releaseVirtualPageSnapshot(memoryDefImage); }
+	}
+}
+
+// Returns the debug names of a module's function definitions, decoding them from the module's name
+// section the first time they are needed, instead of each time the module is instantiated.
+static const std::vector<std::string>& getFunctionDefDebugNames(Runtime::Module* module)
+{
+	Lock<Platform::Mutex> functionDefDebugNamesLock(module->functionDefDebugNamesMutex);
+	if(!module->decodedFunctionDefDebugNames)
+	{
+		DisassemblyNames disassemblyNames;
+		getDisassemblyNames(module->ir, disassemblyNames);
+
+		const Uptr numImportedFunctions = module->ir.functions.imports.size();
+		for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
+			++functionDefIndex)
+		{
+			const Uptr functionIndex = numImportedFunctions + functionDefIndex;
+			std::string debugName = std::move(disassemblyNames.functions[functionIndex].name);
+			if(!debugName.size())
+			{ debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
+			module->functionDefDebugNames.push_back(std::move(debugName));
+		}
+		module->decodedFunctionDefDebugNames = true;
+	}
+	return module->functionDefDebugNames;
+}
+
+std::vector<FunctionProfile> Runtime::getFunctionProfiles(ModuleInstance* moduleInstance)
+{
+	Runtime::Module* module = moduleInstance->module;
+	errorUnless(module && module->profileInstrumentation);
+
+	const LLVMJIT::ModuleProfile profile
+		= LLVMJIT::getModuleProfile(module->ir, module->profileCounters.data(), {});
+	const std::vector<std::string>& functionDefDebugNames = getFunctionDefDebugNames(module);
+
+	std::vector<FunctionProfile> functionProfiles;
+	for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
+		++functionDefIndex)
+	{
+		functionProfiles.push_back({functionDefDebugNames[functionDefIndex],
+									profile.functionDefEntryCounts[functionDefIndex],
+									profile.functionDefCycleCounts[functionDefIndex]});
+	}
+	return functionProfiles;
+}
+
+// Creates snapshots of the initial contents of a module's memory definitions, if they haven't been
+// created by a previous instantiation of the module.
+static void createMemoryDefImages(Runtime::Module* module)
+{
+	Lock<Platform::Mutex> memoryDefImagesLock(module->memoryDefImagesMutex);
+	if(module->createdMemoryDefImages) { return; }
+	module->createdMemoryDefImages = true;
+
+	const Uptr numImportedMemories = module->ir.memories.imports.size();
+	const Uptr numMemoryDefs = module->ir.memories.defs.size();
+	module->memoryDefImages.resize(numMemoryDefs, nullptr);
+
+	// Find the end of each memory definition's active data segments, and whether all of them are
+	// at constant offsets within the memory's minimum size. If a segment is out-of-bounds, it must
+	// trap in order with copying the other segments, so the memory's segments are copied instead.
+	std::vector<U64> numImageBytes(numMemoryDefs, 0);
+	std::vector<bool> canMapSegments(numMemoryDefs, true);
+	for(const DataSegment& dataSegment : module->ir.dataSegments)
+	{
+		if(!dataSegment.isActive || dataSegment.memoryIndex < numImportedMemories) { continue; }
+
+		const Uptr memoryDefIndex = dataSegment.memoryIndex - numImportedMemories;
+		const MemoryType& memoryType = module->ir.memories.defs[memoryDefIndex].type;
+		if(dataSegment.baseOffset.type != InitializerExpression::Type::i32_const)
+		{
+			canMapSegments[memoryDefIndex] = false;
+			continue;
+		}
+
+		const U64 segmentEnd = U64(U32(dataSegment.baseOffset.i32)) + dataSegment.data.size();
+		if(segmentEnd > memoryType.size.min * IR::numBytesPerPage)
+		{ canMapSegments[memoryDefIndex] = false; }
+		else
+		{
+			numImageBytes[memoryDefIndex] = std::max(numImageBytes[memoryDefIndex], segmentEnd);
+		}
+	}
+
+	// Write the data segments to a snapshot of each memory's initial contents.
+	const Uptr pageSizeLog2 = Platform::getPageSizeLog2();
+	for(Uptr memoryDefIndex = 0; memoryDefIndex < numMemoryDefs; ++memoryDefIndex)
+	{
+		if(!canMapSegments[memoryDefIndex] || !numImageBytes[memoryDefIndex]) { continue; }
+
+		const Uptr numImagePages
+			= Uptr((numImageBytes[memoryDefIndex] + (Uptr(1) << pageSizeLog2) - 1) >> pageSizeLog2);
+		Platform::VirtualPageSnapshot* image = Platform::createVirtualPageSnapshot(numImagePages);
+		if(!image) { continue; }
+
+		for(const DataSegment& dataSegment : module->ir.dataSegments)
+		{
+			if(dataSegment.isActive
+			   && dataSegment.memoryIndex == numImportedMemories + memoryDefIndex
+			   && dataSegment.data.size()
+			   && !Platform::writeVirtualPageSnapshot(image,
+													  U32(dataSegment.baseOffset.i32),
+													  dataSegment.data.data(),
+													  dataSegment.data.size()))
+			{
+				Platform::releaseVirtualPageSnapshot(image);
+				image = nullptr;
+				break;
+			}
+		}
+
+		module->memoryDefImages[memoryDefIndex] = image;
+	}
+}
+
+Metrics::Gauge Runtime::moduleInstancesGauge("runtime.module_instances",
+											 "Number of module instances that are alive");
+
+ModuleInstance::~ModuleInstance()
+{
+	moduleInstancesGauge.add(-1);
+
+	if(jitModule)
+	{
+		LLVMJIT::unloadModule(jitModule);
+		jitModule = nullptr;
+	}
+	for(LLVMJIT::LoadedModule* replacedJITModule : replacedJITModules)
+	{ LLVMJIT::unloadModule(replacedJITModule); }
+	replacedJITModules.clear();
+	if(numChargedJITModuleBytes) { memoryBudget->release(numChargedJITModuleBytes); }
+	if(optimizedTierJITModule)
+	{
+		LLVMJIT::unloadModule(optimizedTierJITModule);
+		optimizedTierJITModule = nullptr;
+	}
+	for(LLVMJIT::LoadedModule* lazyCompiledJITModule : lazyCompiledJITModules)
+	{ LLVMJIT::unloadModule(lazyCompiledJITModule); }
+	lazyCompiledJITModules.clear();
+}
+
+// Returns the names a module instance's function definitions are described to profilers by, or
+// an empty vector if there are no profilers to describe them to.
+static std::vector<std::string> getFunctionDefProfilerNames(ModuleInstance* moduleInstance)
+{
+	std::vector<std::string> functionDefNames;
+	if(Platform::isJITProfilerOutputEnabled())
+	{
+		for(FunctionInstance* functionDef : moduleInstance->functionDefs)
+		{
+			functionDefNames.push_back("wasm!" + moduleInstance->debugName + '!'
+									   + functionDef->debugName);
+		}
+	}
+	return functionDefNames;
+}
+
+// Loads object code compiled for a module with the bindings for a module instance. Function
+// definitions that aren't defined by the object code are bound to their FunctionInstance's current
+// code.
+static LLVMJIT::LoadedModule* loadJITModule(ModuleInstance* moduleInstance,
+											const IR::Module& irModule,
+											const std::vector<U8>& objectCode,
+											std::vector<LLVMJIT::JITFunction*>& outJITFunctionDefs)
+{
+	Compartment* compartment = moduleInstance->compartment;
+
+	HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap;
+	ModuleInstance* wavmIntrinsics = compartment->wavmIntrinsics;
+	for(Uptr exportIndex = 0; exportIndex < wavmIntrinsics->exports.size(); ++exportIndex)
+	{
+		FunctionInstance* intrinsicFunction = asFunction(wavmIntrinsics->exports[exportIndex]);
+		wavmAssert(intrinsicFunction);
+		wavmAssert(intrinsicFunction->callingConvention == IR::CallingConvention::intrinsic);
+		const std::string& exportName = (*wavmIntrinsics->exportNames)[exportIndex];
+		errorUnless(wavmIntrinsicsExportMap.add(
+			exportName, LLVMJIT::FunctionBinding{intrinsicFunction->nativeFunction}));
+	}
+
+	std::vector<FunctionType> jitTypes = irModule.types;
+	LLVMJIT::MemoryBinding jitDefaultMemory{
+		moduleInstance->defaultMemory ? moduleInstance->defaultMemory->id : UINTPTR_MAX};
+	LLVMJIT::TableBinding jitDefaultTable{
+		moduleInstance->defaultTable ? moduleInstance->defaultTable->id : UINTPTR_MAX};
+
+	std::vector<LLVMJIT::FunctionBinding> jitFunctionImports;
+	for(Uptr importIndex = 0; importIndex < irModule.functions.imports.size(); ++importIndex)
+	{
+		FunctionInstance* functionImport = moduleInstance->functions[importIndex];
+		jitFunctionImports.push_back({getWASMCallableCode(functionImport)});
+	}
+
+	std::vector<LLVMJIT::FunctionBinding> jitFunctionDefs;
+	for(FunctionInstance* functionDef : moduleInstance->functionDefs)
+	{ jitFunctionDefs.push_back({functionDef->nativeFunction.load(std::memory_order_acquire)}); }
+
+	std::vector<LLVMJIT::TableBinding> jitTables;
+	for(TableInstance* table : moduleInstance->tables) { jitTables.push_back({table->id}); }
+
+	std::vector<LLVMJIT::MemoryBinding> jitMemories;
+	for(MemoryInstance* memory : moduleInstance->memories) { jitMemories.push_back({memory->id}); }
+
+	std::vector<LLVMJIT::GlobalBinding> jitGlobals;
+	for(GlobalInstance* global : moduleInstance->globals)
+	{
+		LLVMJIT::GlobalBinding globalSpec;
+		globalSpec.type = global->type;
+		if(global->type.isMutable) { globalSpec.mutableGlobalId = global->mutableGlobalId; }
+		else
+		{
+			globalSpec.immutableValuePointer = &global->initialValue;
+		}
+		jitGlobals.push_back(globalSpec);
+	}
+
+	std::vector<ExceptionTypeInstance*> jitExceptionTypes;
+	for(ExceptionTypeInstance* exceptionTypeInstance : moduleInstance->exceptionTypes)
+	{ jitExceptionTypes.push_back(exceptionTypeInstance); }
+
+	const Uptr profileCountersAddress
+		= moduleInstance->module
+			  ? reinterpret_cast<Uptr>(moduleInstance->module->profileCounters.data())
+			  : 0;
+
+	// Load the compiled module's object code with this module instance's imports.
+	return LLVMJIT::loadModule(objectCode,
+								  std::move(wavmIntrinsicsExportMap),
+								  std::move(jitTypes),
+								  std::move(jitFunctionImports),
+								  std::move(jitFunctionDefs),
+								  std::move(jitTables),
+								  std::move(jitMemories),
+								  std::move(jitGlobals),
+								  std::move(jitExceptionTypes),
+								  jitDefaultMemory,
+								  jitDefaultTable,
+								  moduleInstance,
+								  reinterpret_cast<Uptr>(getOutOfBoundsAnyFunc()),
+								  getEpochAddress(),
+								  profileCountersAddress,
+								  moduleInstance->functionDefs,
+								  getFunctionDefProfilerNames(moduleInstance),
+								  outJITFunctionDefs,
+								  compartment->codeArena);
+}
+
+// Links the JITFunctions for a module instance's function definitions to the corresponding
+// FunctionInstances, and the FunctionInstances to the compiled machine code. Null elements of
+// jitFunctionDefs are function definitions that weren't loaded, and are left unchanged.
+static void linkJITFunctions(ModuleInstance* moduleInstance,
+							 const std::vector<LLVMJIT::JITFunction*>& jitFunctionDefs)
+{
+	for(Uptr functionDefIndex = 0; functionDefIndex < moduleInstance->functionDefs.size();
+		++functionDefIndex)
+	{
+		LLVMJIT::JITFunction* jitFunction = jitFunctionDefs[functionDefIndex];
+		if(!jitFunction) { continue; }
+
+		FunctionInstance* functionInstance = moduleInstance->functionDefs[functionDefIndex];
+		functionInstance->nativeFunction.store(reinterpret_cast<void*>(jitFunction->baseAddress),
+											   std::memory_order_release);
+		jitFunction->type = LLVMJIT::JITFunction::Type::wasmFunction;
+		jitFunction->functionInstance = functionInstance;
+	}
+}
+
+// Replaces references to the old code of a module instance's function definitions in all the
+// tables of the instance's compartment with references to their new code.
+static void replaceFunctionDefsInTables(
+	ModuleInstance* moduleInstance,
+	const HashMap<const AnyReferee*, const AnyReferee*>& anyRefReplacements)
+{
+	Compartment* compartment = moduleInstance->compartment;
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	for(TableInstance* table : compartment->tables)
+	{ replaceTableElements(table, anyRefReplacements); }
 }
 
-std::vector<U8> Runtime::getObjectCode(Runtime::Module* module) { return module->objectCode; }
+// Finds the function definitions that a function definition calls or references directly.
+struct DirectCalleeVisitor
+{
+	typedef void Result;
 
-Runtime::Module* Runtime::loadPrecompiledModule(const IR::Module& irModule,
-												const std::vector<U8>& objectCode)
+	const IR::Module& irModule;
+	ScratchVector<Uptr>& outCalleeFunctionDefIndices;
+
+	DirectCalleeVisitor(const IR::Module& inIRModule, ScratchVector<Uptr>& inOutCalleeIndices)
+	: irModule(inIRModule), outCalleeFunctionDefIndices(inOutCalleeIndices)
+	{
+	}
+
+	void visitImm(FunctionImm imm)
+	{
+		if(imm.functionIndex >= irModule.functions.imports.size())
+		{
+			outCalleeFunctionDefIndices.push_back(imm.functionIndex
+												  - irModule.functions.imports.size());
+		}
+	}
+	template<typename Imm> void visitImm(Imm) {}
+
+#define VISIT_OPCODE(_, name, nameString, Imm, ...)                                                \
+	void name(Imm imm) { visitImm(imm); }
+	ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+
+	void unknown(Opcode) { Errors::unreachable(); }
+};
+
+// Called by a lazy compile stub to get the code for a function definition, compiling it if it
+// hasn't been compiled yet. The stub for a function definition is also called after it has been
+// compiled, by threads that were already executing the stub, and by code that was compiled before
+// the function definition and calls it directly.
+static void* lazyCompileFunctionDef(FunctionInstance* functionInstance, Uptr functionDefIndex)
 {
-	return new Module(IR::Module(irModule), std::vector<U8>(objectCode));
+	ModuleInstance* moduleInstance = functionInstance->moduleInstance;
+	Runtime::Module* module = moduleInstance->module;
+
+	// A function definition is compiled once its code is no longer its stub. The stubs don't
+	// change after the instance is created, so check that without locking, and only lock the mutex
+	// to compile the function definition.
+	auto isCompiled = [moduleInstance](Uptr index) {
+		return moduleInstance->functionDefs[index]->nativeFunction.load(std::memory_order_acquire)
+			   != moduleInstance->lazyCompileStubs[index];
+	};
+	if(isCompiled(functionDefIndex))
+	{ return functionInstance->nativeFunction.load(std::memory_order_acquire); }
+
+	Lock<Platform::Mutex> lazyCompileLock(moduleInstance->lazyCompileMutex);
+	if(isCompiled(functionDefIndex))
+	{ return functionInstance->nativeFunction.load(std::memory_order_acquire); }
+
+	// Decide which function definitions to compile: the called function definition, and if
+	// enabled, any function definitions it calls directly that haven't been compiled yet.
+	std::vector<Uptr> functionDefIndices = {functionDefIndex};
+	if(module->lazyCompileDirectCallees)
+	{
+		ScratchScope scratchScope;
+		ScratchVector<Uptr> calleeFunctionDefIndices;
+		DirectCalleeVisitor visitor(module->ir, calleeFunctionDefIndices);
+		OperatorDecoderStream decoder(module->ir.functions.defs[functionDefIndex].code);
+		decoder.decodeAll(visitor);
+
+		HashSet<Uptr> addedFunctionDefIndices;
+		addedFunctionDefIndices.add(functionDefIndex);
+		for(Uptr calleeFunctionDefIndex : calleeFunctionDefIndices)
+		{
+			if(!isCompiled(calleeFunctionDefIndex)
+			   && addedFunctionDefIndices.add(calleeFunctionDefIndex))
+			{ functionDefIndices.push_back(calleeFunctionDefIndex); }
+		}
+	}
+
+	// Compile the function definitions, and load them with the instance's bindings. Calls to
+	// other function definitions are bound to their current code: their stubs if they haven't
+	// been compiled yet.
+	std::vector<U8> objectCode = LLVMJIT::compileFunctionDefs(
+		module->ir, functionDefIndices, module->deferredCompileOptions);
+	std::vector<LLVMJIT::JITFunction*> jitFunctionDefs;
+	moduleInstance->lazyCompiledJITModules.push_back(
+		loadJITModule(moduleInstance, module->ir, objectCode, jitFunctionDefs));
+
+	// Switch the compiled function definitions from their stubs to the compiled code.
+	linkJITFunctions(moduleInstance, jitFunctionDefs);
+	HashMap<const AnyReferee*, const AnyReferee*> anyRefReplacements;
+	for(Uptr compiledFunctionDefIndex : functionDefIndices)
+	{
+		const AnyFunc* stubAnyFunc
+			= getAnyFuncFromCode(moduleInstance->lazyCompileStubs[compiledFunctionDefIndex]);
+		anyRefReplacements.addOrFail(
+			&stubAnyFunc->anyRef,
+			&asAnyFunc(moduleInstance->functionDefs[compiledFunctionDefIndex])->anyRef);
+	}
+	replaceFunctionDefsInTables(moduleInstance, anyRefReplacements);
+
+	return functionInstance->nativeFunction.load(std::memory_order_acquire);
 }
 
-ModuleInstance::~ModuleInstance()
+void Runtime::instantiateFunctionDefs(ModuleInstance* moduleInstance, Module* module)
 {
-	if(jitModule)
+	Compartment* compartment = moduleInstance->compartment;
+	moduleInstance->codeModule = module;
+
+	// Create the FunctionInstances for the module's function definitions.
+	const std::vector<std::string>& functionDefDebugNames = getFunctionDefDebugNames(module);
+	for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
+		++functionDefIndex)
 	{
-		LLVMJIT::unloadModule(jitModule);
-		jitModule = nullptr;
+		auto functionInstance = new FunctionInstance(
+			compartment,
+			moduleInstance,
+			module->ir.types[module->ir.functions.defs[functionDefIndex].type.index],
+			nullptr,
+			IR::CallingConvention::wasm,
+			std::string(functionDefDebugNames[functionDefIndex]));
+		moduleInstance->functionDefs.push_back(functionInstance);
+		moduleInstance->functions.push_back(functionInstance);
+	}
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		for(FunctionInstance* functionInstance : moduleInstance->functionDefs)
+		{ compartment->functions.addOrFail(functionInstance); }
+	}
+
+	if(module->tierUpCallCount || module->lazyCompile || module->profileInstrumentation)
+	{ moduleInstance->module = module; }
+
+	if(module->lazyCompile)
+	{
+		// Point each function definition at a stub that compiles it when it is first called.
+		std::vector<FunctionType> functionDefTypes;
+		for(FunctionInstance* functionDef : moduleInstance->functionDefs)
+		{ functionDefTypes.push_back(functionDef->type); }
+
+		std::vector<LLVMJIT::JITFunction*> lazyCompileStubs;
+		moduleInstance->jitModule
+			= LLVMJIT::loadLazyCompileStubs(moduleInstance->functionDefs,
+											functionDefTypes,
+											getFunctionDefProfilerNames(moduleInstance),
+											lazyCompileFunctionDef,
+											lazyCompileStubs,
+											compartment->codeArena);
+		for(Uptr functionDefIndex = 0; functionDefIndex < moduleInstance->functionDefs.size();
+			++functionDefIndex)
+		{
+			void* stubCode
+				= reinterpret_cast<void*>(lazyCompileStubs[functionDefIndex]->baseAddress);
+			moduleInstance->functionDefs[functionDefIndex]->nativeFunction.store(
+				stubCode, std::memory_order_release);
+			moduleInstance->lazyCompileStubs.push_back(stubCode);
+		}
+	}
+	else
+	{
+		// Load the compiled module's object code with this module instance's imports.
+		std::vector<LLVMJIT::JITFunction*> jitFunctionDefs;
+		moduleInstance->jitModule
+			= loadJITModule(moduleInstance, module->ir, module->objectCode, jitFunctionDefs);
+		linkJITFunctions(moduleInstance, jitFunctionDefs);
 	}
+
+	// Charge the loaded code and data to the compartment's memory budget.
+	moduleInstance->memoryBudget = compartment->memoryBudget;
+	const Uptr numJITModuleBytes = LLVMJIT::getLoadedModuleNumBytes(moduleInstance->jitModule);
+	if(!moduleInstance->memoryBudget->charge(numJITModuleBytes))
+	{ throwException(Exception::outOfMemoryType); }
+	moduleInstance->numChargedJITModuleBytes = numJITModuleBytes;
 }
 
 ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
@@ -75,6 +1143,18 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 										   ImportBindings&& imports,
 										   std::string&& moduleDebugName)
 {
+	return instantiateModuleImpl(
+		compartment, module, std::move(imports), std::move(moduleDebugName), true);
+}
+
+ModuleInstance* Runtime::instantiateModuleImpl(Compartment* compartment,
+											   Module* module,
+											   ImportBindings&& imports,
+											   std::string&& moduleDebugName,
+											   bool shouldInitializeSegments)
+{
+	Trace::Span traceSpan("instantiateModule");
+
 	// Create the ModuleInstance and add it to the compartment's modules list.
 	ModuleInstance* moduleInstance = new ModuleInstance(compartment,
 														std::move(imports.functions),
@@ -88,30 +1168,50 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 		compartment->modules.addOrFail(moduleInstance);
 	}
 
-	// Check the type of the ModuleInstance's imports.
+	// Check the type of the ModuleInstance's imports, and that they are in the compartment the
+	// module is being instantiated in.
 	errorUnless(moduleInstance->functions.size() == module->ir.functions.imports.size());
 	for(Uptr importIndex = 0; importIndex < module->ir.functions.imports.size(); ++importIndex)
 	{
 		errorUnless(isA(moduleInstance->functions[importIndex],
 						module->ir.types[module->ir.functions.imports[importIndex].type.index]));
+		errorUnless(isInCompartment(moduleInstance->functions[importIndex], compartment));
 	}
 	errorUnless(moduleInstance->tables.size() == module->ir.tables.imports.size());
 	for(Uptr importIndex = 0; importIndex < module->ir.tables.imports.size(); ++importIndex)
 	{
 		errorUnless(
 			isA(moduleInstance->tables[importIndex], module->ir.tables.imports[importIndex].type));
+		errorUnless(isInCompartment(moduleInstance->tables[importIndex], compartment));
 	}
 	errorUnless(moduleInstance->memories.size() == module->ir.memories.imports.size());
 	for(Uptr importIndex = 0; importIndex < module->ir.memories.imports.size(); ++importIndex)
 	{
 		errorUnless(isA(moduleInstance->memories[importIndex],
 						module->ir.memories.imports[importIndex].type));
+		errorUnless(isInCompartment(moduleInstance->memories[importIndex], compartment));
+
+		// Code that isn't compiled with memory bounds checks relies on the memory having the full
+		// address space reservation. Accesses to 64-bit memories are always bounds checked.
+		errorUnless(module->maxMemoryReservedBytes != UINTPTR_MAX
+					|| module->ir.memories.imports[importIndex].type.indexType == IndexType::i64
+					|| moduleInstance->memories[importIndex]->numReservedBytes
+						   >= fullMemoryNumReservedBytes);
 	}
 	errorUnless(moduleInstance->globals.size() == module->ir.globals.imports.size());
 	for(Uptr importIndex = 0; importIndex < module->ir.globals.imports.size(); ++importIndex)
 	{
 		errorUnless(isA(moduleInstance->globals[importIndex],
 						module->ir.globals.imports[importIndex].type));
+		errorUnless(isInCompartment(moduleInstance->globals[importIndex], compartment));
+	}
+	for(const auto& specializedGlobalImport : module->specializedGlobalImports)
+	{
+		// The module's code uses the values it was specialized for instead of the imported
+		// globals' values.
+		const GlobalInstance* global = moduleInstance->globals[specializedGlobalImport.first];
+		errorUnless(Value(global->type.valueType, global->initialValue)
+					== specializedGlobalImport.second);
 	}
 	errorUnless(moduleInstance->exceptionTypes.size() == module->ir.exceptionTypes.imports.size());
 	for(Uptr importIndex = 0; importIndex < module->ir.exceptionTypes.imports.size(); ++importIndex)
@@ -120,10 +1220,6 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 						module->ir.exceptionTypes.imports[importIndex].type));
 	}
 
-	// Deserialize the disassembly names.
-	DisassemblyNames disassemblyNames;
-	getDisassemblyNames(module->ir, disassemblyNames);
-
 	// Instantiate the module's memory and table definitions.
 	for(const TableDef& tableDef : module->ir.tables.defs)
 	{
@@ -133,18 +1229,34 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 	}
 	for(const MemoryDef& memoryDef : module->ir.memories.defs)
 	{
-		auto memory = createMemory(compartment, memoryDef.type);
+		auto memory = createMemory(compartment, memoryDef.type, module->maxMemoryReservedBytes);
 		if(!memory) { throwException(Exception::outOfMemoryType); }
 		moduleInstance->memories.push_back(memory);
 	}
 
+	// If the module was compiled with mapDataSegmentsOnDemand, map the snapshots of the memory
+	// definitions' initial contents into the new memories, and remember which memories don't need
+	// their data segments copied into them.
+	const Uptr numImportedMemories = module->ir.memories.imports.size();
+	ScratchScope scratchScope;
+	ScratchVector<bool> isMemoryInitialized(moduleInstance->memories.size(), false);
+	if(module->mapDataSegmentsOnDemand && shouldInitializeSegments)
+	{
+		createMemoryDefImages(module);
+		for(Uptr memoryDefIndex = 0; memoryDefIndex < module->memoryDefImages.size();
+			++memoryDefIndex)
+		{
+			const Uptr memoryIndex = numImportedMemories + memoryDefIndex;
+			Platform::VirtualPageSnapshot* image = module->memoryDefImages[memoryDefIndex];
+			isMemoryInitialized[memoryIndex]
+				= image && mapMemoryPageSnapshot(moduleInstance->memories[memoryIndex], image);
+		}
+	}
+
 	// Find the default memory and table for the module and initialize the runtime data memory/table
 	// base pointers.
 	if(moduleInstance->memories.size() != 0)
-	{
-		wavmAssert(moduleInstance->memories.size() == 1);
-		moduleInstance->defaultMemory = moduleInstance->memories[0];
-	}
+	{ moduleInstance->defaultMemory = moduleInstance->memories[0]; }
 	if(moduleInstance->tables.size() != 0)
 	{ moduleInstance->defaultTable = moduleInstance->tables[0]; }
 
@@ -154,7 +1266,9 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 		const Value initialValue
 			= evaluateInitializer(moduleInstance->globals, globalDef.initializer);
 		errorUnless(isSubtype(initialValue.type, globalDef.type.valueType));
-		moduleInstance->globals.push_back(createGlobal(compartment, globalDef.type, initialValue));
+		GlobalInstance* global = createGlobal(compartment, globalDef.type, initialValue);
+		if(!global) { throwException(Exception::outOfMemoryType); }
+		moduleInstance->globals.push_back(global);
 	}
 
 	// Instantiate the module's exception types.
@@ -164,110 +1278,13 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 			createExceptionTypeInstance(exceptionTypeDef.type, "wasmException"));
 	}
 
-	// Instantiate the module's defined functions.
-	for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
-		++functionDefIndex)
-	{
-		const DisassemblyNames::Function& functionNames
-			= disassemblyNames.functions[module->ir.functions.imports.size() + functionDefIndex];
-		std::string debugName = functionNames.name;
-		if(!debugName.size())
-		{ debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
-
-		auto functionInstance = new FunctionInstance(
-			moduleInstance,
-			module->ir.types[module->ir.functions.defs[functionDefIndex].type.index],
-			nullptr,
-			IR::CallingConvention::wasm,
-			std::move(debugName));
-		moduleInstance->functionDefs.push_back(functionInstance);
-		moduleInstance->functions.push_back(functionInstance);
-	}
-
-	HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap;
-	for(auto intrinsicExport : compartment->wavmIntrinsics->exportMap)
-	{
-		FunctionInstance* intrinsicFunction = asFunction(intrinsicExport.value);
-		wavmAssert(intrinsicFunction);
-		wavmAssert(intrinsicFunction->callingConvention == IR::CallingConvention::intrinsic);
-		errorUnless(wavmIntrinsicsExportMap.add(
-			intrinsicExport.key, LLVMJIT::FunctionBinding{intrinsicFunction->nativeFunction}));
-	}
-
-	std::vector<FunctionType> jitTypes = module->ir.types;
-	LLVMJIT::MemoryBinding jitDefaultMemory{
-		moduleInstance->defaultMemory ? moduleInstance->defaultMemory->id : UINTPTR_MAX};
-	LLVMJIT::TableBinding jitDefaultTable{
-		moduleInstance->defaultTable ? moduleInstance->defaultTable->id : UINTPTR_MAX};
-
-	std::vector<LLVMJIT::FunctionBinding> jitFunctionImports;
-	for(Uptr importIndex = 0; importIndex < module->ir.functions.imports.size(); ++importIndex)
-	{
-		FunctionInstance* functionImport = moduleInstance->functions[importIndex];
-		void* nativeFunction = functionImport->nativeFunction;
-		if(functionImport->callingConvention != IR::CallingConvention::wasm)
-		{
-			nativeFunction = LLVMJIT::getIntrinsicThunk(nativeFunction,
-														functionImport,
-														functionImport->type,
-														functionImport->callingConvention);
-		}
-		jitFunctionImports.push_back({nativeFunction});
-	}
-
-	std::vector<LLVMJIT::TableBinding> jitTables;
-	for(TableInstance* table : moduleInstance->tables) { jitTables.push_back({table->id}); }
-
-	std::vector<LLVMJIT::MemoryBinding> jitMemories;
-	for(MemoryInstance* memory : moduleInstance->memories) { jitMemories.push_back({memory->id}); }
-
-	std::vector<LLVMJIT::GlobalBinding> jitGlobals;
-	for(GlobalInstance* global : moduleInstance->globals)
-	{
-		LLVMJIT::GlobalBinding globalSpec;
-		globalSpec.type = global->type;
-		if(global->type.isMutable) { globalSpec.mutableGlobalId = global->mutableGlobalId; }
-		else
-		{
-			globalSpec.immutableValuePointer = &global->initialValue;
-		}
-		jitGlobals.push_back(globalSpec);
-	}
-
-	std::vector<ExceptionTypeInstance*> jitExceptionTypes;
-	for(ExceptionTypeInstance* exceptionTypeInstance : moduleInstance->exceptionTypes)
-	{ jitExceptionTypes.push_back(exceptionTypeInstance); }
-
-	// Load the compiled module's object code with this module instance's imports.
-	std::vector<LLVMJIT::JITFunction*> jitFunctionDefs;
-	moduleInstance->jitModule = LLVMJIT::loadModule(module->objectCode,
-													std::move(wavmIntrinsicsExportMap),
-													std::move(jitTypes),
-													std::move(jitFunctionImports),
-													std::move(jitTables),
-													std::move(jitMemories),
-													std::move(jitGlobals),
-													std::move(jitExceptionTypes),
-													jitDefaultMemory,
-													jitDefaultTable,
-													moduleInstance,
-													reinterpret_cast<Uptr>(getOutOfBoundsAnyFunc()),
-													moduleInstance->functionDefs,
-													jitFunctionDefs);
-
-	// Link the JITFunction to the corresponding FunctionInstance, and the FunctionInstance to the
-	// compiled machine code.
-	for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
-		++functionDefIndex)
-	{
-		LLVMJIT::JITFunction* jitFunction = jitFunctionDefs[functionDefIndex];
-		FunctionInstance* functionInstance = moduleInstance->functionDefs[functionDefIndex];
-		functionInstance->nativeFunction = reinterpret_cast<void*>(jitFunction->baseAddress);
-		jitFunction->type = LLVMJIT::JITFunction::Type::wasmFunction;
-		jitFunction->functionInstance = functionInstance;
-	}
+	// Instantiate the module's defined functions, and load their code.
+	instantiateFunctionDefs(moduleInstance, module);
 
 	// Set up the instance's exports.
+	moduleInstance->exportIndexTable = module->exportIndexTable;
+	moduleInstance->exportNames = module->exportIndexTable->names;
+	moduleInstance->exports.reserve(module->ir.exports.size());
 	for(const Export& exportIt : module->ir.exports)
 	{
 		Object* exportedObject = nullptr;
@@ -288,20 +1305,32 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 			break;
 		default: Errors::unreachable();
 		}
-		moduleInstance->exportMap.addOrFail(exportIt.name, exportedObject);
+		moduleInstance->exports.push_back(exportedObject);
 	}
 
 	// Copy the module's data segments into the module's default memory.
 	for(const DataSegment& dataSegment : module->ir.dataSegments)
 	{
-		if(dataSegment.isActive)
+		if(dataSegment.isActive && shouldInitializeSegments
+		   && !isMemoryInitialized[dataSegment.memoryIndex])
 		{
 			MemoryInstance* memory = moduleInstance->memories[dataSegment.memoryIndex];
 
 			const Value baseOffsetValue
 				= evaluateInitializer(moduleInstance->globals, dataSegment.baseOffset);
-			errorUnless(baseOffsetValue.type == ValueType::i32);
-			const U32 baseOffset = baseOffsetValue.i32;
+			errorUnless(baseOffsetValue.type == ValueType::i32
+						|| baseOffsetValue.type == ValueType::i64);
+			const U64 baseOffset = baseOffsetValue.type == ValueType::i64
+									   ? U64(baseOffsetValue.i64)
+									   : U64(U32(baseOffsetValue.i32));
+
+			// A 32-bit memory's reserved address space covers any segment, so copying a segment
+			// that is out-of-bounds traps when it writes to the memory's uncommitted pages. A
+			// 64-bit memory's segments must be checked against its reserved address space.
+			if(memory->type.indexType == IndexType::i64
+			   && (baseOffset > memory->numReservedBytes
+				   || dataSegment.data.size() > memory->numReservedBytes - baseOffset))
+			{ throwException(Runtime::Exception::memoryAddressOutOfBoundsType); }
 
 			if(dataSegment.data.size())
 			{
@@ -319,10 +1348,14 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 		}
 	}
 
-	// Copy the module's table segments into the module's default table.
+	// Copy the module's table segments into the module's default table. The biased table element
+	// values of the module's functions are computed at most once for each function, and each
+	// segment's values are gathered from them and copied to the table in bulk.
+	std::vector<Uptr> functionBiasedTableValues;
+	std::vector<Uptr> segmentBiasedTableValues;
 	for(const TableSegment& tableSegment : module->ir.tableSegments)
 	{
-		if(tableSegment.isActive)
+		if(tableSegment.isActive && shouldInitializeSegments)
 		{
 			TableInstance* table = moduleInstance->tables[tableSegment.tableIndex];
 
@@ -333,13 +1366,26 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 
 			if(tableSegment.indices.size())
 			{
+				if(!functionBiasedTableValues.size())
+				{ functionBiasedTableValues.resize(moduleInstance->functions.size(), UINTPTR_MAX); }
+
+				segmentBiasedTableValues.resize(tableSegment.indices.size());
 				for(Uptr index = 0; index < tableSegment.indices.size(); ++index)
 				{
 					const Uptr functionIndex = tableSegment.indices[index];
 					wavmAssert(functionIndex < moduleInstance->functions.size());
-					const AnyFunc* anyFunc = asAnyFunc(moduleInstance->functions[functionIndex]);
-					setTableElement(table, baseOffset + index, &anyFunc->anyRef);
+					Uptr& biasedValue = functionBiasedTableValues[functionIndex];
+					if(biasedValue == UINTPTR_MAX)
+					{
+						biasedValue = getBiasedTableElementValue(
+							table, &asAnyFunc(moduleInstance->functions[functionIndex])->anyRef);
+					}
+					segmentBiasedTableValues[index] = biasedValue;
 				}
+				initTableElementsBiased(table,
+										baseOffset,
+										segmentBiasedTableValues.data(),
+										segmentBiasedTableValues.size());
 			}
 			else
 			{
@@ -351,15 +1397,16 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 		}
 	}
 
-	// Copy the module's passive data and table segments into the ModuleInstance for later use.
+	// Share the module's passive data segments with the ModuleInstance, and mark its active data
+	// segments as dropped. Copy the module's passive table segments into the ModuleInstance, since
+	// they refer to the instance's functions.
+	moduleInstance->passiveDataSegments = module->passiveDataSegments;
+	moduleInstance->droppedDataSegmentBits
+		= std::vector<std::atomic<U64>>((module->ir.dataSegments.size() + 63) / 64);
 	for(Uptr segmentIndex = 0; segmentIndex < module->ir.dataSegments.size(); ++segmentIndex)
 	{
-		const DataSegment& dataSegment = module->ir.dataSegments[segmentIndex];
-		if(!dataSegment.isActive)
-		{
-			moduleInstance->passiveDataSegments.add(
-				segmentIndex, std::make_shared<std::vector<U8>>(dataSegment.data));
-		}
+		if(module->ir.dataSegments[segmentIndex].isActive)
+		{ moduleInstance->dropDataSegment(segmentIndex); }
 	}
 	for(Uptr segmentIndex = 0; segmentIndex < module->ir.tableSegments.size(); ++segmentIndex)
 	{
@@ -389,6 +1436,17 @@ void ModuleInstance::finalize()
 	compartment->modules.removeOrFail(this);
 }
 
+FunctionInstance::~FunctionInstance()
+{
+	if(hostFunction) { delete hostFunction; }
+}
+
+void FunctionInstance::finalize()
+{
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	compartment->functions.removeOrFail(this);
+}
+
 FunctionInstance* Runtime::getStartFunction(ModuleInstance* moduleInstance)
 {
 	return moduleInstance->startFunction;
@@ -406,6 +1464,254 @@ TableInstance* Runtime::getDefaultTable(ModuleInstance* moduleInstance)
 Object* Runtime::getInstanceExport(ModuleInstance* moduleInstance, const std::string& name)
 {
 	wavmAssert(moduleInstance);
-	Object* const* exportedObjectPtr = moduleInstance->exportMap.get(name);
-	return exportedObjectPtr ? *exportedObjectPtr : nullptr;
+	const Uptr exportIndex = moduleInstance->exportIndexTable->get(name);
+	return exportIndex == UINTPTR_MAX ? nullptr : moduleInstance->exports[exportIndex];
+}
+
+Uptr Runtime::getModuleExportIndex(Module* module, const std::string& name)
+{
+	return module->exportIndexTable->get(name);
+}
+
+Object* Runtime::getInstanceExportByIndex(ModuleInstance* moduleInstance, Uptr exportIndex)
+{
+	wavmAssert(moduleInstance);
+	errorUnless(exportIndex < moduleInstance->exports.size());
+	return moduleInstance->exports[exportIndex];
+}
+
+// Yields the thread compiling the optimized tier of a module to more urgent compiles between the
+// partitions of the module.
+struct TierUpCompileMonitor : LLVMJIT::CompileMonitor
+{
+	bool beginPartition() override
+	{
+		yieldCompileThread(CompilePriority::warmUp);
+		return true;
+	}
+	void onFunctionDefsEmitted(Uptr numFunctionDefs) override {}
+	void onFunctionDefsCompiled(Uptr numFunctionDefs) override {}
+};
+
+static void tierUp(ModuleInstance* moduleInstance)
+{
+	Runtime::Module* module = moduleInstance->module;
+
+	// Compile the optimized tier of the module, unless a thread tiering up another instance of the
+	// module has already compiled it. Once it is compiled, optimizedTierObjectCode is immutable.
+	{
+		Lock<Platform::Mutex> optimizedTierLock(module->optimizedTierMutex);
+		if(!module->optimizedTierObjectCode.size())
+		{
+			TierUpCompileMonitor monitor;
+			LLVMJIT::CompileOptions llvmJITOptions = module->deferredCompileOptions;
+			llvmJITOptions.monitor = &monitor;
+			module->optimizedTierObjectCode
+				= compileObjectCode(module->ir,
+									llvmJITOptions,
+									module->objectCacheDirectory,
+									module->objectCache.get());
+		}
+	}
+
+	// Load the optimized tier with the same bindings as the baseline tier.
+	std::vector<LLVMJIT::JITFunction*> jitFunctionDefs;
+	LLVMJIT::LoadedModule* optimizedTierJITModule = loadJITModule(
+		moduleInstance, module->ir, module->optimizedTierObjectCode, jitFunctionDefs);
+
+	// Switch the instance's functions to the optimized code, and record which anyrefs to the
+	// baseline tier's functions need to be replaced in tables. The baseline tier stays loaded until
+	// the instance is destroyed, since it may still be running on other threads, and baseline
+	// functions may still be referenced by anyrefs outside of tables.
+	HashMap<const AnyReferee*, const AnyReferee*> anyRefReplacements;
+	std::vector<const AnyReferee*> baselineAnyRefs;
+	for(FunctionInstance* functionInstance : moduleInstance->functionDefs)
+	{ baselineAnyRefs.push_back(&asAnyFunc(functionInstance)->anyRef); }
+	linkJITFunctions(moduleInstance, jitFunctionDefs);
+	for(Uptr functionDefIndex = 0; functionDefIndex < moduleInstance->functionDefs.size();
+		++functionDefIndex)
+	{
+		anyRefReplacements.addOrFail(
+			baselineAnyRefs[functionDefIndex],
+			&asAnyFunc(moduleInstance->functionDefs[functionDefIndex])->anyRef);
+	}
+	moduleInstance->optimizedTierJITModule = optimizedTierJITModule;
+
+	// Replace references to the baseline tier's functions in all the compartment's tables.
+	replaceFunctionDefsInTables(moduleInstance, anyRefReplacements);
+
+	removeGCRoot(moduleInstance);
+}
+
+void Runtime::sampleTierUpCall(ModuleInstance* moduleInstance)
+{
+	const Uptr tierUpCallCount = moduleInstance->module->tierUpCallCount;
+	if(moduleInstance->numTierUpCalls.load(std::memory_order_relaxed) >= tierUpCallCount)
+	{ return; }
+
+	// Only the call that reaches the tier-up call count starts the optimized tier compile. The
+	// instance is kept alive by a GC root until the compile task has finished with it.
+	if(moduleInstance->numTierUpCalls.fetch_add(1, std::memory_order_relaxed) + 1
+	   == tierUpCallCount)
+	{
+		addGCRoot(moduleInstance);
+		queueCompileTask(CompilePriority::warmUp, [moduleInstance] { tierUp(moduleInstance); });
+	}
+}
+
+// Returns whether a new module's definitions, exports and passive segments are compatible with
+// those of a module instance, so the new module's code may be loaded with the instance's bindings.
+static bool isCompatibleModuleLayout(ModuleInstance* moduleInstance, const IR::Module& irModule)
+{
+	if(irModule.functions.imports.size()
+		   != moduleInstance->functions.size() - moduleInstance->functionDefs.size()
+	   || irModule.functions.size() != moduleInstance->functions.size()
+	   || irModule.tables.size() != moduleInstance->tables.size()
+	   || irModule.memories.size() != moduleInstance->memories.size()
+	   || irModule.globals.size() != moduleInstance->globals.size()
+	   || irModule.exceptionTypes.size() != moduleInstance->exceptionTypes.size())
+	{ return false; }
+
+	for(Uptr functionIndex = 0; functionIndex < irModule.functions.size(); ++functionIndex)
+	{
+		const FunctionType functionType
+			= irModule.types[irModule.functions.getType(functionIndex).index];
+		if(!isA(moduleInstance->functions[functionIndex], functionType)) { return false; }
+	}
+	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
+	{
+		if(!isA(moduleInstance->tables[tableIndex], irModule.tables.getType(tableIndex)))
+		{ return false; }
+	}
+	for(Uptr memoryIndex = 0; memoryIndex < irModule.memories.size(); ++memoryIndex)
+	{
+		if(!isA(moduleInstance->memories[memoryIndex], irModule.memories.getType(memoryIndex)))
+		{ return false; }
+	}
+	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
+	{
+		if(!isA(moduleInstance->globals[globalIndex], irModule.globals.getType(globalIndex)))
+		{ return false; }
+	}
+	for(Uptr exceptionTypeIndex = 0; exceptionTypeIndex < irModule.exceptionTypes.size();
+		++exceptionTypeIndex)
+	{
+		if(!isA(moduleInstance->exceptionTypes[exceptionTypeIndex],
+				irModule.exceptionTypes.getType(exceptionTypeIndex)))
+		{ return false; }
+	}
+
+	// The exports must have the same names, and refer to the same objects.
+	if(!moduleInstance->exportNames || irModule.exports.size() != moduleInstance->exports.size())
+	{ return false; }
+	for(Uptr exportIndex = 0; exportIndex < irModule.exports.size(); ++exportIndex)
+	{
+		const Export& exportIt = irModule.exports[exportIndex];
+		if(exportIt.name != (*moduleInstance->exportNames)[exportIndex]) { return false; }
+
+		Object* exportedObject = nullptr;
+		switch(exportIt.kind)
+		{
+		case IR::ObjectKind::function:
+			exportedObject = moduleInstance->functions[exportIt.index];
+			break;
+		case IR::ObjectKind::table: exportedObject = moduleInstance->tables[exportIt.index]; break;
+		case IR::ObjectKind::memory:
+			exportedObject = moduleInstance->memories[exportIt.index];
+			break;
+		case IR::ObjectKind::global:
+			exportedObject = moduleInstance->globals[exportIt.index];
+			break;
+		case IR::ObjectKind::exceptionType:
+			exportedObject = moduleInstance->exceptionTypes[exportIt.index];
+			break;
+		default: Errors::unreachable();
+		}
+		if(exportedObject != moduleInstance->exports[exportIndex]) { return false; }
+	}
+
+	// The instance's passive segments that haven't been dropped must also be passive segments of
+	// the new module with the same contents. The new module's other passive segments are treated as
+	// dropped, like its active segments.
+	for(Uptr segmentIndex = 0; segmentIndex < moduleInstance->passiveDataSegments->size();
+		++segmentIndex)
+	{
+		if(moduleInstance->isDataSegmentDropped(segmentIndex)) { continue; }
+		if(segmentIndex >= irModule.dataSegments.size()
+		   || irModule.dataSegments[segmentIndex].isActive
+		   || irModule.dataSegments[segmentIndex].data
+				  != (*moduleInstance->passiveDataSegments)[segmentIndex])
+		{ return false; }
+	}
+	{
+		Lock<Platform::Mutex> passiveTableSegmentsLock(moduleInstance->passiveTableSegmentsMutex);
+		for(const auto& passiveTableSegmentPair : moduleInstance->passiveTableSegments)
+		{
+			const Uptr segmentIndex = passiveTableSegmentPair.key;
+			if(segmentIndex >= irModule.tableSegments.size()
+			   || irModule.tableSegments[segmentIndex].isActive)
+			{ return false; }
+
+			const std::vector<Uptr>& indices = irModule.tableSegments[segmentIndex].indices;
+			const std::vector<Object*>& objects = *passiveTableSegmentPair.value;
+			if(indices.size() != objects.size()) { return false; }
+			for(Uptr elementIndex = 0; elementIndex < indices.size(); ++elementIndex)
+			{
+				if(moduleInstance->functions[indices[elementIndex]] != objects[elementIndex])
+				{ return false; }
+			}
+		}
+	}
+
+	return true;
+}
+
+bool Runtime::replaceModuleInstanceCode(ModuleInstance* moduleInstance, Module* newModule)
+{
+	wavmAssert(moduleInstance);
+	wavmAssert(newModule);
+
+	// Tiered and lazy compilation and profile instrumentation replace or count an instance's code
+	// on their own, so they can't be combined with replacing it.
+	if(moduleInstance->module || newModule->tierUpCallCount || newModule->lazyCompile
+	   || newModule->profileInstrumentation || !moduleInstance->jitModule)
+	{ return false; }
+
+	if(!isCompatibleModuleLayout(moduleInstance, newModule->ir)) { return false; }
+
+	// Load the new code with the instance's bindings, and charge it to the compartment's memory
+	// budget before any of the instance's functions are switched to it.
+	std::vector<LLVMJIT::JITFunction*> jitFunctionDefs;
+	LLVMJIT::LoadedModule* jitModule
+		= loadJITModule(moduleInstance, newModule->ir, newModule->objectCode, jitFunctionDefs);
+	const Uptr numJITModuleBytes = LLVMJIT::getLoadedModuleNumBytes(jitModule);
+	if(!moduleInstance->memoryBudget->charge(numJITModuleBytes))
+	{
+		LLVMJIT::unloadModule(jitModule);
+		throwException(Exception::outOfMemoryType);
+	}
+	moduleInstance->numChargedJITModuleBytes += numJITModuleBytes;
+
+	// Switch the instance's functions to the new code, and replace the anyrefs to their old code in
+	// the compartment's tables, as tierUp does. The old code stays loaded until the instance is
+	// destroyed, since it may still be running on other threads.
+	HashMap<const AnyReferee*, const AnyReferee*> anyRefReplacements;
+	std::vector<const AnyReferee*> oldAnyRefs;
+	for(FunctionInstance* functionInstance : moduleInstance->functionDefs)
+	{ oldAnyRefs.push_back(&asAnyFunc(functionInstance)->anyRef); }
+	linkJITFunctions(moduleInstance, jitFunctionDefs);
+	for(Uptr functionDefIndex = 0; functionDefIndex < moduleInstance->functionDefs.size();
+		++functionDefIndex)
+	{
+		anyRefReplacements.addOrFail(
+			oldAnyRefs[functionDefIndex],
+			&asAnyFunc(moduleInstance->functionDefs[functionDefIndex])->anyRef);
+	}
+	moduleInstance->replacedJITModules.push_back(moduleInstance->jitModule);
+	moduleInstance->jitModule = jitModule;
+	moduleInstance->codeModule = newModule;
+
+	replaceFunctionDefsInTables(moduleInstance, anyRefReplacements);
+
+	return true;
 }
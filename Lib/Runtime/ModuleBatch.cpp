@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/HashSet.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+static constexpr Uptr batchThreadStackBytes = 8 * 1024 * 1024;
+
+// How long an idle batch thread waits for a module to become ready before checking again. The
+// event may be signaled while no thread is waiting on it, so the threads can't wait indefinitely.
+static constexpr U64 maxIdleWaitMicroseconds = 1000;
+
+struct BatchState
+{
+	Compartment* compartment;
+	const std::vector<BatchModule>& modules;
+	Resolver& resolver;
+	std::vector<BatchModuleResult>& results;
+	const CompileOptions& compileOptions;
+
+	// The first module in the batch with each name, and the modules that import each module.
+	HashMap<std::string, Uptr> moduleIndicesByName;
+	std::vector<std::vector<Uptr>> importerIndices;
+
+	// The number of modules that each module imports that haven't been instantiated yet, the
+	// modules that are ready to be instantiated, and the number of modules that haven't finished
+	// or failed. Protected by mutex.
+	Platform::Mutex mutex;
+	std::vector<Uptr> numPendingDependencies;
+	std::vector<Uptr> readyModuleIndices;
+	Uptr numUnfinishedModules = 0;
+	Platform::Event moduleReadyEvent;
+
+	// Serializes calls to the resolver.
+	Platform::Mutex resolverMutex;
+
+	BatchState(Compartment* inCompartment,
+			   const std::vector<BatchModule>& inModules,
+			   Resolver& inResolver,
+			   std::vector<BatchModuleResult>& inResults,
+			   const CompileOptions& inCompileOptions)
+	: compartment(inCompartment)
+	, modules(inModules)
+	, resolver(inResolver)
+	, results(inResults)
+	, compileOptions(inCompileOptions)
+	{
+	}
+};
+
+// Resolves imports from the modules in the batch, or from the batch's resolver.
+struct BatchResolver : Resolver
+{
+	BatchResolver(BatchState& inState) : state(inState) {}
+
+	bool resolve(const std::string& moduleName,
+				 const std::string& exportName,
+				 IR::ObjectType type,
+				 Object*& outObject) override
+	{
+		if(const Uptr* moduleIndex = state.moduleIndicesByName.get(moduleName))
+		{
+			// The module was instantiated before any module that imports it became ready.
+			ModuleInstance* moduleInstance = state.results[*moduleIndex].moduleInstance;
+			wavmAssert(moduleInstance);
+			outObject = getInstanceExport(moduleInstance, exportName);
+			return outObject && isA(outObject, type);
+		}
+
+		Lock<Platform::Mutex> resolverLock(state.resolverMutex);
+		return state.resolver.resolve(moduleName, exportName, type, outObject);
+	}
+
+private:
+	BatchState& state;
+};
+
+static const IR::Module& getBatchModuleIR(const BatchModule& batchModule)
+{
+	return batchModule.module ? batchModule.module->ir : *batchModule.irModule;
+}
+
+// Calls visitModuleName for the module name of each import of a module.
+template<typename VisitModuleName>
+static void forEachImportModuleName(const IR::Module& module, VisitModuleName&& visitModuleName)
+{
+	for(const auto& import : module.functions.imports) { visitModuleName(import.moduleName); }
+	for(const auto& import : module.tables.imports) { visitModuleName(import.moduleName); }
+	for(const auto& import : module.memories.imports) { visitModuleName(import.moduleName); }
+	for(const auto& import : module.globals.imports) { visitModuleName(import.moduleName); }
+	for(const auto& import : module.exceptionTypes.imports) { visitModuleName(import.moduleName); }
+}
+
+// Marks a module as failed, along with the modules that import it, directly or indirectly.
+// Assumes state.mutex is locked.
+static void failModule(BatchState& state, Uptr moduleIndex, std::string&& error)
+{
+	std::vector<std::pair<Uptr, std::string>> pendingFailures;
+	pendingFailures.emplace_back(moduleIndex, std::move(error));
+	while(pendingFailures.size())
+	{
+		const Uptr failedIndex = pendingFailures.back().first;
+		BatchModuleResult& result = state.results[failedIndex];
+		result.error = std::move(pendingFailures.back().second);
+		pendingFailures.pop_back();
+		--state.numUnfinishedModules;
+
+		for(Uptr importerIndex : state.importerIndices[failedIndex])
+		{
+			// Each module is only failed once: by the first of the modules it imports to fail.
+			if(state.numPendingDependencies[importerIndex] == UINTPTR_MAX) { continue; }
+			state.numPendingDependencies[importerIndex] = UINTPTR_MAX;
+			pendingFailures.emplace_back(importerIndex,
+										 "Imports module '" + state.modules[failedIndex].name
+											 + "', which wasn't instantiated");
+		}
+	}
+}
+
+// Compiles, links, and instantiates a module, and calls its start function. Returns an empty
+// string if it succeeded, or a description of why it failed.
+static std::string instantiateBatchModule(BatchState& state, Context* context, Uptr moduleIndex)
+{
+	const BatchModule& batchModule = state.modules[moduleIndex];
+	BatchModuleResult& result = state.results[moduleIndex];
+	const IR::Module& irModule = getBatchModuleIR(batchModule);
+
+	BatchResolver resolver(state);
+	LinkResult linkResult = linkModule(irModule, resolver);
+	if(!linkResult.success)
+	{
+		result.missingImports = std::move(linkResult.missingImports);
+		return "Failed to link module";
+	}
+
+	Module* module = batchModule.module;
+	if(!module) { module = compileModule(irModule, state.compileOptions); }
+
+	std::string error;
+	catchRuntimeExceptions(
+		[&] {
+			ModuleInstance* moduleInstance
+				= instantiateModule(state.compartment,
+									module,
+									std::move(linkResult.resolvedImports),
+									std::string(batchModule.name));
+			if(FunctionInstance* startFunction = getStartFunction(moduleInstance))
+			{ invokeFunctionChecked(context, startFunction, {}); }
+			result.moduleInstance = moduleInstance;
+		},
+		[&](Exception&& exception) { error = describeException(exception); });
+	return error;
+}
+
+static I64 batchThreadEntry(void* stateVoid)
+{
+	BatchState& state = *(BatchState*)stateVoid;
+	Context* context = nullptr;
+
+	state.mutex.lock();
+	while(state.numUnfinishedModules)
+	{
+		if(!state.readyModuleIndices.size())
+		{
+			// Wait for another thread to finish a module that the remaining modules import.
+			state.mutex.unlock();
+			state.moduleReadyEvent.wait(Platform::getMonotonicClock() + maxIdleWaitMicroseconds);
+			state.mutex.lock();
+			continue;
+		}
+
+		const Uptr moduleIndex = state.readyModuleIndices.back();
+		state.readyModuleIndices.pop_back();
+		state.mutex.unlock();
+
+		// Create the context that this thread calls start functions in when it first needs it.
+		if(!context) { context = createContext(state.compartment); }
+		std::string error = instantiateBatchModule(state, context, moduleIndex);
+
+		state.mutex.lock();
+		if(error.size()) { failModule(state, moduleIndex, std::move(error)); }
+		else
+		{
+			--state.numUnfinishedModules;
+			for(Uptr importerIndex : state.importerIndices[moduleIndex])
+			{
+				if(state.numPendingDependencies[importerIndex] != UINTPTR_MAX
+				   && --state.numPendingDependencies[importerIndex] == 0)
+				{
+					state.readyModuleIndices.push_back(importerIndex);
+					state.moduleReadyEvent.signal();
+				}
+			}
+		}
+	}
+	state.mutex.unlock();
+
+	return 0;
+}
+
+bool Runtime::instantiateModuleBatch(Compartment* compartment,
+									 const std::vector<BatchModule>& modules,
+									 Resolver& resolver,
+									 std::vector<BatchModuleResult>& outResults,
+									 const CompileOptions& compileOptions,
+									 Uptr numThreads)
+{
+	outResults.clear();
+	outResults.resize(modules.size());
+	BatchState state(compartment, modules, resolver, outResults, compileOptions);
+
+	// Find the batch modules that each module imports.
+	for(Uptr moduleIndex = 0; moduleIndex < modules.size(); ++moduleIndex)
+	{
+		wavmAssert(modules[moduleIndex].module || modules[moduleIndex].irModule);
+		state.moduleIndicesByName.add(modules[moduleIndex].name, moduleIndex);
+	}
+	state.importerIndices.resize(modules.size());
+	state.numPendingDependencies.resize(modules.size(), 0);
+	for(Uptr moduleIndex = 0; moduleIndex < modules.size(); ++moduleIndex)
+	{
+		HashSet<Uptr> dependencyIndices;
+		const IR::Module& irModule = getBatchModuleIR(modules[moduleIndex]);
+		forEachImportModuleName(irModule, [&](const std::string& name) {
+			const Uptr* dependencyIndex = state.moduleIndicesByName.get(name);
+			if(dependencyIndex && dependencyIndices.add(*dependencyIndex))
+			{
+				state.importerIndices[*dependencyIndex].push_back(moduleIndex);
+				++state.numPendingDependencies[moduleIndex];
+			}
+		});
+		if(!state.numPendingDependencies[moduleIndex])
+		{ state.readyModuleIndices.push_back(moduleIndex); }
+	}
+	state.numUnfinishedModules = modules.size();
+
+	// Fail the modules that import themselves through a cycle: they are the modules that don't
+	// become ready after all the modules they import are instantiated.
+	{
+		std::vector<Uptr> numUnvisitedDependencies = state.numPendingDependencies;
+		std::vector<Uptr> visitStack = state.readyModuleIndices;
+		while(visitStack.size())
+		{
+			const Uptr moduleIndex = visitStack.back();
+			visitStack.pop_back();
+			for(Uptr importerIndex : state.importerIndices[moduleIndex])
+			{
+				if(--numUnvisitedDependencies[importerIndex] == 0)
+				{ visitStack.push_back(importerIndex); }
+			}
+		}
+
+		Lock<Platform::Mutex> lock(state.mutex);
+		for(Uptr moduleIndex = 0; moduleIndex < modules.size(); ++moduleIndex)
+		{
+			if(numUnvisitedDependencies[moduleIndex]
+			   && state.numPendingDependencies[moduleIndex] != UINTPTR_MAX)
+			{
+				state.numPendingDependencies[moduleIndex] = UINTPTR_MAX;
+				failModule(state, moduleIndex, "Imports itself through a cycle of modules");
+			}
+		}
+	}
+
+	// Instantiate the modules on the worker threads and the calling thread. There's no point in
+	// using more threads than there are modules that could be instantiated at once.
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::max(Uptr(1), std::min(numThreads, modules.size()));
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{ threads.push_back(Platform::createThread(batchThreadStackBytes, batchThreadEntry, &state)); }
+	batchThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	for(const BatchModuleResult& result : outResults)
+	{
+		if(!result.moduleInstance) { return false; }
+	}
+	return true;
+}
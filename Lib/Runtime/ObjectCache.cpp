@@ -0,0 +1,287 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/WASM/WASM.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// The version of the object cache file format, and of the compiler's output. This should be
+// incremented whenever a change to WAVM changes the object code generated for a module, so any
+// object code cached by a previous version of WAVM will be ignored.
+static constexpr U64 objectCacheVersion = 12;
+
+static constexpr U8 objectCacheMagic[8] = {'W', 'A', 'V', 'M', 'O', 'B', 'J', 'C'};
+
+// The header at the start of each object cache file. It contains a second hash of the key material
+// computed with a different seed, so that a collision in the 64-bit hash used for the file name
+// will not return the wrong object code.
+struct ObjectCacheFileHeader
+{
+	U8 magic[8];
+	U64 version;
+	U64 keyHash;
+	U64 keyNumBytes;
+	U64 objectCodeNumBytes;
+};
+
+static void appendKeyBytes(std::vector<U8>& keyBytes, const void* data, Uptr numBytes)
+{
+	keyBytes.insert(keyBytes.end(), (const U8*)data, (const U8*)data + numBytes);
+}
+
+void Runtime::appendCompileOptionsKeyBytes(std::vector<U8>& keyBytes,
+										  const IR::FeatureSpec& featureSpec,
+										  const LLVMJIT::CompileOptions& compileOptions)
+{
+	// The key material starts with the object cache version, a description of the compiler and
+	// target, and anything else that affects the generated object code.
+	appendKeyBytes(keyBytes, &objectCacheVersion, sizeof(objectCacheVersion));
+	const std::string targetDescription = LLVMJIT::getTargetDescription(compileOptions);
+	appendKeyBytes(keyBytes, targetDescription.c_str(), targetDescription.size() + 1);
+	keyBytes.push_back(U8(compileOptions.optimizationLevel));
+	keyBytes.push_back(U8(compileOptions.codeGenOptimizationLevel));
+	keyBytes.push_back(compileOptions.memoryBoundsChecks ? 1 : 0);
+	keyBytes.push_back(compileOptions.epochInterruption ? 1 : 0);
+	keyBytes.push_back(compileOptions.fuelMetering ? 1 : 0);
+	keyBytes.push_back(compileOptions.stackLimitChecks ? 1 : 0);
+	keyBytes.push_back(compileOptions.canonicalizeNaNs ? 1 : 0);
+	keyBytes.push_back(compileOptions.memoryAccessSampling ? 1 : 0);
+	keyBytes.push_back(compileOptions.relaxedMemoryAccesses ? 1 : 0);
+	keyBytes.push_back(compileOptions.profileInstrumentation ? 1 : 0);
+	keyBytes.push_back(compileOptions.profileCycles ? 1 : 0);
+	keyBytes.push_back(compileOptions.framePointers ? 1 : 0);
+	const std::vector<U8> profileBytes = compileOptions.profile
+											 ? serializeModuleProfile(*compileOptions.profile)
+											 : std::vector<U8>();
+	const U64 numProfileBytes = profileBytes.size();
+	appendKeyBytes(keyBytes, &numProfileBytes, sizeof(numProfileBytes));
+	appendKeyBytes(keyBytes, profileBytes.data(), profileBytes.size());
+	const U64 numSpecializedGlobalImports = compileOptions.specializedGlobalImports.size();
+	appendKeyBytes(keyBytes, &numSpecializedGlobalImports, sizeof(numSpecializedGlobalImports));
+	for(const auto& specializedGlobalImport : compileOptions.specializedGlobalImports)
+	{
+		const U64 globalIndex = specializedGlobalImport.first;
+		const IR::Value& value = specializedGlobalImport.second;
+		appendKeyBytes(keyBytes, &globalIndex, sizeof(globalIndex));
+		keyBytes.push_back(U8(value.type));
+		appendKeyBytes(keyBytes, value.bytes, getTypeByteWidth(value.type));
+	}
+
+	const bool featureFlags[] = {featureSpec.mvp,
+								 featureSpec.importExportMutableGlobals,
+								 featureSpec.extendedNamesSection,
+								 featureSpec.simd,
+								 featureSpec.atomics,
+								 featureSpec.exceptionHandling,
+								 featureSpec.nonTrappingFloatToInt,
+								 featureSpec.extendedSignExtension,
+								 featureSpec.multipleResultsAndBlockParams,
+								 featureSpec.bulkMemoryOperations,
+								 featureSpec.referenceTypes,
+								 featureSpec.memory64,
+								 featureSpec.multipleMemories,
+								 featureSpec.sharedTables,
+								 featureSpec.functionRefInstruction,
+								 featureSpec.requireSharedFlagForAtomicOperators};
+	for(bool featureFlag : featureFlags) { keyBytes.push_back(featureFlag ? 1 : 0); }
+	const U64 maxLocals = featureSpec.maxLocals;
+	const U64 maxLabelsPerFunction = featureSpec.maxLabelsPerFunction;
+	appendKeyBytes(keyBytes, &maxLocals, sizeof(maxLocals));
+	appendKeyBytes(keyBytes, &maxLabelsPerFunction, sizeof(maxLabelsPerFunction));
+}
+
+ObjectCacheKey Runtime::getObjectCacheKey(const IR::Module& irModule,
+										  const LLVMJIT::CompileOptions& compileOptions)
+{
+	std::vector<U8> keyBytes;
+	appendCompileOptionsKeyBytes(keyBytes, irModule.featureSpec, compileOptions);
+
+	// Followed by the binary encoding of the module.
+	Serialization::ArrayOutputStream moduleStream;
+	WASM::serialize(moduleStream, irModule);
+	const std::vector<U8> moduleBytes = moduleStream.getBytes();
+	appendKeyBytes(keyBytes, moduleBytes.data(), moduleBytes.size());
+
+	return getObjectCacheKey(keyBytes);
+}
+
+ObjectCacheKey Runtime::getObjectCacheKey(const std::vector<U8>& keyBytes)
+{
+	ObjectCacheKey key;
+	key.hash = XXH<U64>(keyBytes.data(), keyBytes.size(), 0);
+	key.checkHash = XXH<U64>(keyBytes.data(), keyBytes.size(), 0x9E3779B97F4A7C15);
+	key.numBytes = keyBytes.size();
+	return key;
+}
+
+// Returns the name of the object code for a key in a cache: the 64-bit hash in hexadecimal. The
+// check hash and number of bytes of the key material are validated by the entry's header.
+static std::string getObjectCacheKeyName(const ObjectCacheKey& key)
+{
+	char keyName[17];
+	snprintf(keyName, sizeof(keyName), "%016" PRIx64, key.hash);
+	return keyName;
+}
+
+static std::string getObjectCacheFilePath(const std::string& cacheDirectory,
+										  const ObjectCacheKey& key)
+{
+	return cacheDirectory + "/" + getObjectCacheKeyName(key) + ".wavmobj";
+}
+
+// Each object cache entry is an ObjectCacheFileHeader followed by the object code.
+static std::vector<U8> serializeObjectCacheEntry(const ObjectCacheKey& key,
+												 const std::vector<U8>& objectCode)
+{
+	ObjectCacheFileHeader header;
+	memcpy(header.magic, objectCacheMagic, sizeof(objectCacheMagic));
+	header.version = objectCacheVersion;
+	header.keyHash = key.checkHash;
+	header.keyNumBytes = key.numBytes;
+	header.objectCodeNumBytes = objectCode.size();
+
+	std::vector<U8> entry((const U8*)&header, (const U8*)(&header + 1));
+	entry.insert(entry.end(), objectCode.begin(), objectCode.end());
+	return entry;
+}
+
+static bool deserializeObjectCacheEntry(const ObjectCacheKey& key,
+										const std::vector<U8>& entry,
+										std::vector<U8>& outObjectCode)
+{
+	ObjectCacheFileHeader header;
+	if(entry.size() < sizeof(header)) { return false; }
+	memcpy(&header, entry.data(), sizeof(header));
+	if(memcmp(header.magic, objectCacheMagic, sizeof(objectCacheMagic))
+	   || header.version != objectCacheVersion || header.keyHash != key.checkHash
+	   || header.keyNumBytes != key.numBytes
+	   || header.objectCodeNumBytes != entry.size() - sizeof(header))
+	{ return false; }
+
+	outObjectCode.assign(entry.begin() + sizeof(header), entry.end());
+	return true;
+}
+
+static bool loadObjectCacheFile(const std::string& cacheDirectory,
+								const ObjectCacheKey& key,
+								std::vector<U8>& outObjectCode)
+{
+	const std::string filePath = getObjectCacheFilePath(cacheDirectory, key);
+	Platform::File* file = Platform::openFile(
+		filePath, Platform::FileAccessMode::readOnly, Platform::FileCreateMode::openExisting);
+	if(!file) { return false; }
+
+	// Read and validate the entry.
+	U64 numFileBytes = 0;
+	std::vector<U8> entry;
+	Uptr numBytesRead = 0;
+	bool isValid = Platform::getFileNumBytes(file, numFileBytes) && numFileBytes <= UINTPTR_MAX;
+	if(isValid)
+	{
+		entry.resize(Uptr(numFileBytes));
+		isValid = Platform::readFile(file, entry.data(), entry.size(), &numBytesRead)
+				  && numBytesRead == entry.size()
+				  && deserializeObjectCacheEntry(key, entry, outObjectCode);
+	}
+	errorUnless(Platform::closeFile(file));
+
+	if(!isValid)
+	{
+		Log::printf(Log::debug, "Ignoring invalid object cache file %s\n", filePath.c_str());
+		outObjectCode.clear();
+		return false;
+	}
+
+	Log::printf(Log::debug, "Loaded cached object code from %s\n", filePath.c_str());
+	return true;
+}
+
+static void saveObjectCacheFile(const std::string& cacheDirectory,
+								const ObjectCacheKey& key,
+								const std::vector<U8>& entry)
+{
+	// Write the entry to a temporary file, and rename it to the cache file path once it is
+	// complete, so concurrent readers never see a partially written cache file. The temporary file
+	// name is unique to this call, so processes and threads that write the same entry
+	// concurrently each write their own file, and a temporary file left behind by a process that
+	// was killed while writing it doesn't prevent later processes from writing the entry.
+	static const U64 processNonce = (U64(std::random_device()()) << 32) ^ std::random_device()();
+	static std::atomic<U64> nextTempFileIndex{0};
+	char tempFileSuffix[64];
+	snprintf(tempFileSuffix,
+			 sizeof(tempFileSuffix),
+			 ".%016" PRIx64 "-%" PRIu64 ".tmp",
+			 processNonce,
+			 nextTempFileIndex.fetch_add(1, std::memory_order_relaxed));
+
+	const std::string filePath = getObjectCacheFilePath(cacheDirectory, key);
+	const std::string tempFilePath = filePath + tempFileSuffix;
+	Platform::File* file = Platform::openFile(
+		tempFilePath, Platform::FileAccessMode::writeOnly, Platform::FileCreateMode::createAlways);
+	if(!file)
+	{
+		Log::printf(Log::debug, "Failed to create object cache file %s\n", tempFilePath.c_str());
+		return;
+	}
+
+	const bool succeeded = Platform::writeFile(file, entry.data(), entry.size());
+	errorUnless(Platform::closeFile(file));
+
+	if(!succeeded || rename(tempFilePath.c_str(), filePath.c_str()))
+	{
+		Log::printf(Log::debug, "Failed to write object cache file %s\n", filePath.c_str());
+		remove(tempFilePath.c_str());
+	}
+}
+
+bool Runtime::loadCachedObjectCode(const std::string& cacheDirectory,
+								   ObjectCache* objectCache,
+								   const ObjectCacheKey& key,
+								   std::vector<U8>& outObjectCode)
+{
+	if(cacheDirectory.size() && loadObjectCacheFile(cacheDirectory, key, outObjectCode))
+	{ return true; }
+	if(!objectCache) { return false; }
+
+	const std::string keyName = getObjectCacheKeyName(key);
+	std::vector<U8> entry;
+	if(!objectCache->load(keyName, entry)) { return false; }
+	if(!deserializeObjectCacheEntry(key, entry, outObjectCode))
+	{
+		Log::printf(Log::debug, "Ignoring invalid object cache entry %s\n", keyName.c_str());
+		outObjectCode.clear();
+		return false;
+	}
+	Log::printf(Log::debug, "Loaded cached object code for %s\n", keyName.c_str());
+
+	// Copy the entry to the directory, so the next compile doesn't need to load it from the
+	// host's cache.
+	if(cacheDirectory.size()) { saveObjectCacheFile(cacheDirectory, key, entry); }
+	return true;
+}
+
+void Runtime::saveCachedObjectCode(const std::string& cacheDirectory,
+								   ObjectCache* objectCache,
+								   const ObjectCacheKey& key,
+								   const std::vector<U8>& objectCode)
+{
+	std::vector<U8> entry = serializeObjectCacheEntry(key, objectCode);
+	if(cacheDirectory.size()) { saveObjectCacheFile(cacheDirectory, key, entry); }
+	if(objectCache) { objectCache->save(getObjectCacheKeyName(key), std::move(entry)); }
+}
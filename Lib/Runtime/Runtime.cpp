@@ -50,9 +50,12 @@ Context* Runtime::getContextFromRuntimeData(ContextRuntimeData* contextRuntimeDa
 {
 	const CompartmentRuntimeData* compartmentRuntimeData
 		= getCompartmentRuntimeData(contextRuntimeData);
-	const Uptr contextId = contextRuntimeData - compartmentRuntimeData->contexts;
-	Lock<Platform::Mutex> compartmentLock(compartmentRuntimeData->compartment->mutex);
-	return compartmentRuntimeData->compartment->contexts[contextId];
+	Compartment* compartment = compartmentRuntimeData->compartment;
+	const Uptr contextId
+		= Uptr(reinterpret_cast<const U8*>(contextRuntimeData) - compartmentRuntimeData->contexts)
+		  / compartment->numContextRuntimeDataBytes;
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	return compartment->contexts[contextId];
 }
 
 ContextRuntimeData* Runtime::getContextRuntimeData(Context* context)
@@ -6,7 +6,10 @@
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/IndexMap.h"
+#include "WAVM/Inline/SharedBytes.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -14,6 +17,7 @@
 
 #include <atomic>
 #include <functional>
+#include <map>
 #include <memory>
 
 namespace WAVM { namespace Intrinsics {
@@ -30,6 +34,11 @@ namespace WAVM { namespace Runtime {
 	{
 		std::atomic<Uptr> numRootReferences;
 
+		// The number of background garbage collections that had started when the object was
+		// created. Background collections treat objects created since the previous one started as
+		// roots.
+		U64 gcCycle;
+
 		ObjectImpl(ObjectKind inKind);
 
 		// Called on all objects that are about to be deleted before any of them are deleted.
@@ -52,29 +61,86 @@ namespace WAVM { namespace Runtime {
 	// function.
 	struct FunctionInstance : ObjectImpl
 	{
+		// The compartment the function was instantiated in. It may also be referenced by the
+		// compartments cloned from it. Intrinsic functions aren't owned by any compartment, and may
+		// be referenced by all compartments.
+		Compartment* compartment;
 		ModuleInstance* moduleInstance;
 		IR::FunctionType type;
-		void* nativeFunction;
+
+		// The function's code. Tiered and lazy compilation replace a function definition's code
+		// while other threads may be calling it, so it is stored with release order, and loaded
+		// with acquire order.
+		std::atomic<void*> nativeFunction;
+
 		IR::CallingConvention callingConvention;
 		std::string debugName;
 
-		FunctionInstance(ModuleInstance* inModuleInstance,
+		// Caches of the thunks used to call the function from the host, and to call it from
+		// WebAssembly code if it isn't a WebAssembly function. They are set the first time they
+		// are needed, so later calls don't need to take the locks that protect LLVMJIT's global
+		// thunk caches.
+		mutable std::atomic<LLVMJIT::InvokeThunkPointer> invokeThunk;
+		mutable std::atomic<void*> intrinsicThunk;
+
+		// If non-null, the function is an intrinsic with no side effects that always returns this
+		// value, or nothing if its type has no results.
+		const IR::UntaggedValue* constantResult;
+
+		// True if the function is an intrinsic that doesn't use its ContextRuntimeData and can't
+		// throw, so its thunk may call it directly.
+		bool isLeafIntrinsic;
+
+		// If non-null, the function was created by Intrinsics::createHostFunction, and owns the
+		// HostFunction. nativeFunction points to the HostFunction, which is passed to invokeThunk,
+		// and WebAssembly code calls hostTrampoline through a thunk that passes it the HostFunction.
+		Intrinsics::HostFunction* hostFunction;
+		void* hostTrampoline;
+
+		FunctionInstance(Compartment* inCompartment,
+						 ModuleInstance* inModuleInstance,
 						 IR::FunctionType inType,
 						 void* inNativeFunction,
 						 IR::CallingConvention inCallingConvention,
 						 std::string&& inDebugName)
 		: ObjectImpl(ObjectKind::function)
+		, compartment(inCompartment)
 		, moduleInstance(inModuleInstance)
 		, type(inType)
 		, nativeFunction(inNativeFunction)
 		, callingConvention(inCallingConvention)
 		, debugName(std::move(inDebugName))
+		, invokeThunk(nullptr)
+		, intrinsicThunk(nullptr)
+		, constantResult(nullptr)
+		, isLeafIntrinsic(false)
+		, hostFunction(nullptr)
+		, hostTrampoline(nullptr)
 		{
 		}
 
+		virtual ~FunctionInstance() override;
+		virtual void finalize() override;
+
 		virtual const AnyReferee* getAnyRef() const override { return &asAnyFunc(this)->anyRef; }
 	};
 
+	// The bytes committed to a compartment's memories, tables, contexts, and JIT code, and the limit
+	// set by setCompartmentMemoryLimit. The objects that charge bytes to it share ownership of it
+	// with the compartment, since the garbage collector may delete them after the compartment.
+	struct CompartmentMemoryBudget
+	{
+		std::atomic<Uptr> numCommittedBytes{0};
+		std::atomic<Uptr> maxCommittedBytes{UINTPTR_MAX};
+
+		// Adds to the committed bytes, and returns true, if that doesn't exceed the limit.
+		// Otherwise, returns false without changing the committed bytes.
+		bool charge(Uptr numBytes);
+
+		// Subtracts bytes that were charged from the committed bytes.
+		void release(Uptr numBytes);
+	};
+
 	// An instance of a WebAssembly Table.
 	struct TableInstance : ObjectImplWithAnyRef
 	{
@@ -92,9 +158,15 @@ namespace WAVM { namespace Runtime {
 		Uptr numReservedBytes;
 		Uptr numReservedElements;
 
+		// The ID of the table's reserved address range in the owned address ranges.
+		Uptr ownedAddressRangeId;
+
 		Platform::Mutex resizingMutex;
 		std::atomic<Uptr> numElements;
 
+		// The compartment's memory budget, which the table's committed pages are charged to.
+		std::shared_ptr<CompartmentMemoryBudget> memoryBudget;
+
 		TableInstance(Compartment* inCompartment, const IR::TableType& inType)
 		: ObjectImplWithAnyRef(ObjectKind::table)
 		, compartment(inCompartment)
@@ -103,6 +175,7 @@ namespace WAVM { namespace Runtime {
 		, elements(nullptr)
 		, numReservedBytes(0)
 		, numReservedElements(0)
+		, ownedAddressRangeId(UINTPTR_MAX)
 		, numElements(0)
 		{
 		}
@@ -118,6 +191,10 @@ namespace WAVM { namespace Runtime {
 	// A sentinel value that is used for null values of type anyfunc.
 	extern const AnyFunc* getUninitializedAnyFunc();
 
+	// Returns the address of the epoch counter that is bound to code compiled with epoch
+	// interruption.
+	Uptr getEpochAddress();
+
 	// An instance of a WebAssembly Memory.
 	struct MemoryInstance : ObjectImplWithAnyRef
 	{
@@ -129,18 +206,74 @@ namespace WAVM { namespace Runtime {
 		U8* baseAddress;
 		Uptr numReservedBytes;
 
+		// The ID of the memory's reserved address range in the owned address ranges.
+		Uptr ownedAddressRangeId;
+
 		Platform::Mutex resizingMutex;
 		std::atomic<Uptr> numPages;
 
-		MemoryInstance(Compartment* inCompartment, const IR::MemoryType& inType)
+		// The number of pages that are committed or being committed by growMemory. growMemory
+		// claims the pages it grows the memory by with an atomic compare-and-swap on this, so it
+		// can commit them without locking resizingMutex. It is UINTPTR_MAX while another resizing
+		// operation holds resizingMutex.
+		std::atomic<Uptr> numClaimedPages;
+
+		// The snapshot that the memory's pages are mapped from copy-on-write, if it was cloned from
+		// or to another memory. Protected by resizingMutex.
+		Platform::VirtualPageSnapshot* pageSnapshot;
+
+		// Whether any of the memory's pages were mapped from a file by mapMemoryFile or
+		// createFileBackedMemory. Protected by resizingMutex.
+		bool hasMappedFiles;
+
+		// The file that the memory's pages are mapped from, if it was created by
+		// createFileBackedMemory. backingFileMutex serializes changes to the file's size by
+		// concurrent calls to growMemory.
+		Platform::File* const backingFile;
+		const bool isBackingFileShared;
+		Platform::Mutex backingFileMutex;
+
+		// Whether the memory is a shared memory that is mapped shared from its backing file, so
+		// other processes may map the same pages, and wait on and wake addresses in them.
+		const bool isProcessShared;
+
+		// The number of threads waiting on addresses in the memory that have each waiter count
+		// index. Waiters in other processes aren't counted, so the counts of a process-shared
+		// memory start at one to make atomic.notify always call into the runtime.
+		std::atomic<Uptr> waiterCounts[numMemoryWaiterCounts];
+
+		// The compartment's memory budget, which the memory's pages are charged to.
+		std::shared_ptr<CompartmentMemoryBudget> memoryBudget;
+
+		// Whether startMemoryDirtyPageTracking is tracking the writes to the memory, and the
+		// platform pages that were written since the memory's last checkpoint, which are
+		// accumulated from the platform's dirty bits each time they are cleared. Protected by the
+		// dirty page tracking mutex in DirtyPages.cpp.
+		bool isDirtyPageTracked;
+		std::vector<U64> dirtyPageBits;
+
+		MemoryInstance(Compartment* inCompartment,
+					   const IR::MemoryType& inType,
+					   Platform::File* inBackingFile = nullptr,
+					   bool inIsBackingFileShared = false)
 		: ObjectImplWithAnyRef(ObjectKind::memory)
 		, compartment(inCompartment)
 		, id(UINTPTR_MAX)
 		, type(inType)
 		, baseAddress(nullptr)
 		, numReservedBytes(0)
+		, ownedAddressRangeId(UINTPTR_MAX)
 		, numPages(0)
+		, numClaimedPages(0)
+		, pageSnapshot(nullptr)
+		, hasMappedFiles(inBackingFile != nullptr)
+		, backingFile(inBackingFile)
+		, isBackingFileShared(inIsBackingFileShared)
+		, isProcessShared(inType.isShared && inBackingFile && inIsBackingFileShared)
+		, isDirtyPageTracked(false)
 		{
+			for(Uptr index = 0; index < numMemoryWaiterCounts; ++index)
+			{ waiterCounts[index].store(isProcessShared ? 1 : 0, std::memory_order_relaxed); }
 		}
 		~MemoryInstance() override;
 		virtual void finalize() override;
@@ -183,24 +316,159 @@ namespace WAVM { namespace Runtime {
 		}
 	};
 
+	// Identifies the object code compiled for a module in the on-disk object cache.
+	struct ObjectCacheKey
+	{
+		U64 hash;
+		U64 checkHash;
+		U64 numBytes;
+	};
+
+	// Identifies a module compiled with CompileOptions::shareIdenticalModules: the key of its
+	// object code, and the compile options that affect the module but not its object code.
+	struct SharedModuleKey
+	{
+		ObjectCacheKey objectCacheKey;
+		Uptr maxMemoryReservedBytes;
+		Uptr tierUpCallCount;
+		bool mapDataSegmentsOnDemand;
+
+		friend bool operator==(const SharedModuleKey& left, const SharedModuleKey& right)
+		{
+			return left.objectCacheKey.hash == right.objectCacheKey.hash
+				   && left.objectCacheKey.checkHash == right.objectCacheKey.checkHash
+				   && left.objectCacheKey.numBytes == right.objectCacheKey.numBytes
+				   && left.maxMemoryReservedBytes == right.maxMemoryReservedBytes
+				   && left.tierUpCallCount == right.tierUpCallCount
+				   && left.mapDataSegmentsOnDemand == right.mapDataSegmentsOnDemand;
+		}
+	};
+
+	// Maps the names of a module's exports to their indices with a minimal perfect hash. It's built
+	// once for each Module and shared by all the Module's instances, so instantiating a module
+	// doesn't need to hash or copy the names.
+	struct ExportIndexTable
+	{
+		std::shared_ptr<const std::vector<std::string>> names;
+
+		ExportIndexTable(std::vector<std::string>&& inNames);
+
+		// Returns the index of the last export with the name, or UINTPTR_MAX if there isn't one.
+		Uptr get(const std::string& name) const;
+
+	private:
+		std::vector<U32> bucketSeeds;
+		std::vector<Uptr> slotExportIndices;
+	};
+
 	// A compiled WebAssembly module.
 	struct Module : ObjectImplWithAnyRef
 	{
+		// The module's IR. Unless the module's code is compiled after it is created, the code of
+		// its function definitions is released when it is compiled, since instantiating the module
+		// only needs its declarations and segments.
 		IR::Module ir;
 		std::vector<U8> objectCode;
 
+		// If the module was compiled with tiered compilation, objectCode is the baseline tier, and
+		// these are used to compile the optimized tier on demand.
+		Uptr tierUpCallCount;
+		std::string objectCacheDirectory;
+		std::shared_ptr<ObjectCache> objectCache;
+		Platform::Mutex optimizedTierMutex;
+		std::vector<U8> optimizedTierObjectCode;
+
+		// If the module was compiled with lazy compilation, objectCode is empty, and each instance
+		// of the module compiles its function definitions the first time they are called.
+		bool lazyCompile;
+		bool lazyCompileDirectCallees;
+
+		// The options used to compile the optimized tier or the lazily compiled functions.
+		LLVMJIT::CompileOptions deferredCompileOptions;
+
+		// The values of the immutable imported globals that the module's code is specialized for.
+		// The module's instances must import globals with the same values.
+		std::map<Uptr, IR::Value> specializedGlobalImports;
+
+		// The maximum number of bytes of address space to reserve for the memories defined by
+		// instances of the module. If it isn't UINTPTR_MAX, the module was compiled with memory
+		// bounds checks, and may also import memories with less than the full reservation.
+		Uptr maxMemoryReservedBytes;
+
+		// If the module was compiled with mapDataSegmentsOnDemand, the snapshots of the initial
+		// contents of the module's memory definitions are created by the first instantiation of
+		// the module. A memory definition's snapshot is null if its data segments can't be mapped
+		// on demand.
+		bool mapDataSegmentsOnDemand;
+		Platform::Mutex memoryDefImagesMutex;
+		bool createdMemoryDefImages;
+		std::vector<Platform::VirtualPageSnapshot*> memoryDefImages;
+
+		// If the module was compiled with profile instrumentation, the counters updated by the code
+		// of all the module's instances. They are allocated when the module is compiled, so their
+		// address doesn't change while code is bound to it.
+		bool profileInstrumentation;
+		std::vector<U64> profileCounters;
+
+		// The debug names of the module's function definitions. They are decoded from the module's
+		// name section by the first instantiation of the module.
+		Platform::Mutex functionDefDebugNamesMutex;
+		bool decodedFunctionDefDebugNames;
+		std::vector<std::string> functionDefDebugNames;
+
+		// The names of the module's exports and the table that maps them to export indices, shared
+		// by all the module's instances.
+		std::shared_ptr<const ExportIndexTable> exportIndexTable;
+
+		// The bytes of the module's passive data segments, indexed by data segment index, and shared
+		// by all the module's instances. Active data segments have empty bytes.
+		std::shared_ptr<const std::vector<SharedBytes>> passiveDataSegments;
+
+		// If the module is in the table of modules that compileModule shares between identical
+		// compiles, the key it was added with. It is removed from the table when it is freed.
+		bool isShared;
+		SharedModuleKey sharedModuleKey;
+
 		Module(IR::Module&& inIR, std::vector<U8>&& inObjectCode)
-		: ObjectImplWithAnyRef(ObjectKind::module), ir(inIR), objectCode(std::move(inObjectCode))
+		: ObjectImplWithAnyRef(ObjectKind::module)
+		, ir(std::move(inIR))
+		, objectCode(std::move(inObjectCode))
+		, tierUpCallCount(0)
+		, lazyCompile(false)
+		, lazyCompileDirectCallees(false)
+		, maxMemoryReservedBytes(UINTPTR_MAX)
+		, mapDataSegmentsOnDemand(false)
+		, createdMemoryDefImages(false)
+		, profileInstrumentation(false)
+		, decodedFunctionDefDebugNames(false)
+		, isShared(false)
 		{
+			std::vector<std::string> names;
+			for(const IR::Export& exportIt : ir.exports) { names.push_back(exportIt.name); }
+			exportIndexTable = std::make_shared<ExportIndexTable>(std::move(names));
+
+			auto dataSegmentBytes = std::make_shared<std::vector<SharedBytes>>();
+			for(const IR::DataSegment& dataSegment : ir.dataSegments)
+			{ dataSegmentBytes->push_back(dataSegment.isActive ? SharedBytes() : dataSegment.data); }
+			passiveDataSegments = std::move(dataSegmentBytes);
 		}
+		~Module() override;
 	};
 
+	// The number of module instances that are alive.
+	extern Metrics::Gauge moduleInstancesGauge;
+
 	// An instance of a WebAssembly module.
 	struct ModuleInstance : ObjectImplWithAnyRef
 	{
 		Compartment* compartment;
 
-		HashMap<std::string, Object*> exportMap;
+		// The instance's exports, and the table that maps their names to indices in exports.
+		// Instances of the same Module share exportIndexTable and exportNames, so a LinkPlan can
+		// check that an instance has the exports it was created for by comparing a pointer.
+		std::shared_ptr<const ExportIndexTable> exportIndexTable;
+		std::shared_ptr<const std::vector<std::string>> exportNames;
+		std::vector<Object*> exports;
 
 		std::vector<FunctionInstance*> functionDefs;
 
@@ -214,14 +482,45 @@ namespace WAVM { namespace Runtime {
 		MemoryInstance* defaultMemory;
 		TableInstance* defaultTable;
 
-		Platform::Mutex passiveDataSegmentsMutex;
-		HashMap<Uptr, std::shared_ptr<const std::vector<U8>>> passiveDataSegments;
+		// The module's passive data segments, and a bit for each data segment that is set when it is
+		// dropped. Active data segments are dropped when the instance is created. The bits are only
+		// updated atomically, so memory.init and memory.drop don't need to take a lock.
+		std::shared_ptr<const std::vector<SharedBytes>> passiveDataSegments;
+		std::vector<std::atomic<U64>> droppedDataSegmentBits;
 
 		Platform::Mutex passiveTableSegmentsMutex;
 		HashMap<Uptr, std::shared_ptr<const std::vector<Object*>>> passiveTableSegments;
 
 		LLVMJIT::LoadedModule* jitModule;
 
+		// The code that was replaced by replaceModuleInstanceCode, which stays loaded until the
+		// instance is destroyed.
+		std::vector<LLVMJIT::LoadedModule*> replacedJITModules;
+
+		// The module whose code the instance's function definitions run: the module it was
+		// instantiated from, or the module passed to the last replaceModuleInstanceCode call.
+		// Snapshots load its code into the compartments they clone the instance into.
+		Module* codeModule;
+
+		// Only set if the module was compiled with tiered or lazy compilation, or with profile
+		// instrumentation.
+		Module* module;
+		std::atomic<Uptr> numTierUpCalls;
+		LLVMJIT::LoadedModule* optimizedTierJITModule;
+
+		// If the module was compiled with lazy compilation, jitModule contains a lazy compile stub
+		// for each function definition, and each group of lazily compiled function definitions is
+		// loaded into a separate LoadedModule. lazyCompileStubs doesn't change after the instance
+		// is created, and lazyCompileMutex serializes compiling function definitions.
+		Platform::Mutex lazyCompileMutex;
+		std::vector<void*> lazyCompileStubs;
+		std::vector<LLVMJIT::LoadedModule*> lazyCompiledJITModules;
+
+		// The compartment's memory budget, and the number of bytes of jitModule's and
+		// replacedJITModules' code and data that were charged to it.
+		std::shared_ptr<CompartmentMemoryBudget> memoryBudget;
+		Uptr numChargedJITModuleBytes;
+
 		std::string debugName;
 
 		ModuleInstance(Compartment* inCompartment,
@@ -242,12 +541,43 @@ namespace WAVM { namespace Runtime {
 		, defaultMemory(nullptr)
 		, defaultTable(nullptr)
 		, jitModule(nullptr)
+		, codeModule(nullptr)
+		, module(nullptr)
+		, numTierUpCalls(0)
+		, optimizedTierJITModule(nullptr)
+		, numChargedJITModuleBytes(0)
 		, debugName(std::move(inDebugName))
 		{
+			moduleInstancesGauge.add(1);
 		}
 
 		virtual ~ModuleInstance() override;
 		virtual void finalize() override;
+
+		bool isDataSegmentDropped(Uptr segmentIndex) const
+		{
+			const U64 bit = U64(1) << (segmentIndex & 63);
+			return (droppedDataSegmentBits[segmentIndex / 64].load(std::memory_order_acquire) & bit)
+				   != 0;
+		}
+
+		// Sets the data segment's dropped bit, and returns whether it was already set.
+		bool dropDataSegment(Uptr segmentIndex)
+		{
+			const U64 bit = U64(1) << (segmentIndex & 63);
+			std::atomic<U64>& bits = droppedDataSegmentBits[segmentIndex / 64];
+			return (bits.fetch_or(bit, std::memory_order_acq_rel) & bit) != 0;
+		}
+	};
+
+	// A ring buffer of the memory accesses sampled in a context.
+	struct MemoryAccessTrace
+	{
+		MemoryAccessTraceConfig config;
+		std::vector<MemoryAccessRecord> records;
+		Uptr numRecords = 0;
+		Uptr nextRecordIndex = 0;
+		U64 numOverwrittenRecords = 0;
 	};
 
 	struct Context : ObjectImplWithAnyRef
@@ -256,6 +586,16 @@ namespace WAVM { namespace Runtime {
 		Uptr id;
 		struct ContextRuntimeData* runtimeData;
 
+		std::function<bool(Context*)> fuelExhaustedHandler;
+
+		// The number of epochs code running in the context may run for before yielding its
+		// suspendable invoke, or zero if reaching the epoch deadline throws instead.
+		U64 epochYieldSlice = 0;
+
+		// The context's memory access trace, if startContextMemoryAccessTrace was called.
+		Platform::Mutex memoryAccessTraceMutex;
+		std::unique_ptr<MemoryAccessTrace> memoryAccessTrace;
+
 		Context(Compartment* inCompartment)
 		: ObjectImplWithAnyRef(ObjectKind::context)
 		, compartment(inCompartment)
@@ -277,6 +617,7 @@ namespace WAVM { namespace Runtime {
 		// These are weak references that aren't followed by the garbage collector.
 		// If the referenced object is deleted, it will remove the reference here.
 		HashSet<ModuleInstance*> modules;
+		HashSet<FunctionInstance*> functions;
 		HashSet<GlobalInstance*> globals;
 		IndexMap<Uptr, MemoryInstance*> memories;
 		IndexMap<Uptr, TableInstance*> tables;
@@ -286,10 +627,62 @@ namespace WAVM { namespace Runtime {
 
 		IR::UntaggedValue initialContextMutableGlobals[maxMutableGlobals];
 
+		// One more than the largest mutable global ID that has been allocated. Only this prefix of
+		// initialContextMutableGlobals is copied into new contexts.
+		U32 numUsedMutableGlobalIds;
+
+		// The number of bytes of runtime data allocated for each context: a whole number of pages
+		// that is large enough to hold the mutable globals allocated when the compartment's first
+		// context was created, or inherited from the compartment this was cloned from. Zero until
+		// then. Once set, mutable globals may only be allocated within this size.
+		Uptr numContextRuntimeDataBytes;
+
+		// The IDs of finalized contexts. Their runtime data pages are left committed, so
+		// createContext reuses them before allocating a new ID.
+		std::vector<Uptr> freeContextIds;
+
+		// The pages committed for the compartment's runtime data, contexts, memories, tables, and
+		// JIT code are charged to this budget.
+		const std::shared_ptr<CompartmentMemoryBudget> memoryBudget;
+
+		ContextRuntimeData* getContextRuntimeData(Uptr contextId) const
+		{
+			wavmAssert(numContextRuntimeDataBytes);
+			return reinterpret_cast<ContextRuntimeData*>(runtimeData->contexts
+														 + contextId * numContextRuntimeDataBytes);
+		}
+
 		ModuleInstance* wavmIntrinsics;
 
-		Compartment();
+		// The code and data of the JIT modules loaded for the compartment's module instances are
+		// allocated from this arena.
+		LLVMJIT::CodeArena* codeArena;
+
+		// Whether to back the pages committed to the compartment's memories and tables with large
+		// pages.
+		const bool useLargePages;
+
+		// The NUMA node to allocate the compartment's memories and tables from, and run the
+		// threads created for the compartment on, or UINTPTR_MAX if the compartment has no
+		// affinity.
+		const Uptr numaNode;
+
+		// Whether codeArena packs the JIT modules into dual-mapped pages.
+		const bool packJITCode;
+
+		// If the compartment was cloned from another compartment, it may reference the functions
+		// and other objects of that compartment. sourceCompartment is the compartment it was cloned
+		// from, and numClonedCompartments counts the compartments that were cloned from this one
+		// and haven't been deleted yet.
+		Compartment* const sourceCompartment;
+		std::atomic<Uptr> numClonedCompartments;
+
+		Compartment(bool inUseLargePages,
+					Uptr inNUMANode,
+					bool inPackJITCode,
+					Compartment* inSourceCompartment = nullptr);
 		~Compartment() override;
+		virtual void finalize() override;
 	};
 
 	DECLARE_INTRINSIC_MODULE(wavmIntrinsics);
@@ -299,9 +692,93 @@ namespace WAVM { namespace Runtime {
 	// Initializes global state used by the WAVM intrinsics.
 	Runtime::ModuleInstance* instantiateWAVMIntrinsics(Compartment* compartment);
 
-	// Checks whether an address is owned by a table or memory.
-	bool isAddressOwnedByTable(U8* address);
-	bool isAddressOwnedByMemory(U8* address);
+	// Maps a snapshot of a memory's initial contents copy-on-write into the memory. The snapshot
+	// must be no larger than the memory. Returns false if the snapshot couldn't be mapped.
+	bool mapMemoryPageSnapshot(MemoryInstance* memory, Platform::VirtualPageSnapshot* snapshot);
+
+	// Returns a memory's address range to the process-wide pool of free address ranges.
+	void addFreeMemoryReservation(U8* baseAddress, Uptr numReservedBytes);
+
+	// Gets the invoke thunk for a function type, from the current runtime shard's cache if the
+	// thread is bound to one.
+	LLVMJIT::InvokeThunkPointer getShardedInvokeThunk(IR::FunctionType functionType,
+													  IR::CallingConvention callingConvention);
+
+	// If the thread is bound to a runtime shard, takes an address range with numReservedBytes
+	// from the shard's pool of free address ranges, or adds an address range to it. Return false
+	// if the thread isn't bound to a shard, or the shard has no such address range.
+	bool takeShardMemoryReservation(Uptr numReservedBytes, U8*& outBaseAddress);
+	bool addShardMemoryReservation(U8* baseAddress, Uptr numReservedBytes);
+
+	// Returns the address ranges pooled by the current runtime shard to the process-wide pool.
+	void releaseShardMemoryReservations();
+
+	// Counts bytes committed to a compartment towards triggering the next background garbage
+	// collection.
+	void addGCAllocatedBytes(Uptr numBytes);
+
+	// Returns the number of bytes committed to all compartments.
+	Uptr getTotalCommittedCompartmentBytes();
+
+	// Returns the flags to commit pages to a memory or table in a compartment with.
+	inline Platform::CommitFlags getCommitFlags(Compartment* compartment)
+	{
+		return compartment->useLargePages ? Platform::CommitFlags::largePages
+										  : Platform::CommitFlags::none;
+	}
+
+	// The number of bytes of address space reserved for a memory by default. Code that isn't
+	// compiled with memory bounds checks may only access memories with this much address space
+	// reserved.
+	static constexpr Uptr fullMemoryNumReservedBytes = Uptr(8ull * 1024 * 1024 * 1024);
+
+	// The number of bytes of address space reserved for a 64-bit memory by default. 64-bit
+	// memories are always accessed with bounds checks, so this only limits their size.
+	static constexpr Uptr fullMemory64NumReservedBytes = Uptr(256ull * 1024 * 1024 * 1024);
+
+	// The kinds of objects that own address ranges.
+	enum class AddressOwnerKind : U8
+	{
+		none,
+		memory,
+		table
+	};
+
+	// Adds a range of addresses owned by a memory or table, and returns an ID that identifies the
+	// range to removeOwnedAddressRange.
+	Uptr addOwnedAddressRange(U8* baseAddress, Uptr numBytes, AddressOwnerKind ownerKind);
+	void removeOwnedAddressRange(Uptr rangeId);
+
+	// Returns the kind of object that owns an address, or AddressOwnerKind::none if it isn't owned
+	// by a memory or table. This doesn't lock any mutex, so it's safe to call while translating a
+	// signal.
+	AddressOwnerKind getAddressOwnerKind(U8* address);
+
+	// Clones a compartment, and adds each global, memory, and table in the original compartment to
+	// outClonedObjects, mapped to its clone. If isLinkedToSource is false, the clone doesn't keep
+	// the original compartment alive, and may not reference any of its objects after it is created:
+	// the caller must replace the clone's references to them.
+	Compartment* cloneCompartment(Compartment* compartment,
+								  HashMap<Object*, Object*>& outClonedObjects,
+								  bool isLinkedToSource = true);
+
+	// Returns the compartment that owns an object, or null if the object may be referenced by all
+	// compartments.
+	Compartment* getOwnerCompartment(Object* object);
+
+	// Instantiates a module like instantiateModule, but if shouldInitializeSegments is false,
+	// doesn't copy the module's active data and table segments into its memories and tables.
+	ModuleInstance* instantiateModuleImpl(Compartment* compartment,
+										  Module* module,
+										  ImportBindings&& imports,
+										  std::string&& moduleDebugName,
+										  bool shouldInitializeSegments);
+
+	// Creates the FunctionInstances for a module's function definitions in a ModuleInstance, loads
+	// their code with the instance's bindings, and charges the code to the memory budget of the
+	// instance's compartment. The instance's imports and its table, memory, global, and exception
+	// type definitions must already be set.
+	void instantiateFunctionDefs(ModuleInstance* moduleInstance, Module* module);
 
 	// Clones a memory or table with the same ID in a new compartment.
 	TableInstance* cloneTable(TableInstance* memory, Compartment* newCompartment);
@@ -310,6 +787,98 @@ namespace WAVM { namespace Runtime {
 	// Clone a global with same ID and mutable data offset (if mutable) in a new compartment.
 	GlobalInstance* cloneGlobal(GlobalInstance* global, Compartment* newCompartment);
 
+	// Returns code that calls a function with the WebAssembly calling convention: the function's
+	// code if it is a WebAssembly function, or else a thunk that calls it.
+	void* getWASMCallableCode(const FunctionInstance* function);
+
+	// Replaces the elements of a table that are keys in the replacement map with the corresponding
+	// values.
+	void replaceTableElements(TableInstance* table,
+							  const HashMap<const AnyReferee*, const AnyReferee*>& replacements);
+
+	// Writes a contiguous range of table elements starting at baseIndex, as an active elem segment
+	// initializes them. If the range extends past the end of the table, the elements within the
+	// table are written before throwing a tableIndexOutOfBounds exception.
+	void initTableElements(TableInstance* table,
+						   Uptr baseIndex,
+						   const std::vector<const AnyReferee*>& values);
+
+	// Returns the value that is stored in a table element to refer to an AnyReferee, or to null.
+	Uptr getBiasedTableElementValue(TableInstance* table, const AnyReferee* anyRef);
+
+	// Like initTableElements, but writes values that were already translated by
+	// getBiasedTableElementValue, so they can be copied to the table in bulk.
+	void initTableElementsBiased(TableInstance* table,
+								 Uptr baseIndex,
+								 const Uptr* biasedValues,
+								 Uptr numValues);
+
+	// Counts a call to a function in a module instance compiled with tiered compilation, and starts
+	// compiling the optimized tier of the module if the instance has become hot.
+	void sampleTierUpCall(ModuleInstance* moduleInstance);
+
+	// Returns the mutex that is locked while garbage is collected. Unrooted objects aren't freed
+	// while it is locked, so objects found through a table that doesn't root them (e.g. the shared
+	// modules) can be returned to a caller that will root them.
+	Platform::Mutex& getGarbageCollectionMutex();
+
+	// Like compileModule, but reports the compile's progress to a monitor, which may cancel it.
+	// Returns null if the compile was cancelled.
+	Module* compileModuleWithMonitor(const IR::Module& irModule,
+									 const CompileOptions& options,
+									 LLVMJIT::CompileMonitor* monitor);
+
+	// Queues a task to run on the background compile threads, which run the most urgent queued
+	// tasks first, and no more than setMaxAsyncCompileThreads tasks at once.
+	void queueCompileTask(CompilePriority priority, std::function<void()>&& task);
+
+	// Called between the partitions of a compile: if the calling thread is a background compile
+	// thread and a more urgent task is waiting for a thread, gives up the thread's place among the
+	// running tasks until the more urgent tasks have started.
+	void yieldCompileThread(CompilePriority priority);
+
 	TableInstance* getTableFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr tableId);
 	MemoryInstance* getMemoryFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr memoryId);
+
+	// Serializes a module profile in the form returned by getModuleProfile.
+	std::vector<U8> serializeModuleProfile(const LLVMJIT::ModuleProfile& profile);
+
+	// Computes the object cache key for a module from its binary encoding, its feature spec, the
+	// options it is compiled with, and a description of the compiler and target machine.
+	ObjectCacheKey getObjectCacheKey(const IR::Module& irModule,
+									 const LLVMJIT::CompileOptions& compileOptions);
+
+	// Appends the key material for a feature spec, the options code is compiled with, and a
+	// description of the compiler and target machine to keyBytes.
+	void appendCompileOptionsKeyBytes(std::vector<U8>& keyBytes,
+									  const IR::FeatureSpec& featureSpec,
+									  const LLVMJIT::CompileOptions& compileOptions);
+
+	// Hashes arbitrary key material to an object cache key.
+	ObjectCacheKey getObjectCacheKey(const std::vector<U8>& keyBytes);
+
+	// Compiles a module's object code, reusing the object code of the partitions of its function
+	// definitions that are unchanged since previousObjectCode was compiled by this function, as
+	// described by previousManifest. Writes the manifest of the new object code to outManifest.
+	// The options must not have target versions or profile instrumentation.
+	std::vector<U8> compileObjectCodeIncrementally(const IR::Module& irModule,
+												   const LLVMJIT::CompileOptions& compileOptions,
+												   const std::vector<U8>& previousObjectCode,
+												   const std::vector<U8>& previousManifest,
+												   std::vector<U8>& outManifest);
+
+	// Loads object code from the object cache in a directory if it isn't empty, or else from the
+	// host's object cache if it isn't null. Object code loaded from the host's cache is also saved
+	// to the directory. Returns false if neither contains valid object code for the key.
+	bool loadCachedObjectCode(const std::string& cacheDirectory,
+							  ObjectCache* objectCache,
+							  const ObjectCacheKey& key,
+							  std::vector<U8>& outObjectCode);
+
+	// Saves object code to the object cache in a directory if it isn't empty, and to the host's
+	// object cache if it isn't null. Failures are ignored.
+	void saveCachedObjectCode(const std::string& cacheDirectory,
+							  ObjectCache* objectCache,
+							  const ObjectCacheKey& key,
+							  const std::vector<U8>& objectCode);
 }}
@@ -0,0 +1,212 @@
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Diagnostics.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// The signal handler that samples a call stack can't allocate memory or take locks, so it copies
+// the call stack's frame addresses into one of a fixed set of slots. A background thread
+// periodically symbolizes the call stacks in the slots, and frees the slots for more samples.
+struct SampleSlot
+{
+	enum : U32
+	{
+		free,
+		writing,
+		ready
+	};
+	std::atomic<U32> state{free};
+	Uptr numFrames;
+	Uptr frameAddresses[Platform::maxSampledCallStackFrames];
+};
+
+enum
+{
+	numSampleSlots = 1024,
+	symbolizerPeriodMicroseconds = 10000,
+	symbolizerThreadStackBytes = 1024 * 1024
+};
+
+// The slots are allocated by the first call to startGuestCallStackSampling, and never freed, since
+// a sample may still be written by the signal handler on another thread after sampling stops.
+static std::atomic<SampleSlot*> sampleSlots{nullptr};
+static std::atomic<Uptr> nextSampleSlotIndex{0};
+static std::atomic<U64> numDroppedSamples{0};
+
+// The state of the symbolizer thread, protected by samplingMutex.
+static Platform::Mutex samplingMutex;
+static Platform::Thread* symbolizerThread = nullptr;
+static std::atomic<bool> stopSymbolizer{false};
+static Platform::Event symbolizerStopEvent;
+
+// The call stacks that have been symbolized, protected by sampledCallStacksMutex. The call stacks
+// are indexed by their function names, joined by ';'.
+static Platform::Mutex sampledCallStacksMutex;
+static std::vector<SampledCallStack> sampledCallStacks;
+static HashMap<std::string, Uptr> foldedCallStackToIndexMap;
+
+static void sampleCallStack(const Uptr* frameAddresses, Uptr numFrames)
+{
+	SampleSlot* slots = sampleSlots.load(std::memory_order_acquire);
+	SampleSlot& slot
+		= slots[nextSampleSlotIndex.fetch_add(1, std::memory_order_relaxed) % numSampleSlots];
+
+	// If the symbolizer hasn't freed the slot since it was last written, drop the sample.
+	U32 expectedState = SampleSlot::free;
+	if(!slot.state.compare_exchange_strong(
+		   expectedState, SampleSlot::writing, std::memory_order_acquire))
+	{
+		numDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	slot.numFrames = numFrames;
+	for(Uptr frameIndex = 0; frameIndex < numFrames; ++frameIndex)
+	{ slot.frameAddresses[frameIndex] = frameAddresses[frameIndex]; }
+	slot.state.store(SampleSlot::ready, std::memory_order_release);
+}
+
+static void symbolizeSamples()
+{
+	SampleSlot* slots = sampleSlots.load(std::memory_order_acquire);
+	wavmAssert(slots);
+
+	std::vector<std::string> functionNames;
+	for(Uptr slotIndex = 0; slotIndex < numSampleSlots; ++slotIndex)
+	{
+		SampleSlot& slot = slots[slotIndex];
+		if(slot.state.load(std::memory_order_acquire) != SampleSlot::ready) { continue; }
+
+		// Map the frame addresses to the WebAssembly functions containing them, innermost first.
+		// A return address points after its call, which may be the start of the next function if
+		// the call doesn't return, so look up the address before it.
+		functionNames.clear();
+		bool isInnermostFrameWASM = false;
+		for(Uptr frameIndex = 0; frameIndex < slot.numFrames; ++frameIndex)
+		{
+			const Uptr address = slot.frameAddresses[frameIndex] - (frameIndex ? 1 : 0);
+			LLVMJIT::JITFunction* jitFunction = LLVMJIT::getJITFunctionByAddress(address);
+			if(!jitFunction || jitFunction->type != LLVMJIT::JITFunction::Type::wasmFunction)
+			{ continue; }
+
+			const FunctionInstance* functionInstance = jitFunction->functionInstance;
+			std::string functionName = functionInstance->moduleInstance
+										   ? functionInstance->moduleInstance->debugName + '!'
+										   : std::string();
+			functionName += functionInstance->debugName;
+			functionNames.push_back(std::move(functionName));
+			if(!frameIndex) { isInnermostFrameWASM = true; }
+		}
+		slot.state.store(SampleSlot::free, std::memory_order_release);
+
+		// Ignore samples of threads that weren't running WebAssembly code.
+		if(!functionNames.size()) { continue; }
+		if(!isInnermostFrameWASM) { functionNames.insert(functionNames.begin(), "[host]"); }
+
+		std::string foldedCallStack;
+		for(auto nameIt = functionNames.rbegin(); nameIt != functionNames.rend(); ++nameIt)
+		{
+			if(foldedCallStack.size()) { foldedCallStack += ';'; }
+			foldedCallStack += *nameIt;
+		}
+
+		Lock<Platform::Mutex> sampledCallStacksLock(sampledCallStacksMutex);
+		Uptr& callStackIndex
+			= foldedCallStackToIndexMap.getOrAdd(std::move(foldedCallStack), UINTPTR_MAX);
+		if(callStackIndex == UINTPTR_MAX)
+		{
+			callStackIndex = sampledCallStacks.size();
+			sampledCallStacks.push_back(
+				{std::vector<std::string>(functionNames.rbegin(), functionNames.rend()), 0});
+		}
+		++sampledCallStacks[callStackIndex].numSamples;
+	}
+}
+
+static I64 symbolizerThreadEntry(void*)
+{
+	while(true)
+	{
+		const U64 nextSymbolizeClock = Platform::getMonotonicClock() + symbolizerPeriodMicroseconds;
+
+		// Wait until it's time to symbolize the samples again, or until stopGuestCallStackSampling
+		// signals the event. The event may be signaled spuriously, or before this thread waits on
+		// it, so recheck both conditions.
+		while(!stopSymbolizer.load(std::memory_order_acquire)
+			  && Platform::getMonotonicClock() < nextSymbolizeClock)
+		{ symbolizerStopEvent.wait(nextSymbolizeClock); }
+		if(stopSymbolizer.load(std::memory_order_acquire)) { return 0; }
+
+		symbolizeSamples();
+	}
+}
+
+bool Runtime::startGuestCallStackSampling(Uptr samplesPerSecond)
+{
+	wavmAssert(samplesPerSecond > 0);
+
+	Lock<Platform::Mutex> samplingLock(samplingMutex);
+	if(!symbolizerThread)
+	{
+		if(!sampleSlots.load(std::memory_order_acquire))
+		{ sampleSlots.store(new SampleSlot[numSampleSlots], std::memory_order_release); }
+
+		{
+			Lock<Platform::Mutex> sampledCallStacksLock(sampledCallStacksMutex);
+			sampledCallStacks.clear();
+			foldedCallStackToIndexMap = HashMap<std::string, Uptr>();
+			numDroppedSamples.store(0, std::memory_order_relaxed);
+		}
+
+		stopSymbolizer.store(false, std::memory_order_release);
+		symbolizerThread
+			= Platform::createThread(symbolizerThreadStackBytes, symbolizerThreadEntry, nullptr);
+	}
+
+	if(!Platform::startCallStackSampling(samplesPerSecond, sampleCallStack))
+	{
+		stopSymbolizer.store(true, std::memory_order_release);
+		symbolizerStopEvent.signal();
+		Platform::joinThread(symbolizerThread);
+		symbolizerThread = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void Runtime::stopGuestCallStackSampling()
+{
+	Lock<Platform::Mutex> samplingLock(samplingMutex);
+	if(symbolizerThread)
+	{
+		Platform::stopCallStackSampling();
+
+		stopSymbolizer.store(true, std::memory_order_release);
+		symbolizerStopEvent.signal();
+		Platform::joinThread(symbolizerThread);
+		symbolizerThread = nullptr;
+
+		// Symbolize the samples that were taken since the symbolizer thread last ran.
+		symbolizeSamples();
+	}
+}
+
+std::vector<SampledCallStack> Runtime::getSampledGuestCallStacks(U64& outNumDroppedSamples)
+{
+	Lock<Platform::Mutex> sampledCallStacksLock(sampledCallStacksMutex);
+	outNumDroppedSamples = numDroppedSamples.load(std::memory_order_relaxed);
+	return sampledCallStacks;
+}
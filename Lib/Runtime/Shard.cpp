@@ -0,0 +1,142 @@
+#include <atomic>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+struct ShardInvokeThunkKey
+{
+	FunctionType functionType;
+	IR::CallingConvention callingConvention;
+
+	friend bool operator==(const ShardInvokeThunkKey& left, const ShardInvokeThunkKey& right)
+	{
+		return left.functionType == right.functionType
+			   && left.callingConvention == right.callingConvention;
+	}
+};
+
+template<> struct WAVM::Hash<ShardInvokeThunkKey>
+{
+	Uptr operator()(const ShardInvokeThunkKey& key, Uptr seed = 0) const
+	{
+		const Uptr functionTypeHash = WAVM::Hash<FunctionType>()(key.functionType, seed);
+		return WAVM::Hash<Uptr>()(Uptr(key.callingConvention), functionTypeHash);
+	}
+};
+
+// The shard's mutex is only locked by the threads bound to the shard, so threads bound to different
+// shards don't contend for it.
+struct Runtime::RuntimeShard
+{
+	Platform::Mutex mutex;
+	HashMap<ShardInvokeThunkKey, LLVMJIT::InvokeThunkPointer> invokeThunks;
+
+	struct FreeReservation
+	{
+		U8* baseAddress;
+		Uptr numReservedBytes;
+	};
+	std::vector<FreeReservation> freeReservations;
+
+	std::atomic<Uptr> numBoundThreads{0};
+};
+
+static thread_local RuntimeShard* currentShard = nullptr;
+
+RuntimeShard* Runtime::createRuntimeShard() { return new RuntimeShard; }
+
+void Runtime::destroyRuntimeShard(RuntimeShard* shard)
+{
+	wavmAssert(!shard->numBoundThreads.load(std::memory_order_acquire));
+	for(const RuntimeShard::FreeReservation& reservation : shard->freeReservations)
+	{ addFreeMemoryReservation(reservation.baseAddress, reservation.numReservedBytes); }
+	delete shard;
+}
+
+void Runtime::setCurrentRuntimeShard(RuntimeShard* shard)
+{
+	if(currentShard) { currentShard->numBoundThreads.fetch_sub(1, std::memory_order_release); }
+	currentShard = shard;
+	if(shard) { shard->numBoundThreads.fetch_add(1, std::memory_order_acquire); }
+}
+
+RuntimeShard* Runtime::getCurrentRuntimeShard() { return currentShard; }
+
+LLVMJIT::InvokeThunkPointer Runtime::getShardedInvokeThunk(FunctionType functionType,
+														   IR::CallingConvention callingConvention)
+{
+	RuntimeShard* shard = currentShard;
+	if(!shard) { return LLVMJIT::getInvokeThunk(functionType, callingConvention); }
+
+	const ShardInvokeThunkKey key{functionType, callingConvention};
+	{
+		Lock<Platform::Mutex> shardLock(shard->mutex);
+		if(const LLVMJIT::InvokeThunkPointer* invokeThunk = shard->invokeThunks.get(key))
+		{ return *invokeThunk; }
+	}
+
+	// Get the thunk from the process-wide cache without holding the shard's lock, since it may
+	// need to compile the thunk.
+	LLVMJIT::InvokeThunkPointer invokeThunk
+		= LLVMJIT::getInvokeThunk(functionType, callingConvention);
+
+	Lock<Platform::Mutex> shardLock(shard->mutex);
+	shard->invokeThunks.set(key, invokeThunk);
+	return invokeThunk;
+}
+
+bool Runtime::takeShardMemoryReservation(Uptr numReservedBytes, U8*& outBaseAddress)
+{
+	RuntimeShard* shard = currentShard;
+	if(!shard) { return false; }
+
+	Lock<Platform::Mutex> shardLock(shard->mutex);
+	for(Uptr freeIndex = 0; freeIndex < shard->freeReservations.size(); ++freeIndex)
+	{
+		if(shard->freeReservations[freeIndex].numReservedBytes == numReservedBytes)
+		{
+			outBaseAddress = shard->freeReservations[freeIndex].baseAddress;
+			shard->freeReservations.erase(shard->freeReservations.begin() + freeIndex);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Runtime::addShardMemoryReservation(U8* baseAddress, Uptr numReservedBytes)
+{
+	RuntimeShard* shard = currentShard;
+	if(!shard) { return false; }
+
+	Lock<Platform::Mutex> shardLock(shard->mutex);
+	shard->freeReservations.push_back({baseAddress, numReservedBytes});
+	return true;
+}
+
+void Runtime::releaseShardMemoryReservations()
+{
+	RuntimeShard* shard = currentShard;
+	if(!shard) { return; }
+
+	std::vector<RuntimeShard::FreeReservation> freeReservations;
+	{
+		Lock<Platform::Mutex> shardLock(shard->mutex);
+		freeReservations = std::move(shard->freeReservations);
+		shard->freeReservations.clear();
+	}
+	for(const RuntimeShard::FreeReservation& reservation : freeReservations)
+	{ addFreeMemoryReservation(reservation.baseAddress, reservation.numReservedBytes); }
+}
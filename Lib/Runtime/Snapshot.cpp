@@ -0,0 +1,659 @@
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/HashSet.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+struct Runtime::ModuleInstanceSnapshot
+{
+	GCPointer<Compartment> compartment;
+	GCPointer<Context> context;
+	GCPointer<ModuleInstance> moduleInstance;
+};
+
+template<typename ObjectType>
+static std::vector<ObjectType*> remapObjects(const std::vector<ObjectType*>& objects,
+											 const HashMap<Object*, Object*>& clonedObjects)
+{
+	std::vector<ObjectType*> result;
+	for(ObjectType* object : objects)
+	{
+		Object* const* clonedObject = clonedObjects.get(asObject(object));
+		result.push_back(clonedObject ? as<ObjectType>(*clonedObject) : object);
+	}
+	return result;
+}
+
+// Returns whether a clone of a ModuleInstance's compartment can be independent of the compartment:
+// whether the only objects in the compartment that the instance, the context, and the
+// compartment's tables and globals reference are the compartment's tables, memories, and globals,
+// which are cloned with it, and the instance's function definitions, which are cloned by
+// cloneModuleInstance.
+static bool canCloneIndependently(ModuleInstance* moduleInstance, Context* context)
+{
+	Compartment* compartment = moduleInstance->compartment;
+
+	HashSet<Object*> functionDefs;
+	for(FunctionInstance* functionDef : moduleInstance->functionDefs)
+	{ functionDefs.add(functionDef); }
+	auto isCloned = [compartment, &functionDefs](Object* object) {
+		if(!object || functionDefs.contains(object)) { return true; }
+		if(getOwnerCompartment(object) != compartment) { return !getOwnerCompartment(object); }
+		return object->kind == ObjectKind::table || object->kind == ObjectKind::memory
+			   || object->kind == ObjectKind::global;
+	};
+	auto isClonedAnyRef
+		= [&isCloned](const AnyReferee* anyRef) { return !anyRef || isCloned(anyRef->object); };
+
+	for(FunctionInstance* function : moduleInstance->functions)
+	{
+		if(!isCloned(function)) { return false; }
+	}
+	for(Object* exportedObject : moduleInstance->exports)
+	{
+		if(!isCloned(exportedObject)) { return false; }
+	}
+	{
+		Lock<Platform::Mutex> passiveTableSegmentsLock(moduleInstance->passiveTableSegmentsMutex);
+		for(const auto& segmentPair : moduleInstance->passiveTableSegments)
+		{
+			for(Object* object : *segmentPair.value)
+			{
+				if(!isCloned(object)) { return false; }
+			}
+		}
+	}
+
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	for(TableInstance* table : compartment->tables)
+	{
+		const Uptr numElements = getTableNumElements(table);
+		for(Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex)
+		{
+			if(!isClonedAnyRef(getTableElement(table, elementIndex))) { return false; }
+		}
+	}
+	for(GlobalInstance* global : compartment->globals)
+	{
+		if(!isReferenceType(global->type.valueType)) { continue; }
+		if(!global->type.isMutable)
+		{
+			// The values of immutable globals can't be replaced in their clones.
+			const AnyReferee* anyRef = global->initialValue.anyRef;
+			if(anyRef && getOwnerCompartment(anyRef->object)) { return false; }
+		}
+		else if(!isClonedAnyRef(
+					compartment->initialContextMutableGlobals[global->mutableGlobalId].anyRef)
+				|| !isClonedAnyRef(
+					context->runtimeData->mutableGlobals[global->mutableGlobalId].anyRef))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Creates a ModuleInstance in a cloned compartment that refers to the clones of the original
+// ModuleInstance's tables, memories, and globals, with its own function definitions that run the
+// original's code. The original's function definitions are mapped to the clone's in
+// outClonedObjects, and the anyrefs to them in outAnyRefReplacements.
+static ModuleInstance* cloneModuleInstance(
+	ModuleInstance* moduleInstance,
+	Compartment* newCompartment,
+	HashMap<Object*, Object*>& outClonedObjects,
+	HashMap<const AnyReferee*, const AnyReferee*>& outAnyRefReplacements)
+{
+	errorUnless(moduleInstance->codeModule);
+
+	auto remapObject = [&outClonedObjects](Object* object) -> Object* {
+		Object* const* clonedObject = object ? outClonedObjects.get(object) : nullptr;
+		return clonedObject ? *clonedObject : object;
+	};
+
+	const Uptr numFunctionImports
+		= moduleInstance->functions.size() - moduleInstance->functionDefs.size();
+	ModuleInstance* newModuleInstance = new ModuleInstance(
+		newCompartment,
+		std::vector<FunctionInstance*>(moduleInstance->functions.begin(),
+									   moduleInstance->functions.begin() + numFunctionImports),
+		remapObjects(moduleInstance->tables, outClonedObjects),
+		remapObjects(moduleInstance->memories, outClonedObjects),
+		remapObjects(moduleInstance->globals, outClonedObjects),
+		std::vector<ExceptionTypeInstance*>(moduleInstance->exceptionTypes),
+		std::string(moduleInstance->debugName));
+	{
+		Lock<Platform::Mutex> compartmentLock(newCompartment->mutex);
+		newCompartment->modules.addOrFail(newModuleInstance);
+	}
+	newModuleInstance->defaultMemory
+		= asMemoryNullable(remapObject(asObject(moduleInstance->defaultMemory)));
+	newModuleInstance->defaultTable
+		= asTableNullable(remapObject(asObject(moduleInstance->defaultTable)));
+
+	// Load the original's code for the clone's function definitions, bound to the clone's objects.
+	instantiateFunctionDefs(newModuleInstance, moduleInstance->codeModule);
+	for(Uptr functionDefIndex = 0; functionDefIndex < moduleInstance->functionDefs.size();
+		++functionDefIndex)
+	{
+		FunctionInstance* functionDef = moduleInstance->functionDefs[functionDefIndex];
+		FunctionInstance* newFunctionDef = newModuleInstance->functionDefs[functionDefIndex];
+		outClonedObjects.addOrFail(functionDef, newFunctionDef);
+
+		const AnyReferee* newAnyRef = &asAnyFunc(newFunctionDef)->anyRef;
+		outAnyRefReplacements.addOrFail(&asAnyFunc(functionDef)->anyRef, newAnyRef);
+		if(functionDefIndex < moduleInstance->lazyCompileStubs.size())
+		{
+			const AnyFunc* stubAnyFunc
+				= getAnyFuncFromCode(moduleInstance->lazyCompileStubs[functionDefIndex]);
+			outAnyRefReplacements.set(&stubAnyFunc->anyRef, newAnyRef);
+		}
+	}
+
+	newModuleInstance->startFunction
+		= asFunctionNullable(remapObject(asObject(moduleInstance->startFunction)));
+	newModuleInstance->exportIndexTable = moduleInstance->exportIndexTable;
+	newModuleInstance->exportNames = moduleInstance->exportNames;
+	for(Object* exportedObject : moduleInstance->exports)
+	{ newModuleInstance->exports.push_back(remapObject(exportedObject)); }
+
+	newModuleInstance->passiveDataSegments = moduleInstance->passiveDataSegments;
+	newModuleInstance->droppedDataSegmentBits
+		= std::vector<std::atomic<U64>>(moduleInstance->droppedDataSegmentBits.size());
+	for(Uptr wordIndex = 0; wordIndex < moduleInstance->droppedDataSegmentBits.size(); ++wordIndex)
+	{
+		newModuleInstance->droppedDataSegmentBits[wordIndex].store(
+			moduleInstance->droppedDataSegmentBits[wordIndex].load(std::memory_order_acquire),
+			std::memory_order_release);
+	}
+	{
+		Lock<Platform::Mutex> passiveTableSegmentsLock(moduleInstance->passiveTableSegmentsMutex);
+		for(const auto& segmentPair : moduleInstance->passiveTableSegments)
+		{
+			auto newSegmentObjects = std::make_shared<std::vector<Object*>>();
+			for(Object* object : *segmentPair.value)
+			{ newSegmentObjects->push_back(remapObject(object)); }
+			newModuleInstance->passiveTableSegments.add(segmentPair.key, newSegmentObjects);
+		}
+	}
+
+	return newModuleInstance;
+}
+
+// Replaces the anyrefs in a cloned compartment's tables and mutable reference-typed globals, and
+// in a context in it, that refer to the original ModuleInstance's functions with anyrefs to the
+// clone's.
+static void replaceClonedAnyRefs(
+	Compartment* compartment,
+	Context* context,
+	const HashMap<const AnyReferee*, const AnyReferee*>& anyRefReplacements)
+{
+	auto replaceAnyRef = [&anyRefReplacements](const AnyReferee*& anyRef) {
+		const AnyReferee* const* replacement = anyRef ? anyRefReplacements.get(anyRef) : nullptr;
+		if(replacement) { anyRef = *replacement; }
+	};
+
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	for(TableInstance* table : compartment->tables)
+	{ replaceTableElements(table, anyRefReplacements); }
+	for(GlobalInstance* global : compartment->globals)
+	{
+		if(!global->type.isMutable || !isReferenceType(global->type.valueType)) { continue; }
+		replaceAnyRef(compartment->initialContextMutableGlobals[global->mutableGlobalId].anyRef);
+		replaceAnyRef(context->runtimeData->mutableGlobals[global->mutableGlobalId].anyRef);
+	}
+}
+
+// Clones a compartment, and the context and ModuleInstance in it. If nothing else in the
+// compartment is referenced by the clones, the cloned compartment doesn't keep the original
+// compartment alive.
+static void cloneModuleInstanceAndCompartment(ModuleInstance* moduleInstance,
+											  Context* context,
+											  Compartment*& outCompartment,
+											  Context*& outContext,
+											  ModuleInstance*& outModuleInstance)
+{
+	wavmAssert(context->compartment == moduleInstance->compartment);
+
+	HashMap<Object*, Object*> clonedObjects;
+	HashMap<const AnyReferee*, const AnyReferee*> anyRefReplacements;
+	outCompartment = cloneCompartment(moduleInstance->compartment,
+									  clonedObjects,
+									  !canCloneIndependently(moduleInstance, context));
+	outModuleInstance
+		= cloneModuleInstance(moduleInstance, outCompartment, clonedObjects, anyRefReplacements);
+	outContext = cloneContext(context, outCompartment);
+	replaceClonedAnyRefs(outCompartment, outContext, anyRefReplacements);
+}
+
+ModuleInstanceSnapshot* Runtime::createModuleInstanceSnapshot(ModuleInstance* moduleInstance,
+															  Context* context)
+{
+	// Clone the ModuleInstance's compartment, so the snapshot isn't affected by later changes to
+	// the ModuleInstance. Nothing runs in the snapshot's compartment, so its memories' pages stay
+	// unmodified and can be shared copy-on-write by every instance created from the snapshot.
+	Compartment* compartment;
+	Context* snapshotContext;
+	ModuleInstance* snapshotModuleInstance;
+	cloneModuleInstanceAndCompartment(
+		moduleInstance, context, compartment, snapshotContext, snapshotModuleInstance);
+
+	ModuleInstanceSnapshot* snapshot = new ModuleInstanceSnapshot;
+	snapshot->compartment = compartment;
+	snapshot->context = snapshotContext;
+	snapshot->moduleInstance = snapshotModuleInstance;
+	return snapshot;
+}
+
+void Runtime::deleteModuleInstanceSnapshot(ModuleInstanceSnapshot* snapshot) { delete snapshot; }
+
+ModuleInstance* Runtime::instantiateModuleFromSnapshot(ModuleInstanceSnapshot* snapshot,
+													   Compartment*& outCompartment,
+													   Context*& outContext)
+{
+	ModuleInstance* moduleInstance;
+	cloneModuleInstanceAndCompartment(
+		snapshot->moduleInstance, snapshot->context, outCompartment, outContext, moduleInstance);
+	return moduleInstance;
+}
+
+// The version of the snapshot file format. The file starts with a U64 number of bytes of
+// serialized metadata, followed by the metadata. The contents of each memory the module defines
+// follow the metadata in order, starting at the next multiple of IR::numBytesPerPage, so they can
+// be mapped into the memory's pages.
+static constexpr U32 snapshotFileVersion = 1;
+
+// The state of an instance that a snapshot file records.
+struct SnapshotFileMetadata
+{
+	std::vector<U8> objectCode;
+	std::vector<U64> memoryDefNumPages;
+
+	// The elements of each table the module defines: zero for null, or one more than the index of
+	// the function the element refers to.
+	std::vector<std::vector<U64>> tableDefElements;
+
+	// The values of the mutable globals the module defines, in order. Reference values are
+	// recorded like table elements, as a function index plus one in the value's u64.
+	std::vector<IR::UntaggedValue> mutableGlobalDefValues;
+
+	std::vector<U64> passiveDataSegmentIndices;
+	std::vector<U64> passiveTableSegmentIndices;
+};
+
+template<typename Stream>
+static void serializeIndices(Stream& stream, std::vector<U64>& indices)
+{
+	U64 numIndices = indices.size();
+	Serialization::serializeVarUInt64(stream, numIndices);
+	if(Stream::isInput) { indices.resize(Uptr(numIndices)); }
+	for(U64& index : indices) { Serialization::serializeVarUInt64(stream, index); }
+}
+
+template<typename Stream>
+static void serializeSnapshotMetadata(Stream& stream, SnapshotFileMetadata& metadata)
+{
+	U32 version = snapshotFileVersion;
+	Serialization::serialize(stream, version);
+	if(version != snapshotFileVersion)
+	{ throw Serialization::FatalSerializationException("unsupported snapshot version"); }
+
+	U64 numObjectCodeBytes = metadata.objectCode.size();
+	Serialization::serializeVarUInt64(stream, numObjectCodeBytes);
+	if(Stream::isInput)
+	{
+		// Advance the stream before resizing the vector, so malformed input causes a serialization
+		// exception instead of a huge allocation.
+		const U8* objectCodeBytes = stream.advance(Uptr(numObjectCodeBytes));
+		metadata.objectCode.assign(objectCodeBytes, objectCodeBytes + numObjectCodeBytes);
+	}
+	else
+	{
+		Serialization::serializeBytes(
+			stream, metadata.objectCode.data(), metadata.objectCode.size());
+	}
+
+	serializeIndices(stream, metadata.memoryDefNumPages);
+
+	U64 numTableDefs = metadata.tableDefElements.size();
+	Serialization::serializeVarUInt64(stream, numTableDefs);
+	if(Stream::isInput) { metadata.tableDefElements.resize(Uptr(numTableDefs)); }
+	for(std::vector<U64>& elements : metadata.tableDefElements)
+	{ serializeIndices(stream, elements); }
+
+	U64 numMutableGlobalDefs = metadata.mutableGlobalDefValues.size();
+	Serialization::serializeVarUInt64(stream, numMutableGlobalDefs);
+	if(Stream::isInput) { metadata.mutableGlobalDefValues.resize(Uptr(numMutableGlobalDefs)); }
+	for(IR::UntaggedValue& value : metadata.mutableGlobalDefValues)
+	{ Serialization::serializeBytes(stream, value.bytes, sizeof(value.bytes)); }
+
+	serializeIndices(stream, metadata.passiveDataSegmentIndices);
+	serializeIndices(stream, metadata.passiveTableSegmentIndices);
+}
+
+// Maps a reference to one of a ModuleInstance's functions to one more than the function's index,
+// or null to zero. Returns false if the reference is to an object that isn't one of the
+// ModuleInstance's functions.
+static bool getFunctionReferenceIndex(const HashMap<Object*, Uptr>& functionIndices,
+									  const AnyReferee* anyRef,
+									  U64& outIndex)
+{
+	if(!anyRef || !anyRef->object)
+	{
+		outIndex = 0;
+		return true;
+	}
+
+	const Uptr* functionIndex = functionIndices.get(anyRef->object);
+	if(!functionIndex) { return false; }
+	outIndex = U64(*functionIndex) + 1;
+	return true;
+}
+
+// The inverse of getFunctionReferenceIndex. Returns false if the index isn't valid.
+static bool getFunctionReference(ModuleInstance* moduleInstance,
+								 U64 index,
+								 const AnyReferee*& outAnyRef)
+{
+	if(index > moduleInstance->functions.size()) { return false; }
+	outAnyRef = index ? &asAnyFunc(moduleInstance->functions[Uptr(index - 1)])->anyRef : nullptr;
+	return true;
+}
+
+static U64 getSnapshotMemoriesFileOffset(U64 numMetadataBytes)
+{
+	const U64 pageMask = IR::numBytesPerPage - 1;
+	return (sizeof(U64) + numMetadataBytes + pageMask) & ~pageMask;
+}
+
+static bool isZeroPage(const U8* page)
+{
+	const U64* pageWords = (const U64*)page;
+	for(Uptr wordIndex = 0; wordIndex < IR::numBytesPerPage / sizeof(U64); ++wordIndex)
+	{
+		if(pageWords[wordIndex]) { return false; }
+	}
+	return true;
+}
+
+bool Runtime::saveModuleInstanceSnapshot(Module* module,
+										 ModuleInstance* moduleInstance,
+										 Context* context,
+										 Platform::File* file)
+{
+	errorUnless(context->compartment == moduleInstance->compartment);
+	const IR::Module& irModule = module->ir;
+	wavmAssert(moduleInstance->functions.size() == irModule.functions.size());
+
+	SnapshotFileMetadata metadata;
+	metadata.objectCode = getObjectCode(module);
+
+	HashMap<Object*, Uptr> functionIndices;
+	for(Uptr functionIndex = 0; functionIndex < moduleInstance->functions.size(); ++functionIndex)
+	{ functionIndices.set(moduleInstance->functions[functionIndex], functionIndex); }
+
+	std::vector<MemoryInstance*> memoryDefs;
+	for(Uptr memoryDefIndex = 0; memoryDefIndex < irModule.memories.defs.size(); ++memoryDefIndex)
+	{
+		MemoryInstance* memory
+			= moduleInstance->memories[irModule.memories.imports.size() + memoryDefIndex];
+		memoryDefs.push_back(memory);
+		metadata.memoryDefNumPages.push_back(getMemoryNumPages(memory));
+	}
+
+	for(Uptr tableDefIndex = 0; tableDefIndex < irModule.tables.defs.size(); ++tableDefIndex)
+	{
+		TableInstance* table
+			= moduleInstance->tables[irModule.tables.imports.size() + tableDefIndex];
+		std::vector<U64> elements;
+		const Uptr numElements = getTableNumElements(table);
+		for(Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex)
+		{
+			U64 functionReferenceIndex = 0;
+			if(!getFunctionReferenceIndex(
+				   functionIndices, getTableElement(table, elementIndex), functionReferenceIndex))
+			{ return false; }
+			elements.push_back(functionReferenceIndex);
+		}
+		metadata.tableDefElements.push_back(std::move(elements));
+	}
+
+	for(Uptr globalDefIndex = 0; globalDefIndex < irModule.globals.defs.size(); ++globalDefIndex)
+	{
+		GlobalInstance* global
+			= moduleInstance->globals[irModule.globals.imports.size() + globalDefIndex];
+		if(!global->type.isMutable) { continue; }
+
+		IR::UntaggedValue value = getGlobalValue(context, global);
+		if(isReferenceType(global->type.valueType))
+		{
+			U64 functionReferenceIndex = 0;
+			if(!getFunctionReferenceIndex(functionIndices, value.anyRef, functionReferenceIndex))
+			{ return false; }
+			value = IR::UntaggedValue(functionReferenceIndex);
+		}
+		metadata.mutableGlobalDefValues.push_back(value);
+	}
+
+	for(Uptr segmentIndex = 0; segmentIndex < moduleInstance->passiveDataSegments->size();
+		++segmentIndex)
+	{
+		if(!moduleInstance->isDataSegmentDropped(segmentIndex))
+		{ metadata.passiveDataSegmentIndices.push_back(segmentIndex); }
+	}
+	{
+		Lock<Platform::Mutex> passiveTableSegmentsLock(moduleInstance->passiveTableSegmentsMutex);
+		for(const auto& segmentPair : moduleInstance->passiveTableSegments)
+		{ metadata.passiveTableSegmentIndices.push_back(segmentPair.key); }
+	}
+
+	Serialization::ArrayOutputStream stream;
+	serializeSnapshotMetadata(stream, metadata);
+	std::vector<U8> metadataBytes = stream.getBytes();
+
+	// Write the metadata to the start of the file.
+	U64 numMetadataBytes = metadataBytes.size();
+	if(!Platform::seekFile(file, 0, Platform::FileSeekOrigin::begin)
+	   || !Platform::writeFile(file, &numMetadataBytes, sizeof(numMetadataBytes))
+	   || !Platform::writeFile(file, metadataBytes.data(), metadataBytes.size()))
+	{ return false; }
+
+	// Write the contents of the memories, skipping the pages that are all zeroes so they don't use
+	// any space in file systems that support sparse files.
+	U64 fileOffset = getSnapshotMemoriesFileOffset(numMetadataBytes);
+	for(MemoryInstance* memory : memoryDefs)
+	{
+		const U8* baseAddress = getMemoryBaseAddress(memory);
+		const Uptr numPages = getMemoryNumPages(memory);
+		for(Uptr pageIndex = 0; pageIndex < numPages; ++pageIndex)
+		{
+			const U8* page = baseAddress + pageIndex * IR::numBytesPerPage;
+			if(!isZeroPage(page))
+			{
+				if(!Platform::seekFile(file,
+									   I64(fileOffset + pageIndex * IR::numBytesPerPage),
+									   Platform::FileSeekOrigin::begin)
+				   || !Platform::writeFile(file, page, IR::numBytesPerPage))
+				{ return false; }
+			}
+		}
+		fileOffset += U64(numPages) * IR::numBytesPerPage;
+	}
+
+	return Platform::setFileNumBytes(file, fileOffset) && Platform::flushFileWrites(file);
+}
+
+ModuleInstance* Runtime::loadModuleInstanceSnapshot(Compartment* compartment,
+													Context* context,
+													const IR::Module& irModule,
+													Platform::File* file,
+													ImportBindings&& imports,
+													std::string&& debugName)
+{
+	errorUnless(context->compartment == compartment);
+
+	// Read the metadata.
+	U64 numFileBytes = 0;
+	U64 numMetadataBytes = 0;
+	Uptr numBytesRead = 0;
+	if(!Platform::getFileNumBytes(file, numFileBytes) || numFileBytes < sizeof(numMetadataBytes)
+	   || !Platform::seekFile(file, 0, Platform::FileSeekOrigin::begin)
+	   || !Platform::readFile(file, &numMetadataBytes, sizeof(numMetadataBytes), &numBytesRead)
+	   || numBytesRead != sizeof(numMetadataBytes)
+	   || numMetadataBytes > numFileBytes - sizeof(numMetadataBytes))
+	{ return nullptr; }
+
+	std::vector<U8> metadataBytes((Uptr)numMetadataBytes);
+	if(!Platform::readFile(file, metadataBytes.data(), metadataBytes.size(), &numBytesRead)
+	   || numBytesRead != metadataBytes.size())
+	{ return nullptr; }
+
+	SnapshotFileMetadata metadata;
+	try
+	{
+		Serialization::MemoryInputStream stream(metadataBytes.data(), metadataBytes.size());
+		serializeSnapshotMetadata(stream, metadata);
+		if(stream.capacity() != 0) { return nullptr; }
+	}
+	catch(Serialization::FatalSerializationException const&)
+	{
+		return nullptr;
+	}
+
+	// Check that the metadata matches the module.
+	if(metadata.memoryDefNumPages.size() != irModule.memories.defs.size()
+	   || metadata.tableDefElements.size() != irModule.tables.defs.size())
+	{ return nullptr; }
+	Uptr numMutableGlobalDefs = 0;
+	for(const IR::GlobalDef& globalDef : irModule.globals.defs)
+	{
+		if(globalDef.type.isMutable) { ++numMutableGlobalDefs; }
+	}
+	if(metadata.mutableGlobalDefValues.size() != numMutableGlobalDefs) { return nullptr; }
+
+	U64 memoriesFileOffset = getSnapshotMemoriesFileOffset(numMetadataBytes);
+	U64 memoriesEndFileOffset = memoriesFileOffset;
+	if(memoriesFileOffset > numFileBytes) { return nullptr; }
+	for(Uptr memoryDefIndex = 0; memoryDefIndex < irModule.memories.defs.size(); ++memoryDefIndex)
+	{
+		// 64-bit memories may have enough pages for their size in bytes to overflow, so check the
+		// number of pages against the rest of the file before adding it to the end offset.
+		const U64 numPages = metadata.memoryDefNumPages[memoryDefIndex];
+		const U64 maxPages
+			= irModule.memories.defs[memoryDefIndex].type.indexType == IR::IndexType::i64
+				  ? U64(IR::maxMemory64Pages)
+				  : U64(IR::maxMemoryPages);
+		if(numPages > maxPages
+		   || numPages > (numFileBytes - memoriesEndFileOffset) / IR::numBytesPerPage)
+		{ return nullptr; }
+		memoriesEndFileOffset += numPages * IR::numBytesPerPage;
+	}
+
+	// Instantiate the module without copying its segments into its memories and tables: their
+	// contents are replaced by the snapshot's.
+	Module* module = loadPrecompiledModule(irModule, metadata.objectCode);
+	ModuleInstance* moduleInstance = instantiateModuleImpl(
+		compartment, module, std::move(imports), std::move(debugName), false);
+
+	// Map the memories' contents from the file, or read them if they can't be mapped.
+	U64 memoryFileOffset = memoriesFileOffset;
+	for(Uptr memoryDefIndex = 0; memoryDefIndex < irModule.memories.defs.size(); ++memoryDefIndex)
+	{
+		MemoryInstance* memory
+			= moduleInstance->memories[irModule.memories.imports.size() + memoryDefIndex];
+		const Uptr numPages = Uptr(metadata.memoryDefNumPages[memoryDefIndex]);
+		const Uptr numInitialPages = getMemoryNumPages(memory);
+		if(numPages > numInitialPages)
+		{
+			if(growMemory(memory, numPages - numInitialPages) == -1) { return nullptr; }
+		}
+		else if(numPages < numInitialPages)
+		{
+			return nullptr;
+		}
+
+		if(numPages && !mapMemoryFile(memory, 0, numPages, file, memoryFileOffset, false))
+		{
+			const Uptr numBytes = numPages * IR::numBytesPerPage;
+			if(!Platform::seekFile(file, I64(memoryFileOffset), Platform::FileSeekOrigin::begin)
+			   || !Platform::readFile(file, getMemoryBaseAddress(memory), numBytes, &numBytesRead)
+			   || numBytesRead != numBytes)
+			{ return nullptr; }
+		}
+		memoryFileOffset += U64(numPages) * IR::numBytesPerPage;
+	}
+
+	// Restore the tables' elements.
+	for(Uptr tableDefIndex = 0; tableDefIndex < irModule.tables.defs.size(); ++tableDefIndex)
+	{
+		TableInstance* table
+			= moduleInstance->tables[irModule.tables.imports.size() + tableDefIndex];
+		const std::vector<U64>& elements = metadata.tableDefElements[tableDefIndex];
+		const Uptr numInitialElements = getTableNumElements(table);
+		if(elements.size() > numInitialElements)
+		{
+			if(growTable(table, elements.size() - numInitialElements) == -1) { return nullptr; }
+		}
+		else if(elements.size() < numInitialElements)
+		{
+			return nullptr;
+		}
+
+		std::vector<const AnyReferee*> values(elements.size());
+		for(Uptr elementIndex = 0; elementIndex < elements.size(); ++elementIndex)
+		{
+			if(!getFunctionReference(moduleInstance, elements[elementIndex], values[elementIndex]))
+			{ return nullptr; }
+		}
+		initTableElements(table, 0, values);
+	}
+
+	// Restore the mutable globals' values.
+	Uptr mutableGlobalDefIndex = 0;
+	for(Uptr globalDefIndex = 0; globalDefIndex < irModule.globals.defs.size(); ++globalDefIndex)
+	{
+		GlobalInstance* global
+			= moduleInstance->globals[irModule.globals.imports.size() + globalDefIndex];
+		if(!global->type.isMutable) { continue; }
+
+		IR::UntaggedValue value = metadata.mutableGlobalDefValues[mutableGlobalDefIndex++];
+		if(isReferenceType(global->type.valueType))
+		{
+			const AnyReferee* anyRef = nullptr;
+			if(!getFunctionReference(moduleInstance, value.u64, anyRef)) { return nullptr; }
+			value = IR::UntaggedValue(anyRef);
+		}
+		setGlobalValue(context, global, IR::Value(global->type.valueType, value));
+	}
+
+	// Drop the passive segments that were dropped before the snapshot was saved.
+	HashSet<Uptr> passiveDataSegmentIndices;
+	for(U64 segmentIndex : metadata.passiveDataSegmentIndices)
+	{ passiveDataSegmentIndices.add(Uptr(segmentIndex)); }
+	HashSet<Uptr> passiveTableSegmentIndices;
+	for(U64 segmentIndex : metadata.passiveTableSegmentIndices)
+	{ passiveTableSegmentIndices.add(Uptr(segmentIndex)); }
+	for(Uptr segmentIndex = 0; segmentIndex < irModule.dataSegments.size(); ++segmentIndex)
+	{
+		if(!passiveDataSegmentIndices.contains(segmentIndex))
+		{ moduleInstance->dropDataSegment(segmentIndex); }
+	}
+	for(Uptr segmentIndex = 0; segmentIndex < irModule.tableSegments.size(); ++segmentIndex)
+	{
+		if(!passiveTableSegmentIndices.contains(segmentIndex))
+		{ moduleInstance->passiveTableSegments.remove(segmentIndex); }
+	}
+
+	return moduleInstance;
+}
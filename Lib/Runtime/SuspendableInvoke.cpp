@@ -0,0 +1,149 @@
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+struct Runtime::SuspendableInvoke
+{
+	GCPointer<Context> context;
+	GCPointer<FunctionInstance> function;
+	std::vector<Value> arguments;
+
+	Platform::Fiber* fiber = nullptr;
+
+	// The fiber that resumed the invoke, which the invoke switches back to when it is suspended or
+	// done, and the invoke that was running on the thread when it was resumed.
+	Platform::Fiber* resumingFiber = nullptr;
+	SuspendableInvoke* outerInvoke = nullptr;
+
+	SuspendableInvokeState state = SuspendableInvokeState::suspended;
+	bool isStarted = false;
+	bool isCancelling = false;
+	ValueTuple results;
+	Exception exception;
+};
+
+static thread_local SuspendableInvoke* currentInvoke = nullptr;
+
+// Thrown by suspendInvoke when a suspended invoke is resumed to be deleted, to unwind the invoke's
+// stack. It isn't a runtime exception, so it isn't caught by WebAssembly code.
+struct SuspendableInvokeCancellation
+{
+};
+
+static void suspendableInvokeEntry(void* invokeVoid)
+{
+	SuspendableInvoke* invoke = (SuspendableInvoke*)invokeVoid;
+
+	// Runtime exceptions can't unwind past the fiber's entry, so catch them here, and pass them
+	// back to the host through the invoke.
+	try
+	{
+		catchRuntimeExceptions(
+			[invoke] {
+				invoke->results
+					= invokeFunctionChecked(invoke->context, invoke->function, invoke->arguments);
+				invoke->state = SuspendableInvokeState::returned;
+			},
+			[invoke](Exception&& exception) {
+				invoke->exception = std::move(exception);
+				invoke->state = SuspendableInvokeState::threwException;
+			});
+	}
+	catch(SuspendableInvokeCancellation const&)
+	{
+		// The invoke's stack was unwound by deleteSuspendableInvoke, and is left suspended.
+		wavmAssert(invoke->isCancelling);
+	}
+
+	// Switch back to the fiber that resumed the invoke. The invoke's fiber is never resumed.
+	currentInvoke = invoke->outerInvoke;
+	Platform::switchToFiber(invoke->resumingFiber);
+	Errors::unreachable();
+}
+
+SuspendableInvoke* Runtime::createSuspendableInvoke(Context* context,
+													FunctionInstance* function,
+													std::vector<Value>&& arguments,
+													Uptr numStackBytes)
+{
+	SuspendableInvoke* invoke = new SuspendableInvoke;
+	invoke->context = context;
+	invoke->function = function;
+	invoke->arguments = std::move(arguments);
+	invoke->fiber = Platform::createFiber(numStackBytes, suspendableInvokeEntry, invoke);
+	return invoke;
+}
+
+static void switchToInvoke(SuspendableInvoke* invoke)
+{
+	invoke->isStarted = true;
+	invoke->resumingFiber = Platform::getCurrentFiber();
+	invoke->outerInvoke = currentInvoke;
+	currentInvoke = invoke;
+	Platform::switchToFiber(invoke->fiber);
+
+	// The invoke's fiber restores currentInvoke before it switches back to this fiber.
+	wavmAssert(currentInvoke == invoke->outerInvoke);
+}
+
+SuspendableInvokeState Runtime::resumeSuspendableInvoke(SuspendableInvoke* invoke)
+{
+	errorUnless(invoke->state == SuspendableInvokeState::suspended);
+	errorUnless(invoke != currentInvoke);
+
+	switchToInvoke(invoke);
+	return invoke->state;
+}
+
+const ValueTuple& Runtime::getSuspendableInvokeResults(SuspendableInvoke* invoke)
+{
+	errorUnless(invoke->state == SuspendableInvokeState::returned);
+	return invoke->results;
+}
+
+const Exception& Runtime::getSuspendableInvokeException(SuspendableInvoke* invoke)
+{
+	errorUnless(invoke->state == SuspendableInvokeState::threwException);
+	return invoke->exception;
+}
+
+void Runtime::deleteSuspendableInvoke(SuspendableInvoke* invoke)
+{
+	errorUnless(invoke != currentInvoke);
+
+	// If the invoke is suspended in the middle of running, resume it to throw a
+	// SuspendableInvokeCancellation from suspendInvoke, which unwinds its stack: the stack frames
+	// may own GC roots or other resources that must be released before the stack is freed.
+	if(invoke->isStarted && invoke->state == SuspendableInvokeState::suspended)
+	{
+		invoke->isCancelling = true;
+		switchToInvoke(invoke);
+		wavmAssert(invoke->state == SuspendableInvokeState::suspended);
+	}
+
+	Platform::destroyFiber(invoke->fiber);
+	delete invoke;
+}
+
+SuspendableInvoke* Runtime::getCurrentSuspendableInvoke() { return currentInvoke; }
+
+void Runtime::suspendInvoke()
+{
+	SuspendableInvoke* invoke = currentInvoke;
+	errorUnless(invoke);
+
+	currentInvoke = invoke->outerInvoke;
+	Platform::switchToFiber(invoke->resumingFiber);
+
+	if(invoke->isCancelling) { throw SuspendableInvokeCancellation(); }
+}
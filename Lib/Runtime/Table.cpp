@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <stdint.h>
 #include <string.h>
 #include <vector>
@@ -6,6 +7,7 @@
 #include "WAVM/IR/Types.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
@@ -18,10 +20,6 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
-// Global lists of tables; used to query whether an address is reserved by one of them.
-static Platform::Mutex tablesMutex;
-static std::vector<TableInstance*> tables;
-
 enum
 {
 	numGuardPages = 1
@@ -32,26 +30,30 @@ static Uptr getNumPlatformPages(Uptr numBytes)
 	return (numBytes + (Uptr(1) << Platform::getPageSizeLog2()) - 1) >> Platform::getPageSizeLog2();
 }
 
-static const AnyFunc* makeDummyAnyFunc()
+static void initDummyAnyFunc(AnyFunc* anyFunc)
 {
-	AnyFunc* anyFunc = new AnyFunc;
 	anyFunc->anyRef.object = nullptr;
 	anyFunc->functionTypeEncoding = IR::FunctionType::Encoding{0};
 	anyFunc->code[0] = 0xcc; // int3
-	return anyFunc;
 }
 
-const AnyFunc* Runtime::getOutOfBoundsAnyFunc()
+// The out-of-bounds and uninitialized sentinels are allocated as adjacent elements of one array,
+// so the uninitialized sentinel's biased table element value is the constant
+// uninitializedAnyFuncBiasedValue, which generated code uses to translate null references.
+static const AnyFunc* getSentinelAnyFuncs()
 {
-	static const AnyFunc* anyFunc = makeDummyAnyFunc();
-	return anyFunc;
+	static const AnyFunc* anyFuncs = [] {
+		AnyFunc* newAnyFuncs = new AnyFunc[2];
+		initDummyAnyFunc(&newAnyFuncs[0]);
+		initDummyAnyFunc(&newAnyFuncs[1]);
+		return newAnyFuncs;
+	}();
+	return anyFuncs;
 }
 
-const AnyFunc* Runtime::getUninitializedAnyFunc()
-{
-	static const AnyFunc* anyFunc = makeDummyAnyFunc();
-	return anyFunc;
-}
+const AnyFunc* Runtime::getOutOfBoundsAnyFunc() { return &getSentinelAnyFuncs()[0]; }
+
+const AnyFunc* Runtime::getUninitializedAnyFunc() { return &getSentinelAnyFuncs()[1]; }
 
 static Uptr anyRefToBiasedTableElementValue(const AnyReferee* anyRef)
 {
@@ -67,13 +69,21 @@ static const AnyReferee* biasedTableElementValueToAnyRef(Uptr biasedValue)
 static TableInstance* createTableImpl(Compartment* compartment, IR::TableType type)
 {
 	TableInstance* table = new TableInstance(compartment, type);
+	table->memoryBudget = compartment->memoryBudget;
 
-	// In 64-bit, allocate enough address-space to safely access 32-bit table indices without bounds
-	// checking, or 16MB (4M elements) if the host is 32-bit.
+	// If the table has no maximum size below 2^32 elements, reserve enough address-space to safely
+	// access 32-bit table indices without bounds checking. Otherwise, only reserve enough
+	// address-space for the table's maximum size, rounded up to a whole number of (at least one)
+	// pages, and rely on call_indirect checking the index against
+	// CompartmentRuntimeData::tableNumReservedElements.
 	const Uptr pageBytesLog2 = Platform::getPageSizeLog2();
-	const U64 tableMaxElements = Uptr(1) << 32;
-	const U64 tableMaxBytes = sizeof(TableInstance::Element) * tableMaxElements;
-	const U64 tableMaxPages = tableMaxBytes >> pageBytesLog2;
+	const U64 tableMaxPages
+		= type.size.max < IR::maxTableElems
+			  ? std::max(Uptr(1),
+						 getNumPlatformPages(Uptr(type.size.max) * sizeof(TableInstance::Element)))
+			  : (sizeof(TableInstance::Element) * IR::maxTableElems) >> pageBytesLog2;
+	const U64 tableMaxBytes = tableMaxPages << pageBytesLog2;
+	const U64 tableMaxElements = tableMaxBytes / sizeof(TableInstance::Element);
 
 	table->elements
 		= (TableInstance::Element*)Platform::allocateVirtualPages(tableMaxPages + numGuardPages);
@@ -85,11 +95,9 @@ static TableInstance* createTableImpl(Compartment* compartment, IR::TableType ty
 		return nullptr;
 	}
 
-	// Add the table to the global array.
-	{
-		Lock<Platform::Mutex> tablesLock(tablesMutex);
-		tables.push_back(table);
-	}
+	// Add the table's reserved address range to the owned address ranges.
+	table->ownedAddressRangeId
+		= addOwnedAddressRange((U8*)table->elements, tableMaxBytes, AddressOwnerKind::table);
 	return table;
 }
 
@@ -114,20 +122,37 @@ static Iptr growTableImpl(TableInstance* table, Uptr numElementsToGrow, bool ini
 		= getNumPlatformPages(previousNumElements * sizeof(TableInstance::Element));
 	const Uptr newNumPlatformPages
 		= getNumPlatformPages(newNumElements * sizeof(TableInstance::Element));
-	if(newNumPlatformPages != previousNumPlatformPages
-	   && !Platform::commitVirtualPages(
-			  (U8*)table->elements + (previousNumPlatformPages << Platform::getPageSizeLog2()),
-			  newNumPlatformPages - previousNumPlatformPages))
-	{ return -1; }
+	if(newNumPlatformPages != previousNumPlatformPages)
+	{
+		// Charge the new pages to the compartment's memory budget, and return -1 if that would
+		// exceed the budget.
+		const Uptr numBytesToCommit = (newNumPlatformPages - previousNumPlatformPages)
+									  << Platform::getPageSizeLog2();
+		if(!table->memoryBudget->charge(numBytesToCommit)) { return -1; }
+
+		if(!Platform::commitVirtualPages(
+			   (U8*)table->elements + (previousNumPlatformPages << Platform::getPageSizeLog2()),
+			   newNumPlatformPages - previousNumPlatformPages,
+			   Platform::MemoryAccess::readWrite,
+			   getCommitFlags(table->compartment),
+			   table->compartment->numaNode))
+		{
+			table->memoryBudget->release(numBytesToCommit);
+			return -1;
+		}
+	}
 
 	if(initializeNewElements)
 	{
-		// Write the uninitialized sentinel value to the new elements.
+		// Write the uninitialized sentinel value to the new elements. The elements aren't visible
+		// to other threads until the release store to numElements below, so they can be written
+		// with relaxed stores.
+		const Uptr uninitializedBiasedValue
+			= anyRefToBiasedTableElementValue(&getUninitializedAnyFunc()->anyRef);
 		for(Uptr elementIndex = previousNumElements; elementIndex < newNumElements; ++elementIndex)
 		{
-			table->elements[elementIndex].biasedValue.store(
-				anyRefToBiasedTableElementValue(&getUninitializedAnyFunc()->anyRef),
-				std::memory_order_release);
+			table->elements[elementIndex].biasedValue.store(uninitializedBiasedValue,
+															std::memory_order_relaxed);
 		}
 	}
 
@@ -159,6 +184,7 @@ TableInstance* Runtime::createTable(Compartment* compartment, IR::TableType type
 			return nullptr;
 		}
 		compartment->runtimeData->tableBases[table->id] = table->elements;
+		compartment->runtimeData->tableNumReservedElements[table->id] = table->numReservedElements;
 	}
 
 	return table;
@@ -199,6 +225,8 @@ TableInstance* Runtime::cloneTable(TableInstance* table, Compartment* newCompart
 		newTable->id = table->id;
 		newCompartment->tables.insertOrFail(newTable->id, newTable);
 		newCompartment->runtimeData->tableBases[newTable->id] = newTable->elements;
+		newCompartment->runtimeData->tableNumReservedElements[newTable->id]
+			= newTable->numReservedElements;
 	}
 
 	return newTable;
@@ -213,28 +241,21 @@ void TableInstance::finalize()
 
 	wavmAssert(compartment->runtimeData->tableBases[id] == elements);
 	compartment->runtimeData->tableBases[id] = nullptr;
+	compartment->runtimeData->tableNumReservedElements[id] = 0;
 }
 
 TableInstance::~TableInstance()
 {
-	// Remove the table from the global array.
-	{
-		Lock<Platform::Mutex> tablesLock(tablesMutex);
-		for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
-		{
-			if(tables[tableIndex] == this)
-			{
-				tables.erase(tables.begin() + tableIndex);
-				break;
-			}
-		}
-	}
+	// Remove the table's reserved address range from the owned address ranges.
+	if(ownedAddressRangeId != UINTPTR_MAX) { removeOwnedAddressRange(ownedAddressRangeId); }
 
 	// Decommit all pages.
 	if(numElements > 0)
 	{
-		Platform::decommitVirtualPages(
-			(U8*)elements, getNumPlatformPages(numElements * sizeof(TableInstance::Element)));
+		const Uptr numPlatformPages
+			= getNumPlatformPages(numElements * sizeof(TableInstance::Element));
+		Platform::decommitVirtualPages((U8*)elements, numPlatformPages);
+		memoryBudget->release(numPlatformPages << Platform::getPageSizeLog2());
 	}
 
 	// Free the virtual address space.
@@ -248,20 +269,6 @@ TableInstance::~TableInstance()
 	numElements = numReservedBytes = numReservedElements = 0;
 }
 
-bool Runtime::isAddressOwnedByTable(U8* address)
-{
-	// Iterate over all tables and check if the address is within the reserved address space for
-	// each.
-	Lock<Platform::Mutex> tablesLock(tablesMutex);
-	for(auto table : tables)
-	{
-		U8* startAddress = (U8*)table->elements;
-		U8* endAddress = ((U8*)table->elements) + table->numReservedBytes;
-		if(address >= startAddress && address < endAddress) { return true; }
-	}
-	return false;
-}
-
 static const AnyReferee* setTableElementAnyRef(TableInstance* table,
 											   Uptr index,
 											   const AnyReferee* anyRef)
@@ -320,6 +327,8 @@ const AnyReferee* Runtime::setTableElement(TableInstance* table,
 										   Uptr index,
 										   const AnyReferee* newValue)
 {
+	wavmAssert(!newValue || isInCompartment(newValue->object, table->compartment));
+
 	// If the new value is null, write the uninitialized sentinel value instead.
 	if(!newValue) { newValue = &getUninitializedAnyFunc()->anyRef; }
 
@@ -330,6 +339,62 @@ const AnyReferee* Runtime::setTableElement(TableInstance* table,
 	return oldAnyRef == &getUninitializedAnyFunc()->anyRef ? nullptr : oldAnyRef;
 }
 
+void Runtime::initTableElements(TableInstance* table,
+								Uptr baseIndex,
+								const std::vector<const AnyReferee*>& values)
+{
+	// Compute the biased values for the whole range before taking the table's lock.
+	std::vector<Uptr> biasedValues(values.size());
+	for(Uptr index = 0; index < values.size(); ++index)
+	{ biasedValues[index] = getBiasedTableElementValue(table, values[index]); }
+
+	initTableElementsBiased(table, baseIndex, biasedValues.data(), biasedValues.size());
+}
+
+Uptr Runtime::getBiasedTableElementValue(TableInstance* table, const AnyReferee* anyRef)
+{
+	wavmAssert(!anyRef || isInCompartment(anyRef->object, table->compartment));
+	if(!anyRef) { anyRef = &getUninitializedAnyFunc()->anyRef; }
+	return anyRefToBiasedTableElementValue(anyRef);
+}
+
+void Runtime::initTableElementsBiased(TableInstance* table,
+									  Uptr baseIndex,
+									  const Uptr* biasedValues,
+									  Uptr numValues)
+{
+	static_assert(sizeof(TableInstance::Element) == sizeof(Uptr),
+				  "relying on non-standard behavior");
+
+	// Hold the resizing lock while writing the elements, so the table can't be shrunk underneath
+	// the writes. That allows bounds checking the range once up front instead of checking for the
+	// out-of-bounds sentinel value when writing each element.
+	Uptr numInBoundsElements;
+	{
+		Lock<Platform::Mutex> resizingLock(table->resizingMutex);
+
+		const Uptr numElements = table->numElements.load(std::memory_order_acquire);
+		numInBoundsElements
+			= baseIndex >= numElements ? 0 : std::min(numValues, numElements - baseIndex);
+
+		// Other threads may only observe the writes through a table that was already published,
+		// in which case they race with the initialization anyway, so the elements are copied
+		// non-atomically with a single memcpy; the release fence orders the writes before whatever
+		// publishes the table next.
+		if(numInBoundsElements)
+		{
+			memcpy(reinterpret_cast<Uptr*>(table->elements + baseIndex),
+				   biasedValues,
+				   numInBoundsElements * sizeof(Uptr));
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	// Throw the exception after unlocking the mutex, since throwing an exception may unwind the
+	// stack without calling the Lock destructor.
+	if(numInBoundsElements < numValues) { throwException(Exception::tableIndexOutOfBoundsType); }
+}
+
 const AnyReferee* Runtime::getTableElement(TableInstance* table, Uptr index)
 {
 	const AnyReferee* anyRef = getTableElementAnyRef(table, index);
@@ -338,6 +403,31 @@ const AnyReferee* Runtime::getTableElement(TableInstance* table, Uptr index)
 	return anyRef == &getUninitializedAnyFunc()->anyRef ? nullptr : anyRef;
 }
 
+void Runtime::replaceTableElements(
+	TableInstance* table,
+	const HashMap<const AnyReferee*, const AnyReferee*>& replacements)
+{
+	// Hold the resizing mutex so the table's elements aren't decommitted while they are scanned.
+	Lock<Platform::Mutex> resizingLock(table->resizingMutex);
+
+	const Uptr numElements = table->numElements.load(std::memory_order_acquire);
+	for(Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex)
+	{
+		Uptr oldBiasedValue
+			= table->elements[elementIndex].biasedValue.load(std::memory_order_acquire);
+		const AnyReferee* const* replacement
+			= replacements.get(biasedTableElementValueToAnyRef(oldBiasedValue));
+		if(replacement)
+		{
+			// If the element was concurrently changed by another thread, leave the new value.
+			table->elements[elementIndex].biasedValue.compare_exchange_strong(
+				oldBiasedValue,
+				anyRefToBiasedTableElementValue(*replacement),
+				std::memory_order_acq_rel);
+		}
+	}
+}
+
 Uptr Runtime::getTableNumElements(TableInstance* table)
 {
 	return table->numElements.load(std::memory_order_acquire);
@@ -373,6 +463,8 @@ Iptr Runtime::shrinkTable(TableInstance* table, Uptr numElementsToShrink)
 		Platform::decommitVirtualPages(
 			(U8*)table->elements + (newNumPlatformPages << Platform::getPageSizeLog2()),
 			(previousNumPlatformPages - newNumPlatformPages) << Platform::getPageSizeLog2());
+		table->memoryBudget->release((previousNumPlatformPages - newNumPlatformPages)
+									 << Platform::getPageSizeLog2());
 	}
 
 	// Write the out-of-bounds sentinel value to any removed elements that are between the new end
@@ -486,29 +578,48 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 {
 	TableInstance* table = getTableFromRuntimeData(contextRuntimeData, tableId);
 
-	if(sourceOffset != destOffset)
+	// Hold the resizing lock while copying the elements, so the table can't be shrunk underneath
+	// the copy. That allows bounds checking the source and destination ranges once up front,
+	// instead of reading and writing each element with the checks for the out-of-bounds sentinel
+	// value. If either range is out of bounds, the elements before the first out-of-bounds element
+	// are copied before trapping.
+	Uptr numCopyElements;
 	{
-		const Uptr numNonOverlappingElements
-			= sourceOffset < destOffset && U64(sourceOffset) + U64(numElements) > destOffset
-				  ? destOffset - sourceOffset
-				  : numElements;
-
-		// If the end of the source overlaps the beginning of the destination, copy those elements
-		// before they are overwritten by the second part of the copy below.
-		for(Uptr index = numNonOverlappingElements; index < numElements; ++index)
+		Lock<Platform::Mutex> resizingLock(table->resizingMutex);
+
+		const U64 numTableElements = table->numElements.load(std::memory_order_acquire);
+		const U64 maxOffset = std::max(destOffset, sourceOffset);
+		numCopyElements = maxOffset >= numTableElements
+							  ? 0
+							  : Uptr(std::min(U64(numElements), numTableElements - maxOffset));
+
+		// Copy the elements in the direction that reads each source element before it is
+		// overwritten if the ranges overlap.
+		TableInstance::Element* destElements = table->elements + destOffset;
+		const TableInstance::Element* sourceElements = table->elements + sourceOffset;
+		if(destOffset <= sourceOffset)
 		{
-			setTableElementAnyRef(table,
-								  U64(destOffset) + U64(index),
-								  getTableElementAnyRef(table, U64(sourceOffset) + U64(index)));
+			for(Uptr index = 0; index < numCopyElements; ++index)
+			{
+				destElements[index].biasedValue.store(
+					sourceElements[index].biasedValue.load(std::memory_order_acquire),
+					std::memory_order_release);
+			}
 		}
-
-		for(Uptr index = 0; index < numNonOverlappingElements; ++index)
+		else
 		{
-			setTableElementAnyRef(table,
-								  U64(destOffset) + U64(index),
-								  getTableElementAnyRef(table, U64(sourceOffset) + U64(index)));
+			for(Uptr index = numCopyElements; index > 0; --index)
+			{
+				destElements[index - 1].biasedValue.store(
+					sourceElements[index - 1].biasedValue.load(std::memory_order_acquire),
+					std::memory_order_release);
+			}
 		}
 	}
+
+	// Throw the exception after unlocking the mutex, since throwing an exception may unwind the
+	// stack without calling the Lock destructor.
+	if(numCopyElements < numElements) { throwException(Exception::tableIndexOutOfBoundsType); }
 }
 
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
@@ -192,6 +192,41 @@ DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "accessViolationTrap", void, accessVio
 	throwException(Exception::memoryAddressOutOfBoundsType);
 }
 
+DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
+						  "tableIndexOutOfBoundsTrap",
+						  void,
+						  tableIndexOutOfBoundsTrap)
+{
+	throwException(Exception::tableIndexOutOfBoundsType);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "epochDeadlineReached", void, epochDeadlineReached)
+{
+	// If the context has a yield slice and the code is running in a suspendable invoke, yield to
+	// the host that resumed the invoke, and give the context a new slice when it is resumed.
+	Context* context = getContextFromRuntimeData(contextRuntimeData);
+	if(!context->epochYieldSlice || !getCurrentSuspendableInvoke())
+	{ throwException(Exception::epochDeadlineReachedType); }
+
+	suspendInvoke();
+	setContextEpochDeadline(context, context->epochYieldSlice);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "stackOverflowTrap", void, stackOverflowTrap)
+{
+	throwException(Exception::stackOverflowType);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "fuelExhausted", void, fuelExhausted)
+{
+	// Give the context's fuel exhausted handler a chance to refill the fuel, and resume the
+	// calling code if it does.
+	Context* context = getContextFromRuntimeData(contextRuntimeData);
+	if(!context->fuelExhaustedHandler || !context->fuelExhaustedHandler(context)
+	   || contextRuntimeData->fuel < 0)
+	{ throwException(Exception::fuelExhaustedType); }
+}
+
 DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 						  "invalidFloatOperationTrap",
 						  void,
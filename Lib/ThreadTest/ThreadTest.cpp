@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -11,6 +12,7 @@
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/IntrusiveSharedPtr.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Event.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Intrinsics.h"
@@ -24,7 +26,18 @@ using namespace WAVM::Runtime;
 
 enum
 {
-	numStackBytes = 1 * 1024 * 1024
+	numStackBytes = 1 * 1024 * 1024,
+
+	// Platform::Event::signal doesn't wake threads that aren't waiting yet, so waits for a pool
+	// task to be queued or done use this timeout to recheck the condition they are waiting for.
+	maxPoolWaitMicroseconds = 1000
+};
+
+enum class TaskState : U32
+{
+	queued,
+	running,
+	done
 };
 
 // Keeps track of the entry and error functions used by a running WebAssembly-spawned thread.
@@ -40,6 +53,12 @@ struct Thread
 
 	IR::Value argument;
 
+	// Set if the thread runs as a task in the worker pool, instead of on its own platform thread.
+	bool isPoolTask = false;
+	std::atomic<TaskState> taskState{TaskState::queued};
+	I64 result = 0;
+	Platform::Event doneEvent;
+
 	FORCENOINLINE Thread(Runtime::Context* inContext,
 						 Runtime::FunctionInstance* inEntryFunction,
 						 const IR::Value& inArgument)
@@ -113,6 +132,164 @@ static I64 threadEntry(void* threadVoid)
 	return invokeFunctionUnchecked(thread->context, thread->entryFunction, &thread->argument)->i64;
 }
 
+//
+// The worker pool runs the threads created by createThread as tasks on a fixed number of platform
+// threads, so creating a thread doesn't need to create a platform thread and stack. Each worker has
+// a deque of tasks: it pushes the tasks created by the threads it runs to the back of its deque,
+// and runs tasks from the back of its deque, or steals them from the front of other workers'
+// deques. Threads created in the worker pool can't be forked.
+//
+
+static std::atomic<bool> useWorkerPool{false};
+
+struct ExitTaskException
+{
+	I64 exitCode;
+};
+
+struct Worker
+{
+	Platform::Mutex tasksMutex;
+	std::deque<IntrusiveSharedPtr<Thread>> tasks;
+};
+
+static Platform::Mutex workersMutex;
+static std::vector<std::unique_ptr<Worker>> workers;
+static std::atomic<Uptr> numWorkers{0};
+static std::atomic<Uptr> nextWorkerIndex{0};
+static Platform::Event taskQueuedEvent;
+
+static thread_local Worker* currentWorker = nullptr;
+
+// Runs a task on the calling thread. The caller must have changed the task's state from queued to
+// running.
+static void runTask(Thread* thread)
+{
+	wavmAssert(thread->taskState.load(std::memory_order_relaxed) == TaskState::running);
+
+	IntrusiveSharedPtr<Thread> outerThread = std::move(currentThread);
+	currentThread = thread;
+	try
+	{
+		thread->result
+			= invokeFunctionUnchecked(thread->context, thread->entryFunction, &thread->argument)
+				  ->i64;
+	}
+	catch(ExitTaskException exception)
+	{
+		thread->result = exception.exitCode;
+	}
+	currentThread = std::move(outerThread);
+
+	thread->taskState.store(TaskState::done, std::memory_order_release);
+	thread->doneEvent.signal();
+}
+
+// Changes a task's state from queued to running, and returns whether it was successful. A task may
+// be claimed by the worker that dequeues it, or by a thread that joins it before it is dequeued.
+static bool claimTask(Thread* thread)
+{
+	TaskState expectedState = TaskState::queued;
+	return thread->taskState.compare_exchange_strong(expectedState, TaskState::running);
+}
+
+static IntrusiveSharedPtr<Thread> dequeueTask(Worker* worker)
+{
+	// Take the most recently queued task from the worker's own deque.
+	{
+		Lock<Platform::Mutex> tasksLock(worker->tasksMutex);
+		if(worker->tasks.size())
+		{
+			IntrusiveSharedPtr<Thread> task = std::move(worker->tasks.back());
+			worker->tasks.pop_back();
+			return task;
+		}
+	}
+
+	// Steal the least recently queued task from another worker's deque.
+	const Uptr currentNumWorkers = numWorkers.load(std::memory_order_acquire);
+	const Uptr firstVictimIndex = nextWorkerIndex.fetch_add(1, std::memory_order_relaxed);
+	for(Uptr victimOffset = 0; victimOffset < currentNumWorkers; ++victimOffset)
+	{
+		Worker* victim = workers[(firstVictimIndex + victimOffset) % currentNumWorkers].get();
+		if(victim == worker) { continue; }
+
+		Lock<Platform::Mutex> tasksLock(victim->tasksMutex);
+		if(victim->tasks.size())
+		{
+			IntrusiveSharedPtr<Thread> task = std::move(victim->tasks.front());
+			victim->tasks.pop_front();
+			return task;
+		}
+	}
+
+	return nullptr;
+}
+
+static I64 workerEntry(void* workerVoid)
+{
+	currentWorker = (Worker*)workerVoid;
+	while(true)
+	{
+		IntrusiveSharedPtr<Thread> task = dequeueTask(currentWorker);
+		if(!task)
+		{ taskQueuedEvent.wait(Platform::getMonotonicClock() + maxPoolWaitMicroseconds); }
+		else if(claimTask(task))
+		{
+			runTask(task);
+		}
+	}
+}
+
+static void queueTask(Thread* thread)
+{
+	// Start the workers the first time a task is queued.
+	if(!numWorkers.load(std::memory_order_acquire))
+	{
+		Lock<Platform::Mutex> workersLock(workersMutex);
+		if(!numWorkers.load(std::memory_order_relaxed))
+		{
+			const Uptr numHardwareThreads = Platform::getNumberOfHardwareThreads();
+			for(Uptr workerIndex = 0; workerIndex < numHardwareThreads; ++workerIndex)
+			{ workers.emplace_back(new Worker); }
+			numWorkers.store(numHardwareThreads, std::memory_order_release);
+
+			for(const std::unique_ptr<Worker>& worker : workers)
+			{
+				Platform::detachThread(
+					Platform::createThread(numStackBytes, workerEntry, worker.get()));
+			}
+		}
+	}
+
+	// Queue tasks created by a worker on its own deque, and distribute tasks created by other
+	// threads between the workers.
+	Worker* worker = currentWorker;
+	if(!worker)
+	{
+		const Uptr workerIndex = nextWorkerIndex.fetch_add(1, std::memory_order_relaxed);
+		worker = workers[workerIndex % numWorkers.load(std::memory_order_acquire)].get();
+	}
+	{
+		Lock<Platform::Mutex> tasksLock(worker->tasksMutex);
+		worker->tasks.push_back(thread);
+	}
+	taskQueuedEvent.signal();
+}
+
+static I64 joinTask(Thread* thread)
+{
+	// If no worker has started the task yet, run it on the joining thread instead of waiting for
+	// a worker to run it.
+	if(claimTask(thread)) { runTask(thread); }
+
+	while(thread->taskState.load(std::memory_order_acquire) != TaskState::done)
+	{ thread->doneEvent.wait(Platform::getMonotonicClock() + maxPoolWaitMicroseconds); }
+	return thread->result;
+}
+
+void ThreadTest::setUseWorkerPool(bool inUseWorkerPool) { useWorkerPool.store(inUseWorkerPool); }
+
 DEFINE_INTRINSIC_FUNCTION(threadTest,
 						  "createThread",
 						  I64,
@@ -129,18 +306,28 @@ DEFINE_INTRINSIC_FUNCTION(threadTest,
 
 	// Create a thread object that will expose its entry and error functions to the garbage
 	// collector as roots.
-	auto newContext
-		= createContext(getCompartmentFromContext(getContextFromRuntimeData(contextRuntimeData)));
+	Compartment* compartment
+		= getCompartmentFromContext(getContextFromRuntimeData(contextRuntimeData));
+	auto newContext = createContext(compartment);
 	Thread* thread = new Thread(newContext, entryFunction, entryArgument);
 
 	allocateThreadId(thread);
 
-	// Increment the Thread's reference count for the pointer passed to the thread's entry function.
-	// threadFunc calls the corresponding removeRef.
-	thread->addRef();
+	if(useWorkerPool.load(std::memory_order_relaxed))
+	{
+		thread->isPoolTask = true;
+		queueTask(thread);
+	}
+	else
+	{
+		// Increment the Thread's reference count for the pointer passed to the thread's entry
+		// function. threadFunc calls the corresponding removeRef.
+		thread->addRef();
 
-	// Spawn and detach a platform thread that calls threadFunc.
-	thread->platformThread = Platform::createThread(numStackBytes, threadEntry, thread);
+		// Spawn and detach a platform thread that calls threadFunc, on the compartment's NUMA node.
+		thread->platformThread = Platform::createThread(
+			numStackBytes, threadEntry, thread, getCompartmentNUMANode(compartment));
+	}
 
 	return thread->id;
 }
@@ -152,6 +339,9 @@ DEFINE_INTRINSIC_FUNCTION_WITH_CONTEXT_SWITCH(threadTest, "forkThread", I64, for
 	auto newContext = cloneContext(oldContext, compartment);
 
 	wavmAssert(currentThread);
+	if(currentThread->isPoolTask)
+	{ throwException(Runtime::Exception::calledUnimplementedIntrinsicType); }
+
 	Thread* childThread
 		= new Thread(newContext, currentThread->entryFunction, currentThread->argument);
 
@@ -190,6 +380,8 @@ DEFINE_INTRINSIC_FUNCTION_WITH_CONTEXT_SWITCH(threadTest, "forkThread", I64, for
 
 DEFINE_INTRINSIC_FUNCTION(threadTest, "exitThread", void, exitThread, I64 code)
 {
+	// A pool task only exits the task, not the worker thread running it.
+	if(currentThread && currentThread->isPoolTask) { throw ExitTaskException{code}; }
 	Platform::exitThread(code);
 }
 
@@ -213,6 +405,8 @@ static IntrusiveSharedPtr<Thread> removeThreadById(Uptr threadId)
 DEFINE_INTRINSIC_FUNCTION(threadTest, "joinThread", I64, joinThread, I64 threadId)
 {
 	IntrusiveSharedPtr<Thread> thread = removeThreadById(threadId);
+	if(thread->isPoolTask) { return joinTask(thread); }
+
 	const I64 result = Platform::joinThread(thread->platformThread);
 	thread->platformThread = nullptr;
 	return result;
@@ -221,6 +415,8 @@ DEFINE_INTRINSIC_FUNCTION(threadTest, "joinThread", I64, joinThread, I64 threadI
 DEFINE_INTRINSIC_FUNCTION(threadTest, "detachThread", void, detachThread, I64 threadId)
 {
 	IntrusiveSharedPtr<Thread> thread = removeThreadById(threadId);
+	if(thread->isPoolTask) { return; }
+
 	Platform::detachThread(thread->platformThread);
 	thread->platformThread = nullptr;
 }
@@ -0,0 +1,371 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "WASIPrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/Mutex.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#include <linux/io_uring.h>
+
+// The ring is only used if the kernel headers declare the 5.6 API, which can probe the supported
+// operations.
+#ifdef IO_URING_OP_SUPPORTED
+#define WAVM_WASI_USE_IO_URING 1
+#endif
+#endif
+#endif
+
+using namespace WAVM;
+using namespace WAVM::WASI;
+
+struct WASI::IOQueue
+{
+	Platform::Mutex mutex;
+
+#if WAVM_WASI_USE_IO_URING
+	int ringFD = -1;
+
+	// Kernels before 5.6 can't read or write at a descriptor's current position through the ring,
+	// so those operations are forwarded to the system calls.
+	bool canUseCurrentPosition = false;
+
+	// Kernels before 5.3 don't support sendmsg and recvmsg operations.
+	bool canSendAndReceiveMessages = false;
+
+	U8* sqRing = nullptr;
+	Uptr numSQRingBytes = 0;
+	U8* cqRing = nullptr;
+	Uptr numCQRingBytes = 0;
+	io_uring_sqe* sqes = nullptr;
+	Uptr numSQEBytes = 0;
+
+	U32* sqHead = nullptr;
+	U32* sqTail = nullptr;
+	U32* sqMask = nullptr;
+	U32* sqArray = nullptr;
+	U32* cqHead = nullptr;
+	U32* cqTail = nullptr;
+	U32* cqMask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+#endif
+};
+
+#if WAVM_WASI_USE_IO_URING
+enum
+{
+	// The operations are submitted one at a time, so the ring never holds more than one entry.
+	numRingEntries = 4,
+
+	maxProbeOps = 256
+};
+
+static bool initRing(IOQueue* queue)
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	// io_uring_setup fails with ENOSYS on kernels before 5.1, and with EPERM if a seccomp policy
+	// doesn't allow it.
+	const long ringFD = syscall(__NR_io_uring_setup, U32(numRingEntries), &params);
+	if(ringFD < 0) { return false; }
+	queue->ringFD = int(ringFD);
+	queue->canUseCurrentPosition = params.features & IORING_FEAT_RW_CUR_POS;
+
+	queue->numSQRingBytes = params.sq_off.array + params.sq_entries * sizeof(U32);
+	queue->numCQRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	queue->numSQEBytes = params.sq_entries * sizeof(io_uring_sqe);
+
+	void* sqRing = mmap(nullptr,
+						queue->numSQRingBytes,
+						PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE,
+						queue->ringFD,
+						IORING_OFF_SQ_RING);
+	void* cqRing = mmap(nullptr,
+						queue->numCQRingBytes,
+						PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE,
+						queue->ringFD,
+						IORING_OFF_CQ_RING);
+	void* sqes = mmap(nullptr,
+					  queue->numSQEBytes,
+					  PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE,
+					  queue->ringFD,
+					  IORING_OFF_SQES);
+	queue->sqRing = sqRing == MAP_FAILED ? nullptr : (U8*)sqRing;
+	queue->cqRing = cqRing == MAP_FAILED ? nullptr : (U8*)cqRing;
+	queue->sqes = sqes == MAP_FAILED ? nullptr : (io_uring_sqe*)sqes;
+	if(!queue->sqRing || !queue->cqRing || !queue->sqes) { return false; }
+
+	queue->sqHead = (U32*)(queue->sqRing + params.sq_off.head);
+	queue->sqTail = (U32*)(queue->sqRing + params.sq_off.tail);
+	queue->sqMask = (U32*)(queue->sqRing + params.sq_off.ring_mask);
+	queue->sqArray = (U32*)(queue->sqRing + params.sq_off.array);
+	queue->cqHead = (U32*)(queue->cqRing + params.cq_off.head);
+	queue->cqTail = (U32*)(queue->cqRing + params.cq_off.tail);
+	queue->cqMask = (U32*)(queue->cqRing + params.cq_off.ring_mask);
+	queue->cqes = (io_uring_cqe*)(queue->cqRing + params.cq_off.cqes);
+
+	// Kernels before 5.6 can't be asked which operations they support, so the ring is only used
+	// for the operations that all kernels with io_uring support.
+	io_uring_probe* probe = (io_uring_probe*)calloc(
+		1, sizeof(io_uring_probe) + maxProbeOps * sizeof(io_uring_probe_op));
+	const long probeResult = syscall(
+		__NR_io_uring_register, queue->ringFD, U32(IORING_REGISTER_PROBE), probe, U32(maxProbeOps));
+	if(!probeResult)
+	{
+		auto isOpSupported = [probe](U32 op) {
+			return op <= probe->last_op && op < probe->ops_len
+				   && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+		};
+		queue->canSendAndReceiveMessages
+			= isOpSupported(IORING_OP_SENDMSG) && isOpSupported(IORING_OP_RECVMSG);
+	}
+	free(probe);
+
+	return true;
+}
+
+static void destroyRing(IOQueue* queue)
+{
+	if(queue->sqes) { munmap(queue->sqes, queue->numSQEBytes); }
+	if(queue->cqRing) { munmap(queue->cqRing, queue->numCQRingBytes); }
+	if(queue->sqRing) { munmap(queue->sqRing, queue->numSQRingBytes); }
+	if(queue->ringFD >= 0) { close(queue->ringFD); }
+	queue->sqes = nullptr;
+	queue->cqRing = nullptr;
+	queue->sqRing = nullptr;
+	queue->ringFD = -1;
+}
+
+// Submits an operation to the ring, and waits for it to complete. The caller fills in the
+// operation's fields of the submission queue entry.
+template<typename FillSQE> static I64 submitToRing(IOQueue* queue, FillSQE&& fillSQE)
+{
+	Lock<Platform::Mutex> lock(queue->mutex);
+
+	// This is the only thread that writes the submission queue tail while the mutex is locked,
+	// and it waits for each operation to complete, so the queue is always empty here.
+	const U32 sqTail = *queue->sqTail;
+	const U32 sqIndex = sqTail & *queue->sqMask;
+	io_uring_sqe* sqe = &queue->sqes[sqIndex];
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	fillSQE(*sqe);
+	queue->sqArray[sqIndex] = sqIndex;
+	__atomic_store_n(queue->sqTail, sqTail + 1, __ATOMIC_RELEASE);
+
+	// Submit the entry and wait for its completion. If the wait is interrupted by a signal after
+	// the kernel consumed the entry, wait again without resubmitting it.
+	const U32 cqHead = *queue->cqHead;
+	while(cqHead == __atomic_load_n(queue->cqTail, __ATOMIC_ACQUIRE))
+	{
+		const U32 numToSubmit = __atomic_load_n(queue->sqHead, __ATOMIC_ACQUIRE) == sqTail ? 1 : 0;
+		const long result = syscall(__NR_io_uring_enter,
+									queue->ringFD,
+									numToSubmit,
+									1u,
+									U32(IORING_ENTER_GETEVENTS),
+									nullptr,
+									Uptr(0));
+		if(result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			// If the entry wasn't consumed, take it back out of the queue.
+			if(numToSubmit && __atomic_load_n(queue->sqHead, __ATOMIC_ACQUIRE) == sqTail)
+			{
+				__atomic_store_n(queue->sqTail, sqTail, __ATOMIC_RELEASE);
+				return -I64(errno);
+			}
+		}
+	}
+
+	const io_uring_cqe& cqe = queue->cqes[cqHead & *queue->cqMask];
+	const I64 result = cqe.res;
+	__atomic_store_n(queue->cqHead, cqHead + 1, __ATOMIC_RELEASE);
+	return result;
+}
+#endif
+
+IOQueue* WASI::createIOQueue(bool allowRing)
+{
+	IOQueue* queue = new IOQueue;
+#if WAVM_WASI_USE_IO_URING
+	if(allowRing && !initRing(queue)) { destroyRing(queue); }
+#endif
+	return queue;
+}
+
+void WASI::destroyIOQueue(IOQueue* queue)
+{
+#if WAVM_WASI_USE_IO_URING
+	destroyRing(queue);
+#endif
+	delete queue;
+}
+
+bool WASI::isIOQueueUsingRing(IOQueue* queue)
+{
+#if WAVM_WASI_USE_IO_URING
+	return queue->ringFD >= 0;
+#else
+	return false;
+#endif
+}
+
+static I64 getSyscallResult(ssize_t result) { return result >= 0 ? I64(result) : -I64(errno); }
+
+// Emulates preadv and pwritev with pread and pwrite, which are available on all POSIX hosts.
+template<typename Transfer>
+static I64 transferAtOffset(const iovec* iovs, U32 numIOVs, I64 offset, Transfer&& transfer)
+{
+	I64 numTransferredBytes = 0;
+	for(U32 iovIndex = 0; iovIndex < numIOVs; ++iovIndex)
+	{
+		const iovec& iov = iovs[iovIndex];
+		const ssize_t result = transfer(iov.iov_base, iov.iov_len, offset + numTransferredBytes);
+		if(result < 0) { return numTransferredBytes ? numTransferredBytes : -I64(errno); }
+		numTransferredBytes += result;
+		if(Uptr(result) < iov.iov_len) { break; }
+	}
+	return numTransferredBytes;
+}
+
+I64 WASI::submitReadv(IOQueue* queue, int fd, const iovec* iovs, U32 numIOVs, I64 offset)
+{
+#if WAVM_WASI_USE_IO_URING
+	if(queue->ringFD >= 0 && (offset >= 0 || queue->canUseCurrentPosition))
+	{
+		return submitToRing(queue, [&](io_uring_sqe& sqe) {
+			sqe.opcode = IORING_OP_READV;
+			sqe.fd = fd;
+			sqe.addr = U64(Uptr(iovs));
+			sqe.len = numIOVs;
+			sqe.off = offset >= 0 ? U64(offset) : U64(-1);
+		});
+	}
+#endif
+
+	if(offset < 0) { return getSyscallResult(readv(fd, iovs, int(numIOVs))); }
+	return transferAtOffset(iovs, numIOVs, offset, [fd](void* buffer, size_t numBytes, I64 at) {
+		return pread(fd, buffer, numBytes, off_t(at));
+	});
+}
+
+I64 WASI::submitWritev(IOQueue* queue, int fd, const iovec* iovs, U32 numIOVs, I64 offset)
+{
+#if WAVM_WASI_USE_IO_URING
+	if(queue->ringFD >= 0 && (offset >= 0 || queue->canUseCurrentPosition))
+	{
+		return submitToRing(queue, [&](io_uring_sqe& sqe) {
+			sqe.opcode = IORING_OP_WRITEV;
+			sqe.fd = fd;
+			sqe.addr = U64(Uptr(iovs));
+			sqe.len = numIOVs;
+			sqe.off = offset >= 0 ? U64(offset) : U64(-1);
+		});
+	}
+#endif
+
+	if(offset < 0) { return getSyscallResult(writev(fd, iovs, int(numIOVs))); }
+	return transferAtOffset(iovs, numIOVs, offset, [fd](void* buffer, size_t numBytes, I64 at) {
+		return pwrite(fd, buffer, numBytes, off_t(at));
+	});
+}
+
+I64 WASI::submitFsync(IOQueue* queue, int fd, bool onlyData)
+{
+#if WAVM_WASI_USE_IO_URING
+	if(queue->ringFD >= 0)
+	{
+		return submitToRing(queue, [&](io_uring_sqe& sqe) {
+			sqe.opcode = IORING_OP_FSYNC;
+			sqe.fd = fd;
+			sqe.fsync_flags = onlyData ? IORING_FSYNC_DATASYNC : 0;
+		});
+	}
+#endif
+
+#ifdef __APPLE__
+	// MacOS doesn't declare fdatasync.
+	return getSyscallResult(fsync(fd));
+#else
+	return getSyscallResult(onlyData ? fdatasync(fd) : fsync(fd));
+#endif
+}
+
+I64 WASI::submitSendmsg(IOQueue* queue, int fd, const msghdr* message, int flags)
+{
+#if WAVM_WASI_USE_IO_URING
+	if(queue->ringFD >= 0 && queue->canSendAndReceiveMessages)
+	{
+		return submitToRing(queue, [&](io_uring_sqe& sqe) {
+			sqe.opcode = IORING_OP_SENDMSG;
+			sqe.fd = fd;
+			sqe.addr = U64(Uptr(message));
+			sqe.len = 1;
+			sqe.msg_flags = U32(flags);
+		});
+	}
+#endif
+
+	return getSyscallResult(sendmsg(fd, message, flags));
+}
+
+I64 WASI::submitRecvmsg(IOQueue* queue, int fd, msghdr* message, int flags)
+{
+#if WAVM_WASI_USE_IO_URING
+	if(queue->ringFD >= 0 && queue->canSendAndReceiveMessages)
+	{
+		return submitToRing(queue, [&](io_uring_sqe& sqe) {
+			sqe.opcode = IORING_OP_RECVMSG;
+			sqe.fd = fd;
+			sqe.addr = U64(Uptr(message));
+			sqe.len = 1;
+			sqe.msg_flags = U32(flags);
+		});
+	}
+#endif
+
+	return getSyscallResult(recvmsg(fd, message, flags));
+}
+
+I64 WASI::submitPoll(IOQueue* queue, pollfd* fds, U32 numFDs, I32 timeoutMilliseconds)
+{
+#if WAVM_WASI_USE_IO_URING
+	// A poll operation waits for a single descriptor, and would need a linked timeout operation to
+	// expire.
+	if(queue->ringFD >= 0 && numFDs == 1 && timeoutMilliseconds < 0)
+	{
+		const I64 result = submitToRing(queue, [&](io_uring_sqe& sqe) {
+			sqe.opcode = IORING_OP_POLL_ADD;
+			sqe.fd = fds[0].fd;
+			sqe.poll_events = U16(fds[0].events);
+		});
+
+		// poll reports an invalid descriptor as an event instead of an error.
+		if(result == -EBADF) { fds[0].revents = POLLNVAL; }
+		else if(result < 0)
+		{
+			return result;
+		}
+		else
+		{
+			fds[0].revents = short(result);
+		}
+		return 1;
+	}
+#endif
+
+	return getSyscallResult(poll(fds, nfds_t(numFDs), timeoutMilliseconds));
+}
@@ -0,0 +1,1596 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WASIPrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/IndexMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Intrinsics.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASI/WASI.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+using namespace WAVM::WASI;
+
+DEFINE_INTRINSIC_MODULE(wasi)
+
+// The values and layouts below are defined by the wasi_unstable API.
+
+enum ErrNo : I32
+{
+	esuccess = 0,
+	e2big = 1,
+	eacces = 2,
+	eaddrinuse = 3,
+	eaddrnotavail = 4,
+	eafnosupport = 5,
+	eagain = 6,
+	ealready = 7,
+	ebadf = 8,
+	ebusy = 10,
+	ecanceled = 11,
+	econnaborted = 13,
+	econnrefused = 14,
+	econnreset = 15,
+	edeadlk = 16,
+	edestaddrreq = 17,
+	edquot = 19,
+	eexist = 20,
+	efault = 21,
+	efbig = 22,
+	ehostunreach = 23,
+	eilseq = 25,
+	einprogress = 26,
+	eintr = 27,
+	einval = 28,
+	eio = 29,
+	eisconn = 30,
+	eisdir = 31,
+	eloop = 32,
+	emfile = 33,
+	emlink = 34,
+	emsgsize = 35,
+	enametoolong = 37,
+	enetdown = 38,
+	enetreset = 39,
+	enetunreach = 40,
+	enfile = 41,
+	enobufs = 42,
+	enodev = 43,
+	enoent = 44,
+	enomem = 48,
+	enospc = 51,
+	enosys = 52,
+	enotconn = 53,
+	enotdir = 54,
+	enotempty = 55,
+	enotsock = 57,
+	enotsup = 58,
+	enotty = 59,
+	enxio = 60,
+	eoverflow = 61,
+	eperm = 63,
+	epipe = 64,
+	erofs = 69,
+	espipe = 70,
+	etimedout = 73,
+	etxtbsy = 74,
+	exdev = 75,
+	enotcapable = 76
+};
+
+enum FileType : U8
+{
+	unknownFileType = 0,
+	blockDeviceFileType = 1,
+	characterDeviceFileType = 2,
+	directoryFileType = 3,
+	regularFileFileType = 4,
+	datagramSocketFileType = 5,
+	streamSocketFileType = 6,
+	symbolicLinkFileType = 7
+};
+
+enum : U64
+{
+	rightFDDatasync = U64(1) << 0,
+	rightFDRead = U64(1) << 1,
+	rightFDSeek = U64(1) << 2,
+	rightFDFdstatSetFlags = U64(1) << 3,
+	rightFDSync = U64(1) << 4,
+	rightFDTell = U64(1) << 5,
+	rightFDWrite = U64(1) << 6,
+	rightFDAdvise = U64(1) << 7,
+	rightFDAllocate = U64(1) << 8,
+	rightPathCreateDirectory = U64(1) << 9,
+	rightPathCreateFile = U64(1) << 10,
+	rightPathLinkSource = U64(1) << 11,
+	rightPathLinkTarget = U64(1) << 12,
+	rightPathOpen = U64(1) << 13,
+	rightFDReaddir = U64(1) << 14,
+	rightPathReadlink = U64(1) << 15,
+	rightPathRenameSource = U64(1) << 16,
+	rightPathRenameTarget = U64(1) << 17,
+	rightPathFilestatGet = U64(1) << 18,
+	rightPathFilestatSetSize = U64(1) << 19,
+	rightPathFilestatSetTimes = U64(1) << 20,
+	rightFDFilestatGet = U64(1) << 21,
+	rightFDFilestatSetSize = U64(1) << 22,
+	rightFDFilestatSetTimes = U64(1) << 23,
+	rightPathSymlink = U64(1) << 24,
+	rightPathRemoveDirectory = U64(1) << 25,
+	rightPathUnlinkFile = U64(1) << 26,
+	rightPollFDReadwrite = U64(1) << 27,
+	rightSockShutdown = U64(1) << 28,
+
+	allRights = (U64(1) << 29) - 1,
+
+	directoryRights = rightFDFdstatSetFlags | rightFDSync | rightFDAdvise
+					  | rightPathCreateDirectory | rightPathCreateFile | rightPathLinkSource
+					  | rightPathLinkTarget | rightPathOpen | rightFDReaddir | rightPathReadlink
+					  | rightPathRenameSource | rightPathRenameTarget | rightPathFilestatGet
+					  | rightPathFilestatSetSize | rightPathFilestatSetTimes | rightFDFilestatGet
+					  | rightFDFilestatSetTimes | rightPathSymlink | rightPathRemoveDirectory
+					  | rightPathUnlinkFile,
+
+	fileRights = rightFDDatasync | rightFDRead | rightFDSeek | rightFDFdstatSetFlags | rightFDSync
+				 | rightFDTell | rightFDWrite | rightFDAdvise | rightFDAllocate | rightFDFilestatGet
+				 | rightFDFilestatSetSize | rightFDFilestatSetTimes | rightPollFDReadwrite,
+
+	socketRights = rightFDRead | rightFDFdstatSetFlags | rightFDWrite | rightFDFilestatGet
+				   | rightPollFDReadwrite | rightSockShutdown
+};
+
+enum : U32
+{
+	clockRealtime = 0,
+	clockMonotonic = 1,
+	clockProcessCPUTime = 2,
+	clockThreadCPUTime = 3,
+
+	eventTypeClock = 0,
+	eventTypeFDRead = 1,
+	eventTypeFDWrite = 2,
+
+	eventRWFlagHangup = 1,
+
+	fdFlagAppend = 1,
+	fdFlagDsync = 2,
+	fdFlagNonblock = 4,
+	fdFlagRsync = 8,
+	fdFlagSync = 16,
+
+	lookupFlagSymlinkFollow = 1,
+
+	openFlagCreate = 1,
+	openFlagDirectory = 2,
+	openFlagExclusive = 4,
+	openFlagTruncate = 8,
+
+	preopenTypeDirectory = 0,
+
+	recvFlagPeek = 1,
+	recvFlagWaitAll = 2,
+	recvFlagDataTruncated = 1,
+
+	sdFlagRead = 1,
+	sdFlagWrite = 2,
+
+	subclockFlagAbsoluteTime = 1,
+
+	whenceCurrent = 0,
+	whenceEnd = 1,
+	whenceSet = 2
+};
+
+struct GuestIOVec
+{
+	U32 address;
+	U32 numBytes;
+};
+
+struct FDStat
+{
+	U8 fileType;
+	U16 flags;
+	U64 rights;
+	U64 inheritingRights;
+};
+static_assert(sizeof(FDStat) == 24, "FDStat must match the layout of wasi_unstable's fdstat");
+
+struct Prestat
+{
+	U8 type;
+	U32 numNameBytes;
+};
+static_assert(sizeof(Prestat) == 8, "Prestat must match the layout of wasi_unstable's prestat");
+
+struct Subscription
+{
+	U64 userData;
+	U8 type;
+	union
+	{
+		struct
+		{
+			U64 identifier;
+			U32 clockID;
+			U64 timeout;
+			U64 precision;
+			U16 flags;
+		} clock;
+		struct
+		{
+			I32 fd;
+		} fdReadWrite;
+	};
+};
+static_assert(sizeof(Subscription) == 56,
+			  "Subscription must match the layout of wasi_unstable's subscription");
+
+struct Event
+{
+	U64 userData;
+	U16 error;
+	U8 type;
+	U64 numBytes;
+	U16 flags;
+};
+static_assert(sizeof(Event) == 32, "Event must match the layout of wasi_unstable's event");
+
+// A file descriptor of a process, and the host file descriptor it refers to.
+struct FD
+{
+	int hostFD;
+	U8 fileType;
+	U64 rights;
+	U64 inheritingRights;
+
+	// The name of a preopened directory, or empty for other descriptors.
+	std::string preopenedName;
+
+	// The standard streams are shared with the host, so they aren't closed with the process.
+	bool isOwned;
+};
+
+struct WASI::Process
+{
+	Compartment* compartment = nullptr;
+	GCPointer<ModuleInstance> moduleInstance;
+	GCPointer<MemoryInstance> memory;
+
+	std::vector<std::string> args;
+	std::vector<std::string> env;
+
+	Platform::Mutex fdsMutex;
+	IndexMap<I32, FD> fds{0, INT32_MAX};
+
+	IOQueue* ioQueue = nullptr;
+	int randomFD = -1;
+};
+
+// The intrinsic functions are shared by all compartments, so they map their context's compartment
+// to its process.
+static Platform::Mutex processesMutex;
+static HashMap<Compartment*, Process*> processes;
+
+static Process* getProcess(ContextRuntimeData* contextRuntimeData)
+{
+	Compartment* compartment
+		= getCompartmentFromContext(getContextFromRuntimeData(contextRuntimeData));
+
+	Process* process = nullptr;
+	{
+		Lock<Platform::Mutex> processesLock(processesMutex);
+		Process* const* registeredProcess = processes.get(compartment);
+		if(registeredProcess) { process = *registeredProcess; }
+	}
+
+	if(!process)
+	{
+		Log::printf(Log::error, "WASI function called from a compartment without a WASI process\n");
+		throwException(Exception::calledAbortType);
+	}
+	else if(!process->memory)
+	{
+		Log::printf(Log::error, "WASI function called before the process's memory was set\n");
+		throwException(Exception::calledAbortType);
+	}
+	return process;
+}
+
+static I32 asWASIErrNo(int error)
+{
+	switch(error)
+	{
+	case 0: return ErrNo::esuccess;
+	case E2BIG: return ErrNo::e2big;
+	case EACCES: return ErrNo::eacces;
+	case EADDRINUSE: return ErrNo::eaddrinuse;
+	case EADDRNOTAVAIL: return ErrNo::eaddrnotavail;
+	case EAFNOSUPPORT: return ErrNo::eafnosupport;
+	case EAGAIN: return ErrNo::eagain;
+	case EALREADY: return ErrNo::ealready;
+	case EBADF: return ErrNo::ebadf;
+	case EBUSY: return ErrNo::ebusy;
+	case ECANCELED: return ErrNo::ecanceled;
+	case ECONNABORTED: return ErrNo::econnaborted;
+	case ECONNREFUSED: return ErrNo::econnrefused;
+	case ECONNRESET: return ErrNo::econnreset;
+	case EDEADLK: return ErrNo::edeadlk;
+	case EDESTADDRREQ: return ErrNo::edestaddrreq;
+	case EDQUOT: return ErrNo::edquot;
+	case EEXIST: return ErrNo::eexist;
+	case EFAULT: return ErrNo::efault;
+	case EFBIG: return ErrNo::efbig;
+	case EHOSTUNREACH: return ErrNo::ehostunreach;
+	case EILSEQ: return ErrNo::eilseq;
+	case EINPROGRESS: return ErrNo::einprogress;
+	case EINTR: return ErrNo::eintr;
+	case EINVAL: return ErrNo::einval;
+	case EIO: return ErrNo::eio;
+	case EISCONN: return ErrNo::eisconn;
+	case EISDIR: return ErrNo::eisdir;
+	case ELOOP: return ErrNo::eloop;
+	case EMFILE: return ErrNo::emfile;
+	case EMLINK: return ErrNo::emlink;
+	case EMSGSIZE: return ErrNo::emsgsize;
+	case ENAMETOOLONG: return ErrNo::enametoolong;
+	case ENETDOWN: return ErrNo::enetdown;
+	case ENETRESET: return ErrNo::enetreset;
+	case ENETUNREACH: return ErrNo::enetunreach;
+	case ENFILE: return ErrNo::enfile;
+	case ENOBUFS: return ErrNo::enobufs;
+	case ENODEV: return ErrNo::enodev;
+	case ENOENT: return ErrNo::enoent;
+	case ENOMEM: return ErrNo::enomem;
+	case ENOSPC: return ErrNo::enospc;
+	case ENOSYS: return ErrNo::enosys;
+	case ENOTCONN: return ErrNo::enotconn;
+	case ENOTDIR: return ErrNo::enotdir;
+	case ENOTEMPTY: return ErrNo::enotempty;
+	case ENOTSOCK: return ErrNo::enotsock;
+	case ENOTSUP: return ErrNo::enotsup;
+	case ENOTTY: return ErrNo::enotty;
+	case ENXIO: return ErrNo::enxio;
+	case EOVERFLOW: return ErrNo::eoverflow;
+	case EPERM: return ErrNo::eperm;
+	case EPIPE: return ErrNo::epipe;
+	case EROFS: return ErrNo::erofs;
+	case ESPIPE: return ErrNo::espipe;
+	case ETIMEDOUT: return ErrNo::etimedout;
+	case ETXTBSY: return ErrNo::etxtbsy;
+	case EXDEV: return ErrNo::exdev;
+	default: return ErrNo::eio;
+	}
+}
+
+static U8 getHostFDFileType(int hostFD)
+{
+	struct stat fdStat;
+	if(fstat(hostFD, &fdStat)) { return FileType::unknownFileType; }
+
+	if(S_ISBLK(fdStat.st_mode)) { return FileType::blockDeviceFileType; }
+	else if(S_ISCHR(fdStat.st_mode))
+	{
+		return FileType::characterDeviceFileType;
+	}
+	else if(S_ISDIR(fdStat.st_mode))
+	{
+		return FileType::directoryFileType;
+	}
+	else if(S_ISREG(fdStat.st_mode))
+	{
+		return FileType::regularFileFileType;
+	}
+	else if(S_ISLNK(fdStat.st_mode))
+	{
+		return FileType::symbolicLinkFileType;
+	}
+	else if(S_ISSOCK(fdStat.st_mode))
+	{
+		int socketType = 0;
+		socklen_t numSocketTypeBytes = sizeof(socketType);
+		if(!getsockopt(hostFD, SOL_SOCKET, SO_TYPE, &socketType, &numSocketTypeBytes))
+		{
+			if(socketType == SOCK_DGRAM) { return FileType::datagramSocketFileType; }
+			else if(socketType == SOCK_STREAM)
+			{
+				return FileType::streamSocketFileType;
+			}
+		}
+	}
+	return FileType::unknownFileType;
+}
+
+// Returns the rights that make sense for a type of file. WASI libc's isatty checks that a
+// character device doesn't have the seek and tell rights.
+static U64 getMaxRights(U8 fileType)
+{
+	switch(fileType)
+	{
+	case FileType::directoryFileType: return directoryRights;
+	case FileType::characterDeviceFileType: return fileRights & ~(rightFDSeek | rightFDTell);
+	case FileType::datagramSocketFileType:
+	case FileType::streamSocketFileType: return socketRights;
+	default: return fileRights;
+	}
+}
+
+// Looks up a process's file descriptor, and checks that it has the required rights.
+static I32 getFD(Process* process, I32 fd, U64 requiredRights, FD& outFD)
+{
+	Lock<Platform::Mutex> fdsLock(process->fdsMutex);
+	if(fd < 0 || !process->fds.contains(fd)) { return ErrNo::ebadf; }
+	outFD = process->fds[fd];
+	if((outFD.rights & requiredRights) != requiredRights) { return ErrNo::enotcapable; }
+	return ErrNo::esuccess;
+}
+
+// Translates an array of WASI iovecs to host iovecs that point directly into the memory.
+static I32 translateIOVs(MemoryInstance* memory,
+						 U32 iovsAddress,
+						 U32 numIOVs,
+						 std::vector<iovec>& outIOVs)
+{
+	if(numIOVs > IOV_MAX) { return ErrNo::einval; }
+
+	// Load the memory's size once, and validate each buffer against it.
+	const MemoryView memoryView(memory);
+	const GuestIOVec* guestIOVs = memoryView.arrayPtr<GuestIOVec>(iovsAddress, numIOVs);
+	outIOVs.resize(numIOVs);
+	for(U32 iovIndex = 0; iovIndex < numIOVs; ++iovIndex)
+	{
+		const GuestIOVec guestIOV = guestIOVs[iovIndex];
+		outIOVs[iovIndex].iov_base = memoryView.arrayPtr<U8>(guestIOV.address, guestIOV.numBytes);
+		outIOVs[iovIndex].iov_len = guestIOV.numBytes;
+	}
+	return ErrNo::esuccess;
+}
+
+// Reads a path from the memory, and checks that it can't refer to anything outside the directory
+// it is relative to: it may not be absolute, or have any ".." components. Symbolic links in the
+// path's directories are followed, so a link the host created inside a preopened directory may
+// still refer to a file outside it.
+static I32 readRelativePath(MemoryInstance* memory, U32 address, U32 numBytes, std::string& outPath)
+{
+	const char* chars = memoryArrayPtr<char>(memory, address, numBytes);
+	outPath.assign(chars, numBytes);
+	if(outPath.empty()) { return ErrNo::enoent; }
+	if(outPath.find('\0') != std::string::npos) { return ErrNo::einval; }
+	if(outPath[0] == '/') { return ErrNo::enotcapable; }
+
+	Uptr componentBegin = 0;
+	while(componentBegin <= outPath.size())
+	{
+		Uptr componentEnd = outPath.find('/', componentBegin);
+		if(componentEnd == std::string::npos) { componentEnd = outPath.size(); }
+		if(outPath.compare(componentBegin, componentEnd - componentBegin, "..") == 0)
+		{ return ErrNo::enotcapable; }
+		componentBegin = componentEnd + 1;
+	}
+	return ErrNo::esuccess;
+}
+
+static Uptr getNumStringBytes(const std::vector<std::string>& strings)
+{
+	Uptr numBytes = 0;
+	for(const std::string& string : strings) { numBytes += string.size() + 1; }
+	return numBytes;
+}
+
+static I32 getStringsSizes(MemoryInstance* memory,
+						   const std::vector<std::string>& strings,
+						   U32 numStringsAddress,
+						   U32 numStringBytesAddress)
+{
+	const Uptr numStringBytes = getNumStringBytes(strings);
+	if(strings.size() > UINT32_MAX || numStringBytes > UINT32_MAX) { return ErrNo::eoverflow; }
+
+	memoryRef<U32>(memory, numStringsAddress) = U32(strings.size());
+	memoryRef<U32>(memory, numStringBytesAddress) = U32(numStringBytes);
+	return ErrNo::esuccess;
+}
+
+// Writes null-terminated copies of the strings to the buffer, and pointers to them to an array.
+static I32 getStrings(MemoryInstance* memory,
+					  const std::vector<std::string>& strings,
+					  U32 pointersAddress,
+					  U32 bufferAddress)
+{
+	const Uptr numStringBytes = getNumStringBytes(strings);
+	if(strings.size() > UINT32_MAX || numStringBytes > UINT32_MAX) { return ErrNo::eoverflow; }
+
+	U32* pointers = memoryArrayPtr<U32>(memory, pointersAddress, strings.size());
+	U8* buffer = memoryArrayPtr<U8>(memory, bufferAddress, numStringBytes);
+	Uptr bufferOffset = 0;
+	for(Uptr stringIndex = 0; stringIndex < strings.size(); ++stringIndex)
+	{
+		const std::string& string = strings[stringIndex];
+		memcpy(buffer + bufferOffset, string.c_str(), string.size() + 1);
+		pointers[stringIndex] = U32(bufferAddress + bufferOffset);
+		bufferOffset += string.size() + 1;
+	}
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "args_sizes_get",
+						  I32,
+						  wasi_args_sizes_get,
+						  U32 numArgsAddress,
+						  U32 numArgBytesAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+	return getStringsSizes(process->memory, process->args, numArgsAddress, numArgBytesAddress);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "args_get",
+						  I32,
+						  wasi_args_get,
+						  U32 argvAddress,
+						  U32 argBufferAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+	return getStrings(process->memory, process->args, argvAddress, argBufferAddress);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "environ_sizes_get",
+						  I32,
+						  wasi_environ_sizes_get,
+						  U32 numEnvsAddress,
+						  U32 numEnvBytesAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+	return getStringsSizes(process->memory, process->env, numEnvsAddress, numEnvBytesAddress);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "environ_get",
+						  I32,
+						  wasi_environ_get,
+						  U32 envsAddress,
+						  U32 envBufferAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+	return getStrings(process->memory, process->env, envsAddress, envBufferAddress);
+}
+
+static bool getHostClockID(U32 clockID, clockid_t& outHostClockID)
+{
+	switch(clockID)
+	{
+	case clockRealtime: outHostClockID = CLOCK_REALTIME; return true;
+	case clockMonotonic: outHostClockID = CLOCK_MONOTONIC; return true;
+	case clockProcessCPUTime: outHostClockID = CLOCK_PROCESS_CPUTIME_ID; return true;
+	case clockThreadCPUTime: outHostClockID = CLOCK_THREAD_CPUTIME_ID; return true;
+	default: return false;
+	}
+}
+
+static I32 getClockTime(U32 clockID, U64& outNanoseconds)
+{
+	clockid_t hostClockID;
+	if(!getHostClockID(clockID, hostClockID)) { return ErrNo::einval; }
+
+	timespec time;
+	if(clock_gettime(hostClockID, &time)) { return asWASIErrNo(errno); }
+	outNanoseconds = U64(time.tv_sec) * 1000000000 + U64(time.tv_nsec);
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "clock_res_get",
+						  I32,
+						  wasi_clock_res_get,
+						  U32 clockID,
+						  U32 resolutionAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	clockid_t hostClockID;
+	if(!getHostClockID(clockID, hostClockID)) { return ErrNo::einval; }
+
+	timespec resolution;
+	if(clock_getres(hostClockID, &resolution)) { return asWASIErrNo(errno); }
+	memoryRef<U64>(process->memory, resolutionAddress)
+		= U64(resolution.tv_sec) * 1000000000 + U64(resolution.tv_nsec);
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "clock_time_get",
+						  I32,
+						  wasi_clock_time_get,
+						  U32 clockID,
+						  U64 precision,
+						  U32 timeAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	U64 time;
+	const I32 result = getClockTime(clockID, time);
+	if(result != ErrNo::esuccess) { return result; }
+	memoryRef<U64>(process->memory, timeAddress) = time;
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "fd_close", I32, wasi_fd_close, I32 fd)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	FD closedFD;
+	{
+		Lock<Platform::Mutex> fdsLock(process->fdsMutex);
+		if(fd < 0 || !process->fds.contains(fd)) { return ErrNo::ebadf; }
+		closedFD = process->fds[fd];
+		process->fds.removeOrFail(fd);
+	}
+
+	if(closedFD.isOwned && close(closedFD.hostFD)) { return asWASIErrNo(errno); }
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "fd_fdstat_get", I32, wasi_fd_fdstat_get, I32 fd, U32 statAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	FD statFD;
+	const I32 result = getFD(process, fd, 0, statFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	const int hostFlags = fcntl(statFD.hostFD, F_GETFL);
+	if(hostFlags < 0) { return asWASIErrNo(errno); }
+
+	FDStat& fdStat = memoryRef<FDStat>(process->memory, statAddress);
+	fdStat.fileType = statFD.fileType;
+	fdStat.flags = 0;
+	if(hostFlags & O_APPEND) { fdStat.flags |= fdFlagAppend; }
+	if(hostFlags & O_NONBLOCK) { fdStat.flags |= fdFlagNonblock; }
+
+	// On Linux, O_SYNC includes the O_DSYNC bit.
+	if((hostFlags & O_SYNC) == O_SYNC) { fdStat.flags |= fdFlagSync; }
+	else if(hostFlags & O_DSYNC)
+	{
+		fdStat.flags |= fdFlagDsync;
+	}
+
+	fdStat.rights = statFD.rights;
+	fdStat.inheritingRights = statFD.inheritingRights;
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_prestat_get",
+						  I32,
+						  wasi_fd_prestat_get,
+						  I32 fd,
+						  U32 prestatAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	// WASI libc finds the preopened directories by calling this for each descriptor after the
+	// standard streams until it returns EBADF.
+	FD prestatFD;
+	const I32 result = getFD(process, fd, 0, prestatFD);
+	if(result != ErrNo::esuccess) { return result; }
+	if(prestatFD.preopenedName.empty()) { return ErrNo::enotsup; }
+	if(prestatFD.preopenedName.size() > UINT32_MAX) { return ErrNo::eoverflow; }
+
+	Prestat& prestat = memoryRef<Prestat>(process->memory, prestatAddress);
+	prestat.type = preopenTypeDirectory;
+	prestat.numNameBytes = U32(prestatFD.preopenedName.size());
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_prestat_dir_name",
+						  I32,
+						  wasi_fd_prestat_dir_name,
+						  I32 fd,
+						  U32 bufferAddress,
+						  U32 numBufferBytes)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	FD prestatFD;
+	const I32 result = getFD(process, fd, 0, prestatFD);
+	if(result != ErrNo::esuccess) { return result; }
+	if(prestatFD.preopenedName.empty()) { return ErrNo::enotsup; }
+	if(numBufferBytes < prestatFD.preopenedName.size()) { return ErrNo::enametoolong; }
+
+	// The name isn't null-terminated.
+	memcpy(memoryArrayPtr<char>(process->memory, bufferAddress, prestatFD.preopenedName.size()),
+		   prestatFD.preopenedName.data(),
+		   prestatFD.preopenedName.size());
+	return ErrNo::esuccess;
+}
+
+// Reads or writes a descriptor, transferring the data directly between the host descriptor and
+// the process's memory.
+template<typename Submit>
+static I32 transferIOVs(ContextRuntimeData* contextRuntimeData,
+						I32 fd,
+						U64 requiredRights,
+						U32 iovsAddress,
+						U32 numIOVs,
+						U32 numTransferredBytesAddress,
+						Submit&& submit)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	FD transferFD;
+	I32 result = getFD(process, fd, requiredRights, transferFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	std::vector<iovec> iovs;
+	result = translateIOVs(process->memory, iovsAddress, numIOVs, iovs);
+	if(result != ErrNo::esuccess) { return result; }
+
+	const I64 numTransferredBytes = submit(process->ioQueue, transferFD.hostFD, iovs);
+	if(numTransferredBytes < 0) { return asWASIErrNo(int(-numTransferredBytes)); }
+
+	// The host can't transfer more bytes than the iovecs' total size, which fits in a U32 because
+	// they are all in a 32-bit address-space.
+	memoryRef<U32>(process->memory, numTransferredBytesAddress) = U32(numTransferredBytes);
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_read",
+						  I32,
+						  wasi_fd_read,
+						  I32 fd,
+						  U32 iovsAddress,
+						  U32 numIOVs,
+						  U32 numReadBytesAddress)
+{
+	return transferIOVs(contextRuntimeData,
+						fd,
+						rightFDRead,
+						iovsAddress,
+						numIOVs,
+						numReadBytesAddress,
+						[](IOQueue* queue, int hostFD, const std::vector<iovec>& iovs) {
+							return submitReadv(queue, hostFD, iovs.data(), U32(iovs.size()), -1);
+						});
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_pread",
+						  I32,
+						  wasi_fd_pread,
+						  I32 fd,
+						  U32 iovsAddress,
+						  U32 numIOVs,
+						  U64 offset,
+						  U32 numReadBytesAddress)
+{
+	if(offset > U64(INT64_MAX)) { return ErrNo::einval; }
+	return transferIOVs(contextRuntimeData,
+						fd,
+						rightFDRead | rightFDSeek,
+						iovsAddress,
+						numIOVs,
+						numReadBytesAddress,
+						[offset](IOQueue* queue, int hostFD, const std::vector<iovec>& iovs) {
+							return submitReadv(
+								queue, hostFD, iovs.data(), U32(iovs.size()), I64(offset));
+						});
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_write",
+						  I32,
+						  wasi_fd_write,
+						  I32 fd,
+						  U32 iovsAddress,
+						  U32 numIOVs,
+						  U32 numWrittenBytesAddress)
+{
+	return transferIOVs(contextRuntimeData,
+						fd,
+						rightFDWrite,
+						iovsAddress,
+						numIOVs,
+						numWrittenBytesAddress,
+						[](IOQueue* queue, int hostFD, const std::vector<iovec>& iovs) {
+							return submitWritev(queue, hostFD, iovs.data(), U32(iovs.size()), -1);
+						});
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_pwrite",
+						  I32,
+						  wasi_fd_pwrite,
+						  I32 fd,
+						  U32 iovsAddress,
+						  U32 numIOVs,
+						  U64 offset,
+						  U32 numWrittenBytesAddress)
+{
+	if(offset > U64(INT64_MAX)) { return ErrNo::einval; }
+	return transferIOVs(contextRuntimeData,
+						fd,
+						rightFDWrite | rightFDSeek,
+						iovsAddress,
+						numIOVs,
+						numWrittenBytesAddress,
+						[offset](IOQueue* queue, int hostFD, const std::vector<iovec>& iovs) {
+							return submitWritev(
+								queue, hostFD, iovs.data(), U32(iovs.size()), I64(offset));
+						});
+}
+
+static I32 seekFD(ContextRuntimeData* contextRuntimeData,
+				  I32 fd,
+				  I64 offset,
+				  U32 whence,
+				  U32 newOffsetAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	int hostWhence;
+	switch(whence)
+	{
+	case whenceCurrent: hostWhence = SEEK_CUR; break;
+	case whenceEnd: hostWhence = SEEK_END; break;
+	case whenceSet: hostWhence = SEEK_SET; break;
+	default: return ErrNo::einval;
+	}
+
+	// Getting the current offset only requires the tell right.
+	const U64 requiredRights
+		= offset == 0 && whence == whenceCurrent ? rightFDTell : rightFDSeek | rightFDTell;
+
+	FD seekedFD;
+	const I32 result = getFD(process, fd, requiredRights, seekedFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	const off_t newOffset = lseek(seekedFD.hostFD, off_t(offset), hostWhence);
+	if(newOffset < 0) { return asWASIErrNo(errno); }
+	memoryRef<U64>(process->memory, newOffsetAddress) = U64(newOffset);
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "fd_seek",
+						  I32,
+						  wasi_fd_seek,
+						  I32 fd,
+						  I64 offset,
+						  U32 whence,
+						  U32 newOffsetAddress)
+{
+	return seekFD(contextRuntimeData, fd, offset, whence, newOffsetAddress);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "fd_tell", I32, wasi_fd_tell, I32 fd, U32 offsetAddress)
+{
+	return seekFD(contextRuntimeData, fd, 0, whenceCurrent, offsetAddress);
+}
+
+static I32 syncFD(ContextRuntimeData* contextRuntimeData, I32 fd, bool onlyData)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	FD syncedFD;
+	const I32 result = getFD(process, fd, onlyData ? rightFDDatasync : rightFDSync, syncedFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	const I64 syncResult = submitFsync(process->ioQueue, syncedFD.hostFD, onlyData);
+	return syncResult < 0 ? asWASIErrNo(int(-syncResult)) : ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "fd_sync", I32, wasi_fd_sync, I32 fd)
+{
+	return syncFD(contextRuntimeData, fd, false);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "fd_datasync", I32, wasi_fd_datasync, I32 fd)
+{
+	return syncFD(contextRuntimeData, fd, true);
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "path_open",
+						  I32,
+						  wasi_path_open,
+						  I32 dirFD,
+						  U32 lookupFlags,
+						  U32 pathAddress,
+						  U32 numPathBytes,
+						  U32 openFlags,
+						  U64 requestedRights,
+						  U64 requestedInheritingRights,
+						  U32 fdFlags,
+						  U32 fdAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	U64 requiredDirRights = rightPathOpen;
+	if(openFlags & openFlagCreate) { requiredDirRights |= rightPathCreateFile; }
+
+	FD dir;
+	I32 result = getFD(process, dirFD, requiredDirRights, dir);
+	if(result != ErrNo::esuccess) { return result; }
+
+	std::string path;
+	result = readRelativePath(process->memory, pathAddress, numPathBytes, path);
+	if(result != ErrNo::esuccess) { return result; }
+
+	int hostFlags = O_CLOEXEC;
+	if((requestedRights & rightFDRead) && (requestedRights & rightFDWrite))
+	{ hostFlags |= O_RDWR; }
+	else if(requestedRights & rightFDWrite)
+	{
+		hostFlags |= O_WRONLY;
+	}
+	else
+	{
+		hostFlags |= O_RDONLY;
+	}
+	if(openFlags & openFlagCreate) { hostFlags |= O_CREAT; }
+	if(openFlags & openFlagDirectory) { hostFlags |= O_DIRECTORY; }
+	if(openFlags & openFlagExclusive) { hostFlags |= O_EXCL; }
+	if(openFlags & openFlagTruncate) { hostFlags |= O_TRUNC; }
+	if(fdFlags & fdFlagAppend) { hostFlags |= O_APPEND; }
+	if(fdFlags & fdFlagDsync) { hostFlags |= O_DSYNC; }
+	if(fdFlags & fdFlagNonblock) { hostFlags |= O_NONBLOCK; }
+	if(fdFlags & fdFlagSync) { hostFlags |= O_SYNC; }
+#ifdef O_RSYNC
+	if(fdFlags & fdFlagRsync) { hostFlags |= O_RSYNC; }
+#endif
+	if(!(lookupFlags & lookupFlagSymlinkFollow)) { hostFlags |= O_NOFOLLOW; }
+
+	const int hostFD = openat(dir.hostFD, path.c_str(), hostFlags, 0666);
+	if(hostFD < 0) { return asWASIErrNo(errno); }
+
+	// The new descriptor only gets the rights that the directory may pass on to it, and that
+	// make sense for its type of file.
+	FD newFD;
+	newFD.hostFD = hostFD;
+	newFD.fileType = getHostFDFileType(hostFD);
+	newFD.rights = requestedRights & dir.inheritingRights & getMaxRights(newFD.fileType);
+	newFD.inheritingRights = requestedInheritingRights & dir.inheritingRights;
+	newFD.isOwned = true;
+
+	I32 fd;
+	{
+		Lock<Platform::Mutex> fdsLock(process->fdsMutex);
+		fd = process->fds.add(-1, std::move(newFD));
+	}
+	if(fd < 0)
+	{
+		close(hostFD);
+		return ErrNo::emfile;
+	}
+
+	memoryRef<I32>(process->memory, fdAddress) = fd;
+	return ErrNo::esuccess;
+}
+
+// Calls a host function on a path relative to one of the process's directories.
+template<typename HostPathFunction>
+static I32 modifyPath(ContextRuntimeData* contextRuntimeData,
+					  I32 dirFD,
+					  U64 requiredRights,
+					  U32 pathAddress,
+					  U32 numPathBytes,
+					  HostPathFunction&& hostPathFunction)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	FD dir;
+	I32 result = getFD(process, dirFD, requiredRights, dir);
+	if(result != ErrNo::esuccess) { return result; }
+
+	std::string path;
+	result = readRelativePath(process->memory, pathAddress, numPathBytes, path);
+	if(result != ErrNo::esuccess) { return result; }
+
+	return hostPathFunction(dir.hostFD, path.c_str()) ? asWASIErrNo(errno) : ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "path_create_directory",
+						  I32,
+						  wasi_path_create_directory,
+						  I32 dirFD,
+						  U32 pathAddress,
+						  U32 numPathBytes)
+{
+	return modifyPath(
+		contextRuntimeData,
+		dirFD,
+		rightPathCreateDirectory,
+		pathAddress,
+		numPathBytes,
+		[](int hostDirFD, const char* path) { return mkdirat(hostDirFD, path, 0777); });
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "path_remove_directory",
+						  I32,
+						  wasi_path_remove_directory,
+						  I32 dirFD,
+						  U32 pathAddress,
+						  U32 numPathBytes)
+{
+	return modifyPath(
+		contextRuntimeData,
+		dirFD,
+		rightPathRemoveDirectory,
+		pathAddress,
+		numPathBytes,
+		[](int hostDirFD, const char* path) { return unlinkat(hostDirFD, path, AT_REMOVEDIR); });
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "path_unlink_file",
+						  I32,
+						  wasi_path_unlink_file,
+						  I32 dirFD,
+						  U32 pathAddress,
+						  U32 numPathBytes)
+{
+	return modifyPath(contextRuntimeData,
+					  dirFD,
+					  rightPathUnlinkFile,
+					  pathAddress,
+					  numPathBytes,
+					  [](int hostDirFD, const char* path) { return unlinkat(hostDirFD, path, 0); });
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "sock_recv",
+						  I32,
+						  wasi_sock_recv,
+						  I32 fd,
+						  U32 iovsAddress,
+						  U32 numIOVs,
+						  U32 recvFlags,
+						  U32 numReceivedBytesAddress,
+						  U32 outFlagsAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	if(recvFlags & ~U32(recvFlagPeek | recvFlagWaitAll)) { return ErrNo::einval; }
+	int hostFlags = 0;
+	if(recvFlags & recvFlagPeek) { hostFlags |= MSG_PEEK; }
+	if(recvFlags & recvFlagWaitAll) { hostFlags |= MSG_WAITALL; }
+
+	FD socketFD;
+	I32 result = getFD(process, fd, rightFDRead, socketFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	std::vector<iovec> iovs;
+	result = translateIOVs(process->memory, iovsAddress, numIOVs, iovs);
+	if(result != ErrNo::esuccess) { return result; }
+
+	msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = iovs.data();
+	message.msg_iovlen = iovs.size();
+
+	const I64 numReceivedBytes
+		= submitRecvmsg(process->ioQueue, socketFD.hostFD, &message, hostFlags);
+	if(numReceivedBytes < 0) { return asWASIErrNo(int(-numReceivedBytes)); }
+
+	memoryRef<U32>(process->memory, numReceivedBytesAddress) = U32(numReceivedBytes);
+	memoryRef<U16>(process->memory, outFlagsAddress)
+		= (message.msg_flags & MSG_TRUNC) ? recvFlagDataTruncated : 0;
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "sock_send",
+						  I32,
+						  wasi_sock_send,
+						  I32 fd,
+						  U32 iovsAddress,
+						  U32 numIOVs,
+						  U32 sendFlags,
+						  U32 numSentBytesAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	// wasi_unstable doesn't define any send flags.
+	if(sendFlags) { return ErrNo::einval; }
+
+	FD socketFD;
+	I32 result = getFD(process, fd, rightFDWrite, socketFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	std::vector<iovec> iovs;
+	result = translateIOVs(process->memory, iovsAddress, numIOVs, iovs);
+	if(result != ErrNo::esuccess) { return result; }
+
+	msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = iovs.data();
+	message.msg_iovlen = iovs.size();
+
+	// Return EPIPE instead of raising SIGPIPE if the socket's peer has closed it.
+#ifdef MSG_NOSIGNAL
+	const int hostFlags = MSG_NOSIGNAL;
+#else
+	const int hostFlags = 0;
+#endif
+
+	const I64 numSentBytes = submitSendmsg(process->ioQueue, socketFD.hostFD, &message, hostFlags);
+	if(numSentBytes < 0) { return asWASIErrNo(int(-numSentBytes)); }
+
+	memoryRef<U32>(process->memory, numSentBytesAddress) = U32(numSentBytes);
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "sock_shutdown", I32, wasi_sock_shutdown, I32 fd, U32 sdFlags)
+{
+	Process* process = getProcess(contextRuntimeData);
+
+	int how;
+	switch(sdFlags)
+	{
+	case sdFlagRead: how = SHUT_RD; break;
+	case sdFlagWrite: how = SHUT_WR; break;
+	case sdFlagRead | sdFlagWrite: how = SHUT_RDWR; break;
+	default: return ErrNo::einval;
+	}
+
+	FD socketFD;
+	const I32 result = getFD(process, fd, rightSockShutdown, socketFD);
+	if(result != ErrNo::esuccess) { return result; }
+
+	return shutdown(socketFD.hostFD, how) ? asWASIErrNo(errno) : ErrNo::esuccess;
+}
+
+// Waits for at least one of the subscriptions' events, and writes the events that occurred.
+// Subscriptions that can't be waited for, such as those for a descriptor without the poll right,
+// occur immediately with an error.
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "poll_oneoff",
+						  I32,
+						  wasi_poll_oneoff,
+						  U32 subscriptionsAddress,
+						  U32 eventsAddress,
+						  U32 numSubscriptions,
+						  U32 numEventsAddress)
+{
+	Process* process = getProcess(contextRuntimeData);
+	if(!numSubscriptions) { return ErrNo::einval; }
+
+	// Copy the subscriptions, so they can't be changed by another thread while they are waited for.
+	const Subscription* guestSubscriptions
+		= memoryArrayPtr<Subscription>(process->memory, subscriptionsAddress, numSubscriptions);
+	const std::vector<Subscription> subscriptions(guestSubscriptions,
+												  guestSubscriptions + numSubscriptions);
+	Event* guestEvents = memoryArrayPtr<Event>(process->memory, eventsAddress, numSubscriptions);
+
+	std::vector<Event> events;
+	auto addEvent = [&events](const Subscription& subscription, I32 error) -> Event& {
+		Event event;
+		memset(&event, 0, sizeof(Event));
+		event.userData = subscription.userData;
+		event.error = U16(error);
+		event.type = subscription.type;
+		events.push_back(event);
+		return events.back();
+	};
+
+	// The clock subscriptions' timeouts are measured from the time the wait starts on the
+	// monotonic clock, whichever clock they are for.
+	U64 startTime;
+	I32 result = getClockTime(clockMonotonic, startTime);
+	if(result != ErrNo::esuccess) { return result; }
+
+	std::vector<std::pair<Uptr, U64>> clockSubscriptionTimeouts;
+	std::vector<pollfd> pollFDs;
+	std::vector<Uptr> pollFDSubscriptionIndices;
+	for(Uptr subscriptionIndex = 0; subscriptionIndex < numSubscriptions; ++subscriptionIndex)
+	{
+		const Subscription& subscription = subscriptions[subscriptionIndex];
+		switch(subscription.type)
+		{
+		case eventTypeClock: {
+			U64 clockTime;
+			result = getClockTime(subscription.clock.clockID, clockTime);
+			if(result != ErrNo::esuccess) { addEvent(subscription, result); }
+			else
+			{
+				// An absolute timeout is relative to the subscription's clock.
+				U64 timeout = subscription.clock.timeout;
+				if(subscription.clock.flags & subclockFlagAbsoluteTime)
+				{ timeout = timeout > clockTime ? timeout - clockTime : 0; }
+				clockSubscriptionTimeouts.push_back({subscriptionIndex, timeout});
+			}
+			break;
+		}
+		case eventTypeFDRead:
+		case eventTypeFDWrite: {
+			FD polledFD;
+			result = getFD(process, subscription.fdReadWrite.fd, rightPollFDReadwrite, polledFD);
+			if(result != ErrNo::esuccess)
+			{
+				addEvent(subscription, result);
+				break;
+			}
+
+			pollfd hostPollFD;
+			hostPollFD.fd = polledFD.hostFD;
+			hostPollFD.events = subscription.type == eventTypeFDRead ? POLLIN : POLLOUT;
+			hostPollFD.revents = 0;
+			pollFDs.push_back(hostPollFD);
+			pollFDSubscriptionIndices.push_back(subscriptionIndex);
+			break;
+		}
+		default: addEvent(subscription, ErrNo::einval); break;
+		}
+	}
+
+	// Wait until a descriptor is ready or a timeout expires. poll's timeout is in milliseconds,
+	// and may expire before a long timeout, in which case it waits again.
+	U64 elapsedTime = 0;
+	while(true)
+	{
+		I32 pollTimeout = -1;
+		if(events.size()) { pollTimeout = 0; }
+		else
+		{
+			for(const auto& clockSubscriptionTimeout : clockSubscriptionTimeouts)
+			{
+				const U64 remainingTime = clockSubscriptionTimeout.second > elapsedTime
+											  ? clockSubscriptionTimeout.second - elapsedTime
+											  : 0;
+				const U64 remainingMilliseconds
+					= std::min(remainingTime / 1000000 + (remainingTime % 1000000 ? 1 : 0),
+							   U64(INT32_MAX));
+				if(pollTimeout < 0 || I32(remainingMilliseconds) < pollTimeout)
+				{ pollTimeout = I32(remainingMilliseconds); }
+			}
+		}
+
+		const I64 numReadyFDs
+			= submitPoll(process->ioQueue, pollFDs.data(), U32(pollFDs.size()), pollTimeout);
+		if(numReadyFDs < 0) { return asWASIErrNo(int(-numReadyFDs)); }
+
+		for(Uptr pollFDIndex = 0; numReadyFDs && pollFDIndex < pollFDs.size(); ++pollFDIndex)
+		{
+			const pollfd& hostPollFD = pollFDs[pollFDIndex];
+			if(!hostPollFD.revents) { continue; }
+
+			const Subscription& subscription
+				= subscriptions[pollFDSubscriptionIndices[pollFDIndex]];
+			I32 error = ErrNo::esuccess;
+			if(hostPollFD.revents & POLLNVAL) { error = ErrNo::ebadf; }
+			else if(hostPollFD.revents & POLLERR)
+			{
+				error = ErrNo::eio;
+			}
+
+			Event& event = addEvent(subscription, error);
+			if(hostPollFD.revents & POLLHUP) { event.flags |= eventRWFlagHangup; }
+
+			// Report how many bytes can be read without blocking, if the host knows.
+			int numReadableBytes = 0;
+			if(subscription.type == eventTypeFDRead && !error
+			   && !ioctl(hostPollFD.fd, FIONREAD, &numReadableBytes) && numReadableBytes > 0)
+			{ event.numBytes = U64(numReadableBytes); }
+		}
+
+		U64 currentTime;
+		result = getClockTime(clockMonotonic, currentTime);
+		if(result != ErrNo::esuccess) { return result; }
+		elapsedTime = currentTime - startTime;
+		for(const auto& clockSubscriptionTimeout : clockSubscriptionTimeouts)
+		{
+			if(clockSubscriptionTimeout.second <= elapsedTime)
+			{ addEvent(subscriptions[clockSubscriptionTimeout.first], ErrNo::esuccess); }
+		}
+
+		if(events.size()) { break; }
+	}
+
+	memcpy(guestEvents, events.data(), events.size() * sizeof(Event));
+	memoryRef<U32>(process->memory, numEventsAddress) = U32(events.size());
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi,
+						  "random_get",
+						  I32,
+						  wasi_random_get,
+						  U32 bufferAddress,
+						  U32 numBufferBytes)
+{
+	Process* process = getProcess(contextRuntimeData);
+	if(process->randomFD < 0) { return ErrNo::enosys; }
+
+	U8* buffer = memoryArrayPtr<U8>(process->memory, bufferAddress, numBufferBytes);
+	Uptr numReadBytes = 0;
+	while(numReadBytes < numBufferBytes)
+	{
+		const ssize_t result
+			= read(process->randomFD, buffer + numReadBytes, numBufferBytes - numReadBytes);
+		if(result < 0 && errno != EINTR) { return asWASIErrNo(errno); }
+		else if(result == 0)
+		{
+			return ErrNo::eio;
+		}
+		else if(result > 0)
+		{
+			numReadBytes += Uptr(result);
+		}
+	}
+	return ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "sched_yield", I32, wasi_sched_yield)
+{
+	return sched_yield() ? asWASIErrNo(errno) : ErrNo::esuccess;
+}
+
+DEFINE_INTRINSIC_FUNCTION(wasi, "proc_exit", void, wasi_proc_exit, U32 exitCode)
+{
+	throw ExitException{exitCode};
+}
+
+// The rest of wasi_unstable's functions aren't implemented, but are defined so modules that
+// import them can be linked.
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_advise",
+								   I32,
+								   wasi_fd_advise,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U64 offset,
+								   U64 numBytes,
+								   U32 advice)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_allocate",
+								   I32,
+								   wasi_fd_allocate,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U64 offset,
+								   U64 numBytes)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_fdstat_set_flags",
+								   I32,
+								   wasi_fd_fdstat_set_flags,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U32 flags)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_fdstat_set_rights",
+								   I32,
+								   wasi_fd_fdstat_set_rights,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U64 rights,
+								   U64 inheritingRights)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_filestat_get",
+								   I32,
+								   wasi_fd_filestat_get,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U32 filestatAddress)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_filestat_set_size",
+								   I32,
+								   wasi_fd_filestat_set_size,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U64 numBytes)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_filestat_set_times",
+								   I32,
+								   wasi_fd_filestat_set_times,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U64 lastAccessTime,
+								   U64 lastWriteTime,
+								   U32 flags)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_readdir",
+								   I32,
+								   wasi_fd_readdir,
+								   ErrNo::enosys,
+								   I32 fd,
+								   U32 bufferAddress,
+								   U32 numBufferBytes,
+								   U64 cookie,
+								   U32 numUsedBytesAddress)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "fd_renumber",
+								   I32,
+								   wasi_fd_renumber,
+								   ErrNo::enosys,
+								   I32 fromFD,
+								   I32 toFD)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "path_filestat_get",
+								   I32,
+								   wasi_path_filestat_get,
+								   ErrNo::enosys,
+								   I32 dirFD,
+								   U32 lookupFlags,
+								   U32 pathAddress,
+								   U32 numPathBytes,
+								   U32 filestatAddress)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "path_filestat_set_times",
+								   I32,
+								   wasi_path_filestat_set_times,
+								   ErrNo::enosys,
+								   I32 dirFD,
+								   U32 lookupFlags,
+								   U32 pathAddress,
+								   U32 numPathBytes,
+								   U64 lastAccessTime,
+								   U64 lastWriteTime,
+								   U32 flags)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "path_link",
+								   I32,
+								   wasi_path_link,
+								   ErrNo::enosys,
+								   I32 oldDirFD,
+								   U32 oldLookupFlags,
+								   U32 oldPathAddress,
+								   U32 numOldPathBytes,
+								   I32 newDirFD,
+								   U32 newPathAddress,
+								   U32 numNewPathBytes)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "path_readlink",
+								   I32,
+								   wasi_path_readlink,
+								   ErrNo::enosys,
+								   I32 dirFD,
+								   U32 pathAddress,
+								   U32 numPathBytes,
+								   U32 bufferAddress,
+								   U32 numBufferBytes,
+								   U32 numUsedBytesAddress)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "path_rename",
+								   I32,
+								   wasi_path_rename,
+								   ErrNo::enosys,
+								   I32 oldDirFD,
+								   U32 oldPathAddress,
+								   U32 numOldPathBytes,
+								   I32 newDirFD,
+								   U32 newPathAddress,
+								   U32 numNewPathBytes)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "path_symlink",
+								   I32,
+								   wasi_path_symlink,
+								   ErrNo::enosys,
+								   U32 oldPathAddress,
+								   U32 numOldPathBytes,
+								   I32 dirFD,
+								   U32 newPathAddress,
+								   U32 numNewPathBytes)
+DEFINE_CONSTANT_INTRINSIC_FUNCTION(wasi,
+								   "proc_raise",
+								   I32,
+								   wasi_proc_raise,
+								   ErrNo::enosys,
+								   U32 signal)
+
+static void addStdioFD(Process* process, I32 fd)
+{
+	FD stdioFD;
+	stdioFD.hostFD = fd;
+	stdioFD.fileType = getHostFDFileType(fd);
+	stdioFD.rights = getMaxRights(stdioFD.fileType);
+	stdioFD.inheritingRights = 0;
+	stdioFD.isOwned = false;
+	process->fds.insertOrFail(fd, std::move(stdioFD));
+}
+
+Process* WASI::createProcess(
+	Compartment* compartment,
+	std::vector<std::string>&& args,
+	std::vector<std::string>&& env,
+	const std::vector<std::pair<std::string, std::string>>& preopenedDirectories)
+{
+	Process* process = new Process;
+	process->compartment = compartment;
+	process->args = std::move(args);
+	process->env = std::move(env);
+
+	addStdioFD(process, 0);
+	addStdioFD(process, 1);
+	addStdioFD(process, 2);
+
+	for(const auto& preopenedDirectory : preopenedDirectories)
+	{
+		const int hostFD
+			= open(preopenedDirectory.second.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(hostFD < 0)
+		{
+			Log::printf(Log::error,
+						"Couldn't open directory %s: %s\n",
+						preopenedDirectory.second.c_str(),
+						strerror(errno));
+			destroyProcess(process);
+			return nullptr;
+		}
+
+		FD dirFD;
+		dirFD.hostFD = hostFD;
+		dirFD.fileType = FileType::directoryFileType;
+		dirFD.rights = directoryRights;
+		dirFD.inheritingRights = allRights;
+		dirFD.preopenedName = preopenedDirectory.first;
+		dirFD.isOwned = true;
+		process->fds.insertOrFail(I32(process->fds.size()), std::move(dirFD));
+	}
+
+	process->ioQueue = createIOQueue();
+	process->randomFD = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+	{
+		Lock<Platform::Mutex> processesLock(processesMutex);
+		errorUnless(processes.add(compartment, process));
+	}
+
+	process->moduleInstance
+		= Intrinsics::instantiateModule(compartment, INTRINSIC_MODULE_REF(wasi), "wasi_unstable");
+	return process;
+}
+
+void WASI::destroyProcess(Process* process)
+{
+	{
+		Lock<Platform::Mutex> processesLock(processesMutex);
+		Process* const* registeredProcess = processes.get(process->compartment);
+		if(registeredProcess && *registeredProcess == process)
+		{ processes.removeOrFail(process->compartment); }
+	}
+
+	for(const FD& fd : process->fds)
+	{
+		if(fd.isOwned) { close(fd.hostFD); }
+	}
+	if(process->randomFD >= 0) { close(process->randomFD); }
+	if(process->ioQueue) { destroyIOQueue(process->ioQueue); }
+	delete process;
+}
+
+ModuleInstance* WASI::getProcessModuleInstance(Process* process)
+{
+	return process->moduleInstance;
+}
+
+void WASI::setProcessMemory(Process* process, MemoryInstance* memory)
+{
+	process->memory = memory;
+}
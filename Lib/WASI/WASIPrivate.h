@@ -0,0 +1,39 @@
+#pragma once
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "WAVM/Inline/BasicTypes.h"
+
+namespace WAVM { namespace WASI {
+	// A queue that a process's file and socket I/O is submitted through. On Linux kernels that
+	// support it, the queue is an io_uring ring, so each operation is one io_uring_enter call
+	// however many buffers it transfers. Otherwise, the operations are forwarded to the equivalent
+	// system calls.
+	//
+	// The operations block until they complete, and return the number of bytes transferred, or a
+	// negated host errno. The iovecs may point directly into a WebAssembly memory: the data isn't
+	// copied through an intermediate buffer.
+	struct IOQueue;
+
+	// If allowRing is false, the queue always forwards the operations to the system calls.
+	IOQueue* createIOQueue(bool allowRing = true);
+	void destroyIOQueue(IOQueue* queue);
+
+	// Returns whether the operations are submitted through an io_uring ring.
+	bool isIOQueueUsingRing(IOQueue* queue);
+
+	// If offset is negative, reads and writes from the descriptor's current position.
+	I64 submitReadv(IOQueue* queue, int fd, const iovec* iovs, U32 numIOVs, I64 offset);
+	I64 submitWritev(IOQueue* queue, int fd, const iovec* iovs, U32 numIOVs, I64 offset);
+	I64 submitFsync(IOQueue* queue, int fd, bool onlyData);
+	I64 submitSendmsg(IOQueue* queue, int fd, const msghdr* message, int flags);
+	I64 submitRecvmsg(IOQueue* queue, int fd, msghdr* message, int flags);
+
+	// Waits for any of the descriptors to have one of its requested events, like poll. Returns the
+	// number of descriptors with returned events, which is 0 if the timeout expired. A single
+	// descriptor without a timeout is polled through the ring; other polls are forwarded to the
+	// system call.
+	I64 submitPoll(IOQueue* queue, pollfd* fds, U32 numFDs, I32 timeoutMilliseconds);
+}}
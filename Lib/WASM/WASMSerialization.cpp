@@ -1,4 +1,7 @@
 #include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,9 +14,17 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
 #include "WAVM/Inline/Unicode.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Logging/Metrics.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/WASM/WASM.h"
 
 using namespace WAVM;
@@ -108,9 +119,13 @@ namespace WAVM { namespace IR {
 	}
 
 	template<typename Stream>
-	void serialize(Stream& stream, SizeConstraints& sizeConstraints, bool hasMax)
+	void serialize(Stream& stream, SizeConstraints& sizeConstraints, bool hasMax, bool is64 = false)
 	{
-		serializeVarUInt32(stream, sizeConstraints.min);
+		if(is64) { serializeVarUInt64(stream, sizeConstraints.min); }
+		else
+		{
+			serializeVarUInt32(stream, sizeConstraints.min);
+		}
 		if(hasMax) { serializeVarUInt64(stream, sizeConstraints.max); }
 		else if(Stream::isInput)
 		{
@@ -161,9 +176,14 @@ namespace WAVM { namespace IR {
 		Uptr flags = 0;
 		if(!Stream::isInput && memoryType.size.max != UINT64_MAX) { flags |= 0x01; }
 		if(!Stream::isInput && memoryType.isShared) { flags |= 0x02; }
+		if(!Stream::isInput && memoryType.indexType == IndexType::i64) { flags |= 0x04; }
 		serializeVarUInt32(stream, flags);
-		if(Stream::isInput) { memoryType.isShared = (flags & 0x02) != 0; }
-		serialize(stream, memoryType.size, flags & 0x01);
+		if(Stream::isInput)
+		{
+			memoryType.isShared = (flags & 0x02) != 0;
+			memoryType.indexType = (flags & 0x04) ? IndexType::i64 : IndexType::i32;
+		}
+		serialize(stream, memoryType.size, flags & 0x01, flags & 0x04);
 	}
 
 	template<typename Stream> void serialize(Stream& stream, GlobalType& globalType)
@@ -446,17 +466,38 @@ template<typename Stream> void serialize(Stream& stream, CallIndirectImm& imm, c
 	serializeVarUInt32(stream, imm.tableIndex);
 }
 
+// The alignment field of a load or store's immediates has this flag set if it is followed by a
+// memory index. Otherwise, the operator accesses the default memory.
+static constexpr U8 memoryIndexAlignmentFlag = 0x40;
+
+template<typename Stream>
+void serializeMemoryAccess(Stream& stream, U8& alignmentLog2, U64& offset, Uptr& memoryIndex)
+{
+	U8 alignmentFlags = alignmentLog2;
+	if(!Stream::isInput && memoryIndex != 0) { alignmentFlags |= memoryIndexAlignmentFlag; }
+	serializeVarUInt7(stream, alignmentFlags);
+	if(Stream::isInput)
+	{
+		alignmentLog2 = alignmentFlags & ~memoryIndexAlignmentFlag;
+		memoryIndex = 0;
+	}
+	if(alignmentFlags & memoryIndexAlignmentFlag) { serializeVarUInt32(stream, memoryIndex); }
+	serializeVarUInt64(stream, offset);
+}
+
 template<typename Stream, Uptr naturalAlignmentLog2>
 void serialize(Stream& stream, LoadOrStoreImm<naturalAlignmentLog2>& imm, const FunctionDef&)
 {
-	serializeVarUInt7(stream, imm.alignmentLog2);
-	serializeVarUInt32(stream, imm.offset);
+	serializeMemoryAccess(stream, imm.alignmentLog2, imm.offset, imm.memoryIndex);
 }
 template<typename Stream> void serialize(Stream& stream, MemoryImm& imm, const FunctionDef&)
 {
-	serializeConstant(
-		stream, "memory.(grow|size|copy|fill) immediate reserved field must be 0", U8(0));
-	if(Stream::isInput) { imm.memoryIndex = 0; }
+	serializeVarUInt32(stream, imm.memoryIndex);
+}
+template<typename Stream> void serialize(Stream& stream, MemoryCopyImm& imm, const FunctionDef&)
+{
+	serializeVarUInt32(stream, imm.destMemoryIndex);
+	serializeVarUInt32(stream, imm.sourceMemoryIndex);
 }
 template<typename Stream> void serialize(Stream& stream, TableImm& imm, const FunctionDef&)
 {
@@ -484,8 +525,7 @@ void serialize(Stream& stream, ShuffleImm<numLanes>& imm, const FunctionDef&)
 template<typename Stream, Uptr naturalAlignmentLog2>
 void serialize(Stream& stream, AtomicLoadOrStoreImm<naturalAlignmentLog2>& imm, const FunctionDef&)
 {
-	serializeVarUInt7(stream, imm.alignmentLog2);
-	serializeVarUInt32(stream, imm.offset);
+	serializeMemoryAccess(stream, imm.alignmentLog2, imm.offset, imm.memoryIndex);
 }
 
 template<typename Stream> void serialize(Stream& stream, ExceptionTypeImm& imm, const FunctionDef&)
@@ -528,36 +568,141 @@ void serialize(Stream& stream, LiteralImm<Value>& imm, const FunctionDef&)
 	serialize(stream, imm.value);
 }
 
+// Returns the number of bytes in the LEB128 encoding of an unsigned integer.
+static Uptr getVarUIntNumBytes(U64 value)
+{
+	Uptr numBytes = 1;
+	while(value >= 0x80)
+	{
+		value >>= 7;
+		++numBytes;
+	};
+	return numBytes;
+}
+
+// Serializes a varuint32 byte count followed by the bytes written by serializeBody, which are
+// written directly to the stream instead of to a temporary stream. Space is reserved for the count
+// as it would be encoded for estimatedNumBytes, and the bytes are moved once they are written only
+// if the count's encoding has a different number of bytes.
+template<typename SerializeBody>
+static void serializeSizePrefixed(ArrayOutputStream& stream,
+								  Uptr estimatedNumBytes,
+								  SerializeBody serializeBody)
+{
+	const Uptr sizeOffset = stream.getNumBytes();
+	const Uptr numReservedSizeBytes = getVarUIntNumBytes(estimatedNumBytes);
+	stream.advance(numReservedSizeBytes);
+	serializeBody(stream);
+	Uptr numBodyBytes = stream.getNumBytes() - sizeOffset - numReservedSizeBytes;
+
+	const Uptr numSizeBytes = getVarUIntNumBytes(numBodyBytes);
+	if(numSizeBytes != numReservedSizeBytes)
+	{
+		if(numSizeBytes > numReservedSizeBytes)
+		{ stream.advance(numSizeBytes - numReservedSizeBytes); }
+		U8* bodyBytes = stream.getWrittenBytes() + sizeOffset;
+		memmove(bodyBytes + numSizeBytes, bodyBytes + numReservedSizeBytes, numBodyBytes);
+	}
+
+	stream.rewind(sizeOffset);
+	serializeVarUInt32(stream, numBodyBytes);
+	stream.advance(numBodyBytes);
+}
+
+// Writes bytes to a stream in chunks of at most maxChunkBytes, so a stream that buffers its output
+// (e.g. FileOutputStream) doesn't need a buffer as large as the bytes.
+static void serializeBytesInChunks(OutputStream& stream, const U8* bytes, Uptr numBytes)
+{
+	static constexpr Uptr maxChunkBytes = 64 * 1024;
+	while(numBytes)
+	{
+		const Uptr numChunkBytes = std::min(numBytes, maxChunkBytes);
+		serializeBytes(stream, bytes, numChunkBytes);
+		bytes += numChunkBytes;
+		numBytes -= numChunkBytes;
+	};
+}
+
 template<typename SerializeSection>
 void serializeSection(OutputStream& stream, SectionType type, SerializeSection serializeSectionBody)
 {
 	serialize(stream, type);
 	ArrayOutputStream sectionStream;
 	serializeSectionBody(sectionStream);
-	std::vector<U8> sectionBytes = sectionStream.getBytes();
-	Uptr sectionNumBytes = sectionBytes.size();
+	Uptr sectionNumBytes = sectionStream.getNumBytes();
 	serializeVarUInt32(stream, sectionNumBytes);
-	serializeBytes(stream, sectionBytes.data(), sectionBytes.size());
+	serializeBytesInChunks(stream, sectionStream.getWrittenBytes(), sectionNumBytes);
 }
 template<typename SerializeSection>
 void serializeSection(InputStream& stream, SectionType type, SerializeSection serializeSectionBody)
 {
 	Uptr numSectionBytes = 0;
 	serializeVarUInt32(stream, numSectionBytes);
-	MemoryInputStream sectionStream(stream.advance(numSectionBytes), numSectionBytes);
+	MemoryInputStream sectionStream(
+		stream.advance(numSectionBytes), numSectionBytes, stream.getBytesOwner());
 	serializeSectionBody(sectionStream);
 	if(sectionStream.capacity())
 	{ throw FatalSerializationException("section contained more data than expected"); }
 }
 
+// An input stream that reads a fixed number of bytes from a parent stream without requiring them
+// to be buffered contiguously, so the bytes can be decoded as soon as the parent stream has them.
+struct BoundedInputStream : InputStream
+{
+	BoundedInputStream(InputStream& inParent, Uptr numBytes)
+	: InputStream(nullptr, nullptr, inParent.getBytesOwner())
+	, parent(inParent)
+	, bufferBegin(nullptr)
+	, numUnbufferedBytes(numBytes)
+	{
+	}
+
+	virtual Uptr capacity() const { return Uptr(end - next) + numUnbufferedBytes; }
+
+	// Advances the parent stream past the bytes that have been read from this stream. The parent
+	// stream must not be read from again until this is called.
+	void finish() { releaseBuffer(); }
+
+private:
+	InputStream& parent;
+	const U8* bufferBegin;
+	Uptr numUnbufferedBytes;
+
+	void releaseBuffer()
+	{
+		if(bufferBegin)
+		{
+			parent.advance(Uptr(next - bufferBegin));
+			numUnbufferedBytes += Uptr(end - next);
+			bufferBegin = next = end = nullptr;
+		}
+	}
+
+	virtual void getMoreData(Uptr numBytes)
+	{
+		// Give back the unread part of the current buffer, and peek a new buffer from the parent
+		// stream that includes as many of the bytes as it has buffered.
+		releaseBuffer();
+		if(numBytes > numUnbufferedBytes)
+		{ throw FatalSerializationException("expected data but found end of section"); }
+		const Uptr numBufferBytes
+			= std::min(numUnbufferedBytes, std::max(numBytes, parent.getNumBufferedBytes()));
+		bufferBegin = next = parent.peek(numBufferBytes);
+		end = next + numBufferBytes;
+		numUnbufferedBytes -= numBufferBytes;
+	}
+};
+
 static void serialize(OutputStream& stream, UserSection& userSection)
 {
+	// The size of a user section can be computed from its name and data, so they are written
+	// directly to the stream after it.
 	serialize(stream, SectionType::user);
-	ArrayOutputStream sectionStream;
-	serialize(sectionStream, userSection.name);
-	serializeBytes(sectionStream, userSection.data.data(), userSection.data.size());
-	std::vector<U8> sectionBytes = sectionStream.getBytes();
-	serialize(stream, sectionBytes);
+	Uptr sectionNumBytes = getVarUIntNumBytes(userSection.name.size()) + userSection.name.size()
+						   + userSection.data.size();
+	serializeVarUInt32(stream, sectionNumBytes);
+	serialize(stream, userSection.name);
+	serializeBytesInChunks(stream, userSection.data.data(), userSection.data.size());
 }
 
 static void serialize(InputStream& stream, UserSection& userSection)
@@ -565,11 +710,11 @@ static void serialize(InputStream& stream, UserSection& userSection)
 	Uptr numSectionBytes = 0;
 	serializeVarUInt32(stream, numSectionBytes);
 
-	MemoryInputStream sectionStream(stream.advance(numSectionBytes), numSectionBytes);
+	MemoryInputStream sectionStream(
+		stream.advance(numSectionBytes), numSectionBytes, stream.getBytesOwner());
 	serialize(sectionStream, userSection.name);
 	throwIfNotValidUTF8(userSection.name);
-	userSection.data.resize(sectionStream.capacity());
-	serializeBytes(sectionStream, userSection.data.data(), userSection.data.size());
+	serializeBytes(sectionStream, userSection.data, sectionStream.capacity());
 	wavmAssert(!sectionStream.capacity());
 }
 
@@ -611,12 +756,10 @@ private:
 	FunctionDef& functionDef;
 };
 
-static void serializeFunctionBody(OutputStream& sectionStream,
+static void serializeFunctionBody(OutputStream& bodyStream,
 								  Module& module,
 								  FunctionDef& functionDef)
 {
-	ArrayOutputStream bodyStream;
-
 	// Convert the function's local types into LocalSets: runs of locals of the same type.
 	LocalSet* localSets
 		= (LocalSet*)alloca(sizeof(LocalSet) * functionDef.nonParameterLocalTypes.size());
@@ -646,15 +789,15 @@ static void serializeFunctionBody(OutputStream& sectionStream,
 	// Serialize the function code.
 	OperatorDecoderStream irDecoderStream(functionDef.code);
 	OperatorSerializerStream wasmOpEncoderStream(bodyStream, functionDef);
-	while(irDecoderStream) { irDecoderStream.decodeOp(wasmOpEncoderStream); };
-
-	std::vector<U8> bodyBytes = bodyStream.getBytes();
-	serialize(sectionStream, bodyBytes);
+	irDecoderStream.decodeAll(wasmOpEncoderStream);
 }
 
+// Decodes a function body, and writes its code in the IR format to irCodeByteStream.
 static void serializeFunctionBody(InputStream& sectionStream,
 								  Module& module,
-								  FunctionDef& functionDef)
+								  FunctionDef& functionDef,
+								  bool validate,
+								  OutputStream& irCodeByteStream)
 {
 	Uptr numBodyBytes = 0;
 	serializeVarUInt32(sectionStream, numBodyBytes);
@@ -670,14 +813,15 @@ static void serializeFunctionBody(InputStream& sectionStream,
 		serialize(bodyStream, localSet);
 		if(functionDef.nonParameterLocalTypes.size() + localSet.num >= module.featureSpec.maxLocals)
 		{ throw FatalSerializationException("too many locals"); }
-		for(Uptr index = 0; index < localSet.num; ++index)
-		{ functionDef.nonParameterLocalTypes.push_back(localSet.type); }
+		functionDef.nonParameterLocalTypes.insert(
+			functionDef.nonParameterLocalTypes.end(), localSet.num, localSet.type);
 	}
 
-	// Deserialize the function code, validate it, and re-encode it in the IR format.
-	ArrayOutputStream irCodeByteStream;
+	// Deserialize the function code, validate it (unless validate is false, in which case the
+	// caller must validate it later), and re-encode it in the IR format.
 	OperatorEncoderStream irEncoderStream(irCodeByteStream);
-	CodeValidationStream codeValidationStream(module, functionDef);
+	std::unique_ptr<CodeValidationStream> codeValidationStream;
+	if(validate) { codeValidationStream.reset(new CodeValidationStream(module, functionDef)); }
 	while(bodyStream.capacity())
 	{
 		Opcode opcode;
@@ -689,7 +833,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 	{                                                                                              \
 		Imm imm;                                                                                   \
 		serialize(bodyStream, imm, functionDef);                                                   \
-		codeValidationStream.name(imm);                                                            \
+		if(validate) { codeValidationStream->name(imm); }                                          \
 		irEncoderStream.name(imm);                                                                 \
 		break;                                                                                     \
 	}
@@ -698,9 +842,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 		default: throw FatalSerializationException("unknown opcode");
 		};
 	};
-	codeValidationStream.finish();
-
-	functionDef.code = std::move(irCodeByteStream.getBytes());
+	if(validate) { codeValidationStream->finish(); }
 }
 
 template<typename Stream> void serializeTypeSection(Stream& moduleStream, Module& module)
@@ -920,22 +1062,102 @@ template<typename Stream> void serializeElementSection(Stream& moduleStream, Mod
 	});
 }
 
-template<typename Stream> void serializeCodeSection(Stream& moduleStream, Module& module)
+static void serializeCodeSection(OutputStream& moduleStream, Module& module)
 {
 	serializeSection(
-		moduleStream, SectionType::functionDefinitions, [&module](Stream& sectionStream) {
+		moduleStream, SectionType::functionDefinitions, [&module](ArrayOutputStream& sectionStream) {
 			Uptr numFunctionBodies = module.functions.defs.size();
 			serializeVarUInt32(sectionStream, numFunctionBodies);
-			if(Stream::isInput && numFunctionBodies != module.functions.defs.size())
+
+			// Write each function body directly to the section stream. The IR code is usually
+			// about as large as the body's binary encoding, so it's used to estimate the size of
+			// the body's size prefix.
+			for(FunctionDef& functionDef : module.functions.defs)
 			{
-				throw FatalSerializationException(
-					"function and code sections have mismatched function counts");
+				serializeSizePrefixed(
+					sectionStream, functionDef.code.size(), [&](ArrayOutputStream& bodyStream) {
+						serializeFunctionBody(bodyStream, module, functionDef);
+					});
 			}
-			for(FunctionDef& functionDef : module.functions.defs)
-			{ serializeFunctionBody(sectionStream, module, functionDef); }
 		});
 }
 
+static void serializeCodeSection(InputStream& moduleStream,
+								 Module& module,
+								 const std::function<void(Uptr)>& onFunctionDefDecoded,
+								 Uptr numValidationThreads)
+{
+	// Decode the function bodies from the module stream without first reading the whole section,
+	// so each function definition can be passed to onFunctionDefDecoded as soon as its body has
+	// been read.
+	Uptr numSectionBytes = 0;
+	serializeVarUInt32(moduleStream, numSectionBytes);
+	BoundedInputStream sectionStream(moduleStream, numSectionBytes);
+
+	Uptr numFunctionBodies = 0;
+	serializeVarUInt32(sectionStream, numFunctionBodies);
+	if(numFunctionBodies != module.functions.defs.size())
+	{
+		throw FatalSerializationException(
+			"function and code sections have mismatched function counts");
+	}
+
+	// Unless each function definition must be validated before it is passed to
+	// onFunctionDefDecoded, validation with more than one thread is deferred until all the
+	// function bodies are decoded, and then done in parallel.
+	const bool validateInParallel = numValidationThreads != 1 && !onFunctionDefDecoded;
+
+	// Unless each function definition's code must be usable as soon as it is decoded, write the
+	// code of all the function definitions to a single array, so it is stored in one allocation
+	// instead of one per function definition.
+	ArrayOutputStream irCodeByteStream;
+	std::vector<Uptr> codeEndOffsets;
+	if(!onFunctionDefDecoded) { codeEndOffsets.reserve(numFunctionBodies); }
+
+	for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionBodies; ++functionDefIndex)
+	{
+		FunctionDef& functionDef = module.functions.defs[functionDefIndex];
+		if(onFunctionDefDecoded)
+		{
+			ArrayOutputStream functionCodeByteStream;
+			serializeFunctionBody(
+				sectionStream, module, functionDef, !validateInParallel, functionCodeByteStream);
+			functionDef.code = functionCodeByteStream.getBytes();
+			onFunctionDefDecoded(functionDefIndex);
+		}
+		else
+		{
+			serializeFunctionBody(
+				sectionStream, module, functionDef, !validateInParallel, irCodeByteStream);
+			codeEndOffsets.push_back(irCodeByteStream.getNumBytes());
+		}
+	}
+
+	if(sectionStream.capacity())
+	{ throw FatalSerializationException("section contained more data than expected"); }
+	sectionStream.finish();
+
+	if(!onFunctionDefDecoded)
+	{
+		std::vector<U8> codeBytesVector = irCodeByteStream.getBytes();
+		codeBytesVector.shrink_to_fit();
+		const SharedBytes codeBytes(std::move(codeBytesVector));
+
+		Uptr codeBeginOffset = 0;
+		for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionBodies; ++functionDefIndex)
+		{
+			const Uptr codeEndOffset = codeEndOffsets[functionDefIndex];
+			module.functions.defs[functionDefIndex].code
+				= SharedBytes(codeBytes.data() + codeBeginOffset,
+							  codeEndOffset - codeBeginOffset,
+							  codeBytes.getOwner());
+			codeBeginOffset = codeEndOffset;
+		}
+	}
+
+	if(validateInParallel) { IR::validateFunctionDefs(module, numValidationThreads); }
+}
+
 template<typename Stream>
 void serializeDataDeclarationsSection(Stream& moduleStream, Module& module)
 {
@@ -1034,7 +1256,27 @@ static void serializeModule(OutputStream& moduleStream, Module& module)
 	for(auto& userSection : module.userSections) { serialize(moduleStream, userSection); }
 }
 
-static void serializeModule(InputStream& moduleStream, Module& module)
+// Skips the code section, checking only that it defines the declared number of function bodies.
+static void skipCodeSection(InputStream& moduleStream, Module& module)
+{
+	Uptr numSectionBytes = 0;
+	serializeVarUInt32(moduleStream, numSectionBytes);
+	MemoryInputStream sectionStream(moduleStream.advance(numSectionBytes), numSectionBytes);
+
+	Uptr numFunctionBodies = 0;
+	serializeVarUInt32(sectionStream, numFunctionBodies);
+	if(numFunctionBodies != module.functions.defs.size())
+	{
+		throw FatalSerializationException(
+			"function and code sections have mismatched function counts");
+	}
+}
+
+static void serializeModule(InputStream& moduleStream,
+							Module& module,
+							const std::function<void(Uptr)>& onFunctionDefDecoded,
+							Uptr numValidationThreads,
+							bool decodeFunctionBodies = true)
 {
 	serializeConstant(moduleStream, "magic number", U32(magicNumber));
 	serializeConstant(moduleStream, "version", U32(currentVersion));
@@ -1095,7 +1337,12 @@ static void serializeModule(InputStream& moduleStream, Module& module)
 			IR::validateElemSegments(module);
 			break;
 		case SectionType::functionDefinitions:
-			serializeCodeSection(moduleStream, module);
+			if(!decodeFunctionBodies) { skipCodeSection(moduleStream, module); }
+			else
+			{
+				serializeCodeSection(
+					moduleStream, module, onFunctionDefDecoded, numValidationThreads);
+			}
 			hadFunctionDefinitions = true;
 			break;
 		case SectionType::data:
@@ -1136,11 +1383,227 @@ static void serializeModule(InputStream& moduleStream, Module& module)
 	}
 }
 
-void WASM::serialize(Serialization::InputStream& stream, Module& module)
+static Metrics::Histogram decodeTimeHistogram(
+	"wasm.decode_us",
+	"Time to decode and validate a binary WebAssembly module in microseconds");
+
+void WASM::serialize(Serialization::InputStream& stream,
+					 Module& module,
+					 Uptr numValidationThreads)
 {
-	serializeModule(stream, module);
+	Timing::Timer decodeTimer;
+	serializeModule(stream, module, nullptr, numValidationThreads);
+	decodeTimeHistogram.record(decodeTimer.getMicroseconds());
+}
+void WASM::serializeDeclarations(Serialization::InputStream& stream, Module& module)
+{
+	serializeModule(stream, module, nullptr, 1, false);
 }
 void WASM::serialize(Serialization::OutputStream& stream, const Module& module)
 {
 	serializeModule(stream, const_cast<Module&>(module));
 }
+
+// An output stream that writes to a file in chunks of at least minFileWriteBytes.
+struct FileOutputStream : OutputStream
+{
+	static constexpr Uptr minFileWriteBytes = 4 * 1024 * 1024;
+
+	FileOutputStream(Platform::File* inFile) : file(inFile), writeFailed(false)
+	{
+		buffer.resize(minFileWriteBytes);
+		next = buffer.data();
+		end = buffer.data() + buffer.size();
+	}
+
+	// Writes the buffered bytes to the file, and returns false if any write to the file failed.
+	bool flush()
+	{
+		const Uptr numBufferedBytes = Uptr(next - buffer.data());
+		if(numBufferedBytes && !writeFailed
+		   && !Platform::writeFile(file, buffer.data(), numBufferedBytes))
+		{ writeFailed = true; }
+		next = buffer.data();
+		return !writeFailed;
+	}
+
+private:
+	Platform::File* file;
+	bool writeFailed;
+	std::vector<U8> buffer;
+
+	virtual void extendBuffer(Uptr numBytes)
+	{
+		flush();
+
+		// A single write larger than the buffer is rare, since large byte sequences are written
+		// in chunks, but grow the buffer to hold it.
+		if(numBytes > buffer.size()) { buffer.resize(numBytes); }
+		next = buffer.data();
+		end = buffer.data() + buffer.size();
+	}
+};
+
+bool WASM::serialize(Platform::File* file, const Module& module)
+{
+	FileOutputStream stream(file);
+	serializeModule(stream, const_cast<Module&>(module));
+	return stream.flush();
+}
+
+// An input stream that reads the bytes fed to a StreamingDecoder, and waits for more bytes to be
+// fed when it runs out of them.
+struct StreamingInputStream : InputStream
+{
+	StreamingInputStream() : InputStream(nullptr, nullptr), isEndOfStream(false) {}
+
+	virtual Uptr capacity() const
+	{
+		// The stream can't know how many bytes remain until it reaches the end, so wait until
+		// there is at least one byte, or the end of the stream is reached.
+		if(next == end) { const_cast<StreamingInputStream*>(this)->waitForBytes(1); }
+		return Uptr(end - next);
+	}
+
+	void feed(const U8* bytes, Uptr numBytes)
+	{
+		{
+			Lock<Platform::Mutex> fedBytesLock(fedBytesMutex);
+			wavmAssert(!isEndOfStream);
+			fedBytes.insert(fedBytes.end(), bytes, bytes + numBytes);
+		}
+		fedBytesEvent.signal();
+	}
+
+	void endStream()
+	{
+		{
+			Lock<Platform::Mutex> fedBytesLock(fedBytesMutex);
+			isEndOfStream = true;
+		}
+		fedBytesEvent.signal();
+	}
+
+private:
+	enum
+	{
+		waitTimeoutMicroseconds = 1000
+	};
+
+	Platform::Mutex fedBytesMutex;
+	Platform::Event fedBytesEvent;
+	std::vector<U8> fedBytes;
+	bool isEndOfStream;
+
+	// The buffers the stream has read from. The decoder may still refer to bytes it read from an
+	// earlier buffer, so they are kept until the stream is destroyed.
+	std::vector<std::unique_ptr<std::vector<U8>>> buffers;
+
+	// Waits until at least numBytes bytes after the cursor are buffered, or the end of the stream
+	// is reached.
+	void waitForBytes(Uptr numBytes)
+	{
+		while(true)
+		{
+			{
+				Lock<Platform::Mutex> fedBytesLock(fedBytesMutex);
+				const Uptr numBufferedBytes = Uptr(end - next);
+				if(numBufferedBytes < numBytes && fedBytes.size())
+				{
+					// Make a new buffer that contains the unread part of the current buffer
+					// followed by the bytes that have been fed since it was made.
+					std::unique_ptr<std::vector<U8>> buffer(new std::vector<U8>(next, end));
+					buffer->insert(buffer->end(), fedBytes.begin(), fedBytes.end());
+					fedBytes.clear();
+
+					next = buffer->data();
+					end = next + buffer->size();
+					buffers.push_back(std::move(buffer));
+				}
+
+				if(Uptr(end - next) >= numBytes || isEndOfStream) { return; }
+			}
+
+			// The event may be signaled before this thread waits on it, so only wait for a short
+			// time before checking for fed bytes again.
+			fedBytesEvent.wait(Platform::getMonotonicClock() + waitTimeoutMicroseconds);
+		}
+	}
+
+	virtual void getMoreData(Uptr numBytes)
+	{
+		waitForBytes(numBytes);
+		if(Uptr(end - next) < numBytes)
+		{ throw FatalSerializationException("expected data but found end of stream"); }
+	}
+};
+
+struct WASM::StreamingDecoder
+{
+	Module& module;
+	std::function<void(Uptr)> onFunctionDefDecoded;
+	StreamingInputStream stream;
+	Platform::Thread* thread;
+
+	// Written by the decoding thread, and read after it has been joined.
+	std::string errorMessage;
+
+	StreamingDecoder(Module& inModule, std::function<void(Uptr)>&& inOnFunctionDefDecoded)
+	: module(inModule), onFunctionDefDecoded(std::move(inOnFunctionDefDecoded)), thread(nullptr)
+	{
+	}
+};
+
+enum
+{
+	streamingDecodeThreadStackBytes = 1024 * 1024
+};
+
+static I64 streamingDecodeThreadEntry(void* decoderVoid)
+{
+	WASM::StreamingDecoder& decoder = *(WASM::StreamingDecoder*)decoderVoid;
+	try
+	{
+		serializeModule(decoder.stream, decoder.module, decoder.onFunctionDefDecoded, 1);
+		return 1;
+	}
+	catch(FatalSerializationException exception)
+	{
+		decoder.errorMessage
+			= "Error deserializing WebAssembly binary file:\n" + exception.message + "\n";
+	}
+	catch(IR::ValidationException exception)
+	{
+		decoder.errorMessage
+			= "Error validating WebAssembly binary file:\n" + exception.message + "\n";
+	}
+	catch(std::bad_alloc)
+	{
+		decoder.errorMessage = "Memory allocation failed: input is likely malformed\n";
+	}
+	return 0;
+}
+
+WASM::StreamingDecoder* WASM::createStreamingDecoder(
+	Module& outModule,
+	std::function<void(Uptr functionDefIndex)>&& onFunctionDefDecoded)
+{
+	StreamingDecoder* decoder = new StreamingDecoder(outModule, std::move(onFunctionDefDecoded));
+	decoder->thread = Platform::createThread(
+		streamingDecodeThreadStackBytes, streamingDecodeThreadEntry, decoder);
+	return decoder;
+}
+
+void WASM::feedStreamingDecoder(StreamingDecoder* decoder, const U8* bytes, Uptr numBytes)
+{
+	decoder->stream.feed(bytes, numBytes);
+}
+
+bool WASM::finishStreamingDecode(StreamingDecoder* decoder, Log::Category errorCategory)
+{
+	decoder->stream.endStream();
+	const bool succeeded = Platform::joinThread(decoder->thread) != 0;
+	if(!succeeded) { Log::printf(errorCategory, "%s", decoder->errorMessage.c_str()); }
+	delete decoder;
+	return succeeded;
+}
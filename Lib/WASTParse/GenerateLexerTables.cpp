@@ -0,0 +1,58 @@
+#include <string>
+
+#include "Lexer.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/CLI.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/NFA/NFA.h"
+
+#define DUMP_NFA_GRAPH 0
+#define DUMP_DFA_GRAPH 0
+
+using namespace WAVM;
+using namespace WAVM::WAST;
+
+// Translates the lexer's NFA to a DFA, and writes the DFA's tables to a C++ header that is
+// compiled into the lexer. This runs as part of the build, so processes that lex WAST don't need
+// to construct the DFA at startup.
+int main(int argc, char** argv)
+{
+	if(argc != 2)
+	{
+		Log::printf(Log::error, "Usage: GenerateLexerTables <output header>\n");
+		return EXIT_FAILURE;
+	}
+	const char* outputFilename = argv[1];
+
+	Timing::Timer timer;
+
+	NFA::Builder* nfaBuilder = createLexerNFA();
+
+	if(DUMP_NFA_GRAPH)
+	{
+		std::string nfaGraphVizString = NFA::dumpNFAGraphViz(nfaBuilder);
+		errorUnless(saveFile("nfaGraph.dot", nfaGraphVizString.data(), nfaGraphVizString.size()));
+	}
+
+	NFA::Machine nfaMachine(nfaBuilder);
+
+	if(DUMP_DFA_GRAPH)
+	{
+		std::string dfaGraphVizString = nfaMachine.dumpDFAGraphViz().c_str();
+		errorUnless(saveFile("dfaGraph.dot", dfaGraphVizString.data(), dfaGraphVizString.size()));
+	}
+
+	std::string tablesString;
+	tablesString += "// Generated by GenerateLexerTables from the NFA created by createLexerNFA.\n";
+	tablesString += "#pragma once\n";
+	tablesString += "// clang-format off\n";
+	tablesString += nfaMachine.dumpCPPTables("lexer");
+	tablesString += "// clang-format on\n";
+	if(!saveFile(outputFilename, tablesString.data(), tablesString.size()))
+	{ return EXIT_FAILURE; }
+
+	Timing::logTimer("generated lexer tables", timer);
+	return EXIT_SUCCESS;
+}
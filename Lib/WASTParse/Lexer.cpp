@@ -2,22 +2,27 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string>
-#include <tuple>
-#include <utility>
 
 #include "Lexer.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
-#include "WAVM/Inline/CLI.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/NFA/NFA.h"
-#include "WAVM/RegExp/RegExp.h"
+#include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/WASTParse/WASTParse.h"
 
-#define DUMP_NFA_GRAPH 0
-#define DUMP_DFA_GRAPH 0
+// The lexer's DFA tables are generated from createLexerNFA at build time by GenerateLexerTables.
+#include "LexerTables.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEXER_USE_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LEXER_USE_NEON 1
+#endif
 
 using namespace WAVM;
 using namespace WAVM::WAST;
@@ -34,8 +39,6 @@ const char* WAST::describeToken(TokenType tokenType)
 {
 	wavmAssert(tokenType < numTokenTypes);
 	static const char* tokenDescriptions[] = {
-// This ENUM_TOKENS must come before the literalTokenPairs definition that redefines
-// VISIT_OPERATOR_TOKEN.
 #define VISIT_TOKEN(name, description, _) description,
 		ENUM_TOKENS()
 #undef VISIT_TOKEN
@@ -49,122 +52,124 @@ struct StaticData
 	StaticData();
 };
 
-static NFA::StateIndex createTokenSeparatorPeekState(NFA::Builder* builder,
-													 NFA::StateIndex finalState)
+StaticData::StaticData()
+: nfaMachine(lexerCharToOffsetMap,
+			 lexerStateAndOffsetToNextStateMap,
+			 lexerNumClasses,
+			 lexerNumStates)
 {
-	NFA::CharSet tokenSeparatorCharSet;
-	tokenSeparatorCharSet.add(U8(' '));
-	tokenSeparatorCharSet.add(U8('\t'));
-	tokenSeparatorCharSet.add(U8('\r'));
-	tokenSeparatorCharSet.add(U8('\n'));
-	tokenSeparatorCharSet.add(U8('='));
-	tokenSeparatorCharSet.add(U8('('));
-	tokenSeparatorCharSet.add(U8(')'));
-	tokenSeparatorCharSet.add(U8(';'));
-	tokenSeparatorCharSet.add(0);
-	auto separatorState = addState(builder);
-	NFA::addEdge(builder,
-				 separatorState,
-				 tokenSeparatorCharSet,
-				 finalState | NFA::edgeDoesntConsumeInputFlag);
-	return separatorState;
 }
 
-static void addLiteralToNFA(const char* string,
-							NFA::Builder* builder,
-							NFA::StateIndex initialState,
-							NFA::StateIndex finalState)
+// Returns a pointer to the first character in [nextChar, end) that is a, b, c, or d, or end if
+// there isn't one. Where SSE2 or NEON are available, 16 characters are tested at a time.
+static const char* findFirstOf(const char* nextChar,
+							   const char* end,
+							   char a,
+							   char b,
+							   char c,
+							   char d)
 {
-	// Add the literal to the NFA, one character at a time, reusing existing states that are
-	// reachable by the same string.
-	for(const char* nextChar = string; *nextChar; ++nextChar)
+#if LEXER_USE_SSE2
+	const __m128i aChars = _mm_set1_epi8(a);
+	const __m128i bChars = _mm_set1_epi8(b);
+	const __m128i cChars = _mm_set1_epi8(c);
+	const __m128i dChars = _mm_set1_epi8(d);
+	while(end - nextChar >= 16)
 	{
-		NFA::StateIndex nextState = NFA::getNonTerminalEdge(builder, initialState, *nextChar);
-		if(nextState < 0 || nextChar[1] == 0)
-		{
-			nextState = nextChar[1] == 0 ? finalState : addState(builder);
-			NFA::addEdge(builder, initialState, NFA::CharSet(*nextChar), nextState);
-		}
-		initialState = nextState;
-	}
-}
-
-StaticData::StaticData()
-{
-	// clang-format off
-	static const std::pair<TokenType, const char*> regexpTokenPairs[] = {
-		{t_decimalInt, "[+\\-]?\\d+(_\\d+)*"},
-		{t_decimalFloat, "[+\\-]?\\d+(_\\d+)*\\.(\\d+(_\\d+)*)*([eE][+\\-]?\\d+(_\\d+)*)?"},
-		{t_decimalFloat, "[+\\-]?\\d+(_\\d+)*[eE][+\\-]?\\d+(_\\d+)*"},
-
-		{t_hexInt, "[+\\-]?0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*"},
-		{t_hexFloat, "[+\\-]?0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*\\.([\\da-fA-F]+(_[\\da-fA-F]+)*)*([pP][+\\-]?\\d+(_\\d+)*)?"},
-		{t_hexFloat, "[+\\-]?0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*[pP][+\\-]?\\d+(_\\d+)*"},
-
-		{t_floatNaN, "[+\\-]?nan(:0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*)?"},
-		{t_floatInf, "[+\\-]?inf"},
-
-		{t_string, "\"([^\"\n\\\\]*(\\\\([^0-9a-fA-Fu]|[0-9a-fA-F][0-9a-fA-F]|u\\{[0-9a-fA-F]+})))*\""},
-
-		{t_name, "\\$[a-zA-Z0-9\'_+*/~=<>!?@#$%&|:`.\\-\\^\\\\]+"},
+		const __m128i chars = _mm_loadu_si128((const __m128i*)nextChar);
+		const __m128i matches = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chars, aChars), _mm_cmpeq_epi8(chars, bChars)),
+			_mm_or_si128(_mm_cmpeq_epi8(chars, cChars), _mm_cmpeq_epi8(chars, dChars)));
+		const U32 matchMask = U32(_mm_movemask_epi8(matches));
+		if(matchMask) { return nextChar + Platform::countTrailingZeroes(matchMask); }
+		nextChar += 16;
 	};
-	// clang-format on
-
-	static const std::tuple<TokenType, const char*, bool> literalTokenTuples[]
-		= {std::make_tuple(t_leftParenthesis, "(", true),
-		   std::make_tuple(t_rightParenthesis, ")", true),
-		   std::make_tuple(t_equals, "=", true),
-
-#define VISIT_TOKEN(name, _, literalString) std::make_tuple(t_##name, literalString, false),
-		   ENUM_LITERAL_TOKENS()
-#undef VISIT_TOKEN
-
-#undef VISIT_OPERATOR_TOKEN
-#define VISIT_OPERATOR_TOKEN(_, name, nameString, ...) std::make_tuple(t_##name, nameString, false),
-			   ENUM_OPERATORS(VISIT_OPERATOR_TOKEN)
-#undef VISIT_OPERATOR_TOKEN
-		};
-
-	Timing::Timer timer;
-
-	NFA::Builder* nfaBuilder = NFA::createBuilder();
-
-	for(auto regexpTokenPair : regexpTokenPairs)
+#elif LEXER_USE_NEON
+	const uint8x16_t aChars = vdupq_n_u8(U8(a));
+	const uint8x16_t bChars = vdupq_n_u8(U8(b));
+	const uint8x16_t cChars = vdupq_n_u8(U8(c));
+	const uint8x16_t dChars = vdupq_n_u8(U8(d));
+	while(end - nextChar >= 16)
 	{
-		NFA::StateIndex finalState
-			= NFA::maximumTerminalStateIndex - (NFA::StateIndex)regexpTokenPair.first;
-		finalState = createTokenSeparatorPeekState(nfaBuilder, finalState);
-		RegExp::addToNFA(regexpTokenPair.second, nfaBuilder, 0, finalState);
-	}
-
-	for(auto literalTokenTuple : literalTokenTuples)
-	{
-		const TokenType tokenType = std::get<0>(literalTokenTuple);
-		const char* literalString = std::get<1>(literalTokenTuple);
-		const bool isTokenSeparator = std::get<2>(literalTokenTuple);
-
-		NFA::StateIndex finalState = NFA::maximumTerminalStateIndex - (NFA::StateIndex)tokenType;
-		if(!isTokenSeparator)
-		{ finalState = createTokenSeparatorPeekState(nfaBuilder, finalState); }
+		// If any of the 16 characters match, find the first match with the scalar loop below.
+		const uint8x16_t chars = vld1q_u8((const U8*)nextChar);
+		const uint8x16_t matches
+			= vorrq_u8(vorrq_u8(vceqq_u8(chars, aChars), vceqq_u8(chars, bChars)),
+					   vorrq_u8(vceqq_u8(chars, cChars), vceqq_u8(chars, dChars)));
+		if(vmaxvq_u8(matches)) { break; }
+		nextChar += 16;
+	};
+#endif
+	while(nextChar < end && *nextChar != a && *nextChar != b && *nextChar != c && *nextChar != d)
+	{ ++nextChar; };
+	return nextChar;
+}
 
-		addLiteralToNFA(literalString, nfaBuilder, 0, finalState);
-	}
+inline bool isHexDigit(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
 
-	if(DUMP_NFA_GRAPH)
+inline bool isTokenSeparatorChar(char c)
+{
+	// This must match the characters in createTokenSeparatorPeekState.
+	switch(c)
 	{
-		std::string nfaGraphVizString = NFA::dumpNFAGraphViz(nfaBuilder);
-		errorUnless(saveFile("nfaGraph.dot", nfaGraphVizString.data(), nfaGraphVizString.size()));
-	}
-
-	nfaMachine = NFA::Machine(nfaBuilder);
+	case ' ':
+	case '\t':
+	case '\r':
+	case '\n':
+	case '=':
+	case '(':
+	case ')':
+	case ';':
+	case 0: return true;
+	default: return false;
+	};
+}
 
-	if(DUMP_DFA_GRAPH)
+// Scans a quoted string token that starts at firstChar. Returns a pointer to the character
+// following the string if it is a valid string token, or null if it isn't, or if it contains a
+// null character. This is equivalent to feeding the string to the NFA, but scans runs of ordinary
+// characters in the string 16 at a time.
+static const char* scanString(const char* firstChar, const char* end)
+{
+	wavmAssert(*firstChar == '"');
+	const char* nextChar = firstChar + 1;
+	while(true)
 	{
-		std::string dfaGraphVizString = nfaMachine.dumpDFAGraphViz().c_str();
-		errorUnless(saveFile("dfaGraph.dot", dfaGraphVizString.data(), dfaGraphVizString.size()));
-	}
-
-	Timing::logTimer("built lexer tables", timer);
+		nextChar = findFirstOf(nextChar, end, '"', '\\', '\n', 0);
+		if(*nextChar == '\n' || *nextChar == 0) { return nullptr; }
+		else if(*nextChar == '"')
+		{
+			++nextChar;
+			return isTokenSeparatorChar(*nextChar) ? nextChar : nullptr;
+		}
+		else
+		{
+			// Escape sequences: \xx for two hex digits, \u{x+} for one or more hex digits, or a
+			// backslash followed by any other character.
+			const char escapeChar = nextChar[1];
+			if(escapeChar == 0) { return nullptr; }
+			else if(isHexDigit(escapeChar))
+			{
+				if(!isHexDigit(nextChar[2])) { return nullptr; }
+				nextChar += 3;
+			}
+			else if(escapeChar == 'u')
+			{
+				if(nextChar[2] != '{' || !isHexDigit(nextChar[3])) { return nullptr; }
+				nextChar += 4;
+				while(isHexDigit(*nextChar)) { ++nextChar; };
+				if(*nextChar != '}') { return nullptr; }
+				++nextChar;
+			}
+			else
+			{
+				nextChar += 2;
+			}
+		}
+	};
 }
 
 inline bool isRecoveryPointChar(char c)
@@ -205,6 +210,7 @@ Token* WAST::lex(const char* string, Uptr stringLength, LineInfo*& outLineInfo)
 	*nextLineStart++ = 0;
 
 	const char* nextChar = string;
+	const char* stringEnd = string + stringLength - 1;
 	while(true)
 	{
 		// Skip whitespace and comments (keeping track of newlines).
@@ -217,18 +223,14 @@ Token* WAST::lex(const char* string, Uptr stringLength, LineInfo*& outLineInfo)
 				if(nextChar[1] != ';') { goto doneSkippingWhitespace; }
 				else
 				{
-					nextChar += 2;
-					while(*nextChar)
+					// The comment ends at the next newline (which is consumed), or null character.
+					nextChar = findFirstOf(nextChar + 2, stringEnd, '\n', 0, 0, 0);
+					if(*nextChar == '\n')
 					{
-						if(*nextChar == '\n')
-						{
-							// Emit a line start for the newline.
-							*nextLineStart++ = U32(nextChar - string + 1);
-							++nextChar;
-							break;
-						}
+						// Emit a line start for the newline.
+						*nextLineStart++ = U32(nextChar - string + 1);
 						++nextChar;
-					};
+					}
 				}
 				break;
 			// Delimited (possibly multi-line) comments.
@@ -241,6 +243,10 @@ Token* WAST::lex(const char* string, Uptr stringLength, LineInfo*& outLineInfo)
 					U32 commentDepth = 1;
 					while(commentDepth)
 					{
+						// Skip to the next character that may start or end a nested comment,
+						// or is a newline.
+						nextChar = findFirstOf(nextChar, stringEnd, ';', '(', '\n', '\n');
+
 						if(nextChar[0] == ';' && nextChar[1] == ')')
 						{
 							--commentDepth;
@@ -251,7 +257,7 @@ Token* WAST::lex(const char* string, Uptr stringLength, LineInfo*& outLineInfo)
 							++commentDepth;
 							nextChar += 2;
 						}
-						else if(nextChar == string + stringLength - 1)
+						else if(nextChar == stringEnd)
 						{
 							// Emit an unterminated comment token.
 							nextToken->type = t_unterminatedComment;
@@ -288,6 +294,18 @@ Token* WAST::lex(const char* string, Uptr stringLength, LineInfo*& outLineInfo)
 		// Once we reach a non-whitespace, non-comment character, feed characters into the NFA
 		// until it reaches a terminal state.
 		nextToken->begin = U32(nextChar - string);
+		if(*nextChar == '"')
+		{
+			// Scan string tokens without the NFA, which would process them one character at a
+			// time. If the string isn't a valid token, fall back to the NFA to handle the error.
+			if(const char* stringTokenEnd = scanString(nextChar, stringEnd))
+			{
+				nextToken->type = t_string;
+				++nextToken;
+				nextChar = stringTokenEnd;
+				continue;
+			}
+		}
 		NFA::StateIndex terminalState = staticData.nfaMachine.feed(nextChar);
 		if(terminalState != NFA::unmatchedCharacterTerminal)
 		{
@@ -304,7 +322,6 @@ Token* WAST::lex(const char* string, Uptr stringLength, LineInfo*& outLineInfo)
 				++nextToken;
 
 				// Advance until a recovery point or the end of the string.
-				const char* stringEnd = string + stringLength - 1;
 				while(nextChar < stringEnd && !isRecoveryPointChar(*nextChar)) { ++nextChar; }
 			}
 			else
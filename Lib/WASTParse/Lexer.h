@@ -81,6 +81,10 @@
                                                                                                    \
 	ENUM_OPERATORS(VISIT_OPERATOR_TOKEN)
 
+namespace WAVM { namespace NFA {
+	struct Builder;
+}}
+
 namespace WAVM { namespace WAST {
 	enum TokenType : U16
 	{
@@ -108,6 +112,10 @@ namespace WAVM { namespace WAST {
 
 	const char* describeToken(TokenType tokenType);
 
+	// Creates a NFA that recognizes the tokens. Each token type's terminal state is
+	// NFA::maximumTerminalStateIndex minus the token type.
+	NFA::Builder* createLexerNFA();
+
 	TextFileLocus calcLocusFromOffset(const char* string,
 									  const LineInfo* lineInfo,
 									  Uptr charOffset);
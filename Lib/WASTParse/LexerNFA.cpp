@@ -0,0 +1,113 @@
+#include <tuple>
+#include <utility>
+
+#include "Lexer.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/NFA/NFA.h"
+#include "WAVM/RegExp/RegExp.h"
+
+using namespace WAVM;
+using namespace WAVM::WAST;
+
+static NFA::StateIndex createTokenSeparatorPeekState(NFA::Builder* builder,
+													 NFA::StateIndex finalState)
+{
+	NFA::CharSet tokenSeparatorCharSet;
+	tokenSeparatorCharSet.add(U8(' '));
+	tokenSeparatorCharSet.add(U8('\t'));
+	tokenSeparatorCharSet.add(U8('\r'));
+	tokenSeparatorCharSet.add(U8('\n'));
+	tokenSeparatorCharSet.add(U8('='));
+	tokenSeparatorCharSet.add(U8('('));
+	tokenSeparatorCharSet.add(U8(')'));
+	tokenSeparatorCharSet.add(U8(';'));
+	tokenSeparatorCharSet.add(0);
+	auto separatorState = addState(builder);
+	NFA::addEdge(builder,
+				 separatorState,
+				 tokenSeparatorCharSet,
+				 finalState | NFA::edgeDoesntConsumeInputFlag);
+	return separatorState;
+}
+
+static void addLiteralToNFA(const char* string,
+							NFA::Builder* builder,
+							NFA::StateIndex initialState,
+							NFA::StateIndex finalState)
+{
+	// Add the literal to the NFA, one character at a time, reusing existing states that are
+	// reachable by the same string.
+	for(const char* nextChar = string; *nextChar; ++nextChar)
+	{
+		NFA::StateIndex nextState = NFA::getNonTerminalEdge(builder, initialState, *nextChar);
+		if(nextState < 0 || nextChar[1] == 0)
+		{
+			nextState = nextChar[1] == 0 ? finalState : addState(builder);
+			NFA::addEdge(builder, initialState, NFA::CharSet(*nextChar), nextState);
+		}
+		initialState = nextState;
+	}
+}
+
+NFA::Builder* WAST::createLexerNFA()
+{
+	// clang-format off
+	static const std::pair<TokenType, const char*> regexpTokenPairs[] = {
+		{t_decimalInt, "[+\\-]?\\d+(_\\d+)*"},
+		{t_decimalFloat, "[+\\-]?\\d+(_\\d+)*\\.(\\d+(_\\d+)*)*([eE][+\\-]?\\d+(_\\d+)*)?"},
+		{t_decimalFloat, "[+\\-]?\\d+(_\\d+)*[eE][+\\-]?\\d+(_\\d+)*"},
+
+		{t_hexInt, "[+\\-]?0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*"},
+		{t_hexFloat, "[+\\-]?0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*\\.([\\da-fA-F]+(_[\\da-fA-F]+)*)*([pP][+\\-]?\\d+(_\\d+)*)?"},
+		{t_hexFloat, "[+\\-]?0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*[pP][+\\-]?\\d+(_\\d+)*"},
+
+		{t_floatNaN, "[+\\-]?nan(:0[xX][\\da-fA-F]+(_[\\da-fA-F]+)*)?"},
+		{t_floatInf, "[+\\-]?inf"},
+
+		{t_string, "\"([^\"\n\\\\]*(\\\\([^0-9a-fA-Fu]|[0-9a-fA-F][0-9a-fA-F]|u\\{[0-9a-fA-F]+})))*\""},
+
+		{t_name, "\\$[a-zA-Z0-9\'_+*/~=<>!?@#$%&|:`.\\-\\^\\\\]+"},
+	};
+	// clang-format on
+
+	static const std::tuple<TokenType, const char*, bool> literalTokenTuples[]
+		= {std::make_tuple(t_leftParenthesis, "(", true),
+		   std::make_tuple(t_rightParenthesis, ")", true),
+		   std::make_tuple(t_equals, "=", true),
+
+#define VISIT_TOKEN(name, _, literalString) std::make_tuple(t_##name, literalString, false),
+		   ENUM_LITERAL_TOKENS()
+#undef VISIT_TOKEN
+
+#undef VISIT_OPERATOR_TOKEN
+#define VISIT_OPERATOR_TOKEN(_, name, nameString, ...) std::make_tuple(t_##name, nameString, false),
+			   ENUM_OPERATORS(VISIT_OPERATOR_TOKEN)
+#undef VISIT_OPERATOR_TOKEN
+		};
+
+	NFA::Builder* nfaBuilder = NFA::createBuilder();
+
+	for(auto regexpTokenPair : regexpTokenPairs)
+	{
+		NFA::StateIndex finalState
+			= NFA::maximumTerminalStateIndex - (NFA::StateIndex)regexpTokenPair.first;
+		finalState = createTokenSeparatorPeekState(nfaBuilder, finalState);
+		RegExp::addToNFA(regexpTokenPair.second, nfaBuilder, 0, finalState);
+	}
+
+	for(auto literalTokenTuple : literalTokenTuples)
+	{
+		const TokenType tokenType = std::get<0>(literalTokenTuple);
+		const char* literalString = std::get<1>(literalTokenTuple);
+		const bool isTokenSeparator = std::get<2>(literalTokenTuple);
+
+		NFA::StateIndex finalState = NFA::maximumTerminalStateIndex - (NFA::StateIndex)tokenType;
+		if(!isTokenSeparator)
+		{ finalState = createTokenSeparatorPeekState(nfaBuilder, finalState); }
+
+		addLiteralToNFA(literalString, nfaBuilder, 0, finalState);
+	}
+
+	return nfaBuilder;
+}
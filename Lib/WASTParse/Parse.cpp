@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include <cstdarg>
 #include <cstdio>
 #include <string>
@@ -226,6 +227,7 @@ UnresolvedFunctionType WAST::parseFunctionTypeRefAndOrDecl(
 }
 
 IndexedFunctionType WAST::resolveFunctionType(ModuleState* moduleState,
+											  ParseState* parseState,
 											  const UnresolvedFunctionType& unresolvedType)
 {
 	if(!unresolvedType.reference)
@@ -233,7 +235,7 @@ IndexedFunctionType WAST::resolveFunctionType(ModuleState* moduleState,
 	else
 	{
 		// Resolve the referenced type.
-		const Uptr referencedFunctionTypeIndex = resolveRef(moduleState->parseState,
+		const Uptr referencedFunctionTypeIndex = resolveRef(parseState,
 															moduleState->typeNameToIndexMap,
 															moduleState->module.types.size(),
 															unresolvedType.reference);
@@ -249,7 +251,7 @@ IndexedFunctionType WAST::resolveFunctionType(ModuleState* moduleState,
 					  != unresolvedType.explicitType)
 			{
 				parseErrorf(
-					moduleState->parseState,
+					parseState,
 					unresolvedType.reference.token,
 					"referenced function type (%s) does not match declared parameters and "
 					"results (%s)",
@@ -265,6 +267,14 @@ IndexedFunctionType WAST::resolveFunctionType(ModuleState* moduleState,
 IndexedFunctionType WAST::getUniqueFunctionTypeIndex(ModuleState* moduleState,
 													 FunctionType functionType)
 {
+	// While function bodies are parsed in parallel, the type table may only be read.
+	if(moduleState->isParsingFunctionBodiesInParallel)
+	{
+		const Uptr* functionTypeIndex = moduleState->functionTypeToIndexMap.get(functionType);
+		if(!functionTypeIndex) { throw MissingFunctionTypeException(); }
+		return IndexedFunctionType{*functionTypeIndex};
+	}
+
 	// If this type is not in the module's type table yet, add it.
 	Uptr& functionTypeIndex
 		= moduleState->functionTypeToIndexMap.getOrAdd(functionType, UINTPTR_MAX);
@@ -532,7 +542,14 @@ bool WAST::tryParseString(CursorState* cursor, std::string& outString)
 			++cursor->nextToken;
 			assert(cursor->parseState->string + cursor->nextToken->begin > nextChar);
 			return true;
-		default: outString += *nextChar++; break;
+		default:
+		{
+			// Copy the characters up to the next escape code or the closing quote at once.
+			const Uptr numChars = strcspn(nextChar, "\\\"");
+			outString.append(nextChar, numChars);
+			nextChar += numChars;
+			break;
+		}
 		};
 	};
 }
@@ -2,6 +2,7 @@
 
 #include <string.h>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,6 +22,13 @@ namespace WAVM { namespace WAST {
 	{
 	};
 
+	// Thrown by getUniqueFunctionTypeIndex while function bodies are parsed in parallel, if the
+	// function type must be added to the module: the function body is parsed again afterwards, so
+	// the types are added in the same order as when the function bodies are parsed serially.
+	struct MissingFunctionTypeException
+	{
+	};
+
 	// Like WAST::Error, but only has an offset in the input string instead of a full
 	// TextFileLocus.
 	struct UnresolvedError
@@ -123,6 +131,17 @@ namespace WAVM { namespace WAST {
 		IR::FunctionType explicitType;
 	};
 
+	// A function definition whose locals and code are parsed after all declarations have been
+	// parsed.
+	struct DeferredFunctionBody
+	{
+		Uptr functionIndex;
+		Uptr functionDefIndex;
+		const Token* firstBodyToken;
+		std::shared_ptr<NameToIndexMap> localNameToIndexMap;
+		std::shared_ptr<std::vector<std::string>> localDisassemblyNames;
+	};
+
 	// State associated with parsing a module.
 	struct ModuleState
 	{
@@ -147,8 +166,15 @@ namespace WAVM { namespace WAST {
 		// Thunks that are called after parsing all declarations.
 		std::vector<std::function<void(ModuleState*)>> postDeclarationCallbacks;
 
+		// The function bodies, which are parsed after the post-declaration callbacks are called.
+		std::vector<DeferredFunctionBody> functionBodies;
+
+		// True while function bodies are parsed in parallel. The module's types may not be added
+		// to while it is set, so the other module state may be read concurrently.
+		bool isParsingFunctionBodiesInParallel;
+
 		ModuleState(ParseState* inParseState, IR::Module& inModule)
-		: parseState(inParseState), module(inModule)
+		: parseState(inParseState), module(inModule), isParsingFunctionBodiesInParallel(false)
 		{
 		}
 	};
@@ -197,6 +223,7 @@ namespace WAVM { namespace WAST {
 		NameToIndexMap& outLocalNameToIndexMap,
 		std::vector<std::string>& outLocalDisassemblyNames);
 	IR::IndexedFunctionType resolveFunctionType(ModuleState* moduleState,
+												ParseState* parseState,
 												const UnresolvedFunctionType& unresolvedType);
 	IR::IndexedFunctionType getUniqueFunctionTypeIndex(ModuleState* moduleState,
 													   IR::FunctionType functionType);
@@ -290,6 +317,11 @@ namespace WAVM { namespace WAST {
 	// Function parsing.
 	IR::FunctionDef parseFunctionDef(CursorState* cursor, const Token* funcToken);
 
+	// Parses the module's deferred function bodies. If numThreads is greater than one, they are
+	// parsed in parallel on that many threads; if it is zero, one thread is used for each hardware
+	// thread. The parsed module doesn't depend on the number of threads.
+	void parseFunctionBodies(ModuleState* moduleState, Uptr numThreads);
+
 	// Module parsing.
-	void parseModuleBody(CursorState* cursor, IR::Module& outModule);
+	void parseModuleBody(CursorState* cursor, IR::Module& outModule, Uptr numThreads = 1);
 }}
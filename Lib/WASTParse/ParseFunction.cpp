@@ -1,5 +1,7 @@
 #include <inttypes.h>
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <utility>
@@ -17,6 +19,7 @@
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Serialization.h"
 #include "WAVM/Platform/Intrinsic.h"
+#include "WAVM/Platform/Thread.h"
 
 using namespace WAVM;
 using namespace WAVM::IR;
@@ -153,7 +156,33 @@ static void parseAndValidateRedundantBranchTargetName(CursorState* cursor,
 }
 
 static void parseImm(CursorState* cursor, NoImm&) {}
-static void parseImm(CursorState* cursor, MemoryImm& outImm) { outImm.memoryIndex = 0; }
+static bool tryParseMemoryRef(CursorState* cursor, Uptr& outMemoryIndex)
+{
+	return tryParseAndResolveNameOrIndexRef(cursor,
+											cursor->moduleState->memoryNameToIndexMap,
+											cursor->moduleState->module.memories.size(),
+											"memory",
+											outMemoryIndex);
+}
+
+static void parseImm(CursorState* cursor, MemoryImm& outImm)
+{
+	if(!tryParseMemoryRef(cursor, outImm.memoryIndex)) { outImm.memoryIndex = 0; }
+}
+static void parseImm(CursorState* cursor, MemoryCopyImm& outImm)
+{
+	// memory.copy either has both a destination and source memory, or neither.
+	if(!tryParseMemoryRef(cursor, outImm.destMemoryIndex))
+	{ outImm.destMemoryIndex = outImm.sourceMemoryIndex = 0; }
+	else
+	{
+		outImm.sourceMemoryIndex = parseAndResolveNameOrIndexRef(
+			cursor,
+			cursor->moduleState->memoryNameToIndexMap,
+			cursor->moduleState->module.memories.size(),
+			"memory");
+	}
+}
 static void parseImm(CursorState* cursor, TableImm& outImm)
 {
 	if(!tryParseAndResolveNameOrIndexRef(cursor,
@@ -253,7 +282,9 @@ static void parseImm(CursorState* cursor, CallIndirectImm& outImm)
 	NameToIndexMap paramNameToIndexMap;
 	const UnresolvedFunctionType unresolvedFunctionType
 		= parseFunctionTypeRefAndOrDecl(cursor, paramNameToIndexMap, paramDisassemblyNames);
-	outImm.type.index = resolveFunctionType(cursor->moduleState, unresolvedFunctionType).index;
+	outImm.type.index
+		= resolveFunctionType(cursor->moduleState, cursor->parseState, unresolvedFunctionType)
+			  .index;
 
 	// Disallow named parameters.
 	if(paramNameToIndexMap.size())
@@ -269,12 +300,14 @@ static void parseImm(CursorState* cursor, CallIndirectImm& outImm)
 template<Uptr naturalAlignmentLog2>
 static void parseImm(CursorState* cursor, LoadOrStoreImm<naturalAlignmentLog2>& outImm)
 {
+	if(!tryParseMemoryRef(cursor, outImm.memoryIndex)) { outImm.memoryIndex = 0; }
+
 	outImm.offset = 0;
 	if(cursor->nextToken->type == t_offset)
 	{
 		++cursor->nextToken;
 		require(cursor, t_equals);
-		outImm.offset = parseI32(cursor);
+		outImm.offset = parseI64(cursor);
 	}
 
 	const U32 naturalAlignment = 1 << naturalAlignmentLog2;
@@ -340,6 +373,7 @@ static void parseImm(CursorState* cursor, AtomicLoadOrStoreImm<naturalAlignmentL
 	parseImm(cursor, loadOrStoreImm);
 	outImm.alignmentLog2 = loadOrStoreImm.alignmentLog2;
 	outImm.offset = loadOrStoreImm.offset;
+	outImm.memoryIndex = loadOrStoreImm.memoryIndex;
 }
 
 static void parseImm(CursorState* cursor, ExceptionTypeImm& outImm)
@@ -362,12 +396,7 @@ static void parseImm(CursorState* cursor, RethrowImm& outImm)
 static void parseImm(CursorState* cursor, DataSegmentAndMemImm& outImm)
 {
 	outImm.dataSegmentIndex = parseIptr(cursor);
-	if(!tryParseAndResolveNameOrIndexRef(cursor,
-										 cursor->moduleState->memoryNameToIndexMap,
-										 cursor->moduleState->module.memories.size(),
-										 "memory",
-										 outImm.memoryIndex))
-	{ outImm.memoryIndex = 0; }
+	if(!tryParseMemoryRef(cursor, outImm.memoryIndex)) { outImm.memoryIndex = 0; }
 }
 
 static void parseImm(CursorState* cursor, DataSegmentImm& outImm)
@@ -436,7 +465,9 @@ static void parseControlImm(CursorState* cursor,
 			// If there was a type reference, resolve it. This also verifies that if there were also
 			// params and/or results declared inline that they match the resolved type reference.
 			const Uptr referencedFunctionTypeIndex
-				= resolveFunctionType(cursor->moduleState, unresolvedFunctionType).index;
+				= resolveFunctionType(
+					  cursor->moduleState, cursor->parseState, unresolvedFunctionType)
+					  .index;
 			if(referencedFunctionTypeIndex != UINTPTR_MAX)
 			{
 				wavmAssert(referencedFunctionTypeIndex < cursor->moduleState->module.types.size());
@@ -749,90 +780,19 @@ FunctionDef WAST::parseFunctionDef(CursorState* cursor, const Token* funcToken)
 	const Uptr functionIndex = cursor->moduleState->module.functions.size();
 	const Uptr functionDefIndex = cursor->moduleState->module.functions.defs.size();
 	const Token* firstBodyToken = cursor->nextToken;
-	cursor->moduleState->postTypeCallbacks.push_back([functionIndex,
-													  functionDefIndex,
-													  firstBodyToken,
-													  localNameToIndexMap,
-													  localDisassemblyNames,
-													  unresolvedFunctionType](
-														 ModuleState* moduleState) {
-		// Resolve the function type and set it on the FunctionDef.
-		const IndexedFunctionType functionTypeIndex
-			= resolveFunctionType(moduleState, unresolvedFunctionType);
-		moduleState->module.functions.defs[functionDefIndex].type = functionTypeIndex;
-
-		// Defer parsing the body of the function until all function types have been resolved.
-		moduleState->postDeclarationCallbacks.push_back([functionIndex,
-														 functionDefIndex,
-														 firstBodyToken,
-														 localNameToIndexMap,
-														 localDisassemblyNames,
-														 functionTypeIndex](
-															ModuleState* moduleState) {
-			FunctionDef& functionDef = moduleState->module.functions.defs[functionDefIndex];
-			FunctionType functionType = functionTypeIndex.index == UINTPTR_MAX
-											? FunctionType()
-											: moduleState->module.types[functionTypeIndex.index];
-
-			// Parse the function's local variables.
-			CursorState functionCursorState(firstBodyToken, moduleState->parseState, moduleState);
-			while(tryParseParenthesizedTagged(&functionCursorState, t_local, [&] {
-				Name localName;
-				if(tryParseName(&functionCursorState, localName))
-				{
-					bindName(
-						moduleState->parseState,
-						*localNameToIndexMap,
-						localName,
-						functionType.params().size() + functionDef.nonParameterLocalTypes.size());
-					localDisassemblyNames->push_back(localName.getString());
-					functionDef.nonParameterLocalTypes.push_back(
-						parseValueType(&functionCursorState));
-				}
-				else
-				{
-					while(functionCursorState.nextToken->type != t_rightParenthesis)
-					{
-						localDisassemblyNames->push_back(std::string());
-						functionDef.nonParameterLocalTypes.push_back(
-							parseValueType(&functionCursorState));
-					};
-				}
-			}))
-				;
-			moduleState->disassemblyNames.functions[functionIndex].locals
-				= std::move(*localDisassemblyNames);
-
-			// Parse the function's code.
-			FunctionState functionState(localNameToIndexMap, functionDef, moduleState->module);
-			functionCursorState.functionState = &functionState;
-			const Token* validationErrorToken = firstBodyToken;
-			try
-			{
-				parseInstrSequence(&functionCursorState);
-				if(!moduleState->parseState->unresolvedErrors.size())
-				{
-					validationErrorToken = functionCursorState.nextToken;
-					functionState.validatingCodeStream.end();
-					functionState.validatingCodeStream.finishValidation();
-				}
-			}
-			catch(ValidationException exception)
-			{
-				parseErrorf(
-					moduleState->parseState, validationErrorToken, "%s", exception.message.c_str());
-			}
-			catch(RecoverParseException)
-			{
-			}
-			catch(FatalParseException)
-			{
-			}
-			functionDef.code = std::move(functionState.codeByteStream.getBytes());
-			moduleState->disassemblyNames.functions[functionIndex].labels
-				= std::move(functionState.labelDisassemblyNames);
+	cursor->moduleState->postTypeCallbacks.push_back(
+		[functionDefIndex, unresolvedFunctionType](ModuleState* moduleState) {
+			// Resolve the function type and set it on the FunctionDef.
+			moduleState->module.functions.defs[functionDefIndex].type = resolveFunctionType(
+				moduleState, moduleState->parseState, unresolvedFunctionType);
 		});
-	});
+
+	// Defer parsing the body of the function until all function types have been resolved.
+	cursor->moduleState->functionBodies.push_back({functionIndex,
+												   functionDefIndex,
+												   firstBodyToken,
+												   localNameToIndexMap,
+												   localDisassemblyNames});
 
 	// Continue parsing after the closing parenthesis.
 	findClosingParenthesis(cursor, funcToken - 1);
@@ -840,3 +800,158 @@ FunctionDef WAST::parseFunctionDef(CursorState* cursor, const Token* funcToken)
 
 	return {{UINTPTR_MAX}, {}, {}};
 }
+
+// Parses a function definition's locals and code, reporting errors to parseState. The function's
+// state is only updated once the body has been parsed, so if a MissingFunctionTypeException is
+// thrown, the body can be parsed again.
+static void parseFunctionBody(ModuleState* moduleState,
+							  ParseState* parseState,
+							  const DeferredFunctionBody& body)
+{
+	FunctionDef functionDef;
+	functionDef.type = moduleState->module.functions.defs[body.functionDefIndex].type;
+	FunctionType functionType = functionDef.type.index == UINTPTR_MAX
+									? FunctionType()
+									: moduleState->module.types[functionDef.type.index];
+	std::shared_ptr<NameToIndexMap> localNameToIndexMap
+		= std::make_shared<NameToIndexMap>(*body.localNameToIndexMap);
+	std::vector<std::string> localDisassemblyNames = *body.localDisassemblyNames;
+
+	// Parse the function's local variables.
+	CursorState functionCursorState(body.firstBodyToken, parseState, moduleState);
+	while(tryParseParenthesizedTagged(&functionCursorState, t_local, [&] {
+		Name localName;
+		if(tryParseName(&functionCursorState, localName))
+		{
+			bindName(parseState,
+					 *localNameToIndexMap,
+					 localName,
+					 functionType.params().size() + functionDef.nonParameterLocalTypes.size());
+			localDisassemblyNames.push_back(localName.getString());
+			functionDef.nonParameterLocalTypes.push_back(parseValueType(&functionCursorState));
+		}
+		else
+		{
+			while(functionCursorState.nextToken->type != t_rightParenthesis)
+			{
+				localDisassemblyNames.push_back(std::string());
+				functionDef.nonParameterLocalTypes.push_back(parseValueType(&functionCursorState));
+			};
+		}
+	}))
+		;
+
+	// Parse the function's code.
+	FunctionState functionState(localNameToIndexMap, functionDef, moduleState->module);
+	functionCursorState.functionState = &functionState;
+	const Token* validationErrorToken = body.firstBodyToken;
+	try
+	{
+		parseInstrSequence(&functionCursorState);
+		if(!parseState->unresolvedErrors.size())
+		{
+			validationErrorToken = functionCursorState.nextToken;
+			functionState.validatingCodeStream.end();
+			functionState.validatingCodeStream.finishValidation();
+		}
+	}
+	catch(ValidationException exception)
+	{
+		parseErrorf(parseState, validationErrorToken, "%s", exception.message.c_str());
+	}
+	catch(RecoverParseException)
+	{
+	}
+	catch(FatalParseException)
+	{
+	}
+	functionDef.code = std::move(functionState.codeByteStream.getBytes());
+
+	moduleState->module.functions.defs[body.functionDefIndex] = std::move(functionDef);
+	IR::DisassemblyNames::Function& disassemblyNames
+		= moduleState->disassemblyNames.functions[body.functionIndex];
+	disassemblyNames.locals = std::move(localDisassemblyNames);
+	disassemblyNames.labels = std::move(functionState.labelDisassemblyNames);
+}
+
+static constexpr Uptr parseThreadStackBytes = 8 * 1024 * 1024;
+
+struct ParallelParseState
+{
+	ModuleState* moduleState;
+	std::atomic<Uptr> nextFunctionBodyIndex{0};
+
+	// The errors found in each function body, and whether each function body must be parsed again
+	// after the parallel parse because it needed to add a function type.
+	std::vector<ParseState> functionBodyParseStates;
+	std::vector<bool> isFunctionBodyDeferred;
+
+	ParallelParseState(ModuleState* inModuleState) : moduleState(inModuleState) {}
+};
+
+static I64 parseThreadEntry(void* stateVoid)
+{
+	ParallelParseState& state = *(ParallelParseState*)stateVoid;
+	while(true)
+	{
+		const Uptr bodyIndex = state.nextFunctionBodyIndex++;
+		if(bodyIndex >= state.moduleState->functionBodies.size()) { break; }
+
+		try
+		{
+			parseFunctionBody(state.moduleState,
+							  &state.functionBodyParseStates[bodyIndex],
+							  state.moduleState->functionBodies[bodyIndex]);
+		}
+		catch(MissingFunctionTypeException)
+		{
+			state.functionBodyParseStates[bodyIndex].unresolvedErrors.clear();
+			state.isFunctionBodyDeferred[bodyIndex] = true;
+		}
+	}
+	return 0;
+}
+
+void WAST::parseFunctionBodies(ModuleState* moduleState, Uptr numThreads)
+{
+	const std::vector<DeferredFunctionBody>& bodies = moduleState->functionBodies;
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::min(numThreads, Uptr(bodies.size()));
+
+	// If there were already errors, parse the function bodies serially, since any function body
+	// after the first error isn't validated.
+	ParseState* parseState = moduleState->parseState;
+	if(numThreads <= 1 || parseState->unresolvedErrors.size())
+	{
+		for(const DeferredFunctionBody& body : bodies)
+		{ parseFunctionBody(moduleState, parseState, body); }
+		return;
+	}
+
+	// Parse the function bodies on the worker threads and the calling thread, each with its own
+	// ParseState to collect its errors.
+	ParallelParseState state(moduleState);
+	state.functionBodyParseStates.resize(bodies.size(),
+										 ParseState(parseState->string, parseState->lineInfo));
+	state.isFunctionBodyDeferred.resize(bodies.size(), false);
+
+	moduleState->isParsingFunctionBodiesInParallel = true;
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{ threads.push_back(Platform::createThread(parseThreadStackBytes, parseThreadEntry, &state)); }
+	parseThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+	moduleState->isParsingFunctionBodiesInParallel = false;
+
+	// Parse the function bodies that need to add function types serially, in order, so the types
+	// are added in the same order as if all function bodies were parsed serially. Then report the
+	// errors in the order of the function bodies.
+	for(Uptr bodyIndex = 0; bodyIndex < bodies.size(); ++bodyIndex)
+	{
+		ParseState& bodyParseState = state.functionBodyParseStates[bodyIndex];
+		if(state.isFunctionBodyDeferred[bodyIndex])
+		{ parseFunctionBody(moduleState, &bodyParseState, bodies[bodyIndex]); }
+		for(UnresolvedError& error : bodyParseState.unresolvedErrors)
+		{ parseState->unresolvedErrors.push_back(std::move(error)); }
+	}
+}
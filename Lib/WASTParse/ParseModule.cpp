@@ -19,6 +19,7 @@
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Logging/Metrics.h"
 #include "WAVM/WASTParse/WASTParse.h"
 
 using namespace WAVM;
@@ -184,6 +185,25 @@ static Uptr createImport(CursorState* cursor,
 	return importIndex;
 }
 
+static IndexType parseOptionalIndexType(CursorState* cursor)
+{
+	if(cursor->nextToken->type == t_i64)
+	{
+		++cursor->nextToken;
+		return IndexType::i64;
+	}
+	else
+	{
+		if(cursor->nextToken->type == t_i32) { ++cursor->nextToken; }
+		return IndexType::i32;
+	}
+}
+
+static U64 getMaxMemoryPages(IndexType indexType)
+{
+	return indexType == IndexType::i64 ? IR::maxMemory64Pages : IR::maxMemoryPages;
+}
+
 static bool parseOptionalSharedDeclaration(CursorState* cursor)
 {
 	if(cursor->nextToken->type == t_shared)
@@ -247,8 +267,8 @@ static void parseImport(CursorState* cursor)
 			// Resolve the function import type after all type declarations have been parsed.
 			cursor->moduleState->postTypeCallbacks.push_back(
 				[unresolvedFunctionType, importIndex](ModuleState* moduleState) {
-					moduleState->module.functions.imports[importIndex].type
-						= resolveFunctionType(moduleState, unresolvedFunctionType);
+					moduleState->module.functions.imports[importIndex].type = resolveFunctionType(
+						moduleState, moduleState->parseState, unresolvedFunctionType);
 				});
 			break;
 		}
@@ -269,8 +289,9 @@ static void parseImport(CursorState* cursor)
 		}
 		case t_memory:
 		{
+			const IndexType indexType = parseOptionalIndexType(cursor);
 			const SizeConstraints sizeConstraints
-				= parseSizeConstraints(cursor, IR::maxMemoryPages);
+				= parseSizeConstraints(cursor, getMaxMemoryPages(indexType));
 			const bool isShared = parseOptionalSharedDeclaration(cursor);
 			createImport(cursor,
 						 name,
@@ -279,7 +300,7 @@ static void parseImport(CursorState* cursor)
 						 cursor->moduleState->memoryNameToIndexMap,
 						 cursor->moduleState->module.memories,
 						 cursor->moduleState->disassemblyNames.memories,
-						 MemoryType{isShared, sizeConstraints});
+						 MemoryType{isShared, sizeConstraints, indexType});
 			break;
 		}
 		case t_global:
@@ -645,8 +666,8 @@ static void parseFunc(CursorState* cursor)
 			const Uptr importIndex = cursor->moduleState->module.functions.imports.size();
 			cursor->moduleState->postTypeCallbacks.push_back(
 				[unresolvedFunctionType, importIndex](ModuleState* moduleState) {
-					moduleState->module.functions.imports[importIndex].type
-						= resolveFunctionType(moduleState, unresolvedFunctionType);
+					moduleState->module.functions.imports[importIndex].type = resolveFunctionType(
+						moduleState, moduleState->parseState, unresolvedFunctionType);
 				});
 			return IndexedFunctionType{UINTPTR_MAX};
 		},
@@ -711,15 +732,17 @@ static void parseMemory(CursorState* cursor)
 		ObjectKind::memory,
 		// Parse a memory import.
 		[](CursorState* cursor) {
+			const IndexType indexType = parseOptionalIndexType(cursor);
 			const SizeConstraints sizeConstraints
-				= parseSizeConstraints(cursor, IR::maxMemoryPages);
+				= parseSizeConstraints(cursor, getMaxMemoryPages(indexType));
 			const bool isShared = parseOptionalSharedDeclaration(cursor);
-			return MemoryType{isShared, sizeConstraints};
+			return MemoryType{isShared, sizeConstraints, indexType};
 		},
 		// Parse a memory definition
 		[](CursorState* cursor, const Token*) {
+			const IndexType indexType = parseOptionalIndexType(cursor);
 			SizeConstraints sizeConstraints;
-			if(!tryParseSizeConstraints(cursor, IR::maxMemoryPages, sizeConstraints))
+			if(!tryParseSizeConstraints(cursor, getMaxMemoryPages(indexType), sizeConstraints))
 			{
 				std::string dataString;
 
@@ -736,12 +759,13 @@ static void parseMemory(CursorState* cursor)
 				cursor->moduleState->module.dataSegments.push_back(
 					{true,
 					 cursor->moduleState->module.memories.size(),
-					 InitializerExpression(I32(0)),
+					 indexType == IndexType::i64 ? InitializerExpression(I64(0))
+												 : InitializerExpression(I32(0)),
 					 std::move(dataVector)});
 			}
 
 			const bool isShared = parseOptionalSharedDeclaration(cursor);
-			return MemoryDef{MemoryType(isShared, sizeConstraints)};
+			return MemoryDef{MemoryType(isShared, sizeConstraints, indexType)};
 		});
 }
 
@@ -848,7 +872,7 @@ template<typename Map> void dumpHashMapSpaceAnalysis(const Map& map, const char*
 	}
 }
 
-void WAST::parseModuleBody(CursorState* cursor, IR::Module& outModule)
+void WAST::parseModuleBody(CursorState* cursor, IR::Module& outModule, Uptr numThreads)
 {
 	try
 	{
@@ -872,6 +896,9 @@ void WAST::parseModuleBody(CursorState* cursor, IR::Module& outModule)
 		{
 			for(const auto& callback : cursor->moduleState->postDeclarationCallbacks)
 			{ callback(&moduleState); }
+
+			// Parse the function bodies, which may reference any declaration.
+			parseFunctionBodies(&moduleState, numThreads);
 		}
 
 		// Validate the module's definitions (excluding function code, which is validated as it is
@@ -915,10 +942,14 @@ void WAST::parseModuleBody(CursorState* cursor, IR::Module& outModule)
 	cursor->moduleState = nullptr;
 }
 
+static Metrics::Histogram parseTimeHistogram("wast.parse_us",
+											  "Time to lex and parse a WAST module in microseconds");
+
 bool WAST::parseModule(const char* string,
 					   Uptr stringLength,
 					   IR::Module& outModule,
-					   std::vector<Error>& outErrors)
+					   std::vector<Error>& outErrors,
+					   Uptr numThreads)
 {
 	Timing::Timer timer;
 
@@ -935,13 +966,13 @@ bool WAST::parseModule(const char* string,
 			// Parse (module <module body>)
 			parseParenthesized(&cursor, [&] {
 				require(&cursor, t_module);
-				parseModuleBody(&cursor, outModule);
+				parseModuleBody(&cursor, outModule, numThreads);
 			});
 		}
 		else
 		{
 			// Also allow a module body without any enclosing (module ...).
-			parseModuleBody(&cursor, outModule);
+			parseModuleBody(&cursor, outModule, numThreads);
 		}
 		require(&cursor, t_eof);
 	}
@@ -964,6 +995,7 @@ bool WAST::parseModule(const char* string,
 	freeLineInfo(lineInfo);
 
 	Timing::logRatePerSecond("lexed and parsed WAST", timer, stringLength / 1024.0 / 1024.0, "MB");
+	parseTimeHistogram.record(timer.getMicroseconds());
 
 	return outErrors.size() == 0;
 }
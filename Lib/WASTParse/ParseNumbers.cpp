@@ -3,11 +3,13 @@
 
 #include "Lexer.h"
 #include "Parse.h"
+#include "PowersOfFive.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Floats.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Intrinsic.h"
 
 // Include the David Gay's dtoa code.
 // #define strtod and dtoa to avoid conflicting with the C standard library versions
@@ -204,9 +206,193 @@ template<typename DestFloat> static F64 getMaxCastableF64()
 	return f64Components.value;
 }
 
-// Parses a floating point literal, advancing nextChar past the parsed characters. Assumes it will
-// only be called for input that's already been accepted by the lexer as a float literal.
-template<typename Float> Float parseFloat(const char*& nextChar, ParseState* parseState)
+// Multiplies two 64-bit integers, and returns the high and low 64 bits of the 128-bit product.
+static void multiplyU64(U64 a, U64 b, U64& outHigh, U64& outLow)
+{
+#if defined(__SIZEOF_INT128__)
+	__extension__ typedef unsigned __int128 U128;
+	const U128 product = U128(a) * U128(b);
+	outHigh = U64(product >> 64);
+	outLow = U64(product);
+#else
+	const U64 aLow = a & 0xffffffff;
+	const U64 aHigh = a >> 32;
+	const U64 bLow = b & 0xffffffff;
+	const U64 bHigh = b >> 32;
+	const U64 lowLow = aLow * bLow;
+	const U64 lowHigh = aLow * bHigh;
+	const U64 highLow = aHigh * bLow;
+	const U64 middle = (lowLow >> 32) + (lowHigh & 0xffffffff) + (highLow & 0xffffffff);
+	outHigh = aHigh * bHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+	outLow = (middle << 32) | (lowLow & 0xffffffff);
+#endif
+}
+
+// Computes the F64 nearest to significand * 10^exponent using the Eisel-Lemire algorithm, which
+// multiplies the significand by a 128-bit approximation of the power of ten. 128 bits are always
+// enough to round correctly for a significand with at most 19 digits.
+static F64 computeDecimalF64(bool isNegative, U64 significand, I64 exponent)
+{
+	typedef Floats::FloatComponents<F64> F64Components;
+	F64Components resultComponents;
+	resultComponents.bits.sign = isNegative ? 1 : 0;
+
+	if(significand == 0 || exponent < minPowerOfFiveExponent)
+	{
+		resultComponents.bits.exponent = 0;
+		resultComponents.bits.significand = 0;
+		return resultComponents.value;
+	}
+	if(exponent > maxPowerOfFiveExponent)
+	{
+		resultComponents.bits.exponent = F64Components::maxExponentBits;
+		resultComponents.bits.significand = 0;
+		return resultComponents.value;
+	}
+
+	// Normalize the significand so its most significant bit is set, and multiply it by the
+	// normalized power of five. If the low bits of the high half of the product might be affected
+	// by a carry from the low half, also multiply by the low half of the power of five.
+	const U64 numLeadingZeroes = Platform::countLeadingZeroes(significand);
+	significand <<= numLeadingZeroes;
+	const U64* powerOfFive = powersOfFive[exponent - minPowerOfFiveExponent];
+	U64 productHigh;
+	U64 productLow;
+	multiplyU64(significand, powerOfFive[0], productHigh, productLow);
+	if((productHigh & 0x1ff) == 0x1ff)
+	{
+		U64 secondProductHigh;
+		U64 secondProductLow;
+		multiplyU64(significand, powerOfFive[1], secondProductHigh, secondProductLow);
+		productLow += secondProductHigh;
+		if(secondProductHigh > productLow) { ++productHigh; }
+	}
+
+	// Take the top 54 bits of the product, and compute the binary exponent.
+	// ((152170 + 65536) * exponent) >> 16 is floor(exponent * log2(10)) for exponent in
+	// [-342, 308].
+	const U64 upperBit = productHigh >> 63;
+	U64 resultSignificand = productHigh >> (upperBit + 9);
+	I64 resultExponent = ((((152170 + 65536) * exponent) >> 16) + 63) + I64(upperBit)
+						 - I64(numLeadingZeroes) + 1023;
+
+	if(resultExponent <= 0)
+	{
+		// The result is subnormal, or rounds to zero.
+		if(-resultExponent + 1 >= 64)
+		{
+			resultComponents.bits.exponent = 0;
+			resultComponents.bits.significand = 0;
+			return resultComponents.value;
+		}
+		resultSignificand >>= -resultExponent + 1;
+		resultSignificand += resultSignificand & 1;
+		resultSignificand >>= 1;
+
+		// Rounding may have produced the smallest normal number.
+		resultComponents.bits.exponent
+			= resultSignificand < (U64(1) << F64Components::numSignificandBits) ? 0 : 1;
+		resultComponents.bits.significand = resultSignificand;
+		return resultComponents.value;
+	}
+
+	// If the product is exactly halfway between two F64s, round to even instead of up. This can
+	// only happen when the decimal value is exactly representable in 128 bits, which is only
+	// possible for exponents in [-4, 23].
+	if(productLow <= 1 && exponent >= -4 && exponent <= 23 && (resultSignificand & 3) == 1
+	   && (resultSignificand << (upperBit + 9)) == productHigh)
+	{ resultSignificand &= ~U64(1); }
+
+	// Round the 54-bit significand to 53 bits, and handle the rounding overflowing it.
+	resultSignificand += resultSignificand & 1;
+	resultSignificand >>= 1;
+	if(resultSignificand >= (U64(2) << F64Components::numSignificandBits))
+	{
+		resultSignificand = U64(1) << F64Components::numSignificandBits;
+		++resultExponent;
+	}
+
+	if(resultExponent >= I64(F64Components::maxExponentBits))
+	{
+		resultComponents.bits.exponent = F64Components::maxExponentBits;
+		resultComponents.bits.significand = 0;
+		return resultComponents.value;
+	}
+	resultComponents.bits.exponent = U64(resultExponent);
+	resultComponents.bits.significand
+		= resultSignificand & ((U64(1) << F64Components::numSignificandBits) - 1);
+	return resultComponents.value;
+}
+
+// Tries to parse a decimal floating point literal with at most 19 significant digits, advancing
+// nextChar past the parsed characters if successful. Returns false without advancing nextChar if
+// the literal must be parsed by parseDtoaF64 instead.
+static bool tryParseDecimalF64(const char*& nextChar, F64& outF64)
+{
+	const char* firstChar = nextChar;
+	const bool isNegative = parseSign(nextChar);
+	if(nextChar[0] == '0' && (nextChar[1] == 'x' || nextChar[1] == 'X'))
+	{
+		nextChar = firstChar;
+		return false;
+	}
+
+	// Accumulate the significant digits, and subtract one from the exponent for each digit after
+	// the decimal point.
+	U64 significand = 0;
+	Uptr numSignificantDigits = 0;
+	I64 exponent = 0;
+	bool isFraction = false;
+	while(true)
+	{
+		if(*nextChar >= '0' && *nextChar <= '9')
+		{
+			const U8 digit = *nextChar - '0';
+			if(digit != 0 || numSignificantDigits)
+			{
+				if(++numSignificantDigits > 19)
+				{
+					nextChar = firstChar;
+					return false;
+				}
+				significand = significand * 10 + digit;
+			}
+			if(isFraction) { --exponent; }
+		}
+		else if(*nextChar == '.' && !isFraction)
+		{
+			isFraction = true;
+		}
+		else if(*nextChar != '_')
+		{
+			break;
+		}
+		++nextChar;
+	};
+
+	// Parse the exponent, saturating it at a value that is large enough to overflow or underflow
+	// any significand.
+	if(*nextChar == 'e' || *nextChar == 'E')
+	{
+		++nextChar;
+		const bool isExponentNegative = parseSign(nextChar);
+		I64 explicitExponent = 0;
+		while((*nextChar >= '0' && *nextChar <= '9') || *nextChar == '_')
+		{
+			if(*nextChar != '_' && explicitExponent < 100000)
+			{ explicitExponent = explicitExponent * 10 + (*nextChar - '0'); }
+			++nextChar;
+		};
+		exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+	}
+
+	outF64 = computeDecimalF64(isNegative, significand, exponent);
+	return true;
+}
+
+// Parses a floating point literal with David Gay's strtod, advancing nextChar past the parsed
+// characters.
+static F64 parseDtoaF64(const char*& nextChar)
 {
 	// Scan the token's characters for underscores, and make a copy of it without the underscores
 	// for strtod.
@@ -250,6 +436,17 @@ template<typename Float> Float parseFloat(const char*& nextChar, ParseState* par
 	F64 f64 = parseNonSpecialF64(noUnderscoreFirstChar, &endChar);
 	if(endChar == noUnderscoreFirstChar)
 	{ Errors::fatalf("strtod failed to parse number accepted by lexer"); }
+	return f64;
+}
+
+// Parses a floating point literal, advancing nextChar past the parsed characters. Assumes it will
+// only be called for input that's already been accepted by the lexer as a float literal.
+template<typename Float> Float parseFloat(const char*& nextChar, ParseState* parseState)
+{
+	// Most decimal literals can be parsed without strtod, which is much slower.
+	const char* firstChar = nextChar;
+	F64 f64;
+	if(!tryParseDecimalF64(nextChar, f64)) { f64 = parseDtoaF64(nextChar); }
 
 	const F64 maxCastableF64 = getMaxCastableF64<Float>();
 	if(f64 < -maxCastableF64 || f64 > maxCastableF64)
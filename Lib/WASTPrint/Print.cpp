@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <utility>
@@ -18,6 +19,8 @@
 #include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/IsNameChar.h"
 #include "WAVM/Inline/Serialization.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/WASTPrint/WASTPrint.h"
 
 using namespace WAVM;
@@ -88,45 +91,98 @@ static std::string escapeName(const std::string& name)
 	return escapedName;
 }
 
-static std::string expandIndentation(std::string&& inString, U8 spacesPerIndentLevel = 2)
+// Appends a string to outString, replacing the INDENT_STRING and DEDENT_STRING markers in it with
+// the indentation they imply: each newline is followed by spacesPerIndentLevel spaces for each
+// level of indentation. inOutIndentDepth is the indentation depth at the start of the string, and
+// is updated to the depth at its end, so a text may be expanded in consecutive pieces.
+static void appendExpandedIndentation(std::string& outString,
+									  const std::string& inString,
+									  Uptr& inOutIndentDepth,
+									  U8 spacesPerIndentLevel = 2)
 {
-	std::string paddedInput = std::move(inString);
-	paddedInput += '\0';
-
-	std::string result;
-	result.reserve(paddedInput.size() * 2);
-	const char* next = paddedInput.data();
-	const char* end = paddedInput.data() + paddedInput.size() - 1;
-	Uptr indentDepth = 0;
+	const char* next = inString.data();
+	const char* end = inString.data() + inString.size();
 	while(next < end)
 	{
+		// Copy the characters up to the next newline or marker at once.
+		const char* runEnd = next;
+		while(runEnd < end && *runEnd != '\n' && *runEnd != INDENT_STRING[0]) { ++runEnd; }
+		outString.append(next, runEnd);
+		next = runEnd;
+		if(next == end) { break; }
+
 		// Absorb INDENT_STRING and DEDENT_STRING, but keep track of the indentation depth, and
 		// insert a proportional number of spaces following newlines.
-		if(next[0] == INDENT_STRING[0] && next[1] == INDENT_STRING[1])
+		if(*next == '\n')
 		{
-			++indentDepth;
-			next += 2;
+			outString += '\n';
+			outString.append(inOutIndentDepth * spacesPerIndentLevel, ' ');
+			++next;
 		}
-		else if(next[0] == DEDENT_STRING[0] && next[1] == DEDENT_STRING[1])
+		else if(end - next >= 2 && next[1] == INDENT_STRING[1])
 		{
-			errorUnless(indentDepth > 0);
-			--indentDepth;
+			++inOutIndentDepth;
 			next += 2;
 		}
-		else if(*next == '\n')
+		else if(end - next >= 2 && next[1] == DEDENT_STRING[1])
 		{
-			result += '\n';
-			result.insert(result.end(), indentDepth * spacesPerIndentLevel, ' ');
-			++next;
+			errorUnless(inOutIndentDepth > 0);
+			--inOutIndentDepth;
+			next += 2;
 		}
 		else
 		{
-			result += *next++;
+			outString += *next++;
 		}
 	}
-	return result;
 }
 
+// Collects the printed text, and writes it to a file in chunks of at least minFileWriteBytes if
+// there is a file, to bound the memory used to print a large module.
+struct PrintOutput
+{
+	static constexpr Uptr minFileWriteBytes = 4 * 1024 * 1024;
+
+	std::string text;
+	Platform::File* file;
+	bool writeFailed;
+
+	PrintOutput(Platform::File* inFile = nullptr) : file(inFile), writeFailed(false)
+	{
+		if(file) { text.reserve(minFileWriteBytes * 2); }
+	}
+
+	// Appends a piece of printed text, replacing its indentation markers.
+	void write(const std::string& string)
+	{
+		appendExpandedIndentation(text, string, indentDepth);
+		if(file && text.size() >= minFileWriteBytes) { flush(); }
+	}
+
+	// Appends a piece of printed text that was already expanded starting at getIndentDepth(), and
+	// ends at the same depth.
+	void writeExpanded(const std::string& string)
+	{
+		text += string;
+		if(file && text.size() >= minFileWriteBytes) { flush(); }
+	}
+
+	Uptr getIndentDepth() const { return indentDepth; }
+
+	void flush()
+	{
+		if(file && text.size())
+		{
+			if(!writeFailed && !Platform::writeFile(file, text.data(), text.size()))
+			{ writeFailed = true; }
+			text.clear();
+		}
+	}
+
+private:
+	Uptr indentDepth = 0;
+};
+
 struct ScopedTagPrinter
 {
 	ScopedTagPrinter(std::string& inString, const char* tag) : string(inString)
@@ -202,6 +258,7 @@ static void print(std::string& string, const TableType& type)
 
 static void print(std::string& string, const MemoryType& type)
 {
+	if(type.indexType == IndexType::i64) { string += " i64"; }
 	string += ' ';
 	print(string, type.size);
 	if(type.isShared) { string += " shared"; }
@@ -259,12 +316,16 @@ private:
 struct ModulePrintContext
 {
 	const Module& module;
-	std::string& string;
+	PrintOutput& output;
+	const Uptr numThreads;
+
+	// The text that has been printed, but not yet written to the output.
+	std::string string;
 
 	DisassemblyNames names;
 
-	ModulePrintContext(const Module& inModule, std::string& inString)
-	: module(inModule), string(inString)
+	ModulePrintContext(const Module& inModule, PrintOutput& inOutput, Uptr inNumThreads)
+	: module(inModule), output(inOutput), numThreads(inNumThreads)
 	{
 		// Start with the names from the module's user name section, but make sure they are unique,
 		// and add the "$" sigil.
@@ -287,6 +348,7 @@ struct ModulePrintContext
 	}
 
 	void printModule();
+	void printFunctionDefs();
 
 	void printLinkingSection(const IR::UserSection& linkingSection);
 
@@ -324,6 +386,7 @@ struct FunctionPrintContext
 
 	ModulePrintContext& moduleContext;
 	const Module& module;
+	const Uptr functionDefIndex;
 	const FunctionDef& functionDef;
 	FunctionType functionType;
 	std::string& string;
@@ -333,12 +396,15 @@ struct FunctionPrintContext
 	NameScope labelNameScope;
 	Uptr labelIndex;
 
-	FunctionPrintContext(ModulePrintContext& inModuleContext, Uptr functionDefIndex)
+	FunctionPrintContext(ModulePrintContext& inModuleContext,
+						 Uptr inFunctionDefIndex,
+						 std::string& inString)
 	: moduleContext(inModuleContext)
 	, module(inModuleContext.module)
+	, functionDefIndex(inFunctionDefIndex)
 	, functionDef(inModuleContext.module.functions.defs[functionDefIndex])
 	, functionType(inModuleContext.module.types[functionDef.type.index])
-	, string(inModuleContext.string)
+	, string(inString)
 	, labelNames(inModuleContext.names.functions[module.functions.imports.size() + functionDefIndex]
 					 .labels)
 	, localNames(inModuleContext.names.functions[module.functions.imports.size() + functionDefIndex]
@@ -348,6 +414,7 @@ struct FunctionPrintContext
 	{
 	}
 
+	void printFunctionDef();
 	void printFunctionBody();
 
 	void unknown(Opcode) { Errors::unreachable(); }
@@ -397,7 +464,8 @@ struct FunctionPrintContext
 
 	void br(BranchImm imm)
 	{
-		string += "\nbr " + getBranchTargetId(imm.targetDepth);
+		string += "\nbr ";
+		printBranchTargetId(imm.targetDepth);
 		enterUnreachable();
 	}
 	void br_table(BranchTableImm imm)
@@ -416,15 +484,19 @@ struct FunctionPrintContext
 			{
 				string += ' ';
 			}
-			string += getBranchTargetId(targetDepths[targetIndex]);
+			printBranchTargetId(targetDepths[targetIndex]);
 		}
 		string += '\n';
-		string += getBranchTargetId(imm.defaultTargetDepth);
+		printBranchTargetId(imm.defaultTargetDepth);
 		string += " ;; default" DEDENT_STRING;
 
 		enterUnreachable();
 	}
-	void br_if(BranchImm imm) { string += "\nbr_if " + getBranchTargetId(imm.targetDepth); }
+	void br_if(BranchImm imm)
+	{
+		string += "\nbr_if ";
+		printBranchTargetId(imm.targetDepth);
+	}
 
 	void unreachable(NoImm)
 	{
@@ -437,24 +509,29 @@ struct FunctionPrintContext
 
 	void get_local(GetOrSetVariableImm<false> imm)
 	{
-		string += "\nget_local " + localNames[imm.variableIndex];
+		string += "\nget_local ";
+		string += localNames[imm.variableIndex];
 	}
 	void set_local(GetOrSetVariableImm<false> imm)
 	{
-		string += "\nset_local " + localNames[imm.variableIndex];
+		string += "\nset_local ";
+		string += localNames[imm.variableIndex];
 	}
 	void tee_local(GetOrSetVariableImm<false> imm)
 	{
-		string += "\ntee_local " + localNames[imm.variableIndex];
+		string += "\ntee_local ";
+		string += localNames[imm.variableIndex];
 	}
 
 	void get_global(GetOrSetVariableImm<true> imm)
 	{
-		string += "\nget_global " + moduleContext.names.globals[imm.variableIndex];
+		string += "\nget_global ";
+		string += moduleContext.names.globals[imm.variableIndex];
 	}
 	void set_global(GetOrSetVariableImm<true> imm)
 	{
-		string += "\nset_global " + moduleContext.names.globals[imm.variableIndex];
+		string += "\nset_global ";
+		string += moduleContext.names.globals[imm.variableIndex];
 	}
 
 	void table_get(TableImm imm)
@@ -482,7 +559,7 @@ struct FunctionPrintContext
 			{
 				if(catchDepth == imm.catchDepth)
 				{
-					string += getBranchTargetId(targetDepth);
+					printBranchTargetId(targetDepth);
 					return;
 				}
 				++catchDepth;
@@ -494,7 +571,8 @@ struct FunctionPrintContext
 
 	void call(FunctionImm imm)
 	{
-		string += "\ncall " + moduleContext.names.functions[imm.functionIndex].name;
+		string += "\ncall ";
+		string += moduleContext.names.functions[imm.functionIndex].name;
 	}
 	void call_indirect(CallIndirectImm imm)
 	{
@@ -509,7 +587,24 @@ struct FunctionPrintContext
 	}
 
 	void printImm(NoImm) {}
-	void printImm(MemoryImm imm) { errorUnless(imm.memoryIndex == 0); }
+	void printMemoryRef(Uptr memoryIndex)
+	{
+		string += ' ';
+		string += moduleContext.names.memories[memoryIndex];
+	}
+
+	void printImm(MemoryImm imm)
+	{
+		if(imm.memoryIndex != 0) { printMemoryRef(imm.memoryIndex); }
+	}
+	void printImm(MemoryCopyImm imm)
+	{
+		if(imm.destMemoryIndex != 0 || imm.sourceMemoryIndex != 0)
+		{
+			printMemoryRef(imm.destMemoryIndex);
+			printMemoryRef(imm.sourceMemoryIndex);
+		}
+	}
 	void printImm(TableImm imm)
 	{
 		string += ' ';
@@ -544,6 +639,7 @@ struct FunctionPrintContext
 
 	template<Uptr naturalAlignmentLog2> void printImm(LoadOrStoreImm<naturalAlignmentLog2> imm)
 	{
+		if(imm.memoryIndex != 0) { printMemoryRef(imm.memoryIndex); }
 		if(imm.offset != 0)
 		{
 			string += " offset=";
@@ -582,6 +678,7 @@ struct FunctionPrintContext
 	template<Uptr naturalAlignmentLog2>
 	void printImm(AtomicLoadOrStoreImm<naturalAlignmentLog2> imm)
 	{
+		if(imm.memoryIndex != 0) { printMemoryRef(imm.memoryIndex); }
 		if(imm.offset != 0)
 		{
 			string += " offset=";
@@ -655,11 +752,15 @@ private:
 
 	std::vector<ControlContext> controlStack;
 
-	std::string getBranchTargetId(Uptr depth)
+	void printBranchTargetId(Uptr depth)
 	{
 		const ControlContext& controlContext = controlStack[controlStack.size() - depth - 1];
-		return controlContext.type == ControlContext::Type::function ? std::to_string(depth)
-																	 : controlContext.labelId;
+		if(controlContext.type != ControlContext::Type::function)
+		{ string += controlContext.labelId; }
+		else
+		{
+			string += std::to_string(depth);
+		}
 	}
 
 	std::string printControlLabel(const char* labelIdBase)
@@ -717,7 +818,7 @@ void printImport(std::string& string,
 
 void ModulePrintContext::printModule()
 {
-	ScopedTagPrinter moduleTag(string, "module");
+	string += "(module" INDENT_STRING;
 
 	// Print the types.
 	for(Uptr typeIndex = 0; typeIndex < module.types.size(); ++typeIndex)
@@ -910,67 +1011,11 @@ void ModulePrintContext::printModule()
 		string += names.functions[module.startFunctionIndex].name;
 	}
 
-	// Print the function definitions.
-	for(Uptr functionDefIndex = 0; functionDefIndex < module.functions.defs.size();
-		++functionDefIndex)
-	{
-		const Uptr functionIndex = module.functions.imports.size() + functionDefIndex;
-		const FunctionDef& functionDef = module.functions.defs[functionDefIndex];
-		FunctionType functionType = module.types[functionDef.type.index];
-		FunctionPrintContext functionContext(*this, functionDefIndex);
-
-		string += "\n\n";
-		ScopedTagPrinter funcTag(string, "func");
-
-		string += ' ';
-		string += names.functions[functionIndex].name;
-
-		// Print the function's type.
-		string += " (type ";
-		string += names.types[functionDef.type.index];
-		string += ')';
-
-		// Print the function parameters.
-		if(functionType.params().size())
-		{
-			for(Uptr parameterIndex = 0; parameterIndex < functionType.params().size();
-				++parameterIndex)
-			{
-				string += '\n';
-				ScopedTagPrinter paramTag(string, "param");
-				string += ' ';
-				string += functionContext.localNames[parameterIndex];
-				string += ' ';
-				print(string, functionType.params()[parameterIndex]);
-			}
-		}
-
-		// Print the function return type.
-		if(functionType.results().size())
-		{
-			string += '\n';
-			ScopedTagPrinter resultTag(string, "result");
-			for(Uptr resultIndex = 0; resultIndex < functionType.results().size(); ++resultIndex)
-			{
-				string += ' ';
-				print(string, functionType.results()[resultIndex]);
-			}
-		}
-
-		// Print the function's locals.
-		for(Uptr localIndex = 0; localIndex < functionDef.nonParameterLocalTypes.size();
-			++localIndex)
-		{
-			string += '\n';
-			ScopedTagPrinter localTag(string, "local");
-			string += ' ';
-			string += functionContext.localNames[functionType.params().size() + localIndex];
-			string += ' ';
-			print(string, functionDef.nonParameterLocalTypes[localIndex]);
-		}
-
-		functionContext.printFunctionBody();
-	}
+	// Write the text printed so far to the output before printing the function definitions, which
+	// are written to it as they are printed.
+	output.write(string);
+	string.clear();
+	printFunctionDefs();
 
 	// Print user sections (other than the name section).
 	for(const auto& userSection : module.userSections)
@@ -997,6 +1042,10 @@ void ModulePrintContext::printModule()
 			string += DEDENT_STRING "\n";
 		}
 	}
+
+	string += DEDENT_STRING ")";
+	output.write(string);
+	string.clear();
 }
 
 void ModulePrintContext::printLinkingSection(const IR::UserSection& linkingSection)
@@ -1331,6 +1380,152 @@ void ModulePrintContext::printLinkingSection(const IR::UserSection& linkingSecti
 	string += linkingSectionString;
 }
 
+void FunctionPrintContext::printFunctionDef()
+{
+	const Uptr functionIndex = module.functions.imports.size() + functionDefIndex;
+
+	string += "\n\n";
+	ScopedTagPrinter funcTag(string, "func");
+
+	string += ' ';
+	string += moduleContext.names.functions[functionIndex].name;
+
+	// Print the function's type.
+	string += " (type ";
+	string += moduleContext.names.types[functionDef.type.index];
+	string += ')';
+
+	// Print the function parameters.
+	if(functionType.params().size())
+	{
+		for(Uptr parameterIndex = 0; parameterIndex < functionType.params().size();
+			++parameterIndex)
+		{
+			string += '\n';
+			ScopedTagPrinter paramTag(string, "param");
+			string += ' ';
+			string += localNames[parameterIndex];
+			string += ' ';
+			print(string, functionType.params()[parameterIndex]);
+		}
+	}
+
+	// Print the function return type.
+	if(functionType.results().size())
+	{
+		string += '\n';
+		ScopedTagPrinter resultTag(string, "result");
+		for(Uptr resultIndex = 0; resultIndex < functionType.results().size(); ++resultIndex)
+		{
+			string += ' ';
+			print(string, functionType.results()[resultIndex]);
+		}
+	}
+
+	// Print the function's locals.
+	for(Uptr localIndex = 0; localIndex < functionDef.nonParameterLocalTypes.size(); ++localIndex)
+	{
+		string += '\n';
+		ScopedTagPrinter localTag(string, "local");
+		string += ' ';
+		string += localNames[functionType.params().size() + localIndex];
+		string += ' ';
+		print(string, functionDef.nonParameterLocalTypes[localIndex]);
+	}
+
+	printFunctionBody();
+}
+
+// The function definitions are printed in batches: the batch's function definitions are printed in
+// parallel, and then written to the output in order.
+static constexpr Uptr numFunctionDefsPerPrintBatch = 1024;
+static constexpr Uptr printThreadStackBytes = 1024 * 1024;
+
+struct ParallelPrintState
+{
+	ModulePrintContext& moduleContext;
+	Uptr indentDepth;
+	Uptr batchBeginIndex;
+	Uptr batchEndIndex;
+	std::atomic<Uptr> nextFunctionDefIndex;
+	std::vector<std::string> functionDefStrings;
+
+	ParallelPrintState(ModulePrintContext& inModuleContext, Uptr inIndentDepth)
+	: moduleContext(inModuleContext), indentDepth(inIndentDepth)
+	{
+	}
+};
+
+static I64 printThreadEntry(void* stateVoid)
+{
+	ParallelPrintState& state = *(ParallelPrintState*)stateVoid;
+	std::string string;
+	while(true)
+	{
+		const Uptr functionDefIndex = state.nextFunctionDefIndex++;
+		if(functionDefIndex >= state.batchEndIndex) { break; }
+
+		// Print the function definition, and expand its indentation on this thread too: every
+		// function definition starts and ends at the same indentation depth.
+		FunctionPrintContext functionContext(state.moduleContext, functionDefIndex, string);
+		functionContext.printFunctionDef();
+
+		Uptr indentDepth = state.indentDepth;
+		appendExpandedIndentation(
+			state.functionDefStrings[functionDefIndex - state.batchBeginIndex], string, indentDepth);
+		wavmAssert(indentDepth == state.indentDepth);
+		string.clear();
+	}
+	return 0;
+}
+
+void ModulePrintContext::printFunctionDefs()
+{
+	const Uptr numFunctionDefs = module.functions.defs.size();
+	const Uptr numBatchThreads = std::min(
+		numThreads ? numThreads : Platform::getNumberOfHardwareThreads(), numFunctionDefs);
+	if(numBatchThreads <= 1)
+	{
+		for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionDefs; ++functionDefIndex)
+		{
+			FunctionPrintContext functionContext(*this, functionDefIndex, string);
+			functionContext.printFunctionDef();
+			output.write(string);
+			string.clear();
+		}
+		return;
+	}
+
+	ParallelPrintState state(*this, output.getIndentDepth());
+	for(Uptr batchBeginIndex = 0; batchBeginIndex < numFunctionDefs;
+		batchBeginIndex += numFunctionDefsPerPrintBatch)
+	{
+		// Print the batch's function definitions on the worker threads and the calling thread.
+		state.batchBeginIndex = batchBeginIndex;
+		state.batchEndIndex
+			= std::min(numFunctionDefs, batchBeginIndex + numFunctionDefsPerPrintBatch);
+		state.nextFunctionDefIndex.store(batchBeginIndex);
+		state.functionDefStrings.resize(state.batchEndIndex - batchBeginIndex);
+
+		std::vector<Platform::Thread*> threads;
+		for(Uptr threadIndex = 1; threadIndex < numBatchThreads; ++threadIndex)
+		{
+			threads.push_back(
+				Platform::createThread(printThreadStackBytes, printThreadEntry, &state));
+		}
+		printThreadEntry(&state);
+		for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+		// Write the printed function definitions in order, so the output doesn't depend on the
+		// number of threads.
+		for(std::string& functionDefString : state.functionDefStrings)
+		{
+			output.writeExpanded(functionDefString);
+			functionDefString = std::string();
+		}
+	}
+}
+
 void FunctionPrintContext::printFunctionBody()
 {
 	// string += "(";
@@ -1343,10 +1538,19 @@ void FunctionPrintContext::printFunctionBody()
 	string += INDENT_STRING "\n";
 }
 
-std::string WAST::print(const Module& module)
+std::string WAST::print(const Module& module, Uptr numThreads)
 {
-	std::string string;
-	ModulePrintContext context(module, string);
+	PrintOutput output;
+	ModulePrintContext context(module, output, numThreads);
+	context.printModule();
+	return std::move(output.text);
+}
+
+bool WAST::print(const Module& module, Platform::File* file, Uptr numThreads)
+{
+	PrintOutput output(file);
+	ModulePrintContext context(module, output, numThreads);
 	context.printModule();
-	return expandIndentation(std::move(string));
+	output.flush();
+	return !output.writeFailed;
 }
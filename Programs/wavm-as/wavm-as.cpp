@@ -7,9 +7,11 @@
 #include "WAVM/IR/Module.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/CLI.h"
+#include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Serialization.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTParse/WASTParse.h"
 
@@ -24,7 +26,8 @@ static bool loadTextModuleFromFile(const char* filename, IR::Module& outModule)
 	wastBytes.push_back(0);
 
 	std::vector<WAST::Error> parseErrors;
-	if(WAST::parseModule((const char*)wastBytes.data(), wastBytes.size(), outModule, parseErrors))
+	if(WAST::parseModule(
+		   (const char*)wastBytes.data(), wastBytes.size(), outModule, parseErrors, 0))
 	{ return true; }
 	else
 	{
@@ -86,28 +89,37 @@ int main(int argc, char** argv)
 		}
 	}
 
-	// Serialize the WASM module.
-	std::vector<U8> wasmBytes;
+	// Serialize the WASM module, writing the bytes to the output file as they are serialized.
+	Platform::File* outputFile = Platform::openFile(
+		outputFilename, Platform::FileAccessMode::writeOnly, Platform::FileCreateMode::createAlways);
+	if(!outputFile)
+	{
+		Log::printf(Log::error, "Couldn't write %s: couldn't open file.\n", outputFilename);
+		return EXIT_FAILURE;
+	}
+
+	bool writeSucceeded;
 	try
 	{
 		Timing::Timer saveTimer;
-
-		Serialization::ArrayOutputStream stream;
-		WASM::serialize(stream, module);
-		wasmBytes = stream.getBytes();
-
-		Timing::logRatePerSecond(
-			"Serialized WASM", saveTimer, wasmBytes.size() / 1024.0 / 1024.0, "MB");
+		writeSucceeded = WASM::serialize(outputFile, module);
+		Timing::logTimer("Serialized WASM", saveTimer);
 	}
 	catch(Serialization::FatalSerializationException exception)
 	{
+		errorUnless(Platform::closeFile(outputFile));
 		Log::printf(Log::error,
 					"Error serializing WebAssembly binary file:\n%s\n",
 					exception.message.c_str());
 		return EXIT_FAILURE;
 	}
 
-	// Write the serialized data to the output file.
-	return saveFile(outputFilename, wasmBytes.data(), wasmBytes.size()) ? EXIT_SUCCESS
-																		: EXIT_FAILURE;
+	errorUnless(Platform::closeFile(outputFile));
+	if(!writeSucceeded)
+	{
+		Log::printf(Log::error, "Couldn't write %s.\n", outputFilename);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
 }
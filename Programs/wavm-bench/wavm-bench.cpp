@@ -0,0 +1,530 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WAVM/Emscripten/Emscripten.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/CLI.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/ThreadTest/ThreadTest.h"
+#include "WAVM/WASM/WASM.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// A benchmark: a function of a module that is invoked a number of times in each iteration. If the
+// function name is "main", the module is run like wavm-run runs it: its main or _main export is
+// invoked with the program's command-line arguments.
+struct Benchmark
+{
+	std::string name;
+	std::string filename;
+	std::string functionName;
+	Uptr numInvocations;
+};
+
+// The time spent in each phase of one iteration of a benchmark, in milliseconds.
+struct IterationTimes
+{
+	F64 load = 0.0;
+	F64 compile = 0.0;
+	F64 instantiate = 0.0;
+	F64 run = 0.0;
+	Uptr numTraps = 0;
+};
+
+struct BenchmarkOptions
+{
+	Uptr numIterations = 5;
+	Uptr numWarmupIterations = 1;
+	CompileOptions compileOptions;
+};
+
+// Resolves imports from the Emscripten and ThreadTest intrinsic modules. Unlike wavm-run, it
+// doesn't generate stubs for missing imports: a benchmark that doesn't link is an error.
+struct IntrinsicResolver : Resolver
+{
+	HashMap<std::string, ModuleInstance*> moduleNameToInstanceMap;
+
+	bool resolve(const std::string& moduleName,
+				 const std::string& exportName,
+				 ObjectType type,
+				 Object*& outObject) override
+	{
+		ModuleInstance* const* namedInstance = moduleNameToInstanceMap.get(moduleName);
+		if(!namedInstance) { return false; }
+		outObject = getInstanceExport(*namedInstance, exportName);
+		return outObject && isA(outObject, type);
+	}
+};
+
+static bool loadModule(const char* filename, IR::Module& outModule)
+{
+	// Read the specified file into an array.
+	std::vector<U8> fileBytes;
+	if(!loadFile(filename, fileBytes)) { return false; }
+
+	// If the file starts with the WASM binary magic number, load it as a binary irModule.
+	static const U8 wasmMagicNumber[4] = {0x00, 0x61, 0x73, 0x6d};
+	if(fileBytes.size() >= 4 && !memcmp(fileBytes.data(), wasmMagicNumber, 4))
+	{ return WASM::loadBinaryModule(fileBytes.data(), fileBytes.size(), outModule); }
+	else
+	{
+		// Make sure the WAST file is null terminated.
+		fileBytes.push_back(0);
+
+		// Load it as a text irModule.
+		std::vector<WAST::Error> parseErrors;
+		if(!WAST::parseModule(
+			   (const char*)fileBytes.data(), fileBytes.size(), outModule, parseErrors))
+		{
+			Log::printf(Log::error, "Error parsing WebAssembly text file:\n");
+			WAST::reportParseErrors(filename, parseErrors);
+			return false;
+		}
+
+		return true;
+	}
+}
+
+// Runs one iteration of a benchmark: loads, compiles, and instantiates its module in a new
+// compartment, invokes its function, then frees the compartment.
+static bool runIteration(const Benchmark& benchmark,
+						 const BenchmarkOptions& options,
+						 IterationTimes& outTimes)
+{
+	// Load the module.
+	Timing::Timer loadTimer;
+	IR::Module irModule;
+	if(!loadModule(benchmark.filename.c_str(), irModule)) { return false; }
+	outTimes.load = loadTimer.getMilliseconds();
+
+	// Compile the module.
+	Timing::Timer compileTimer;
+	GCPointer<Runtime::Module> module = compileModule(irModule, options.compileOptions);
+	outTimes.compile = compileTimer.getMilliseconds();
+
+	// Link and instantiate the module in a new compartment.
+	Timing::Timer instantiateTimer;
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		IntrinsicResolver resolver;
+
+		std::unique_ptr<Emscripten::Instance> emscriptenInstance(
+			Emscripten::instantiate(compartment, irModule));
+		if(emscriptenInstance)
+		{
+			resolver.moduleNameToInstanceMap.set("env", emscriptenInstance->env);
+			resolver.moduleNameToInstanceMap.set("asm2wasm", emscriptenInstance->asm2wasm);
+			resolver.moduleNameToInstanceMap.set("global", emscriptenInstance->global);
+		}
+		resolver.moduleNameToInstanceMap.set("threadTest", ThreadTest::instantiate(compartment));
+
+		LinkResult linkResult = linkModule(irModule, resolver);
+		if(!linkResult.success)
+		{
+			for(auto& missingImport : linkResult.missingImports)
+			{
+				Log::printf(Log::error,
+							"%s: missing import: module=\"%s\" export=\"%s\" type=\"%s\"\n",
+							benchmark.name.c_str(),
+							missingImport.moduleName.c_str(),
+							missingImport.exportName.c_str(),
+							asString(missingImport.type).c_str());
+			}
+			return false;
+		}
+
+		ModuleInstance* moduleInstance = instantiateModule(
+			compartment, module, std::move(linkResult.resolvedImports), benchmark.name.c_str());
+		if(!moduleInstance) { return false; }
+
+		FunctionInstance* startFunction = getStartFunction(moduleInstance);
+		if(startFunction) { invokeFunctionChecked(context, startFunction, {}); }
+		if(emscriptenInstance) { Emscripten::initializeGlobals(context, irModule, moduleInstance); }
+
+		// Look up the function to invoke, and set up its arguments.
+		FunctionInstance* function;
+		std::vector<Value> invokeArgs;
+		if(benchmark.functionName == "main")
+		{
+			function = asFunctionNullable(getInstanceExport(moduleInstance, "main"));
+			if(!function)
+			{ function = asFunctionNullable(getInstanceExport(moduleInstance, "_main")); }
+			if(function && getFunctionType(function).params().size() == 2)
+			{
+				if(!emscriptenInstance)
+				{
+					Log::printf(Log::error,
+								"%s: module does not declare a default memory object to put "
+								"arguments in\n",
+								benchmark.name.c_str());
+					return false;
+				}
+				Emscripten::injectCommandArgs(
+					emscriptenInstance.get(), {benchmark.filename.c_str()}, invokeArgs);
+			}
+		}
+		else
+		{
+			function = asFunctionNullable(
+				getInstanceExport(moduleInstance, benchmark.functionName.c_str()));
+		}
+		if(!function)
+		{
+			Log::printf(Log::error,
+						"%s: module does not export function '%s'\n",
+						benchmark.name.c_str(),
+						benchmark.functionName.c_str());
+			return false;
+		}
+		if(getFunctionType(function).params().size() != invokeArgs.size())
+		{
+			Log::printf(Log::error,
+						"%s: function '%s' can't be invoked without arguments\n",
+						benchmark.name.c_str(),
+						benchmark.functionName.c_str());
+			return false;
+		}
+		outTimes.instantiate = instantiateTimer.getMilliseconds();
+
+		// Invoke the function, counting the invocations that trap.
+		Timing::Timer runTimer;
+		for(Uptr invocationIndex = 0; invocationIndex < benchmark.numInvocations;
+			++invocationIndex)
+		{
+			catchRuntimeExceptions([&] { invokeFunctionChecked(context, function, invokeArgs); },
+								   [&](Exception&&) { ++outTimes.numTraps; });
+		}
+		outTimes.run = runTimer.getMilliseconds();
+	}
+
+	// Free the compartment, so each iteration starts from the same state.
+	module = nullptr;
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+	collectGarbage();
+	return true;
+}
+
+// Appends a string to a JSON document as a quoted string literal.
+static void appendJSONString(std::string& json, const std::string& string)
+{
+	json += '"';
+	for(char c : string)
+	{
+		switch(c)
+		{
+		case '"': json += "\\\""; break;
+		case '\\': json += "\\\\"; break;
+		case '\n': json += "\\n"; break;
+		case '\t': json += "\\t"; break;
+		default:
+			if(U8(c) < 0x20)
+			{
+				char escape[7];
+				snprintf(escape, sizeof(escape), "\\u%04x", unsigned(U8(c)));
+				json += escape;
+			}
+			else
+			{
+				json += c;
+			}
+			break;
+		};
+	}
+	json += '"';
+}
+
+static void appendJSONNumber(std::string& json, F64 value)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.3f", value);
+	json += buffer;
+}
+
+static void appendJSONNumber(std::string& json, U64 value)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+	json += buffer;
+}
+
+// Appends the minimum, median, mean, and maximum of a set of samples to a JSON document as an
+// object.
+static void appendJSONSummary(std::string& json, std::vector<F64> samples)
+{
+	wavmAssert(samples.size());
+	std::sort(samples.begin(), samples.end());
+
+	F64 sum = 0.0;
+	for(F64 sample : samples) { sum += sample; }
+
+	const Uptr middleIndex = samples.size() / 2;
+	const F64 median = samples.size() % 2 ? samples[middleIndex]
+										  : (samples[middleIndex - 1] + samples[middleIndex]) / 2.0;
+
+	json += "{\"min\": ";
+	appendJSONNumber(json, samples.front());
+	json += ", \"median\": ";
+	appendJSONNumber(json, median);
+	json += ", \"mean\": ";
+	appendJSONNumber(json, sum / F64(samples.size()));
+	json += ", \"max\": ";
+	appendJSONNumber(json, samples.back());
+	json += "}";
+}
+
+// Runs the warmup and measured iterations of a benchmark, and appends its results to a JSON
+// document as an object.
+static bool runBenchmark(const Benchmark& benchmark,
+						 const BenchmarkOptions& options,
+						 std::string& json)
+{
+	Log::printf(Log::debug, "Running benchmark %s\n", benchmark.name.c_str());
+
+	std::vector<IterationTimes> iterations;
+	for(Uptr iterationIndex = 0;
+		iterationIndex < options.numWarmupIterations + options.numIterations;
+		++iterationIndex)
+	{
+		IterationTimes times;
+		if(!runIteration(benchmark, options, times)) { return false; }
+		if(iterationIndex >= options.numWarmupIterations) { iterations.push_back(times); }
+	}
+
+	std::vector<F64> loadTimes, compileTimes, instantiateTimes, runTimes;
+	for(const IterationTimes& times : iterations)
+	{
+		loadTimes.push_back(times.load);
+		compileTimes.push_back(times.compile);
+		instantiateTimes.push_back(times.instantiate);
+		runTimes.push_back(times.run);
+	}
+
+	// The steady-state throughput is derived from the median run time, which is less sensitive
+	// to outlying iterations than the mean.
+	std::vector<F64> sortedRunTimes = runTimes;
+	std::sort(sortedRunTimes.begin(), sortedRunTimes.end());
+	const F64 medianRunSeconds = sortedRunTimes[sortedRunTimes.size() / 2] / 1000.0;
+
+	json += "    {\"name\": ";
+	appendJSONString(json, benchmark.name);
+	json += ", \"file\": ";
+	appendJSONString(json, benchmark.filename);
+	json += ", \"function\": ";
+	appendJSONString(json, benchmark.functionName);
+	json += ", \"invocations\": ";
+	appendJSONNumber(json, U64(benchmark.numInvocations));
+	json += ",\n     \"loadMs\": ";
+	appendJSONSummary(json, loadTimes);
+	json += ",\n     \"compileMs\": ";
+	appendJSONSummary(json, compileTimes);
+	json += ",\n     \"instantiateMs\": ";
+	appendJSONSummary(json, instantiateTimes);
+	json += ",\n     \"runMs\": ";
+	appendJSONSummary(json, runTimes);
+	json += ",\n     \"invocationsPerSecond\": ";
+	appendJSONNumber(json,
+					 medianRunSeconds > 0.0 ? F64(benchmark.numInvocations) / medianRunSeconds
+											: 0.0);
+	json += ", \"trapsPerIteration\": ";
+	appendJSONNumber(json, U64(iterations.back().numTraps));
+	json += ", \"peakResidentBytes\": ";
+	appendJSONNumber(json, U64(Platform::getPeakResidentBytes()));
+	json += "}";
+	return true;
+}
+
+// Parses a suite file. Each line that isn't blank or a # comment describes a benchmark with four
+// whitespace-separated fields: its name, the path of its module relative to the suite file, the
+// name of the function to invoke, and the number of invocations in each iteration.
+static bool loadSuite(const char* filename, std::vector<Benchmark>& outBenchmarks)
+{
+	std::vector<U8> fileBytes;
+	if(!loadFile(filename, fileBytes)) { return false; }
+	const std::string text(fileBytes.begin(), fileBytes.end());
+
+	std::string directory = filename;
+	const Uptr separatorIndex = directory.find_last_of("/\\");
+	directory = separatorIndex == std::string::npos ? "" : directory.substr(0, separatorIndex + 1);
+
+	Uptr lineNumber = 0;
+	Uptr lineBegin = 0;
+	while(lineBegin < text.size())
+	{
+		Uptr lineEnd = text.find('\n', lineBegin);
+		if(lineEnd == std::string::npos) { lineEnd = text.size(); }
+		std::string line = text.substr(lineBegin, lineEnd - lineBegin);
+		lineBegin = lineEnd + 1;
+		++lineNumber;
+
+		const Uptr commentIndex = line.find('#');
+		if(commentIndex != std::string::npos) { line.resize(commentIndex); }
+
+		std::vector<std::string> fields;
+		Uptr fieldBegin = line.find_first_not_of(" \t\r");
+		while(fieldBegin != std::string::npos)
+		{
+			Uptr fieldEnd = line.find_first_of(" \t\r", fieldBegin);
+			if(fieldEnd == std::string::npos) { fieldEnd = line.size(); }
+			fields.push_back(line.substr(fieldBegin, fieldEnd - fieldBegin));
+			fieldBegin = line.find_first_not_of(" \t\r", fieldEnd);
+		}
+		if(!fields.size()) { continue; }
+
+		const Uptr numInvocations
+			= fields.size() == 4 ? Uptr(strtoull(fields[3].c_str(), nullptr, 10)) : 0;
+		if(!numInvocations)
+		{
+			Log::printf(Log::error,
+						"%s:%" PRIuPTR ": expected: name path function invocations\n",
+						filename,
+						lineNumber);
+			return false;
+		}
+		outBenchmarks.push_back({fields[0], directory + fields[1], fields[2], numInvocations});
+	}
+
+	return true;
+}
+
+static void showHelp()
+{
+	Log::printf(Log::error,
+				"Usage: wavm-bench [switches] [programfile...]\n"
+				"  in.wast|in.wasm       Benchmark running a program's main function once per\n"
+				"                        iteration\n"
+				"  --suite file          Benchmark the modules and functions listed in a suite\n"
+				"                        file (e.g. Test/benchmarks/suite.txt)\n"
+				"  --iterations n        Number of measured iterations of each benchmark\n"
+				"                        (default 5)\n"
+				"  --warmup n            Number of iterations of each benchmark to run before the\n"
+				"                        measured iterations (default 1)\n"
+				"  --output file         Write the JSON results to a file instead of stdout, which\n"
+				"                        the benchmarked programs may also write to\n"
+				"  --optimize level      Optimization level: none, fast (default), O2, or O3\n"
+				"  -d|--debug            Write additional debug information to stdout\n"
+				"\n"
+				"Each iteration loads, compiles, instantiates, and runs the benchmark in a new\n"
+				"compartment; the results report the time spent in each phase of the measured\n"
+				"iterations. peakResidentBytes is the peak for the process when the benchmark\n"
+				"finished, so it includes the benchmarks that ran before it.\n");
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	std::vector<Benchmark> benchmarks;
+	const char* outputFilename = nullptr;
+	for(char** args = argv + 1; *args; ++args)
+	{
+		if(!strcmp(*args, "--suite"))
+		{
+			if(!*++args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			if(!loadSuite(*args, benchmarks)) { return EXIT_FAILURE; }
+		}
+		else if(!strcmp(*args, "--iterations"))
+		{
+			if(!*++args || !(options.numIterations = Uptr(strtoull(*args, nullptr, 10))))
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*args, "--warmup"))
+		{
+			if(!*++args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.numWarmupIterations = Uptr(strtoull(*args, nullptr, 10));
+		}
+		else if(!strcmp(*args, "--output"))
+		{
+			if(!*++args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			outputFilename = *args;
+		}
+		else if(!strcmp(*args, "--optimize"))
+		{
+			if(!*++args
+			   || !parseOptimizationLevel(*args, options.compileOptions.optimizationLevel))
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*args, "--debug") || !strcmp(*args, "-d"))
+		{
+			Log::setCategoryEnabled(Log::debug, true);
+		}
+		else if(!strcmp(*args, "--help") || !strcmp(*args, "-h"))
+		{
+			showHelp();
+			return EXIT_SUCCESS;
+		}
+		else
+		{
+			benchmarks.push_back({*args, *args, "main", 1});
+		}
+	}
+
+	if(!benchmarks.size())
+	{
+		showHelp();
+		return EXIT_FAILURE;
+	}
+
+	// Treat any unhandled exception (e.g. in a start function) as a fatal error.
+	Runtime::setUnhandledExceptionHandler([](Runtime::Exception&& exception) {
+		Errors::fatalf("Runtime exception: %s\n", describeException(exception).c_str());
+	});
+
+	std::string json = "{\"iterations\": ";
+	appendJSONNumber(json, U64(options.numIterations));
+	json += ", \"warmupIterations\": ";
+	appendJSONNumber(json, U64(options.numWarmupIterations));
+	json += ",\n  \"benchmarks\": [\n";
+	for(Uptr benchmarkIndex = 0; benchmarkIndex < benchmarks.size(); ++benchmarkIndex)
+	{
+		if(benchmarkIndex) { json += ",\n"; }
+		if(!runBenchmark(benchmarks[benchmarkIndex], options, json)) { return EXIT_FAILURE; }
+	}
+	json += "\n  ]\n}\n";
+
+	if(outputFilename)
+	{
+		return saveFile(outputFilename, json.data(), json.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	else
+	{
+		fwrite(json.data(), 1, json.size(), stdout);
+		return EXIT_SUCCESS;
+	}
+}
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -5,9 +6,11 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/CLI.h"
 #include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/LZ4.h"
 #include "WAVM/Inline/Serialization.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTParse/WASTParse.h"
@@ -45,49 +48,240 @@ static bool loadModule(const char* filename, IR::Module& outModule)
 	}
 }
 
+// Reads the object code and incremental compile manifest embedded in the output of a previous
+// incremental compile. If the file doesn't exist or isn't valid, leaves them empty.
+static void loadPreviousIncrementalCompile(const char* filename,
+										   const IR::FeatureSpec& featureSpec,
+										   std::vector<U8>& outObjectCode,
+										   std::vector<U8>& outManifest)
+{
+	Platform::File* file = Platform::openFile(
+		filename, Platform::FileAccessMode::readOnly, Platform::FileCreateMode::openExisting);
+	if(!file) { return; }
+	errorUnless(Platform::closeFile(file));
+
+	std::vector<U8> fileBytes;
+	IR::Module previousModule(featureSpec);
+	if(!loadFile(filename, fileBytes)
+	   || !WASM::loadBinaryModuleDeclarations(
+		   fileBytes.data(), fileBytes.size(), previousModule, Log::debug))
+	{ return; }
+
+	for(const UserSection& userSection : previousModule.userSections)
+	{
+		if(userSection.name == "wavm.precompiled_object")
+		{ outObjectCode.assign(userSection.data.begin(), userSection.data.end()); }
+		else if(userSection.name == "wavm.precompiled_object.lz4")
+		{
+			if(!LZ4::decompress(userSection.data.data(), userSection.data.size(), outObjectCode))
+			{ outObjectCode.clear(); }
+		}
+		else if(userSection.name == "wavm.incremental_manifest")
+		{
+			outManifest.assign(userSection.data.begin(), userSection.data.end());
+		}
+	}
+	if(!outObjectCode.size()) { outManifest.clear(); }
+}
+
+static void showHelp()
+{
+	Log::printf(Log::error,
+				"Usage: wavm-compile [switches] (in.wast|in.wasm) (out.wasm|out.o)\n"
+				"  --optimize level      Optimization level: none, fast (default), O2, or O3\n"
+				"  --codegen-optimize level\n"
+				"                        Code generator optimization level: none, less, default,\n"
+				"                        or aggressive (defaults to match --optimize)\n"
+				"  --target-cpu cpu      Generate code for an LLVM CPU name instead of the host CPU\n"
+				"  --target-features f   Enable or disable a comma-separated list of LLVM target\n"
+				"                        features (e.g. +avx2,-avx512f)\n"
+				"  --target-version cpu[:f]\n"
+				"                        Also compile a version of the code for an LLVM CPU name\n"
+				"                        and optional target features, which is loaded instead of\n"
+				"                        the --target-cpu version on hosts that support it. May be\n"
+				"                        repeated, in order of preference (e.g. --target-version\n"
+				"                        skylake-avx512 --target-version haswell)\n"
+				"  --object              Write the module's native code as a single relocatable\n"
+				"                        object file instead of embedding it in out.wasm. Its\n"
+				"                        references to the module's types, memories, tables and\n"
+				"                        imports are undefined symbols that the embedder binds.\n"
+				"  --compress            Compress the native code embedded in out.wasm with LZ4\n"
+				"  --incremental         If out.wasm was written by an incremental compile, only\n"
+				"                        recompile the parts of the module that have changed since\n"
+				"                        then, and reuse its native code for the rest\n");
+}
+
 int main(int argc, char** argv)
 {
-	if(argc != 3)
+	// Compile the module's IR using all the host's hardware threads.
+	Runtime::CompileOptions compileOptions;
+	compileOptions.numCompileThreads = 0;
+
+	const char* inputFilename = nullptr;
+	const char* outputFilename = nullptr;
+	bool writeObject = false;
+	bool compressObject = false;
+	bool incremental = false;
+	for(char** args = argv + 1; *args; ++args)
 	{
-		Log::printf(Log::error, "Usage: wavm-compile (in.wast|in.wasm) out.wasm\n");
+		if(!strcmp(*args, "--object")) { writeObject = true; }
+		else if(!strcmp(*args, "--compress")) { compressObject = true; }
+		else if(!strcmp(*args, "--incremental")) { incremental = true; }
+		else if(!strcmp(*args, "--optimize"))
+		{
+			if(!*++args || !parseOptimizationLevel(*args, compileOptions.optimizationLevel))
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*args, "--codegen-optimize"))
+		{
+			if(!*++args
+			   || !parseCodeGenOptimizationLevel(*args, compileOptions.codeGenOptimizationLevel))
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*args, "--target-cpu"))
+		{
+			if(!*++args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			compileOptions.targetCPU = *args;
+		}
+		else if(!strcmp(*args, "--target-features"))
+		{
+			if(!*++args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			appendTargetFeatures(*args, compileOptions.targetFeatures);
+		}
+		else if(!strcmp(*args, "--target-version"))
+		{
+			if(!*++args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			Runtime::CompileOptions::TargetVersion targetVersion;
+			const char* featureList = strchr(*args, ':');
+			if(!featureList) { targetVersion.targetCPU = *args; }
+			else
+			{
+				targetVersion.targetCPU = std::string(*args, featureList - *args);
+				appendTargetFeatures(featureList + 1, targetVersion.targetFeatures);
+			}
+			compileOptions.targetVersions.push_back(std::move(targetVersion));
+		}
+		else if(!inputFilename)
+		{
+			inputFilename = *args;
+		}
+		else if(!outputFilename)
+		{
+			outputFilename = *args;
+		}
+		else
+		{
+			showHelp();
+			return EXIT_FAILURE;
+		}
+	}
+	if(!inputFilename || !outputFilename
+	   || (writeObject && (compileOptions.targetVersions.size() || compressObject || incremental))
+	   || (incremental && compileOptions.targetVersions.size()))
+	{
+		showHelp();
 		return EXIT_FAILURE;
 	}
-	const char* inputFilename = argv[1];
-	const char* outputFilename = argv[2];
+
+	// Compiling in parallel partitions produces a WAVM-specific package of several object files, so
+	// compile the module on a single thread to write it as a single object file.
+	if(writeObject) { compileOptions.numCompileThreads = 1; }
 
 	IR::Module irModule;
 
 	// Load the module IR.
 	if(!loadModule(inputFilename, irModule)) { return EXIT_FAILURE; }
 
-	// Compile the module's IR.
-	Runtime::Module* module = Runtime::compileModule(irModule);
+	// Compile the module's IR. An incremental compile reuses the object code embedded in the
+	// previous output file, and embeds the manifest of the new object code in the output file.
+	Runtime::Module* module;
+	if(!incremental) { module = Runtime::compileModule(irModule, compileOptions); }
+	else
+	{
+		std::vector<U8> previousObjectCode;
+		std::vector<U8> previousManifest;
+		loadPreviousIncrementalCompile(
+			outputFilename, irModule.featureSpec, previousObjectCode, previousManifest);
+
+		std::vector<U8> manifest;
+		module = Runtime::compileModuleIncrementally(
+			irModule, previousObjectCode, previousManifest, manifest, compileOptions);
+		if(manifest.size())
+		{ irModule.userSections.push_back({"wavm.incremental_manifest", std::move(manifest)}); }
+	}
+
+	// Write the compiled object code to the output file.
+	if(writeObject)
+	{
+		const std::vector<U8> objectCode = Runtime::getObjectCode(module);
+		return saveFile(outputFilename, objectCode.data(), objectCode.size()) ? EXIT_SUCCESS
+																			   : EXIT_FAILURE;
+	}
 
 	// Extract the compiled object code and add it to the IR module as a user section.
-	irModule.userSections.push_back({"wavm.precompiled_object", Runtime::getObjectCode(module)});
+	if(!compressObject)
+	{
+		irModule.userSections.push_back(
+			{"wavm.precompiled_object", Runtime::getObjectCode(module)});
+	}
+	else
+	{
+		const std::vector<U8> objectCode = Runtime::getObjectCode(module);
+		std::vector<U8> compressedObjectCode;
+		LZ4::compress(objectCode.data(), objectCode.size(), compressedObjectCode);
+		irModule.userSections.push_back(
+			{"wavm.precompiled_object.lz4", std::move(compressedObjectCode)});
+	}
+
+	// Serialize the WASM module, writing the bytes to the output file as they are serialized.
+	Platform::File* outputFile = Platform::openFile(
+		outputFilename, Platform::FileAccessMode::writeOnly, Platform::FileCreateMode::createAlways);
+	if(!outputFile)
+	{
+		Log::printf(Log::error, "Couldn't write %s: couldn't open file.\n", outputFilename);
+		return EXIT_FAILURE;
+	}
 
-	// Serialize the WASM module.
-	std::vector<U8> wasmBytes;
+	bool writeSucceeded;
 	try
 	{
 		Timing::Timer saveTimer;
-
-		Serialization::ArrayOutputStream stream;
-		WASM::serialize(stream, irModule);
-		wasmBytes = stream.getBytes();
-
-		Timing::logRatePerSecond(
-			"Serialized WASM", saveTimer, wasmBytes.size() / 1024.0 / 1024.0, "MB");
+		writeSucceeded = WASM::serialize(outputFile, irModule);
+		Timing::logTimer("Serialized WASM", saveTimer);
 	}
 	catch(Serialization::FatalSerializationException exception)
 	{
+		errorUnless(Platform::closeFile(outputFile));
 		Log::printf(Log::error,
 					"Error serializing WebAssembly binary file:\n%s\n",
 					exception.message.c_str());
 		return EXIT_FAILURE;
 	}
 
-	// Write the serialized data to the output file.
-	return saveFile(outputFilename, wasmBytes.data(), wasmBytes.size()) ? EXIT_SUCCESS
-																		: EXIT_FAILURE;
+	errorUnless(Platform::closeFile(outputFile));
+	if(!writeSucceeded)
+	{
+		Log::printf(Log::error, "Couldn't write %s.\n", outputFilename);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
 }
@@ -6,6 +6,7 @@
 #include "WAVM/Inline/CLI.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTPrint/WASTPrint.h"
 
@@ -34,13 +35,25 @@ int main(int argc, char** argv)
 	IR::Module module;
 	if(!loadBinaryModuleFromFile(inputFilename, module)) { return EXIT_FAILURE; }
 
-	// Print the module to WAST.
+	// Print the module to WAST, writing the text to the output file as it is printed, and using
+	// all hardware threads to print the function definitions.
+	Platform::File* outputFile = Platform::openFile(
+		outputFilename, Platform::FileAccessMode::writeOnly, Platform::FileCreateMode::createAlways);
+	if(!outputFile)
+	{
+		Log::printf(Log::error, "Couldn't write %s: couldn't open file.\n", outputFilename);
+		return EXIT_FAILURE;
+	}
+
 	Timing::Timer printTimer;
-	const std::string wastString = WAST::print(module);
-	Timing::logRatePerSecond(
-		"Printed WAST", printTimer, F64(wastString.size()) / 1024.0 / 1024.0, "MB");
+	const bool printSucceeded = WAST::print(module, outputFile, 0);
+	errorUnless(Platform::closeFile(outputFile));
+	if(!printSucceeded)
+	{
+		Log::printf(Log::error, "Couldn't write %s.\n", outputFilename);
+		return EXIT_FAILURE;
+	}
+	Timing::logTimer("Printed WAST", printTimer);
 
-	// Write the serialized data to the output file.
-	return saveFile(outputFilename, wastString.data(), wastString.size()) ? EXIT_SUCCESS
-																		  : EXIT_FAILURE;
+	return EXIT_SUCCESS;
 }
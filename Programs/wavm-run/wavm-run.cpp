@@ -1,11 +1,13 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "WAVM/Emscripten/Emscripten.h"
+#include "WAVM/HostAccel/HostAccel.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Operators.h"
 #include "WAVM/IR/Types.h"
@@ -13,18 +15,30 @@
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/CLI.h"
+#include "WAVM/Inline/Config.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/LZ4.h"
 #include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/SharedBytes.h"
 #include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Logging/Metrics.h"
+#include "WAVM/Logging/Trace.h"
+#include "WAVM/ParallelFor/ParallelFor.h"
+#include "WAVM/Platform/Diagnostics.h"
 #include "WAVM/Runtime/Linker.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/ThreadTest/ThreadTest.h"
 #include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTParse/WASTParse.h"
 
+#if WAVM_ENABLE_WASI
+#include "WAVM/WASI/WASI.h"
+#endif
+
 using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::Runtime;
@@ -123,19 +137,31 @@ struct RootResolver : Resolver
 	}
 };
 
-static bool loadModule(const char* filename, IR::Module& outModule)
+// Loads a module from a binary or text WebAssembly file. If onlyDeclarations is true, a binary
+// module's function bodies aren't decoded or validated; see WASM::serializeDeclarations.
+static bool loadModule(const char* filename,
+					   IR::Module& outModule,
+					   Uptr numValidationThreads,
+					   bool onlyDeclarations)
 {
-	// Read the specified file into an array.
-	std::vector<U8> fileBytes;
-	if(!loadFile(filename, fileBytes)) { return false; }
+	// Map the specified file into memory.
+	SharedBytes mappedFileBytes;
+	if(!loadMappedFile(filename, mappedFileBytes)) { return false; }
 
-	// If the file starts with the WASM binary magic number, load it as a binary irModule.
+	// If the file starts with the WASM binary magic number, load it as a binary irModule. The
+	// irModule's data segments and user sections refer to the mapped file instead of copying it.
 	static const U8 wasmMagicNumber[4] = {0x00, 0x61, 0x73, 0x6d};
-	if(fileBytes.size() >= 4 && !memcmp(fileBytes.data(), wasmMagicNumber, 4))
-	{ return WASM::loadBinaryModule(fileBytes.data(), fileBytes.size(), outModule); }
+	if(mappedFileBytes.size() >= 4 && !memcmp(mappedFileBytes.data(), wasmMagicNumber, 4))
+	{
+		if(onlyDeclarations)
+		{ return WASM::loadBinaryModuleDeclarations(mappedFileBytes, outModule, Log::error); }
+		return WASM::loadBinaryModule(
+			mappedFileBytes, outModule, Log::error, numValidationThreads);
+	}
 	else
 	{
-		// Make sure the WAST file is null terminated.
+		// Copy the WAST file to make sure it is null terminated.
+		std::vector<U8> fileBytes(mappedFileBytes.begin(), mappedFileBytes.end());
 		fileBytes.push_back(0);
 
 		// Load it as a text irModule.
@@ -156,32 +182,486 @@ struct CommandLineOptions
 {
 	const char* filename = nullptr;
 	const char* functionName = nullptr;
+	Runtime::CompileOptions compileOptions;
 	char** args = nullptr;
 	bool onlyCheck = false;
 	bool enableEmscripten = true;
+	std::vector<const char*> wasiDirectories;
 	bool enableThreadTest = false;
+	bool enableParallelFor = false;
+	bool enableHostAccel = false;
+	bool useThreadPool = false;
 	bool precompiled = false;
+	bool useLargePages = false;
+	bool packJITCode = false;
+	Uptr numaNode = UINTPTR_MAX;
+	I64 fuel = -1;
+	Uptr stackBudgetBytes = 0;
+	Uptr numValidationThreads = 1;
+	const char* profileOutputFilename = nullptr;
+	bool printFunctionProfile = false;
+	const char* sampleProfileFilename = nullptr;
+	Uptr samplesPerSecond = 1000;
+	bool writePerfMap = false;
+	bool writeJITDump = false;
+	bool printMetrics = false;
+	const char* traceFilename = nullptr;
+	bool serve = false;
+	Uptr servePoolSize = 4;
+};
+
+// Prints the values of the metrics collected while compiling and running the module.
+static void printMetrics()
+{
+	for(const Metrics::MetricValue& metric : Metrics::getMetrics())
+	{
+		switch(metric.type)
+		{
+		case Metrics::Type::counter:
+		case Metrics::Type::gauge:
+			Log::printf(Log::error, "%-40s %20" PRIi64 "\n", metric.name.c_str(), metric.value);
+			break;
+		case Metrics::Type::histogram:
+			Log::printf(Log::error,
+						"%-40s %20" PRIu64 " samples, sum %" PRIu64 "\n",
+						metric.name.c_str(),
+						metric.count,
+						metric.sum);
+			break;
+		default: Errors::unreachable();
+		};
+	}
+}
+
+// Prints the functions of a module instance that were called, ordered by the cycles spent in them.
+static void printFunctionProfile(ModuleInstance* moduleInstance)
+{
+	std::vector<FunctionProfile> functionProfiles = getFunctionProfiles(moduleInstance);
+	std::sort(functionProfiles.begin(),
+			  functionProfiles.end(),
+			  [](const FunctionProfile& left, const FunctionProfile& right) {
+				  return left.numCycles > right.numCycles
+						 || (left.numCycles == right.numCycles && left.numCalls > right.numCalls);
+			  });
+
+	U64 totalCycles = 0;
+	for(const FunctionProfile& functionProfile : functionProfiles)
+	{ totalCycles += functionProfile.numCycles; }
+
+	// The cycles spent in a function include its callees, so the percentages don't add up to 100.
+	Log::printf(Log::error, "%20s %8s %20s  %s\n", "cycles", "%", "calls", "function");
+	for(const FunctionProfile& functionProfile : functionProfiles)
+	{
+		if(!functionProfile.numCalls) { break; }
+		Log::printf(Log::error,
+					"%20" PRIu64 " %7.2f%% %20" PRIu64 "  %s\n",
+					functionProfile.numCycles,
+					totalCycles ? F64(functionProfile.numCycles) * 100.0 / F64(totalCycles) : 0.0,
+					functionProfile.numCalls,
+					functionProfile.name.c_str());
+	}
+}
+
+// Appends a field of a protocol buffer message to a stream.
+static void writeProtoVarInt(Serialization::OutputStream& stream, U64 fieldNumber, U64 value)
+{
+	U64 key = fieldNumber << 3;
+	Serialization::serializeVarUInt64(stream, key);
+	Serialization::serializeVarUInt64(stream, value);
+}
+static void writeProtoBytes(Serialization::OutputStream& stream,
+							U64 fieldNumber,
+							const std::vector<U8>& bytes)
+{
+	U64 key = (fieldNumber << 3) | 2;
+	U64 numBytes = bytes.size();
+	Serialization::serializeVarUInt64(stream, key);
+	Serialization::serializeVarUInt64(stream, numBytes);
+	Serialization::serializeBytes(stream, bytes.data(), bytes.size());
+}
+
+// Encodes sampled call stacks as a pprof profile: an uncompressed Profile protocol buffer message,
+// as defined by https://github.com/google/pprof/blob/master/proto/profile.proto.
+static std::vector<U8> encodePProfProfile(const std::vector<SampledCallStack>& callStacks,
+										  Uptr samplesPerSecond)
+{
+	enum
+	{
+		profileSampleType = 1,
+		profileSample = 2,
+		profileLocation = 4,
+		profileFunction = 5,
+		profileStringTable = 6,
+		profilePeriodType = 11,
+		profilePeriod = 12,
+	};
+
+	// Strings are referenced by their index in the string table, which must start with "".
+	std::vector<std::string> strings{""};
+	HashMap<std::string, U64> stringToIndexMap;
+	auto getStringIndex = [&](const std::string& string) -> U64 {
+		U64& index = stringToIndexMap.getOrAdd(string, strings.size());
+		if(index == strings.size()) { strings.push_back(string); }
+		return index;
+	};
+
+	auto encodeValueType = [&](const char* type, const char* unit) {
+		Serialization::ArrayOutputStream valueTypeStream;
+		writeProtoVarInt(valueTypeStream, 1, getStringIndex(type));
+		writeProtoVarInt(valueTypeStream, 2, getStringIndex(unit));
+		return valueTypeStream.getBytes();
+	};
+
+	const U64 nanosecondsPerSample = U64(1000000000) / samplesPerSecond;
+	Serialization::ArrayOutputStream stream;
+	writeProtoBytes(stream, profileSampleType, encodeValueType("samples", "count"));
+	writeProtoBytes(stream, profileSampleType, encodeValueType("cpu", "nanoseconds"));
+
+	// Each function has a location with the same ID, which starts at 1.
+	HashMap<std::string, U64> functionNameToIdMap;
+	std::vector<const std::string*> functionNames;
+	for(const SampledCallStack& callStack : callStacks)
+	{
+		// A sample lists its locations innermost first.
+		Serialization::ArrayOutputStream sampleStream;
+		for(auto nameIt = callStack.functionNames.rbegin();
+			nameIt != callStack.functionNames.rend();
+			++nameIt)
+		{
+			U64& functionId = functionNameToIdMap.getOrAdd(*nameIt, functionNames.size() + 1);
+			if(functionId == functionNames.size() + 1) { functionNames.push_back(&*nameIt); }
+			writeProtoVarInt(sampleStream, 1, functionId);
+		}
+		writeProtoVarInt(sampleStream, 2, callStack.numSamples);
+		writeProtoVarInt(sampleStream, 2, callStack.numSamples * nanosecondsPerSample);
+		writeProtoBytes(stream, profileSample, sampleStream.getBytes());
+	}
+
+	for(Uptr functionIndex = 0; functionIndex < functionNames.size(); ++functionIndex)
+	{
+		const U64 functionId = functionIndex + 1;
+
+		Serialization::ArrayOutputStream lineStream;
+		writeProtoVarInt(lineStream, 1, functionId);
+		Serialization::ArrayOutputStream locationStream;
+		writeProtoVarInt(locationStream, 1, functionId);
+		writeProtoBytes(locationStream, 4, lineStream.getBytes());
+		writeProtoBytes(stream, profileLocation, locationStream.getBytes());
+
+		Serialization::ArrayOutputStream functionStream;
+		writeProtoVarInt(functionStream, 1, functionId);
+		writeProtoVarInt(functionStream, 2, getStringIndex(*functionNames[functionIndex]));
+		writeProtoBytes(stream, profileFunction, functionStream.getBytes());
+	}
+
+	writeProtoBytes(stream, profilePeriodType, encodeValueType("cpu", "nanoseconds"));
+	writeProtoVarInt(stream, profilePeriod, nanosecondsPerSample);
+
+	for(const std::string& string : strings)
+	{ writeProtoBytes(stream, profileStringTable, std::vector<U8>(string.begin(), string.end())); }
+
+	return stream.getBytes();
+}
+
+// Writes the call stacks sampled while running the program to a file: as a pprof profile if the
+// filename ends with .pb or .pprof, or otherwise as folded stacks, as read by flamegraph.pl.
+static bool writeSampleProfile(const CommandLineOptions& options)
+{
+	U64 numDroppedSamples = 0;
+	const std::vector<SampledCallStack> callStacks = getSampledGuestCallStacks(numDroppedSamples);
+	if(numDroppedSamples)
+	{
+		Log::printf(Log::error, "Dropped %" PRIu64 " call stack samples\n", numDroppedSamples);
+	}
+
+	const std::string filename = options.sampleProfileFilename;
+	auto hasExtension = [&](const char* extension) {
+		const Uptr numExtensionChars = strlen(extension);
+		return filename.size() >= numExtensionChars
+			   && !filename.compare(
+				   filename.size() - numExtensionChars, numExtensionChars, extension);
+	};
+
+	std::vector<U8> bytes;
+	if(hasExtension(".pb") || hasExtension(".pprof"))
+	{ bytes = encodePProfProfile(callStacks, options.samplesPerSecond); }
+	else
+	{
+		// Each line of folded stacks is the function names of a call stack, outermost first and
+		// separated by ';', followed by a space and the number of samples.
+		std::string foldedStacks;
+		for(const SampledCallStack& callStack : callStacks)
+		{
+			for(Uptr nameIndex = 0; nameIndex < callStack.functionNames.size(); ++nameIndex)
+			{
+				if(nameIndex) { foldedStacks += ';'; }
+				std::string name = callStack.functionNames[nameIndex];
+				std::replace(name.begin(), name.end(), ';', ':');
+				std::replace(name.begin(), name.end(), ' ', '_');
+				foldedStacks += name;
+			}
+			foldedStacks += ' ' + std::to_string(callStack.numSamples) + '\n';
+		}
+		bytes.assign(foldedStacks.begin(), foldedStacks.end());
+	}
+	return saveFile(options.sampleProfileFilename, bytes.data(), bytes.size());
+}
+
+// Parses a command-line argument for a function parameter. Returns false if the parameter's type
+// can't be passed on the command line.
+static bool parseArgument(const char* string, ValueType type, Value& outValue)
+{
+	switch(type)
+	{
+	case ValueType::i32: outValue = (U32)atoi(string); return true;
+	case ValueType::i64: outValue = (U64)atol(string); return true;
+	case ValueType::f32: outValue = (F32)atof(string); return true;
+	case ValueType::f64: outValue = atof(string); return true;
+	case ValueType::v128:
+	case ValueType::anyref:
+	case ValueType::anyfunc: return false;
+	default: Errors::unreachable();
+	}
+}
+
+static void logMissingImports(const LinkResult& linkResult)
+{
+	Log::printf(Log::error, "Failed to link module:\n");
+	for(auto& missingImport : linkResult.missingImports)
+	{
+		Log::printf(Log::error,
+					"Missing import: module=\"%s\" export=\"%s\" type=\"%s\"\n",
+					missingImport.moduleName.c_str(),
+					missingImport.exportName.c_str(),
+					asString(missingImport.type).c_str());
+	}
+}
+
+// An instance of the program in its own compartment, that has already run its start function.
+struct ServeInstance
+{
+	GCPointer<Compartment> compartment;
+	Context* context = nullptr;
+	ModuleInstance* moduleInstance = nullptr;
 };
 
+static bool createServeInstance(const CommandLineOptions& options,
+								const IR::Module& irModule,
+								Runtime::Module* module,
+								ServeInstance& outInstance)
+{
+	outInstance.compartment = Runtime::createCompartment(
+		options.useLargePages, options.numaNode, options.packJITCode);
+	RootResolver rootResolver(outInstance.compartment);
+	if(options.enableThreadTest)
+	{
+		ThreadTest::setUseWorkerPool(options.useThreadPool);
+		rootResolver.moduleNameToInstanceMap.set(
+			"threadTest", ThreadTest::instantiate(outInstance.compartment));
+	}
+	if(options.enableParallelFor)
+	{
+		rootResolver.moduleNameToInstanceMap.set(
+			"parallelFor", ParallelFor::instantiate(outInstance.compartment));
+	}
+	if(options.enableHostAccel)
+	{
+		rootResolver.moduleNameToInstanceMap.set(
+			"hostAccel", HostAccel::instantiate(outInstance.compartment));
+	}
+
+	LinkResult linkResult = linkModule(irModule, rootResolver);
+	if(!linkResult.success)
+	{
+		logMissingImports(linkResult);
+		return false;
+	}
+
+	outInstance.moduleInstance = instantiateModule(outInstance.compartment,
+												   module,
+												   std::move(linkResult.resolvedImports),
+												   options.filename);
+	if(!outInstance.moduleInstance) { return false; }
+
+	if(options.enableHostAccel)
+	{
+		MemoryInstance* memory
+			= asMemoryNullable(getInstanceExport(outInstance.moduleInstance, "memory"));
+		if(memory) { HostAccel::setMemory(outInstance.compartment, memory); }
+	}
+
+	outInstance.context = Runtime::createContext(outInstance.compartment);
+	if(options.fuel >= 0) { setContextFuel(outInstance.context, options.fuel); }
+	setContextStackBudget(outInstance.context, options.stackBudgetBytes);
+
+	FunctionInstance* startFunction = getStartFunction(outInstance.moduleInstance);
+	if(!startFunction) { return true; }
+
+	bool succeeded = true;
+	catchRuntimeExceptions(
+		[&] { invokeFunctionChecked(outInstance.context, startFunction, {}); },
+		[&](Exception&& exception) {
+			Log::printf(Log::error,
+						"Start function threw exception: %s\n",
+						describeException(exception).c_str());
+			succeeded = false;
+		});
+	return succeeded;
+}
+
+static void destroyServeInstance(ServeInstance& instance)
+{
+	instance.context = nullptr;
+	instance.moduleInstance = nullptr;
+	HostAccel::setMemory(instance.compartment, nullptr);
+	errorUnless(tryCollectCompartment(std::move(instance.compartment)));
+}
+
+// Reads a line from a stream, without its newline. Returns false at the end of the stream.
+static bool readLine(FILE* stream, std::string& outLine)
+{
+	outLine.clear();
+	int c;
+	while((c = fgetc(stream)) != EOF && c != '\n') { outLine += char(c); }
+	return c != EOF || !outLine.empty();
+}
+
+// Splits a line into its whitespace-separated words.
+static std::vector<std::string> splitWords(const std::string& line)
+{
+	std::vector<std::string> words;
+	const char* separators = " \t\r";
+	Uptr wordStart = line.find_first_not_of(separators);
+	while(wordStart != std::string::npos)
+	{
+		const Uptr wordEnd = std::min(line.find_first_of(separators, wordStart), line.size());
+		words.push_back(line.substr(wordStart, wordEnd - wordStart));
+		wordStart = line.find_first_not_of(separators, wordEnd);
+	}
+	return words;
+}
+
+// Handles one request to serve mode: a line with the name of a function to invoke, followed by
+// its whitespace-separated arguments. Returns the line to respond with.
+static std::string serveRequest(ServeInstance& instance, const std::vector<std::string>& words)
+{
+	FunctionInstance* function
+		= asFunctionNullable(getInstanceExport(instance.moduleInstance, words[0]));
+	if(!function) { return "error: module does not export function '" + words[0] + "'"; }
+
+	FunctionType functionType = getFunctionType(function);
+	if(functionType.params().size() != words.size() - 1)
+	{
+		return "error: function '" + words[0] + "' takes "
+			   + std::to_string(functionType.params().size()) + " argument(s)";
+	}
+
+	std::vector<Value> invokeArgs;
+	for(Uptr paramIndex = 0; paramIndex < functionType.params().size(); ++paramIndex)
+	{
+		Value value;
+		if(!parseArgument(words[paramIndex + 1].c_str(), functionType.params()[paramIndex], value))
+		{
+			return std::string("error: cannot parse argument for ")
+				   + asString(functionType.params()[paramIndex]) + " parameter";
+		}
+		invokeArgs.push_back(value);
+	}
+
+	std::string response;
+	catchRuntimeExceptions(
+		[&] { response = asString(invokeFunctionChecked(instance.context, function, invokeArgs)); },
+		[&](Exception&& exception) { response = "error: " + describeException(exception); });
+	return response;
+}
+
+// Serves invocations of the program's functions, read from stdin one per line. The responses are
+// written to stdout in the same order: the function's results, or a line starting with "error:".
+// Each request is invoked in a fresh instance of the program taken from a pool of instances that
+// are created ahead of the requests, so the requests don't pay to instantiate the program, and
+// can't observe the state left behind by earlier requests.
+static int serve(const CommandLineOptions& options,
+				 const IR::Module& irModule,
+				 Runtime::Module* module)
+{
+	std::vector<ServeInstance> pool;
+	int result = EXIT_SUCCESS;
+	std::string line;
+	while(true)
+	{
+		// Refill the pool before waiting for the next request.
+		while(pool.size() < options.servePoolSize)
+		{
+			ServeInstance instance;
+			if(!createServeInstance(options, irModule, module, instance))
+			{
+				destroyServeInstance(instance);
+				result = EXIT_FAILURE;
+				break;
+			}
+			pool.push_back(std::move(instance));
+		}
+		if(result != EXIT_SUCCESS || !readLine(stdin, line)) { break; }
+
+		const std::vector<std::string> words = splitWords(line);
+		if(words.empty()) { continue; }
+
+		// If the pool size is zero, create an instance for the request.
+		ServeInstance instance;
+		if(pool.size())
+		{
+			instance = std::move(pool.back());
+			pool.pop_back();
+		}
+		else if(!createServeInstance(options, irModule, module, instance))
+		{
+			destroyServeInstance(instance);
+			result = EXIT_FAILURE;
+			break;
+		}
+
+		const std::string response = serveRequest(instance, words);
+		printf("%s\n", response.c_str());
+		fflush(stdout);
+
+		// Discard the instance instead of reusing it for the next request.
+		destroyServeInstance(instance);
+	}
+
+	for(ServeInstance& instance : pool) { destroyServeInstance(instance); }
+	return result;
+}
+
 static int run(const CommandLineOptions& options)
 {
 	IR::Module irModule;
 
-	// Load the module.
-	if(!loadModule(options.filename, irModule)) { return EXIT_FAILURE; }
+	// Load the module. Precompiled object code is used instead of the module's function bodies, so
+	// unless the module is only being checked, skip decoding and validating them.
+	if(!loadModule(options.filename,
+				   irModule,
+				   options.numValidationThreads,
+				   options.precompiled && !options.onlyCheck))
+	{ return EXIT_FAILURE; }
 	if(options.onlyCheck) { return EXIT_SUCCESS; }
 
 	// Compile the module.
 	Runtime::Module* module = nullptr;
-	if(!options.precompiled) { module = Runtime::compileModule(irModule); }
+	if(!options.precompiled)
+	{
+		module = Runtime::compileModule(irModule, options.compileOptions);
+	}
 	else
 	{
 		const UserSection* precompiledObjectSection = nullptr;
+		bool isCompressed = false;
 		for(const UserSection& userSection : irModule.userSections)
 		{
-			if(userSection.name == "wavm.precompiled_object")
+			if(userSection.name == "wavm.precompiled_object"
+			   || userSection.name == "wavm.precompiled_object.lz4")
 			{
 				precompiledObjectSection = &userSection;
+				isCompressed = userSection.name == "wavm.precompiled_object.lz4";
 				break;
 			}
 		}
@@ -191,15 +671,29 @@ static int run(const CommandLineOptions& options)
 			Log::printf(Log::error, "Input file did not contain 'wavm.precompiled_object' section");
 			return EXIT_FAILURE;
 		}
+
+		const SharedBytes& sectionBytes = precompiledObjectSection->data;
+		std::vector<U8> objectCode;
+		if(!isCompressed) { objectCode.assign(sectionBytes.begin(), sectionBytes.end()); }
 		else
 		{
-			module = Runtime::loadPrecompiledModule(irModule, precompiledObjectSection->data);
+			Timing::Timer decompressTimer;
+			if(!LZ4::decompress(sectionBytes.data(), sectionBytes.size(), objectCode))
+			{
+				Log::printf(Log::error,
+							"Input file's 'wavm.precompiled_object.lz4' section is corrupt\n");
+				return EXIT_FAILURE;
+			}
+			Timing::logTimer("Decompressed precompiled object code", decompressTimer);
 		}
+		module = Runtime::loadPrecompiledModule(irModule, objectCode);
 	}
 
+	if(options.serve) { return serve(options, irModule, module); }
+
 	// Link the module with the intrinsic modules.
-	Compartment* compartment = Runtime::createCompartment();
-	Context* context = Runtime::createContext(compartment);
+	Compartment* compartment = Runtime::createCompartment(
+		options.useLargePages, options.numaNode, options.packJITCode);
 	RootResolver rootResolver(compartment);
 
 	Emscripten::Instance* emscriptenInstance = nullptr;
@@ -214,24 +708,52 @@ static int run(const CommandLineOptions& options)
 		}
 	}
 
+#if WAVM_ENABLE_WASI
+	// If the module imports any WASI functions, create a WASI process for it. Its arguments are the
+	// program's, and it may access the directories named by --dir.
+	WASI::Process* wasiProcess = nullptr;
+	for(const auto& functionImport : irModule.functions.imports)
+	{
+		if(functionImport.moduleName != "wasi_unstable") { continue; }
+
+		std::vector<std::string> wasiArgs;
+		wasiArgs.push_back(options.filename);
+		for(char** args = options.args; *args; ++args) { wasiArgs.push_back(*args); }
+
+		std::vector<std::pair<std::string, std::string>> preopenedDirectories;
+		for(const char* directory : options.wasiDirectories)
+		{ preopenedDirectories.emplace_back(directory, directory); }
+
+		wasiProcess = WASI::createProcess(
+			compartment, std::move(wasiArgs), std::vector<std::string>(), preopenedDirectories);
+		if(!wasiProcess) { return EXIT_FAILURE; }
+		rootResolver.moduleNameToInstanceMap.set("wasi_unstable",
+												 WASI::getProcessModuleInstance(wasiProcess));
+		break;
+	}
+#endif
+
 	if(options.enableThreadTest)
 	{
+		ThreadTest::setUseWorkerPool(options.useThreadPool);
 		ModuleInstance* threadTestInstance = ThreadTest::instantiate(compartment);
 		rootResolver.moduleNameToInstanceMap.set("threadTest", threadTestInstance);
 	}
+	if(options.enableParallelFor)
+	{
+		ModuleInstance* parallelForInstance = ParallelFor::instantiate(compartment);
+		rootResolver.moduleNameToInstanceMap.set("parallelFor", parallelForInstance);
+	}
+	if(options.enableHostAccel)
+	{
+		ModuleInstance* hostAccelInstance = HostAccel::instantiate(compartment);
+		rootResolver.moduleNameToInstanceMap.set("hostAccel", hostAccelInstance);
+	}
 
 	LinkResult linkResult = linkModule(irModule, rootResolver);
 	if(!linkResult.success)
 	{
-		Log::printf(Log::error, "Failed to link module:\n");
-		for(auto& missingImport : linkResult.missingImports)
-		{
-			Log::printf(Log::error,
-						"Missing import: module=\"%s\" export=\"%s\" type=\"%s\"\n",
-						missingImport.moduleName.c_str(),
-						missingImport.exportName.c_str(),
-						asString(missingImport.type).c_str());
-		}
+		logMissingImports(linkResult);
 		return EXIT_FAILURE;
 	}
 
@@ -240,6 +762,34 @@ static int run(const CommandLineOptions& options)
 		compartment, module, std::move(linkResult.resolvedImports), options.filename);
 	if(!moduleInstance) { return EXIT_FAILURE; }
 
+	// Let the hostAccel functions access the module's exported memory, or the memory it imports
+	// from the Emscripten intrinsics.
+	if(options.enableHostAccel)
+	{
+		MemoryInstance* memory = asMemoryNullable(getInstanceExport(moduleInstance, "memory"));
+		if(!memory && emscriptenInstance) { memory = emscriptenInstance->emscriptenMemory; }
+		if(memory) { HostAccel::setMemory(compartment, memory); }
+	}
+
+#if WAVM_ENABLE_WASI
+	if(wasiProcess)
+	{
+		MemoryInstance* memory = asMemoryNullable(getInstanceExport(moduleInstance, "memory"));
+		if(!memory)
+		{
+			Log::printf(Log::error, "WASI module doesn't export a memory named \"memory\"\n");
+			return EXIT_FAILURE;
+		}
+		WASI::setProcessMemory(wasiProcess, memory);
+	}
+#endif
+
+	// Create the context after instantiating the module, so its runtime data is sized to hold all
+	// the module's mutable globals.
+	Context* context = Runtime::createContext(compartment);
+	if(options.fuel >= 0) { setContextFuel(context, options.fuel); }
+	setContextStackBudget(context, options.stackBudgetBytes);
+
 	// Call the module start function, if it has one.
 	FunctionInstance* startFunction = getStartFunction(moduleInstance);
 	if(startFunction) { invokeFunctionChecked(context, startFunction, {}); }
@@ -258,6 +808,8 @@ static int run(const CommandLineOptions& options)
 		if(!functionInstance)
 		{ functionInstance = asFunctionNullable(getInstanceExport(moduleInstance, "_main")); }
 		if(!functionInstance)
+		{ functionInstance = asFunctionNullable(getInstanceExport(moduleInstance, "_start")); }
+		if(!functionInstance)
 		{
 			Log::printf(Log::error, "Module does not export main function\n");
 			return EXIT_FAILURE;
@@ -313,18 +865,10 @@ static int run(const CommandLineOptions& options)
 		for(U32 i = 0; options.args[i]; ++i)
 		{
 			Value value;
-			switch(functionType.params()[i])
+			if(!parseArgument(options.args[i], functionType.params()[i], value))
 			{
-			case ValueType::i32: value = (U32)atoi(options.args[i]); break;
-			case ValueType::i64: value = (U64)atol(options.args[i]); break;
-			case ValueType::f32: value = (F32)atof(options.args[i]); break;
-			case ValueType::f64: value = atof(options.args[i]); break;
-			case ValueType::v128:
-			case ValueType::anyref:
-			case ValueType::anyfunc:
 				Errors::fatalf("Cannot parse command-line argument for %s function parameter",
 							   asString(functionType.params()[i]));
-			default: Errors::unreachable();
 			}
 			invokeArgs.push_back(value);
 		}
@@ -334,6 +878,17 @@ static int run(const CommandLineOptions& options)
 	Timing::Timer executionTimer;
 	IR::ValueTuple functionResults = invokeFunctionChecked(context, functionInstance, invokeArgs);
 	Timing::logTimer("Invoked function", executionTimer);
+	if(options.fuel >= 0)
+	{ Log::printf(Log::debug, "Remaining fuel: %" PRIi64 "\n", getContextFuel(context)); }
+
+	// Write the profile collected while running the module.
+	if(options.profileOutputFilename)
+	{
+		const std::vector<U8> profile = getModuleProfile(moduleInstance);
+		if(!saveFile(options.profileOutputFilename, profile.data(), profile.size()))
+		{ return EXIT_FAILURE; }
+	}
+	if(options.printFunctionProfile) { printFunctionProfile(moduleInstance); }
 
 	if(options.functionName)
 	{
@@ -363,8 +918,75 @@ static void showHelp()
 				"  -f|--function name    Specify function name to run in module rather than main\n"
 				"  -h|--help             Display this message\n"
 				"  --disable-emscripten  Disable Emscripten intrinsics\n"
+#if WAVM_ENABLE_WASI
+				"  --dir directory       Allow a WASI program to access the directory\n"
+#endif
 				"  --enable-thread-test  Enable ThreadTest intrinsics\n"
+				"  --thread-pool         Run threads created by ThreadTest intrinsics on a pool of\n"
+				"                        worker threads\n"
+				"  --enable-parallel-for Enable the parallelFor intrinsic module\n"
+				"  --enable-host-accel   Enable the hostAccel intrinsic module\n"
 				"  --precompiled         Use precompiled object code in programfile\n"
+				"  --object-cache dir    Cache compiled object code in the specified directory\n"
+				"  --tier-up-calls n     Compile with minimal optimization, and recompile at the\n"
+				"                        --optimize level after n calls from the host\n"
+				"  --max-memory-reservation bytes\n"
+				"                        Reserve at most this much address space for each memory,\n"
+				"                        and bounds check memory accesses\n"
+				"  --large-pages         Back memories and tables with large pages where possible\n"
+				"  --pack-jit-code       Pack JIT code into pages mapped both writable and\n"
+				"                        executable\n"
+				"  --numa-node n         Allocate memories and tables from NUMA node n, and run\n"
+				"                        the threads created by ThreadTest intrinsics on it\n"
+				"  --fuel n              Compile with fuel metering, and trap after the program\n"
+				"                        executes n operators\n"
+				"  --stack-budget bytes  Compile with stack limit checks, and trap if a call from\n"
+				"                        the host uses more than this much stack\n"
+				"  --canonicalize-nans   Compile with floating-point operators that produce\n"
+				"                        canonical NaNs\n"
+				"  --relaxed-memory      Compile with memory accesses that may be vectorized, but\n"
+				"                        leave imprecise memory contents after a trap\n"
+				"  --profile-out file    Compile with profile instrumentation, and write the\n"
+				"                        profile to a file after the program returns\n"
+				"  --profile-in file     Optimize the program with a profile written by\n"
+				"                        --profile-out\n"
+				"  --profile             Compile with profile instrumentation, and print the\n"
+				"                        cycles spent in each function after the program returns\n"
+				"  --sample-profile file Compile with frame pointers, sample the program's call\n"
+				"                        stacks while it runs, and write them to a file: as a\n"
+				"                        pprof profile if it ends with .pb or .pprof, or else as\n"
+				"                        folded stacks for flamegraph.pl\n"
+				"  --sample-rate n       Sample the call stacks n times per second (default 1000)\n"
+				"  --lazy-compile        Compile each function the first time it is called\n"
+				"  --lazy-compile-callees\n"
+				"                        Like --lazy-compile, but also compile the functions that a\n"
+				"                        function calls directly along with it\n"
+				"  --validation-threads n\n"
+				"                        Validate the function bodies of a binary module in\n"
+				"                        parallel on n threads (0 for one per hardware thread)\n"
+				"  --optimize level      Optimization level: none, fast (default), O2, or O3\n"
+				"  --codegen-optimize level\n"
+				"                        Code generator optimization level: none, less, default,\n"
+				"                        or aggressive (defaults to match --optimize)\n"
+				"  --target-cpu cpu      Generate code for an LLVM CPU name instead of the host CPU\n"
+				"  --target-features f   Enable or disable a comma-separated list of LLVM target\n"
+				"                        features (e.g. +avx2,-avx512f)\n"
+				"  --perf-map            Describe JIT code to Linux perf in /tmp/perf-<pid>.map\n"
+				"  --jitdump             Describe JIT code to Linux perf in /tmp/jit-<pid>.dump,\n"
+				"                        for use with perf record -k 1 and perf inject --jit\n"
+				"  --gdb-jit             Register JIT code with GDB and LLDB through the GDB JIT\n"
+				"                        interface\n"
+				"  --serve               Invoke the functions named by lines read from stdin, each\n"
+				"                        followed by its arguments, and write their results to\n"
+				"                        stdout. Each line is invoked in a fresh instance of the\n"
+				"                        program, without Emscripten or WASI intrinsics\n"
+				"  --serve-pool n        Keep n instances ready for --serve requests (default 4)\n"
+				"  --trace file          Write the spans of time spent compiling, linking, and\n"
+				"                        instantiating modules to a file as Chrome trace JSON\n"
+				"  --metrics             Print the compilation and runtime metrics after the\n"
+				"                        program returns\n"
+				"  --async-log           Write the debug and metrics output from a background\n"
+				"                        thread, so the program's threads don't wait for stdout\n"
 				"  --                    Stop parsing arguments\n");
 }
 
@@ -395,14 +1017,259 @@ int main(int argc, char** argv)
 		{
 			options.enableEmscripten = false;
 		}
+#if WAVM_ENABLE_WASI
+		else if(!strcmp(*options.args, "--dir"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.wasiDirectories.push_back(*options.args);
+		}
+#endif
 		else if(!strcmp(*options.args, "--enable-thread-test"))
 		{
 			options.enableThreadTest = true;
 		}
+		else if(!strcmp(*options.args, "--thread-pool"))
+		{
+			options.enableThreadTest = true;
+			options.useThreadPool = true;
+		}
+		else if(!strcmp(*options.args, "--enable-parallel-for"))
+		{
+			options.enableParallelFor = true;
+		}
+		else if(!strcmp(*options.args, "--enable-host-accel"))
+		{
+			options.enableHostAccel = true;
+		}
 		else if(!strcmp(*options.args, "--precompiled"))
 		{
 			options.precompiled = true;
 		}
+		else if(!strcmp(*options.args, "--object-cache"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.compileOptions.objectCacheDirectory = *options.args;
+		}
+		else if(!strcmp(*options.args, "--tier-up-calls"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.compileOptions.tierUpCallCount = Uptr(strtoull(*options.args, nullptr, 10));
+		}
+		else if(!strcmp(*options.args, "--max-memory-reservation"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.compileOptions.maxMemoryReservedBytes
+				= Uptr(strtoull(*options.args, nullptr, 10));
+		}
+		else if(!strcmp(*options.args, "--large-pages"))
+		{
+			options.useLargePages = true;
+		}
+		else if(!strcmp(*options.args, "--pack-jit-code"))
+		{
+			options.packJITCode = true;
+		}
+		else if(!strcmp(*options.args, "--numa-node"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.numaNode = Uptr(strtoull(*options.args, nullptr, 10));
+		}
+		else if(!strcmp(*options.args, "--fuel"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			const U64 fuel = strtoull(*options.args, nullptr, 10);
+			options.fuel = fuel > U64(INT64_MAX) ? INT64_MAX : I64(fuel);
+			options.compileOptions.fuelMetering = true;
+		}
+		else if(!strcmp(*options.args, "--stack-budget"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.stackBudgetBytes = Uptr(strtoull(*options.args, nullptr, 10));
+			options.compileOptions.stackLimitChecks = true;
+		}
+		else if(!strcmp(*options.args, "--canonicalize-nans"))
+		{
+			options.compileOptions.canonicalizeNaNs = true;
+		}
+		else if(!strcmp(*options.args, "--relaxed-memory"))
+		{
+			options.compileOptions.relaxedMemoryAccesses = true;
+		}
+		else if(!strcmp(*options.args, "--profile-out"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.profileOutputFilename = *options.args;
+			options.compileOptions.profileInstrumentation = true;
+		}
+		else if(!strcmp(*options.args, "--profile"))
+		{
+			options.printFunctionProfile = true;
+			options.compileOptions.profileInstrumentation = true;
+			options.compileOptions.profileCycles = true;
+		}
+		else if(!strcmp(*options.args, "--sample-profile"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.sampleProfileFilename = *options.args;
+			options.compileOptions.framePointers = true;
+		}
+		else if(!strcmp(*options.args, "--sample-rate"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.samplesPerSecond = Uptr(strtoull(*options.args, nullptr, 10));
+			if(!options.samplesPerSecond)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*options.args, "--profile-in"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			if(!loadFile(*options.args, options.compileOptions.profile)) { return EXIT_FAILURE; }
+		}
+		else if(!strcmp(*options.args, "--validation-threads"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.numValidationThreads = Uptr(strtoull(*options.args, nullptr, 10));
+		}
+		else if(!strcmp(*options.args, "--lazy-compile"))
+		{
+			options.compileOptions.lazyCompile = true;
+		}
+		else if(!strcmp(*options.args, "--lazy-compile-callees"))
+		{
+			options.compileOptions.lazyCompile = true;
+			options.compileOptions.lazyCompileDirectCallees = true;
+		}
+		else if(!strcmp(*options.args, "--optimize"))
+		{
+			if(!*++options.args
+			   || !parseOptimizationLevel(*options.args, options.compileOptions.optimizationLevel))
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*options.args, "--codegen-optimize"))
+		{
+			if(!*++options.args
+			   || !parseCodeGenOptimizationLevel(
+					  *options.args, options.compileOptions.codeGenOptimizationLevel))
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(*options.args, "--target-cpu"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.compileOptions.targetCPU = *options.args;
+		}
+		else if(!strcmp(*options.args, "--target-features"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			appendTargetFeatures(*options.args, options.compileOptions.targetFeatures);
+		}
+		else if(!strcmp(*options.args, "--perf-map"))
+		{
+			options.writePerfMap = true;
+		}
+		else if(!strcmp(*options.args, "--jitdump"))
+		{
+			options.writeJITDump = true;
+		}
+		else if(!strcmp(*options.args, "--gdb-jit"))
+		{
+			LLVMJIT::setDebuggerRegistrationEnabled(true);
+		}
+		else if(!strcmp(*options.args, "--serve"))
+		{
+			options.serve = true;
+		}
+		else if(!strcmp(*options.args, "--serve-pool"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.serve = true;
+			options.servePoolSize = Uptr(strtoull(*options.args, nullptr, 10));
+		}
+		else if(!strcmp(*options.args, "--trace"))
+		{
+			if(!*++options.args)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			options.traceFilename = *options.args;
+		}
+		else if(!strcmp(*options.args, "--metrics"))
+		{
+			options.printMetrics = true;
+		}
+		else if(!strcmp(*options.args, "--async-log"))
+		{
+			Log::setAsyncOutput(true);
+		}
 		else if(!strcmp(*options.args, "--"))
 		{
 			++options.args;
@@ -429,10 +1296,69 @@ int main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
+	if(options.precompiled && options.profileOutputFilename)
+	{
+		Log::printf(Log::error, "--profile-out can't be used with --precompiled\n");
+		return EXIT_FAILURE;
+	}
+
+	if(options.precompiled && options.printFunctionProfile)
+	{
+		Log::printf(Log::error, "--profile can't be used with --precompiled\n");
+		return EXIT_FAILURE;
+	}
+
+	if(options.serve && (options.profileOutputFilename || options.printFunctionProfile))
+	{
+		Log::printf(Log::error, "--profile-out and --profile can't be used with --serve\n");
+		return EXIT_FAILURE;
+	}
+
+	if(!Platform::setJITProfilerOutput(options.writePerfMap, options.writeJITDump))
+	{
+		Log::printf(Log::error, "Couldn't create the perf map or jitdump file\n");
+		return EXIT_FAILURE;
+	}
+
+	if(options.traceFilename) { Trace::setEnabled(true); }
+	if(options.sampleProfileFilename
+	   && !Runtime::startGuestCallStackSampling(options.samplesPerSecond))
+	{
+		Log::printf(Log::error, "Call stack sampling isn't supported on this platform\n");
+		return EXIT_FAILURE;
+	}
+
 	// Treat any unhandled exception (e.g. in a thread) as a fatal error.
 	Runtime::setUnhandledExceptionHandler([](Runtime::Exception&& exception) {
 		Errors::fatalf("Runtime exception: %s\n", describeException(exception).c_str());
 	});
 
-	return run(options);
+#if WAVM_ENABLE_WASI
+	// A WASI program may exit by calling proc_exit, which unwinds to here.
+	int result;
+	try
+	{
+		result = run(options);
+	}
+	catch(const WASI::ExitException& exitException)
+	{
+		result = int(exitException.exitCode);
+	}
+#else
+	int result = run(options);
+#endif
+	if(options.sampleProfileFilename)
+	{
+		Runtime::stopGuestCallStackSampling();
+		if(!writeSampleProfile(options)) { result = EXIT_FAILURE; }
+	}
+	if(options.traceFilename)
+	{
+		Trace::setEnabled(false);
+		const std::string traceJSON = Trace::getChromeTraceJSON();
+		if(!saveFile(options.traceFilename, traceJSON.data(), traceJSON.size()))
+		{ result = EXIT_FAILURE; }
+	}
+	if(options.printMetrics) { printMetrics(); }
+	return result;
 }
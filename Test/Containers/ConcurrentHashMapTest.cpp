@@ -0,0 +1,154 @@
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/ConcurrentHashMap.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Platform/Thread.h"
+
+using namespace WAVM;
+
+static void testConcurrentMapBasics()
+{
+	ConcurrentHashMap<std::string, U32> map;
+
+	errorUnless(!map.contains("a"));
+	errorUnless(map.get("a", 0) == 0);
+
+	errorUnless(map.add("a", 1));
+	errorUnless(!map.add("a", 2));
+	errorUnless(map["a"] == 1);
+
+	map.addOrFail("b", 2);
+	errorUnless(map.getOrAdd("b", 3) == 2);
+	errorUnless(map.getOrAdd("c", 3) == 3);
+
+	map.set("a", 4);
+	map.set("d", 5);
+	errorUnless(map.get("a", 0) == 4);
+	errorUnless(map.get("d", 0) == 5);
+
+	errorUnless(map.remove("a"));
+	errorUnless(!map.remove("a"));
+	errorUnless(!map.contains("a"));
+	errorUnless(map.contains("b"));
+	errorUnless(map.add("a", 6));
+	errorUnless(map["a"] == 6);
+}
+
+static void testConcurrentMapChurn()
+{
+	// Add and remove many keys, so the stripes are resized and refill their tombstones.
+	ConcurrentHashMap<Uptr, Uptr> map;
+	for(Uptr i = 0; i < 100000; ++i)
+	{
+		errorUnless(map.add(i, i * 3));
+		if(i >= 1000) { errorUnless(map.remove(i - 1000)); }
+	}
+
+	for(Uptr i = 0; i < 100000; ++i)
+	{ errorUnless(map.get(i, UINTPTR_MAX) == (i < 99000 ? UINTPTR_MAX : i * 3)); }
+}
+
+struct ConcurrentTestState
+{
+	ConcurrentHashMap<Uptr, Uptr> map;
+	std::atomic<bool> isDone{false};
+	std::atomic<Uptr> numReads{0};
+};
+
+enum
+{
+	numStableKeys = 1000,
+	numChurnedKeys = 1000,
+	numWriterIterations = 200000
+};
+
+static I64 readerThreadEntry(void* argument)
+{
+	ConcurrentTestState& state = *(ConcurrentTestState*)argument;
+	Uptr numReads = 0;
+	while(!state.isDone.load())
+	{
+		// The stable keys are never removed, and the churned keys always map to a value derived
+		// from the key while they're in the map.
+		for(Uptr key = 0; key < numStableKeys; ++key)
+		{ errorUnless(state.map.get(key, UINTPTR_MAX) == key + 1); }
+		for(Uptr key = numStableKeys; key < numStableKeys + numChurnedKeys; ++key)
+		{
+			const Uptr value = state.map.get(key, UINTPTR_MAX);
+			errorUnless(value == UINTPTR_MAX || value == key * 2 || value == key * 3);
+		}
+		numReads += numStableKeys + numChurnedKeys;
+	}
+	state.numReads += numReads;
+	return 0;
+}
+
+static void testConcurrentMapThreads()
+{
+	ConcurrentTestState state;
+	for(Uptr key = 0; key < numStableKeys; ++key) { state.map.addOrFail(key, key + 1); }
+
+	std::vector<Platform::Thread*> readerThreads;
+	for(Uptr threadIndex = 0; threadIndex < 4; ++threadIndex)
+	{ readerThreads.push_back(Platform::createThread(256 * 1024, readerThreadEntry, &state)); }
+
+	// Add, replace, and remove the churned keys while the readers are reading them.
+	for(Uptr iteration = 0; iteration < numWriterIterations; ++iteration)
+	{
+		const Uptr key = numStableKeys + iteration % numChurnedKeys;
+		switch(iteration % 3)
+		{
+		case 0: state.map.add(key, key * 2); break;
+		case 1: state.map.set(key, key * 3); break;
+		case 2: state.map.remove(key); break;
+		default: Errors::unreachable();
+		}
+	}
+
+	state.isDone.store(true);
+	for(Platform::Thread* thread : readerThreads)
+	{ errorUnless(Platform::joinThread(thread) == 0); }
+	errorUnless(state.numReads.load() > 0);
+}
+
+// Replacing values while readers are continuously reading the stripes must not retire more objects
+// than the map can hold before it waits for the readers.
+static void testRetiredObjectsBounded()
+{
+	ConcurrentTestState state;
+	for(Uptr key = 0; key < numStableKeys; ++key) { state.map.addOrFail(key, key + 1); }
+
+	std::vector<Platform::Thread*> readerThreads;
+	for(Uptr threadIndex = 0; threadIndex < 4; ++threadIndex)
+	{ readerThreads.push_back(Platform::createThread(256 * 1024, readerThreadEntry, &state)); }
+
+	const Uptr maxRetiredObjects = 64 * 2 * ConcurrentHashMap<Uptr, Uptr>::maxRetiredObjects;
+	for(Uptr iteration = 0; iteration < numWriterIterations * 2; ++iteration)
+	{
+		const Uptr key = numStableKeys + iteration % numChurnedKeys;
+		state.map.set(key, (iteration / numChurnedKeys) % 2 ? key * 3 : key * 2);
+		if(iteration % 1000 == 0)
+		{ errorUnless(state.map.getNumRetiredObjects() <= maxRetiredObjects); }
+	}
+
+	state.isDone.store(true);
+	for(Platform::Thread* thread : readerThreads)
+	{ errorUnless(Platform::joinThread(thread) == 0); }
+	errorUnless(state.numReads.load() > 0);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testConcurrentMapBasics();
+	testConcurrentMapChurn();
+	testConcurrentMapThreads();
+	testRetiredObjectsBounded();
+	Timing::logTimer("ConcurrentHashMapTest", timer);
+	return 0;
+}
@@ -8,11 +8,16 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/GroupHashTable.h"
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Timing.h"
 
 using namespace WAVM;
 
+// The tests are run for a HashMap using each hash table implementation.
+template<typename Key, typename Value, typename Probing>
+using TestHashMap = HashMap<Key, Value, DefaultHashPolicy<Key>, Probing>;
+
 static std::string generateRandomString()
 {
 	enum
@@ -28,14 +33,14 @@ static std::string generateRandomString()
 	return std::string(buffer);
 }
 
-static void testStringMap()
+template<typename Probing> static void testStringMap()
 {
 	enum
 	{
 		numStrings = 1000
 	};
 
-	HashMap<std::string, U32> map;
+	TestHashMap<std::string, U32, Probing> map;
 	std::vector<HashMapPair<std::string, U32>> pairs;
 
 	srand(0);
@@ -97,9 +102,9 @@ static void testStringMap()
 	}
 }
 
-static void testU32Map()
+template<typename Probing> static void testU32Map()
 {
-	HashMap<U32, U32> map;
+	TestHashMap<U32, U32, Probing> map;
 
 	enum
 	{
@@ -131,18 +136,38 @@ static void testU32Map()
 	for(Uptr i = 0; i < maxI; ++i) { errorUnless(!map.contains(U32(i))); }
 }
 
+template<typename Probing> static void testMapChurn()
+{
+	// Repeatedly add a key and remove the key added 64 iterations earlier, so the map stays small
+	// while many different keys pass through it.
+	TestHashMap<Uptr, Uptr, Probing> map;
+	for(Uptr i = 0; i < 100000; ++i)
+	{
+		errorUnless(map.add(i, i * 3));
+		if(i >= 64)
+		{
+			errorUnless(map.remove(i - 64));
+			errorUnless(!map.contains(i - 64));
+		}
+		errorUnless(map.size() == (i < 64 ? i + 1 : 64));
+	}
+
+	for(Uptr i = 100000 - 64; i < 100000; ++i) { errorUnless(*map.get(i) == i * 3); }
+	for(Uptr i = 0; i < 100000 - 64; ++i) { errorUnless(!map.get(i)); }
+}
+
 #if defined(__clang__)
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wself-assign"
 #endif
-static void testMapCopy()
+template<typename Probing> static void testMapCopy()
 {
 	// Add 1000..1999 to a HashMap.
-	HashMap<Uptr, Uptr> a;
+	TestHashMap<Uptr, Uptr, Probing> a;
 	for(Uptr i = 0; i < 1000; ++i) { a.add(i + 1000, i); }
 
 	// Copy the map to a new HashMap.
-	HashMap<Uptr, Uptr> b{a};
+	TestHashMap<Uptr, Uptr, Probing> b{a};
 
 	// Test that both the new and old HashMap contain the expected numbers.
 	for(Uptr i = 0; i < 1000; ++i)
@@ -180,14 +205,14 @@ static void testMapCopy()
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wself-move"
 #endif
-static void testMapMove()
+template<typename Probing> static void testMapMove()
 {
 	// Add 1000..1999 to a HashMap.
-	HashMap<Uptr, Uptr> a;
+	TestHashMap<Uptr, Uptr, Probing> a;
 	for(Uptr i = 0; i < 1000; ++i) { a.add(i + 1000, i); }
 
 	// Move the map to a new HashMap.
-	HashMap<Uptr, Uptr> b{std::move(a)};
+	TestHashMap<Uptr, Uptr, Probing> b{std::move(a)};
 
 	// Test that the new HashMap contains the expected numbers.
 	for(Uptr i = 0; i < 1000; ++i)
@@ -212,9 +237,9 @@ static void testMapMove()
 #pragma clang diagnostic pop
 #endif
 
-static void testMapInitializerList()
+template<typename Probing> static void testMapInitializerList()
 {
-	HashMap<Uptr, Uptr> map{{1, 1}, {3, 2}, {5, 3}, {7, 4}, {11, 5}, {13, 6}, {17, 7}};
+	TestHashMap<Uptr, Uptr, Probing> map{{1, 1}, {3, 2}, {5, 3}, {7, 4}, {11, 5}, {13, 6}, {17, 7}};
 	errorUnless(!map.get(0));
 	errorUnless(*map.get(1) == 1);
 	errorUnless(!map.get(2));
@@ -235,10 +260,10 @@ static void testMapInitializerList()
 	errorUnless(*map.get(17) == 7);
 }
 
-static void testMapIterator()
+template<typename Probing> static void testMapIterator()
 {
 	// Add 1..9 to a HashMap.
-	HashMap<Uptr, Uptr> a;
+	TestHashMap<Uptr, Uptr, Probing> a;
 	for(Uptr i = 1; i < 10; ++i) { a.add(i, i * 2); }
 
 	// 1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9 = 45
@@ -271,9 +296,9 @@ static void testMapIterator()
 	}
 }
 
-static void testMapGetOrAdd()
+template<typename Probing> static void testMapGetOrAdd()
 {
-	HashMap<Uptr, Uptr> map;
+	TestHashMap<Uptr, Uptr, Probing> map;
 
 	errorUnless(!map.get(0));
 	errorUnless(map.getOrAdd(0, 1) == 1);
@@ -284,9 +309,9 @@ static void testMapGetOrAdd()
 	errorUnless(*map.get(0) == 8);
 }
 
-static void testMapSet()
+template<typename Probing> static void testMapSet()
 {
-	HashMap<Uptr, Uptr> map;
+	TestHashMap<Uptr, Uptr, Probing> map;
 
 	errorUnless(!map.get(0));
 	errorUnless(map.set(0, 1) == 1);
@@ -303,9 +328,9 @@ struct EmplacedValue
 	EmplacedValue(const std::string& inA, const std::string& inB) : a(inA), b(inB) {}
 };
 
-static void testMapEmplace()
+template<typename Probing> static void testMapEmplace()
 {
-	HashMap<Uptr, EmplacedValue> map;
+	TestHashMap<Uptr, EmplacedValue, Probing> map;
 
 	EmplacedValue& a = map.getOrAdd(0, "a", "b");
 	errorUnless(a.a == "a");
@@ -325,9 +350,9 @@ static void testMapEmplace()
 	errorUnless(d.b == "f");
 }
 
-static void testMapBracketOperator()
+template<typename Probing> static void testMapBracketOperator()
 {
-	HashMap<Uptr, Uptr> map{{1, 1}, {3, 2}, {5, 3}, {7, 4}, {11, 5}, {13, 6}, {17, 7}};
+	TestHashMap<Uptr, Uptr, Probing> map{{1, 1}, {3, 2}, {5, 3}, {7, 4}, {11, 5}, {13, 6}, {17, 7}};
 	errorUnless(map[1] == 1);
 	errorUnless(map[3] == 2);
 	errorUnless(map[5] == 3);
@@ -337,19 +362,26 @@ static void testMapBracketOperator()
 	errorUnless(map[17] == 7);
 }
 
+template<typename Probing> static void runTests()
+{
+	testStringMap<Probing>();
+	testU32Map<Probing>();
+	testMapChurn<Probing>();
+	testMapCopy<Probing>();
+	testMapMove<Probing>();
+	testMapInitializerList<Probing>();
+	testMapIterator<Probing>();
+	testMapGetOrAdd<Probing>();
+	testMapSet<Probing>();
+	testMapEmplace<Probing>();
+	testMapBracketOperator<Probing>();
+}
+
 I32 main()
 {
 	Timing::Timer timer;
-	testStringMap();
-	testU32Map();
-	testMapCopy();
-	testMapMove();
-	testMapInitializerList();
-	testMapIterator();
-	testMapGetOrAdd();
-	testMapSet();
-	testMapEmplace();
-	testMapBracketOperator();
+	runTests<RobinHoodProbing>();
+	runTests<GroupProbing>();
 	Timing::logTimer("HashMapTest", timer);
 	return 0;
 }
\ No newline at end of file
@@ -7,11 +7,16 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/GroupHashTable.h"
 #include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/Timing.h"
 
 using namespace WAVM;
 
+// The tests are run for a HashSet using each hash table implementation.
+template<typename Element, typename Probing>
+using TestHashSet = HashSet<Element, DefaultHashPolicy<Element>, Probing>;
+
 static std::string generateRandomString()
 {
 	enum
@@ -27,14 +32,14 @@ static std::string generateRandomString()
 	return std::string(buffer);
 }
 
-static void testStringSet()
+template<typename Probing> static void testStringSet()
 {
 	enum
 	{
 		numStrings = 1000
 	};
 
-	HashSet<std::string> set;
+	TestHashSet<std::string, Probing> set;
 	std::vector<std::string> strings;
 
 	srand(0);
@@ -88,9 +93,9 @@ static void testStringSet()
 	}
 }
 
-static void testU32Set()
+template<typename Probing> static void testU32Set()
 {
-	HashSet<U32> set;
+	TestHashSet<U32, Probing> set;
 
 	enum
 	{
@@ -125,14 +130,14 @@ static void testU32Set()
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wself-assign"
 #endif
-static void testSetCopy()
+template<typename Probing> static void testSetCopy()
 {
 	// Add 1000..1999 to a HashSet.
-	HashSet<Uptr> a;
+	TestHashSet<Uptr, Probing> a;
 	for(Uptr i = 0; i < 1000; ++i) { a.add(i + 1000); }
 
 	// Copy the set to a new HashSet.
-	HashSet<Uptr> b{a};
+	TestHashSet<Uptr, Probing> b{a};
 
 	// Test that both the new and old HashSet contain the expected numbers.
 	for(Uptr i = 0; i < 1000; ++i)
@@ -170,14 +175,14 @@ static void testSetCopy()
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wself-move"
 #endif
-static void testSetMove()
+template<typename Probing> static void testSetMove()
 {
 	// Add 1000..1999 to a HashSet.
-	HashSet<Uptr> a;
+	TestHashSet<Uptr, Probing> a;
 	for(Uptr i = 0; i < 1000; ++i) { a.add(i + 1000); }
 
 	// Move the set to a new HashSet.
-	HashSet<Uptr> b{std::move(a)};
+	TestHashSet<Uptr, Probing> b{std::move(a)};
 
 	// Test that the new HashSet contains the expected numbers.
 	for(Uptr i = 0; i < 1000; ++i)
@@ -202,9 +207,9 @@ static void testSetMove()
 #pragma clang diagnostic pop
 #endif
 
-static void testSetInitializerList()
+template<typename Probing> static void testSetInitializerList()
 {
-	HashSet<Uptr> set{1, 3, 5, 7, 11, 13, 17};
+	TestHashSet<Uptr, Probing> set{1, 3, 5, 7, 11, 13, 17};
 	errorUnless(!set.contains(0));
 	errorUnless(set.contains(1));
 	errorUnless(!set.contains(2));
@@ -225,10 +230,10 @@ static void testSetInitializerList()
 	errorUnless(set.contains(17));
 }
 
-static void testSetIterator()
+template<typename Probing> static void testSetIterator()
 {
 	// Add 1..9 to a HashSet.
-	HashSet<Uptr> a;
+	TestHashSet<Uptr, Probing> a;
 	for(Uptr i = 1; i < 10; ++i) { a.add(i); }
 
 	// 1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9 = 45
@@ -249,9 +254,9 @@ static void testSetIterator()
 	}
 }
 
-static void testSetBracketOperator()
+template<typename Probing> static void testSetBracketOperator()
 {
-	HashSet<Uptr> set{1, 3, 5, 7, 11, 13, 17};
+	TestHashSet<Uptr, Probing> set{1, 3, 5, 7, 11, 13, 17};
 	errorUnless(set[1] == 1);
 	errorUnless(set[3] == 3);
 	errorUnless(set[5] == 5);
@@ -261,16 +266,22 @@ static void testSetBracketOperator()
 	errorUnless(set[17] == 17);
 }
 
+template<typename Probing> static void runTests()
+{
+	testStringSet<Probing>();
+	testU32Set<Probing>();
+	testSetCopy<Probing>();
+	testSetMove<Probing>();
+	testSetInitializerList<Probing>();
+	testSetIterator<Probing>();
+	testSetBracketOperator<Probing>();
+}
+
 I32 main()
 {
 	Timing::Timer timer;
-	testStringSet();
-	testU32Set();
-	testSetCopy();
-	testSetMove();
-	testSetInitializerList();
-	testSetIterator();
-	testSetBracketOperator();
+	runTests<RobinHoodProbing>();
+	runTests<GroupProbing>();
 	Timing::logTimer("HashSetTest", timer);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/GroupHashTable.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/HashSet.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+
+using namespace WAVM;
+
+// Compares the time per operation of a HashMap using HashTable (Robin Hood probing) and
+// GroupHashTable (group probing), for maps of a few sizes with integer and string keys.
+
+static void reportTime(const char* probingName,
+					   const char* keyTypeName,
+					   Uptr numElements,
+					   const char* operationName,
+					   Timing::Timer& timer,
+					   Uptr numOps)
+{
+	Log::printf(Log::error,
+				"%s %s %" PRIuPTR " %s: %.1f ns/op\n",
+				probingName,
+				keyTypeName,
+				numElements,
+				operationName,
+				F64(timer.getMicroseconds()) * 1000.0 / F64(numOps));
+}
+
+template<typename Key, typename Probing>
+static void benchmarkMap(const char* probingName,
+						 const char* keyTypeName,
+						 const std::vector<Key>& keys,
+						 const std::vector<Key>& missingKeys)
+{
+	// Repeat the lookups so each benchmark does about the same total number of operations.
+	const Uptr numLookupRepeats = keys.size() >= 1000000 ? 1 : 1000000 / keys.size();
+
+	HashMap<Key, Uptr, DefaultHashPolicy<Key>, Probing> map;
+
+	Timing::Timer addTimer;
+	for(Uptr index = 0; index < keys.size(); ++index) { map.addOrFail(keys[index], index); }
+	reportTime(probingName, keyTypeName, keys.size(), "add", addTimer, keys.size());
+
+	Uptr sum = 0;
+	Timing::Timer hitTimer;
+	for(Uptr repeat = 0; repeat < numLookupRepeats; ++repeat)
+	{
+		for(const Key& key : keys) { sum += *map.get(key); }
+	}
+	reportTime(
+		probingName, keyTypeName, keys.size(), "get_hit", hitTimer, keys.size() * numLookupRepeats);
+
+	Timing::Timer missTimer;
+	for(Uptr repeat = 0; repeat < numLookupRepeats; ++repeat)
+	{
+		for(const Key& key : missingKeys) { sum += map.contains(key); }
+	}
+	reportTime(probingName,
+			   keyTypeName,
+			   keys.size(),
+			   "get_miss",
+			   missTimer,
+			   missingKeys.size() * numLookupRepeats);
+
+	Timing::Timer removeTimer;
+	for(const Key& key : keys) { map.removeOrFail(key); }
+	reportTime(probingName, keyTypeName, keys.size(), "remove", removeTimer, keys.size());
+
+	// Use the sum so the lookups aren't optimized away.
+	errorUnless(sum != UINTPTR_MAX);
+}
+
+static std::string generateRandomString()
+{
+	std::string result;
+	const Uptr numChars = 8 + rand() % 16;
+	for(Uptr charIndex = 0; charIndex < numChars; ++charIndex)
+	{ result += char(0x20 + (rand() % (0x7E - 0x20))); }
+	return result;
+}
+
+I32 main()
+{
+	for(Uptr numElements : {Uptr(100), Uptr(10000), Uptr(1000000)})
+	{
+		// Use distinct pseudo-random integers for the keys, and the next integers in the
+		// sequence as keys that aren't in the map.
+		std::vector<Uptr> uptrKeys;
+		std::vector<Uptr> missingUptrKeys;
+		Uptr state = 0x5555555555555555ull;
+		for(Uptr index = 0; index < numElements * 2; ++index)
+		{
+			state = state * 6364136223846793005ull + 1442695040888963407ull;
+			(index < numElements ? uptrKeys : missingUptrKeys).push_back(state);
+		}
+
+		benchmarkMap<Uptr, RobinHoodProbing>("robin_hood", "uptr", uptrKeys, missingUptrKeys);
+		benchmarkMap<Uptr, GroupProbing>("group", "uptr", uptrKeys, missingUptrKeys);
+
+		// Random strings are distinct with high probability, so deduplicate them with a HashSet
+		// before using them as keys.
+		srand(0);
+		HashSet<std::string> stringSet;
+		std::vector<std::string> stringKeys;
+		std::vector<std::string> missingStringKeys;
+		while(stringKeys.size() + missingStringKeys.size() < numElements * 2)
+		{
+			std::string string = generateRandomString();
+			if(stringSet.add(string))
+			{
+				(stringKeys.size() < numElements ? stringKeys : missingStringKeys)
+					.push_back(std::move(string));
+			}
+		}
+
+		benchmarkMap<std::string, RobinHoodProbing>(
+			"robin_hood", "string", stringKeys, missingStringKeys);
+		benchmarkMap<std::string, GroupProbing>("group", "string", stringKeys, missingStringKeys);
+	}
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/ScratchArena.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Platform/Thread.h"
+
+using namespace WAVM;
+
+static void testScratchScopeReuse()
+{
+	// Allocations in consecutive scopes reuse the same memory.
+	U8* firstAllocation;
+	{
+		ScratchScope scratchScope;
+		firstAllocation = (U8*)ScratchArena::get().allocate(100, 8);
+	}
+	{
+		ScratchScope scratchScope;
+		errorUnless(ScratchArena::get().allocate(100, 8) == firstAllocation);
+	}
+
+	// Allocations in a nested scope follow the allocations in the outer scope, and are reused
+	// when the nested scope ends.
+	ScratchScope outerScope;
+	U8* outerAllocation = (U8*)ScratchArena::get().allocate(16, 16);
+	memset(outerAllocation, 0xab, 16);
+	U8* innerAllocation;
+	{
+		ScratchScope innerScope;
+		innerAllocation = (U8*)ScratchArena::get().allocate(32, 16);
+		errorUnless(innerAllocation >= outerAllocation + 16);
+		memset(innerAllocation, 0, 32);
+	}
+	errorUnless(ScratchArena::get().allocate(32, 16) == innerAllocation);
+	for(Uptr index = 0; index < 16; ++index) { errorUnless(outerAllocation[index] == 0xab); }
+}
+
+static void testScratchAlignment()
+{
+	ScratchScope scratchScope;
+	for(Uptr alignment = 1; alignment <= 16; alignment *= 2)
+	{
+		ScratchArena::get().allocate(1, 1);
+		void* allocation = ScratchArena::get().allocate(alignment, alignment);
+		errorUnless((reinterpret_cast<Uptr>(allocation) & (alignment - 1)) == 0);
+	}
+}
+
+static void testScratchVector()
+{
+	// Grow vectors past the default chunk size, so the arena has to add chunks, including chunks
+	// larger than the default size.
+	for(Uptr iteration = 0; iteration < 3; ++iteration)
+	{
+		ScratchScope scratchScope;
+		ScratchVector<U64> values;
+		ScratchVector<U32> otherValues;
+		for(Uptr index = 0; index < 100000; ++index)
+		{
+			values.push_back(index * 3);
+			otherValues.push_back(U32(index * 5));
+		}
+		for(Uptr index = 0; index < 100000; ++index)
+		{
+			errorUnless(values[index] == index * 3);
+			errorUnless(otherValues[index] == U32(index * 5));
+		}
+
+		ScratchVector<bool> flags(1000, false);
+		flags[999] = true;
+		errorUnless(!flags[0] && flags[999]);
+	}
+}
+
+static I64 threadEntry(void* argument)
+{
+	// Each thread has its own arena.
+	U8* mainThreadAllocation = (U8*)argument;
+	ScratchScope scratchScope;
+	U8* allocation = (U8*)ScratchArena::get().allocate(64, 8);
+	errorUnless(allocation != mainThreadAllocation);
+	memset(allocation, 0xcd, 64);
+	return 0;
+}
+
+static void testScratchThreads()
+{
+	ScratchScope scratchScope;
+	U8* allocation = (U8*)ScratchArena::get().allocate(64, 8);
+	memset(allocation, 0x12, 64);
+
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 0; threadIndex < 4; ++threadIndex)
+	{ threads.push_back(Platform::createThread(256 * 1024, threadEntry, allocation)); }
+	for(Platform::Thread* thread : threads) { errorUnless(Platform::joinThread(thread) == 0); }
+
+	for(Uptr index = 0; index < 64; ++index) { errorUnless(allocation[index] == 0x12); }
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testScratchScopeReuse();
+	testScratchAlignment();
+	testScratchVector();
+	testScratchThreads();
+	Timing::logTimer("ScratchArenaTest", timer);
+	return 0;
+}
@@ -1,7 +1,10 @@
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "WAVM/IR/Module.h"
@@ -9,9 +12,13 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/CLI.h"
 #include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/HashSet.h"
+#include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Serialization.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTParse/TestScript.h"
 #include "WAVM/WASTParse/WASTParse.h"
@@ -28,38 +35,44 @@ enum class DumpFormat
 	both
 };
 
-static void dumpWAST(const std::string& wastString, const char* outputDir)
+// The files dumped by a test script. Files are named by the hash of their contents, so the same
+// module dumped by several commands or scripts is only written once.
+struct DumpedFiles
 {
-	const Uptr wastHash = Hash<std::string>()(wastString);
+	struct File
+	{
+		std::string name;
+		std::vector<U8> bytes;
+	};
+	std::vector<File> files;
+	HashSet<std::string> fileNames;
 
-	Platform::File* wastFile
-		= Platform::openFile(std::string(outputDir) + "/" + std::to_string(wastHash) + ".wast",
-							 Platform::FileAccessMode::writeOnly,
-							 Platform::FileCreateMode::createAlways);
-	errorUnless(wastFile);
-	errorUnless(Platform::writeFile(wastFile, (const U8*)wastString.c_str(), wastString.size()));
-	errorUnless(Platform::closeFile(wastFile));
+	void add(std::string&& name, const U8* bytes, Uptr numBytes)
+	{
+		if(fileNames.add(name)) { files.push_back({std::move(name), {bytes, bytes + numBytes}}); }
+	}
+};
+
+static void dumpWAST(const std::string& wastString, DumpedFiles& dumpedFiles)
+{
+	const Uptr wastHash = Hash<std::string>()(wastString);
+	dumpedFiles.add(std::to_string(wastHash) + ".wast",
+					(const U8*)wastString.c_str(),
+					wastString.size());
 }
 
-static void dumpWASM(const U8* wasmBytes, Uptr numBytes, const char* outputDir)
+static void dumpWASM(const U8* wasmBytes, Uptr numBytes, DumpedFiles& dumpedFiles)
 {
 	const Uptr wasmHash = XXH<Uptr>(wasmBytes, numBytes, 0);
-
-	Platform::File* wasmFile
-		= Platform::openFile(std::string(outputDir) + "/" + std::to_string(wasmHash) + ".wasm",
-							 Platform::FileAccessMode::writeOnly,
-							 Platform::FileCreateMode::createAlways);
-	errorUnless(wasmFile);
-	errorUnless(Platform::writeFile(wasmFile, wasmBytes, numBytes));
-	errorUnless(Platform::closeFile(wasmFile));
+	dumpedFiles.add(std::to_string(wasmHash) + ".wasm", wasmBytes, numBytes);
 }
 
-static void dumpModule(const Module& module, const char* outputDir, DumpFormat dumpFormat)
+static void dumpModule(const Module& module, DumpedFiles& dumpedFiles, DumpFormat dumpFormat)
 {
 	if(dumpFormat == DumpFormat::wast || dumpFormat == DumpFormat::both)
 	{
 		const std::string wastString = WAST::print(module);
-		dumpWAST(wastString, outputDir);
+		dumpWAST(wastString, dumpedFiles);
 	}
 
 	if(dumpFormat == DumpFormat::wasm || dumpFormat == DumpFormat::both)
@@ -80,11 +93,13 @@ static void dumpModule(const Module& module, const char* outputDir, DumpFormat d
 			return;
 		}
 
-		dumpWASM(wasmBytes.data(), wasmBytes.size(), outputDir);
+		dumpWASM(wasmBytes.data(), wasmBytes.size(), dumpedFiles);
 	}
 }
 
-static void dumpCommandModules(const Command* command, const char* outputDir, DumpFormat dumpFormat)
+static void dumpCommandModules(const Command* command,
+							   DumpedFiles& dumpedFiles,
+							   DumpFormat dumpFormat)
 {
 	switch(command->type)
 	{
@@ -96,7 +111,7 @@ static void dumpCommandModules(const Command* command, const char* outputDir, Du
 		case ActionType::_module:
 		{
 			auto moduleAction = (ModuleAction*)actionCommand->action.get();
-			dumpModule(*moduleAction->module, outputDir, dumpFormat);
+			dumpModule(*moduleAction->module, dumpedFiles, dumpFormat);
 			break;
 		}
 		default: break;
@@ -106,7 +121,7 @@ static void dumpCommandModules(const Command* command, const char* outputDir, Du
 	case Command::assert_unlinkable:
 	{
 		auto assertUnlinkableCommand = (AssertUnlinkableCommand*)command;
-		dumpModule(*assertUnlinkableCommand->moduleAction->module, outputDir, dumpFormat);
+		dumpModule(*assertUnlinkableCommand->moduleAction->module, dumpedFiles, dumpFormat);
 		break;
 	}
 	case Command::assert_invalid:
@@ -115,13 +130,13 @@ static void dumpCommandModules(const Command* command, const char* outputDir, Du
 		auto assertInvalidOrMalformedCommand = (AssertInvalidOrMalformedCommand*)command;
 		if(assertInvalidOrMalformedCommand->quotedModuleType == QuotedModuleType::text
 		   && (dumpFormat == DumpFormat::wast || dumpFormat == DumpFormat::both))
-		{ dumpWAST(assertInvalidOrMalformedCommand->quotedModuleString, outputDir); }
+		{ dumpWAST(assertInvalidOrMalformedCommand->quotedModuleString, dumpedFiles); }
 		else if(assertInvalidOrMalformedCommand->quotedModuleType == QuotedModuleType::binary
 				&& (dumpFormat == DumpFormat::wasm || dumpFormat == DumpFormat::both))
 		{
 			dumpWASM((const U8*)assertInvalidOrMalformedCommand->quotedModuleString.data(),
 					 assertInvalidOrMalformedCommand->quotedModuleString.size(),
-					 outputDir);
+					 dumpedFiles);
 		}
 
 		break;
@@ -130,11 +145,93 @@ static void dumpCommandModules(const Command* command, const char* outputDir, Du
 	};
 }
 
+// The state shared by the threads that dump test scripts in parallel.
+struct ParallelDumpState
+{
+	const std::vector<const char*>& filenames;
+	const std::string outputDir;
+	const DumpFormat dumpFormat;
+	std::atomic<Uptr> nextFilenameIndex{0};
+	std::atomic<bool> failed{false};
+
+	// The names of the files that have been written by any thread, protected by mutex.
+	Platform::Mutex mutex;
+	HashSet<std::string> writtenFileNames;
+
+	ParallelDumpState(const std::vector<const char*>& inFilenames,
+					  const char* inOutputDir,
+					  DumpFormat inDumpFormat)
+	: filenames(inFilenames), outputDir(inOutputDir), dumpFormat(inDumpFormat)
+	{
+	}
+};
+
+static bool dumpTestScript(ParallelDumpState& state, const char* filename)
+{
+	// Read the file into a vector.
+	std::vector<U8> testScriptBytes;
+	if(!loadFile(filename, testScriptBytes)) { return false; }
+
+	// Make sure the file is null terminated.
+	testScriptBytes.push_back(0);
+
+	// Parse the test script.
+	std::vector<std::unique_ptr<Command>> testCommands;
+	std::vector<WAST::Error> testErrors;
+	IR::FeatureSpec featureSpec;
+	featureSpec.requireSharedFlagForAtomicOperators = true;
+	WAST::parseTestCommands((const char*)testScriptBytes.data(),
+							testScriptBytes.size(),
+							featureSpec,
+							testCommands,
+							testErrors);
+	if(testErrors.size()) { return false; }
+
+	DumpedFiles dumpedFiles;
+	for(auto& command : testCommands)
+	{ dumpCommandModules(command.get(), dumpedFiles, state.dumpFormat); }
+
+	// Write the script's files once all its modules have been dumped, skipping the files that
+	// another script already wrote.
+	for(DumpedFiles::File& dumpedFile : dumpedFiles.files)
+	{
+		{
+			Lock<Platform::Mutex> writtenFileNamesLock(state.mutex);
+			if(!state.writtenFileNames.add(dumpedFile.name)) { continue; }
+		}
+
+		Platform::File* file = Platform::openFile(state.outputDir + "/" + dumpedFile.name,
+												  Platform::FileAccessMode::writeOnly,
+												  Platform::FileCreateMode::createAlways);
+		errorUnless(file);
+		errorUnless(Platform::writeFile(file, dumpedFile.bytes.data(), dumpedFile.bytes.size()));
+		errorUnless(Platform::closeFile(file));
+	}
+	return true;
+}
+
+static constexpr Uptr dumpThreadStackBytes = 8 * 1024 * 1024;
+
+static I64 dumpThreadEntry(void* stateVoid)
+{
+	ParallelDumpState& state = *(ParallelDumpState*)stateVoid;
+	while(true)
+	{
+		const Uptr filenameIndex = state.nextFilenameIndex++;
+		if(filenameIndex >= state.filenames.size()) { break; }
+
+		if(!dumpTestScript(state, state.filenames[filenameIndex]))
+		{ state.failed.store(true, std::memory_order_relaxed); }
+	}
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
-	const char* filename = nullptr;
+	std::vector<const char*> filenames;
 	const char* outputDir = ".";
 	DumpFormat dumpFormat = DumpFormat::both;
+	Uptr numThreads = 0;
 	bool showHelpAndExit = false;
 
 	for(Iptr argumentIndex = 1; argumentIndex < argc; ++argumentIndex)
@@ -150,6 +247,18 @@ int main(int argc, char** argv)
 				break;
 			}
 		}
+		else if(!strcmp(argv[argumentIndex], "--threads"))
+		{
+			char* numThreadsEnd = nullptr;
+			if(argumentIndex + 1 == argc
+			   || (numThreads = strtoul(argv[++argumentIndex], &numThreadsEnd, 10)) == 0
+			   || *numThreadsEnd)
+			{
+				Log::printf(Log::error, "Expected a positive number after '--threads'\n");
+				showHelpAndExit = true;
+				break;
+			}
+		}
 		else if(!strcmp(argv[argumentIndex], "--wast"))
 		{
 			dumpFormat = dumpFormat == DumpFormat::wasm ? DumpFormat::both : DumpFormat::wast;
@@ -158,60 +267,34 @@ int main(int argc, char** argv)
 		{
 			dumpFormat = dumpFormat == DumpFormat::wast ? DumpFormat::both : DumpFormat::wasm;
 		}
-		else if(!filename)
-		{
-			filename = argv[argumentIndex];
-		}
 		else
 		{
-			Log::printf(Log::error, "Unrecognized argument: %s\n", argv[argumentIndex]);
-			showHelpAndExit = true;
-			break;
+			filenames.push_back(argv[argumentIndex]);
 		}
 	}
 
-	if(!filename) { showHelpAndExit = true; }
+	if(!filenames.size()) { showHelpAndExit = true; }
 
 	if(showHelpAndExit)
 	{
-		Log::printf(
-			Log::error,
-			"Usage: DumpTestModule [--output-dir <directory>] [--wast] [--wasm] <input .wast>\n");
+		Log::printf(Log::error,
+					"Usage: DumpTestModule [--output-dir <directory>] [--wast] [--wasm]\n"
+					"                      [--threads <n>] <input .wast> [<input .wast>...]\n");
 		return EXIT_FAILURE;
 	}
 
-	wavmAssert(filename);
-
 	// Always enable debug logging for tests.
 	Log::setCategoryEnabled(Log::debug, true);
 
-	// Read the file into a vector.
-	std::vector<U8> testScriptBytes;
-	if(!loadFile(filename, testScriptBytes)) { return EXIT_FAILURE; }
-
-	// Make sure the file is null terminated.
-	testScriptBytes.push_back(0);
-
-	// Process the test script.
-	std::vector<std::unique_ptr<Command>> testCommands;
-	std::vector<WAST::Error> testErrors;
+	// Dump the test scripts on the worker threads and the calling thread.
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::min(numThreads, Uptr(filenames.size()));
+	ParallelDumpState state(filenames, outputDir, dumpFormat);
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{ threads.push_back(Platform::createThread(dumpThreadStackBytes, dumpThreadEntry, &state)); }
+	dumpThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
 
-	// Parse the test script.
-	IR::FeatureSpec featureSpec;
-	featureSpec.requireSharedFlagForAtomicOperators = true;
-	WAST::parseTestCommands((const char*)testScriptBytes.data(),
-							testScriptBytes.size(),
-							featureSpec,
-							testCommands,
-							testErrors);
-	if(!testErrors.size())
-	{
-		for(auto& command : testCommands)
-		{ dumpCommandModules(command.get(), outputDir, dumpFormat); }
-		return EXIT_SUCCESS;
-	}
-	else
-	{
-		return EXIT_FAILURE;
-	}
+	return state.failed.load(std::memory_order_relaxed) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
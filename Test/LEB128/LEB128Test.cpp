@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <initializer_list>
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
+
+using namespace WAVM;
+using namespace WAVM::Serialization;
+
+static U64 generateRandomU64()
+{
+	// Pick a random number of significant bits, so small and large values are both common.
+	U64 value = 0;
+	for(Uptr byteIndex = 0; byteIndex < 8; ++byteIndex)
+	{ value = (value << 8) | U64(rand() & 0xff); }
+	const Uptr numSignificantBits = 1 + rand() % 64;
+	return numSignificantBits == 64 ? value : value & ((U64(1) << numSignificantBits) - 1);
+}
+
+// Decodes a value from bytes, followed by numPaddingBytes bytes, so the value is decoded both with
+// and without the longest possible encoding buffered.
+template<typename Value, Uptr maxBits>
+static Value decodeVarInt(const std::vector<U8>& bytes,
+						  Uptr numPaddingBytes,
+						  Value minValue,
+						  Value maxValue)
+{
+	std::vector<U8> paddedBytes = bytes;
+	paddedBytes.resize(bytes.size() + numPaddingBytes, 0xff);
+
+	MemoryInputStream stream(paddedBytes.data(), paddedBytes.size());
+	Value value;
+	serializeVarInt<Value, maxBits>(stream, value, minValue, maxValue);
+	errorUnless(stream.capacity() == numPaddingBytes);
+	return value;
+}
+
+template<typename Value, Uptr maxBits>
+static void testRoundTrip(Value value, Value minValue, Value maxValue)
+{
+	ArrayOutputStream outputStream;
+	serializeVarInt<Value, maxBits>(outputStream, value, minValue, maxValue);
+	const std::vector<U8> bytes = outputStream.getBytes();
+	errorUnless(bytes.size() <= (maxBits + 6) / 7);
+
+	for(Uptr numPaddingBytes : {0, 1, 16})
+	{
+		const Value decodedValue
+			= decodeVarInt<Value, maxBits>(bytes, numPaddingBytes, minValue, maxValue);
+		errorUnless(decodedValue == value);
+	}
+}
+
+template<typename Value, Uptr maxBits>
+static void testDecodingThrows(std::initializer_list<U8> bytes, Value minValue, Value maxValue)
+{
+	for(Uptr numPaddingBytes : {0, 16})
+	{
+		try
+		{
+			decodeVarInt<Value, maxBits>(bytes, numPaddingBytes, minValue, maxValue);
+			Errors::fatal("Decoding an invalid LEB128 encoding didn't throw an exception");
+		}
+		catch(FatalSerializationException const&)
+		{
+		}
+	}
+}
+
+static void testRoundTrips()
+{
+	for(U32 value : {U32(0), U32(1), U32(63), U32(64), U32(127), U32(128), U32(UINT32_MAX)})
+	{ testRoundTrip<U32, 32>(value, 0, UINT32_MAX); }
+	for(I32 value : {0, 1, -1, 63, 64, -64, -65, INT32_MIN, INT32_MAX})
+	{ testRoundTrip<I32, 32>(value, INT32_MIN, INT32_MAX); }
+	for(U64 value : {U64(0), U64(127), U64(128), U64(UINT64_MAX)})
+	{ testRoundTrip<U64, 64>(value, 0, UINT64_MAX); }
+	for(I64 value : {I64(0), I64(-1), I64(-64), I64(-65), I64(INT64_MIN), I64(INT64_MAX)})
+	{ testRoundTrip<I64, 64>(value, INT64_MIN, INT64_MAX); }
+	for(U8 value : {U8(0), U8(1)}) { testRoundTrip<U8, 1>(value, 0, 1); }
+	for(I8 value : {I8(0), I8(-64), I8(63)}) { testRoundTrip<I8, 7>(value, -64, 63); }
+
+	for(Uptr iteration = 0; iteration < 10000; ++iteration)
+	{
+		const U64 value = generateRandomU64();
+		testRoundTrip<U32, 32>(U32(value), 0, UINT32_MAX);
+		testRoundTrip<I32, 32>(I32(value), INT32_MIN, INT32_MAX);
+		testRoundTrip<U64, 64>(value, 0, UINT64_MAX);
+		testRoundTrip<I64, 64>(I64(value), INT64_MIN, INT64_MAX);
+	}
+}
+
+static void testInvalidEncodings()
+{
+	// Truncated encodings.
+	testDecodingThrows<U32, 32>({0x80}, 0, UINT32_MAX);
+	testDecodingThrows<I64, 64>({0xff, 0xff}, INT64_MIN, INT64_MAX);
+
+	// Encodings with unused bits in the final byte that don't match the used bits.
+	testDecodingThrows<U32, 32>({0xff, 0xff, 0xff, 0xff, 0x1f}, 0, UINT32_MAX);
+	testDecodingThrows<I32, 32>({0xff, 0xff, 0xff, 0xff, 0x4f}, INT32_MIN, INT32_MAX);
+	testDecodingThrows<U8, 1>({0x02}, 0, 1);
+
+	// Encodings that are longer than maxBits allows.
+	testDecodingThrows<U32, 32>({0x80, 0x80, 0x80, 0x80, 0x80, 0x00}, 0, UINT32_MAX);
+
+	// Encodings of values outside the expected range.
+	testDecodingThrows<U32, 32>({0x80, 0x01}, 0, 127);
+	testDecodingThrows<I8, 7>({0x40}, 0, 63);
+}
+
+static void benchmarkDecode()
+{
+	enum
+	{
+		numValues = 1000000,
+		numIterations = 10
+	};
+
+	// Encode a mix of values that mostly fit in one or two bytes, like the immediates of a
+	// WebAssembly module's code section.
+	ArrayOutputStream outputStream;
+	for(Uptr valueIndex = 0; valueIndex < numValues; ++valueIndex)
+	{
+		U32 value = (rand() % 4) ? U32(rand() % 128) : U32(generateRandomU64());
+		serializeVarUInt32(outputStream, value);
+	}
+	const std::vector<U8> bytes = outputStream.getBytes();
+
+	Timing::Timer timer;
+	U32 checksum = 0;
+	for(Uptr iteration = 0; iteration < numIterations; ++iteration)
+	{
+		MemoryInputStream stream(bytes.data(), bytes.size());
+		for(Uptr valueIndex = 0; valueIndex < numValues; ++valueIndex)
+		{
+			U32 value;
+			serializeVarUInt32(stream, value);
+			checksum += value;
+		}
+		errorUnless(!stream.capacity());
+	}
+	Timing::logRatePerSecond(
+		"Decoded LEB128 values", timer, F64(numValues * numIterations) / 1000000.0, "million");
+	Log::printf(Log::debug, "Checksum of decoded LEB128 values: %u\n", checksum);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testRoundTrips();
+	testInvalidEncodings();
+	benchmarkDecode();
+	Timing::logTimer("LEB128Test", timer);
+	return 0;
+}
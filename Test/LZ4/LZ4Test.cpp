@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/LZ4.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+
+using namespace WAVM;
+
+// Generates bytes that compress like machine code: short runs of random bytes, mixed with copies
+// of earlier bytes at varying distances.
+static std::vector<U8> generateCompressibleBytes(Uptr numBytes)
+{
+	std::vector<U8> bytes;
+	while(bytes.size() < numBytes)
+	{
+		const Uptr runLength = 1 + rand() % 32;
+		if(bytes.size() >= 64 && rand() % 2)
+		{
+			const Uptr offset = 1 + rand() % (bytes.size() < 70000 ? bytes.size() : 70000);
+			for(Uptr index = 0; index < runLength && bytes.size() < numBytes; ++index)
+			{ bytes.push_back(bytes[bytes.size() - offset]); }
+		}
+		else
+		{
+			for(Uptr index = 0; index < runLength && bytes.size() < numBytes; ++index)
+			{ bytes.push_back(U8(rand())); }
+		}
+	}
+	return bytes;
+}
+
+static void testRoundTrip(const std::vector<U8>& bytes)
+{
+	std::vector<U8> compressedBytes;
+	LZ4::compress(bytes.data(), bytes.size(), compressedBytes);
+
+	std::vector<U8> decompressedBytes;
+	errorUnless(LZ4::decompress(compressedBytes.data(), compressedBytes.size(), decompressedBytes));
+	errorUnless(decompressedBytes == bytes);
+}
+
+static void testRoundTrips()
+{
+	testRoundTrip({});
+	testRoundTrip({1});
+	testRoundTrip(std::vector<U8>(12, 'a'));
+	testRoundTrip(std::vector<U8>(13, 'a'));
+	testRoundTrip(std::vector<U8>(100000, 0));
+
+	// Runs of a repeated byte longer than the 15 bytes that fit in a sequence's token.
+	std::vector<U8> longRuns;
+	for(Uptr runIndex = 0; runIndex < 64; ++runIndex)
+	{ longRuns.insert(longRuns.end(), 1 + rand() % 1000, U8(runIndex)); }
+	testRoundTrip(longRuns);
+
+	for(Uptr iteration = 0; iteration < 100; ++iteration)
+	{
+		const Uptr numBytes = rand() % 4096;
+		std::vector<U8> randomBytes;
+		for(Uptr index = 0; index < numBytes; ++index) { randomBytes.push_back(U8(rand())); }
+		testRoundTrip(randomBytes);
+		testRoundTrip(generateCompressibleBytes(numBytes));
+	}
+	testRoundTrip(generateCompressibleBytes(1000000));
+}
+
+static void testInvalidCompressedBytes()
+{
+	std::vector<U8> compressedBytes;
+	const std::vector<U8> bytes = generateCompressibleBytes(10000);
+	LZ4::compress(bytes.data(), bytes.size(), compressedBytes);
+
+	// Every truncation of the compressed bytes must be rejected.
+	std::vector<U8> decompressedBytes;
+	for(Uptr numBytes = 0; numBytes < compressedBytes.size(); ++numBytes)
+	{ errorUnless(!LZ4::decompress(compressedBytes.data(), numBytes, decompressedBytes)); }
+
+	// A size that is larger than the compressed bytes could produce.
+	std::vector<U8> hugeSize = {0, 0, 0, 0, 0, 0, 0, 1, 0};
+	errorUnless(!LZ4::decompress(hugeSize.data(), hugeSize.size(), decompressedBytes));
+
+	// A match at an offset before the start of the output.
+	std::vector<U8> badOffset = {8, 0, 0, 0, 0, 0, 0, 0, 0x10, 'a', 2, 0, 0x30, 'b', 'c', 'd'};
+	errorUnless(!LZ4::decompress(badOffset.data(), badOffset.size(), decompressedBytes));
+
+	// Corrupting the compressed bytes must not read or write out of bounds.
+	for(Uptr iteration = 0; iteration < 1000; ++iteration)
+	{
+		std::vector<U8> corruptBytes = compressedBytes;
+		corruptBytes[8 + rand() % (corruptBytes.size() - 8)] = U8(rand());
+		LZ4::decompress(corruptBytes.data(), corruptBytes.size(), decompressedBytes);
+	}
+}
+
+static void benchmarkDecompress()
+{
+	enum
+	{
+		numBytes = 16 * 1024 * 1024,
+		numIterations = 10
+	};
+
+	const std::vector<U8> bytes = generateCompressibleBytes(numBytes);
+	std::vector<U8> compressedBytes;
+	Timing::Timer compressTimer;
+	LZ4::compress(bytes.data(), bytes.size(), compressedBytes);
+	Timing::logRatePerSecond("Compressed bytes", compressTimer, F64(numBytes) / 1048576.0, "MiB");
+	Log::printf(Log::debug,
+				"Compressed %u bytes to %u bytes\n",
+				unsigned(bytes.size()),
+				unsigned(compressedBytes.size()));
+
+	Timing::Timer decompressTimer;
+	std::vector<U8> decompressedBytes;
+	for(Uptr iteration = 0; iteration < numIterations; ++iteration)
+	{
+		errorUnless(
+			LZ4::decompress(compressedBytes.data(), compressedBytes.size(), decompressedBytes));
+	}
+	Timing::logRatePerSecond(
+		"Decompressed bytes", decompressTimer, F64(numBytes * numIterations) / 1048576.0, "MiB");
+	errorUnless(decompressedBytes == bytes);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testRoundTrips();
+	testInvalidCompressedBytes();
+	benchmarkDecompress();
+	Timing::logTimer("LZ4Test", timer);
+	return 0;
+}
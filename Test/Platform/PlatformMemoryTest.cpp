@@ -0,0 +1,274 @@
+#include <inttypes.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Thread.h"
+
+using namespace WAVM;
+using namespace WAVM::Platform;
+
+static constexpr Uptr numTestPages = 64;
+
+static Uptr getPageSize() { return Uptr(1) << getPageSizeLog2(); }
+
+static U8* allocateCommittedPages(Uptr numPages)
+{
+	U8* baseAddress = allocateVirtualPages(numPages);
+	errorUnless(baseAddress);
+	errorUnless(commitVirtualPages(baseAddress, numPages));
+	return baseAddress;
+}
+
+// Writes a different value to the first U64 of each page.
+static void writePages(U8* baseAddress, Uptr numPages, U64 seed)
+{
+	for(Uptr pageIndex = 0; pageIndex < numPages; ++pageIndex)
+	{
+		const U64 value = seed + pageIndex;
+		memcpy(baseAddress + pageIndex * getPageSize(), &value, sizeof(value));
+	}
+}
+
+static U64 readPage(const U8* baseAddress, Uptr pageIndex)
+{
+	U64 value;
+	memcpy(&value, baseAddress + pageIndex * getPageSize(), sizeof(value));
+	return value;
+}
+
+static bool testCloneIndependence()
+{
+	U8* source = allocateCommittedPages(numTestPages);
+	U8* clone = allocateCommittedPages(numTestPages);
+	writePages(source, numTestPages, 1000);
+
+	VirtualPageSnapshot* cloneSnapshot = nullptr;
+	if(!cloneVirtualPagesCopyOnWrite(source, clone, numTestPages, nullptr, cloneSnapshot))
+	{
+		Log::printf(Log::metrics, "Copy-on-write cloning isn't supported: skipping the tests.\n");
+		freeVirtualPages(source, numTestPages);
+		freeVirtualPages(clone, numTestPages);
+		return false;
+	}
+	errorUnless(!memcmp(source, clone, numTestPages * getPageSize()));
+
+	// Writes to either copy must not be visible in the other.
+	writePages(source, numTestPages / 2, 2000);
+	writePages(clone + (numTestPages / 2) * getPageSize(), numTestPages / 2, 3000);
+	for(Uptr pageIndex = 0; pageIndex < numTestPages / 2; ++pageIndex)
+	{
+		errorUnless(readPage(source, pageIndex) == 2000 + pageIndex);
+		errorUnless(readPage(clone, pageIndex) == 1000 + pageIndex);
+	}
+	for(Uptr pageIndex = numTestPages / 2; pageIndex < numTestPages; ++pageIndex)
+	{
+		errorUnless(readPage(source, pageIndex) == 1000 + pageIndex);
+		errorUnless(readPage(clone, pageIndex) == 3000 + pageIndex - numTestPages / 2);
+	}
+
+	releaseVirtualPageSnapshot(cloneSnapshot);
+	freeVirtualPages(source, numTestPages);
+	freeVirtualPages(clone, numTestPages);
+	return true;
+}
+
+static void testCloneOfClone()
+{
+	U8* source = allocateCommittedPages(numTestPages);
+	U8* clone = allocateCommittedPages(numTestPages);
+	U8* unmodifiedCloneOfClone = allocateCommittedPages(numTestPages);
+	U8* modifiedCloneOfClone = allocateCommittedPages(numTestPages);
+	writePages(source, numTestPages, 1000);
+
+	VirtualPageSnapshot* cloneSnapshot = nullptr;
+	errorUnless(cloneVirtualPagesCopyOnWrite(source, clone, numTestPages, nullptr, cloneSnapshot));
+
+	// Cloning an unmodified clone must share its snapshot.
+	VirtualPageSnapshot* unmodifiedSnapshot = nullptr;
+	errorUnless(cloneVirtualPagesCopyOnWrite(
+		clone, unmodifiedCloneOfClone, numTestPages, cloneSnapshot, unmodifiedSnapshot));
+	errorUnless(unmodifiedSnapshot == cloneSnapshot);
+	errorUnless(!memcmp(unmodifiedCloneOfClone, source, numTestPages * getPageSize()));
+
+	// Once a page of the clone is written, cloning it must copy the written page instead of
+	// sharing the snapshot.
+	writePages(clone + 5 * getPageSize(), 1, 4000);
+	VirtualPageSnapshot* modifiedSnapshot = nullptr;
+	errorUnless(cloneVirtualPagesCopyOnWrite(
+		clone, modifiedCloneOfClone, numTestPages, cloneSnapshot, modifiedSnapshot));
+	errorUnless(modifiedSnapshot != cloneSnapshot);
+	errorUnless(readPage(modifiedCloneOfClone, 5) == 4000);
+	errorUnless(!memcmp(modifiedCloneOfClone, clone, numTestPages * getPageSize()));
+
+	// Decommitting and recommitting a page mapped from a snapshot must zero it, not revert it to
+	// the snapshot's contents.
+	decommitVirtualPages(unmodifiedCloneOfClone + 3 * getPageSize(), 1);
+	errorUnless(commitVirtualPages(unmodifiedCloneOfClone + 3 * getPageSize(), 1));
+	errorUnless(readPage(unmodifiedCloneOfClone, 3) == 0);
+	errorUnless(readPage(unmodifiedCloneOfClone, 4) == 1004);
+	errorUnless(readPage(clone, 3) == 1003);
+
+	releaseVirtualPageSnapshot(cloneSnapshot);
+	releaseVirtualPageSnapshot(unmodifiedSnapshot);
+	releaseVirtualPageSnapshot(modifiedSnapshot);
+	freeVirtualPages(source, numTestPages);
+	freeVirtualPages(clone, numTestPages);
+	freeVirtualPages(unmodifiedCloneOfClone, numTestPages);
+	freeVirtualPages(modifiedCloneOfClone, numTestPages);
+}
+
+// Logs the time to clone pages that aren't mapped from a snapshot, which copies them into a new
+// snapshot, and the time to clone the unmodified clone, which shares the snapshot without copying.
+static void benchmarkClone()
+{
+	static constexpr Uptr numBenchmarkPages = 16384;
+	U8* source = allocateCommittedPages(numBenchmarkPages);
+	U8* clone = allocateCommittedPages(numBenchmarkPages);
+	U8* cloneOfClone = allocateCommittedPages(numBenchmarkPages);
+	writePages(source, numBenchmarkPages, 1000);
+
+	Timing::Timer copyTimer;
+	VirtualPageSnapshot* cloneSnapshot = nullptr;
+	errorUnless(
+		cloneVirtualPagesCopyOnWrite(source, clone, numBenchmarkPages, nullptr, cloneSnapshot));
+	copyTimer.stop();
+
+	Timing::Timer shareTimer;
+	VirtualPageSnapshot* cloneOfCloneSnapshot = nullptr;
+	errorUnless(cloneVirtualPagesCopyOnWrite(
+		clone, cloneOfClone, numBenchmarkPages, cloneSnapshot, cloneOfCloneSnapshot));
+	shareTimer.stop();
+	errorUnless(cloneOfCloneSnapshot == cloneSnapshot);
+	errorUnless(readPage(cloneOfClone, numBenchmarkPages - 1) == 1000 + numBenchmarkPages - 1);
+
+	Log::printf(Log::metrics,
+				"Cloned %" PRIuPTR " pages in %.2fms by copying, and in %.2fms by sharing\n",
+				numBenchmarkPages,
+				copyTimer.getMilliseconds(),
+				shareTimer.getMilliseconds());
+
+	releaseVirtualPageSnapshot(cloneSnapshot);
+	releaseVirtualPageSnapshot(cloneOfCloneSnapshot);
+	freeVirtualPages(source, numBenchmarkPages);
+	freeVirtualPages(clone, numBenchmarkPages);
+	freeVirtualPages(cloneOfClone, numBenchmarkPages);
+}
+
+struct ConcurrentWriterState
+{
+	U8* baseAddress;
+	std::atomic<bool> stop{false};
+	U64 numWrites = 0;
+};
+
+static I64 concurrentWriterThreadEntry(void* argument)
+{
+	ConcurrentWriterState* state = (ConcurrentWriterState*)argument;
+	while(!state->stop.load(std::memory_order_relaxed))
+	{
+		++state->numWrites;
+		for(Uptr pageIndex = 0; pageIndex < numTestPages; ++pageIndex)
+		{
+			volatile U64* value = (volatile U64*)(state->baseAddress + pageIndex * getPageSize());
+			*value = state->numWrites;
+		}
+	}
+	return 0;
+}
+
+static void testCloneWhileSourceIsWritten()
+{
+	// Clone pages while another thread writes them: none of the writes to the source may be lost.
+	ConcurrentWriterState state;
+	state.baseAddress = allocateCommittedPages(numTestPages);
+	U8* clone = allocateCommittedPages(numTestPages);
+	Thread* writerThread = createThread(1024 * 1024, concurrentWriterThreadEntry, &state);
+
+	for(Uptr iteration = 0; iteration < 100; ++iteration)
+	{
+		VirtualPageSnapshot* cloneSnapshot = nullptr;
+		errorUnless(cloneVirtualPagesCopyOnWrite(
+			state.baseAddress, clone, numTestPages, nullptr, cloneSnapshot));
+		releaseVirtualPageSnapshot(cloneSnapshot);
+	}
+
+	state.stop.store(true, std::memory_order_relaxed);
+	joinThread(writerThread);
+	for(Uptr pageIndex = 0; pageIndex < numTestPages; ++pageIndex)
+	{ errorUnless(readPage(state.baseAddress, pageIndex) == state.numWrites); }
+
+	freeVirtualPages(state.baseAddress, numTestPages);
+	freeVirtualPages(clone, numTestPages);
+}
+
+static U64 getPageBit(const std::vector<U64>& bits, Uptr pageIndex)
+{
+	return bits[pageIndex / 64] & (U64(1) << (pageIndex % 64));
+}
+
+static void testDirtyPageTracking()
+{
+	if(!acquireVirtualPageDirtyTracking())
+	{
+		Log::printf(Log::metrics, "Dirty page tracking isn't supported: skipping the test.\n");
+		return;
+	}
+
+	// The dirty bits are process-wide, so they may only be acquired by one tracker at a time.
+	errorUnless(!acquireVirtualPageDirtyTracking());
+
+	U8* baseAddress = allocateCommittedPages(numTestPages);
+	writePages(baseAddress, numTestPages, 0);
+	clearVirtualPageDirtyBits();
+
+	// Only the written pages may be reported as dirty.
+	std::vector<U64> dirtyBits((numTestPages + 63) / 64);
+	errorUnless(readVirtualPageDirtyBits(baseAddress, numTestPages, dirtyBits.data()));
+	for(Uptr pageIndex = 0; pageIndex < numTestPages; ++pageIndex)
+	{ errorUnless(!getPageBit(dirtyBits, pageIndex)); }
+
+	const Uptr writtenPageIndices[] = {1, 2, 5, numTestPages - 1};
+	for(Uptr pageIndex : writtenPageIndices) { baseAddress[pageIndex * getPageSize()] = 1; }
+	errorUnless(readVirtualPageDirtyBits(baseAddress, numTestPages, dirtyBits.data()));
+	for(Uptr pageIndex = 0; pageIndex < numTestPages; ++pageIndex)
+	{
+		bool isWritten = false;
+		for(Uptr writtenPageIndex : writtenPageIndices)
+		{ isWritten = isWritten || writtenPageIndex == pageIndex; }
+		errorUnless(!getPageBit(dirtyBits, pageIndex) == !isWritten);
+	}
+
+	// Clearing the bits must reset all of them.
+	clearVirtualPageDirtyBits();
+	errorUnless(readVirtualPageDirtyBits(baseAddress, numTestPages, dirtyBits.data()));
+	for(Uptr pageIndex = 0; pageIndex < numTestPages; ++pageIndex)
+	{ errorUnless(!getPageBit(dirtyBits, pageIndex)); }
+
+	freeVirtualPages(baseAddress, numTestPages);
+	releaseVirtualPageDirtyTracking();
+
+	// Once released, the bits may be acquired again.
+	errorUnless(acquireVirtualPageDirtyTracking());
+	releaseVirtualPageDirtyTracking();
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	if(testCloneIndependence())
+	{
+		testCloneOfClone();
+		benchmarkClone();
+		testCloneWhileSourceIsWritten();
+	}
+	testDirtyPageTracking();
+	Timing::logTimer("PlatformMemoryTest", timer);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include <inttypes.h>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Thread.h"
+
+using namespace WAVM;
+using namespace WAVM::Platform;
+
+static constexpr Uptr numStackBytes = 1024 * 1024;
+
+// A pooled host thread keeps its thread-local variables between the threads it runs, so this
+// counts the threads that ran on the calling host thread.
+static thread_local I64 numThreadsOnHostThread = 0;
+
+// The compiler may compute the address of a thread-local variable before a call to
+// forkCurrentThread, and use it in the forked thread, so the forked threads count themselves by
+// calling this function instead of accessing the variable directly.
+FORCENOINLINE static I64 countThread() { return ++numThreadsOnHostThread; }
+
+static I64 countThreadEntry(void*) { return countThread(); }
+
+// Forks the thread twice, and returns the numbers of threads that each forked thread counted on
+// its host thread.
+static I64 forkTwiceThreadEntry(void*)
+{
+	I64 results[2];
+	for(I64& result : results)
+	{
+		Thread* forkedThread = forkCurrentThread();
+		if(!forkedThread) { return countThread(); }
+		result = joinThread(forkedThread);
+	}
+	return results[0] * 10 + results[1];
+}
+
+static void testPooledThreads()
+{
+	setMaxPooledThreads(1);
+
+	// The second thread runs on the host thread of the first.
+	errorUnless(joinThread(createThread(numStackBytes, countThreadEntry, nullptr)) == 1);
+	errorUnless(joinThread(createThread(numStackBytes, countThreadEntry, nullptr)) == 2);
+
+	// A thread with a different stack size doesn't.
+	errorUnless(joinThread(createThread(numStackBytes * 2, countThreadEntry, nullptr)) == 1);
+
+	// The forking thread runs on the pooled host thread, so the first forked thread needs a new
+	// host thread, and the second forked thread runs on the host thread of the first.
+	errorUnless(joinThread(createThread(numStackBytes, forkTwiceThreadEntry, nullptr)) == 12);
+
+	// Once the pool is emptied, threads run on new host threads.
+	setMaxPooledThreads(0);
+	errorUnless(joinThread(createThread(numStackBytes, countThreadEntry, nullptr)) == 1);
+	errorUnless(joinThread(createThread(numStackBytes, countThreadEntry, nullptr)) == 1);
+}
+
+static I64 emptyThreadEntry(void*) { return 0; }
+
+// Logs the time to create and join a thread with and without the thread pool.
+static void benchmarkCreateThread()
+{
+	static constexpr Uptr numThreads = 1000;
+	for(Uptr maxPooledThreads : {Uptr(0), Uptr(1)})
+	{
+		setMaxPooledThreads(maxPooledThreads);
+		Timing::Timer timer;
+		for(Uptr threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+		{ errorUnless(!joinThread(createThread(numStackBytes, emptyThreadEntry, nullptr))); }
+		Log::printf(Log::metrics,
+					"Created and joined a thread in %.1fus with %" PRIuPTR " pooled threads\n",
+					timer.getMicroseconds() / F64(numThreads),
+					maxPooledThreads);
+	}
+	setMaxPooledThreads(0);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testPooledThreads();
+	benchmarkCreateThread();
+	Timing::logTimer("PlatformThreadTest", timer);
+	return 0;
+}
@@ -1,5 +1,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 #include <memory>
@@ -7,6 +9,7 @@
 #include <utility>
 #include <vector>
 
+#include "WAVM/HostAccel/HostAccel.h"
 #include "WAVM/IR/Types.h"
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
@@ -16,12 +19,19 @@
 #include "WAVM/Inline/Floats.h"
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/ParallelFor/ParallelFor.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Linker.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/Runtime/RuntimeData.h"
 #include "WAVM/ThreadTest/ThreadTest.h"
+#include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTParse/TestScript.h"
 #include "WAVM/WASTParse/WASTParse.h"
 
@@ -32,8 +42,52 @@ using namespace WAVM::WAST;
 
 DEFINE_INTRINSIC_MODULE(spectest);
 
+// The compiled modules shared by all the test scripts that are being run. Modules are keyed by
+// their binary encoding, so a module that is defined by more than one command or script is only
+// compiled once.
+struct CompiledModuleCache
+{
+	Platform::Mutex mutex;
+	HashMap<std::string, GCPointer<Runtime::Module>> modules;
+};
+
+// The time spent in the phases of running test commands, in microseconds. Parsing a script also
+// validates its modules, so both are included in the parse time.
+struct PhaseTimes
+{
+	U64 parse = 0;
+	U64 compile = 0;
+	U64 instantiate = 0;
+	U64 invoke = 0;
+
+	void operator+=(const PhaseTimes& other)
+	{
+		parse += other.parse;
+		compile += other.compile;
+		instantiate += other.instantiate;
+		invoke += other.invoke;
+	}
+};
+
+// Adds the time between its construction and destruction to a phase's time. It is also destroyed
+// when a trap unwinds the stack, so the time until the trap is included.
+struct PhaseTimer
+{
+	PhaseTimer(U64& inPhaseMicroseconds) : phaseMicroseconds(inPhaseMicroseconds) {}
+	~PhaseTimer() { phaseMicroseconds += timer.getMicroseconds(); }
+
+private:
+	U64& phaseMicroseconds;
+	Timing::Timer timer;
+};
+
 struct TestScriptState
 {
+	CompiledModuleCache& compiledModuleCache;
+
+	// The time spent in each phase of the command that is being processed.
+	PhaseTimes commandPhaseTimes;
+
 	bool hasInstantiatedModule;
 	GCPointer<ModuleInstance> lastModuleInstance;
 	GCPointer<Compartment> compartment;
@@ -44,8 +98,9 @@ struct TestScriptState
 
 	std::vector<WAST::Error> errors;
 
-	TestScriptState()
-	: hasInstantiatedModule(false)
+	TestScriptState(CompiledModuleCache& inCompiledModuleCache)
+	: compiledModuleCache(inCompiledModuleCache)
+	, hasInstantiatedModule(false)
 	, compartment(Runtime::createCompartment())
 	, context(Runtime::createContext(compartment))
 	{
@@ -53,6 +108,8 @@ struct TestScriptState
 			"spectest",
 			Intrinsics::instantiateModule(compartment, INTRINSIC_MODULE_REF(spectest), "spectest"));
 		moduleNameToInstanceMap.set("threadTest", ThreadTest::instantiate(compartment));
+		moduleNameToInstanceMap.set("parallelFor", ParallelFor::instantiate(compartment));
+		moduleNameToInstanceMap.set("hostAccel", HostAccel::instantiate(compartment));
 	}
 };
 
@@ -134,6 +191,37 @@ static ModuleInstance* getModuleContextByInternalName(TestScriptState& state,
 	return moduleInstance;
 }
 
+static Runtime::Module* compileModuleCached(TestScriptState& state, const IR::Module& irModule)
+{
+	std::string moduleBytes;
+	try
+	{
+		Serialization::ArrayOutputStream stream;
+		WASM::serialize(stream, irModule);
+		const std::vector<U8> bytes = stream.getBytes();
+		moduleBytes.assign((const char*)bytes.data(), bytes.size());
+	}
+	catch(Serialization::FatalSerializationException)
+	{
+		// If the module can't be encoded, just compile it without caching it.
+		return compileModule(irModule);
+	}
+
+	CompiledModuleCache& cache = state.compiledModuleCache;
+	{
+		Lock<Platform::Mutex> cacheLock(cache.mutex);
+		const GCPointer<Runtime::Module>* cachedModule = cache.modules.get(moduleBytes);
+		if(cachedModule) { return *cachedModule; }
+	}
+
+	// Compile the module without holding the lock, so other threads may compile other modules at
+	// the same time. If another thread compiled the same module in the meantime, its compiled
+	// module is used, and this one is left for the collectGarbage call at exit.
+	Runtime::Module* module = compileModule(irModule);
+	Lock<Platform::Mutex> cacheLock(cache.mutex);
+	return cache.modules.getOrAdd(moduleBytes, module);
+}
+
 static Runtime::ExceptionTypeInstance* getExpectedExceptionType(WAST::ExpectedTrapType expectedType)
 {
 	switch(expectedType)
@@ -173,21 +261,35 @@ static bool processAction(TestScriptState& state, Action* action, IR::ValueTuple
 	{
 		auto moduleAction = (ModuleAction*)action;
 
-		// Clear the previous module.
+		// Clear the previous module. Only the script's compartment is collected, since other test
+		// scripts may be running on other threads.
 		state.lastModuleInstance = nullptr;
-		collectGarbage();
+		collectCompartmentGarbage(state.compartment);
 
 		// Link and instantiate the module.
 		TestScriptResolver resolver(state);
 		LinkResult linkResult = linkModule(*moduleAction->module, resolver);
 		if(linkResult.success)
 		{
+			Runtime::Module* module;
+			{
+				PhaseTimer compileTimer(state.commandPhaseTimes.compile);
+				module = compileModuleCached(state, *moduleAction->module);
+			}
+
+			// The instantiate time includes calling the module's start function.
+			PhaseTimer instantiateTimer(state.commandPhaseTimes.instantiate);
 			state.hasInstantiatedModule = true;
 			state.lastModuleInstance = instantiateModule(state.compartment,
-														 compileModule(*moduleAction->module),
+														 module,
 														 std::move(linkResult.resolvedImports),
 														 "test module");
 
+			// Let the hostAccel functions access the module's memory, if it exports one.
+			MemoryInstance* memory
+				= asMemoryNullable(getInstanceExport(state.lastModuleInstance, "memory"));
+			if(memory) { HostAccel::setMemory(state.compartment, memory); }
+
 			// Call the module start function, if it has one.
 			FunctionInstance* startFunction = getStartFunction(state.lastModuleInstance);
 			if(startFunction) { invokeFunctionChecked(state.context, startFunction, {}); }
@@ -240,6 +342,7 @@ static bool processAction(TestScriptState& state, Action* action, IR::ValueTuple
 		}
 
 		// Execute the invoke
+		PhaseTimer invokeTimer(state.commandPhaseTimes.invoke);
 		outResults = invokeFunctionChecked(
 			state.context, functionInstance, invokeAction->arguments.values);
 
@@ -270,6 +373,7 @@ static bool processAction(TestScriptState& state, Action* action, IR::ValueTuple
 		}
 
 		// Get the value of the specified global.
+		PhaseTimer invokeTimer(state.commandPhaseTimes.invoke);
 		outResults = getGlobalValue(state.context, globalInstance);
 
 		return true;
@@ -505,11 +609,17 @@ static void processCommand(TestScriptState& state, const Command* command)
 				LinkResult linkResult = linkModule(*assertCommand->moduleAction->module, resolver);
 				if(linkResult.success)
 				{
-					auto moduleInstance
-						= instantiateModule(state.compartment,
-											compileModule(*assertCommand->moduleAction->module),
-											std::move(linkResult.resolvedImports),
-											"test module");
+					Runtime::Module* module;
+					{
+						PhaseTimer compileTimer(state.commandPhaseTimes.compile);
+						module = compileModuleCached(state, *assertCommand->moduleAction->module);
+					}
+
+					PhaseTimer instantiateTimer(state.commandPhaseTimes.instantiate);
+					auto moduleInstance = instantiateModule(state.compartment,
+															module,
+															std::move(linkResult.resolvedImports),
+															"test module");
 
 					// Call the module start function, if it has one.
 					FunctionInstance* startFunction = getStartFunction(moduleInstance);
@@ -571,11 +681,194 @@ DEFINE_INTRINSIC_MEMORY(spectest,
 						shared_memory,
 						MemoryType(true, SizeConstraints{1, 2}))
 
+// The time spent running a test command.
+struct CommandTiming
+{
+	TextFileLocus locus;
+	U64 totalMicroseconds;
+	PhaseTimes phaseTimes;
+};
+
+// A test script to run, and the errors it produced.
+struct TestScript
+{
+	const char* filename;
+	bool loadedFile = false;
+	std::vector<WAST::Error> errors;
+
+	// The time spent parsing the script, and running each of its commands.
+	U64 parseMicroseconds = 0;
+	std::vector<CommandTiming> commandTimings;
+
+	TestScript(const char* inFilename) : filename(inFilename) {}
+};
+
+static void runTestScript(TestScript& testScript,
+						  const FeatureSpec& featureSpec,
+						  CompiledModuleCache& compiledModuleCache)
+{
+	// Read the file into a vector.
+	std::vector<U8> testScriptBytes;
+	if(!loadFile(testScript.filename, testScriptBytes)) { return; }
+	testScript.loadedFile = true;
+
+	// Make sure the file is null terminated.
+	testScriptBytes.push_back(0);
+
+	// Process the test script.
+	TestScriptState* testScriptState = new TestScriptState(compiledModuleCache);
+	std::vector<std::unique_ptr<Command>> testCommands;
+
+	// Parse the test script.
+	Timing::Timer parseTimer;
+	WAST::parseTestCommands((const char*)testScriptBytes.data(),
+							testScriptBytes.size(),
+							featureSpec,
+							testCommands,
+							testScriptState->errors);
+	testScript.parseMicroseconds = parseTimer.getMicroseconds();
+	if(!testScriptState->errors.size())
+	{
+		// Process the test script commands.
+		for(auto& command : testCommands)
+		{
+			Log::printf(Log::debug,
+						"Evaluating test command at %s:%s\n",
+						testScript.filename,
+						command->locus.describe().c_str());
+			testScriptState->commandPhaseTimes = PhaseTimes();
+			Timing::Timer commandTimer;
+			catchRuntimeExceptions(
+				[testScriptState, &command] { processCommand(*testScriptState, command.get()); },
+				[testScriptState, &command](Runtime::Exception&& exception) {
+					testErrorf(*testScriptState,
+							   command->locus,
+							   "unexpected trap: %s",
+							   describeExceptionType(exception.typeInstance).c_str());
+				});
+			testScript.commandTimings.push_back({command->locus,
+												 commandTimer.getMicroseconds(),
+												 testScriptState->commandPhaseTimes});
+		}
+	}
+
+	testScript.errors = std::move(testScriptState->errors);
+
+	// Free the script's compartment. This doesn't free the compiled modules, which aren't owned by
+	// the compartment.
+	Compartment* compartment = testScriptState->compartment;
+	HostAccel::setMemory(compartment, nullptr);
+	delete testScriptState;
+	testCommands.clear();
+	collectCompartmentGarbage(compartment);
+}
+
+static constexpr Uptr testScriptThreadStackBytes = 8 * 1024 * 1024;
+
+// The state shared by the threads that run test scripts in parallel.
+struct ParallelTestScriptState
+{
+	std::vector<TestScript>& testScripts;
+	const FeatureSpec& featureSpec;
+	CompiledModuleCache& compiledModuleCache;
+	std::atomic<Uptr> nextTestScriptIndex{0};
+
+	ParallelTestScriptState(std::vector<TestScript>& inTestScripts,
+							const FeatureSpec& inFeatureSpec,
+							CompiledModuleCache& inCompiledModuleCache)
+	: testScripts(inTestScripts)
+	, featureSpec(inFeatureSpec)
+	, compiledModuleCache(inCompiledModuleCache)
+	{
+	}
+};
+
+static I64 testScriptThreadEntry(void* stateVoid)
+{
+	ParallelTestScriptState& state = *(ParallelTestScriptState*)stateVoid;
+	while(true)
+	{
+		const Uptr testScriptIndex = state.nextTestScriptIndex++;
+		if(testScriptIndex >= state.testScripts.size()) { break; }
+
+		runTestScript(
+			state.testScripts[testScriptIndex], state.featureSpec, state.compiledModuleCache);
+	}
+	return 0;
+}
+
+static void printTestScriptTiming(const std::vector<TestScript>& testScripts,
+								  Uptr numSlowestCommands)
+{
+	// Sum the time spent in each phase by all the scripts. The commands of different scripts may
+	// run in parallel, so the times are the sum of the time spent by each thread.
+	PhaseTimes totalPhaseTimes;
+	U64 totalCommandMicroseconds = 0;
+	std::vector<std::pair<const TestScript*, const CommandTiming*>> commandTimings;
+	for(const TestScript& testScript : testScripts)
+	{
+		totalPhaseTimes.parse += testScript.parseMicroseconds;
+		for(const CommandTiming& commandTiming : testScript.commandTimings)
+		{
+			totalPhaseTimes += commandTiming.phaseTimes;
+			totalCommandMicroseconds += commandTiming.totalMicroseconds;
+			commandTimings.push_back({&testScript, &commandTiming});
+		}
+	}
+
+	// The time spent running commands outside the timed phases, e.g. linking modules and checking
+	// results.
+	const U64 timedCommandMicroseconds
+		= totalPhaseTimes.compile + totalPhaseTimes.instantiate + totalPhaseTimes.invoke;
+	const U64 otherMicroseconds = totalCommandMicroseconds > timedCommandMicroseconds
+									  ? totalCommandMicroseconds - timedCommandMicroseconds
+									  : 0;
+
+	Log::printf(Log::debug,
+				"Test script timing: parse+validate %.2fms, compile %.2fms, instantiate %.2fms, "
+				"invoke %.2fms, other %.2fms\n",
+				totalPhaseTimes.parse / 1000.0,
+				totalPhaseTimes.compile / 1000.0,
+				totalPhaseTimes.instantiate / 1000.0,
+				totalPhaseTimes.invoke / 1000.0,
+				otherMicroseconds / 1000.0);
+
+	numSlowestCommands = std::min(numSlowestCommands, Uptr(commandTimings.size()));
+	if(!numSlowestCommands) { return; }
+	std::partial_sort(commandTimings.begin(),
+					  commandTimings.begin() + numSlowestCommands,
+					  commandTimings.end(),
+					  [](const std::pair<const TestScript*, const CommandTiming*>& a,
+						 const std::pair<const TestScript*, const CommandTiming*>& b) {
+						  return a.second->totalMicroseconds > b.second->totalMicroseconds;
+					  });
+
+	Log::printf(Log::debug, "Slowest test commands:\n");
+	for(Uptr commandIndex = 0; commandIndex < numSlowestCommands; ++commandIndex)
+	{
+		const TestScript& testScript = *commandTimings[commandIndex].first;
+		const CommandTiming& commandTiming = *commandTimings[commandIndex].second;
+		Log::printf(Log::debug,
+					"  %.2fms %s:%s (compile %.2fms, instantiate %.2fms, invoke %.2fms)\n",
+					commandTiming.totalMicroseconds / 1000.0,
+					testScript.filename,
+					commandTiming.locus.describe().c_str(),
+					commandTiming.phaseTimes.compile / 1000.0,
+					commandTiming.phaseTimes.instantiate / 1000.0,
+					commandTiming.phaseTimes.invoke / 1000.0);
+	}
+}
+
 static void showHelp()
 {
 	Log::printf(Log::error,
-				"Usage: RunTestScript [options] in.wast [options]\n"
-				"  -h|--help                 Display this message\n");
+				"Usage: RunTestScript [options] in.wast [in.wast...] [options]\n"
+				"  -h|--help                 Display this message\n"
+				"  --threads <n>             Run up to n test scripts in parallel (default: the\n"
+				"                            number of hardware threads)\n"
+				"  --timing [n]              Print the time spent in each phase of running the\n"
+				"                            test scripts, and the n slowest commands (default:\n"
+				"                            10)\n");
 }
 
 int main(int argc, char** argv)
@@ -584,7 +877,10 @@ int main(int argc, char** argv)
 	FeatureSpec featureSpec;
 	featureSpec.requireSharedFlagForAtomicOperators = true;
 
-	const char* filename = nullptr;
+	std::vector<TestScript> testScripts;
+	Uptr numThreads = 0;
+	bool printTiming = false;
+	Uptr numSlowestCommands = 10;
 	for(int argIndex = 1; argIndex < argc; ++argIndex)
 	{
 		if(!strcmp(argv[argIndex], "--help") || !strcmp(argv[argIndex], "-h"))
@@ -592,18 +888,40 @@ int main(int argc, char** argv)
 			showHelp();
 			return EXIT_SUCCESS;
 		}
-		else if(!filename)
+		else if(!strcmp(argv[argIndex], "--threads"))
 		{
-			filename = argv[argIndex];
+			char* numThreadsEnd = nullptr;
+			if(argIndex + 1 == argc
+			   || (numThreads = strtoul(argv[++argIndex], &numThreadsEnd, 10)) == 0
+			   || *numThreadsEnd)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(argv[argIndex], "--timing"))
+		{
+			// The number of slowest commands is optional, so only consume the next argument if it
+			// is a number.
+			printTiming = true;
+			char* numSlowestCommandsEnd = nullptr;
+			if(argIndex + 1 < argc && *argv[argIndex + 1] >= '0' && *argv[argIndex + 1] <= '9')
+			{
+				numSlowestCommands = strtoul(argv[++argIndex], &numSlowestCommandsEnd, 10);
+				if(*numSlowestCommandsEnd)
+				{
+					showHelp();
+					return EXIT_FAILURE;
+				}
+			}
 		}
 		else
 		{
-			showHelp();
-			return EXIT_FAILURE;
+			testScripts.emplace_back(argv[argIndex]);
 		}
 	}
 
-	if(!filename)
+	if(!testScripts.size())
 	{
 		showHelp();
 		return EXIT_FAILURE;
@@ -617,54 +935,40 @@ int main(int argc, char** argv)
 	// Always enable debug logging for tests.
 	Log::setCategoryEnabled(Log::debug, true);
 
-	// Read the file into a vector.
-	std::vector<U8> testScriptBytes;
-	if(!loadFile(filename, testScriptBytes)) { return EXIT_FAILURE; }
-
-	// Make sure the file is null terminated.
-	testScriptBytes.push_back(0);
-
-	// Process the test script.
-	TestScriptState* testScriptState = new TestScriptState();
-	std::vector<std::unique_ptr<Command>> testCommands;
-
-	// Parse the test script.
-	WAST::parseTestCommands((const char*)testScriptBytes.data(),
-							testScriptBytes.size(),
-							featureSpec,
-							testCommands,
-							testScriptState->errors);
-	if(!testScriptState->errors.size())
+	// Run the test scripts on the worker threads and the calling thread. Each script has its own
+	// compartment, so the scripts only share the compiled modules.
+	if(!numThreads) { numThreads = Platform::getNumberOfHardwareThreads(); }
+	numThreads = std::min(numThreads, Uptr(testScripts.size()));
 	{
-		// Process the test script commands.
-		for(auto& command : testCommands)
+		CompiledModuleCache compiledModuleCache;
+		ParallelTestScriptState state(testScripts, featureSpec, compiledModuleCache);
+		std::vector<Platform::Thread*> threads;
+		for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
 		{
-			Log::printf(
-				Log::debug, "Evaluating test command at %s\n", command->locus.describe().c_str());
-			catchRuntimeExceptions(
-				[testScriptState, &command] { processCommand(*testScriptState, command.get()); },
-				[testScriptState, &command](Runtime::Exception&& exception) {
-					testErrorf(*testScriptState,
-							   command->locus,
-							   "unexpected trap: %s",
-							   describeExceptionType(exception.typeInstance).c_str());
-				});
+			threads.push_back(Platform::createThread(
+				testScriptThreadStackBytes, testScriptThreadEntry, &state));
 		}
+		testScriptThreadEntry(&state);
+		for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
 	}
 
+	// Print the errors from each script in the order they were given.
 	int exitCode = EXIT_SUCCESS;
-	if(testScriptState->errors.size())
+	for(const TestScript& testScript : testScripts)
 	{
-		// Print any errors;
-		Log::printf(Log::error, "Error running test script:\n");
-		reportParseErrors(filename, testScriptState->errors);
+		if(!testScript.loadedFile) { exitCode = EXIT_FAILURE; }
+		else if(testScript.errors.size())
+		{
+			Log::printf(Log::error, "Error running test script:\n");
+			reportParseErrors(testScript.filename, testScript.errors);
 
-		Log::printf(Log::error, "%s: testing failed!\n", filename);
-		exitCode = EXIT_FAILURE;
+			Log::printf(Log::error, "%s: testing failed!\n", testScript.filename);
+			exitCode = EXIT_FAILURE;
+		}
 	}
 
-	delete testScriptState;
-	testCommands.clear();
+	if(printTiming) { printTestScriptTiming(testScripts, numSlowestCommands); }
+
 	collectGarbage();
 
 	return exitCode;
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static const char testWAST[]
+	= "(module\n"
+	  "  (func $fib (export \"fib\") (param $n i32) (result i32)\n"
+	  "    (if (result i32) (i32.lt_u (get_local $n) (i32.const 2))\n"
+	  "      (then (get_local $n))\n"
+	  "      (else (i32.add (call $fib (i32.sub (get_local $n) (i32.const 1)))\n"
+	  "                     (call $fib (i32.sub (get_local $n) (i32.const 2)))))\n"
+	  "    )\n"
+	  "  )\n"
+	  "  (func (export \"fibPlusOne\") (param $n i32) (result i32)\n"
+	  "    (i32.add (call $fib (get_local $n)) (i32.const 1))\n"
+	  "  )\n"
+	  ")\n";
+
+static void testCompiledModule(Runtime::Module* module)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, module, {}, "AsyncCompileTest");
+		FunctionInstance* fibPlusOne
+			= asFunctionNullable(getInstanceExport(moduleInstance, "fibPlusOne"));
+		errorUnless(fibPlusOne);
+
+		const ValueTuple results = invokeFunctionChecked(context, fibPlusOne, {Value(I32(20))});
+		errorUnless(results.size() == 1 && results[0].i32 == 6766);
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+// The state of a compile's onFinished callback.
+struct FinishedState
+{
+	std::atomic<Uptr> numCalls{0};
+	std::atomic<Runtime::Module*> module{nullptr};
+	std::atomic<Uptr> finishOrder{UINTPTR_MAX};
+};
+
+static std::atomic<Uptr> numFinishedCompiles{0};
+
+static AsyncCompile* startCompile(const IR::Module& irModule,
+								  const CompileOptions& options,
+								  CompilePriority priority,
+								  FinishedState& finishedState)
+{
+	return compileModuleAsync(
+		irModule, options, priority, [&finishedState](Runtime::Module* module) {
+			finishedState.module.store(module);
+			finishedState.finishOrder.store(numFinishedCompiles++);
+			++finishedState.numCalls;
+		});
+}
+
+// Waits for a compile to finish, checks its progress and the module it passed to onFinished, and
+// returns the compiled module.
+static Runtime::Module* finishCompile(AsyncCompile* compile,
+									  const IR::Module& irModule,
+									  const FinishedState& finishedState,
+									  bool expectCancelled)
+{
+	AsyncCompileProgress progress;
+	do
+	{
+		progress = getAsyncCompileProgress(compile);
+		errorUnless(progress.numFunctionDefs == irModule.functions.defs.size());
+		errorUnless(progress.numFunctionDefsEmitted <= progress.numFunctionDefs);
+		errorUnless(progress.numFunctionDefsCompiled <= progress.numFunctionDefsEmitted);
+	} while(!progress.isFinished);
+	if(!expectCancelled)
+	{ errorUnless(progress.numFunctionDefsCompiled == progress.numFunctionDefs); }
+
+	Runtime::Module* module = finishAsyncCompile(compile);
+	errorUnless(finishedState.numCalls.load() == 1);
+	errorUnless(finishedState.module.load() == module);
+	errorUnless(!module == expectCancelled);
+	return module;
+}
+
+// Compiles a module with each priority and number of compile threads at once, and checks that
+// each compile produces a working module.
+static void testConcurrentCompiles(const IR::Module& irModule)
+{
+	const CompilePriority priorities[]
+		= {CompilePriority::warmUp, CompilePriority::normal, CompilePriority::interactive};
+	const Uptr numCompileThreads[] = {1, 4};
+
+	std::vector<AsyncCompile*> compiles;
+	std::vector<FinishedState> finishedStates(3 * 2);
+	for(Uptr priorityIndex = 0; priorityIndex < 3; ++priorityIndex)
+	{
+		for(Uptr threadsIndex = 0; threadsIndex < 2; ++threadsIndex)
+		{
+			CompileOptions options;
+			options.numCompileThreads = numCompileThreads[threadsIndex];
+			compiles.push_back(startCompile(irModule,
+											options,
+											priorities[priorityIndex],
+											finishedStates[compiles.size()]));
+		}
+	}
+
+	for(Uptr compileIndex = 0; compileIndex < compiles.size(); ++compileIndex)
+	{
+		GCPointer<Runtime::Module> module
+			= finishCompile(compiles[compileIndex], irModule, finishedStates[compileIndex], false);
+		testCompiledModule(module);
+	}
+}
+
+// Occupies the only background compile thread with a compile whose onFinished callback blocks, so
+// the compiles queued behind it start in priority order once it is released, and a compile that is
+// cancelled while queued never starts.
+static void testPriorityAndCancellation(const IR::Module& irModule)
+{
+	setMaxAsyncCompileThreads(1);
+
+	std::atomic<bool> isBlockingCompileFinishing{false};
+	std::atomic<bool> releaseBlockingCompile{false};
+	Runtime::Module* blockingModule = nullptr;
+	AsyncCompile* blockingCompile = compileModuleAsync(
+		irModule, CompileOptions(), CompilePriority::normal, [&](Runtime::Module* module) {
+			blockingModule = module;
+			isBlockingCompileFinishing.store(true);
+			while(!releaseBlockingCompile.load()) {}
+		});
+	while(!isBlockingCompileFinishing.load()) {}
+
+	FinishedState warmUpState;
+	FinishedState normalState;
+	FinishedState interactiveState;
+	FinishedState cancelledState;
+	numFinishedCompiles.store(0);
+	AsyncCompile* warmUpCompile
+		= startCompile(irModule, CompileOptions(), CompilePriority::warmUp, warmUpState);
+	AsyncCompile* normalCompile
+		= startCompile(irModule, CompileOptions(), CompilePriority::normal, normalState);
+	AsyncCompile* cancelledCompile
+		= startCompile(irModule, CompileOptions(), CompilePriority::interactive, cancelledState);
+	AsyncCompile* interactiveCompile
+		= startCompile(irModule, CompileOptions(), CompilePriority::interactive, interactiveState);
+	cancelAsyncCompile(cancelledCompile);
+
+	// None of the queued compiles can start while the blocking compile occupies the thread.
+	errorUnless(!getAsyncCompileProgress(warmUpCompile).isFinished);
+	errorUnless(!getAsyncCompileProgress(interactiveCompile).isFinished);
+	releaseBlockingCompile.store(true);
+
+	GCPointer<Runtime::Module> module = finishAsyncCompile(blockingCompile);
+	errorUnless(module && module == blockingModule);
+	testCompiledModule(module);
+
+	errorUnless(!finishCompile(cancelledCompile, irModule, cancelledState, true));
+	module = finishCompile(interactiveCompile, irModule, interactiveState, false);
+	testCompiledModule(module);
+	module = finishCompile(normalCompile, irModule, normalState, false);
+	testCompiledModule(module);
+	module = finishCompile(warmUpCompile, irModule, warmUpState, false);
+	testCompiledModule(module);
+
+	// The queued compiles ran in priority order, after the cancelled compile, which was queued
+	// ahead of the other interactive compile.
+	errorUnless(cancelledState.finishOrder.load() == 0);
+	errorUnless(interactiveState.finishOrder.load() == 1);
+	errorUnless(normalState.finishOrder.load() == 2);
+	errorUnless(warmUpState.finishOrder.load() == 3);
+
+	setMaxAsyncCompileThreads(Platform::getNumberOfHardwareThreads());
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("AsyncCompileTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+
+	testConcurrentCompiles(irModule);
+	testPriorityAndCancellation(irModule);
+
+	Timing::logTimer("AsyncCompileTest", timer);
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static void sleepMicroseconds(U64 numMicroseconds)
+{
+	Platform::Event event;
+	event.wait(Platform::getMonotonicClock() + numMicroseconds);
+}
+
+// Creates unrooted globals, which are garbage as soon as they are created. Creating more objects
+// than the minimum background collection trigger requests a background collection.
+static void createGarbage(Compartment* compartment)
+{
+	for(Uptr globalIndex = 0; globalIndex < 2048; ++globalIndex)
+	{ errorUnless(createGlobal(compartment, GlobalType(ValueType::i32, false), Value(I32(0)))); }
+}
+
+// An unrooted object must not be freed by background collections while a
+// NoBackgroundCollectionScope is active, and must be freed by them once it ends.
+static void testNoBackgroundCollectionScope()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	startBackgroundGarbageCollection(1);
+
+	Uptr numCommittedBytesWithMemory = 0;
+	{
+		NoBackgroundCollectionScope noBackgroundCollectionScope;
+
+		const Uptr numCommittedBytesWithoutMemory = getCompartmentCommittedBytes(compartment);
+		MemoryInstance* memory = createMemory(compartment, MemoryType(false, {16, 16}));
+		errorUnless(memory);
+		numCommittedBytesWithMemory = getCompartmentCommittedBytes(compartment);
+		errorUnless(numCommittedBytesWithMemory > numCommittedBytesWithoutMemory);
+
+		// Request several background collections, and give them time to run.
+		for(Uptr round = 0; round < 4; ++round)
+		{
+			createGarbage(compartment);
+			sleepMicroseconds(200000);
+		}
+
+		errorUnless(getCompartmentCommittedBytes(compartment) >= numCommittedBytesWithMemory);
+		errorUnless(getMemoryNumPages(memory) == 16);
+	}
+
+	// Once the scope ends, the deferred collection runs. It treats the objects created since the
+	// background collection thread started as roots, so the memory is freed by a later collection.
+	Timing::Timer timer;
+	while(getCompartmentCommittedBytes(compartment) >= numCommittedBytesWithMemory
+		  && timer.getSeconds() < 30.0)
+	{
+		createGarbage(compartment);
+		sleepMicroseconds(100000);
+	}
+	errorUnless(getCompartmentCommittedBytes(compartment) < numCommittedBytesWithMemory);
+
+	stopBackgroundGarbageCollection();
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+static I64 copyRootThreadEntry(void* argument)
+{
+	MemoryInstance* memory = (MemoryInstance*)argument;
+	for(Uptr iteration = 0; iteration < 1000000; ++iteration)
+	{
+		GCPointer<MemoryInstance> root = memory;
+		GCPointer<MemoryInstance> copy = root;
+		errorUnless(copy == memory);
+	}
+	return 0;
+}
+
+// Threads that root and unroot an object while collections read the root reference counts must
+// neither let the object be freed while it's rooted, nor leave it rooted once they're done.
+static void testConcurrentRooting()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	MemoryInstance* memory = createMemory(compartment, MemoryType(false, {1, 1}));
+	errorUnless(memory);
+
+	Platform::Thread* threads[4];
+	{
+		GCPointer<MemoryInstance> memoryRoot = memory;
+		for(Platform::Thread*& thread : threads)
+		{ thread = Platform::createThread(1024 * 1024, copyRootThreadEntry, memory); }
+		for(Uptr collectionIndex = 0; collectionIndex < 100; ++collectionIndex)
+		{ collectGarbage(); }
+		for(Platform::Thread* thread : threads) { errorUnless(!Platform::joinThread(thread)); }
+		errorUnless(getMemoryNumPages(memory) == 1);
+	}
+
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	testNoBackgroundCollectionScope();
+	testConcurrentRooting();
+
+	// Leave the background collection thread running with garbage to collect when the process
+	// exits: it must be stopped before the static objects it uses are destroyed.
+	startBackgroundGarbageCollection(1);
+	GCPointer<Compartment> compartment = createCompartment();
+	createGarbage(compartment);
+
+	Timing::logTimer("BackgroundGCTest", timer);
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/Runtime/RuntimeData.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// step adds an incremented counter to a value in memory, and calls scale through the table with
+// it. The two versions of the module only differ in the factor scale multiplies by.
+static const char oldWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (memory 1)\n"
+	  "  (global $counter (mut i32) (i32.const 0))\n"
+	  "  (table (export \"table\") 1 anyfunc)\n"
+	  "  (elem (i32.const 0) $scale)\n"
+	  "  (func $scale (export \"scale\") (param $x i32) (result i32)\n"
+	  "    (i32.mul (get_local $x) (i32.const 2)))\n"
+	  "  (func (export \"step\") (result i32)\n"
+	  "    (set_global $counter (i32.add (get_global $counter) (i32.const 1)))\n"
+	  "    (i32.store (i32.const 0) (i32.add (i32.load (i32.const 0)) (get_global $counter)))\n"
+	  "    (call_indirect (type $i32_to_i32) (i32.load (i32.const 0)) (i32.const 0))\n"
+	  "  )\n"
+	  ")\n";
+
+static const char newWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (memory 1)\n"
+	  "  (global $counter (mut i32) (i32.const 0))\n"
+	  "  (table (export \"table\") 1 anyfunc)\n"
+	  "  (elem (i32.const 0) $scale)\n"
+	  "  (func $scale (export \"scale\") (param $x i32) (result i32)\n"
+	  "    (i32.mul (get_local $x) (i32.const 10)))\n"
+	  "  (func (export \"step\") (result i32)\n"
+	  "    (set_global $counter (i32.add (get_global $counter) (i32.const 1)))\n"
+	  "    (i32.store (i32.const 0) (i32.add (i32.load (i32.const 0)) (get_global $counter)))\n"
+	  "    (call_indirect (type $i32_to_i32) (i32.load (i32.const 0)) (i32.const 0))\n"
+	  "  )\n"
+	  ")\n";
+
+// The same as newWAST, but with an extra global, so it can't replace oldWAST's code.
+static const char incompatibleWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (memory 1)\n"
+	  "  (global $counter (mut i32) (i32.const 0))\n"
+	  "  (global $unused (mut i32) (i32.const 0))\n"
+	  "  (table (export \"table\") 1 anyfunc)\n"
+	  "  (elem (i32.const 0) $scale)\n"
+	  "  (func $scale (export \"scale\") (param $x i32) (result i32)\n"
+	  "    (i32.mul (get_local $x) (i32.const 100)))\n"
+	  "  (func (export \"step\") (result i32)\n"
+	  "    (set_global $counter (i32.add (get_global $counter) (i32.const 1)))\n"
+	  "    (i32.store (i32.const 0) (i32.add (i32.load (i32.const 0)) (get_global $counter)))\n"
+	  "    (call_indirect (type $i32_to_i32) (i32.load (i32.const 0)) (i32.const 0))\n"
+	  "  )\n"
+	  ")\n";
+
+static bool parseTestModule(const char* string, Uptr numChars, IR::Module& outIRModule)
+{
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(string, numChars, outIRModule, parseErrors))
+	{
+		WAST::reportParseErrors("HotSwapTest", parseErrors);
+		return false;
+	}
+	return true;
+}
+
+static I32 invokeI32(Context* context, FunctionInstance* function, const std::vector<Value>& args)
+{
+	const ValueTuple results = invokeFunctionChecked(context, function, args);
+	errorUnless(results.size() == 1 && results[0].type == ValueType::i32);
+	return results[0].i32;
+}
+
+static void testReplaceCode(Runtime::Module* oldModule,
+							Runtime::Module* newModule,
+							Runtime::Module* incompatibleModule,
+							Runtime::Module* lazyNewModule)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, oldModule, {}, "HotSwapTest");
+
+		// Look up the exports before replacing the code, to check that they call the new code.
+		FunctionInstance* step = asFunctionNullable(getInstanceExport(moduleInstance, "step"));
+		FunctionInstance* scale = asFunctionNullable(getInstanceExport(moduleInstance, "scale"));
+		TableInstance* table = asTableNullable(getInstanceExport(moduleInstance, "table"));
+		errorUnless(step && scale && table);
+
+		// A table the module doesn't define, which refers to one of its functions.
+		GCPointer<TableInstance> hostTable = createTable(
+			compartment, TableType(ReferenceType::anyfunc, false, SizeConstraints{1, 1}));
+		errorUnless(hostTable);
+		setTableElement(hostTable, 0, &asAnyFunc(scale)->anyRef);
+
+		errorUnless(invokeI32(context, step, {}) == 2);
+		errorUnless(invokeI32(context, scale, {Value(I32(5))}) == 10);
+
+		// Modules with an incompatible layout, or that are compiled lazily, are rejected without
+		// changing the instance.
+		errorUnless(!replaceModuleInstanceCode(moduleInstance, incompatibleModule));
+		errorUnless(!replaceModuleInstanceCode(moduleInstance, lazyNewModule));
+		errorUnless(invokeI32(context, scale, {Value(I32(5))}) == 10);
+
+		// Replacing the code keeps the memory and global state, and switches the exports and
+		// both tables to the new code.
+		const AnyReferee* oldScaleAnyRef = &asAnyFunc(scale)->anyRef;
+		errorUnless(replaceModuleInstanceCode(moduleInstance, newModule));
+		errorUnless(invokeI32(context, scale, {Value(I32(5))}) == 50);
+		errorUnless(invokeI32(context, step, {}) == 30);
+		errorUnless(invokeI32(context, step, {}) == 60);
+
+		const AnyReferee* newScaleAnyRef = &asAnyFunc(scale)->anyRef;
+		errorUnless(newScaleAnyRef != oldScaleAnyRef);
+		errorUnless(getTableElement(table, 0) == newScaleAnyRef);
+		errorUnless(getTableElement(hostTable, 0) == newScaleAnyRef);
+
+		// The code can be replaced again, including by the module it was originally compiled from.
+		errorUnless(replaceModuleInstanceCode(moduleInstance, oldModule));
+		errorUnless(invokeI32(context, step, {}) == 20);
+		errorUnless(getTableElement(hostTable, 0) == &asAnyFunc(scale)->anyRef);
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module oldIRModule;
+	IR::Module newIRModule;
+	IR::Module incompatibleIRModule;
+	if(!parseTestModule(oldWAST, sizeof(oldWAST), oldIRModule)
+	   || !parseTestModule(newWAST, sizeof(newWAST), newIRModule)
+	   || !parseTestModule(incompatibleWAST, sizeof(incompatibleWAST), incompatibleIRModule))
+	{ return EXIT_FAILURE; }
+
+	CompileOptions lazyCompileOptions;
+	lazyCompileOptions.lazyCompile = true;
+
+	GCPointer<Runtime::Module> oldModule = compileModule(oldIRModule);
+	GCPointer<Runtime::Module> newModule = compileModule(newIRModule);
+	GCPointer<Runtime::Module> incompatibleModule = compileModule(incompatibleIRModule);
+	GCPointer<Runtime::Module> lazyNewModule = compileModule(newIRModule, lazyCompileOptions);
+
+	testReplaceCode(oldModule, newModule, incompatibleModule, lazyNewModule);
+
+	Timing::logTimer("HotSwapTest", timer);
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// The test modules have enough function definitions for 3 partitions of 16.
+static constexpr Uptr numTestFunctions = 40;
+static constexpr Uptr numTestPartitions = 3;
+
+// The manifest has a 16 byte header, followed by 40 bytes for each partition.
+static constexpr Uptr numManifestHeaderBytes = 16;
+static constexpr Uptr numManifestPartitionBytes = 40;
+
+// Creates a module with functions f0, f1, ... that each return their index, except for
+// editedFunctionIndex, which returns 1000. If extraExport is true, the module also exports its
+// first function with another name, which changes the module's declarations.
+static bool parseTestModule(Uptr editedFunctionIndex, bool extraExport, IR::Module& outIRModule)
+{
+	std::string wast = "(module\n";
+	for(Uptr functionIndex = 0; functionIndex < numTestFunctions; ++functionIndex)
+	{
+		const Uptr result = functionIndex == editedFunctionIndex ? 1000 : functionIndex;
+		wast += "  (func (export \"f" + std::to_string(functionIndex) + "\") (result i32)";
+		wast += " (i32.const " + std::to_string(result) + "))\n";
+	}
+	if(extraExport) { wast += "  (export \"extra\" (func 0))\n"; }
+	wast += ")\n";
+
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(wast.c_str(), wast.size() + 1, outIRModule, parseErrors))
+	{
+		WAST::reportParseErrors("IncrementalCompileTest", parseErrors);
+		return false;
+	}
+	return true;
+}
+
+// Checks that the functions of a module return their index, except for editedFunctionIndex, which
+// returns editedResult.
+static void checkResults(Runtime::Module* module, Uptr editedFunctionIndex, I32 editedResult)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, module, {}, "IncrementalCompileTest");
+		for(Uptr functionIndex = 0; functionIndex < numTestFunctions; ++functionIndex)
+		{
+			FunctionInstance* function = asFunctionNullable(
+				getInstanceExport(moduleInstance, "f" + std::to_string(functionIndex)));
+			errorUnless(function);
+			const ValueTuple results = invokeFunctionChecked(context, function, {});
+			errorUnless(results.size() == 1 && results[0].type == ValueType::i32);
+			errorUnless(results[0].i32
+						== (functionIndex == editedFunctionIndex ? editedResult
+																 : I32(functionIndex)));
+		}
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+static bool isManifestPartitionEqual(const std::vector<U8>& a,
+									 const std::vector<U8>& b,
+									 Uptr partitionIndex)
+{
+	const Uptr offset = numManifestHeaderBytes + partitionIndex * numManifestPartitionBytes;
+	return !memcmp(a.data() + offset, b.data() + offset, numManifestPartitionBytes);
+}
+
+static void testIncrementalCompile()
+{
+	IR::Module originalIRModule;
+	IR::Module editedIRModule;
+	IR::Module extraExportIRModule;
+	errorUnless(parseTestModule(UINTPTR_MAX, false, originalIRModule));
+	errorUnless(parseTestModule(20, false, editedIRModule));
+	errorUnless(parseTestModule(20, true, extraExportIRModule));
+
+	// Compiling without previous object code compiles the whole module, and writes a manifest with
+	// an entry for each partition.
+	std::vector<U8> originalManifest;
+	GCPointer<Runtime::Module> originalModule
+		= compileModuleIncrementally(originalIRModule, {}, {}, originalManifest);
+	errorUnless(originalManifest.size()
+				== numManifestHeaderBytes + numTestPartitions * numManifestPartitionBytes);
+	const std::vector<U8> originalObjectCode = getObjectCode(originalModule);
+	checkResults(originalModule, UINTPTR_MAX, 0);
+
+	// Editing a function only changes the key of the partition that contains it.
+	std::vector<U8> editedManifest;
+	GCPointer<Runtime::Module> editedModule = compileModuleIncrementally(
+		editedIRModule, originalObjectCode, originalManifest, editedManifest);
+	errorUnless(editedManifest.size() == originalManifest.size());
+	errorUnless(isManifestPartitionEqual(originalManifest, editedManifest, 0));
+	errorUnless(!isManifestPartitionEqual(originalManifest, editedManifest, 1));
+	errorUnless(isManifestPartitionEqual(originalManifest, editedManifest, 2));
+	checkResults(editedModule, 20, 1000);
+
+	// The object code of partitions with matching keys is reused instead of being recompiled:
+	// pairing the original object code with the edited module's manifest makes all the partitions
+	// match, so the edited function keeps its original code.
+	std::vector<U8> staleManifest;
+	GCPointer<Runtime::Module> staleModule = compileModuleIncrementally(
+		editedIRModule, originalObjectCode, editedManifest, staleManifest);
+	errorUnless(staleManifest == editedManifest);
+	checkResults(staleModule, 20, 20);
+
+	// Changing the module's declarations changes the key of every partition.
+	std::vector<U8> extraExportManifest;
+	GCPointer<Runtime::Module> extraExportModule = compileModuleIncrementally(
+		extraExportIRModule, getObjectCode(editedModule), editedManifest, extraExportManifest);
+	errorUnless(extraExportManifest.size() == editedManifest.size());
+	for(Uptr partitionIndex = 0; partitionIndex < numTestPartitions; ++partitionIndex)
+	{ errorUnless(!isManifestPartitionEqual(editedManifest, extraExportManifest, partitionIndex)); }
+	checkResults(extraExportModule, 20, 1000);
+
+	// An invalid manifest is ignored, and the whole module is compiled.
+	std::vector<U8> recompiledManifest;
+	GCPointer<Runtime::Module> recompiledModule = compileModuleIncrementally(
+		editedIRModule, originalObjectCode, {0xff, 0xff, 0xff}, recompiledManifest);
+	errorUnless(recompiledManifest == editedManifest);
+	checkResults(recompiledModule, 20, 1000);
+
+	// Lazily compiled modules are compiled as a whole, and have an empty manifest.
+	CompileOptions lazyCompileOptions;
+	lazyCompileOptions.lazyCompile = true;
+	std::vector<U8> lazyManifest;
+	GCPointer<Runtime::Module> lazyModule = compileModuleIncrementally(
+		editedIRModule, originalObjectCode, originalManifest, lazyManifest, lazyCompileOptions);
+	errorUnless(!lazyManifest.size());
+	checkResults(lazyModule, 20, 1000);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testIncrementalCompile();
+	Timing::logTimer("IncrementalCompileTest", timer);
+	return 0;
+}
@@ -0,0 +1,290 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/FunctionRef.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static const char testWAST[]
+	= "(module\n"
+	  "  (func (export \"div\") (param i32 i32) (result i32)\n"
+	  "    (i32.div_s (get_local 0) (get_local 1))\n"
+	  "  )\n"
+	  "  (func (export \"mix\") (param i32 f64 i32 i64) (result f64)\n"
+	  "    (f64.add (f64.mul (f64.convert_s/i32 (get_local 0)) (get_local 1))\n"
+	  "             (f64.convert_s/i64 (i64.sub (get_local 3) (i64.extend_s/i32 (get_local 2)))))\n"
+	  "  )\n"
+	  "  (func (export \"truncate\") (param f32) (result i64) (i64.trunc_s/f32 (get_local 0)))\n"
+	  "  (func (export \"divrem\") (param i64 i32) (result i32 i64)\n"
+	  "    (i32.rem_s (i32.wrap/i64 (get_local 0)) (get_local 1))\n"
+	  "    (i64.div_s (get_local 0) (i64.extend_s/i32 (get_local 1)))\n"
+	  "  )\n"
+	  ")\n";
+
+// Calls a thunk, and returns the type of the runtime exception it threw, or nullptr if it didn't
+// throw one.
+static ExceptionTypeInstance* getThrownExceptionType(FunctionRef<void()> thunk)
+{
+	ExceptionTypeInstance* exceptionType = nullptr;
+	catchRuntimeExceptions(thunk,
+						   [&](Exception&& exception) { exceptionType = exception.typeInstance; });
+	return exceptionType;
+}
+
+// The result of invoking a function with invokeFunctionChecked, which the other ways of invoking
+// it are compared against.
+struct ExpectedResult
+{
+	ExceptionTypeInstance* exceptionType = nullptr;
+	Value value;
+};
+
+static ExpectedResult invokeChecked(Context* context,
+									FunctionInstance* function,
+									const std::vector<Value>& arguments)
+{
+	ExpectedResult expected;
+	expected.exceptionType = getThrownExceptionType([&] {
+		const ValueTuple results = invokeFunctionChecked(context, function, arguments);
+		errorUnless(results.size() == 1);
+		expected.value = results[0];
+	});
+	return expected;
+}
+
+static bool isSameResult(const ExpectedResult& expected, const UntaggedValue& result)
+{
+	return !memcmp(expected.value.bytes, result.bytes, getTypeByteWidth(expected.value.type));
+}
+
+static FunctionInstance* getExportedFunction(ModuleInstance* moduleInstance, const char* name)
+{
+	FunctionInstance* function = asFunctionNullable(getInstanceExport(moduleInstance, name));
+	errorUnless(function);
+	return function;
+}
+
+static const std::vector<std::vector<Value>> divArguments = {
+	{I32(7), I32(2)},
+	{I32(-7), I32(2)},
+	{I32(1), I32(0)},
+	{I32(INT32_MIN), I32(-1)},
+	{I32(INT32_MIN), I32(1)},
+};
+
+static const std::vector<std::vector<Value>> mixArguments = {
+	{I32(3), F64(0.5), I32(1), I64(10)},
+	{I32(-2), F64(-1.25), I32(-5), I64(INT64_MIN / 2)},
+};
+
+static const std::vector<std::vector<Value>> truncateArguments = {
+	{F32(-3.75f)},
+	{F32(1.0e30f)},
+};
+
+// Invoking a function with invokePrepared must return the same results, and throw the same
+// exceptions, as invokeFunctionChecked.
+static void testPreparedInvoke(Context* context, ModuleInstance* moduleInstance)
+{
+	const std::pair<const char*, const std::vector<std::vector<Value>>*> functions[] = {
+		{"div", &divArguments},
+		{"mix", &mixArguments},
+		{"truncate", &truncateArguments},
+	};
+	for(const auto& functionArguments : functions)
+	{
+		FunctionInstance* function = getExportedFunction(moduleInstance, functionArguments.first);
+		const PreparedInvoke preparedInvoke = prepareInvoke(context, function);
+		errorUnless(preparedInvoke.function == function);
+		errorUnless(preparedInvoke.functionType == getFunctionType(function));
+
+		for(const std::vector<Value>& arguments : *functionArguments.second)
+		{
+			const ExpectedResult expected = invokeChecked(context, function, arguments);
+
+			std::vector<UntaggedValue> untaggedArguments(arguments.begin(), arguments.end());
+			UntaggedValue result;
+			ExceptionTypeInstance* exceptionType = getThrownExceptionType(
+				[&] { result = *invokePrepared(preparedInvoke, untaggedArguments.data()); });
+
+			errorUnless(exceptionType == expected.exceptionType);
+			errorUnless(exceptionType || isSameResult(expected, result));
+		}
+	}
+}
+
+// Invoking a function with TypedInvoke must return the same results, and throw the same
+// exceptions, as invokeFunctionChecked.
+static void testTypedInvoke(Context* context, ModuleInstance* moduleInstance)
+{
+	FunctionInstance* divFunction = getExportedFunction(moduleInstance, "div");
+	const TypedInvoke<I32(I32, I32)> div(context, divFunction);
+	for(const std::vector<Value>& arguments : divArguments)
+	{
+		const ExpectedResult expected = invokeChecked(context, divFunction, arguments);
+		I32 result = 0;
+		const I32 dividend = arguments[0].i32;
+		const I32 divisor = arguments[1].i32;
+		errorUnless(getThrownExceptionType([&] { result = div(dividend, divisor); })
+					== expected.exceptionType);
+		errorUnless(expected.exceptionType || result == expected.value.i32);
+	}
+
+	FunctionInstance* mixFunction = getExportedFunction(moduleInstance, "mix");
+	const TypedInvoke<F64(I32, F64, I32, I64)> mix(context, mixFunction);
+	for(const std::vector<Value>& arguments : mixArguments)
+	{
+		const ExpectedResult expected = invokeChecked(context, mixFunction, arguments);
+		errorUnless(!expected.exceptionType);
+		const F64 result
+			= mix(arguments[0].i32, arguments[1].f64, arguments[2].i32, arguments[3].i64);
+		errorUnless(!memcmp(&result, &expected.value.f64, sizeof(F64)));
+	}
+
+	FunctionInstance* truncateFunction = getExportedFunction(moduleInstance, "truncate");
+	const TypedInvoke<I64(F32)> truncate(context, truncateFunction);
+	for(const std::vector<Value>& arguments : truncateArguments)
+	{
+		const ExpectedResult expected = invokeChecked(context, truncateFunction, arguments);
+		I64 result = 0;
+		errorUnless(getThrownExceptionType([&] { result = truncate(arguments[0].f32); })
+					== expected.exceptionType);
+		errorUnless(expected.exceptionType || result == expected.value.i64);
+	}
+
+	// Constructing a TypedInvoke with a signature that doesn't match the function's type throws.
+	errorUnless(getThrownExceptionType([&] { TypedInvoke<I32(I32)> wrong(context, divFunction); })
+				== Exception::invokeSignatureMismatchType);
+	errorUnless(
+		getThrownExceptionType([&] { TypedInvoke<I64(I32, I32)> wrong(context, divFunction); })
+		== Exception::invokeSignatureMismatchType);
+}
+
+static const std::vector<std::vector<Value>> divremArguments = {
+	{I64(-100), I32(7)},
+	{I64(0x100000005), I32(0)},
+	{I64(INT64_MAX), I32(-3)},
+	{I64(INT64_MIN), I32(-1)},
+	{I64(12), I32(5)},
+};
+
+// Invoking a function with invokeFunctionBatch must return the same results, and trap on the same
+// invokes with the same exceptions, as invoking it with invokeFunctionChecked for each tuple of
+// arguments.
+static void testInvokeBatch(Context* context,
+							ModuleInstance* moduleInstance,
+							const char* exportName,
+							const std::vector<std::vector<Value>>& argumentTuples)
+{
+	FunctionInstance* function = getExportedFunction(moduleInstance, exportName);
+	const FunctionType functionType = getFunctionType(function);
+	const Uptr numParams = functionType.params().size();
+	const Uptr numResults = functionType.results().size();
+
+	std::vector<UntaggedValue> arguments;
+	for(const std::vector<Value>& argumentTuple : argumentTuples)
+	{
+		errorUnless(argumentTuple.size() == numParams);
+		arguments.insert(arguments.end(), argumentTuple.begin(), argumentTuple.end());
+	}
+
+	// Fill the results with a value that the batch must overwrite, including for trapped invokes.
+	UntaggedValue garbage;
+	memset(garbage.bytes, 0xcc, sizeof(garbage.bytes));
+	std::vector<UntaggedValue> results(argumentTuples.size() * numResults, garbage);
+
+	std::vector<ExceptionTypeInstance*> trapExceptionTypes(argumentTuples.size(), nullptr);
+	Uptr numTrapHandlerCalls = 0;
+	Uptr lastTrapInvokeIndex = UINTPTR_MAX;
+	const Uptr numTraps = invokeFunctionBatch(
+		context,
+		function,
+		argumentTuples.size(),
+		arguments.data(),
+		results.data(),
+		[&](Uptr invokeIndex, Exception&& exception) {
+			// The trapped invokes are reported once each, in order.
+			errorUnless(invokeIndex < argumentTuples.size());
+			errorUnless(lastTrapInvokeIndex == UINTPTR_MAX || invokeIndex > lastTrapInvokeIndex);
+			lastTrapInvokeIndex = invokeIndex;
+			trapExceptionTypes[invokeIndex] = exception.typeInstance;
+			++numTrapHandlerCalls;
+		});
+	errorUnless(numTraps == numTrapHandlerCalls);
+
+	Uptr numExpectedTraps = 0;
+	for(Uptr invokeIndex = 0; invokeIndex < argumentTuples.size(); ++invokeIndex)
+	{
+		ValueTuple expectedResults;
+		ExceptionTypeInstance* expectedExceptionType = getThrownExceptionType([&] {
+			expectedResults
+				= invokeFunctionChecked(context, function, argumentTuples[invokeIndex]);
+		});
+		errorUnless(trapExceptionTypes[invokeIndex] == expectedExceptionType);
+
+		const UntaggedValue* invokeResults = results.data() + invokeIndex * numResults;
+		for(Uptr resultIndex = 0; resultIndex < numResults; ++resultIndex)
+		{
+			// The results of a trapped invoke are zeroed.
+			const UntaggedValue& result = invokeResults[resultIndex];
+			if(expectedExceptionType)
+			{ errorUnless(!memcmp(result.bytes, UntaggedValue().bytes, sizeof(result.bytes))); }
+			else
+			{
+				const Value& expectedResult = expectedResults[resultIndex];
+				errorUnless(!memcmp(result.bytes,
+									expectedResult.bytes,
+									getTypeByteWidth(functionType.results()[resultIndex])));
+			}
+		}
+
+		if(expectedExceptionType) { ++numExpectedTraps; }
+	}
+	errorUnless(numTraps == numExpectedTraps);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("InvokeTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, compileModule(irModule), {}, "InvokeTest");
+
+		testPreparedInvoke(context, moduleInstance);
+		testTypedInvoke(context, moduleInstance);
+		testInvokeBatch(context, moduleInstance, "div", divArguments);
+		testInvokeBatch(context, moduleInstance, "mix", mixArguments);
+		testInvokeBatch(context, moduleInstance, "truncate", truncateArguments);
+		testInvokeBatch(context, moduleInstance, "divrem", divremArguments);
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+
+	Timing::logTimer("InvokeTest", timer);
+	return 0;
+}
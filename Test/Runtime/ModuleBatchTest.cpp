@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static const char hostWAST[] = "(module (func (export \"seven\") (result i32) (i32.const 7)))";
+
+// The modules in the batch, listed so that each module's dependencies follow it.
+static const std::pair<const char*, const char*> batchWASTs[] = {
+	{"top",
+	 "(module\n"
+	 "  (import \"mid\" \"twice\" (func $twice (result i32)))\n"
+	 "  (import \"env\" \"seven\" (func $seven (result i32)))\n"
+	 "  (func (export \"get\") (result i32) (i32.add (call $twice) (call $seven)))\n"
+	 ")\n"},
+	{"mid",
+	 "(module\n"
+	 "  (import \"base\" \"get\" (func $get (result i32)))\n"
+	 "  (func (export \"twice\") (result i32) (i32.mul (call $get) (i32.const 2)))\n"
+	 ")\n"},
+	{"base",
+	 "(module\n"
+	 "  (global $value (mut i32) (i32.const 0))\n"
+	 "  (func $start (set_global $value (i32.const 42)))\n"
+	 "  (start $start)\n"
+	 "  (func (export \"get\") (result i32) (get_global $value))\n"
+	 ")\n"},
+	{"independent", "(module (func (export \"get\") (result i32) (i32.const 1)))"},
+	{"missingImport",
+	 "(module\n"
+	 "  (import \"env\" \"eight\" (func (result i32)))\n"
+	 "  (func (export \"get\") (result i32) (i32.const 2))\n"
+	 ")\n"},
+	{"importsMissingImport",
+	 "(module\n"
+	 "  (import \"missingImport\" \"get\" (func (result i32)))\n"
+	 "  (func (export \"get\") (result i32) (i32.const 3))\n"
+	 ")\n"},
+	{"trappingStart",
+	 "(module\n"
+	 "  (func $start (unreachable))\n"
+	 "  (start $start)\n"
+	 "  (func (export \"get\") (result i32) (i32.const 4))\n"
+	 ")\n"},
+	{"cycleA",
+	 "(module\n"
+	 "  (import \"cycleB\" \"get\" (func (result i32)))\n"
+	 "  (func (export \"get\") (result i32) (i32.const 5))\n"
+	 ")\n"},
+	{"cycleB",
+	 "(module\n"
+	 "  (import \"cycleA\" \"get\" (func (result i32)))\n"
+	 "  (func (export \"get\") (result i32) (i32.const 6))\n"
+	 ")\n"},
+};
+
+// The modules that must be instantiated, and the results of calling their "get" exports.
+static const std::pair<const char*, I32> expectedResults[] = {
+	{"top", 91},
+	{"mid", 84},
+	{"base", 42},
+	{"independent", 1},
+};
+
+// Resolves the env module's imports to the host module's exports, and checks that it's never
+// called concurrently.
+struct EnvResolver : Resolver
+{
+	EnvResolver(const IR::Module& hostIRModule, ModuleInstance* hostInstance)
+	: hostResolver(hostIRModule, hostInstance)
+	{
+	}
+
+	bool resolve(const std::string& moduleName,
+				 const std::string& exportName,
+				 IR::ObjectType type,
+				 Object*& outObject) override
+	{
+		errorUnless(numActiveResolves.fetch_add(1) == 0);
+		const bool resolved
+			= moduleName == "env" && hostResolver.resolve(moduleName, exportName, type, outObject);
+		numActiveResolves.fetch_sub(1);
+		return resolved;
+	}
+
+private:
+	ModuleExportResolver hostResolver;
+	std::atomic<Uptr> numActiveResolves{0};
+};
+
+static void parseModule(const char* wast, IR::Module& outIRModule)
+{
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(wast, strlen(wast) + 1, outIRModule, parseErrors))
+	{
+		WAST::reportParseErrors("ModuleBatchTest", parseErrors);
+		Errors::fatal("Failed to parse a test module");
+	}
+}
+
+static I32 invokeGet(Context* context, ModuleInstance* moduleInstance)
+{
+	FunctionInstance* function = asFunctionNullable(getInstanceExport(moduleInstance, "get"));
+	errorUnless(function);
+	const ValueTuple results = invokeFunctionChecked(context, function, {});
+	errorUnless(results.size() == 1 && results[0].type == ValueType::i32);
+	return results[0].i32;
+}
+
+// Instantiates the batch, either from IR modules or from modules compiled by the caller, on a
+// number of threads, and checks which modules were instantiated and that they were linked to each
+// other.
+static void testBatch(const std::vector<IR::Module>& irModules, bool precompile, Uptr numThreads)
+{
+	IR::Module hostIRModule;
+	parseModule(hostWAST, hostIRModule);
+
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> hostInstance
+			= instantiateModule(compartment, compileModule(hostIRModule), {}, "host");
+		EnvResolver resolver(hostIRModule, hostInstance);
+
+		std::vector<GCPointer<Runtime::Module>> modules;
+		std::vector<BatchModule> batchModules;
+		for(Uptr moduleIndex = 0; moduleIndex < irModules.size(); ++moduleIndex)
+		{
+			BatchModule batchModule;
+			batchModule.name = batchWASTs[moduleIndex].first;
+			if(precompile)
+			{
+				modules.push_back(compileModule(irModules[moduleIndex]));
+				batchModule.module = modules.back();
+			}
+			else
+			{
+				batchModule.irModule = &irModules[moduleIndex];
+			}
+			batchModules.push_back(std::move(batchModule));
+		}
+
+		std::vector<BatchModuleResult> results;
+		errorUnless(!instantiateModuleBatch(
+			compartment, batchModules, resolver, results, CompileOptions(), numThreads));
+		errorUnless(results.size() == batchModules.size());
+
+		// Root the instances before anything else is allocated in the compartment.
+		std::vector<GCPointer<ModuleInstance>> instances;
+		for(const BatchModuleResult& result : results)
+		{ instances.push_back(result.moduleInstance); }
+
+		for(Uptr moduleIndex = 0; moduleIndex < results.size(); ++moduleIndex)
+		{
+			const std::string moduleName = batchWASTs[moduleIndex].first;
+			const BatchModuleResult& result = results[moduleIndex];
+
+			const I32* expectedResult = nullptr;
+			for(const auto& expected : expectedResults)
+			{
+				if(moduleName == expected.first) { expectedResult = &expected.second; }
+			}
+
+			if(expectedResult)
+			{
+				errorUnless(result.moduleInstance && result.error.empty());
+				errorUnless(invokeGet(context, result.moduleInstance) == *expectedResult);
+			}
+			else
+			{
+				errorUnless(!result.moduleInstance && !result.error.empty());
+			}
+
+			// Only the module with an import that the resolver can't resolve reports it.
+			errorUnless(result.missingImports.size() == (moduleName == "missingImport" ? 1 : 0));
+		}
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	std::vector<IR::Module> irModules(sizeof(batchWASTs) / sizeof(batchWASTs[0]));
+	for(Uptr moduleIndex = 0; moduleIndex < irModules.size(); ++moduleIndex)
+	{ parseModule(batchWASTs[moduleIndex].second, irModules[moduleIndex]); }
+
+	for(Uptr numThreads : {Uptr(1), Uptr(4), Uptr(0)})
+	{
+		testBatch(irModules, false, numThreads);
+		testBatch(irModules, true, numThreads);
+	}
+
+	Timing::logTimer("ModuleBatchTest", timer);
+	return 0;
+}
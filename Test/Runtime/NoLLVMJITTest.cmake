@@ -0,0 +1,5 @@
+# Runs NoLLVMJITTest, which must fail with a fatal error that says WAVM was built without LLVMJIT.
+execute_process(COMMAND ${TEST_EXECUTABLE} RESULT_VARIABLE result ERROR_VARIABLE errors)
+if(result EQUAL 0 OR NOT errors MATCHES "WAVM_ENABLE_LLVMJIT=OFF")
+	message(FATAL_ERROR "NoLLVMJITTest didn't fail with the expected error (${result}):\n${errors}")
+endif()
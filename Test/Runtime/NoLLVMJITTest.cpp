@@ -0,0 +1,24 @@
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// A runtime built with WAVM_ENABLE_LLVMJIT=OFF can't generate the thunks for the intrinsics a
+// compartment instantiates, or load object code, so running a precompiled module must fail with a
+// fatal error that says why. NoLLVMJITTest.cmake checks that the error is printed.
+I32 main()
+{
+	IR::Module irModule;
+	GCPointer<Runtime::Module> module = loadPrecompiledModule(irModule, std::vector<U8>());
+	GCPointer<Compartment> compartment = createCompartment();
+	instantiateModule(compartment, module, {}, "NoLLVMJITTest");
+
+	Log::printf(Log::error, "Instantiating a module without LLVMJIT didn't fail.\n");
+	return 1;
+}
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/FunctionRef.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// run calls classify and an element of the table for each i in [0, n), and returns the sum of the
+// results. The branches in classify and the call_indirect are skewed, so the profile has hot and
+// cold paths.
+static const char testWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (table 2 anyfunc)\n"
+	  "  (elem (i32.const 0) $double $triple)\n"
+	  "  (func $double (param $x i32) (result i32) (i32.shl (get_local $x) (i32.const 1)))\n"
+	  "  (func $triple (param $x i32) (result i32) (i32.mul (get_local $x) (i32.const 3)))\n"
+	  "  (func $classify (param $x i32) (result i32)\n"
+	  "    (if (result i32) (i32.lt_u (i32.rem_u (get_local $x) (i32.const 10)) (i32.const 9))\n"
+	  "      (then (i32.const 1))\n"
+	  "      (else (i32.const 100))\n"
+	  "    )\n"
+	  "  )\n"
+	  "  (func $run (export \"run\") (param $n i32) (param $calleeModulus i32) (result i32)\n"
+	  "    (local $i i32)\n"
+	  "    (local $sum i32)\n"
+	  "    (block $done\n"
+	  "      (loop $continue\n"
+	  "        (br_if $done (i32.ge_u (get_local $i) (get_local $n)))\n"
+	  "        (set_local $sum (i32.add (get_local $sum) (call $classify (get_local $i))))\n"
+	  "        (set_local $sum\n"
+	  "          (i32.add (get_local $sum)\n"
+	  "                   (call_indirect (type $i32_to_i32)\n"
+	  "                                  (get_local $i)\n"
+	  "                                  (i32.eqz (i32.rem_u (get_local $i)\n"
+	  "                                                      (get_local $calleeModulus))))))\n"
+	  "        (set_local $i (i32.add (get_local $i) (i32.const 1)))\n"
+	  "        (br $continue)\n"
+	  "      )\n"
+	  "    )\n"
+	  "    (get_local $sum)\n"
+	  "  )\n"
+	  "  (func $callTable (export \"callTable\") (param $index i32) (param $x i32) (result i32)\n"
+	  "    (call_indirect (type $i32_to_i32) (get_local $x) (get_local $index))\n"
+	  "  )\n"
+	  ")\n";
+
+struct InvokeResult
+{
+	ExceptionTypeInstance* exceptionType = nullptr;
+	I32 value = 0;
+};
+
+static InvokeResult invokeExport(Context* context,
+								 ModuleInstance* moduleInstance,
+								 const char* exportName,
+								 const std::vector<Value>& arguments)
+{
+	FunctionInstance* function = asFunctionNullable(getInstanceExport(moduleInstance, exportName));
+	errorUnless(function);
+
+	InvokeResult result;
+	catchRuntimeExceptions(
+		[&] {
+			const ValueTuple results = invokeFunctionChecked(context, function, arguments);
+			errorUnless(results.size() == 1 && results[0].type == ValueType::i32);
+			result.value = results[0].i32;
+		},
+		[&](Exception&& exception) { result.exceptionType = exception.typeInstance; });
+	return result;
+}
+
+static const std::vector<std::vector<Value>> runArguments = {
+	{I32(1000), I32(1000)},
+	{I32(1000), I32(2)},
+	{I32(37), I32(1)},
+};
+
+static const std::vector<std::vector<Value>> callTableArguments = {
+	{I32(0), I32(21)},
+	{I32(1), I32(21)},
+	{I32(2), I32(21)},
+};
+
+// Calls the module's exports with each of the test arguments, and checks that the results and
+// traps are the same as those of the uninstrumented module.
+static void testModuleBehavior(Runtime::Module* module, Runtime::Module* referenceModule)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, module, {}, "ProfileTest");
+		GCPointer<ModuleInstance> referenceInstance
+			= instantiateModule(compartment, referenceModule, {}, "ProfileTestReference");
+
+		auto testExport = [&](const char* exportName,
+							  const std::vector<std::vector<Value>>& argumentTuples) {
+			for(const std::vector<Value>& arguments : argumentTuples)
+			{
+				const InvokeResult result
+					= invokeExport(context, moduleInstance, exportName, arguments);
+				const InvokeResult expected
+					= invokeExport(context, referenceInstance, exportName, arguments);
+				errorUnless(result.exceptionType == expected.exceptionType);
+				errorUnless(result.exceptionType || result.value == expected.value);
+			}
+		};
+		testExport("run", runArguments);
+		testExport("callTable", callTableArguments);
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+static const FunctionProfile* findFunctionProfile(const std::vector<FunctionProfile>& profiles,
+												  const char* name)
+{
+	for(const FunctionProfile& profile : profiles)
+	{
+		if(profile.name == name) { return &profile; }
+	}
+	return nullptr;
+}
+
+// Collects a profile from two instances of an instrumented module, and checks the counts.
+static std::vector<U8> collectProfile(const IR::Module& irModule, bool profileCycles)
+{
+	CompileOptions instrumentedOptions;
+	instrumentedOptions.profileInstrumentation = true;
+	instrumentedOptions.profileCycles = profileCycles;
+	GCPointer<Runtime::Module> module = compileModule(irModule, instrumentedOptions);
+
+	std::vector<U8> profile;
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> instances[2] = {
+			instantiateModule(compartment, module, {}, "ProfileTest0"),
+			instantiateModule(compartment, module, {}, "ProfileTest1"),
+		};
+		errorUnless(!invokeExport(context, instances[0], "run", {I32(30), I32(10)}).exceptionType);
+		errorUnless(!invokeExport(context, instances[1], "run", {I32(20), I32(10)}).exceptionType);
+
+		// A trapping call is still counted.
+		errorUnless(invokeExport(context, instances[1], "callTable", {I32(5), I32(0)}).exceptionType
+					== Exception::tableIndexOutOfBoundsType);
+
+		// The profile is shared by the module's instances.
+		for(ModuleInstance* instance : instances)
+		{
+			const std::vector<FunctionProfile> functionProfiles = getFunctionProfiles(instance);
+			errorUnless(functionProfiles.size() == irModule.functions.defs.size());
+
+			const FunctionProfile* classify = findFunctionProfile(functionProfiles, "classify");
+			const FunctionProfile* doubleProfile = findFunctionProfile(functionProfiles, "double");
+			const FunctionProfile* triple = findFunctionProfile(functionProfiles, "triple");
+			const FunctionProfile* run = findFunctionProfile(functionProfiles, "run");
+			const FunctionProfile* callTable = findFunctionProfile(functionProfiles, "callTable");
+			errorUnless(classify && doubleProfile && triple && run && callTable);
+			errorUnless(classify->numCalls == 50);
+			errorUnless(triple->numCalls == 5);
+			errorUnless(doubleProfile->numCalls == 45);
+			errorUnless(run->numCalls == 2);
+			errorUnless(callTable->numCalls == 1);
+			errorUnless(!profileCycles || run->numCycles > 0);
+		}
+
+		profile = getModuleProfile(instances[0]);
+		errorUnless(profile.size());
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+
+	// Instrumented code must behave the same as the uninstrumented code.
+	testModuleBehavior(module, compileModule(irModule));
+	return profile;
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("ProfileTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+	GCPointer<Runtime::Module> referenceModule = compileModule(irModule);
+
+	const std::vector<U8> profile = collectProfile(irModule, false);
+	collectProfile(irModule, true);
+
+	// Code optimized with the profile must behave the same as the unoptimized code, on both the
+	// hot paths and the cold ones, such as calling a different function than the profiled
+	// call_indirect callee.
+	CompileOptions optimizedOptions;
+	optimizedOptions.profile = profile;
+	testModuleBehavior(compileModule(irModule, optimizedOptions), referenceModule);
+
+	// An invalid profile is ignored.
+	CompileOptions invalidProfileOptions;
+	invalidProfileOptions.profile = {0xff, 0xff, 0xff};
+	testModuleBehavior(compileModule(irModule, invalidProfileOptions), referenceModule);
+
+	Timing::logTimer("ProfileTest", timer);
+	return 0;
+}
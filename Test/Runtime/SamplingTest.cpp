@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// run calls outer, which calls inner, which spins for a number of iterations. The calls are
+// indirect so the functions aren't inlined into each other, and each iteration of the spin loop
+// depends on the previous one so the loop can't be folded away.
+static const char testWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (table 2 anyfunc)\n"
+	  "  (elem (i32.const 0) $outer $inner)\n"
+	  "  (func $inner (param $n i32) (result i32)\n"
+	  "    (local $x i32)\n"
+	  "    (set_local $x (i32.const 1))\n"
+	  "    (block $done\n"
+	  "      (loop $spin\n"
+	  "        (br_if $done (i32.eqz (get_local $n)))\n"
+	  "        (set_local $x (i32.add (i32.mul (get_local $x) (i32.const 1664525))\n"
+	  "                               (i32.const 1013904223)))\n"
+	  "        (set_local $x (i32.xor (get_local $x) (i32.shr_u (get_local $x) (i32.const 7))))\n"
+	  "        (set_local $n (i32.sub (get_local $n) (i32.const 1)))\n"
+	  "        (br $spin)\n"
+	  "      )\n"
+	  "    )\n"
+	  "    (get_local $x)\n"
+	  "  )\n"
+	  "  (func $outer (param $n i32) (result i32)\n"
+	  "    (call_indirect (type $i32_to_i32) (get_local $n) (i32.const 1)))\n"
+	  "  (func $run (export \"run\") (param $n i32) (result i32)\n"
+	  "    (call_indirect (type $i32_to_i32) (get_local $n) (i32.const 0)))\n"
+	  ")\n";
+
+// Returns whether a sampled call stack ends with run calling outer calling inner.
+static bool isSpinCallStack(const SampledCallStack& callStack)
+{
+	const std::vector<std::string>& names = callStack.functionNames;
+	const Uptr numNames = names.size();
+	return numNames >= 3 && names[numNames - 3] == "SamplingTest!run"
+		   && names[numNames - 2] == "SamplingTest!outer"
+		   && names[numNames - 1] == "SamplingTest!inner";
+}
+
+static void testSampleCallStacks(Runtime::Module* module)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, module, {}, "SamplingTest");
+		FunctionInstance* run = asFunctionNullable(getInstanceExport(moduleInstance, "run"));
+		errorUnless(run);
+
+		errorUnless(startGuestCallStackSampling(1000));
+
+		// Spin until the spin loop's call stack has been sampled, or give up after 30 seconds.
+		Timing::Timer spinTimer;
+		U64 numDroppedSamples = 0;
+		U64 numSpinSamples = 0;
+		while(!numSpinSamples && spinTimer.getSeconds() < 30.0)
+		{
+			invokeFunctionChecked(context, run, {Value(I32(50000000))});
+			for(const SampledCallStack& callStack : getSampledGuestCallStacks(numDroppedSamples))
+			{
+				errorUnless(callStack.functionNames.size() && callStack.numSamples);
+				if(isSpinCallStack(callStack)) { numSpinSamples += callStack.numSamples; }
+			}
+		}
+		stopGuestCallStackSampling();
+		errorUnless(numSpinSamples);
+
+		// Restarting sampling discards the call stacks sampled before.
+		errorUnless(startGuestCallStackSampling(1000));
+		stopGuestCallStackSampling();
+		errorUnless(!getSampledGuestCallStacks(numDroppedSamples).size());
+	}
+
+	// The module must stay loaded until sampling is stopped, so collect it only after that.
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("SamplingTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+
+	CompileOptions compileOptions;
+	compileOptions.framePointers = true;
+	GCPointer<Runtime::Module> module = compileModule(irModule, compileOptions);
+
+	// Sampling isn't supported on every platform, in which case there's nothing to test.
+	if(!startGuestCallStackSampling(1000))
+	{
+		Log::printf(Log::metrics, "Call stack sampling isn't supported on this platform.\n");
+		return 0;
+	}
+	stopGuestCallStackSampling();
+
+	testSampleCallStacks(module);
+
+	Timing::logTimer("SamplingTest", timer);
+	return 0;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// bump increments a counter in a mutable global and in memory. get calls the function at an index
+// in the table with the sum of the data segment's byte and the counter.
+static const char testWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (memory 1)\n"
+	  "  (data (i32.const 0) \"\\2a\")\n"
+	  "  (global $counter (mut i32) (i32.const 0))\n"
+	  "  (table 2 anyfunc)\n"
+	  "  (elem (i32.const 0) $double $triple)\n"
+	  "  (func $double (param $x i32) (result i32) (i32.mul (get_local $x) (i32.const 2)))\n"
+	  "  (func $triple (param $x i32) (result i32) (i32.mul (get_local $x) (i32.const 3)))\n"
+	  "  (func (export \"bump\") (result i32)\n"
+	  "    (set_global $counter (i32.add (get_global $counter) (i32.const 1)))\n"
+	  "    (i32.store (i32.const 4) (i32.add (i32.load (i32.const 4)) (i32.const 1)))\n"
+	  "    (get_global $counter)\n"
+	  "  )\n"
+	  "  (func (export \"get\") (param $index i32) (result i32)\n"
+	  "    (call_indirect (type $i32_to_i32)\n"
+	  "                   (i32.add (i32.load8_u (i32.const 0)) (i32.load (i32.const 4)))\n"
+	  "                   (get_local $index))\n"
+	  "  )\n"
+	  ")\n";
+
+static I32 invokeExport(Context* context,
+						ModuleInstance* moduleInstance,
+						const char* exportName,
+						const std::vector<Value>& arguments = {})
+{
+	FunctionInstance* function = asFunctionNullable(getInstanceExport(moduleInstance, exportName));
+	errorUnless(function);
+	const ValueTuple results = invokeFunctionChecked(context, function, arguments);
+	errorUnless(results.size() == 1 && results[0].type == ValueType::i32);
+	return results[0].i32;
+}
+
+// Instances created from a snapshot must have their own copy of the snapshotted instance's
+// functions, so they keep working after the snapshotted instance's compartment and the snapshot
+// are collected.
+static void testCollectSourceCompartment(Runtime::Module* module)
+{
+	GCPointer<Compartment> sourceCompartment = createCompartment();
+	GCPointer<Context> sourceContext = createContext(sourceCompartment);
+	GCPointer<ModuleInstance> sourceInstance
+		= instantiateModule(sourceCompartment, module, {}, "SnapshotTest");
+	errorUnless(invokeExport(sourceContext, sourceInstance, "bump") == 1);
+
+	ModuleInstanceSnapshot* snapshot = createModuleInstanceSnapshot(sourceInstance, sourceContext);
+
+	Compartment* cloneCompartmentPointer = nullptr;
+	Context* cloneContextPointer = nullptr;
+	GCPointer<ModuleInstance> cloneInstance = instantiateModuleFromSnapshot(
+		snapshot, cloneCompartmentPointer, cloneContextPointer);
+	GCPointer<Compartment> cloneCompartment = cloneCompartmentPointer;
+	GCPointer<Context> cloneContext = cloneContextPointer;
+
+	// Collect the snapshotted instance's compartment and the snapshot.
+	sourceInstance = nullptr;
+	sourceContext = nullptr;
+	errorUnless(tryCollectCompartment(std::move(sourceCompartment)));
+	deleteModuleInstanceSnapshot(snapshot);
+	collectGarbage();
+
+	// The clone has the snapshotted state, and calls its own functions through its table.
+	errorUnless(invokeExport(cloneContext, cloneInstance, "get", {Value(I32(0))}) == 86);
+	errorUnless(invokeExport(cloneContext, cloneInstance, "get", {Value(I32(1))}) == 129);
+	errorUnless(invokeExport(cloneContext, cloneInstance, "bump") == 2);
+	errorUnless(invokeExport(cloneContext, cloneInstance, "get", {Value(I32(0))}) == 88);
+
+	cloneInstance = nullptr;
+	cloneContext = nullptr;
+	errorUnless(tryCollectCompartment(std::move(cloneCompartment)));
+}
+
+// Instances created from the same snapshot must not share any mutable state.
+static void testCloneIndependence(Runtime::Module* module)
+{
+	GCPointer<Compartment> sourceCompartment = createCompartment();
+	GCPointer<Context> sourceContext = createContext(sourceCompartment);
+	GCPointer<ModuleInstance> sourceInstance
+		= instantiateModule(sourceCompartment, module, {}, "SnapshotTest");
+	ModuleInstanceSnapshot* snapshot = createModuleInstanceSnapshot(sourceInstance, sourceContext);
+
+	GCPointer<Compartment> cloneCompartments[2];
+	GCPointer<Context> cloneContexts[2];
+	GCPointer<ModuleInstance> cloneInstances[2];
+	for(Uptr cloneIndex = 0; cloneIndex < 2; ++cloneIndex)
+	{
+		Compartment* compartment = nullptr;
+		Context* context = nullptr;
+		cloneInstances[cloneIndex] = instantiateModuleFromSnapshot(snapshot, compartment, context);
+		cloneCompartments[cloneIndex] = compartment;
+		cloneContexts[cloneIndex] = context;
+	}
+	deleteModuleInstanceSnapshot(snapshot);
+
+	errorUnless(invokeExport(cloneContexts[0], cloneInstances[0], "bump") == 1);
+	errorUnless(invokeExport(cloneContexts[0], cloneInstances[0], "bump") == 2);
+	errorUnless(invokeExport(cloneContexts[1], cloneInstances[1], "bump") == 1);
+	errorUnless(invokeExport(sourceContext, sourceInstance, "get", {Value(I32(0))}) == 84);
+
+	for(Uptr cloneIndex = 0; cloneIndex < 2; ++cloneIndex)
+	{
+		cloneInstances[cloneIndex] = nullptr;
+		cloneContexts[cloneIndex] = nullptr;
+		errorUnless(tryCollectCompartment(std::move(cloneCompartments[cloneIndex])));
+	}
+	sourceInstance = nullptr;
+	sourceContext = nullptr;
+	errorUnless(tryCollectCompartment(std::move(sourceCompartment)));
+}
+
+// Instances loaded from a snapshot file must have the saved state, and must not write their
+// memory back to the file. Loading a file that isn't a snapshot of the module must fail.
+static void testSaveAndLoadSnapshotFile(Runtime::Module* module, const IR::Module& irModule)
+{
+	const std::string path = Platform::getCurrentWorkingDirectory() + "/SnapshotTest.snapshot";
+
+	GCPointer<Compartment> sourceCompartment = createCompartment();
+	GCPointer<Context> sourceContext = createContext(sourceCompartment);
+	GCPointer<ModuleInstance> sourceInstance
+		= instantiateModule(sourceCompartment, module, {}, "SnapshotTest");
+	errorUnless(invokeExport(sourceContext, sourceInstance, "bump") == 1);
+	errorUnless(invokeExport(sourceContext, sourceInstance, "bump") == 2);
+
+	Platform::File* file = Platform::openFile(
+		path, Platform::FileAccessMode::readWrite, Platform::FileCreateMode::createAlways);
+	errorUnless(file);
+	errorUnless(saveModuleInstanceSnapshot(module, sourceInstance, sourceContext, file));
+	errorUnless(Platform::closeFile(file));
+
+	sourceInstance = nullptr;
+	sourceContext = nullptr;
+	errorUnless(tryCollectCompartment(std::move(sourceCompartment)));
+
+	// Load the snapshot twice: the second load must not see the first instance's writes.
+	for(Uptr loadIndex = 0; loadIndex < 2; ++loadIndex)
+	{
+		file = Platform::openFile(
+			path, Platform::FileAccessMode::readOnly, Platform::FileCreateMode::openExisting);
+		errorUnless(file);
+
+		GCPointer<Compartment> compartment = createCompartment();
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= loadModuleInstanceSnapshot(compartment, context, irModule, file, {}, "SnapshotTest");
+		errorUnless(Platform::closeFile(file));
+		errorUnless(moduleInstance);
+
+		errorUnless(invokeExport(context, moduleInstance, "get", {Value(I32(0))}) == 88);
+		errorUnless(invokeExport(context, moduleInstance, "get", {Value(I32(1))}) == 132);
+		errorUnless(invokeExport(context, moduleInstance, "bump") == 3);
+		errorUnless(invokeExport(context, moduleInstance, "get", {Value(I32(0))}) == 90);
+
+		moduleInstance = nullptr;
+		context = nullptr;
+		errorUnless(tryCollectCompartment(std::move(compartment)));
+	}
+
+	// Loading the snapshot for a different module must fail.
+	IR::Module emptyIRModule;
+	file = Platform::openFile(
+		path, Platform::FileAccessMode::readOnly, Platform::FileCreateMode::openExisting);
+	errorUnless(file);
+	{
+		GCPointer<Compartment> compartment = createCompartment();
+		GCPointer<Context> context = createContext(compartment);
+		errorUnless(!loadModuleInstanceSnapshot(
+			compartment, context, emptyIRModule, file, {}, "SnapshotTest"));
+		context = nullptr;
+		errorUnless(tryCollectCompartment(std::move(compartment)));
+	}
+	errorUnless(Platform::closeFile(file));
+
+	// Loading a truncated snapshot must fail.
+	file = Platform::openFile(
+		path, Platform::FileAccessMode::readWrite, Platform::FileCreateMode::openExisting);
+	errorUnless(file);
+	U64 numFileBytes = 0;
+	errorUnless(Platform::getFileNumBytes(file, numFileBytes));
+	errorUnless(Platform::setFileNumBytes(file, numFileBytes / 2));
+	{
+		GCPointer<Compartment> compartment = createCompartment();
+		GCPointer<Context> context = createContext(compartment);
+		errorUnless(
+			!loadModuleInstanceSnapshot(compartment, context, irModule, file, {}, "SnapshotTest"));
+		context = nullptr;
+		errorUnless(tryCollectCompartment(std::move(compartment)));
+	}
+	errorUnless(Platform::closeFile(file));
+
+	errorUnless(remove(path.c_str()) == 0);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("SnapshotTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+	GCPointer<Runtime::Module> module = compileModule(irModule);
+
+	testCollectSourceCompartment(module);
+	testCloneIndependence(module);
+	testSaveAndLoadSnapshotFile(module, irModule);
+
+	Timing::logTimer("SnapshotTest", timer);
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/FunctionRef.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASM/WASM.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static const char testWAST[]
+	= "(module\n"
+	  "  (func $square (param $x i64) (result i64) (i64.mul (get_local $x) (get_local $x)))\n"
+	  "  (func (export \"sumOfSquares\") (param $n i64) (result i64)\n"
+	  "    (local $total i64)\n"
+	  "    (block $done\n"
+	  "      (loop $continue\n"
+	  "        (br_if $done (i64.eqz (get_local $n)))\n"
+	  "        (set_local $total (i64.add (get_local $total) (call $square (get_local $n))))\n"
+	  "        (set_local $n (i64.sub (get_local $n) (i64.const 1)))\n"
+	  "        (br $continue)\n"
+	  "      )\n"
+	  "    )\n"
+	  "    (get_local $total)\n"
+	  "  )\n"
+	  "  (func (export \"divide\") (param i32 i32) (result i32)\n"
+	  "    (i32.div_u (get_local 0) (get_local 1))\n"
+	  "  )\n"
+	  ")\n";
+
+static ExceptionTypeInstance* getThrownExceptionType(FunctionRef<void()> thunk)
+{
+	ExceptionTypeInstance* exceptionType = nullptr;
+	catchRuntimeExceptions(thunk,
+						   [&](Exception&& exception) { exceptionType = exception.typeInstance; });
+	return exceptionType;
+}
+
+// Calls the test module's exports in an instance of a compiled module, and checks the results.
+static void testCompiledModule(Runtime::Module* module)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<Context> context = createContext(compartment);
+		GCPointer<ModuleInstance> moduleInstance
+			= instantiateModule(compartment, module, {}, "StreamingCompileTest");
+
+		FunctionInstance* sumOfSquares
+			= asFunctionNullable(getInstanceExport(moduleInstance, "sumOfSquares"));
+		FunctionInstance* divide = asFunctionNullable(getInstanceExport(moduleInstance, "divide"));
+		errorUnless(sumOfSquares && divide);
+
+		ValueTuple results = invokeFunctionChecked(context, sumOfSquares, {Value(I64(100))});
+		errorUnless(results.size() == 1 && results[0].i64 == 338350);
+		results = invokeFunctionChecked(context, divide, {Value(I32(100)), Value(I32(7))});
+		errorUnless(results.size() == 1 && results[0].i32 == 14);
+		errorUnless(getThrownExceptionType([&] {
+						invokeFunctionChecked(context, divide, {Value(I32(1)), Value(I32(0))});
+					})
+					== Exception::integerDivideByZeroOrOverflowType);
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+// Compiles a binary module with a streaming compile that is fed chunks of numChunkBytes, and
+// checks that the compiled module behaves like one compiled from the whole binary.
+static void testStreamingCompile(const std::vector<U8>& wasmBytes,
+								 Uptr numChunkBytes,
+								 const CompileOptions& options)
+{
+	StreamingCompile* compile = beginStreamingCompile(FeatureSpec(), options);
+	for(Uptr offset = 0; offset < wasmBytes.size(); offset += numChunkBytes)
+	{
+		const Uptr numBytes = std::min(numChunkBytes, wasmBytes.size() - offset);
+		feedStreamingCompile(compile, wasmBytes.data() + offset, numBytes);
+	}
+
+	IR::Module irModule;
+	GCPointer<Runtime::Module> module = finishStreamingCompile(compile, irModule);
+	errorUnless(module);
+	errorUnless(irModule.functions.defs.size() == 3);
+	testCompiledModule(module);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("StreamingCompileTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+	testCompiledModule(compileModule(irModule));
+
+	Serialization::ArrayOutputStream stream;
+	WASM::serialize(stream, irModule);
+	const std::vector<U8> wasmBytes = stream.getBytes();
+
+	// Stream the binary in chunks that split its function bodies, and all at once, with the
+	// default options and with the options that defer compiling until the stream is finished.
+	CompileOptions lazyOptions;
+	lazyOptions.lazyCompile = true;
+	for(Uptr numChunkBytes : {Uptr(1), Uptr(5), wasmBytes.size()})
+	{
+		testStreamingCompile(wasmBytes, numChunkBytes, CompileOptions());
+		testStreamingCompile(wasmBytes, numChunkBytes, lazyOptions);
+	}
+
+	// A streaming compile of a truncated binary must fail.
+	StreamingCompile* compile = beginStreamingCompile(FeatureSpec());
+	feedStreamingCompile(compile, wasmBytes.data(), wasmBytes.size() - 1);
+	IR::Module truncatedIRModule;
+	errorUnless(!finishStreamingCompile(compile, truncatedIRModule));
+
+	Timing::logTimer("StreamingCompileTest", timer);
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Intrinsics.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Calls test.suspend the number of times given by its parameter, then returns the parameter.
+static const char testWAST[]
+	= "(module\n"
+	  "  (import \"test\" \"suspend\" (func $suspend))\n"
+	  "  (func (export \"run\") (param $numSuspends i32) (result i32)\n"
+	  "    (local $i i32)\n"
+	  "    (block $done\n"
+	  "      (loop $loop\n"
+	  "        (br_if $done (i32.eq (get_local $i) (get_local $numSuspends)))\n"
+	  "        (call $suspend)\n"
+	  "        (set_local $i (i32.add (get_local $i) (i32.const 1)))\n"
+	  "        (br $loop)\n"
+	  "      )\n"
+	  "    )\n"
+	  "    (get_local $numSuspends)\n"
+	  "  )\n"
+	  ")\n";
+
+// The number of test.suspend calls whose stack frame has been destroyed, by returning or by being
+// unwound.
+static Uptr numSuspendFramesDestroyed = 0;
+
+struct SuspendFrame
+{
+	~SuspendFrame() { ++numSuspendFramesDestroyed; }
+};
+
+DEFINE_INTRINSIC_MODULE(test)
+
+// Suspends the invoke while holding a GC root to the calling context on the invoke's stack.
+DEFINE_INTRINSIC_FUNCTION(test, "suspend", void, test_suspend)
+{
+	SuspendFrame frame;
+	GCPointer<Context> context = getContextFromRuntimeData(contextRuntimeData);
+	suspendInvoke();
+}
+
+// An instance of the test module in its own compartment.
+struct TestInstance
+{
+	GCPointer<Compartment> compartment;
+	GCPointer<Context> context;
+	GCPointer<FunctionInstance> run;
+
+	TestInstance(const IR::Module& irModule, Runtime::Module* module)
+	{
+		compartment = createCompartment();
+		context = createContext(compartment);
+
+		GCPointer<ModuleInstance> testIntrinsics
+			= Intrinsics::instantiateModule(compartment, INTRINSIC_MODULE_REF(test), "test");
+		const LinkPlan linkPlan = createLinkPlan(irModule, {{"test", testIntrinsics}});
+		errorUnless(linkPlan.success);
+		LinkResult linkResult = linkModule(irModule, linkPlan, {testIntrinsics});
+		errorUnless(linkResult.success);
+
+		ModuleInstance* moduleInstance = instantiateModule(
+			compartment, module, std::move(linkResult.resolvedImports), "SuspendableInvokeTest");
+		errorUnless(moduleInstance);
+		run = asFunctionNullable(getInstanceExport(moduleInstance, "run"));
+		errorUnless(run);
+	}
+
+	// Releases the instance's roots, and returns whether its compartment could be collected.
+	bool collect()
+	{
+		context = nullptr;
+		run = nullptr;
+		return tryCollectCompartment(std::move(compartment));
+	}
+};
+
+static SuspendableInvoke* createRunInvoke(TestInstance& instance, I32 numSuspends)
+{
+	return createSuspendableInvoke(instance.context, instance.run, {Value(numSuspends)});
+}
+
+static void testReturn(const IR::Module& irModule, Runtime::Module* module)
+{
+	TestInstance instance(irModule, module);
+	SuspendableInvoke* invoke = createRunInvoke(instance, 2);
+	errorUnless(resumeSuspendableInvoke(invoke) == SuspendableInvokeState::suspended);
+	errorUnless(resumeSuspendableInvoke(invoke) == SuspendableInvokeState::suspended);
+	errorUnless(resumeSuspendableInvoke(invoke) == SuspendableInvokeState::returned);
+	errorUnless(getSuspendableInvokeResults(invoke) == ValueTuple(Value(I32(2))));
+	deleteSuspendableInvoke(invoke);
+	errorUnless(instance.collect());
+}
+
+static void testDeleteUnstarted(const IR::Module& irModule, Runtime::Module* module)
+{
+	TestInstance instance(irModule, module);
+	deleteSuspendableInvoke(createRunInvoke(instance, 1));
+	errorUnless(instance.collect());
+}
+
+// Deleting an invoke that is suspended in the middle of running must unwind its stack, releasing
+// the GC root held by the suspended test.suspend call, so the compartment can be collected.
+static void testDeleteSuspended(const IR::Module& irModule, Runtime::Module* module)
+{
+	TestInstance instance(irModule, module);
+	SuspendableInvoke* invoke = createRunInvoke(instance, 3);
+
+	numSuspendFramesDestroyed = 0;
+	errorUnless(resumeSuspendableInvoke(invoke) == SuspendableInvokeState::suspended);
+	errorUnless(resumeSuspendableInvoke(invoke) == SuspendableInvokeState::suspended);
+	errorUnless(numSuspendFramesDestroyed == 1);
+
+	deleteSuspendableInvoke(invoke);
+	errorUnless(numSuspendFramesDestroyed == 2);
+	errorUnless(instance.collect());
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("SuspendableInvokeTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+	GCPointer<Runtime::Module> module = compileModule(irModule);
+
+	testReturn(irModule, module);
+	testDeleteUnstarted(irModule, module);
+	testDeleteSuspended(irModule, module);
+
+	Timing::logTimer("SuspendableInvokeTest", timer);
+	return 0;
+}
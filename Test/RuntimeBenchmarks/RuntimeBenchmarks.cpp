@@ -0,0 +1,439 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// The module that the benchmarks run. Each exported function loops over one operation, so the cost
+// of invoking it is amortized over many operations.
+static const char benchmarkWAST[]
+	= "(module\n"
+	  "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+	  "  (memory (export \"memory\") 1 65536 shared)\n"
+	  "  (table $table (export \"table\") 4 1048576 anyfunc)\n"
+	  "  (elem (i32.const 0) $increment $decrement $double $negate)\n"
+	  "\n"
+	  "  (func $increment (param $x i32) (result i32) (i32.add (get_local $x) (i32.const 1)))\n"
+	  "  (func $decrement (param $x i32) (result i32) (i32.sub (get_local $x) (i32.const 1)))\n"
+	  "  (func $double (param $x i32) (result i32) (i32.shl (get_local $x) (i32.const 1)))\n"
+	  "  (func $negate (param $x i32) (result i32) (i32.sub (i32.const 0) (get_local $x)))\n"
+	  "\n"
+	  "  (func (export \"identity\") (param $x i32) (result i32) (get_local $x))\n"
+	  "\n"
+	  "  (func (export \"trap\") (unreachable))\n"
+	  "\n"
+	  // Makes numCalls indirect calls, whose callee is selected by masking the call's index with
+	  // calleeMask: a mask of 0 always calls the same function, and 3 cycles between four.
+	  "  (func (export \"callIndirect\") (param $numCalls i32) (param $calleeMask i32)\n"
+	  "    (result i32)\n"
+	  "    (local $i i32) (local $sum i32)\n"
+	  "    (loop $loop\n"
+	  "      (set_local $sum (call_indirect (type $i32_to_i32)\n"
+	  "                                     (get_local $sum)\n"
+	  "                                     (i32.and (get_local $i) (get_local $calleeMask))))\n"
+	  "      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))\n"
+	  "                           (get_local $numCalls)))\n"
+	  "    )\n"
+	  "    (get_local $sum)\n"
+	  "  )\n"
+	  "\n"
+	  "  (func (export \"memoryGrow\") (param $numGrows i32)\n"
+	  "    (local $i i32)\n"
+	  "    (loop $loop\n"
+	  "      (if (i32.eq (memory.grow (i32.const 1)) (i32.const -1)) (then (unreachable)))\n"
+	  "      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))\n"
+	  "                           (get_local $numGrows)))\n"
+	  "    )\n"
+	  "  )\n"
+	  "\n"
+	  "  (func (export \"tableSet\") (param $numSets i32)\n"
+	  "    (local $i i32)\n"
+	  "    (loop $loop\n"
+	  "      (table.set $table (i32.and (get_local $i) (i32.const 3)) (ref.func $increment))\n"
+	  "      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))\n"
+	  "                           (get_local $numSets)))\n"
+	  "    )\n"
+	  "  )\n"
+	  "\n"
+	  // Passes the turn stored at address 0 back and forth with another thread numRoundTrips
+	  // times: waits until the turn is this thread's, then gives it to the other thread and wakes
+	  // it.
+	  "  (func (export \"pingPong\") (param $turn i32) (param $numRoundTrips i32)\n"
+	  "    (local $i i32)\n"
+	  "    (loop $loop\n"
+	  "      (block $ready\n"
+	  "        (loop $wait\n"
+	  "          (br_if $ready (i32.eq (i32.atomic.load (i32.const 0)) (get_local $turn)))\n"
+	  "          (drop (i32.atomic.wait (i32.const 0)\n"
+	  "                                 (i32.xor (get_local $turn) (i32.const 1))\n"
+	  "                                 (f64.const inf)))\n"
+	  "          (br $wait)\n"
+	  "        )\n"
+	  "      )\n"
+	  "      (i32.atomic.store (i32.const 0) (i32.xor (get_local $turn) (i32.const 1)))\n"
+	  "      (drop (atomic.wake (i32.const 0) (i32.const 1)))\n"
+	  "      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))\n"
+	  "                           (get_local $numRoundTrips)))\n"
+	  "    )\n"
+	  "  )\n"
+	  ")\n";
+
+// An instance of the benchmark module in its own compartment.
+struct BenchmarkInstance
+{
+	GCPointer<Compartment> compartment;
+	GCPointer<Context> context;
+	GCPointer<ModuleInstance> moduleInstance;
+
+	BenchmarkInstance(Runtime::Module* module)
+	{
+		compartment = createCompartment();
+		context = createContext(compartment);
+		moduleInstance = instantiateModule(compartment, module, {}, "RuntimeBenchmarks");
+		errorUnless(moduleInstance);
+	}
+
+	~BenchmarkInstance()
+	{
+		context = nullptr;
+		moduleInstance = nullptr;
+		errorUnless(tryCollectCompartment(std::move(compartment)));
+	}
+
+	FunctionInstance* getFunction(const char* name)
+	{
+		FunctionInstance* function = asFunctionNullable(getInstanceExport(moduleInstance, name));
+		errorUnless(function);
+		return function;
+	}
+};
+
+static void reportTime(const char* benchmarkName, Timing::Timer& timer, Uptr numOps)
+{
+	Log::printf(Log::error,
+				"%s: %.1f ns/op\n",
+				benchmarkName,
+				F64(timer.getMicroseconds()) * 1000.0 / F64(numOps));
+}
+
+// The number of threads that grow a memory concurrently in the memoryGrow benchmark, and the
+// number of pages each grows it by: all the threads together grow it to 1GiB.
+static constexpr Uptr numMemoryGrowThreads = 4;
+static constexpr Uptr numMemoryGrowsPerThread = 4096;
+
+// Invokes a function in a new thread.
+struct InvokeThread
+{
+	Context* context;
+	FunctionInstance* function;
+	std::vector<UntaggedValue> arguments;
+	Platform::Thread* thread = nullptr;
+
+	InvokeThread(Context* inContext,
+				 FunctionInstance* inFunction,
+				 std::vector<UntaggedValue>&& inArguments)
+	: context(inContext), function(inFunction), arguments(std::move(inArguments))
+	{
+	}
+
+	void start() { thread = Platform::createThread(1024 * 1024, threadEntry, this); }
+	void join() { Platform::joinThread(thread); }
+
+private:
+	static I64 threadEntry(void* argument)
+	{
+		InvokeThread* invokeThread = (InvokeThread*)argument;
+		invokeFunctionUnchecked(
+			invokeThread->context, invokeThread->function, invokeThread->arguments.data());
+		return 0;
+	}
+};
+
+// Round trips through invokeFunctionUnchecked to a function that returns its argument.
+static void benchmarkInvoke(Runtime::Module* module)
+{
+	static constexpr Uptr numInvokes = 1000000;
+	BenchmarkInstance instance(module);
+	FunctionInstance* function = instance.getFunction("identity");
+
+	Timing::Timer timer;
+	for(Uptr invokeIndex = 0; invokeIndex < numInvokes; ++invokeIndex)
+	{
+		UntaggedValue argument = I32(invokeIndex);
+		errorUnless(invokeFunctionUnchecked(instance.context, function, &argument)->i32
+					== I32(invokeIndex));
+	}
+	reportTime("invoke", timer, numInvokes);
+}
+
+// Indirect calls whose callee is always the same (a hit in any cache or speculation of the
+// callee), or cycles between four functions (a miss).
+static void benchmarkCallIndirect(Runtime::Module* module,
+								  const char* benchmarkName,
+								  I32 calleeMask)
+{
+	static constexpr Uptr numCalls = 10000000;
+	BenchmarkInstance instance(module);
+	FunctionInstance* function = instance.getFunction("callIndirect");
+
+	UntaggedValue arguments[2] = {I32(numCalls), calleeMask};
+	Timing::Timer timer;
+	invokeFunctionUnchecked(instance.context, function, arguments);
+	reportTime(benchmarkName, timer, numCalls);
+}
+
+// Concurrent memory.grow calls on a shared memory.
+static void benchmarkMemoryGrow(Runtime::Module* module)
+{
+	BenchmarkInstance instance(module);
+	FunctionInstance* function = instance.getFunction("memoryGrow");
+
+	std::vector<GCPointer<Context>> contexts;
+	std::vector<InvokeThread> threads;
+	for(Uptr threadIndex = 0; threadIndex < numMemoryGrowThreads; ++threadIndex)
+	{
+		contexts.push_back(createContext(instance.compartment));
+		threads.emplace_back(contexts.back(),
+							 function,
+							 std::vector<UntaggedValue>{I32(numMemoryGrowsPerThread)});
+	}
+
+	Timing::Timer timer;
+	for(InvokeThread& thread : threads) { thread.start(); }
+	for(InvokeThread& thread : threads) { thread.join(); }
+	reportTime("memory_grow", timer, numMemoryGrowThreads * numMemoryGrowsPerThread);
+
+	MemoryInstance* memory = asMemory(getInstanceExport(instance.moduleInstance, "memory"));
+	errorUnless(getMemoryNumPages(memory) == 1 + numMemoryGrowThreads * numMemoryGrowsPerThread);
+}
+
+// Two threads that pass a turn back and forth with atomic.wait and atomic.wake.
+static void benchmarkAtomicWaitWake(Runtime::Module* module)
+{
+	static constexpr Uptr numRoundTrips = 100000;
+	BenchmarkInstance instance(module);
+	FunctionInstance* function = instance.getFunction("pingPong");
+
+	GCPointer<Context> contexts[2] = {createContext(instance.compartment),
+									  createContext(instance.compartment)};
+	InvokeThread threads[2] = {
+		{contexts[0], function, {I32(0), I32(numRoundTrips)}},
+		{contexts[1], function, {I32(1), I32(numRoundTrips)}},
+	};
+
+	Timing::Timer timer;
+	for(InvokeThread& thread : threads) { thread.start(); }
+	for(InvokeThread& thread : threads) { thread.join(); }
+
+	// Each round trip passes the turn from one thread to the other and back.
+	reportTime("atomic_wait_wake", timer, numRoundTrips * 2);
+}
+
+// table.set in WebAssembly code, and growing a table with the runtime API.
+static void benchmarkTable(Runtime::Module* module)
+{
+	static constexpr Uptr numSets = 10000000;
+	static constexpr Uptr numGrows = 100000;
+	BenchmarkInstance instance(module);
+
+	UntaggedValue argument = I32(numSets);
+	Timing::Timer setTimer;
+	invokeFunctionUnchecked(instance.context, instance.getFunction("tableSet"), &argument);
+	reportTime("table_set", setTimer, numSets);
+
+	TableInstance* table = asTable(getInstanceExport(instance.moduleInstance, "table"));
+	Timing::Timer growTimer;
+	for(Uptr growIndex = 0; growIndex < numGrows; ++growIndex)
+	{ errorUnless(growTable(table, 1) != -1); }
+	reportTime("table_grow", growTimer, numGrows);
+}
+
+// Invoking a function that traps, and catching the trap.
+static void benchmarkTrap(Runtime::Module* module)
+{
+	static constexpr Uptr numTraps = 100000;
+	BenchmarkInstance instance(module);
+	FunctionInstance* function = instance.getFunction("trap");
+
+	Uptr numCaughtTraps = 0;
+	Timing::Timer timer;
+	for(Uptr trapIndex = 0; trapIndex < numTraps; ++trapIndex)
+	{
+		catchRuntimeExceptions(
+			[&] { invokeFunctionUnchecked(instance.context, function, nullptr); },
+			[&](Exception&& exception) {
+				errorUnless(exception.typeInstance == Exception::reachedUnreachableType);
+				++numCaughtTraps;
+			});
+	}
+	reportTime("trap_catch", timer, numTraps);
+	errorUnless(numCaughtTraps == numTraps);
+}
+
+// Cloning a compartment that contains an instance of the benchmark module, and freeing the clone.
+static void benchmarkCloneCompartment(Runtime::Module* module)
+{
+	static constexpr Uptr numClones = 1000;
+	BenchmarkInstance instance(module);
+
+	Timing::Timer timer;
+	for(Uptr cloneIndex = 0; cloneIndex < numClones; ++cloneIndex)
+	{
+		GCPointer<Compartment> clonedCompartment = cloneCompartment(instance.compartment);
+		errorUnless(clonedCompartment);
+		errorUnless(tryCollectCompartment(std::move(clonedCompartment)));
+	}
+	reportTime("clone_compartment", timer, numClones);
+}
+
+// A resolver that looks up imports by name in a set of named module instances.
+struct NamedInstanceResolver : Resolver
+{
+	HashMap<std::string, ModuleInstance*> moduleNameToInstanceMap;
+
+	bool resolve(const std::string& moduleName,
+				 const std::string& exportName,
+				 ObjectType type,
+				 Object*& outObject) override
+	{
+		ModuleInstance* const* instance = moduleNameToInstanceMap.get(moduleName);
+		if(!instance) { return false; }
+		outObject = getInstanceExport(*instance, exportName);
+		return outObject && isA(outObject, type);
+	}
+};
+
+// Linking a module with many imports, by looking up each import by name, and with a LinkPlan.
+static void benchmarkLink()
+{
+	static constexpr Uptr numImports = 1000;
+	static constexpr Uptr numLinks = 1000;
+
+	std::string providerWAST = "(module\n";
+	std::string importerWAST = "(module\n";
+	for(Uptr importIndex = 0; importIndex < numImports; ++importIndex)
+	{
+		const std::string name = "function" + std::to_string(importIndex);
+		providerWAST += "  (func (export \"" + name + "\") (param i32) (result i32) get_local 0)\n";
+		importerWAST += "  (import \"env\" \"" + name + "\" (func (param i32) (result i32)))\n";
+	}
+	providerWAST += ")";
+	importerWAST += ")";
+
+	IR::Module providerIRModule;
+	IR::Module importerIRModule;
+	std::vector<WAST::Error> parseErrors;
+	errorUnless(WAST::parseModule(
+		providerWAST.c_str(), providerWAST.size() + 1, providerIRModule, parseErrors));
+	errorUnless(WAST::parseModule(
+		importerWAST.c_str(), importerWAST.size() + 1, importerIRModule, parseErrors));
+
+	GCPointer<Runtime::Module> providerModule = compileModule(providerIRModule);
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		GCPointer<ModuleInstance> provider
+			= instantiateModule(compartment, providerModule, {}, "RuntimeBenchmarks provider");
+		errorUnless(provider);
+
+		NamedInstanceResolver resolver;
+		resolver.moduleNameToInstanceMap.set("env", provider);
+		Timing::Timer resolverTimer;
+		for(Uptr linkIndex = 0; linkIndex < numLinks; ++linkIndex)
+		{ errorUnless(linkModule(importerIRModule, resolver).success); }
+		reportTime("link_resolver", resolverTimer, numLinks * numImports);
+
+		const LinkPlan plan = createLinkPlan(importerIRModule, {{"env", provider}});
+		errorUnless(plan.success);
+		Timing::Timer planTimer;
+		for(Uptr linkIndex = 0; linkIndex < numLinks; ++linkIndex)
+		{ errorUnless(linkModule(importerIRModule, plan, {provider}).success); }
+		reportTime("link_plan", planTimer, numLinks * numImports);
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+static void showHelp()
+{
+	Log::printf(Log::error,
+				"Usage: RuntimeBenchmarks benchmark\n"
+				"  benchmark is one of: invoke, call_indirect_hit, call_indirect_miss,\n"
+				"  memory_grow, atomic_wait_wake, table, trap_catch, clone_compartment, link\n");
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2)
+	{
+		showHelp();
+		return EXIT_FAILURE;
+	}
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(benchmarkWAST, sizeof(benchmarkWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("RuntimeBenchmarks", parseErrors);
+		return EXIT_FAILURE;
+	}
+	GCPointer<Runtime::Module> module = compileModule(irModule);
+
+	const char* benchmarkName = argv[1];
+	if(!strcmp(benchmarkName, "invoke")) { benchmarkInvoke(module); }
+	else if(!strcmp(benchmarkName, "call_indirect_hit"))
+	{
+		benchmarkCallIndirect(module, benchmarkName, 0);
+	}
+	else if(!strcmp(benchmarkName, "call_indirect_miss"))
+	{
+		benchmarkCallIndirect(module, benchmarkName, 3);
+	}
+	else if(!strcmp(benchmarkName, "memory_grow"))
+	{
+		benchmarkMemoryGrow(module);
+	}
+	else if(!strcmp(benchmarkName, "atomic_wait_wake"))
+	{
+		benchmarkAtomicWaitWake(module);
+	}
+	else if(!strcmp(benchmarkName, "table"))
+	{
+		benchmarkTable(module);
+	}
+	else if(!strcmp(benchmarkName, "trap_catch"))
+	{
+		benchmarkTrap(module);
+	}
+	else if(!strcmp(benchmarkName, "clone_compartment"))
+	{
+		benchmarkCloneCompartment(module);
+	}
+	else if(!strcmp(benchmarkName, "link"))
+	{
+		benchmarkLink();
+	}
+	else
+	{
+		showHelp();
+		return EXIT_FAILURE;
+	}
+
+	module = nullptr;
+	collectGarbage();
+	return EXIT_SUCCESS;
+}
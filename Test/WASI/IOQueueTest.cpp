@@ -0,0 +1,191 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "WASIPrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Thread.h"
+
+using namespace WAVM;
+using namespace WAVM::WASI;
+
+static iovec makeIOV(void* buffer, Uptr numBytes)
+{
+	iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = numBytes;
+	return iov;
+}
+
+static int createTempFile()
+{
+	char path[] = "/tmp/WAVMIOQueueTestXXXXXX";
+	const int fd = mkstemp(path);
+	errorUnless(fd >= 0);
+	errorUnless(!unlink(path));
+	return fd;
+}
+
+static void testReadWrite(IOQueue* queue)
+{
+	const int fd = createTempFile();
+
+	// Write two buffers at the current position, then overwrite part of them at an offset.
+	char hello[] = "hello ";
+	char world[] = "world";
+	const iovec writeIOVs[2] = {makeIOV(hello, 6), makeIOV(world, 5)};
+	errorUnless(submitWritev(queue, fd, writeIOVs, 2, -1) == 11);
+	errorUnless(lseek(fd, 0, SEEK_CUR) == 11);
+
+	char there[] = "there";
+	const iovec overwriteIOV = makeIOV(there, 5);
+	errorUnless(submitWritev(queue, fd, &overwriteIOV, 1, 6) == 5);
+	errorUnless(lseek(fd, 0, SEEK_CUR) == 11);
+	errorUnless(submitFsync(queue, fd, false) == 0);
+	errorUnless(submitFsync(queue, fd, true) == 0);
+
+	// Read it back at an offset into two buffers, which doesn't move the current position.
+	char first[4] = {};
+	char second[16] = {};
+	const iovec readIOVs[2] = {makeIOV(first, sizeof(first)), makeIOV(second, sizeof(second))};
+	errorUnless(submitReadv(queue, fd, readIOVs, 2, 0) == 11);
+	errorUnless(!memcmp(first, "hell", 4));
+	errorUnless(!memcmp(second, "o there", 7));
+	errorUnless(lseek(fd, 0, SEEK_CUR) == 11);
+
+	// Read at the current position, which moves it to the end.
+	errorUnless(lseek(fd, 6, SEEK_SET) == 6);
+	memset(second, 0, sizeof(second));
+	const iovec readIOV = makeIOV(second, sizeof(second));
+	errorUnless(submitReadv(queue, fd, &readIOV, 1, -1) == 5);
+	errorUnless(!memcmp(second, "there", 5));
+	errorUnless(submitReadv(queue, fd, &readIOV, 1, -1) == 0);
+
+	// Errors are returned as negated errnos.
+	errorUnless(!close(fd));
+	errorUnless(submitReadv(queue, fd, &readIOV, 1, -1) == -EBADF);
+	errorUnless(submitWritev(queue, fd, writeIOVs, 2, 0) == -EBADF);
+}
+
+static void testSendReceive(IOQueue* queue)
+{
+	int sockets[2];
+	errorUnless(!socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+	char message[] = "message";
+	iovec sendIOV = makeIOV(message, 7);
+	msghdr sendHeader;
+	memset(&sendHeader, 0, sizeof(sendHeader));
+	sendHeader.msg_iov = &sendIOV;
+	sendHeader.msg_iovlen = 1;
+	errorUnless(submitSendmsg(queue, sockets[0], &sendHeader, 0) == 7);
+
+	char buffer[16] = {};
+	iovec receiveIOV = makeIOV(buffer, sizeof(buffer));
+	msghdr receiveHeader;
+	memset(&receiveHeader, 0, sizeof(receiveHeader));
+	receiveHeader.msg_iov = &receiveIOV;
+	receiveHeader.msg_iovlen = 1;
+	errorUnless(submitRecvmsg(queue, sockets[1], &receiveHeader, 0) == 7);
+	errorUnless(!memcmp(buffer, "message", 7));
+
+	errorUnless(!close(sockets[0]));
+	errorUnless(!close(sockets[1]));
+}
+
+struct DelayedWriteState
+{
+	int fd;
+};
+
+static I64 delayedWriteThreadEntry(void* argument)
+{
+	DelayedWriteState* state = (DelayedWriteState*)argument;
+	usleep(10000);
+	const char byte = 'x';
+	errorUnless(write(state->fd, &byte, 1) == 1);
+	return 0;
+}
+
+static void testPoll(IOQueue* queue)
+{
+	int pipeFDs[2];
+	errorUnless(!pipe(pipeFDs));
+
+	// An empty pipe isn't readable, but is writable.
+	pollfd readFD;
+	readFD.fd = pipeFDs[0];
+	readFD.events = POLLIN;
+	readFD.revents = 0;
+	errorUnless(submitPoll(queue, &readFD, 1, 0) == 0);
+
+	pollfd writeFD;
+	writeFD.fd = pipeFDs[1];
+	writeFD.events = POLLOUT;
+	writeFD.revents = 0;
+	errorUnless(submitPoll(queue, &writeFD, 1, -1) == 1);
+	errorUnless(writeFD.revents & POLLOUT);
+
+	// Wait without a timeout for another thread to write to the pipe.
+	DelayedWriteState state{pipeFDs[1]};
+	Platform::Thread* writerThread
+		= Platform::createThread(1024 * 1024, delayedWriteThreadEntry, &state);
+	readFD.revents = 0;
+	errorUnless(submitPoll(queue, &readFD, 1, -1) == 1);
+	errorUnless(readFD.revents & POLLIN);
+	Platform::joinThread(writerThread);
+
+	// Wait for either end, with a timeout.
+	pollfd bothFDs[2] = {readFD, writeFD};
+	bothFDs[0].revents = bothFDs[1].revents = 0;
+	errorUnless(submitPoll(queue, bothFDs, 2, 1000) == 2);
+	errorUnless((bothFDs[0].revents & POLLIN) && (bothFDs[1].revents & POLLOUT));
+
+	// Once the write end is closed and the pipe is drained, the read end is hung up.
+	char byte;
+	errorUnless(read(pipeFDs[0], &byte, 1) == 1 && byte == 'x');
+	errorUnless(!close(pipeFDs[1]));
+	readFD.revents = 0;
+	errorUnless(submitPoll(queue, &readFD, 1, -1) == 1);
+	errorUnless(readFD.revents & POLLHUP);
+
+	// A closed descriptor is reported as an event, like poll does.
+	errorUnless(!close(pipeFDs[0]));
+	readFD.revents = 0;
+	errorUnless(submitPoll(queue, &readFD, 1, -1) == 1);
+	errorUnless(readFD.revents & POLLNVAL);
+}
+
+static void testQueue(IOQueue* queue)
+{
+	testReadWrite(queue);
+	testSendReceive(queue);
+	testPoll(queue);
+	destroyIOQueue(queue);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	// Test the queue with the ring if the host supports it, and without it.
+	IOQueue* queue = createIOQueue();
+	if(!isIOQueueUsingRing(queue))
+	{ Log::printf(Log::metrics, "io_uring isn't supported: only testing the fallback.\n"); }
+	testQueue(queue);
+
+	IOQueue* fallbackQueue = createIOQueue(false);
+	errorUnless(!isIOQueueUsingRing(fallbackQueue));
+	testQueue(fallbackQueue);
+
+	Timing::logTimer("IOQueueTest", timer);
+	return 0;
+}
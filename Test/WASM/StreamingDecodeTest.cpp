@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/WASM/WASM.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+
+static const char testWAST[]
+	= "(module\n"
+	  "  (import \"env\" \"log\" (func $log (param i32)))\n"
+	  "  (memory (export \"memory\") 1)\n"
+	  "  (data (i32.const 16) \"streaming decode test\")\n"
+	  "  (global $counter (mut i32) (i32.const 0))\n"
+	  "  (table 2 anyfunc)\n"
+	  "  (elem (i32.const 0) $sum $count)\n"
+	  "  (func $sum (export \"sum\") (param $n i32) (result i32)\n"
+	  "    (local $total i32)\n"
+	  "    (block $done\n"
+	  "      (loop $continue\n"
+	  "        (br_if $done (i32.eqz (get_local $n)))\n"
+	  "        (set_local $total (i32.add (get_local $total) (get_local $n)))\n"
+	  "        (set_local $n (i32.sub (get_local $n) (i32.const 1)))\n"
+	  "        (br $continue)\n"
+	  "      )\n"
+	  "    )\n"
+	  "    (get_local $total)\n"
+	  "  )\n"
+	  "  (func $count (param $n i32) (result i32)\n"
+	  "    (set_global $counter (i32.add (get_global $counter) (get_local $n)))\n"
+	  "    (call $log (get_global $counter))\n"
+	  "    (get_global $counter)\n"
+	  "  )\n"
+	  "  (func (export \"checksum\") (param $address i32) (param $numBytes i32) (result i64)\n"
+	  "    (local $hash i64)\n"
+	  "    (set_local $hash (i64.const 0xcbf29ce484222325))\n"
+	  "    (block $done\n"
+	  "      (loop $continue\n"
+	  "        (br_if $done (i32.eqz (get_local $numBytes)))\n"
+	  "        (set_local $hash (i64.mul (i64.xor (get_local $hash)\n"
+	  "                                           (i64.load8_u (get_local $address)))\n"
+	  "                                  (i64.const 0x100000001b3)))\n"
+	  "        (set_local $address (i32.add (get_local $address) (i32.const 1)))\n"
+	  "        (set_local $numBytes (i32.sub (get_local $numBytes) (i32.const 1)))\n"
+	  "        (br $continue)\n"
+	  "      )\n"
+	  "    )\n"
+	  "    (get_local $hash)\n"
+	  "  )\n"
+	  "  (func (export \"dispatch\") (param $index i32) (param $n i32) (result i32)\n"
+	  "    (call_indirect (param i32) (result i32) (get_local $n) (get_local $index))\n"
+	  "  )\n"
+	  ")\n";
+
+static std::vector<U8> serializeModule(const IR::Module& irModule)
+{
+	Serialization::ArrayOutputStream stream;
+	WASM::serialize(stream, irModule);
+	return stream.getBytes();
+}
+
+// Feeds a binary module to a streaming decoder in chunks of numChunkBytes, and checks that it
+// decodes to the same module as the binary, reporting each function definition once, in order.
+static void testStreamingDecode(const std::vector<U8>& wasmBytes,
+								Uptr numChunkBytes,
+								Uptr numFunctionDefs)
+{
+	IR::Module irModule;
+	std::vector<Uptr> decodedFunctionDefIndices;
+	WASM::StreamingDecoder* decoder
+		= WASM::createStreamingDecoder(irModule, [&](Uptr functionDefIndex) {
+			  errorUnless(functionDefIndex < irModule.functions.defs.size());
+			  decodedFunctionDefIndices.push_back(functionDefIndex);
+		  });
+	for(Uptr offset = 0; offset < wasmBytes.size(); offset += numChunkBytes)
+	{
+		const Uptr numBytes = std::min(numChunkBytes, wasmBytes.size() - offset);
+		WASM::feedStreamingDecoder(decoder, wasmBytes.data() + offset, numBytes);
+	}
+	errorUnless(WASM::finishStreamingDecode(decoder));
+
+	errorUnless(decodedFunctionDefIndices.size() == numFunctionDefs);
+	for(Uptr index = 0; index < numFunctionDefs; ++index)
+	{ errorUnless(decodedFunctionDefIndices[index] == index); }
+
+	// The streamed module must be the same as the module that was serialized.
+	errorUnless(serializeModule(irModule) == wasmBytes);
+}
+
+// Decodes a malformed binary, which must fail.
+static void testStreamingDecodeError(const std::vector<U8>& wasmBytes)
+{
+	IR::Module irModule;
+	WASM::StreamingDecoder* decoder = WASM::createStreamingDecoder(irModule);
+	WASM::feedStreamingDecoder(decoder, wasmBytes.data(), wasmBytes.size());
+	errorUnless(!WASM::finishStreamingDecode(decoder, Log::debug));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testWAST, sizeof(testWAST), irModule, parseErrors))
+	{
+		WAST::reportParseErrors("StreamingDecodeTest", parseErrors);
+		return EXIT_FAILURE;
+	}
+	const std::vector<U8> wasmBytes = serializeModule(irModule);
+	const Uptr numFunctionDefs = irModule.functions.defs.size();
+
+	// Feed the binary a byte at a time, in chunks that split sections and function bodies at
+	// different points, and all at once.
+	for(Uptr numChunkBytes : {Uptr(1), Uptr(3), Uptr(7), Uptr(64), wasmBytes.size()})
+	{ testStreamingDecode(wasmBytes, numChunkBytes, numFunctionDefs); }
+
+	// Decoding a binary that ends before its last section, or in the middle of a function body,
+	// must fail.
+	std::vector<U8> truncatedBytes(wasmBytes.begin(), wasmBytes.end() - 1);
+	testStreamingDecodeError(truncatedBytes);
+	truncatedBytes.assign(wasmBytes.begin(), wasmBytes.begin() + wasmBytes.size() / 2);
+	testStreamingDecodeError(truncatedBytes);
+
+	// A binary with the wrong magic number must fail.
+	std::vector<U8> badMagicBytes = wasmBytes;
+	badMagicBytes[0] ^= 0xff;
+	testStreamingDecodeError(badMagicBytes);
+
+	Timing::logTimer("StreamingDecodeTest", timer);
+	return 0;
+}
@@ -0,0 +1,196 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+
+// Parses modules with many float literals of a few kinds, checks that the parsed values match the
+// C library's strtod, and reports the parse time per literal for each kind.
+
+static U64 nextRandom(U64& state)
+{
+	state = state * 6364136223846793005ull + 1442695040888963407ull;
+	return state >> 11 | state << 53;
+}
+
+static F64 bitsToF64(U64 bits)
+{
+	F64 f64;
+	memcpy(&f64, &bits, sizeof(f64));
+	return f64;
+}
+
+static F32 bitsToF32(U32 bits)
+{
+	F32 f32;
+	memcpy(&f32, &bits, sizeof(f32));
+	return f32;
+}
+
+static std::string removeUnderscores(const std::string& literal)
+{
+	std::string result;
+	for(char c : literal)
+	{
+		if(c != '_') { result += c; }
+	}
+	return result;
+}
+
+static void benchmarkLiterals(const char* kindName,
+							  const char* typeName,
+							  const std::vector<std::string>& literals)
+{
+	std::string wast = "(module\n";
+	for(const std::string& literal : literals)
+	{ wast += std::string("(global ") + typeName + " (" + typeName + ".const " + literal + "))\n"; }
+	wast += ")";
+
+	Timing::Timer timer;
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(wast.c_str(), wast.size() + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors(kindName, parseErrors);
+		Errors::fatalf("Failed to parse %s float literals", kindName);
+	}
+	Log::printf(Log::error,
+				"%s %s: %.1f ns/literal\n",
+				kindName,
+				typeName,
+				F64(timer.getMicroseconds()) * 1000.0 / F64(literals.size()));
+
+	errorUnless(irModule.globals.defs.size() == literals.size());
+	for(Uptr index = 0; index < literals.size(); ++index)
+	{
+		const InitializerExpression& initializer = irModule.globals.defs[index].initializer;
+		const F64 expected = strtod(removeUnderscores(literals[index]).c_str(), nullptr);
+		bool isMatch;
+		if(!strcmp(typeName, "f64"))
+		{ isMatch = !memcmp(&initializer.f64, &expected, sizeof(F64)); }
+		else
+		{
+			const F32 expectedF32 = F32(expected);
+			isMatch = !memcmp(&initializer.f32, &expectedF32, sizeof(F32));
+		}
+		if(!isMatch)
+		{ Errors::fatalf("%s parsed incorrectly as a %s", literals[index].c_str(), typeName); }
+	}
+}
+
+enum
+{
+	numLiteralsPerKind = 100000
+};
+
+I32 main()
+{
+	// Literals at the edges of the fast path's rounding and range.
+	const std::vector<std::string> edgeCaseLiterals = {
+		"0",
+		"-0.0",
+		"0.000e10",
+		"1",
+		"1e-400",
+		"-1e-400",
+		"4.9406564584124654e-324",
+		"2.4703282292062327e-324",
+		"2.4703282292062328e-324",
+		"2.2250738585072011e-308",
+		"2.2250738585072014e-308",
+		"1.7976931348623157e308",
+		"9007199254740993",
+		"9007199254740995",
+		"9223372036854775807",
+		"18446744073709551615",
+		"1_000.000_1e1_0",
+		"0.000000000000000000000000000001234567890123456789",
+		"123456789012345678901234567890",
+		"0.5e-22",
+		"4.5e15",
+		"3.0517578125e-5",
+		"1e23",
+		"8.98846567431158e307",
+	};
+	benchmarkLiterals("edge_cases", "f64", edgeCaseLiterals);
+
+	U64 state = 0x5555555555555555ull;
+	char buffer[64];
+
+	// Short decimal literals, like most constants in hand-written code.
+	std::vector<std::string> shortLiterals;
+	for(Uptr index = 0; index < numLiteralsPerKind; ++index)
+	{
+		snprintf(buffer,
+				 sizeof(buffer),
+				 "%" PRIu64 ".%" PRIu64 "e%d",
+				 nextRandom(state) % 1000000,
+				 nextRandom(state) % 10000,
+				 int(nextRandom(state) % 61) - 30);
+		shortLiterals.push_back(buffer);
+	}
+	benchmarkLiterals("short", "f64", shortLiterals);
+	benchmarkLiterals("short", "f32", shortLiterals);
+
+	// The shortest literals that round trip random finite floats, like the constants in compiled
+	// code.
+	std::vector<std::string> f64RoundTripLiterals;
+	while(f64RoundTripLiterals.size() < numLiteralsPerKind)
+	{
+		const F64 f64 = bitsToF64(nextRandom(state));
+		if(f64 != f64 || f64 - f64 != 0) { continue; }
+		snprintf(buffer, sizeof(buffer), "%.17g", f64);
+		f64RoundTripLiterals.push_back(buffer);
+	}
+	benchmarkLiterals("round_trip", "f64", f64RoundTripLiterals);
+
+	std::vector<std::string> f32RoundTripLiterals;
+	while(f32RoundTripLiterals.size() < numLiteralsPerKind)
+	{
+		const F32 f32 = bitsToF32(U32(nextRandom(state)));
+		if(f32 != f32 || f32 - f32 != 0) { continue; }
+		snprintf(buffer, sizeof(buffer), "%.9g", F64(f32));
+		f32RoundTripLiterals.push_back(buffer);
+	}
+	benchmarkLiterals("round_trip", "f32", f32RoundTripLiterals);
+
+	// Literals with more than 19 significant digits.
+	std::vector<std::string> longLiterals;
+	for(Uptr index = 0; index < numLiteralsPerKind; ++index)
+	{
+		std::string literal;
+		for(Uptr digitIndex = 0; digitIndex < 25; ++digitIndex)
+		{
+			const U64 digit = digitIndex == 0 ? 1 + nextRandom(state) % 9 : nextRandom(state) % 10;
+			literal += char('0' + digit);
+			if(digitIndex == 0) { literal += '.'; }
+		}
+		snprintf(buffer, sizeof(buffer), "e%d", int(nextRandom(state) % 601) - 300);
+		longLiterals.push_back(literal + buffer);
+	}
+	benchmarkLiterals("long", "f64", longLiterals);
+
+	// Hexadecimal literals.
+	std::vector<std::string> hexLiterals;
+	while(hexLiterals.size() < numLiteralsPerKind)
+	{
+		const F64 f64 = bitsToF64(nextRandom(state));
+		if(f64 != f64 || f64 - f64 != 0) { continue; }
+		snprintf(buffer, sizeof(buffer), "%a", f64);
+		hexLiterals.push_back(buffer);
+	}
+	benchmarkLiterals("hex", "f64", hexLiterals);
+
+	return 0;
+}
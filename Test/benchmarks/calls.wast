@@ -0,0 +1,33 @@
+;; Microbenchmarks for the overhead of calls. Each exported function makes about 100,000,000
+;; calls of one kind, so the throughput of a kind of call can be tracked by timing its function.
+
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (table anyfunc (elem $increment $decrement))
+
+  (func $increment (param $x i32) (result i32) (i32.add (get_local $x) (i32.const 1)))
+  (func $decrement (param $x i32) (result i32) (i32.sub (get_local $x) (i32.const 1)))
+
+  ;; Direct calls of a function that can't be inlined into the caller.
+  (func $fib (param $n i32) (result i32)
+    (if (result i32) (i32.lt_u (get_local $n) (i32.const 2))
+      (then (get_local $n))
+      (else (i32.add (call $fib (i32.sub (get_local $n) (i32.const 1)))
+                     (call $fib (i32.sub (get_local $n) (i32.const 2)))))
+    )
+  )
+  (func (export "direct") (result i32) (call $fib (i32.const 38)))
+
+  ;; Indirect calls whose callee alternates between two functions with the same signature.
+  (func (export "indirect") (result i32)
+    (local $i i32) (local $sum i32)
+    (loop $loop
+      (set_local $sum (call_indirect (type $i32_to_i32)
+                                     (get_local $sum)
+                                     (i32.and (get_local $i) (i32.const 1))))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+)
@@ -0,0 +1,280 @@
+;; Microbenchmarks for SIMD operators whose lowering depends on the target's SIMD instruction
+;; set. Each exported function applies one operator to a varying operand 100,000,000 times, so
+;; the throughput of an operator can be tracked by timing its function, e.g.:
+;;   time wavm-run -f i8x16.any_true Test/benchmarks/simd.wast
+
+(module
+  (func (export "i8x16.any_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i8x16.any_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i16x8.any_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i16x8.any_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i32x4.any_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i32x4.any_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i64x2.any_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i64x2.any_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i8x16.all_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i8x16.all_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i16x8.all_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i16x8.all_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i32x4.all_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i32x4.all_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i64x2.all_true") (result i32)
+    (local $i i32) (local $v v128) (local $sum i32)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $sum (i32.add (get_local $sum) (i64x2.all_true (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (get_local $sum)
+  )
+
+  (func (export "i8x16.add_saturate_s") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i8x16.add_saturate_s (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i8x16.sub_saturate_s") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i8x16.sub_saturate_s (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i8x16.add_saturate_u") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i8x16.add_saturate_u (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i8x16.sub_saturate_u") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i8x16.sub_saturate_u (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i16x8.add_saturate_s") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i16x8.add_saturate_s (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i16x8.sub_saturate_s") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i16x8.sub_saturate_s (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i16x8.add_saturate_u") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i16x8.add_saturate_u (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i16x8.sub_saturate_u") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i16x8.sub_saturate_u (get_local $v)
+        (v128.const i32 0x7f7f7f7f 0x80808080 0x7f7f7f7f 0x80808080))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i32x4.trunc_s:sat/f32x4") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const f32 -3e9 -1.5 1.5 3e9))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i32x4.trunc_s:sat/f32x4 (get_local $v))))
+      (set_local $v (f32x4.add (get_local $v) (v128.const f32 0.25 0.25 0.25 0.25)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i32x4.trunc_u:sat/f32x4") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const f32 -3e9 -1.5 1.5 3e9))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i32x4.trunc_u:sat/f32x4 (get_local $v))))
+      (set_local $v (f32x4.add (get_local $v) (v128.const f32 0.25 0.25 0.25 0.25)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i64x2.trunc_s:sat/f64x2") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const f64 -1e19 1e19))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i64x2.trunc_s:sat/f64x2 (get_local $v))))
+      (set_local $v (f64x2.add (get_local $v) (v128.const f64 0.25 0.25)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "i64x2.trunc_u:sat/f64x2") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const f64 -1e19 1e19))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc) (i64x2.trunc_u:sat/f64x2 (get_local $v))))
+      (set_local $v (f64x2.add (get_local $v) (v128.const f64 0.25 0.25)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "v8x16.shuffle/reverse") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc)
+        (v8x16.shuffle (15 14 13 12 11 10 9 8 7 6 5 4 3 2 1 0) (get_local $v) (get_local $v))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+
+  (func (export "v8x16.shuffle/interleave") (result i32)
+    (local $i i32) (local $v v128) (local $acc v128)
+    (set_local $v (v128.const i32 0 0x100 0x10000 0x1000000))
+    (loop $loop
+      (set_local $acc (v128.xor (get_local $acc)
+        (v8x16.shuffle (0 16 1 17 2 18 3 19 4 20 5 21 6 22 7 23) (get_local $v) (get_local $acc))))
+      (set_local $v (i32x4.add (get_local $v) (v128.const i32 1 1 1 1)))
+      (br_if $loop (i32.ne (tee_local $i (i32.add (get_local $i) (i32.const 1)))
+                           (i32.const 100000000)))
+    )
+    (i32x4.extract_lane 0 (get_local $acc))
+  )
+)
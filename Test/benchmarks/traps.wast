@@ -0,0 +1,20 @@
+;; Microbenchmarks for the overhead of trapping. Each exported function traps immediately, so the
+;; cost of a kind of trap can be tracked by timing many invocations of its function.
+
+(module
+  (memory 1)
+
+  ;; A trap raised by an explicit check in the generated code.
+  (func (export "unreachable") (unreachable))
+
+  ;; A trap raised by the hardware for an integer division by zero. The divisor is loaded from
+  ;; memory so the division can't be folded at compile time.
+  (func (export "divide_by_zero") (result i32)
+    (i32.div_u (i32.const 1) (i32.load (i32.const 0)))
+  )
+
+  ;; A trap raised by the hardware for an access to a memory's guard pages.
+  (func (export "out_of_bounds") (result i32)
+    (i32.load (i32.const -4))
+  )
+)
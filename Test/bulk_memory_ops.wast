@@ -439,6 +439,30 @@
 (assert_trap   (invoke "memory.copy" (i32.const 0xffffffff) (i32.const 0) (i32.const 1)) "out of bounds memory access")
 (assert_trap   (invoke "memory.copy" (i32.const 0) (i32.const 0xffffffff) (i32.const 1)) "out of bounds memory access")
 
+;; memory.copy between ranges that overlap by more than the distance between them
+
+(module
+	(memory $m 1 1)
+
+	(data (i32.const 0) "\01\02\03\04\05\06\07\08")
+
+	(func (export "memory.copy")
+		(param $destAddress i32)
+		(param $sourceAddress i32)
+		(param $numBytes i32)
+		(memory.copy (get_local $destAddress) (get_local $sourceAddress) (get_local $numBytes))
+	)
+
+	(func (export "i64.load") (param $address i32) (result i64)
+		(i64.load (get_local $address))
+	)
+)
+
+(assert_return (invoke "memory.copy" (i32.const 1) (i32.const 0) (i32.const 7)))
+(assert_return (invoke "i64.load" (i32.const 0)) (i64.const 0x0706050403020101))
+(assert_return (invoke "memory.copy" (i32.const 0) (i32.const 2) (i32.const 6)))
+(assert_return (invoke "i64.load" (i32.const 0)) (i64.const 0x0706070605040302))
+
 ;; memory.fill
 
 (module
@@ -483,6 +507,64 @@
 
 (assert_trap   (invoke "memory.fill" (i32.const 0xffffffff) (i32.const 0) (i32.const 1)) "out of bounds memory access")
 
+;; memory.copy and memory.fill with small constant sizes
+
+(module
+	(memory $m 1 1)
+	(data (i32.const 0) "\10\11\12\13\14\15\16\17\18\19\1a\1b\1c\1d\1e\1f\20\21\22\23\24\25\26")
+
+	(func (export "memory.copy 23") (param $destAddress i32) (param $sourceAddress i32)
+		(memory.copy (get_local $destAddress) (get_local $sourceAddress) (i32.const 23))
+	)
+
+	(func (export "memory.copy 3") (param $destAddress i32) (param $sourceAddress i32)
+		(memory.copy (get_local $destAddress) (get_local $sourceAddress) (i32.const 3))
+	)
+
+	(func (export "memory.fill 23") (param $destAddress i32) (param $value i32)
+		(memory.fill (get_local $destAddress) (get_local $value) (i32.const 23))
+	)
+
+	(func (export "i32.load8_u") (param $address i32) (result i32)
+		(i32.load8_u (get_local $address))
+	)
+)
+
+(assert_return (invoke "memory.copy 23" (i32.const 100) (i32.const 0)))
+(assert_return (invoke "i32.load8_u" (i32.const 99))  (i32.const 0))
+(assert_return (invoke "i32.load8_u" (i32.const 100)) (i32.const 0x10))
+(assert_return (invoke "i32.load8_u" (i32.const 115)) (i32.const 0x1f))
+(assert_return (invoke "i32.load8_u" (i32.const 116)) (i32.const 0x20))
+(assert_return (invoke "i32.load8_u" (i32.const 122)) (i32.const 0x26))
+(assert_return (invoke "i32.load8_u" (i32.const 123)) (i32.const 0))
+
+;; Overlapping copies must behave as if the source bytes were copied to a temporary buffer first.
+(assert_return (invoke "memory.copy 23" (i32.const 101) (i32.const 100)))
+(assert_return (invoke "i32.load8_u" (i32.const 100)) (i32.const 0x10))
+(assert_return (invoke "i32.load8_u" (i32.const 101)) (i32.const 0x10))
+(assert_return (invoke "i32.load8_u" (i32.const 102)) (i32.const 0x11))
+(assert_return (invoke "i32.load8_u" (i32.const 123)) (i32.const 0x26))
+(assert_return (invoke "memory.copy 23" (i32.const 100) (i32.const 101)))
+(assert_return (invoke "i32.load8_u" (i32.const 100)) (i32.const 0x10))
+(assert_return (invoke "i32.load8_u" (i32.const 101)) (i32.const 0x11))
+(assert_return (invoke "i32.load8_u" (i32.const 122)) (i32.const 0x26))
+(assert_return (invoke "i32.load8_u" (i32.const 123)) (i32.const 0x26))
+
+(assert_return (invoke "memory.copy 3" (i32.const 65533) (i32.const 0)))
+(assert_return (invoke "i32.load8_u" (i32.const 65535)) (i32.const 0x12))
+(assert_trap   (invoke "memory.copy 3" (i32.const 65534) (i32.const 0)) "out of bounds memory access")
+(assert_trap   (invoke "memory.copy 3" (i32.const 0) (i32.const 65534)) "out of bounds memory access")
+(assert_trap   (invoke "memory.copy 3" (i32.const 0xffffffff) (i32.const 0)) "out of bounds memory access")
+
+(assert_return (invoke "memory.fill 23" (i32.const 200) (i32.const 0x1a5)))
+(assert_return (invoke "i32.load8_u" (i32.const 199)) (i32.const 0))
+(assert_return (invoke "i32.load8_u" (i32.const 200)) (i32.const 0xa5))
+(assert_return (invoke "i32.load8_u" (i32.const 216)) (i32.const 0xa5))
+(assert_return (invoke "i32.load8_u" (i32.const 222)) (i32.const 0xa5))
+(assert_return (invoke "i32.load8_u" (i32.const 223)) (i32.const 0))
+(assert_trap   (invoke "memory.fill 23" (i32.const 65520) (i32.const 0)) "out of bounds memory access")
+(assert_trap   (invoke "memory.fill 23" (i32.const 0xffffffff) (i32.const 0)) "out of bounds memory access")
+
 ;; passive elem segments
 
 (module (elem passive $f) (func $f))
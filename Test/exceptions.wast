@@ -171,3 +171,98 @@
 
 (assert_unlinkable (module (exception_type (import "A" "a") i64)) "import type doesn't match")
 (assert_unlinkable (module (exception_type (import "A" "c") i32 i64)) "import type doesn't match")
+
+;; exceptions with more arguments than fit in a platform exception's inline data
+
+(module $B
+  (exception_type $small (export "small") i64 f64)
+  (exception_type $large (export "large") i64 i64 i64 i64 i64 i64 i64 i64)
+
+  (func $throw_large (export "throw_large") (param i64)
+    (throw $large (get_local 0) (i64.const 2) (i64.const 3) (i64.const 4)
+                  (i64.const 5) (i64.const 6) (i64.const 7) (i64.const 8)))
+
+  (func (export "catch_large") (result i64)
+    try (result i64)
+      i64.const 1
+      call $throw_large
+      unreachable
+    catch $large
+      i64.add i64.add i64.add i64.add i64.add i64.add i64.add
+    end
+    )
+
+  (func (export "catch_small_inside_catch_large") (result i64)
+    try (result i64)
+      i64.const 10
+      call $throw_large
+      unreachable
+    catch $large
+      i64.add i64.add i64.add i64.add i64.add i64.add i64.add
+      try (result i64 f64)
+        (throw $small (i64.const 100) (f64.const 200.0))
+      catch $small
+      end
+      i64.trunc_s/f64
+      i64.add
+      i64.add
+    end
+    )
+)
+
+(assert_throws (invoke "throw_large" (i64.const 1)) $B "large"
+  (i64.const 1) (i64.const 2) (i64.const 3) (i64.const 4)
+  (i64.const 5) (i64.const 6) (i64.const 7) (i64.const 8))
+(assert_return (invoke "catch_large") (i64.const 36))
+(assert_return (invoke "catch_small_inside_catch_large") (i64.const 345))
+
+;; throws that are caught by a try in the same function
+
+(module
+  (exception_type $a i32 f64)
+  (exception_type $b i64)
+
+  (func (export "catch_arguments_in_order") (result f64)
+    (local $f f64)
+    try (result i32 f64)
+      (throw $a (i32.const 2) (f64.const 5.0))
+    catch $a
+    end
+    set_local $f
+    f64.convert_s/i32
+    get_local $f
+    f64.div
+    )
+
+  (func (export "catch_from_outer_try") (result i64)
+    try (result i64)
+      try (result i64)
+        (throw $b (i64.const 30))
+      catch $a
+        drop
+        drop
+        i64.const 0
+      end
+    catch $b
+      i64.const 1
+      i64.add
+    end
+    )
+
+  (func (export "catch_in_loop") (param $n i32) (result i64)
+    (local $sum i64)
+    loop $continue
+      try
+        (throw $b (i64.extend_u/i32 (get_local $n)))
+      catch $b
+        (set_local $sum (i64.add (get_local $sum)))
+      end
+      (br_if $continue (tee_local $n (i32.sub (get_local $n) (i32.const 1))))
+    end
+    get_local $sum
+    )
+)
+
+(assert_return (invoke "catch_arguments_in_order") (f64.const 0.4))
+(assert_return (invoke "catch_from_outer_try") (i64.const 31))
+(assert_return (invoke "catch_in_loop" (i32.const 100000)) (i64.const 5000050000))
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 #include "WAVM/IR/IR.h"
@@ -6,6 +7,7 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/CLI.h"
 #include "WAVM/Inline/Config.h"
+#include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/WASM/WASM.h"
@@ -14,15 +16,47 @@ using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::Runtime;
 
+// The compiled modules are freed by collecting garbage once every this many inputs, rather than
+// after every input.
+static constexpr Uptr numInputsPerGarbageCollection = 64;
+
+// Options set by the flags that start with "--", which libFuzzer ignores and leaves for
+// LLVMFuzzerInitialize.
+static bool validateOnly = false;
+static CompileOptions compileOptions;
+
+extern "C" I32 LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+	for(int argIndex = 1; argIndex < *argc; ++argIndex)
+	{
+		const char* arg = (*argv)[argIndex];
+		if(!strcmp(arg, "--validate-only")) { validateOnly = true; }
+		else if(!strcmp(arg, "--unoptimized"))
+		{
+			// Fuzz the emitter and code generator without spending time on optimizing the code.
+			compileOptions.optimizationLevel = OptimizationLevel::none;
+			compileOptions.codeGenOptimizationLevel = CodeGenOptimizationLevel::none;
+		}
+	}
+	return 0;
+}
+
 extern "C" I32 LLVMFuzzerTestOneInput(const U8* data, Uptr numBytes)
 {
 	IR::Module module;
 	module.featureSpec.maxLabelsPerFunction = 65536;
 	module.featureSpec.maxLocals = 1024;
 	if(!WASM::loadBinaryModule(data, numBytes, module, Log::debug)) { return 0; }
+	if(validateOnly) { return 0; }
 
-	compileModule(module);
-	collectGarbage();
+	compileModule(module, compileOptions);
+
+	static Uptr numInputsSinceGarbageCollection = 0;
+	if(++numInputsSinceGarbageCollection == numInputsPerGarbageCollection)
+	{
+		collectGarbage();
+		numInputsSinceGarbageCollection = 0;
+	}
 
 	return 0;
 }
@@ -30,17 +64,31 @@ extern "C" I32 LLVMFuzzerTestOneInput(const U8* data, Uptr numBytes)
 #if !WAVM_ENABLE_LIBFUZZER
 I32 main(int argc, char** argv)
 {
-	if(argc != 2)
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	std::vector<const char*> inputFilenames;
+	for(int argIndex = 1; argIndex < argc; ++argIndex)
 	{
-		Log::printf(Log::error, "Usage: FuzzCompile in.wasm\n");
+		if(strncmp(argv[argIndex], "--", 2)) { inputFilenames.push_back(argv[argIndex]); }
+	}
+	if(!inputFilenames.size())
+	{
+		Log::printf(Log::error,
+					"Usage: FuzzCompile [--validate-only] [--unoptimized] in.wasm [in.wasm...]\n");
 		return EXIT_FAILURE;
 	}
-	const char* inputFilename = argv[1];
 
-	std::vector<U8> wasmBytes;
-	if(!loadFile(inputFilename, wasmBytes)) { return EXIT_FAILURE; }
+	// Run each input, and report how many inputs were run per second.
+	Timing::Timer fuzzTimer;
+	for(const char* inputFilename : inputFilenames)
+	{
+		std::vector<U8> wasmBytes;
+		if(!loadFile(inputFilename, wasmBytes)) { return EXIT_FAILURE; }
 
-	LLVMFuzzerTestOneInput(wasmBytes.data(), wasmBytes.size());
+		LLVMFuzzerTestOneInput(wasmBytes.data(), wasmBytes.size());
+	}
+	collectGarbage();
+	Timing::logRatePerSecond("Ran fuzz inputs", fuzzTimer, F64(inputFilenames.size()), "inputs");
 	return EXIT_SUCCESS;
 }
 #endif
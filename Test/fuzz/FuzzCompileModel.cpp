@@ -88,6 +88,11 @@ static void generateImm(RandomStream& random, IR::Module& module, MemoryImm& out
 {
 	outImm.memoryIndex = random.get(module.memories.size() - 1);
 }
+static void generateImm(RandomStream& random, IR::Module& module, MemoryCopyImm& outImm)
+{
+	outImm.destMemoryIndex = random.get(module.memories.size() - 1);
+	outImm.sourceMemoryIndex = random.get(module.memories.size() - 1);
+}
 static void generateImm(RandomStream& random, IR::Module& module, TableImm& outImm)
 {
 	outImm.tableIndex = random.get(module.tables.size() - 1);
@@ -132,6 +137,7 @@ static void generateImm(RandomStream& random,
 {
 	outImm.alignmentLog2 = random.get<U8>(naturalAlignmentLog2);
 	outImm.offset = random.get(UINT32_MAX);
+	outImm.memoryIndex = random.get(module.memories.size() - 1);
 }
 
 template<Uptr naturalAlignmentLog2>
@@ -141,6 +147,7 @@ static void generateImm(RandomStream& random,
 {
 	outImm.alignmentLog2 = naturalAlignmentLog2;
 	outImm.offset = random.get(UINT32_MAX);
+	outImm.memoryIndex = random.get(module.memories.size() - 1);
 }
 
 template<Uptr numLanes>
@@ -0,0 +1,229 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "WAVM/IR/IR.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/CLI.h"
+#include "WAVM/Inline/Config.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASM/WASM.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Instantiates a module compiled with two different configurations, calls its start function and
+// exported functions with arguments derived from the input, and checks that both configurations
+// return the same results or throw the same exceptions.
+
+// The fuel each call may consume before it is stopped, so calls that loop forever stop at the
+// same point in either configuration.
+static constexpr I64 fuelPerCall = 1 << 20;
+
+// The result of calling a function: either the exception it threw, or the values it returned.
+struct CallOutcome
+{
+	std::string description;
+	bool threwException = false;
+	bool overflowedStack = false;
+	ValueTuple results;
+};
+
+static bool hasImports(const IR::Module& irModule)
+{
+	return irModule.functions.imports.size() || irModule.tables.imports.size()
+		   || irModule.memories.imports.size() || irModule.globals.imports.size()
+		   || irModule.exceptionTypes.imports.size();
+}
+
+static bool hasMemory64(const IR::Module& irModule)
+{
+	for(const MemoryDef& memoryDef : irModule.memories.defs)
+	{
+		if(memoryDef.type.indexType == IndexType::i64) { return true; }
+	}
+	return false;
+}
+
+// Derives an argument value from the input bytes: small values are more likely to reach
+// interesting paths, so most arguments are 0, 1 or all ones, and the rest are a hash of the input.
+static UntaggedValue getArgument(const U8* data, Uptr numBytes, Uptr callIndex, Uptr argIndex)
+{
+	const U64 hash = U64(XXH<Uptr>(data, numBytes, Hash<Uptr>()(callIndex, argIndex)));
+	UntaggedValue value;
+	switch(hash & 3)
+	{
+	case 0: value.u64 = 0; break;
+	case 1: value.u64 = 1; break;
+	case 2: value.u64 = UINT64_MAX; break;
+	default: value.u64 = hash >> 2; break;
+	}
+	value.v128.u64[1] = U64(XXH<Uptr>(data, numBytes, Uptr(hash)));
+	return value;
+}
+
+static CallOutcome callFunction(Context* context,
+								FunctionInstance* function,
+								std::vector<Value>&& arguments)
+{
+	CallOutcome outcome;
+	setContextFuel(context, fuelPerCall);
+	catchRuntimeExceptions(
+		[&] { outcome.results = invokeFunctionChecked(context, function, arguments); },
+		[&](Exception&& exception) {
+			outcome.threwException = true;
+			outcome.overflowedStack = exception.typeInstance == Exception::stackOverflowType;
+			outcome.description = describeExceptionType(exception.typeInstance);
+		});
+	return outcome;
+}
+
+static void runModule(const IR::Module& irModule,
+					  const CompileOptions& compileOptions,
+					  const U8* data,
+					  Uptr numBytes,
+					  std::vector<CallOutcome>& outOutcomes)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	{
+		ModuleInstance* moduleInstance = nullptr;
+		CallOutcome instantiateOutcome;
+		catchRuntimeExceptions(
+			[&] {
+				moduleInstance = instantiateModule(
+					compartment, compileModule(irModule, compileOptions), {}, "fuzz");
+			},
+			[&](Exception&& exception) {
+				instantiateOutcome.threwException = true;
+				instantiateOutcome.description = describeExceptionType(exception.typeInstance);
+			});
+		outOutcomes.push_back(std::move(instantiateOutcome));
+
+		if(moduleInstance)
+		{
+			Context* context = createContext(compartment);
+			if(FunctionInstance* startFunction = getStartFunction(moduleInstance))
+			{ outOutcomes.push_back(callFunction(context, startFunction, {})); }
+
+			for(Uptr exportIndex = 0; exportIndex < irModule.exports.size(); ++exportIndex)
+			{
+				const Export& exportIt = irModule.exports[exportIndex];
+				if(exportIt.kind != IR::ObjectKind::function) { continue; }
+
+				FunctionInstance* function
+					= asFunction(getInstanceExport(moduleInstance, exportIt.name));
+				std::vector<Value> arguments;
+				bool hasReferenceParams = false;
+				for(ValueType paramType : getFunctionType(function).params())
+				{
+					hasReferenceParams |= isReferenceType(paramType);
+					arguments.push_back(Value(
+						paramType, getArgument(data, numBytes, exportIndex, arguments.size())));
+				}
+				if(!hasReferenceParams)
+				{ outOutcomes.push_back(callFunction(context, function, std::move(arguments))); }
+			}
+		}
+	}
+	errorUnless(tryCollectCompartment(std::move(compartment)));
+}
+
+// References from different compartments can't be compared, so only their nullness is compared.
+static bool areResultsEqual(const ValueTuple& a, const ValueTuple& b)
+{
+	if(a.size() != b.size()) { return false; }
+	for(Uptr resultIndex = 0; resultIndex < a.size(); ++resultIndex)
+	{
+		if(isReferenceType(a[resultIndex].type) && isReferenceType(b[resultIndex].type))
+		{
+			if(!a[resultIndex].anyRef != !b[resultIndex].anyRef) { return false; }
+		}
+		else if(a[resultIndex] != b[resultIndex])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+extern "C" I32 LLVMFuzzerTestOneInput(const U8* data, Uptr numBytes)
+{
+	IR::Module irModule;
+	irModule.featureSpec.maxLabelsPerFunction = 65536;
+	irModule.featureSpec.maxLocals = 1024;
+	if(!WASM::loadBinaryModule(data, numBytes, irModule, Log::debug)) { return 0; }
+	if(hasImports(irModule)) { return 0; }
+
+	// Both configurations meter fuel and canonicalize NaNs, so the results are deterministic. The
+	// first configuration doesn't optimize, and relies on guard pages to catch out-of-bounds
+	// memory accesses. The second optimizes aggressively, and bounds checks memory accesses if
+	// that doesn't restrict how large the module's memories can grow.
+	CompileOptions referenceOptions;
+	referenceOptions.optimizationLevel = OptimizationLevel::none;
+	referenceOptions.codeGenOptimizationLevel = CodeGenOptimizationLevel::none;
+	referenceOptions.fuelMetering = true;
+	referenceOptions.canonicalizeNaNs = true;
+
+	CompileOptions optimizedOptions;
+	optimizedOptions.optimizationLevel = OptimizationLevel::aggressive;
+	optimizedOptions.fuelMetering = true;
+	optimizedOptions.canonicalizeNaNs = true;
+	if(!hasMemory64(irModule)) { optimizedOptions.maxMemoryReservedBytes = Uptr(4) << 30; }
+
+	std::vector<CallOutcome> referenceOutcomes;
+	std::vector<CallOutcome> optimizedOutcomes;
+	runModule(irModule, referenceOptions, data, numBytes, referenceOutcomes);
+	runModule(irModule, optimizedOptions, data, numBytes, optimizedOutcomes);
+	collectGarbage();
+
+	wavmAssert(referenceOutcomes.size() == optimizedOutcomes.size());
+	for(Uptr callIndex = 0; callIndex < referenceOutcomes.size(); ++callIndex)
+	{
+		const CallOutcome& reference = referenceOutcomes[callIndex];
+		const CallOutcome& optimized = optimizedOutcomes[callIndex];
+
+		// The stack frames are different sizes in either configuration, so a call that overflows
+		// the stack in one may not in the other.
+		if(reference.overflowedStack || optimized.overflowedStack) { break; }
+
+		if(reference.threwException != optimized.threwException
+		   || reference.description != optimized.description
+		   || !areResultsEqual(reference.results, optimized.results))
+		{
+			Errors::fatalf("Call %" PRIuPTR " differs: %s%s without optimization, %s%s with.\n",
+						   callIndex,
+						   reference.description.c_str(),
+						   asString(reference.results).c_str(),
+						   optimized.description.c_str(),
+						   asString(optimized.results).c_str());
+		}
+	}
+
+	return 0;
+}
+
+#if !WAVM_ENABLE_LIBFUZZER
+I32 main(int argc, char** argv)
+{
+	if(argc != 2)
+	{
+		Log::printf(Log::error, "Usage: FuzzDifferential in.wasm\n");
+		return EXIT_FAILURE;
+	}
+	const char* inputFilename = argv[1];
+
+	std::vector<U8> wasmBytes;
+	if(!loadFile(inputFilename, wasmBytes)) { return EXIT_FAILURE; }
+
+	LLVMFuzzerTestOneInput(wasmBytes.data(), wasmBytes.size());
+	return EXIT_SUCCESS;
+}
+#endif
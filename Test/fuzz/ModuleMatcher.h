@@ -71,6 +71,11 @@ namespace WAVM {
 		{
 			if(a.memoryIndex != b.memoryIndex) { failVerification(); }
 		}
+		void verifyMatches(MemoryCopyImm a, MemoryCopyImm b)
+		{
+			if(a.destMemoryIndex != b.destMemoryIndex || a.sourceMemoryIndex != b.sourceMemoryIndex)
+			{ failVerification(); }
+		}
 		void verifyMatches(TableImm a, TableImm b)
 		{
 			if(a.tableIndex != b.tableIndex) { failVerification(); }
@@ -119,7 +124,9 @@ namespace WAVM {
 		void verifyMatches(LoadOrStoreImm<naturalAlignmentLog2> a,
 						   LoadOrStoreImm<naturalAlignmentLog2> b)
 		{
-			if(a.alignmentLog2 != b.alignmentLog2 || a.offset != b.offset) { failVerification(); }
+			if(a.alignmentLog2 != b.alignmentLog2 || a.offset != b.offset
+			   || a.memoryIndex != b.memoryIndex)
+			{ failVerification(); }
 		}
 
 		template<Uptr numLanes>
@@ -140,7 +147,9 @@ namespace WAVM {
 		void verifyMatches(AtomicLoadOrStoreImm<naturalAlignmentLog2> a,
 						   AtomicLoadOrStoreImm<naturalAlignmentLog2> b)
 		{
-			if(a.alignmentLog2 != b.alignmentLog2 || a.offset != b.offset) { failVerification(); }
+			if(a.alignmentLog2 != b.alignmentLog2 || a.offset != b.offset
+			   || a.memoryIndex != b.memoryIndex)
+			{ failVerification(); }
 		}
 
 		void verifyMatches(ExceptionTypeImm a, ExceptionTypeImm b)
@@ -191,13 +200,8 @@ namespace WAVM {
 
 			while(aNextByte < aEnd && bNextByte < bEnd)
 			{
-				wavmAssert(aNextByte + sizeof(Opcode) <= aEnd);
-				wavmAssert(bNextByte + sizeof(Opcode) <= bEnd);
-
-				Opcode aOpcode;
-				Opcode bOpcode;
-				memcpy(&aOpcode, aNextByte, sizeof(Opcode));
-				memcpy(&bOpcode, bNextByte, sizeof(Opcode));
+				const Opcode aOpcode = decodeOpcode(aNextByte);
+				const Opcode bOpcode = decodeOpcode(bNextByte);
 				if(aOpcode != bOpcode) { failVerification(); }
 
 				switch(aOpcode)
@@ -205,15 +209,13 @@ namespace WAVM {
 #define VISIT_OPCODE(opcode, name, nameString, Imm, ...)                                           \
 	case Opcode::name:                                                                             \
 	{                                                                                              \
-		wavmAssert(aNextByte + sizeof(OpcodeAndImm<Imm>) <= aEnd);                                 \
-		wavmAssert(bNextByte + sizeof(OpcodeAndImm<Imm>) <= bEnd);                                 \
-		OpcodeAndImm<Imm> aEncodedOperator;                                                        \
-		OpcodeAndImm<Imm> bEncodedOperator;                                                        \
-		memcpy(&aEncodedOperator, aNextByte, sizeof(OpcodeAndImm<Imm>));                           \
-		memcpy(&bEncodedOperator, bNextByte, sizeof(OpcodeAndImm<Imm>));                           \
-		aNextByte += sizeof(OpcodeAndImm<Imm>);                                                    \
-		bNextByte += sizeof(OpcodeAndImm<Imm>);                                                    \
-		verifyMatches(aEncodedOperator.imm, bEncodedOperator.imm);                                 \
+		Imm aImm;                                                                                  \
+		Imm bImm;                                                                                  \
+		decodeImm(aNextByte, aImm);                                                                \
+		decodeImm(bNextByte, bImm);                                                                \
+		wavmAssert(aNextByte <= aEnd);                                                             \
+		wavmAssert(bNextByte <= bEnd);                                                             \
+		verifyMatches(aImm, bImm);                                                                 \
 		break;                                                                                     \
 	}
 					ENUM_OPERATORS(VISIT_OPCODE)
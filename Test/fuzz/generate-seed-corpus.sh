@@ -16,10 +16,10 @@ mkdir wast-seed-corpus
 
 find $WAVM_DIR/Test \
   -iname *.wast -not -iname skip-stack-guard-page.wast -not -iname br_table.wast \
-  | ASAN_OPTIONS=detect_leaks=0 xargs -n1 bin/DumpTestModules --wast --output-dir ./wast-seed-corpus 
+  | ASAN_OPTIONS=detect_leaks=0 xargs bin/DumpTestModules --wast --output-dir ./wast-seed-corpus 
 
 mkdir wasm-seed-corpus
 
 find $WAVM_DIR/Test \
   -iname *.wast -not -iname skip-stack-guard-page.wast -not -iname br_table.wast \
-  | ASAN_OPTIONS=detect_leaks=0 xargs -n1 bin/DumpTestModules --wasm --output-dir ./wasm-seed-corpus 
+  | ASAN_OPTIONS=detect_leaks=0 xargs bin/DumpTestModules --wasm --output-dir ./wasm-seed-corpus 
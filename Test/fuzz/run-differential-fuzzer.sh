@@ -0,0 +1,22 @@
+#!/bin/bash
+
+set -v
+
+BUILD_DIR=$(pwd)
+WAVM_DIR=$(cd `dirname $0`/../.. && pwd)
+
+cd $BUILD_DIR
+
+ninja
+
+mkdir differential-corpus
+
+ASAN_OPTIONS=detect_leaks=0 bin/FuzzDifferential -use_value_profile=1 \
+  -workers=36 \
+  -jobs=36 \
+  -detect_leaks=0 \
+  -rss_limit_mb=4096 \
+  differential-corpus \
+	compile-corpus \
+	wasm-corpus \
+	wasm-seed-corpus
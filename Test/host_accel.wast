@@ -0,0 +1,119 @@
+(module
+
+	(import "hostAccel" "blake2b" (func $blake2b (param i32 i32 i32 i32)))
+	(import "hostAccel" "sha256" (func $sha256 (param i32 i32 i32)))
+	(import "hostAccel" "crc32c" (func $crc32c (param i32 i32 i32) (result i32)))
+	(import "hostAccel" "lz4_compress" (func $lz4_compress (param i32 i32 i32 i32) (result i32)))
+	(import "hostAccel" "lz4_decompress" (func $lz4_decompress (param i32 i32 i32 i32) (result i32)))
+
+	(memory (export "memory") 1)
+
+	(data (i32.const 0) "abc")
+	(data (i32.const 16) "123456789")
+
+	(global $digestAddress i32 (i32.const 256))
+	(global $uncompressedAddress i32 (i32.const 4096))
+	(global $compressedAddress i32 (i32.const 16384))
+	(global $decompressedAddress i32 (i32.const 32768))
+
+	(func (export "blake2b abc") (param $digestWordIndex i32) (result i64)
+		(call $blake2b (i32.const 0) (i32.const 3) (get_global $digestAddress) (i32.const 64))
+		(i64.load (i32.add (get_global $digestAddress)
+			(i32.shl (get_local $digestWordIndex) (i32.const 3))))
+		)
+
+	(func (export "blake2b") (param $address i32) (param $numBytes i32) (param $numDigestBytes i32)
+		(call $blake2b
+			(get_local $address) (get_local $numBytes) (get_global $digestAddress) (get_local $numDigestBytes))
+		)
+
+	(func (export "sha256 abc") (param $digestWordIndex i32) (result i64)
+		(call $sha256 (i32.const 0) (i32.const 3) (get_global $digestAddress))
+		(i64.load (i32.add (get_global $digestAddress)
+			(i32.shl (get_local $digestWordIndex) (i32.const 3))))
+		)
+
+	(func (export "sha256") (param $address i32) (param $numBytes i32) (param $digestAddress i32)
+		(call $sha256 (get_local $address) (get_local $numBytes) (get_local $digestAddress))
+		)
+
+	(func (export "crc32c") (param $crc i32) (param $address i32) (param $numBytes i32) (result i32)
+		(call $crc32c (get_local $crc) (get_local $address) (get_local $numBytes))
+		)
+
+	;; Fills the uncompressed buffer with a repetitive pattern of 4096 bytes.
+	(func $initUncompressed
+		(local $i i32)
+		loop $loop
+			(i32.store8 (i32.add (get_global $uncompressedAddress) (get_local $i))
+				(i32.rem_u (i32.mul (get_local $i) (get_local $i)) (i32.const 251)))
+			(set_local $i (i32.add (get_local $i) (i32.const 1)))
+			(br_if $loop (i32.lt_u (get_local $i) (i32.const 4096)))
+		end
+		)
+
+	;; Compresses and decompresses the pattern, and returns the number of decompressed bytes, or -2
+	;; if they don't match the pattern.
+	(func (export "lz4 round trip") (result i32)
+		(local $numCompressedBytes i32)
+		(local $numDecompressedBytes i32)
+		(local $i i32)
+		(call $initUncompressed)
+		(set_local $numCompressedBytes
+			(call $lz4_compress
+				(get_global $uncompressedAddress) (i32.const 4096) (get_global $compressedAddress) (i32.const 8192)))
+		(set_local $numDecompressedBytes
+			(call $lz4_decompress
+				(get_global $compressedAddress) (get_local $numCompressedBytes)
+				(get_global $decompressedAddress) (i32.const 8192)))
+		block $done
+			loop $loop
+				(br_if $done (i32.ge_u (get_local $i) (get_local $numDecompressedBytes)))
+				(i32.ne (i32.load8_u (i32.add (get_global $uncompressedAddress) (get_local $i)))
+						(i32.load8_u (i32.add (get_global $decompressedAddress) (get_local $i))))
+				if
+					(return (i32.const -2))
+				end
+				(set_local $i (i32.add (get_local $i) (i32.const 1)))
+				br $loop
+			end
+		end
+		(get_local $numDecompressedBytes)
+		)
+
+	(func (export "lz4 compress") (param $numBytes i32) (param $outNumBytes i32) (result i32)
+		(call $initUncompressed)
+		(call $lz4_compress
+			(get_global $uncompressedAddress) (get_local $numBytes)
+			(get_global $compressedAddress) (get_local $outNumBytes))
+		)
+
+	(func (export "lz4 decompress") (param $numBytes i32) (param $outNumBytes i32) (result i32)
+		(call $lz4_decompress
+			(get_global $compressedAddress) (get_local $numBytes)
+			(get_global $decompressedAddress) (get_local $outNumBytes))
+		)
+)
+
+(assert_return (invoke "blake2b abc" (i32.const 0)) (i64.const 0x0d4d1c983fa580ba))
+(assert_return (invoke "blake2b abc" (i32.const 7)) (i64.const 0x239900d4ed8623b9))
+(assert_trap (invoke "blake2b" (i32.const 0) (i32.const 3) (i32.const 0)) "invalid argument")
+(assert_trap (invoke "blake2b" (i32.const 0) (i32.const 3) (i32.const 65)) "invalid argument")
+(assert_trap (invoke "blake2b" (i32.const 65535) (i32.const 2) (i32.const 64))
+	"out of bounds memory access")
+
+(assert_return (invoke "sha256 abc" (i32.const 0)) (i64.const 0xeacf018fbf1678ba))
+(assert_return (invoke "sha256 abc" (i32.const 3)) (i64.const 0xad1500f261ff10b4))
+(assert_trap (invoke "sha256" (i32.const 0) (i32.const 3) (i32.const 65505))
+	"out of bounds memory access")
+
+(assert_return (invoke "crc32c" (i32.const 0) (i32.const 16) (i32.const 9)) (i32.const 0xe3069283))
+(assert_return (invoke "crc32c" (i32.const 0) (i32.const 16) (i32.const 0)) (i32.const 0))
+(assert_trap (invoke "crc32c" (i32.const 0) (i32.const 65536) (i32.const 1))
+	"out of bounds memory access")
+
+(assert_return (invoke "lz4 round trip") (i32.const 4096))
+(assert_return (invoke "lz4 compress" (i32.const 4096) (i32.const 16)) (i32.const -1))
+(assert_return (invoke "lz4 compress" (i32.const 0) (i32.const 16)) (i32.const 9))
+(assert_return (invoke "lz4 decompress" (i32.const 9) (i32.const 0)) (i32.const 0))
+(assert_return (invoke "lz4 decompress" (i32.const 4) (i32.const 8192)) (i32.const -1))
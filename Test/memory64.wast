@@ -0,0 +1,79 @@
+;; 64-bit memories
+
+(module
+	(memory i64 1 4)
+	(data (i64.const 8) "abcd")
+
+	(func (export "load8_u") (param $address i64) (result i32)
+		(i32.load8_u (get_local $address)))
+	(func (export "store8") (param $address i64) (param $value i32)
+		(i32.store8 (get_local $address) (get_local $value)))
+	(func (export "load32 offset") (param $address i64) (result i32)
+		(i32.load offset=4 (get_local $address)))
+	(func (export "load32 far offset") (param $address i64) (result i32)
+		(i32.load offset=0x100000000 (get_local $address)))
+	(func (export "load32 max offset") (param $address i64) (result i32)
+		(i32.load offset=0xffffffffffffffff (get_local $address)))
+	(func (export "size") (result i64) (memory.size))
+	(func (export "grow") (param $delta i64) (result i64) (memory.grow (get_local $delta)))
+	(func (export "fill") (param $address i64) (param $value i32) (param $numBytes i64)
+		(memory.fill (get_local $address) (get_local $value) (get_local $numBytes)))
+	(func (export "copy") (param $dest i64) (param $source i64) (param $numBytes i64)
+		(memory.copy (get_local $dest) (get_local $source) (get_local $numBytes)))
+)
+
+(assert_return (invoke "load8_u" (i64.const 8)) (i32.const 0x61))
+(assert_return (invoke "load32 offset" (i64.const 4)) (i32.const 0x64636261))
+(assert_return (invoke "load8_u" (i64.const 65535)) (i32.const 0))
+(assert_trap (invoke "load8_u" (i64.const 65536)) "out of bounds memory access")
+(assert_trap (invoke "load8_u" (i64.const 0x100000000)) "out of bounds memory access")
+(assert_trap (invoke "load8_u" (i64.const -1)) "out of bounds memory access")
+(assert_trap (invoke "load32 offset" (i64.const 65532)) "out of bounds memory access")
+(assert_trap (invoke "load32 offset" (i64.const -4)) "out of bounds memory access")
+(assert_trap (invoke "load32 far offset" (i64.const 0)) "out of bounds memory access")
+(assert_trap (invoke "load32 max offset" (i64.const 1)) "out of bounds memory access")
+(assert_trap (invoke "store8" (i64.const -1) (i32.const 0)) "out of bounds memory access")
+
+(assert_return (invoke "size") (i64.const 1))
+(assert_return (invoke "grow" (i64.const 1)) (i64.const 1))
+(assert_return (invoke "size") (i64.const 2))
+(assert_return (invoke "load8_u" (i64.const 65536)) (i32.const 0))
+(assert_return (invoke "grow" (i64.const 3)) (i64.const -1))
+(assert_return (invoke "grow" (i64.const 0x100000001)) (i64.const -1))
+(assert_return (invoke "size") (i64.const 2))
+
+(invoke "fill" (i64.const 0x10000) (i32.const 0x7a) (i64.const 4))
+(assert_return (invoke "load8_u" (i64.const 0x10003)) (i32.const 0x7a))
+(invoke "copy" (i64.const 0x10008) (i64.const 8) (i64.const 4))
+(assert_return (invoke "load32 offset" (i64.const 0x10004)) (i32.const 0x64636261))
+(assert_trap (invoke "fill" (i64.const -1) (i32.const 0) (i64.const 1)) "out of bounds memory access")
+(assert_trap (invoke "copy" (i64.const 0) (i64.const 8) (i64.const -1)) "out of bounds memory access")
+
+;; Data segments of 64-bit memories have i64 base offsets.
+
+(assert_invalid
+	(module (memory i64 1) (data (i32.const 0) "a"))
+	"type mismatch"
+)
+
+(assert_trap
+	(module (memory i64 1) (data (i64.const 0x100000000) "a"))
+	"out of bounds memory access"
+)
+
+;; 64-bit memories are accessed with i64 addresses.
+
+(assert_invalid
+	(module (memory i64 1) (func (drop (i32.load (i32.const 0)))))
+	"type mismatch"
+)
+
+(assert_invalid
+	(module (memory 1) (func (drop (i32.load (i64.const 0)))))
+	"type mismatch"
+)
+
+(assert_invalid
+	(module (memory 1) (func (drop (i32.load offset=0x100000000 (i32.const 0)))))
+	"offset too large"
+)
@@ -361,4 +361,90 @@
 		"\00"
 		)
 	"expected '('"
-	)
\ No newline at end of file
+	)
+;; Multi-value results that are returned in registers or in the context's return memory, depending
+;; on how many integer and floating-point/vector results there are.
+
+(module
+	(func $ints (result i32 i64 i32) (i32.const 1) (i64.const 2) (i32.const 3))
+	(func $floats (result f32 f64) (f32.const 4) (f64.const 5))
+	(func $mixed (result i32 f64 i64 f32 i32) (i32.const 6) (f64.const 7) (i64.const 8) (f32.const 9) (i32.const 10))
+	(func $too_many_ints (result i64 i64 i64 i64) (i64.const 11) (i64.const 12) (i64.const 13) (i64.const 14))
+	(func $too_many_floats (result f64 f64 f64) (f64.const 15) (f64.const 16) (f64.const 17))
+
+	(func (export "ints") (result i32 i64 i32) (call $ints))
+	(func (export "floats") (result f32 f64) (call $floats))
+	(func (export "mixed") (result i32 f64 i64 f32 i32) (call $mixed))
+	(func (export "too_many_ints") (result i64 i64 i64 i64) (call $too_many_ints))
+	(func (export "too_many_floats") (result f64 f64 f64) (call $too_many_floats))
+)
+
+(assert_return (invoke "ints") (i32.const 1) (i64.const 2) (i32.const 3))
+(assert_return (invoke "floats") (f32.const 4) (f64.const 5))
+(assert_return (invoke "mixed") (i32.const 6) (f64.const 7) (i64.const 8) (f32.const 9) (i32.const 10))
+(assert_return (invoke "too_many_ints") (i64.const 11) (i64.const 12) (i64.const 13) (i64.const 14))
+(assert_return (invoke "too_many_floats") (f64.const 15) (f64.const 16) (f64.const 17))
+
+;; call_indirect on tables whose address-space reservation is sized by their maximum size.
+
+(module
+	(type $v (func))
+	(table (export "table") 2 4 anyfunc)
+	(func (export "call_indirect") (param i32) (call_indirect (type $v) (get_local 0)))
+)
+
+(register "bounded_table")
+
+(assert_trap (invoke "call_indirect" (i32.const 1)) "uninitialized element")
+(assert_trap (invoke "call_indirect" (i32.const 2)) "undefined element")
+(assert_trap (invoke "call_indirect" (i32.const 4)) "undefined element")
+(assert_trap (invoke "call_indirect" (i32.const 100000)) "undefined element")
+(assert_trap (invoke "call_indirect" (i32.const -1)) "undefined element")
+
+(module
+	(type $v (func))
+	(import "bounded_table" "table" (table 2 anyfunc))
+	(func (export "call_indirect") (param i32) (call_indirect (type $v) (get_local 0)))
+)
+
+(assert_trap (invoke "call_indirect" (i32.const 1)) "uninitialized element")
+(assert_trap (invoke "call_indirect" (i32.const 4)) "undefined element")
+(assert_trap (invoke "call_indirect" (i32.const 100000)) "undefined element")
+(assert_trap (invoke "call_indirect" (i32.const -1)) "undefined element")
+
+;; Invoking a function whose arguments don't fit in the context's thunk argument buffer.
+
+(module
+	(func (export "many_args") (param i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64 i64) (result i64)
+		(i64.add (get_local 0) (get_local 39))
+	)
+)
+
+(assert_return (invoke "many_args" (i64.const 1) (i64.const 2) (i64.const 3) (i64.const 4) (i64.const 5) (i64.const 6) (i64.const 7) (i64.const 8) (i64.const 9) (i64.const 10) (i64.const 11) (i64.const 12) (i64.const 13) (i64.const 14) (i64.const 15) (i64.const 16) (i64.const 17) (i64.const 18) (i64.const 19) (i64.const 20) (i64.const 21) (i64.const 22) (i64.const 23) (i64.const 24) (i64.const 25) (i64.const 26) (i64.const 27) (i64.const 28) (i64.const 29) (i64.const 30) (i64.const 31) (i64.const 32) (i64.const 33) (i64.const 34) (i64.const 35) (i64.const 36) (i64.const 37) (i64.const 38) (i64.const 39) (i64.const 40)) (i64.const 41))
+
+;; Identical function definitions are compiled once, but are still distinct functions. Function
+;; definitions whose code only differs in their branch tables aren't identical.
+
+(module
+	(type $i (func (param i32) (result i32)))
+	(table anyfunc (elem $a $b $c))
+	(func $a (export "a") (type $i) (i32.mul (get_local 0) (i32.const 3)))
+	(func $b (export "b") (type $i) (i32.mul (get_local 0) (i32.const 3)))
+	(func $c (export "c") (type $i)
+		(block (block (br_table 0 1 (get_local 0))) (return (i32.const 1)))
+		(i32.const 2)
+	)
+	(func $d (export "d") (type $i)
+		(block (block (br_table 1 0 (get_local 0))) (return (i32.const 1)))
+		(i32.const 2)
+	)
+	(func (export "call_indirect") (param i32 i32) (result i32)
+		(call_indirect (type $i) (get_local 1) (get_local 0)))
+)
+
+(assert_return (invoke "a" (i32.const 5)) (i32.const 15))
+(assert_return (invoke "b" (i32.const 5)) (i32.const 15))
+(assert_return (invoke "c" (i32.const 0)) (i32.const 1))
+(assert_return (invoke "d" (i32.const 0)) (i32.const 2))
+(assert_return (invoke "call_indirect" (i32.const 1) (i32.const 7)) (i32.const 21))
+(assert_return (invoke "call_indirect" (i32.const 2) (i32.const 1)) (i32.const 2))
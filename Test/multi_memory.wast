@@ -0,0 +1,122 @@
+;; Multiple memories
+
+(module
+	(memory $a 1)
+	(memory $b 1 2)
+	(data $a (i32.const 0) "abcd")
+	(data $b (i32.const 0) "efgh")
+
+	(func (export "load a") (param $address i32) (result i32)
+		(i32.load8_u $a (get_local $address)))
+	(func (export "load b") (param $address i32) (result i32)
+		(i32.load8_u $b (get_local $address)))
+	(func (export "load32 b offset") (param $address i32) (result i32)
+		(i32.load $b offset=4 (get_local $address)))
+	(func (export "store b") (param $address i32) (param $value i32)
+		(i32.store8 $b (get_local $address) (get_local $value)))
+	(func (export "store a load b") (param $address i32) (param $value i32) (result i32)
+		(i32.store8 $a (get_local $address) (get_local $value))
+		(i32.load8_u $b (get_local $address)))
+	(func (export "size a") (result i32) (memory.size $a))
+	(func (export "size b") (result i32) (memory.size $b))
+	(func (export "grow b") (param $delta i32) (result i32) (memory.grow $b (get_local $delta)))
+	(func (export "fill b") (param $address i32) (param $value i32) (param $numBytes i32)
+		(memory.fill $b (get_local $address) (get_local $value) (get_local $numBytes)))
+	(func (export "copy b to a") (param $dest i32) (param $source i32) (param $numBytes i32)
+		(memory.copy $a $b (get_local $dest) (get_local $source) (get_local $numBytes)))
+	(func (export "copy 4 b to a") (param $dest i32) (param $source i32)
+		(memory.copy $a $b (get_local $dest) (get_local $source) (i32.const 4)))
+)
+
+(assert_return (invoke "load a" (i32.const 0)) (i32.const 0x61))
+(assert_return (invoke "load b" (i32.const 0)) (i32.const 0x65))
+(assert_return (invoke "store a load b" (i32.const 1) (i32.const 0x7a)) (i32.const 0x66))
+(assert_return (invoke "load a" (i32.const 1)) (i32.const 0x7a))
+(invoke "store b" (i32.const 2) (i32.const 0x79))
+(assert_return (invoke "load b" (i32.const 2)) (i32.const 0x79))
+(assert_return (invoke "load a" (i32.const 2)) (i32.const 0x63))
+(assert_trap (invoke "load32 b offset" (i32.const -4)) "out of bounds memory access")
+
+(assert_return (invoke "size a") (i32.const 1))
+(assert_return (invoke "size b") (i32.const 1))
+(assert_trap (invoke "load b" (i32.const 65536)) "out of bounds memory access")
+(assert_return (invoke "grow b" (i32.const 1)) (i32.const 1))
+(assert_return (invoke "size a") (i32.const 1))
+(assert_return (invoke "size b") (i32.const 2))
+(assert_return (invoke "load b" (i32.const 65536)) (i32.const 0))
+(assert_trap (invoke "load a" (i32.const 65536)) "out of bounds memory access")
+(assert_return (invoke "grow b" (i32.const 1)) (i32.const -1))
+
+(invoke "fill b" (i32.const 0x10000) (i32.const 0x71) (i32.const 4))
+(invoke "copy b to a" (i32.const 8) (i32.const 0xfffe) (i32.const 4))
+(assert_return (invoke "load a" (i32.const 9)) (i32.const 0))
+(assert_return (invoke "load a" (i32.const 10)) (i32.const 0x71))
+(invoke "copy 4 b to a" (i32.const 16) (i32.const 0))
+(assert_return (invoke "load a" (i32.const 18)) (i32.const 0x79))
+(assert_trap (invoke "copy b to a" (i32.const 0xfffe) (i32.const 0) (i32.const 4))
+	"out of bounds memory access")
+(assert_trap (invoke "copy 4 b to a" (i32.const 0) (i32.const 0x1fffe))
+	"out of bounds memory access")
+
+;; Copies between a 32-bit and a 64-bit memory use each memory's index type for its address.
+
+(module
+	(memory $a 1)
+	(memory $b i64 1)
+	(data $b (i64.const 0) "abcd")
+
+	(func (export "copy b to a") (param $dest i32) (param $source i64) (param $numBytes i32)
+		(memory.copy $a $b (get_local $dest) (get_local $source) (get_local $numBytes)))
+	(func (export "load a") (param $address i32) (result i32)
+		(i32.load8_u $a (get_local $address)))
+)
+
+(invoke "copy b to a" (i32.const 4) (i64.const 0) (i32.const 4))
+(assert_return (invoke "load a" (i32.const 7)) (i32.const 0x64))
+(assert_trap (invoke "copy b to a" (i32.const 0) (i64.const 0x100000000) (i32.const 1))
+	"out of bounds memory access")
+
+;; The memory index of a load or store follows its alignment in the binary format if bit 6 of
+;; the alignment is set.
+
+(module binary
+	"\00asm" "\01\00\00\00"              ;; WebAssembly version 1
+	"\01\05\01"                          ;; type section: 5 bytes, 1 entry
+	"\60\00\01\7f"                       ;;   (func (result i32))
+	"\03\02\01"                          ;; function section: 2 bytes, 1 entry
+	"\00"                                ;;   [0] type 0
+	"\05\05\02"                          ;; memory section: 5 bytes, 2 entries
+	"\00\01"                             ;;   (memory 1)
+	"\00\01"                             ;;   (memory 1)
+	"\07\08\01"                          ;; export section: 8 bytes, 1 entry
+	"\04load\00\00"                      ;;   (export "load" (func 0))
+	"\0a\0a\01"                          ;; code section: 10 bytes, 1 entry
+	"\08\00"                             ;;   [0] 8 bytes, no locals
+	"\41\00"                             ;;     i32.const 0
+	"\28\42\01\00"                       ;;     i32.load align=4 memory=1 offset=0
+	"\0b"                                ;;     end
+	"\0b\09\01"                          ;; data section: 9 bytes, 1 entry
+	"\01"                                ;;   [0] active data segment, memory 1
+	"\41\00\0b"                          ;;     base offset (i32.const 0)
+	"\03abc"                             ;;     3 bytes of data
+)
+
+(assert_return (invoke "load") (i32.const 0x636261))
+
+(assert_invalid
+	(module binary
+		"\00asm" "\01\00\00\00"              ;; WebAssembly version 1
+		"\01\05\01"                          ;; type section: 5 bytes, 1 entry
+		"\60\00\01\7f"                       ;;   (func (result i32))
+		"\03\02\01"                          ;; function section: 2 bytes, 1 entry
+		"\00"                                ;;   [0] type 0
+		"\05\03\01"                          ;; memory section: 3 bytes, 1 entry
+		"\00\01"                             ;;   (memory 1)
+		"\0a\0a\01"                          ;; code section: 10 bytes, 1 entry
+		"\08\00"                             ;;   [0] 8 bytes, no locals
+		"\41\00"                             ;;     i32.const 0
+		"\28\42\01\00"                       ;;     i32.load align=4 memory=1 offset=0
+		"\0b"                                ;;     end
+	)
+	"unknown memory"
+)
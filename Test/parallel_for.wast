@@ -0,0 +1,87 @@
+(module
+
+	(import "parallelFor" "parallel_for" (func $parallel_for (param anyfunc i32 i32 i32)))
+
+	(memory 1 1 shared)
+
+	(global $atomicAccumulatorAddress i32 (i32.const 0))
+	(global $atomicRangeCountAddress i32 (i32.const 8))
+
+	(func $initAccumulator
+		(i64.atomic.store (get_global $atomicAccumulatorAddress) (i64.const 0))
+		(i64.atomic.store (get_global $atomicRangeCountAddress) (i64.const 0))
+		)
+
+	(func $getAccumulator (result i64) (i64.atomic.load (get_global $atomicAccumulatorAddress)))
+	(func $getRangeCount (result i64) (i64.atomic.load (get_global $atomicRangeCountAddress)))
+
+	;; Adds the indices in [begin, end) to the accumulator, and counts the range.
+	(func $sumRange (param $begin i32) (param $end i32)
+		(local $sum i64)
+		block $done
+			loop $loop
+				(br_if $done (i32.ge_s (get_local $begin) (get_local $end)))
+				(set_local $sum (i64.add (get_local $sum) (i64.extend_s/i32 (get_local $begin))))
+				(set_local $begin (i32.add (get_local $begin) (i32.const 1)))
+				br $loop
+			end
+		end
+		(drop (i64.atomic.rmw.add (get_global $atomicAccumulatorAddress) (get_local $sum)))
+		(drop (i64.atomic.rmw.add (get_global $atomicRangeCountAddress) (i64.const 1)))
+		)
+
+	;; Traps for the range that contains index 5000.
+	(func $trapAt5000 (param $begin i32) (param $end i32)
+		(i32.and (i32.le_s (get_local $begin) (i32.const 5000))
+		         (i32.gt_s (get_local $end) (i32.const 5000)))
+		if
+			unreachable
+		end
+		)
+
+	(func $wrongType (param $begin i32) (result i32) (get_local $begin))
+
+	(func (export "sum") (param $begin i32) (param $end i32) (param $grain i32) (result i64)
+		(call $initAccumulator)
+		(call $parallel_for
+			(ref.func $sumRange) (get_local $begin) (get_local $end) (get_local $grain))
+		(call $getAccumulator)
+		)
+
+	(func (export "rangeCount") (param $begin i32) (param $end i32) (param $grain i32) (result i64)
+		(call $initAccumulator)
+		(call $parallel_for
+			(ref.func $sumRange) (get_local $begin) (get_local $end) (get_local $grain))
+		(call $getRangeCount)
+		)
+
+	(func (export "trap") (param $grain i32)
+		(call $parallel_for
+			(ref.func $trapAt5000) (i32.const 0) (i32.const 10000) (get_local $grain))
+		)
+
+	(func (export "wrongType")
+		(call $parallel_for (ref.func $wrongType) (i32.const 0) (i32.const 10) (i32.const 1))
+		)
+
+	(func (export "null")
+		(call $parallel_for (ref.null) (i32.const 0) (i32.const 10) (i32.const 1))
+		)
+)
+
+(assert_return (invoke "sum" (i32.const 0) (i32.const 10000) (i32.const 7)) (i64.const 49995000))
+(assert_return (invoke "sum" (i32.const 0) (i32.const 10000) (i32.const 100000))
+	(i64.const 49995000))
+(assert_return (invoke "sum" (i32.const -100) (i32.const 101) (i32.const 1)) (i64.const 0))
+(assert_return (invoke "sum" (i32.const 5) (i32.const 5) (i32.const 1)) (i64.const 0))
+(assert_return (invoke "sum" (i32.const 5) (i32.const 0) (i32.const 1)) (i64.const 0))
+(assert_return (invoke "sum" (i32.const 2147483640) (i32.const 2147483647) (i32.const 3))
+	(i64.const 15032385501))
+(assert_return (invoke "rangeCount" (i32.const 0) (i32.const 1000) (i32.const 10)) (i64.const 100))
+(assert_return (invoke "rangeCount" (i32.const 0) (i32.const 1001) (i32.const 10)) (i64.const 101))
+
+(assert_trap (invoke "trap" (i32.const 1)) "unreachable")
+(assert_trap (invoke "trap" (i32.const 64)) "unreachable")
+(assert_trap (invoke "sum" (i32.const 0) (i32.const 10) (i32.const 0)) "invalid argument")
+(assert_trap (invoke "wrongType") "indirect call signature mismatch")
+(assert_trap (invoke "null") "indirect call signature mismatch")
@@ -342,6 +342,15 @@
   (func (export "i64x2.any_true") (param $a v128) (result i32) (i64x2.any_true (get_local $a)))
 )
 
+(assert_return (invoke "i8x16.any_true" (v128.const i32 0 0 0 0)) (i32.const 0))
+(assert_return (invoke "i8x16.any_true" (v128.const i32 0 0 0x100 0)) (i32.const 1))
+(assert_return (invoke "i16x8.any_true" (v128.const i32 0 0 0 0)) (i32.const 0))
+(assert_return (invoke "i16x8.any_true" (v128.const i32 0x80000000 0 0 0)) (i32.const 1))
+(assert_return (invoke "i32x4.any_true" (v128.const i32 0 0 0 0)) (i32.const 0))
+(assert_return (invoke "i32x4.any_true" (v128.const i32 0 0 0 1)) (i32.const 1))
+(assert_return (invoke "i64x2.any_true" (v128.const i32 0 0 0 0)) (i32.const 0))
+(assert_return (invoke "i64x2.any_true" (v128.const i32 0 0 0x10000 0)) (i32.const 1))
+
 (module
   (func (export "i8x16.all_true") (param $a v128) (result i32) (i8x16.all_true (get_local $a)))
   (func (export "i16x8.all_true") (param $a v128) (result i32) (i16x8.all_true (get_local $a)))
@@ -349,6 +358,15 @@
   (func (export "i64x2.all_true") (param $a v128) (result i32) (i64x2.all_true (get_local $a)))
 )
 
+(assert_return (invoke "i8x16.all_true" (v128.const i32 0x01010101 0x01010101 0x01010101 0x01010101)) (i32.const 1))
+(assert_return (invoke "i8x16.all_true" (v128.const i32 0x01010101 0x01010101 0x01000101 0x01010101)) (i32.const 0))
+(assert_return (invoke "i16x8.all_true" (v128.const i32 0x00010100 0x00010100 0x00010100 0x00010100)) (i32.const 1))
+(assert_return (invoke "i16x8.all_true" (v128.const i32 0x00010100 0x00010100 0x00010100 0x01000000)) (i32.const 0))
+(assert_return (invoke "i32x4.all_true" (v128.const i32 1 0x100 0x10000 0x80000000)) (i32.const 1))
+(assert_return (invoke "i32x4.all_true" (v128.const i32 1 0x100 0 0x80000000)) (i32.const 0))
+(assert_return (invoke "i64x2.all_true" (v128.const i32 0 1 1 0)) (i32.const 1))
+(assert_return (invoke "i64x2.all_true" (v128.const i32 1 1 0 0)) (i32.const 0))
+
 (module
   (func (export "i8x16.eq") (param $a v128) (param $b v128) (result v128) (i8x16.eq (get_local $a) (get_local $b)))
   (func (export "i16x8.eq") (param $a v128) (param $b v128) (result v128) (i16x8.eq (get_local $a) (get_local $b)))
@@ -491,7 +509,10 @@
   (invoke "i32x4.trunc_s:sat/f32x4" (f32.const -inf))
   (v128.const i32 -2147483648 -2147483648 -2147483648 -2147483648))
   
-(; not yet working correctly
+(assert_return
+  (invoke "i32x4.trunc_s:sat/f32x4" (f32.const 2147483648.0))
+  (v128.const i32 2147483647 2147483647 2147483647 2147483647))
+
 (assert_return
   (invoke "i32x4.trunc_s:sat/f32x4" (f32.const +inf))
   (v128.const i32 2147483647 2147483647 2147483647 2147483647))
@@ -499,7 +520,6 @@
 (assert_return
   (invoke "i32x4.trunc_s:sat/f32x4" (f32.const nan))
   (v128.const i32 0 0 0 0))
-;)
   
 ;; i32x4.trunc_u:sat/f32x4
 
@@ -45,6 +45,11 @@ public:
   static pint_t findFDE(pint_t mh, pint_t pc);
   static void add(pint_t mh, pint_t ip_start, pint_t ip_end, pint_t fde);
   static void removeAllIn(pint_t mh);
+  // Returns a counter that is incremented whenever entries are removed, so
+  // callers may cache the results of findFDE until it changes.
+  static unsigned getGeneration() {
+    return __atomic_load_n(&_generation, __ATOMIC_ACQUIRE);
+  }
   static void iterateCacheEntries(void (*func)(unw_word_t ip_start,
                                                unw_word_t ip_end,
                                                unw_word_t fde, unw_word_t mh));
@@ -65,7 +70,9 @@ private:
   static void dyldUnloadHook(const struct mach_header *mh, intptr_t slide);
   static bool _registeredForDyldUnloads;
 #endif
+  static unsigned _generation;
   // Can't use std::vector<> here because this code is below libc++.
+  // The entries are sorted by ip_start, and don't overlap.
   static entry *_buffer;
   static entry *_bufferUsed;
   static entry *_bufferEnd;
@@ -90,6 +97,9 @@ typename DwarfFDECache<A>::entry DwarfFDECache<A>::_initialBuffer[64];
 template <typename A>
 RWMutex DwarfFDECache<A>::_lock;
 
+template <typename A>
+unsigned DwarfFDECache<A>::_generation = 0;
+
 #ifdef __APPLE__
 template <typename A>
 bool DwarfFDECache<A>::_registeredForDyldUnloads = false;
@@ -99,14 +109,24 @@ template <typename A>
 typename A::pint_t DwarfFDECache<A>::findFDE(pint_t mh, pint_t pc) {
   pint_t result = 0;
   _LIBUNWIND_LOG_IF_FALSE(_lock.lock_shared());
-  for (entry *p = _buffer; p < _bufferUsed; ++p) {
-    if ((mh == p->mh) || (mh == 0)) {
-      if ((p->ip_start <= pc) && (pc < p->ip_end)) {
-        result = p->fde;
-        break;
-      }
+  // Binary search for the first entry that starts after pc. Since the entries
+  // don't overlap, only the entry before it may contain pc.
+  entry *first = _buffer;
+  size_t count = (size_t)(_bufferUsed - _buffer);
+  while (count > 0) {
+    size_t half = count / 2;
+    if (first[half].ip_start <= pc) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
     }
   }
+  if (first > _buffer) {
+    entry *p = first - 1;
+    if (((mh == p->mh) || (mh == 0)) && (pc < p->ip_end))
+      result = p->fde;
+  }
   _LIBUNWIND_LOG_IF_FALSE(_lock.unlock_shared());
   return result;
 }
@@ -128,10 +148,17 @@ void DwarfFDECache<A>::add(pint_t mh, pint_t ip_start, pint_t ip_end,
     _bufferUsed = &newBuffer[oldSize];
     _bufferEnd = &newBuffer[newSize];
   }
-  _bufferUsed->mh = mh;
-  _bufferUsed->ip_start = ip_start;
-  _bufferUsed->ip_end = ip_end;
-  _bufferUsed->fde = fde;
+  // Insert the entry in ip_start order. JIT code is usually registered in
+  // increasing address order, so this is usually an append.
+  entry *insertAt = _bufferUsed;
+  while ((insertAt > _buffer) && (insertAt[-1].ip_start > ip_start))
+    --insertAt;
+  memmove(insertAt + 1, insertAt,
+          (size_t)(_bufferUsed - insertAt) * sizeof(entry));
+  insertAt->mh = mh;
+  insertAt->ip_start = ip_start;
+  insertAt->ip_end = ip_end;
+  insertAt->fde = fde;
   ++_bufferUsed;
 #ifdef __APPLE__
   if (!_registeredForDyldUnloads) {
@@ -155,6 +182,7 @@ void DwarfFDECache<A>::removeAllIn(pint_t mh) {
     }
   }
   _bufferUsed = d;
+  __atomic_store_n(&_generation, _generation + 1, __ATOMIC_RELEASE);
   _LIBUNWIND_LOG_IF_FALSE(_lock.unlock());
 }
 
@@ -461,6 +489,7 @@ private:
 #if defined(_LIBUNWIND_SUPPORT_DWARF_UNWIND)
   bool getInfoFromDwarfSection(pint_t pc, const UnwindInfoSections &sects,
                                             uint32_t fdeSectionOffsetHint=0);
+  bool getInfoFromDynamicFDE(pint_t pc);
   int stepWithDwarfFDE() {
     return DwarfInstructions<A, R>::stepWithDwarf(_addressSpace,
                                               (pint_t)this->getReg(UNW_REG_IP),
@@ -1261,6 +1290,77 @@ bool UnwindCursor<A, R>::getInfoFromCompactEncodingSection(pint_t pc,
 #endif // defined(_LIBUNWIND_SUPPORT_COMPACT_UNWIND)
 
 
+#if defined(_LIBUNWIND_SUPPORT_DWARF_UNWIND)
+template <typename A, typename R>
+bool UnwindCursor<A, R>::getInfoFromDynamicFDE(pint_t pc) {
+  typename CFI_Parser<A>::FDE_Info fdeInfo;
+  typename CFI_Parser<A>::CIE_Info cieInfo;
+  bool foundFDE = false;
+
+#if !defined(_LIBUNWIND_HAS_NO_THREADS)
+  // Each thread caches the most recently decoded dynamic FDEs, so unwinding
+  // through the same JIT functions repeatedly doesn't need to take the FDE
+  // cache's lock, or decode the FDE and its CIE again.
+  struct DecodedFDE {
+    unsigned generation;
+    typename CFI_Parser<A>::FDE_Info fdeInfo;
+    typename CFI_Parser<A>::CIE_Info cieInfo;
+  };
+  static const size_t kNumDecodedFDEs = 8;
+  static __thread DecodedFDE decodedFDEs[kNumDecodedFDEs];
+  static __thread size_t nextDecodedFDE;
+
+  const unsigned generation = DwarfFDECache<A>::getGeneration();
+  for (size_t i = 0; i < kNumDecodedFDEs; ++i) {
+    const DecodedFDE &decoded = decodedFDEs[i];
+    if ((decoded.generation == generation) &&
+        (decoded.fdeInfo.pcStart <= pc) && (pc < decoded.fdeInfo.pcEnd)) {
+      fdeInfo = decoded.fdeInfo;
+      cieInfo = decoded.cieInfo;
+      foundFDE = true;
+      break;
+    }
+  }
+#endif
+
+  if (!foundFDE) {
+    pint_t cachedFDE = DwarfFDECache<A>::findFDE(0, pc);
+    if (cachedFDE == 0)
+      return false;
+    if (CFI_Parser<A>::decodeFDE(_addressSpace, cachedFDE, &fdeInfo,
+                                 &cieInfo) != NULL)
+      return false;
+#if !defined(_LIBUNWIND_HAS_NO_THREADS)
+    DecodedFDE &decoded = decodedFDEs[nextDecodedFDE];
+    nextDecodedFDE = (nextDecodedFDE + 1) % kNumDecodedFDEs;
+    decoded.generation = generation;
+    decoded.fdeInfo = fdeInfo;
+    decoded.cieInfo = cieInfo;
+#endif
+  }
+
+  typename CFI_Parser<A>::PrologInfo prolog;
+  if (!CFI_Parser<A>::parseFDEInstructions(_addressSpace, fdeInfo, cieInfo, pc,
+                                           &prolog))
+    return false;
+
+  // save off parsed FDE info
+  _info.start_ip         = fdeInfo.pcStart;
+  _info.end_ip           = fdeInfo.pcEnd;
+  _info.lsda             = fdeInfo.lsda;
+  _info.handler          = cieInfo.personality;
+  _info.gp               = prolog.spExtraArgSize;
+                            // Some frameless functions need SP
+                            // altered when resuming in function.
+  _info.flags            = 0;
+  _info.format           = dwarfEncoding();
+  _info.unwind_info      = fdeInfo.fdeStart;
+  _info.unwind_info_size = (uint32_t)fdeInfo.fdeLength;
+  _info.extra            = 0;
+  return true;
+}
+#endif // defined(_LIBUNWIND_SUPPORT_DWARF_UNWIND)
+
 template <typename A, typename R>
 void UnwindCursor<A, R>::setInfoBasedOnIPRegister(bool isReturnAddress) {
   pint_t pc = (pint_t)this->getReg(UNW_REG_IP);
@@ -1278,6 +1378,14 @@ void UnwindCursor<A, R>::setInfoBasedOnIPRegister(bool isReturnAddress) {
   if (isReturnAddress)
     --pc;
 
+#if defined(_LIBUNWIND_SUPPORT_DWARF_UNWIND)
+  // Look for an FDE that was dynamically registered for this pc first. JIT
+  // code isn't in any loaded image, so looking for its unwind sections would
+  // search every loaded image on each unwind step.
+  if (this->getInfoFromDynamicFDE(pc))
+    return;
+#endif
+
   // Ask address space object to find unwind sections for this pc.
   UnwindInfoSections sects;
   if (_addressSpace.findUnwindSections(pc, sects)) {
@@ -1322,36 +1430,6 @@ void UnwindCursor<A, R>::setInfoBasedOnIPRegister(bool isReturnAddress) {
   }
 
 #if defined(_LIBUNWIND_SUPPORT_DWARF_UNWIND)
-  // There is no static unwind info for this pc. Look to see if an FDE was
-  // dynamically registered for it.
-  pint_t cachedFDE = DwarfFDECache<A>::findFDE(0, pc);
-  if (cachedFDE != 0) {
-    CFI_Parser<LocalAddressSpace>::FDE_Info fdeInfo;
-    CFI_Parser<LocalAddressSpace>::CIE_Info cieInfo;
-    const char *msg = CFI_Parser<A>::decodeFDE(_addressSpace,
-                                                cachedFDE, &fdeInfo, &cieInfo);
-    if (msg == NULL) {
-      typename CFI_Parser<A>::PrologInfo prolog;
-      if (CFI_Parser<A>::parseFDEInstructions(_addressSpace, fdeInfo, cieInfo,
-                                                                pc, &prolog)) {
-        // save off parsed FDE info
-        _info.start_ip         = fdeInfo.pcStart;
-        _info.end_ip           = fdeInfo.pcEnd;
-        _info.lsda             = fdeInfo.lsda;
-        _info.handler          = cieInfo.personality;
-        _info.gp               = prolog.spExtraArgSize;
-                                  // Some frameless functions need SP
-                                  // altered when resuming in function.
-        _info.flags            = 0;
-        _info.format           = dwarfEncoding();
-        _info.unwind_info      = fdeInfo.fdeStart;
-        _info.unwind_info_size = (uint32_t)fdeInfo.fdeLength;
-        _info.extra            = 0;
-        return;
-      }
-    }
-  }
-
   // Lastly, ask AddressSpace object about platform specific ways to locate
   // other FDEs.
   pint_t fde;